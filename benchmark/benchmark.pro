@@ -0,0 +1,59 @@
+# qmake .pro file for qdirstat/benchmark
+#
+# qdirstat-benchmark: Generate synthetic directory trees and time reading
+# them, writing and reading cache files, sorting, the treemap layout and the
+# statistics, and time the primitives that are called for each item on the
+# hot paths (url(), locate(), the sorters, MimeCategorizer, ExcludeRules,
+# parsing cache lines, FileInfoSet::normalized()). The results are written
+# as one JSON object per line, so they can be compared across versions.
+#
+# This is not built by default. Build it from the project toplevel dir with
+#
+#     qmake CONFIG+=benchmark
+#     make
+#
+# or just in this directory with
+#
+#     qmake && make
+#
+# It uses the same code as QDirStat itself (libqdirstat-engine from
+# ../engine), but no QtWidgets and no X11 / Wayland display. It is not
+# installed.
+
+TEMPLATE	 = app
+
+QT		-= widgets
+QT		+= core gui network	# Like libqdirstat-engine
+CONFIG		+= console
+CONFIG		-= app_bundle
+DEFINES		+= QDIRSTAT_HEADLESS
+INCLUDEPATH	+= ../src ../engine
+DEPENDPATH	+= ../src ../engine
+MOC_DIR		 = .moc
+OBJECTS_DIR	 = .obj
+LIBS		+= -L../engine -lqdirstat-engine -lz -lrt
+
+!CONFIG(engine_shared): PRE_TARGETDEPS += ../engine/libqdirstat-engine.a
+
+# Optional: Read the RPM database directly with librpm instead of starting
+# "rpm -ql" for each package. Enable with
+#
+#     qmake CONFIG+=librpm
+
+CONFIG(librpm) {
+    CONFIG	+= link_pkgconfig
+    PKGCONFIG	+= rpm
+    DEFINES	+= HAVE_LIBRPM
+}
+
+major_is_less_5 = $$find(QT_MAJOR_VERSION, [234])
+!isEmpty(major_is_less_5):DEFINES += 'Q_DECL_OVERRIDE=""'
+
+TARGET		 = qdirstat-benchmark
+
+QMAKE_CXXFLAGS	+=  -Wno-deprecated -Wno-deprecated-declarations
+
+
+# Everything else is in libqdirstat-engine (../engine)
+
+SOURCES	  = main.cpp
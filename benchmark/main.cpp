@@ -0,0 +1,986 @@
+/*
+ *   File name: main.cpp
+ *   Summary:	qdirstat-benchmark main program
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <unistd.h>	// getopt(), getpid()
+#include <stdlib.h>	// atoi()
+#include <utime.h>	// utime()
+#include <time.h>	// time()
+#include <stdio.h>	// stdout
+#include <iostream>	// cout, cerr
+#include <algorithm>	// std::sort()
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QThread>
+
+#include "DirTree.h"
+#include "DirTreeCache.h"
+#include "CacheParser.h"
+#include "BlockGzip.h"
+#include "DirInfo.h"
+#include "FileInfo.h"
+#include "FileInfoIterator.h"
+#include "FileInfoSet.h"
+#include "FileInfoSorter.h"
+#include "MimeCategorizer.h"
+#include "ExcludeRules.h"
+#include "FileSizeStats.h"
+#include "FileAgeStats.h"
+#include "StatsEngine.h"
+#include "TreemapLayout.h"
+#include "Settings.h"
+#include "Logger.h"
+#include "Exception.h"
+#include "Version.h"
+
+
+// The treemap layout is calculated for a typical full HD treemap view
+
+#define TREEMAP_WIDTH		1920
+#define TREEMAP_HEIGHT		1080
+
+// Seed for the pseudo random file sizes and modification times, so the same
+// trees are generated on every run and on every machine
+
+#define RANDOM_SEED		4711
+
+#define SECONDS_PER_YEAR	( 365 * 24 * 3600 )
+
+// The microbenchmarks of single primitives repeat the operation over all
+// items of the tree until at least this many calls are timed, so even the
+// small trees give timings well above the timer resolution
+
+#define MICRO_MIN_CALLS		200000
+
+// Max. line length when reading back a cache file
+
+#define MAX_CACHE_LINE_LEN	8192
+
+
+using std::cout;
+using std::cerr;
+using namespace QDirStat;
+
+static const char * progName = "qdirstat-benchmark";
+
+
+/**
+ * The shapes of the synthetic trees. Each of them stresses different parts
+ * of the code: Deep trees the recursion and the per-directory overhead, wide
+ * ones the read job queue, many small files the overall per-item overhead,
+ * and a huge flat directory sorting and the treemap layout of one level.
+ **/
+static const char * treeNames[] = { "deep", "wide", "small", "flat" };
+static const int    treeCount	= sizeof( treeNames ) / sizeof( treeNames[0] );
+
+
+void usage()
+{
+    cerr << "\n"
+	 << "Usage: \n"
+	 << "\n"
+	 << "  " << progName << " [-kvh] [-b <base-dir>] [-s <scale>] [-r <repeat>] [-j <threads>]\n"
+	 << "  " << progName << "            [-t <tree>] [-o <result-file>]\n"
+	 << "\n"
+	 << "  Generate synthetic directory trees and time reading them, writing and\n"
+	 << "  reading cache files, sorting, the treemap layout and the statistics,\n"
+	 << "  and the primitives that are called for each item on the hot paths.\n"
+	 << "  The results are written as one JSON object per line.\n"
+	 << "\n"
+	 << "  -b dir	create the trees below this directory (default: /dev/shm, i.e.\n"
+	 << "		tmpfs where available, so only the CPU time is measured)\n"
+	 << "  -s n	scale factor for the number of items in each tree (default: 1)\n"
+	 << "  -r n	repeat each benchmark n times (default: 5)\n"
+	 << "  -j n	use n threads for reading directories (default: 1)\n"
+	 << "  -t tree	only this tree: deep, wide, small or flat (default: all)\n"
+	 << "  -o file	append the results to this file instead of stdout\n"
+	 << "  -k	keep the generated trees\n"
+	 << "  -v	verbose\n"
+	 << "  -h	help (this usage message)\n"
+	 << "\n"
+	 << std::endl;
+}
+
+
+/**
+ * Simple linear congruential generator. Unlike qrand(), this gives the same
+ * sequence on all platforms.
+ **/
+class Random
+{
+public:
+
+    Random(): _state( RANDOM_SEED ) {}
+
+    quint32 next()
+    {
+	_state = _state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (quint32) ( _state >> 33 );
+    }
+
+    quint32 next( quint32 limit ) { return next() % limit; }
+
+private:
+
+    quint64 _state;
+};
+
+
+/**
+ * Generator for the synthetic trees.
+ **/
+class TreeGenerator
+{
+public:
+
+    TreeGenerator( int scale ):
+	_scale( scale ),
+	_now( time( 0 ) ),
+	_items( 0 )
+	{}
+
+    /**
+     * Create tree 'name' in directory 'path'. Return 'true' on success.
+     **/
+    bool create( const QString & name, const QString & path );
+
+    /**
+     * Return the number of files and directories created so far.
+     **/
+    qint64 items() const { return _items; }
+
+protected:
+
+    bool createDir  ( const QString & path );
+    bool createFiles( const QString & path, int count );
+    bool createTree ( const QString & path, int fanout, int depth, int files );
+
+    int	    _scale;
+    time_t  _now;
+    qint64  _items;
+    Random  _random;
+};
+
+
+bool TreeGenerator::create( const QString & name, const QString & path )
+{
+    if ( ! createDir( path ) )
+	return false;
+
+    if ( name == "deep" )
+    {
+	// 10 chains of 100 nested directories with 5 files each
+
+	for ( int chain = 0; chain < 10 * _scale; ++chain )
+	{
+	    QString dir = path + QString( "/chain-%1" ).arg( chain );
+
+	    for ( int depth = 0; depth < 100; ++depth )
+	    {
+		if ( depth > 0 )
+		    dir += QString( "/d%1" ).arg( depth );
+
+		if ( ! createDir( dir ) || ! createFiles( dir, 5 ) )
+		    return false;
+	    }
+	}
+
+	return true;
+    }
+
+    if ( name == "wide" )	// 1000 directories with 10 files each
+    {
+	for ( int i = 0; i < 1000 * _scale; ++i )
+	{
+	    QString dir = path + QString( "/dir-%1" ).arg( i );
+
+	    if ( ! createDir( dir ) || ! createFiles( dir, 10 ) )
+		return false;
+	}
+
+	return true;
+    }
+
+    if ( name == "small" )	// 1555 directories with 20 files each
+	return createTree( path, 6, 4, 20 * _scale );
+
+    if ( name == "flat" )	// One directory with 50000 files
+	return createFiles( path, 50000 * _scale );
+
+    cerr << progName << ": Unknown tree " << qPrintable( name ) << std::endl;
+
+    return false;
+}
+
+
+bool TreeGenerator::createTree( const QString & path, int fanout, int depth, int files )
+{
+    if ( ! createFiles( path, files ) )
+	return false;
+
+    if ( depth <= 0 )
+	return true;
+
+    for ( int i = 0; i < fanout; ++i )
+    {
+	QString dir = path + QString( "/sub-%1" ).arg( i );
+
+	if ( ! createDir( dir ) || ! createTree( dir, fanout, depth - 1, files ) )
+	    return false;
+    }
+
+    return true;
+}
+
+
+bool TreeGenerator::createDir( const QString & path )
+{
+    if ( ! QDir().mkpath( path ) )
+    {
+	cerr << progName << ": Can't create " << qPrintable( path ) << std::endl;
+	return false;
+    }
+
+    ++_items;
+
+    return true;
+}
+
+
+bool TreeGenerator::createFiles( const QString & path, int count )
+{
+    for ( int i = 0; i < count; ++i )
+    {
+	QString name = path + QString( "/file-%1.%2" ).arg( i )
+	    .arg( i % 3 == 0 ? "txt" : i % 3 == 1 ? "jpg" : "o" );
+	QFile file( name );
+
+	// Mostly small files, some larger ones, very few large ones. The files
+	// are sparse, so this does not fill up the filesystem.
+
+	quint32 sizeClass = _random.next( 100 );
+	qint64	size	  = sizeClass < 80 ? _random.next( 16 * 1024 )	     :
+			    sizeClass < 98 ? _random.next( 4 * 1024 * 1024 ) :
+			    (qint64) _random.next( 1024 ) * 1024 * 1024;
+
+	if ( ! file.open( QIODevice::WriteOnly ) || ! file.resize( size ) )
+	{
+	    cerr << progName << ": Can't create " << qPrintable( name ) << std::endl;
+	    return false;
+	}
+
+	file.close();
+
+	// Spread the modification times over the last 10 years
+
+	struct utimbuf times;
+	times.actime  = _now;
+	times.modtime = _now - _random.next( 10 * SECONDS_PER_YEAR );
+	utime( QFile::encodeName( name ).constData(), &times );
+
+	++_items;
+    }
+
+    return true;
+}
+
+
+/**
+ * Timing results of one benchmark.
+ **/
+class BenchmarkResult
+{
+public:
+
+    BenchmarkResult( const QString & tree, const QString & benchmark ):
+	_tree( tree ),
+	_benchmark( benchmark ),
+	_items( 0 )
+	{}
+
+    void addTime( qint64 nanosec ) { _nanosec << nanosec; }
+    void setItems( qint64 items )  { _items = items; }
+
+    /**
+     * Return the results as a JSON document in one line.
+     **/
+    QByteArray toJson( const QJsonObject & environment ) const;
+
+protected:
+
+    QString	    _tree;
+    QString	    _benchmark;
+    qint64	    _items;
+    QList<qint64>   _nanosec;
+};
+
+
+QByteArray BenchmarkResult::toJson( const QJsonObject & environment ) const
+{
+    QList<qint64> sorted = _nanosec;
+    std::sort( sorted.begin(), sorted.end() );
+
+    QJsonObject json = environment;
+    QJsonArray	runs;
+
+    foreach ( qint64 nanosec, _nanosec )
+	runs.append( nanosec / 1000000.0 );
+
+    json[ "tree"	   ] = _tree;
+    json[ "benchmark"	   ] = _benchmark;
+    json[ "items"	   ] = (double) _items;
+    json[ "minMillisec"	   ] = sorted.isEmpty() ? 0.0 : sorted.first() / 1000000.0;
+    json[ "medianMillisec" ] = sorted.isEmpty() ? 0.0 : sorted.at( sorted.size() / 2 ) / 1000000.0;
+    json[ "minNanosecPerItem" ] = sorted.isEmpty() || _items <= 0 ?
+	0.0 : (double) sorted.first() / _items;
+    json[ "runsMillisec"   ] = runs;
+
+    return QJsonDocument( json ).toJson( QJsonDocument::Compact );
+}
+
+
+/**
+ * Wait until 'tree' has finished reading.
+ **/
+static void waitForTree( DirTree * tree )
+{
+    QEventLoop eventLoop;
+
+    QObject::connect( tree,	  SIGNAL( finished() ),
+		      &eventLoop, SLOT	( quit()     ) );
+
+    QObject::connect( tree,	  SIGNAL( aborted()  ),
+		      &eventLoop, SLOT	( quit()     ) );
+
+    if ( tree->isBusy() )	// Not finished right away?
+	eventLoop.exec();
+}
+
+
+/**
+ * Create a new DirTree and read 'dir' with 'threads' scanner threads.
+ **/
+static DirTree * readTree( const QString & dir, int threads )
+{
+    DirTree * tree = new DirTree();
+    CHECK_NEW( tree );
+
+    tree->setCrossFilesystems( false );
+    tree->setUseCacheFiles( false );
+    tree->setScanThreads( threads > 1 ? threads : 0 );
+    tree->startReading( dir );
+    waitForTree( tree );
+
+    return tree;
+}
+
+
+/**
+ * Sort the children of 'dir' and of all directories below it like the tree
+ * view does.
+ **/
+static void sortRecursive( DirInfo *	 dir,
+			   DataColumn	 sortCol   = SizeCol,
+			   Qt::SortOrder sortOrder = Qt::DescendingOrder )
+{
+    const FileInfoList & children = dir->sortedChildren( sortCol, sortOrder );
+
+    foreach ( FileInfo * child, children )
+    {
+	if ( child->isDirInfo() )
+	    sortRecursive( child->toDirInfo(), sortCol, sortOrder );
+    }
+}
+
+
+/**
+ * Append all items below 'dir' to 'items', including the dot entries.
+ **/
+static void collectItems( DirInfo * dir, FileInfoList & items )
+{
+    for ( FileInfoIterator it( dir ); *it; ++it )
+    {
+	items << *it;
+
+	if ( (*it)->isDirInfo() )
+	    collectItems( (*it)->toDirInfo(), items );
+    }
+}
+
+
+/**
+ * Return the directory with the most direct children below 'dir'.
+ **/
+static DirInfo * largestDir( DirInfo * dir )
+{
+    DirInfo * largest = dir;
+
+    for ( FileInfoIterator it( dir ); *it; ++it )
+    {
+	if ( (*it)->isDirInfo() )
+	{
+	    DirInfo * sub = largestDir( (*it)->toDirInfo() );
+
+	    if ( sub->directChildrenCount() > largest->directChildrenCount() )
+		largest = sub;
+	}
+    }
+
+    return largest;
+}
+
+
+/**
+ * Read the text of the (compressed) cache file 'fileName'.
+ **/
+static QByteArray readCacheText( const QString & fileName )
+{
+    QByteArray	    text;
+    BlockGzipReader reader( fileName );
+    char	    line[ MAX_CACHE_LINE_LEN ];
+
+    while ( reader.ok() && reader.gets( line, sizeof( line ) ) )
+	text += line;
+
+    return text;
+}
+
+
+/**
+ * Drop the cached statistics in 'dir' and in all directories below it so
+ * the StatsEngine really traverses the tree.
+ **/
+static void dropStatsCacheRecursive( DirInfo * dir )
+{
+    dir->dropStatsCache();
+
+    for ( FileInfoIterator it( dir ); *it; ++it )
+    {
+	if ( (*it)->isDirInfo() )
+	    dropStatsCacheRecursive( (*it)->toDirInfo() );
+    }
+}
+
+
+/**
+ * Return how often a loop over 'count' items has to be repeated for at least
+ * MICRO_MIN_CALLS calls.
+ **/
+static int microRounds( int count )
+{
+    return count > 0 ? qMax( 1, ( MICRO_MIN_CALLS + count - 1 ) / count ) : 0;
+}
+
+
+/**
+ * Time the primitives that are called for each item on the hot paths one by
+ * one on the already read 'tree' and append the results to 'results'. The
+ * items of these results are the number of calls, so minNanosecPerItem is
+ * the time for one call.
+ *
+ * 'cacheFileName' is the cache file written for the tree before.
+ **/
+static void runMicroBenchmarks( const QString &		 name,
+				DirTree *		 tree,
+				const QString &		 cacheFileName,
+				int			 repeat,
+				QList<BenchmarkResult> & results )
+{
+    QElapsedTimer timer;
+    DirInfo *	  topDir = tree->firstToplevel()->toDirInfo();
+    FileInfoList  items;
+
+    items << topDir;
+    collectItems( topDir, items );
+
+    int rounds = microRounds( items.size() );
+
+    // FileInfo::url()
+
+    QStringList urls;
+    QStringList names;
+
+    foreach ( FileInfo * item, items )
+    {
+	urls  << item->url();
+	names << item->name();
+    }
+
+    BenchmarkResult url( name, "url" );
+    url.setItems( (qint64) rounds * items.size() );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	int len = 0;
+	timer.start();
+
+	for ( int round = 0; round < rounds; ++round )
+	{
+	    foreach ( FileInfo * item, items )
+		len += item->url().size();
+	}
+
+	url.addTime( timer.nsecsElapsed() );
+
+	if ( len == 0 )		// Don't let the compiler optimize the loop away
+	    cerr << progName << ": No URLs" << std::endl;
+    }
+
+    results << url;
+
+    // DirTree::locate() and FileInfo::locate() for the URL of each item
+
+    BenchmarkResult locate( name, "locate" );
+    locate.setItems( (qint64) rounds * urls.size() );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	int notFound = 0;
+	timer.start();
+
+	for ( int round = 0; round < rounds; ++round )
+	{
+	    foreach ( const QString & itemUrl, urls )
+	    {
+		if ( ! tree->locate( itemUrl, true ) )	// findPseudoDirs
+		    ++notFound;
+	    }
+	}
+
+	locate.addTime( timer.nsecsElapsed() );
+
+	if ( notFound > 0 )
+	    cerr << progName << ": locate() did not find " << notFound << " items" << std::endl;
+    }
+
+    results << locate;
+
+    // DirInfo::sortedChildren() for the other columns of the tree view;
+    // the "sortedChildren" benchmark is the one for SizeCol.
+
+    DataColumn sortCols[] = { NameCol, TotalItemsCol, LatestMTimeCol, UserCol };
+
+    for ( size_t col = 0; col < sizeof( sortCols ) / sizeof( sortCols[0] ); ++col )
+    {
+	BenchmarkResult sort( name, "sortedChildren:" + DataColumns::toString( sortCols[ col ] ) );
+	sort.setItems( items.size() );
+
+	for ( int i = 0; i < repeat; ++i )
+	{
+	    topDir->dropSortCache( true );	// recursive
+	    timer.start();
+	    sortRecursive( topDir, sortCols[ col ], Qt::AscendingOrder );
+	    sort.addTime( timer.nsecsElapsed() );
+	}
+
+	results << sort;
+    }
+
+    // FileInfoSorter as a plain comparison for std::stable_sort() on the
+    // largest directory, i.e. without the sort keys of sortedChildren()
+
+    DirInfo *	 dir = largestDir( topDir );
+    FileInfoList children;
+
+    for ( FileInfoIterator it( dir ); *it; ++it )
+	children << *it;
+
+    BenchmarkResult sorter( name, "fileInfoSorter" );
+    sorter.setItems( children.size() );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	FileInfoList unsorted = children;
+
+	timer.start();
+	std::stable_sort( unsorted.begin(), unsorted.end(),
+			  FileInfoSorter( SizeCol, Qt::DescendingOrder ) );
+	sorter.addTime( timer.nsecsElapsed() );
+    }
+
+    results << sorter;
+
+    // MimeCategorizer::category() by name; the one for a FileInfo caches
+    // the result in the item after the first call.
+
+    MimeCategorizer * categorizer = MimeCategorizer::instance();
+    BenchmarkResult   category( name, "mimeCategory" );
+    category.setItems( (qint64) rounds * names.size() );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	timer.start();
+
+	for ( int round = 0; round < rounds; ++round )
+	{
+	    foreach ( const QString & itemName, names )
+		categorizer->category( itemName );
+	}
+
+	category.addTime( timer.nsecsElapsed() );
+    }
+
+    results << category;
+
+    // ExcludeRules::match() with typical rules that don't match anything
+    // in the synthetic trees, so every rule is checked for each item
+
+    ExcludeRules excludeRules;
+    excludeRules.add( new ExcludeRule( QRegExp( "*.bak", Qt::CaseSensitive, QRegExp::Wildcard ) ) );
+    excludeRules.add( new ExcludeRule( QRegExp( "lost+found", Qt::CaseSensitive, QRegExp::FixedString ) ) );
+    excludeRules.add( new ExcludeRule( QRegExp( ".*/\\.git$" ), true ) );	// useFullPath
+    excludeRules.add( new ExcludeRule( QRegExp( "*/.cache/*", Qt::CaseSensitive, QRegExp::Wildcard ), true ) );
+
+    BenchmarkResult exclude( name, "excludeRules" );
+    exclude.setItems( (qint64) rounds * urls.size() );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	int excluded = 0;
+	timer.start();
+
+	for ( int round = 0; round < rounds; ++round )
+	{
+	    for ( int item = 0; item < urls.size(); ++item )
+	    {
+		if ( excludeRules.match( urls.at( item ), names.at( item ) ) )
+		    ++excluded;
+	    }
+	}
+
+	exclude.addTime( timer.nsecsElapsed() );
+
+	if ( excluded > 0 )
+	    cerr << progName << ": Exclude rules matched " << excluded << " items" << std::endl;
+    }
+
+    results << exclude;
+
+    // CacheLineParser: Splitting and parsing the lines of a cache file
+    // without the decompression and without building the tree
+
+    QByteArray cacheText = readCacheText( cacheFileName );
+    BenchmarkResult cacheParse( name, "cacheParseLines" );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	CacheLineParser parser( true );	// withUidGidPerm
+	CacheItemBatch	batch;
+
+	timer.start();
+	int lines = parser.parseLines( cacheText, batch );
+	cacheParse.addTime( timer.nsecsElapsed() );
+	cacheParse.setItems( lines );
+    }
+
+    results << cacheParse;
+
+    // FileInfoSet::normalized() for a selection of all items, i.e. the
+    // worst case of selecting everything in the tree view
+
+    FileInfoSet selection;
+
+    foreach ( FileInfo * item, items )
+	selection << item;
+
+    BenchmarkResult normalized( name, "normalized" );
+    normalized.setItems( selection.size() );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	timer.start();
+	FileInfoSet result = selection.normalized();
+	normalized.addTime( timer.nsecsElapsed() );
+
+	if ( result.size() != 1 )
+	    cerr << progName << ": normalized() left " << result.size() << " items" << std::endl;
+    }
+
+    results << normalized;
+}
+
+
+/**
+ * Run all benchmarks for the tree in 'dir' and return the results.
+ **/
+static QList<BenchmarkResult> runBenchmarks( const QString & name,
+					     const QString & dir,
+					     const QString & cacheFileName,
+					     int	     threads,
+					     int	     repeat,
+					     bool	     verbose )
+{
+    QList<BenchmarkResult> results;
+    QElapsedTimer	   timer;
+
+    // Reading the tree from disk
+
+    BenchmarkResult scan( name, "scan" );
+    DirTree * tree = 0;
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	delete tree;
+	timer.start();
+	tree = readTree( dir, threads );
+	scan.addTime( timer.nsecsElapsed() );
+    }
+
+    FileInfo * toplevel = tree ? tree->firstToplevel() : 0;
+
+    if ( ! toplevel || ! toplevel->isDirInfo() )
+    {
+	cerr << progName << ": Can't read " << qPrintable( dir ) << std::endl;
+	delete tree;
+
+	return results;
+    }
+
+    qint64 items = toplevel->totalItems() + 1;
+    scan.setItems( items );
+    results << scan;
+
+    if ( verbose )
+	cout << "Read " << items << " items from " << qPrintable( dir ) << std::endl;
+
+    // Writing a cache file
+
+    BenchmarkResult cacheWrite( name, "cacheWrite" );
+    cacheWrite.setItems( items );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	timer.start();
+	CacheWriter writer( cacheFileName, tree );
+	cacheWrite.addTime( timer.nsecsElapsed() );
+
+	if ( ! writer.ok() )
+	    cerr << progName << ": Error writing " << qPrintable( cacheFileName ) << std::endl;
+    }
+
+    results << cacheWrite;
+
+    // Reading that cache file
+
+    BenchmarkResult cacheRead( name, "cacheRead" );
+    cacheRead.setItems( items );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	DirTree * cacheTree = new DirTree();
+	CHECK_NEW( cacheTree );
+
+	timer.start();
+
+	if ( cacheTree->readCache( cacheFileName ) )
+	    waitForTree( cacheTree );
+
+	cacheRead.addTime( timer.nsecsElapsed() );
+	delete cacheTree;
+    }
+
+    results << cacheRead;
+
+    // Sorting the children of all directories
+
+    DirInfo * topDir = toplevel->toDirInfo();
+    BenchmarkResult sort( name, "sortedChildren" );
+    sort.setItems( items );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	topDir->dropSortCache( true );	// recursive
+	timer.start();
+	sortRecursive( topDir );
+	sort.addTime( timer.nsecsElapsed() );
+    }
+
+    results << sort;
+
+    // Treemap layout
+
+    BenchmarkResult treemap( name, "treemapLayout" );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	TreemapLayout layout;
+
+	timer.start();
+	layout.layout( toplevel, QRectF( 0, 0, TREEMAP_WIDTH, TREEMAP_HEIGHT ) );
+	treemap.addTime( timer.nsecsElapsed() );
+	treemap.setItems( layout.size() );
+    }
+
+    results << treemap;
+
+    // File size and file age statistics
+
+    BenchmarkResult stats( name, "stats" );
+    stats.setItems( items );
+
+    for ( int i = 0; i < repeat; ++i )
+    {
+	FileSizeStats sizeStats;
+	FileAgeStats  ageStats;
+	StatsEngine   engine;
+
+	engine.addCollector( &sizeStats );
+	engine.addCollector( &ageStats );
+	dropStatsCacheRecursive( topDir );
+
+	timer.start();
+	engine.collect( toplevel );
+	stats.addTime( timer.nsecsElapsed() );
+    }
+
+    results << stats;
+
+    // The primitives on the hot paths
+
+    runMicroBenchmarks( name, tree, cacheFileName, repeat, results );
+
+    delete tree;
+    QFile::remove( cacheFileName );
+
+    return results;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    QString baseDir	= "/dev/shm";
+    QString onlyTree;
+    QString resultFileName;
+    int	    scale	= 1;
+    int	    repeat	= 5;
+    int	    threads	= 1;
+    bool    keep	= false;
+    bool    verbose	= false;
+    int	    opt;
+
+    while ( ( opt = getopt( argc, argv, "b:s:r:j:t:o:kvh" ) ) != -1 )
+    {
+	switch ( opt )
+	{
+	    case 'b': baseDir	     = QString::fromLocal8Bit( optarg ); break;
+	    case 's': scale	     = qMax( 1, atoi( optarg ) );	 break;
+	    case 'r': repeat	     = qMax( 1, atoi( optarg ) );	 break;
+	    case 'j': threads	     = atoi( optarg );			 break;
+	    case 't': onlyTree	     = QString::fromLocal8Bit( optarg ); break;
+	    case 'o': resultFileName = QString::fromLocal8Bit( optarg ); break;
+	    case 'k': keep	     = true;				 break;
+	    case 'v': verbose	     = true;				 break;
+
+	    case 'h':
+		usage();
+		return 0;
+
+	    default:
+		usage();
+		return 1;
+	}
+    }
+
+    if ( optind < argc )
+    {
+	usage();
+	return 1;
+    }
+
+    Logger logger( "/tmp/qdirstat-$USER", "qdirstat-benchmark.log" );
+    logger.setLogLevel( LogSeverityWarning );
+
+    // Use separate settings so the user's exclude rules don't change the
+    // results
+    QCoreApplication::setOrganizationName( "QDirStat" );
+    QCoreApplication::setApplicationName ( "QDirStat-Benchmark" );
+
+    QCoreApplication qtApp( argc, argv );
+
+    if ( ! QFileInfo( baseDir ).isWritable() )
+	baseDir = QDir::tempPath();
+
+    QString workDir = QString( "%1/qdirstat-benchmark-%2" ).arg( baseDir ).arg( getpid() );
+
+    QJsonObject environment;
+    environment[ "version"   ] = QDIRSTAT_VERSION;
+    environment[ "qt"	     ] = qVersion();
+    environment[ "cpus"	     ] = QThread::idealThreadCount();
+    environment[ "threads"   ] = threads;
+    environment[ "scale"     ] = scale;
+    environment[ "timestamp" ] = QDateTime::currentDateTime().toString( Qt::ISODate );
+
+    QFile resultFile;
+
+    if ( resultFileName.isEmpty() )
+	resultFile.open( stdout, QIODevice::WriteOnly );
+    else
+	resultFile.setFileName( resultFileName );
+
+    if ( ! resultFile.isOpen() && ! resultFile.open( QIODevice::WriteOnly | QIODevice::Append ) )
+    {
+	cerr << progName << ": Can't open " << qPrintable( resultFileName ) << std::endl;
+	return 1;
+    }
+
+    bool ok = true;
+
+    for ( int i = 0; i < treeCount && ok; ++i )
+    {
+	QString name = treeNames[ i ];
+
+	if ( ! onlyTree.isEmpty() && name != onlyTree )
+	    continue;
+
+	QString dir = workDir + "/" + name;
+	TreeGenerator generator( scale );
+
+	if ( verbose )
+	    cout << "Generating " << qPrintable( dir ) << std::endl;
+
+	ok = generator.create( name, dir );
+
+	if ( ok )
+	{
+	    QList<BenchmarkResult> results =
+		runBenchmarks( name, dir, workDir + "/" + name + ".cache.gz",
+			       threads, repeat, verbose );
+
+	    ok = ! results.isEmpty();
+
+	    foreach ( const BenchmarkResult & result, results )
+	    {
+		resultFile.write( result.toJson( environment ) );
+		resultFile.write( "\n" );
+	    }
+
+	    resultFile.flush();
+	}
+
+	if ( ! keep )
+	    QDir( dir ).removeRecursively();
+    }
+
+    if ( ! keep )
+	QDir( workDir ).removeRecursively();
+
+    // If running with 'sudo', don't leave any config files behind that are
+    // owned by root.
+    Settings::fixFileOwners();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+# qmake .pro file for qdirstat/cache-writer
+#
+# qdirstat-cache-writer: Scan a directory tree and write a QDirStat cache file
+# without any GUI, e.g. from a cron job.
+#
+# This uses the same directory reading and cache writing code as QDirStat
+# itself (libqdirstat-engine from ../engine), but no QtWidgets and no X11 /
+# Wayland display.
+
+TEMPLATE	 = app
+
+QT		-= widgets
+QT		+= core gui network	# Like libqdirstat-engine
+CONFIG		+= console
+CONFIG		-= app_bundle
+DEFINES		+= QDIRSTAT_HEADLESS
+INCLUDEPATH	+= ../src ../engine
+DEPENDPATH	+= ../src ../engine
+MOC_DIR		 = .moc
+OBJECTS_DIR	 = .obj
+LIBS		+= -L../engine -lqdirstat-engine -lz -lrt
+
+!CONFIG(engine_shared): PRE_TARGETDEPS += ../engine/libqdirstat-engine.a
+
+# Optional: Read the RPM database directly with librpm instead of starting
+# "rpm -ql" for each package. Enable with
+#
+#     qmake CONFIG+=librpm
+
+CONFIG(librpm) {
+    CONFIG	+= link_pkgconfig
+    PKGCONFIG	+= rpm
+    DEFINES	+= HAVE_LIBRPM
+}
+
+major_is_less_5 = $$find(QT_MAJOR_VERSION, [234])
+!isEmpty(major_is_less_5):DEFINES += 'Q_DECL_OVERRIDE=""'
+isEmpty(INSTALL_PREFIX):INSTALL_PREFIX = /usr
+
+TARGET		 = qdirstat-cache-writer
+TARGET.files	 = qdirstat-cache-writer
+TARGET.path	 = $$INSTALL_PREFIX/bin
+INSTALLS	+= TARGET
+
+QMAKE_CXXFLAGS	+=  -Wno-deprecated -Wno-deprecated-declarations
+
+
+# Everything else is in libqdirstat-engine (../engine)
+
+SOURCES	  = main.cpp
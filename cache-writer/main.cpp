@@ -0,0 +1,186 @@
+/*
+ *   File name: main.cpp
+ *   Summary:	qdirstat-cache-writer main program
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <unistd.h>	// getopt()
+#include <stdlib.h>	// atoi()
+#include <iostream>	// cout, cerr
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QThread>
+
+#include "DirTree.h"
+#include "DirScanner.h"
+#include "DirTreeCache.h"
+#include "BinaryCache.h"
+#include "FileInfo.h"
+#include "Settings.h"
+#include "Logger.h"
+#include "Exception.h"
+#include "Version.h"
+
+
+using std::cout;
+using std::cerr;
+using namespace QDirStat;
+
+static const char * progName = "qdirstat-cache-writer";
+
+
+void usage()
+{
+    cerr << "\n"
+	 << "Usage: \n"
+	 << "\n"
+	 << "  " << progName << " [-l12muvdh] [-j <threads>] <directory> [<cache-file-name>]\n"
+	 << "\n"
+	 << "  If not specified, <cache-file-name> defaults to \"" << DEFAULT_CACHE_NAME << "\"\n"
+	 << "  in <directory>. The cache file is always gzip-compressed unless its name\n"
+	 << "  ends with \"" << BINARY_CACHE_SUFFIX << "\"; then it is written in the binary cache format.\n"
+	 << "\n"
+	 << "  -l	long format - always add full path, even for plain files\n"
+	 << "  -1	file format 1.0 without UID/GID/permissions\n"
+	 << "  -2	(default) file format 2.0 with UID/GID/permissions\n"
+	 << "  -m	scan mounted filesystems (cross filesystem boundaries)\n"
+	 << "  -j n	use n threads for reading directories (default: one per CPU)\n"
+	 << "  -u	use io_uring for the stat calls (Linux 5.6 and later)\n"
+	 << "  -v	verbose\n"
+	 << "  -d	debug\n"
+	 << "  -h	help (this usage message)\n"
+	 << "\n"
+	 << "See also   man qdirstat-cache-writer"
+	 << "\n"
+	 << std::endl;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    bool longFormat	= false;
+    bool withUidGidPerm = true;
+    bool scanMounted	= false;
+    bool useIoUring	= false;
+    bool verbose	= false;
+    bool debug		= false;
+    int	 threads	= QThread::idealThreadCount();
+    int	 opt;
+
+    while ( ( opt = getopt( argc, argv, "l12mj:uvdh" ) ) != -1 )
+    {
+	switch ( opt )
+	{
+	    case 'l': longFormat     = true;		break;
+	    case '1': withUidGidPerm = false;		break;
+	    case '2': withUidGidPerm = true;		break;
+	    case 'm': scanMounted    = true;		break;
+	    case 'j': threads	     = atoi( optarg );	break;
+	    case 'u': useIoUring     = true;		break;
+	    case 'v': verbose	     = true;		break;
+	    case 'd': debug	     = true;		break;
+
+	    case 'h':
+		usage();
+		return 0;
+
+	    default:
+		usage();
+		return 1;
+	}
+    }
+
+    // One or two parameters are required
+
+    if ( optind >= argc || argc - optind > 2 )
+    {
+	usage();
+	return 1;
+    }
+
+    Logger logger( "/tmp/qdirstat-$USER", "qdirstat-cache-writer.log" );
+    logger.setLogLevel( debug ? LogSeverityVerbose : LogSeverityInfo );
+    logInfo() << progName << " " << QDIRSTAT_VERSION
+	      << " built with Qt " << QT_VERSION_STR
+	      << endl;
+
+    // Set org/app name for QSettings (exclude rules etc.)
+    QCoreApplication::setOrganizationName( "QDirStat" );
+    QCoreApplication::setApplicationName ( "QDirStat" );
+
+    QCoreApplication qtApp( argc, argv );
+
+    QString dir = QFileInfo( QString::fromLocal8Bit( argv[ optind ] ) ).absoluteFilePath();
+    QString cacheFileName = argc - optind > 1 ?
+	QString::fromLocal8Bit( argv[ optind + 1 ] ) :
+	dir + "/" + DEFAULT_CACHE_NAME;
+
+    DirTree * tree = new DirTree();
+    CHECK_NEW( tree );
+
+    tree->setCrossFilesystems( scanMounted );
+    tree->setUseCacheFiles( false );	// Always read everything from disk
+    tree->setScanThreads( threads > 1 ? threads : 0 );
+    DirScanner::setUseStatRing( useIoUring );
+
+    QObject::connect( tree,	SIGNAL( finished() ),
+		      &qtApp,	SLOT  ( quit()	   ) );
+
+    QObject::connect( tree,	SIGNAL( aborted()  ),
+		      &qtApp,	SLOT  ( quit()	   ) );
+
+    if ( verbose )
+	cout << "Reading " << qPrintable( dir ) << std::endl;
+
+    QElapsedTimer timer;
+    timer.start();
+    tree->startReading( dir );
+
+    if ( tree->isBusy() )	// Not finished right away?
+	qtApp.exec();
+
+    FileInfo * toplevel = tree->firstToplevel();
+    bool ok = false;
+
+    if ( ! toplevel || ! toplevel->isDirInfo() )
+    {
+	cerr << progName << ": Can't read " << qPrintable( dir ) << std::endl;
+    }
+    else
+    {
+	if ( verbose )
+	{
+	    cout << "Read " << toplevel->totalItems() << " items in "
+		 << timer.elapsed() / 1000.0 << " sec" << std::endl;
+	    cout << "Writing " << qPrintable( cacheFileName ) << std::endl;
+	}
+
+	if ( cacheFileName.endsWith( BINARY_CACHE_SUFFIX ) )
+	{
+	    ok = tree->writeCache( cacheFileName );
+	}
+	else
+	{
+	    CacheWriter writer( cacheFileName, tree, longFormat, withUidGidPerm );
+	    ok = writer.ok();
+	}
+
+	if ( ! ok )
+	    cerr << progName << ": Error writing " << qPrintable( cacheFileName ) << std::endl;
+	else if ( verbose )
+	    cout << "Done after " << timer.elapsed() / 1000.0 << " sec" << std::endl;
+    }
+
+    delete tree;
+
+    // If running with 'sudo', don't leave any config files behind that are
+    // owned by root.
+    Settings::fixFileOwners();
+
+    return ok ? 0 : 1;
+}
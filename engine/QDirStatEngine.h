@@ -0,0 +1,56 @@
+/*
+ *   File name: QDirStatEngine.h
+ *   Summary:	Public headers of the QDirStat engine library
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef QDirStatEngine_h
+#define QDirStatEngine_h
+
+/**
+ * The API of libqdirstat-engine: Reading directory trees, reading and
+ * writing cache files, and the statistics over a tree, without any
+ * widgets. This needs a QCoreApplication with an event loop, but no
+ * display.
+ *
+ * Example:
+ *
+ *     QDirStat::DirTree tree;
+ *     QObject::connect( &tree, SIGNAL( finished() ), &app, SLOT( quit() ) );
+ *     tree.startReading( "/var" );
+ *     app.exec();
+ *
+ *     QDirStat::FileSizeStats stats( tree.firstToplevel() );
+ *
+ * Only what is included here is meant to be used from outside. Anything
+ * that is not compatible with that any more increases
+ * QDIRSTAT_ENGINE_API_VERSION.
+ **/
+
+#define QDIRSTAT_ENGINE_API_VERSION	1
+
+#include "Version.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "DotEntry.h"
+#include "FileInfo.h"
+#include "FileInfoIterator.h"
+#include "DirReadJob.h"
+#include "DirTreeCache.h"
+#include "CacheSummary.h"
+#include "BinaryCache.h"
+#include "ExcludeRules.h"
+#include "ScanStats.h"
+#include "OwnerStats.h"
+#include "StatsEngine.h"
+#include "FileSizeStats.h"
+#include "FileAgeStats.h"
+#include "FileTypeStats.h"
+#include "MimeCategorizer.h"
+#include "Logger.h"
+#include "Exception.h"
+
+#endif	// QDirStatEngine_h
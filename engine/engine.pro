@@ -0,0 +1,236 @@
+# qmake .pro file for qdirstat/engine
+#
+# libqdirstat-engine: The directory reading, cache and statistics code of
+# QDirStat (DirTree, DirReadJob, DirTreeCache, FileSizeStats, FileTypeStats,
+# MimeCategorizer etc.) as a library without any widgets. It is used by the
+# command line tools (cache-writer, benchmark), and it can be embedded in
+# other programs that run without an X11 / Wayland display.
+#
+# This is a static library by default. Build a shared one with
+#
+#     qmake CONFIG+=engine_shared
+#
+# Install the library and its headers (to $INSTALL_PREFIX/lib and
+# $INSTALL_PREFIX/include/qdirstat) with
+#
+#     qmake CONFIG+=engine_install
+#
+# The headers are in ../src; QDirStatEngine.h includes the most important
+# ones.
+#
+# QDirStat itself (../src) still compiles these sources on its own: A few of
+# them (SettingsHelpers, RpmPkgManager) have some extra code for widgets.
+
+TEMPLATE	 = lib
+
+QT		-= widgets
+QT		+= core gui network	# QColor in MimeCategory; no display needed
+DEFINES		+= QDIRSTAT_HEADLESS
+INCLUDEPATH	+= ../src
+DEPENDPATH	+= ../src
+MOC_DIR		 = .moc
+OBJECTS_DIR	 = .obj
+LIBS		+= -lz -lrt
+
+CONFIG(engine_shared) {
+    VERSION	 = 1.0.0
+} else {
+    CONFIG	+= staticlib
+}
+
+# Optional: Read the RPM database directly with librpm instead of starting
+# "rpm -ql" for each package. Enable with
+#
+#     qmake CONFIG+=librpm
+
+CONFIG(librpm) {
+    CONFIG	+= link_pkgconfig
+    PKGCONFIG	+= rpm
+    DEFINES	+= HAVE_LIBRPM
+}
+
+major_is_less_5 = $$find(QT_MAJOR_VERSION, [234])
+!isEmpty(major_is_less_5):DEFINES += 'Q_DECL_OVERRIDE=""'
+isEmpty(INSTALL_PREFIX):INSTALL_PREFIX = /usr
+
+TARGET		 = qdirstat-engine
+
+QMAKE_CXXFLAGS	+=  -Wno-deprecated -Wno-deprecated-declarations
+
+
+SOURCES	  = ../src/AsyncCommand.cpp		\
+	    ../src/Attic.cpp			\
+	    ../src/BackgroundCacheWriter.cpp	\
+	    ../src/BinaryCache.cpp		\
+	    ../src/BlockGzip.cpp		\
+	    ../src/CacheDelta.cpp		\
+	    ../src/CacheIndex.cpp		\
+	    ../src/CacheParser.cpp		\
+	    ../src/CacheSummary.cpp		\
+	    ../src/CacheVerifier.cpp		\
+	    ../src/CompactName.cpp		\
+	    ../src/CushionSurface.cpp		\
+	    ../src/DataColumns.cpp		\
+	    ../src/DebugHelpers.cpp		\
+	    ../src/DeviceTable.cpp		\
+	    ../src/DirInfo.cpp			\
+	    ../src/DirReadJob.cpp		\
+	    ../src/DirSaver.cpp			\
+	    ../src/DirScanner.cpp		\
+	    ../src/DirTree.cpp			\
+	    ../src/DirTreeCache.cpp		\
+	    ../src/DirWatcher.cpp		\
+	    ../src/DotEntry.cpp			\
+	    ../src/DpkgPkgManager.cpp		\
+	    ../src/Exception.cpp		\
+	    ../src/ExcludeRules.cpp		\
+	    ../src/ExtentScanner.cpp		\
+	    ../src/FileAgeStats.cpp		\
+	    ../src/FileInfo.cpp			\
+	    ../src/FileInfoIterator.cpp		\
+	    ../src/FileInfoSet.cpp		\
+	    ../src/FileInfoSorter.cpp		\
+	    ../src/FileSizeStats.cpp		\
+	    ../src/FileTypeStats.cpp		\
+	    ../src/FlatpakPkgManager.cpp	\
+	    ../src/FormatUtil.cpp		\
+	    ../src/HardLinkIndex.cpp		\
+	    ../src/IdTable.cpp			\
+	    ../src/Logger.cpp			\
+	    ../src/MemoryPressure.cpp		\
+	    ../src/MimeCategorizer.cpp		\
+	    ../src/MimeCategory.cpp		\
+	    ../src/MountPoints.cpp		\
+	    ../src/NameMatcher.cpp		\
+	    ../src/NodeArena.cpp		\
+	    ../src/OwnerStats.cpp		\
+	    ../src/PacManPkgManager.cpp		\
+	    ../src/PercentileStats.cpp		\
+	    ../src/PkgFileListCache.cpp		\
+	    ../src/PkgFilter.cpp		\
+	    ../src/PkgInfo.cpp			\
+	    ../src/PkgManager.cpp		\
+	    ../src/PkgNameIndex.cpp		\
+	    ../src/PkgQuery.cpp			\
+	    ../src/PkgReader.cpp		\
+	    ../src/Process.cpp			\
+	    ../src/ProcessStarter.cpp		\
+	    ../src/QuantileSketch.cpp		\
+	    ../src/RemoteScan.cpp		\
+	    ../src/RemoteScanCoordinator.cpp	\
+	    ../src/RpmPkgManager.cpp		\
+	    ../src/ScanDaemon.cpp		\
+	    ../src/ScanStats.cpp		\
+	    ../src/ScanTuner.cpp		\
+	    ../src/SearchFilter.cpp		\
+	    ../src/SessionCache.cpp		\
+	    ../src/Settings.cpp			\
+	    ../src/SettingsHelpers.cpp		\
+	    ../src/SharedTree.cpp		\
+	    ../src/SnapPkgManager.cpp		\
+	    ../src/SpillStore.cpp		\
+	    ../src/StatRing.cpp			\
+	    ../src/StatsEngine.cpp		\
+	    ../src/SysUtil.cpp			\
+	    ../src/Trace.cpp			\
+	    ../src/TreeColumns.cpp		\
+	    ../src/TreeDiff.cpp			\
+	    ../src/TreeSnapshot.cpp		\
+	    ../src/TreemapLayout.cpp
+
+
+HEADERS	  = QDirStatEngine.h			\
+	    ../src/AsyncCommand.h		\
+	    ../src/Attic.h			\
+	    ../src/BackgroundCacheWriter.h	\
+	    ../src/BinaryCache.h		\
+	    ../src/BlockGzip.h			\
+	    ../src/BrokenLibc.h			\
+	    ../src/CacheDelta.h			\
+	    ../src/CacheIndex.h			\
+	    ../src/CacheParser.h		\
+	    ../src/CacheSummary.h		\
+	    ../src/CacheVerifier.h		\
+	    ../src/CompactName.h		\
+	    ../src/CushionSurface.h		\
+	    ../src/DataColumns.h		\
+	    ../src/DebugHelpers.h		\
+	    ../src/DeviceTable.h		\
+	    ../src/DirInfo.h			\
+	    ../src/DirReadJob.h			\
+	    ../src/DirSaver.h			\
+	    ../src/DirScanner.h			\
+	    ../src/DirTree.h			\
+	    ../src/DirTreeCache.h		\
+	    ../src/DirTreeFilter.h		\
+	    ../src/DirWatcher.h			\
+	    ../src/DotEntry.h			\
+	    ../src/DpkgPkgManager.h		\
+	    ../src/Exception.h			\
+	    ../src/ExcludeRules.h		\
+	    ../src/ExtentScanner.h		\
+	    ../src/FileAgeStats.h		\
+	    ../src/FileInfo.h			\
+	    ../src/FileInfoIterator.h		\
+	    ../src/FileInfoSet.h		\
+	    ../src/FileInfoSorter.h		\
+	    ../src/FileSize.h			\
+	    ../src/FileSizeStats.h		\
+	    ../src/FileTypeStats.h		\
+	    ../src/FlatpakPkgManager.h		\
+	    ../src/FormatUtil.h			\
+	    ../src/HardLinkIndex.h		\
+	    ../src/IdTable.h			\
+	    ../src/ListMover.h			\
+	    ../src/Logger.h			\
+	    ../src/MemoryPressure.h		\
+	    ../src/MimeCategorizer.h		\
+	    ../src/MimeCategory.h		\
+	    ../src/MountPoints.h		\
+	    ../src/MpscRing.h			\
+	    ../src/NameMatcher.h		\
+	    ../src/NodeArena.h			\
+	    ../src/OwnerStats.h			\
+	    ../src/PacManPkgManager.h		\
+	    ../src/ParallelSort.h		\
+	    ../src/PercentileStats.h		\
+	    ../src/PkgFileListCache.h		\
+	    ../src/PkgFilter.h			\
+	    ../src/PkgInfo.h			\
+	    ../src/PkgManager.h			\
+	    ../src/PkgNameIndex.h		\
+	    ../src/PkgQuery.h			\
+	    ../src/PkgReader.h			\
+	    ../src/Process.h			\
+	    ../src/ProcessStarter.h		\
+	    ../src/QuantileSketch.h		\
+	    ../src/RemoteScan.h			\
+	    ../src/RemoteScanCoordinator.h	\
+	    ../src/RpmPkgManager.h		\
+	    ../src/ScanDaemon.h			\
+	    ../src/ScanStats.h			\
+	    ../src/ScanTuner.h			\
+	    ../src/SearchFilter.h		\
+	    ../src/SessionCache.h		\
+	    ../src/Settings.h			\
+	    ../src/SettingsHelpers.h		\
+	    ../src/SharedTree.h			\
+	    ../src/SnapPkgManager.h		\
+	    ../src/SpillStore.h			\
+	    ../src/StatRing.h			\
+	    ../src/StatsEngine.h		\
+	    ../src/SysUtil.h			\
+	    ../src/Trace.h			\
+	    ../src/TreeColumns.h		\
+	    ../src/TreeDiff.h			\
+	    ../src/TreeSnapshot.h		\
+	    ../src/TreemapLayout.h		\
+	    ../src/Version.h
+
+
+CONFIG(engine_install) {
+    target.path	 = $$INSTALL_PREFIX/lib
+    headers.path = $$INSTALL_PREFIX/include/qdirstat
+    headers.files = $$HEADERS
+    INSTALLS	+= target headers
+}
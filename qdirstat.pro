@@ -14,11 +14,17 @@
 # If you want to install to, say, /usr/local, set INSTALL_PREFIX:
 #
 #     qmake INSTALL_PREFIX=/usr/local
+#
+# To also build the benchmarks in benchmark/ (they are not installed):
+#
+#     qmake CONFIG+=benchmark
 
 TEMPLATE = subdirs
 CONFIG  += ordered
 
-SUBDIRS  = src scripts doc doc/stats man
+SUBDIRS  = src engine cache-writer scripts doc doc/stats man
+
+CONFIG(benchmark): SUBDIRS += benchmark
 
 macx {
     # FIXME: Prevent build failure because of missing main() (issue #131)
@@ -6,7 +6,11 @@ TEMPLATE       = app
 TARGET         = $(nothing)
 QMAKE_STRIP    = /bin/true # prevent stripping the script(s)
 
-scripts.files  = qdirstat-cache-writer
-scripts.path   = $$INSTALL_PREFIX/bin
-
-INSTALLS      += scripts
+# qdirstat-cache-writer is now a native program (see ../cache-writer) with the
+# same name and the same command line options; the Perl script is only kept
+# for reference and for systems without a C++ compiler and Qt.
+#
+# scripts.files  = qdirstat-cache-writer
+# scripts.path   = $$INSTALL_PREFIX/bin
+#
+# INSTALLS      += scripts
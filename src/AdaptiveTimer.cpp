@@ -72,6 +72,10 @@ void AdaptiveTimer::clear()
 
     _delayStage    = 0;
     _coolDownStage = 0;
+
+    _costBudget    = 0;
+    _cost          = 0;
+    _sinceDelivery.invalidate();
 }
 
 
@@ -80,6 +84,17 @@ void AdaptiveTimer::delayedRequest( const QVariant & payload )
     // logDebug() << "Received request for " << payload.toString() << endl;
     _payload = payload;
 
+    if ( _costBudget > 0 )
+    {
+        // Don't postpone a pending delivery: That would never deliver
+        // anything while requests keep coming in.
+
+        if ( ! _deliveryTimer.isActive() )
+            _deliveryTimer.start();
+
+        return;
+    }
+
     if ( _coolDownTimer.isActive() )
         increaseDelay();
     else
@@ -92,7 +107,61 @@ void AdaptiveTimer::delayedRequest( const QVariant & payload )
 void AdaptiveTimer::deliveryTimeout()
 {
     // logDebug() << "Delivering request for " << _payload.toString() << endl;
+
+    QElapsedTimer timer;
+    timer.start();
+
     emit deliverRequest( _payload );
+
+    if ( _costBudget > 0 )
+    {
+        _cost += timer.elapsed();
+        adaptToCost();
+    }
+}
+
+
+void AdaptiveTimer::adaptToCost()
+{
+    if ( ! _sinceDelivery.isValid() )
+    {
+        // First delivery: Nothing to compare with yet
+
+        _sinceDelivery.start();
+        _cost = 0;
+
+        return;
+    }
+
+    qint64 elapsed = qMax( _sinceDelivery.restart(), (qint64) 1 );
+    qint64 percent = 100 * _cost / elapsed;
+
+    if ( percent > _costBudget )
+        setDelayStage( _delayStage + 1 );
+    else if ( percent < _costBudget / 2 )
+        setDelayStage( _delayStage - 1 );
+
+    _cost = 0;
+}
+
+
+void AdaptiveTimer::setDelayStage( int stage )
+{
+    stage = qBound( 0, stage, _delays.size() - 1 );
+
+    if ( stage == _delayStage || _delays.isEmpty() )
+        return;
+
+    _delayStage = stage;
+    int delay   = _delays[ _delayStage ];
+
+#if VERBOSE_DELAY
+    logDebug() << "Switching to delay stage " << _delayStage
+               << ": " << delay << " millisec"
+               << endl;
+#endif
+
+    _deliveryTimer.setInterval( delay );
 }
 
 
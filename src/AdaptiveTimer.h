@@ -13,6 +13,7 @@
 #include <QObject>
 #include <QVariant>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QList>
 
 
@@ -36,6 +37,10 @@ namespace QDirStat
      *
      * The intention behind this is to reduce very expensive operations to a
      * minimum and only show the latest and up-to-date data.
+     *
+     * Alternatively, the delay can be adapted to what delivering the events
+     * actually costs (see setCostBudget()) rather than to how often they
+     * come in.
      **/
     class AdaptiveTimer: public QObject
     {
@@ -65,6 +70,32 @@ namespace QDirStat
          **/
         void addCoolDownPeriod( int coolDownMillisec );
 
+        /**
+         * Adapt the delay stage to the cost of delivering requests: If the
+         * receivers of deliverRequest() plus everything reported with
+         * addCost() use up more than 'percent' of the time between two
+         * deliveries, use the next longer delay; if they use less than half
+         * of that, use the next shorter one. 0 (the default) switches this
+         * off and adapts the delay to the rate of incoming requests.
+         *
+         * With a cost budget, more requests don't postpone a pending
+         * delivery, so the requests are delivered at most once per delay
+         * interval even if they never stop coming in.
+         **/
+        void setCostBudget( int percent ) { _costBudget = percent; }
+
+        /**
+         * Return the cost budget in percent or 0 if there is none.
+         **/
+        int costBudget() const { return _costBudget; }
+
+        /**
+         * Report additional cost of the last delivery that was not spent in
+         * the receivers of deliverRequest(), e.g. for repainting a widget
+         * later. This is only used with a cost budget.
+         **/
+        void addCost( qint64 millisec ) { _cost += millisec; }
+
         /**
          * Clear all internal data, including all defined delays and intervals.
          **/
@@ -129,6 +160,17 @@ namespace QDirStat
          **/
         void decreaseDelay();
 
+        /**
+         * Use the next longer or shorter delay stage depending on the cost
+         * of the deliveries since the last one.
+         **/
+        void adaptToCost();
+
+        /**
+         * Switch to delay stage 'stage'.
+         **/
+        void setDelayStage( int stage );
+
 
         // Data members
 
@@ -141,6 +183,10 @@ namespace QDirStat
         IntList  _coolDownPeriods;
         QTimer   _coolDownTimer;
 
+        int           _costBudget;
+        qint64        _cost;
+        QElapsedTimer _sinceDelivery;
+
     }; // class AdaptiveTimer
 
 } // namespace QDirStat
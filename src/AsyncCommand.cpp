@@ -0,0 +1,198 @@
+/*
+ *   File name: AsyncCommand.cpp
+ *   Summary:	External command that does not block the caller
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QProcessEnvironment>
+
+#include "AsyncCommand.h"
+#include "Process.h"
+#include "SysUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+AsyncCommand::AsyncCommand( const QString     & command,
+			    const QStringList & args,
+			    QObject	      * parent ):
+    QObject( parent ),
+    _command( command ),
+    _args( args ),
+    _timeoutSec( COMMAND_TIMEOUT_SEC ),
+    _process( 0 ),
+    _running( false ),
+    _ok( false ),
+    _cancelled( false ),
+    _timedOut( false ),
+    _exitCode( -1 )
+{
+    _timer.setSingleShot( true );
+
+    connect( &_timer, SIGNAL( timeout() ),
+	     this,    SLOT  ( timeout() ) );
+}
+
+
+AsyncCommand::~AsyncCommand()
+{
+    if ( _process )
+    {
+	_process->disconnect( this );
+	_process->kill();
+	_process->waitForFinished( 1000 );
+	delete _process;
+    }
+}
+
+
+void AsyncCommand::start()
+{
+    if ( _running )
+	return;
+
+    _running   = true;
+    _ok	       = false;
+    _cancelled = false;
+    _timedOut  = false;
+    _exitCode  = -1;
+    _output.clear();
+
+    if ( ! SysUtil::haveCommand( _command ) )
+    {
+	logInfo() << "Command not found: " << _command << endl;
+	_output = "ERROR: Command not found";
+
+	// Don't emit finished() before the caller had a chance to connect
+
+	QTimer::singleShot( 0, this, SLOT( notStarted() ) );
+	return;
+    }
+
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert( "LANG", "C" ); // Prevent output in translated languages
+
+    _process = new Process( this );
+    CHECK_NEW( _process );
+
+    _process->setProgram( _command );
+    _process->setArguments( _args );
+    _process->setProcessEnvironment( env );
+    _process->setProcessChannelMode( QProcess::MergedChannels ); // combine stdout and stderr
+
+    connect( _process, SIGNAL( finished	     ( int, QProcess::ExitStatus ) ),
+	     this,     SLOT  ( processFinished() ) );
+
+    connect( _process, SIGNAL( error	     ( QProcess::ProcessError ) ),
+	     this,     SLOT  ( processError( QProcess::ProcessError ) ) );
+
+#if LOG_COMMANDS
+    logDebug() << _command << " " << _args.join( " " ) << endl;
+#endif
+
+    _process->start();
+
+    if ( _timeoutSec > 0 )
+	_timer.start( _timeoutSec * 1000 );
+}
+
+
+void AsyncCommand::cancel()
+{
+    if ( ! _running || _cancelled )
+	return;
+
+    _cancelled = true;
+
+    if ( _process )
+	_process->kill();	// processFinished() follows
+}
+
+
+void AsyncCommand::timeout()
+{
+    if ( ! _process )
+	return;
+
+    logError() << "Timeout: \"" << _command << "\" args: " << _args << endl;
+
+    _timedOut = true;
+    _process->kill();		// processFinished() follows
+}
+
+
+void AsyncCommand::processFinished()
+{
+    if ( ! _process )
+	return;
+
+    _output = QString::fromUtf8( _process->readAll() );
+
+    if ( _timedOut )
+    {
+	_output = "ERROR: Timeout\n\n" + _output;
+    }
+    else if ( _cancelled )
+    {
+	_output = "ERROR: Cancelled\n\n" + _output;
+    }
+    else if ( _process->exitStatus() != QProcess::NormalExit )
+    {
+	logError() << "Command crashed: \"" << _command << "\" args: " << _args << endl;
+	_output = "ERROR: Command crashed\n\n" + _output;
+    }
+    else
+    {
+	_ok	  = true;
+	_exitCode = _process->exitCode();
+    }
+
+#if LOG_OUTPUT
+    logDebug() << "Output: \n" << _output << endl;
+#endif
+
+    finish();
+}
+
+
+void AsyncCommand::processError( QProcess::ProcessError error )
+{
+    if ( ! _process || error != QProcess::FailedToStart )
+	return;
+
+    logError() << "Can't start \"" << _command << "\": " << _process->errorString() << endl;
+    _output = "ERROR: Can't start command";
+
+    finish();
+}
+
+
+void AsyncCommand::notStarted()
+{
+    finish();
+}
+
+
+void AsyncCommand::finish()
+{
+    _timer.stop();
+
+    if ( _process )
+    {
+	_process->disconnect( this );
+	_process->deleteLater();
+	_process = 0;
+    }
+
+    if ( ! _running )
+	return;
+
+    _running = false;
+    emit finished( this );
+}
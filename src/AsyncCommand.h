@@ -0,0 +1,178 @@
+/*
+ *   File name: AsyncCommand.h
+ *   Summary:	External command that does not block the caller
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef AsyncCommand_h
+#define AsyncCommand_h
+
+
+#include <QObject>
+#include <QProcess>
+#include <QStringList>
+#include <QTimer>
+
+
+namespace QDirStat
+{
+    class Process;
+
+
+    /**
+     * External command that runs in the background while the event loop
+     * keeps going: This is the non-blocking counterpart of
+     * SysUtil::runCommand() for callers in the GUI thread.
+     *
+     * Like SysUtil::runCommand(), the command is started with LANG=C, and
+     * stdout and stderr are combined in output().
+     *
+     * Usage:
+     *
+     *	   AsyncCommand * cmd = new AsyncCommand( "/usr/bin/dpkg", args, this );
+     *	   connect( cmd,  SIGNAL( finished( AsyncCommand * ) ),
+     *		    this, SLOT	( cmdFinished( AsyncCommand * ) ) );
+     *	   cmd->start();
+     *
+     * finished() is emitted exactly once for each start(), even if the
+     * command is not found, if it times out or if it is cancelled; it is
+     * never emitted from within start() or cancel(), so it is safe to
+     * delete the object (with deleteLater()) in the slot.
+     **/
+    class AsyncCommand: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This does not start the command yet.
+	 **/
+	AsyncCommand( const QString	& command,
+		      const QStringList & args,
+		      QObject		* parent = 0 );
+
+	/**
+	 * Destructor. This kills the command if it is still running;
+	 * finished() is not emitted then.
+	 **/
+	virtual ~AsyncCommand();
+
+	/**
+	 * Set the timeout in seconds after which the command is killed.
+	 * 0 means no timeout. The default is COMMAND_TIMEOUT_SEC.
+	 **/
+	void setTimeout( int timeoutSec ) { _timeoutSec = timeoutSec; }
+
+	/**
+	 * Start the command.
+	 **/
+	void start();
+
+	/**
+	 * Kill the command if it is running. finished() follows with
+	 * cancelled() returning 'true'.
+	 **/
+	void cancel();
+
+	/**
+	 * Return 'true' if the command was started and finished() was not
+	 * emitted yet.
+	 **/
+	bool isRunning() const { return _running; }
+
+	/**
+	 * Return 'true' if the command exited normally, i.e. it was found,
+	 * it did not crash, it did not time out and it was not cancelled.
+	 * The exit code may still be nonzero.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Return 'true' if the command was killed because of cancel().
+	 **/
+	bool cancelled() const { return _cancelled; }
+
+	/**
+	 * Return the exit code of the command or -1 if it did not exit
+	 * normally.
+	 **/
+	int exitCode() const { return _exitCode; }
+
+	/**
+	 * Return the output of the command (stdout and stderr).
+	 **/
+	const QString & output() const { return _output; }
+
+	/**
+	 * Return the command and its arguments.
+	 **/
+	const QString &	    command() const { return _command; }
+	const QStringList & args()    const { return _args;    }
+
+
+    signals:
+
+	/**
+	 * Emitted when the command is finished, no matter how.
+	 **/
+	void finished( AsyncCommand * command );
+
+
+    protected slots:
+
+	/**
+	 * Notification that the process exited.
+	 **/
+	void processFinished();
+
+	/**
+	 * Notification of a process error. Only FailedToStart is handled
+	 * here; processFinished() follows for the others.
+	 **/
+	void processError( QProcess::ProcessError error );
+
+	/**
+	 * Notification that the command takes too long.
+	 **/
+	void timeout();
+
+	/**
+	 * Emit finished() (and clean up) for a command that never ran.
+	 **/
+	void notStarted();
+
+
+    protected:
+
+	/**
+	 * Clean up the process and emit finished().
+	 **/
+	void finish();
+
+
+	//
+	// Data members
+	//
+
+	QString	    _command;
+	QStringList _args;
+	int	    _timeoutSec;
+	Process *   _process;
+	QTimer	    _timer;
+	bool	    _running;
+	bool	    _ok;
+	bool	    _cancelled;
+	bool	    _timedOut;
+	int	    _exitCode;
+	QString	    _output;
+
+    };	// class AsyncCommand
+
+}	// namespace QDirStat
+
+
+#endif	// AsyncCommand_h
@@ -25,10 +25,10 @@ Attic::Attic( DirTree * tree,
 
     if ( parent )
     {
-	_device = parent->device();
+	setDevice( parent->device() );
 	_mode	= parent->mode();
-	_uid	= parent->uid();
-	_gid	= parent->gid();
+	setUid( parent->uid() );
+	setGid( parent->gid() );
 	_mtime	= 0;
     }
 }
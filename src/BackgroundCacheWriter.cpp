@@ -0,0 +1,251 @@
+/*
+ *   File name: BackgroundCacheWriter.cpp
+ *   Summary:	Writing QDirStat cache files in a background thread
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stdio.h>	// rename()
+#include <sys/stat.h>	// S_ISREG()
+
+#include <QFile>
+#include <QRunnable>
+
+#include "BackgroundCacheWriter.h"
+#include "BinaryCache.h"
+#include "BlockGzip.h"
+#include "CacheIndex.h"
+#include "DirTree.h"
+#include "DirTreeCache.h"
+#include "FileInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Interval for checking the progress of the background thread
+
+#define PROGRESS_INTERVAL_MILLISEC	250
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Thread pool job that runs a BackgroundCacheWriter.
+     **/
+    class BackgroundCacheWriterJob: public QRunnable
+    {
+    public:
+
+	BackgroundCacheWriterJob( BackgroundCacheWriter * writer ):
+	    QRunnable(),
+	    _writer( writer )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	    { _writer->run(); }
+
+    protected:
+
+	BackgroundCacheWriter * _writer;
+    };
+}
+
+
+BackgroundCacheWriter::BackgroundCacheWriter( QObject * parent ):
+    QObject( parent ),
+    _withUidGidPerm( false ),
+    _fastCompression( false ),
+    _active( false ),
+    _ok( false ),
+    _index( 0 ),
+    _totalItems( 0 )
+{
+    _threadPool.setMaxThreadCount( 1 );
+
+    connect( &_timer, SIGNAL( timeout()	    ),
+	     this,    SLOT  ( checkProgress() ) );
+}
+
+
+BackgroundCacheWriter::~BackgroundCacheWriter()
+{
+    _cancelRequested.storeRelease( 1 );
+    _threadPool.waitForDone();
+}
+
+
+bool BackgroundCacheWriter::start( DirTree * tree, const QString & fileName )
+{
+    if ( _active || ! tree )
+	return false;
+
+    if ( tree->hasFileSummaries() )	// See DirTree::writeCache()
+    {
+	logError() << "Not writing " << fileName
+		   << ": Some files are only in the sums of their directories" << endl;
+	return false;
+    }
+
+    // The snapshot is cached in the directories, and so are statistics
+
+    tree->finishStats();
+
+    FileInfo * toplevel = tree->firstToplevel();
+    _snapshot = tree->snapshot();
+
+    if ( ! toplevel || ! _snapshot )
+	return false;
+
+    // Everything the thread needs is copied here: It must not touch the
+    // tree.
+
+    _fileName	     = fileName;
+    _toplevelPath    = toplevel->url();
+    _withUidGidPerm  = toplevel->hasUid();
+    _fastCompression = CacheWriter::fastCompression();
+    _totalItems	     = _snapshot->totalItems() + 1;
+    _ok		     = false;
+    _active	     = true;
+    _itemsWritten.storeRelease( 0 );
+    _done.storeRelease( 0 );
+    _cancelRequested.storeRelease( 0 );
+
+    logInfo() << "Writing " << _fileName << " in the background" << endl;
+
+    _threadPool.start( new BackgroundCacheWriterJob( this ) );
+    _timer.start( PROGRESS_INTERVAL_MILLISEC );
+
+    return true;
+}
+
+
+void BackgroundCacheWriter::cancel()
+{
+    if ( _active )
+    {
+	logInfo() << "Canceling writing " << _fileName << endl;
+	_cancelRequested.storeRelease( 1 );
+    }
+}
+
+
+void BackgroundCacheWriter::checkProgress()
+{
+    if ( ! _done.loadAcquire() )
+    {
+	emit progress( (int) ( 100 * (qint64) _itemsWritten.loadAcquire() / _totalItems ) );
+	return;
+    }
+
+    _timer.stop();
+    _threadPool.waitForDone();
+    _snapshot.clear();
+    _active = false;
+
+    if ( _ok )
+	logInfo() << "Wrote " << _fileName << endl;
+
+    emit finished( _ok );
+}
+
+
+void BackgroundCacheWriter::run()
+{
+    // This is called in the context of the background thread!
+    // Only the snapshot and the copies from start() are used here.
+
+    QString tmpName = _fileName + ".new";
+    bool    ok	    = false;
+
+    if ( _fileName.endsWith( BINARY_CACHE_SUFFIX ) )
+    {
+	BinaryCacheWriter writer( tmpName, _snapshot, _toplevelPath, _withUidGidPerm,
+				  &_cancelRequested, &_itemsWritten );
+
+	ok = writer.ok() && rename( tmpName.toUtf8(), _fileName.toUtf8() ) == 0;
+    }
+    else
+    {
+	BlockGzipWriter cache( tmpName );
+
+	if ( cache.ok() )
+	{
+	    CacheIndex index;
+	    _index = &index;
+
+	    cache.setCompressionLevel( _fastCompression ? 1 : -1 );
+	    CacheWriter::writeHeader( &cache, _withUidGidPerm );
+
+	    ok = writeDir( &cache, _snapshot.data(), _toplevelPath );
+	    index.setEnd( cache.blockNo(), cache.blockPos() );
+	    _index = 0;
+
+	    ok = cache.close() && ok;
+
+	    // The old index would not match the new file; without the new
+	    // one, the cache file can still be read from the start
+
+	    QFile::remove( CacheIndex::fileName( _fileName ) );
+
+	    if ( ok && rename( tmpName.toUtf8(), _fileName.toUtf8() ) == 0 )
+		index.write( _fileName, cache.blockOffsets() );
+	    else
+		ok = false;
+	}
+    }
+
+    if ( ! ok )
+    {
+	if ( ! wasCanceled() )
+	    logError() << "Writing " << _fileName << " failed" << endl;
+
+	QFile::remove( tmpName );
+    }
+
+    _ok = ok;
+    _done.storeRelease( 1 );
+}
+
+
+bool BackgroundCacheWriter::writeDir( BlockGzipWriter *	      cache,
+				      const TreeSnapshotDir * dir,
+				      const QString &	      path )
+{
+    if ( _cancelRequested.loadAcquire() )
+	return false;
+
+    const SnapshotItem & self = dir->self();
+
+    _index->add( path, cache->blockNo(), cache->blockPos(), dir->totalAllocatedSize() );
+
+    CacheWriter::formatItem( _lineBuffer, path, true,
+			     self.mode, self.rawSize,
+			     _withUidGidPerm, self.uid, self.gid, self.mtime,
+			     -1, 1 );
+    cache->write( _lineBuffer );
+
+    foreach ( const SnapshotItem & file, dir->files() )
+    {
+	CacheWriter::formatItem( _lineBuffer, file.name, false,
+				 file.mode, file.rawSize,
+				 _withUidGidPerm, file.uid, file.gid, file.mtime,
+				 file.isSparse ? file.blocks : -1,
+				 S_ISREG( file.mode ) ? file.links : 1 );
+	cache->write( _lineBuffer );
+    }
+
+    _itemsWritten.fetchAndAddRelaxed( 1 + dir->files().size() );
+
+    QString prefix = path == "/" ? path : path + "/";
+
+    foreach ( const TreeSnapshotDirPtr & subDir, dir->subDirs() )
+    {
+	if ( ! writeDir( cache, subDir.data(), prefix + subDir->name() ) )
+	    return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,154 @@
+/*
+ *   File name: BackgroundCacheWriter.h
+ *   Summary:	Writing QDirStat cache files in a background thread
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef BackgroundCacheWriter_h
+#define BackgroundCacheWriter_h
+
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QTimer>
+
+#include "TreeSnapshot.h"
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class BlockGzipWriter;
+    class CacheIndex;
+
+
+    /**
+     * Writer for a text cache file (see CacheWriter) that does the work in
+     * a background thread, so the GUI remains usable while a huge tree is
+     * written. If the file name ends with BINARY_CACHE_SUFFIX, it writes a
+     * binary cache file (see BinaryCacheWriter) instead.
+     *
+     * start() takes a TreeSnapshotDir of the tree in the GUI thread; the
+     * background thread only uses that snapshot, so the tree may change
+     * in any way meanwhile. The file is written under a temporary name
+     * and only renamed when it is complete, so cancel() never leaves a
+     * partial cache file behind.
+     *
+     * Usage:
+     *
+     *	   BackgroundCacheWriter * writer = new BackgroundCacheWriter( this );
+     *	   connect( writer, SIGNAL( finished( bool ) ), ... );
+     *	   writer->start( tree, fileName );
+     **/
+    class BackgroundCacheWriter: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	BackgroundCacheWriter( QObject * parent = 0 );
+
+	/**
+	 * Destructor. This cancels writing and waits for the thread.
+	 **/
+	virtual ~BackgroundCacheWriter();
+
+	/**
+	 * Start writing the complete tree 'tree' to cache file 'fileName'.
+	 * Return 'false' if there is nothing to write or if the writer is
+	 * still busy.
+	 *
+	 * This has to be called in the GUI thread.
+	 **/
+	bool start( DirTree * tree, const QString & fileName );
+
+	/**
+	 * Stop writing. This emits finished( false ) when the thread is done.
+	 **/
+	void cancel();
+
+	/**
+	 * Return 'true' if a cache file is being written.
+	 **/
+	bool isActive() const { return _active; }
+
+	/**
+	 * Return the name of the cache file that is written.
+	 **/
+	const QString & fileName() const { return _fileName; }
+
+	/**
+	 * Return 'true' if writing was canceled.
+	 **/
+	bool wasCanceled() const { return _cancelRequested.loadAcquire(); }
+
+	/**
+	 * Write the cache file. This is called in the background thread.
+	 **/
+	void run();
+
+
+    signals:
+
+	/**
+	 * Emitted from time to time while writing with the percentage that
+	 * is done.
+	 **/
+	void progress( int percent );
+
+	/**
+	 * Emitted when writing is finished, canceled or failed.
+	 **/
+	void finished( bool ok );
+
+
+    protected slots:
+
+	/**
+	 * Check if the thread is done and emit progress() or finished().
+	 **/
+	void checkProgress();
+
+
+    protected:
+
+	/**
+	 * Write the subtree of 'dir' with path 'path'. Return 'false' if
+	 * writing is canceled.
+	 **/
+	bool writeDir( BlockGzipWriter *	 cache,
+		       const TreeSnapshotDir * dir,
+		       const QString &	 path );
+
+
+	QThreadPool		_threadPool;
+	QTimer			_timer;
+	TreeSnapshotDirPtr	_snapshot;
+	QString			_fileName;
+	QString			_toplevelPath;
+	bool			_withUidGidPerm;
+	bool			_fastCompression;
+	bool			_active;
+	bool			_ok;		// Only valid after the thread is done
+	CacheIndex *		_index;		// Only used in the thread
+	QByteArray		_lineBuffer;	// Only used in the thread
+	qint64			_totalItems;
+	QAtomicInt		_itemsWritten;
+	QAtomicInt		_done;
+	QAtomicInt		_cancelRequested;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef BackgroundCacheWriter_h
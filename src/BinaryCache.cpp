@@ -0,0 +1,709 @@
+/*
+ *   File name: BinaryCache.cpp
+ *   Summary:	QDirStat binary cache reader / writer
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stddef.h>	// offsetof()
+#include <string.h>	// memcmp(), memcpy(), memset()
+
+#include "BinaryCache.h"
+#include "DirInfo.h"
+#include "DirTree.h"
+#include "DotEntry.h"
+#include "ExcludeRules.h"
+#include "FormatUtil.h"
+#include "SpillStore.h"
+#include "Logger.h"
+#include "Exception.h"
+#include "Trace.h"
+
+#define VERBOSE_BINARY_CACHE	0
+
+// Names up to this length are written only once to the string table; all
+// records with the same name refer to the same bytes. Longer names are
+// rarely repeated.
+
+#define MAX_SHARED_NAME_LEN	48
+
+using namespace QDirStat;
+
+
+BinaryCacheWriter::BinaryCacheWriter( const QString & fileName,
+				      DirTree *	      tree,
+				      FileInfo *      subtree ):
+    _toplevel( 0 ),
+    _stringsSize( 0 ),
+    _recordCount( 0 ),
+    _withUidGidPerm( true ),
+    _ok( true ),
+    _cancel( 0 ),
+    _itemsWritten( 0 )
+{
+    _ok = writeCache( fileName, tree, subtree );
+}
+
+
+BinaryCacheWriter::BinaryCacheWriter( const QString &		 fileName,
+				      const TreeSnapshotDirPtr & snapshot,
+				      const QString &		 toplevelPath,
+				      bool			 withUidGidPerm,
+				      const QAtomicInt *	 cancel,
+				      QAtomicInt *		 itemsWritten ):
+    _toplevel( 0 ),
+    _stringsSize( 0 ),
+    _recordCount( 0 ),
+    _withUidGidPerm( withUidGidPerm ),
+    _ok( true ),
+    _cancel( cancel ),
+    _itemsWritten( itemsWritten )
+{
+    if ( ! snapshot || ! openFile( fileName ) )
+    {
+	_ok = false;
+	return;
+    }
+
+    // Only the toplevel directory has its full path as its name
+    writeSnapshot( snapshot.data(), toplevelPath.toUtf8() );
+
+    _ok = closeFile( fileName );
+}
+
+
+BinaryCacheWriter::~BinaryCacheWriter()
+{
+    // NOP
+}
+
+
+bool BinaryCacheWriter::writeCache( const QString & fileName,
+				    DirTree *	    tree,
+				    FileInfo *	    subtree )
+{
+    if ( ! tree )
+	return false;
+
+    _toplevel = subtree ? subtree : tree->firstToplevel();
+
+    if ( ! _toplevel || ! _toplevel->isDirInfo() )
+	return false;
+
+    _withUidGidPerm = _toplevel->hasUid();
+
+    if ( ! openFile( fileName ) )
+	return false;
+
+    writeTree( _toplevel );
+
+    return closeFile( fileName );
+}
+
+
+bool BinaryCacheWriter::openFile( const QString & fileName )
+{
+    _file.setFileName( fileName );
+
+    if ( ! _file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+	logError() << "Can't open " << fileName << ": " << _file.errorString() << endl;
+	return false;
+    }
+
+    // The names go to a temporary file first: The string table is at the
+    // end of the cache file, after all records.
+
+    if ( ! _strings.open() )
+    {
+	logError() << "Can't open temporary file: " << _strings.errorString() << endl;
+	return false;
+    }
+
+    // Write a dummy header; the real one is written when all the numbers
+    // are known.
+
+    BinaryCacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+    write( _file, &header, sizeof( header ) );
+
+    return _ok;
+}
+
+
+bool BinaryCacheWriter::closeFile( const QString & fileName )
+{
+    BinaryCacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+
+    memcpy( header.magic, BINARY_CACHE_MAGIC, sizeof( header.magic ) );
+    header.version	 = BINARY_CACHE_VERSION;
+    header.byteOrderMark = BINARY_CACHE_BOM;
+    header.flags	 = _withUidGidPerm ? BinaryCacheWithUidGidPerm : 0;
+    header.recordSize	 = sizeof( BinaryCacheRecord );
+    header.recordCount	 = _recordCount;
+    header.recordsOffset = sizeof( BinaryCacheHeader );
+    header.stringsOffset = sizeof( BinaryCacheHeader ) + _recordCount * sizeof( BinaryCacheRecord );
+    header.stringsSize	 = _stringsSize;
+
+    if ( ! appendStrings() )
+	_ok = false;
+
+    _file.seek( 0 );
+    write( _file, &header, sizeof( header ) );
+    _file.close();
+
+    if ( _file.error() != QFile::NoError )
+	_ok = false;
+
+    if ( _cancel && _cancel->loadAcquire() )
+	logDebug() << "Writing " << fileName << " canceled" << endl;
+    else if ( ! _ok )
+	logError() << "Error writing " << fileName << ": " << _file.errorString() << endl;
+    else
+	logDebug() << "Wrote " << _recordCount << " items to " << fileName << endl;
+
+    return _ok;
+}
+
+
+void BinaryCacheWriter::writeTree( FileInfo * item )
+{
+    if ( ! item || ! _ok )
+	return;
+
+    quint64 index = 0;
+
+    //
+    // Write record for this item
+    //
+
+    if ( ! item->isDotEntry() )
+    {
+	// Only the toplevel directory has its full path as its name
+	QString name = item == _toplevel ? item->url() : item->name();
+
+	index = writeRecord( item, name.toUtf8() );
+    }
+
+    //
+    // Write file children
+    //
+
+    if ( item->dotEntry() )
+	writeTree( item->dotEntry() );
+
+    if ( item->isDirInfo() && item->toDirInfo()->hasSpilledFiles() )
+    {
+	// Files of an out-of-core tree: Use temporary objects from the spill
+	// store without paging them in
+
+	FileInfoList files;
+	item->tree()->spillStore()->load( item->toDirInfo(), files );
+
+	foreach ( FileInfo * file, files )
+	    writeRecord( file, file->name().toUtf8() );
+
+	qDeleteAll( files );
+    }
+
+    //
+    // Recurse through subdirectories
+    //
+
+    FileInfo * child = item->firstChild();
+
+    while ( child )
+    {
+	writeTree( child );
+	child = child->next();
+    }
+
+    if ( item->isDirInfo() && ! item->isDotEntry() && _recordCount > index + 1 )
+	patchSubtreeEnd( index, _recordCount );
+}
+
+
+void BinaryCacheWriter::writeSnapshot( const TreeSnapshotDir * dir, const QByteArray & name )
+{
+    if ( ! _ok )
+	return;
+
+    if ( _cancel && _cancel->loadAcquire() )
+    {
+	_ok = false;
+	return;
+    }
+
+    quint64 index = writeRecord( dir->self(), name );
+
+    // The files of the dot entry are already files of the directory in a
+    // snapshot
+
+    foreach ( const SnapshotItem & file, dir->files() )
+	writeRecord( file, file.name.toUtf8() );
+
+    if ( _itemsWritten )
+	_itemsWritten->fetchAndAddRelaxed( 1 + dir->files().size() );
+
+    foreach ( const TreeSnapshotDirPtr & subDir, dir->subDirs() )
+	writeSnapshot( subDir.data(), subDir->name().toUtf8() );
+
+    if ( _recordCount > index + 1 )
+	patchSubtreeEnd( index, _recordCount );
+}
+
+
+quint64 BinaryCacheWriter::writeRecord( FileInfo * item, const QByteArray & name )
+{
+    BinaryCacheRecord rec;
+    memset( &rec, 0, sizeof( rec ) );
+
+    rec.size	   = item->rawByteSize();
+    rec.blocks	   = item->isSparseFile() ? item->blocks() : -1;
+    rec.mtime	   = item->mtime();
+    rec.mode	   = item->mode();
+    rec.uid	   = _withUidGidPerm ? item->uid() : 0;
+    rec.gid	   = _withUidGidPerm ? item->gid() : 0;
+    rec.links	   = item->links();
+
+    return writeRecord( rec, name );
+}
+
+
+quint64 BinaryCacheWriter::writeRecord( const SnapshotItem & item, const QByteArray & name )
+{
+    BinaryCacheRecord rec;
+    memset( &rec, 0, sizeof( rec ) );
+
+    rec.size	   = item.rawSize;
+    rec.blocks	   = item.isSparse ? item.blocks : -1;
+    rec.mtime	   = item.mtime;
+    rec.mode	   = item.mode;
+    rec.uid	   = _withUidGidPerm ? item.uid : 0;
+    rec.gid	   = _withUidGidPerm ? item.gid : 0;
+    rec.links	   = item.links;
+
+    return writeRecord( rec, name );
+}
+
+
+quint64 BinaryCacheWriter::writeRecord( BinaryCacheRecord & rec, const QByteArray & name )
+{
+    rec.nameLength = name.size();
+    rec.subtreeEnd = _recordCount + 1;
+
+    bool shared = name.size() <= MAX_SHARED_NAME_LEN;
+
+    if ( shared && _nameOffsets.contains( name ) )
+    {
+	rec.nameOffset = _nameOffsets.value( name );
+    }
+    else
+    {
+	rec.nameOffset = _stringsSize;
+	write( _strings, name.constData(), name.size() );
+	_stringsSize += name.size();
+
+	if ( shared )
+	    _nameOffsets.insert( name, rec.nameOffset );
+    }
+
+    write( _file, &rec, sizeof( rec ) );
+
+    return _recordCount++;
+}
+
+
+void BinaryCacheWriter::patchSubtreeEnd( quint64 index, quint64 subtreeEnd )
+{
+    qint64 pos = sizeof( BinaryCacheHeader )
+	+ index * sizeof( BinaryCacheRecord )
+	+ offsetof( BinaryCacheRecord, subtreeEnd );
+
+    _file.seek( pos );
+    write( _file, &subtreeEnd, sizeof( subtreeEnd ) );
+    _file.seek( _file.size() );
+}
+
+
+bool BinaryCacheWriter::appendStrings()
+{
+    if ( ! _ok )
+	return false;
+
+    _strings.seek( 0 );
+    _file.seek( _file.size() );
+
+    while ( ! _strings.atEnd() )
+    {
+	QByteArray buf = _strings.read( 1024 * 1024 );
+
+	if ( buf.isEmpty() )
+	    break;
+
+	write( _file, buf.constData(), buf.size() );
+    }
+
+    return _ok && _strings.error() == QFile::NoError;
+}
+
+
+void BinaryCacheWriter::write( QIODevice & dev, const void * data, qint64 size )
+{
+    if ( _ok && dev.write( (const char *) data, size ) != size )
+	_ok = false;
+}
+
+
+
+
+BinaryCacheReader::BinaryCacheReader( const QString & fileName,
+				      DirTree *	      tree,
+				      DirInfo *	      parent ):
+    _tree( tree ),
+    _parent( parent ),
+    _toplevel( 0 ),
+    _fileName( fileName ),
+    _file( fileName ),
+    _data( 0 ),
+    _dataSize( 0 ),
+    _records( 0 ),
+    _strings( 0 ),
+    _stringsSize( 0 ),
+    _recordCount( 0 ),
+    _next( 0 ),
+    _filterDir( 0 ),
+    _withUidGidPerm( false ),
+    _ok( true )
+{
+    if ( ! _file.open( QIODevice::ReadOnly ) )
+    {
+	logError() << "Can't open " << fileName << ": " << _file.errorString() << endl;
+	_ok = false;
+	return;
+    }
+
+    _dataSize = _file.size();
+    _data     = _dataSize > 0 ? _file.map( 0, _dataSize ) : 0;
+
+    if ( ! _data )
+    {
+	logError() << "Can't map " << fileName << ": " << _file.errorString() << endl;
+	_ok = false;
+	return;
+    }
+
+    _ok = checkHeader();
+}
+
+
+BinaryCacheReader::~BinaryCacheReader()
+{
+    if ( _data )
+	_file.unmap( _data );
+}
+
+
+bool BinaryCacheReader::isBinaryCache( const QString & fileName )
+{
+    QFile file( fileName );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return false;
+
+    QByteArray magic = file.read( sizeof( BINARY_CACHE_MAGIC ) - 1 );
+
+    return magic == BINARY_CACHE_MAGIC;
+}
+
+
+bool BinaryCacheReader::checkHeader()
+{
+    if ( _dataSize < (qint64) sizeof( BinaryCacheHeader ) )
+    {
+	logError() << _fileName << " is too short for a binary cache file" << endl;
+	return false;
+    }
+
+    const BinaryCacheHeader * header = (const BinaryCacheHeader *) _data;
+
+    if ( memcmp( header->magic, BINARY_CACHE_MAGIC, sizeof( header->magic ) ) != 0 )
+    {
+	logError() << _fileName << " is no binary cache file" << endl;
+	return false;
+    }
+
+    if ( header->byteOrderMark != BINARY_CACHE_BOM )
+    {
+	logError() << _fileName << " was written on a machine with a different byte order" << endl;
+	return false;
+    }
+
+    if ( header->version    != BINARY_CACHE_VERSION ||
+	 header->recordSize != sizeof( BinaryCacheRecord ) )
+    {
+	logError() << _fileName << ": Unsupported binary cache version "
+		   << header->version << endl;
+	return false;
+    }
+
+    // All of these come from the file: Compare with subtractions that
+    // can't overflow, not with sums that can.
+
+    const quint64 size = _dataSize;
+
+    if ( header->recordsOffset < sizeof( BinaryCacheHeader )		 ||
+	 header->recordsOffset % sizeof( quint64 ) != 0			 ||
+	 header->stringsOffset > size					 ||
+	 header->stringsSize   > size - header->stringsOffset		 ||
+	 header->recordsOffset > header->stringsOffset			 ||
+	 header->recordCount   > ( header->stringsOffset - header->recordsOffset )
+				 / sizeof( BinaryCacheRecord ) )
+    {
+	logError() << _fileName << ": Corrupt binary cache header" << endl;
+	return false;
+    }
+
+    _records	    = (const BinaryCacheRecord *) ( _data + header->recordsOffset );
+    _recordCount    = header->recordCount;
+    _strings	    = (const char *) _data + header->stringsOffset;
+    _stringsSize    = header->stringsSize;
+    _withUidGidPerm = header->flags & BinaryCacheWithUidGidPerm;
+
+    return true;
+}
+
+
+void BinaryCacheReader::rewind()
+{
+    _next     = 0;
+    _toplevel = 0;
+    _dirStack.clear();
+    _prefixAncestors.clear();
+    _filterDir = 0;
+}
+
+
+void BinaryCacheReader::setSubtreePrefix( const QString & path )
+{
+    _subtreePrefix = path;
+
+    while ( _subtreePrefix.size() > 1 && _subtreePrefix.endsWith( '/' ) )
+	_subtreePrefix.chop( 1 );
+}
+
+
+bool BinaryCacheReader::read( int maxRecords )
+{
+    TRACE_SPAN( "BinaryCacheReader::read" );
+
+    int count = 0;
+
+    while ( _ok && _next < _recordCount &&
+	    ( maxRecords == 0 || count++ < maxRecords ) )
+    {
+	addItem();
+    }
+
+    return ! eof();
+}
+
+
+QString BinaryCacheReader::firstDir() const
+{
+    if ( ! _ok || _recordCount == 0 || ! S_ISDIR( _records[0].mode ) )
+	return "";
+
+    return name( _records[0] );
+}
+
+
+QString BinaryCacheReader::name( const BinaryCacheRecord & rec ) const
+{
+    if ( ! nameInStrings( rec ) )
+	return QString();
+
+    return QString::fromUtf8( _strings + rec.nameOffset, rec.nameLength );
+}
+
+
+void BinaryCacheReader::addItem()
+{
+    quint64 index = _next++;
+    const BinaryCacheRecord & rec = _records[ index ];
+
+    if ( rec.nameLength == 0 || ! nameInStrings( rec ) ||
+	 rec.subtreeEnd <= index || rec.subtreeEnd > _recordCount )
+    {
+	error( QString( "Corrupt record #%1" ).arg( index ) );
+	return;
+    }
+
+    // Leave all directories whose subtree ends here
+
+    while ( ! _dirStack.isEmpty() && _dirStack.last().second <= index )
+	_dirStack.pop_back();
+
+    DirInfo * parent = _dirStack.isEmpty() ? 0 : _dirStack.last().first;
+    QString   itemName = name( rec );
+    bool      isAncestor = false;	// of the subtree prefix
+
+    if ( index == 0 )
+    {
+	if ( ! S_ISDIR( rec.mode ) )
+	{
+	    error( "First record is not a directory" );
+	    return;
+	}
+
+	// The toplevel directory: Its name is its absolute path.
+
+	parent = _parent;
+
+	if ( ! parent && _tree->root() && ! _tree->root()->hasChildren() )
+	    parent = _tree->root();
+
+	if ( ! parent )
+	{
+	    QString path = itemName.section( '/', 0, -2 );
+	    parent = dynamic_cast<DirInfo *>( _tree->locate( path.isEmpty() ? "/" : path ) );
+	}
+
+	if ( ! parent )
+	{
+	    error( QString( "Could not locate parent for \"%1\"" ).arg( itemName ) );
+	    return;
+	}
+
+	if ( ! _subtreePrefix.isEmpty() &&
+	     ! ( _subtreePrefix + "/" ).startsWith( itemName + "/" ) &&
+	     ! ( itemName + "/" ).startsWith( _subtreePrefix + "/" ) )
+	{
+	    logWarning() << _fileName << " does not contain " << _subtreePrefix
+			 << "; reading all of it" << endl;
+	    _subtreePrefix.clear();
+	}
+
+	isAncestor = ! _subtreePrefix.isEmpty() &&
+	    _subtreePrefix.startsWith( itemName + "/" );
+
+	if ( parent != _tree->root() )
+	    itemName = itemName.section( '/', -1 );
+    }
+    else if ( ! parent )
+    {
+	error( QString( "No parent for record #%1" ).arg( index ) );
+	return;
+    }
+    else if ( skipRecord( parent, itemName, S_ISDIR( rec.mode ), isAncestor ) )
+    {
+	if ( S_ISDIR( rec.mode ) )
+	    _next = rec.subtreeEnd;	// Skip the complete subtree
+
+	return;
+    }
+
+    if ( S_ISDIR( rec.mode ) )
+    {
+#if VERBOSE_BINARY_CACHE
+	logDebug() << "Creating DirInfo for " << itemName << " with parent " << parent << endl;
+#endif
+	DirInfo * dir = new DirInfo( _tree, parent, itemName,
+				     rec.mode, rec.size,
+				     _withUidGidPerm, rec.uid, rec.gid,
+				     rec.mtime );
+	CHECK_NEW( dir );
+	dir->setReadState( DirReading );
+	parent->insertChild( dir );
+
+	if ( ! _toplevel )
+	    _toplevel = dir;
+
+	if ( isAncestor )
+	    _prefixAncestors.insert( dir );
+
+	_tree->childAddedNotify( dir );
+
+	if ( dir != _toplevel && ExcludeRules::instance()->match( dir->url(), dir->name() ) )
+	{
+	    logDebug() << "Excluding " << itemName << endl;
+	    dir->setExcluded();
+	    dir->setReadState( DirOnRequestOnly );
+	    dir->finalizeLocal();
+	    _tree->sendReadJobFinished( dir );
+
+	    // Skip the complete subtree
+
+	    _next = rec.subtreeEnd;
+	}
+	else
+	{
+	    _dirStack.append( DirStackEntry( dir, rec.subtreeEnd ) );
+	}
+    }
+    else
+    {
+	FileInfo * item = new FileInfo( _tree, parent, itemName,
+					rec.mode, rec.size,
+					_withUidGidPerm, rec.uid, rec.gid,
+					rec.mtime,
+					rec.blocks, rec.links );
+	CHECK_NEW( item );
+	parent->insertChild( item );
+	_tree->childAddedNotify( item );
+    }
+}
+
+
+bool BinaryCacheReader::skipRecord( DirInfo *	   parent,
+				    const QString & itemName,
+				    bool	    isDir,
+				    bool &	    isAncestor_ret )
+{
+    isAncestor_ret = false;
+
+    if ( ! _subtreePrefix.isEmpty() && _prefixAncestors.contains( parent ) )
+    {
+	// Above the subtree prefix: Only the directories on the way there
+
+	if ( ! isDir )
+	    return true;
+
+	QString path = parent->url() + ( parent->url().endsWith( '/' ) ? "" : "/" ) + itemName;
+
+	if ( path != _subtreePrefix )
+	{
+	    if ( ! _subtreePrefix.startsWith( path + "/" ) )
+		return true;
+
+	    isAncestor_ret = true;
+	}
+    }
+
+    if ( ! _tree->hasFilters() )
+	return false;
+
+    if ( _tree->checkIgnoreNameFilters( itemName ) )
+	return true;
+
+    if ( ! _tree->hasPathFilters() )
+	return false;
+
+    if ( parent != _filterDir )
+    {
+	_filterDir    = parent;
+	_filterDirUrl = parent->url();
+    }
+
+    return _tree->checkIgnorePathFilters( _filterDirUrl, itemName );
+}
+
+
+void BinaryCacheReader::error( const QString & msg )
+{
+    logError() << _fileName << ": " << msg << endl;
+    _ok = false;
+}
@@ -0,0 +1,366 @@
+/*
+ *   File name: BinaryCache.h
+ *   Summary:	QDirStat binary cache reader / writer
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef BinaryCache_h
+#define BinaryCache_h
+
+
+#include <QFile>
+#include <QTemporaryFile>
+#include <QHash>
+#include <QByteArray>
+#include <QVector>
+#include <QPair>
+#include <QSet>
+#include <QAtomicInt>
+
+#include "FileSize.h"
+#include "TreeSnapshot.h"
+
+
+// Write a binary cache instead of a gzipped text cache if the cache file
+// name ends with this.
+
+#define BINARY_CACHE_SUFFIX	".qdcache"
+
+#define BINARY_CACHE_MAGIC	"QDSBCACH"
+#define BINARY_CACHE_VERSION	1
+#define BINARY_CACHE_BOM	0x01020304
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class FileInfo;
+
+
+    /**
+     * Header of a binary cache file. This is at the very start of the file.
+     *
+     * All numbers are in the byte order of the machine that wrote the file;
+     * 'byteOrderMark' is used to detect a different byte order when reading.
+     **/
+    struct BinaryCacheHeader
+    {
+	char	magic[8];		// BINARY_CACHE_MAGIC without trailing 0
+	quint32 version;		// BINARY_CACHE_VERSION
+	quint32 byteOrderMark;		// BINARY_CACHE_BOM
+	quint32 flags;			// BinaryCacheWithUidGidPerm
+	quint32 recordSize;		// sizeof( BinaryCacheRecord )
+	quint64 recordCount;
+	quint64 recordsOffset;		// file offset of the first record
+	quint64 stringsOffset;		// file offset of the string table
+	quint64 stringsSize;		// size of the string table in bytes
+	quint64 reserved;
+    };	// 64 bytes
+
+
+    enum BinaryCacheFlags
+    {
+	BinaryCacheWithUidGidPerm = 0x01,
+	BinaryCacheStream	  = 0x02	// streamed by a remote scan agent (see RemoteScan.h)
+    };
+
+
+    /**
+     * One item of the tree in a binary cache file: A fixed-width record.
+     *
+     * The records are in preorder: Each directory is followed by all the
+     * items in its subtree; 'subtreeEnd' is the index of the first record
+     * after that subtree. So the parent of each item is simply the nearest
+     * directory before it whose subtree still contains it, and complete
+     * subtrees can be skipped without looking at them.
+     *
+     * Names are not stored in the records, but in a string table at the end
+     * of the file (UTF-8, no trailing 0). The first record (the toplevel
+     * directory) has its absolute path as its name, all others have only
+     * their name without path. Records with the same name may refer to the
+     * same bytes in the string table.
+     **/
+    struct BinaryCacheRecord
+    {
+	quint64 size;			// size in bytes
+	qint64	blocks;			// 512 byte blocks, or -1 if not sparse
+	qint64	mtime;
+	quint64 nameOffset;		// offset of the name in the string table
+	quint64 subtreeEnd;		// index of the first record after the subtree
+	quint32 nameLength;		// name length in bytes
+	quint32 mode;			// type and permissions, like st_mode
+	quint32 uid;
+	quint32 gid;
+	quint32 links;
+	quint32 reserved;
+    };	// 64 bytes
+
+
+
+    /**
+     * Writer for binary cache files.
+     **/
+    class BinaryCacheWriter
+    {
+    public:
+
+	/**
+	 * Write 'tree' to file 'fileName' in binary format. If 'subtree' is
+	 * non-null, write only that subtree; its first record then has the
+	 * full path of 'subtree' as its name, so BinaryCacheReader can add it
+	 * to a tree that already has its parent.
+	 *
+	 * Check BinaryCacheWriter::ok() to see if writing the cache file went
+	 * OK.
+	 **/
+	BinaryCacheWriter( const QString & fileName,
+			   DirTree *	   tree,
+			   FileInfo *	   subtree = 0 );
+
+	/**
+	 * Write the snapshot 'snapshot' of the directory 'toplevelPath' to
+	 * file 'fileName' in binary format. This does not touch the tree, so
+	 * it can be used in any thread (see BackgroundCacheWriter).
+	 *
+	 * If 'cancel' is non-null, writing fails as soon as it is set. If
+	 * 'itemsWritten' is non-null, it is increased with each item.
+	 **/
+	BinaryCacheWriter( const QString &	      fileName,
+			   const TreeSnapshotDirPtr & snapshot,
+			   const QString &	      toplevelPath,
+			   bool			      withUidGidPerm,
+			   const QAtomicInt *	      cancel	   = 0,
+			   QAtomicInt *		      itemsWritten = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~BinaryCacheWriter();
+
+	/**
+	 * Returns true if writing the cache file went OK.
+	 **/
+	bool ok() const { return _ok; }
+
+    protected:
+
+	/**
+	 * Write the cache file. Returns 'true' if OK, 'false' upon error.
+	 **/
+	bool writeCache( const QString & fileName, DirTree * tree, FileInfo * subtree );
+
+	/**
+	 * Open the output file and the temporary file for the string table
+	 * and write a dummy header. Returns 'true' if OK, 'false' upon error.
+	 **/
+	bool openFile( const QString & fileName );
+
+	/**
+	 * Write the real header and the string table and close the output
+	 * file. Returns 'true' if OK, 'false' upon error.
+	 **/
+	bool closeFile( const QString & fileName );
+
+	/**
+	 * Write 'item' and its subtree recursively.
+	 **/
+	void writeTree( FileInfo * item );
+
+	/**
+	 * Write the snapshot 'dir' with 'name' and its subtree recursively.
+	 **/
+	void writeSnapshot( const TreeSnapshotDir * dir, const QByteArray & name );
+
+	/**
+	 * Write one record for 'item' with 'name' and return its index.
+	 **/
+	quint64 writeRecord( FileInfo * item, const QByteArray & name );
+	quint64 writeRecord( const SnapshotItem & item, const QByteArray & name );
+
+	/**
+	 * Write the record 'rec' with 'name' and return its index. The name
+	 * and subtree fields of 'rec' are set here.
+	 **/
+	quint64 writeRecord( BinaryCacheRecord & rec, const QByteArray & name );
+
+	/**
+	 * Go back to record no. 'index' and set its subtreeEnd field.
+	 **/
+	void patchSubtreeEnd( quint64 index, quint64 subtreeEnd );
+
+	/**
+	 * Append the string table to the output file.
+	 **/
+	bool appendStrings();
+
+	/**
+	 * Write 'size' bytes from 'data' to the output file.
+	 **/
+	void write( QIODevice & dev, const void * data, qint64 size );
+
+
+	QFile		_file;
+	QTemporaryFile	_strings;
+	QHash<QByteArray, quint64> _nameOffsets;	// short names already written
+	FileInfo *	_toplevel;
+	quint64		_stringsSize;
+	quint64		_recordCount;
+	bool		_withUidGidPerm;
+	bool		_ok;
+	const QAtomicInt * _cancel;
+	QAtomicInt *	_itemsWritten;
+
+    };	// class BinaryCacheWriter
+
+
+
+    /**
+     * Reader for binary cache files.
+     *
+     * The cache file is mapped into memory, and the records are used
+     * directly from there; no parsing at all is needed.
+     *
+     * This is normally not used directly, but through CacheReader which
+     * automatically detects the binary format.
+     **/
+    class BinaryCacheReader
+    {
+    public:
+
+	/**
+	 * Constructor: Open and map cache file 'fileName'. Its content will
+	 * be added to 'tree' below 'parent' (or below the tree's root if
+	 * 'parent' is 0).
+	 **/
+	BinaryCacheReader( const QString & fileName,
+			   DirTree	 * tree,
+			   DirInfo	 * parent = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~BinaryCacheReader();
+
+	/**
+	 * Return 'true' if 'fileName' is a binary cache file.
+	 **/
+	static bool isBinaryCache( const QString & fileName );
+
+	/**
+	 * Returns true if reading the cache file went OK.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Returns true if all records are read (or if there was an error).
+	 **/
+	bool eof() const { return ! _ok || _next >= _recordCount; }
+
+	/**
+	 * Read at most 'maxRecords' records (or all if 'maxRecords' is 0).
+	 * Returns 'true' if OK and there is more to read, 'false' otherwise.
+	 **/
+	bool read( int maxRecords = 0 );
+
+	/**
+	 * Start over reading from the first record.
+	 **/
+	void rewind();
+
+	/**
+	 * Return the absolute path of the first directory in this cache file
+	 * or an empty string if there is none.
+	 **/
+	QString firstDir() const;
+
+	/**
+	 * Return the toplevel directory that was created from the first
+	 * record or 0 if that is not read yet.
+	 **/
+	DirInfo * toplevel() const { return _toplevel; }
+
+	/**
+	 * Return 'true' if the cache file has UID, GID and permissions.
+	 **/
+	bool withUidGidPerm() const { return _withUidGidPerm; }
+
+	/**
+	 * Only load the items at or below directory 'path' and the
+	 * directories on the way there. The subtrees of all other
+	 * directories are skipped without creating any tree items.
+	 *
+	 * This has to be called before the first read().
+	 **/
+	void setSubtreePrefix( const QString & path );
+
+    protected:
+
+	/**
+	 * Return 'true' if the record with 'itemName' below 'parent' is not
+	 * wanted: Outside of the subtree prefix or ignored by the filters of
+	 * the tree. 'isDir' is 'true' for a directory that is on the way to
+	 * the subtree prefix.
+	 **/
+	bool skipRecord( DirInfo * parent, const QString & itemName, bool isDir, bool & isAncestor_ret );
+
+	/**
+	 * Check the header and set up the pointers into the mapped file.
+	 **/
+	bool checkHeader();
+
+	/**
+	 * Create a tree item from the current record.
+	 **/
+	void addItem();
+
+	/**
+	 * Return the name of record 'rec' as a QString.
+	 **/
+	QString name( const BinaryCacheRecord & rec ) const;
+
+	/**
+	 * Return 'true' if the name of record 'rec' is completely inside
+	 * the string table. The values come from the file, so they must not
+	 * be added: That might overflow.
+	 **/
+	bool nameInStrings( const BinaryCacheRecord & rec ) const
+	    { return rec.nameOffset <= _stringsSize && rec.nameLength <= _stringsSize - rec.nameOffset; }
+
+	/**
+	 * Log an error and stop reading.
+	 **/
+	void error( const QString & msg );
+
+
+	typedef QPair<DirInfo *, quint64> DirStackEntry;
+
+	DirTree *		    _tree;
+	DirInfo *		    _parent;
+	DirInfo *		    _toplevel;
+	QString			    _fileName;
+	QFile			    _file;
+	uchar *			    _data;
+	qint64			    _dataSize;
+	const BinaryCacheRecord *   _records;
+	const char *		    _strings;
+	quint64			    _stringsSize;
+	quint64			    _recordCount;
+	quint64			    _next;
+	QVector<DirStackEntry>	    _dirStack;
+	QString			    _subtreePrefix;
+	QSet<DirInfo *>		    _prefixAncestors;	// dirs above _subtreePrefix
+	DirInfo *		    _filterDir;		// cache for skipRecord()
+	QString			    _filterDirUrl;
+	bool			    _withUidGidPerm;
+	bool			    _ok;
+
+    };	// class BinaryCacheReader
+
+}	// namespace QDirStat
+
+
+#endif // ifndef BinaryCache_h
@@ -0,0 +1,646 @@
+/*
+ *   File name: BlockGzip.cpp
+ *   Summary:	Multi-threaded gzip compression in independent blocks
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stdarg.h>	// va_list
+#include <stdio.h>	// vsnprintf()
+#include <string.h>	// memcpy(), memset(), memchr()
+
+#include <zlib.h>
+
+#include <QThread>
+#include <QRunnable>
+#include <QMutexLocker>
+
+#include "BlockGzip.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Identifier of the extra field subfield with the block size
+
+#define BLOCK_GZIP_SI1		'Q'
+#define BLOCK_GZIP_SI2		'D'
+
+// Max. size of one compressed block; anything larger is a corrupt file
+
+#define BLOCK_GZIP_MAX_SIZE	( 16 * BLOCK_GZIP_BLOCK_SIZE )
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Thread pool job to compress or decompress one block.
+     **/
+    class BlockGzipJob: public QRunnable
+    {
+    public:
+
+	BlockGzipJob( BlockGzipBlock * block,
+		      bool	       compress,
+		      QMutex	     * mutex,
+		      QWaitCondition * blockDone ):
+	    QRunnable(),
+	    _block( block ),
+	    _compress( compress ),
+	    _mutex( mutex ),
+	    _blockDone( blockDone )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    // This is called in the context of a worker thread!
+	    // Only the block itself is touched here, and only this thread
+	    // uses it until it is marked as done.
+
+	    bool ok;
+
+	    if ( _compress )
+	    {
+		_block->compressed = BlockGzipWriter::compressBlock( _block->data, _block->level );
+		_block->data.clear();
+		ok = ! _block->compressed.isEmpty();
+	    }
+	    else
+	    {
+		ok = BlockGzipReader::decompressBlock( _block->compressed, _block->data );
+		_block->compressed.clear();
+	    }
+
+	    QMutexLocker locker( _mutex );
+	    _block->ok	 = ok;
+	    _block->done = true;
+	    _blockDone->wakeAll();
+	}
+
+    protected:
+
+	BlockGzipBlock * _block;
+	bool		 _compress;
+	QMutex		 * _mutex;
+	QWaitCondition * _blockDone;
+    };
+}
+
+
+static void putLE16( char * buf, quint16 value )
+{
+    buf[0] = (char) (   value	    & 0xFF );
+    buf[1] = (char) ( ( value >> 8 ) & 0xFF );
+}
+
+
+static void putLE32( char * buf, quint32 value )
+{
+    putLE16( buf,     (quint16) ( value	       & 0xFFFF ) );
+    putLE16( buf + 2, (quint16) ( ( value >> 16 ) & 0xFFFF ) );
+}
+
+
+static quint32 getLE32( const char * buf )
+{
+    const uchar * ubuf = (const uchar *) buf;
+
+    return (quint32) ubuf[0]
+	| ( (quint32) ubuf[1] << 8  )
+	| ( (quint32) ubuf[2] << 16 )
+	| ( (quint32) ubuf[3] << 24 );
+}
+
+
+/**
+ * Check if 'buf' is a gzip member header with the block size extra field
+ * and return the block size, or 0 if it is not.
+ **/
+static quint32 blockSize( const char * buf )
+{
+    const uchar * ubuf = (const uchar *) buf;
+
+    if ( ubuf[0] != 0x1F || ubuf[1] != 0x8B ||	  // gzip magic
+	 ubuf[2] != 8				||   // deflate
+	 ubuf[3] != 4				||   // FLG.FEXTRA only
+	 ubuf[10] != 8 || ubuf[11] != 0		||   // XLEN
+	 ubuf[12] != BLOCK_GZIP_SI1		||
+	 ubuf[13] != BLOCK_GZIP_SI2		||
+	 ubuf[14] != 4 || ubuf[15] != 0	     )	     // SLEN
+    {
+	return 0;
+    }
+
+    return getLE32( buf + 16 );
+}
+
+
+
+
+BlockGzipWriter::BlockGzipWriter( const QString & fileName, int threadCount ):
+    _file( fileName ),
+    _blockCount( 0 ),
+    _level( -1 ),
+    _ok( true )
+{
+    if ( threadCount < 1 )
+	threadCount = QThread::idealThreadCount();
+
+    threadCount = qMax( 1, threadCount );
+    _threadPool.setMaxThreadCount( threadCount );
+    _maxPending = 2 * threadCount;
+    _current.reserve( BLOCK_GZIP_BLOCK_SIZE + 1024 );
+
+    if ( ! _file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+	logError() << "Can't open " << fileName << ": " << _file.errorString() << endl;
+	_ok = false;
+    }
+}
+
+
+BlockGzipWriter::~BlockGzipWriter()
+{
+    close();
+}
+
+
+void BlockGzipWriter::printf( const char * format, ... )
+{
+    char    buf[ 1024 ];
+    char *  str = buf;
+    va_list args;
+
+    va_start( args, format );
+    int len = vsnprintf( buf, sizeof( buf ), format, args );
+    va_end( args );
+
+    QByteArray longStr;
+
+    if ( len >= (int) sizeof( buf ) )
+    {
+	// Very long output (unlikely, but possible with long file names)
+
+	longStr.resize( len + 1 );
+	va_start( args, format );
+	vsnprintf( longStr.data(), len + 1, format, args );
+	va_end( args );
+	str = longStr.data();
+    }
+
+    if ( len > 0 )
+	_current.append( str, len );
+
+    if ( _current.size() >= BLOCK_GZIP_BLOCK_SIZE )
+	submitBlock();
+}
+
+
+void BlockGzipWriter::putChar( char c )
+{
+    _current.append( c );
+
+    if ( _current.size() >= BLOCK_GZIP_BLOCK_SIZE )
+	submitBlock();
+}
+
+
+void BlockGzipWriter::write( const char * data, int len )
+{
+    _current.append( data, len );
+
+    if ( _current.size() >= BLOCK_GZIP_BLOCK_SIZE )
+	submitBlock();
+}
+
+
+void BlockGzipWriter::submitBlock()
+{
+    if ( _current.isEmpty() || ! _file.isOpen() )
+	return;
+
+    BlockGzipBlock * block = new BlockGzipBlock();
+    CHECK_NEW( block );
+
+    block->data	 = _current;
+    block->level = _level;
+    _current.clear();
+    _current.reserve( BLOCK_GZIP_BLOCK_SIZE + 1024 );
+    _blocks << block;
+    ++_blockCount;
+
+    _threadPool.start( new BlockGzipJob( block, true, &_mutex, &_blockDone ) );
+
+    // Don't let the queue grow without limits if the tree is walked faster
+    // than the blocks can be compressed
+
+    writeBlocks( _maxPending );
+}
+
+
+void BlockGzipWriter::writeBlocks( int minPending )
+{
+    QMutexLocker locker( &_mutex );
+
+    while ( ! _blocks.isEmpty() )
+    {
+	BlockGzipBlock * block = _blocks.first();
+
+	if ( ! block->done )
+	{
+	    if ( minPending > 0 && _blocks.size() < minPending )
+		return;
+
+	    _blockDone.wait( &_mutex );
+	    continue;
+	}
+
+	_blocks.removeFirst();
+
+	if ( ! block->ok )
+	    _ok = false;
+
+	if ( _ok )
+	{
+	    qint64 size = block->compressed.size();
+	    _blockOffsets << _file.pos();
+
+	    if ( _file.write( block->compressed.constData(), size ) != size )
+	    {
+		logError() << "Error writing " << _file.fileName() << ": "
+			   << _file.errorString() << endl;
+		_ok = false;
+	    }
+	}
+
+	delete block;
+    }
+}
+
+
+bool BlockGzipWriter::close()
+{
+    if ( ! _file.isOpen() )
+	return _ok;
+
+    submitBlock();
+    writeBlocks( 0 );
+    _threadPool.waitForDone();
+    _file.close();
+
+    if ( _file.error() != QFile::NoError )
+	_ok = false;
+
+    return _ok;
+}
+
+
+QByteArray BlockGzipWriter::compressBlock( const QByteArray & data, int level )
+{
+    z_stream zs;
+    memset( &zs, 0, sizeof( zs ) );
+
+    // Negative window bits: Raw deflate data without zlib header;
+    // the gzip header and trailer are written here.
+
+    if ( deflateInit2( &zs, level, Z_DEFLATED,
+		       -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+    {
+	return QByteArray();
+    }
+
+    QByteArray result;
+    result.resize( BLOCK_GZIP_HEADER_SIZE
+		   + deflateBound( &zs, data.size() )
+		   + BLOCK_GZIP_TRAILER_SIZE );
+
+    zs.next_in	 = (Bytef *) data.constData();
+    zs.avail_in	 = data.size();
+    zs.next_out	 = (Bytef *) result.data() + BLOCK_GZIP_HEADER_SIZE;
+    zs.avail_out = result.size() - BLOCK_GZIP_HEADER_SIZE - BLOCK_GZIP_TRAILER_SIZE;
+
+    int rc = deflate( &zs, Z_FINISH );
+    uLong deflatedSize = zs.total_out;
+    deflateEnd( &zs );
+
+    if ( rc != Z_STREAM_END )
+	return QByteArray();
+
+    int totalSize = BLOCK_GZIP_HEADER_SIZE + deflatedSize + BLOCK_GZIP_TRAILER_SIZE;
+    result.resize( totalSize );
+
+    char * buf = result.data();
+    memset( buf, 0, BLOCK_GZIP_HEADER_SIZE );
+
+    buf[ 0] = (char) 0x1F;	// gzip magic
+    buf[ 1] = (char) 0x8B;
+    buf[ 2] = 8;		// CM: deflate
+    buf[ 3] = 4;		// FLG: FEXTRA
+				// 4..7: MTIME (0: not available)
+				// 8: XFL
+    buf[ 9] = 3;		// OS: Unix
+    putLE16( buf + 10, 8 );	// XLEN
+    buf[12] = BLOCK_GZIP_SI1;
+    buf[13] = BLOCK_GZIP_SI2;
+    putLE16( buf + 14, 4 );	// SLEN
+    putLE32( buf + 16, totalSize );
+
+    char * trailer = buf + totalSize - BLOCK_GZIP_TRAILER_SIZE;
+    uLong  crc	   = crc32( 0L, (const Bytef *) data.constData(), data.size() );
+
+    putLE32( trailer,	  (quint32) crc );
+    putLE32( trailer + 4, (quint32) data.size() );
+
+    return result;
+}
+
+
+
+
+BlockGzipReader::BlockGzipReader( const QString & fileName, int threadCount ):
+    _fileName( fileName ),
+    _file( fileName ),
+    _pos( 0 ),
+    _fileEof( false ),
+    _ok( true )
+{
+    if ( threadCount < 1 )
+	threadCount = QThread::idealThreadCount();
+
+    threadCount = qMax( 1, threadCount );
+    _threadPool.setMaxThreadCount( threadCount );
+    _maxPending = 2 * threadCount;
+
+    if ( ! _file.open( QIODevice::ReadOnly ) )
+    {
+	logError() << "Can't open " << fileName << ": " << _file.errorString() << endl;
+	_ok = false;
+	return;
+    }
+
+    readAhead();
+}
+
+
+BlockGzipReader::~BlockGzipReader()
+{
+    clearBlocks();
+}
+
+
+bool BlockGzipReader::isBlockGzip( const QString & fileName )
+{
+    QFile file( fileName );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return false;
+
+    QByteArray header = file.read( BLOCK_GZIP_HEADER_SIZE );
+
+    return header.size() == BLOCK_GZIP_HEADER_SIZE && blockSize( header.constData() ) > 0;
+}
+
+
+bool BlockGzipReader::eof() const
+{
+    if ( ! _ok )
+	return true;
+
+    return _pos >= _current.size() && _blocks.isEmpty() && _fileEof;
+}
+
+
+void BlockGzipReader::readAhead()
+{
+    while ( _ok && ! _fileEof && _blocks.size() < _maxPending )
+    {
+	QByteArray header = _file.read( BLOCK_GZIP_HEADER_SIZE );
+
+	if ( header.isEmpty() )
+	{
+	    _fileEof = true;
+	    return;
+	}
+
+	quint32 size = header.size() == BLOCK_GZIP_HEADER_SIZE ?
+	    blockSize( header.constData() ) : 0;
+
+	if ( size < BLOCK_GZIP_HEADER_SIZE + BLOCK_GZIP_TRAILER_SIZE ||
+	     size > BLOCK_GZIP_MAX_SIZE )
+	{
+	    logError() << _fileName << ": Bad block header at offset "
+		       << _file.pos() - header.size() << endl;
+	    _ok = false;
+	    return;
+	}
+
+	BlockGzipBlock * block = new BlockGzipBlock();
+	CHECK_NEW( block );
+
+	block->compressed = header;
+	block->compressed.append( _file.read( size - BLOCK_GZIP_HEADER_SIZE ) );
+
+	if ( block->compressed.size() != (int) size )
+	{
+	    logError() << _fileName << ": Unexpected end of file" << endl;
+	    delete block;
+	    _ok = false;
+	    return;
+	}
+
+	_blocks << block;
+	_threadPool.start( new BlockGzipJob( block, false, &_mutex, &_blockDone ) );
+    }
+}
+
+
+bool BlockGzipReader::nextBlock()
+{
+    _current.clear();
+    _pos = 0;
+
+    readAhead();
+
+    if ( _blocks.isEmpty() )
+	return false;
+
+    BlockGzipBlock * block = 0;
+
+    {
+	QMutexLocker locker( &_mutex );
+	block = _blocks.first();
+
+	while ( ! block->done )
+	    _blockDone.wait( &_mutex );
+
+	_blocks.removeFirst();
+    }
+
+    if ( block->ok )
+    {
+	_current = block->data;
+    }
+    else
+    {
+	logError() << _fileName << ": Corrupt compressed data" << endl;
+	_ok = false;
+    }
+
+    delete block;
+
+    // Start decompressing the next one while this one is being processed
+
+    readAhead();
+
+    return _ok;
+}
+
+
+bool BlockGzipReader::gets( char * buf, int size )
+{
+    if ( ! _ok || size < 1 )
+	return false;
+
+    int len = 0;
+
+    while ( len < size - 1 )
+    {
+	if ( _pos >= _current.size() && ! nextBlock() )
+	    break;
+
+	if ( _current.isEmpty() )
+	    continue;
+
+	const char * start = _current.constData() + _pos;
+	int	     avail = qMin( _current.size() - _pos, size - 1 - len );
+	const char * nl	   = (const char *) memchr( start, '\n', avail );
+	int	     count = nl ? ( nl - start ) + 1 : avail;
+
+	memcpy( buf + len, start, count );
+	len  += count;
+	_pos += count;
+
+	if ( nl )
+	    break;
+    }
+
+    buf[ len ] = 0;
+
+    return len > 0;
+}
+
+
+bool BlockGzipReader::takeBlock( QByteArray & data )
+{
+    if ( ! _ok )
+	return false;
+
+    while ( _pos >= _current.size() )
+    {
+	if ( ! nextBlock() )
+	    return false;
+    }
+
+    data = _pos == 0 ? _current : _current.mid( _pos );
+    _current.clear();
+    _pos = 0;
+
+    return true;
+}
+
+
+void BlockGzipReader::rewind()
+{
+    clearBlocks();
+
+    _current.clear();
+    _pos     = 0;
+    _fileEof = false;
+
+    if ( _file.isOpen() )
+    {
+	_file.seek( 0 );
+	readAhead();
+    }
+}
+
+
+bool BlockGzipReader::seek( qint64 fileOffset, int blockPos )
+{
+    if ( ! _ok || ! _file.isOpen() )
+	return false;
+
+    clearBlocks();
+
+    _current.clear();
+    _pos     = 0;
+    _fileEof = false;
+
+    if ( ! _file.seek( fileOffset ) || ! nextBlock() )
+    {
+	logError() << _fileName << ": Can't seek to block at offset " << fileOffset << endl;
+	_ok = false;
+	return false;
+    }
+
+    if ( blockPos < 0 || blockPos > _current.size() )
+    {
+	logError() << _fileName << ": Bad offset " << blockPos
+		   << " in block at offset " << fileOffset << endl;
+	_ok = false;
+	return false;
+    }
+
+    _pos = blockPos;
+
+    return true;
+}
+
+
+void BlockGzipReader::clearBlocks()
+{
+    _threadPool.waitForDone();
+    qDeleteAll( _blocks );
+    _blocks.clear();
+}
+
+
+bool BlockGzipReader::decompressBlock( const QByteArray & compressed, QByteArray & data )
+{
+    if ( compressed.size() < BLOCK_GZIP_HEADER_SIZE + BLOCK_GZIP_TRAILER_SIZE )
+	return false;
+
+    const char * trailer = compressed.constData() + compressed.size() - BLOCK_GZIP_TRAILER_SIZE;
+    quint32	 crc	 = getLE32( trailer );
+    quint32	 size	 = getLE32( trailer + 4 );
+
+    if ( size > BLOCK_GZIP_MAX_SIZE )
+	return false;
+
+    z_stream zs;
+    memset( &zs, 0, sizeof( zs ) );
+
+    if ( inflateInit2( &zs, -MAX_WBITS ) != Z_OK )
+	return false;
+
+    data.resize( size );
+
+    zs.next_in	 = (Bytef *) compressed.constData() + BLOCK_GZIP_HEADER_SIZE;
+    zs.avail_in	 = compressed.size() - BLOCK_GZIP_HEADER_SIZE - BLOCK_GZIP_TRAILER_SIZE;
+    zs.next_out	 = (Bytef *) data.data();
+    zs.avail_out = size;
+
+    int rc = inflate( &zs, Z_FINISH );
+    bool ok = rc == Z_STREAM_END && zs.total_out == size;
+    inflateEnd( &zs );
+
+    if ( ok )
+	ok = crc32( 0L, (const Bytef *) data.constData(), data.size() ) == crc;
+
+    if ( ! ok )
+	data.clear();
+
+    return ok;
+}
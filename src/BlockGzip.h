@@ -0,0 +1,294 @@
+/*
+ *   File name: BlockGzip.h
+ *   Summary:	Multi-threaded gzip compression in independent blocks
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef BlockGzip_h
+#define BlockGzip_h
+
+
+#include <QFile>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+
+
+// Uncompressed size of one block
+
+#define BLOCK_GZIP_BLOCK_SIZE	( 1024 * 1024 )
+
+// Size of the gzip member header with the block size in the extra field
+
+#define BLOCK_GZIP_HEADER_SIZE	20
+
+// Size of the gzip member trailer (CRC32 and uncompressed size)
+
+#define BLOCK_GZIP_TRAILER_SIZE 8
+
+
+namespace QDirStat
+{
+    /**
+     * One block of a block gzip file: The uncompressed data and the
+     * complete gzip member for them.
+     **/
+    struct BlockGzipBlock
+    {
+	QByteArray data;
+	QByteArray compressed;
+	int	   level;	// zlib compression level
+	bool	   done;
+	bool	   ok;
+
+	BlockGzipBlock(): level( -1 ), done( false ), ok( false ) {}
+    };
+
+
+    /**
+     * Writer for gzip files that consist of independently compressed blocks.
+     *
+     * Each block is a complete gzip member of its own, and a gzip file may
+     * consist of any number of members. So the result is a perfectly normal
+     * gzip file that can be read with gzip, zcat or zlib's gzread() /
+     * gzgets(); but the blocks can be compressed in parallel, and since
+     * each block header contains the size of the block in an extra field
+     * (very much like BGZF), BlockGzipReader can also decompress them in
+     * parallel.
+     *
+     * Data are collected in a block buffer in the calling thread; full
+     * blocks are compressed in a thread pool, and the compressed blocks are
+     * written in the original order as they become ready.
+     **/
+    class BlockGzipWriter
+    {
+    public:
+
+	/**
+	 * Constructor: Create file 'fileName' and prepare for writing. Use
+	 * 'threadCount' compression threads; 0 means one per CPU core.
+	 **/
+	BlockGzipWriter( const QString & fileName, int threadCount = 0 );
+
+	/**
+	 * Destructor. This closes the file if that was not done yet.
+	 **/
+	virtual ~BlockGzipWriter();
+
+	/**
+	 * Return 'true' if everything went OK so far.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Write formatted output like printf().
+	 **/
+	void printf( const char * format, ... )
+#ifdef __GNUC__
+	    __attribute__(( format( printf, 2, 3 ) ))
+#endif
+	    ;
+
+	/**
+	 * Write one character.
+	 **/
+	void putChar( char c );
+
+	/**
+	 * Write 'len' bytes at 'data'.
+	 **/
+	void write( const char * data, int len );
+
+	/**
+	 * Write 'data'.
+	 **/
+	void write( const QByteArray & data )
+	    { write( data.constData(), data.size() ); }
+
+	/**
+	 * Set the zlib compression level for the blocks that are written
+	 * from now on: 1 is the fastest, 9 the best compression, -1 the zlib
+	 * default (6).
+	 **/
+	void setCompressionLevel( int level ) { _level = level; }
+
+	/**
+	 * Compress and write all pending data and close the file.
+	 * Return 'true' if everything went OK.
+	 **/
+	bool close();
+
+	/**
+	 * Compress 'data' into a complete gzip member with a block size
+	 * extra field with zlib compression level 'level'.
+	 **/
+	static QByteArray compressBlock( const QByteArray & data, int level = -1 );
+
+	/**
+	 * Return the number of the block that the next output goes to.
+	 **/
+	int blockNo() const { return _blockCount; }
+
+	/**
+	 * Return the offset in the current block where the next output goes
+	 * to.
+	 **/
+	int blockPos() const { return _current.size(); }
+
+	/**
+	 * Return the file offsets of the blocks that are written so far by
+	 * their number. After close(), this is the complete list.
+	 **/
+	const QVector<qint64> & blockOffsets() const { return _blockOffsets; }
+
+    protected:
+
+	/**
+	 * Hand the current block buffer over to the thread pool.
+	 **/
+	void submitBlock();
+
+	/**
+	 * Write the blocks at the head of the queue that are compressed.
+	 * If 'minPending' is > 0, wait until only that many blocks are still
+	 * in the queue; if it is 0, wait until all are written.
+	 **/
+	void writeBlocks( int minPending );
+
+
+	QFile			 _file;
+	QThreadPool		 _threadPool;
+	QByteArray		 _current;
+	QList<BlockGzipBlock *>	 _blocks;
+	QMutex			 _mutex;
+	QWaitCondition		 _blockDone;
+	QVector<qint64>		 _blockOffsets;
+	int			 _blockCount;
+	int			 _maxPending;
+	int			 _level;
+	bool			 _ok;
+
+    };	// class BlockGzipWriter
+
+
+
+    /**
+     * Reader for files written by BlockGzipWriter.
+     *
+     * This reads the compressed blocks ahead and decompresses several of
+     * them in parallel in a thread pool while the caller is still busy with
+     * the data of the current block.
+     **/
+    class BlockGzipReader
+    {
+    public:
+
+	/**
+	 * Constructor: Open 'fileName' for reading. Use 'threadCount'
+	 * decompression threads; 0 means one per CPU core.
+	 **/
+	BlockGzipReader( const QString & fileName, int threadCount = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~BlockGzipReader();
+
+	/**
+	 * Return 'true' if 'fileName' is a file written by BlockGzipWriter,
+	 * i.e. if its first gzip member has the block size extra field.
+	 **/
+	static bool isBlockGzip( const QString & fileName );
+
+	/**
+	 * Return 'true' if everything went OK so far.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Return 'true' if all the data are read (or if there was an error).
+	 **/
+	bool eof() const;
+
+	/**
+	 * Read one line (including the trailing newline), but at most
+	 * 'size' - 1 characters into 'buf' and terminate it with a 0 byte.
+	 * This works like zlib's gzgets() or fgets().
+	 *
+	 * Return 'false' if nothing could be read.
+	 **/
+	bool gets( char * buf, int size );
+
+	/**
+	 * Take the rest of the decompressed data of the current block or the
+	 * next one and store it in 'data'. This does not copy anything
+	 * (QByteArray is implicitly shared), so it is much faster than
+	 * gets() for callers that can handle lines that continue in the
+	 * next block.
+	 *
+	 * Return 'false' if there is nothing left to read.
+	 **/
+	bool takeBlock( QByteArray & data );
+
+	/**
+	 * Start over from the beginning of the file.
+	 **/
+	void rewind();
+
+	/**
+	 * Continue reading at offset 'blockPos' in the decompressed data of
+	 * the block that starts at 'fileOffset' in the file, e.g. from the
+	 * positions in a CacheIndex. Return 'false' if that is not possible.
+	 **/
+	bool seek( qint64 fileOffset, int blockPos );
+
+	/**
+	 * Decompress the gzip member 'compressed' into 'data'.
+	 * Return 'true' if OK, 'false' if there was an error.
+	 **/
+	static bool decompressBlock( const QByteArray & compressed, QByteArray & data );
+
+    protected:
+
+	/**
+	 * Read compressed blocks from the file and start decompressing them
+	 * until enough are in the queue.
+	 **/
+	void readAhead();
+
+	/**
+	 * Make the next decompressed block the current one. Return 'false'
+	 * if there is none.
+	 **/
+	bool nextBlock();
+
+	/**
+	 * Wait for all blocks in the queue and delete them.
+	 **/
+	void clearBlocks();
+
+
+	QString			 _fileName;
+	QFile			 _file;
+	QThreadPool		 _threadPool;
+	QList<BlockGzipBlock *>	 _blocks;
+	QMutex			 _mutex;
+	QWaitCondition		 _blockDone;
+	QByteArray		 _current;
+	int			 _pos;
+	int			 _maxPending;
+	bool			 _fileEof;
+	bool			 _ok;
+
+    };	// class BlockGzipReader
+
+}	// namespace QDirStat
+
+
+#endif // ifndef BlockGzip_h
@@ -0,0 +1,370 @@
+/*
+ *   File name: CacheDelta.cpp
+ *   Summary:	Delta cache files against a baseline cache file
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QFileInfo>
+#include <QDir>
+
+#include "CacheDelta.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Max. number of delta cache files in a chain (to catch loops)
+
+#define MAX_DELTA_CHAIN		1000
+
+#define FNV_OFFSET_BASIS	14695981039346656037ULL
+#define FNV_PRIME		1099511628211ULL
+
+using namespace QDirStat;
+
+
+/**
+ * Add 'len' bytes at 'data' to FNV-1a hash 'hash'.
+ **/
+static quint64 fnvHash( quint64 hash, const void * data, int len )
+{
+    const unsigned char * bytes = (const unsigned char *) data;
+
+    for ( int i=0; i < len; ++i )
+    {
+	hash ^= bytes[ i ];
+	hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+
+CacheDelta::CacheDelta( const QString & fileName ):
+    _ok( true ),
+    _skipFiles( false )
+{
+    QString name = fileName;
+
+    while ( _ok )
+    {
+	if ( _deltas.size() >= MAX_DELTA_CHAIN )
+	{
+	    logError() << "Delta cache file chain too long at " << name << endl;
+	    _ok = false;
+	    break;
+	}
+
+	CacheParser parser( name );
+
+	if ( ! parser.ok() )
+	{
+	    _ok = false;
+	    break;
+	}
+
+	if ( ! parser.isDelta() )
+	{
+	    _baseFileName = name;
+	    break;
+	}
+
+	DeltaFile delta;
+	QString	  baseline;
+
+	_ok = loadDelta( parser, delta, baseline );
+	_deltas.prepend( delta );
+
+	// A relative baseline path is relative to the delta cache file
+
+	if ( QFileInfo( baseline ).isRelative() )
+	    baseline = QFileInfo( name ).dir().filePath( baseline );
+
+	name = baseline;
+    }
+
+    if ( ! _deltas.isEmpty() )
+    {
+	logInfo() << "Applying " << _deltas.size() << " delta cache files to "
+		  << _baseFileName << endl;
+    }
+}
+
+
+CacheDelta::~CacheDelta()
+{
+    // NOP
+}
+
+
+bool CacheDelta::loadDelta( CacheParser & parser,
+			    DeltaFile	& delta,
+			    QString	& baseline_ret )
+{
+    CacheItemBatch   batch;
+    CacheItemBatch * current = 0;
+
+    while ( parser.takeBatch( batch ) )
+    {
+	foreach ( const CacheItem & item, batch )
+	{
+	    if ( item.syntaxError )
+	    {
+		logError() << "Syntax error in " << parser.fileName() << ":" << item.lineNo << endl;
+		return false;
+	    }
+
+	    if ( item.isBaseline )
+		baseline_ret = item.path;
+	    else if ( item.isRemoved )
+		delta.removed.insert( item.path );
+	    else if ( item.isDir )
+	    {
+		QString key = dirKey( item.path, item.name );
+		current = &delta.blocks[ key ];
+		current->clear();
+		*current << item;
+		delta.blockOrder << key;
+	    }
+	    else if ( ! item.isPending )
+	    {
+		CacheItemBatch * block = item.absolute ? &delta.blocks[ item.path ] : current;
+
+		if ( block && ! block->isEmpty() )
+		    *block << item;
+		else
+		{
+		    logError() << parser.fileName() << ":" << item.lineNo << ": "
+			       << "No directory for " << item.name << endl;
+		}
+
+		if ( block != current )
+		    current = 0; // The hash may be rehashed; don't keep a stale pointer
+	    }
+	}
+
+	batch.clear();
+    }
+
+    // Drop any empty blocks that were only created by lookups
+
+    QMutableHashIterator<QString, CacheItemBatch> it( delta.blocks );
+
+    while ( it.hasNext() )
+    {
+	if ( it.next().value().isEmpty() )
+	    it.remove();
+    }
+
+    if ( baseline_ret.isEmpty() )
+    {
+	logError() << "No baseline cache file in " << parser.fileName() << endl;
+	return false;
+    }
+
+    return parser.ok();
+}
+
+
+void CacheDelta::merge( const CacheItemBatch & in, CacheItemBatch & out )
+{
+    foreach ( const CacheItem & item, in )
+    {
+	if ( item.syntaxError || item.isPending || item.isRemoved || item.isBaseline )
+	{
+	    out << item;
+	    continue;
+	}
+
+	bool removed = false;
+
+	if ( item.isDir )
+	{
+	    QString key = dirKey( item.path, item.name );
+	    const CacheItemBatch * block = resolve( key, removed );
+
+	    if ( block )
+	    {
+		out += *block;
+		_replaced.insert( key );
+	    }
+	    else if ( ! removed )
+		out << item;
+
+	    // The files of this directory follow; they are in the block
+
+	    _skipFiles = block || removed;
+	}
+	else if ( item.absolute )
+	{
+	    if ( ! resolve( item.path, removed ) && ! removed )
+		out << item;
+	}
+	else if ( ! _skipFiles )
+	{
+	    out << item;
+	}
+    }
+}
+
+
+void CacheDelta::finish( CacheItemBatch & out )
+{
+    // In the order they first appeared in the chain, so parents are
+    // always added before their children
+
+    foreach ( const DeltaFile & delta, _deltas )
+    {
+	foreach ( const QString & key, delta.blockOrder )
+	{
+	    if ( _replaced.contains( key ) )
+		continue;
+
+	    _replaced.insert( key );
+	    bool removed = false;
+	    const CacheItemBatch * block = resolve( key, removed );
+
+	    if ( block )
+		out += *block;
+	}
+    }
+}
+
+
+void CacheDelta::rewind()
+{
+    _replaced.clear();
+    _skipFiles = false;
+}
+
+
+const CacheItemBatch * CacheDelta::resolve( const QString & key, bool & removed_ret ) const
+{
+    removed_ret = false;
+
+    for ( int i = _deltas.size() - 1; i >= 0; --i )
+    {
+	const DeltaFile & delta = _deltas.at( i );
+	QHash<QString, CacheItemBatch>::const_iterator it = delta.blocks.find( key );
+
+	if ( it != delta.blocks.end() )
+	    return &it.value();
+
+	if ( removes( delta, key ) )
+	{
+	    removed_ret = true;
+	    return 0;
+	}
+    }
+
+    return 0;
+}
+
+
+bool CacheDelta::removes( const DeltaFile & delta, const QString & key )
+{
+    if ( delta.removed.isEmpty() )
+	return false;
+
+    QString path = key;
+
+    while ( ! path.isEmpty() )
+    {
+	if ( delta.removed.contains( path ) )
+	    return true;
+
+	int pos = path.lastIndexOf( '/' );
+
+	if ( pos <= 0 )
+	    break;
+
+	path.truncate( pos );
+    }
+
+    return false;
+}
+
+
+QString CacheDelta::dirKey( const QString & path, const QString & name )
+{
+    if ( path.isEmpty() )
+	return name;
+    else if ( name.isEmpty() )
+	return path;
+    else if ( path == "/" )
+	return path + name;
+    else return path + "/" + name;
+}
+
+
+quint64 CacheDelta::itemSignature( const QString & name,
+				   mode_t	   mode,
+				   FileSize	   size,
+				   uid_t	   uid,
+				   gid_t	   gid,
+				   time_t	   mtime,
+				   FileSize	   blocks,
+				   int		   links )
+{
+    qint64 fields[] = { mode, size, uid, gid, mtime, blocks, links };
+
+    quint64 hash = fnvHash( FNV_OFFSET_BASIS, fields, sizeof( fields ) );
+
+    return fnvHash( hash, name.constData(), name.size() * sizeof( QChar ) );
+}
+
+
+bool CacheDelta::readSignatures( const QString		 & fileName,
+				 QHash<QString, quint64> & signatures_ret,
+				 bool			 & withUidGidPerm_ret )
+{
+    CacheDelta delta( fileName );
+
+    if ( ! delta.ok() )
+	return false;
+
+    CacheParser parser( delta.baseFileName() );
+
+    if ( ! parser.ok() )
+	return false;
+
+    withUidGidPerm_ret = parser.withUidGidPerm();
+
+    CacheItemBatch batch;
+    CacheItemBatch merged;
+    QString	   currentDir;
+    bool	   done = false;
+
+    while ( ! done )
+    {
+	if ( parser.takeBatch( batch ) )
+	    delta.merge( batch, merged );
+	else
+	{
+	    delta.finish( merged );
+	    done = true;
+	}
+
+	foreach ( const CacheItem & item, merged )
+	{
+	    if ( item.syntaxError || item.isPending || item.isRemoved || item.isBaseline )
+		continue;
+
+	    if ( item.isDir )
+		currentDir = dirKey( item.path, item.name );
+
+	    const QString & key = item.isDir || ! item.absolute ? currentDir : item.path;
+
+	    signatures_ret[ key ] += itemSignature( item.isDir ? QString() : item.name,
+						    item.mode, item.size,
+						    item.uid, item.gid, item.mtime,
+						    item.blocks, item.links );
+	}
+
+	batch.clear();
+	merged.clear();
+    }
+
+    return parser.ok();
+}
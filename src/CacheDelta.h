@@ -0,0 +1,172 @@
+/*
+ *   File name: CacheDelta.h
+ *   Summary:	Delta cache files against a baseline cache file
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheDelta_h
+#define CacheDelta_h
+
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QList>
+
+#include "CacheParser.h"
+
+
+namespace QDirStat
+{
+    /**
+     * A chain of delta cache files on top of a full cache file.
+     *
+     * A delta cache file only contains the directories that changed since
+     * its baseline cache file was written: For each of them the "D" line
+     * and the lines of all its direct non-directory children, just like in
+     * a full cache file. Directories that no longer exist are listed in
+     * "Removed" lines. A "Baseline" line refers to the baseline cache file
+     * which may be a delta cache file itself.
+     *
+     * CacheReader reads the full cache file at the start of the chain and
+     * uses merge() to replace the changed directories and to drop the
+     * removed ones on the fly; finish() adds the directories that are new
+     * in any of the deltas.
+     **/
+    class CacheDelta
+    {
+    public:
+
+	/**
+	 * Constructor: Load the chain of delta cache files that starts with
+	 * 'fileName'. If 'fileName' is not a delta cache file, the chain is
+	 * empty and baseFileName() is 'fileName'. Check ok() for the result.
+	 **/
+	CacheDelta( const QString & fileName );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~CacheDelta();
+
+	/**
+	 * Return 'true' if the complete chain could be loaded.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Return the name of the full cache file at the start of the chain.
+	 **/
+	const QString & baseFileName() const { return _baseFileName; }
+
+	/**
+	 * Return the number of delta cache files in the chain.
+	 **/
+	int chainLength() const { return _deltas.size(); }
+
+	/**
+	 * Merge a batch of items from the base cache file with the deltas
+	 * and append the result to 'out': Directories that were changed in a
+	 * delta are replaced with the newest version from the deltas, removed
+	 * directories are dropped.
+	 **/
+	void merge( const CacheItemBatch & in, CacheItemBatch & out );
+
+	/**
+	 * Append the directories that are not in the base cache file (that
+	 * were added in one of the deltas) to 'out'. Call this once after the
+	 * complete base cache file was merged.
+	 **/
+	void finish( CacheItemBatch & out );
+
+	/**
+	 * Start over for reading the base cache file again.
+	 **/
+	void rewind();
+
+	/**
+	 * Return the key for a directory with path 'path' and name 'name'
+	 * (its full path).
+	 **/
+	static QString dirKey( const QString & path, const QString & name );
+
+	/**
+	 * Return a signature of the fields of one cache file item. The
+	 * signature of a directory is the sum of the signature of its own
+	 * fields (without a name) and those of its direct non-directory
+	 * children, so it does not depend on the order of the children.
+	 **/
+	static quint64 itemSignature( const QString & name,
+				      mode_t	      mode,
+				      FileSize	      size,
+				      uid_t	      uid,
+				      gid_t	      gid,
+				      time_t	      mtime,
+				      FileSize	      blocks,
+				      int	      links );
+
+	/**
+	 * Read cache file 'fileName' (a full or a delta cache file) and
+	 * return the signature of each directory in 'signatures_ret' and if
+	 * it has UID, GID and permissions in 'withUidGidPerm_ret'.
+	 *
+	 * Return 'false' upon error.
+	 **/
+	static bool readSignatures( const QString	    & fileName,
+				    QHash<QString, quint64> & signatures_ret,
+				    bool		    & withUidGidPerm_ret );
+
+
+    protected:
+
+	/**
+	 * One delta cache file.
+	 **/
+	struct DeltaFile
+	{
+	    QHash<QString, CacheItemBatch> blocks;	// By directory key
+	    QStringList			   blockOrder;
+	    QSet<QString>		   removed;
+	};
+
+	/**
+	 * Load delta cache file 'parser' into 'delta' and return the name
+	 * of its baseline cache file in 'baseline_ret'.
+	 **/
+	bool loadDelta( CacheParser & parser,
+			DeltaFile   & delta,
+			QString	    & baseline_ret );
+
+	/**
+	 * Return the newest version of the directory with key 'key' from the
+	 * deltas or 0 if it did not change. 'removed_ret' is set to 'true' if
+	 * the directory or one of its ancestors was removed.
+	 **/
+	const CacheItemBatch * resolve( const QString & key, bool & removed_ret ) const;
+
+	/**
+	 * Return 'true' if 'delta' removes the directory with key 'key' or one
+	 * of its ancestors.
+	 **/
+	static bool removes( const DeltaFile & delta, const QString & key );
+
+
+	//
+	// Data members
+	//
+
+	QString		 _baseFileName;
+	QList<DeltaFile> _deltas;	// Oldest first
+	bool		 _ok;
+	bool		 _skipFiles;	// Skip the files of the current base directory
+	QSet<QString>	 _replaced;	// Directories from the deltas that were in the base
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheDelta_h
@@ -0,0 +1,328 @@
+/*
+ *   File name: CacheIndex.cpp
+ *   Summary:	Directory offset index for QDirStat cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QUrl>
+
+#include "CacheIndex.h"
+#include "Logger.h"
+#include "Exception.h"
+
+#define CACHE_INDEX_HEADER	"[qdirstat 1.0 cache index]"
+
+using namespace QDirStat;
+
+
+/**
+ * Return 'true' if 'path' is somewhere below directory 'dir'.
+ **/
+static bool isBelow( const QString & path, const QString & dir )
+{
+    if ( ! path.startsWith( dir ) || path.size() <= dir.size() )
+	return false;
+
+    return dir.endsWith( '/' ) || path.at( dir.size() ) == '/';
+}
+
+
+CacheIndex::CacheIndex():
+    _endFileOffset( -1 ),
+    _endBlockPos( 0 ),
+    _summaryFileOffset( -1 ),
+    _summaryBlockPos( 0 )
+{
+}
+
+
+QString CacheIndex::fileName( const QString & cacheFileName )
+{
+    return cacheFileName + CACHE_INDEX_SUFFIX;
+}
+
+
+void CacheIndex::add( const QString & path,
+		      int	      blockNo,
+		      int	      blockPos,
+		      FileSize	      allocatedSize )
+{
+    CacheIndexEntry entry;
+
+    entry.path		= path;
+    entry.fileOffset	= blockNo;	// Converted in write()
+    entry.blockPos	= blockPos;
+    entry.allocatedSize = allocatedSize;
+    entry.subtreeEnd	= -1;
+
+    _entries << entry;
+}
+
+
+void CacheIndex::setEnd( int blockNo, int blockPos )
+{
+    _endFileOffset = blockNo;		// Converted in write()
+    _endBlockPos   = blockPos;
+}
+
+
+void CacheIndex::setSummary( int blockNo, int blockPos )
+{
+    _summaryFileOffset = blockNo;	// Converted in write()
+    _summaryBlockPos   = blockPos;
+}
+
+
+bool CacheIndex::write( const QString &		cacheFileName,
+			const QVector<qint64> & blockOffsets )
+{
+    QFileInfo cacheInfo( cacheFileName );
+    QFile     file( fileName( cacheFileName ) );
+
+    if ( ! file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+	logError() << "Can't open " << file.fileName() << ": " << file.errorString() << endl;
+	return false;
+    }
+
+    QByteArray data;
+    data.reserve( _entries.size() * 64 + 256 );
+
+    data += CACHE_INDEX_HEADER "\n"
+	"# Do not edit!\n"
+	"#\n"
+	"# Size and mtime of the cache file\n"
+	"#\n";
+
+    data += "Cache\t" + QByteArray::number( cacheInfo.size() ) + "\t"
+	+ QByteArray::number( (qint64) cacheInfo.lastModified().toTime_t() ) + "\n";
+
+    if ( _summaryFileOffset >= 0 && _summaryFileOffset < blockOffsets.size() )
+    {
+	// Before the directories, so readSummaryPos() is done right away
+
+	data += "Summary\t" + QByteArray::number( blockOffsets.at( _summaryFileOffset ) ) + "\t"
+	    + QByteArray::number( _summaryBlockPos ) + "\n";
+    }
+
+    data += "#\n"
+	"# File offset of the block, offset in the block, allocated size, path\n"
+	"#\n";
+
+    foreach ( const CacheIndexEntry & entry, _entries )
+    {
+	if ( entry.fileOffset < 0 || entry.fileOffset >= blockOffsets.size() )
+	{
+	    logError() << "No block #" << entry.fileOffset << " for " << entry.path << endl;
+	    file.close();
+	    file.remove();
+
+	    return false;
+	}
+
+	data += QByteArray::number( blockOffsets.at( entry.fileOffset ) ) + "\t"
+	    + QByteArray::number( entry.blockPos ) + "\t"
+	    + QByteArray::number( entry.allocatedSize ) + "\t"
+	    + QUrl::toPercentEncoding( entry.path, "/" ) + "\n";
+    }
+
+    if ( _endFileOffset >= 0 && _endFileOffset < blockOffsets.size() )
+    {
+	data += "End\t" + QByteArray::number( blockOffsets.at( _endFileOffset ) ) + "\t"
+	    + QByteArray::number( _endBlockPos ) + "\n";
+    }
+
+    if ( file.write( data ) != data.size() )
+    {
+	logError() << "Error writing " << file.fileName() << ": " << file.errorString() << endl;
+	file.close();
+	file.remove();
+
+	return false;
+    }
+
+    return true;
+}
+
+
+bool CacheIndex::read( const QString & cacheFileName )
+{
+    _entries.clear();
+    _pathIndex.clear();
+    _endFileOffset     = -1;
+    _endBlockPos       = 0;
+    _summaryFileOffset = -1;
+    _summaryBlockPos   = 0;
+
+    QFile file( fileName( cacheFileName ) );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return false;		// No index - this is not an error
+
+    if ( file.readLine().trimmed() != CACHE_INDEX_HEADER )
+    {
+	logWarning() << file.fileName() << " is no cache index" << endl;
+	return false;
+    }
+
+    QFileInfo cacheInfo( cacheFileName );
+    bool      matching = false;
+    bool      ok       = true;
+    int	      lineNo   = 1;
+
+    while ( ok && ! file.atEnd() )
+    {
+	QByteArray line = file.readLine();
+	++lineNo;
+
+	if ( line.endsWith( '\n' ) )
+	    line.chop( 1 );
+
+	if ( line.isEmpty() || line.startsWith( '#' ) )
+	    continue;
+
+	QList<QByteArray> fields = line.split( '\t' );
+
+	if ( fields.first() == "Cache" && fields.size() == 3 )
+	{
+	    matching = fields.at( 1 ).toLongLong() == cacheInfo.size() &&
+		fields.at( 2 ).toLongLong() == (qint64) cacheInfo.lastModified().toTime_t();
+
+	    if ( ! matching )
+	    {
+		logInfo() << file.fileName() << " is outdated - not using it" << endl;
+		return false;
+	    }
+	}
+	else if ( fields.first() == "End" && fields.size() == 3 )
+	{
+	    _endFileOffset = fields.at( 1 ).toLongLong( &ok );
+
+	    if ( ok )
+		_endBlockPos = fields.at( 2 ).toInt( &ok );
+	}
+	else if ( fields.first() == "Summary" && fields.size() == 3 )
+	{
+	    _summaryFileOffset = fields.at( 1 ).toLongLong( &ok );
+
+	    if ( ok )
+		_summaryBlockPos = fields.at( 2 ).toInt( &ok );
+	}
+	else if ( fields.size() == 4 )
+	{
+	    CacheIndexEntry entry;
+
+	    entry.fileOffset = fields.at( 0 ).toLongLong( &ok );
+
+	    if ( ok )
+		entry.blockPos = fields.at( 1 ).toInt( &ok );
+
+	    if ( ok )
+		entry.allocatedSize = fields.at( 2 ).toLongLong( &ok );
+
+	    entry.path	     = QUrl::fromPercentEncoding( fields.at( 3 ) );
+	    entry.subtreeEnd = -1;
+
+	    _pathIndex.insert( entry.path, _entries.size() );
+	    _entries << entry;
+	}
+	else
+	{
+	    ok = false;
+	}
+    }
+
+    if ( ! ok || ! matching )
+    {
+	logWarning() << file.fileName() << ":" << lineNo << ": Syntax error - not using it" << endl;
+	_entries.clear();
+	_pathIndex.clear();
+
+	return false;
+    }
+
+    findSubtreeEnds();
+    logDebug() << "Using " << file.fileName() << " with " << _entries.size() << " directories" << endl;
+
+    return true;
+}
+
+
+bool CacheIndex::readSummaryPos( const QString & cacheFileName,
+				 qint64	       & fileOffset_ret,
+				 int	       & blockPos_ret )
+{
+    QFile file( fileName( cacheFileName ) );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return false;
+
+    if ( file.readLine().trimmed() != CACHE_INDEX_HEADER )
+	return false;
+
+    QFileInfo cacheInfo( cacheFileName );
+    bool      matching = false;
+
+    while ( ! file.atEnd() )
+    {
+	QByteArray line = file.readLine().trimmed();
+
+	if ( line.isEmpty() || line.startsWith( '#' ) )
+	    continue;
+
+	QList<QByteArray> fields = line.split( '\t' );
+
+	if ( fields.first() == "Cache" && fields.size() == 3 )
+	{
+	    matching = fields.at( 1 ).toLongLong() == cacheInfo.size() &&
+		fields.at( 2 ).toLongLong() == (qint64) cacheInfo.lastModified().toTime_t();
+
+	    if ( ! matching )
+		return false;
+	}
+	else if ( fields.first() == "Summary" && fields.size() == 3 )
+	{
+	    bool ok = false;
+	    fileOffset_ret = fields.at( 1 ).toLongLong( &ok );
+
+	    if ( ok )
+		blockPos_ret = fields.at( 2 ).toInt( &ok );
+
+	    return ok && matching;
+	}
+	else
+	{
+	    return false;	// The directories start: No summary
+	}
+    }
+
+    return false;
+}
+
+
+void CacheIndex::findSubtreeEnds()
+{
+    // The directories are in depth-first order, so the subtree of each
+    // one ends with the next one that is not below it.
+
+    QVector<int> stack;
+
+    for ( int i=0; i < _entries.size(); ++i )
+    {
+	const QString & path = _entries.at( i ).path;
+
+	while ( ! stack.isEmpty() && ! isBelow( path, _entries.at( stack.last() ).path ) )
+	    _entries[ stack.takeLast() ].subtreeEnd = i;
+
+	stack << i;
+    }
+
+    while ( ! stack.isEmpty() )
+	_entries[ stack.takeLast() ].subtreeEnd = _entries.size();
+}
@@ -0,0 +1,167 @@
+/*
+ *   File name: CacheIndex.h
+ *   Summary:	Directory offset index for QDirStat cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheIndex_h
+#define CacheIndex_h
+
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+#include "FileSize.h"
+
+
+// Name suffix of the index file that is written next to a cache file
+
+#define CACHE_INDEX_SUFFIX	".idx"
+
+
+namespace QDirStat
+{
+    /**
+     * Position of one directory in a block gzip cache file.
+     **/
+    struct CacheIndexEntry
+    {
+	QString	 path;
+	qint64	 fileOffset;	// Offset of the block with the "D" line
+	int	 blockPos;	// Offset of the "D" line in that block
+	FileSize allocatedSize;	// Total allocated size of the subtree
+	int	 subtreeEnd;	// Index of the first entry after the subtree
+    };
+
+
+    /**
+     * Index of the directories in a cache file written by CacheWriter: For
+     * each directory, the compressed block where its "D" line is and the
+     * offset of that line in the decompressed data of that block. This is
+     * possible because each block of a BlockGzipWriter file is a gzip
+     * member of its own that can be decompressed without the ones before.
+     *
+     * The index is a small text file next to the cache file (with
+     * CACHE_INDEX_SUFFIX appended). It is optional: Without it, cache files
+     * are simply read from the start.
+     *
+     * With it, CacheParser can jump directly to any directory and, since
+     * the directories are in depth-first order, also over the complete
+     * subtree of any directory. So loading one subtree of a huge cache
+     * file only needs to decompress the blocks of that subtree.
+     *
+     * The index also contains the size and the modification time of the
+     * cache file; if they don't match, the index is ignored.
+     **/
+    class CacheIndex
+    {
+    public:
+
+	/**
+	 * Constructor for an empty index.
+	 **/
+	CacheIndex();
+
+	/**
+	 * Return the name of the index file for 'cacheFileName'.
+	 **/
+	static QString fileName( const QString & cacheFileName );
+
+	/**
+	 * Read the index for 'cacheFileName'. Return 'false' if there is
+	 * none or if it does not match that cache file.
+	 **/
+	bool read( const QString & cacheFileName );
+
+	/**
+	 * Add directory 'path' that is written to block no. 'blockNo' at
+	 * offset 'blockPos'. This is used while writing a cache file; the
+	 * block numbers are converted to file offsets in write().
+	 **/
+	void add( const QString & path,
+		  int		  blockNo,
+		  int		  blockPos,
+		  FileSize	  allocatedSize );
+
+	/**
+	 * Set the position after the last directory, i.e. where the lines
+	 * after the tree start (if there are any).
+	 **/
+	void setEnd( int blockNo, int blockPos );
+
+	/**
+	 * Set the position of the summary (see CacheSummary) at the end of
+	 * the cache file.
+	 **/
+	void setSummary( int blockNo, int blockPos );
+
+	/**
+	 * Write the index for cache file 'cacheFileName' that is now
+	 * complete. 'blockOffsets' are the file offsets of its blocks.
+	 * Return 'true' if OK.
+	 **/
+	bool write( const QString &	    cacheFileName,
+		    const QVector<qint64> & blockOffsets );
+
+	/**
+	 * Return the number of directories in the index.
+	 **/
+	int count() const { return _entries.size(); }
+
+	/**
+	 * Return entry no. 'index'.
+	 **/
+	const CacheIndexEntry & entry( int index ) const
+	    { return _entries.at( index ); }
+
+	/**
+	 * Return the index of the entry for directory 'path' or -1 if there
+	 * is none.
+	 **/
+	int find( const QString & path ) const
+	    { return _pathIndex.value( path, -1 ); }
+
+	/**
+	 * Return the file offset and the block offset where the lines after
+	 * the tree start. The file offset is -1 if there are none.
+	 **/
+	qint64 endFileOffset() const { return _endFileOffset; }
+	int    endBlockPos()   const { return _endBlockPos;   }
+
+	/**
+	 * Read only the position of the summary from the index of
+	 * 'cacheFileName' and store it in 'fileOffset_ret' and
+	 * 'blockPos_ret'. This is written at the start of the index, so it
+	 * does not read the directories. Return 'false' if there is no index,
+	 * if it does not match the cache file, or if it has no summary.
+	 **/
+	static bool readSummaryPos( const QString & cacheFileName,
+				    qint64	  & fileOffset_ret,
+				    int		  & blockPos_ret );
+
+
+    protected:
+
+	/**
+	 * Set the subtreeEnd fields of all entries.
+	 **/
+	void findSubtreeEnds();
+
+
+	QVector<CacheIndexEntry> _entries;
+	QHash<QString, int>	 _pathIndex;
+	qint64			 _endFileOffset;
+	int			 _endBlockPos;
+	qint64			 _summaryFileOffset;
+	int			 _summaryBlockPos;
+
+    };	// class CacheIndex
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheIndex_h
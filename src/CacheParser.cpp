@@ -0,0 +1,1418 @@
+/*
+ *   File name: CacheParser.cpp
+ *   Summary:	Parser thread for QDirStat text cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>	// S_IFREG etc.
+#include <ctype.h>	// isspace(), isxdigit()
+#include <string.h>	// memchr()
+#include <strings.h>	// strncasecmp()
+
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QThread>
+
+#include "CacheParser.h"
+#include "CacheIndex.h"
+#include "DirTreeCache.h"
+#include "ExcludeRules.h"
+#include "BlockGzip.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+#define KB 1024LL
+#define MB (1024LL*1024)
+#define GB (1024LL*1024*1024)
+#define TB (1024LL*1024*1024*1024)
+
+// Size of the chunks to read from a gzip file that is not a block gzip file
+
+#define GZ_CHUNK_SIZE		( 256 * 1024 )
+
+// Number of items the producer thread hands over at once
+
+#define CACHE_BATCH_SIZE	1000
+
+// Max. number of batches that the producer thread may be ahead
+
+#define MAX_PENDING_BATCHES	16
+
+// Max. number of threads that parse chunks of lines in parallel
+
+#define CACHE_PARSE_MAX_THREADS 8
+
+// Number of chunks per parse thread that may be in the pipeline
+
+#define CACHE_PARSE_UNITS_PER_THREAD	2
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Thread pool job that runs the producer of a CacheParser.
+     **/
+    class CacheParserJob: public QRunnable
+    {
+    public:
+
+	CacheParserJob( CacheParser * parser ):
+	    QRunnable(),
+	    _parser( parser )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    if ( _parser->canParseParallel() )
+		_parser->produceParallel();
+	    else
+		_parser->produce();
+	}
+
+    protected:
+
+	CacheParser * _parser;
+    };
+
+
+    /**
+     * A chunk of complete lines that is parsed by a CacheParseJob.
+     **/
+    struct CacheParseUnit
+    {
+	QByteArray     data;
+	CacheItemBatch items;
+	int	       lineCount;
+	bool	       done;		// protected by the mutex of the job
+    };
+
+
+    /**
+     * Thread pool job that parses the lines of one CacheParseUnit.
+     **/
+    class CacheParseJob: public QRunnable
+    {
+    public:
+
+	CacheParseJob( CacheParseUnit * unit,
+		       bool		withUidGidPerm,
+		       QMutex	      * mutex,
+		       QWaitCondition * unitDone ):
+	    QRunnable(),
+	    _unit( unit ),
+	    _withUidGidPerm( withUidGidPerm ),
+	    _mutex( mutex ),
+	    _unitDone( unitDone )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    // This is called in the context of a worker thread!
+	    // Only the unit itself is touched here, and only this thread
+	    // uses it until it is marked as done.
+
+	    CacheLineParser parser( _withUidGidPerm );
+	    _unit->lineCount = parser.parseLines( _unit->data, _unit->items );
+	    _unit->data.clear();
+
+	    QMutexLocker locker( _mutex );
+	    _unit->done = true;
+	    _unitDone->wakeAll();
+	}
+
+    protected:
+
+	CacheParseUnit * _unit;
+	bool		 _withUidGidPerm;
+	QMutex		 * _mutex;
+	QWaitCondition * _unitDone;
+    };
+}
+
+
+/**
+ * Return the full path of 'item'.
+ **/
+static QString fullPath( const CacheItem & item )
+{
+    if ( item.path.isEmpty() )
+	return item.name;
+
+    return ( item.path == "/" ? QString() : item.path ) + "/" + item.name;
+}
+
+
+/**
+ * Return 'true' if 'path' is somewhere below directory 'dir'.
+ **/
+static bool isBelow( const QString & path, const QString & dir )
+{
+    if ( ! path.startsWith( dir ) || path.size() <= dir.size() )
+	return false;
+
+    return dir.endsWith( '/' ) || path.at( dir.size() ) == '/';
+}
+
+
+CacheLineParser::CacheLineParser( bool withUidGidPerm ):
+    _line( "" ),
+    _lineLen( 0 ),
+    _lineNo( 0 ),
+    _fieldsCount( 0 ),
+    _withUidGidPerm( withUidGidPerm )
+{
+}
+
+
+CacheParser::CacheParser( const QString & fileName ):
+    CacheLineParser(),
+    _fileName( fileName ),
+    _cache( 0 ),
+    _blockReader( 0 ),
+    _chunkPos( 0 ),
+    _inputEof( false ),
+    _ok( true ),
+    _isDelta( false ),
+    _excludeRules( 0 ),
+    _skipFiles( false ),
+    _firstDirSeen( false ),
+    _index( 0 ),
+    _seekEntry( -1 ),
+    _jumpEntry( -1 ),
+    _lazyDepth( 0 ),
+    _started( false ),
+    _producerDone( false )
+{
+    _threadPool.setMaxThreadCount( 1 );
+    _parsePool.setMaxThreadCount( qBound( 1, QThread::idealThreadCount() - 1, CACHE_PARSE_MAX_THREADS ) );
+
+    if ( BlockGzipReader::isBlockGzip( fileName ) )
+    {
+	// Written by CacheWriter: Decompress the blocks in parallel
+
+	_blockReader = new BlockGzipReader( fileName );
+	CHECK_NEW( _blockReader );
+	_ok = _blockReader->ok();
+    }
+    else
+    {
+	// Any other gzip file, e.g. from qdirstat-cache-writer
+
+	_cache = gzopen( fileName.toUtf8(), "r" );
+
+	if ( _cache == 0 )
+	{
+	    logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+	    _ok = false;
+	}
+    }
+
+    if ( _ok )
+	checkHeader();
+}
+
+
+CacheParser::~CacheParser()
+{
+    stop();
+
+    if ( _cache )
+	gzclose( _cache );
+
+    if ( _blockReader )
+	delete _blockReader;
+
+    if ( _excludeRules )
+	delete _excludeRules;
+
+    if ( _index )
+	delete _index;
+}
+
+
+void CacheParser::setSubtreePrefix( const QString & path )
+{
+    _subtreePrefix = path;
+
+    while ( _subtreePrefix.size() > 1 && _subtreePrefix.endsWith( '/' ) )
+	_subtreePrefix.chop( 1 );
+}
+
+
+void CacheParser::setExcludeRules( ExcludeRules * rules )
+{
+    if ( _excludeRules )
+	delete _excludeRules;
+
+    _excludeRules = 0;
+
+    if ( ! rules || rules->isEmpty() )
+	return;
+
+    // A private copy: The producer thread must not share the regexps with
+    // the GUI thread.
+
+    _excludeRules = new ExcludeRules();
+    CHECK_NEW( _excludeRules );
+
+    for ( ExcludeRuleListIterator it = rules->begin(); it != rules->end(); ++it )
+    {
+	ExcludeRule * rule = new ExcludeRule( (*it)->regexp(),
+					      (*it)->useFullPath(),
+					      (*it)->checkAnyFileChild() );
+	CHECK_NEW( rule );
+	_excludeRules->add( rule );
+    }
+
+    _excludeRules->match( "/", "/" );	// Build the index in this thread
+}
+
+
+bool CacheParser::seekToSubtree( const QString & path )
+{
+    if ( ! loadIndex() )
+	return false;
+
+    QString dir = path;
+
+    while ( dir.size() > 1 && dir.endsWith( '/' ) )
+	dir.chop( 1 );
+
+    int entry = _index->find( dir );
+
+    if ( entry < 0 )
+	return false;
+
+    _seekEntry = entry;
+    setSubtreePrefix( dir );
+    rewind();		// Now this goes to that entry
+
+    return _ok;
+}
+
+
+bool CacheParser::setLazyDepth( int depth )
+{
+    if ( depth > 0 && ! loadIndex() )
+	return false;
+
+    _lazyDepth = qMax( depth, 0 );
+
+    return true;
+}
+
+
+bool CacheParser::loadIndex()
+{
+    if ( _index )
+	return true;
+
+    // Only the blocks of files from CacheWriter can be read on their own
+
+    if ( ! _blockReader || _isDelta )
+	return false;
+
+    _index = new CacheIndex();
+    CHECK_NEW( _index );
+
+    if ( ! _index->read( _fileName ) )
+    {
+	delete _index;
+	_index = 0;
+
+	return false;
+    }
+
+    return true;
+}
+
+
+bool CacheParser::takeBatch( CacheItemBatch & batch, int timeoutMillisec )
+{
+    if ( ! _started )
+    {
+	if ( ! _ok || streamEof() )
+	    return false;
+
+	_started      = true;
+	_producerDone = false;
+	_threadPool.start( new CacheParserJob( this ) );
+    }
+
+    QMutexLocker locker( &_mutex );
+
+    if ( _batches.isEmpty() && ! _producerDone && timeoutMillisec != 0 )
+    {
+	if ( timeoutMillisec < 0 )
+	{
+	    while ( _batches.isEmpty() && ! _producerDone )
+		_batchReady.wait( &_mutex );
+	}
+	else
+	{
+	    _batchReady.wait( &_mutex, timeoutMillisec );
+	}
+    }
+
+    if ( _batches.isEmpty() )
+	return false;
+
+    batch = _batches.takeFirst();
+    _batchTaken.wakeAll();
+
+    return true;
+}
+
+
+bool CacheParser::eof()
+{
+    if ( ! _started )
+	return ! _ok || streamEof();
+
+    QMutexLocker locker( &_mutex );
+
+    return _producerDone && _batches.isEmpty();
+}
+
+
+void CacheParser::stop()
+{
+    if ( ! _started )
+	return;
+
+    _stopRequested.storeRelease( 1 );
+
+    {
+	QMutexLocker locker( &_mutex );
+	_batchTaken.wakeAll();
+    }
+
+    _threadPool.waitForDone();
+
+    _batches.clear();
+    _started	  = false;
+    _producerDone = false;
+    _stopRequested.storeRelease( 0 );
+}
+
+
+void CacheParser::rewind()
+{
+    stop();
+
+    _chunk.clear();
+    _spill.clear();
+    _chunkPos = 0;
+    _inputEof = false;
+    _lineNo   = 0;
+
+    _skipRawPrefix.clear();
+    _skipPath.clear();
+    _skipFiles	  = false;
+    _firstDirSeen = false;
+    _jumpEntry	  = -1;
+
+    if ( _seekEntry >= 0 )
+    {
+	const CacheIndexEntry & entry = _index->entry( _seekEntry );
+	seekTo( entry.fileOffset, entry.blockPos );
+    }
+    else if ( _cache )
+    {
+	gzrewind( _cache );
+	checkHeader();		// skip cache header
+    }
+    else if ( _blockReader )
+    {
+	_blockReader->rewind();
+	checkHeader();		// skip cache header
+    }
+}
+
+
+QString CacheParser::firstDir()
+{
+    stop();
+
+    while ( ! streamEof() )
+    {
+	if ( ! readLine() )
+	    return "";
+
+	splitLine();
+
+	if ( fieldsCount() < 2 )
+	    return "";
+
+	CacheField type = field( 0 );
+	CacheField path = field( 1 );
+
+	if ( fieldIs( type, "D" ) )
+	    return QString::fromUtf8( path.data, path.len );
+    }
+
+    return "";
+}
+
+
+void CacheParser::produce()
+{
+    // This is called in the context of the producer thread!
+    // Only the input stream and the line buffer are used here, and the
+    // consumer does not touch them while this thread is running.
+
+    CacheItemBatch batch;
+    batch.reserve( CACHE_BATCH_SIZE );
+
+    while ( ! _stopRequested.loadAcquire() && ! streamEof() )
+    {
+	if ( _jumpEntry >= 0 )
+	    jumpOverSubtree();
+
+	if ( ! readLine() )
+	    continue;
+
+	splitLine();
+
+	if ( fieldsCount() == 0 || skipLine() )
+	    continue;
+
+	batch.resize( batch.size() + 1 );
+	CacheItem & item = batch.last();
+	parseItem( item );
+
+	if ( item.isDir && item.absolute && ! item.syntaxError &&
+	     ! checkDir( item, field( 1 ) ) )
+	{
+	    batch.resize( batch.size() - 1 );
+	    continue;
+	}
+
+	if ( batch.size() >= CACHE_BATCH_SIZE )
+	{
+	    if ( ! pushBatch( batch ) )
+		break;
+
+	    batch.clear();
+	    batch.reserve( CACHE_BATCH_SIZE );
+	}
+    }
+
+    if ( ! batch.isEmpty() )
+	pushBatch( batch );
+
+    QMutexLocker locker( &_mutex );
+    _producerDone = true;
+    _batchReady.wakeAll();
+}
+
+
+bool CacheParser::canParseParallel() const
+{
+    // Skipping subtrees and jumping with the index depends on the lines
+    // before, so that is only done line by line
+
+    return _parsePool.maxThreadCount() > 1 &&
+	_subtreePrefix.isEmpty() &&
+	_lazyDepth == 0		 &&
+	_seekEntry < 0;
+}
+
+
+void CacheParser::produceParallel()
+{
+    // This is called in the context of the producer thread!
+    // The chunks are cut at the last complete line; the rest of a chunk
+    // is prepended to the next one.
+
+    QList<CacheParseUnit *> units;	// in file order
+    QByteArray		    spill;
+    const int		    maxUnits = _parsePool.maxThreadCount() * CACHE_PARSE_UNITS_PER_THREAD;
+    bool		    moreInput = true;
+
+    CacheItemBatch batch;
+    batch.reserve( CACHE_BATCH_SIZE );
+
+    while ( ! _stopRequested.loadAcquire() )
+    {
+	// Keep the parse threads busy
+
+	while ( moreInput && units.size() < maxUnits )
+	{
+	    QByteArray data;
+
+	    if ( fillBuffer() )
+	    {
+		int lastNewline = _chunk.lastIndexOf( '\n' );
+
+		if ( lastNewline < 0 )	// No complete line in this chunk
+		{
+		    spill += _chunk;
+		    continue;
+		}
+
+		if ( spill.isEmpty() && lastNewline == _chunk.size() - 1 )
+		{
+		    data = _chunk;	// No copy
+		}
+		else
+		{
+		    data = spill;
+		    data.append( _chunk.constData(), lastNewline + 1 );
+		}
+
+		spill = _chunk.mid( lastNewline + 1 );
+	    }
+	    else
+	    {
+		moreInput = false;
+		data	  = spill;	// Last line without a newline
+		spill.clear();
+	    }
+
+	    _chunk.clear();
+	    _chunkPos = 0;
+
+	    if ( data.isEmpty() )
+		continue;
+
+	    CacheParseUnit * unit = new CacheParseUnit;
+	    CHECK_NEW( unit );
+	    unit->data	    = data;
+	    unit->lineCount = 0;
+	    unit->done	    = false;
+	    units << unit;
+
+	    _parsePool.start( new CacheParseJob( unit, _withUidGidPerm, &_unitMutex, &_unitDone ) );
+	}
+
+	if ( units.isEmpty() )
+	    break;
+
+	// Hand over the results of the oldest unit
+
+	{
+	    QMutexLocker locker( &_unitMutex );
+
+	    while ( ! units.first()->done )
+		_unitDone.wait( &_unitMutex );
+	}
+
+	CacheParseUnit * unit = units.takeFirst();
+	bool stopped = false;
+
+	for ( int i=0; i < unit->items.size() && ! stopped; ++i )
+	{
+	    CacheItem & item = unit->items[ i ];
+	    item.lineNo += _lineNo;
+
+	    if ( ! filterItem( item ) )
+		continue;
+
+	    batch << item;
+
+	    if ( batch.size() >= CACHE_BATCH_SIZE )
+	    {
+		stopped = ! pushBatch( batch );
+		batch.clear();
+		batch.reserve( CACHE_BATCH_SIZE );
+	    }
+	}
+
+	_lineNo += unit->lineCount;
+	delete unit;
+
+	if ( stopped )
+	    break;
+    }
+
+    _parsePool.waitForDone();
+    qDeleteAll( units );
+
+    if ( ! batch.isEmpty() && ! _stopRequested.loadAcquire() )
+	pushBatch( batch );
+
+    QMutexLocker locker( &_mutex );
+    _producerDone = true;
+    _batchReady.wakeAll();
+}
+
+
+bool CacheParser::skipLine()
+{
+    if ( _subtreePrefix.isEmpty() && ! _excludeRules && _lazyDepth == 0 )
+	return false;
+
+    if ( fieldsCount() < 2 )
+	return false;
+
+    CacheField keyword = field( 0 );
+
+    // Pending directories are only resumed if the complete file is read
+
+    if ( fieldIs( keyword, "Pending" ) && _seekEntry >= 0 )
+	return true;
+
+    if ( fieldIs( keyword, "Pending"  ) ||
+	 fieldIs( keyword, "Removed"  ) ||
+	 fieldIs( keyword, "Baseline" )	  )
+    {
+	return false;
+    }
+
+    CacheField rawPath = field( 1 );
+
+    if ( rawPath.len == 0 || *rawPath.data != '/' )	// Relative: A file
+	return _skipFiles;				// in the current dir
+
+    bool below = ! _skipRawPrefix.isEmpty() &&
+	rawPath.len > _skipRawPrefix.size() &&
+	rawPath.data[ _skipRawPrefix.size() ] == '/' &&
+	memcmp( rawPath.data, _skipRawPrefix.constData(), _skipRawPrefix.size() ) == 0;
+
+    if ( fieldIs( keyword, "D" ) )
+    {
+	// A new directory: Its files are skipped if it is skipped
+
+	_skipFiles = below;
+
+	if ( ! below )
+	    _skipRawPrefix.clear();	// Left the skipped subtree
+    }
+
+    return below;
+}
+
+
+bool CacheParser::checkDir( CacheItem & item, const CacheField & rawPath )
+{
+    item.isExcluded = false;
+
+    if ( _subtreePrefix.isEmpty() && ! _excludeRules && _lazyDepth == 0 )
+	return true;
+
+    QString path = fullPath( item );
+    bool toplevel = ! _firstDirSeen;
+    _firstDirSeen = true;
+
+    if ( toplevel )
+	_toplevelPath = path;
+
+    if ( ! _subtreePrefix.isEmpty() )
+    {
+	QString dirPrefix = path == "/" ? path : path + "/";
+
+	if ( _subtreePrefix.startsWith( dirPrefix ) )
+	{
+	    // On the way to the subtree: Only the directory itself
+
+	    _skipFiles = true;
+	    return true;
+	}
+
+	if ( path != _subtreePrefix && ! path.startsWith( _subtreePrefix + "/" ) )
+	{
+	    if ( _seekEntry >= 0 )
+	    {
+		// The end of the subtree from seekToSubtree(): Done
+
+		_chunk.clear();
+		_chunkPos = 0;
+		_inputEof = true;
+
+		return false;
+	    }
+
+	    _skipRawPrefix = QByteArray( rawPath.data, rawPath.len );
+	    _skipFiles	   = true;
+	    skipSubtree( path );
+
+	    return false;
+	}
+    }
+
+    if ( _excludeRules && ! toplevel && _excludeRules->match( path, item.name ) )
+    {
+	item.isExcluded = true;
+	_skipRawPrefix	= QByteArray( rawPath.data, rawPath.len );
+	_skipFiles	= true;
+	skipSubtree( path );
+    }
+    else if ( _lazyDepth > 0 && ! toplevel )
+    {
+	int depth = path.mid( _toplevelPath.size() ).count( '/' );
+
+	if ( _toplevelPath == "/" )
+	    ++depth;
+
+	if ( depth > _lazyDepth )
+	{
+	    int entry = _index ? _index->find( path ) : -1;
+
+	    if ( entry >= 0 )
+	    {
+		item.isLazy	 = true;
+		item.subtreeSize = _index->entry( entry ).allocatedSize;
+		_skipRawPrefix	 = QByteArray( rawPath.data, rawPath.len );
+		_skipFiles	 = true;
+		skipSubtree( path );
+	    }
+	}
+    }
+
+    return true;
+}
+
+
+bool CacheParser::filterItem( CacheItem & item )
+{
+    if ( ! _excludeRules || item.syntaxError ||
+	 item.isPending || item.isRemoved || item.isBaseline )
+    {
+	return true;
+    }
+
+    if ( ! item.absolute )	// A file in the current directory
+	return ! _skipFiles;
+
+    QString path = fullPath( item );
+    bool    below = ! _skipPath.isEmpty() && isBelow( path, _skipPath );
+
+    if ( item.isDir )
+    {
+	_skipFiles = below;
+
+	if ( ! below )
+	    _skipPath.clear();	// Left the skipped subtree
+    }
+
+    if ( below )
+	return false;
+
+    if ( item.isDir )
+    {
+	bool toplevel = ! _firstDirSeen;
+	_firstDirSeen = true;
+
+	if ( ! toplevel && _excludeRules->match( path, item.name ) )
+	{
+	    item.isExcluded = true;
+	    _skipPath	    = path;
+	    _skipFiles	    = true;
+	}
+    }
+
+    return true;
+}
+
+
+void CacheParser::skipSubtree( const QString & path )
+{
+    if ( ! _index )
+	return;
+
+    int entry = _index->find( path );
+
+    if ( entry < 0 )
+	return;
+
+    // In the same block, skipping the lines is cheaper than decompressing
+    // that block again
+
+    int	   end	     = _index->entry( entry ).subtreeEnd;
+    qint64 endOffset = end < _index->count() ?
+	_index->entry( end ).fileOffset : _index->endFileOffset();
+
+    if ( endOffset != _index->entry( entry ).fileOffset )
+	_jumpEntry = end;
+}
+
+
+void CacheParser::jumpOverSubtree()
+{
+    int entry  = _jumpEntry;
+    _jumpEntry = -1;
+
+    if ( entry < _index->count() )
+    {
+	seekTo( _index->entry( entry ).fileOffset, _index->entry( entry ).blockPos );
+    }
+    else if ( _index->endFileOffset() >= 0 )
+    {
+	seekTo( _index->endFileOffset(), _index->endBlockPos() );
+    }
+    else	// Nothing after the tree
+    {
+	_chunk.clear();
+	_chunkPos = 0;
+	_inputEof = true;
+    }
+}
+
+
+bool CacheParser::seekTo( qint64 fileOffset, int blockPos )
+{
+    _chunk.clear();
+    _spill.clear();
+    _chunkPos = 0;
+    _inputEof = false;
+
+    if ( ! _blockReader || ! _blockReader->seek( fileOffset, blockPos ) )
+    {
+	_ok	  = false;
+	_inputEof = true;
+
+	return false;
+    }
+
+    return true;
+}
+
+
+bool CacheParser::pushBatch( const CacheItemBatch & batch )
+{
+    QMutexLocker locker( &_mutex );
+
+    while ( _batches.size() >= MAX_PENDING_BATCHES && ! _stopRequested.loadAcquire() )
+	_batchTaken.wait( &_mutex );
+
+    if ( _stopRequested.loadAcquire() )
+	return false;
+
+    _batches << batch;
+    _batchReady.wakeAll();
+
+    return true;
+}
+
+
+void CacheLineParser::parseItem( CacheItem & item )
+{
+    item.lineNo	     = _lineNo;
+    item.fieldsCount = fieldsCount();
+    item.syntaxError = false;
+    item.isPending   = false;
+    item.isRemoved   = false;
+    item.isBaseline  = false;
+    item.isExcluded  = false;
+    item.isLazy	     = false;
+    item.subtreeSize = -1;
+
+    if ( fieldsCount() >= 2 )
+    {
+	CacheField keyword = field( 0 );
+
+	item.isPending	= fieldIs( keyword, "Pending"  );
+	item.isRemoved	= fieldIs( keyword, "Removed"  );
+	item.isBaseline = fieldIs( keyword, "Baseline" );
+
+	if ( item.isPending || item.isRemoved || item.isBaseline )
+	{
+	    item.path = unescapedPath( field( 1 ) );
+	    return;
+	}
+    }
+
+    int expectedFields = _withUidGidPerm ? 7 : 4;
+
+    if ( fieldsCount() < expectedFields )
+    {
+	item.syntaxError = true;
+	return;
+    }
+
+    int n = 0;
+    CacheField type	= field( n++ );
+    CacheField rawPath	= field( n++ );
+    CacheField sizeStr	= field( n++ );
+
+    CacheField uidStr	= _withUidGidPerm ? field( n++ ) : CacheField();
+    CacheField gidStr	= _withUidGidPerm ? field( n++ ) : CacheField();
+    CacheField permStr	= _withUidGidPerm ? field( n++ ) : CacheField();
+
+    CacheField mtimeStr = field( n++ );
+    CacheField blocksStr = CacheField();
+    CacheField linksStr	= CacheField();
+
+    while ( fieldsCount() > n+1 )
+    {
+	CacheField keyword = field( n++ );
+	CacheField valStr  = field( n++ );
+
+	if ( fieldIs( keyword, "blocks:" ) ) blocksStr = valStr;
+	if ( fieldIs( keyword, "links:"	 ) ) linksStr  = valStr;
+    }
+
+
+    // Type
+
+    mode_t mode = S_IFREG;
+
+    if	    ( fieldIs( type, "F"	) )	mode = S_IFREG;
+    else if ( fieldIs( type, "D"	) )	mode = S_IFDIR;
+    else if ( fieldIs( type, "L"	) )	mode = S_IFLNK;
+    else if ( fieldIs( type, "BlockDev" ) )	mode = S_IFBLK;
+    else if ( fieldIs( type, "CharDev"	) )	mode = S_IFCHR;
+    else if ( fieldIs( type, "FIFO"	) )	mode = S_IFIFO;
+    else if ( fieldIs( type, "Socket"	) )	mode = S_IFSOCK;
+
+    item.isDir	  = mode == S_IFDIR;
+    item.absolute = *rawPath.data == '/';
+
+
+    // Size, UID, GID, permissions, MTime
+
+    item.size	= parseSize( sizeStr );
+    item.uid	= parseNumber( uidStr.data,  uidStr.len,  10 );
+    item.gid	= parseNumber( gidStr.data,  gidStr.len,  10 );
+    item.mode	= mode | parseNumber( permStr.data, permStr.len, 8 );
+    item.mtime	= parseNumber( mtimeStr.data, mtimeStr.len, 0 );
+
+
+    // Optional fields
+
+    item.blocks = blocksStr.data ? parseNumber( blocksStr.data, blocksStr.len, 10 ) : -1;
+    item.links	= linksStr.data	 ? parseNumber( linksStr.data,	linksStr.len,  10 ) :  1;
+
+
+    // Path and name
+
+    splitPath( rawPath, item.path, item.name );
+}
+
+
+bool CacheParser::checkHeader()
+{
+    if ( ! _ok || ! readLine() )
+	return false;
+
+    // logDebug() << "Checking cache file header" << endl;
+    splitLine();
+
+    // Check for    [qdirstat <version> cache file]
+    // or	    [kdirstat <version> cache file]
+    // or	    [qdirstat <version> cache delta]
+
+    if ( fieldsCount() != 4 )	_ok = false;
+
+    if ( _ok )
+    {
+	_isDelta = fieldIs( field( 0 ), "[qdirstat" ) && fieldIs( field( 3 ), "delta]" );
+
+	if ( ( ! fieldIs( field( 0 ), "[qdirstat" ) &&
+	       ! fieldIs( field( 0 ), "[kdirstat" )    ) ||
+	     ! fieldIs( field( 2 ), "cache" ) ||
+	     ( ! fieldIs( field( 3 ), "file]" ) && ! _isDelta ) )
+	{
+	    _ok = false;
+	    logError() << _fileName << ":" << _lineNo
+		      << ": Unknown file format" << endl;
+	}
+    }
+
+    if ( _ok )
+    {
+	CacheField versionStr = field( 1 );
+        float	   version    = QByteArray( versionStr.data, versionStr.len ).toFloat( &_ok );
+        _withUidGidPerm	      = _ok && version > 1.99;
+
+	if ( ! _ok )
+	    logError() << _fileName << ":" << _lineNo
+		      << ": Incompatible cache file version" << endl;
+    }
+
+    // logDebug() << "Cache file header check OK: " << _ok << endl;
+
+    return _ok;
+}
+
+
+bool CacheParser::streamEof()
+{
+    if ( ! _ok )
+	return true;
+
+    return _inputEof && _chunkPos >= _chunk.size();
+}
+
+
+bool CacheParser::fillBuffer()
+{
+    _chunk.clear();
+    _chunkPos = 0;
+
+    if ( ! _ok || _inputEof )
+	return false;
+
+    if ( _blockReader )
+    {
+	// Just take over the decompressed block without copying it
+
+	if ( ! _blockReader->takeBlock( _chunk ) )
+	{
+	    _inputEof = true;
+
+	    if ( ! _blockReader->ok() )
+	    {
+		_ok = false;
+		logError() << _fileName << ":" << _lineNo << ": Read error" << endl;
+	    }
+
+	    return false;
+	}
+    }
+    else if ( _cache )
+    {
+	_chunk.resize( GZ_CHUNK_SIZE );
+	int len = gzread( _cache, _chunk.data(), GZ_CHUNK_SIZE );
+
+	if ( len <= 0 )
+	{
+	    _chunk.clear();
+	    _inputEof = true;
+
+	    if ( len < 0 )
+	    {
+		_ok = false;
+		logError() << _fileName << ":" << _lineNo << ": Read error" << endl;
+	    }
+
+	    return false;
+	}
+
+	_chunk.resize( len );
+    }
+    else
+    {
+	return false;
+    }
+
+    return true;
+}
+
+
+bool CacheParser::nextRawLine()
+{
+    _spill.clear();
+
+    while ( true )
+    {
+	if ( _chunkPos >= _chunk.size() && ! fillBuffer() )
+	{
+	    if ( _spill.isEmpty() )
+		return false;
+
+	    // Last line without a newline
+
+	    _line    = _spill.constData();
+	    _lineLen = _spill.size();
+
+	    return true;
+	}
+
+	const char * start = _chunk.constData() + _chunkPos;
+	int	     avail = _chunk.size() - _chunkPos;
+	const char * nl	   = (const char *) memchr( start, '\n', avail );
+
+	if ( ! nl )
+	{
+	    // This line continues in the next chunk
+
+	    _spill.append( start, avail );
+	    _chunkPos = _chunk.size();
+	    continue;
+	}
+
+	int len = nl - start;
+	_chunkPos += len + 1;
+
+	if ( _spill.isEmpty() )
+	{
+	    _line    = start;
+	    _lineLen = len;
+	}
+	else
+	{
+	    _spill.append( start, len );
+	    _line    = _spill.constData();
+	    _lineLen = _spill.size();
+	}
+
+	return true;
+    }
+}
+
+
+bool CacheParser::readLine()
+{
+    _fieldsCount = 0;
+
+    while ( _ok && nextRawLine() )
+    {
+	_lineNo++;
+
+	if ( setLine( _line, _lineLen ) )
+	    return true;
+    }
+
+    _line    = "";
+    _lineLen = 0;
+
+    return false;
+}
+
+
+bool CacheLineParser::setLine( const char * line, int len )
+{
+    _line    = line;
+    _lineLen = len;
+
+    // Skip leading and trailing whitespace
+
+    while ( _lineLen > 0 && isspace( (unsigned char) *_line ) )
+    {
+	++_line;
+	--_lineLen;
+    }
+
+    while ( _lineLen > 0 && isspace( (unsigned char) _line[ _lineLen - 1 ] ) )
+	--_lineLen;
+
+    return _lineLen > 0 && *_line != '#'; // Skip empty lines and comments
+}
+
+
+int CacheLineParser::parseLines( const QByteArray & data, CacheItemBatch & items )
+{
+    const char * pos = data.constData();
+    const char * end = pos + data.size();
+
+    _lineNo = 0;
+
+    while ( pos < end )
+    {
+	const char * nl = (const char *) memchr( pos, '\n', end - pos );
+	int	     len = nl ? nl - pos : end - pos;
+
+	_lineNo++;
+
+	if ( setLine( pos, len ) )
+	{
+	    splitLine();
+
+	    if ( fieldsCount() > 0 )
+	    {
+		items.resize( items.size() + 1 );
+		parseItem( items.last() );
+	    }
+	}
+
+	pos += len + 1;
+    }
+
+    return _lineNo;
+}
+
+
+void CacheLineParser::splitLine()
+{
+    _fieldsCount = 0;
+
+    const char * pos = _line;
+    const char * end = _line + _lineLen;
+
+    while ( pos < end && _fieldsCount < MAX_FIELDS_PER_LINE-1 )
+    {
+	while ( pos < end && isspace( (unsigned char) *pos ) )
+	    ++pos;
+
+	if ( pos >= end )
+	    break;
+
+	CacheField & field = _fields[ _fieldsCount++ ];
+	field.data = pos;
+
+	while ( pos < end && ! isspace( (unsigned char) *pos ) )
+	    ++pos;
+
+	field.len = pos - field.data;
+    }
+}
+
+
+CacheField CacheLineParser::field( int no ) const
+{
+    if ( no >= 0 && no < _fieldsCount )
+	return _fields[ no ];
+
+    CacheField empty = { 0, 0 };
+
+    return empty;
+}
+
+
+bool CacheLineParser::fieldIs( const CacheField & field, const char * str )
+{
+    return field.data &&
+	strncasecmp( field.data, str, field.len ) == 0 &&
+	str[ field.len ] == 0;
+}
+
+
+qint64 CacheLineParser::parseNumber( const char * data,
+				     int	  len,
+				     int	  base,
+				     int *	  used_ret )
+{
+    int  pos	  = 0;
+    bool negative = false;
+
+    if ( pos < len && data[ pos ] == '-' )
+    {
+	negative = true;
+	++pos;
+    }
+
+    if ( base == 0 || base == 16 )
+    {
+	if ( pos + 1 < len && data[ pos ] == '0' && ( data[ pos+1 ] == 'x' || data[ pos+1 ] == 'X' ) )
+	{
+	    base = 16;
+	    pos += 2;
+	}
+	else if ( base == 0 )
+	{
+	    base = 10;
+	}
+    }
+
+    qint64 value = 0;
+
+    while ( pos < len )
+    {
+	char c	  = data[ pos ];
+	int digit = -1;
+
+	if	( c >= '0' && c <= '9' )		digit = c - '0';
+	else if ( base == 16 && c >= 'a' && c <= 'f' )	digit = c - 'a' + 10;
+	else if ( base == 16 && c >= 'A' && c <= 'F' )	digit = c - 'A' + 10;
+
+	if ( digit < 0 || digit >= base )
+	    break;
+
+	value = value * base + digit;
+	++pos;
+    }
+
+    if ( used_ret )
+	*used_ret = pos;
+
+    return negative ? -value : value;
+}
+
+
+FileSize CacheLineParser::parseSize( const CacheField & field )
+{
+    int used = 0;
+    FileSize size = parseNumber( field.data, field.len, 10, &used );
+
+    if ( used < field.len )
+    {
+	switch ( field.data[ used ] )
+	{
+	    case 'K':	size *= KB; break;
+	    case 'M':	size *= MB; break;
+	    case 'G':	size *= GB; break;
+	    case 'T':	size *= TB; break;
+	    default: break;
+	}
+    }
+
+    return size;
+}
+
+
+void CacheLineParser::splitPath( const CacheField & rawPath,
+				 QString	  & path_ret,
+				 QString	  & name_ret )
+{
+    const char * start = rawPath.data;
+    const char * end   = start + rawPath.len;
+
+    while ( end > start && end[-1] == '/' )	// Ignore trailing slashes
+	--end;
+
+    if ( end == start )
+    {
+	path_ret = QString();
+	name_ret = rawPath.len > 0 ? "/" : "";
+	return;
+    }
+
+    const char * slash = end - 1;
+
+    while ( slash >= start && *slash != '/' )
+	--slash;
+
+    name_ret = unescapedPath( slash + 1, end - ( slash + 1 ) );
+
+    if ( slash < start )	// No path, just a name
+    {
+	path_ret = QString();
+	return;
+    }
+
+    const char * pathEnd = slash;
+
+    while ( pathEnd > start && pathEnd[-1] == '/' )
+	--pathEnd;
+
+    path_ret = pathEnd == start ? QString( "/" ) : unescapedPath( start, pathEnd - start );
+}
+
+
+QString CacheLineParser::unescapedPath( const char * data, int len )
+{
+    // Most paths don't need any unescaping: Convert them directly
+
+    bool plain = true;
+
+    for ( int i = 0; i < len && plain; ++i )
+    {
+	if ( data[i] == '%' || ( data[i] == '/' && i + 1 < len && data[i+1] == '/' ) )
+	    plain = false;
+    }
+
+    if ( plain )
+	return QString::fromUtf8( data, len );
+
+    _unescaped.resize( len );
+    char * out = _unescaped.data();
+
+    for ( int i = 0; i < len; ++i )
+    {
+	char c = data[i];
+
+	if ( c == '%' && i + 2 < len &&
+	     isxdigit( (unsigned char) data[i+1] ) &&
+	     isxdigit( (unsigned char) data[i+2] ) )
+	{
+	    c = (char) parseNumber( data + i + 1, 2, 16 );
+	    i += 2;
+	}
+	else if ( c == '/' && out > _unescaped.data() && out[-1] == '/' )
+	{
+	    continue;	// Duplicate slash
+	}
+
+	*out++ = c;
+    }
+
+    return QString::fromUtf8( _unescaped.constData(), out - _unescaped.constData() );
+}
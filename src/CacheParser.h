@@ -0,0 +1,519 @@
+/*
+ *   File name: CacheParser.h
+ *   Summary:	Parser thread for QDirStat text cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheParser_h
+#define CacheParser_h
+
+
+#include <sys/types.h>	// mode_t, uid_t, gid_t
+#include <zlib.h>	// gzFile
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+#include "FileSize.h"
+
+
+#define MAX_FIELDS_PER_LINE	32
+
+
+namespace QDirStat
+{
+    class BlockGzipReader;
+    class CacheIndex;
+    class ExcludeRules;
+
+
+    /**
+     * One data line of a cache file, parsed and ready to be added to the
+     * tree.
+     **/
+    struct CacheItem
+    {
+	int	 lineNo;
+	bool	 syntaxError;	// Too few fields; only 'fieldsCount' is valid
+	bool	 isPending;	// "Pending" line; only 'path' is valid
+	bool	 isRemoved;	// "Removed" line (delta files); only 'path' is valid
+	bool	 isBaseline;	// "Baseline" line (delta files); only 'path' is valid
+	bool	 isDir;
+	bool	 absolute;	// The line had an absolute path
+	bool	 isExcluded;	// Directory matched the exclude rules in the parser
+	bool	 isLazy;	// Directory without its contents; see setLazyDepth()
+	FileSize subtreeSize;	// Only for 'isLazy': Allocated size from the index
+	int	 fieldsCount;
+	mode_t	 mode;		// File type and permissions
+	FileSize size;
+	uid_t	 uid;
+	gid_t	 gid;
+	time_t	 mtime;
+	FileSize blocks;	// -1 if not specified
+	int	 links;
+	QString	 path;		// Unescaped path of the parent (may be empty)
+	QString	 name;		// Unescaped name without path
+    };
+
+
+    typedef QVector<CacheItem> CacheItemBatch;
+
+
+    /**
+     * One field of a cache line: A view into the decompressed data, not
+     * 0-terminated.
+     **/
+    struct CacheField
+    {
+	const char * data;
+	int	     len;
+    };
+
+
+    /**
+     * Parser for single lines of a text cache file: Split a line into
+     * fields, parse the numbers and unescape the paths.
+     *
+     * This has no state besides the current line, so each thread that
+     * parses lines can simply use an instance of its own.
+     **/
+    class CacheLineParser
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	CacheLineParser( bool withUidGidPerm = false );
+
+	/**
+	 * Return 'true' if the cache file format has UID, GID, permissions
+	 * (cache file format 2.0 or later), 'false' otherwise.
+	 **/
+	bool withUidGidPerm() const { return _withUidGidPerm; }
+
+	/**
+	 * Parse all data lines in 'data', which has to consist of complete
+	 * lines, and append them to 'items'. Their line numbers are relative
+	 * to the start of 'data'. Return the number of lines, including
+	 * empty lines and comments.
+	 *
+	 * This can be used in any thread.
+	 **/
+	int parseLines( const QByteArray & data, CacheItemBatch & items );
+
+
+    protected:
+
+	/**
+	 * Make the raw line with 'len' bytes at 'line' the current line
+	 * without leading or trailing whitespace. Return 'false' if it is
+	 * empty or a comment.
+	 **/
+	bool setLine( const char * line, int len );
+
+	/**
+	 * Split the current line into fields separated by whitespace.
+	 **/
+	void splitLine();
+
+	/**
+	 * Returns field no. 'no' in the current line after splitLine() or an
+	 * empty field if there is no such field.
+	 **/
+	CacheField field( int no ) const;
+
+	/**
+	 * Returns the number of fields in the current line after
+	 * splitLine().
+	 **/
+	int fieldsCount() const { return _fieldsCount; }
+
+	/**
+	 * Parse the current line (after splitLine()) into 'item'.
+	 **/
+	void parseItem( CacheItem & item );
+
+	/**
+	 * Return 'true' if 'field' is 'str' (case insensitive).
+	 **/
+	static bool fieldIs( const CacheField & field, const char * str );
+
+	/**
+	 * Parse an integer number at the start of 'data' with 'len' bytes in
+	 * 'base' (8, 10 or 16; 0 for decimal or hex with a leading "0x").
+	 * Return the number of bytes that were used in 'used_ret'.
+	 **/
+	static qint64 parseNumber( const char * data,
+				   int		len,
+				   int		base,
+				   int *	used_ret = 0 );
+
+	/**
+	 * Parse a size with an optional unit suffix ("K", "M", "G", "T").
+	 **/
+	static FileSize parseSize( const CacheField & field );
+
+	/**
+	 * Split the raw (escaped) path 'rawPath' into its path and its name
+	 * component, unescape both and return them in path_ret and name_ret.
+	 * path_ret remains null if there is no path.
+	 *
+	 * Example:
+	 *     "/some/dir/somewhere/myfile.obj"
+	 * ->  "/some/dir/somewhere", "myfile.obj"
+	 **/
+	void splitPath( const CacheField & rawPath,
+			QString		 & path_ret,
+			QString		 & name_ret );
+
+	/**
+	 * Return the unescaped version of a raw path with 'len' bytes at
+	 * 'data': Decode any "%xx" escapes and replace duplicate (or
+	 * triplicate or more) slashes with just one.
+	 **/
+	QString unescapedPath( const char * data, int len );
+
+	/**
+	 * Return the unescaped version of a raw path field.
+	 **/
+	QString unescapedPath( const CacheField & rawPath )
+	    { return unescapedPath( rawPath.data, rawPath.len ); }
+
+
+
+
+	//
+	// Data members
+	//
+
+	const char *	  _line;
+	int		  _lineLen;
+	int		  _lineNo;
+	CacheField	  _fields[ MAX_FIELDS_PER_LINE ];
+	int		  _fieldsCount;
+	bool		  _withUidGidPerm;
+	QByteArray	  _unescaped;	// Buffer for unescapedPath()
+
+    };	// class CacheLineParser
+
+
+    /**
+     * Parser for the lines of a gzipped text cache file.
+     *
+     * The header and (for CacheReader::firstDir()) the first few lines are
+     * read directly in the calling thread. The data lines are read by a
+     * producer thread: It decompresses the file, splits the lines into
+     * fields, parses the numbers and unescapes the paths, and hands over
+     * the results in batches of CacheItems. So the GUI thread only needs
+     * to link the new nodes into the tree.
+     *
+     * The producer thread is started with the first takeBatch() call. It
+     * stays at most a few batches ahead of the consumer, so reading a huge
+     * cache file does not need huge amounts of memory.
+     *
+     * When the complete file is read, the producer thread cuts the
+     * decompressed data into chunks of complete lines and has them parsed
+     * in parallel by a pool of CacheLineParsers; it then only filters the
+     * results in their original order. Since every directory line has
+     * the full path, any line boundary is a valid split point.
+     **/
+    class CacheParser: public CacheLineParser
+    {
+    public:
+
+	/**
+	 * Constructor: Open cache file 'fileName' and check its header.
+	 * Check ok() for the result.
+	 **/
+	CacheParser( const QString & fileName );
+
+	/**
+	 * Destructor. This stops the producer thread.
+	 **/
+	virtual ~CacheParser();
+
+	/**
+	 * Return 'true' if everything went OK so far.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Return 'true' if all data lines are parsed and all batches are
+	 * taken (or if there was an error).
+	 **/
+	bool eof();
+
+	/**
+	 * Return 'true' if this is a delta cache file that only contains the
+	 * changes against a baseline cache file. See CacheDelta.
+	 **/
+	bool isDelta() const { return _isDelta; }
+
+	/**
+	 * Take the next batch of items and store it in 'batch'. Start the
+	 * producer thread if it is not running yet.
+	 *
+	 * Wait at most 'timeoutMillisec' milliseconds for it if there is
+	 * none yet; -1 waits until there is one or until the end of the file.
+	 *
+	 * Return 'false' if there was no batch.
+	 **/
+	bool takeBatch( CacheItemBatch & batch, int timeoutMillisec = -1 );
+
+	/**
+	 * Stop the producer thread and start over from the beginning of the
+	 * file.
+	 **/
+	void rewind();
+
+	/**
+	 * Return the raw path of the first directory in the cache file or an
+	 * empty string if there is none. See CacheReader::firstDir().
+	 *
+	 * This reads lines in the calling thread, so it stops the producer
+	 * thread first.
+	 **/
+	QString firstDir();
+
+	/**
+	 * Return the cache file name.
+	 **/
+	const QString & fileName() const { return _fileName; }
+
+	/**
+	 * Only hand over the items at or below directory 'path' and the
+	 * directories on the way there (without their files). Everything
+	 * else is skipped in the producer thread right after the line is
+	 * split into fields, without even unescaping it.
+	 *
+	 * This has to be called before the first takeBatch().
+	 **/
+	void setSubtreePrefix( const QString & path );
+
+	/**
+	 * Check the directories against a copy of 'rules' in the producer
+	 * thread: An excluded directory is still handed over (with
+	 * 'isExcluded' set), but all lines below it are skipped.
+	 *
+	 * This has to be called before the first takeBatch().
+	 **/
+	void setExcludeRules( ExcludeRules * rules );
+
+	/**
+	 * Only hand over the subtree of directory 'path': Jump directly to
+	 * it with the CacheIndex of the cache file and stop at the end of the
+	 * subtree. Unlike with setSubtreePrefix(), the directories on the way
+	 * there are not handed over.
+	 *
+	 * Return 'false' if there is no index or if 'path' is not in it.
+	 *
+	 * This has to be called before the first takeBatch().
+	 **/
+	bool seekToSubtree( const QString & path );
+
+	/**
+	 * Hand over the directories more than 'depth' levels below the first
+	 * one without their contents and with 'isLazy' set, and jump over
+	 * their subtrees with the CacheIndex of the cache file. 0 disables
+	 * this.
+	 *
+	 * Return 'false' if there is no index.
+	 *
+	 * This has to be called before the first takeBatch().
+	 **/
+	bool setLazyDepth( int depth );
+
+
+    protected:
+
+	/**
+	 * Read and parse the data lines and hand them over in batches until
+	 * the end of the file or until stop() is called.
+	 *
+	 * This is called in the producer thread.
+	 **/
+	void produce();
+
+	/**
+	 * Like produce(), but parse chunks of lines in parallel in the parse
+	 * thread pool. This is only used if the complete file is read.
+	 *
+	 * This is called in the producer thread.
+	 **/
+	void produceParallel();
+
+	/**
+	 * Return 'true' if produceParallel() can be used.
+	 **/
+	bool canParseParallel() const;
+
+	/**
+	 * Add 'batch' to the batches for the consumer. Wait while there are
+	 * too many batches that are not taken yet. Return 'false' if the
+	 * producer should stop.
+	 *
+	 * This is called in the producer thread.
+	 **/
+	bool pushBatch( const CacheItemBatch & batch );
+
+	/**
+	 * Stop the producer thread and wait until it is finished. Any
+	 * batches that are not taken yet are discarded.
+	 **/
+	void stop();
+
+	/**
+	 * Return 'true' if the current line (after splitLine()) is in a
+	 * subtree that is skipped. This only checks the raw fields.
+	 *
+	 * This is called in the producer thread.
+	 **/
+	bool skipLine();
+
+	/**
+	 * Check the directory 'item' that was just parsed from raw path
+	 * 'rawPath' against the subtree prefix and the exclude rules. Return
+	 * 'false' if it is skipped; set its 'isExcluded' flag if it is
+	 * excluded. Either way, everything below it is skipped.
+	 *
+	 * This is called in the producer thread.
+	 **/
+	bool checkDir( CacheItem & item, const CacheField & rawPath );
+
+	/**
+	 * Check 'item' that was parsed in parallel against the exclude rules:
+	 * Like skipLine() and checkDir() together, but with the unescaped
+	 * paths. Return 'false' if it is skipped.
+	 *
+	 * This is called in the producer thread.
+	 **/
+	bool filterItem( CacheItem & item );
+
+	/**
+	 * Skip the rest of the subtree of directory 'path' with the index if
+	 * it continues in another block.
+	 *
+	 * This is called in the producer thread.
+	 **/
+	void skipSubtree( const QString & path );
+
+	/**
+	 * Continue reading at the index entry that was set by skipSubtree().
+	 *
+	 * This is called in the producer thread.
+	 **/
+	void jumpOverSubtree();
+
+	/**
+	 * Continue reading at offset 'blockPos' in the block at 'fileOffset'.
+	 **/
+	bool seekTo( qint64 fileOffset, int blockPos );
+
+	/**
+	 * Read the CacheIndex of the cache file if that is not done yet.
+	 * Return 'false' if there is none.
+	 **/
+	bool loadIndex();
+
+	/**
+	 * Check this cache's header (see if it is a QDirStat cache at all).
+	 **/
+	bool checkHeader();
+
+	/**
+	 * Read the next line that is not empty or a comment and make it the
+	 * current line (_line, _lineLen) without leading or trailing
+	 * whitespace.
+	 *
+	 * Returns true if OK, false if error or at the end of the file.
+	 **/
+	bool readLine();
+
+	/**
+	 * Make the next raw line the current line. Normally this is just a
+	 * pointer into the decompressed data; only a line that continues in
+	 * the next block is copied.
+	 *
+	 * Returns false at the end of the file.
+	 **/
+	bool nextRawLine();
+
+	/**
+	 * Get the next chunk of decompressed data. Returns false at the end
+	 * of the file or upon error.
+	 **/
+	bool fillBuffer();
+
+	/**
+	 * Return 'true' if the end of the file is reached (or if there was an
+	 * error).
+	 **/
+	bool streamEof();
+
+	friend class CacheParserJob;
+
+
+	//
+	// Data members
+	//
+
+	QString		  _fileName;
+	gzFile		  _cache;
+	BlockGzipReader * _blockReader;
+	QByteArray	  _chunk;	// Current chunk of decompressed data
+	int		  _chunkPos;
+	QByteArray	  _spill;	// Line that continues in the next chunk
+	bool		  _inputEof;
+	bool		  _ok;
+	bool		  _isDelta;
+
+	// Pushdown of the subtree prefix and the exclude rules; only used in
+	// the producer thread once it is started
+
+	QString		  _subtreePrefix;
+	ExcludeRules *	  _excludeRules;	// private copy
+	QByteArray	  _skipRawPrefix;	// raw path of a skipped subtree
+	QString		  _skipPath;		// the same for filterItem()
+	bool		  _skipFiles;		// files of the current directory
+	bool		  _firstDirSeen;
+
+	// Random access with the index
+
+	CacheIndex *	  _index;
+	int		  _seekEntry;		// seekToSubtree() or -1
+	int		  _jumpEntry;		// skipSubtree() or -1
+	int		  _lazyDepth;
+	QString		  _toplevelPath;
+
+	// Producer thread
+
+	QThreadPool		_threadPool;
+	QMutex			_mutex;
+	QWaitCondition		_batchReady;
+	QWaitCondition		_batchTaken;
+	QList<CacheItemBatch>	_batches;	// protected by _mutex
+	bool			_started;
+	bool			_producerDone;	// protected by _mutex
+	QAtomicInt		_stopRequested;
+
+	// Parallel parsing
+
+	QThreadPool		_parsePool;
+	QMutex			_unitMutex;
+	QWaitCondition		_unitDone;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheParser_h
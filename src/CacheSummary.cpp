@@ -0,0 +1,390 @@
+/*
+ *   File name: CacheSummary.cpp
+ *   Summary:	Summary section of QDirStat cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>	// std::sort()
+
+#include <QUrl>
+#include <QList>
+#include <QPair>
+
+#include "CacheSummary.h"
+#include "CacheIndex.h"
+#include "BlockGzip.h"
+#include "DirInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Number of suffixes that are written with their own line; all others are
+// added up in "*"
+
+#define CACHE_SUMMARY_MAX_TYPES		100
+
+// Longer "suffixes" are most likely parts of a name with dots
+
+#define CACHE_SUMMARY_MAX_SUFFIX_LEN	12
+
+#define SUMMARY_LINE_SIZE		( 16 * 1024 )
+
+
+using namespace QDirStat;
+
+
+static bool typeSizeGreaterThan( const QPair<QString, CacheSummaryBucket> & a,
+				 const QPair<QString, CacheSummaryBucket> & b )
+{
+    return a.second.size > b.second.size;
+}
+
+
+CacheSummary::CacheSummary()
+{
+    // NOP
+}
+
+
+void CacheSummary::addDir( DirInfo * dir, const QString & url )
+{
+    if ( _dirs.isEmpty() )
+	_toplevelUrl = url;
+
+    if ( ! url.startsWith( _toplevelUrl ) )
+	return;
+
+    int depth = url.mid( _toplevelUrl.size() ).count( '/' );
+
+    if ( _toplevelUrl == "/" && url.size() > 1 )
+	++depth;
+
+    if ( depth > CACHE_SUMMARY_DEPTH )
+	return;
+
+    CacheSummaryDir summary;
+
+    summary.path	  = url;
+    summary.depth	  = depth;
+    summary.totalSize	  = dir->totalSize();
+    summary.allocatedSize = dir->totalAllocatedSize();
+    summary.items	  = dir->totalItems();
+    summary.files	  = dir->totalFiles();
+    summary.subDirs	  = dir->totalSubDirs();
+    summary.latestMtime	  = dir->latestMtime();
+
+    _dirIndex.insert( url, _dirs.size() );
+    _dirs << summary;
+}
+
+
+void CacheSummary::addFile( FileInfo * item )
+{
+    FileSize size = item->size();
+
+    CacheSummaryBucket & sizeBucket = _sizes[ CacheSummary::sizeBucket( size ) ];
+    ++sizeBucket.files;
+    sizeBucket.size += size;
+
+    time_t    mtime = item->mtime();
+    struct tm mtimeInfo;
+
+    if ( localtime_r( &mtime, &mtimeInfo ) )
+    {
+	CacheSummaryBucket & yearBucket = _years[ mtimeInfo.tm_year + 1900 ];
+	++yearBucket.files;
+	yearBucket.size += size;
+    }
+
+    CacheSummaryBucket & typeBucket = _types[ suffix( item->name() ) ];
+    ++typeBucket.files;
+    typeBucket.size += size;
+
+    if ( item->hasUid() )
+    {
+	CacheSummaryBucket & userBucket = _users[ (int) item->uid() ];
+	++userBucket.files;
+	userBucket.size += size;
+    }
+
+    if ( item->hasGid() )
+    {
+	CacheSummaryBucket & groupBucket = _groups[ (int) item->gid() ];
+	++groupBucket.files;
+	groupBucket.size += size;
+    }
+}
+
+
+int CacheSummary::sizeBucket( FileSize size )
+{
+    int bucket = 0;
+
+    while ( size > 0 )
+    {
+	++bucket;
+	size >>= 1;
+    }
+
+    return bucket;
+}
+
+
+QString CacheSummary::suffix( const QString & name )
+{
+    int pos = name.lastIndexOf( '.' );
+
+    if ( pos <= 0 || name.size() - pos > CACHE_SUMMARY_MAX_SUFFIX_LEN + 1 || pos == name.size() - 1 )
+	return QString();
+
+    return name.mid( pos ).toLower();
+}
+
+
+void CacheSummary::write( BlockGzipWriter * cache ) const
+{
+    if ( _dirs.isEmpty() )
+	return;
+
+    QByteArray data;
+
+    data += "#\n"
+	"# Summary of the first levels and of all files\n"
+	"#\n"
+	"# Dir   depth size allocated items files subdirs latest-mtime path\n"
+	"# Size  bucket files size   (bucket n: 2^(n-1) .. 2^n - 1 bytes)\n"
+	"# Year  year files size\n"
+	"# Type  suffix files size   (\"-\": no suffix, \"*\": all others)\n"
+	"# User  uid files size\n"
+	"# Group gid files size\n"
+	"#\n";
+
+    foreach ( const CacheSummaryDir & dir, _dirs )
+    {
+	data += "#S Dir "
+	    + QByteArray::number( dir.depth )		  + " "
+	    + QByteArray::number( dir.totalSize )	  + " "
+	    + QByteArray::number( dir.allocatedSize )	  + " "
+	    + QByteArray::number( dir.items )		  + " "
+	    + QByteArray::number( dir.files )		  + " "
+	    + QByteArray::number( dir.subDirs )		  + " "
+	    + QByteArray::number( (qint64) dir.latestMtime ) + " "
+	    + QUrl::toPercentEncoding( dir.path, "/" )	  + "\n";
+    }
+
+    for ( CacheSummaryHistogram::const_iterator it = _sizes.constBegin(); it != _sizes.constEnd(); ++it )
+    {
+	data += "#S Size " + QByteArray::number( it.key() ) + " "
+	    + QByteArray::number( it.value().files ) + " "
+	    + QByteArray::number( it.value().size  ) + "\n";
+    }
+
+    for ( CacheSummaryHistogram::const_iterator it = _years.constBegin(); it != _years.constEnd(); ++it )
+    {
+	data += "#S Year " + QByteArray::number( it.key() ) + " "
+	    + QByteArray::number( it.value().files ) + " "
+	    + QByteArray::number( it.value().size  ) + "\n";
+    }
+
+    // Only the largest types; the others are added up
+
+    QList<QPair<QString, CacheSummaryBucket> > types;
+
+    for ( CacheSummaryTypes::const_iterator it = _types.constBegin(); it != _types.constEnd(); ++it )
+	types << qMakePair( it.key(), it.value() );
+
+    std::sort( types.begin(), types.end(), typeSizeGreaterThan );
+    CacheSummaryBucket others;
+
+    for ( int i=0; i < types.size(); ++i )
+    {
+	const QString &		   suffix = types.at( i ).first;
+	const CacheSummaryBucket & bucket = types.at( i ).second;
+
+	if ( i >= CACHE_SUMMARY_MAX_TYPES && ! suffix.isEmpty() )
+	{
+	    others.files += bucket.files;
+	    others.size	 += bucket.size;
+
+	    continue;
+	}
+
+	data += "#S Type "
+	    + ( suffix.isEmpty() ? QByteArray( "-" ) : QUrl::toPercentEncoding( suffix ) ) + " "
+	    + QByteArray::number( bucket.files ) + " "
+	    + QByteArray::number( bucket.size  ) + "\n";
+    }
+
+    if ( others.files > 0 )
+    {
+	data += "#S Type * "
+	    + QByteArray::number( others.files ) + " "
+	    + QByteArray::number( others.size  ) + "\n";
+    }
+
+    for ( CacheSummaryHistogram::const_iterator it = _users.constBegin(); it != _users.constEnd(); ++it )
+    {
+	data += "#S User " + QByteArray::number( it.key() ) + " "
+	    + QByteArray::number( it.value().files ) + " "
+	    + QByteArray::number( it.value().size  ) + "\n";
+    }
+
+    for ( CacheSummaryHistogram::const_iterator it = _groups.constBegin(); it != _groups.constEnd(); ++it )
+    {
+	data += "#S Group " + QByteArray::number( it.key() ) + " "
+	    + QByteArray::number( it.value().files ) + " "
+	    + QByteArray::number( it.value().size  ) + "\n";
+    }
+
+    data += "#S End\n";
+    cache->write( data );
+}
+
+
+bool CacheSummary::read( const QString & cacheFileName )
+{
+    _dirs.clear();
+    _dirIndex.clear();
+    _sizes.clear();
+    _years.clear();
+    _types.clear();
+    _users.clear();
+    _groups.clear();
+
+    qint64 fileOffset = -1;
+    int	   blockPos   = 0;
+
+    if ( ! CacheIndex::readSummaryPos( cacheFileName, fileOffset, blockPos ) )
+	return false;
+
+    BlockGzipReader reader( cacheFileName, 1 );
+
+    if ( ! reader.ok() || ! reader.seek( fileOffset, blockPos ) )
+    {
+	logWarning() << "Can't find the summary in " << cacheFileName << endl;
+	return false;
+    }
+
+    QByteArray buf( SUMMARY_LINE_SIZE, '\0' );
+    bool done = false;
+    bool ok   = true;
+
+    while ( ok && ! done && reader.gets( buf.data(), buf.size() ) )
+    {
+	QByteArray line( buf.constData() );
+
+	if ( line.endsWith( '\n' ) )
+	    line.chop( 1 );
+
+	if ( line == "#S End" )
+	    done = true;
+	else if ( line.startsWith( "#S " ) )
+	    ok = parseLine( line );
+    }
+
+    if ( ! ok || ! done || _dirs.isEmpty() )
+    {
+	logWarning() << "Bad summary in " << cacheFileName << " - not using it" << endl;
+	_dirs.clear();
+	_dirIndex.clear();
+
+	return false;
+    }
+
+    _toplevelUrl = _dirs.first().path;
+    logDebug() << "Read the summary of " << cacheFileName << " with "
+	       << _dirs.size() << " directories" << endl;
+
+    return true;
+}
+
+
+bool CacheSummary::parseLine( const QByteArray & line )
+{
+    QList<QByteArray> fields = line.split( ' ' );
+    const QByteArray & keyword = fields.at( 1 );
+    bool ok = true;
+
+    if ( keyword == "Dir" )
+    {
+	if ( fields.size() != 10 )
+	    return false;
+
+	CacheSummaryDir dir;
+
+	qint64 values[ 6 ];
+	dir.depth = fields.at( 2 ).toInt( &ok );
+
+	for ( int i=0; ok && i < 6; ++i )
+	    values[ i ] = fields.at( i + 3 ).toLongLong( &ok );
+
+	if ( ! ok )
+	    return false;
+
+	dir.totalSize	  = values[ 0 ];
+	dir.allocatedSize = values[ 1 ];
+	dir.items	  = values[ 2 ];
+	dir.files	  = values[ 3 ];
+	dir.subDirs	  = values[ 4 ];
+	dir.latestMtime	  = (time_t) values[ 5 ];
+	dir.path	  = QUrl::fromPercentEncoding( fields.at( 9 ) );
+
+	_dirIndex.insert( dir.path, _dirs.size() );
+	_dirs << dir;
+
+	return true;
+    }
+
+    if ( keyword != "Size" && keyword != "Year" && keyword != "Type" &&
+	 keyword != "User" && keyword != "Group" )
+    {
+	return true;	// Something newer; ignore it
+    }
+
+    if ( fields.size() != 5 )
+	return false;
+
+    CacheSummaryBucket bucket;
+    bucket.files = fields.at( 3 ).toLongLong( &ok );
+
+    if ( ok )
+	bucket.size = fields.at( 4 ).toLongLong( &ok );
+
+    if ( ! ok )
+	return false;
+
+    if ( keyword == "Type" )
+    {
+	QString suffix = fields.at( 2 ) == "-" ? QString() : QUrl::fromPercentEncoding( fields.at( 2 ) );
+	_types.insert( suffix, bucket );
+
+	return true;
+    }
+
+    int key = fields.at( 2 ).toInt( &ok );
+
+    if ( ok )
+    {
+	if ( keyword == "Size" )
+	    _sizes.insert( key, bucket );
+	else if ( keyword == "Year" )
+	    _years.insert( key, bucket );
+	else if ( keyword == "User" )
+	    _users.insert( key, bucket );
+	else
+	    _groups.insert( key, bucket );
+    }
+
+    return ok;
+}
+
+
+const CacheSummaryDir * CacheSummary::dir( const QString & path ) const
+{
+    int index = _dirIndex.value( path, -1 );
+
+    return index < 0 ? 0 : &_dirs.at( index );
+}
@@ -0,0 +1,192 @@
+/*
+ *   File name: CacheSummary.h
+ *   Summary:	Summary section of QDirStat cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheSummary_h
+#define CacheSummary_h
+
+
+#include <time.h>	// time_t
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QMap>
+
+#include "FileSize.h"
+
+
+// Number of directory levels below the toplevel directory that the summary
+// has the totals for
+
+#define CACHE_SUMMARY_DEPTH	3
+
+
+namespace QDirStat
+{
+    class BlockGzipWriter;
+    class DirInfo;
+    class FileInfo;
+
+
+    /**
+     * The totals of one directory in a cache summary.
+     **/
+    struct CacheSummaryDir
+    {
+	QString	  path;
+	int	  depth;	// 0 for the toplevel directory
+	FileSize  totalSize;
+	FileSize  allocatedSize;
+	FileCount items;
+	FileCount files;
+	FileCount subDirs;
+	time_t	  latestMtime;
+    };
+
+
+    /**
+     * Number of files and their total size in one bucket of a histogram.
+     **/
+    struct CacheSummaryBucket
+    {
+	CacheSummaryBucket(): files( 0 ), size( 0 ) {}
+
+	FileCount files;
+	FileSize  size;
+    };
+
+    typedef QMap<int, CacheSummaryBucket>	 CacheSummaryHistogram;
+    typedef QHash<QString, CacheSummaryBucket> CacheSummaryTypes;
+
+
+    /**
+     * Summary of a cache file: The totals of the directories of the first
+     * CACHE_SUMMARY_DEPTH levels and histograms of all files by size, by
+     * year of the modification time, by suffix and by owner.
+     *
+     * CacheWriter collects this while it writes the tree and appends it
+     * after the tree as comment lines ("#S ..."), so anything that reads
+     * cache files without knowing about it simply skips it. The position
+     * is stored in the CacheIndex, so read() can jump right to it without
+     * parsing the tree. That is enough for showing the sizes of the top
+     * levels while the tree is still being read, and for anything that
+     * never needs the individual files.
+     **/
+    class CacheSummary
+    {
+    public:
+
+	/**
+	 * Constructor for an empty summary.
+	 **/
+	CacheSummary();
+
+	/**
+	 * Return 'true' if there is nothing in this summary.
+	 **/
+	bool isEmpty() const { return _dirs.isEmpty(); }
+
+	/**
+	 * Add directory 'dir' with URL 'url' if it is not too deep. The
+	 * first one is the toplevel directory. This is used while writing.
+	 **/
+	void addDir( DirInfo * dir, const QString & url );
+
+	/**
+	 * Add file 'item' to the histograms. This is used while writing.
+	 **/
+	void addFile( FileInfo * item );
+
+	/**
+	 * Write the summary to cache file 'cache'.
+	 **/
+	void write( BlockGzipWriter * cache ) const;
+
+	/**
+	 * Read the summary of cache file 'cacheFileName'. This needs the
+	 * index of that cache file (see CacheIndex) to find it. Return
+	 * 'false' if there is no index or no summary.
+	 **/
+	bool read( const QString & cacheFileName );
+
+	/**
+	 * Return the directories in the order of the cache file.
+	 **/
+	const QVector<CacheSummaryDir> & dirs() const { return _dirs; }
+
+	/**
+	 * Return the summary of directory 'path' or 0 if there is none.
+	 **/
+	const CacheSummaryDir * dir( const QString & path ) const;
+
+	/**
+	 * Return the histogram of the file sizes: Bucket 0 is for empty
+	 * files, bucket i for 2^(i-1) .. 2^i - 1 bytes.
+	 **/
+	const CacheSummaryHistogram & sizeHistogram() const { return _sizes; }
+
+	/**
+	 * Return the histogram of the years of the modification times.
+	 **/
+	const CacheSummaryHistogram & yearHistogram() const { return _years; }
+
+	/**
+	 * Return the files by suffix (lowercase with a leading '.'). Files
+	 * without a suffix are in "", the suffixes that were not among the
+	 * largest ones in "*".
+	 **/
+	const CacheSummaryTypes & types() const { return _types; }
+
+	/**
+	 * Return the files by user ID. Files without a known user are not in
+	 * here.
+	 **/
+	const CacheSummaryHistogram & users() const { return _users; }
+
+	/**
+	 * Return the files by group ID. Files without a known group are not
+	 * in here.
+	 **/
+	const CacheSummaryHistogram & groups() const { return _groups; }
+
+	/**
+	 * Return the size histogram bucket for a file of 'size' bytes.
+	 **/
+	static int sizeBucket( FileSize size );
+
+
+    protected:
+
+	/**
+	 * Parse one "#S" line from a cache file. Return 'false' if it is
+	 * not a valid summary line.
+	 **/
+	bool parseLine( const QByteArray & line );
+
+	/**
+	 * Return the suffix of 'name' for the types or "" if there is none.
+	 **/
+	static QString suffix( const QString & name );
+
+
+	QVector<CacheSummaryDir> _dirs;
+	QHash<QString, int>	 _dirIndex;
+	QString			 _toplevelUrl;
+	CacheSummaryHistogram	 _sizes;
+	CacheSummaryHistogram	 _years;
+	CacheSummaryTypes	 _types;
+	CacheSummaryHistogram	 _users;
+	CacheSummaryHistogram	 _groups;
+
+    };	// class CacheSummary
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheSummary_h
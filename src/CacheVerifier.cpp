@@ -0,0 +1,348 @@
+/*
+ *   File name: CacheVerifier.cpp
+ *   Summary:	Check the contents of a DirTree read from a cache against the disk
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stdlib.h>	// random()
+#include <sys/stat.h>	// lstat()
+
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+#include "CacheVerifier.h"
+#include "FileInfo.h"
+#include "FileInfoIterator.h"
+#include "DirTree.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Files smaller than this are only checked in a random sample by default
+
+#define DEFAULT_VERIFY_MIN_FILE_SIZE	(1024*1024)
+
+// Fraction of the smaller files that is checked by default
+
+#define DEFAULT_VERIFY_SAMPLE_FRACTION	0.01
+
+// Number of items each worker checks in one go
+
+#define VERIFY_BATCH_SIZE		256
+
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Worker for checking a batch of items in a thread of the pool.
+     **/
+    class CacheVerifyWorker: public QRunnable
+    {
+    public:
+
+	CacheVerifyWorker( CacheVerifier *	     verifier,
+			   int			     generation,
+			   const CacheVerifyJobList & jobs ):
+	    _verifier( verifier ),
+	    _generation( generation ),
+	    _jobs( jobs )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    for ( int i=0; i < _jobs.size(); ++i )
+	    {
+		CacheVerifyJob & job = _jobs[i];
+		job.result = CacheVerifier::verify( job );
+	    }
+
+	    // The verifier waits for all workers in its destructor, so it
+	    // is still there.
+
+	    _verifier->workerDone( _generation, _jobs );
+	}
+
+    protected:
+
+	CacheVerifier *	   _verifier;
+	int		   _generation;
+	CacheVerifyJobList _jobs;
+    };
+}
+
+
+CacheVerifier::CacheVerifier( DirTree * tree ):
+    QObject(),
+    _tree( tree ),
+    _minFileSize( DEFAULT_VERIFY_MIN_FILE_SIZE ),
+    _sampleFraction( DEFAULT_VERIFY_SAMPLE_FRACTION ),
+    _generation( 0 ),
+    _pendingCount( 0 ),
+    _checkedCount( 0 ),
+    _collectScheduled( false )
+{
+    // This is mostly waiting for the disk; don't compete with the GUI thread
+    _threadPool.setMaxThreadCount( qMax( 1, QThread::idealThreadCount() - 1 ) );
+}
+
+
+CacheVerifier::~CacheVerifier()
+{
+    cancel();
+    _threadPool.waitForDone();
+}
+
+
+void CacheVerifier::setSampleFraction( double fraction )
+{
+    _sampleFraction = qBound( 0.0, fraction, 1.0 );
+}
+
+
+void CacheVerifier::start( FileInfo * subtree )
+{
+    cancel();
+    _mismatches.clear();
+    _checkedCount = 0;
+
+    if ( ! subtree )
+	return;
+
+    CacheVerifyJobList jobs;
+    collectJobs( subtree, jobs );
+
+    logInfo() << "Checking " << jobs.size() << " items in " << subtree
+	      << " against the disk: All directories, files of at least "
+	      << formatSize( _minFileSize ) << " and "
+	      << formatPercent( 100.0 * _sampleFraction ) << " of the others" << endl;
+
+    for ( int start = 0; start < jobs.size(); start += VERIFY_BATCH_SIZE )
+    {
+	CacheVerifyWorker * worker = new CacheVerifyWorker( this, _generation,
+							    jobs.mid( start, VERIFY_BATCH_SIZE ) );
+	CHECK_NEW( worker );
+
+	_threadPool.start( worker );	// takes over ownership
+    }
+
+    _pendingCount = jobs.size();
+
+    if ( _pendingCount == 0 )
+	emit finished();
+}
+
+
+void CacheVerifier::cancel()
+{
+    // Workers that did not start yet are simply dropped; the results of
+    // those that are running will be ignored because of the new generation.
+
+    _threadPool.clear();
+
+    QMutexLocker locker( &_mutex );
+    _results.clear();
+    ++_generation;
+    _pendingCount = 0;
+    _removed.clear();
+}
+
+
+void CacheVerifier::clear()
+{
+    cancel();
+    _mismatches.clear();
+    _checkedCount = 0;
+}
+
+
+void CacheVerifier::remove( FileInfo * item )
+{
+    if ( _pendingCount > 0 )
+    {
+	// A worker might still be checking it; drop that result when it comes
+
+	_removed.insert( item );
+    }
+
+    if ( ! _mismatches.isEmpty() )
+	_mismatches.remove( item );
+}
+
+
+FileInfoList CacheVerifier::mismatches( FileInfo * subtree ) const
+{
+    FileInfoList items;
+
+    for ( QHash<FileInfo *, CacheMismatch>::const_iterator it = _mismatches.constBegin();
+	  it != _mismatches.constEnd();
+	  ++it )
+    {
+	if ( ! subtree || it.key()->isInSubtree( subtree ) )
+	    items << it.key();
+    }
+
+    return items;
+}
+
+
+void CacheVerifier::collectJobs( FileInfo * subtree, CacheVerifyJobList & jobs )
+{
+    addJob( subtree, jobs );
+
+    FileInfoList dirs;
+    dirs << subtree;
+
+    while ( ! dirs.isEmpty() )
+    {
+	FileInfoIterator it( dirs.takeLast() );
+
+	while ( *it )
+	{
+	    FileInfo * item = *it;
+
+	    if ( item->hasChildren() )
+		dirs << item;
+
+	    addJob( item, jobs );
+	    ++it;
+	}
+    }
+}
+
+
+void CacheVerifier::addJob( FileInfo * item, CacheVerifyJobList & jobs )
+{
+    if ( item->isPseudoDir() || item->isPkgInfo() || item->isExcluded() ||
+	 ! item->isLocalFile() || item == _tree->root() )
+    {
+	return;
+    }
+
+    if ( item->isDirInfo() )
+    {
+	// Mount points that were not read are not in the cache file either
+
+	if ( item->readState() == DirOnRequestOnly )
+	    return;
+    }
+    else if ( item->rawByteSize() < _minFileSize )
+    {
+	if ( _sampleFraction <= 0.0 ||
+	     random() >= _sampleFraction * RAND_MAX )
+	{
+	    return;
+	}
+    }
+
+    CacheVerifyJob job;
+    job.item   = item;
+    job.path   = item->url();
+    job.mode   = item->mode();
+    job.size   = item->rawByteSize();
+    job.mtime  = item->mtime();
+    job.result = CacheMatch;
+
+    jobs << job;
+}
+
+
+CacheMismatch CacheVerifier::verify( const CacheVerifyJob & job )
+{
+    struct stat statInfo;
+
+    if ( lstat( job.path.toUtf8().constData(), &statInfo ) != 0 )
+	return CacheMissingOnDisk;
+
+    if ( ( statInfo.st_mode & S_IFMT ) != ( job.mode & S_IFMT ) )
+	return CacheTypeChanged;
+
+    // The size of a directory says nothing about its contents
+
+    if ( S_ISREG( statInfo.st_mode ) && statInfo.st_size != job.size )
+	return CacheSizeChanged;
+
+    if ( statInfo.st_mtime != job.mtime )
+	return CacheMtimeChanged;
+
+    return CacheMatch;
+}
+
+
+QString CacheVerifier::mismatchText( CacheMismatch mismatch )
+{
+    switch ( mismatch )
+    {
+	case CacheMatch:		return tr( "Unchanged" );
+	case CacheMissingOnDisk:	return tr( "Missing on disk" );
+	case CacheTypeChanged:		return tr( "Type changed" );
+	case CacheSizeChanged:		return tr( "Size changed" );
+	case CacheMtimeChanged:		return tr( "Modified" );
+    }
+
+    return QString();
+}
+
+
+void CacheVerifier::workerDone( int generation, const CacheVerifyJobList & jobs )
+{
+    QMutexLocker locker( &_mutex );
+
+    _results << CacheVerifyResultPair( generation, jobs );
+
+    if ( ! _collectScheduled )
+    {
+	_collectScheduled = true;
+	QMetaObject::invokeMethod( this, "collectResults", Qt::QueuedConnection );
+    }
+}
+
+
+void CacheVerifier::collectResults()
+{
+    QList<CacheVerifyResultPair> results;
+
+    {
+	QMutexLocker locker( &_mutex );
+	results = _results;
+	_results.clear();
+	_collectScheduled = false;
+    }
+
+    if ( results.isEmpty() )	// Cancelled in the meantime
+	return;
+
+    foreach ( const CacheVerifyResultPair & result, results )
+    {
+	if ( result.first != _generation )	// Items might be long gone
+	    continue;
+
+	foreach ( const CacheVerifyJob & job, result.second )
+	{
+	    if ( _removed.contains( job.item ) )
+		continue;
+
+	    if ( job.result != CacheMatch )
+		_mismatches.insert( job.item, job.result );
+	}
+
+	_pendingCount -= result.second.size();
+	_checkedCount += result.second.size();
+    }
+
+    if ( _pendingCount <= 0 )
+    {
+	_pendingCount = 0;
+	_removed.clear();
+	logInfo() << _checkedCount << " items checked against the disk; "
+		  << _mismatches.size() << " mismatches" << endl;
+	emit finished();
+    }
+}
@@ -0,0 +1,244 @@
+/*
+ *   File name: CacheVerifier.h
+ *   Summary:	Check the contents of a DirTree read from a cache against the disk
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheVerifier_h
+#define CacheVerifier_h
+
+
+#include <sys/types.h>	// mode_t
+#include <time.h>	// time_t
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    class DirTree;
+
+
+    /**
+     * Result of checking one item against the disk, in the order in which
+     * the checks are done.
+     **/
+    enum CacheMismatch
+    {
+	CacheMatch = 0,		// Everything as expected
+	CacheMissingOnDisk,	// Not there anymore (or not accessible)
+	CacheTypeChanged,	// e.g. a file that is now a directory
+	CacheSizeChanged,	// Different size (only for files)
+	CacheMtimeChanged	// Different modification time
+    };
+
+
+    /**
+     * One item to check in the worker threads. Everything that is needed
+     * is copied in the GUI thread, so the workers don't need to access the
+     * FileInfo.
+     **/
+    struct CacheVerifyJob
+    {
+	FileInfo *    item;
+	QString	      path;
+	mode_t	      mode;
+	FileSize      size;
+	time_t	      mtime;
+	CacheMismatch result;
+    };
+
+    typedef QVector<CacheVerifyJob> CacheVerifyJobList;
+    typedef QPair<int, CacheVerifyJobList> CacheVerifyResultPair;	// generation, jobs
+
+
+    /**
+     * Check a DirTree that was read from a cache file against the disk
+     * without reading the tree again: Each directory and a selection of the
+     * files are checked with lstat(), and their type, size and modification
+     * time are compared with the tree. A directory gets a new modification
+     * time whenever an entry is created, removed or renamed in it, so this
+     * also finds changed directory contents without reading them.
+     *
+     * Since there are many more files than directories, files of at least
+     * minFileSize() bytes are always checked, and only a random sample
+     * (sampleFraction()) of the smaller ones.
+     *
+     * This is done in batches in a thread pool of its own while the GUI
+     * keeps going. finished() is emitted when all results are there.
+     **/
+    class CacheVerifier: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	CacheVerifier( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~CacheVerifier();
+
+	/**
+	 * Return the size from which on files are always checked.
+	 **/
+	FileSize minFileSize() const { return _minFileSize; }
+
+	/**
+	 * Set the size from which on files are always checked.
+	 **/
+	void setMinFileSize( FileSize size ) { _minFileSize = size; }
+
+	/**
+	 * Return the fraction (0.0 .. 1.0) of the smaller files that are
+	 * checked.
+	 **/
+	double sampleFraction() const { return _sampleFraction; }
+
+	/**
+	 * Set the fraction (0.0 .. 1.0) of the smaller files that are
+	 * checked.
+	 **/
+	void setSampleFraction( double fraction );
+
+	/**
+	 * Check 'subtree' against the disk in the background. Any previous
+	 * run is cancelled, and its results are discarded.
+	 **/
+	void start( FileInfo * subtree );
+
+	/**
+	 * Cancel checking. The results that are already there are kept.
+	 **/
+	void cancel();
+
+	/**
+	 * Remove all results and cancel checking.
+	 **/
+	void clear();
+
+	/**
+	 * Remove the result for 'item' if there is one. This is called when
+	 * the item is destroyed.
+	 **/
+	void remove( FileInfo * item );
+
+	/**
+	 * Return 'true' if items are still being checked.
+	 **/
+	bool isBusy() const { return _pendingCount > 0; }
+
+	/**
+	 * Return the number of items that were checked in the last run.
+	 **/
+	int checkedCount() const { return _checkedCount; }
+
+	/**
+	 * Return 'true' if any mismatches were found.
+	 **/
+	bool hasMismatches() const { return ! _mismatches.isEmpty(); }
+
+	/**
+	 * Return the result for 'item'. Items that were not checked are a
+	 * CacheMatch.
+	 **/
+	CacheMismatch mismatch( FileInfo * item ) const
+	    { return _mismatches.isEmpty() ? CacheMatch : _mismatches.value( item, CacheMatch ); }
+
+	/**
+	 * Return the items in 'subtree' that don't match the disk.
+	 **/
+	FileInfoList mismatches( FileInfo * subtree ) const;
+
+	/**
+	 * Return a text for 'mismatch' for the user.
+	 **/
+	static QString mismatchText( CacheMismatch mismatch );
+
+	/**
+	 * Check 'job' against the disk and return the result.
+	 *
+	 * This is called in the worker threads.
+	 **/
+	static CacheMismatch verify( const CacheVerifyJob & job );
+
+
+    signals:
+
+	/**
+	 * Emitted when checking is finished (but not when it is cancelled).
+	 **/
+	void finished();
+
+
+    protected slots:
+
+	/**
+	 * Take over the results of the workers. This is called in the GUI
+	 * thread.
+	 **/
+	void collectResults();
+
+
+    protected:
+
+	/**
+	 * Add the items to check in 'subtree' recursively to 'jobs'.
+	 **/
+	void collectJobs( FileInfo * subtree, CacheVerifyJobList & jobs );
+
+	/**
+	 * Add a job for 'item' to 'jobs'.
+	 **/
+	void addJob( FileInfo * item, CacheVerifyJobList & jobs );
+
+	/**
+	 * Notification from a worker thread that it is done with 'jobs'.
+	 **/
+	void workerDone( int generation, const CacheVerifyJobList & jobs );
+
+	friend class CacheVerifyWorker;
+
+
+	//
+	// Data members
+	//
+
+	DirTree *			  _tree;
+	FileSize			  _minFileSize;
+	double				  _sampleFraction;
+	QThreadPool			  _threadPool;
+	int				  _generation;
+	int				  _pendingCount;
+	int				  _checkedCount;
+	QHash<FileInfo *, CacheMismatch>  _mismatches;
+	QSet<FileInfo *>		  _removed;	// while workers are busy
+
+	// Shared with the worker threads; protected by _mutex
+	QMutex				  _mutex;
+	QList<CacheVerifyResultPair>	  _results;
+	bool				  _collectScheduled;
+
+    };	// class CacheVerifier
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheVerifier_h
@@ -7,6 +7,8 @@
  */
 
 
+#include <unistd.h>	// sysconf()
+
 #include <QApplication>
 #include <QRegExp>
 #include <QProcessEnvironment>
@@ -24,6 +26,13 @@
 #define SIMULATE_COMMAND	1
 #define WAIT_TIMEOUT_MILLISEC	30000
 
+// Linux limits the length of each single command line argument
+// (MAX_ARG_STRLEN), and the complete cleanup command is one argument of
+// "sh -c", so this applies to batch mode, not only ARG_MAX.
+
+#define MAX_SINGLE_ARG_LEN	( 128 * 1024 )
+#define COMMAND_LEN_RESERVE	4096
+
 using namespace QDirStat;
 
 
@@ -40,6 +49,8 @@ Cleanup::Cleanup( QString   command,
     _worksForDotEntry	   = false;
     _recurse		   = false;
     _askForConfirmation	   = false;
+    _maxParallel	   = 0;
+    _batch		   = false;
     _refreshPolicy	   = RefreshThis;
     _outputWindowPolicy	   = ShowAfterTimeout;
     _outputWindowTimeout   = 500;
@@ -75,6 +86,12 @@ bool Cleanup::worksFor( FileInfo *item ) const
 }
 
 
+bool Cleanup::isNativeDelete() const
+{
+    return ! _recurse && _command.simplified() == "rm -rf %p";
+}
+
+
 void Cleanup::execute( FileInfo *item, OutputWindow * outputWindow )
 {
     if ( worksFor( item ) )
@@ -89,6 +106,97 @@ void Cleanup::execute( FileInfo *item, OutputWindow * outputWindow )
 }
 
 
+/**
+ * Return the length of 'str' in the command line when it is quoted and
+ * escaped (see Cleanup::quoted() and Cleanup::escaped()) and followed by a
+ * blank.
+ **/
+static int quotedLength( const QString & str )
+{
+    return str.toUtf8().size() + 3 + 3 * str.count( '\'' );
+}
+
+
+void Cleanup::executeBatch( const QList<FileInfo *> & items, OutputWindow * outputWindow )
+{
+    if ( _recurse )
+    {
+	logWarning() << this << ": Batch mode is not supported for recursive cleanups" << endl;
+
+	foreach ( FileInfo * item, items )
+	    execute( item, outputWindow );
+
+	return;
+    }
+
+    // Group the items by their parent directory: That is the working
+    // directory of each command and what %d expands to.
+
+    QMap<QString, QList<FileInfo *> > dirItems;
+
+    foreach ( FileInfo * item, items )
+    {
+	if ( ! worksFor( item ) )
+	{
+	    logWarning() << "Cleanup " << this << " does not work for " << item << endl;
+	    continue;
+	}
+
+	FileInfo * parent = item->parent();
+
+	if ( parent && parent->isPseudoDir() )
+	    parent = parent->parent();
+
+	dirItems[ parent ? parent->path() : itemDir( item ) ] << item;
+    }
+
+    int pathCount = _command.count( "%p" );
+    int nameCount = _command.count( "%n" );
+    int maxLen	  = maxCommandLength();
+
+    for ( QMap<QString, QList<FileInfo *> >::const_iterator it = dirItems.constBegin();
+	  it != dirItems.constEnd();
+	  ++it )
+    {
+	const QString & dir = it.key();
+
+	if ( pathCount + nameCount == 0 )
+	{
+	    // Nothing to pass for each item: Just one command for this directory
+
+	    startCommand( expandBatchVariables( QList<FileInfo *>(), dir, _command ), dir, outputWindow );
+	    continue;
+	}
+
+	const int baseLen = _command.toUtf8().size() +
+	    _command.count( "%d" ) * quotedLength( dir );
+
+	QList<FileInfo *> batch;
+	int len = baseLen;
+
+	foreach ( FileInfo * item, it.value() )
+	{
+	    int itemLen =
+		pathCount * quotedLength( item->path() ) +
+		nameCount * quotedLength( item->name() );
+
+	    if ( ! batch.isEmpty() && len + itemLen > maxLen )
+	    {
+		startCommand( expandBatchVariables( batch, dir, _command ), dir, outputWindow );
+		batch.clear();
+		len = baseLen;
+	    }
+
+	    batch << item;
+	    len	  += itemLen;
+	}
+
+	if ( ! batch.isEmpty() )
+	    startCommand( expandBatchVariables( batch, dir, _command ), dir, outputWindow );
+    }
+}
+
+
 void Cleanup::executeRecursive( FileInfo *item, OutputWindow * outputWindow )
 {
     if ( worksFor( item ) )
@@ -188,6 +296,30 @@ QString Cleanup::expandVariables( const FileInfo * item,
 }
 
 
+QString Cleanup::expandBatchVariables( const QList<FileInfo *> & items,
+				       const QString		 & dirName,
+				       const QString		 & unexpanded ) const
+{
+    QString expanded = expandDesktopSpecificApps( unexpanded );
+    QStringList paths;
+    QStringList names;
+
+    foreach ( const FileInfo * item, items )
+    {
+	paths << quoted( escaped( item->path() ) );
+	names << quoted( escaped( item->name() ) );
+    }
+
+    expanded.replace( "%p", paths.join( " " ) );
+    expanded.replace( "%n", names.join( " " ) );
+
+    if ( ! dirName.isEmpty() )
+	expanded.replace( "%d", quoted( escaped( dirName ) ) );
+
+    return expanded;
+}
+
+
 QString Cleanup::quoted( const QString & unquoted) const
 {
     return "'" + unquoted + "'";
@@ -256,6 +388,14 @@ QString Cleanup::chooseShell( OutputWindow * outputWindow ) const
 void Cleanup::runCommand( const FileInfo * item,
 			  const QString	 & command,
 			  OutputWindow	 * outputWindow ) const
+{
+    startCommand( expandVariables( item, command ), itemDir( item ), outputWindow );
+}
+
+
+void Cleanup::startCommand( const QString & cleanupCommand,
+			    const QString & dir,
+			    OutputWindow  * outputWindow ) const
 {
     QString shell = chooseShell( outputWindow );
 
@@ -267,13 +407,12 @@ void Cleanup::runCommand( const FileInfo * item,
 	return;
     }
 
-    QString cleanupCommand( expandVariables( item, command ));
     Process * process = new Process( parent() );
     CHECK_NEW( process );
 
     process->setProgram( shell );
     process->setArguments( QStringList() << "-c" << cleanupCommand );
-    process->setWorkingDirectory( itemDir( item ) );
+    process->setWorkingDirectory( dir );
     // logDebug() << "New process \"" << process << endl;
 
     outputWindow->addProcess( process );
@@ -283,6 +422,18 @@ void Cleanup::runCommand( const FileInfo * item,
 }
 
 
+int Cleanup::maxCommandLength()
+{
+    long argMax = sysconf( _SC_ARG_MAX );
+    long maxLen = MAX_SINGLE_ARG_LEN;
+
+    if ( argMax > 0 )
+	maxLen = qMin( maxLen, argMax / 2 ); // Leave room for the environment
+
+    return (int) maxLen - COMMAND_LEN_RESERVE;
+}
+
+
 QMap<int, QString> Cleanup::refreshPolicyMapping()
 {
     QMap<int, QString> mapping;
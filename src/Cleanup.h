@@ -131,6 +131,35 @@ namespace QDirStat
 	 **/
 	bool askForConfirmation() const { return _askForConfirmation; }
 
+	/**
+	 * Return the maximum number of processes of this cleanup to run in
+	 * parallel if multiple items are selected. 0 (the default) means to
+	 * use the OutputWindow default, i.e. as many as are useful for this
+	 * machine. Recursive cleanups always run one after another since the
+	 * order of the directory levels matters.
+	 **/
+	int maxParallel() const { return _maxParallel; }
+
+	/**
+	 * Return 'true' if this cleanup passes many items to one command
+	 * (like 'xargs') instead of starting the command once for each
+	 * selected item: %p and %n then expand to the paths or names of all
+	 * items in the same directory, and the command is split into as
+	 * many invocations as needed to stay below the system's limit for
+	 * the command line length.
+	 *
+	 * This is not supported for recursive cleanups.
+	 **/
+	bool batch() const { return _batch; }
+
+	/**
+	 * Return 'true' if this cleanup simply deletes the items with
+	 * "rm -rf %p". This is done in-process with a Deleter instead of
+	 * starting a shell and an 'rm' process for each item. Use a command
+	 * like "/bin/rm -rf %p" to really start 'rm'.
+	 **/
+	bool isNativeDelete() const;
+
 	/**
 	 * Return the shell to use to invoke the command of this cleanup.
 	 * If this is is empty, use defaultShells().first().
@@ -207,8 +236,8 @@ namespace QDirStat
 	 * output window for all cleanup tasks that are to be started in one
 	 * user action; if multiple items are selected, the corresponding
 	 * command will be started for each of the selected items individually
-	 * one after another, but the output window will remain open and
-	 * collect the output of each one. Likewise, if a command is recursive,
+	 * (possibly in parallel, see maxParallel()), but the output window
+	 * will remain open and collect the output of each one. Likewise, if a command is recursive,
 	 * it is started for each directory level, and the output is also
 	 * collected in the same output window.
 	 *
@@ -306,6 +335,8 @@ namespace QDirStat
 	void setWorksForDotEntry     ( bool canDo    )		   { _worksForDotEntry	    = canDo;	 }
 	void setRecurse		     ( bool recurse  )		   { _recurse		    = recurse;	 }
 	void setAskForConfirmation   ( bool ask	     )		   { _askForConfirmation    = ask;	 }
+	void setMaxParallel	     ( int maxParallel )	   { _maxParallel	    = maxParallel; }
+	void setBatch		     ( bool batch    )		   { _batch		    = batch;	 }
 	void setShell		     ( const QString &	  sh	 ) { _shell		    = sh;	 }
 	void setRefreshPolicy	     ( RefreshPolicy	  policy ) { _refreshPolicy	    = policy;	 }
 	void setOutputWindowPolicy   ( OutputWindowPolicy policy ) { _outputWindowPolicy    = policy;	 }
@@ -324,6 +355,12 @@ namespace QDirStat
 	 **/
 	void execute( FileInfo * item, OutputWindow * outputWindow );
 
+	/**
+	 * Perform the cleanup with all 'items' in batch mode (see batch()):
+	 * Start as few commands as possible, each with many items.
+	 **/
+	void executeBatch( const QList<FileInfo *> & items, OutputWindow * outputWindow );
+
 
     protected:
 
@@ -383,6 +420,15 @@ namespace QDirStat
 	QString expandVariables ( const FileInfo * item,
 				  const QString	 & unexpanded ) const;
 
+	/**
+	 * Expand the variables in 'unexpanded' for a batch of 'items' that
+	 * are all in directory 'dirName': %p and %n expand to the quoted
+	 * paths and names of all items, separated by blanks.
+	 **/
+	QString expandBatchVariables( const QList<FileInfo *> & items,
+				      const QString		& dirName,
+				      const QString		& unexpanded ) const;
+
 	/**
 	 * Expand some variables in string 'unexpanded' to application that are
 	 * typically different from one desktop (KDE, Gnome, Xfce) to the next:
@@ -410,6 +456,20 @@ namespace QDirStat
 			 const QString	& command,
 			 OutputWindow	* outputWindow) const;
 
+	/**
+	 * Start the already expanded command 'cleanupCommand' with a shell
+	 * in directory 'dir'.
+	 **/
+	void startCommand( const QString & cleanupCommand,
+			   const QString & dir,
+			   OutputWindow	 * outputWindow ) const;
+
+	/**
+	 * Return the maximum length in bytes of one command line for batch
+	 * mode.
+	 **/
+	static int maxCommandLength();
+
 
 	//
 	// Data members
@@ -424,6 +484,8 @@ namespace QDirStat
 	bool		   _worksForDotEntry;
 	bool		   _recurse;
 	bool		   _askForConfirmation;
+	int		   _maxParallel;
+	bool		   _batch;
 	QString		   _shell;
 	RefreshPolicy	   _refreshPolicy;
 	OutputWindowPolicy _outputWindowPolicy;
@@ -20,6 +20,7 @@
 #include "SelectionModel.h"
 #include "OutputWindow.h"
 #include "Refresher.h"
+#include "Deleter.h"
 #include "Logger.h"
 #include "Exception.h"
 
@@ -255,6 +256,13 @@ void CleanupCollection::execute()
     CHECK_NEW( outputWindow );
     outputWindow->setAutoClose( cleanup->outputWindowAutoClose() );
 
+    // The directory levels of a recursive cleanup need to be done in order
+
+    if ( cleanup->recurse() )
+	outputWindow->setMaxParallel( 1 );
+    else if ( cleanup->maxParallel() > 0 )
+	outputWindow->setMaxParallel( cleanup->maxParallel() );
+
     switch ( cleanup->outputWindowPolicy() )
     {
 	case Cleanup::ShowAlways:
@@ -297,16 +305,55 @@ void CleanupCollection::execute()
     // perform an action on each of them individually. We can't know if the
     // action on the ancestor affects any of its children.
 
-    foreach ( FileInfo * item, selection )
+    Deleter * deleter = 0;
+
+    if ( cleanup->isNativeDelete() )
     {
-	if ( cleanup->worksFor( item ) )
+	// No shell and no 'rm' processes: Delete everything along the subtrees
+	// that are already in the DirTree in worker threads. The selection
+	// needs to be normalized here since the Deleter takes care of the
+	// children of each directory.
+
+	FileInfoSet items;
+
+	foreach ( FileInfo * item, selection.normalized() )
 	{
-	    cleanup->execute( item, outputWindow );
+	    if ( cleanup->worksFor( item ) )
+		items << item;
+	    else
+	    {
+		logWarning() << "Cleanup " << cleanup
+			     << " does not work for " << item << endl;
+	    }
 	}
-	else
+
+	deleter = new Deleter( items, this );
+	CHECK_NEW( deleter );
+
+	deleter->setOutputWindow( outputWindow );
+
+	connect( deleter, SIGNAL( progress	 ( QString ) ),
+		 this,	  SIGNAL( cleanupProgress( QString ) ) );
+
+	deleter->start();
+    }
+    else if ( cleanup->batch() )
+    {
+	cleanup->executeBatch( selection.toList(), outputWindow );
+    }
+    else
+    {
+	foreach ( FileInfo * item, selection )
 	{
-	    logWarning() << "Cleanup " << cleanup
-			 << " does not work for " << item << endl;
+	    if ( cleanup->worksFor( item ) )
+	    {
+		cleanup->execute( item, outputWindow );
+	    }
+	    else
+	    {
+		logWarning() << "Cleanup " << cleanup
+			     << " does not work for " << item << endl;
+	    }
 	}
     }
 
@@ -328,7 +375,10 @@ void CleanupCollection::execute()
         }
     }
 
-    outputWindow->noMoreProcesses();
+    // The Deleter tells the output window itself when it is done
+
+    if ( ! deleter )
+	outputWindow->noMoreProcesses();
 }
 
 
@@ -525,6 +575,8 @@ void CleanupCollection::readSettings()
 	    bool worksForDotEntry      = settings.value( "WorksForDotEntry"	, true	).toBool();
 	    bool recurse	       = settings.value( "Recurse"		, false ).toBool();
 	    bool askForConfirmation    = settings.value( "AskForConfirmation"	, false ).toBool();
+	    bool batch		       = settings.value( "Batch"		, false ).toBool();
+	    int	 maxParallel	       = settings.value( "MaxParallel"		, 0	).toInt();
 	    bool outputWindowAutoClose = settings.value( "OutputWindowAutoClose", false ).toBool();
 	    int	 outputWindowTimeout   = settings.value( "OutputWindowTimeout"	, 0	).toInt();
 
@@ -549,6 +601,8 @@ void CleanupCollection::readSettings()
 		cleanup->setRecurse	    ( recurse	       );
 		cleanup->setShell	    ( shell	       );
 		cleanup->setAskForConfirmation	 ( askForConfirmation	 );
+		cleanup->setBatch		 ( batch		 );
+		cleanup->setMaxParallel		 ( maxParallel		 );
 		cleanup->setOutputWindowAutoClose( outputWindowAutoClose );
 		cleanup->setOutputWindowTimeout	 ( outputWindowTimeout	 );
 		cleanup->setRefreshPolicy     ( static_cast<Cleanup::RefreshPolicy>( refreshPolicy ) );
@@ -624,11 +678,15 @@ void CleanupCollection::writeSettings()
 	settings.setValue( "WorksForDotEntry"	  , cleanup->worksForDotEntry()	     );
 	settings.setValue( "Recurse"		  , cleanup->recurse()		     );
 	settings.setValue( "AskForConfirmation"	  , cleanup->askForConfirmation()    );
+	settings.setValue( "Batch"		  , cleanup->batch()		     );
 	settings.setValue( "OutputWindowAutoClose", cleanup->outputWindowAutoClose() );
 
 	if ( cleanup->outputWindowTimeout() > 0 )
 	    settings.setValue( "OutputWindowTimeout"  , cleanup->outputWindowTimeout()	 );
 
+	if ( cleanup->maxParallel() > 0 )
+	    settings.setValue( "MaxParallel", cleanup->maxParallel() );
+
 	writeEnumEntry( settings, "RefreshPolicy",
 			cleanup->refreshPolicy(),
 			Cleanup::refreshPolicyMapping() );
@@ -138,6 +138,11 @@ namespace QDirStat
 	 **/
 	void startingCleanup( const QString & cleanupName );
 
+	/**
+	 * Emitted while a cleanup is running if it can report any progress.
+	 **/
+	void cleanupProgress( const QString & text );
+
 	/**
 	 * Emitted when the last process of a cleanup is finished.
 	 *
@@ -159,6 +159,8 @@ void CleanupConfigPage::save( void * value )
 	cleanup->setShell( _ui->shellComboBox->currentText() );
 
     cleanup->setRecurse( _ui->recurseCheckBox->isChecked() );
+    cleanup->setBatch  ( _ui->batchCheckBox->isChecked()   );
+    cleanup->setMaxParallel( _ui->maxParallelSpinBox->value() );
 
     cleanup->setAskForConfirmation( _ui->askForConfirmationCheckBox->isChecked() );
     cleanup->setWorksForDir	  ( _ui->worksForDirCheckBox->isChecked()	 );
@@ -201,6 +203,8 @@ void CleanupConfigPage::load( void * value )
 
     _ui->recurseCheckBox->setChecked	       ( cleanup->recurse()	       );
     _ui->askForConfirmationCheckBox->setChecked( cleanup->askForConfirmation() );
+    _ui->batchCheckBox->setChecked	       ( cleanup->batch()	       );
+    _ui->maxParallelSpinBox->setValue	       ( cleanup->maxParallel()	       );
     _ui->worksForDirCheckBox->setChecked       ( cleanup->worksForDir()	       );
     _ui->worksForFilesCheckBox->setChecked     ( cleanup->worksForFile()       );
     _ui->worksForDotEntriesCheckBox->setChecked( cleanup->worksForDotEntry()   );
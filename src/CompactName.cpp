@@ -0,0 +1,275 @@
+/*
+ *   File name: CompactName.cpp
+ *   Summary:	Memory-saving storage for file names in the DirTree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// memcpy(), memcmp(), strlen()
+
+#include <QHash>	// qHashBits()
+
+#include "CompactName.h"
+#include "NodeArena.h"
+#include "Exception.h"
+
+
+// The reference count is in the lower 15 bits; the top bit marks names
+// that are in the table of shared names.
+
+#define MAX_REFS		0x7FFF
+#define SHARED_FLAG		0x8000
+
+// Only share names up to this length: Longer ones are rarely repeated, so
+// they would only make the table larger.
+
+#define MAX_SHARED_NAME_LEN	48
+
+
+namespace QDirStat
+{
+    /**
+     * Entry in the table of shared names: The bytes of the name and its
+     * data. For lookups, 'data' is 0 and 'bytes' is the name to find.
+     **/
+    struct SharedNameKey
+    {
+	const char * bytes;
+	int	     len;
+	char *	     data;
+    };
+
+
+    inline uint qHash( const SharedNameKey & key, uint seed )
+    {
+	return qHashBits( key.bytes, key.len, seed );
+    }
+
+
+    inline bool operator==( const SharedNameKey & a, const SharedNameKey & b )
+    {
+	return a.len == b.len && memcmp( a.bytes, b.bytes, a.len ) == 0;
+    }
+
+}	// namespace QDirStat
+
+
+using namespace QDirStat;
+
+
+QSet<SharedNameKey> * CompactName::_sharedNames = 0;
+
+
+CompactName::CompactName( const QString & name ):
+    _data( 0 )
+{
+    if ( ! name.isEmpty() )
+    {
+	QByteArray utf8 = name.toUtf8();
+	assign( utf8.constData(), utf8.size() );
+    }
+}
+
+
+CompactName::CompactName( const char * name ):
+    _data( 0 )
+{
+    if ( name )
+	assign( name, strlen( name ) );
+}
+
+
+CompactName::CompactName( const CompactName & other ):
+    _data( 0 )
+{
+    assign( other );
+}
+
+
+CompactName::~CompactName()
+{
+    release();
+}
+
+
+CompactName & CompactName::operator=( const CompactName & other )
+{
+    if ( other._data != _data )
+    {
+	release();
+	assign( other );
+    }
+
+    return *this;
+}
+
+
+CompactName CompactName::fromBytes( const char * bytes, int len )
+{
+    CompactName name;
+    name.assign( bytes, len );
+
+    return name;
+}
+
+
+bool CompactName::operator==( const CompactName & other ) const
+{
+    if ( _data == other._data )
+	return true;
+
+    int len = byteLength();
+
+    return len == other.byteLength() && memcmp( bytes(), other.bytes(), len ) == 0;
+}
+
+
+char * CompactName::newData( const char * bytes, int len )
+{
+    char * data = (char *) NodeArena::instance()->allocate( COMPACT_NAME_HEADER_SIZE + len );
+
+    ( (quint16 *) data )[0] = (quint16) len;
+    refs( data ) = 1;
+    memcpy( data + COMPACT_NAME_HEADER_SIZE, bytes, len );
+
+    return data;
+}
+
+
+void CompactName::assign( const char * bytes, int len )
+{
+    len = qMin( len, COMPACT_NAME_MAX_LEN );
+
+    if ( len <= 0 )
+    {
+	_data = 0;
+	return;
+    }
+
+    if ( ! _sharedNames || len > MAX_SHARED_NAME_LEN )
+    {
+	_data = newData( bytes, len );
+	return;
+    }
+
+    SharedNameKey key;
+    key.bytes = bytes;
+    key.len   = len;
+    key.data  = 0;
+
+    QSet<SharedNameKey>::iterator it = _sharedNames->find( key );
+
+    if ( it != _sharedNames->end() )
+    {
+	char * data = it->data;
+
+	if ( ( refs( data ) & MAX_REFS ) < MAX_REFS )
+	{
+	    ++refs( data );
+	    _data = data;
+	    return;
+	}
+
+	// Too many references: Start over with a new shared copy. The old
+	// one lives on with the names that still use it.
+
+	refs( data ) &= ~SHARED_FLAG;
+	_sharedNames->erase( it );
+    }
+
+    _data = newData( bytes, len );
+    refs( _data ) |= SHARED_FLAG;
+
+    key.bytes = _data + COMPACT_NAME_HEADER_SIZE;
+    key.data  = _data;
+    _sharedNames->insert( key );
+}
+
+
+void CompactName::assign( const CompactName & other )
+{
+    if ( ! other._data )
+	_data = 0;
+    else if ( ( refs( other._data ) & MAX_REFS ) < MAX_REFS )
+    {
+	_data = other._data;
+	++refs( _data );
+    }
+    else
+	assign( other.bytes(), other.byteLength() );
+}
+
+
+void CompactName::release()
+{
+    if ( ! _data )
+	return;
+
+    quint16 & ref = refs( _data );
+
+    if ( --ref & MAX_REFS )	// Still in use by other names?
+    {
+	_data = 0;
+	return;
+    }
+
+    if ( ( ref & SHARED_FLAG ) && _sharedNames )
+    {
+	SharedNameKey key;
+	key.bytes = bytes();
+	key.len	  = byteLength();
+	key.data  = _data;
+
+	_sharedNames->remove( key );
+    }
+
+    NodeArena::instance()->deallocate( _data, COMPACT_NAME_HEADER_SIZE + byteLength() );
+    _data = 0;
+}
+
+
+void CompactName::setSharing( bool enabled )
+{
+    if ( enabled )
+    {
+	if ( ! _sharedNames )
+	{
+	    _sharedNames = new QSet<SharedNameKey>();
+	    CHECK_NEW( _sharedNames );
+	}
+    }
+    else if ( _sharedNames )
+    {
+	// The names stay valid; they are just no longer in the table
+
+	foreach ( const SharedNameKey & key, *_sharedNames )
+	    refs( key.data ) &= ~SHARED_FLAG;
+
+	delete _sharedNames;
+	_sharedNames = 0;
+    }
+}
+
+
+int CompactName::sharedNameCount()
+{
+    return _sharedNames ? _sharedNames->size() : 0;
+}
+
+
+double CompactName::memoryShare() const
+{
+    if ( ! _data )
+	return 0.0;
+
+    // The NodeArena rounds up to its granularity
+
+    int size	 = COMPACT_NAME_HEADER_SIZE + byteLength();
+    int refCount = ( (const quint16 *) _data )[1] & MAX_REFS;
+
+    size = ( size + NODE_ARENA_GRANULARITY - 1 ) / NODE_ARENA_GRANULARITY * NODE_ARENA_GRANULARITY;
+
+    return size / (double) qMax( 1, refCount );
+}
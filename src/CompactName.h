@@ -0,0 +1,200 @@
+/*
+ *   File name: CompactName.h
+ *   Summary:	Memory-saving storage for file names in the DirTree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CompactName_h
+#define CompactName_h
+
+
+#include <QString>
+#include <QByteArray>
+#include <QSet>
+
+
+// Names can't be longer than this; anything beyond is cut off.
+// This is far above PATH_MAX.
+
+#define COMPACT_NAME_MAX_LEN	0xFFFF
+
+// Length and reference count in front of the bytes
+
+#define COMPACT_NAME_HEADER_SIZE ( 2 * sizeof( quint16 ) )
+
+
+namespace QDirStat
+{
+    struct SharedNameKey;
+
+
+    /**
+     * A file name stored as its bytes in the filesystem, i.e. UTF-8 for
+     * practically all names, with the length and a reference count in
+     * front, in memory from the NodeArena.
+     *
+     * A QString needs 2 bytes for each character plus its header; for the
+     * mostly ASCII file names in a typical tree, this needs less than half
+     * of that, which adds up with millions of names. The price is a
+     * conversion to QString each time the name is used as a string, so use
+     * the names of tree nodes as QStrings only where they are needed, e.g.
+     * for display.
+     *
+     * Names that are not valid UTF-8 are kept with their exact original
+     * bytes (see fromBytes()), so they can still be used for system calls
+     * like lstat(); only the QString from toString() is lossy for them.
+     *
+     * The memory of a name is shared (with a reference count) by all its
+     * copies. With name sharing enabled (see setSharing()), identical
+     * names are shared even if they were created separately: Trees of
+     * source checkouts, node_modules or Maildirs have the same names
+     * ("index.js", "package.json", "cur", "new") over and over again.
+     *
+     * Like the NodeArena, this is not thread-safe: Names are created and
+     * destroyed in the GUI thread.
+     **/
+    class CompactName
+    {
+    public:
+
+	/**
+	 * Constructor for an empty name.
+	 **/
+	CompactName(): _data( 0 ) {}
+
+	/**
+	 * Constructor from a QString. This is stored as UTF-8.
+	 **/
+	CompactName( const QString & name );
+
+	/**
+	 * Constructor from a C string in UTF-8.
+	 **/
+	CompactName( const char * name );
+
+	/**
+	 * Copy constructor.
+	 **/
+	CompactName( const CompactName & other );
+
+	/**
+	 * Destructor.
+	 **/
+	~CompactName();
+
+	/**
+	 * Assignment operator.
+	 **/
+	CompactName & operator=( const CompactName & other );
+
+	/**
+	 * Return a name with the exact bytes 'bytes' with length 'len', no
+	 * matter if that is valid UTF-8 or not.
+	 **/
+	static CompactName fromBytes( const char * bytes, int len );
+
+	/**
+	 * Return the name as a QString. Bytes that are not valid UTF-8 are
+	 * replaced with U+FFFD.
+	 **/
+	QString toString() const
+	    { return _data ? QString::fromUtf8( bytes(), byteLength() ) : QString(); }
+
+	/**
+	 * Return the original bytes of the name.
+	 **/
+	QByteArray toBytes() const
+	    { return _data ? QByteArray( bytes(), byteLength() ) : QByteArray(); }
+
+	/**
+	 * Return the bytes of the name. This is not 0-terminated!
+	 **/
+	const char * bytes() const { return _data ? _data + COMPACT_NAME_HEADER_SIZE : ""; }
+
+	/**
+	 * Return the number of bytes of the name.
+	 **/
+	int byteLength() const { return _data ? ( (const quint16 *) _data )[0] : 0; }
+
+	/**
+	 * Return 'true' if the name is empty.
+	 **/
+	bool isEmpty() const { return _data == 0; }
+
+	/**
+	 * Return this name's share of the memory of its data: The size of
+	 * the data divided by the number of names that share it. The sum for
+	 * all names is the memory they need together.
+	 **/
+	double memoryShare() const;
+
+	/**
+	 * Enable or disable sharing identical names. This affects only names
+	 * that are created from now on. Disabling it frees the table of
+	 * shared names; the names themselves stay valid.
+	 **/
+	static void setSharing( bool enabled );
+
+	/**
+	 * Return 'true' if identical names are shared.
+	 **/
+	static bool sharing() { return _sharedNames != 0; }
+
+	/**
+	 * Return the number of different names in the table of shared names.
+	 **/
+	static int sharedNameCount();
+
+	/**
+	 * Return 'true' if this is the same name as 'other'.
+	 **/
+	bool operator==( const CompactName & other ) const;
+	bool operator!=( const CompactName & other ) const
+	    { return ! ( *this == other ); }
+
+
+    protected:
+
+	/**
+	 * Store 'bytes' with length 'len', sharing them with an identical
+	 * name if name sharing is enabled.
+	 **/
+	void assign( const char * bytes, int len );
+
+	/**
+	 * Share the data of 'other' or copy it if it has too many references.
+	 **/
+	void assign( const CompactName & other );
+
+	/**
+	 * Drop the reference to the data and free it if this was the last one.
+	 **/
+	void release();
+
+	/**
+	 * Allocate data for 'bytes' with length 'len' with one reference.
+	 **/
+	static char * newData( const char * bytes, int len );
+
+	/**
+	 * Return the reference count and flags of 'data'.
+	 **/
+	static quint16 & refs( char * data ) { return ( (quint16 *) data )[1]; }
+
+
+	// The length and the reference count as quint16, followed by the
+	// bytes; 0 for empty names
+	char * _data;
+
+	// The shared names; 0 if sharing is disabled
+	static QSet<SharedNameKey> * _sharedNames;
+
+    };	// class CompactName
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CompactName_h
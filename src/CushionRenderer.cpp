@@ -0,0 +1,694 @@
+/*
+ *   File name: CushionRenderer.cpp
+ *   Summary:	Multi-threaded treemap cushion rendering for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <math.h>    // sqrtf()
+#include <string.h>  // memcpy()
+
+#include <QRunnable>
+#include <QThread>
+#include <QMutexLocker>
+#include <QPixmap>
+#include <QMetaObject>
+
+#include "CushionRenderer.h"
+#include "Logger.h"
+#include "Exception.h"
+#include "Trace.h"
+
+
+// Number of cushions that one worker renders in one go. Most cushions are
+// tiny, so giving each one a task of its own would mostly be overhead.
+
+#define CUSHION_BATCH_SIZE	64
+
+#define VERBOSE_CUSHION_RENDERER	0
+
+// Default memory budget for the cushion cache in kilobytes; the treemap
+// view might change this
+
+#define DEFAULT_CUSHION_CACHE_SIZE	( 64 * 1024 )
+
+
+// Vectorized row shaders. These are selected at runtime depending on what
+// the CPU supports, so the binary still runs on CPUs without them.
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#  define HAVE_X86_SHADERS	1
+#  include <immintrin.h>
+#else
+#  define HAVE_X86_SHADERS	0
+#endif
+
+#if defined( __aarch64__ )
+#  define HAVE_NEON_SHADER	1
+#  include <arm_neon.h>
+#else
+#  define HAVE_NEON_SHADER	0
+#endif
+
+
+namespace QDirStat
+{
+    /**
+     * One batch of cushions for the thread pool.
+     **/
+    class CushionRenderWorker: public QRunnable
+    {
+    public:
+
+	CushionRenderWorker( CushionRenderer	  * renderer,
+			     int		    generation,
+			     const CushionJobList & jobs,
+			     const CushionLight	  & light ):
+	    _renderer( renderer ),
+	    _generation( generation ),
+	    _jobs( jobs ),
+	    _light( light )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    TRACE_SPAN( "CushionRenderer::renderBatch" );
+
+	    for ( int i = 0; i < _jobs.size(); ++i )
+	    {
+		CushionJob & job = _jobs[ i ];
+		job.image = CushionRenderer::renderCushion( job.rect, job.surface, job.color,
+							    _light, job.scale );
+	    }
+
+	    _renderer->workerDone( _generation, _jobs );
+	}
+
+    protected:
+
+	CushionRenderer * _renderer;
+	int		  _generation;
+	CushionJobList	  _jobs;
+	CushionLight	  _light;
+    };
+}
+
+
+/**
+ * Everything that is the same for all pixels of one row of a cushion.
+ **/
+struct CushionRowParams
+{
+    float nyTerm;	// lightZ - ny * lightY
+    float nySquare;	// ny * ny + 1
+    float lightX;
+    float ambient;
+    float red;
+    float green;
+    float blue;
+};
+
+
+/**
+ * Shade 'width' pixels of one row of a cushion and store them in 'line'.
+ * The surface normal's X component is 'nx0' for the first pixel and grows
+ * by 'nxStep' from one pixel to the next.
+ **/
+typedef void ( *CushionRowShader )( QRgb		   * line,
+				    int			     width,
+				    float		     nx0,
+				    float		     nxStep,
+				    const CushionRowParams & par );
+
+
+static void shadeRowScalar( QRgb		   * line,
+			    int			     width,
+			    float		     nx0,
+			    float		     nxStep,
+			    const CushionRowParams & par )
+{
+    for ( int x = 0; x < width; ++x )
+    {
+	const float nx = nx0 + x * nxStep;
+	float cosa = ( par.nyTerm - nx * par.lightX ) / sqrtf( nx * nx + par.nySquare );
+
+	if ( cosa < 0.0f )
+	    cosa = 0.0f;
+
+	cosa += par.ambient;
+
+	const int red	= qMin( (int) ( cosa * par.red	 + 0.5f ), 255 );
+	const int green = qMin( (int) ( cosa * par.green + 0.5f ), 255 );
+	const int blue	= qMin( (int) ( cosa * par.blue	 + 0.5f ), 255 );
+
+	line[ x ] = qRgb( red, green, blue );
+    }
+}
+
+
+#if HAVE_X86_SHADERS
+
+__attribute__(( target( "sse4.1" ) ))
+static void shadeRowSse4( QRgb			 * line,
+			  int			   width,
+			  float			   nx0,
+			  float			   nxStep,
+			  const CushionRowParams & par )
+{
+    const __m128  offsets  = _mm_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f );
+    const __m128  step	   = _mm_set1_ps( nxStep );
+    const __m128  nyTerm   = _mm_set1_ps( par.nyTerm   );
+    const __m128  nySquare = _mm_set1_ps( par.nySquare );
+    const __m128  lightX   = _mm_set1_ps( par.lightX   );
+    const __m128  ambient  = _mm_set1_ps( par.ambient  );
+    const __m128  red	   = _mm_set1_ps( par.red      );
+    const __m128  green	   = _mm_set1_ps( par.green    );
+    const __m128  blue	   = _mm_set1_ps( par.blue     );
+    const __m128  half	   = _mm_set1_ps( 0.5f );
+    const __m128  zero	   = _mm_setzero_ps();
+    const __m128i maxVal   = _mm_set1_epi32( 255 );
+    const __m128i alpha	   = _mm_set1_epi32( (int) 0xFF000000 );
+
+    int x = 0;
+
+    for ( ; x + 4 <= width; x += 4 )
+    {
+	__m128 nx   = _mm_add_ps( _mm_set1_ps( nx0 + x * nxStep ), _mm_mul_ps( offsets, step ) );
+	__m128 num  = _mm_sub_ps( nyTerm, _mm_mul_ps( nx, lightX ) );
+	__m128 den  = _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( nx, nx ), nySquare ) );
+	__m128 cosa = _mm_add_ps( _mm_max_ps( _mm_div_ps( num, den ), zero ), ambient );
+
+	__m128i r = _mm_min_epi32( _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( cosa, red   ), half ) ), maxVal );
+	__m128i g = _mm_min_epi32( _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( cosa, green ), half ) ), maxVal );
+	__m128i b = _mm_min_epi32( _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( cosa, blue  ), half ) ), maxVal );
+
+	__m128i rgb = _mm_or_si128( _mm_or_si128( alpha, _mm_slli_epi32( r, 16 ) ),
+				    _mm_or_si128( _mm_slli_epi32( g, 8 ), b ) );
+
+	_mm_storeu_si128( (__m128i *) ( line + x ), rgb );
+    }
+
+    shadeRowScalar( line + x, width - x, nx0 + x * nxStep, nxStep, par );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static void shadeRowAvx2( QRgb			 * line,
+			  int			   width,
+			  float			   nx0,
+			  float			   nxStep,
+			  const CushionRowParams & par )
+{
+    const __m256  offsets  = _mm256_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f );
+    const __m256  step	   = _mm256_set1_ps( nxStep );
+    const __m256  nyTerm   = _mm256_set1_ps( par.nyTerm   );
+    const __m256  nySquare = _mm256_set1_ps( par.nySquare );
+    const __m256  lightX   = _mm256_set1_ps( par.lightX   );
+    const __m256  ambient  = _mm256_set1_ps( par.ambient  );
+    const __m256  red	   = _mm256_set1_ps( par.red      );
+    const __m256  green	   = _mm256_set1_ps( par.green    );
+    const __m256  blue	   = _mm256_set1_ps( par.blue     );
+    const __m256  half	   = _mm256_set1_ps( 0.5f );
+    const __m256  zero	   = _mm256_setzero_ps();
+    const __m256i maxVal   = _mm256_set1_epi32( 255 );
+    const __m256i alpha	   = _mm256_set1_epi32( (int) 0xFF000000 );
+
+    int x = 0;
+
+    for ( ; x + 8 <= width; x += 8 )
+    {
+	__m256 nx   = _mm256_add_ps( _mm256_set1_ps( nx0 + x * nxStep ), _mm256_mul_ps( offsets, step ) );
+	__m256 num  = _mm256_sub_ps( nyTerm, _mm256_mul_ps( nx, lightX ) );
+	__m256 den  = _mm256_sqrt_ps( _mm256_add_ps( _mm256_mul_ps( nx, nx ), nySquare ) );
+	__m256 cosa = _mm256_add_ps( _mm256_max_ps( _mm256_div_ps( num, den ), zero ), ambient );
+
+	__m256i r = _mm256_min_epi32( _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( cosa, red   ), half ) ), maxVal );
+	__m256i g = _mm256_min_epi32( _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( cosa, green ), half ) ), maxVal );
+	__m256i b = _mm256_min_epi32( _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( cosa, blue  ), half ) ), maxVal );
+
+	__m256i rgb = _mm256_or_si256( _mm256_or_si256( alpha, _mm256_slli_epi32( r, 16 ) ),
+				       _mm256_or_si256( _mm256_slli_epi32( g, 8 ), b ) );
+
+	_mm256_storeu_si256( (__m256i *) ( line + x ), rgb );
+    }
+
+    shadeRowScalar( line + x, width - x, nx0 + x * nxStep, nxStep, par );
+}
+
+#endif	// HAVE_X86_SHADERS
+
+
+#if HAVE_NEON_SHADER
+
+static void shadeRowNeon( QRgb			 * line,
+			  int			   width,
+			  float			   nx0,
+			  float			   nxStep,
+			  const CushionRowParams & par )
+{
+    const float	      offsetVal[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    const float32x4_t offsets  = vld1q_f32( offsetVal );
+    const float32x4_t step     = vdupq_n_f32( nxStep );
+    const float32x4_t nyTerm   = vdupq_n_f32( par.nyTerm   );
+    const float32x4_t nySquare = vdupq_n_f32( par.nySquare );
+    const float32x4_t lightX   = vdupq_n_f32( par.lightX   );
+    const float32x4_t ambient  = vdupq_n_f32( par.ambient  );
+    const float32x4_t red      = vdupq_n_f32( par.red      );
+    const float32x4_t green    = vdupq_n_f32( par.green    );
+    const float32x4_t blue     = vdupq_n_f32( par.blue     );
+    const float32x4_t half     = vdupq_n_f32( 0.5f );
+    const float32x4_t zero     = vdupq_n_f32( 0.0f );
+    const uint32x4_t  maxVal   = vdupq_n_u32( 255 );
+    const uint32x4_t  alpha    = vdupq_n_u32( 0xFF000000 );
+
+    int x = 0;
+
+    for ( ; x + 4 <= width; x += 4 )
+    {
+	float32x4_t nx	 = vaddq_f32( vdupq_n_f32( nx0 + x * nxStep ), vmulq_f32( offsets, step ) );
+	float32x4_t num	 = vsubq_f32( nyTerm, vmulq_f32( nx, lightX ) );
+	float32x4_t den	 = vsqrtq_f32( vaddq_f32( vmulq_f32( nx, nx ), nySquare ) );
+	float32x4_t cosa = vaddq_f32( vmaxq_f32( vdivq_f32( num, den ), zero ), ambient );
+
+	uint32x4_t r = vminq_u32( vcvtq_u32_f32( vaddq_f32( vmulq_f32( cosa, red   ), half ) ), maxVal );
+	uint32x4_t g = vminq_u32( vcvtq_u32_f32( vaddq_f32( vmulq_f32( cosa, green ), half ) ), maxVal );
+	uint32x4_t b = vminq_u32( vcvtq_u32_f32( vaddq_f32( vmulq_f32( cosa, blue  ), half ) ), maxVal );
+
+	uint32x4_t rgb = vorrq_u32( vorrq_u32( alpha, vshlq_n_u32( r, 16 ) ),
+				    vorrq_u32( vshlq_n_u32( g, 8 ), b ) );
+
+	vst1q_u32( (uint32_t *) ( line + x ), rgb );
+    }
+
+    shadeRowScalar( line + x, width - x, nx0 + x * nxStep, nxStep, par );
+}
+
+#endif	// HAVE_NEON_SHADER
+
+
+/**
+ * Return the best row shader for this CPU.
+ **/
+static CushionRowShader chooseRowShader()
+{
+#if HAVE_X86_SHADERS
+    __builtin_cpu_init();
+
+    if ( __builtin_cpu_supports( "avx2" ) )
+	return shadeRowAvx2;
+
+    if ( __builtin_cpu_supports( "sse4.1" ) )
+	return shadeRowSse4;
+#endif
+
+#if HAVE_NEON_SHADER
+    return shadeRowNeon;	// NEON is mandatory on AArch64
+#endif
+
+    return shadeRowScalar;
+}
+
+
+using namespace QDirStat;
+
+
+CushionRenderer::CushionRenderer( QObject * parent ):
+    QObject( parent ),
+    _generation( 0 ),
+    _pendingCount( 0 ),
+    _collectScheduled( false ),
+    _cache( DEFAULT_CUSHION_CACHE_SIZE )
+{
+    // Leave one core for the GUI thread
+    _threadPool.setMaxThreadCount( qMax( 1, QThread::idealThreadCount() - 1 ) );
+    MemoryPressure::add( this );
+}
+
+
+CushionRenderer::~CushionRenderer()
+{
+    MemoryPressure::remove( this );
+    cancelAll();
+    _threadPool.waitForDone();
+}
+
+
+void CushionRenderer::render( const CushionJobList & allJobs,
+			      const CushionLight   & light )
+{
+    _light = light;
+
+    // Deliver what is already in the cache right away
+
+    CushionJobList jobs;
+
+    foreach ( const CushionJob & job, allJobs )
+    {
+	QPixmap * cushion = _cache.object( CushionCacheKey( job.rect, job.surface, job.color,
+							    light, job.scale ) );
+
+	if ( cushion )
+	{
+	    job.tile->setCushion( *cushion );
+	    job.tile->update();
+	}
+	else
+	{
+	    jobs << job;
+	}
+    }
+
+    for ( int start = 0; start < jobs.size(); start += CUSHION_BATCH_SIZE )
+    {
+	CushionRenderWorker * worker =
+	    new CushionRenderWorker( this, _generation,
+				     jobs.mid( start, CUSHION_BATCH_SIZE ),
+				     light );
+	CHECK_NEW( worker );
+
+	_threadPool.start( worker );	// takes over ownership
+    }
+
+    _pendingCount += jobs.size();
+
+#if VERBOSE_CUSHION_RENDERER
+    logDebug() << "Rendering " << jobs.size() << " cushions with "
+	       << _threadPool.maxThreadCount() << " threads; "
+	       << allJobs.size() - jobs.size() << " from the cache" << endl;
+#endif
+}
+
+
+void CushionRenderer::clearCache()
+{
+    _cache.clear();
+}
+
+
+void CushionRenderer::evictCache( int percent )
+{
+    // Lowering the limit makes QCache drop the least recently used
+    // cushions; then restore the configured budget.
+
+    int maxCost = _cache.maxCost();
+    int keep	= _cache.totalCost() * ( 100 - qBound( 0, percent, 100 ) ) / 100;
+
+    _cache.setMaxCost( keep );
+    _cache.setMaxCost( maxCost );
+}
+
+
+void CushionRenderer::cancelAll()
+{
+    // Workers that did not start yet are simply dropped; those that are
+    // running can't be stopped, but their results will be ignored because
+    // of the new generation.
+
+    _threadPool.clear();
+
+    QMutexLocker locker( &_mutex );
+    _results.clear();
+    ++_generation;
+    _pendingCount = 0;
+}
+
+
+void CushionRenderer::workerDone( int generation, const CushionJobList & jobs )
+{
+    QMutexLocker locker( &_mutex );
+
+    _results << CushionResultPair( generation, jobs );
+
+    if ( ! _collectScheduled )
+    {
+	_collectScheduled = true;
+	QMetaObject::invokeMethod( this, "collectResults", Qt::QueuedConnection );
+    }
+}
+
+
+void CushionRenderer::collectResults()
+{
+    QList<CushionResultPair> results;
+
+    {
+	QMutexLocker locker( &_mutex );
+	results = _results;
+	_results.clear();
+	_collectScheduled = false;
+    }
+
+    foreach ( const CushionResultPair & result, results )
+    {
+	if ( result.first != _generation )	// Tiles are long gone
+	    continue;
+
+	foreach ( const CushionJob & job, result.second )
+	{
+	    QPixmap cushion = QPixmap::fromImage( job.image );
+	    job.tile->setCushion( cushion );
+	    job.tile->update();
+
+	    if ( _cache.maxCost() > 0 && ! cushion.isNull() )
+	    {
+		// The cost is the size in kilobytes
+		int cost = qMax( 1, cushion.width() * cushion.height() * 4 / 1024 );
+
+		_cache.insert( CushionCacheKey( job.rect, job.surface, job.color, _light, job.scale ),
+			       new QPixmap( cushion ), cost );
+	    }
+	}
+
+	_pendingCount -= result.second.size();
+    }
+}
+
+
+bool CushionCacheKey::operator==( const CushionCacheKey & other ) const
+{
+    return rect	   == other.rect			&&
+	scale	   == other.scale			&&
+	color	   == other.color			&&
+	surface.xx1() == other.surface.xx1()		&&
+	surface.xx2() == other.surface.xx2()		&&
+	surface.yy1() == other.surface.yy1()		&&
+	surface.yy2() == other.surface.yy2()		&&
+	light.ambient == other.light.ambient		&&
+	light.lightX  == other.light.lightX		&&
+	light.lightY  == other.light.lightY		&&
+	light.lightZ  == other.light.lightZ		&&
+	light.enforceContrast == other.light.enforceContrast;
+}
+
+
+/**
+ * Return a hash value for the bit pattern of 'value'.
+ **/
+static inline uint hashDouble( double value )
+{
+    quint64 bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+
+    return qHash( bits );
+}
+
+
+uint QDirStat::qHash( const CushionCacheKey & key )
+{
+    // The light is almost always the same for all keys, so it is not worth
+    // hashing. The surface coefficients differ even for tiles of the same
+    // size.
+
+    uint hash = hashDouble( key.rect.x() );
+
+    hash = hash * 31 + hashDouble( key.rect.y() );
+    hash = hash * 31 + hashDouble( key.rect.width() );
+    hash = hash * 31 + hashDouble( key.rect.height() );
+    hash = hash * 31 + hashDouble( key.surface.xx1() );
+    hash = hash * 31 + hashDouble( key.surface.yy1() );
+    hash = hash * 31 + key.color;
+
+    return hash;
+}
+
+
+QImage CushionRenderer::renderCushion( const QRectF	    & rect,
+				       const CushionSurface & surface,
+				       const QColor	    & color,
+				       const CushionLight   & light,
+				       qreal		      scale )
+{
+    if ( rect.width() < 1.0 || rect.height() < 1.0 )
+	return QImage();
+
+    QImage image( (int) ( rect.width()	* scale ),
+		  (int) ( rect.height() * scale ), QImage::Format_RGB32 );
+
+    shadeCushion( image, rect.topLeft(), image.rect(), surface, color, light, scale );
+
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 1, 0 ))
+    image.setDevicePixelRatio( scale );
+#endif
+
+    return image;
+}
+
+
+void CushionRenderer::renderCushion( QImage		  & image,
+				     const QRectF	  & rect,
+				     const CushionSurface & surface,
+				     const QColor	  & color,
+				     const CushionLight	  & light,
+				     const QPointF	  & origin )
+{
+    if ( rect.width() < 1.0 || rect.height() < 1.0 )
+	return;
+
+    // Tiles may stick out of the image by a pixel because of rounding
+
+    QRect pixels = QRect( (int) rect.x()     - (int) origin.x(),
+			  (int) rect.y()     - (int) origin.y(),
+			  (int) rect.width(), (int) rect.height() ) & image.rect();
+
+    if ( ! pixels.isEmpty() )
+	shadeCushion( image, origin, pixels, surface, color, light );
+}
+
+
+void CushionRenderer::shadeCushion( QImage		 & image,
+				    const QPointF	 & origin,
+				    const QRect		 & pixels,
+				    const CushionSurface & surface,
+				    const QColor	 & color,
+				    const CushionLight	 & light,
+				    qreal		   scale )
+{
+    // Thread-safe: Static local variables are initialized only once
+    static const CushionRowShader shadeRow = chooseRowShader();
+
+    // The surface normal for the pixel at (x0, y0) is
+    //
+    //	   nx = 2 * xx2 * x0 + xx1
+    //	   ny = 2 * yy2 * y0 + yy1
+    //
+    // with x0, y0 the pixel centers. Store coordinates as double, but
+    // shade in float: That is accurate enough for 8 bit color channels.
+    //
+    // With a scale, one image pixel is 1 / scale treemap pixels wide.
+
+    const double step	= 1.0 / scale;
+    const double xx22	= surface.xx2() * 2;
+    const double yy22	= surface.yy2() * 2;
+    const float	 nx0	= xx22 * ( origin.x() + ( pixels.x() + 0.5 ) * step ) + surface.xx1();
+    const float	 nxStep = xx22 * step;
+
+    CushionRowParams par;
+    par.lightX	= light.lightX;
+    par.ambient = light.ambient;
+    par.red	= color.red();
+    par.green	= color.green();
+    par.blue	= color.blue();
+
+    double y0 = origin.y() + ( pixels.y() + 0.5 ) * step;
+
+    for ( int y = pixels.top(); y <= pixels.bottom(); ++y, y0 += step )
+    {
+	const double ny = yy22 * y0 + surface.yy1();
+
+	par.nyTerm   = light.lightZ - ny * light.lightY;
+	par.nySquare = ny * ny + 1.0;
+
+	QRgb * line = (QRgb *) image.scanLine( y ) + pixels.x();
+	shadeRow( line, pixels.width(), nx0, nxStep, par );
+    }
+
+    if ( light.enforceContrast )
+	enforceContrast( image, pixels );
+}
+
+
+void CushionRenderer::enforceContrast( QImage & image )
+{
+    enforceContrast( image, image.rect() );
+}
+
+
+void CushionRenderer::enforceContrast( QImage & image, const QRect & pixels )
+{
+    const int left   = pixels.left();
+    const int top    = pixels.top();
+    const int width  = pixels.width();
+    const int height = pixels.height();
+
+    if ( width > 5 )
+    {
+	// Check contrast along the right image boundary:
+	//
+	// Compare samples from the outmost boundary to samples a few pixels to
+	// the inside and count identical pixel values. A number of identical
+	// pixels are tolerated, but not too many.
+
+	int x1 = left + width - 6;
+	int x2 = left + width - 1;
+	int interval = qMax( height / 10, 5 );
+	int sameColorCount = 0;
+
+
+	// Take samples
+
+	for ( int y = interval; y < height; y+= interval )
+	{
+	    if ( image.pixel( x1, top + y ) == image.pixel( x2, top + y ) )
+		sameColorCount++;
+	}
+
+	if ( sameColorCount * 10 > height )
+	{
+	    // Add a line at the right boundary
+
+	    QRgb val = contrastingColor( image.pixel( x2, top + height / 2 ) );
+
+	    for ( int y = 0; y < height; y++ )
+		( (QRgb *) image.scanLine( top + y ) )[ x2 ] = val;
+	}
+    }
+
+
+    if ( height > 5 )
+    {
+	// Check contrast along the bottom boundary
+
+	int y1 = top + height - 6;
+	int y2 = top + height - 1;
+	int interval = qMax( width / 10, 5 );
+	int sameColorCount = 0;
+
+	for ( int x = interval; x < width; x += interval )
+	{
+	    if ( image.pixel( left + x, y1 ) == image.pixel( left + x, y2 ) )
+		sameColorCount++;
+	}
+
+	if ( sameColorCount * 10 > height )
+	{
+	    // Add a grey line at the bottom boundary
+
+	    QRgb   val  = contrastingColor( image.pixel( left + width / 2, y2 ) );
+	    QRgb * line = (QRgb *) image.scanLine( y2 ) + left;
+
+	    for ( int x = 0; x < width; x++ )
+		line[ x ] = val;
+	}
+    }
+}
+
+
+QRgb CushionRenderer::contrastingColor( QRgb col )
+{
+    if ( qGray( col ) < 128 )
+	return qRgb( qRed( col ) * 2, qGreen( col ) * 2, qBlue( col ) * 2 );
+    else
+	return qRgb( qRed( col ) / 2, qGreen( col ) / 2, qBlue( col ) / 2 );
+}
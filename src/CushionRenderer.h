@@ -0,0 +1,300 @@
+/*
+ *   File name: CushionRenderer.h
+ *   Summary:	Multi-threaded treemap cushion rendering for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CushionRenderer_h
+#define CushionRenderer_h
+
+
+#include <QObject>
+#include <QImage>
+#include <QColor>
+#include <QRect>
+#include <QRectF>
+#include <QPointF>
+#include <QList>
+#include <QCache>
+#include <QPixmap>
+#include <QPair>
+#include <QMutex>
+#include <QThreadPool>
+
+#include "TreemapTile.h"	// CushionSurface
+#include "MemoryPressure.h"
+
+
+namespace QDirStat
+{
+    /**
+     * The light source parameters for rendering cushions.
+     **/
+    struct CushionLight
+    {
+	double ambient;		// ambient light, 0.0 .. 1.0
+	double lightX;		// direction of the light source,
+	double lightY;		// already scaled with the part of
+	double lightZ;		// the light that is not ambient
+	bool   enforceContrast;
+
+	CushionLight():
+	    ambient( 0.0 ), lightX( 0.0 ), lightY( 0.0 ), lightZ( 0.0 ),
+	    enforceContrast( false )
+	    {}
+    };
+
+
+    /**
+     * One cushion to render: Everything that is needed to render it,
+     * copied from the tile, and the rendered image.
+     *
+     * 'scale' is the number of image pixels for each logical pixel of
+     * 'rect' in each direction: The device pixel ratio for crisp cushions
+     * on a HiDPI screen or 1.0.
+     *
+     * 'tile' is only used in the GUI thread to deliver the result; the
+     * worker threads never touch it.
+     **/
+    struct CushionJob
+    {
+	TreemapTile *	tile;
+	QRectF		rect;
+	CushionSurface	surface;
+	QColor		color;
+	qreal		scale;
+	QImage		image;
+
+	CushionJob():
+	    tile( 0 ),
+	    scale( 1.0 )
+	    {}
+    };
+
+    typedef QList<CushionJob> CushionJobList;
+
+
+    /**
+     * Key for the cushion cache: Everything that a rendered cushion
+     * depends on.
+     *
+     * Notice that this does not include the tile's FileInfo: Two tiles
+     * with the same geometry, surface, color and light get exactly the
+     * same cushion, so there is nothing about a cache entry that could
+     * ever become stale when the tree changes.
+     **/
+    struct CushionCacheKey
+    {
+	QRectF		rect;
+	CushionSurface	surface;
+	QRgb		color;
+	CushionLight	light;
+	qreal		scale;
+
+	CushionCacheKey( const QRectF	      & rect,
+			 const CushionSurface & surface,
+			 const QColor	      & color,
+			 const CushionLight   & light,
+			 qreal			scale = 1.0 ):
+	    rect( rect ),
+	    surface( surface ),
+	    color( color.rgb() ),
+	    light( light ),
+	    scale( scale )
+	    {}
+
+	bool operator==( const CushionCacheKey & other ) const;
+    };
+
+    uint qHash( const CushionCacheKey & key );
+
+
+    /**
+     * Class to render treemap cushions in a pool of worker threads.
+     *
+     * The TreemapView hands over the cushions of all leaf tiles after
+     * building the treemap; they are rendered into QImages (which, unlike
+     * QPixmaps, may be used outside the GUI thread) in batches, and the
+     * results are delivered to the tiles in the GUI thread as they become
+     * ready. Until then, the tiles show a plain placeholder.
+     **/
+    class CushionRenderer: public QObject, public DiscardableCache
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	CushionRenderer( QObject * parent = 0 );
+
+	/**
+	 * Destructor. This waits for the worker threads to finish.
+	 **/
+	virtual ~CushionRenderer();
+
+	/**
+	 * Start rendering the cushions of 'jobs' with light 'light'.
+	 **/
+	void render( const CushionJobList & jobs, const CushionLight & light );
+
+	/**
+	 * Forget about all pending jobs. This must be called before any of
+	 * the tiles is deleted. The worker threads will finish rendering
+	 * what they have already started, but those results are silently
+	 * discarded.
+	 **/
+	void cancelAll();
+
+	/**
+	 * Return the number of cushions that are still being rendered.
+	 **/
+	int pendingCount() const { return _pendingCount; }
+
+	/**
+	 * Set the memory budget for the cache of rendered cushions in
+	 * kilobytes. 0 disables the cache.
+	 *
+	 * Cushions that are in the cache don't need to be rendered again
+	 * when the treemap is rebuilt with the same geometry, e.g. after
+	 * zooming back out to a previous treemap root.
+	 **/
+	void setCacheSize( int kiloBytes ) { _cache.setMaxCost( kiloBytes ); }
+
+	/**
+	 * Return the memory budget of the cushion cache in kilobytes.
+	 **/
+	int cacheSize() const { return _cache.maxCost(); }
+
+	/**
+	 * Return the memory of the cushions in the cache in kilobytes.
+	 **/
+	int cacheUsed() const { return _cache.totalCost(); }
+
+	/**
+	 * Drop 'percent' percent of the cached cushions, the least recently
+	 * used ones first. Implemented from DiscardableCache.
+	 **/
+	virtual void evictCache( int percent ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Render a cushion for a tile with 'rect', 'surface' and 'color'
+	 * as described in "cushioned treemaps" by Jarke J. van Wijk and Huub
+	 * van de Wetering of the TU Eindhoven, NL.
+	 *
+	 * This does not use anything from the tile or the view, so it is
+	 * safe to call from any thread.
+	 *
+	 * The pixels are shaded row by row in float precision with the best
+	 * SIMD instructions that the CPU supports (AVX2, SSE4.1, NEON), or
+	 * with plain C++ if there are none.
+	 *
+	 * With a 'scale' other than 1.0, the image has that many pixels for
+	 * each logical pixel of 'rect' in each direction, and it has that
+	 * device pixel ratio. Each of those pixels is shaded with the exact
+	 * surface normal at its center, so this is just as smooth as
+	 * rendering a larger cushion.
+	 **/
+	static QImage renderCushion( const QRectF	  & rect,
+				     const CushionSurface & surface,
+				     const QColor	  & color,
+				     const CushionLight	  & light,
+				     qreal		    scale = 1.0 );
+
+	/**
+	 * Render a cushion like above, but directly into 'image' at the
+	 * position of 'rect'. 'origin' is the position of the image's top
+	 * left pixel in the treemap; by default, 'rect' is in image
+	 * coordinates. Anything outside the image is clipped.
+	 **/
+	static void renderCushion( QImage		& image,
+				   const QRectF		& rect,
+				   const CushionSurface & surface,
+				   const QColor		& color,
+				   const CushionLight	& light,
+				   const QPointF	& origin = QPointF() );
+
+	/**
+	 * Check if the contrast of the specified image is sufficient to
+	 * visually distinguish an outline at the right and bottom borders
+	 * and add a grey line there, if necessary.
+	 **/
+	static void enforceContrast( QImage & image );
+
+	/**
+	 * Same as above, but only for the part 'pixels' of 'image'.
+	 **/
+	static void enforceContrast( QImage & image, const QRect & pixels );
+
+	/**
+	 * Returns a color that gives a reasonable contrast to 'col': Lighter
+	 * if 'col' is dark, darker if 'col' is light.
+	 **/
+	static QRgb contrastingColor( QRgb col );
+
+
+    public slots:
+
+	/**
+	 * Clear the cache of rendered cushions to free its memory.
+	 **/
+	void clearCache();
+
+
+    protected slots:
+
+	/**
+	 * Deliver all results that are ready so far to their tiles.
+	 **/
+	void collectResults();
+
+
+    protected:
+
+	friend class CushionRenderWorker;
+
+	/**
+	 * Notification from a worker thread that it is done with 'jobs'.
+	 * This is called in the context of that worker thread.
+	 **/
+	void workerDone( int generation, const CushionJobList & jobs );
+
+	/**
+	 * Shade the part 'pixels' of 'image' with a cushion. 'origin' is
+	 * the position of the image's top left pixel in the treemap, and
+	 * 'scale' the number of image pixels for each treemap pixel.
+	 **/
+	static void shadeCushion( QImage	       & image,
+				  const QPointF	       & origin,
+				  const QRect	       & pixels,
+				  const CushionSurface & surface,
+				  const QColor	       & color,
+				  const CushionLight   & light,
+				  qreal			 scale = 1.0 );
+
+
+	typedef QPair<int, CushionJobList> CushionResultPair;
+
+	QThreadPool		  _threadPool;
+	int			  _generation;
+	int			  _pendingCount;
+	CushionLight		  _light;
+
+	QCache<CushionCacheKey, QPixmap> _cache;
+
+	// Shared with the worker threads; protected by _mutex
+
+	QMutex			  _mutex;
+	QList<CushionResultPair>  _results;
+	bool			  _collectScheduled;
+
+    };	// class CushionRenderer
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CushionRenderer_h
@@ -0,0 +1,87 @@
+/*
+ *   File name: CushionSurface.cpp
+ *   Summary:	Treemap rendering for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "CushionSurface.h"
+
+
+using namespace QDirStat;
+
+
+CushionSurface::CushionSurface()
+{
+    _xx2        = 0.0;
+    _xx1        = 0.0;
+    _yy2        = 0.0;
+    _yy1        = 0.0;
+    _ridgeCount = 0;
+}
+
+
+void CushionSurface::addRidge( Orientation dim, const QRectF & rect )
+{
+    _ridgeCount++;
+
+    if ( dim == TreemapHorizontal )
+    {
+	_xx2 = squareRidge( _xx2, rect.left(), rect.right() );
+	_xx1 = linearRidge( _xx1, rect.left(), rect.right() );
+    }
+    else
+    {
+	_yy2 = squareRidge( _yy2, rect.top(), rect.bottom() );
+	_yy1 = linearRidge( _yy1, rect.top(), rect.bottom() );
+    }
+}
+
+
+double CushionSurface::squareRidge( double squareCoefficient, int x1, int x2 ) const
+{
+    if ( x2 != x1 ) // Avoid division by zero
+	squareCoefficient -= ridgeCoefficient() / ( x2 - x1 );
+
+    return squareCoefficient;
+}
+
+
+double CushionSurface::linearRidge( double linearCoefficient, int x1, int x2 ) const
+{
+    if ( x2 != x1 ) // Avoid division by zero
+	linearCoefficient += ridgeCoefficient() * ( x2 + x1 ) / ( x2 - x1 );
+
+    return linearCoefficient;
+}
+
+
+double CushionSurface::ridgeCoefficient() const
+{
+    switch ( _ridgeCount )
+    {
+        // Regressive factors found out by experimenting with different nesting
+        // depths.
+        //
+        // In the original code before 11/2023, this was a constant 4.0, but
+        // that turned out much too dark to identify individual tiles for
+        // nontrivial directory trees after the code change to be closer to the
+        // proposed algorithm in the TU Eindhoven papers. A smaller constant
+        // number turned out to lead to much too light tiles in shallower
+        // trees, so now the factors are at least a bit dynamic.
+
+        case 0:
+        case 1:
+        case 2:  return 1.5;
+        case 3:
+        case 4:  return 1.3;
+        case 5:
+        case 6:
+        case 7:  return 1.2;
+
+        default: return 1.1;
+    }
+}
+
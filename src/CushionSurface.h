@@ -0,0 +1,120 @@
+/*
+ *   File name: CushionSurface.h
+ *   Summary:	Treemap rendering for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CushionSurface_h
+#define CushionSurface_h
+
+
+#include <QRectF>
+
+
+namespace QDirStat
+{
+    enum Orientation
+    {
+	TreemapHorizontal,
+	TreemapVertical,
+	TreemapAuto
+    };
+
+
+    /**
+     * Helper class for cushioned treemaps: This class holds the polynome
+     * parameters for the cushion surface. The height of each point of such a
+     * surface is defined as:
+     *
+     *	   z(x, y) = a*x^2 + b*y^2 + c*x + d*y
+     * or
+     *	   z(x, y) = xx2*x^2 + yy2*y^2 + xx1*x + yy1*y
+     *
+     * to better keep track of which coefficient belongs where.
+     **/
+    class CushionSurface
+    {
+    public:
+	/**
+	 * Constructor. All polynome coefficients are set to 0.
+	 **/
+	CushionSurface();
+
+	/**
+	 * Adds a ridge in dimension 'dim' within rectangle 'rect' to this
+	 * surface.
+	 *
+	 * See the paper about "cushion treemaps" by Jarke J. van Wiik and Huub
+	 * van de Wetering from the TU Eindhoven, NL for more details.
+	 *
+	 * If you don't want to get all that involved: The coefficients are
+	 * changed in some way.
+	 **/
+	void addRidge( Orientation dim, const QRectF & rect );
+
+	/**
+	 * Returns the polynomal coefficient of the second order for the X
+	 * direction.
+	 **/
+	double xx2() const { return _xx2; }
+
+	/**
+	 * Returns the polynomal coefficient of the first order for the X
+	 * direction.
+	 **/
+	double xx1() const { return _xx1; }
+
+	/**
+	 * Returns the polynomal coefficient of the second order for the Y
+	 * direction.
+	 **/
+	double yy2() const { return _yy2; }
+
+	/**
+	 * Returns the polynomal coefficient of the first order for the Y
+	 * direction.
+	 **/
+	double yy1() const { return _yy1; }
+
+        /**
+         * Return the number of ridge pairs (square and linear) on this level.
+         **/
+        int ridgeCount() const { return _ridgeCount; }
+
+        /**
+         * Return a multiplication factor for both square and linear ridges,
+         * depending on the ridge count.
+         **/
+        double ridgeCoefficient() const;
+
+
+    protected:
+
+	/**
+	 * Calculate a new square polynomal coefficient for adding a ridge of
+	 * specified height between x1 and x2.
+	 **/
+	double squareRidge( double squareCoefficient, int x1, int x2 ) const;
+
+	/**
+	 * Calculate a new linear polynomal coefficient for adding a ridge of
+	 * specified height between x1 and x2.
+	 **/
+	double linearRidge( double linearCoefficient, int x1, int x2 ) const;
+
+
+	// Data members
+
+	double _xx2, _xx1;
+	double _yy2, _yy1;
+        int    _ridgeCount;
+
+    }; // class CushionSurface
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CushionSurface_h
@@ -69,7 +69,8 @@ const DataColumnList DataColumns::defaultColumns() const
 	    << UserCol
 	    << GroupCol
 	    << PermissionsCol
-	    << OctalPermissionsCol;
+	    << OctalPermissionsCol
+	    << SizeDeltaCol;
 
     return columns;
 }
@@ -145,6 +146,7 @@ QString DataColumns::toString( DataColumn col )
 	case GroupCol:			return "GroupCol";
 	case PermissionsCol:		return "PermissionsCol";
 	case OctalPermissionsCol:	return "OctalPermissionsCol";
+	case SizeDeltaCol:		return "SizeDeltaCol";
 	case ReadJobsCol:		return "ReadJobsCol";
 	case UndefinedCol:		return "UndefinedCol";
 
@@ -37,6 +37,7 @@ namespace QDirStat
         GroupCol,               // Group
         PermissionsCol,         // Permissions (symbolic; -rwxrxxrwx)
         OctalPermissionsCol,    // Permissions (octal; 0644)
+	SizeDeltaCol,		// Change of size against a baseline (TreeDiff)
 	ReadJobsCol,		// Number of pending read jobs in subtree
 	UndefinedCol
     };
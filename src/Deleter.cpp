@@ -0,0 +1,607 @@
+/*
+ *   File name: Deleter.cpp
+ *   Summary:	In-process deletion of subtrees in worker threads
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>	// fstat()
+#include <fcntl.h>	// openat(), AT_REMOVEDIR
+#include <dirent.h>	// fdopendir(), readdir()
+#include <unistd.h>	// unlinkat(), close(), dup()
+#include <errno.h>
+#include <string.h>	// strcmp()
+
+#include <QFile>
+#include <QPair>
+#include <QRunnable>
+#include <QThread>
+#include <QMutexLocker>
+
+#include "Deleter.h"
+#include "DirInfo.h"
+#include "OutputWindow.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Maximum number of worker threads. Deleting is mostly waiting for the
+// filesystem journal; more threads than this do not help much.
+
+#define DELETER_MAX_THREADS	8
+
+// Interval for checking the progress and the errors of the worker threads.
+
+#define DELETER_POLL_MILLISEC	200
+
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Task for removing one node in a worker thread.
+     **/
+    class DeleteTask: public QRunnable
+    {
+    public:
+
+	DeleteTask( Deleter * deleter, int nodeIndex ):
+	    _deleter( deleter ),
+	    _nodeIndex( nodeIndex )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	    { _deleter->removeNode( _nodeIndex ); }
+
+    protected:
+
+	Deleter * _deleter;
+	int	  _nodeIndex;
+    };
+}
+
+
+Deleter::Deleter( const FileInfoSet & items, QObject * parent ):
+    QObject( parent ),
+    _deleted( 0 ),
+    _total( 0 ),
+    _finishedNodes( 0 ),
+    _lastReported( -1 ),
+    _errorCount( 0 )
+{
+    // Selected files (and the contents of selected pseudo directories) are
+    // collected in one node for each parent directory that only removes
+    // them, not the directory itself.
+
+    QHash<DirInfo *, int> fileNodes;
+
+    foreach ( FileInfo * item, items )
+    {
+	if ( item->isPseudoDir() || ! item->isDir() )
+	{
+	    DirInfo * dir = item->parent();
+
+	    if ( dir && dir->isPseudoDir() )
+		dir = dir->parent();
+
+	    if ( ! dir )
+		continue;
+
+	    if ( ! fileNodes.contains( dir ) )
+		fileNodes.insert( dir, addDir( dir, -1, false ) );
+
+	    int nodeIndex = fileNodes.value( dir );
+
+	    if ( item->isPseudoDir() )
+		addChildren( item->toDirInfo(), nodeIndex );
+	    else
+	    {
+		_nodes.at( nodeIndex )->fileNames << QFile::encodeName( item->name() );
+		_total.ref();
+	    }
+	}
+	else
+	{
+	    addDir( item, -1, true );
+	}
+    }
+
+    _threadPool.setMaxThreadCount( qBound( 1, QThread::idealThreadCount(), DELETER_MAX_THREADS ) );
+
+    connect( &_timer, SIGNAL( timeout() ),
+	     this,    SLOT  ( poll()	) );
+
+    logInfo() << "Deleting " << total() << " items in " << _nodes.size() << " directories" << endl;
+}
+
+
+Deleter::~Deleter()
+{
+    _threadPool.waitForDone();
+
+    for ( int i = 0; i < _nodes.size(); ++i )
+	closeNode( i );
+
+    qDeleteAll( _nodes );
+}
+
+
+int Deleter::addDir( FileInfo * dir, int parent, bool removeDir )
+{
+    DeleteNode * node = new DeleteNode();
+    CHECK_NEW( node );
+
+    node->path	    = QFile::encodeName( dir->path() );
+    node->name	    = node->path.mid( node->path.lastIndexOf( '/' ) + 1 );
+    node->parent    = parent;
+    node->fd	    = -1;
+    node->device    = dir->device();
+    node->removeDir = removeDir;
+    node->complete  = true;
+    node->pending.storeRelease( 1 );	// its own files
+    node->keep.storeRelease( 0 );
+
+    int nodeIndex = _nodes.size();
+    _nodes << node;
+
+    if ( removeDir )
+    {
+	_total.ref();
+
+	// Only trust the DirTree for directories that were read completely
+	// and whose children are all in the tree. Everything else is read
+	// again with readdir() when it is removed.
+
+	if ( dir->isDirInfo() && dir->readState() == DirFinished && ! dir->isExcluded() )
+	    addChildren( dir->toDirInfo(), nodeIndex );
+	else
+	    node->complete = false;
+    }
+
+    return nodeIndex;
+}
+
+
+void Deleter::addChildren( DirInfo * dir, int nodeIndex )
+{
+    DeleteNode * node = _nodes.at( nodeIndex );
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isPseudoDir() )
+	{
+	    addChildren( child->toDirInfo(), nodeIndex );
+	}
+	else if ( child->isDir() )
+	{
+	    if ( child->isMountPoint() )
+	    {
+		// Never cross filesystem boundaries: Keep the mount point and
+		// thus all its parent directories.
+
+		addError( tr( "Not deleting mount point %1" ).arg( child->path() ) );
+		node->keep.storeRelease( 1 );
+	    }
+	    else
+	    {
+		node->pending.ref();
+		addDir( child, nodeIndex, true );
+	    }
+	}
+	else
+	{
+	    node->fileNames << QFile::encodeName( child->name() );
+	    _total.ref();
+	}
+    }
+
+    if ( dir->dotEntry() )
+	addChildren( dir->dotEntry(), nodeIndex );
+
+    if ( dir->attic() )
+	addChildren( dir->attic(), nodeIndex );
+}
+
+
+void Deleter::start()
+{
+    if ( _outputWindow )
+    {
+	_outputWindow->addCommandLine( tr( "Deleting %1 items in %2 directories" )
+				       .arg( total() ).arg( _nodes.size() ) );
+    }
+
+    // The deepest directories are at the end of the list; start with them
+    // so their parents can be removed as early as possible.
+
+    for ( int i = _nodes.size() - 1; i >= 0; --i )
+    {
+	DeleteTask * task = new DeleteTask( this, i );
+	CHECK_NEW( task );
+
+	_threadPool.start( task ); // The thread pool takes over ownership
+    }
+
+    _timer.start( DELETER_POLL_MILLISEC );
+    poll();
+}
+
+
+void Deleter::removeNode( int nodeIndex )
+{
+    DeleteNode * node = _nodes.at( nodeIndex );
+
+    if ( ! node->complete )
+    {
+	int fd = openNode( nodeIndex );
+
+	if ( fd < 0 || ! removeContents( fd, node->path, node->device ) )
+	    node->keep.storeRelease( 1 );
+    }
+    else if ( ! node->fileNames.isEmpty() )
+    {
+	int fd = openNode( nodeIndex );
+
+	if ( fd < 0 )
+	{
+	    node->keep.storeRelease( 1 );
+	}
+	else
+	{
+	    foreach ( const QByteArray & name, node->fileNames )
+	    {
+		if ( unlinkat( fd, name.constData(), 0 ) == 0 || errno == ENOENT )
+		{
+		    _deleted.ref();
+		}
+		else
+		{
+		    addError( tr( "Can't delete %1/%2: %3" )
+			      .arg( QFile::decodeName( node->path ) )
+			      .arg( QFile::decodeName( name ) )
+			      .arg( formatErrno() ) );
+		    node->keep.storeRelease( 1 );
+		}
+	    }
+	}
+    }
+
+    partDone( nodeIndex );
+}
+
+
+void Deleter::partDone( int nodeIndex )
+{
+    while ( nodeIndex >= 0 )
+    {
+	DeleteNode * node = _nodes.at( nodeIndex );
+
+	if ( node->pending.deref() ) // Still something left in this directory?
+	    return;
+
+	if ( node->removeDir && ! node->keep.loadAcquire() )
+	{
+	    // The parent of a toplevel node is not in the list; all others
+	    // are removed relative to their parent node which is still open.
+
+	    int parentFd = -1;
+
+	    if ( node->parent >= 0 )
+	    {
+		parentFd = openNode( node->parent );
+	    }
+	    else
+	    {
+		int	   slash      = node->path.lastIndexOf( '/' );
+		QByteArray parentPath = slash > 0 ? node->path.left( slash ) : QByteArray( "/" );
+
+		parentFd = open( parentPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+		if ( parentFd < 0 )
+		{
+		    addError( tr( "Can't open %1: %2" )
+			      .arg( QFile::decodeName( parentPath ) ).arg( formatErrno() ) );
+		}
+	    }
+
+	    if ( parentFd < 0 )
+	    {
+		node->keep.storeRelease( 1 );
+	    }
+	    else
+	    {
+		int result = unlinkat( parentFd, node->name.constData(), AT_REMOVEDIR );
+
+		if ( result < 0 && ( errno == ENOTEMPTY || errno == EEXIST ) )
+		{
+		    // Something was created in that directory after it was read
+
+		    int fd = openNode( nodeIndex );
+
+		    if ( fd >= 0 && removeContents( fd, node->path, node->device ) )
+			result = unlinkat( parentFd, node->name.constData(), AT_REMOVEDIR );
+		    else
+			errno = ENOTEMPTY;
+		}
+
+		if ( result == 0 || errno == ENOENT )
+		{
+		    _deleted.ref();
+		}
+		else
+		{
+		    addError( tr( "Can't delete directory %1: %2" )
+			      .arg( QFile::decodeName( node->path ) ).arg( formatErrno() ) );
+		    node->keep.storeRelease( 1 );
+		}
+
+		if ( node->parent < 0 )
+		    close( parentFd );
+	    }
+	}
+
+	// Nothing below this node needs its directory anymore
+
+	closeNode( nodeIndex );
+	nodeIndex = node->parent;
+
+	if ( nodeIndex >= 0 && node->keep.loadAcquire() )
+	    _nodes.at( nodeIndex )->keep.storeRelease( 1 );
+
+	_finishedNodes.ref();
+    }
+}
+
+
+int Deleter::openNode( int nodeIndex )
+{
+    QMutexLocker locker( &_fdMutex );
+
+    return openNodeLocked( nodeIndex );
+}
+
+
+int Deleter::openNodeLocked( int nodeIndex )
+{
+    DeleteNode * node = _nodes.at( nodeIndex );
+
+    if ( node->fd != -1 )	// Open or failed before
+	return node->fd;
+
+    if ( node->parent < 0 )
+    {
+	node->fd = openDir( AT_FDCWD, node->path, node->path, node->device );
+    }
+    else
+    {
+	int parentFd = openNodeLocked( node->parent );
+
+	// An error for the parent was already reported
+
+	node->fd = parentFd < 0 ? -1 : openDir( parentFd, node->name, node->path, node->device );
+    }
+
+    if ( node->fd < 0 )
+	node->fd = -2;
+
+    return node->fd;
+}
+
+
+void Deleter::closeNode( int nodeIndex )
+{
+    QMutexLocker locker( &_fdMutex );
+    DeleteNode * node = _nodes.at( nodeIndex );
+
+    if ( node->fd >= 0 )
+    {
+	close( node->fd );
+	node->fd = -2;		// Never open it again
+    }
+}
+
+
+int Deleter::openDir( int		   parentFd,
+		      const QByteArray & name,
+		      const QByteArray & path,
+		      dev_t		   device )
+{
+    int fd = openat( parentFd, name.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC );
+
+    if ( fd < 0 )
+    {
+	addError( tr( "Can't open %1: %2" ).arg( QFile::decodeName( path ) ).arg( formatErrno() ) );
+	return -1;
+    }
+
+    struct stat statInfo;
+
+    if ( fstat( fd, &statInfo ) != 0 )
+    {
+	addError( tr( "Can't read %1: %2" ).arg( QFile::decodeName( path ) ).arg( formatErrno() ) );
+	close( fd );
+	return -1;
+    }
+
+    if ( statInfo.st_dev != device )
+    {
+	addError( tr( "Not deleting mount point %1" ).arg( QFile::decodeName( path ) ) );
+	close( fd );
+	return -1;
+    }
+
+    return fd;
+}
+
+
+bool Deleter::removeContents( int fd, const QByteArray & path, dev_t device )
+{
+    // closedir() closes the fd that readdir() uses; the caller keeps 'fd'
+
+    int	  readFd = dup( fd );
+    DIR * dir	 = readFd < 0 ? 0 : fdopendir( readFd );
+
+    if ( ! dir )
+    {
+	addError( tr( "Can't read %1: %2" ).arg( QFile::decodeName( path ) ).arg( formatErrno() ) );
+
+	if ( readFd >= 0 )
+	    close( readFd );
+
+	return false;
+    }
+
+    // The duplicate shares the position with 'fd' which might have been
+    // read before.
+
+    rewinddir( dir );
+
+    // Read the complete directory first; removing entries while reading it
+    // may or may not make readdir() skip some.
+
+    QList<QPair<QByteArray, unsigned char> > entries;
+    struct dirent * entry;
+
+    while ( ( entry = readdir( dir ) ) )
+    {
+	if ( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
+	    continue;
+
+	entries << qMakePair( QByteArray( entry->d_name ), entry->d_type );
+    }
+
+    closedir( dir );
+
+    bool ok = true;
+
+    for ( int i = 0; i < entries.size(); ++i )
+    {
+	const QByteArray & name    = entries.at( i ).first;
+	unsigned char	   type	   = entries.at( i ).second;
+	QByteArray	   subPath = path + "/" + name;
+	bool		   isDir   = false;
+
+	if ( type == DT_DIR || type == DT_UNKNOWN )
+	{
+	    // Open it right away instead of checking the type first: It might
+	    // be replaced by a symlink in between.
+
+	    int subFd = openat( fd, name.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC );
+
+	    if ( subFd >= 0 )
+	    {
+		struct stat statInfo;
+		isDir = true;
+
+		if ( fstat( subFd, &statInfo ) != 0 )
+		{
+		    addError( tr( "Can't read %1: %2" ).arg( QFile::decodeName( subPath ) ).arg( formatErrno() ) );
+		    close( subFd );
+		    ok = false;
+		    continue;
+		}
+
+		if ( statInfo.st_dev != device )
+		{
+		    addError( tr( "Not deleting mount point %1" ).arg( QFile::decodeName( subPath ) ) );
+		    close( subFd );
+		    ok = false;
+		    continue;
+		}
+
+		_total.ref();
+		bool removed = removeContents( subFd, subPath, device );
+		close( subFd );
+
+		if ( ! removed )
+		{
+		    ok = false;
+		    continue;
+		}
+	    }
+	    else if ( errno == ENOENT )
+	    {
+		continue;
+	    }
+	    else if ( errno != ENOTDIR && errno != ELOOP ) // Not a directory (anymore)
+	    {
+		addError( tr( "Can't open %1: %2" ).arg( QFile::decodeName( subPath ) ).arg( formatErrno() ) );
+		ok = false;
+		continue;
+	    }
+	}
+
+	if ( ! isDir )
+	    _total.ref();
+
+	if ( unlinkat( fd, name.constData(), isDir ? AT_REMOVEDIR : 0 ) == 0 || errno == ENOENT )
+	{
+	    _deleted.ref();
+	}
+	else
+	{
+	    addError( tr( "Can't delete %1: %2" ).arg( QFile::decodeName( subPath ) ).arg( formatErrno() ) );
+	    ok = false;
+	}
+    }
+
+    return ok;
+}
+
+
+void Deleter::addError( const QString & error )
+{
+    QMutexLocker locker( &_errorMutex );
+    _errors << error;
+}
+
+
+void Deleter::poll()
+{
+    QStringList errors;
+
+    {
+	QMutexLocker locker( &_errorMutex );
+	errors = _errors;
+	_errors.clear();
+    }
+
+    _errorCount += errors.size();
+
+    foreach ( const QString & error, errors )
+    {
+	if ( _outputWindow )
+	    _outputWindow->addStderr( error );
+	else
+	    logWarning() << error << endl;
+    }
+
+    int deletedItems = deleted();
+
+    if ( deletedItems != _lastReported )
+    {
+	_lastReported = deletedItems;
+	emit progress( tr( "Deleted %1 of %2 items" ).arg( deletedItems ).arg( total() ) );
+    }
+
+    if ( _finishedNodes.loadAcquire() < _nodes.size() )
+	return;
+
+    _timer.stop();
+
+    QString summary = tr( "Deleted %1 items" ).arg( deletedItems );
+    logInfo() << summary << ", " << _errorCount << " errors" << endl;
+
+    if ( _outputWindow )
+    {
+	_outputWindow->addStdout( summary );
+	_outputWindow->noMoreProcesses();
+    }
+
+    emit finished( _errorCount );
+    deleteLater();
+}
@@ -0,0 +1,247 @@
+/*
+ *   File name: Deleter.h
+ *   Summary:	In-process deletion of subtrees in worker threads
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef Deleter_h
+#define Deleter_h
+
+#include <sys/types.h>	// dev_t
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QByteArray>
+#include <QStringList>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QThreadPool>
+#include <QPointer>
+#include <QTimer>
+
+#include "FileInfoSet.h"
+
+class OutputWindow;
+
+
+namespace QDirStat
+{
+    class FileInfo;
+    class DirInfo;
+
+
+    /**
+     * One directory for the Deleter: The files to unlink in it and whether
+     * or not to remove the directory itself when all its subdirectories are
+     * done.
+     *
+     * This is plain data that is collected from the DirTree in the GUI
+     * thread, so the worker threads never touch the tree.
+     **/
+    struct DeleteNode
+    {
+	QByteArray	  path;		// only for messages and toplevel nodes
+	QByteArray	  name;		// relative to the parent node
+	QList<QByteArray> fileNames;
+	int		  parent;	// index of the parent node or -1
+	int		  fd;		// -1 if not open yet, -2 if that failed
+	dev_t		  device;
+	bool		  removeDir;	// false for the parent of selected files
+	bool		  complete;	// subtree is completely in the DirTree
+	QAtomicInt	  pending;	// unfinished subdirectories + own files
+	QAtomicInt	  keep;		// something below could not be removed
+    };
+
+
+    /**
+     * Class to delete files and directories of a DirTree without starting
+     * an external "rm -rf" process: It uses the already read subtrees to
+     * unlinkat() the files of each directory in worker threads and removes
+     * the directories bottom-up as soon as all their subdirectories are
+     * done. So there is no additional stat() pass over the disk, and the
+     * total number of items is known right away for the progress.
+     *
+     * Subtrees that were not read completely (excluded directories, read
+     * errors, directories that were not read yet) are removed with
+     * readdir() and unlinkat() in the worker thread.
+     *
+     * Mount points below the deleted directories are not crossed; their
+     * parent directories are kept. Below the toplevel directories,
+     * everything is opened and removed relative to the file descriptor of
+     * its parent directory with O_NOFOLLOW, so a directory that is replaced
+     * by a symlink while deleting is never followed.
+     *
+     * Like Refresher, an instance of this class deletes itself when it is
+     * done.
+     **/
+    class Deleter: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This collects everything to delete from the subtrees
+	 * of 'items' which should be normalized (see
+	 * FileInfoSet::normalized()).
+	 **/
+	Deleter( const FileInfoSet & items, QObject * parent = 0 );
+
+	/**
+	 * Destructor. This waits for all worker threads.
+	 **/
+	virtual ~Deleter();
+
+	/**
+	 * Set an output window to report progress and errors to. When all
+	 * is done, this calls OutputWindow::noMoreProcesses() so it emits
+	 * lastProcessFinished() just like for a cleanup with external
+	 * processes.
+	 **/
+	void setOutputWindow( OutputWindow * outputWindow )
+	    { _outputWindow = outputWindow; }
+
+	/**
+	 * Start deleting in the worker threads.
+	 **/
+	void start();
+
+	/**
+	 * Return the number of files and directories that were removed so
+	 * far.
+	 **/
+	int deleted() const { return _deleted.loadAcquire(); }
+
+	/**
+	 * Return the total number of files and directories to remove. This
+	 * may increase for subtrees that were not completely read.
+	 **/
+	int total() const { return _total.loadAcquire(); }
+
+	/**
+	 * Remove one node: Unlink its files, and if it has no subdirectories,
+	 * finish it. This is called in a worker thread.
+	 **/
+	void removeNode( int nodeIndex );
+
+
+    signals:
+
+	/**
+	 * Emitted periodically while deleting.
+	 **/
+	void progress( const QString & text );
+
+	/**
+	 * Emitted when everything is done.
+	 **/
+	void finished( int errorCount );
+
+
+    protected slots:
+
+	/**
+	 * Check for new errors and for the end of the work in the GUI
+	 * thread.
+	 **/
+	void poll();
+
+
+    protected:
+
+	/**
+	 * Add a node for directory 'dir' and the nodes of all its
+	 * subdirectories. Return the index of the new node.
+	 *
+	 * If 'removeDir' is 'false', the node is only for some files in
+	 * 'dir', and the directory itself is kept.
+	 **/
+	int addDir( FileInfo * dir, int parent, bool removeDir );
+
+	/**
+	 * Add the children of 'dir' to node 'nodeIndex': Files to its file
+	 * names, directories as new nodes. Pseudo directories (dot entries,
+	 * attics) are resolved to their children.
+	 **/
+	void addChildren( DirInfo * dir, int nodeIndex );
+
+	/**
+	 * One part of a node is done (its files or one of its
+	 * subdirectories); if this was the last one, remove the directory
+	 * and notify the parent node.
+	 **/
+	void partDone( int nodeIndex );
+
+	/**
+	 * Return the file descriptor of the directory of node 'nodeIndex'.
+	 * It is opened relative to its parent node (which is opened as well
+	 * if needed) the first time, and it stays open until the node is
+	 * finished. Return a negative value if it can't be opened; that error
+	 * is only reported once.
+	 *
+	 * This can be called in any thread.
+	 **/
+	int openNode( int nodeIndex );
+
+	/**
+	 * The same as openNode() with _fdMutex already locked.
+	 **/
+	int openNodeLocked( int nodeIndex );
+
+	/**
+	 * Close the file descriptor of node 'nodeIndex' if it is open.
+	 **/
+	void closeNode( int nodeIndex );
+
+	/**
+	 * Open directory 'name' relative to 'parentFd' without following
+	 * symlinks and check that it is on device 'device'. Report an error
+	 * and return -1 if that fails. 'path' is only for messages.
+	 **/
+	int openDir( int		parentFd,
+		     const QByteArray & name,
+		     const QByteArray & path,
+		     dev_t		device );
+
+	/**
+	 * Remove everything in the open directory 'fd' with readdir() without
+	 * leaving device 'device'. 'path' is only for messages. Return 'true'
+	 * if everything could be removed. 'fd' stays open.
+	 **/
+	bool removeContents( int fd, const QByteArray & path, dev_t device );
+
+	/**
+	 * Report an error. This can be called in any thread.
+	 **/
+	void addError( const QString & error );
+
+
+	//
+	// Data members
+	//
+
+	QList<DeleteNode *>	_nodes;
+	QThreadPool		_threadPool;
+	QTimer			_timer;
+	QPointer<OutputWindow>	_outputWindow;
+
+	QAtomicInt		_deleted;
+	QAtomicInt		_total;
+	QAtomicInt		_finishedNodes;
+	int			_lastReported;
+	int			_errorCount;
+
+	QMutex			_errorMutex;
+	QStringList		_errors;
+	QMutex			_fdMutex;
+
+    };	// class Deleter
+
+}	// namespace QDirStat
+
+
+#endif // ifndef Deleter_h
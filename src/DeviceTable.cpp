@@ -0,0 +1,112 @@
+/*
+ *   File name: DeviceTable.cpp
+ *   Summary:	Cached properties of the devices that are read
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "DeviceTable.h"
+#include "MountPoints.h"
+#include "SysUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+DeviceTable * DeviceTable::_instance = 0;
+
+
+DeviceTable * DeviceTable::instance()
+{
+    if ( ! _instance )
+    {
+	_instance = new DeviceTable();
+	CHECK_NEW( _instance );
+    }
+
+    return _instance;
+}
+
+
+void DeviceTable::clear()
+{
+    if ( _instance )
+	_instance->_devices.clear();
+}
+
+
+DeviceInfo & DeviceTable::entry( dev_t device )
+{
+    QHash<dev_t, DeviceInfo>::iterator it = _devices.find( device );
+
+    if ( it == _devices.end() )
+    {
+	DeviceInfo info;
+	info.isRotational = SysUtil::isRotational( device );
+	it = _devices.insert( device, info );
+    }
+
+    return it.value();
+}
+
+
+const DeviceInfo & DeviceTable::info( dev_t device, const QString & path )
+{
+    DeviceTable * table = instance();
+
+    if ( device == 0 )
+    {
+	table->_unknownDevice = DeviceInfo();
+	resolveMountPoint( table->_unknownDevice, path );
+
+	return table->_unknownDevice;
+    }
+
+    DeviceInfo & info = table->entry( device );
+
+    if ( ! info.hasMountInfo && ! path.isEmpty() )
+    {
+	resolveMountPoint( info, path );
+
+	logDebug() << "Device " << (quint64) device << ": " << info.deviceName
+		   << " on " << info.mountPath
+		   << " type " << info.filesystemType
+		   << ( info.isRotational ? " (rotational)" : "" )
+		   << endl;
+    }
+
+    return info;
+}
+
+
+bool DeviceTable::isRotational( dev_t device )
+{
+    if ( device == 0 )
+	return false;
+
+    return instance()->entry( device ).isRotational;
+}
+
+
+void DeviceTable::resolveMountPoint( DeviceInfo & info, const QString & path )
+{
+    MountPoint * mountPoint = MountPoints::findByPath( path );
+
+    if ( ! mountPoint )
+	mountPoint = MountPoints::findNearestMountPoint( path );
+
+    if ( mountPoint )
+    {
+	info.mountPath	    = mountPoint->path();
+	info.deviceName	    = mountPoint->device();
+	info.filesystemType = mountPoint->filesystemType();
+	info.isNtfs	    = mountPoint->isNtfs();
+	info.isNetworkMount = mountPoint->isNetworkMount();
+    }
+
+    info.hasMountInfo = true;
+}
@@ -0,0 +1,112 @@
+/*
+ *   File name: DeviceTable.h
+ *   Summary:	Cached properties of the devices that are read
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DeviceTable_h
+#define DeviceTable_h
+
+
+#include <sys/types.h>	// dev_t
+
+#include <QString>
+#include <QHash>
+
+
+namespace QDirStat
+{
+    /**
+     * The properties of one device (one dev_t) that the read jobs and the
+     * job queue need, resolved only once for all directories on it.
+     **/
+    struct DeviceInfo
+    {
+	DeviceInfo():
+	    isNtfs( false ),
+	    isNetworkMount( false ),
+	    isRotational( false ),
+	    hasMountInfo( false )
+	    {}
+
+	QString mountPath;	// of the nearest mount point
+	QString deviceName;	// "/dev/sda2", "nas:/export" etc.
+	QString filesystemType;
+	bool	isNtfs;		// i-numbers of hard links are not reliable
+	bool	isNetworkMount;
+	bool	isRotational;
+	bool	hasMountInfo;	// the mount point fields are valid
+    };
+
+
+    /**
+     * Singleton table of the properties of the devices, i.e. of the dev_t
+     * of the directories that are read: The fs type, if it is NTFS, a
+     * network mount or a rotational disk. Looking those up for each
+     * directory means searching the mount points and reading from /sys
+     * again and again; this does that only once for each device.
+     *
+     * The content is dropped when the mount points are cleared (see
+     * MountPoints::clear()).
+     *
+     * This is not thread-safe; use it only in the GUI thread.
+     **/
+    class DeviceTable
+    {
+    public:
+
+	/**
+	 * Return the properties of 'device'. If its mount point is not
+	 * known yet, it is looked up from 'path' (any path on that device).
+	 *
+	 * Device 0 is used for directories from a cache file that don't
+	 * have a device; for those the mount point is looked up each time.
+	 **/
+	static const DeviceInfo & info( dev_t device, const QString & path );
+
+	/**
+	 * Return 'true' if 'device' is a rotational disk. This does not
+	 * need the mount point.
+	 **/
+	static bool isRotational( dev_t device );
+
+	/**
+	 * Forget all devices.
+	 *
+	 * This does not create the singleton if it doesn't exist yet.
+	 **/
+	static void clear();
+
+
+    protected:
+
+	/**
+	 * Return the singleton, creating it if needed.
+	 **/
+	static DeviceTable * instance();
+
+	/**
+	 * Return the entry for 'device', creating it if needed.
+	 **/
+	DeviceInfo & entry( dev_t device );
+
+	/**
+	 * Fill in the fields of 'info' that need the mount point.
+	 **/
+	static void resolveMountPoint( DeviceInfo & info, const QString & path );
+
+
+	static DeviceTable *	    _instance;
+
+	QHash<dev_t, DeviceInfo>    _devices;
+	DeviceInfo		    _unknownDevice;
+
+    };	// class DeviceTable
+
+}	// namespace QDirStat
+
+
+#endif // ifndef DeviceTable_h
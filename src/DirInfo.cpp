@@ -7,7 +7,8 @@
  */
 
 
-#include <algorithm>    // std::stable_sort()
+#include <QMutex>
+#include <QMutexLocker>
 
 #include "DirInfo.h"
 #include "DirTree.h"
@@ -15,9 +16,18 @@
 #include "Attic.h"
 #include "FileInfoIterator.h"
 #include "FileInfoSorter.h"
+#include "ParallelSort.h"
 #include "FormatUtil.h"
 #include "Exception.h"
 #include "DebugHelpers.h"
+#include "SpillStore.h"
+#include "Trace.h"
+
+
+// Build an index of the children by name for directories where finding a
+// child by name needs to look at more children than this
+
+#define CHILD_INDEX_THRESHOLD	32
 
 // How many times the standard deviation from the average is considered dominant
 #define DOMINANCE_FACTOR                         5.0
@@ -25,12 +35,203 @@
 #define DOMINANCE_MAX_PERCENT                   70.0
 #define DOMINANCE_ITEM_COUNT                    30
 
+// How many sort orders to keep for each directory
+#define MAX_SORT_PERMUTATIONS			 3
+
+// Sort only the rows that are needed for directories with more children
+// than this if that is at most 1/PARTIAL_SORT_MAX_SHARE of them; otherwise
+// the parallel sort of all of them is faster
+#define PARTIAL_SORT_MIN_SIZE			 20000
+#define PARTIAL_SORT_MAX_SHARE			 4
+#define MAX_CACHED_STATS			 2
+
 #define VERBOSE_DOMINANCE_CHECK                 0
 #define DIRECT_CHILDREN_COUNT_SANITY_CHECK      0
 
 using namespace QDirStat;
 
 
+// Creating and deleting attics and dot entries uses the ID tables and the
+// shared names of all items. DirTree::finalizeTree() moves items to the
+// attics of several subtrees in parallel, so this is serialized.
+
+static QMutex pseudoDirMutex;
+
+
+namespace QDirStat
+{
+    /**
+     * The children of a directory sorted by one column in one sort order:
+     * The indices of the children in their unsorted order, i.e. the
+     * children list followed by the dot entry.
+     **/
+    struct DirSortPermutation
+    {
+	DataColumn	 sortCol;
+	Qt::SortOrder	 sortOrder;
+	QVector<quint32> rows;
+	int		 sortedCount;	// Rows in their final order
+    };
+
+
+    /**
+     * The last few sort orders of the children of a directory, the most
+     * recently used one first. They remain valid as long as no children are
+     * added or removed.
+     **/
+    struct DirSortCache
+    {
+	QList<DirSortPermutation> permutations;
+    };
+
+
+    /**
+     * The statistics of all items below a directory for one set of
+     * StatsCollectors, identified by their cache keys.
+     **/
+    struct DirCachedStats
+    {
+	QStringList	   keys;
+	StatsCollectorList stats;
+    };
+
+
+    /**
+     * The last few cached statistics of a directory, the most recently
+     * used one first, the last snapshot and the last column-wise copy of
+     * the subtree. They remain valid as long as nothing is added or
+     * removed in the subtree.
+     **/
+    struct DirStatsCache
+    {
+	~DirStatsCache()
+	{
+	    foreach ( const DirCachedStats & cached, entries )
+		qDeleteAll( cached.stats );
+	}
+
+	QList<DirCachedStats> entries;
+	TreeSnapshotDirPtr    snapshot;
+	TreeColumnsPtr	      columns;
+    };
+
+
+}	// namespace QDirStat
+
+
+ChildrenSummary::ChildrenSummary():
+    size( 0 ),
+    allocatedSize( 0 ),
+    blocks( 0 ),
+    items( 0 ),
+    subDirs( 0 ),
+    files( 0 ),
+    unignoredItems( 0 ),
+    ignoredItems( 0 ),
+    errSubDirs( 0 ),
+    latestMtime( 0 ),
+    oldestFileMtime( 0 )
+{
+    // NOP
+}
+
+
+void ChildrenSummary::add( FileInfo * newChild )
+{
+    size	  += newChild->size();
+    allocatedSize += newChild->allocatedSize();
+    blocks	  += newChild->blocks();
+    items++;
+
+    if ( newChild->isDir() )
+	subDirs++;
+    else
+	unignoredItems++;
+
+    if ( newChild->isFile() )
+	files++;
+
+    if ( newChild->mtime() > latestMtime )
+	latestMtime = newChild->mtime();
+
+    time_t childOldestFileMTime = newChild->oldestFileMtime();
+
+    if ( childOldestFileMTime > 0 && newChild->isFile() )
+    {
+	if ( oldestFileMtime == 0 || childOldestFileMTime < oldestFileMtime )
+	    oldestFileMtime = childOldestFileMTime;
+    }
+}
+
+
+void ChildrenSummary::addSubtree( FileInfo * child )
+{
+    // Exactly what DirInfo::recalc() adds for this child
+
+    size	   += child->totalSize();
+    allocatedSize  += child->totalAllocatedSize();
+    blocks	   += child->totalBlocks();
+    items	   += child->totalItems() + 1;
+    subDirs	   += child->totalSubDirs();
+    files	   += child->totalFiles();
+    unignoredItems += child->totalUnignoredItems();
+    ignoredItems   += child->totalIgnoredItems();
+    errSubDirs	   += child->errSubDirCount();
+
+    if ( child->isDir() )
+    {
+	subDirs++;
+
+	if ( child->readError() )
+	    errSubDirs++;
+    }
+    else
+    {
+	if ( child->isIgnored() )
+	    ignoredItems++;
+	else
+	    unignoredItems++;
+    }
+
+    if ( child->isFile() )
+	files++;
+
+    if ( child->latestMtime() > latestMtime )
+	latestMtime = child->latestMtime();
+
+    time_t childOldestFileMTime = child->oldestFileMtime();
+
+    if ( childOldestFileMTime > 0 )
+    {
+	if ( oldestFileMtime == 0 || childOldestFileMTime < oldestFileMtime )
+	    oldestFileMtime = childOldestFileMTime;
+    }
+}
+
+
+/**
+ * Return the summary fields of 'dir' as a ChildrenSummary.
+ **/
+static ChildrenSummary totalsOf( DirInfo * dir )
+{
+    ChildrenSummary totals;
+
+    totals.size		  = dir->totalSize();
+    totals.allocatedSize  = dir->totalAllocatedSize();
+    totals.blocks	  = dir->totalBlocks();
+    totals.items	  = dir->totalItems();
+    totals.subDirs	  = dir->totalSubDirs();
+    totals.files	  = dir->totalFiles();
+    totals.unignoredItems = dir->totalUnignoredItems();
+    totals.ignoredItems	  = dir->totalIgnoredItems();
+    totals.errSubDirs	  = dir->errSubDirCount();
+    totals.latestMtime	  = dir->latestMtime();
+    totals.oldestFileMtime = dir->oldestFileMtime();
+
+    return totals;
+}
+
+
 DirInfo::DirInfo( DirTree * tree,
 		  DirInfo * parent )
     : FileInfo( tree, parent )
@@ -50,9 +251,12 @@ DirInfo::DirInfo( const QString & filenameWithoutPath,
 		parent )
 {
     init();
-    ensureDotEntry();
 
-    _directChildrenCount++;	// One for the newly created dot entry
+    // No dot entry yet: It is only created for the first non-directory
+    // child (see insertChild()), so directories that have only
+    // subdirectories or nothing at all never get one.
+
+    _wantDotEntry = true;
 }
 
 
@@ -76,9 +280,7 @@ DirInfo::DirInfo( DirTree *	  tree,
 		mtime )
 {
     init();
-    ensureDotEntry();
-
-    _directChildrenCount++;	// One for the newly created dot entry
+    _wantDotEntry = true;
 }
 
 
@@ -86,13 +288,26 @@ void DirInfo::init()
 {
     _dotEntry		 = 0;
     _attic		 = 0;
+    _wantDotEntry	 = false;
+    _systemPathClass	 = 0;
     _isMountPoint	 = false;
     _isExcluded		 = false;
     _summaryDirty	 = false;
+    _mtimesDirty	 = false;
     _deletingAll	 = false;
     _locked		 = false;
     _touched		 = false;
+    _exposed		 = false;
+    _hasSizeEstimate	 = false;
+    _isSampled		 = false;
+    _hasSpilledFiles	 = false;
+    _hasFileSummary	 = false;
+    _filesUnfolded	 = false;
+    _hasChildIndex	 = false;
+    _isCachePlaceholder	 = false;
     _pendingReadJobs	 = 0;
+    _subtreeFirst	 = 0;
+    _subtreeLast	 = 0;
     _dotEntry		 = 0;
     _firstChild		 = 0;
     _totalSize		 = _size;
@@ -109,19 +324,76 @@ void DirInfo::init()
     _oldestFileMtime	 = 0;
     _readState		 = DirQueued;
     _sortedChildren	 = 0;
-    _dominantChildren    = 0;
+    _dominantCount	 = -1;
+    _sortCache		 = 0;
+    _statsCache		 = 0;
     _lastSortCol	 = UndefinedCol;
     _lastSortOrder	 = Qt::AscendingOrder;
+
+    if ( _tree )	// A new directory has no depth-first number yet
+	_tree->invalidateSubtreeNumbers();
 }
 
 
 DirInfo::~DirInfo()
 {
-    clear();
+    deleteChildren();	// The parent already subtracted this subtree
+
+    if ( _hasSizeEstimate )
+	setSizeEstimate( -1 );
+
+    if ( _isSampled && _tree )
+	_tree->setSample( this, 0 );
+
+    if ( _hasSpilledFiles && _tree )
+	_tree->spillStore()->remove( this );
+
+    if ( _hasFileSummary && _tree )
+	_tree->setFileSummary( this, 0 );
+
+    if ( _tree && readError() )
+	_tree->dropReadError( this );
+
+    dropChildIndex();
 }
 
 
 void DirInfo::clear()
+{
+    ChildrenSummary totalsBefore;
+
+    if ( _parent )
+	totalsBefore = totalsOf( this );
+
+    deleteChildren();
+
+    if ( _parent )
+	subtractFromAncestors( totalsBefore );
+}
+
+
+void DirInfo::subtractFromAncestors( ChildrenSummary totalsBefore )
+{
+    const ChildrenSummary totals = totalsOf( this );
+
+    totalsBefore.size		-= totals.size;
+    totalsBefore.allocatedSize	-= totals.allocatedSize;
+    totalsBefore.blocks		-= totals.blocks;
+    totalsBefore.items		-= totals.items;
+    totalsBefore.subDirs	-= totals.subDirs;
+    totalsBefore.files		-= totals.files;
+    totalsBefore.unignoredItems -= totals.unignoredItems;
+    totalsBefore.ignoredItems	-= totals.ignoredItems;
+    totalsBefore.errSubDirs	-= totals.errSubDirs;
+
+    // The old latest and oldest mtime stay in 'totalsBefore': If they are
+    // gone now, the ancestors recalculate them.
+
+    _parent->childrenRemoved( totalsBefore );
+}
+
+
+void DirInfo::deleteChildren()
 {
     _deletingAll = true;
 
@@ -153,28 +425,41 @@ void DirInfo::clear()
 	_attic = 0;
     }
 
+    if ( _hasSpilledFiles )
+    {
+	_tree->spillStore()->remove( this );
+	_hasSpilledFiles = false;
+    }
+
+    dropChildIndex();
     _summaryDirty = true;
     _deletingAll  = false;
     dropSortCache();
+    dropStatsCache();
 }
 
 
 void DirInfo::reset()
 {
+    ChildrenSummary totalsBefore;
+
+    if ( _parent )
+	totalsBefore = totalsOf( this );
+
     if ( _firstChild || _dotEntry || _attic )
-	clear();
+	deleteChildren();
 
     _readState	     = DirQueued;
     _pendingReadJobs = 0;
     _summaryDirty    = true;
-
-    ensureDotEntry();
-
-    if ( _tree )
-	_tree->childAddedNotify( _dotEntry );
+    _isCachePlaceholder = false;
+    _wantDotEntry    = true;
 
     recalc();
     dropSortCache();
+
+    if ( _parent )
+	subtractFromAncestors( totalsBefore );
 }
 
 
@@ -184,8 +469,12 @@ DotEntry * DirInfo::ensureDotEntry()
     {
 	// logDebug() << "Creating dot entry for " << this << endl;
 
+	QMutexLocker locker( &pseudoDirMutex );
 	_dotEntry = new DotEntry( _tree, this );
 	CHECK_NEW( _dotEntry );
+
+	_directChildrenCount++;
+	dropSortCache();
     }
 
     return _dotEntry;
@@ -194,7 +483,11 @@ DotEntry * DirInfo::ensureDotEntry()
 
 void DirInfo::deleteEmptyDotEntry()
 {
-    if ( ! _dotEntry->firstChild() && ! _dotEntry->hasAtticChildren() )
+    if ( ! _dotEntry )
+	return;
+
+    if ( ! _dotEntry->firstChild() && ! _dotEntry->hasAtticChildren() &&
+	 ! _dotEntry->hasSpilledFiles() )
     {
         // logDebug() << "Deleting dot entry for " << this << endl;
 
@@ -206,12 +499,25 @@ void DirInfo::deleteEmptyDotEntry()
 }
 
 
+DotEntry * DirInfo::takeDotEntry()
+{
+    DotEntry * dotEntry = _dotEntry;
+    _dotEntry = 0;
+
+    if ( dotEntry )
+	dotEntry->setParent( 0 );
+
+    return dotEntry;
+}
+
+
 Attic * DirInfo::ensureAttic()
 {
     if ( ! _attic )
     {
 	// logDebug() << "Creating attic for " << this << endl;
 
+	QMutexLocker locker( &pseudoDirMutex );
 	_attic = new Attic( _tree, this );
 	CHECK_NEW( _attic );
     }
@@ -226,6 +532,7 @@ void DirInfo::deleteEmptyAttic()
     {
         // logDebug() << "Deleting attic for " << this << endl;
 
+	QMutexLocker locker( &pseudoDirMutex );
 	delete _attic;
 	_attic = 0;
     }
@@ -240,6 +547,8 @@ bool DirInfo::hasAtticChildren() const
 
 void DirInfo::recalc()
 {
+    TRACE_SPAN( "DirInfo::recalc" );
+
     // logDebug() << this << endl;
 
     _totalSize		 = _size;
@@ -314,7 +623,124 @@ void DirInfo::recalc()
 	_errSubDirCount	   += _attic->errSubDirCount();
     }
 
+    if ( _isSampled && _tree )
+    {
+	// Add the extrapolated values for the entries that were not read
+
+	const ChildrenSummary extra = _tree->sample( this ).extra;
+
+	_totalSize	     += extra.size;
+	_totalAllocatedSize  += extra.allocatedSize;
+	_totalBlocks	     += extra.blocks;
+	_totalItems	     += extra.items;
+	_totalFiles	     += extra.files;
+	_totalUnignoredItems += extra.unignoredItems;
+    }
+
+    if ( _hasFileSummary && _tree )
+    {
+	// The entries of a directory read in directories-only mode
+
+	const ChildrenSummary files = _tree->fileSummary( this ).files;
+
+	_totalSize	     += files.size;
+	_totalAllocatedSize  += files.allocatedSize;
+	_totalBlocks	     += files.blocks;
+	_totalItems	     += files.items;
+	_totalFiles	     += files.files;
+	_totalUnignoredItems += files.unignoredItems;
+
+	if ( files.latestMtime > _latestMtime )
+	    _latestMtime = files.latestMtime;
+
+	if ( files.oldestFileMtime > 0 &&
+	     ( _oldestFileMtime == 0 || files.oldestFileMtime < _oldestFileMtime ) )
+	{
+	    _oldestFileMtime = files.oldestFileMtime;
+	}
+    }
+
+    if ( _hasSpilledFiles && _tree )
+    {
+	// The files in the spill store are real children, just not in memory
+
+	const ChildrenSummary spilled = _tree->spillStore()->summary( this );
+
+	_directChildrenCount += spilled.items;
+	_totalSize	     += spilled.size;
+	_totalAllocatedSize  += spilled.allocatedSize;
+	_totalBlocks	     += spilled.blocks;
+	_totalItems	     += spilled.items;
+	_totalFiles	     += spilled.files;
+	_totalUnignoredItems += spilled.unignoredItems;
+
+	if ( spilled.latestMtime > _latestMtime )
+	    _latestMtime = spilled.latestMtime;
+
+	if ( spilled.oldestFileMtime > 0 &&
+	     ( _oldestFileMtime == 0 || spilled.oldestFileMtime < _oldestFileMtime ) )
+	{
+	    _oldestFileMtime = spilled.oldestFileMtime;
+	}
+    }
+
     _summaryDirty = false;
+    _mtimesDirty  = false;
+}
+
+
+void DirInfo::recalcMtimes()
+{
+    // Only the mtime part of recalc(): The other summary fields are up to
+    // date, so this does not go any deeper than the direct children.
+
+    _latestMtime     = _mtime;
+    _oldestFileMtime = 0;
+
+    FileInfoIterator it( this );
+
+    while ( *it )
+    {
+	time_t childLatestMtime = (*it)->latestMtime();
+
+	if ( childLatestMtime > _latestMtime )
+	    _latestMtime = childLatestMtime;
+
+	time_t childOldestFileMTime = (*it)->oldestFileMtime();
+
+	if ( childOldestFileMTime > 0 )
+	{
+	    if ( _oldestFileMtime == 0 ||
+		 childOldestFileMTime < _oldestFileMtime )
+	    {
+		_oldestFileMtime = childOldestFileMTime;
+	    }
+	}
+
+	++it;
+    }
+
+    QList<ChildrenSummary> extras;
+
+    if ( _hasFileSummary && _tree )
+	extras << _tree->fileSummary( this ).files;
+
+    if ( _hasSpilledFiles && _tree )
+	extras << _tree->spillStore()->summary( this );
+
+    foreach ( const ChildrenSummary & extra, extras )
+    {
+	if ( extra.latestMtime > _latestMtime )
+	    _latestMtime = extra.latestMtime;
+
+	if ( extra.oldestFileMtime > 0 &&
+	     ( _oldestFileMtime == 0 || extra.oldestFileMtime < _oldestFileMtime ) )
+	{
+	    _oldestFileMtime = extra.oldestFileMtime;
+	}
+    }
+
+    _mtimesDirty = false;
 }
 
 
@@ -351,7 +777,7 @@ FileSize DirInfo::totalBlocks()
 }
 
 
-int DirInfo::totalItems()
+FileCount DirInfo::totalItems()
 {
     if ( _summaryDirty )
 	recalc();
@@ -360,7 +786,7 @@ int DirInfo::totalItems()
 }
 
 
-int DirInfo::totalSubDirs()
+FileCount DirInfo::totalSubDirs()
 {
     if ( _summaryDirty )
 	recalc();
@@ -369,7 +795,7 @@ int DirInfo::totalSubDirs()
 }
 
 
-int DirInfo::totalFiles()
+FileCount DirInfo::totalFiles()
 {
     if ( _summaryDirty )
 	recalc();
@@ -378,7 +804,7 @@ int DirInfo::totalFiles()
 }
 
 
-int DirInfo::totalNonDirItems()
+FileCount DirInfo::totalNonDirItems()
 {
     if ( _summaryDirty )
 	recalc();
@@ -387,7 +813,7 @@ int DirInfo::totalNonDirItems()
 }
 
 
-int DirInfo::totalIgnoredItems()
+FileCount DirInfo::totalIgnoredItems()
 {
     if ( _summaryDirty )
 	recalc();
@@ -396,7 +822,7 @@ int DirInfo::totalIgnoredItems()
 }
 
 
-int DirInfo::totalUnignoredItems()
+FileCount DirInfo::totalUnignoredItems()
 {
     if ( _summaryDirty )
 	recalc();
@@ -409,6 +835,8 @@ time_t DirInfo::latestMtime()
 {
     if ( _summaryDirty )
 	recalc();
+    else if ( _mtimesDirty )
+	recalcMtimes();
 
     return _latestMtime;
 }
@@ -418,6 +846,8 @@ time_t DirInfo::oldestFileMtime()
 {
     if ( _summaryDirty )
 	recalc();
+    else if ( _mtimesDirty )
+	recalcMtimes();
 
     return _oldestFileMtime;
 }
@@ -462,11 +892,14 @@ int DirInfo::countDirectChildren()
     if ( _dotEntry )
 	++_directChildrenCount;
 
+    if ( _hasSpilledFiles && _tree )
+	_directChildrenCount += _tree->spillStore()->summary( this ).items;
+
     return _directChildrenCount;
 }
 
 
-int DirInfo::errSubDirCount()
+FileCount DirInfo::errSubDirCount()
 {
     if ( _summaryDirty )
 	recalc();
@@ -488,7 +921,18 @@ void DirInfo::setReadState( DirReadState newReadState )
     if ( _readState == DirAborted && newReadState == DirFinished )
 	return;
 
+    bool wasError = readError();
     _readState = newReadState;
+
+    // Keep the tree's index of unreadable directories up to date
+
+    if ( _tree && readError() != wasError )
+    {
+	if ( wasError )
+	    _tree->dropReadError( this );
+	else
+	    _tree->setReadError( this );
+    }
 }
 
 
@@ -509,6 +953,9 @@ void DirInfo::insertChild( FileInfo * newChild )
 {
     CHECK_PTR( newChild );
 
+    if ( ! newChild->isDir() && ! _dotEntry && _wantDotEntry )
+	ensureDotEntry();
+
     if ( newChild->isDir() || ! _dotEntry )
     {
 	/**
@@ -529,6 +976,10 @@ void DirInfo::insertChild( FileInfo * newChild )
 	newChild->setNext( _firstChild );
 	_firstChild = newChild;
 	newChild->setParent( this );	// make sure the parent pointer is correct
+	addToChildIndex( newChild );
+
+	if ( newChild->isDirInfo() && _tree )
+	    _tree->invalidateSubtreeNumbers();
 
 	childAdded( newChild );		// update summaries
     }
@@ -543,74 +994,241 @@ void DirInfo::insertChild( FileInfo * newChild )
 }
 
 
-void DirInfo::moveToAttic( FileInfo * child )
+void DirInfo::insertChildren( const FileInfoList & newChildren )
 {
-    unlinkChild( child );
-    addToAttic( child );
-}
+    FileInfoList    dotEntryChildren;
+    ChildrenSummary summary;
 
+    foreach ( FileInfo * newChild, newChildren )
+    {
+	CHECK_PTR( newChild );
 
-void DirInfo::addToAttic( FileInfo * newChild )
-{
-    CHECK_PTR( newChild );
+	if ( newChild->isIgnored() )
+	{
+	    // Ignored children need special treatment for the totals, and
+	    // they are rare enough not to bother: Use the normal path.
 
-    Attic * attic = 0;
+	    insertChild( newChild );
+	}
+	else if ( newChild->isDir() || ! ( _dotEntry || _wantDotEntry ) )
+	{
+	    // Same as in insertChild(): No particular order, just insert at
+	    // the list head in constant time.
 
-    if ( ! newChild->isDir() && _dotEntry )
-	attic = _dotEntry->ensureAttic();
+	    newChild->setNext( _firstChild );
+	    _firstChild = newChild;
+	    newChild->setParent( this );	// make sure the parent pointer is correct
+	    addToChildIndex( newChild );
 
-    if ( ! attic )
-	attic = ensureAttic();
+	    if ( newChild->isDirInfo() && _tree )
+		_tree->invalidateSubtreeNumbers();
 
-    newChild->setIgnored( true );
+	    summary.add( newChild );
+	}
+	else
+	{
+	    dotEntryChildren << newChild;
+	}
+    }
 
-    if ( newChild->isDir() )
-	_totalIgnoredItems += newChild->totalIgnoredItems();
-    else
-	_totalIgnoredItems++;
+    if ( summary.items > 0 )
+	childrenAdded( summary, summary.items );	// update summaries
 
-    CHECK_PTR( attic );
-    attic->insertChild( newChild );
+    if ( ! dotEntryChildren.isEmpty() )
+	ensureDotEntry()->insertChildren( dotEntryChildren );
 }
 
 
-void DirInfo::childAdded( FileInfo * newChild )
+void DirInfo::moveToAttic( FileInfo * child )
 {
-    bool addToTotal = true;
+    unlinkChild( child );
+    addToAttic( child );
 
-    if ( newChild->isIgnored() )
-    {
-	if ( newChild->isDir() )
-	    _totalIgnoredItems += newChild->totalIgnoredItems();
-	else
-	    _totalIgnoredItems++;
+    // The totals of ignored items in the attic are different
 
-	// Add ignored items only to all the totals if this directory is also
-	// ignored or if this is the attic.
+    _summaryDirty = true;
+}
 
-	if ( ! _isIgnored &&  ! isAttic() )
-	    addToTotal = false;
-    }
-    else
-    {
-	if ( ! newChild->isDir() )
-	    _totalUnignoredItems++;
-    }
 
-    if ( addToTotal )
+void DirInfo::moveIgnoredToAttic( FileInfoList * movedDirs )
+{
+    FileInfo * dirChain	     = 0;	// For the attic of this directory
+    FileInfo * dotEntryChain = 0;	// For the attic of the dot entry
+    FileInfo * prev	     = 0;
+    FileInfo * child	     = _firstChild;
+
+    while ( child )
     {
-	if ( ! _summaryDirty )
+	FileInfo * next = child->next();
+
+	if ( child->isIgnored() )
 	{
-	    _totalSize		+= newChild->size();
-	    _totalAllocatedSize += newChild->allocatedSize();
-	    _totalBlocks	+= newChild->blocks();
-	    _totalItems++;
+	    if ( prev )
+		prev->setNext( next );
+	    else
+		_firstChild = next;
 
-	    if ( newChild->parent() == this )
-		_directChildrenCount++;
+	    if ( ! child->isDir() && ( _dotEntry || _wantDotEntry ) )
+	    {
+		child->setNext( dotEntryChain );
+		dotEntryChain = child;
+	    }
+	    else
+	    {
+		child->setNext( dirChain );
+		dirChain = child;
+	    }
 
-	    if ( newChild->isDir() )
-		_totalSubDirs++;
+	    if ( movedDirs && child->isDirInfo() )
+		*movedDirs << child;
+	}
+	else
+	{
+	    prev = child;
+	}
+
+	child = next;
+    }
+
+    if ( ! dirChain && ! dotEntryChain )
+	return;
+
+    spliceIntoAttic( this, dirChain );
+
+    if ( dotEntryChain )
+	spliceIntoAttic( ensureDotEntry(), dotEntryChain );
+
+    dropChildIndex();
+    dropSortCache();
+    dropStatsCache();
+
+    if ( _dotEntry )
+    {
+	if ( _dotEntry->attic() )
+	    _dotEntry->attic()->recalc();
+
+	_dotEntry->recalc();
+    }
+
+    if ( _attic )
+	_attic->recalc();
+
+    recalc();
+}
+
+
+void DirInfo::spliceIntoAttic( DirInfo * dir, FileInfo * chain )
+{
+    if ( ! chain )
+	return;
+
+    Attic *    attic = dir->ensureAttic();
+    FileInfo * last  = chain;
+
+    for ( FileInfo * child = chain; child; child = child->next() )
+    {
+	child->setParent( attic );
+	last = child;
+    }
+
+    last->setNext( attic->firstChild() );
+    attic->setFirstChild( chain );
+    attic->dropSortCache();
+}
+
+
+void DirInfo::takeAtticChildren()
+{
+    if ( ! _attic )
+	return;
+
+    FileInfo * chain = _attic->firstChild();
+
+    if ( chain )
+    {
+	FileInfo * last = chain;
+
+	for ( FileInfo * child = chain; child; child = child->next() )
+	{
+	    child->setParent( this );
+	    last = child;
+	}
+
+	last->setNext( _firstChild );
+	_firstChild = chain;
+	_attic->setFirstChild( 0 );
+
+	dropChildIndex();
+	dropSortCache();
+	dropStatsCache();
+    }
+
+    deleteEmptyAttic();
+    recalc();
+}
+
+
+void DirInfo::addToAttic( FileInfo * newChild )
+{
+    CHECK_PTR( newChild );
+
+    Attic * attic = 0;
+
+    if ( ! newChild->isDir() && ( _dotEntry || _wantDotEntry ) )
+	attic = ensureDotEntry()->ensureAttic();
+
+    if ( ! attic )
+	attic = ensureAttic();
+
+    newChild->setIgnored( true );
+
+    if ( newChild->isDir() )
+	_totalIgnoredItems += newChild->totalIgnoredItems();
+    else
+	_totalIgnoredItems++;
+
+    CHECK_PTR( attic );
+    attic->insertChild( newChild );
+}
+
+
+void DirInfo::childAdded( FileInfo * newChild )
+{
+    bool addToTotal = true;
+
+    if ( newChild->isIgnored() )
+    {
+	if ( newChild->isDir() )
+	    _totalIgnoredItems += newChild->totalIgnoredItems();
+	else
+	    _totalIgnoredItems++;
+
+	// Add ignored items only to all the totals if this directory is also
+	// ignored or if this is the attic.
+
+	if ( ! _isIgnored &&  ! isAttic() )
+	    addToTotal = false;
+    }
+    else
+    {
+	if ( ! newChild->isDir() )
+	    _totalUnignoredItems++;
+    }
+
+    if ( addToTotal )
+    {
+	if ( ! _summaryDirty )
+	{
+	    _totalSize		+= newChild->size();
+	    _totalAllocatedSize += newChild->allocatedSize();
+	    _totalBlocks	+= newChild->blocks();
+	    _totalItems++;
+
+	    if ( newChild->parent() == this )
+		_directChildrenCount++;
+
+	    if ( newChild->isDir() )
+		_totalSubDirs++;
 
 	    if ( newChild->isFile() )
 		_totalFiles++;
@@ -645,28 +1263,131 @@ void DirInfo::childAdded( FileInfo * newChild )
 
     if ( _lastSortCol != ReadJobsCol )
 	dropSortCache();
+    else
+	dropSortPermutations();
+
+    dropStatsCache();
 
     if ( _parent )
 	_parent->childAdded( newChild );
 }
 
 
+void DirInfo::childrenAdded( const ChildrenSummary & summary, int directChildren )
+{
+    // This is the batch version of childAdded() for children that are not
+    // ignored; see there.
+
+    _totalUnignoredItems += summary.unignoredItems;
+
+    if ( ! _summaryDirty )
+    {
+	_totalSize	     += summary.size;
+	_totalAllocatedSize  += summary.allocatedSize;
+	_totalBlocks	     += summary.blocks;
+	_totalItems	     += summary.items;
+	_totalSubDirs	     += summary.subDirs;
+	_totalFiles	     += summary.files;
+	_directChildrenCount += directChildren;
+
+	if ( summary.latestMtime > _latestMtime )
+	    _latestMtime = summary.latestMtime;
+
+	if ( summary.oldestFileMtime > 0 )
+	{
+	    if ( _oldestFileMtime == 0 ||
+		 summary.oldestFileMtime < _oldestFileMtime )
+	    {
+		_oldestFileMtime = summary.oldestFileMtime;
+	    }
+	}
+    }
+
+    if ( _lastSortCol != ReadJobsCol )
+	dropSortCache();
+    else
+	dropSortPermutations();
+
+    dropStatsCache();
+
+    if ( _parent )
+	_parent->childrenAdded( summary );
+}
+
+
+void DirInfo::childrenRemoved( const ChildrenSummary & summary, int directChildren )
+{
+    // If the summary is dirty anyway, there is nothing to subtract from,
+    // but the ancestors might still be valid.
+
+    if ( ! _summaryDirty )
+    {
+	_totalSize	     -= summary.size;
+	_totalAllocatedSize  -= summary.allocatedSize;
+	_totalBlocks	     -= summary.blocks;
+	_totalItems	     -= summary.items;
+	_totalSubDirs	     -= summary.subDirs;
+	_totalFiles	     -= summary.files;
+	_totalUnignoredItems -= summary.unignoredItems;
+	_totalIgnoredItems   -= summary.ignoredItems;
+	_errSubDirCount	     -= summary.errSubDirs;
+	_directChildrenCount -= directChildren;
+
+	// There is no way to find the second latest or oldest mtime without
+	// looking at all the other children again.
+
+	if ( summary.latestMtime > 0 && summary.latestMtime >= _latestMtime )
+	    _mtimesDirty = true;
+
+	if ( summary.oldestFileMtime > 0 && summary.oldestFileMtime <= _oldestFileMtime )
+	    _mtimesDirty = true;
+    }
+
+    if ( _lastSortCol != ReadJobsCol )
+	dropSortCache();
+    else
+	dropSortPermutations();
+
+    dropStatsCache();
+
+    if ( ! _parent )
+	return;
+
+    if ( isAttic() )
+    {
+	// The parent of the attic only counts the ignored items and the
+	// subdirectories with read errors in the attic; see recalc().
+
+	ChildrenSummary ignored;
+	ignored.ignoredItems = summary.ignoredItems;
+	ignored.errSubDirs   = summary.errSubDirs;
+
+	_parent->childrenRemoved( ignored );
+    }
+    else
+    {
+	_parent->childrenRemoved( summary );
+    }
+}
+
+
 void DirInfo::deletingChild( FileInfo * child )
 {
     /**
-     * When children are deleted, things go downhill: Marking the summary
-     * fields as dirty (i.e. outdated) is the only thing that can be done here.
-     *
-     * The accumulated sizes could be updated (by subtracting this deleted
-     * child's values from them), but the latest mtime definitely has to be
-     * recalculated: The child now being deleted might just be the one with the
-     * latest mtime, and figuring out the second-latest cannot easily be
-     * done. So we merely mark the summary as dirty and wait until a recalc()
-     * will be triggered from outside - which might as well never happen if
-     * nobody wants to know some summary field anyway.
+     * The direct parent subtracts the deleted child's subtree from its sums
+     * and from those of all its ancestors (see childrenRemoved()), so they
+     * stay valid without a recalc() of the whole subtree. The ancestors only
+     * get this notification to drop their caches.
      **/
 
-    _summaryDirty = true;
+    if ( child->parent() == this && ! _deletingAll )
+    {
+	ChildrenSummary removed;
+	removed.addSubtree( child );
+	childrenRemoved( removed, 1 );
+    }
+
+    dropStatsCache();
 
     if ( _parent )
 	_parent->deletingChild( child );
@@ -702,7 +1423,15 @@ void DirInfo::unlinkChild( FileInfo * deletedChild )
     }
 
     dropSortCache();
-    _summaryDirty = true;
+
+    if ( _hasChildIndex && _tree )
+    {
+	QHash<QString, FileInfo *> & index = _tree->childIndex( this );
+	QHash<QString, FileInfo *>::iterator it = index.find( deletedChild->name() );
+
+	if ( it != index.end() && it.value() == deletedChild )
+	    index.erase( it );
+    }
 
     if ( deletedChild == _firstChild )
     {
@@ -821,119 +1550,402 @@ QString DirInfo::sizePrefix() const
 }
 
 
-void DirInfo::finalizeLocal()
+FileSize DirInfo::sizeEstimate()
 {
-    // logDebug() << this << endl;
+    if ( ! _hasSizeEstimate || ! _tree )
+	return -1;
 
-    cleanupDotEntries();
-    cleanupAttics();
-    checkIgnored();
+    if ( _readState != DirOnRequestOnly && ! isBusy() )
+	return -1;	// The real sums are complete now
+
+    return _tree->sizeEstimate( this );
 }
 
 
-void DirInfo::finalizeAll()
+void DirInfo::setSizeEstimate( FileSize estimate )
 {
-    FileInfo * child = firstChild();
+    if ( _tree )
+	_tree->setSizeEstimate( this, estimate );
 
-    while ( child )
-    {
-	if ( child->isDirInfo() && ! child->isDotEntry() )
-	{
-	    child->toDirInfo()->finalizeAll();
-	}
+    _hasSizeEstimate = _tree && estimate >= 0;
+}
 
-	child = child->next();
-    }
 
-    // Optimization: As long as this directory is not finalized yet, it does
-    // (very likely) have a dot entry and thus all direct children are
-    // subdirectories, not plain files, so we don't need to bother checking
-    // plain file children as well - so do finalizeLocal() only after all
-    // children are processed. If this step were the first, for directories
-    // that don't have any subdirectories finalizeLocal() would immediately
-    // get all their plain file children reparented to themselves, so they
-    // would need to be processed in the loop, too.
+void DirInfo::setSample( const DirSample & sample )
+{
+    dropSample();
 
-    finalizeLocal();
+    if ( ! _tree )
+	return;
+
+    _tree->setSample( this, &sample );
+    _isSampled = true;
+    childrenAdded( sample.extra );	// Add to the sums here and upwards
 }
 
 
-void DirInfo::cleanupDotEntries()
+void DirInfo::dropSample()
 {
-    if ( ! _dotEntry )
+    if ( ! _isSampled )
 	return;
 
-    // Reparent dot entry children if there are no subdirectories on this level
+    ChildrenSummary extra;
 
-    if ( ! _firstChild && ! hasAtticChildren() )
+    if ( _tree )
     {
-	takeAllChildren( _dotEntry );
-
-	// Reparent the dot entry's attic's children to this item's attic
-
-	if ( _dotEntry->hasAtticChildren() )
-	{
-	    ensureAttic();
-	    _attic->takeAllChildren( _dotEntry->attic() );
-	}
+	extra = _tree->sample( this ).extra;
+	_tree->setSample( this, 0 );
     }
 
-    // Delete the dot entry if it is now empty.
-    //
-    // This also affects dot entries that were just disowned because they had
-    // no siblings (i.e., there are no subdirectories on this level).
-    //
-    // Notice that this also checks if the dot entry's attic (if it has one) is
-    // empty, and that its attic is deleted along with the dot entry.
+    _isSampled = false;
+    childrenRemoved( extra );	// Subtract from the sums here and upwards
+}
 
-    deleteEmptyDotEntry();
+
+FileSize DirInfo::sampleError()
+{
+    return _tree ? _tree->sampleError( this ) : -1;
 }
 
 
-void DirInfo::cleanupAttics()
+FileInfo * DirInfo::findDirectChild( const QString & name )
 {
-    if ( _dotEntry )
-	_dotEntry->cleanupAttics();
+    if ( _hasChildIndex && _tree )
+	return _tree->childIndex( this ).value( name );
 
-    if ( _attic )
+    int count = 0;
+
+    for ( FileInfo * child = _firstChild; child; child = child->next() )
     {
-	_attic->finalizeLocal();
+	if ( child->name() == name )
+	    return child;
 
-	if ( ! _attic->firstChild() && ! _attic->dotEntry() )
-	{
-	    delete _attic;
-	    _attic = 0;
+	++count;
+    }
 
-	    if ( _lastIncludeAttic )
-		dropSortCache();
+    if ( count > CHILD_INDEX_THRESHOLD && _tree )
+    {
+	// There will probably be more lookups here; make them cheap.
 
-	    _summaryDirty = true;
-	}
+	QHash<QString, FileInfo *> & index = _tree->childIndex( this );
+	index.reserve( count );
+
+	for ( FileInfo * child = _firstChild; child; child = child->next() )
+	    index.insert( child->name(), child );
+
+	_hasChildIndex = true;
     }
+
+    return 0;
 }
 
 
-void DirInfo::checkIgnored()
+FileInfo * DirInfo::locateChild( const QString & name, bool findPseudoDirs )
 {
-    if ( _dotEntry )
-	_dotEntry->checkIgnored();
+    if ( findPseudoDirs )
+    {
+	if ( _dotEntry && name == dotEntryName() )
+	    return _dotEntry;
 
-    // Cascade the 'ignored' status up the tree:
-    //
-    // Display all directories as ignored that have any ignored items, but no
-    // items that are not ignored.
+	if ( _attic && name == atticName() )
+	    return _attic;
+    }
 
-    _isIgnored = ( totalIgnoredItems() > 0 && totalUnignoredItems() == 0 );
+    FileInfo * child = findDirectChild( name );
 
-    if ( _isIgnored )
-	ignoreEmptySubDirs();
+    if ( ! child && _dotEntry )
+	child = _dotEntry->findDirectChild( name );
 
-    if ( ! isPseudoDir() && _parent )
-	_parent->checkIgnored();
+    if ( ! child && _attic )
+	child = _attic->findDirectChild( name );
+
+    if ( ! child && _dotEntry && _dotEntry->attic() )
+	child = _dotEntry->attic()->findDirectChild( name );
+
+    return child;
 }
 
 
-void DirInfo::ignoreEmptySubDirs()
+void DirInfo::addToChildIndex( FileInfo * child )
+{
+    if ( _hasChildIndex && _tree )
+	_tree->childIndex( this ).insert( child->name(), child );
+}
+
+
+void DirInfo::dropChildIndex()
+{
+    if ( ! _hasChildIndex )
+	return;
+
+    if ( _tree )
+	_tree->dropChildIndex( this );
+
+    _hasChildIndex = false;
+}
+
+
+DirFileSummary DirInfo::fileSummary() const
+{
+    return _hasFileSummary && _tree ? _tree->fileSummary( this ) : DirFileSummary();
+}
+
+
+void DirInfo::setFileSummary( const DirFileSummary & summary )
+{
+    dropFileSummary();
+
+    if ( ! _tree )
+	return;
+
+    _tree->setFileSummary( this, &summary );
+    _hasFileSummary = true;
+    childrenAdded( summary.files );	// Add to the sums here and upwards
+}
+
+
+void DirInfo::dropFileSummary()
+{
+    if ( ! _hasFileSummary )
+	return;
+
+    ChildrenSummary files;
+
+    if ( _tree )
+    {
+	files = _tree->fileSummary( this ).files;
+	_tree->setFileSummary( this, 0 );
+    }
+
+    _hasFileSummary = false;
+    childrenRemoved( files );	// Subtract from the sums here and upwards
+}
+
+
+bool DirInfo::hasFoldedFiles() const
+{
+    // In directories-only mode, the file summary is all there is to know
+    // about the files.
+
+    return _hasFileSummary && ! _filesUnfolded && _tree &&
+	_tree->foldFilesBelow() > 0 && ! _tree->dirsOnly();
+}
+
+
+void DirInfo::spillFiles()
+{
+    if ( _dotEntry )
+	_dotEntry->spillFiles();
+
+    if ( ! _tree || ! _tree->outOfCore() || _hasSpilledFiles )
+	return;
+
+    FileInfoList spilled;
+
+    for ( FileInfo * child = _firstChild; child; child = child->next() )
+    {
+	if ( ! child->isDirInfo() && child->links() <= 1 )
+	    spilled << child;
+    }
+
+    if ( spilled.isEmpty() || ! _tree->spillStore()->store( this, spilled ) )
+	return;
+
+    // Unlink the spilled children in one pass; they stay in the sums, so
+    // don't touch _directChildrenCount and the totals.
+
+    FileInfo * lastKept = 0;
+    FileInfo * child	= _firstChild;
+
+    while ( child )
+    {
+	FileInfo * next = child->next();
+
+	if ( ! child->isDirInfo() && child->links() <= 1 )
+	{
+	    if ( lastKept )
+		lastKept->setNext( next );
+	    else
+		_firstChild = next;
+
+	    delete child;
+	}
+	else
+	{
+	    lastKept = child;
+	}
+
+	child = next;
+    }
+
+    _hasSpilledFiles = true;
+    dropChildIndex();
+    dropSortCache();
+    dropStatsCache();
+}
+
+
+bool DirInfo::pageInFiles()
+{
+    if ( ! _hasSpilledFiles )
+	return false;
+
+    // Stop anything that walks this directory in another thread
+    _tree->pagingInFilesNotify( this );
+
+    FileInfoList files;
+    bool ok = _tree->spillStore()->load( this, files );
+
+    _tree->spillStore()->remove( this );
+    _hasSpilledFiles = false;
+
+    if ( ! ok )
+    {
+	// Better lose the files than keep inconsistent sums forever
+
+	qDeleteAll( files );
+
+	for ( DirInfo * dir = this; dir; dir = dir->parent() )
+	    dir->_summaryDirty = true;
+
+	return false;
+    }
+
+    // The sums already include these files, so just link them in
+
+    foreach ( FileInfo * file, files )
+    {
+	file->setNext( _firstChild );
+	_firstChild = file;
+	addToChildIndex( file );
+    }
+
+    dropSortCache();
+    dropStatsCache();
+    _tree->filesPagedInNotify( this );
+
+    return true;
+}
+
+
+void DirInfo::finalizeLocal()
+{
+    // logDebug() << this << endl;
+
+    cleanupDotEntries();
+    cleanupAttics();
+    checkIgnored();
+}
+
+
+void DirInfo::finalizeAll()
+{
+    FileInfo * child = firstChild();
+
+    while ( child )
+    {
+	if ( child->isDirInfo() && ! child->isDotEntry() )
+	{
+	    child->toDirInfo()->finalizeAll();
+	}
+
+	child = child->next();
+    }
+
+    // Optimization: As long as this directory is not finalized yet, it does
+    // (very likely) have a dot entry and thus all direct children are
+    // subdirectories, not plain files, so we don't need to bother checking
+    // plain file children as well - so do finalizeLocal() only after all
+    // children are processed. If this step were the first, for directories
+    // that don't have any subdirectories finalizeLocal() would immediately
+    // get all their plain file children reparented to themselves, so they
+    // would need to be processed in the loop, too.
+
+    finalizeLocal();
+}
+
+
+void DirInfo::cleanupDotEntries()
+{
+    // From now on, new files go directly to this directory if there is no
+    // dot entry anymore, just like after reparenting them below.
+
+    _wantDotEntry = false;
+
+    if ( ! _dotEntry )
+	return;
+
+    // Reparent dot entry children if there are no subdirectories on this level
+
+    if ( ! _firstChild && ! hasAtticChildren() )
+    {
+	takeAllChildren( _dotEntry );
+
+	// Reparent the dot entry's attic's children to this item's attic
+
+	if ( _dotEntry->hasAtticChildren() )
+	{
+	    ensureAttic();
+	    _attic->takeAllChildren( _dotEntry->attic() );
+	}
+    }
+
+    // Delete the dot entry if it is now empty.
+    //
+    // This also affects dot entries that were just disowned because they had
+    // no siblings (i.e., there are no subdirectories on this level).
+    //
+    // Notice that this also checks if the dot entry's attic (if it has one) is
+    // empty, and that its attic is deleted along with the dot entry.
+
+    deleteEmptyDotEntry();
+}
+
+
+void DirInfo::cleanupAttics()
+{
+    if ( _dotEntry )
+	_dotEntry->cleanupAttics();
+
+    if ( _attic )
+    {
+	_attic->finalizeLocal();
+
+	if ( ! _attic->firstChild() && ! _attic->dotEntry() )
+	{
+	    delete _attic;
+	    _attic = 0;
+
+	    if ( _lastIncludeAttic )
+		dropSortCache();
+
+	    _summaryDirty = true;
+	}
+    }
+}
+
+
+void DirInfo::checkIgnored()
+{
+    if ( _dotEntry )
+	_dotEntry->checkIgnored();
+
+    // Cascade the 'ignored' status up the tree:
+    //
+    // Display all directories as ignored that have any ignored items, but no
+    // items that are not ignored.
+
+    _isIgnored = ( totalIgnoredItems() > 0 && totalUnignoredItems() == 0 );
+
+    if ( _isIgnored )
+	ignoreEmptySubDirs();
+
+    if ( ! isPseudoDir() && _parent )
+	_parent->checkIgnored();
+}
+
+
+void DirInfo::ignoreEmptySubDirs()
 {
     FileInfoIterator it( this );
 
@@ -982,88 +1994,550 @@ void DirInfo::clearTouched( bool recursive )
 }
 
 
+void DirInfo::clearExposed( bool recursive )
+{
+    if ( ! _exposed )
+	return;
+
+    _exposed = false;
+
+    // Only children of exposed directories can be exposed themselves:
+    // The view cannot ask for them without knowing their parent's children.
+
+    if ( recursive )
+    {
+	if ( ! isDotEntry() )
+	{
+	    FileInfo * child = _firstChild;
+
+	    while ( child )
+	    {
+		if ( child->isDirInfo() )
+		    child->toDirInfo()->clearExposed( recursive );
+
+		child = child->next();
+	    }
+
+	    if ( _dotEntry )
+		_dotEntry->clearExposed( recursive );
+	}
+
+	if ( _attic )
+	    _attic->clearExposed( recursive );
+    }
+}
+
+
 const FileInfoList & DirInfo::sortedChildren( DataColumn    sortCol,
 					      Qt::SortOrder sortOrder,
-					      bool	    includeAttic )
+					      bool	    includeAttic,
+					      int	    sortedCount )
 {
-    if ( _sortedChildren &&
-	 sortCol      == _lastSortCol	   &&
-	 sortOrder    == _lastSortOrder	   &&
-	 includeAttic == _lastIncludeAttic    )
+    bool sameOrder = _sortedChildren &&
+	sortCol	     == _lastSortCol	  &&
+	sortOrder    == _lastSortOrder	  &&
+	includeAttic == _lastIncludeAttic;
+
+    if ( sameOrder )
     {
-	return *_sortedChildren;
+	// Only the first rows of a huge directory might be sorted so far;
+	// they know their row, the others don't.
+
+	int needed = sortedCount < 0 ?
+	    _sortedChildren->size() : qMin( sortedCount, _sortedChildren->size() );
+
+	if ( needed == 0 || _sortedChildren->at( needed - 1 )->sortedRow() == needed - 1 )
+	    return *_sortedChildren;
     }
 
+    TRACE_SPAN( "DirInfo::sortedChildren" );
+
 
-    // Clean old sorted children list and create a new one
+    // Clean old sorted children list and create a new one. The cached sort
+    // orders remain valid: The children did not change. If only more rows
+    // need to be sorted, the sort orders of the subtree remain valid, too.
+
+    dropSortedChildren( ! sameOrder,	// recursive
+			true );		// keepPermutations
+
+
+    // Sort
+
+    FileInfoList children = unsortedChildren();
+    const DirSortPermutation & permutation = sortPermutation( children, sortCol, sortOrder, sortedCount );
+    const QVector<quint32> & rows = permutation.rows;
 
-    dropSortCache( true ); // recursive
     _sortedChildren = new FileInfoList();
     CHECK_NEW( _sortedChildren );
+    _sortedChildren->reserve( rows.size() + 1 );
+
+    foreach ( quint32 row, rows )
+	_sortedChildren->append( children.at( row ) );
+
+    if ( includeAttic && _attic )
+	_sortedChildren->append( _attic );
+
+    _lastSortCol      = sortCol;
+    _lastSortOrder    = sortOrder;
+    _lastIncludeAttic = includeAttic;
+
+    // Let each child know its row so finding it is O(1). The attic is
+    // behind all children, so it is only in its final row if all of them
+    // are sorted.
+
+    int sorted = permutation.sortedCount;
 
+    if ( sorted == rows.size() )
+	sorted = _sortedChildren->size();
 
-    // Populate with unsorted children list
+    for ( int row = 0; row < _sortedChildren->size(); ++row )
+	_sortedChildren->at( row )->setSortedRow( row < sorted ? row : -1 );
 
+
+#if DIRECT_CHILDREN_COUNT_SANITY_CHECK
+
+    if ( _sortedChildren->size() != _directChildrenCount )
+    {
+	Debug::dumpChildrenList( this, *_sortedChildren );
+
+	THROW( Exception( QString( "_directChildrenCount of %1 corrupted; is %2, should be %3" )
+			  .arg( debugUrl() )
+			  .arg( _directChildrenCount )
+			  .arg( _sortedChildren->size() ) ) );
+    }
+#endif
+
+    return *_sortedChildren;
+}
+
+
+FileInfoList DirInfo::unsortedChildren() const
+{
+    FileInfoList children;
+    children.reserve( _directChildrenCount );
     FileInfo * child = _firstChild;
 
     while ( child )
     {
-	_sortedChildren->append( child );
+	children.append( child );
 	child = child->next();
     }
 
     if ( _dotEntry )
-	_sortedChildren->append( _dotEntry );
+	children.append( _dotEntry );
+
+    return children;
+}
 
 
-    // Sort
+DirSortPermutation * DirInfo::findSortPermutation( int	   size,
+						   DataColumn	   sortCol,
+						   Qt::SortOrder   sortOrder )
+{
+    if ( ! _sortCache )
+	return 0;
+
+    QList<DirSortPermutation> & permutations = _sortCache->permutations;
+
+    for ( int i = 0; i < permutations.size(); ++i )
+    {
+	if ( permutations.at( i ).sortCol   == sortCol &&
+	     permutations.at( i ).sortOrder == sortOrder )
+	{
+	    if ( permutations.at( i ).rows.size() != size )
+	    {
+		// Someone forgot to drop the sort cache after changing the
+		// children. Don't trust any of the cached sort orders.
+
+		logWarning() << "Stale sort cache for " << this << endl;
+		permutations.clear();
+
+		return 0;
+	    }
+
+	    // logDebug() << "Reusing sort order of " << this << " by " << sortCol << endl;
+	    permutations.move( i, 0 );
+
+	    return &permutations.first();
+	}
+    }
+
+    return 0;
+}
+
+
+const DirSortPermutation & DirInfo::addSortPermutation( DataColumn		 sortCol,
+							Qt::SortOrder		 sortOrder,
+							const QVector<quint32> & rows,
+							int			 sortedCount )
+{
+    if ( ! _sortCache )
+    {
+	_sortCache = new DirSortCache();
+	CHECK_NEW( _sortCache );
+    }
+
+    QList<DirSortPermutation> & permutations = _sortCache->permutations;
+
+    DirSortPermutation permutation;
+    permutation.sortCol	    = sortCol;
+    permutation.sortOrder   = sortOrder;
+    permutation.rows	    = rows;
+    permutation.sortedCount = sortedCount;
+
+    permutations.prepend( permutation );
+
+    while ( permutations.size() > MAX_SORT_PERMUTATIONS )
+	permutations.removeLast();
+
+    return permutations.first();
+}
+
+
+const DirSortPermutation & DirInfo::sortPermutation( const FileInfoList & children,
+						      DataColumn	   sortCol,
+						      Qt::SortOrder	   sortOrder,
+						      int		   sortedCount )
+{
+    int size = children.size();
+
+    if ( sortedCount < 0 || sortedCount > size )
+	sortedCount = size;
+
+    DirSortPermutation * cached = findSortPermutation( size, sortCol, sortOrder );
+
+    if ( cached && cached->sortedCount >= sortedCount )
+	return *cached;
+
+    if ( size >= PARTIAL_SORT_MIN_SIZE && sortedCount <= size / PARTIAL_SORT_MAX_SHARE )
+    {
+	// Sort only as many rows as needed. The rows that are sorted already
+	// all come before the others, so only the others need to be sorted.
+
+	if ( cached )
+	{
+	    // logDebug() << "Sorting " << sortedCount << " children of " << this << endl;
+
+	    FileInfoSorter::partialSortRows( children, sortCol, sortOrder, cached->rows,
+					     cached->sortedCount, sortedCount );
+	    cached->sortedCount = sortedCount;
+
+	    return *cached;
+	}
+
+	QVector<quint32> rows( size );
+
+	for ( int i = 0; i < size; ++i )
+	    rows[ i ] = i;
+
+	FileInfoSorter::partialSortRows( children, sortCol, sortOrder, rows, 0, sortedCount );
+
+	return addSortPermutation( sortCol, sortOrder, rows, sortedCount );
+    }
 
     // logDebug() << "Sorting children of " << this << " by " << sortCol << endl;
 
+    // This replaces a partially sorted permutation with the same order: The
+    // partial sort breaks ties the same way as the two stable sorts here.
+
+    QVector<quint32> rows( size );
+
+    for ( int i = 0; i < size; ++i )
+	rows[ i ] = i;
+
+    // The sort keys are fetched in this thread before sorting, so the sums
+    // of dirty subdirectories are not updated by the parallel sort threads.
+
     if ( sortCol != NameCol )
     {
 	// Do secondary sorting by NameCol (always in ascending order)
 
-	std::stable_sort( _sortedChildren->begin(),
-			  _sortedChildren->end(),
-			  FileInfoSorter( NameCol, Qt::AscendingOrder ) );
+	FileInfoSorter::sortRows( children, NameCol, Qt::AscendingOrder, rows );
     }
 
 
     // Primary sorting by sortCol ascending or descending (as specified in sortOrder)
 
-    std::stable_sort( _sortedChildren->begin(),
-		      _sortedChildren->end(),
-		      FileInfoSorter( sortCol, sortOrder ) );
+    FileInfoSorter::sortRows( children, sortCol, sortOrder, rows );
 
-    if ( includeAttic && _attic )
-	_sortedChildren->append( _attic );
+    if ( cached )
+    {
+	cached->rows	    = rows;
+	cached->sortedCount = size;
 
-    _lastSortCol      = sortCol;
-    _lastSortOrder    = sortOrder;
-    _lastIncludeAttic = includeAttic;
+	return *cached;
+    }
 
+    return addSortPermutation( sortCol, sortOrder, rows, size );
+}
 
-#if DIRECT_CHILDREN_COUNT_SANITY_CHECK
 
-    if ( _sortedChildren->size() != _directChildrenCount )
+namespace QDirStat
+{
+    /**
+     * Sorting the children of one directory for DirInfo::presortChildren()
+     * in a thread pool. The keys are fetched before in the GUI thread.
+     **/
+    class DirPresortJob: public QRunnable
     {
-	Debug::dumpChildrenList( this, *_sortedChildren );
+    public:
+
+	DirPresortJob( DirInfo *	  dir,
+		       int		  size,
+		       FileInfoSortKeys * nameKeys,
+		       FileInfoSortKeys * sortKeys,
+		       Qt::SortOrder	  sortOrder ):
+	    dir( dir ),
+	    nameKeys( nameKeys ),
+	    sortKeys( sortKeys ),
+	    sortOrder( sortOrder ),
+	    rows( size )
+	{
+	    setAutoDelete( false );
+	}
 
-	THROW( Exception( QString( "_directChildrenCount of %1 corrupted; is %2, should be %3" )
-			  .arg( debugUrl() )
-			  .arg( _directChildrenCount )
-			  .arg( _sortedChildren->size() ) ) );
+	virtual ~DirPresortJob()
+	{
+	    delete nameKeys;
+	    delete sortKeys;
+	}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    for ( int i = 0; i < rows.size(); ++i )
+		rows[ i ] = i;
+
+	    if ( nameKeys )
+		nameKeys->sortRows( Qt::AscendingOrder, rows );
+
+	    sortKeys->sortRows( sortOrder, rows );
+	}
+
+	DirInfo *	   dir;
+	FileInfoSortKeys * nameKeys;
+	FileInfoSortKeys * sortKeys;
+	Qt::SortOrder	   sortOrder;
+	QVector<quint32>   rows;
+    };
+
+}	// namespace QDirStat
+
+
+void DirInfo::presortChildren( const QList<DirInfo *> & dirs,
+			       DataColumn		sortCol,
+			       Qt::SortOrder		sortOrder )
+{
+    if ( sortCol == UndefinedCol )
+	return;
+
+    QList<DirPresortJob *> jobs;
+    QThreadPool pool;
+    pool.setMaxThreadCount( qMin( QThread::idealThreadCount(), PARALLEL_SORT_MAX_THREADS ) );
+
+    foreach ( DirInfo * dir, dirs )
+    {
+	FileInfoList children = dir->unsortedChildren();
+
+	if ( children.size() < 2 ||
+	     dir->findSortPermutation( children.size(), sortCol, sortOrder ) )
+	{
+	    continue;
+	}
+
+	// Fetch the keys here in the GUI thread; only the sorting is done
+	// in the pool.
+
+	DirPresortJob * job =
+	    new DirPresortJob( dir, children.size(),
+			       sortCol != NameCol ? FileInfoSorter::sortKeys( children, NameCol ) : 0,
+			       FileInfoSorter::sortKeys( children, sortCol ),
+			       sortOrder );
+	CHECK_NEW( job );
+	jobs << job;
+
+	// Huge directories are sorted in parallel on their own anyway
+
+	if ( children.size() >= PARALLEL_SORT_MIN_SIZE )
+	    job->run();
+	else
+	    pool.start( job );
     }
-#endif
 
-    return *_sortedChildren;
+    pool.waitForDone();
+
+    foreach ( DirPresortJob * job, jobs )
+    {
+	job->dir->addSortPermutation( sortCol, sortOrder, job->rows, job->rows.size() );
+	delete job;
+    }
+
+    if ( ! jobs.isEmpty() )
+	logDebug() << "Sorted " << jobs.size() << " directories by " << sortCol << endl;
 }
 
 
 void DirInfo::dropSortCache( bool recursive )
 {
-    if ( _sortedChildren )
+    dropSortedChildren( recursive,
+			false ); // keepPermutations
+}
+
+
+StatsCollectorList DirInfo::cachedStats( const QStringList & keys ) const
+{
+    if ( _statsCache )
+    {
+	QList<DirCachedStats> & entries = _statsCache->entries;
+
+	for ( int i = 0; i < entries.size(); ++i )
+	{
+	    if ( entries.at( i ).keys == keys )
+	    {
+		if ( i > 0 )
+		    entries.move( i, 0 );	// Most recently used first
+
+		return entries.first().stats;
+	    }
+	}
+    }
+
+    return StatsCollectorList();
+}
+
+
+void DirInfo::setCachedStats( const QStringList	       & keys,
+			      const StatsCollectorList & stats )
+{
+    if ( ! _statsCache )
+    {
+	_statsCache = new DirStatsCache();
+	CHECK_NEW( _statsCache );
+    }
+
+    QList<DirCachedStats> & entries = _statsCache->entries;
+
+    for ( int i = entries.size() - 1; i >= 0; --i )
+    {
+	if ( entries.at( i ).keys == keys || i >= MAX_CACHED_STATS - 1 )
+	{
+	    qDeleteAll( entries.at( i ).stats );
+	    entries.removeAt( i );
+	}
+    }
+
+    DirCachedStats cached;
+    cached.keys	 = keys;
+    cached.stats = stats;
+    entries.prepend( cached );
+}
+
+
+TreeSnapshotDirPtr DirInfo::cachedSnapshot() const
+{
+    return _statsCache ? _statsCache->snapshot : TreeSnapshotDirPtr();
+}
+
+
+void DirInfo::setCachedSnapshot( const TreeSnapshotDirPtr & snapshot )
+{
+    if ( ! _statsCache )
+    {
+	_statsCache = new DirStatsCache();
+	CHECK_NEW( _statsCache );
+    }
+
+    _statsCache->snapshot = snapshot;
+}
+
+
+TreeColumnsPtr DirInfo::cachedColumns() const
+{
+    return _statsCache ? _statsCache->columns : TreeColumnsPtr();
+}
+
+
+void DirInfo::setCachedColumns( const TreeColumnsPtr & columns )
+{
+    if ( ! _statsCache )
+    {
+	_statsCache = new DirStatsCache();
+	CHECK_NEW( _statsCache );
+    }
+
+    _statsCache->columns = columns;
+}
+
+
+void DirInfo::dropStatsCache()
+{
+    if ( _statsCache )
+    {
+	delete _statsCache;
+	_statsCache = 0;
+    }
+}
+
+
+void DirInfo::dropSortPermutations()
+{
+    if ( _sortCache )
+    {
+	delete _sortCache;
+	_sortCache = 0;
+    }
+}
+
+
+void DirInfo::trimCaches( bool all )
+{
+    if ( all )
+    {
+	dropSortPermutations();
+	dropStatsCache();
+    }
+    else
+    {
+	// Keep only the most recently used entry of each cache
+
+	if ( _sortCache )
+	{
+	    while ( _sortCache->permutations.size() > 1 )
+		_sortCache->permutations.removeLast();
+	}
+
+	if ( _statsCache )
+	{
+	    QList<DirCachedStats> & entries = _statsCache->entries;
+
+	    while ( entries.size() > 1 )
+	    {
+		qDeleteAll( entries.last().stats );
+		entries.removeLast();
+	    }
+	}
+    }
+
+    FileInfo * child = _firstChild;
+
+    while ( child )
+    {
+	if ( child->isDirInfo() )
+	    child->toDirInfo()->trimCaches( all );
+
+	child = child->next();
+    }
+
+    if ( _dotEntry )
+	_dotEntry->trimCaches( all );
+
+    if ( _attic )
+	_attic->trimCaches( all );
+}
+
+
+void DirInfo::dropSortedChildren( bool recursive, bool keepPermutations )
+{
+    if ( _sortedChildren || _sortCache )
     {
 	// logDebug() << "Dropping sort cache for " << this << endl;
 
@@ -1077,8 +2551,14 @@ void DirInfo::dropSortCache( bool recursive )
 	// open to a certain tree level), then closed them again and now opens
 	// select branches manually.
 
-	delete _sortedChildren;
-	_sortedChildren = 0;
+	if ( _sortedChildren )
+	{
+	    delete _sortedChildren;
+	    _sortedChildren = 0;
+	}
+
+	if ( ! keepPermutations )
+	    dropSortPermutations();
 
 	// Optimization: If this dir didn't have any sort cache, there won't be
 	// any in the subtree, either. And dot entries don't have dir children
@@ -1093,25 +2573,42 @@ void DirInfo::dropSortCache( bool recursive )
 		while ( child )
 		{
 		    if ( child->isDirInfo() )
-			child->toDirInfo()->dropSortCache( recursive );
+			child->toDirInfo()->dropSortedChildren( recursive, keepPermutations );
 
 		    child = child->next();
 		}
 
 		if ( _dotEntry )
-		    _dotEntry->dropSortCache( recursive );
+		    _dotEntry->dropSortedChildren( recursive, keepPermutations );
 	    }
 
 	    if ( _attic )
-		_attic->dropSortCache( recursive );
+		_attic->dropSortedChildren( recursive, keepPermutations );
 	}
     }
 
-    if ( _dominantChildren )
+    _dominantCount = -1;
+}
+
+
+qint64 DirInfo::sortCacheBytes() const
+{
+    qint64 bytes = 0;
+
+    // Not counting the few bytes of the QList header
+
+    if ( _sortedChildren )
+	bytes += sizeof( FileInfoList ) + _sortedChildren->size() * sizeof( FileInfo * );
+
+    if ( _sortCache )
     {
-        delete _dominantChildren;
-        _dominantChildren = 0;
+	bytes += sizeof( DirSortCache );
+
+	foreach ( const DirSortPermutation & permutation, _sortCache->permutations )
+	    bytes += sizeof( DirSortPermutation ) + permutation.rows.capacity() * sizeof( quint32 );
     }
+
+    return bytes;
 }
 
 
@@ -1137,12 +2634,17 @@ void DirInfo::takeAllChildren( DirInfo * oldParent )
 	FileInfo * oldFirstChild = _firstChild;
 	_firstChild = child;
 	FileInfo * lastChild = child;
+	dropChildIndex();
 
 	oldParent->setFirstChild( 0 );
 	oldParent->recalc();
 
 	_directChildrenCount = -1;
 	_summaryDirty	     = true;
+	oldParent->dropStatsCache();
+
+	for ( DirInfo * dir = this; dir; dir = dir->parent() )
+	    dir->dropStatsCache();
 
 	while ( child )
 	{
@@ -1152,26 +2654,54 @@ void DirInfo::takeAllChildren( DirInfo * oldParent )
 	}
 
 	lastChild->setNext( oldFirstChild );
+
+	if ( _tree )
+	    _tree->invalidateSubtreeNumbers();
     }
 }
 
 
+void DirInfo::numberSubtree( quint32 & counter )
+{
+    _subtreeFirst = counter++;
+
+    for ( FileInfo * child = _firstChild; child; child = child->next() )
+    {
+	if ( child->isDirInfo() )
+	    child->toDirInfo()->numberSubtree( counter );
+    }
+
+    if ( _dotEntry )
+	_dotEntry->numberSubtree( counter );
+
+    if ( _attic )
+	_attic->numberSubtree( counter );
+
+    _subtreeLast = counter - 1;
+}
+
+
 bool DirInfo::isDominantChild( FileInfo * child )
 {
-    if ( ! _dominantChildren )
+    if ( _dominantCount < 0 )
         findDominantChildren();
 
-    if ( _dominantChildren && _dominantChildren->contains( child ) )
-        return true;
-    else
-        return false;
+    // The dominant children are the first ones of the sorted children, and
+    // each child knows its sorted row, so this is O(1) for painting rows.
+
+    int row = child->sortedRow();
+
+    return row >= 0 && row < _dominantCount &&
+        _sortedChildren->at( row ) == child;
 }
 
 
 void DirInfo::findDominantChildren()
 {
     if ( ! _sortedChildren )
-        return;
+        return;		// Try again when there are sorted children
+
+    _dominantCount = 0;
 
     switch ( _lastSortCol )
     {
@@ -1188,18 +2718,18 @@ void DirInfo::findDominantChildren()
     if ( _lastSortOrder != Qt::DescendingOrder )
         return;
 
-    if ( _dominantChildren )
-        delete _dominantChildren;
-
-    _dominantChildren = new FileInfoList();
-    CHECK_NEW( _dominantChildren );
+    int count = qMin( _sortedChildren->size(), DOMINANCE_ITEM_COUNT );
 
-    qreal count = qMin( _sortedChildren->size(), 30 );
+    // Same as FileInfo::subtreeAllocatedPercent() for each child, but
+    // without fetching the totals of this directory again for each one
 
-    if ( count < 2 )
+    if ( count < 2 || pendingReadJobs() > 0 || totalAllocatedSize() == 0 )
         return;
 
-    qreal medianPercent      = _sortedChildren->at( count / 2 )->subtreeAllocatedPercent();
+    qreal percentFactor      = 100.0 / totalAllocatedSize();
+    FileInfo * medianChild   = _sortedChildren->at( count / 2 );
+    qreal medianPercent      = medianChild->isExcluded() ?
+        -1.0 : medianChild->totalAllocatedSize() * percentFactor;
     qreal dominanceThreshold = qBound( DOMINANCE_MIN_PERCENT,
                                        DOMINANCE_FACTOR * medianPercent,
                                        DOMINANCE_MAX_PERCENT );
@@ -1212,17 +2742,19 @@ void DirInfo::findDominantChildren()
 #endif
 
 
-    // Add the children that are larger to the dominant children
+    // Count the children that are larger
 
-    for ( int i=0; i < count; ++i )
+    while ( _dominantCount < count )
     {
-        FileInfo * child        = _sortedChildren->at( i );
-        qreal      childPercent = child->subtreeAllocatedPercent();
+        FileInfo * child = _sortedChildren->at( _dominantCount );
 
-        if ( childPercent < dominanceThreshold )
+        if ( child->isExcluded() ||
+             child->totalAllocatedSize() * percentFactor < dominanceThreshold )
+        {
             break;
+        }
 
-        _dominantChildren->append( child );
-        // logDebug() << "Adding " << child->name() << ":\t\t" << formatPercent( childPercent ) << endl;
+        // logDebug() << "Dominant: " << child->name() << endl;
+        ++_dominantCount;
     }
 }
@@ -11,8 +11,14 @@
 #define DirInfo_h
 
 
+#include <QVector>
+#include <QHash>
+
 #include "FileInfo.h"
 #include "DataColumns.h"
+#include "StatsEngine.h"
+#include "TreeSnapshot.h"
+#include "TreeColumns.h"
 
 
 namespace QDirStat
@@ -20,6 +26,79 @@ namespace QDirStat
     // Forward declarations
     class DirTree;
     class DotEntry;
+    class MimeCategory;
+    struct DirSortCache;
+    struct DirSortPermutation;
+    struct DirStatsCache;
+
+
+    /**
+     * Summary of a batch of new children for DirInfo::insertChildren():
+     * The sums of the fields that are relevant for the DirInfo totals.
+     * This is also used for the children that are removed, see
+     * DirInfo::childrenRemoved().
+     **/
+    struct ChildrenSummary
+    {
+	ChildrenSummary();
+
+	/**
+	 * Add the values of a new child to this summary.
+	 **/
+	void add( FileInfo * newChild );
+
+	/**
+	 * Add the values of 'child' including its complete subtree, i.e.
+	 * everything it contributes to the totals of its parent.
+	 **/
+	void addSubtree( FileInfo * child );
+
+	FileSize  size;
+	FileSize  allocatedSize;
+	FileSize  blocks;
+	FileCount items;
+	FileCount subDirs;
+	FileCount files;
+	FileCount unignoredItems;
+	FileCount ignoredItems;
+	FileCount errSubDirs;
+	time_t	  latestMtime;
+	time_t	  oldestFileMtime;
+    };
+
+
+    /**
+     * Extrapolated values for the entries of a directory that were not
+     * read in a sampling scan (see DirTree::sampleFraction()): Only a
+     * random sample of the non-directory entries of a very large directory
+     * is read, and the others are assumed to be like that sample.
+     **/
+    struct DirSample
+    {
+	DirSample(): variance( 0.0 ) {}
+
+	ChildrenSummary extra;	  // extrapolated sums of the entries not read
+	double		variance; // variance of the extrapolated total size
+    };
+
+
+    /**
+     * Sums of the non-directory entries of a directory that was read in
+     * directories-only mode (see DirTree::dirsOnly()): No FileInfo objects
+     * are created for them; they only count in the sums of the directory
+     * and its ancestors.
+     **/
+    struct DirFileSummary
+    {
+	ChildrenSummary files;
+
+	// Totals of the regular files by MIME category; files without a
+	// category are counted with a null category.
+
+	QHash<MimeCategory *, FileSize> categorySum;
+	QHash<MimeCategory *, int>	categoryCount;
+    };
+
 
     /**
      * A more specialized version of FileInfo: This class can actually manage
@@ -64,9 +143,10 @@ namespace QDirStat
 	/**
 	 * Default constructor.
 	 *
-	 * This is the only constructor that will not create a dot entry
-	 * immediately. If that is desired, you can always use ensureDotEntry()
-	 * later.
+	 * Unlike the other constructors, this does not make the directory
+	 * create a dot entry for its first non-directory child; all its
+	 * children are stored directly. If a dot entry is desired, you can
+	 * always use ensureDotEntry().
 	 **/
 	DirInfo( DirTree * tree,
 		 DirInfo * parent = 0 );
@@ -108,7 +188,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalItems() Q_DECL_OVERRIDE;
+	virtual FileCount totalItems() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of subdirectories in this subtree,
@@ -116,7 +196,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalSubDirs() Q_DECL_OVERRIDE;
+	virtual FileCount totalSubDirs() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of plain file children in this subtree,
@@ -124,7 +204,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalFiles() Q_DECL_OVERRIDE;
+	virtual FileCount totalFiles() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of non-directory items in this subtree,
@@ -132,7 +212,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalNonDirItems() Q_DECL_OVERRIDE;
+	virtual FileCount totalNonDirItems() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of ignored (non-directory!) items in this
@@ -140,7 +220,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalIgnoredItems() Q_DECL_OVERRIDE;
+	virtual FileCount totalIgnoredItems() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of not ignored (non-directory!) items in
@@ -148,7 +228,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalUnignoredItems() Q_DECL_OVERRIDE;
+	virtual FileCount totalUnignoredItems() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of direct children of this directory.
@@ -173,7 +253,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int errSubDirCount() Q_DECL_OVERRIDE;
+	virtual FileCount errSubDirCount() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the latest modification time of this subtree.
@@ -264,7 +344,27 @@ namespace QDirStat
 	 * Reimplemented - inherited from FileInfo.
 	 **/
 	virtual void setFirstChild( FileInfo * newfirstChild ) Q_DECL_OVERRIDE
-	    { _firstChild = newfirstChild; }
+	    { dropChildIndex(); _firstChild = newfirstChild; }
+
+	/**
+	 * Return the child named 'name' in the children list of this
+	 * directory (not in its dot entry or attic) or 0 if there is none.
+	 *
+	 * For directories with many children, this builds an index of the
+	 * children by name the first time, so this is a hash lookup
+	 * afterwards.
+	 **/
+	FileInfo * findDirectChild( const QString & name );
+
+	/**
+	 * Return the item named 'name' directly below this directory: One of
+	 * its children, one of the files in its dot entry or one of the
+	 * ignored items in its attics. If 'findPseudoDirs' is 'true', also
+	 * return the dot entry or the attic for their pseudo names.
+	 *
+	 * Return 0 if there is no such item.
+	 **/
+	FileInfo * locateChild( const QString & name, bool findPseudoDirs = false );
 
 	/**
 	 * Insert a child into the children list.
@@ -274,6 +374,19 @@ namespace QDirStat
 	 **/
 	virtual void insertChild( FileInfo * newChild ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Insert a whole batch of children into the children list, e.g. all
+	 * entries of a directory that were just read.
+	 *
+	 * This is equivalent to calling insertChild() for each of them, but
+	 * the summary fields of this directory and all its ancestors are only
+	 * updated once for the complete batch, not once for each child.
+	 *
+	 * Just like with insertChild(), non-directory children go to the dot
+	 * entry if there is one.
+	 **/
+	void insertChildren( const FileInfoList & newChildren );
+
 	/**
 	 * Add a child to the attic. This is very much like insertChild(), but
 	 * it inserts the child into the appropriate attic instead (and sets
@@ -289,6 +402,30 @@ namespace QDirStat
 	 **/
 	virtual void moveToAttic( FileInfo * newChild );
 
+	/**
+	 * Move all ignored direct children to the attic in one pass over the
+	 * children list, like moveToAttic() for each of them: Each attic gets
+	 * them as one chain. If 'movedDirs' is non-null, the moved
+	 * directories are added to it. The sums of this directory, its dot
+	 * entry and their attics are recalculated.
+	 *
+	 * Unlike moveToAttic(), this changes nothing above this directory:
+	 * Recalculate the parents afterwards. The tree is not notified
+	 * either, so call DirTree::invalidateSubtreeNumbers(). This way, it
+	 * can be used for directories in different subtrees in parallel as
+	 * long as they have no index of their children (see
+	 * dropChildIndex()).
+	 **/
+	void moveIgnoredToAttic( FileInfoList * movedDirs = 0 );
+
+	/**
+	 * Move all children of the attic back to the normal children list,
+	 * delete the attic and recalculate the sums. Like
+	 * moveIgnoredToAttic(), this changes nothing above this directory
+	 * and does not notify the tree.
+	 **/
+	void takeAtticChildren();
+
 	/**
 	 * Get the "Dot Entry" for this node if there is one (or 0 otherwise):
 	 * This is a pseudo entry that directory nodes use to store
@@ -302,6 +439,9 @@ namespace QDirStat
 	/**
 	 * Return the dot entry for this node. If it doesn't have one yet,
 	 * create it first.
+	 *
+	 * Directories create their dot entry only when the first
+	 * non-directory child is inserted, not in the constructor.
 	 **/
 	virtual DotEntry * ensureDotEntry();
 
@@ -312,6 +452,13 @@ namespace QDirStat
 	 **/
 	virtual void deleteEmptyDotEntry();
 
+	/**
+	 * Take the dot entry out of this directory without deleting it and
+	 * return it (or 0 if there is none). Ownership is transferred to the
+	 * caller.
+	 **/
+	DotEntry * takeDotEntry();
+
 	/**
 	 * Return the "Attic" entry for this node if there is one (or 0
 	 * otherwise): This is a pseudo entry that directory nodes use to store
@@ -346,6 +493,31 @@ namespace QDirStat
 	 **/
 	virtual void childAdded( FileInfo * newChild ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Notification that a batch of children has been added somewhere in
+	 * the subtree. 'directChildren' is the number of those children that
+	 * are direct children of this directory.
+	 *
+	 * This updates the summary fields just like childAdded() does for an
+	 * individual child, and it is cascaded upward in the tree.
+	 **/
+	void childrenAdded( const ChildrenSummary & summary,
+			    int			    directChildren = 0 );
+
+	/**
+	 * Subtract the values of children that are removed from the subtree
+	 * from the summary fields. 'directChildren' is the number of those
+	 * children that are direct children of this directory.
+	 *
+	 * This is cascaded upward in the tree, so keeping the sums up to date
+	 * only takes time proportional to the depth of the tree, not to its
+	 * size. Only the latest and oldest mtime can't be updated this way:
+	 * If a removed child had one of them, they are recalculated from the
+	 * direct children when they are needed next time.
+	 **/
+	void childrenRemoved( const ChildrenSummary & summary,
+			      int		      directChildren = 0 );
+
 	/**
 	 * Remove a child from the children list.
 	 *
@@ -435,6 +607,149 @@ namespace QDirStat
 	 **/
 	virtual QString sizePrefix() const Q_DECL_OVERRIDE;
 
+	/**
+	 * Return the estimated total allocated size of this subtree while it
+	 * is not read yet or still being read, or -1 if there is none.
+	 *
+	 * Estimates are only available for mount points (see
+	 * DirTree::estimateSize()) and for packages whose file lists are not
+	 * read yet (their installed size); as soon as the subtree is read, the
+	 * real sums take over. Notice that totalSize() and the other sums never
+	 * include an estimate.
+	 **/
+	FileSize sizeEstimate();
+
+	/**
+	 * Set the estimated total allocated size of this subtree. -1 removes
+	 * the estimate.
+	 **/
+	void setSizeEstimate( FileSize estimate );
+
+	/**
+	 * Return 'true' if the contents of this directory are not read yet
+	 * because the cache file it came from was opened lazily; they are
+	 * read from there when a view needs them. See
+	 * DirTree::readCachePlaceholder().
+	 **/
+	bool isCachePlaceholder() const { return _isCachePlaceholder; }
+
+	/**
+	 * Set or clear the cache placeholder flag.
+	 **/
+	void setCachePlaceholder( bool placeholder = true )
+	    { _isCachePlaceholder = placeholder; }
+
+	/**
+	 * Return the cached SystemFileChecker::PathClass of the path of this
+	 * directory or 0 if there is none yet.
+	 **/
+	int systemPathClass() const { return _systemPathClass; }
+
+	/**
+	 * Cache the SystemFileChecker::PathClass of the path of this
+	 * directory.
+	 **/
+	void setSystemPathClass( int pathClass )
+	    { _systemPathClass = pathClass; }
+
+	/**
+	 * Return 'true' if only a sample of the non-directory entries of this
+	 * directory was read and the others are extrapolated (see DirSample).
+	 **/
+	bool isSampled() const { return _isSampled; }
+
+	/**
+	 * Set the extrapolated values for the entries of this directory that
+	 * were not read. They are added to the sums of this directory and all
+	 * its ancestors just like real children.
+	 **/
+	void setSample( const DirSample & sample );
+
+	/**
+	 * Drop the extrapolated values, e.g. before this directory is read
+	 * again.
+	 **/
+	void dropSample();
+
+	/**
+	 * Return the half width of the 95% confidence interval of the total
+	 * size of this subtree if anything in it is extrapolated from a
+	 * sample, or -1 if the total size is exact.
+	 **/
+	FileSize sampleError();
+
+	/**
+	 * Return 'true' if the non-directory children of this directory are
+	 * in the tree's spill store (see SpillStore) rather than in memory.
+	 * They still count in all sums and in directChildrenCount().
+	 **/
+	bool hasSpilledFiles() const { return _hasSpilledFiles; }
+
+	/**
+	 * Move the non-directory children of this directory and of its dot
+	 * entry to the tree's spill store and delete them if the tree is in
+	 * out-of-core mode. Files with multiple hard links are kept since the
+	 * tree's hard link index needs them. The sums don't change.
+	 *
+	 * This is meant to be called when reading this directory is finished
+	 * before any view was told about its children.
+	 **/
+	void spillFiles();
+
+	/**
+	 * Get the files of this directory back from the tree's spill store
+	 * and insert them as children again. This does nothing if there are
+	 * no spilled files. Returns 'true' if any files were paged in.
+	 **/
+	bool pageInFiles();
+
+	/**
+	 * Return 'true' if the non-directory entries of this directory were
+	 * only added to the sums because it was read in directories-only mode
+	 * (see DirFileSummary).
+	 **/
+	bool hasFileSummary() const { return _hasFileSummary; }
+
+	/**
+	 * Return the sums of the non-directory entries that were read in
+	 * directories-only mode. Use hasFileSummary() first to check if there
+	 * are any.
+	 **/
+	DirFileSummary fileSummary() const;
+
+	/**
+	 * Set the sums of the non-directory entries that were read in
+	 * directories-only mode. They are added to the sums of this directory
+	 * and all its ancestors.
+	 **/
+	void setFileSummary( const DirFileSummary & summary );
+
+	/**
+	 * Drop the sums of the non-directory entries that were read in
+	 * directories-only mode, e.g. before this directory is read again.
+	 **/
+	void dropFileSummary();
+
+	/**
+	 * Return 'true' if small files of this directory were folded into
+	 * its file summary (see DirTree::foldFilesBelow()) and they were not
+	 * unfolded yet.
+	 **/
+	bool hasFoldedFiles() const;
+
+	/**
+	 * Return 'true' if no files of this directory are folded when it is
+	 * read because a view wanted to show them all.
+	 **/
+	bool filesUnfolded() const { return _filesUnfolded; }
+
+	/**
+	 * Set if no files of this directory are folded when it is read. Use
+	 * DirTree::unfoldFiles() to unfold the files of a directory that is
+	 * already read.
+	 **/
+	void setFilesUnfolded( bool unfolded ) { _filesUnfolded = unfolded; }
+
 	/**
 	 * Set the state of the directory reading process.
 	 * See readState() for details.
@@ -450,16 +765,103 @@ namespace QDirStat
 	 * This might return cached information if all parameters are the same
 	 * as for the last call to this function, and there were no children
 	 * added or removed in the meantime.
+	 *
+	 * The sort orders for the last few columns are cached as well, so
+	 * switching back and forth between sort columns does not sort again.
+	 * Very large directories are sorted in parallel.
+	 *
+	 * If 'sortedCount' is not -1, only that many children at the start
+	 * of the list are guaranteed to be in their final order; the others
+	 * follow in any order, and their sortedRow() is -1. This is much
+	 * faster for the first rows of a huge directory. Asking for more
+	 * later only sorts the rest of them as far as needed.
 	 **/
 	const FileInfoList & sortedChildren( DataColumn	   sortCol,
 					     Qt::SortOrder sortOrder,
-					     bool	   includeAttic = false );
+					     bool	   includeAttic = false,
+					     int	   sortedCount	= -1 );
 
 	/**
-	 * Drop all cached information about children sorting.
+	 * Drop all cached information about children sorting. Call this
+	 * whenever children are added or removed.
 	 **/
 	void dropSortCache( bool recursive = false );
 
+	/**
+	 * Return the number of bytes of the cached sorted children list and
+	 * the cached sort orders of this directory alone (not recursive).
+	 * This is an estimate for the memory statistics.
+	 **/
+	qint64 sortCacheBytes() const;
+
+	/**
+	 * Compute the sort orders of the children of all 'dirs' by 'sortCol'
+	 * and 'sortOrder' and cache them, so sortedChildren() for them only
+	 * needs to put the children in that order. The sort keys are fetched
+	 * in the calling thread; the sorting itself is done for several
+	 * directories in parallel.
+	 *
+	 * This is meant for all directories that are expanded in a view when
+	 * the user changes the sort column.
+	 **/
+	static void presortChildren( const QList<DirInfo *> & dirs,
+				     DataColumn		      sortCol,
+				     Qt::SortOrder	      sortOrder );
+
+	/**
+	 * Return the cached statistics of all items below this directory
+	 * (but not of the directory itself) for a StatsEngine with collectors
+	 * with cache keys 'keys', or an empty list if there are none.
+	 * Ownership stays with this directory.
+	 **/
+	StatsCollectorList cachedStats( const QStringList & keys ) const;
+
+	/**
+	 * Store statistics of all items below this directory for collectors
+	 * with cache keys 'keys'. This directory takes over ownership.
+	 **/
+	void setCachedStats( const QStringList	      & keys,
+			     const StatsCollectorList & stats );
+
+	/**
+	 * Return the last snapshot of this subtree if nothing was added or
+	 * removed in it since then, or a null pointer (see TreeSnapshotDir).
+	 **/
+	TreeSnapshotDirPtr cachedSnapshot() const;
+
+	/**
+	 * Keep 'snapshot' as the last snapshot of this subtree.
+	 **/
+	void setCachedSnapshot( const TreeSnapshotDirPtr & snapshot );
+
+	/**
+	 * Return the last column-wise copy of this subtree if nothing was
+	 * added or removed in it since then, or a null pointer (see
+	 * TreeColumns).
+	 **/
+	TreeColumnsPtr cachedColumns() const;
+
+	/**
+	 * Keep 'columns' as the last column-wise copy of this subtree.
+	 **/
+	void setCachedColumns( const TreeColumnsPtr & columns );
+
+	/**
+	 * Drop all cached statistics, the last snapshot and the last
+	 * column-wise copy. This happens
+	 * automatically whenever children are added or removed anywhere in
+	 * this subtree.
+	 **/
+	void dropStatsCache();
+
+	/**
+	 * Free memory in this subtree: Drop all cached sort orders and
+	 * statistics if 'all' is 'true', otherwise all but the most recently
+	 * used ones. The sorted children lists are kept. This is for low
+	 * memory situations; see MemoryPressure.
+	 **/
+	void trimCaches( bool all );
+
 	/**
 	 * Check if this directory is locked. This is purely a user lock
 	 * that can be used by the application. The DirInfo does not care
@@ -478,7 +880,8 @@ namespace QDirStat
 	void unlock() { _locked = false; }
 
 	/**
-	 * Recursively delete all children, including the dot entry.
+	 * Recursively delete all children, including the dot entry, and
+	 * subtract them from the summary fields of the ancestors.
 	 **/
 	void clear();
 
@@ -487,8 +890,8 @@ namespace QDirStat
 	 * of refreshing the tree from this point on:
 	 *
 	 * Delete all children if there are any, delete the dot entry's
-	 * children if there are any, restore the dot entry if it was removed
-	 * (e.g. in finalizeLocal()), set the read state to DirQueued.
+	 * children if there are any, create a dot entry again for the first
+	 * non-directory child, set the read state to DirQueued.
 	 **/
 	virtual void reset();
 
@@ -511,6 +914,26 @@ namespace QDirStat
 	 **/
 	void clearTouched( bool recursive = false );
 
+	/**
+	 * Mark the children of this directory as 'exposed': A connected view
+	 * asked for them, typically because this directory is expanded.
+	 * Item models can use this to skip any notifications about the
+	 * children of directories that are not exposed; the view catches up
+	 * when it asks for them.
+	 **/
+	void setExposed() { _exposed = true; }
+
+	/**
+	 * Check the 'exposed' flag.
+	 **/
+	bool isExposed() const { return _exposed; }
+
+	/**
+	 * Clear the 'exposed' flag, e.g. when this directory is collapsed in
+	 * the view. If 'recursive' is 'true', do this for the subtree, too.
+	 **/
+	void clearExposed( bool recursive = false );
+
 	/**
 	 * Returns true if this is a DirInfo object.
 	 *
@@ -549,11 +972,41 @@ namespace QDirStat
 	 **/
 	virtual void takeAllChildren( DirInfo * oldParent );
 
+	/**
+	 * Return the depth-first preorder number of this directory and the
+	 * highest one of any directory in its subtree: A directory is in the
+	 * subtree of this one if its own number is in that range. These are
+	 * only valid if DirTree::updateSubtreeNumbers() returned 'true'.
+	 **/
+	quint32 subtreeFirst() const { return _subtreeFirst; }
+	quint32 subtreeLast()  const { return _subtreeLast;  }
+
+	/**
+	 * Add 'child' to the index of the children by name if there is one.
+	 **/
+	void addToChildIndex( FileInfo * child );
+
+	/**
+	 * Number this directory and all directories below it (including
+	 * dot entries and attics) in depth-first preorder, beginning with
+	 * 'counter'. See DirTree::updateSubtreeNumbers().
+	 **/
+	void numberSubtree( quint32 & counter );
+
+	/**
+	 * Drop the index of the children by name, e.g. after the children
+	 * list was changed in a way that is not worthwhile to track.
+	 **/
+	void dropChildIndex();
+
 	/**
 	 * Recursively recalculate the summary fields when they are dirty.
 	 *
 	 * This is a _very_ expensive operation since the entire subtree may
-	 * recursively be traversed.
+	 * recursively be traversed. Normally this is only needed after the
+	 * subtree was changed wholesale: Adding and removing children updates
+	 * the sums of all ancestors directly (see childAdded() and
+	 * childrenRemoved()).
 	 **/
 	void recalc();
 
@@ -569,6 +1022,30 @@ namespace QDirStat
 
     protected:
 
+	/**
+	 * Recursively delete all children, including the dot entry, without
+	 * telling the ancestors about the changed sums.
+	 **/
+	void deleteChildren();
+
+	/**
+	 * Link the items of 'chain' (linked by next()) into the attic of
+	 * 'dir' as a whole; create the attic if necessary.
+	 **/
+	static void spliceIntoAttic( DirInfo * dir, FileInfo * chain );
+
+	/**
+	 * Subtract the difference between 'totalsBefore' and the current
+	 * summary fields from the ancestors after children were removed.
+	 **/
+	void subtractFromAncestors( ChildrenSummary totalsBefore );
+
+	/**
+	 * Recalculate only the latest and oldest mtime from the direct
+	 * children when a child that had one of them was removed.
+	 **/
+	void recalcMtimes();
+
 	/**
 	 * Clean up unneeded / undesired dot entries:
 	 * Delete dot entries that don't have any children,
@@ -584,10 +1061,63 @@ namespace QDirStat
 	virtual void cleanupAttics();
 
         /**
-         * Populate the _dominantChildren list.
+         * Calculate the number of dominant children, i.e. of the first
+         * sorted children that are dominant, and cache it in
+         * _dominantCount until the sorted children are dropped.
          **/
         void findDominantChildren();
 
+	/**
+	 * Drop the sorted children list and the dominant children. If
+	 * 'keepPermutations' is 'true', keep the cached sort orders since the
+	 * children did not change; this is for just sorting differently.
+	 **/
+	void dropSortedChildren( bool recursive, bool keepPermutations );
+
+	/**
+	 * Drop only the cached sort orders, but keep the sorted children
+	 * list. This is for changes that make the sort orders obsolete while
+	 * the current sorted list is kept on purpose.
+	 **/
+	void dropSortPermutations();
+
+	/**
+	 * Return the order of 'children' (the unsorted children) sorted by
+	 * 'sortCol' and 'sortOrder' as indices into 'children', with at
+	 * least 'sortedCount' of them (-1 for all) in their final order.
+	 * This uses the cached permutation if there is one, and it sorts
+	 * more of it if needed.
+	 **/
+	const DirSortPermutation & sortPermutation( const FileInfoList & children,
+						    DataColumn		 sortCol,
+						    Qt::SortOrder	 sortOrder,
+						    int			 sortedCount );
+
+	/**
+	 * Return the cached order of the children sorted by 'sortCol' and
+	 * 'sortOrder' or 0 if there is none. 'size' is the number of
+	 * unsorted children; the cache is dropped if that does not match.
+	 **/
+	DirSortPermutation * findSortPermutation( int		size,
+						  DataColumn	sortCol,
+						  Qt::SortOrder sortOrder );
+
+	/**
+	 * Add the order of the children sorted by 'sortCol' and 'sortOrder'
+	 * with the first 'sortedCount' rows in their final order to the
+	 * cache and return the cached copy.
+	 **/
+	const DirSortPermutation & addSortPermutation( DataColumn		sortCol,
+						       Qt::SortOrder		sortOrder,
+						       const QVector<quint32> & rows,
+						       int			sortedCount );
+
+	/**
+	 * Return the direct children in their unsorted order, followed by
+	 * the dot entry if there is one.
+	 **/
+	FileInfoList unsortedChildren() const;
+
 
 	//
 	// Data members
@@ -596,10 +1126,23 @@ namespace QDirStat
 	bool		_isMountPoint:1;	// Flag: is this a mount point?
 	bool		_isExcluded:1;		// Flag: was this directory excluded?
 	bool		_summaryDirty:1;	// dirty flag for the cached values
+	bool		_mtimesDirty:1;		// only the mtimes need a recalc
 	bool		_deletingAll:1;		// Deleting complete children tree?
 	bool		_locked:1;		// App lock
 	bool		_touched:1;		// App 'touch' flag
+	bool		_exposed:1;		// Children requested by a view
+	bool		_hasSizeEstimate:1;	// Size estimate in the DirTree?
+	bool		_isSampled:1;		// Sample in the DirTree?
+	bool		_hasSpilledFiles:1;	// Files in the spill store?
+	bool		_hasFileSummary:1;	// File summary in the DirTree?
+	bool		_filesUnfolded:1;	// Don't fold small files?
+	bool		_hasChildIndex:1;	// Child index in the DirTree?
+	bool		_isCachePlaceholder:1;	// Contents still in a cache file?
+	bool		_wantDotEntry:1;	// Create a dot entry for the first file?
+	quint8		_systemPathClass:2;	// (cache) see SystemFileChecker
 	int		_pendingReadJobs;	// number of open directories in this subtree
+	quint32		_subtreeFirst;		// depth-first number of this directory
+	quint32		_subtreeLast;		// highest number in this subtree
 
 	// Children management
 
@@ -612,18 +1155,20 @@ namespace QDirStat
 	FileSize	_totalSize;
 	FileSize	_totalAllocatedSize;
 	FileSize	_totalBlocks;
-	int		_totalItems;
-	int		_totalSubDirs;
-	int		_totalFiles;
-	int		_totalIgnoredItems;
-	int		_totalUnignoredItems;
+	FileCount	_totalItems;
+	FileCount	_totalSubDirs;
+	FileCount	_totalFiles;
+	FileCount	_totalIgnoredItems;
+	FileCount	_totalUnignoredItems;
 	int		_directChildrenCount;
-	int		_errSubDirCount;
+	FileCount	_errSubDirCount;
 	time_t		_latestMtime;
 	time_t		_oldestFileMtime;
 
 	FileInfoList *	_sortedChildren;
-        FileInfoList *  _dominantChildren;
+        int		_dominantCount;		// (cache) -1: not calculated yet
+	DirSortCache *	_sortCache;
+	DirStatsCache * _statsCache;
 	DataColumn	_lastSortCol;
 	Qt::SortOrder	_lastSortOrder;
 	bool		_lastIncludeAttic;
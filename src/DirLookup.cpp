@@ -0,0 +1,273 @@
+/*
+ *   File name: DirLookup.cpp
+ *   Summary:	Directory checks that don't block the GUI
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QDir>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QRunnable>
+
+#include "DirLookup.h"
+#include "QDirStatApp.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "Attic.h"
+#include "Exception.h"
+
+
+// Results from the worker thread are reused for this long; after that, the
+// directory is looked up again because it might have changed.
+
+#define RESULT_LIFETIME_MILLISEC	10000
+
+// Forget old results when there are more than this many.
+
+#define MAX_RESULTS			500
+
+
+using namespace QDirStat;
+
+
+DirLookup * DirLookup::_instance = 0;
+
+
+namespace QDirStat
+{
+    /**
+     * Task for looking up one path in the worker thread.
+     **/
+    class DirLookupTask: public QRunnable
+    {
+    public:
+
+	DirLookupTask( DirLookup * lookup, const QString & path, bool list ):
+	    _lookup( lookup ),
+	    _path( path ),
+	    _list( list )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    bool	isDir = QFileInfo( _path ).isDir();
+	    QStringList subDirs;
+
+	    if ( isDir && _list )
+	    {
+		subDirs = QDir( _path ).entryList( QDir::Dirs | QDir::NoDotAndDotDot,
+						   QDir::Name );
+	    }
+
+	    // The lookup is a singleton that is never deleted, so it is
+	    // safe to send the result there even if this took a long time.
+
+	    QMetaObject::invokeMethod( _lookup, "workerFinished",
+				       Qt::QueuedConnection,
+				       Q_ARG( QString,	   _path   ),
+				       Q_ARG( bool,	   isDir   ),
+				       Q_ARG( bool,	   _list   ),
+				       Q_ARG( QStringList, subDirs ) );
+	}
+
+    protected:
+
+	DirLookup * _lookup;
+	QString	    _path;
+	bool	    _list;
+    };
+}
+
+
+DirLookup * DirLookup::instance()
+{
+    if ( ! _instance )
+    {
+	_instance = new DirLookup();
+	CHECK_NEW( _instance );
+    }
+
+    return _instance;
+}
+
+
+DirLookup::DirLookup():
+    QObject(),
+    _busy( false )
+{
+    _clock.start();
+}
+
+
+QString DirLookup::normalized( const QString & path )
+{
+    return path.isEmpty() ? path : QDir::cleanPath( path );
+}
+
+
+DirInfo * DirLookup::treeDir( const QString & path, bool & isFile_ret )
+{
+    isFile_ret = false;
+    DirTree * tree = app()->dirTree();
+
+    if ( ! tree || ! path.startsWith( "/" ) )
+	return 0;
+
+    FileInfo * item = tree->locate( path );
+
+    if ( ! item )
+	return 0;
+
+    if ( item->isDirInfo() && ! item->isPseudoDir() )
+	return item->toDirInfo();
+
+    isFile_ret = ! item->isDirInfo() && ! item->isSymLink(); // A link may point to a dir
+
+    return 0;
+}
+
+
+const DirLookup::Result * DirLookup::recentResult( const QString & path ) const
+{
+    QHash<QString, Result>::const_iterator it = _results.find( path );
+
+    if ( it == _results.end() || _clock.elapsed() - it.value().time > RESULT_LIFETIME_MILLISEC )
+	return 0;
+
+    return &it.value();
+}
+
+
+bool DirLookup::knownIsDir( const QString & rawPath, bool & isDir_ret )
+{
+    QString path = normalized( rawPath );
+    bool isFile;
+
+    if ( treeDir( path, isFile ) || isFile )
+    {
+	isDir_ret = ! isFile;
+	return true;
+    }
+
+    const Result * result = recentResult( path );
+
+    if ( result )
+    {
+	isDir_ret = result->isDir;
+	return true;
+    }
+
+    return false;
+}
+
+
+bool DirLookup::knownSubDirs( const QString & rawDir, QStringList & subDirs_ret )
+{
+    QString dir = normalized( rawDir );
+    bool isFile;
+    DirInfo * dirInfo = treeDir( dir, isFile );
+
+    if ( dirInfo &&
+	 ( dirInfo->readState() == DirFinished || dirInfo->readState() == DirCached ) )
+    {
+	subDirs_ret.clear();
+
+	for ( FileInfo * child = dirInfo->firstChild(); child; child = child->next() )
+	{
+	    if ( child->isDirInfo() && ! child->isPseudoDir() )
+		subDirs_ret << child->name();
+	}
+
+	if ( dirInfo->attic() )
+	{
+	    for ( FileInfo * child = dirInfo->attic()->firstChild(); child; child = child->next() )
+	    {
+		if ( child->isDirInfo() )
+		    subDirs_ret << child->name();
+	    }
+	}
+
+	subDirs_ret.sort();
+
+	return true;
+    }
+
+    const Result * result = recentResult( dir );
+
+    if ( result && result->listed )
+    {
+	subDirs_ret = result->subDirs;
+	return true;
+    }
+
+    return false;
+}
+
+
+void DirLookup::requestIsDir( const QString & path )
+{
+    _waitingIsDir = normalized( path );
+    startWorker();
+}
+
+
+void DirLookup::requestSubDirs( const QString & dir )
+{
+    _waitingSubDirs = normalized( dir );
+    startWorker();
+}
+
+
+void DirLookup::startWorker()
+{
+    if ( _busy )
+	return;
+
+    // Listing is more work, but it also answers the check
+
+    bool    list = ! _waitingSubDirs.isEmpty();
+    QString path = list ? _waitingSubDirs : _waitingIsDir;
+
+    if ( path.isEmpty() )
+	return;
+
+    if ( path == _waitingIsDir )
+	_waitingIsDir.clear();
+
+    if ( list )
+	_waitingSubDirs.clear();
+
+    DirLookupTask * task = new DirLookupTask( this, path, list );
+    CHECK_NEW( task );
+
+    _busy = true;
+    QThreadPool::globalInstance()->start( task );  // Deletes the task when done
+}
+
+
+void DirLookup::workerFinished( const QString	  & path,
+				bool		    isDir,
+				bool		    listed,
+				const QStringList & subDirs )
+{
+    _busy = false;
+
+    if ( _results.size() >= MAX_RESULTS )
+	_results.clear();
+
+    Result & result = _results[ path ];
+    result.isDir   = isDir;
+    result.listed  = listed;
+    result.subDirs = subDirs;
+    result.time	   = _clock.elapsed();
+
+    emit isDirFound( path, isDir );
+
+    if ( listed )
+	emit subDirsFound( path, subDirs );
+
+    startWorker();
+}
@@ -0,0 +1,163 @@
+/*
+ *   File name: DirLookup.h
+ *   Summary:	Directory checks that don't block the GUI
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DirLookup_h
+#define DirLookup_h
+
+
+#include <QObject>
+#include <QStringList>
+#include <QHash>
+#include <QElapsedTimer>
+
+
+namespace QDirStat
+{
+    class DirInfo;
+
+
+    /**
+     * Singleton for checking if a path is a directory and for listing the
+     * subdirectories of a directory without blocking the GUI: Typing a path
+     * under a hung network mount must not freeze the application.
+     *
+     * Whatever is known without any I/O is answered immediately: From the
+     * in-memory DirTree if the path is already scanned, or from a recent
+     * result. Everything else is looked up in a worker thread, and the
+     * result is delivered with a signal.
+     *
+     * There is at most one worker at any time, and only the latest request
+     * of each kind waits for it; the others are outdated anyway. If the
+     * worker hangs on a dead mount, the lookups just don't come back until
+     * it returns; the GUI is not affected.
+     *
+     * This is used by ExistingDirValidator and ExistingDirCompleter.
+     **/
+    class DirLookup: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Return the singleton instance of this class.
+	 **/
+	static DirLookup * instance();
+
+	/**
+	 * Return 'true' if it is known without any I/O whether 'path' is a
+	 * directory and return that in 'isDir_ret'.
+	 **/
+	bool knownIsDir( const QString & path, bool & isDir_ret );
+
+	/**
+	 * Return 'true' if the subdirectories of 'dir' are known without any
+	 * I/O and return their names (without path) in 'subDirs_ret'.
+	 **/
+	bool knownSubDirs( const QString & dir, QStringList & subDirs_ret );
+
+	/**
+	 * Check in the background if 'path' is a directory.
+	 * isDirFound() is emitted when the result is there.
+	 **/
+	void requestIsDir( const QString & path );
+
+	/**
+	 * List the subdirectories of 'dir' in the background.
+	 * subDirsFound() is emitted when the result is there.
+	 **/
+	void requestSubDirs( const QString & dir );
+
+	/**
+	 * Return 'path' in the form that is used for all lookups and in all
+	 * signals: Without redundant slashes, "." and "..".
+	 **/
+	static QString normalized( const QString & path );
+
+
+    signals:
+
+	/**
+	 * Emitted when a background check for 'path' is done.
+	 **/
+	void isDirFound( const QString & path, bool isDir );
+
+	/**
+	 * Emitted when the subdirectories of 'dir' are listed.
+	 **/
+	void subDirsFound( const QString & dir, const QStringList & subDirs );
+
+
+    protected slots:
+
+	/**
+	 * Notification that the worker thread is done with 'path'.
+	 **/
+	void workerFinished( const QString	& path,
+			     bool		  isDir,
+			     bool		  listed,
+			     const QStringList	& subDirs );
+
+
+    protected:
+
+	/**
+	 * Constructor. Use instance() instead.
+	 **/
+	DirLookup();
+
+	/**
+	 * Start the worker for the next waiting request if it is idle.
+	 **/
+	void startWorker();
+
+	/**
+	 * Return the directory 'path' in the in-memory tree or 0 if it is
+	 * not there. Return in 'isFile_ret' if there is a non-directory
+	 * item with that path.
+	 **/
+	DirInfo * treeDir( const QString & path, bool & isFile_ret );
+
+	/**
+	 * A result of the worker thread.
+	 **/
+	struct Result
+	{
+	    Result(): isDir( false ), listed( false ), time( 0 ) {}
+
+	    bool	isDir;
+	    bool	listed;		// subDirs is valid
+	    QStringList subDirs;
+	    qint64	time;		// _clock when this was looked up
+	};
+
+	/**
+	 * Return the recent result for 'path' or 0 if there is none.
+	 **/
+	const Result * recentResult( const QString & path ) const;
+
+
+	//
+	// Data members
+	//
+
+	static DirLookup *	_instance;
+
+	bool			_busy;
+	QString			_waitingIsDir;
+	QString			_waitingSubDirs;
+	QHash<QString, Result>	_results;
+	QElapsedTimer		_clock;
+
+    };	// class DirLookup
+
+}	// namespace QDirStat
+
+
+#endif	// DirLookup_h
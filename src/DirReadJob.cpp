@@ -7,34 +7,103 @@
  */
 
 
-#include <dirent.h>     // struct dirent
-#include <fcntl.h>	// AT_ constants (fstatat() flags)
-#include <unistd.h>     // R_OK, X_OK
+#include <errno.h>
 
 #include <QMutableListIterator>
-#include <QMultiMap>
+#include <QSet>
+#include <QElapsedTimer>
 
 #include "DirReadJob.h"
 #include "DirTree.h"
 #include "DirInfo.h"
+#include "Attic.h"
 #include "DirTreeCache.h"
+#include "DirScanner.h"
 #include "ExcludeRules.h"
+#include "MimeCategorizer.h"
 #include "MountPoints.h"
+#include "DeviceTable.h"
+#include "SysUtil.h"
+#include "ScanStats.h"
+#include "OwnerStats.h"
 #include "Exception.h"
+#include "Trace.h"
 
 #define DONT_TRUST_NTFS_HARD_LINKS      1
 #define VERBOSE_NTFS_HARD_LINKS         0
 
+// Rough numbers for estimating the size of a directory that is not read
+// yet for reading the largest directories first: Bytes of the directory
+// itself per entry, how many entries a subdirectory counts for, and the
+// average size of an entry.
+
+#define ESTIMATE_DIR_BYTES_PER_ENTRY	32
+#define ESTIMATE_ENTRIES_PER_SUBDIR	16
+#define ESTIMATE_BYTES_PER_ENTRY	( 64 * 1024LL )
+
+// Rate limit for the "polite scan" mode in directory entries per second:
+// Start with the initial rate, cut it in half if the latency per entry
+// rises above the factor of the baseline latency, otherwise add the step
+// once per adjust interval.
+
+#define POLITE_INITIAL_RATE		2000.0
+#define POLITE_MIN_RATE			  50.0
+#define POLITE_MAX_RATE		       50000.0
+#define POLITE_RATE_STEP		 250.0
+#define POLITE_BACKOFF_LATENCY_FACTOR	   2.0
+#define POLITE_ADJUST_MILLISEC		1000
+#define POLITE_MAX_WAIT_MILLISEC	 250
+
+// Default time slice for reading in the GUI thread: About half a frame, so
+// the user interface still feels smooth
+
+#define DEFAULT_TIME_SLICE_MILLISEC	8
+
+// A huge directory checks the time slice after each this many entries
+
+#define TIME_SLICE_CHECK_ENTRIES	256
+
 using namespace QDirStat;
 
 
+namespace QDirStat
+{
+    /**
+     * What LocalDirReadJob::processScanResult() needs to continue where
+     * it stopped when the time slice was used up.
+     **/
+    struct LocalDirScanProgress
+    {
+	LocalDirScanProgress():
+	    pos( 0 ),
+	    sampleSquareSum( 0.0 ),
+	    nanosec( 0 )
+	    {}
+
+	int		pos;		// Next entry of the scan result
+	ChildrenSummary sampleSum;
+	double		sampleSquareSum;
+	DirFileSummary	fileSummary;
+	qint64		nanosec;	// Building the tree so far
+    };
+}
+
+
+bool DirReadJobQueue::_inodeOrder   = true;
+bool DirReadJobQueue::_largestFirst = false;
+bool DirReadJobQueue::_politeScan   = false;
+int  DirReadJobQueue::_timeSliceMillisec = DEFAULT_TIME_SLICE_MILLISEC;
+
+
 DirReadJob::DirReadJob( DirTree * tree,
 			DirInfo * dir  ):
     _tree( tree ),
     _dir( dir ),
     _queue( 0 )
 {
-    _started = false;
+    _started	  = false;
+    _inode	  = 0;
+    _sizeEstimate = -1;
 
     if ( _dir )
 	_dir->readJobAdded();
@@ -98,6 +167,12 @@ void DirReadJob::childAdded( FileInfo *newChild )
 }
 
 
+void DirReadJob::childrenAdded( DirInfo * parent, const FileInfoList & newChildren )
+{
+    _tree->childrenAddedNotify( parent, newChildren );
+}
+
+
 void DirReadJob::deletingChild( FileInfo *deletedChild )
 {
     _tree->deletingChildNotify( deletedChild );
@@ -143,24 +218,10 @@ bool DirReadJob::crossingFilesystems( DirInfo * parent, DirInfo * child )
 
 QString DirReadJob::device( const DirInfo * dir ) const
 {
-    QString device;
-
-    if ( dir )
-    {
-	MountPoint * mountPoint = MountPoints::findByPath( dir->url() );
-
-        if ( ! mountPoint )
-            mountPoint = MountPoints::findNearestMountPoint( dir->url() );
-
-	if ( mountPoint )
-        {
-	    device = mountPoint->device();
-
-            // logDebug() << "Found " << mountPoint << " for " << dir << endl;
-        }
-    }
+    if ( ! dir )
+	return QString();
 
-    return device;
+    return DeviceTable::info( dir->device(), dir->url() ).deviceName;
 }
 
 
@@ -178,6 +239,7 @@ bool DirReadJob::shouldCrossIntoFilesystem( const DirInfo * dir ) const
     bool doCross =
 	! mountPoint->isSystemMount()  &&	//  /dev, /proc, /sys, ...
 	! mountPoint->isDuplicate()    &&	//  bind mount or multiple mounted
+	! mountPoint->isOverlay()      &&	//  layers are read where they are
 	! mountPoint->isNetworkMount();		//  NFS or CIFS (Samba)
 
     logDebug() << ( doCross ? "Reading" : "Not reading" )
@@ -197,8 +259,10 @@ LocalDirReadJob::LocalDirReadJob( DirTree * tree,
 				  DirInfo * dir ):
     DirReadJob( tree, dir ),
     _applyFileChildExcludeRules( false ),
-    _checkedForNtfs( false ),
-    _isNtfs( false )
+    _scanResult( 0 ),
+    _refreshKeptSubDirs( true ),
+    _sampleFraction( 0.0 ),
+    _progress( 0 )
 {
     if ( _dir )
 	_dirName = _dir->url();
@@ -207,180 +271,402 @@ LocalDirReadJob::LocalDirReadJob( DirTree * tree,
 
 LocalDirReadJob::~LocalDirReadJob()
 {
-    // NOP
+    if ( _scanResult )
+	delete _scanResult;
+
+    if ( _progress )
+	delete _progress;
+
+    // Subdirectories from a smart refresh that are no longer on disk
+
+    foreach ( DirInfo * subDir, _keptSubDirs )
+    {
+	subDir->setParent( 0 );
+	deletingChild( subDir );	// Notify the views and the selection
+	delete subDir;
+    }
+}
+
+
+void LocalDirReadJob::read()
+{
+    if ( _scanResult )
+    {
+	// A worker thread of the DirScanner is done reading this directory,
+	// or the last time slice was not enough for all of its entries; now
+	// do the rest of the work in this (the GUI) thread.
+
+	processScanResult();
+	// This job might be deleted now; don't access any members any more!
+    }
+    else
+    {
+	DirReadJob::read();
+    }
+}
+
+
+void LocalDirReadJob::setScanResult( DirScanResult * scanResult )
+{
+    if ( _scanResult )
+	delete _scanResult;
+
+    _scanResult = scanResult;
 }
 
 
 void LocalDirReadJob::startReading()
 {
-    struct dirent * entry;
-    struct stat	    statInfo;
-    QString	    defaultCacheName = DEFAULT_CACHE_NAME;
-    DIR *	    diskDir;
+    TRACE_SPAN( "LocalDirReadJob::startReading" );
 
     // logDebug() << _dir << endl;
 
-    bool ok = true;
+    // The exclude rules for file children are checked right on the names
+    // from the directory, so an excluded directory is not stat()ed at all.
+    //
+    // Intentionally not also checking the DirTree specific exclude rules
+    // here: They are meant strictly for directory exclude rules.
+
+    QList<QRegExp> excludeFileChildren;
 
-    if ( access( _dirName.toUtf8(), X_OK | R_OK ) != 0 )
+    if ( _applyFileChildExcludeRules )
+	excludeFileChildren = ExcludeRules::instance()->fileChildRegexps();
+
+    if ( _queue && _queue->scanner()->isActive() )
     {
-	ok = false;
-	logWarning() << "No permission to read directory " << _dirName << endl;
-	finishReading( _dir, DirPermissionDenied );
+	// Let a worker thread do the system calls. We'll get the result back
+	// in the next read() call after the queue unblocked this job again.
+
+	_dir->setReadState( DirReading );
+	_queue->dispatchToScanner( this, _dir->rawPath(), _sampleFraction, excludeFileChildren );
+
+	return;
     }
 
-    if ( ok )
-    {
-	diskDir = ::opendir( _dirName.toUtf8() );
+    _scanResult = new DirScanResult();
+    CHECK_NEW( _scanResult );
+
+    DirScanner::scanDir( _dir->rawPath(), *_scanResult, _sampleFraction, excludeFileChildren );
+    processScanResult();
+
+    // Don't add anything after processScanResult() since this deletes this job!
+}
+
+
+void LocalDirReadJob::processScanResult()
+{
+    const DirScanResult & scanResult = *_scanResult;
+    QString defaultCacheName = DEFAULT_CACHE_NAME;
 
-	if ( ! diskDir )
+    if ( ! _progress )	// Not continuing after the last time slice
+    {
+	switch ( scanResult.status )
 	{
-	    logWarning() << "opendir(" << _dirName << ") failed" << endl;
-	    ok = false;
-	    // opendir() doesn't set 'errno' according to POSIX	 :-(
-	    finishReading( _dir, DirError );
+	    case DirScanResult::ScanPermissionDenied:
+		logWarning() << "No permission to read directory " << _dirName << endl;
+		finishReading( _dir, DirPermissionDenied );
+		_tree->setReadError( _dir, scanResult.errorNumber );
+		finished();
+		return;
+
+	    case DirScanResult::ScanOpenDirError:
+		logWarning() << "opendir(" << _dirName << ") failed: "
+			     << formatErrno( scanResult.errorNumber ) << endl;
+		finishReading( _dir, DirError );
+		_tree->setReadError( _dir, scanResult.errorNumber );
+		finished();
+		return;
+
+	    case DirScanResult::ScanOk:
+		break;
+
+	    // No 'default' branch so the compiler can catch unhandled enum values
 	}
-    }
 
-    if ( ok )
-    {
+	_progress = new LocalDirScanProgress();
+	CHECK_NEW( _progress );
+
+	ScanStats::instance()->addScan( _dir->device(), scanResult.entries.size(), scanResult.nanosec );
+
+	if ( queue() )
+	    queue()->scanned( scanResult.entries.size(), scanResult.nanosec );
+
 	_dir->setReadState( DirReading );
-	int dirFd = dirfd( diskDir );
-	int flags = AT_SYMLINK_NOFOLLOW;
+	_dir->dropSample();	// From a previous sampling scan
+	_dir->dropFileSummary();	// From a previous directories-only scan
+    }
 
-#ifdef AT_NO_AUTOMOUNT
-	flags |= AT_NO_AUTOMOUNT;
-#endif
+    QElapsedTimer timer;
+    timer.start();
+
+    // Sums of the non-directory entries that were read, for extrapolating
+    // the others if this was a sampling scan
+
+    ChildrenSummary & sampleSum	      = _progress->sampleSum;
+    double	    & sampleSquareSum = _progress->sampleSquareSum;
+
+    // Non-directory children are inserted in one batch at the end: This
+    // updates the summary fields of all ancestors only once, not once for
+    // each child. Subdirectories are inserted right away since they may
+    // need to be finished or queued for reading immediately.
+
+    FileInfoList newChildren;
 
-	QMultiMap<ino_t, QString> entryMap;
+    // In directories-only mode, the non-directory entries are only added to
+    // this summary, and so are regular files below the fold size.
 
-	while ( ( entry = readdir( diskDir ) ) )
+    bool	     dirsOnly	 = _tree->dirsOnly();
+    FileSize	     foldBelow	 = _dir->filesUnfolded() ? 0 : _tree->foldFilesBelow();
+    DirFileSummary & fileSummary = _progress->fileSummary;
+
+    // The entries are already sorted by i-number (see DirScanner::scanDir()).
+
+    const int startPos = _progress->pos;
+    const int count    = scanResult.entries.size();
+
+    for ( int & pos = _progress->pos; pos < count; ++pos )
+    {
+	int done = pos - startPos;
+
+	if ( done > 0 && done % TIME_SLICE_CHECK_ENTRIES == 0 &&
+	     _queue && _queue->timeSliceUsedUp() )
 	{
-	    QString entryName = QString::fromUtf8( entry->d_name );
+	    // A huge directory: Let the user interface catch up and continue
+	    // with the next time slice. The children so far are already
+	    // inserted then, so the views can show them.
 
-	    if ( entryName != "."  &&
-		 entryName != ".."   )
-	    {
-		entryMap.insert( entry->d_ino, entryName );
-	    }
+	    insertNewChildren( newChildren );
+	    _progress->nanosec += timer.nsecsElapsed();
+
+	    return;
 	}
 
-	// QMultiMap (just like QMap) guarantees sort order by keys, so we are
-	// now iterating over the directory entries by i-number order. Most
-	// filesystems will benefit from that since they store i-nodes sorted
-	// by i-number on disk, so (at least with rotational disks) seek times
-	// are minimized by this strategy.
-	//
-	// Notice that we need a QMultiMap, not just a map: If a file has
-	// multiple hard links in the same directory, a QMap would store only
-	// one of them, all others would go missing in the DirTree.
+	const DirScanEntry & entry = scanResult.entries.at( pos );
+	QString entryName = QString::fromUtf8( scanResult.name( entry ), entry.nameLength );
+
+	// Keep the exact bytes of names that are not valid UTF-8 so those
+	// items can still be found in the filesystem
 
-	foreach ( QString entryName, entryMap )
+	bool keepRawName = entryName.contains( QChar::ReplacementCharacter );
+
+	if ( entry.statErrno == 0 )	// fstatat() OK?
 	{
-	    if ( fstatat( dirFd, entryName.toUtf8(), &statInfo, flags ) == 0 )	// OK?
+	    struct stat statInfo = entry.statInfo;
+
+	    if ( S_ISDIR( statInfo.st_mode ) )	// directory child?
 	    {
-		if ( S_ISDIR( statInfo.st_mode ) )	// directory child?
+		DirInfo * keptSubDir = _keptSubDirs.isEmpty() ?
+		    0 : _keptSubDirs.take( entryName );
+
+		if ( keptSubDir )
+		{
+		    reuseSubDir( keptSubDir );
+		}
+		else
 		{
 		    DirInfo *subDir = new DirInfo( entryName, &statInfo, _tree, _dir );
 		    CHECK_NEW( subDir );
 
-		    processSubDir( entryName, subDir );
+		    if ( keepRawName )
+			subDir->setRawName( scanResult.name( entry ), entry.nameLength );
 
+		    processSubDir( entryName, subDir, entry.ino );
 		}
-		else  // non-directory child
+	    }
+	    else  // non-directory child
+	    {
+		if ( entryName == defaultCacheName &&	// .qdirstat.cache.gz found?
+		     _tree->useCacheFiles() )
 		{
-		    if ( entryName == defaultCacheName )	// .qdirstat.cache.gz found?
-		    {
-			logDebug() << "Found cache file " << defaultCacheName << endl;
+		    logDebug() << "Found cache file " << defaultCacheName << endl;
 
-			// Try to read the cache file. If that was successful and the toplevel
-			// path in that cache file matches the path of the directory we are
-			// reading right now, the directory is finished reading, the read job
-			// (this object) was just deleted, and we may no longer access any
-			// member variables; just return.
+		    // Reading the cache file might delete this subtree, so
+		    // make sure the batch is owned by the tree now.
 
-			if ( readCacheFile( entryName ) )
-			    return;
-		    }
+		    insertNewChildren( newChildren );
+
+		    // Try to read the cache file. If that was successful and the toplevel
+		    // path in that cache file matches the path of the directory we are
+		    // reading right now, the directory is finished reading, the read job
+		    // (this object) was just deleted, and we may no longer access any
+		    // member variables; just return.
+
+		    if ( readCacheFile( entryName ) )
+			return;
+		}
 
 #if DONT_TRUST_NTFS_HARD_LINKS
 
-                    if ( statInfo.st_nlink > 1 && isNtfs() )
-                    {
-                        // NTFS seems to return bogus hard link counts; use 1 instead.
-                        // See  https://github.com/shundhammer/qdirstat/issues/88
+		if ( statInfo.st_nlink > 1 && isNtfs() )
+		{
+		    // NTFS seems to return bogus hard link counts; use 1 instead.
+		    // See  https://github.com/shundhammer/qdirstat/issues/88
 
 #if ! VERBOSE_NTFS_HARD_LINKS
-                        if ( ! _warnedAboutNtfsHardLinks )
+		    if ( ! _warnedAboutNtfsHardLinks )
 #endif
-                        {
-                            logWarning() << "Not trusting NTFS with hard links: \""
-                                         << _dir->url() << "/" << entryName
-                                         << "\" links: " << statInfo.st_nlink
-                                         << " -> resetting to 1"
-                                         << endl;
-                            _warnedAboutNtfsHardLinks = true;
-                        }
-
-                        statInfo.st_nlink = 1;
-                    }
+		    {
+			logWarning() << "Not trusting NTFS with hard links: \""
+				     << _dir->url() << "/" << entryName
+				     << "\" links: " << statInfo.st_nlink
+				     << " -> resetting to 1"
+				     << endl;
+			_warnedAboutNtfsHardLinks = true;
+		    }
+
+		    statInfo.st_nlink = 1;
+		}
 #endif
-		    FileInfo * child = new FileInfo( entryName, &statInfo, _tree, _dir );
-		    CHECK_NEW( child );
+		bool fold = dirsOnly ||
+		    ( S_ISREG( statInfo.st_mode ) && statInfo.st_size < foldBelow );
+
+		if ( fold && statInfo.st_nlink <= 1 && ! checkIgnoreFilters( entryName ) )
+		{
+		    // A temporary object on the stack gets all the sizes
+		    // exactly right without allocating a tree node. Files with
+		    // multiple hard links are excluded since the tree's hard
+		    // link index would keep a pointer to it.
+
+		    FileInfo file( entryName, &statInfo, _tree, _dir );
+		    addToFileSummary( fileSummary, &file );
+		    _tree->ownerStats()->add( &file );
 
-		    if ( checkIgnoreFilters( entryName ) )
+		    if ( scanResult.unsampledEntries > 0 )
 		    {
-			// logDebug() << "Ignoring " << child << endl;
-			_dir->addToAttic( child );
+			sampleSum.add( &file );
+			sampleSquareSum += (double) file.size() * (double) file.size();
 		    }
-		    else
-			_dir->insertChild( child );
 
+		    continue;
+		}
+
+		FileInfo * child = new FileInfo( entryName, &statInfo, _tree, _dir );
+		CHECK_NEW( child );
+
+		if ( keepRawName )
+		    child->setRawName( scanResult.name( entry ), entry.nameLength );
+
+		if ( scanResult.unsampledEntries > 0 )
+		{
+		    sampleSum.add( child );
+		    sampleSquareSum += (double) child->size() * (double) child->size();
+		}
+
+		if ( checkIgnoreFilters( entryName ) )
+		{
+		    // logDebug() << "Ignoring " << child << endl;
+		    _dir->addToAttic( child );
 		    childAdded( child );
 		}
+		else
+		{
+		    newChildren << child;
+		}
 	    }
-	    else  // lstat() error
-	    {
-		handleLstatError( entryName );
-	    }
 	}
+	else  // lstat() error
+	{
+	    errno = entry.statErrno;
+	    handleLstatError( entryName );
+	}
+    }
 
-	closedir( diskDir );
-	DirReadState readState = DirFinished;
+    insertNewChildren( newChildren );
 
-	//
-	// Check all entries against exclude rules that match against any
-	// direct non-directory entry.
-	//
-	// Doing this now is a performance optimization: This could also be
-	// done immediately after each entry is read, but that would mean
-	// iterating over all exclude rules for every single directory entry,
-	// even if there are no exclude rules that match against any
-	// files, so it would be a general performance penalty.
-	//
-	// Doing this after all entries are read means more cleanup if any
-	// exclude rule does match, but that is the exceptional case; if there
-	// are no such rules to begin with, the match function returns 'false'
-	// immediately, so the performance impact is minimal.
-	//
-	// Also intentionally not also checking the DirTree specific exclude
-	// rules here: They are meant strictly for directory exclude rules.
+    if ( fileSummary.files.items > 0 )
+	_dir->setFileSummary( fileSummary );
 
-	if ( _applyFileChildExcludeRules &&
-	     ExcludeRules::instance()->matchDirectChildren( _dir ) )
-	{
-	    excludeDirLate();
-	    readState = DirOnRequestOnly;
-	}
+    if ( scanResult.unsampledEntries > 0 )
+	addSample( sampleSum, sampleSquareSum, scanResult.unsampledEntries );
+
+    DirReadState readState = DirFinished;
 
-	finishReading( _dir, readState );
+    if ( scanResult.excluded )
+    {
+	// A file child matched an exclude rule (see startReading())
+
+	excludeDirLate();
+	readState = DirOnRequestOnly;
     }
 
+    ScanStats::instance()->addTreeBuilding( count, _progress->nanosec + timer.nsecsElapsed() );
+
+    finishReading( _dir, readState );
     finished();
     // Don't add anything after finished() since this deletes this job!
 }
 
 
+void LocalDirReadJob::addSample( const ChildrenSummary & sampleSum,
+				 double			 sampleSquareSum,
+				 int			 unsampledEntries )
+{
+    FileCount n = sampleSum.items;
+
+    if ( n < 1 )
+    {
+	logWarning() << "Empty sample in " << _dir << endl;
+	return;
+    }
+
+    // Assume the entries that were not read are just like the sample
+
+    double   factor = (double) unsampledEntries / n;
+    DirSample sample;
+
+    sample.extra.size		= qRound64( sampleSum.size	    * factor );
+    sample.extra.allocatedSize	= qRound64( sampleSum.allocatedSize * factor );
+    sample.extra.blocks		= qRound64( sampleSum.blocks	    * factor );
+    sample.extra.items		= unsampledEntries;
+    sample.extra.files		= qRound64( sampleSum.files	    * factor );
+    sample.extra.unignoredItems = unsampledEntries;
+
+    // Variance of the extrapolated total N * mean of all N entries with
+    // the finite population correction (1 - n/N); the n sampled entries
+    // themselves are exact, but this is what the estimate for the whole
+    // directory is based on.
+
+    if ( n > 1 )
+    {
+	double total	= n + unsampledEntries;
+	double mean	= (double) sampleSum.size / n;
+	double variance = ( sampleSquareSum - n * mean * mean ) / ( n - 1 );
+
+	sample.variance = total * total * ( 1.0 - n / total ) * qMax( 0.0, variance ) / n;
+    }
+
+    logInfo() << "Read a sample of " << n << " of " << n + unsampledEntries
+	      << " entries in " << _dir << endl;
+
+    _dir->setSample( sample );
+}
+
+
+void LocalDirReadJob::addToFileSummary( DirFileSummary & summary, FileInfo * file )
+{
+    summary.files.add( file );
+
+    if ( ! file->isFile() )
+	return;
+
+    MimeCategory * category = MimeCategorizer::instance()->category( file->name() );
+
+    summary.categorySum[ category ] += file->size();
+    summary.categoryCount[ category ]++;
+}
+
+
+void LocalDirReadJob::insertNewChildren( FileInfoList & newChildren )
+{
+    if ( ! newChildren.isEmpty() )
+    {
+	_dir->insertChildren( newChildren );
+	childrenAdded( _dir, newChildren );
+	newChildren.clear();
+    }
+}
+
+
 void LocalDirReadJob::finishReading( DirInfo * dir, DirReadState readState )
 {
     // logDebug() << dir << endl;
@@ -388,11 +674,20 @@ void LocalDirReadJob::finishReading( DirInfo * dir, DirReadState readState )
 
     dir->setReadState( readState );
     dir->finalizeLocal();
+
+    // In an out-of-core tree, the files go to the spill store now: No view
+    // was told about the children of this directory yet.
+
+    if ( readState == DirFinished )
+	dir->spillFiles();
+
     _tree->sendReadJobFinished( dir );
 }
 
 
-void LocalDirReadJob::processSubDir( const QString & entryName, DirInfo * subDir )
+void LocalDirReadJob::processSubDir( const QString & entryName,
+				     DirInfo	   * subDir,
+				     ino_t	     inode )
 {
     _dir->insertChild( subDir );
     childAdded( subDir );
@@ -406,20 +701,30 @@ void LocalDirReadJob::processSubDir( const QString & entryName, DirInfo * subDir
     {
 	if ( ! crossingFilesystems(_dir, subDir ) ) // normal case
 	{
+	    // A different device number on the same filesystem: Btrfs subvolume
+
+	    if ( subDir->device() != _dir->device() )
+		_tree->subvolumeFound( subDir );
+
 	    LocalDirReadJob * job = new LocalDirReadJob( _tree, subDir );
 	    CHECK_NEW( job );
 	    job->setApplyFileChildExcludeRules( true );
+	    job->setSampleFraction( _sampleFraction );
+	    job->setInode( inode );
 	    _tree->addJob( job );
 	}
 	else	    // The subdirectory we just found is a mount point.
 	{
 	    subDir->setMountPoint();
+	    _tree->estimateSize( subDir );
 
 	    if ( _tree->crossFilesystems() && shouldCrossIntoFilesystem( subDir ) )
 	    {
 		LocalDirReadJob * job = new LocalDirReadJob( _tree, subDir );
 		CHECK_NEW( job );
 		job->setApplyFileChildExcludeRules( true );
+		job->setSampleFraction( _sampleFraction );
+		job->setInode( inode );
 		_tree->addJob( job );
 	    }
 	    else
@@ -431,17 +736,34 @@ void LocalDirReadJob::processSubDir( const QString & entryName, DirInfo * subDir
 }
 
 
+void LocalDirReadJob::reuseSubDir( DirInfo * subDir )
+{
+    _dir->insertChild( subDir );
+    childAdded( subDir );
+
+    if ( ! _refreshKeptSubDirs )
+	return;
+
+    SmartRefreshJob * job = new SmartRefreshJob( _tree, subDir );
+    CHECK_NEW( job );
+    _tree->addJob( job );
+}
+
+
 bool LocalDirReadJob::matchesExcludeRule( const QString & entryName ) const
 {
+    QElapsedTimer timer;
+    timer.start();
+
     QString full = fullName( entryName );
+    bool match = ExcludeRules::instance()->match( full, entryName );
 
-    if ( ExcludeRules::instance()->match( full, entryName ) )
-	return true;
+    if ( ! match && _tree->excludeRules() )
+	match = _tree->excludeRules()->match( full, entryName );
 
-    if ( ! _tree->excludeRules() )
-	return false;
+    ScanStats::instance()->addExcludeCheck( timer.nsecsElapsed() );
 
-    return _tree->excludeRules()->match( full, entryName );
+    return match;
 }
 
 
@@ -450,7 +772,19 @@ bool LocalDirReadJob::checkIgnoreFilters( const QString & entryName ) const
     if ( ! _tree->hasFilters() )
 	return false;
 
-    return _tree->checkIgnoreFilters( fullName( entryName ) );
+    QElapsedTimer timer;
+    timer.start();
+
+    // The filters build the complete path only if they really need it
+
+    bool ignore = _tree->checkIgnoreNameFilters( entryName );
+
+    if ( ! ignore && _tree->hasPathFilters() )
+	ignore = _tree->checkIgnorePathFilters( _dirName, entryName );
+
+    ScanStats::instance()->addExcludeCheck( timer.nsecsElapsed() );
+
+    return ignore;
 }
 
 
@@ -472,7 +806,7 @@ bool LocalDirReadJob::readCacheFile( const QString & cacheFileName )
 	{
 	    logDebug() << "Clearing complete tree" << endl;
 
-	    _tree->clearAndReadCache( cacheFullName );
+	    _tree->clearAndReadCache( cacheFullName, _tree->checkStaleCaches() );
 
 	    // Since this clears the tree and thus the job queue and thus
 	    // deletes this read job, it is important not to do anything after
@@ -484,6 +818,7 @@ bool LocalDirReadJob::readCacheFile( const QString & cacheFileName )
 	else
 	{
 	    cacheReadJob->reader()->rewind();  // Read offset was moved by firstDir()
+	    cacheReadJob->setCheckStale( _tree->checkStaleCaches() );
 	    _tree->addJob( cacheReadJob );     // The job queue will assume ownership of cacheReadJob
 
 	    if ( _dir->parent() )
@@ -622,22 +957,107 @@ bool LocalDirReadJob::isNtfs()
     if ( ! MountPoints::hasNtfs() )
         return false;
 
-    if ( ! _checkedForNtfs )
+    if ( _dirName.isEmpty() )
+        return false;
+
+    return DeviceTable::info( _dir->device(), _dirName ).isNtfs;
+}
+
+
+
+
+
+
+SmartRefreshJob::SmartRefreshJob( DirTree * tree,
+				  DirInfo * dir,
+				  bool	    recursive ):
+    DirReadJob( tree, dir ),
+    _recursive( recursive )
+{
+    // NOP
+}
+
+
+SmartRefreshJob::~SmartRefreshJob()
+{
+    // NOP
+}
+
+
+void SmartRefreshJob::startReading()
+{
+    struct stat statInfo;
+    QString	dirName = _dir->url();
+
+    if ( lstat( dirName.toUtf8(), &statInfo ) != 0 || ! S_ISDIR( statInfo.st_mode ) )
     {
-        _isNtfs         = false;
-        _checkedForNtfs = true;
+	// Gone or no longer a directory. Let a LocalDirReadJob take care of
+	// the error handling.
 
-        if ( ! _dirName.isEmpty() )
-        {
-            MountPoint * mountPoint = MountPoints::findNearestMountPoint( _dirName );
-            _isNtfs = mountPoint && mountPoint->isNtfs();
-        }
+	logDebug() << "Can't stat " << dirName << " - rereading" << endl;
+	reread( _dir->mtime() );
+    }
+    else if ( _recursive &&
+	      statInfo.st_mtime == _dir->mtime() &&
+	      ! _dir->readError() )
+    {
+	refreshSubDirs();
+    }
+    else
+    {
+#if 0
+	logDebug() << dirName << " changed - rereading" << endl;
+#endif
+	reread( statInfo.st_mtime );
     }
 
-    return _isNtfs;
+    finished();
+    // Don't add anything after finished() since this deletes this job!
+}
+
+
+void SmartRefreshJob::refreshSubDirs()
+{
+    FileInfo * child = _dir->firstChild();
+
+    while ( child )
+    {
+	if ( child->isDirInfo() && ! child->isPseudoDir() )
+	{
+	    DirInfo * subDir = child->toDirInfo();
+
+	    // Leave excluded directories and mount points that were not read
+	    // alone
+
+	    if ( subDir->readState() != DirOnRequestOnly )
+	    {
+		SmartRefreshJob * job = new SmartRefreshJob( _tree, subDir );
+		CHECK_NEW( job );
+		_tree->addJob( job );
+	    }
+	}
+
+	child = child->next();
+    }
 }
 
 
+void SmartRefreshJob::reread( time_t mtime )
+{
+    QHash<QString, DirInfo *> keptSubDirs = _tree->detachSubDirs( _dir );
+
+    _tree->ownerStats()->invalidate();	// The old children are gone
+    _dir->reset();
+    _dir->setExcluded( false );
+    _dir->setMtime( mtime );
+    _dir->setReadState( DirReading );
+
+    LocalDirReadJob * job = new LocalDirReadJob( _tree, _dir );
+    CHECK_NEW( job );
+    job->setApplyFileChildExcludeRules( _dir->parent() != _tree->root() );
+    job->setKeptSubDirs( keptSubDirs, _recursive );
+    _tree->addJob( job );
+}
 
 
 
@@ -647,6 +1067,8 @@ CacheReadJob::CacheReadJob( DirTree	* tree,
 			    CacheReader * reader )
     : ObjDirReadJob( tree, parent )
     , _reader( reader )
+    , _checkStale( false )
+    , _refreshAll( false )
 {
     if ( _reader )
 	_reader->rewind();
@@ -659,6 +1081,8 @@ CacheReadJob::CacheReadJob( DirTree	  * tree,
 			    DirInfo	  * parent,
 			    const QString & cacheFileName )
     : ObjDirReadJob( tree, parent )
+    , _checkStale( false )
+    , _refreshAll( false )
 {
     _reader = new CacheReader( cacheFileName, tree, parent );
     CHECK_NEW( _reader );
@@ -711,38 +1135,194 @@ void CacheReadJob::read()
     if ( _reader->eof() || ! _reader->ok() )
     {
 	// logDebug() << "Cache reading finished - ok: " << _reader->ok() << endl;
+
+	if ( _reader->ok() )
+	{
+	    if ( _refreshAll && _reader->pendingDirs().isEmpty() )
+		refreshAll();
+	    else if ( _checkStale && _reader->pendingDirs().isEmpty() )
+		refreshStaleDirs();
+
+	    resumePendingDirs();
+	}
+
 	finished();
     }
 }
 
 
+void CacheReadJob::resumePendingDirs()
+{
+    QList<DirInfo *> pendingDirs = _reader->pendingDirs();
 
+    if ( pendingDirs.isEmpty() )
+	return;
 
+    // Let the reader finalize the tree first; that would also clean up the
+    // dot entries of the pending directories.
 
-DirReadJobQueue::DirReadJobQueue()
-    : QObject()
-{
-    connect( &_timer, SIGNAL( timeout() ),
-	     this,    SLOT  ( timeSlicedRead() ) );
-}
+    delete _reader;
+    _reader = 0;
 
+    logInfo() << "Resuming reading at " << pendingDirs.size() << " pending directories" << endl;
 
-DirReadJobQueue::~DirReadJobQueue()
-{
-    clear();
+    foreach ( DirInfo * dir, pendingDirs )
+    {
+	dir->reset();
+
+	LocalDirReadJob * job = new LocalDirReadJob( tree(), dir );
+	CHECK_NEW( job );
+
+	tree()->addJob( job );
+    }
 }
 
 
-void DirReadJobQueue::enqueue( DirReadJob * job )
+
+void CacheReadJob::refreshStaleDirs()
 {
-    if ( job )
-    {
-	_queue.append( job );
-	job->setQueue( this );
+    DirInfo * toplevel = _reader->toplevel();
+
+    if ( ! toplevel )
+	return;
+
+    // The time the cache file was written
+
+    struct stat statInfo;
+
+    if ( stat( _reader->fileName().toUtf8(), &statInfo ) != 0 )
+	return;
+
+    time_t cacheTime = statInfo.st_mtime;
+
+    // Only a spot check of the directories at the top: Checking all of
+    // them would take almost as long as reading them. A SmartRefreshJob
+    // then checks the complete subtree of an outdated one.
+
+    QList<DirInfo *> staleDirs;
+
+    if ( isStale( toplevel, cacheTime, true ) )
+    {
+	staleDirs << toplevel;
+    }
+    else
+    {
+	for ( FileInfo * child = toplevel->firstChild(); child; child = child->next() )
+	{
+	    if ( ! child->isDirInfo() || child->isPseudoDir() )
+		continue;
+
+	    DirInfo * subDir = child->toDirInfo();
+
+	    if ( subDir->readState() != DirOnRequestOnly && isStale( subDir, cacheTime, false ) )
+		staleDirs << subDir;
+	}
+    }
+
+    foreach ( DirInfo * dir, staleDirs )
+    {
+	logInfo() << "Cache file " << _reader->fileName()
+		  << " is outdated for " << dir << " - rereading" << endl;
+
+	SmartRefreshJob * job = new SmartRefreshJob( tree(), dir );
+	CHECK_NEW( job );
+	tree()->addJob( job );
+    }
+}
+
+
+void CacheReadJob::refreshAll()
+{
+    DirInfo * toplevel = _reader->toplevel();
+
+    if ( ! toplevel )
+	return;
+
+    logInfo() << "Checking " << toplevel << " for changes since "
+	      << _reader->fileName() << " was written" << endl;
+
+    SmartRefreshJob * job = new SmartRefreshJob( tree(), toplevel );
+    CHECK_NEW( job );
+    tree()->addJob( job );
+}
+
+
+bool CacheReadJob::isStale( DirInfo * dir, time_t cacheTime, bool toplevel )
+{
+    struct stat statInfo;
+
+    if ( lstat( dir->url().toUtf8(), &statInfo ) != 0 || ! S_ISDIR( statInfo.st_mode ) )
+	return true;
+
+    // The ctime also changes when the mtime is set back, e.g. by a backup
+    // restore, and with permission or owner changes
+
+    if ( statInfo.st_ctime > cacheTime )
+	return true;
+
+    if ( toplevel )
+	return statInfo.st_mtime > cacheTime;
+
+    return statInfo.st_mtime != dir->mtime();
+}
+
+
+
+
+
+DirReadJobQueue::DirReadJobQueue()
+    : QObject()
+    , _currentJob( 0 )
+    , _idleIo( false )
+{
+    connect( &_timer, SIGNAL( timeout() ),
+	     this,    SLOT  ( timeSlicedRead() ) );
+
+    connect( &_scanner, SIGNAL( scanFinished( DirReadJob *, DirScanResult * ) ),
+	     this,	SLOT  ( scanFinished( DirReadJob *, DirScanResult * ) ) );
+}
+
+
+DirReadJobQueue::~DirReadJobQueue()
+{
+    clear();
+}
+
+
+void DirReadJobQueue::enqueue( DirReadJob * job )
+{
+    if ( job )
+    {
+	if ( _currentJob && _priorityJobs.contains( _currentJob ) )
+	{
+	    // A subdirectory of a directory that is read with priority
+
+	    _priorityJobs.insert( job );
+	    _queue.insert( priorityPos(), job );
+	}
+	else
+	{
+	    _queue.append( job );
+	}
+
+	queued( job );
+	job->setQueue( this );
 
 	if ( ! _timer.isActive() )
 	{
 	    // logDebug() << "First job queued" << endl;
+
+	    if ( ! ScanStats::instance()->isRunning() )
+		ScanStats::instance()->start();
+
+	    if ( _politeScan )
+	    {
+		// For reading in this thread without worker threads
+
+		_rateLimiter.reset();
+		_idleIo = SysUtil::setIdleIoPriority( true );
+	    }
+
 	    emit startingReading();
 	    _timer.start( 0 );
 	}
@@ -755,7 +1335,11 @@ DirReadJob * DirReadJobQueue::dequeue()
     DirReadJob * job = _queue.takeFirst();
 
     if ( job )
+    {
+	unqueued( job );
+	_priorityJobs.remove( job );
 	job->setQueue( 0 );
+    }
 
     return job;
 }
@@ -763,10 +1347,17 @@ DirReadJob * DirReadJobQueue::dequeue()
 
 void DirReadJobQueue::clear()
 {
+    _scanner.cancelAll();
     qDeleteAll( _queue );
     qDeleteAll( _blocked );
     _queue.clear();
     _blocked.clear();
+    _priorityJobs.clear();
+    _queuedDevices.clear();
+    _queuedCount.clear();
+    _inodeQueues.clear();
+    _sizeQueues.clear();
+    _lastInode.clear();
 }
 
 
@@ -785,14 +1376,22 @@ void DirReadJobQueue::abort()
     }
 
     clear();
+    ScanStats::instance()->finish();
 }
 
 
 void DirReadJobQueue::killAll( DirInfo * subtree, DirReadJob * exceptJob )
 {
-    if ( ! subtree )
+    // Each directory knows how many read jobs there are in its subtree, so
+    // there is nothing to do (and no need to check the whole queue) if
+    // there are none.
+
+    if ( ! subtree || subtree->pendingReadJobs() == 0 )
 	return;
 
+    QSet<DirInfo *> dirs;
+    collectPendingDirs( subtree, dirs );
+
     QMutableListIterator<DirReadJob *> it( _queue );
     int count = 0;
 
@@ -806,11 +1405,13 @@ void DirReadJobQueue::killAll( DirInfo * subtree, DirReadJob * exceptJob )
 	    continue;
 	}
 
-	if ( job->dir() && job->dir()->isInSubtree( subtree ) )
+	if ( job->dir() && dirs.contains( job->dir() ) )
 	{
 	    // logDebug() << "Killing " << job << endl;
 	    ++count;
 	    it.remove();
+	    unqueued( job );
+	    _priorityJobs.remove( job );
 	    delete job;
 	}
     }
@@ -827,11 +1428,13 @@ void DirReadJobQueue::killAll( DirInfo * subtree, DirReadJob * exceptJob )
 	    continue;
 	}
 
-	if ( job->dir() && job->dir()->isInSubtree( subtree ) )
+	if ( job->dir() && dirs.contains( job->dir() ) )
 	{
 	    // logDebug() << "Killing " << job << endl;
 	    ++count;
 	    it.remove();
+	    cancelScan( job );
+	    _priorityJobs.remove( job );
 	    delete job;
 	}
     }
@@ -840,12 +1443,425 @@ void DirReadJobQueue::killAll( DirInfo * subtree, DirReadJob * exceptJob )
 }
 
 
+void DirReadJobQueue::prioritize( DirInfo * subtree )
+{
+    if ( ! subtree || subtree->pendingReadJobs() == 0 )
+	return;
+
+    QSet<DirInfo *> dirs;
+    collectPendingDirs( subtree, dirs );
+
+    // Jobs that are already in the scanner are not moved, but the jobs for
+    // their subdirectories will get priority.
+
+    foreach ( DirReadJob * job, _blocked )
+    {
+	if ( job->dir() && dirs.contains( job->dir() ) )
+	    _priorityJobs.insert( job );
+    }
+
+    // Keep the started jobs at the head of the queue, then the jobs for
+    // this subtree, then all others, each in their previous order.
+
+    QList<DirReadJob *> started;
+    QList<DirReadJob *> bumped;
+    QList<DirReadJob *> others;
+
+    foreach ( DirReadJob * job, _queue )
+    {
+	if ( job->started() )
+	    started << job;
+	else if ( job->dir() && dirs.contains( job->dir() ) )
+	{
+	    bumped << job;
+	    _priorityJobs.insert( job );
+	}
+	else
+	    others << job;
+    }
+
+    if ( bumped.isEmpty() )
+	return;
+
+    _queue = started + bumped + others;
+
+    logDebug() << "Reading " << bumped.size() << " dirs in " << subtree << " first" << endl;
+}
+
+
+int DirReadJobQueue::priorityPos() const
+{
+    int pos = 0;
+
+    while ( pos < _queue.size() && _queue.at( pos )->started() )
+	++pos;
+
+    return pos;
+}
+
+
+void DirReadJobQueue::collectPendingDirs( DirInfo * dir, QSet<DirInfo *> & dirs )
+{
+    // The directory of each read job has a pending read job itself, and so
+    // has each of its ancestors; so only descend into those. This is
+    // proportional to the number of read jobs in this subtree, not to the
+    // size of the subtree.
+
+    dirs.insert( dir );
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() && child->pendingReadJobs() > 0 )
+	    collectPendingDirs( child->toDirInfo(), dirs );
+    }
+
+    if ( dir->attic() && dir->attic()->pendingReadJobs() > 0 )
+	collectPendingDirs( dir->attic(), dirs );
+}
+
+
+bool DirReadJobQueue::pendingDirs( QList<DirInfo *> & dirs ) const
+{
+    bool complete = true;
+
+    foreach ( DirReadJob * job, _queue + _blocked )
+    {
+	if ( ! job->dir() || dynamic_cast<ObjDirReadJob *>( job ) )
+	{
+	    // Cache and package read jobs have no local directory to read
+
+	    complete = false;
+	    continue;
+	}
+
+	dirs << job->dir();
+    }
+
+    return complete;
+}
+
+
 void DirReadJobQueue::timeSlicedRead()
+{
+    ScanStats::instance()->sampleQueue( count(), _scanner.pendingCount() );
+
+    // Read as many jobs as fit into the time slice: Most directories are
+    // small, and a trip through the event loop for each one of them costs
+    // more than reading it.
+
+    _sliceTimer.start();
+
+    do
+    {
+	if ( ! readNextJob() )
+	    break;
+    }
+    while ( _timeSliceMillisec > 0 && ! timeSliceUsedUp() );
+
+    _sliceTimer.invalidate();
+}
+
+
+bool DirReadJobQueue::timeSliceUsedUp() const
+{
+    return _timeSliceMillisec > 0 &&
+	_sliceTimer.isValid() && _sliceTimer.elapsed() >= _timeSliceMillisec;
+}
+
+
+bool DirReadJobQueue::readNextJob()
 {
     if ( _queue.isEmpty() )
+    {
 	_timer.stop();
-    else
-	_queue.first()->read();
+	return false;
+    }
+
+    // Take the first job that can make progress: One that is already
+    // started, or one for a device that still has worker threads
+    // available. So a slow device cannot hold up reading the others.
+    //
+    // Started jobs are normally at the head of the queue since
+    // scanFinished() prepends them, so stop looking as soon as all devices
+    // with jobs in the queue turned out to be saturated.
+
+    DirReadJob * job = 0;
+    QSet<dev_t> saturated;
+
+    foreach ( DirReadJob * candidate, _queue )
+    {
+	if ( candidate->started() )
+	{
+	    job = candidate;
+	    break;
+	}
+
+	dev_t device = _queuedDevices.value( candidate );
+
+	if ( saturated.contains( device ) )
+	    continue;
+
+	if ( ! scannerSaturated( device ) )
+	{
+	    // Jobs with priority are at the head of the queue; don't let the
+	    // i-number order get in their way.
+
+	    if ( _priorityJobs.contains( candidate ) )
+		job = candidate;
+	    else if ( _sizeQueues.contains( device ) )
+		job = nextLargest( device );
+	    else if ( _inodeQueues.contains( device ) )
+		job = nextInInodeOrder( device );
+	    else
+		job = candidate;
+
+	    break;
+	}
+
+	saturated.insert( device );
+
+	if ( saturated.size() >= _queuedCount.size() )
+	    break;
+    }
+
+    if ( ! job )
+    {
+	// There is enough work lined up for the scanner threads. Wait until
+	// one of them delivers a result; that will restart the timer.
+
+	_timer.stop();
+	return false;
+    }
+
+    if ( _politeScan && ! job->started() )
+    {
+	int wait = _rateLimiter.waitMillisec();
+
+	if ( wait > 0 )
+	{
+	    // Keep the timer running so new jobs don't restart it right away;
+	    // scan results still restart it without any delay.
+
+	    _timer.start( wait );
+	    return false;
+	}
+    }
+
+    if ( _timer.interval() > 0 )
+	_timer.start( 0 );
+
+    _currentJob = job;
+    job->read();	// This might delete the job
+    _currentJob = 0;
+
+    return true;
+}
+
+
+bool DirReadJobQueue::scannerSaturated( dev_t device ) const
+{
+    if ( ! _scanner.isActive() )
+	return false;
+
+    // Keep the worker threads busy, but don't dispatch the complete queue:
+    // The results need to be processed in this thread, and they should come
+    // in at about the same rate as they are processed.
+
+    return _scanner.pendingCount( device ) >= 2 * _scanner.threadCount( device );
+}
+
+
+dev_t DirReadJobQueue::jobDevice( DirReadJob * job )
+{
+    return job->dir() ? job->dir()->device() : 0;
+}
+
+
+void DirReadJobQueue::queued( DirReadJob * job )
+{
+    dev_t device = jobDevice( job );
+
+    _queuedDevices.insert( job, device );
+    _queuedCount[ device ]++;
+
+    if ( job->started() )
+	return;
+
+    if ( _largestFirst && job->dir() )
+    {
+	if ( job->sizeEstimate() < 0 )
+	    job->setSizeEstimate( estimateSize( job ) );
+
+	_sizeQueues[ device ].insert( job->sizeEstimate(), job );
+    }
+    else if ( _inodeOrder && job->inode() != 0 && isRotational( device ) )
+    {
+	_inodeQueues[ device ].insert( job->inode(), job );
+    }
+}
+
+
+void DirReadJobQueue::unqueued( DirReadJob * job )
+{
+    QHash<DirReadJob *, dev_t>::iterator it = _queuedDevices.find( job );
+
+    if ( it == _queuedDevices.end() )
+	return;
+
+    QHash<dev_t, int>::iterator count = _queuedCount.find( it.value() );
+
+    if ( count != _queuedCount.end() && --count.value() <= 0 )
+	_queuedCount.erase( count );
+
+    QHash<dev_t, QMultiMap<quint64, DirReadJob *> >::iterator inodeQueue =
+	_inodeQueues.find( it.value() );
+
+    if ( inodeQueue != _inodeQueues.end() )
+    {
+	inodeQueue.value().remove( job->inode(), job );
+
+	if ( inodeQueue.value().isEmpty() )
+	    _inodeQueues.erase( inodeQueue );
+    }
+
+    QHash<dev_t, QMultiMap<FileSize, DirReadJob *> >::iterator sizeQueue =
+	_sizeQueues.find( it.value() );
+
+    if ( sizeQueue != _sizeQueues.end() )
+    {
+	sizeQueue.value().remove( job->sizeEstimate(), job );
+
+	if ( sizeQueue.value().isEmpty() )
+	    _sizeQueues.erase( sizeQueue );
+    }
+
+    _queuedDevices.erase( it );
+}
+
+
+DirReadJob * DirReadJobQueue::nextInInodeOrder( dev_t device )
+{
+    QMultiMap<quint64, DirReadJob *> & inodeQueue = _inodeQueues[ device ];
+
+    if ( inodeQueue.isEmpty() )
+	return 0;
+
+    QMultiMap<quint64, DirReadJob *>::iterator it =
+	inodeQueue.lowerBound( _lastInode.value( device ) );
+
+    if ( it == inodeQueue.end() )	// Start over with the lowest i-number
+	it = inodeQueue.begin();
+
+    _lastInode[ device ] = it.key();
+
+    return it.value();
+}
+
+
+DirReadJob * DirReadJobQueue::nextLargest( dev_t device )
+{
+    QMultiMap<FileSize, DirReadJob *> & sizeQueue = _sizeQueues[ device ];
+
+    if ( sizeQueue.isEmpty() )
+	return 0;
+
+    return ( sizeQueue.end() - 1 ).value();
+}
+
+
+FileSize DirReadJobQueue::estimateSize( DirReadJob * job )
+{
+    DirInfo * dir = job->dir();
+
+    if ( ! dir )
+	return 0;
+
+    FileSize estimate = dir->sizeEstimate();	// Mount points only
+
+    if ( estimate >= 0 )
+	return estimate;
+
+    FileSize entries = dir->rawByteSize() / ESTIMATE_DIR_BYTES_PER_ENTRY;
+    FileSize subDirs = dir->links() > 2 ? dir->links() - 2 : 0;
+
+    entries += subDirs * ESTIMATE_ENTRIES_PER_SUBDIR;
+
+    return entries * ESTIMATE_BYTES_PER_ENTRY;
+}
+
+
+void DirReadJobQueue::setPoliteScan( bool enable )
+{
+    _politeScan = enable;
+    DirScanner::setIdleIoPriority( enable );
+}
+
+
+void DirReadJobQueue::scanned( int entries, qint64 nanosec )
+{
+    if ( _politeScan )
+	_rateLimiter.scanned( entries, nanosec );
+}
+
+
+bool DirReadJobQueue::isRotational( dev_t device )
+{
+    bool rotational = DeviceTable::isRotational( device );
+
+    if ( rotational && ! _inodeOrderDevices.contains( device ) )
+    {
+	_inodeOrderDevices.insert( device );
+	logInfo() << "Reading device " << (quint64) device << " in i-number order" << endl;
+    }
+
+    return rotational;
+}
+
+
+void DirReadJobQueue::dispatchToScanner( DirReadJob	      * job,
+					 const QByteArray     & dirName,
+					 double			sampleFraction,
+					 const QList<QRegExp> & excludeFileChildren )
+{
+    CHECK_PTR( job );
+
+    _queue.removeOne( job );
+    unqueued( job );
+    _blocked.append( job );
+    _scanner.scan( job, dirName, jobDevice( job ), sampleFraction, excludeFileChildren );
+}
+
+
+void DirReadJobQueue::scanFinished( DirReadJob * job, DirScanResult * scanResult )
+{
+    LocalDirReadJob * localJob = dynamic_cast<LocalDirReadJob *>( job );
+
+    if ( ! localJob || ! _blocked.contains( job ) )
+    {
+	logError() << "Unexpected scan result for " << job << endl;
+	delete scanResult;
+
+	return;
+    }
+
+    localJob->setScanResult( scanResult );
+
+    // Process the result as soon as possible to keep the number of
+    // unprocessed results (and thus the memory they need) low.
+
+    _blocked.removeOne( job );
+    _queue.prepend( job );
+    queued( job );
+
+    if ( ! _timer.isActive() || _timer.interval() > 0 )
+	_timer.start( 0 );
+}
+
+
+void DirReadJobQueue::cancelScan( DirReadJob * job )
+{
+    if ( _scanner.isPending( job ) )
+	_scanner.cancel( job );
 }
 
 
@@ -856,19 +1872,29 @@ void DirReadJobQueue::jobFinishedNotify( DirReadJob *job )
 	// Get rid of the old (finished) job.
 
 	_queue.removeOne( job );
+	unqueued( job );
+	_priorityJobs.remove( job );
 	delete job;
     }
 
     // The timer will start a new job when it fires.
 
     if ( _queue.isEmpty() && _blocked.isEmpty() )	// No new job available - we're done.
+    {
+	ScanStats::instance()->finish();
+	_scanner.tuner()->writeSettings();
+
+	if ( _idleIo )
+	    _idleIo = ! SysUtil::setIdleIoPriority( false );
+
 	emit finished();
+    }
 }
 
 
 void DirReadJobQueue::deletingChildNotify( FileInfo * child )
 {
-    if ( child && child->isDirInfo() )
+    if ( child && child->isDirInfo() && child->pendingReadJobs() > 0 )
     {
 	logDebug() << "Killing all pending read jobs for " << child << endl;
 	killAll( child->toDirInfo() );
@@ -882,6 +1908,16 @@ void DirReadJobQueue::addBlocked( DirReadJob * job )
 }
 
 
+void DirReadJobQueue::block( DirReadJob * job )
+{
+    CHECK_PTR( job );
+
+    _queue.removeOne( job );
+    unqueued( job );
+    _blocked.append( job );
+}
+
+
 void DirReadJobQueue::unblock( DirReadJob * job )
 {
     _blocked.removeAll( job );
@@ -890,3 +1926,82 @@ void DirReadJobQueue::unblock( DirReadJob * job )
     if ( _blocked.isEmpty() )
 	logDebug() << "No more jobs waiting for external processes" << endl;
 }
+
+
+
+
+ScanRateLimiter::ScanRateLimiter()
+{
+    reset();
+}
+
+
+void ScanRateLimiter::reset()
+{
+    _rate     = POLITE_INITIAL_RATE;
+    _budget   = 0.0;
+    _latency  = 0.0;
+    _baseline = 0.0;
+    _refillTimer.start();
+    _adjustTimer.start();
+}
+
+
+int ScanRateLimiter::waitMillisec()
+{
+    // Refill the budget for the time since the last call, but don't let it
+    // grow beyond one second's worth after a pause
+
+    _budget = qMin( _rate, _budget + _rate * _refillTimer.restart() / 1000.0 );
+
+    if ( _budget > 0.0 )
+	return 0;
+
+    int wait = (int) ( -_budget / _rate * 1000.0 ) + 1;
+
+    return qMin( wait, POLITE_MAX_WAIT_MILLISEC );
+}
+
+
+void ScanRateLimiter::scanned( int entries, qint64 nanosec )
+{
+    _budget -= entries;
+
+    if ( entries > 0 && nanosec > 0 )
+    {
+	double latency = (double) nanosec / entries;
+
+	_latency  = _latency  > 0.0 ? 0.8 * _latency + 0.2 * latency : latency;
+	_baseline = _baseline > 0.0 ? qMin( _baseline, _latency )  : _latency;
+    }
+
+    if ( _adjustTimer.elapsed() >= POLITE_ADJUST_MILLISEC )
+	adjustRate();
+}
+
+
+void ScanRateLimiter::adjustRate()
+{
+    _adjustTimer.restart();
+
+    if ( _latency > POLITE_BACKOFF_LATENCY_FACTOR * _baseline )
+    {
+	double oldRate = _rate;
+	_rate = qMax( POLITE_MIN_RATE, _rate / 2 );
+
+	if ( _rate < oldRate )
+	{
+	    logInfo() << "Latency " << (int) _latency << " ns per entry; backing off to "
+		      << (int) _rate << " entries per second" << endl;
+	}
+    }
+    else
+    {
+	_rate = qMin( POLITE_MAX_RATE, _rate + POLITE_RATE_STEP );
+    }
+
+    // The first directories might have been in the page cache; don't
+    // stick to that baseline forever.
+
+    _baseline *= 1.05;
+}
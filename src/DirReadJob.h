@@ -12,8 +12,13 @@
 
 
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMultiMap>
+#include <QSet>
 
 #include "FileInfo.h"
+#include "DirScanner.h"
 #include "Logger.h"
 
 
@@ -25,6 +30,9 @@ namespace QDirStat
     class CacheReader;
     class DirReadJobQueue;
     class MountPoint;
+    struct ChildrenSummary;
+    struct DirFileSummary;
+    struct LocalDirScanProgress;
 
 
     /**
@@ -99,6 +107,35 @@ namespace QDirStat
 	 **/
 	void setQueue( DirReadJobQueue * queue ) { _queue = queue; }
 
+	/**
+	 * Return 'true' if reading was already started for this job.
+	 **/
+	bool started() const { return _started; }
+
+	/**
+	 * Return the i-number of the directory to read or 0 if it is not
+	 * known. The queue uses this to read directories on rotational disks
+	 * in i-number order.
+	 **/
+	quint64 inode() const { return _inode; }
+
+	/**
+	 * Set the i-number of the directory to read.
+	 **/
+	void setInode( quint64 inode ) { _inode = inode; }
+
+	/**
+	 * Return the estimated size of the subtree of the directory to read
+	 * that the queue uses for reading the largest directories first, or
+	 * -1 if it was not estimated yet.
+	 **/
+	FileSize sizeEstimate() const { return _sizeEstimate; }
+
+	/**
+	 * Set the estimated size of the subtree of the directory to read.
+	 **/
+	void setSizeEstimate( FileSize estimate ) { _sizeEstimate = estimate; }
+
 
     protected:
 
@@ -118,6 +155,15 @@ namespace QDirStat
 	 **/
 	void childAdded( FileInfo *newChild );
 
+	/**
+	 * Notification that a batch of new children has been added to 'parent'
+	 * with DirInfo::insertChildren().
+	 *
+	 * This is the batch version of childAdded(); derived classes are
+	 * required to call either one of them for each new child.
+	 **/
+	void childrenAdded( DirInfo * parent, const FileInfoList & newChildren );
+
 	/**
 	 * Notification that a child is about to be deleted.
 	 *
@@ -160,6 +206,8 @@ namespace QDirStat
 	DirInfo *	   _dir;
 	DirReadJobQueue *  _queue;
 	bool		   _started;
+	quint64		   _inode;
+	FileSize	   _sizeEstimate;
 
     };	// class DirReadJob
 
@@ -245,6 +293,48 @@ namespace QDirStat
 	void setApplyFileChildExcludeRules( bool val )
 	    { _applyFileChildExcludeRules = val; }
 
+	/**
+	 * Set the fraction of the non-directory entries of very large
+	 * directories to read; the others are extrapolated from that sample
+	 * (see DirTree::sampleFraction()). The read jobs for subdirectories
+	 * inherit this. The default is 0.0, i.e. read everything.
+	 **/
+	void setSampleFraction( double fraction )
+	    { _sampleFraction = fraction; }
+
+	/**
+	 * Read the directory: Start reading if this was not done yet, or
+	 * process the result that a DirScanner worker thread delivered.
+	 *
+	 * Reimplemented from DirReadJob.
+	 **/
+	virtual void read() Q_DECL_OVERRIDE;
+
+	/**
+	 * Set the result of reading this directory in a DirScanner worker
+	 * thread. This job takes over ownership of 'scanResult'; it will be
+	 * processed in the next call to read().
+	 **/
+	void setScanResult( DirScanResult * scanResult );
+
+	/**
+	 * Set subdirectories that were already read before and that should be
+	 * used again instead of reading them from scratch if a subdirectory
+	 * with the same name is still there. The key of the hash is the name.
+	 *
+	 * This is used for a smart refresh (see SmartRefreshJob): Each of
+	 * those subdirectories that is used again gets a SmartRefreshJob of
+	 * its own unless 'refreshKeptSubDirs' is 'false'. This job takes over
+	 * ownership of all of them; the ones that are not used again are
+	 * deleted.
+	 **/
+	void setKeptSubDirs( const QHash<QString, DirInfo *> & keptSubDirs,
+			     bool refreshKeptSubDirs = true )
+	{
+	    _keptSubDirs	= keptSubDirs;
+	    _refreshKeptSubDirs = refreshKeptSubDirs;
+	}
+
     protected:
 
 	/**
@@ -254,6 +344,31 @@ namespace QDirStat
 	 **/
 	virtual void startReading();
 
+	/**
+	 * Create the FileInfo / DirInfo nodes for the entries of the scan
+	 * result, handle the special cases (cache files, exclude rules) and
+	 * finish reading.
+	 *
+	 * For a huge directory, this stops in the middle when the time slice
+	 * of the queue is used up; the next read() call continues there.
+	 * Otherwise this will delete this job, so don't access any members
+	 * after it returns.
+	 **/
+	void processScanResult();
+
+	/**
+	 * Insert a batch of new (non-ignored) children into the directory of
+	 * this job and send the corresponding notification. 'newChildren' is
+	 * empty afterwards.
+	 **/
+	void insertNewChildren( FileInfoList & newChildren );
+
+	/**
+	 * Add 'file' (a temporary object that is not in the tree) to the file
+	 * summary of a directory that is read in directories-only mode.
+	 **/
+	void addToFileSummary( DirFileSummary & summary, FileInfo * file );
+
 	/**
 	 * Finish reading the directory: Set the specified read state, send
 	 * signals and finalize the directory (clean up dot entries etc.).
@@ -261,10 +376,17 @@ namespace QDirStat
 	void finishReading( DirInfo * dir, DirReadState readState );
 
 	/**
-	 * Process one subdirectory entry.
+	 * Process one subdirectory entry with i-number 'inode'.
 	 **/
 	void processSubDir( const QString & entryName,
-			    DirInfo	  * subDir    );
+			    DirInfo	  * subDir,
+			    ino_t	    inode     );
+
+	/**
+	 * Insert a subdirectory from the kept subdirectories again and queue
+	 * a SmartRefreshJob for it.
+	 **/
+	void reuseSubDir( DirInfo * subDir );
 
 	/**
 	 * Return 'true' if 'entryName' matches an exclude rule of the
@@ -300,9 +422,9 @@ namespace QDirStat
 	void handleLstatError( const QString & entryName );
 
 	/**
-	 * Exclude the directory of this read job after it is almost completely
-	 * read. This is used when checking for exclude rules matching direct
-	 * file children of a directory.
+	 * Exclude the directory of this read job after it is read. This is
+	 * used when an exclude rule matches a direct file child of the
+	 * directory.
 	 *
 	 * The main purpose of having this as a separate function is to have a
 	 * clear backtrace if it segfaults.
@@ -319,15 +441,28 @@ namespace QDirStat
 	 **/
 	bool isNtfs();
 
+	/**
+	 * Extrapolate the 'unsampledEntries' entries of this directory that
+	 * were not read from the 'sampleCount' entries that were read with
+	 * the sum 'sampleSum' and the sum of the squared sizes
+	 * 'sampleSquareSum', and add the result to the directory.
+	 **/
+	void addSample( const ChildrenSummary & sampleSum,
+			double			sampleSquareSum,
+			int			unsampledEntries );
+
 
 	//
 	// Data members
 	//
 
-	QString _dirName;
-	bool	_applyFileChildExcludeRules;
-	bool	_checkedForNtfs;
-	bool	_isNtfs;
+	QString		_dirName;
+	bool		_applyFileChildExcludeRules;
+	DirScanResult * _scanResult;
+	QHash<QString, DirInfo *> _keptSubDirs;
+	bool		_refreshKeptSubDirs;
+	double		_sampleFraction;
+	LocalDirScanProgress * _progress;	// of processScanResult()
 
 	static bool _warnedAboutNtfsHardLinks;
 
@@ -335,6 +470,70 @@ namespace QDirStat
 
 
 
+    /**
+     * Read job for a smart refresh of a directory that was read before
+     * (from disk or from a cache file):
+     *
+     * If the modification time of the directory did not change, no entry
+     * was added, removed or renamed, so the children are kept as they are;
+     * only the subdirectories get a SmartRefreshJob of their own.
+     *
+     * Otherwise the directory is read again with a LocalDirReadJob, but
+     * subdirectories that are still there are used again (also with a
+     * SmartRefreshJob of their own) rather than read from scratch.
+     *
+     * Notice that changes of file contents that do not change the directory
+     * (e.g. a log file that grew) are not noticed by this. That is the
+     * price for not having to look at every single file.
+     *
+     * A non-recursive SmartRefreshJob always reads its directory again
+     * (keeping the subdirectories), but it leaves the subdirectories alone.
+     * This is used when a change in that directory is known (see
+     * DirWatcher).
+     **/
+    class SmartRefreshJob: public DirReadJob
+    {
+    public:
+
+	/**
+	 * Constructor. If 'recursive' is 'false', only 'dir' itself is read
+	 * again, not its subdirectories.
+	 **/
+	SmartRefreshJob( DirTree * tree, DirInfo * dir, bool recursive = true );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~SmartRefreshJob();
+
+    protected:
+
+	/**
+	 * Check the directory and either keep it or read it again.
+	 *
+	 * Reimplemented from DirReadJob.
+	 **/
+	virtual void startReading() Q_DECL_OVERRIDE;
+
+	/**
+	 * Queue a SmartRefreshJob for each subdirectory that was completely
+	 * read before.
+	 **/
+	void refreshSubDirs();
+
+	/**
+	 * Read the directory again, using the subdirectories that are
+	 * completely read again where possible.
+	 **/
+	void reread( time_t mtime );
+
+
+	bool _recursive;
+
+    };	// SmartRefreshJob
+
+
+
     class CacheReadJob: public ObjDirReadJob
     {
 	Q_OBJECT
@@ -382,6 +581,29 @@ namespace QDirStat
 	 **/
 	CacheReader * reader() const { return _reader; }
 
+	/**
+	 * Check if the cache file is outdated when it is read completely:
+	 * Spot-check the first directory of the cache file and its
+	 * subdirectories against the filesystem and read those that changed
+	 * since the cache file was written again with a SmartRefreshJob.
+	 *
+	 * This is meant for cache files that are found while reading a
+	 * directory.
+	 **/
+	void setCheckStale( bool check ) { _checkStale = check; }
+
+	/**
+	 * Check the complete tree from the cache file against the filesystem
+	 * when it is read completely: A recursive SmartRefreshJob for its
+	 * first directory reads only the directories again whose
+	 * modification time changed since then. This is more thorough than
+	 * setCheckStale(), but it needs one lstat() for each directory.
+	 *
+	 * This is meant for cache files that QDirStat wrote for itself (see
+	 * SessionCache).
+	 **/
+	void setRefreshAll( bool refresh ) { _refreshAll = refresh; }
+
 
     protected:
 
@@ -390,13 +612,103 @@ namespace QDirStat
 	 **/
 	void init();
 
+	/**
+	 * Queue a SmartRefreshJob for each directory that the spot check
+	 * finds outdated. See setCheckStale().
+	 **/
+	void refreshStaleDirs();
+
+	/**
+	 * Queue a SmartRefreshJob for the first directory of the cache file.
+	 * See setRefreshAll().
+	 **/
+	void refreshAll();
+
+	/**
+	 * Return 'true' if directory 'dir' from the cache file that was
+	 * written at 'cacheTime' changed since then. If 'toplevel' is
+	 * 'true', a change in the second the cache file was written is
+	 * tolerated: Writing the cache file into that directory changes it.
+	 **/
+	static bool isStale( DirInfo * dir, time_t cacheTime, bool toplevel );
+
+	/**
+	 * Queue a LocalDirReadJob for each directory that the cache file
+	 * lists as pending, i.e. that was not read yet when the cache file
+	 * was written as a checkpoint of an interrupted scan.
+	 *
+	 * If there are any, this destroys the reader to finalize the tree
+	 * before the new jobs are queued.
+	 **/
+	void resumePendingDirs();
+
 
 	CacheReader * _reader;
+	bool	      _checkStale;
+	bool	      _refreshAll;
 
     };	// class CacheReadJob
 
 
 
+    /**
+     * Rate limiter for the "polite scan" mode of DirReadJobQueue: It allows
+     * reading a number of directory entries per second, and it adapts that
+     * rate to the time each entry takes to read (readdir() and lstat()):
+     * When that latency rises above what it was before, the disks are
+     * probably busy with something else, so the rate is cut in half;
+     * otherwise it slowly increases again.
+     **/
+    class ScanRateLimiter
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	ScanRateLimiter();
+
+	/**
+	 * Start over with the initial rate, e.g. for a new scan.
+	 **/
+	void reset();
+
+	/**
+	 * Return the number of milliseconds to wait before reading the next
+	 * directory or 0 if that can be done now.
+	 **/
+	int waitMillisec();
+
+	/**
+	 * Notification that 'entries' directory entries were read in
+	 * 'nanosec' nanoseconds.
+	 **/
+	void scanned( int entries, qint64 nanosec );
+
+	/**
+	 * Return the current rate in entries per second.
+	 **/
+	double rate() const { return _rate; }
+
+    protected:
+
+	/**
+	 * Adjust the rate to the latency once in a while.
+	 **/
+	void adjustRate();
+
+
+	double	      _rate;		// entries per second
+	double	      _budget;		// entries that may be read right now
+	double	      _latency;		// moving average, nanosec per entry
+	double	      _baseline;	// latency when the disks are not busy
+	QElapsedTimer _refillTimer;
+	QElapsedTimer _adjustTimer;
+
+    };	// class ScanRateLimiter
+
+
+
     /**
      * Queue for read jobs
      *
@@ -451,6 +763,13 @@ namespace QDirStat
 	 **/
 	void addBlocked( DirReadJob * job );
 
+	/**
+	 * Move a job that is in the queue to the blocked jobs, e.g. because
+	 * it has to wait for more data from an external process. It will not
+	 * be scheduled until unblock() is called for it.
+	 **/
+	void block( DirReadJob * job );
+
 	/**
 	 * Notification that a job that was blocked is now ready to be
 	 * scheduled, so it will be taken out of the list of blocked jobs and
@@ -474,6 +793,28 @@ namespace QDirStat
 	 **/
 	void killAll( DirInfo * subtree, DirReadJob * exceptJob = 0 );
 
+	/**
+	 * Read the directories in 'subtree' before all others: Move the jobs
+	 * for them that are not started yet to the head of the queue. The
+	 * jobs for any subdirectories found while reading them go there as
+	 * well, so the complete subtree is read first.
+	 *
+	 * This is for the directories the user is looking at while reading
+	 * is still in progress. It only changes the order of the jobs, not
+	 * how many are read at the same time.
+	 **/
+	void prioritize( DirInfo * subtree );
+
+	/**
+	 * Collect the directories of all pending jobs in 'dirs', i.e. the
+	 * directories whose contents are not read yet.
+	 *
+	 * Return 'false' if there is any job that cannot simply be restarted
+	 * with a LocalDirReadJob for its directory (e.g. a CacheReadJob or a
+	 * PkgReadJob); 'dirs' is incomplete then.
+	 **/
+	bool pendingDirs( QList<DirInfo *> & dirs ) const;
+
 	/**
 	 * Notification that a job is finished.
 	 * This takes that job out of the queue and deletes it.
@@ -481,6 +822,99 @@ namespace QDirStat
 	 **/
 	void jobFinishedNotify( DirReadJob *job );
 
+	/**
+	 * Set the number of worker threads for reading local directories.
+	 * 0 or 1 means to read everything in the GUI thread.
+	 **/
+	void setScanThreads( int threadCount )
+	    { _scanner.setThreadCount( threadCount ); }
+
+	/**
+	 * Enable or disable reading the directories on rotational disks in
+	 * i-number order instead of in the order they were queued. Most
+	 * filesystems store the i-nodes sorted by i-number on disk, so this
+	 * saves a lot of seeking.
+	 **/
+	static void setInodeOrder( bool enable ) { _inodeOrder = enable; }
+
+	/**
+	 * Return 'true' if directories on rotational disks are read in
+	 * i-number order.
+	 **/
+	static bool inodeOrder() { return _inodeOrder; }
+
+	/**
+	 * Enable or disable reading the directories that are probably the
+	 * largest first (see estimateSize()) instead of in the order they
+	 * were queued. The totals of a large tree are then close to their
+	 * final values much earlier during reading. This takes precedence
+	 * over the i-number order.
+	 **/
+	static void setLargestFirst( bool enable ) { _largestFirst = enable; }
+
+	/**
+	 * Return 'true' if the largest directories are read first.
+	 **/
+	static bool largestFirst() { return _largestFirst; }
+
+	/**
+	 * Enable or disable the "polite scan" mode to read a filesystem that
+	 * is in production use without slowing down everything else: All
+	 * directories are read with the idle I/O priority, and new
+	 * directories are only started as fast as the ScanRateLimiter
+	 * allows, which backs off as soon as reading becomes slower.
+	 **/
+	static void setPoliteScan( bool enable );
+
+	/**
+	 * Return 'true' if the "polite scan" mode is enabled.
+	 **/
+	static bool politeScan() { return _politeScan; }
+
+	/**
+	 * Set the time slice for reading in this (the GUI) thread in
+	 * milliseconds: Each call of timeSlicedRead() processes as many jobs
+	 * as fit into it before it returns to the event loop, and a job for
+	 * a huge directory stops in the middle when it is used up. 0 means
+	 * one job at a time, no matter how long it takes.
+	 **/
+	static void setTimeSlice( int millisec ) { _timeSliceMillisec = millisec; }
+
+	/**
+	 * Return the time slice for reading in milliseconds.
+	 **/
+	static int timeSlice() { return _timeSliceMillisec; }
+
+	/**
+	 * Return 'true' if the current time slice is used up, so a job that
+	 * is not done yet should return and continue with its next read()
+	 * call.
+	 **/
+	bool timeSliceUsedUp() const;
+
+	/**
+	 * Notification that a job read 'entries' directory entries in
+	 * 'nanosec' nanoseconds. This is what the rate limit of the "polite
+	 * scan" mode adapts to.
+	 **/
+	void scanned( int entries, qint64 nanosec );
+
+	/**
+	 * Return the scanner that manages the worker threads.
+	 **/
+	DirScanner * scanner() { return &_scanner; }
+
+	/**
+	 * Let a scanner worker thread read the directory for 'job'. The job
+	 * is moved to the blocked jobs until the worker thread is done; then
+	 * it is moved to the head of the queue again so the result is
+	 * processed with the next time slice.
+	 **/
+	void dispatchToScanner( DirReadJob	       * job,
+				const QByteArray     & dirName,
+				double		       sampleFraction	   = 0.0,
+				const QList<QRegExp> & excludeFileChildren = QList<QRegExp>() );
+
 
     signals:
 
@@ -521,12 +955,112 @@ namespace QDirStat
 	 **/
 	void timeSlicedRead();
 
+	/**
+	 * Notification that a scanner worker thread is done reading the
+	 * directory for 'job'.
+	 **/
+	void scanFinished( DirReadJob * job, DirScanResult * scanResult );
+
 
     protected:
 
-	QList<DirReadJob *>  _queue;
-	QList<DirReadJob *>  _blocked;
-	QTimer		     _timer;
+	/**
+	 * Read the next job that can make progress. Return 'false' if there
+	 * is nothing more to do in this time slice.
+	 **/
+	bool readNextJob();
+
+	/**
+	 * Return 'true' if all scanner worker threads for 'device' are busy
+	 * and enough work is lined up for them, so no more jobs for that
+	 * device should be dispatched to the scanner for the time being.
+	 **/
+	bool scannerSaturated( dev_t device ) const;
+
+	/**
+	 * Return the device of the directory of 'job'.
+	 **/
+	static dev_t jobDevice( DirReadJob * job );
+
+	/**
+	 * Bookkeeping for the number of jobs for each device in the queue:
+	 * Call queued() after 'job' was added to the queue and unqueued()
+	 * after it was removed.
+	 **/
+	void queued  ( DirReadJob * job );
+	void unqueued( DirReadJob * job );
+
+	/**
+	 * Return the position in the queue for a job with priority: After the
+	 * started jobs at the head of the queue that have results waiting to
+	 * be processed.
+	 **/
+	int priorityPos() const;
+
+	/**
+	 * Add 'dir' and all directories below it that have pending read jobs
+	 * in their subtree to 'dirs'.
+	 **/
+	static void collectPendingDirs( DirInfo * dir, QSet<DirInfo *> & dirs );
+
+	/**
+	 * Return the job for 'device' that is next in i-number order: The one
+	 * with the next higher i-number than the last one, starting over with
+	 * the lowest one at the end, like an elevator.
+	 **/
+	DirReadJob * nextInInodeOrder( dev_t device );
+
+	/**
+	 * Return the job for 'device' with the largest size estimate.
+	 **/
+	DirReadJob * nextLargest( dev_t device );
+
+	/**
+	 * Estimate the size of the subtree of the directory of 'job' before
+	 * it is read: The size estimate of a mount point if there is one,
+	 * otherwise from the number of entries, judging from the size of the
+	 * directory itself and from its link count (the number of its
+	 * subdirectories + 2).
+	 **/
+	static FileSize estimateSize( DirReadJob * job );
+
+	/**
+	 * Return 'true' if 'device' is a rotational disk (see DeviceTable).
+	 **/
+	bool isRotational( dev_t device );
+
+	/**
+	 * Remove 'job' from the scanner's pending scans before it is deleted.
+	 **/
+	void cancelScan( DirReadJob * job );
+
+
+	QList<DirReadJob *>	   _queue;
+	QList<DirReadJob *>	   _blocked;
+	QTimer			   _timer;
+	DirScanner		   _scanner;
+	QHash<DirReadJob *, dev_t> _queuedDevices;
+	QHash<dev_t, int>	   _queuedCount;
+	QSet<dev_t>		   _inodeOrderDevices;	// logged already
+	QHash<dev_t, quint64>	   _lastInode;
+	QSet<DirReadJob *>	   _priorityJobs;
+	DirReadJob *		   _currentJob;	// The job that is reading right now
+	ScanRateLimiter		   _rateLimiter;
+	bool			   _idleIo;	// GUI thread has idle I/O priority
+	QElapsedTimer		   _sliceTimer;	// Only valid in timeSlicedRead()
+
+	// The jobs that were not started yet for each rotational disk by i-number
+
+	QHash<dev_t, QMultiMap<quint64, DirReadJob *> > _inodeQueues;
+
+	// The jobs that were not started yet for each device by size estimate
+
+	QHash<dev_t, QMultiMap<FileSize, DirReadJob *> > _sizeQueues;
+
+	static bool		   _inodeOrder;
+	static bool		   _largestFirst;
+	static bool		   _politeScan;
+	static int		   _timeSliceMillisec;
     };
 
 
@@ -0,0 +1,718 @@
+/*
+ *   File name: DirScanner.cpp
+ *   Summary:	Multi-threaded directory reading for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <errno.h>
+#include <string.h>	// strlen()
+#include <dirent.h>	// opendir(), readdir()
+#include <fcntl.h>	// open(), AT_ constants (fstatat() flags)
+#include <unistd.h>	// access(), R_OK, X_OK
+
+#ifdef __linux__
+#  include <sys/syscall.h>	// SYS_getdents64
+#endif
+
+#include <algorithm>	// std::stable_sort()
+
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+#include "DirScanner.h"
+#include "StatRing.h"
+#include "DeviceTable.h"
+#include "SysUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Use getdents64() directly instead of readdir() where available: This reads
+// the directory with a lot less system calls because of the larger buffer,
+// and the names can be copied right from the buffer.
+
+#if defined( __linux__ ) && defined( SYS_getdents64 )
+#  define USE_GETDENTS64	1
+#else
+#  define USE_GETDENTS64	0
+#endif
+
+// Use statx() instead of fstatat() where available: It allows to request
+// only the fields that are really needed, which saves some work on some
+// filesystems (in particular on network filesystems).
+
+#if defined( __linux__ ) && defined( STATX_BASIC_STATS )
+#  define USE_STATX		1
+#else
+#  define USE_STATX		0
+#endif
+
+// Buffer size for getdents64(); this is on the stack of the calling thread.
+
+#define GETDENTS_BUF_SIZE	( 64 * 1024 )
+
+// Minimum number of entries in a directory to use io_uring for the stat
+// calls; for only a handful, the overhead is not worth it.
+
+#define STAT_RING_MIN_ENTRIES	8
+
+// Number of worker threads for a rotational disk. More would only make the
+// disk seek more.
+
+#define ROTATIONAL_DISK_THREADS	2
+
+// Number of worker threads for each Btrfs subvolume on a rotational disk.
+// Otherwise, the subvolumes share the normal number of threads.
+
+#define ROTATIONAL_SUBVOLUME_THREADS	1
+
+// Only directories with at least this many non-directory entries are
+// sampled in a sampling scan, and the sample has at least this size.
+
+#define SAMPLE_MIN_ENTRIES	10000
+#define SAMPLE_MIN_SIZE		1000
+
+// Number of slots in the ring buffer for handing the results of the worker
+// threads over to the GUI thread. Each slot is only a ticket and a pointer.
+
+#define RESULT_RING_SIZE	4096
+
+using namespace QDirStat;
+
+
+bool DirScanner::_useStatRing = false;
+bool DirScanner::_idleIoPriority = false;
+
+
+#if USE_GETDENTS64
+
+/**
+ * Directory entry as returned by the getdents64() system call.
+ * glibc does not have a declaration for this before version 2.30.
+ **/
+struct LinuxDirent64
+{
+    quint64		d_ino;
+    qint64		d_off;
+    unsigned short	d_reclen;
+    unsigned char	d_type;
+    char		d_name[1];	// actually d_reclen - 19 bytes
+};
+
+#endif
+
+
+#if USE_STATX
+
+// Set to 'false' if the kernel does not know statx() (ENOSYS). This is not
+// protected by a mutex: If several threads find out at the same time, it is
+// simply set several times.
+
+static volatile bool haveStatx = true;
+
+#endif
+
+
+static bool inodeLessThan( const DirScanEntry & a, const DirScanEntry & b )
+{
+    return a.ino < b.ino;
+}
+
+
+DirScanner::DirScanner( QObject * parent ):
+    QObject( parent ),
+    _threadCount( 0 ),
+    _nextTicket( 0 ),
+    _results( RESULT_RING_SIZE ),
+    _collectScheduled( 0 ),
+    _overflowCount( 0 )
+{
+    // NOP
+}
+
+
+DirScanner::~DirScanner()
+{
+    cancelAll();
+
+    foreach ( QThreadPool * pool, _threadPools )
+	pool->waitForDone();
+
+    qDeleteAll( _threadPools );
+
+    // Get rid of any results that came in after the last collectResults()
+
+    ScanResultPair leftOver;
+
+    while ( _results.pop( leftOver ) )
+	delete leftOver.second;
+
+    foreach ( const ScanResultPair & pair, _overflow )
+	delete pair.second;
+
+    _overflow.clear();
+}
+
+
+void DirScanner::setThreadCount( int threadCount )
+{
+    _threadCount = qMax( 0, threadCount );
+
+    if ( isActive() )
+    {
+	for ( QHash<dev_t, QThreadPool *>::const_iterator it = _threadPools.constBegin();
+	      it != _threadPools.constEnd();
+	      ++it )
+	{
+	    int threads = poolThreadCount( it.key() );
+
+	    _deviceThreadCount[ it.key() ] = threads;
+	    it.value()->setMaxThreadCount( threads );
+	}
+
+	logInfo() << "Using " << _threadCount << " directory reading threads per device" << endl;
+    }
+}
+
+
+QThreadPool * DirScanner::threadPool( dev_t device, const QByteArray & dirName )
+{
+    QThreadPool * pool = _threadPools.value( device, 0 );
+
+    if ( ! pool )
+    {
+	int threads = poolThreadCount( device );
+
+	if ( ScanTuner::isEnabled() && ! _subvolumes.contains( device ) )
+	{
+	    const DeviceInfo & info = DeviceTable::info( device, QString::fromUtf8( dirName ) );
+	    threads = _tuner.addDevice( device, info.deviceName, threads );
+	}
+
+	logInfo() << "Using " << threads << " directory reading threads for "
+		  << ( _subvolumes.contains( device ) ? "subvolume " : "device " )
+		  << (quint64) device << endl;
+
+	pool = new QThreadPool();
+	CHECK_NEW( pool );
+
+	pool->setMaxThreadCount( threads );
+	_threadPools.insert( device, pool );
+	_deviceThreadCount.insert( device, threads );
+    }
+
+    return pool;
+}
+
+
+int DirScanner::poolThreadCount( dev_t device ) const
+{
+    QHash<dev_t, bool>::const_iterator it = _subvolumes.constFind( device );
+
+    if ( it != _subvolumes.constEnd() )
+    {
+	// There are often many subvolumes (snapshots) on the same disk, and
+	// each one has a pool of its own: Share the threads between them,
+	// but give each one at least one thread.
+
+	if ( it.value() )
+	    return qMin( _threadCount, ROTATIONAL_SUBVOLUME_THREADS );
+
+	return qMax( 1, _threadCount / _subvolumes.size() );
+    }
+
+    int tuned = _tuner.threads( device );
+
+    if ( tuned > 0 )
+	return tuned;
+
+    if ( DeviceTable::isRotational( device ) )
+	return qMin( _threadCount, ROTATIONAL_DISK_THREADS );
+
+    return _threadCount;
+}
+
+
+void DirScanner::setSubvolume( dev_t device, bool rotational )
+{
+    if ( _subvolumes.contains( device ) )
+	return;
+
+    _subvolumes.insert( device, rotational );
+
+    // Now the threads are shared by more subvolumes
+
+    for ( QHash<dev_t, bool>::const_iterator it = _subvolumes.constBegin();
+	  it != _subvolumes.constEnd();
+	  ++it )
+    {
+	QThreadPool * pool = _threadPools.value( it.key(), 0 );
+
+	if ( pool )
+	{
+	    int threads = poolThreadCount( it.key() );
+	    pool->setMaxThreadCount( threads );
+	    _deviceThreadCount[ it.key() ] = threads;
+	}
+    }
+}
+
+
+void DirScanner::scan( DirReadJob	     * job,
+		       const QByteArray     & dirName,
+		       dev_t		      device,
+		       double		      sampleFraction,
+		       const QList<QRegExp> & excludeFileChildren )
+{
+    CHECK_PTR( job );
+
+    quint64 ticket = ++_nextTicket;
+    _pendingJobs.insert( ticket, job );
+    _pendingTickets.insert( job, ticket );
+    _ticketDevices.insert( ticket, device );
+    _devicePendingCount[ device ]++;
+
+    DirScanWorker * worker = new DirScanWorker( this, ticket, dirName, sampleFraction,
+						excludeFileChildren );
+    CHECK_NEW( worker );
+
+    threadPool( device, dirName )->start( worker ); // The thread pool takes over ownership
+}
+
+
+void DirScanner::cancel( DirReadJob * job )
+{
+    if ( _pendingTickets.contains( job ) )
+    {
+	quint64 ticket = _pendingTickets.take( job );
+	_pendingJobs.remove( ticket );
+    }
+}
+
+
+void DirScanner::cancelAll()
+{
+    _pendingJobs.clear();
+    _pendingTickets.clear();
+}
+
+
+void DirScanner::workerDone( quint64 ticket, DirScanResult * result )
+{
+    // This is called in the context of a worker thread!
+
+    if ( ! _results.push( ScanResultPair( ticket, result ) ) )
+    {
+	// The GUI thread is lagging far behind; don't wait for it.
+
+	QMutexLocker locker( &_mutex );
+	_overflow << ScanResultPair( ticket, result );
+	_overflowCount.ref();
+    }
+
+    // Collect all results that arrive until the GUI thread gets to it in
+    // one go; don't flood the GUI thread's event queue with one event for
+    // each directory.
+
+    if ( _collectScheduled.testAndSetOrdered( 0, 1 ) )
+	QMetaObject::invokeMethod( this, "collectResults", Qt::QueuedConnection );
+}
+
+
+void DirScanner::collectResults()
+{
+    // Clear the flag before taking the results: Anything that is delivered
+    // from now on that this call might miss schedules another call.
+
+    _collectScheduled.fetchAndStoreOrdered( 0 );
+
+    QList<ScanResultPair> results;
+    ScanResultPair next;
+
+    while ( _results.pop( next ) )
+	results << next;
+
+    if ( _overflowCount.loadAcquire() > 0 )
+    {
+	QMutexLocker locker( &_mutex );
+	results << _overflow;
+	_overflow.clear();
+	_overflowCount.storeRelease( 0 );
+    }
+
+    foreach ( const ScanResultPair & pair, results )
+    {
+	// This worker thread is free again, no matter if the job is still
+	// interested in the result.
+
+	QHash<quint64, dev_t>::iterator it = _ticketDevices.find( pair.first );
+
+	if ( it != _ticketDevices.end() )
+	{
+	    dev_t device = it.value();
+	    bool  busy	 = _devicePendingCount.value( device ) >= _deviceThreadCount.value( device );
+
+	    _devicePendingCount[ device ]--;
+	    _ticketDevices.erase( it );
+	    tuneThreads( device, pair.second, busy );
+	}
+
+	DirReadJob * job = _pendingJobs.take( pair.first );
+
+	if ( job )
+	{
+	    _pendingTickets.remove( job );
+	    emit scanFinished( job, pair.second ); // The receiver takes over ownership
+	}
+	else // The job was cancelled in the meantime
+	{
+	    delete pair.second;
+	}
+    }
+}
+
+
+void DirScanner::tuneThreads( dev_t device, const DirScanResult * result, bool busy )
+{
+    if ( ! ScanTuner::isEnabled() )
+	return;
+
+    int threads = _tuner.addScan( device, result->entries.size(), result->nanosec, busy );
+
+    if ( threads > 0 )
+    {
+	QThreadPool * pool = _threadPools.value( device, 0 );
+
+	if ( pool )
+	{
+	    pool->setMaxThreadCount( threads );
+	    _deviceThreadCount[ device ] = threads;
+	}
+    }
+}
+
+
+/**
+ * Add a directory entry with name 'name' (with 'len' bytes), i-number 'ino'
+ * and type 'type' to 'result' unless it is "." or "..".
+ **/
+static void addEntry( DirScanResult & result,
+		      const char    * name,
+		      int	      len,
+		      ino_t	      ino,
+		      uchar	      type )
+{
+    if ( name[0] == '.' &&
+	 ( len == 1 || ( len == 2 && name[1] == '.' ) ) )
+    {
+	return; // Skip "." and ".."
+    }
+
+    DirScanEntry scanEntry;
+    scanEntry.nameOffset = result.names.size();
+    scanEntry.nameLength = len;
+    scanEntry.ino	 = ino;
+    scanEntry.type	 = type;
+    scanEntry.statErrno	 = 0;
+
+    result.names.append( name, len );
+    result.names.append( '\0' );
+    result.entries.append( scanEntry );
+}
+
+
+#if USE_GETDENTS64
+
+/**
+ * Read all entries of the open directory 'dirFd' into 'result' with
+ * getdents64().
+ **/
+static void readEntries( int dirFd, DirScanResult & result )
+{
+    // quint64 for the alignment of LinuxDirent64
+    quint64 buf[ GETDENTS_BUF_SIZE / sizeof( quint64 ) ];
+
+    while ( true )
+    {
+	long len = syscall( SYS_getdents64, dirFd, buf, sizeof( buf ) );
+
+	if ( len <= 0 )		// End of directory or error
+	    return;
+
+	const char * ptr = (const char *) buf;
+	const char * end = ptr + len;
+
+	while ( ptr < end )
+	{
+	    const LinuxDirent64 * entry = (const LinuxDirent64 *) ptr;
+	    addEntry( result, entry->d_name, strlen( entry->d_name ), entry->d_ino, entry->d_type );
+	    ptr += entry->d_reclen;
+	}
+    }
+}
+
+#endif
+
+
+/**
+ * Get the information about 'name' in directory 'dirFd' like fstatat()
+ * without following symlinks. Return 0 if OK, errno otherwise.
+ **/
+static int statEntry( int dirFd, const char * name, struct stat * statInfo )
+{
+    int flags = AT_SYMLINK_NOFOLLOW;
+
+#ifdef AT_NO_AUTOMOUNT
+    flags |= AT_NO_AUTOMOUNT;
+#endif
+
+#if USE_STATX
+
+    if ( haveStatx )
+    {
+	struct statx stx;
+
+	if ( statx( dirFd, name, flags, StatRing::statxMask(), &stx ) == 0 )
+	{
+	    StatRing::toStat( &stx, statInfo );
+	    return 0;
+	}
+
+	if ( errno != ENOSYS )
+	    return errno;
+
+	haveStatx = false;	// Old kernel: Use fstatat() from now on
+    }
+
+#endif
+
+    if ( fstatat( dirFd, name, statInfo, flags ) != 0 )
+	return errno;
+
+    return 0;
+}
+
+
+/**
+ * Return 'true' if 'entry' might be a directory, i.e. if it needs to be
+ * stat()ed in any case.
+ **/
+static inline bool mightBeDir( const DirScanEntry & entry )
+{
+    return entry.type == DT_DIR || entry.type == DT_UNKNOWN;
+}
+
+
+/**
+ * Return 'true' if the name of any non-directory entry of 'result' matches
+ * any of 'patterns'. Entries of unknown type are only stat()ed if their name
+ * matches.
+ **/
+static bool matchFileChildren( int		      dirFd,
+			       const DirScanResult  & result,
+			       const QList<QRegExp> & patterns )
+{
+    foreach ( const DirScanEntry & entry, result.entries )
+    {
+	if ( entry.type == DT_DIR )
+	    continue;
+
+	QString name = QString::fromUtf8( result.name( entry ), entry.nameLength );
+	bool	match = false;
+
+	for ( int i = 0; i < patterns.size() && ! match; ++i )
+	    match = patterns.at( i ).exactMatch( name );
+
+	if ( match && entry.type == DT_UNKNOWN )
+	{
+	    struct stat statInfo;
+
+	    if ( statEntry( dirFd, result.name( entry ), &statInfo ) == 0 &&
+		 S_ISDIR( statInfo.st_mode ) )
+	    {
+		match = false;
+	    }
+	}
+
+	if ( match )
+	    return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * Keep only a random sample of about 'fraction' of the non-directory
+ * entries of 'result', but all entries that might be directories. Store
+ * the number of the dropped entries in result.unsampledEntries.
+ **/
+static void sampleEntries( DirScanResult    & result,
+			   double	      fraction,
+			   const QByteArray & dirName )
+{
+    int candidates = 0;
+
+    foreach ( const DirScanEntry & entry, result.entries )
+    {
+	if ( ! mightBeDir( entry ) )
+	    ++candidates;
+    }
+
+    if ( candidates < SAMPLE_MIN_ENTRIES )
+	return;
+
+    fraction = qMax( fraction, (double) SAMPLE_MIN_SIZE / candidates );
+
+    if ( fraction >= 1.0 )
+	return;
+
+    // A simple xorshift generator seeded from the directory name: This
+    // needs no locking, and the same directory always gets the same sample.
+
+    quint32 state     = qHash( dirName ) | 1;
+    quint32 threshold = (quint32) ( fraction * 4294967295.0 );
+
+    DirScanEntryList sample;
+    sample.reserve( result.entries.size() - candidates + (int) ( fraction * candidates ) + 1 );
+
+    foreach ( const DirScanEntry & entry, result.entries )
+    {
+	if ( ! mightBeDir( entry ) )
+	{
+	    state ^= state << 13;
+	    state ^= state >> 17;
+	    state ^= state << 5;
+
+	    if ( state > threshold )
+	    {
+		++result.unsampledEntries;
+		continue;
+	    }
+	}
+
+	sample.append( entry );
+    }
+
+    result.entries = sample;
+}
+
+
+void DirScanner::scanDir( const QByteArray     & dirName,
+			  DirScanResult	       & result,
+			  double		 sampleFraction,
+			  const QList<QRegExp> & excludeFileChildren )
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    result.entries.clear();
+    result.names.clear();
+    result.unsampledEntries = 0;
+    result.errorNumber	    = 0;
+    result.excluded	    = false;
+
+    if ( access( dirName, X_OK | R_OK ) != 0 )
+    {
+	result.status	   = DirScanResult::ScanPermissionDenied;
+	result.errorNumber = errno;
+	return;
+    }
+
+#if USE_GETDENTS64
+
+    int dirFd = open( dirName, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+    if ( dirFd < 0 )
+    {
+	result.status	   = DirScanResult::ScanOpenDirError;
+	result.errorNumber = errno;
+	return;
+    }
+
+    readEntries( dirFd, result );
+
+#else
+
+    DIR * diskDir = ::opendir( dirName );
+
+    if ( ! diskDir )
+    {
+	result.status	   = DirScanResult::ScanOpenDirError;
+	result.errorNumber = errno;
+	return;
+    }
+
+    int dirFd = dirfd( diskDir );
+    struct dirent * entry;
+
+    while ( ( entry = readdir( diskDir ) ) )
+	addEntry( result, entry->d_name, strlen( entry->d_name ), entry->d_ino, entry->d_type );
+
+#endif
+
+    result.status = DirScanResult::ScanOk;
+
+    // Check the exclude rules for file children on the names alone: If the
+    // directory is excluded, there is nothing left to stat().
+
+    if ( ! excludeFileChildren.isEmpty() &&
+	 matchFileChildren( dirFd, result, excludeFileChildren ) )
+    {
+	result.excluded = true;
+	result.entries.clear();
+	result.names.clear();
+    }
+    else if ( sampleFraction > 0.0 )
+	sampleEntries( result, sampleFraction, dirName );
+
+    // Do the stat calls in i-number order. Most filesystems will benefit
+    // from that since they store i-nodes sorted by i-number on disk, so (at
+    // least with rotational disks) seek times are minimized by this strategy.
+    //
+    // A stable sort keeps multiple hard links to the same file in the same
+    // directory in readdir() order; none of them must go missing.
+
+    std::stable_sort( result.entries.begin(), result.entries.end(), inodeLessThan );
+
+    StatRing * ring = 0;
+
+    if ( _useStatRing && result.entries.size() >= STAT_RING_MIN_ENTRIES )
+	ring = StatRing::forThisThread();
+
+    if ( ! ring || ! ring->statEntries( dirFd, result ) )
+    {
+	for ( DirScanEntryList::iterator it = result.entries.begin();
+	      it != result.entries.end();
+	      ++it )
+	{
+	    it->statErrno = statEntry( dirFd, result.name( *it ), &it->statInfo );
+	}
+    }
+
+#if USE_GETDENTS64
+    ::close( dirFd );
+#else
+    closedir( diskDir );
+#endif
+
+    result.nanosec = timer.nsecsElapsed();
+}
+
+
+
+
+void DirScanWorker::run()
+{
+    // The pool threads are reused, so set this each time in case it was
+    // changed in the meantime
+
+    SysUtil::setIdleIoPriority( DirScanner::idleIoPriority() );
+
+    DirScanResult * result = new DirScanResult();
+    DirScanner::scanDir( _dirName, *result, _sampleFraction, _excludeFileChildren );
+
+    _scanner->workerDone( _ticket, result ); // The scanner takes over ownership
+}
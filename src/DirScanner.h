@@ -0,0 +1,417 @@
+/*
+ *   File name: DirScanner.h
+ *   Summary:	Multi-threaded directory reading for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DirScanner_h
+#define DirScanner_h
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+#include <QByteArray>
+#include <QMutex>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QRegExp>
+
+#include "MpscRing.h"
+#include "ScanTuner.h"
+
+
+namespace QDirStat
+{
+    class DirReadJob;
+
+
+    /**
+     * One directory entry as obtained by getdents64() / readdir() and
+     * statx() / fstatat().
+     *
+     * This is plain data without any reference to the DirTree, so it can
+     * safely be created in a scanner thread and handed over to the GUI
+     * thread.
+     *
+     * The name is not stored here, but in the name buffer of the
+     * DirScanResult (see DirScanResult::name()), so there is no extra heap
+     * allocation for each entry.
+     **/
+    struct DirScanEntry
+    {
+	int	    nameOffset; // offset of the name in DirScanResult::names
+	int	    nameLength; // name length in bytes without the trailing 0
+	ino_t	    ino;	// i-number from the directory entry for sorting
+	uchar	    type;	// d_type from the directory entry (DT_DIR etc.)
+	struct stat statInfo;	// only valid if statErrno == 0
+	int	    statErrno;	// errno of statx() / fstatat() or 0 if it was OK
+    };
+
+    typedef QVector<DirScanEntry> DirScanEntryList;
+
+
+    /**
+     * The result of reading one directory.
+     **/
+    struct DirScanResult
+    {
+	enum Status
+	{
+	    ScanOk,
+	    ScanPermissionDenied,	// access() failed
+	    ScanOpenDirError		// open() / opendir() failed
+	};
+
+	DirScanResult():
+	    status( ScanOk ),
+	    errorNumber( 0 ),
+	    nanosec( 0 ),
+	    unsampledEntries( 0 ),
+	    excluded( false )
+	    {}
+
+	/**
+	 * Return the raw (0-terminated) name of 'entry'.
+	 **/
+	const char * name( const DirScanEntry & entry ) const
+	    { return names.constData() + entry.nameOffset; }
+
+	Status		 status;
+	int		 errorNumber;	// errno if the status is an error
+	DirScanEntryList entries;
+	QByteArray	 names;		// all names, each with a trailing 0
+	qint64		 nanosec;	// time for reading the directory
+	int		 unsampledEntries; // non-directories not in the sample
+	bool		 excluded;	// a non-directory matched an exclude pattern
+    };
+
+
+    /**
+     * Class to read directories in a pool of worker threads: Each worker
+     * thread does the system calls (getdents64() / statx() on Linux) for one
+     * directory and collects the results in a DirScanResult. Those results
+     * are handed back to the GUI thread which creates the FileInfo / DirInfo
+     * nodes and links them into the DirTree.
+     *
+     * Nothing in any worker thread ever touches the DirTree or any of its
+     * nodes; this is strictly left to the GUI thread. This avoids any need
+     * for locking in the tree, and it keeps the DirTreeModel and the views
+     * happy, too.
+     *
+     * There is a separate thread pool for each device: A slow device like a
+     * network filesystem then cannot stall reading the fast ones because
+     * all worker threads are waiting for it. Rotational disks get only very
+     * few threads; more would only make them seek more.
+     *
+     * Unless disabled (see ScanTuner::setEnabled()), the number of threads
+     * of each device is tuned while reading: The ScanTuner tries more or
+     * fewer threads and stays with the number that reads the most entries
+     * per second. Subvolumes are not tuned; they share the threads.
+     *
+     * Each Btrfs subvolume has a device number of its own, so it also gets
+     * a thread pool of its own (see setSubvolume()): A scan of a filesystem
+     * with many subvolumes or snapshots is split at the subvolume
+     * boundaries, and the subvolumes are read in parallel.
+     *
+     * Notice that this is only useful for local directory reading; for
+     * reading cache files or package file lists there isn't much to gain.
+     **/
+    class DirScanner: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	DirScanner( QObject * parent = 0 );
+
+	/**
+	 * Destructor. This waits for all worker threads to finish.
+	 **/
+	virtual ~DirScanner();
+
+	/**
+	 * Set the number of worker threads. 0 or 1 means not to use any
+	 * worker threads at all, i.e. to read in the GUI thread like in the
+	 * classic single-threaded mode.
+	 **/
+	void setThreadCount( int threadCount );
+
+	/**
+	 * Return the number of worker threads.
+	 **/
+	int threadCount() const { return _threadCount; }
+
+	/**
+	 * Return the number of worker threads for 'device'. This is less
+	 * than threadCount() for rotational disks.
+	 **/
+	int threadCount( dev_t device ) const
+	    { return _deviceThreadCount.value( device, _threadCount ); }
+
+	/**
+	 * Register 'device' as the (anonymous) device number of a Btrfs
+	 * subvolume on a disk that is 'rotational' or not. There are often
+	 * many subvolumes on the same disk, and each of them gets a thread
+	 * pool of its own, so they share the threads.
+	 **/
+	void setSubvolume( dev_t device, bool rotational );
+
+	/**
+	 * Return 'true' if 'device' is registered as a Btrfs subvolume.
+	 **/
+	bool isSubvolume( dev_t device ) const
+	    { return _subvolumes.contains( device ); }
+
+	/**
+	 * Return the tuner for the number of threads of each device.
+	 **/
+	ScanTuner * tuner() { return &_tuner; }
+
+	/**
+	 * Return 'true' if worker threads should be used at all.
+	 **/
+	bool isActive() const { return _threadCount > 1; }
+
+	/**
+	 * Return the number of directories currently being read in worker
+	 * threads (or waiting for a worker thread to become available).
+	 **/
+	int pendingCount() const { return _pendingJobs.size(); }
+
+	/**
+	 * Return the number of directories on 'device' currently being read
+	 * in worker threads (or waiting for a worker thread). Unlike
+	 * pendingCount(), this includes cancelled scans that are still
+	 * running since they still keep a worker thread busy.
+	 **/
+	int pendingCount( dev_t device ) const
+	    { return _devicePendingCount.value( device ); }
+
+	/**
+	 * Return 'true' if a worker thread is currently reading the directory
+	 * for 'job'.
+	 **/
+	bool isPending( DirReadJob * job ) const
+	    { return _pendingTickets.contains( job ); }
+
+	/**
+	 * Start reading directory 'dirName' on 'device' in a worker thread on
+	 * behalf of 'job'. When done, the scanFinished() signal is emitted in
+	 * the GUI thread. See scanDir() for 'sampleFraction' and
+	 * 'excludeFileChildren'.
+	 **/
+	void scan( DirReadJob	        * job,
+		   const QByteArray     & dirName,
+		   dev_t		  device	      = 0,
+		   double		  sampleFraction      = 0.0,
+		   const QList<QRegExp> & excludeFileChildren = QList<QRegExp>() );
+
+	/**
+	 * Forget about the pending scan for 'job'; this is typically called
+	 * just before it is deleted. The worker thread will still finish
+	 * reading that directory, but the result will be silently discarded.
+	 **/
+	void cancel( DirReadJob * job );
+
+	/**
+	 * Forget about all pending scans.
+	 **/
+	void cancelAll();
+
+	/**
+	 * Read directory 'dirName' (which needs to be a complete path) and
+	 * store the entries in 'result'.
+	 *
+	 * This does only system calls and does not use anything from the
+	 * DirTree, so it is safe to call from any thread (and this is what the
+	 * worker threads do). The entries are sorted by i-number.
+	 *
+	 * If 'sampleFraction' is more than 0.0, only a random sample of about
+	 * that fraction of the non-directory entries of a very large
+	 * directory is kept (and stat()ed); the number of the others is
+	 * stored in result.unsampledEntries. All subdirectories are always
+	 * kept. The same directory always gets the same sample.
+	 *
+	 * If the name of any non-directory entry matches one of the patterns
+	 * in 'excludeFileChildren' (the exclude rules that check the file
+	 * children of a directory), the directory is to be excluded:
+	 * result.excluded is set, and nothing is stat()ed and no entries are
+	 * returned. This is checked right after reading the names, so such a
+	 * directory only costs reading the directory itself. The patterns
+	 * must only be used by the calling thread.
+	 **/
+	static void scanDir( const QByteArray	  & dirName,
+			     DirScanResult	  & result,
+			     double		    sampleFraction	= 0.0,
+			     const QList<QRegExp> & excludeFileChildren = QList<QRegExp>() );
+
+	/**
+	 * Enable or disable doing the stat calls of scanDir() with io_uring
+	 * (see StatRing) where available. This keeps many stat requests in
+	 * flight at the same time which helps a lot with high-latency
+	 * storage like network filesystems.
+	 **/
+	static void setUseStatRing( bool use ) { _useStatRing = use; }
+
+	/**
+	 * Return 'true' if the stat calls should be done with io_uring.
+	 **/
+	static bool useStatRing() { return _useStatRing; }
+
+	/**
+	 * Enable or disable reading with the idle I/O priority in the worker
+	 * threads (see SysUtil::setIdleIoPriority()), so reading does not
+	 * slow down other processes that need the disks.
+	 **/
+	static void setIdleIoPriority( bool idle ) { _idleIoPriority = idle; }
+
+	/**
+	 * Return 'true' if the worker threads read with the idle I/O
+	 * priority.
+	 **/
+	static bool idleIoPriority() { return _idleIoPriority; }
+
+    signals:
+
+	/**
+	 * Emitted in the GUI thread when a worker thread is done reading the
+	 * directory for 'job'. The receiver takes over ownership of 'result'.
+	 **/
+	void scanFinished( DirReadJob * job, DirScanResult * result );
+
+    protected slots:
+
+	/**
+	 * Take all results that the worker threads delivered so far and emit
+	 * a scanFinished() signal for each of them.
+	 *
+	 * This is called in the GUI thread via a queued invocation. There is
+	 * at most one of them pending at any time, no matter how many results
+	 * come in until the GUI thread gets to it.
+	 **/
+	void collectResults();
+
+    protected:
+
+	friend class DirScanWorker;
+
+	/**
+	 * Notification from a worker thread that it is done. This is called
+	 * in the context of that worker thread.
+	 **/
+	void workerDone( quint64 ticket, DirScanResult * result );
+
+	/**
+	 * Return the thread pool for 'device'. Create it if there is none
+	 * yet; 'dirName' is a directory on that device.
+	 **/
+	QThreadPool * threadPool( dev_t device, const QByteArray & dirName );
+
+	/**
+	 * Return the number of threads for a new thread pool for 'device'.
+	 **/
+	int poolThreadCount( dev_t device ) const;
+
+	/**
+	 * Pass the time for 'result' on 'device' to the tuner and change the
+	 * number of threads of that device if it says so. 'busy' is 'true'
+	 * if all threads of that device had work.
+	 **/
+	void tuneThreads( dev_t device, const DirScanResult * result, bool busy );
+
+
+	typedef QPair<quint64, DirScanResult *> ScanResultPair;
+
+	int			       _threadCount;
+	quint64			       _nextTicket;
+
+	// Only used from the GUI thread
+
+	QHash<dev_t, QThreadPool *>    _threadPools;
+	QHash<dev_t, int>	       _deviceThreadCount;
+	QHash<dev_t, bool>	       _subvolumes;	// device -> rotational
+	QHash<dev_t, int>	       _devicePendingCount;
+	QHash<quint64, dev_t>	       _ticketDevices;
+	QHash<quint64, DirReadJob *>   _pendingJobs;
+	QHash<DirReadJob *, quint64>   _pendingTickets;
+	ScanTuner		       _tuner;
+
+	// Shared with the worker threads. The results are handed over
+	// through the lock-free ring; only if that is full, they go to the
+	// overflow list which is protected by _mutex.
+
+	MpscRing<ScanResultPair>       _results;
+	QAtomicInt		       _collectScheduled;
+	QAtomicInt		       _overflowCount;
+	QMutex			       _mutex;
+	QList<ScanResultPair>	       _overflow;
+
+	static bool		       _useStatRing;
+	static bool		       _idleIoPriority;
+
+    };	// class DirScanner
+
+
+
+    /**
+     * The runnable that is executed in a worker thread of the DirScanner
+     * thread pool: Read one directory.
+     **/
+    class DirScanWorker: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	DirScanWorker( DirScanner	    * scanner,
+		       quint64		      ticket,
+		       const QByteArray	    & dirName,
+		       double		      sampleFraction,
+		       const QList<QRegExp> & excludeFileChildren ):
+	    QRunnable(),
+	    _scanner( scanner ),
+	    _ticket( ticket ),
+	    _dirName( dirName ),
+	    _sampleFraction( sampleFraction ),
+	    _excludeFileChildren( excludeFileChildren )
+	    {}
+
+	/**
+	 * Read the directory and deliver the result to the scanner.
+	 *
+	 * Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+    protected:
+
+	DirScanner * _scanner;
+	quint64	     _ticket;
+	QByteArray   _dirName;
+	double	     _sampleFraction;
+
+	// Only used by this worker: A QRegExp keeps its match state in the
+	// object, so it cannot be shared between threads.
+
+	QList<QRegExp> _excludeFileChildren;
+
+    };	// class DirScanWorker
+
+}	// namespace QDirStat
+
+
+#endif // ifndef DirScanner_h
@@ -7,11 +7,25 @@
  */
 
 
+#include <math.h>	// sqrt()
+#include <stdio.h>	// rename()
+#include <sys/stat.h>	// stat()
+#include <algorithm>	// std::sort()
+
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
+#include <QStandardPaths>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
 
 #include "DirTree.h"
+#include "AsyncCommand.h"
+#include "BackgroundCacheWriter.h"
 #include "DirTreeCache.h"
+#include "BinaryCache.h"
 #include "DirTreeFilter.h"
 #include "DotEntry.h"
 #include "Attic.h"
@@ -19,25 +33,146 @@
 #include "FileInfoSet.h"
 #include "ExcludeRules.h"
 #include "PkgReader.h"
+#include "RemoteScan.h"
+#include "RemoteScanCoordinator.h"
+#include "ScanDaemon.h"
+#include "SharedTree.h"
+#include "ScanStats.h"
+#include "SessionCache.h"
 #include "MountPoints.h"
+#include "DeviceTable.h"
+#include "NodeArena.h"
 #include "FormatUtil.h"
+#include "HardLinkIndex.h"
+#include "ExtentScanner.h"
+#include "CacheVerifier.h"
+#include "OwnerStats.h"
+#include "SpillStore.h"
+#include "SysUtil.h"
 #include "Logger.h"
 #include "Exception.h"
 
 #define VERBOSE_EXCLUDE_RULES	1
 
+#define DEFAULT_CHECKPOINT_INTERVAL_SEC	300
+
+// Number of session cache files to keep (see SessionCache)
+#define MAX_SESSION_CACHES	20
+
+// Time slice for deleting the items of a cleared tree and the number of
+// items to delete before checking the time again
+
+#define REAP_SLICE_MILLISEC	20
+#define REAP_CHECK_INTERVAL	1000
+
+// Finalize a tree with filters in parallel if a toplevel directory has at
+// least this many items, with at most this many threads, and split it into
+// up to this many subtrees per thread, so the threads finish at about the
+// same time
+
+#define FINALIZE_PARALLEL_MIN_ITEMS	50000
+#define FINALIZE_MAX_THREADS		8
+#define FINALIZE_PARTS_PER_THREAD	8
+
 using namespace QDirStat;
 
 
+namespace QDirStat
+{
+    /**
+     * Worker for DirTree::finalizeTree(): Finalize subtrees from a list
+     * that is shared with the other workers. Each worker takes the next
+     * subtree that no other worker has taken yet until there are no more.
+     **/
+    class FinalizeFilteredTask: public QRunnable
+    {
+    public:
+
+	FinalizeFilteredTask( const QList<DirInfo *> & subtrees,
+			      QAtomicInt	     & nextSubtree ):
+	    _subtrees( subtrees ),
+	    _nextSubtree( nextSubtree )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    while ( true )
+	    {
+		int index = _nextSubtree.fetchAndAddOrdered( 1 );
+
+		if ( index >= _subtrees.size() )
+		    return;
+
+		DirTree::finalizeFiltered( _subtrees.at( index ) );
+	    }
+	}
+
+    protected:
+
+	const QList<DirInfo *> & _subtrees;
+	QAtomicInt &		 _nextSubtree;
+    };
+
+
+    static bool moreItems( DirInfo * a, DirInfo * b )
+    {
+	return a->totalItems() > b->totalItems();
+    }
+
+}	// namespace QDirStat
+
+
 DirTree::DirTree():
     QObject(),
     _excludeRules( 0 ),
+    _nameFilterCount( 0 ),
     _beingDestroyed( false ),
+    _skipNodeDeletion( false ),
+    _reapingNodes( false ),
+    _subtreeNumbersValid( false ),
     _haveClusterSize( false ),
     _blocksPerCluster( 1 )
 {
     _isBusy	      = false;
     _crossFilesystems = false;
+    _useCacheFiles    = true;
+    _checkStaleCaches = true;
+    _smartRefresh     = false;
+    _useSizeEstimates = true;
+    _sampleFraction   = 0.0;
+    _checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL_SEC;
+    _ownCheckpoint    = false;
+    _qgroupCommand    = 0;
+    _haveQgroups      = true;
+    _useScanDaemon    = true;
+    _useSharedTrees   = true;
+    _publishTrees     = false;
+    _publishOnFinish  = false;
+    _useSessionCache  = false;
+    _sessionCacheWriter = 0;
+
+    _hardLinks = new HardLinkIndex();
+    CHECK_NEW( _hardLinks );
+
+    _extents = new ExtentScanner( this );
+    CHECK_NEW( _extents );
+
+    _ownerStats = new OwnerStats( this );
+    CHECK_NEW( _ownerStats );
+
+    _cacheVerifier = new CacheVerifier( this );
+    CHECK_NEW( _cacheVerifier );
+
+    _outOfCore	= false;
+    _dirsOnly	= false;
+    _foldFilesBelow = 0;
+    _lazyCacheDepth = 0;
+    _spillStore = new SpillStore( this );
+    CHECK_NEW( _spillStore );
+
+    _daemonClient = new ScanDaemonClient( this );
+    CHECK_NEW( _daemonClient );
+
     _root = new DirInfo( this );
     CHECK_NEW( _root );
 
@@ -46,25 +181,72 @@ DirTree::DirTree():
 
     connect( this,	  SIGNAL( deletingChild	     ( FileInfo * ) ),
 	     & _jobQueue, SLOT	( deletingChildNotify( FileInfo * ) ) );
+
+    connect( & _checkpointTimer, SIGNAL( timeout()	   ),
+	     this,		 SLOT  ( writeCheckpoint() ) );
+
+    connect( & _reapTimer, SIGNAL( timeout()   ),
+	     this,	   SLOT  ( reapNodes() ) );
+
+    MemoryPressure::add( this );
 }
 
 
 DirTree::~DirTree()
 {
+    finishStats();
     _beingDestroyed = true;
+    MemoryPressure::remove( this );
 
-    if ( _root )
-	delete _root;
+    if ( ! _publishedUrl.isEmpty() )
+	SharedTree::withdraw( _publishedUrl );
+
+    if ( _skipNodeDeletion )
+    {
+	// The system reclaims the memory of the whole process at once
+
+	logInfo() << "Not deleting " << NodeArena::instance()->liveCount()
+		  << " tree items on exit" << endl;
+    }
+    else
+    {
+	if ( _root )
+	    delete _root;
+
+	qDeleteAll( _reapQueue );
+    }
 
     if ( _excludeRules )
 	delete _excludeRules;
 
+    delete _hardLinks;
+    delete _extents;
+    delete _ownerStats;
+    delete _cacheVerifier;
+    delete _qgroupCommand;	// This kills the command if it is still running
+    delete _spillStore;
+    delete _daemonClient;
     clearFilters();
 }
 
 
+void DirTree::evictCache( int percent )
+{
+    // Everything that is dropped here is recalculated when needed. Keep
+    // the most recently used sort order and statistics unless everything
+    // has to go, so the current view does not have to wait.
+
+    finishStats();
+
+    if ( _root )
+	_root->trimCaches( percent >= 100 );
+}
+
+
 void DirTree::setRoot( DirInfo *newRoot )
 {
+    finishStats();
+
     if ( _root )
     {
 	emit deletingChild( _root );
@@ -96,6 +278,29 @@ FileInfo * DirTree::firstToplevel() const
 }
 
 
+FileInfo * DirTree::visibleRoot() const
+{
+    if ( _root && _root->firstChild() && _root->firstChild()->next() )
+	return _root;	// Several toplevel items
+
+    return firstToplevel();
+}
+
+
+QStringList DirTree::toplevelUrls() const
+{
+    QStringList urls;
+
+    if ( ! _root )
+	return urls;
+
+    for ( FileInfo * item = _root->firstChild(); item; item = item->next() )
+	urls << item->url();
+
+    return urls;
+}
+
+
 bool DirTree::isToplevel( FileInfo *item ) const
 {
     return item && item->parent() && ! item->parent()->parent();
@@ -110,18 +315,132 @@ QString DirTree::url() const
 
 void DirTree::clear()
 {
+    finishStats();
     _jobQueue.clear();
+    _daemonClient->close();
+    _checkpointTimer.stop();
+    _ownCheckpoint = false;
+    _publishOnFinish = false;
+    _sessionCacheFile.clear();
+
+    if ( ! _publishedUrl.isEmpty() )
+    {
+	// Other sessions that already use it can go on with it
+	SharedTree::withdraw( _publishedUrl );
+	_publishedUrl.clear();
+    }
 
     if ( _root )
     {
 	emit clearing();
-	_root->clear();
+	reapChildren( _root );
     }
 
+    // Only the items that are queued for deleting are still in these
+
+    _sizeEstimates.clear();
+    _overlayMounts.clear();
+    _samples.clear();
+    _fileSummaries.clear();
+
+    _hardLinks->clear();
+    _extents->clear();
+    _ownerStats->clear();
+    _cacheVerifier->clear();
+    _spillStore->clear();
+    _readErrors.clear();
+    _subtreeNumbersValid = false;
     _isBusy	      = false;
     _haveClusterSize  = false;
     _blocksPerCluster = 1;
     _device.clear();
+
+    delete _qgroupCommand;
+    _qgroupCommand = 0;
+    _qgroupQueue.clear();
+    _haveQgroups = true;
+}
+
+
+void DirTree::reapChildren( DirInfo * dir )
+{
+    FileInfo * child = dir->firstChild();
+
+    while ( child )
+    {
+	FileInfo * nextChild = child->next();
+
+	dir->deletingChild( child );	// Just unlink it
+	child->setNext( 0 );
+	child->setParent( 0 );
+	_reapQueue << child;
+
+	child = nextChild;
+    }
+
+    dir->clear();	// The dot entry and the attic
+
+    if ( ! _reapQueue.isEmpty() )
+    {
+	logInfo() << "Deleting " << NodeArena::instance()->liveCount()
+		  << " old tree items in the background" << endl;
+
+	_reapTimer.start( 0 );
+    }
+}
+
+
+void DirTree::reapNodes()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int count = 0;
+    _reapingNodes = true;
+
+    while ( ! _reapQueue.isEmpty() )
+    {
+	if ( ++count % REAP_CHECK_INTERVAL == 0 && timer.elapsed() > REAP_SLICE_MILLISEC )
+	    break;
+
+	FileInfo * item = _reapQueue.takeLast();
+
+	if ( item->isDirInfo() )
+	{
+	    // Take the children and the dot entry out, so deleting this
+	    // directory does not take long even if it is very large.
+
+	    DirInfo * dir   = item->toDirInfo();
+	    FileInfo * child = dir->firstChild();
+	    dir->setFirstChild( 0 );
+
+	    while ( child )
+	    {
+		FileInfo * nextChild = child->next();
+
+		child->setNext( 0 );
+		child->setParent( 0 );
+		_reapQueue << child;
+
+		child = nextChild;
+	    }
+
+	    DotEntry * dotEntry = dir->takeDotEntry();
+
+	    if ( dotEntry )
+		_reapQueue << dotEntry;
+	}
+
+	delete item;
+    }
+
+    _reapingNodes = false;
+
+    if ( _reapQueue.isEmpty() )
+    {
+	_reapTimer.stop();
+	NodeArena::instance()->logStats();
+    }
 }
 
 
@@ -135,6 +454,12 @@ void DirTree::reset()
 
 void DirTree::startReading( const QString & rawUrl )
 {
+    if ( RemoteReadJob::isRemoteUrl( rawUrl ) )
+    {
+	readRemote( rawUrl );
+	return;
+    }
+
     QFileInfo fileInfo( rawUrl );
     _url = fileInfo.absoluteFilePath();
     // logDebug() << "rawUrl: \"" << rawUrl << "\"" << endl;
@@ -146,180 +471,990 @@ void DirTree::startReading( const QString & rawUrl )
     if ( _root->hasChildren() )
 	clear();
 
-    _isBusy = true;
-    emit startingReading();
+    if ( _useScanDaemon && _daemonClient->connectTo( _url ) )
+    {
+	// The scan daemon sends its snapshot as soon as it has one
 
-    FileInfo * item = LocalDirReadJob::stat( _url, this, _root );
-    CHECK_PTR( item );
+	_isBusy = true;
+	emit startingReading();
+	return;
+    }
 
-    if ( item )
+    if ( _useSharedTrees )
     {
-	childAddedNotify( item );
+	QString sharedTree = SharedTree::find( _url );
 
-	if ( item->isDirInfo() )
+	if ( ! sharedTree.isEmpty() && readCache( sharedTree ) )
 	{
-	    addJob( new LocalDirReadJob( this, item->toDirInfo() ) );
-	    emit readJobFinished( _root );
+	    logInfo() << "Using the tree from " << sharedTree << endl;
+	    return;
 	}
-	else
+    }
+
+    if ( _useSessionCache )
+    {
+	// Show the tree from the last session right away and read only what
+	// changed since then
+
+	QString sessionCache = SessionCache::find( _url, _device );
+
+	if ( ! sessionCache.isEmpty() &&
+	     readCache( sessionCache, QString(),
+			false,	  // checkStale
+			true ) )  // refreshAll
 	{
-	    finalizeTree();
-	    _isBusy = false;
-	    emit readJobFinished( _root );
-	    emit finished();
+	    logInfo() << "Using the session cache " << sessionCache << endl;
+	    _sessionCacheFile = sessionCache;
+	    return;
 	}
     }
+
+    _isBusy = true;
+    _ownCheckpoint = false;
+    _publishOnFinish = _publishTrees;
+    _sessionCacheFile = _useSessionCache ? SessionCache::fileName( _url, _device ) : QString();
+    startCheckpointTimer();
+    emit startingReading();
+
+    FileInfo * item = addToplevel( _url );
+
+    if ( item && item->isDirInfo() )
+    {
+	ScanStats::instance()->setExpectedEntries( expectedEntries( _url ) );
+	emit readJobFinished( _root );
+    }
+    else if ( item )
+    {
+	finalizeTree();
+	_isBusy = false;
+	emit readJobFinished( _root );
+	emit finished();
+    }
     else	// stat() failed
     {
-	logWarning() << "stat(" << _url << ") failed" << endl;
 	_isBusy = false;
 	emit finished();
     }
 }
 
 
-void DirTree::refresh( const FileInfoSet & refreshSet )
+void DirTree::startReading( const QStringList & paths )
 {
-    FileInfoSet items = refreshSet.invalidRemoved().normalized();
-
-    foreach ( FileInfo * item, items )
+    if ( paths.size() == 1 )
     {
-	// Need to check the magic number here again because a previous
-	// iteration step might have made the item invalid already
-
-	if ( item && item->checkMagicNumber() )
-	{
-	    if ( item->isDirInfo() )
-		refresh( item->toDirInfo() );
-	    else if ( item->parent() )
-		refresh( item->parent() );
-	}
+	startReading( paths.first() );
+	return;
     }
-}
 
+    if ( _root->hasChildren() )
+	clear();
 
-void DirTree::refresh( DirInfo * subtree )
-{
-    if ( ! _root )
-	return;
+    QStringList urls;
 
-    if ( ! subtree->checkMagicNumber() )
+    foreach ( const QString & path, paths )
     {
-	// Not using CHECK_MAGIC() here which would throw an exception since
-	// this might easily happen after cleanup actions with multi selection
-	// if one selected item is in the subtree of another, and that parent
-	// was already refreshed.
+	if ( RemoteReadJob::isRemoteUrl( path ) )
+	{
+	    logWarning() << "Not reading remote " << path << " together with other directories" << endl;
+	    continue;
+	}
 
-	logWarning() << "Item is no longer valid - not refreshing subtree" << endl;
-	return;
+	QString url = QFileInfo( path ).absoluteFilePath();
+
+	if ( ! urls.contains( url ) )
+	    urls << url;
     }
 
-    if ( subtree->isDotEntry() )
-	subtree = subtree->parent();
+    // The toplevel items can't be inside each other, or the same items
+    // would be counted twice
 
-    if ( ! subtree || ! subtree->parent() )	// Refresh all (from first toplevel)
+    QStringList nestedUrls;
+
+    foreach ( const QString & url, urls )
     {
-	try
-	{
-	    startReading( QDir::cleanPath( firstToplevel()->url() ) );
-	}
-	catch ( const SysCallFailedException & ex )
+	foreach ( const QString & otherUrl, urls )
 	{
-	    CAUGHT( ex );
+	    if ( url.startsWith( otherUrl + "/" ) || ( otherUrl == "/" && url != "/" ) )
+	    {
+		logWarning() << "Not reading " << url << " separately: It is inside " << otherUrl << endl;
+		nestedUrls << url;
+		break;
+	    }
 	}
     }
-    else	// Refresh subtree
+
+    foreach ( const QString & url, nestedUrls )
+	urls.removeAll( url );
+
+    // Each toplevel item has its own device
+
+    _url    = urls.isEmpty() ? QString() : urls.first();
+    _device.clear();
+
+    _isBusy = true;
+    _ownCheckpoint = false;
+    _publishOnFinish = false;
+    _sessionCacheFile.clear();
+    emit startingReading();
+
+    int jobCount = 0;
+    FileCount expected = 0;
+
+    foreach ( const QString & url, urls )
     {
-	// logDebug() << "Refreshing subtree " << subtree << endl;
+	logInfo() << "   url: \"" << url << "\"" << endl;
+	FileInfo * item = addToplevel( url, false );	// Go on with the others
 
-	clearSubtree( subtree );
+	if ( item && item->isDirInfo() )
+	{
+	    ++jobCount;
 
-	subtree->reset();
-	subtree->setExcluded( false );
+	    FileCount entries = expectedEntries( url );
+	    expected = ( expected < 0 || entries <= 0 ) ? -1 : expected + entries;
+	}
+    }
 
-	_isBusy = true;
-	subtree->setReadState( DirReading );
-	emit startingReading();
-	addJob( new LocalDirReadJob( this, subtree ) );
+    if ( jobCount > 0 )
+    {
+	ScanStats::instance()->setExpectedEntries( qMax( expected, 0LL ) );
+	emit readJobFinished( _root );
+    }
+    else
+    {
+	finalizeTree();
+	_isBusy = false;
+	emit readJobFinished( _root );
+	emit finished();
     }
 }
 
 
-void DirTree::abortReading()
+FileCount DirTree::expectedEntries( const QString & url ) const
 {
-    if ( _jobQueue.isEmpty() )
-	return;
+    // Only a complete filesystem can be estimated, and a sampling scan
+    // reads only some of the entries
 
-    _jobQueue.abort();
+    MountPoint * mountPoint = MountPoints::findByPath( url );
 
-    _isBusy = false;
-    emit aborted();
-}
+    if ( ! mountPoint || _sampleFraction > 0.0 )
+	return 0;
 
+    FileCount entries = mountPoint->usedInodes();
 
-void DirTree::finalizeTree()
-{
-    if ( _root && hasFilters() )
+    if ( entries <= 0 )
+	return 0;
+
+    if ( _crossFilesystems )
     {
-	recalc( _root );
-	ignoreEmptyDirs( _root );
-	recalc( _root );
+	// The same filesystems that the read jobs cross into
+
+	QString prefix = url == "/" ? url : url + "/";
+
+	foreach ( MountPoint * subMount, MountPoints::normalMountPoints() )
+	{
+	    if ( subMount == mountPoint			||
+		 ! subMount->path().startsWith( prefix ) ||
+		 subMount->isNetworkMount() )
+	    {
+		continue;
+	    }
+
+	    FileCount subEntries = subMount->usedInodes();
 
-        if ( _root->firstChild() )
-            moveIgnoredToAttic( _root->firstChild()->toDirInfo() );
+	    if ( subEntries <= 0 )	// Can't estimate this one
+		return 0;
 
-	recalc( _root );
+	    entries += subEntries;
+	}
     }
-}
 
+    logDebug() << "Expecting about " << entries << " entries in " << url << endl;
 
-void DirTree::slotFinished()
-{
-    finalizeTree();
-    _isBusy = false;
-    emit finished();
+    return entries;
 }
 
 
-void DirTree::childAddedNotify( FileInfo * newChild )
+FileInfo * DirTree::addToplevel( const QString & url, bool doThrow )
 {
-    if ( ! _haveClusterSize )
-        detectClusterSize( newChild );
+    FileInfo * item = LocalDirReadJob::stat( url, this, _root, doThrow );
 
-    emit childAdded( newChild );
-
-    if ( newChild->dotEntry() )
-	emit childAdded( newChild->dotEntry() );
-}
+    if ( ! item )
+    {
+	logWarning() << "stat(" << url << ") failed" << endl;
+	return 0;
+    }
 
+    childAddedNotify( item );
 
-void DirTree::deletingChildNotify( FileInfo * deletedChild )
-{
-    logDebug() << "Deleting child " << deletedChild << endl;
-    emit deletingChild( deletedChild );
+    if ( item->isDirInfo() )
+    {
+	estimateSize( item->toDirInfo() );
 
-    if ( deletedChild == _root )
-	_root = 0;
-}
+	LocalDirReadJob * job = new LocalDirReadJob( this, item->toDirInfo() );
+	CHECK_NEW( job );
 
+	job->setSampleFraction( _sampleFraction );
+	addJob( job );
+    }
 
-void DirTree::childDeletedNotify()
-{
-    emit childDeleted();
+    return item;
 }
 
 
-void DirTree::deleteSubtree( FileInfo *subtree )
+void DirTree::estimateSize( DirInfo * dir )
 {
-    // logDebug() << "Deleting subtree " << subtree << endl;
-    DirInfo * parent = subtree->parent();
+    if ( ! _useSizeEstimates || ! dir )
+	return;
 
-    // Send notification to anybody interested (e.g., to attached views)
-    deletingChildNotify( subtree );
+    MountPoint * mountPoint = MountPoints::findByPath( dir->url() );
 
-    if ( parent )
+    if ( mountPoint && mountPoint->isOverlay() )
     {
-	if ( parent->isDotEntry() && ! parent->hasChildren() )
+	// The filesystem size is that of the filesystem of the layers; the
+	// layers themselves are only known when reading is finished.
+
+	_overlayMounts << dir->url();
+	return;
+    }
+
+    if ( ! MountPoints::hasSizeInfo() )
+	return;
+
+    if ( ! mountPoint			||
+	 mountPoint->isSystemMount()	||
+	 mountPoint->isDuplicate()	||
+	 mountPoint->isBtrfs()		||
+	 mountPoint->isNetworkMount()	  )
+    {
+	return;
+    }
+
+    FileSize used = mountPoint->usedSize();
+
+    if ( used > 0 )
+    {
+	logInfo() << "Estimated size of " << dir << ": " << formatSize( used ) << endl;
+	dir->setSizeEstimate( used );
+    }
+}
+
+
+void DirTree::estimateOverlays()
+{
+    if ( _overlayMounts.isEmpty() )
+	return;
+
+    // Many overlays typically share the same lower layers, often through
+    // symlinks with short names (Docker: overlay2/l/*): Resolve each layer
+    // only once.
+
+    QHash<QString, FileSize> layerSizes;
+
+    foreach ( const QString & url, _overlayMounts )
+    {
+	FileInfo *   item	= locate( url );
+	MountPoint * mountPoint = MountPoints::findByPath( url );
+
+	if ( ! item || ! item->isDirInfo() || ! mountPoint ||
+	     item->readState() != DirOnRequestOnly )
+	{
+	    continue;
+	}
+
+	FileSize size = 0;
+	int	 found = 0;
+	QStringList layers = mountPoint->overlayLayers();
+
+	foreach ( const QString & layer, layers )
+	{
+	    if ( ! layerSizes.contains( layer ) )
+	    {
+		QString	   path	    = QFileInfo( layer ).canonicalFilePath();
+		FileInfo * layerDir = path.isEmpty() ? 0 : locate( path );
+
+		layerSizes.insert( layer, layerDir && layerDir->isDirInfo() ?
+				   layerDir->totalAllocatedSize() : -1 );
+	    }
+
+	    FileSize layerSize = layerSizes.value( layer );
+
+	    if ( layerSize >= 0 )
+	    {
+		size += layerSize;
+		++found;
+	    }
+	}
+
+	// Only if all layers were read in this tree; anything else would
+	// look more precise than it is
+
+	if ( found > 0 && found == layers.size() )
+	{
+	    logInfo() << "Estimated size of overlay " << url << " from "
+		      << found << " layers: " << formatSize( size ) << endl;
+	    item->toDirInfo()->setSizeEstimate( size );
+	}
+    }
+
+    _overlayMounts.clear();
+}
+
+
+/**
+ * Return the path of the btrfs command or an empty string if there is none.
+ **/
+static QString btrfsCommand()
+{
+    static bool	   checked = false;
+    static QString command;
+
+    if ( ! checked )
+    {
+	checked = true;
+
+	QStringList candidates;
+	candidates << "/usr/sbin/btrfs" << "/sbin/btrfs" << "/usr/bin/btrfs" << "/bin/btrfs";
+
+	foreach ( const QString & candidate, candidates )
+	{
+	    if ( SysUtil::haveCommand( candidate ) )
+	    {
+		command = candidate;
+		break;
+	    }
+	}
+
+	if ( command.isEmpty() )
+	    logInfo() << "No btrfs command available" << endl;
+    }
+
+    return command;
+}
+
+
+/**
+ * Return the referenced size from the output of "btrfs qgroup show --raw"
+ * for one subvolume or -1 if there is none:
+ *
+ *   qgroupid	      rfer	   excl
+ *   --------	      ----	   ----
+ *   0/257     10995116277    107374182
+ **/
+static FileSize qgroupReferencedSize( const QString & output )
+{
+    foreach ( const QString & line, output.split( '\n', QString::SkipEmptyParts ) )
+    {
+	QStringList fields = line.split( QRegExp( "\\s+" ), QString::SkipEmptyParts );
+
+	if ( fields.size() >= 3 && fields[0].startsWith( "0/" ) )
+	{
+	    bool     ok;
+	    FileSize size = fields[1].toLongLong( &ok );
+
+	    if ( ok )
+		return size;
+	}
+    }
+
+    return -1;
+}
+
+
+void DirTree::subvolumeFound( DirInfo * dir )
+{
+    CHECK_PTR( dir );
+
+    // The subvolume has an anonymous device number; the information if it
+    // is on a rotational disk is only available for the block device.
+
+    bool rotational = false;
+    MountPoint * mountPoint = MountPoints::findByPath( dir->url() );
+
+    if ( mountPoint )
+    {
+	struct stat statInfo;
+
+	if ( stat( mountPoint->device().toUtf8().constData(), &statInfo ) == 0 &&
+	     S_ISBLK( statInfo.st_mode ) )
+	{
+	    rotational = DeviceTable::isRotational( statInfo.st_rdev );
+	}
+    }
+
+    logInfo() << "Btrfs subvolume " << dir << endl;
+    _jobQueue.scanner()->setSubvolume( dir->device(), rotational );
+
+    if ( _useSizeEstimates && _haveQgroups && ! btrfsCommand().isEmpty() )
+    {
+	_qgroupQueue << dir->url();
+	startQgroupQuery();
+    }
+}
+
+
+void DirTree::startQgroupQuery()
+{
+    if ( _qgroupCommand || _qgroupQueue.isEmpty() )
+	return;
+
+    QStringList args;
+    args << "qgroup" << "show" << "--raw" << "-f" << _qgroupQueue.takeFirst();
+
+    _qgroupCommand = new AsyncCommand( btrfsCommand(), args, this );
+    CHECK_NEW( _qgroupCommand );
+
+    connect( _qgroupCommand, SIGNAL( finished	       ( AsyncCommand * ) ),
+	     this,	     SLOT  ( qgroupQueryFinished( AsyncCommand * ) ) );
+
+    _qgroupCommand->start();
+}
+
+
+void DirTree::qgroupQueryFinished( AsyncCommand * command )
+{
+    command->deleteLater();
+
+    if ( command != _qgroupCommand )
+	return;
+
+    _qgroupCommand = 0;
+    QString path = command->args().last();
+
+    if ( ! command->ok() || command->exitCode() != 0 )
+    {
+	// Quota groups are not enabled, or no permission: This is the same
+	// for the other subvolumes.
+
+	logInfo() << "No Btrfs quota group information for " << path << endl;
+	_haveQgroups = false;
+	_qgroupQueue.clear();
+	return;
+    }
+
+    FileSize   referenced = qgroupReferencedSize( command->output() );
+    FileInfo * item	  = locate( path );
+
+    if ( referenced > 0 && item && item->isDirInfo() )
+    {
+	logInfo() << "Estimated size of " << path << ": " << formatSize( referenced ) << endl;
+	item->toDirInfo()->setSizeEstimate( referenced );
+    }
+
+    startQgroupQuery();
+}
+
+
+void DirTree::setSizeEstimate( const DirInfo * dir, FileSize estimate )
+{
+    if ( estimate >= 0 )
+	_sizeEstimates.insert( dir, estimate );
+    else if ( ! _sizeEstimates.isEmpty() )
+	_sizeEstimates.remove( dir );
+}
+
+
+void DirTree::setSample( const DirInfo * dir, const DirSample * sample )
+{
+    if ( sample )
+	_samples.insert( dir, *sample );
+    else if ( ! _samples.isEmpty() )
+	_samples.remove( dir );
+}
+
+
+QList<DirInfo *> DirTree::readErrorDirs( const FileInfo * subtree ) const
+{
+    if ( ! subtree || subtree == _root )
+	return _readErrors.keys();
+
+    QList<DirInfo *> dirs;
+
+    for ( QHash<DirInfo *, int>::const_iterator it = _readErrors.constBegin();
+	  it != _readErrors.constEnd();
+	  ++it )
+    {
+	if ( it.key()->isInSubtree( subtree ) )
+	    dirs << it.key();
+    }
+
+    return dirs;
+}
+
+
+void DirTree::setFileSummary( const DirInfo * dir, const DirFileSummary * summary )
+{
+    if ( summary )
+	_fileSummaries.insert( dir, *summary );
+    else if ( ! _fileSummaries.isEmpty() )
+	_fileSummaries.remove( dir );
+}
+
+
+FileSize DirTree::sampleError( const DirInfo * subtree ) const
+{
+    if ( _samples.isEmpty() )
+	return -1;
+
+    // The variances of the independent samples add up. There are only
+    // samples for a few very large directories, so just check for each of
+    // them if it is in this subtree.
+
+    double variance = 0.0;
+    bool   found	= false;
+
+    for ( QHash<const DirInfo *, DirSample>::const_iterator it = _samples.constBegin();
+	  it != _samples.constEnd();
+	  ++it )
+    {
+	for ( const FileInfo * dir = it.key(); dir; dir = dir->parent() )
+	{
+	    if ( dir == subtree )
+	    {
+		variance += it.value().variance;
+		found = true;
+		break;
+	    }
+	}
+    }
+
+    if ( ! found )
+	return -1;
+
+    return qRound64( 1.96 * sqrt( variance ) );
+}
+
+
+bool DirTree::updateSubtreeNumbers()
+{
+    if ( _subtreeNumbersValid )
+	return true;
+
+    if ( _isBusy || ! _root )
+	return false;
+
+    quint32 counter = 0;
+    _root->numberSubtree( counter );
+    _subtreeNumbersValid = true;
+
+    return true;
+}
+
+
+void DirTree::refresh( const FileInfoSet & refreshSet )
+{
+    // Collect the directories to refresh first: After a cleanup with many
+    // selected files, many of them are in the same directory, and each
+    // directory should be read only once.
+
+    FileInfoSet dirs;
+
+    foreach ( FileInfo * item, refreshSet.invalidRemoved() )
+    {
+	if ( item->isPseudoDir() || ! item->isDirInfo() )
+	    item = item->parent();
+
+	if ( item )
+	    dirs << item;
+    }
+
+    dirs = dirs.normalized();
+
+    if ( dirs.isEmpty() )
+	return;
+
+    if ( dirs.size() == 1 || dirs.contains( _root ) || isRemote() )
+    {
+	refresh( ( *dirs.begin() )->toDirInfo() );
+	return;
+    }
+
+    logDebug() << "Refreshing " << dirs.size() << " subtrees" << endl;
+
+    FileInfoSet subtrees;
+
+    foreach ( FileInfo * dir, dirs )
+    {
+	if ( dir->checkMagicNumber() && ! dir->toDirInfo()->isBusy() )
+	    subtrees << dir;
+    }
+
+    if ( subtrees.isEmpty() )
+    {
+	logWarning() << "Nothing to refresh" << endl;
+	return;
+    }
+
+    if ( ! _smartRefresh )
+    {
+	clearSubtrees( subtrees );
+
+	foreach ( FileInfo * item, subtrees )
+	{
+	    DirInfo * subtree = item->toDirInfo();
+
+	    subtree->reset();
+	    subtree->setExcluded( false );
+	    subtree->setReadState( DirReading );
+	}
+    }
+
+    _isBusy = true;
+    emit startingReading();
+
+    foreach ( FileInfo * item, subtrees )
+    {
+	DirInfo * subtree = item->toDirInfo();
+
+	if ( _smartRefresh )
+	    addJob( new SmartRefreshJob( this, subtree ) );
+	else
+	    addJob( new LocalDirReadJob( this, subtree ) );
+    }
+}
+
+
+void DirTree::refresh( DirInfo * subtree )
+{
+    if ( ! _root )
+	return;
+
+    if ( ! subtree->checkMagicNumber() )
+    {
+	// Not using CHECK_MAGIC() here which would throw an exception since
+	// this might easily happen after cleanup actions with multi selection
+	// if one selected item is in the subtree of another, and that parent
+	// was already refreshed.
+
+	logWarning() << "Item is no longer valid - not refreshing subtree" << endl;
+	return;
+    }
+
+    if ( subtree->isDotEntry() )
+	subtree = subtree->parent();
+
+    if ( isRemote() )
+    {
+	// A subtree can't be read on its own from another machine
+
+	startReading( _url );
+	return;
+    }
+
+    if ( _smartRefresh )
+    {
+	smartRefresh( subtree );
+	return;
+    }
+
+    if ( ! subtree || ! subtree->parent() )	// Refresh all toplevel items
+    {
+	try
+	{
+	    QStringList urls = toplevelUrls();
+
+	    if ( urls.size() > 1 )
+		startReading( urls );
+	    else
+		startReading( QDir::cleanPath( firstToplevel()->url() ) );
+	}
+	catch ( const SysCallFailedException & ex )
+	{
+	    CAUGHT( ex );
+	}
+    }
+    else	// Refresh subtree
+    {
+	// logDebug() << "Refreshing subtree " << subtree << endl;
+
+	clearSubtree( subtree );
+
+	subtree->reset();
+	subtree->setExcluded( false );
+
+	_isBusy = true;
+	subtree->setReadState( DirReading );
+	emit startingReading();
+	addJob( new LocalDirReadJob( this, subtree ) );
+    }
+}
+
+
+void DirTree::abortReading()
+{
+    if ( _jobQueue.isEmpty() )
+    {
+	if ( _isBusy && _daemonClient->isConnected() )
+	{
+	    // Still waiting for the snapshot from the scan daemon
+
+	    _daemonClient->close();
+	    _isBusy = false;
+	    emit aborted();
+	}
+
+	return;
+    }
+
+    if ( _checkpointTimer.isActive() )
+    {
+	_checkpointTimer.stop();
+	writeCheckpoint();
+
+	// Keep it for resumeReading() no matter what is read next
+	_ownCheckpoint = false;
+    }
+
+    _jobQueue.abort();
+
+    _isBusy = false;
+    emit aborted();
+}
+
+
+void DirTree::startCheckpointTimer()
+{
+    if ( _checkpointInterval > 0 )
+	_checkpointTimer.start( _checkpointInterval * 1000 );
+}
+
+
+bool DirTree::writeCheckpoint()
+{
+    QList<DirInfo *> pending;
+
+    if ( ! _isBusy || ! firstToplevel() || ! pendingDirs( pending ) )
+    {
+	// Nothing read yet, or still reading the cache file of a resumed scan
+
+	logInfo() << "No checkpoint possible right now" << endl;
+	return false;
+    }
+
+    if ( hasFileSummaries() )	// See writeCache()
+    {
+	logInfo() << "No checkpoint possible with files only in the directory sums" << endl;
+	return false;
+    }
+
+    QString fileName = checkpointFileName();
+    QString tmpName  = fileName + ".new";
+    QDir().mkpath( QFileInfo( fileName ).path() );
+
+    // Write to a new file first so a crash while writing does not destroy
+    // the previous checkpoint
+
+    CacheWriter writer( tmpName, this );
+
+    if ( ! writer.ok() || rename( tmpName.toUtf8(), fileName.toUtf8() ) != 0 )
+    {
+	logWarning() << "Can't write checkpoint " << fileName << endl;
+	QFile::remove( tmpName );
+
+	return false;
+    }
+
+    logInfo() << "Wrote checkpoint with " << pending.size()
+	      << " pending directories to " << fileName << endl;
+    _ownCheckpoint = true;
+
+    return true;
+}
+
+
+bool DirTree::resumeReading()
+{
+    if ( ! haveCheckpoint() || ! readCache( checkpointFileName() ) )
+	return false;
+
+    // Remove the checkpoint once reading is finished
+
+    _ownCheckpoint = true;
+    startCheckpointTimer();
+
+    return true;
+}
+
+
+QString DirTree::checkpointFileName()
+{
+    QString cacheDir = QStandardPaths::writableLocation( QStandardPaths::GenericCacheLocation );
+
+    return cacheDir + "/qdirstat/scan-checkpoint.cache.gz";
+}
+
+
+bool DirTree::haveCheckpoint()
+{
+    return QFile::exists( checkpointFileName() );
+}
+
+
+void DirTree::finalizeTree()
+{
+    if ( _root && hasFilters() )
+    {
+	// Moving the ignored items to the attics doesn't notify the tree, and
+	// the indexes of the children by name can't be kept up to date in
+	// parallel; they are created again when needed.
+
+	invalidateSubtreeNumbers();
+	dropChildIndexes();
+
+	FileInfo * toplevel = _root->firstChild();
+
+	while ( toplevel )
+	{
+	    if ( toplevel->isDirInfo() )
+	    {
+		finalizeParallel( toplevel->toDirInfo() );
+
+		// A toplevel directory is never moved to the attic
+
+		if ( ! toplevel->isIgnored() && toplevel->totalUnignoredItems() == 0 )
+		    toplevel->setIgnored( true );
+	    }
+
+	    toplevel = toplevel->next();
+	}
+
+	_root->recalc();
+    }
+
+    estimateOverlays();
+}
+
+
+void DirTree::slotFinished()
+{
+    _checkpointTimer.stop();
+
+    if ( _ownCheckpoint )
+    {
+	// The scan is complete, so there is nothing left to resume
+
+	QFile::remove( checkpointFileName() );
+	_ownCheckpoint = false;
+    }
+
+    finalizeTree();
+    _isBusy = false;
+    emit finished();
+
+    if ( _publishOnFinish && SharedTree::publish( this ) )
+	_publishedUrl = _url;
+
+    if ( ! _sessionCacheFile.isEmpty() )
+	writeSessionCache();
+
+    if ( _extents->enabled() )
+	_extents->start( visibleRoot() );
+}
+
+
+void DirTree::writeSessionCache()
+{
+    if ( hasPartialTotals() )
+	return;
+
+    FileInfo * toplevel = firstToplevel();
+
+    if ( ! toplevel || ! toplevel->isDirInfo() || toplevel->isPkgInfo() )
+	return;
+
+    if ( ! _sessionCacheWriter )
+    {
+	_sessionCacheWriter = new BackgroundCacheWriter( this );
+	CHECK_NEW( _sessionCacheWriter );
+    }
+
+    if ( _sessionCacheWriter->isActive() )
+    {
+	logInfo() << "Still writing " << _sessionCacheWriter->fileName() << endl;
+	return;
+    }
+
+    SessionCache::prune( MAX_SESSION_CACHES - 1 );
+    _sessionCacheWriter->start( this, _sessionCacheFile );
+}
+
+
+void DirTree::childAddedNotify( FileInfo * newChild )
+{
+    if ( ! _haveClusterSize )
+        detectClusterSize( newChild );
+
+    _ownerStats->add( newChild );
+    emit childAdded( newChild );
+
+    if ( newChild->dotEntry() )
+	emit childAdded( newChild->dotEntry() );
+}
+
+
+void DirTree::childrenAddedNotify( DirInfo * parent, const FileInfoList & newChildren )
+{
+    if ( newChildren.isEmpty() )
+	return;
+
+    if ( ! _haveClusterSize )
+    {
+	foreach ( FileInfo * child, newChildren )
+	{
+	    detectClusterSize( child );
+
+	    if ( _haveClusterSize )
+		break;
+	}
+    }
+
+    _ownerStats->add( parent, newChildren );
+
+    // Don't bother with a signal for each child if nobody is interested
+
+    if ( receivers( SIGNAL( childAdded( FileInfo * ) ) ) > 0 )
+    {
+	foreach ( FileInfo * child, newChildren )
+	{
+	    emit childAdded( child );
+
+	    if ( child->dotEntry() )
+		emit childAdded( child->dotEntry() );
+	}
+    }
+
+    emit childrenAdded( parent );
+}
+
+
+void DirTree::deletingChildNotify( FileInfo * deletedChild )
+{
+    logDebug() << "Deleting child " << deletedChild << endl;
+    _ownerStats->invalidate();
+    emit deletingChild( deletedChild );
+
+    if ( deletedChild == _root )
+	_root = 0;
+}
+
+
+void DirTree::childDeletedNotify()
+{
+    emit childDeleted();
+}
+
+
+void DirTree::deleteSubtree( FileInfo *subtree )
+{
+    // logDebug() << "Deleting subtree " << subtree << endl;
+    finishStats();
+    DirInfo * parent = subtree->parent();
+
+    // Send notification to anybody interested (e.g., to attached views)
+    deletingChildNotify( subtree );
+
+    if ( parent )
+    {
+	if ( parent->isDotEntry() && ! parent->hasChildren() )
 	    // This was the last child of a dot entry
 	{
 	    // Get rid of that now empty and useless dot entry
@@ -330,43 +1465,172 @@ void DirTree::deleteSubtree( FileInfo *subtree )
 		{
 		    // logDebug() << "Removing empty dot entry " << parent << endl;
 
-		    deletingChildNotify( parent );
-		    parent->parent()->deleteEmptyDotEntry();
+		    deletingChildNotify( parent );
+		    parent->parent()->deleteEmptyDotEntry();
+
+		    delete parent;
+		    parent = 0;
+		}
+	    }
+	    else	// no parent - this should never happen (?)
+	    {
+		logError() << "Internal error: Killing dot entry without parent " << parent << endl;
+
+		// Better leave that dot entry alone - we shouldn't have come
+		// here in the first place. Who knows what will happen if this
+		// thing is deleted now?!
+		//
+		// Intentionally NOT calling:
+		//     delete parent;
+	    }
+	}
+    }
+
+    if ( parent )
+    {
+	// Give the parent of the child to be deleted a chance to unlink the
+	// child from its children list and take care of internal summary
+	// fields
+	parent->deletingChild( subtree );
+    }
+
+    delete subtree;
+
+    if ( subtree == _root )
+    {
+	_root = 0;
+    }
+
+    emit childDeleted();
+}
+
+
+void DirTree::smartRefresh( DirInfo * subtree )
+{
+    if ( subtree && subtree->isDotEntry() )
+	subtree = subtree->parent();
+
+    if ( ! subtree || subtree == _root )
+    {
+	// All toplevel items; there are several after startReading() with
+	// several paths
+
+	QList<DirInfo *> toplevels;
+
+	for ( FileInfo * item = _root ? _root->firstChild() : 0; item; item = item->next() )
+	{
+	    if ( item->isDirInfo() && ! item->isPkgInfo() && ! item->isBusy() )
+		toplevels << item->toDirInfo();
+	}
+
+	if ( toplevels.size() > 1 )
+	{
+	    logDebug() << "Smart refresh for " << toplevels.size() << " toplevel items" << endl;
+
+	    _isBusy = true;
+	    emit startingReading();
+
+	    foreach ( DirInfo * toplevel, toplevels )
+		addJob( new SmartRefreshJob( this, toplevel ) );
+
+	    return;
+	}
+
+	FileInfo * toplevel = firstToplevel();
+	subtree = toplevel ? toplevel->toDirInfo() : 0;
+    }
+
+    if ( ! subtree || subtree->isBusy() )
+    {
+	logWarning() << "Nothing to refresh" << endl;
+	return;
+    }
+
+    logDebug() << "Smart refresh for " << subtree << endl;
+
+    _isBusy = true;
+    emit startingReading();
+    addJob( new SmartRefreshJob( this, subtree ) );
+}
+
+
+void DirTree::refreshDir( DirInfo * dir )
+{
+    if ( dir && dir->isPseudoDir() )
+	dir = dir->parent();
+
+    if ( ! dir || dir == _root || dir->isBusy() )
+	return;
+
+    if ( isRemote() )
+    {
+	startReading( _url );
+	return;
+    }
+
+    logDebug() << "Refreshing " << dir << endl;
+
+    _isBusy = true;
+    emit startingReading();
+    addJob( new SmartRefreshJob( this, dir, false ) );	// not recursive
+}
+
+
+bool DirTree::unfoldFiles( DirInfo * dir )
+{
+    if ( ! dir || ! dir->hasFoldedFiles() || dir->isBusy() )
+	return false;
+
+    logDebug() << "Unfolding the files of " << dir << endl;
+
+    finishStats();
+    dir->setFilesUnfolded( true );
+    refreshDir( dir );
+
+    return true;
+}
+
+
+QHash<QString, DirInfo *> DirTree::detachSubDirs( DirInfo * subtree )
+{
+    QHash<QString, DirInfo *> subDirs;
+
+    if ( ! subtree->hasChildren() )
+	return subDirs;
+
+    finishStats();
+    _ownerStats->invalidate();
+    emit clearingSubtree( subtree );
 
-		    delete parent;
-		    parent = 0;
-		}
-	    }
-	    else	// no parent - this should never happen (?)
-	    {
-		logError() << "Internal error: Killing dot entry without parent " << parent << endl;
+    FileInfo * child = subtree->firstChild();
 
-		// Better leave that dot entry alone - we shouldn't have come
-		// here in the first place. Who knows what will happen if this
-		// thing is deleted now?!
-		//
-		// Intentionally NOT calling:
-		//     delete parent;
+    while ( child )
+    {
+	FileInfo * nextChild = child->next();
+
+	if ( child->isDirInfo() && ! child->isPseudoDir() )
+	{
+	    DirInfo * subDir = child->toDirInfo();
+
+	    if ( ! subDir->isBusy() &&
+		 ( subDir->readState() == DirFinished ||
+		   subDir->readState() == DirCached	) )
+	    {
+		subtree->deletingChild( subDir );	// Just unlink it
+		subDir->setNext( 0 );
+		subDir->clearTouched( true );		// The views forget about it
+		subDir->clearExposed( true );
+		subDirs.insert( subDir->name(), subDir );
 	    }
 	}
-    }
 
-    if ( parent )
-    {
-	// Give the parent of the child to be deleted a chance to unlink the
-	// child from its children list and take care of internal summary
-	// fields
-	parent->deletingChild( subtree );
+	child = nextChild;
     }
 
-    delete subtree;
-
-    if ( subtree == _root )
-    {
-	_root = 0;
-    }
+    subtree->clear();
+    emit subtreeCleared( subtree );
 
-    emit childDeleted();
+    return subDirs;
 }
 
 
@@ -374,6 +1638,8 @@ void DirTree::clearSubtree( DirInfo * subtree )
 {
     if ( subtree->hasChildren() )
     {
+	finishStats();
+	_ownerStats->invalidate();
 	emit clearingSubtree( subtree );
 	subtree->clear();
 	emit subtreeCleared( subtree );
@@ -381,14 +1647,28 @@ void DirTree::clearSubtree( DirInfo * subtree )
 }
 
 
+void DirTree::clearSubtrees( const FileInfoSet & subtrees )
+{
+    finishStats();
+    emit clearingSubtrees( subtrees );
+
+    foreach ( FileInfo * subtree, subtrees )
+	clearSubtree( subtree->toDirInfo() );
+
+    emit subtreesCleared();
+}
+
+
 void DirTree::addJob( DirReadJob * job )
 {
+    finishStats();
     _jobQueue.enqueue( job );
 }
 
 
 void DirTree::addBlockedJob( DirReadJob * job )
 {
+    finishStats();
     _jobQueue.addBlocked( job );
 }
 
@@ -433,6 +1713,44 @@ void DirTree::sendReadJobFinished( DirInfo * dir )
 }
 
 
+void DirTree::filesPagedInNotify( DirInfo * dir )
+{
+    emit filesPagedIn( dir );
+}
+
+
+void DirTree::pagingInFilesNotify( DirInfo * dir )
+{
+    finishStats();
+    emit pagingInFiles( dir );
+}
+
+
+void DirTree::addStatsEngine( StatsEngine * engine )
+{
+    if ( ! _statsEngines.contains( engine ) )
+	_statsEngines << engine;
+}
+
+
+void DirTree::removeStatsEngine( StatsEngine * engine )
+{
+    _statsEngines.removeAll( engine );
+}
+
+
+void DirTree::finishStats()
+{
+    // A worker thread of an engine must not wait for itself
+
+    if ( QThread::currentThread() != thread() )
+	return;
+
+    while ( ! _statsEngines.isEmpty() )
+	_statsEngines.takeFirst()->waitForDone();
+}
+
+
 FileInfo * DirTree::locate( QString url, bool findPseudoDirs )
 {
     if ( ! _root )
@@ -451,33 +1769,132 @@ FileInfo * DirTree::locate( QString url, bool findPseudoDirs )
 }
 
 
-bool DirTree::writeCache( const QString & cacheFileName )
+TreeSnapshotDirPtr DirTree::snapshot( DirInfo * subtree ) const
+{
+    if ( ! subtree )
+    {
+	FileInfo * toplevel = firstToplevel();
+
+	if ( ! toplevel || ! toplevel->isDirInfo() )
+	    return TreeSnapshotDirPtr();
+
+	subtree = toplevel->toDirInfo();
+    }
+
+    return TreeSnapshotDir::take( subtree );
+}
+
+
+bool DirTree::writeCache( const QString & cacheFileName,
+			  const QString & baselineFileName )
 {
+    if ( hasFileSummaries() )
+    {
+	// The cache file would have smaller totals without any notice
+
+	logError() << "Not writing " << cacheFileName
+		   << ": Some files are only in the sums of their directories" << endl;
+	return false;
+    }
+
+    if ( ! baselineFileName.isEmpty() )
+    {
+	if ( cacheFileName.endsWith( BINARY_CACHE_SUFFIX ) )
+	{
+	    logError() << "Delta cache files are only supported in the text format" << endl;
+	    return false;
+	}
+
+	CacheWriter writer( cacheFileName, this, false, true, baselineFileName );
+	return writer.ok();
+    }
+
+    if ( cacheFileName.endsWith( BINARY_CACHE_SUFFIX ) )
+    {
+	BinaryCacheWriter writer( cacheFileName, this );
+	return writer.ok();
+    }
+
     CacheWriter writer( cacheFileName.toUtf8(), this );
     return writer.ok();
 }
 
 
-bool DirTree::readCache( const QString & cacheFileName )
+bool DirTree::readCache( const QString & cacheFileName,
+			 const QString & subtreePrefix,
+			 bool		 checkStale,
+			 bool		 refreshAll )
 {
-    CacheReader * reader = new CacheReader( cacheFileName, this, 0 );
-    CHECK_NEW( reader );
+    {
+	// Just check if this is a valid cache file; the CacheReadJob opens
+	// it again.
+
+	CacheReader reader( cacheFileName, this, 0 );
 
-    if ( ! reader->ok() )
-        return false;
+	if ( ! reader.ok() )
+	    return false;
+    }
 
     _isBusy = true;
     emit startingReading();
-    addJob( new CacheReadJob( this, 0, cacheFileName ) );
+    CacheReadJob * job = new CacheReadJob( this, 0, cacheFileName );
+    CHECK_NEW( job );
+
+    if ( ! subtreePrefix.isEmpty() && job->reader() )
+	job->reader()->setSubtreePrefix( subtreePrefix );
+
+    job->setCheckStale( checkStale );
+    job->setRefreshAll( refreshAll );
+
+    _lazyCacheFile.clear();
+
+    if ( _lazyCacheDepth > 0 && job->reader() &&
+	 job->reader()->setLazyDepth( _lazyCacheDepth ) )
+    {
+	_lazyCacheFile = cacheFileName;
+    }
+
+    addJob( job );
+
+    return true;
+}
+
+
+bool DirTree::readCachePlaceholder( DirInfo * dir )
+{
+    if ( ! dir || ! dir->isCachePlaceholder() || _lazyCacheFile.isEmpty() )
+	return false;
+
+    CacheReader * reader = new CacheReader( _lazyCacheFile, this, dir );
+    CHECK_NEW( reader );
+
+    if ( ! reader->ok() || ! reader->readSubtree( dir ) )
+    {
+	logWarning() << "Can't read " << dir << " from " << _lazyCacheFile << endl;
+	delete reader;
+
+	return false;
+    }
+
+    reader->setLazyDepth( _lazyCacheDepth );
+    dir->setCachePlaceholder( false );
+    dir->setReadState( DirReading );
+
+    // No startingReading() here: This is called while a view is busy
+    // with its layout.
+
+    _isBusy = true;
+    addJob( new CacheReadJob( this, dir, reader ) );
 
     return true;
 }
 
 
-void DirTree::clearAndReadCache( const QString & cacheFileName )
+void DirTree::clearAndReadCache( const QString & cacheFileName,
+				 bool		 checkStale )
 {
     clear();
-    readCache( cacheFileName );
+    readCache( cacheFileName, QString(), checkStale );
 }
 
 
@@ -494,6 +1911,65 @@ void DirTree::readPkg( const PkgFilter & pkgFilter )
 }
 
 
+bool DirTree::readPkgFileList( PkgInfo * pkg )
+{
+    if ( ! pkg || ! pkg->isFileListPending() )
+	return false;
+
+    // No startingReading() here: This is called while a view is busy
+    // with its layout.
+
+    _isBusy = true;
+
+    PkgReader reader( this );
+    reader.readFileList( pkg );
+    prioritize( pkg );
+
+    return true;
+}
+
+
+void DirTree::readRemote( const QString & url )
+{
+    if ( _root->hasChildren() )
+	clear();
+
+    _url    = url;
+    _device = "";
+    logInfo() << "Remote url: \"" << _url << "\"" << endl;
+
+    _isBusy = true;
+    emit startingReading();
+
+    RemoteHostList hosts;
+    QString	   remoteDir;
+    RemoteReadJob::parseUrl( url, hosts, remoteDir );
+
+    if ( hosts.size() > 1 )
+    {
+	// This deletes itself when it is done
+
+	RemoteScanCoordinator * coordinator = new RemoteScanCoordinator( this, url );
+	CHECK_NEW( coordinator );
+
+	coordinator->start();
+    }
+    else
+    {
+	RemoteReadJob * job = new RemoteReadJob( this, url );
+	CHECK_NEW( job );
+
+	addJob( job );
+    }
+}
+
+
+bool DirTree::isRemote() const
+{
+    return RemoteReadJob::isRemoteUrl( _url );
+}
+
+
 void DirTree::setExcludeRules( ExcludeRules * newRules )
 {
     if ( _excludeRules )
@@ -521,23 +1997,78 @@ void DirTree::setExcludeRules( ExcludeRules * newRules )
 
 void DirTree::addFilter( DirTreeFilter * filter )
 {
-    if ( filter )
+    if ( ! filter )
+	return;
+
+    // Keep the cheaper filters that only check the name first
+
+    if ( filter->checksNameOnly() )
+	_filters.insert( _nameFilterCount++, filter );
+    else
 	_filters << filter;
 }
 
 
+qint64 DirTree::filterMemoryUsage() const
+{
+    qint64 bytes = 0;
+
+    foreach ( const DirTreeFilter * filter, _filters )
+	bytes += filter->memoryUsage();
+
+    return bytes;
+}
+
+
 void DirTree::clearFilters()
 {
     qDeleteAll( _filters );
     _filters.clear();
+    _nameFilterCount = 0;
 }
 
 
 bool DirTree::checkIgnoreFilters( const QString & path )
 {
-    foreach ( DirTreeFilter * filter, _filters )
+    if ( _nameFilterCount > 0 &&
+	 checkIgnoreNameFilters( path.mid( path.lastIndexOf( '/' ) + 1 ) ) )
+    {
+	return true;
+    }
+
+    return checkIgnorePathFilters( path );
+}
+
+
+bool DirTree::checkIgnoreNameFilters( const QString & name )
+{
+    for ( int i = 0; i < _nameFilterCount; ++i )
+    {
+	if ( _filters.at( i )->ignoreName( name ) )
+	    return true;
+    }
+
+    return false;
+}
+
+
+bool DirTree::checkIgnorePathFilters( const QString & path )
+{
+    for ( int i = _nameFilterCount; i < _filters.size(); ++i )
+    {
+	if ( _filters.at( i )->ignore( path ) )
+	    return true;
+    }
+
+    return false;
+}
+
+
+bool DirTree::checkIgnorePathFilters( const QString & dirPath, const QString & name )
+{
+    for ( int i = _nameFilterCount; i < _filters.size(); ++i )
     {
-	if ( filter->ignore( path ) )
+	if ( _filters.at( i )->ignoreEntry( dirPath, name ) )
 	    return true;
     }
 
@@ -545,96 +2076,148 @@ bool DirTree::checkIgnoreFilters( const QString & path )
 }
 
 
-void DirTree::moveIgnoredToAttic( DirInfo * dir )
+void DirTree::finalizeParallel( DirInfo * dir )
 {
-    if ( ! dir )
-        return;
+    const int threads = qMin( QThread::idealThreadCount(), FINALIZE_MAX_THREADS );
 
-    if ( dir->totalIgnoredItems() == 0 && dir->totalUnignoredItems() > 0 )
+    if ( threads < 2 || dir->totalItems() < FINALIZE_PARALLEL_MIN_ITEMS )
+    {
+	finalizeFiltered( dir );
 	return;
+    }
 
-    // Not using FileInfoIterator because we don't want to iterate over the dot
-    // entry as well, just the normal children.
+    // Split the largest subtree into its subdirectories until there are
+    // enough subtrees or they are all small. The subtrees are independent
+    // of each other, so they are finalized in parallel. The directories
+    // that were split are finalized afterwards, each one after its
+    // subdirectories, i.e. in the reverse order of splitting.
 
-    FileInfo * child = dir->firstChild();
-    FileInfoList ignoredChildren;
+    const int maxParts = threads * FINALIZE_PARTS_PER_THREAD;
+    const int minSplitItems = dir->totalItems() / maxParts;
 
-    while ( child )
+    QList<DirInfo *> subtrees;
+    QList<DirInfo *> splitDirs;
+    subtrees << dir;
+
+    while ( ! subtrees.isEmpty() && subtrees.size() < maxParts )
     {
-	if ( child->isIgnored() )
-	{
-	    // Don't move the child right here, otherwise the iteration breaks
-	    ignoredChildren << child;
-	}
-	else
+	std::sort( subtrees.begin(), subtrees.end(), moreItems );
+
+	if ( subtrees.first()->totalItems() < minSplitItems )
+	    break;
+
+	DirInfo * largest = subtrees.takeFirst();
+	splitDirs << largest;
+
+	for ( FileInfo * child = largest->firstChild(); child; child = child->next() )
 	{
-            moveIgnoredToAttic( child->toDirInfo() );
+	    if ( child->isDirInfo() )
+		subtrees << child->toDirInfo();
 	}
-
-	child = child->next();
     }
 
+    // Largest first, so the small ones at the end fill the gaps
 
-    foreach ( FileInfo * child, ignoredChildren )
-    {
-	// logDebug() << "Moving ignored " << child << " to attic" << endl;
-	dir->moveToAttic( child );
+    std::sort( subtrees.begin(), subtrees.end(), moreItems );
 
-	if ( child->isDirInfo() )
-	    unatticAll( child->toDirInfo() );
-    }
+    QAtomicInt nextSubtree( 0 );
+    QThreadPool pool;
+    pool.setMaxThreadCount( threads );
 
-    if ( ! ignoredChildren.isEmpty() )
+    for ( int i = 0; i < threads && i < subtrees.size(); ++i )
     {
-	dir->recalc();
-
-	if ( dir->attic() )
-	    dir->attic()->recalc();
+	FinalizeFilteredTask * task = new FinalizeFilteredTask( subtrees, nextSubtree );
+	CHECK_NEW( task );
+	pool.start( task );	// auto-deleted when done
     }
+
+    // Nothing else may change the tree meanwhile, so don't process any
+    // events
+
+    pool.waitForDone();
+
+    for ( int i = splitDirs.size() - 1; i >= 0; --i )
+	finalizeFilteredDir( splitDirs.at( i ) );
 }
 
 
-void DirTree::ignoreEmptyDirs( DirInfo * dir )
+void DirTree::finalizeFiltered( DirInfo * dir )
 {
     CHECK_PTR( dir );
 
+    // Post-order: All subdirectories are final before their parent
+
     FileInfo * child = dir->firstChild();
-    FileInfoList ignoredChildren;
 
     while ( child )
     {
-	if ( ! child->isIgnored() && child->isDirInfo() )
-	{
-	    DirInfo * subDir = child->toDirInfo();
-
-	    if ( subDir->totalUnignoredItems() == 0 )
-		// && ! subDir->isMountPoint()
-	    {
-		// logDebug() << "Ignoring empty subdir " << subDir << endl;
-		subDir->setIgnored( true );
-	    }
-	    else
-	    {
-		ignoreEmptyDirs( subDir );
-	    }
-	}
+	if ( child->isDirInfo() )
+	    finalizeFiltered( child->toDirInfo() );
 
 	child = child->next();
     }
+
+    finalizeFilteredDir( dir );
 }
 
 
-void DirTree::unatticAll( DirInfo * dir )
+void DirTree::finalizeFilteredDir( DirInfo * dir )
 {
-    CHECK_PTR( dir );
+    if ( dir->dotEntry() )
+	recalc( dir->dotEntry() );
 
     if ( dir->attic() )
+	recalc( dir->attic() );
+
+    dir->recalc();
+
+    // The parents are not notified of the moves below, so any cached
+    // statistics would be outdated
+
+    dir->dropStatsCache();
+
+    if ( dir->totalUnignoredItems() == 0 )
+	return;
+
+    // Nothing to move if nothing in this subtree is ignored; empty
+    // subdirectories are still marked as ignored, though.
+
+    bool moveToAttic = dir->totalIgnoredItems() > 0;
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( ! child->isIgnored() && child->isDirInfo() && child->totalUnignoredItems() == 0 )
+	{
+	    // logDebug() << "Ignoring empty subdir " << child << endl;
+	    child->setIgnored( true );
+	}
+    }
+
+    if ( ! moveToAttic )
+	return;
+
+    FileInfoList movedDirs;
+    dir->moveIgnoredToAttic( &movedDirs );
+
+    if ( ! movedDirs.isEmpty() )
     {
-	// logDebug() << "Moving all attic children to the normal children list for " << dir << endl;
-	dir->takeAllChildren( dir->attic() );
-	dir->deleteEmptyAttic();
+	foreach ( FileInfo * moved, movedDirs )
+	    unatticAll( moved->toDirInfo() );
+
+	if ( dir->attic() )
+	    dir->attic()->recalc();
+
 	dir->recalc();
     }
+}
+
+
+void DirTree::unatticAll( DirInfo * dir )
+{
+    CHECK_PTR( dir );
+
+    // logDebug() << "Moving all attic children to the normal children list for " << dir << endl;
+    dir->takeAtticChildren();
 
     FileInfoIterator it( dir );
 
@@ -648,6 +2231,13 @@ void DirTree::unatticAll( DirInfo * dir )
 }
 
 
+void DirTree::dropChildIndexes()
+{
+    foreach ( const DirInfo * dir, _childIndexes.keys() )
+	const_cast<DirInfo *>( dir )->dropChildIndex();
+}
+
+
 void DirTree::recalc( DirInfo * dir )
 {
     CHECK_PTR( dir );
@@ -12,18 +12,32 @@
 
 
 #include <QList>
+#include <QHash>
+#include <QTimer>
+#include <QStringList>
 
 #include "DirReadJob.h"
+#include "DirInfo.h"
+#include "FileInfoSet.h"
 #include "PkgFilter.h"
+#include "MemoryPressure.h"
 
 
 namespace QDirStat
 {
+    class AsyncCommand;
+    class BackgroundCacheWriter;
+    class CacheVerifier;
     class DirInfo;
     class DirReadJob;
-    class FileInfoSet;
     class ExcludeRules;
     class DirTreeFilter;
+    class ExtentScanner;
+    class HardLinkIndex;
+    class OwnerStats;
+    class PkgInfo;
+    class SpillStore;
+    class ScanDaemonClient;
 
 
     /**
@@ -41,7 +55,7 @@ namespace QDirStat
      *
      * See also FileInfo, DirInfo.
      **/
-    class DirTree: public QObject
+    class DirTree: public QObject, public DiscardableCache
     {
 	Q_OBJECT
 
@@ -59,6 +73,12 @@ namespace QDirStat
 	 **/
 	virtual ~DirTree();
 
+	/**
+	 * Free memory under memory pressure: Drop the cached sort orders and
+	 * statistics of all directories. Implemented from DiscardableCache.
+	 **/
+	virtual void evictCache( int percent ) Q_DECL_OVERRIDE;
+
 
      public slots:
 
@@ -70,14 +90,47 @@ namespace QDirStat
 	 * caller a chance to set up Qt signal connections, and for this the
 	 * constructor must return before any signals are sent, i.e. before
 	 * anything is read.
+	 *
+	 * If a scan daemon is running for 'path', the tree is taken over from
+	 * there instead of reading anything (see ScanDaemon).
 	 **/
 	void startReading( const QString & path );
 
+	/**
+	 * Start reading several local directories at once into this tree.
+	 * Each of them is a toplevel item below the invisible root item, so
+	 * their sizes can be compared in the views.
+	 *
+	 * All read jobs go into the same job queue; it already reads
+	 * directories on different devices in parallel, so a slow device
+	 * does not hold up the others.
+	 *
+	 * Remote URLs, the scan daemon and shared trees are not used here.
+	 * With only one path, this is the same as startReading() with that
+	 * path.
+	 **/
+	void startReading( const QStringList & paths );
+
 	/**
 	 * Forcefully stop a running read process.
 	 **/
 	void abortReading();
 
+	/**
+	 * Write a checkpoint of the tree that is currently being read to
+	 * checkpointFileName(): A cache file with everything that is read so
+	 * far and the directories that are still pending. resumeReading()
+	 * can continue from there if reading was aborted or the program
+	 * crashed.
+	 *
+	 * This is done automatically every checkpointInterval() seconds and
+	 * when reading is aborted.
+	 *
+	 * Returns true if OK, false upon error or if there is nothing to
+	 * write a checkpoint for right now.
+	 **/
+	bool writeCheckpoint();
+
 	/**
 	 * Refresh a subtree, i.e. read its contents from disk again.
 	 *
@@ -86,13 +139,387 @@ namespace QDirStat
 	 * become invalid (a subtreeDeleted() signal will be emitted to notify
 	 * about that fact).
 	 *
-	 * When 0 is passed, the entire tree will be refreshed, i.e. from the
-	 * first toplevel element on.
+	 * When 0 is passed, the entire tree will be refreshed, i.e. all
+	 * toplevel items.
+	 *
+	 * If smart refresh is enabled, this uses smartRefresh() instead.
 	 **/
 	void refresh( DirInfo * subtree = 0 );
 
 	/**
-	 * Refresh a number of subtrees.
+	 * Refresh a subtree, but only read those directories again whose
+	 * modification time changed; keep the children of all others (see
+	 * SmartRefreshJob). This is a lot faster than a normal refresh if
+	 * most of the tree did not change, in particular after reading a
+	 * cache file.
+	 *
+	 * When 0 is passed, the entire tree will be refreshed, i.e. all
+	 * toplevel items.
+	 **/
+	void smartRefresh( DirInfo * subtree = 0 );
+
+	/**
+	 * Read only the direct children of 'dir' again, but keep its
+	 * subdirectories that are completely read, including their subtrees.
+	 * This is used for live updates when it is known that something
+	 * changed in 'dir' (see DirWatcher).
+	 **/
+	void refreshDir( DirInfo * dir );
+
+	/**
+	 * Return 'true' if refresh() should do a smart refresh.
+	 **/
+	bool smartRefreshEnabled() const { return _smartRefresh; }
+
+	/**
+	 * Enable or disable smart refresh for refresh().
+	 **/
+	void setSmartRefreshEnabled( bool enabled )
+	    { _smartRefresh = enabled; }
+
+	/**
+	 * Return 'true' if mount points get a size estimate from the used
+	 * size of their filesystem until they are read.
+	 **/
+	bool useSizeEstimates() const { return _useSizeEstimates; }
+
+	/**
+	 * Enable or disable size estimates for mount points.
+	 **/
+	void setUseSizeEstimates( bool use )
+	    { _useSizeEstimates = use; }
+
+	/**
+	 * Return 'true' if startReading() gets the tree from a scan daemon
+	 * for that directory if there is one (see ScanDaemon).
+	 **/
+	bool useScanDaemon() const { return _useScanDaemon; }
+
+	/**
+	 * Enable or disable getting the tree from a scan daemon.
+	 **/
+	void setUseScanDaemon( bool use )
+	    { _useScanDaemon = use; }
+
+	/**
+	 * Return 'true' if startReading() takes the tree from a shared
+	 * memory segment that another session published for that directory
+	 * if there is one (see SharedTree).
+	 **/
+	bool useSharedTrees() const { return _useSharedTrees; }
+
+	/**
+	 * Enable or disable taking the tree from a shared memory segment.
+	 **/
+	void setUseSharedTrees( bool use )
+	    { _useSharedTrees = use; }
+
+	/**
+	 * Return 'true' if the tree is published in a shared memory segment
+	 * for other sessions after reading a directory is finished.
+	 **/
+	bool publishTrees() const { return _publishTrees; }
+
+	/**
+	 * Enable or disable publishing the tree in shared memory.
+	 **/
+	void setPublishTrees( bool publish )
+	    { _publishTrees = publish; }
+
+	/**
+	 * Return 'true' if startReading() shows the tree from the session
+	 * cache for that directory right away if there is one and then
+	 * checks it for changes, and if a session cache file is written in
+	 * the background when reading a directory is finished (see
+	 * SessionCache).
+	 **/
+	bool useSessionCache() const { return _useSessionCache; }
+
+	/**
+	 * Enable or disable the session cache.
+	 **/
+	void setUseSessionCache( bool use )
+	    { _useSessionCache = use; }
+
+	/**
+	 * If 'dir' is a mount point of a filesystem of its own, set its size
+	 * estimate to the used size of that filesystem. This is only one
+	 * statfs() call, so there is a fairly good idea of the size right
+	 * away, long before reading that subtree is finished; and for mount
+	 * points that are not read at all.
+	 *
+	 * Btrfs subvolumes share the space of the whole filesystem, and bind
+	 * mounts show only part of a filesystem, so they don't get an
+	 * estimate. Neither do network mounts where statfs() might block.
+	 *
+	 * Overlay filesystems (e.g. of containers) are never read: Their
+	 * layers are directories of another filesystem that are read there
+	 * just once, no matter how many overlays use them. When reading is
+	 * finished, an overlay gets the sum of its layers as its estimate if
+	 * all of them are in this tree (see estimateOverlays()).
+	 **/
+	void estimateSize( DirInfo * dir );
+
+	/**
+	 * Notification that 'dir' is the root of a Btrfs subvolume on the
+	 * same filesystem as its parent, i.e. it has a device number of its
+	 * own, but it is not a filesystem boundary.
+	 *
+	 * Its directories are then read by a thread pool of their own (see
+	 * DirScanner::setSubvolume()). If size estimates are enabled, the
+	 * size that Btrfs quota groups report for it is queried in the
+	 * background and used as its size estimate; this only works if quota
+	 * groups are enabled for that filesystem, and typically only for
+	 * root.
+	 **/
+	void subvolumeFound( DirInfo * dir );
+
+	/**
+	 * Return the size estimate for 'dir' or -1 if there is none.
+	 * Use DirInfo::sizeEstimate() instead which also checks if the
+	 * estimate is still needed.
+	 **/
+	FileSize sizeEstimate( const DirInfo * dir ) const
+	    { return _sizeEstimates.value( dir, -1 ); }
+
+	/**
+	 * Store the size estimate for 'dir'; -1 removes it. Use
+	 * DirInfo::setSizeEstimate() instead.
+	 **/
+	void setSizeEstimate( const DirInfo * dir, FileSize estimate );
+
+	/**
+	 * Return the fraction of the non-directory entries of very large
+	 * directories that is read in a sampling scan, or 0.0 if every entry
+	 * is read (the default). See also DirScanner::scanDir().
+	 *
+	 * This is only used when starting to read a tree; refreshing a
+	 * subtree always reads it exactly.
+	 **/
+	double sampleFraction() const { return _sampleFraction; }
+
+	/**
+	 * Set the fraction for sampling scans. 0.0 disables sampling.
+	 **/
+	void setSampleFraction( double fraction )
+	    { _sampleFraction = qBound( 0.0, fraction, 1.0 ); }
+
+	/**
+	 * Return the sample of directory 'dir'. Use DirInfo::isSampled()
+	 * first to check if there is one.
+	 **/
+	DirSample sample( const DirInfo * dir ) const
+	    { return _samples.value( dir ); }
+
+	/**
+	 * Store the sample of 'dir'; 0 removes it. Use DirInfo::setSample()
+	 * and DirInfo::dropSample() instead.
+	 **/
+	void setSample( const DirInfo * dir, const DirSample * sample );
+
+	/**
+	 * Return the directories in 'subtree' (0 for the complete tree) that
+	 * could not be read, in no particular order.
+	 *
+	 * This is an index that is kept up to date while reading, so this
+	 * does not need to traverse the tree.
+	 **/
+	QList<DirInfo *> readErrorDirs( const FileInfo * subtree = 0 ) const;
+
+	/**
+	 * Return the number of directories in the tree that could not be
+	 * read.
+	 **/
+	int readErrorCount() const { return _readErrors.size(); }
+
+	/**
+	 * Return the errno of the failed system call for unreadable
+	 * directory 'dir' or 0 if it is unknown.
+	 **/
+	int readErrorNumber( const DirInfo * dir ) const
+	    { return _readErrors.value( const_cast<DirInfo *>( dir ), 0 ); }
+
+	/**
+	 * Add 'dir' to the unreadable directories with errno 'errorNumber'
+	 * (0 if unknown). DirInfo::setReadState() does this automatically
+	 * for the error states; read jobs only need to call this to add the
+	 * errno.
+	 **/
+	void setReadError( DirInfo * dir, int errorNumber = 0 )
+	    { _readErrors.insert( dir, errorNumber ); }
+
+	/**
+	 * Remove 'dir' from the unreadable directories. DirInfo does this
+	 * automatically when its read state changes or when it is deleted.
+	 **/
+	void dropReadError( DirInfo * dir )
+	    { _readErrors.remove( dir ); }
+
+	/**
+	 * Return the half width of the 95% confidence interval of the total
+	 * size of 'subtree' or -1 if nothing in it is extrapolated from a
+	 * sample. Use DirInfo::sampleError() instead.
+	 **/
+	FileSize sampleError( const DirInfo * subtree ) const;
+
+	/**
+	 * Return the index of the children of 'dir' by name; this creates an
+	 * empty one if there is none yet. Use DirInfo::findDirectChild()
+	 * instead.
+	 **/
+	QHash<QString, FileInfo *> & childIndex( const DirInfo * dir )
+	    { return _childIndexes[ dir ]; }
+
+	/**
+	 * Drop the index of the children of 'dir' by name. Use
+	 * DirInfo::dropChildIndex() instead.
+	 **/
+	void dropChildIndex( const DirInfo * dir )
+	    { _childIndexes.remove( dir ); }
+
+	/**
+	 * Make sure the depth-first numbers of all directories (see
+	 * DirInfo::subtreeFirst()) are up to date; renumber the whole tree if
+	 * anything was added or moved since the last time. Return 'false' if
+	 * they can't be used because the tree is busy: They would be outdated
+	 * again right away.
+	 *
+	 * Removing items does not invalidate the numbers of the others.
+	 **/
+	bool updateSubtreeNumbers();
+
+	/**
+	 * Notification that a directory was added or moved, so the
+	 * depth-first numbers need to be updated.
+	 **/
+	void invalidateSubtreeNumbers() { _subtreeNumbersValid = false; }
+
+	/**
+	 * Return 'true' if this tree is read in directories-only mode: No
+	 * FileInfo objects are created for the non-directory entries of each
+	 * directory; they are only added to the directory's sums (see
+	 * DirFileSummary). So memory usage depends only on the number of
+	 * directories, not on the number of files.
+	 *
+	 * Files with multiple hard links and ignored files are still added
+	 * as tree items.
+	 **/
+	bool dirsOnly() const { return _dirsOnly; }
+
+	/**
+	 * Enable or disable directories-only mode. This is only used when
+	 * reading directories.
+	 **/
+	void setDirsOnly( bool dirsOnly ) { _dirsOnly = dirsOnly; }
+
+	/**
+	 * Return the size below which regular files are folded into the
+	 * file summary of their directory (see DirFileSummary) instead of
+	 * getting a FileInfo object, or 0 if no files are folded (the
+	 * default). This is directories-only mode just for small files: On
+	 * trees with huge numbers of tiny files, they are most of the memory,
+	 * but hardly ever interesting one by one.
+	 *
+	 * Files with multiple hard links and ignored files are still added
+	 * as tree items.
+	 **/
+	FileSize foldFilesBelow() const { return _foldFilesBelow; }
+
+	/**
+	 * Set the size below which files are folded. 0 disables folding.
+	 * This is only used when reading directories.
+	 **/
+	void setFoldFilesBelow( FileSize size ) { _foldFilesBelow = qMax( size, 0LL ); }
+
+	/**
+	 * Read directory 'dir' with folded files (see
+	 * DirInfo::hasFoldedFiles()) again without folding any of its files,
+	 * so they show up as tree items. This is used when a view wants to
+	 * show the contents of that directory.
+	 *
+	 * Return 'false' if there is nothing to unfold or if the directory is
+	 * busy.
+	 **/
+	bool unfoldFiles( DirInfo * dir );
+
+	/**
+	 * Return the number of directory levels below the toplevel that are
+	 * loaded when a cache file is opened, or 0 if the complete cache file
+	 * is loaded (the default).
+	 *
+	 * Deeper directories are only added as placeholders that are loaded
+	 * when a view needs their contents. This needs a CacheIndex to skip
+	 * their subtrees in the cache file; without one, the complete cache
+	 * file is loaded anyway.
+	 **/
+	int lazyCacheDepth() const { return _lazyCacheDepth; }
+
+	/**
+	 * Set the number of directory levels that are loaded when a cache
+	 * file is opened. 0 loads everything.
+	 **/
+	void setLazyCacheDepth( int depth ) { _lazyCacheDepth = qMax( depth, 0 ); }
+
+	/**
+	 * Return the file summary of directory 'dir'. Use
+	 * DirInfo::fileSummary() instead.
+	 **/
+	DirFileSummary fileSummary( const DirInfo * dir ) const
+	    { return _fileSummaries.value( dir ); }
+
+	/**
+	 * Return 'true' if any directory has files that are only in its
+	 * file summary (directories only, folded small files). Cache files
+	 * have no place for those.
+	 **/
+	bool hasFileSummaries() const { return ! _fileSummaries.isEmpty(); }
+
+	/**
+	 * Store the file summary of 'dir'; 0 removes it. Use
+	 * DirInfo::setFileSummary() and DirInfo::dropFileSummary() instead.
+	 **/
+	void setFileSummary( const DirInfo * dir, const DirFileSummary * summary );
+
+	/**
+	 * Return 'true' if this tree is in out-of-core mode: Only the
+	 * directories are kept in memory; the files of each directory are
+	 * moved to the spill store when reading that directory is finished
+	 * and paged in again when a view needs them. See SpillStore.
+	 *
+	 * This is meant for trees with far more files than fit into memory.
+	 **/
+	bool outOfCore() const { return _outOfCore; }
+
+	/**
+	 * Enable or disable out-of-core mode. This is only used when reading
+	 * directories; files that are already in the spill store stay there
+	 * until they are paged in.
+	 **/
+	void setOutOfCore( bool outOfCore ) { _outOfCore = outOfCore; }
+
+	/**
+	 * Return 'true' if identical file names share their memory. See
+	 * CompactName. This is global for all trees.
+	 **/
+	bool shareNames() const { return CompactName::sharing(); }
+
+	/**
+	 * Enable or disable sharing identical file names. This is for trees
+	 * that have the same names over and over again, like source
+	 * checkouts; it only affects names that are read from now on.
+	 **/
+	void setShareNames( bool share ) { CompactName::setSharing( share ); }
+
+	/**
+	 * Return the store for the files of out-of-core trees.
+	 **/
+	SpillStore * spillStore() const { return _spillStore; }
+
+	/**
+	 * Refresh a number of subtrees as one batch: Each directory is read
+	 * only once, all subtrees are cleared in one go (see
+	 * clearSubtrees()), and all read jobs are queued together, so there
+	 * is only one startingReading() and one finished() signal.
 	 **/
 	void refresh( const FileInfoSet & refreshSet );
 
@@ -107,11 +534,35 @@ namespace QDirStat
 	 **/
 	void clearSubtree( DirInfo * subtree );
 
+	/**
+	 * Clear a number of subtrees like clearSubtree(). This is bracketed
+	 * by clearingSubtrees() and subtreesCleared(), so the views can do
+	 * their bookkeeping for all of them at once.
+	 **/
+	void clearSubtrees( const FileInfoSet & subtrees );
+
+	/**
+	 * Delete all children of a subtree like clearSubtree(), but take the
+	 * subdirectories that are completely read out of the tree instead of
+	 * deleting them and return them with their names as the keys. The
+	 * caller takes over ownership of them.
+	 *
+	 * This is used for a smart refresh (see SmartRefreshJob).
+	 **/
+	QHash<QString, DirInfo *> detachSubDirs( DirInfo * subtree );
+
 	/**
 	 * Finalize the complete tree after all read jobs are done.
 	 **/
 	void finalizeTree();
 
+	/**
+	 * Set the size estimates of the overlay filesystems that were found
+	 * while reading to the sum of the sizes of their layers in this tree.
+	 * This only refers to the layers; nothing is counted twice.
+	 **/
+	void estimateOverlays();
+
 
     public:
 
@@ -138,6 +589,26 @@ namespace QDirStat
 	 **/
 	FileInfo * firstToplevel() const;
 
+	/**
+	 * Return the item that contains everything that was opened: The
+	 * first toplevel item or, if several directories were opened
+	 * together, the invisible root item above all of them.
+	 **/
+	FileInfo * visibleRoot() const;
+
+	/**
+	 * Return the URLs of all toplevel items.
+	 **/
+	QStringList toplevelUrls() const;
+
+	/**
+	 * Return an immutable snapshot of 'subtree' (the first toplevel
+	 * directory if 0) that other threads can use while this tree keeps
+	 * changing, or a null pointer if there is no such directory. See
+	 * TreeSnapshotDir.
+	 **/
+	TreeSnapshotDirPtr snapshot( DirInfo * subtree = 0 ) const;
+
 	/**
 	 * Return 'true' if 'item' is a toplevel item, i.e. a direct child of
 	 * the root item.
@@ -151,9 +622,21 @@ namespace QDirStat
 
 	/**
 	 * Clear all items of this tree.
+	 *
+	 * The old items are not deleted right away: They are taken out of the
+	 * tree and deleted bit by bit in the background (see reapNodes()), so
+	 * reading a new directory can start at once even if the old tree had
+	 * millions of items.
 	 **/
 	void clear();
 
+	/**
+	 * Don't delete any items when this tree is destroyed: The process is
+	 * about to end, and the system reclaims all the memory at once much
+	 * faster than deleting millions of items one by one.
+	 **/
+	void prepareForExit() { _skipNodeDeletion = true; }
+
 	/**
 	 * Clear all items, exclude rules and filters of this tree.
 	 **/
@@ -176,6 +659,12 @@ namespace QDirStat
 	 **/
 	void addJob( DirReadJob * job );
 
+	/**
+	 * Read the directories in 'subtree' before all others if reading is
+	 * still in progress. See DirReadJobQueue::prioritize().
+	 **/
+	void prioritize( DirInfo * subtree ) { _jobQueue.prioritize( subtree ); }
+
 	/**
 	 * Add a new directory read job to the list of blocked jobs. A job may
 	 * be blocked because it may be waiting for an external process to
@@ -204,6 +693,43 @@ namespace QDirStat
 	void setCrossFilesystems( bool doCross )
 	    { _crossFilesystems = doCross; }
 
+	/**
+	 * Should cache files (.qdirstat.cache.gz) found while reading local
+	 * directories be used instead of reading those directories?
+	 **/
+	bool useCacheFiles() const { return _useCacheFiles; }
+
+	/**
+	 * Enable or disable using cache files found while reading.
+	 **/
+	void setUseCacheFiles( bool use )
+	    { _useCacheFiles = use; }
+
+	/**
+	 * Should cache files found while reading local directories be
+	 * checked for directories that changed since they were written? See
+	 * CacheReadJob::setCheckStale().
+	 **/
+	bool checkStaleCaches() const { return _checkStaleCaches; }
+
+	/**
+	 * Enable or disable checking cache files found while reading.
+	 **/
+	void setCheckStaleCaches( bool check )
+	    { _checkStaleCaches = check; }
+
+	/**
+	 * Return the number of worker threads for reading local directories.
+	 * 0 or 1 means that everything is read in the GUI thread.
+	 **/
+	int scanThreads() { return _jobQueue.scanner()->threadCount(); }
+
+	/**
+	 * Set the number of worker threads for reading local directories.
+	 **/
+	void setScanThreads( int threadCount )
+	    { _jobQueue.setScanThreads( threadCount ); }
+
 	/**
 	 * Notification that a child has been added.
 	 *
@@ -212,6 +738,14 @@ namespace QDirStat
 	 **/
 	virtual void childAddedNotify( FileInfo *newChild );
 
+	/**
+	 * Notification that a batch of children has been added to 'parent'
+	 * with DirInfo::insertChildren().
+	 *
+	 * This emits one childrenAdded() signal for the complete batch.
+	 **/
+	void childrenAddedNotify( DirInfo * parent, const FileInfoList & newChildren );
+
 	/**
 	 * Notification that a child is about to be deleted.
 	 *
@@ -255,29 +789,123 @@ namespace QDirStat
 	 **/
 	void sendReadJobFinished( DirInfo * dir );
 
+	/**
+	 * Notification that the files of 'dir' were paged in from the spill
+	 * store. This emits a filesPagedIn() signal.
+	 **/
+	void filesPagedInNotify( DirInfo * dir );
+
+	/**
+	 * Notification that the files of 'dir' are about to be paged in
+	 * from the spill store. This emits a pagingInFiles() signal.
+	 **/
+	void pagingInFilesNotify( DirInfo * dir );
+
 	/**
 	 * Returns 'true' if directory reading is in progress in this tree.
 	 **/
 	bool isBusy() { return _isBusy; }
 
+	/**
+	 * Register 'engine' while its threads collect statistics from this
+	 * tree (see StatsEngine::start()).
+	 **/
+	void addStatsEngine( StatsEngine * engine );
+
+	/**
+	 * Unregister 'engine' when its threads are done.
+	 **/
+	void removeStatsEngine( StatsEngine * engine );
+
+	/**
+	 * Wait until all registered StatsEngines are done. This is called
+	 * before anything changes the tree, so the items are not pulled out
+	 * from under their threads.
+	 **/
+	void finishStats();
+
 	/**
 	 * Write the complete tree to a cache file.
 	 *
+	 * If 'baselineFileName' is not empty, write only the directories that
+	 * changed since that cache file was written (a delta cache file).
+	 * Reading the delta cache file later also reads its baseline.
+	 *
 	 * Returns true if OK, false upon error.
 	 **/
-	bool writeCache( const QString & cacheFileName );
+	bool writeCache( const QString & cacheFileName,
+			 const QString & baselineFileName = QString() );
 
 	/**
-	 * Read a cache file.
+	 * Read a cache file. If 'subtreePrefix' is not empty, only the
+	 * subtree of that directory (and the directories on the way there) is
+	 * loaded; the rest of the cache file is skipped while reading.
+	 *
+	 * If 'checkStale' is 'true', the directories that changed since the
+	 * cache file was written are read again afterwards. If 'refreshAll'
+	 * is 'true', the complete tree is checked for that (see
+	 * CacheReadJob::setRefreshAll()).
 	 *
 	 * Returns true if OK, false upon error.
 	 **/
-	bool readCache( const QString & cacheFileName );
+	bool readCache( const QString & cacheFileName,
+			const QString & subtreePrefix = QString(),
+			bool		checkStale    = false,
+			bool		refreshAll    = false );
 
 	/**
 	 * Clear the tree and read a cache file.
 	 **/
-	void clearAndReadCache( const QString & cacheFileName );
+	void clearAndReadCache( const QString & cacheFileName,
+				bool		checkStale = false );
+
+	/**
+	 * Read the contents of cache placeholder 'dir' (see
+	 * DirInfo::isCachePlaceholder()) from the cache file it came from.
+	 *
+	 * Returns true if OK, false upon error.
+	 **/
+	bool readCachePlaceholder( DirInfo * dir );
+
+	/**
+	 * Read the checkpoint file of an interrupted scan and continue
+	 * reading the directories that were still pending when it was
+	 * written. Like with readCache(), the tree should be cleared first.
+	 *
+	 * Returns true if OK, false upon error.
+	 **/
+	bool resumeReading();
+
+	/**
+	 * Return the interval in seconds for writing checkpoints while
+	 * reading or 0 if checkpoints are disabled.
+	 **/
+	int checkpointInterval() const { return _checkpointInterval; }
+
+	/**
+	 * Set the interval in seconds for writing checkpoints while reading.
+	 * 0 disables checkpoints.
+	 **/
+	void setCheckpointInterval( int seconds )
+	    { _checkpointInterval = qMax( 0, seconds ); }
+
+	/**
+	 * Return the name of the checkpoint file.
+	 **/
+	static QString checkpointFileName();
+
+	/**
+	 * Return 'true' if there is a checkpoint file to resume reading from.
+	 **/
+	static bool haveCheckpoint();
+
+	/**
+	 * Collect the directories that are not read yet in 'dirs'. Return
+	 * 'false' if that is not possible for all of them. See
+	 * DirReadJobQueue::pendingDirs().
+	 **/
+	bool pendingDirs( QList<DirInfo *> & dirs ) const
+	    { return _jobQueue.pendingDirs( dirs ); }
 
 	/**
 	 * Read installed packages that match the specified PkgFilter and their
@@ -285,6 +913,29 @@ namespace QDirStat
 	 **/
 	void readPkg( const PkgFilter & pkgFilter );
 
+	/**
+	 * Read the file list of package 'pkg' that was deferred until a view
+	 * needs it (see PkgInfo::isFileListPending()). Its read job is put
+	 * first in the queue.
+	 *
+	 * Returns true if OK, false upon error.
+	 **/
+	bool readPkgFileList( PkgInfo * pkg );
+
+	/**
+	 * Read a directory on another machine with the remote scan agent
+	 * (see RemoteScan.h). 'url' is "ssh://[user@]host[:port]/path".
+	 * With a comma-separated list of hosts, the work is distributed among
+	 * all of them (see RemoteScanCoordinator). startReading() does this
+	 * automatically for such URLs.
+	 **/
+	void readRemote( const QString & url );
+
+	/**
+	 * Return 'true' if this tree was read from another machine.
+	 **/
+	bool isRemote() const;
+
 	/**
 	 * Return exclude rules specific to this tree (as opposed to the global
 	 * ones stored in the ExcludeRules singleton) or 0 if there are none.
@@ -312,6 +963,9 @@ namespace QDirStat
 	/**
 	 * Add a filter to ignore files during directory reading.
 	 *
+	 * Filters that only check the filename are always checked before
+	 * those that need the complete path.
+	 *
 	 * The DirTree takes over ownership of the filter object and will
 	 * delete it when appropriate.
 	 **/
@@ -329,11 +983,48 @@ namespace QDirStat
 	 **/
 	bool checkIgnoreFilters( const QString & path );
 
+	/**
+	 * Check only the filters that only need the filename against 'name'
+	 * or only the other filters against the complete path 'path'. This
+	 * is the same as checkIgnoreFilters(), but the path only needs to be
+	 * built if no filter on the name matched.
+	 **/
+	bool checkIgnoreNameFilters( const QString & name );
+	bool checkIgnorePathFilters( const QString & path );
+
+	/**
+	 * Check only the filters that need the complete path against entry
+	 * 'name' in directory 'dirPath'. This does not need to build the
+	 * complete path for filters that can do without it (see
+	 * DirTreeFilter::ignoreEntry()).
+	 **/
+	bool checkIgnorePathFilters( const QString & dirPath, const QString & name );
+
+	/**
+	 * Return 'true' if there is any filter that needs the complete path.
+	 **/
+	bool hasPathFilters() const { return _nameFilterCount < _filters.size(); }
+
 	/**
 	 * Return 'true' if there is any filter, 'false' if not.
 	 **/
 	bool hasFilters() const { return ! _filters.isEmpty(); }
 
+	/**
+	 * Return 'true' if the totals of this tree don't match the disk
+	 * because of filters, sampling, or files that are only in the sums
+	 * (directories only, folded files). A cache file of such a tree
+	 * would look complete when it is read again, but it isn't.
+	 **/
+	bool hasPartialTotals() const
+	    { return hasFilters() || _sampleFraction > 0.0 || _dirsOnly || _foldFilesBelow > 0; }
+
+	/**
+	 * Return an estimate of the memory that the filters keep, e.g. the
+	 * file list cache of a DirTreePkgFilter, in bytes.
+	 **/
+	qint64 filterMemoryUsage() const;
+
 	/**
 	 * Return 'true' if this DirTree is in the process of being destroyed,
 	 * so any FileInfo / DirInfo pointers stored outside the tree might
@@ -341,6 +1032,37 @@ namespace QDirStat
 	 **/
 	bool beingDestroyed() const { return _beingDestroyed; }
 
+	/**
+	 * Return 'true' if items that were already taken out of this tree
+	 * are being deleted (see reapNodes()): They don't need to remove
+	 * themselves from any index of the tree anymore.
+	 **/
+	bool reapingNodes() const { return _reapingNodes; }
+
+	/**
+	 * Return the index of all files with multiple hard links in this tree
+	 * by device and inode number.
+	 **/
+	HardLinkIndex * hardLinks() const { return _hardLinks; }
+
+	/**
+	 * Return the extent-aware disk usage of the larger files in this
+	 * tree. If it is enabled, it is started when reading is finished.
+	 **/
+	ExtentScanner * extents() const { return _extents; }
+
+	/**
+	 * Return the disk usage by user and by group in this tree. This is
+	 * kept up to date while reading.
+	 **/
+	OwnerStats * ownerStats() const { return _ownerStats; }
+
+	/**
+	 * Return the checker of the tree contents against the disk, e.g.
+	 * after reading a cache file.
+	 **/
+	CacheVerifier * cacheVerifier() const { return _cacheVerifier; }
+
         /**
          * Return the number of 512-bytes blocks per cluster.
          *
@@ -366,6 +1088,16 @@ namespace QDirStat
 	 **/
 	void childAdded( FileInfo * newChild );
 
+	/**
+	 * Emitted once for a whole batch of children that have been added to
+	 * 'parent'. This is much cheaper to handle than an individual
+	 * childAdded() signal for each of them.
+	 *
+	 * Notice that childAdded() is still emitted for each of those children
+	 * if anybody is connected to it.
+	 **/
+	void childrenAdded( DirInfo * parent );
+
 	/**
 	 * Emitted when the tree is about to be cleared.
 	 **/
@@ -397,6 +1129,19 @@ namespace QDirStat
 	 **/
 	void subtreeCleared( DirInfo * subtree );
 
+	/**
+	 * Emitted before a number of subtrees are cleared at once. The
+	 * clearingSubtree() and subtreeCleared() signals for each of them
+	 * follow.
+	 **/
+	void clearingSubtrees( const FileInfoSet & subtrees );
+
+	/**
+	 * Emitted when clearing the subtrees from clearingSubtrees() is
+	 * finished.
+	 **/
+	void subtreesCleared();
+
 	/**
 	 * Emitted when reading is started.
 	 **/
@@ -423,6 +1168,20 @@ namespace QDirStat
 	 **/
 	void readJobFinished( DirInfo * dir );
 
+	/**
+	 * Emitted when the files of 'dir' were paged in from the spill store,
+	 * i.e. there are new children in memory that are already included in
+	 * all sums.
+	 **/
+	void filesPagedIn( DirInfo * dir );
+
+	/**
+	 * Emitted just before the files of 'dir' are paged in from the spill
+	 * store, i.e. before the children of 'dir' change. Anything that
+	 * walks the tree in another thread must stop now.
+	 **/
+	void pagingInFiles( DirInfo * dir );
+
 	/**
 	 * Single line progress information, emitted when the read status
 	 * changes - typically when a new directory is being read. Connect to a
@@ -439,37 +1198,111 @@ namespace QDirStat
 	 **/
 	void slotFinished();
 
+	/**
+	 * Notification that the quota group query for a subvolume is done.
+	 **/
+	void qgroupQueryFinished( AsyncCommand * command );
+
+	/**
+	 * Delete some of the items that clear() took out of the tree, as
+	 * many as possible within a short time slice, so the user interface
+	 * and reading the new tree go on in between. This is called with a
+	 * zero duration timer until all of them are gone.
+	 **/
+	void reapNodes();
+
 
     protected:
 
 	/**
-	 * Recurse through the tree from 'dir' on and move any ignored items to
-	 * the attic on the same level.
+	 * Finalize the subtree of toplevel directory 'dir' for a tree with
+	 * filters with finalizeFiltered(): For a large tree, split it into
+	 * independent subtrees that are finalized in parallel and finalize
+	 * the directories above them afterwards.
 	 **/
-	void moveIgnoredToAttic( DirInfo * dir );
+	void finalizeParallel( DirInfo * dir );
 
 	/**
-	 * Recurse through the tree from 'dir' on and ignore any empty dirs
-	 * (i.e. dirs without any unignored non-directory child) that are not
-	 * ignored yet.
+	 * Finalize the subtree of 'dir' for a tree with filters in one
+	 * post-order traversal: Recalculate the sums, ignore the empty
+	 * subdirectories (i.e. those without any unignored non-directory
+	 * item) and move the ignored items to the attic on the same level.
+	 *
+	 * An empty directory is left alone: Its parent moves it to the attic
+	 * as a whole, with nothing inside moved to any attic.
+	 *
+	 * This changes nothing outside of the subtree (see
+	 * DirInfo::moveIgnoredToAttic()), so it can be used for different
+	 * subtrees in parallel.
 	 **/
-	void ignoreEmptyDirs( DirInfo * dir );
+	static void finalizeFiltered( DirInfo * dir );
+
+	/**
+	 * The part of finalizeFiltered() for 'dir' itself when its
+	 * subdirectories are finalized already.
+	 **/
+	static void finalizeFilteredDir( DirInfo * dir );
 
 	/**
 	 * Move all items from the attic to the normal children list.
 	 **/
-	void unatticAll( DirInfo * dir );
+	static void unatticAll( DirInfo * dir );
+
+	/**
+	 * Drop the indexes of the children by name of all directories.
+	 **/
+	void dropChildIndexes();
+
+	friend class FinalizeFilteredTask;
 
 	/**
 	 * Recursively force a complete recalculation of all sums.
 	 **/
-	void recalc( DirInfo * dir );
+	static void recalc( DirInfo * dir );
 
         /**
          * Try to derive the cluster size from 'item'.
          **/
         void detectClusterSize( FileInfo * item );
 
+	/**
+	 * Start the timer for writing checkpoints if they are enabled.
+	 **/
+	void startCheckpointTimer();
+
+	/**
+	 * Start the next waiting quota group query if none is running.
+	 **/
+	void startQgroupQuery();
+
+	/**
+	 * Write the tree to the session cache file for the directory that
+	 * was read in the background (see SessionCache).
+	 **/
+	void writeSessionCache();
+
+	/**
+	 * Create the toplevel item for local directory or file 'url' and
+	 * queue a read job for it if it is a directory. Return the new item
+	 * or 0 if 'url' can't be read and 'doThrow' is 'false'; otherwise
+	 * that throws a SysCallFailedException.
+	 **/
+	FileInfo * addToplevel( const QString & url, bool doThrow = true );
+
+	/**
+	 * Return the number of entries that reading 'url' is expected to
+	 * find, based on the used inodes of its filesystem and, if reading
+	 * crosses filesystems, of the filesystems mounted below it. Return 0
+	 * if that can't be estimated, e.g. if 'url' is not a mount point.
+	 **/
+	FileCount expectedEntries( const QString & url ) const;
+
+	/**
+	 * Take all children of 'dir' out of the tree and queue them for
+	 * reapNodes().
+	 **/
+	void reapChildren( DirInfo * dir );
+
 
 
 	// Data members
@@ -477,14 +1310,58 @@ namespace QDirStat
 	DirInfo *		_root;
 	DirReadJobQueue		_jobQueue;
 	bool			_crossFilesystems;
+	bool			_useCacheFiles;
+	bool			_checkStaleCaches;
+	bool			_smartRefresh;
+	bool			_useSizeEstimates;
+	double			_sampleFraction;
+	int			_checkpointInterval;
+	QTimer			_checkpointTimer;
+	bool			_ownCheckpoint;
 	bool			_isBusy;
 	QString			_device;
 	QString			_url;
 	ExcludeRules *		_excludeRules;
+	HardLinkIndex *		_hardLinks;
+	ExtentScanner *		_extents;
+	OwnerStats *		_ownerStats;
+	CacheVerifier *		_cacheVerifier;
+	SpillStore *		_spillStore;
+	ScanDaemonClient *	_daemonClient;
+	bool			_useScanDaemon;
+	bool			_useSharedTrees;
+	bool			_publishTrees;
+	bool			_publishOnFinish;
+	QString			_publishedUrl;		// in shared memory
+	bool			_useSessionCache;
+	QString			_sessionCacheFile;	// to write when finished
+	BackgroundCacheWriter * _sessionCacheWriter;
+	bool			_outOfCore;
+	bool			_dirsOnly;
+	FileSize		_foldFilesBelow;
+	int			_lazyCacheDepth;
+	QString			_lazyCacheFile;		// with placeholders
 	QList<DirTreeFilter *>	_filters;
+	QList<StatsEngine *>	_statsEngines;		// while they are busy
+	int			_nameFilterCount;	// Always first in _filters
 	bool			_beingDestroyed;
+	bool			_skipNodeDeletion;
+	bool			_reapingNodes;
+	QList<FileInfo *>	_reapQueue;		// detached, not yet deleted
+	QTimer			_reapTimer;
+	bool			_subtreeNumbersValid;
         bool                    _haveClusterSize;
         int                     _blocksPerCluster;
+	QStringList		_qgroupQueue;		// subvolume paths
+	QStringList		_overlayMounts;		// paths, waiting for estimates
+	AsyncCommand *		_qgroupCommand;
+	bool			_haveQgroups;
+
+	QHash<const DirInfo *, FileSize> _sizeEstimates;
+	QHash<const DirInfo *, DirSample> _samples;
+	QHash<const DirInfo *, DirFileSummary> _fileSummaries;
+	QHash<DirInfo *, int>		       _readErrors;	// errno or 0
+	QHash<const DirInfo *, QHash<QString, FileInfo *> > _childIndexes;
 
     };	// class DirTree
 
@@ -7,17 +7,28 @@
  */
 
 
+#include <sys/stat.h>   // S_IFMT
 #include <ctype.h>      // isspace()
-#include <QUrl>
+#include <string.h>     // memset()
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
 
 #include "DirTreeCache.h"
+#include "BinaryCache.h"
+#include "BlockGzip.h"
+#include "CacheDelta.h"
+#include "CacheIndex.h"
+#include "CacheSummary.h"
 #include "DirInfo.h"
 #include "DirTree.h"
 #include "DotEntry.h"
 #include "ExcludeRules.h"
 #include "FormatUtil.h"
+#include "SpillStore.h"
 #include "Logger.h"
 #include "Exception.h"
+#include "Trace.h"
 #include "BrokenLibc.h"     // ALLPERMS
 
 #define KB 1024LL
@@ -27,6 +38,10 @@
 
 #define MAX_ERROR_COUNT			1000
 
+// Max. time to wait for the parser thread when reading in time slices
+
+#define MAX_BATCH_WAIT_MILLISEC		10
+
 #define VERBOSE_READ			0
 #define VERBOSE_CACHE_DIRS		0
 #define VERBOSE_CACHE_FILE_INFOS	0
@@ -35,10 +50,166 @@
 using namespace QDirStat;
 
 
-CacheWriter::CacheWriter( const QString & fileName, DirTree *tree )
-    : _withUidGuidPerm( true )
+bool CacheWriter::_fastCompression = false;
+
+
+/**
+ * Append the decimal number 'value' to 'buf'.
+ **/
+static void appendNumber( QByteArray & buf, qint64 value )
+{
+    char   digits[ 24 ];
+    char * end = digits + sizeof( digits );
+    char * pos = end;
+    bool   negative = value < 0;
+    quint64 val = negative ? - (quint64) value : (quint64) value;
+
+    do
+    {
+	*--pos = (char) ( '0' + val % 10 );
+	val /= 10;
+    } while ( val > 0 );
+
+    if ( negative )
+	*--pos = '-';
+
+    buf.append( pos, end - pos );
+}
+
+
+/**
+ * Append 'value' in hex (lowercase, without "0x") to 'buf'.
+ **/
+static void appendHex( QByteArray & buf, quint64 value )
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    char   digits[ 16 ];
+    char * end = digits + sizeof( digits );
+    char * pos = end;
+
+    do
+    {
+	*--pos = hexDigits[ value & 0xF ];
+	value >>= 4;
+    } while ( value > 0 );
+
+    buf.append( pos, end - pos );
+}
+
+
+/**
+ * Append 'value' in octal with at least 'minDigits' digits to 'buf'.
+ **/
+static void appendOctal( QByteArray & buf, uint value, int minDigits )
+{
+    char   digits[ 12 ];
+    char * end = digits + sizeof( digits );
+    char * pos = end;
+
+    do
+    {
+	*--pos = (char) ( '0' + ( value & 7 ) );
+	value >>= 3;
+    } while ( value > 0 || end - pos < minDigits );
+
+    buf.append( pos, end - pos );
+}
+
+
+/**
+ * Pad the field that starts at 'fieldStart' in 'buf' with blanks to
+ * 'width' characters.
+ **/
+static void appendPadding( QByteArray & buf, int fieldStart, int width )
+{
+    int missing = width - ( buf.size() - fieldStart );
+
+    if ( missing > 0 )
+    {
+	int oldSize = buf.size();
+	buf.resize( oldSize + missing );
+	memset( buf.data() + oldSize, ' ', missing );
+    }
+}
+
+
+/**
+ * Return 'true' if the ASCII character 'c' can be written to a cache file
+ * as it is, 'false' if it needs to be escaped.
+ **/
+static inline bool isPlainUrlChar( ushort c )
+{
+    if ( ( c >= 'a' && c <= 'z' ) ||
+	 ( c >= 'A' && c <= 'Z' ) ||
+	 ( c >= '0' && c <= '9' )    )
+    {
+	return true;
+    }
+
+    switch ( c )
+    {
+	case '-': case '.': case '_': case '~':
+	case '!': case '$': case '&': case '\'':
+	case '(': case ')': case '*': case '+':
+	case ',': case ';': case '=': case ':':
+	case '@': case '/':
+	    return true;
+
+	default:
+	    return false;
+    }
+}
+
+
+/**
+ * Append 'byte' in percent notation to 'buf'.
+ **/
+static inline void appendEscapedByte( QByteArray & buf, uchar byte )
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    char escaped[ 3 ];
+    escaped[0] = '%';
+    escaped[1] = hexDigits[ byte >> 4	];
+    escaped[2] = hexDigits[ byte & 0xF ];
+
+    buf.append( escaped, 3 );
+}
+
+
+/**
+ * Return 'true' if 'path' is directory 'dir' or anything below it; unlike
+ * a plain startsWith(), this does not match "/usr/lib64" for "/usr/lib".
+ **/
+static bool isAtOrBelow( const QString & path, const QString & dir )
+{
+    return path.startsWith( dir ) &&
+	( path.size() == dir.size() || path.at( dir.size() ) == '/' || dir.endsWith( '/' ) );
+}
+
+
+CacheWriter::CacheWriter( const QString & fileName,
+			  DirTree *	  tree,
+			  bool		  longFormat,
+			  bool		  withUidGidPerm,
+			  const QString & baselineFileName )
+    : _withUidGuidPerm( withUidGidPerm )
+    , _longFormat( longFormat )
+    , _baselineFileName( baselineFileName )
+    , _changedDirs( 0 )
+    , _index( 0 )
+    , _summary( 0 )
 {
-    _ok = writeCache( fileName, tree );
+    // An old index would not match the new file
+
+    if ( QFile::exists( CacheIndex::fileName( fileName ) ) )
+	QFile::remove( CacheIndex::fileName( fileName ) );
+
+    if ( baselineFileName.isEmpty() )
+	_ok = writeCache( fileName, tree );
+    else
+	_ok = writeDelta( fileName, tree );
 }
 
 
@@ -58,43 +229,238 @@ bool CacheWriter::writeCache( const QString & fileName, DirTree *tree )
     if ( ! firstToplevel )
         return false;
 
-    gzFile cache = gzopen( (const char *) fileName.toUtf8(), "w" );
+    BlockGzipWriter cache( fileName );
 
-    if ( cache == 0 )
-    {
-	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+    if ( ! cache.ok() )
 	return false;
+
+    cache.setCompressionLevel( _fastCompression ? 1 : -1 );
+    _withUidGuidPerm = _withUidGuidPerm && firstToplevel->hasUid();
+    writeHeader( &cache, _withUidGuidPerm );
+
+    // Index of the directories for reading subtrees
+
+    CacheIndex	 index;
+    CacheSummary summary;
+    _index   = &index;
+    _summary = &summary;
+
+    writeTree( &cache, tree->root()->firstChild() );
+    index.setEnd( cache.blockNo(), cache.blockPos() );
+    _index   = 0;
+    _summary = 0;
+
+    QList<DirInfo *> pendingDirs;
+
+    if ( tree->isBusy() && tree->pendingDirs( pendingDirs ) )
+	writePendingDirs( &cache, pendingDirs );
+
+    // The summary is at the very end; the index knows where
+
+    if ( ! summary.isEmpty() )
+    {
+	index.setSummary( cache.blockNo(), cache.blockPos() );
+	summary.write( &cache );
     }
 
-    _withUidGuidPerm = firstToplevel->hasUid();
-    const char * version = _withUidGuidPerm ? "2.0" : "1.0";
+    if ( ! cache.close() )
+	return false;
+
+    // Without the index, the cache file can still be read from the start
+
+    index.write( fileName, cache.blockOffsets() );
+
+    return true;
+}
 
-    gzprintf( cache, "[qdirstat %s cache file]\n", version );
-    gzprintf( cache,
+
+void CacheWriter::writeHeader( BlockGzipWriter * cache, bool withUidGidPerm )
+{
+    const char * version = withUidGidPerm ? "2.0" : "1.0";
+
+    cache->printf( "[qdirstat %s cache file]\n", version );
+    cache->printf(
               "# Do not edit!\n"
               "#\n" );
 
-    if ( _withUidGuidPerm )
+    if ( withUidGidPerm )
     {
-        gzprintf( cache,
+        cache->printf(
                   "# Type  path                            size     uid   gid  perm.       mtime      <optional fields>\n"
                   "#\n" );
     }
     else
     {
-        gzprintf( cache,
+        cache->printf(
                   "# Type  path                            size    mtime      <optional fields>\n"
                   "#\n" );
     }
+}
 
-    writeTree( cache, tree->root()->firstChild() );
-    gzclose( cache );
 
-    return true;
+bool CacheWriter::writeDelta( const QString & fileName, DirTree *tree )
+{
+    if ( ! tree )
+	return false;
+
+    FileInfo * firstToplevel = tree->firstToplevel();
+
+    if ( ! firstToplevel || ! firstToplevel->isDirInfo() )
+        return false;
+
+    // Read the signatures of all directories of the baseline. The delta
+    // uses the same format as the baseline, so unchanged items have the
+    // same signature.
+
+    QHash<QString, quint64> baseline;
+    bool baselineWithUidGidPerm = false;
+
+    if ( ! CacheDelta::readSignatures( _baselineFileName, baseline, baselineWithUidGidPerm ) )
+    {
+	logError() << "Can't read baseline cache file " << _baselineFileName << endl;
+	return false;
+    }
+
+    BlockGzipWriter cache( fileName );
+
+    if ( ! cache.ok() )
+	return false;
+
+    cache.setCompressionLevel( _fastCompression ? 1 : -1 );
+    _withUidGuidPerm = baselineWithUidGidPerm && firstToplevel->hasUid();
+    const char * version = _withUidGuidPerm ? "2.0" : "1.0";
+
+    // A baseline in the same directory (the usual case for an archive) is
+    // referenced with a relative path, so the archive can be moved.
+
+    QString baselineName = QFileInfo( fileName ).absoluteDir().relativeFilePath( QFileInfo( _baselineFileName ).absoluteFilePath() );
+
+    cache.printf( "[qdirstat %s cache delta]\n", version );
+    cache.printf(
+              "# Do not edit!\n"
+              "#\n"
+              "# Only the directories that changed since the baseline cache file\n"
+              "#\n"
+              "Baseline %s\n"
+              "#\n", urlEncoded( baselineName ).data() );
+
+    writeDeltaTree( &cache, firstToplevel->toDirInfo(), baseline );
+
+    // All directories that are still in the baseline were removed. Write
+    // only the topmost ones; their subdirectories are implicitly removed.
+
+    QStringList removed = baseline.keys();
+    removed.sort();
+    int removedCount = 0;
+
+    foreach ( const QString & key, removed )
+    {
+	if ( baseline.contains( key.left( key.lastIndexOf( '/' ) ) ) )
+	    continue;
+
+	if ( removedCount++ == 0 )
+	    cache.printf( "\n# Removed since the baseline cache file\n#\n" );
+
+	cache.printf( "Removed %s\n", urlEncoded( key ).data() );
+    }
+
+    logInfo() << "Delta against " << _baselineFileName << ": "
+	      << _changedDirs << " changed, " << removedCount << " removed dirs" << endl;
+
+    return cache.close();
 }
 
 
-void CacheWriter::writeTree( gzFile cache, FileInfo * item )
+void CacheWriter::writeDeltaTree( BlockGzipWriter	  * cache,
+				  DirInfo		  * dir,
+				  QHash<QString, quint64> & baseline )
+{
+    if ( ! dir )
+	return;
+
+    // The files of a directory are in its dot entry or, after finalizing,
+    // directly in the directory
+
+    QList<FileInfo *> files;
+    quint64 sig = signature( dir );
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( ! child->isDirInfo() )
+	    files << child;
+    }
+
+    if ( dir->dotEntry() )
+    {
+	for ( FileInfo * child = dir->dotEntry()->firstChild(); child; child = child->next() )
+	    files << child;
+    }
+
+    // Temporary objects for the files in the spill store of an out-of-core
+    // tree
+
+    FileInfoList spilledFiles;
+
+    if ( dir->hasSpilledFiles() )
+	dir->tree()->spillStore()->load( dir, spilledFiles );
+
+    if ( dir->dotEntry() && dir->dotEntry()->hasSpilledFiles() )
+	dir->tree()->spillStore()->load( dir->dotEntry(), spilledFiles );
+
+    files += spilledFiles;
+
+    foreach ( FileInfo * file, files )
+	sig += signature( file );
+
+    QHash<QString, quint64>::iterator it = baseline.find( itemUrl( dir ) );
+    bool changed = it == baseline.end() || it.value() != sig;
+
+    if ( it != baseline.end() )
+	baseline.erase( it );
+
+    if ( changed )
+    {
+	writeItem( cache, dir );
+
+	foreach ( FileInfo * file, files )
+	    writeItem( cache, file );
+
+	++_changedDirs;
+    }
+
+    qDeleteAll( spilledFiles );
+
+    // Recurse through subdirectories
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() && ! child->isDotEntry() )
+	    writeDeltaTree( cache, child->toDirInfo(), baseline );
+    }
+}
+
+
+quint64 CacheWriter::signature( FileInfo * item )
+{
+    // Only what writeItem() writes and the same way CacheParser reads it
+
+    mode_t mode = item->mode() & S_IFMT;
+
+    if ( _withUidGuidPerm )
+	mode |= item->mode() & ALLPERMS;
+
+    return CacheDelta::itemSignature( item->isDirInfo() ? QString() : item->name(),
+				      mode,
+				      item->rawByteSize(),
+				      _withUidGuidPerm ? item->uid() : 0,
+				      _withUidGuidPerm ? item->gid() : 0,
+				      item->mtime(),
+				      item->isSparseFile() ? item->blocks() : -1,
+				      item->isFile() && item->links() > 1 ? item->links() : 1 );
+}
+
+
+void CacheWriter::writeTree( BlockGzipWriter * cache, FileInfo * item )
 {
     if ( ! item )
 	return;
@@ -113,6 +479,20 @@ void CacheWriter::writeTree( gzFile cache, FileInfo * item )
     if ( item->dotEntry() )
 	writeTree( cache, item->dotEntry() );
 
+    if ( item->isDirInfo() && item->toDirInfo()->hasSpilledFiles() )
+    {
+	// Files of an out-of-core tree: Use temporary objects from the spill
+	// store without paging them in
+
+	FileInfoList files;
+	item->tree()->spillStore()->load( item->toDirInfo(), files );
+
+	foreach ( FileInfo * file, files )
+	    writeItem( cache, file );
+
+	qDeleteAll( files );
+    }
+
     //
     // Recurse through subdirectories
     //
@@ -127,81 +507,166 @@ void CacheWriter::writeTree( gzFile cache, FileInfo * item )
 }
 
 
-void CacheWriter::writeItem( gzFile cache, FileInfo * item )
+void CacheWriter::writeItem( BlockGzipWriter * cache, FileInfo * item )
 {
     if ( ! item )
 	return;
 
+    if ( _index && item->isDirInfo() && ! item->isDotEntry() )
+    {
+	_index->add( itemUrl( item ), cache->blockNo(), cache->blockPos(),
+		     item->totalAllocatedSize() );
+    }
+
+    if ( _summary )
+    {
+	if ( item->isDirInfo() && ! item->isDotEntry() )
+	    _summary->addDir( item->toDirInfo(), itemUrl( item ) );
+	else if ( item->isFile() )
+	    _summary->addFile( item );
+    }
+
+    bool absolute = ( item->isDirInfo() && ! item->isDotEntry() ) || _longFormat;
+
+    formatItem( _lineBuffer,
+		absolute ? itemUrl( item ) : item->name(),
+		absolute,
+		item->mode(),
+		item->rawByteSize(),
+		_withUidGuidPerm,
+		item->uid(),
+		item->gid(),
+		item->mtime(),
+		item->isSparseFile() ? item->blocks() : -1,
+		item->isFile() ? item->links() : 1 );
+
+    cache->write( _lineBuffer );
+}
+
+
+void CacheWriter::formatItem( QByteArray &    line,
+			      const QString & name,
+			      bool	      absolute,
+			      mode_t	      mode,
+			      FileSize	      size,
+			      bool	      withUidGidPerm,
+			      uid_t	      uid,
+			      gid_t	      gid,
+			      time_t	      mtime,
+			      FileSize	      sparseBlocks,
+			      nlink_t	      links )
+{
+    // The line is formatted into a buffer that is reused for all items:
+    // No printf() and no temporary strings for the fields
+
+    line.truncate( 0 );		// This keeps the capacity
+
     // Write file type
 
     const char * file_type = "";
-    if	    ( item->isFile()		)	file_type = "F";
-    else if ( item->isDir()		)	file_type = "D";
-    else if ( item->isSymLink()		)	file_type = "L";
-    else if ( item->isBlockDevice()	)	file_type = "BlockDev";
-    else if ( item->isCharDevice()	)	file_type = "CharDev";
-    else if ( item->isFifo()		)	file_type = "FIFO";
-    else if ( item->isSocket()		)	file_type = "Socket";
+    if	    ( S_ISREG ( mode ) )	file_type = "F";
+    else if ( S_ISDIR ( mode ) )	file_type = "D";
+    else if ( S_ISLNK ( mode ) )	file_type = "L";
+    else if ( S_ISBLK ( mode ) )	file_type = "BlockDev";
+    else if ( S_ISCHR ( mode ) )	file_type = "CharDev";
+    else if ( S_ISFIFO( mode ) )	file_type = "FIFO";
+    else if ( S_ISSOCK( mode ) )	file_type = "Socket";
 
-    gzprintf( cache, "%s", file_type );
+    line += file_type;
 
     // Write name
 
-    if ( item->isDirInfo() && ! item->isDotEntry() )
+    if ( absolute )
     {
 	// Use absolute path
 
-	gzprintf( cache, " %-30s", urlEncoded( item->url() ).data() );
+	line += ' ';
+	int start = line.size();
+	appendEncoded( line, name );
+	appendPadding( line, start, 30 );
     }
     else
     {
 	// Use relative path
 
-	gzprintf( cache, "\t%-24s", urlEncoded( item->name() ).data() );
+	line += '\t';
+	int start = line.size();
+	appendEncoded( line, name );
+	appendPadding( line, start, 24 );
     }
 
 
     // Write size
 
-    gzprintf( cache, "\t%s", formatSize( item->rawByteSize() ).toUtf8().data() );
+    line += '\t';
+    appendSize( line, size );
 
 
     // Format 2.0 only: UID, GID, permissions
 
-    if ( _withUidGuidPerm )
+    if ( withUidGidPerm )
     {
-        gzprintf( cache, "\t%d  %d  0%3o",
-                  item->uid(),
-                  item->gid(),
-                  item->mode() & ALLPERMS );
+	line += '\t';
+	appendNumber( line, uid );
+	line += "  ";
+	appendNumber( line, gid );
+	line += "  0";
+	appendOctal( line, mode & ALLPERMS, 3 );
     }
 
 
     // Write mtime
 
-    gzprintf( cache, "\t0x%lx", (unsigned long) item->mtime() );
+    line += "\t0x";
+    appendHex( line, (unsigned long) mtime );
 
     // Optional fields
 
-    if ( item->isSparseFile() )
-	gzprintf( cache, "\tblocks: %lld", item->blocks() );
+    if ( sparseBlocks >= 0 )
+    {
+	line += "\tblocks: ";
+	appendNumber( line, sparseBlocks );
+    }
 
-    if ( item->isFile() && item->links() > 1 )
-	gzprintf( cache, "\tlinks: %u", (unsigned) item->links() );
+    if ( links > 1 )
+    {
+	line += "\tlinks: ";
+	appendNumber( line, links );
+    }
 
-    gzputc( cache, '\n' );
+    line += '\n';
 }
 
 
-QByteArray CacheWriter::urlEncoded( const QString & path )
+void CacheWriter::writePendingDirs( BlockGzipWriter * cache, const QList<DirInfo *> & dirs )
 {
-    // Using a protocol ("scheme") part to avoid directory names with a colon
-    // ":" being cut off because it looks like a URL protocol.
-    QUrl url;
-    url.setScheme( "foo" );
-    url.setPath( path );
+    if ( dirs.isEmpty() )
+	return;
 
-    QByteArray encoded = url.toEncoded( QUrl::RemoveScheme );
+    cache->printf( "\n"
+		   "# Not read yet; reading continues there when this file is read\n"
+		   "#\n" );
+
+    foreach ( DirInfo * dir, dirs )
+	cache->printf( "Pending %s\n", urlEncoded( itemUrl( dir ) ).data() );
+}
+
+
+const QString & CacheWriter::itemUrl( FileInfo * item )
+{
+    _urlBuffer.truncate( 0 );	// This keeps the capacity
+
+    StringPathSink sink( _urlBuffer );
+    item->writeUrl( sink );
+
+    return _urlBuffer;
+}
+
+
+QByteArray CacheWriter::urlEncoded( const QString & path )
+{
+    QByteArray encoded;
+    appendEncoded( encoded, path );
 
     if ( encoded.isEmpty() )
     {
@@ -209,7 +674,72 @@ QByteArray CacheWriter::urlEncoded( const QString & path )
     }
 
     return encoded;
+}
+
+
+void CacheWriter::appendEncoded( QByteArray & buf, const QString & path )
+{
+    // Escape everything that is not a plain ASCII character in a URL path
+    // (with the UTF-8 bytes for non-ASCII characters), just like QUrl
+    // would, but without any temporary objects. Unlike QUrl, this also
+    // escapes a '%' that happens to be followed by two hex digits.
+
+    const ushort * str = path.utf16();
+    int		   len = path.size();
+
+    for ( int i=0; i < len; ++i )
+    {
+	ushort c = str[i];
 
+	if ( c < 0x80 )
+	{
+	    if ( isPlainUrlChar( c ) )
+		buf += (char) c;
+	    else
+		appendEscapedByte( buf, (uchar) c );
+
+	    continue;
+	}
+
+	uint ucs4 = c;
+
+	if ( QChar::isHighSurrogate( c ) && i + 1 < len && QChar::isLowSurrogate( str[ i+1 ] ) )
+	    ucs4 = QChar::surrogateToUcs4( c, str[ ++i ] );
+	else if ( QChar::isSurrogate( c ) )
+	    ucs4 = QChar::ReplacementCharacter;
+
+	if ( ucs4 < 0x800 )
+	{
+	    appendEscapedByte( buf, 0xC0 | ( ucs4 >> 6 ) );
+	}
+	else if ( ucs4 < 0x10000 )
+	{
+	    appendEscapedByte( buf, 0xE0 | ( ucs4 >> 12 ) );
+	    appendEscapedByte( buf, 0x80 | ( ( ucs4 >> 6 ) & 0x3F ) );
+	}
+	else
+	{
+	    appendEscapedByte( buf, 0xF0 | ( ucs4 >> 18 ) );
+	    appendEscapedByte( buf, 0x80 | ( ( ucs4 >> 12 ) & 0x3F ) );
+	    appendEscapedByte( buf, 0x80 | ( ( ucs4 >> 6 ) & 0x3F ) );
+	}
+
+	appendEscapedByte( buf, 0x80 | ( ucs4 & 0x3F ) );
+    }
+}
+
+
+void CacheWriter::appendSize( QByteArray & buf, FileSize size )
+{
+    const char * unit = "";
+
+    if	    ( size >= TB && size % TB == 0 ) { size /= TB; unit = "T"; }
+    else if ( size >= GB && size % GB == 0 ) { size /= GB; unit = "G"; }
+    else if ( size >= MB && size % MB == 0 ) { size /= MB; unit = "M"; }
+    else if ( size >= KB && size % KB == 0 ) { size /= KB; unit = "K"; }
+
+    appendNumber( buf, size );
+    buf += unit;
 }
 
 
@@ -239,39 +769,109 @@ QString CacheWriter::formatSize( FileSize size )
 CacheReader::CacheReader( const QString & fileName,
 			  DirTree *	  tree,
 			  DirInfo *	  parent ):
-    QObject(),
-    _multiSlash( "//+" ) // cache regexp for multiple use
+    QObject()
 {
     _fileName		= fileName;
-    _buffer[0]		= 0;
-    _line		= _buffer;
-    _lineNo		= 0;
+    _batchPos		= 0;
     _ok			= true;
     _errorCount         = 0;
     _tree		= tree;
     _toplevel		= parent;
     _lastDir		= 0;
+
+    if ( parent )
+	_dirs.insert( parent->url(), parent );
     _lastExcludedDir	= 0;
+    _skippingDir	= false;
+    _filterDir		= 0;
+    _excludesPushedDown = false;
+    _reuseDir		= 0;
+    _parser		= 0;
+    _binReader		= 0;
+    _delta		= 0;
+    _summary		= 0;
+    _deltaDone		= false;
+    _withUidGidPerm	= false;
+
+    if ( BinaryCacheReader::isBinaryCache( fileName ) )
+    {
+	_binReader = new BinaryCacheReader( fileName, tree, parent );
+	CHECK_NEW( _binReader );
+	_withUidGidPerm = _binReader->withUidGidPerm();
+	_ok = _binReader->ok();
 
-    _cache = gzopen( fileName.toUtf8(), "r" );
+	if ( ! _ok )
+	    emit error();
 
-    if ( _cache == 0 )
-    {
-	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
-	_ok = false;
-	emit error();
 	return;
     }
 
-    // logDebug() << "Opening " << fileName << " OK" << endl;
-    checkHeader();
+    // Decompressing and parsing is done in a separate thread
+
+    _parser = new CacheParser( fileName );
+    CHECK_NEW( _parser );
+
+    if ( _parser->ok() && _parser->isDelta() )
+    {
+	// Read the full cache file at the start of the chain of deltas and
+	// apply the deltas while reading it
+
+	_delta = new CacheDelta( fileName );
+	CHECK_NEW( _delta );
+
+	delete _parser;
+	_parser = new CacheParser( _delta->baseFileName() );
+	CHECK_NEW( _parser );
+	_ok = _delta->ok();
+    }
+
+    _withUidGidPerm = _parser->withUidGidPerm();
+    _ok = _ok && _parser->ok();
+
+    if ( ! _delta )
+    {
+	// Skip excluded subtrees in the parser thread already. Not with
+	// deltas: They are merged by path, so they need all the lines.
+
+	_parser->setExcludeRules( ExcludeRules::instance() );
+	_excludesPushedDown = true;
+
+	if ( _ok && ! parent )
+	{
+	    _summary = new CacheSummary();
+	    CHECK_NEW( _summary );
+
+	    if ( ! _summary->read( fileName ) )
+	    {
+		delete _summary;
+		_summary = 0;
+	    }
+	}
+    }
+
+    if ( ! _ok )
+	emit error();
 }
 
 
 CacheReader::~CacheReader()
 {
-    if ( _cache )
-	gzclose( _cache );
+    if ( _parser )
+	delete _parser;
+
+    if ( _delta )
+	delete _delta;
+
+    if ( _summary )
+	delete _summary;
+
+    if ( _binReader )
+    {
+	if ( ! _toplevel )
+	    _toplevel = _binReader->toplevel();
+
+	delete _binReader;
+    }
 
     logDebug() << "Cache reading finished" << endl;
 
@@ -288,156 +888,217 @@ CacheReader::~CacheReader()
 
 void CacheReader::rewind()
 {
-    if ( _cache )
+    if ( _binReader )
+	_binReader->rewind();
+
+    if ( _parser )
     {
-	gzrewind( _cache );
-	checkHeader();		// skip cache header
+	_parser->rewind();
+	_batch.clear();
+	_batchPos = 0;
+    }
+
+    if ( _delta )
+    {
+	_delta->rewind();
+	_deltaDone = false;
     }
 }
 
 
-bool CacheReader::read( int maxLines )
+DirInfo * CacheReader::toplevel() const
+{
+    if ( ! _toplevel && _binReader )
+	return _binReader->toplevel();
+
+    return _toplevel;
+}
+
+
+void CacheReader::setSubtreePrefix( const QString & path )
 {
-    while ( ! gzeof( _cache )
-	    && _ok
-	    && ( maxLines == 0 || --maxLines > 0 ) )
+    if ( _binReader )
     {
-	if ( readLine() )
-	{
-	    splitLine();
-	    addItem();
-	}
+	_binReader->setSubtreePrefix( path );
+    }
+    else if ( _parser && ! _delta )
+    {
+	if ( ! _parser->seekToSubtree( path ) )
+	    _parser->setSubtreePrefix( path );
+    }
+    else
+    {
+	logWarning() << "Can't load only " << path << " from delta cache " << _fileName << endl;
     }
+}
+
+
+bool CacheReader::readSubtree( DirInfo * dir )
+{
+    if ( ! dir || ! _parser || _delta || ! _parser->seekToSubtree( dir->url() ) )
+	return false;
+
+    _reuseDir	 = dir;
+    _reuseDirUrl = dir->url();
 
-    return _ok && ! gzeof( _cache );
+    return true;
 }
 
 
-void CacheReader::addItem()
+bool CacheReader::setLazyDepth( int depth )
 {
-    int expectedFields = _withUidGidPerm ? 7 : 4;
+    return _parser && ! _delta && _parser->setLazyDepth( depth );
+}
 
-    if ( fieldsCount() < expectedFields )
-    {
-	logError() << "Syntax error in " << _fileName << ":" << _lineNo
-		   << ": Expected at least " << expectedFields
-                   << " fields, saw only " << fieldsCount()
-		   << endl;
 
-	setReadError( _lastDir );
+bool CacheReader::read( int maxLines )
+{
+    TRACE_SPAN( "CacheReader::read" );
 
-	if ( ++_errorCount > MAX_ERROR_COUNT )
+    if ( _binReader )
+    {
+	bool more = _binReader->read( maxLines );
+
+	if ( ! _binReader->ok() && _ok )
 	{
-	    logError() << "Too many syntax errors. Giving up." << endl;
 	    _ok = false;
 	    emit error();
 	}
 
-	return;
+	return more;
     }
 
-    int n = 0;
-    char * type		= field( n++ );
-    char * raw_path	= field( n++ );
-    char * size_str	= field( n++ );
-
-    char * uid_str      = _withUidGidPerm ? field( n++ ) : 0;
-    char * gid_str      = _withUidGidPerm ? field( n++ ) : 0;
-    char * perm_str     = _withUidGidPerm ? field( n++ ) : 0;
+    if ( ! _parser )
+	return false;
 
-    char * mtime_str	= field( n++ );
-    char * blocks_str	= 0;
-    char * links_str	= 0;
+    int count = 0;
 
-    while ( fieldsCount() > n+1 )
+    while ( _ok && ( maxLines == 0 || count < maxLines ) )
     {
-	char * keyword	= field( n++ );
-	char * val_str	= field( n++ );
-
-	if ( strcasecmp( keyword, "blocks:" ) == 0 ) blocks_str = val_str;
-	if ( strcasecmp( keyword, "links:"  ) == 0 ) links_str	= val_str;
-    }
-
+	if ( _batchPos >= _batch.size() )
+	{
+	    _batch.clear();
+	    _batchPos = 0;
 
-    // Type
+	    // When reading in time slices, don't block the GUI thread for
+	    // long if the parser thread does not keep up; just try again
+	    // with the next time slice.
 
-    mode_t mode = S_IFREG;
+	    if ( ! nextBatch( maxLines == 0 ? -1 : MAX_BATCH_WAIT_MILLISEC ) )
+		break;
 
-    if	    ( strcasecmp( type, "F"	   ) == 0 )	mode = S_IFREG;
-    else if ( strcasecmp( type, "D"	   ) == 0 )	mode = S_IFDIR;
-    else if ( strcasecmp( type, "L"	   ) == 0 )	mode = S_IFLNK;
-    else if ( strcasecmp( type, "BlockDev" ) == 0 )	mode = S_IFBLK;
-    else if ( strcasecmp( type, "CharDev"  ) == 0 )	mode = S_IFCHR;
-    else if ( strcasecmp( type, "FIFO"	   ) == 0 )	mode = S_IFIFO;
-    else if ( strcasecmp( type, "Socket"   ) == 0 )	mode = S_IFSOCK;
+	    continue;	// Merging with the deltas may leave nothing
+	}
 
+	addItem( _batch.at( _batchPos++ ) );
+	++count;
+    }
 
-    // Path
+    if ( _ok && ! _parser->ok() && _parser->eof() )
+    {
+	_ok = false;
+	emit error();
+    }
 
-    if ( *raw_path == '/' )
-	_lastDir = 0;
+    return ! eof();
+}
 
 
-    // Size
+bool CacheReader::nextBatch( int timeoutMillisec )
+{
+    if ( ! _delta )
+	return _parser->takeBatch( _batch, timeoutMillisec );
 
-    char * end = 0;
-    FileSize size = strtoll( size_str, &end, 10 );
+    CacheItemBatch batch;
 
-    if ( end )
+    if ( _parser->takeBatch( batch, timeoutMillisec ) )
     {
-	switch ( *end )
-	{
-	    case 'K':	size *= KB; break;
-	    case 'M':	size *= MB; break;
-	    case 'G':	size *= GB; break;
-	    case 'T':	size *= TB; break;
-	    default: break;
-	}
+	_delta->merge( batch, _batch );
+	return true;
     }
 
+    if ( _parser->eof() && ! _deltaDone )
+    {
+	// Now add the directories that are new in the deltas
 
-    // UID, GID, permissions
+	_deltaDone = true;
+	_delta->finish( _batch );
+	return true;
+    }
 
-    uid_t  uid  = uid_str  ? strtol( uid_str,  0, 10 ) : 0;
-    gid_t  gid  = gid_str  ? strtol( gid_str,  0, 10 ) : 0;
-    mode_t perm = perm_str ? strtol( perm_str, 0,  8 ) : 0;
+    return false;
+}
 
-    mode |= perm;
 
+void CacheReader::addItem( const CacheItem & item )
+{
+    if ( item.isPending )
+    {
+	addPendingDir( item );
+	return;
+    }
 
-    // MTime
+    if ( item.isRemoved || item.isBaseline )
+	return;
+
+    if ( item.syntaxError )
+    {
+	int expectedFields = _withUidGidPerm ? 7 : 4;
 
-    time_t mtime = strtol( mtime_str, 0, 0 );
+	logError() << "Syntax error in " << _fileName << ":" << item.lineNo
+		   << ": Expected at least " << expectedFields
+                   << " fields, saw only " << item.fieldsCount
+		   << endl;
 
+	setReadError( _lastDir );
 
-    // Blocks
+	if ( ++_errorCount > MAX_ERROR_COUNT )
+	{
+	    logError() << "Too many syntax errors. Giving up." << endl;
+	    _ok = false;
+	    emit error();
+	}
 
-    FileSize blocks = blocks_str ? strtoll( blocks_str, 0, 10 ) : -1;
+	return;
+    }
 
+    // Path
 
-    // Links
+    const QString & path = item.path;
+    const QString & name = item.name;
 
-    int links = links_str ? atoi( links_str ) : 1;
+    if ( item.absolute )
+    {
+	_lastDir = 0;
 
+	// Still in a subtree that the filters ignore?
 
-    //
-    // Create a new item
-    //
+	_skippingDir = ! _skippedDirUrl.isEmpty() && isAtOrBelow( path, _skippedDirUrl );
+    }
 
-    QString fullPath = unescapedPath( raw_path );
-    QString path;
-    QString name;
-    splitPath( fullPath, path, name );
+    if ( _skippingDir )
+	return;
 
     if ( _lastExcludedDir )
     {
-	if ( path.startsWith( _lastExcludedDirUrl ) )
+	if ( isAtOrBelow( path, _lastExcludedDirUrl ) )
 	{
 	    // logDebug() << "Excluding " << path << "/" << name << endl;
 	    return;
 	}
     }
 
+    if ( _reuseDir && item.isDir && item.absolute && buildPath( path, name ) == _reuseDirUrl )
+    {
+	// The directory from readSubtree() is already in the tree: Only add
+	// its contents
+
+	_lastDir  = _reuseDir;
+	_reuseDir = 0;
+
+	return;
+    }
+
     // Find parent in tree
 
     DirInfo * parent = _lastDir;
@@ -447,6 +1108,18 @@ void CacheReader::addItem()
 	if ( ! _tree->root()->hasChildren() )
 	    parent = _tree->root();
 
+	// Directories from this cache file are in the hash, no matter in which
+	// order the cache file lists them
+
+	if ( ! parent && ! path.isEmpty() )
+	    parent = _dirs.value( path, 0 );
+
+	if ( parent && parent->isExcluded() )
+	{
+	    // logDebug() << "Excluding " << path << "/" << name << endl;
+	    return;
+	}
+
 	// Try the easy way first - the starting point of this cache
 
 	if ( ! parent && _toplevel )
@@ -454,7 +1127,7 @@ void CacheReader::addItem()
 
 #if DEBUG_LOCATE_PARENT
 	if ( parent )
-	    logDebug() << "Using cache starting point as parent for " << fullPath << endl;
+	    logDebug() << "Using cache starting point as parent for " << buildPath( path, name ) << endl;
 #endif
 
 
@@ -472,7 +1145,7 @@ void CacheReader::addItem()
 
 	if ( ! parent ) // Still nothing?
 	{
-	    logError() << _fileName << ":" << _lineNo << ": "
+	    logError() << _fileName << ":" << item.lineNo << ": "
 		       << "Could not locate parent \"" << path << "\" for "
 		       << name << endl;
 
@@ -490,19 +1163,37 @@ void CacheReader::addItem()
 	}
     }
 
-    if ( strcasecmp( type, "D" ) == 0 )
+    if ( parent && parent != _tree->root() && ignoredByFilters( parent, name ) )
+    {
+	// Skip ignored items without even creating them; for a directory,
+	// its complete subtree
+
+	if ( item.isDir )
+	{
+	    _skippedDirUrl = buildPath( path.isEmpty() ? parent->url() : path, name );
+	    _skippingDir   = true;
+	    _lastDir	   = 0;
+	}
+
+	return;
+    }
+
+    if ( item.isDir )
     {
 	QString url = ( parent == _tree->root() ) ? buildPath( path, name ) : name;
 #if VERBOSE_CACHE_DIRS
 	logDebug() << "Creating DirInfo for " << url << " with parent " << parent << endl;
 #endif
 	DirInfo * dir = new DirInfo( _tree, parent, url,
-				     mode, size,
-                                     _withUidGidPerm, uid, gid,
-                                     mtime );
+				     item.mode, item.size,
+                                     _withUidGidPerm, item.uid, item.gid,
+                                     item.mtime );
 	dir->setReadState( DirReading );
 	_lastDir = dir;
 
+	if ( item.absolute )
+	    _dirs.insert( buildPath( path, name ), dir );
+
 	if ( parent )
 	    parent->insertChild( dir );
 
@@ -519,7 +1210,9 @@ void CacheReader::addItem()
 
 	if ( dir != _toplevel )
 	{
-	    if ( ExcludeRules::instance()->match( dir->url(), dir->name() ) )
+	    if ( item.isExcluded ||
+		 ( ! _excludesPushedDown &&
+		   ExcludeRules::instance()->match( dir->url(), dir->name() ) ) )
 	    {
 		logDebug() << "Excluding " << name << endl;
 		dir->setExcluded();
@@ -531,6 +1224,31 @@ void CacheReader::addItem()
 		_lastExcludedDirUrl = _lastExcludedDir->url();
 		_lastDir	    = 0;
 	    }
+	    else if ( item.isLazy )
+	    {
+		// Only a placeholder; the parser skipped its contents. They
+		// are read when a view needs them.
+
+		dir->setCachePlaceholder();
+		dir->setReadState( DirOnRequestOnly );
+
+		if ( item.subtreeSize >= 0 )
+		    dir->setSizeEstimate( item.subtreeSize );
+
+		dir->finalizeLocal();
+		_tree->sendReadJobFinished( dir );
+		_lastDir = 0;
+	    }
+	}
+
+	if ( _summary && _lastDir == dir && item.absolute )
+	{
+	    // Show the size of the top levels right away
+
+	    const CacheSummaryDir * summaryDir = _summary->dir( buildPath( path, name ) );
+
+	    if ( summaryDir )
+		dir->setSizeEstimate( summaryDir->allocatedSize );
 	}
     }
     else
@@ -542,178 +1260,84 @@ void CacheReader::addItem()
 		       << buildPath( parent->debugUrl(), name ) << endl;
 #endif
 
-	    FileInfo * item = new FileInfo( _tree, parent, name,
-					    mode, size,
-                                            _withUidGidPerm, uid, gid,
-                                            mtime,
-                                            blocks, links );
-	    parent->insertChild( item );
-	    _tree->childAddedNotify( item );
+	    FileInfo * newItem = new FileInfo( _tree, parent, name,
+					       item.mode, item.size,
+					       _withUidGidPerm, item.uid, item.gid,
+					       item.mtime,
+					       item.blocks, item.links );
+	    parent->insertChild( newItem );
+	    _tree->childAddedNotify( newItem );
 	}
 	else
 	{
-	    logError() << _fileName << ":" << _lineNo << ": "
+	    logError() << _fileName << ":" << item.lineNo << ": "
 		       << "No parent for item " << name << endl;
 	}
     }
 }
 
 
-bool CacheReader::eof()
+bool CacheReader::ignoredByFilters( DirInfo * parent, const QString & name )
 {
-    if ( ! _ok || ! _cache )
-	return true;
+    if ( ! _tree->hasFilters() )
+	return false;
 
-    return gzeof( _cache );
-}
+    if ( _tree->checkIgnoreNameFilters( name ) )
+	return true;
 
+    if ( ! _tree->hasPathFilters() )
+	return false;
 
-QString CacheReader::firstDir()
-{
-    while ( ! gzeof( _cache ) && _ok )
+    if ( parent != _filterDir )
     {
-	if ( ! readLine() )
-	    return "";
-
-	splitLine();
-
-	if ( fieldsCount() < 2 )
-	    return "";
-
-	int n = 0;
-	char * type = field( n++ );
-	char * path = field( n++ );
-
-	if ( strcasecmp( type, "D" ) == 0 )
-	    return QString( path );
+	_filterDir    = parent;
+	_filterDirUrl = parent->url();
     }
 
-    return "";
+    return _tree->checkIgnorePathFilters( _filterDirUrl, name );
 }
 
 
-bool CacheReader::checkHeader()
+void CacheReader::addPendingDir( const CacheItem & item )
 {
-    if ( ! _ok || ! readLine() )
-	return false;
-
-    // logDebug() << "Checking cache file header" << endl;
-    QString line( _line );
-    splitLine();
-
-    // Check for    [qdirstat <version> cache file]
-    // or	    [kdirstat <version> cache file]
+    FileInfo * dir = _dirs.value( item.path, 0 );
+    _lastDir	   = 0;
 
-    if ( fieldsCount() != 4 )	_ok = false;
-
-    if ( _ok )
-    {
-	if ( ( strcmp( field( 0 ), "[qdirstat" ) != 0 &&
-	       strcmp( field( 0 ), "[kdirstat" ) != 0	) ||
-	     strcmp( field( 2 ), "cache"     ) != 0 ||
-	     strcmp( field( 3 ), "file]"     ) != 0 )
-	{
-	    _ok = false;
-	    logError() << _fileName << ":" << _lineNo
-		      << ": Unknown file format" << endl;
-	}
-    }
+    if ( ! dir )
+	dir = _tree->locate( item.path );
 
-    if ( _ok )
+    if ( ! dir || ! dir->isDirInfo() )
     {
-	QString versionStr = field( 1 );
-        float   version    = versionStr.toFloat( &_ok );
-        _withUidGidPerm    = _ok && version > 1.99;
-
-	if ( ! _ok )
-	    logError() << _fileName << ":" << _lineNo
-		      << ": Incompatible cache file version" << endl;
+	logError() << _fileName << ":" << item.lineNo << ": "
+		   << "No directory \"" << item.path << "\" to continue reading" << endl;
+	return;
     }
 
-    // logDebug() << "Cache file header check OK: " << _ok << endl;
-
-    if ( ! _ok )
-	emit error();
+    if ( dir->isExcluded() )
+	return;
 
-    return _ok;
+    _pendingDirs << dir->toDirInfo();
 }
 
 
-bool CacheReader::readLine()
+bool CacheReader::eof()
 {
-    if ( ! _ok || ! _cache )
-	return false;
-
-    _fieldsCount = 0;
+    if ( _binReader )
+	return _binReader->eof();
 
-    do
-    {
-	_lineNo++;
-
-	if ( ! gzgets( _cache, _buffer, MAX_CACHE_LINE_LEN-1 ) )
-	{
-	    _buffer[0]	= 0;
-	    _line	= _buffer;
-
-	    if ( ! gzeof( _cache ) )
-	    {
-		_ok = false;
-		logError() << _fileName << ":" << _lineNo << ": Read error" << endl;
-		emit error();
-	    }
-
-	    return false;
-	}
-
-	_line = skipWhiteSpace( _buffer );
-	killTrailingWhiteSpace( _line );
-
-	// logDebug() << "line[ " << _lineNo << "]: \"" << _line<< "\"" << endl;
-
-    } while ( ! gzeof( _cache ) &&
-	      ( *_line == 0   ||	// empty line
-		*_line == '#'	  ) );	// comment line
+    if ( ! _ok || ! _parser )
+	return true;
 
-    return true;
+    return _batchPos >= _batch.size() && _parser->eof() && ( ! _delta || _deltaDone );
 }
 
 
-void CacheReader::splitLine()
+QString CacheReader::firstDir()
 {
-    _fieldsCount = 0;
+    if ( _binReader )
+	return _binReader->firstDir();
 
-    if ( ! _ok || ! _line )
-	return;
-
-    if ( *_line == '#' )	// skip comment lines
-	*_line = 0;
-
-    char * current = _line;
-    char * end	   = _line + strlen( _line );
-
-    while ( current
-	    && current < end
-	    && *current
-	    && _fieldsCount < MAX_FIELDS_PER_LINE-1 )
-    {
-	_fields[ _fieldsCount++ ] = current;
-	current = findNextWhiteSpace( current );
-
-	if ( current && current < end )
-	{
-	    *current++ = 0;
-	    current = skipWhiteSpace( current );
-	}
-    }
-}
-
-
-char * CacheReader::field( int no )
-{
-    if ( no >= 0 && no < _fieldsCount )
-	return _fields[ no ];
-    else
-	return 0;
+    return _parser ? _parser->firstDir() : "";
 }
 
 
@@ -755,29 +1379,6 @@ void CacheReader::killTrailingWhiteSpace( char * cptr )
 }
 
 
-void CacheReader::splitPath( const QString & fileNameWithPath,
-			     QString	   & path_ret,
-			     QString	   & name_ret ) const
-{
-    bool absolutePath = fileNameWithPath.startsWith( "/" );
-    QStringList components = fileNameWithPath.split( "/", QString::SkipEmptyParts );
-
-    if ( components.isEmpty() )
-    {
-	path_ret = "";
-	name_ret = absolutePath ? "/" : "";
-    }
-    else
-    {
-	name_ret = components.takeLast();
-	path_ret = components.join( "/" );
-
-	if ( absolutePath )
-	    path_ret.prepend( "/" );
-    }
-}
-
-
 QString CacheReader::buildPath( const QString & path, const QString & name ) const
 {
     if ( path.isEmpty() )
@@ -790,24 +1391,6 @@ QString CacheReader::buildPath( const QString & path, const QString & name ) con
 }
 
 
-QString CacheReader::unescapedPath( const QString & rawPath ) const
-{
-    // Using a protocol part to avoid directory names with a colon ":"
-    // being cut off because it looks like a URL protocol.
-    QString protocol = "foo:";
-    QString url = protocol + cleanPath( rawPath );
-
-    return QUrl::fromEncoded( url.toUtf8() ).path();
-}
-
-
-QString CacheReader::cleanPath( const QString & rawPath ) const
-{
-    QString clean = rawPath;
-    return clean.replace( _multiSlash, "/" );
-}
-
-
 void CacheReader::finalizeRecursive( DirInfo * dir )
 {
     if ( dir->readState() != DirOnRequestOnly )
@@ -11,17 +11,21 @@
 #define DirTreeCache_h
 
 
-#include <zlib.h>    // gzFile
 #include "DirTree.h"
+#include "CacheParser.h"
 
 
 #define DEFAULT_CACHE_NAME	".qdirstat.cache.gz"
-#define MAX_CACHE_LINE_LEN	1024
-#define MAX_FIELDS_PER_LINE	32
 
 
 namespace QDirStat
 {
+    class BinaryCacheReader;
+    class BlockGzipWriter;
+    class CacheDelta;
+    class CacheIndex;
+    class CacheSummary;
+
     class CacheWriter
     {
     public:
@@ -29,9 +33,22 @@ namespace QDirStat
 	/**
 	 * Write 'tree' to file 'fileName' in gzip format (using zlib).
 	 *
+	 * If 'longFormat' is true, write the full path for each item, not
+	 * only for directories. If 'withUidGidPerm' is false, write the 1.0
+	 * format without UID, GID and permissions.
+	 *
+	 * If 'baselineFileName' is not empty, write a delta cache file that
+	 * only contains the directories that changed since that cache file
+	 * (which may be a delta cache file itself) was written. See
+	 * CacheDelta.
+	 *
 	 * Check CacheWriter::ok() to see if writing the cache file went OK.
 	 **/
-	CacheWriter( const QString & fileName, DirTree *tree );
+	CacheWriter( const QString & fileName,
+		     DirTree *	     tree,
+		     bool	     longFormat	      = false,
+		     bool	     withUidGidPerm   = true,
+		     const QString & baselineFileName = QString() );
 
 	/**
 	 * Destructor
@@ -50,26 +67,93 @@ namespace QDirStat
 	 **/
 	QString formatSize( FileSize size );
 
+	/**
+	 * Write the header of a cache file to 'cache'.
+	 **/
+	static void writeHeader( BlockGzipWriter * cache, bool withUidGidPerm );
+
+	/**
+	 * Format the cache file line of an item with these fields into
+	 * 'line'. 'name' is the complete path if 'absolute' is 'true';
+	 * 'sparseBlocks' is -1 if the item is not a sparse file.
+	 **/
+	static void formatItem( QByteArray &	line,
+				const QString & name,
+				bool		absolute,
+				mode_t		mode,
+				FileSize	size,
+				bool		withUidGidPerm,
+				uid_t		uid,
+				gid_t		gid,
+				time_t		mtime,
+				FileSize	sparseBlocks,
+				nlink_t		links );
+
+	/**
+	 * Return 'true' if cache files are compressed with the fastest zlib
+	 * level (1) rather than the default level. That is about three times
+	 * as fast, and the files are only slightly larger.
+	 **/
+	static bool fastCompression() { return _fastCompression; }
+
+	/**
+	 * Enable or disable the fast compression of cache files.
+	 **/
+	static void setFastCompression( bool fast ) { _fastCompression = fast; }
+
 
     protected:
 
 	/**
-	 * Write cache file in gzip format.
+	 * Write cache file in gzip format. The file is written in independently
+	 * compressed blocks that are compressed in parallel.
 	 * Returns 'true' if OK, 'false' upon error.
 	 **/
 	bool writeCache( const QString & fileName, DirTree *tree );
 
+	/**
+	 * Write a delta cache file against _baselineFileName in gzip format.
+	 * Returns 'true' if OK, 'false' upon error.
+	 **/
+	bool writeDelta( const QString & fileName, DirTree *tree );
+
+	/**
+	 * Write the directories from 'dir' on recursively that are different
+	 * in 'baseline' to cache file 'cache'. Remove all directories of the
+	 * tree from 'baseline', so only the removed ones remain.
+	 **/
+	void writeDeltaTree( BlockGzipWriter	     * cache,
+			     DirInfo		     * dir,
+			     QHash<QString, quint64> & baseline );
+
+	/**
+	 * Return the signature of 'item' as it would be written to the cache
+	 * file. See CacheDelta::itemSignature().
+	 **/
+	quint64 signature( FileInfo * item );
+
 	/**
 	 * Write 'item' recursively to cache file 'cache'.
-	 * Uses zlib to write gzip-compressed files.
 	 **/
-	void writeTree( gzFile cache, FileInfo * item );
+	void writeTree( BlockGzipWriter * cache, FileInfo * item );
 
 	/**
 	 * Write 'item' to cache file 'cache' without recursion.
-	 * Uses zlib to write gzip-compressed files.
 	 **/
-	void writeItem( gzFile cache, FileInfo * item );
+	void writeItem( BlockGzipWriter * cache, FileInfo * item );
+
+	/**
+	 * Write the directories that are not read yet ("Pending" lines) to
+	 * cache file 'cache'. This is used for checkpoints of a scan that is
+	 * still in progress.
+	 **/
+	void writePendingDirs( BlockGzipWriter * cache, const QList<DirInfo *> & dirs );
+
+	/**
+	 * Return the URL of 'item'. This is written to a buffer that is
+	 * reused for each item, so it is only valid until the next call.
+	 **/
+	const QString & itemUrl( FileInfo * item );
 
         /**
          * Return the 'path' in an URL-encoded form, i.e. with some special
@@ -77,12 +161,31 @@ namespace QDirStat
          **/
         QByteArray urlEncoded( const QString & path );
 
+	/**
+	 * Append 'path' URL-encoded like urlEncoded() to 'buf'.
+	 **/
+	static void appendEncoded( QByteArray & buf, const QString & path );
+
+	/**
+	 * Append 'size' formatted like formatSize() to 'buf'.
+	 **/
+	static void appendSize( QByteArray & buf, FileSize size );
+
 	//
 	// Data members
 	//
 
         bool _withUidGuidPerm;
+	bool _longFormat;
 	bool _ok;
+	QString _baselineFileName;
+	int	_changedDirs;
+	QString _urlBuffer;
+	QByteArray _lineBuffer;	// for writeItem()
+	CacheIndex * _index;	// only while writing a full cache file
+	CacheSummary * _summary; // only while writing a full cache file
+
+	static bool _fastCompression;
     };
 
 
@@ -150,12 +253,75 @@ namespace QDirStat
 	 **/
 	DirTree * tree() const { return _tree; }
 
+	/**
+	 * Returns the cache file name.
+	 **/
+	const QString & fileName() const { return _fileName; }
+
+	/**
+	 * Returns the summary of the cache file (see CacheSummary) or 0 if
+	 * it has none. This is available right away, long before the tree is
+	 * read; while reading, the directories of the top levels show their
+	 * size from the summary.
+	 **/
+	const CacheSummary * summary() const { return _summary; }
+
+	/**
+	 * Returns the first directory that was created from the cache file
+	 * or 0 if there is none yet.
+	 **/
+	DirInfo * toplevel() const;
+
+	/**
+	 * Only load the items at or below directory 'path' and the
+	 * directories on the way there. Everything else is skipped while
+	 * parsing without creating any tree items.
+	 *
+	 * If the cache file has a CacheIndex, this jumps directly to that
+	 * directory, and the directories on the way there are not loaded.
+	 *
+	 * This has to be called before the first read().
+	 **/
+	void setSubtreePrefix( const QString & path );
+
+	/**
+	 * Only load the contents of directory 'dir' which is already in the
+	 * tree, typically a placeholder from a lazy read (see setLazyDepth()).
+	 * The reader has to be created with 'dir' as its parent.
+	 *
+	 * Return 'false' if the cache file has no CacheIndex or if 'dir' is
+	 * not in it.
+	 *
+	 * This has to be called before the first read().
+	 **/
+	bool readSubtree( DirInfo * dir );
+
+	/**
+	 * Only load the directories up to 'depth' levels below the first
+	 * one; the ones below that are added as cache placeholders without
+	 * their contents (see DirInfo::isCachePlaceholder()). 0 loads
+	 * everything.
+	 *
+	 * Return 'false' if the cache file has no CacheIndex to skip the
+	 * rest of the file.
+	 *
+	 * This has to be called before the first read().
+	 **/
+	bool setLazyDepth( int depth );
+
         /**
          * Return 'true' if the cache file format has UID, GID, permissions
          * (cache file format 2.0 or later), 'false' otherwise.
          **/
         bool withUidGidPerm() const { return _withUidGidPerm; }
 
+	/**
+	 * Return the directories that were not read yet when this cache file
+	 * was written as a checkpoint of an interrupted scan, i.e. where
+	 * reading should continue.
+	 **/
+	const QList<DirInfo *> & pendingDirs() const { return _pendingDirs; }
+
 	/**
 	 * Skip leading whitespace from a string.
 	 * Returns a pointer to the first character that is non-whitespace.
@@ -200,68 +366,35 @@ namespace QDirStat
     protected:
 
 	/**
-	 * Check this cache's header (see if it is a QDirStat cache at all)
-	 **/
-	bool checkHeader();
-
-	/**
-	 * Use _fields to add one item to _tree.
+	 * Add one parsed item to _tree.
 	 **/
-	void addItem();
+	void addItem( const CacheItem & item );
 
 	/**
-	 * Read the next line that is not empty or a comment and store it in
-	 * _line.
-         *
-         * Returns true if OK, false if error.
-	 **/
-	bool readLine();
-
-	/**
-	 * split the current input line into fields separated by whitespace.
+	 * Get the next batch of items from the parser (merged with the deltas
+	 * if this is a delta cache file) into _batch. Wait at most
+	 * 'timeoutMillisec' milliseconds for the parser thread.
+	 *
+	 * Returns 'false' if there was no batch.
 	 **/
-	void splitLine();
+	bool nextBatch( int timeoutMillisec );
 
 	/**
-	 * Returns the start of field no. 'no' in the current input line
-	 * after splitLine().
+	 * Return 'true' if the filters of the tree ignore 'name' in directory
+	 * 'parent'.
 	 **/
-	char * field( int no );
+	bool ignoredByFilters( DirInfo * parent, const QString & name );
 
 	/**
-	 * Split up a file name with path into its path and its name component
-	 * and return them in path_ret and name_ret, respectively.
-	 *
-	 * Example:
-	 *     "/some/dir/somewhere/myfile.obj"
-	 * ->  "/some/dir/somewhere", "myfile.obj"
+	 * Add the directory from a "Pending" line to the pending directories.
 	 **/
-	void splitPath( const QString & fileNameWithPath,
-			QString	      & path_ret,
-			QString	      & name_ret ) const;
+	void addPendingDir( const CacheItem & item );
 
 	/**
 	 * Build a full path from path + file name (without path).
 	 **/
 	QString buildPath( const QString & path, const QString & name ) const;
 
-	/**
-	 * Return an unescaped version of 'rawPath'.
-	 **/
-	QString unescapedPath( const QString & rawPath ) const;
-
-	/**
-	 * Clean a path: Replace duplicate (or triplicate or more) slashes with
-	 * just one. QUrl doesn't seem to handle those well.
-	 **/
-	QString cleanPath( const QString & rawPath ) const;
-
-	/**
-	 * Returns the number of fields in the current input line after
-	 * splitLine().
-	 **/
-	int fieldsCount() const { return _fieldsCount; }
-
 	/**
 	 * Recursively set the read status of all dirs from 'dir' on, send tree
 	 * signals and finalize local (i.e. clean up empty or unneeded dot
@@ -281,21 +414,32 @@ namespace QDirStat
 	//
 
 	DirTree *	_tree;
-	gzFile		_cache;
-	char		_buffer[ MAX_CACHE_LINE_LEN ];
-	char *		_line;
-	int		_lineNo;
+	CacheParser *	_parser;
+	BinaryCacheReader * _binReader;
+	CacheDelta *	_delta;
+	CacheSummary *	_summary;
+	bool		_deltaDone;
+	CacheItemBatch	_batch;
+	int		_batchPos;
 	QString		_fileName;
-	char *		_fields[ MAX_FIELDS_PER_LINE ];
-	int		_fieldsCount;
 	bool		_ok;
         int             _errorCount;
 	DirInfo *	_toplevel;
 	DirInfo *	_lastDir;
 	DirInfo *	_lastExcludedDir;
 	QString		_lastExcludedDirUrl;
-        QRegExp         _multiSlash;
+	QString		_skippedDirUrl;		// ignored by the filters
+	bool		_skippingDir;
+	DirInfo *	_filterDir;		// cache for ignoredByFilters()
+	QString		_filterDirUrl;
+	bool		_excludesPushedDown;	// checked by the parser
+	DirInfo *	_reuseDir;		// from readSubtree()
+	QString		_reuseDirUrl;
         bool            _withUidGidPerm;
+	QList<DirInfo *> _pendingDirs;
+
+	// All directories that were created from this cache file by path
+	QHash<QString, DirInfo *> _dirs;
     };
 
 }	// namespace QDirStat
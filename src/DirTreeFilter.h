@@ -43,6 +43,47 @@ namespace QDirStat
 	 **/
 	virtual bool ignore( const QString & path ) const = 0;
 
+	/**
+	 * Return 'true' if the filesystem object 'name' in directory
+	 * 'dirPath' should be ignored, 'false' if not. Directory reading
+	 * calls this for all entries of one directory in a row, so a derived
+	 * class can look up anything it needs for that directory only once.
+	 *
+	 * This default implementation builds the complete path and calls
+	 * ignore().
+	 **/
+	virtual bool ignoreEntry( const QString & dirPath,
+				  const QString & name ) const
+	    { return ignore( ( dirPath == "/" ? QString() : dirPath ) + "/" + name ); }
+
+	/**
+	 * Return 'true' if this filter only checks the name of a filesystem
+	 * object, not the rest of its path. Those filters are checked with
+	 * ignoreName() first, before the complete path is even built.
+	 *
+	 * This default implementation returns 'false'.
+	 **/
+	virtual bool checksNameOnly() const { return false; }
+
+	/**
+	 * Return 'true' if the filesystem object with 'name' (without path)
+	 * should be ignored, 'false' if not. This is only called if
+	 * checksNameOnly() returns 'true'.
+	 *
+	 * This default implementation returns 'false'.
+	 **/
+	virtual bool ignoreName( const QString & name ) const
+	    { Q_UNUSED( name ); return false; }
+
+	/**
+	 * Return an estimate of the memory this filter keeps in bytes, not
+	 * counting the filter object itself. This is for the memory
+	 * statistics.
+	 *
+	 * This default implementation returns 0.
+	 **/
+	virtual qint64 memoryUsage() const { return 0; }
+
     };	// class DirTreeFilter
 
 }	// namespace QDirStat
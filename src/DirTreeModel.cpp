@@ -8,14 +8,27 @@
 
 
 #include <QPalette>
+#include <QHash>
+#include <QElapsedTimer>
 
 #include "Qt4Compat.h"
 
 #include "DirTreeModel.h"
 #include "DirTree.h"
+#include "DirTreeCache.h"
+#include "ExtentScanner.h"
+#include "CacheVerifier.h"
 #include "DirInfo.h"
+#include "DotEntry.h"
+#include "Attic.h"
+#include "DirScanner.h"
+#include "DirWatcher.h"
+#include "ScanStats.h"
+#include "StatsEngine.h"
+#include "AdaptiveTimer.h"
 #include "FileInfoIterator.h"
 #include "DataColumns.h"
+#include "PkgInfo.h"
 #include "SelectionModel.h"
 #include "Settings.h"
 #include "SettingsHelpers.h"
@@ -23,6 +36,7 @@
 #include "FormatUtil.h"
 #include "Exception.h"
 #include "DebugHelpers.h"
+#include "TreeDiff.h"
 
 
 // Number of clusters up to which a file will be considered small and will also
@@ -33,28 +47,71 @@
 // like (4k)
 #define SMALL_FILE_SHOW_ALLOC_THRESHOLD		75
 
+// Number of rows to keep the formatted column texts for
+#define ROW_TEXT_CACHE_SIZE	5000
+
+// Number of children of a directory to report to the view at once
+#define FETCH_CHUNK_SIZE	1000
+
+// Number of children to sort again in one time slice after switching the
+// sort column at the start or end of reading (at least one directory)
+#define RESORT_BATCH_ITEMS	20000
+
 using namespace QDirStat;
 
 
+/**
+ * Return 'true' if 'item' somewhere below 'dir' is still there after the
+ * direct children of 'dir' are read again, i.e. if it is in one of the
+ * subdirectories that are kept.
+ **/
+static bool survivesRefresh( FileInfo * item, DirInfo * dir )
+{
+    while ( item->parent() && item->parent() != dir )
+	item = item->parent();
+
+    if ( ! item->isDirInfo() || item->isPseudoDir() )
+	return false;
+
+    DirReadState state = item->readState();
+
+    return state == DirFinished || state == DirCached;
+}
+
+
 DirTreeModel::DirTreeModel( QObject * parent ):
     QAbstractItemModel( parent ),
     _tree(0),
+    _dirWatcher(0),
+    _treeDiff(0),
     _selectionModel(0),
     _readJobsCol( PercentBarCol ),
+    _updateTimer(0),
     _updateTimerMillisec( 333 ),
     _slowUpdateMillisec( 3000 ),
+    _updateCpuBudget( 10 ),
     _slowUpdate( false ),
     _sortCol( NameCol ),
     _sortOrder( Qt::AscendingOrder ),
-    _removingRows( false )
+    _removingRows( false ),
+    _clearingSubtrees( false ),
+    _rowTextCache( ROW_TEXT_CACHE_SIZE )
 {
     createTree();
     readSettings();
     loadIcons();
-    _updateTimer.setInterval( _updateTimerMillisec );
 
-    connect( &_updateTimer, SIGNAL( timeout()		 ),
-	     this,	    SLOT  ( sendPendingUpdates() ) );
+    _updateTimer = new AdaptiveTimer( this );
+    CHECK_NEW( _updateTimer );
+    initUpdateTimer();
+
+    connect( _updateTimer, SIGNAL( deliverRequest( QVariant ) ),
+	     this,	   SLOT	 ( sendPendingUpdates()	      ) );
+
+    _resortTimer.setInterval( 0 );
+
+    connect( &_resortTimer, SIGNAL( timeout()	      ),
+	     this,	    SLOT  ( resortShownDirs() ) );
 }
 
 
@@ -62,6 +119,9 @@ DirTreeModel::~DirTreeModel()
 {
     writeSettings();
 
+    if ( _dirWatcher )
+	delete _dirWatcher;
+
     if ( _tree )
 	delete _tree;
 }
@@ -73,11 +133,42 @@ void DirTreeModel::readSettings()
     settings.beginGroup( "DirectoryTree" );
 
     _tree->setCrossFilesystems( settings.value( "CrossFilesystems",   false ).toBool() );
+    _tree->setSmartRefreshEnabled( settings.value( "SmartRefresh",    false ).toBool() );
+    _tree->setUseSizeEstimates( settings.value( "SizeEstimatesForMountPoints", true ).toBool() );
+    _tree->setSampleFraction  ( settings.value( "SampleFraction",     0.0   ).toDouble() );
+    _tree->setCheckpointInterval( settings.value( "CheckpointIntervalSec", 300 ).toInt() );
+    _tree->setScanThreads     ( settings.value( "ScanThreads",        1     ).toInt()  );
+    _tree->setOutOfCore       ( settings.value( "OutOfCore",          false ).toBool() );
+    _tree->setDirsOnly        ( settings.value( "DirectoriesOnly",    false ).toBool() );
+    _tree->setFoldFilesBelow  ( settings.value( "FoldFilesBelowKiB",  0     ).toLongLong() * 1024 );
+    _tree->setShareNames      ( settings.value( "ShareNames",         false ).toBool() );
+    _tree->setLazyCacheDepth  ( settings.value( "LazyCacheDepth",     0     ).toInt()  );
+    _tree->setCheckStaleCaches( settings.value( "CheckStaleCaches",   true  ).toBool() );
+    _tree->setUseSharedTrees  ( settings.value( "UseSharedTrees",     true  ).toBool() );
+    _tree->setPublishTrees    ( settings.value( "PublishTrees",       false ).toBool() );
+    _tree->setUseSessionCache ( settings.value( "SessionCache",       true  ).toBool() );
+    CacheWriter::setFastCompression( settings.value( "FastCacheCompression", false ).toBool() );
+    _tree->extents()->setEnabled( settings.value( "ExtentAwareUsage", false ).toBool() );
+    _tree->extents()->setMinFileSize( settings.value( "ExtentMinFileSizeKiB",
+						      (int) ( _tree->extents()->minFileSize() / 1024 ) ).toLongLong() * 1024 );
+    _tree->cacheVerifier()->setMinFileSize( settings.value( "VerifyCacheMinFileSizeKiB",
+							    (int) ( _tree->cacheVerifier()->minFileSize() / 1024 ) ).toLongLong() * 1024 );
+    _tree->cacheVerifier()->setSampleFraction( settings.value( "VerifyCacheSamplePercent",
+							       100.0 * _tree->cacheVerifier()->sampleFraction() ).toDouble() / 100.0 );
+    _dirWatcher->setEnabled   ( settings.value( "WatchForChanges",    false ).toBool() );
     _useBoldForDominantItems =	settings.value( "UseBoldForDominant", true  ).toBool();
     FileInfo::setIgnoreHardLinks( settings.value( "IgnoreHardLinks",	false ).toBool() );
+    DirScanner::setUseStatRing( settings.value( "UseIoUring",		false ).toBool() );
+    ScanTuner::setEnabled( settings.value( "AutoTuneScanThreads",	true  ).toBool() );
+    DirReadJobQueue::setInodeOrder( settings.value( "InodeOrderOnRotationalDisks", true ).toBool() );
+    DirReadJobQueue::setLargestFirst( settings.value( "LargestFirst",	false ).toBool() );
+    DirReadJobQueue::setPoliteScan( settings.value( "PoliteScan",	false ).toBool() );
+    DirReadJobQueue::setTimeSlice( settings.value( "ReadTimeSliceMillisec", DirReadJobQueue::timeSlice() ).toInt() );
+    StatsEngine::setUseColumns( settings.value( "ColumnarStats",	false ).toBool() );
     _treeIconDir	 = settings.value( "TreeIconDir" , ":/icons/tree-medium/" ).toString();
     _updateTimerMillisec = settings.value( "UpdateTimerMillisec", 333 ).toInt();
     _slowUpdateMillisec	 = settings.value( "SlowUpdateMillisec", 3000 ).toInt();
+    _updateCpuBudget	 = settings.value( "UpdateCpuBudgetPercent", 10 ).toInt();
 
     settings.endGroup();
 
@@ -87,6 +178,7 @@ void DirTreeModel::readSettings()
 
 	_dirReadErrColor     = readColorEntry( settings, "DirReadErrColor",	QColor( Qt::red		 ) );
 	_subtreeReadErrColor = readColorEntry( settings, "SubtreeReadErrColor", QColor( 0xa0, 0x00, 0x00 ) );
+	_cacheMismatchColor  = readColorEntry( settings, "CacheMismatchColor",	QColor( 0xc0, 0x60, 0x00 ) );
 
 	settings.endGroup();
     }
@@ -96,6 +188,7 @@ void DirTreeModel::readSettings()
 
 	_dirReadErrColor     = readColorEntry( settings, "DirReadErrColor",	QColor( Qt::red		 ) );
 	_subtreeReadErrColor = readColorEntry( settings, "SubtreeReadErrColor", QColor( Qt::yellow	 ) );
+	_cacheMismatchColor  = readColorEntry( settings, "CacheMismatchColor",	QColor( 0xff, 0xa0, 0x40 ) );
 
 	settings.endGroup();
     }
@@ -110,10 +203,38 @@ void DirTreeModel::writeSettings()
     settings.setValue( "SlowUpdateMillisec", _slowUpdateMillisec  );
 
     settings.setDefaultValue( "CrossFilesystems",    _tree ? _tree->crossFilesystems() : false );
+    settings.setDefaultValue( "SmartRefresh",        _tree ? _tree->smartRefreshEnabled() : false );
+    settings.setDefaultValue( "SizeEstimatesForMountPoints", _tree ? _tree->useSizeEstimates() : true );
+    settings.setDefaultValue( "SampleFraction",      _tree ? _tree->sampleFraction() : 0.0 );
+    settings.setDefaultValue( "CheckpointIntervalSec", _tree ? _tree->checkpointInterval() : 300 );
+    settings.setDefaultValue( "ScanThreads",         _tree ? _tree->scanThreads()      : 1     );
+    settings.setDefaultValue( "OutOfCore",           _tree ? _tree->outOfCore()        : false );
+    settings.setDefaultValue( "DirectoriesOnly",     _tree ? _tree->dirsOnly()         : false );
+    settings.setDefaultValue( "FoldFilesBelowKiB",   _tree ? (int) ( _tree->foldFilesBelow() / 1024 ) : 0 );
+    settings.setDefaultValue( "ShareNames",          _tree ? _tree->shareNames()       : false );
+    settings.setDefaultValue( "LazyCacheDepth",      _tree ? _tree->lazyCacheDepth()   : 0     );
+    settings.setDefaultValue( "CheckStaleCaches",    _tree ? _tree->checkStaleCaches() : true  );
+    settings.setDefaultValue( "UseSharedTrees",      _tree ? _tree->useSharedTrees()   : true  );
+    settings.setDefaultValue( "PublishTrees",        _tree ? _tree->publishTrees()     : false );
+    settings.setDefaultValue( "SessionCache",        _tree ? _tree->useSessionCache()  : true  );
+    settings.setDefaultValue( "FastCacheCompression", CacheWriter::fastCompression() );
+    settings.setDefaultValue( "ExtentAwareUsage",    _tree ? _tree->extents()->enabled() : false );
+    settings.setDefaultValue( "ExtentMinFileSizeKiB", _tree ? (int) ( _tree->extents()->minFileSize() / 1024 ) : 1024 );
+    settings.setDefaultValue( "VerifyCacheMinFileSizeKiB", _tree ? (int) ( _tree->cacheVerifier()->minFileSize() / 1024 ) : 1024 );
+    settings.setDefaultValue( "VerifyCacheSamplePercent",  _tree ? 100.0 * _tree->cacheVerifier()->sampleFraction() : 1.0 );
+    settings.setDefaultValue( "WatchForChanges",     _dirWatcher ? _dirWatcher->enabled() : false );
     settings.setDefaultValue( "UseBoldForDominant",  _useBoldForDominantItems	 );
     settings.setDefaultValue( "IgnoreHardLinks",     FileInfo::ignoreHardLinks() );
+    settings.setDefaultValue( "UseIoUring",	     DirScanner::useStatRing()	 );
+    settings.setDefaultValue( "AutoTuneScanThreads", ScanTuner::isEnabled()	 );
+    settings.setDefaultValue( "InodeOrderOnRotationalDisks", DirReadJobQueue::inodeOrder() );
+    settings.setDefaultValue( "LargestFirst",	     DirReadJobQueue::largestFirst() );
+    settings.setDefaultValue( "PoliteScan",	     DirReadJobQueue::politeScan() );
+    settings.setDefaultValue( "ReadTimeSliceMillisec", DirReadJobQueue::timeSlice() );
+    settings.setDefaultValue( "ColumnarStats",	     StatsEngine::useColumns() );
     settings.setDefaultValue( "TreeIconDir",	     _treeIconDir		 );
     settings.setDefaultValue( "UpdateTimerMillisec", _updateTimerMillisec	 );
+    settings.setDefaultValue( "UpdateCpuBudgetPercent", _updateCpuBudget );
 
     settings.endGroup();
 
@@ -122,6 +243,7 @@ void DirTreeModel::writeSettings()
 
     writeColorEntry( settings, "DirReadErrColor",     _dirReadErrColor	   );
     writeColorEntry( settings, "SubtreeReadErrColor", _subtreeReadErrColor );
+    writeColorEntry( settings, "CacheMismatchColor",  _cacheMismatchColor  );
 
     settings.endGroup();
 }
@@ -138,10 +260,46 @@ bool DirTreeModel::usingDarkTheme()
 void DirTreeModel::setSlowUpdate( bool slow )
 {
     _slowUpdate = slow;
-    _updateTimer.setInterval( _slowUpdate ? _slowUpdateMillisec : _updateTimerMillisec );
+    initUpdateTimer();
 
     if ( slow )
-	logInfo() << "Display update every " << _updateTimer.interval() << " millisec" << endl;
+	logInfo() << "Display update every " << _slowUpdateMillisec << " millisec" << endl;
+}
+
+
+void DirTreeModel::initUpdateTimer()
+{
+    // Start with the normal update interval and double it each time the
+    // views need more than the CPU budget for the updates, up to the slow
+    // update interval.
+
+    _updateTimer->clear();
+
+    if ( ! _slowUpdate )
+    {
+	for ( int delay = _updateTimerMillisec;
+	      delay > 0 && delay < _slowUpdateMillisec;
+	      delay *= 2 )
+	{
+	    _updateTimer->addDelayStage( delay );
+	}
+    }
+
+    _updateTimer->addDelayStage( _slowUpdateMillisec );
+
+    // A budget of 0 would switch the timer to adapting to the rate of
+    // requests instead; use 100% to effectively never slow down.
+    _updateTimer->setCostBudget( _updateCpuBudget > 0 ? _updateCpuBudget : 100 );
+}
+
+
+void DirTreeModel::addUpdateCost( qint64 nanosec )
+{
+    if ( _tree->isBusy() )
+    {
+	_updateTimer->addCost( nanosec / 1000000 );
+	ScanStats::instance()->addModelUpdate( nanosec );
+    }
 }
 
 
@@ -150,6 +308,21 @@ void DirTreeModel::createTree()
     _tree = new DirTree();
     CHECK_NEW( _tree );
 
+    _dirWatcher = new DirWatcher( _tree );
+    CHECK_NEW( _dirWatcher );
+
+    connect( _dirWatcher, SIGNAL( refreshing	( DirInfo * ) ),
+	     this,	  SLOT	( dirRefreshing ( DirInfo * ) ) );
+
+    connect( _dirWatcher, SIGNAL( refreshingAll ( DirInfo * ) ),
+	     this,	  SLOT	( treeRefreshing( DirInfo * ) ) );
+
+    _treeDiff = new TreeDiff( _tree, this );
+    CHECK_NEW( _treeDiff );
+
+    connect( _treeDiff, SIGNAL( changed()	  ),
+	     this,	SLOT  ( treeDiffChanged() ) );
+
     connect( _tree, SIGNAL( startingReading() ),
 	     this,  SLOT  ( busyDisplay() ) );
 
@@ -162,6 +335,9 @@ void DirTreeModel::createTree()
     connect( _tree, SIGNAL( readJobFinished( DirInfo * ) ),
 	     this,  SLOT  ( readJobFinished( DirInfo * ) ) );
 
+    connect( _tree, SIGNAL( childrenAdded  ( DirInfo * ) ),
+	     this,  SLOT  ( childrenAdded  ( DirInfo * ) ) );
+
     connect( _tree, SIGNAL( deletingChild( FileInfo * ) ),
 	     this,  SLOT  ( deletingChild( FileInfo * ) ) );
 
@@ -171,8 +347,17 @@ void DirTreeModel::createTree()
     connect( _tree, SIGNAL( subtreeCleared( DirInfo * ) ),
 	     this,  SLOT  ( subtreeCleared( DirInfo * ) ) );
 
+    connect( _tree, SIGNAL( clearingSubtrees( FileInfoSet ) ),
+	     this,  SLOT  ( clearingSubtrees( FileInfoSet ) ) );
+
+    connect( _tree, SIGNAL( subtreesCleared() ),
+	     this,  SLOT  ( subtreesCleared() ) );
+
     connect( _tree, SIGNAL( childDeleted() ),
 	     this,  SLOT  ( childDeleted() ) );
+
+    connect( _tree->cacheVerifier(), SIGNAL( finished()	     ),
+	     this,		     SLOT  ( cacheVerified() ) );
 }
 
 
@@ -186,6 +371,10 @@ void DirTreeModel::clear()
 	// dumpPersistentIndexList();
 
 	_tree->clear();
+	_fetchedRows.clear();
+	_shownSort.clear();
+	_resortTimer.stop();
+	clearRowTextCache();
 	endResetModel();
 
 	// logDebug() << "After endResetModel()" << endl;
@@ -201,11 +390,21 @@ void DirTreeModel::openUrl( const QString & url )
     if ( _tree->root() &&  _tree->root()->hasChildren() )
 	clear();
 
-    _updateTimer.start();
     _tree->startReading( url );
 }
 
 
+void DirTreeModel::openUrls( const QStringList & urls )
+{
+    CHECK_PTR( _tree );
+
+    if ( _tree->root() &&  _tree->root()->hasChildren() )
+	clear();
+
+    _tree->startReading( urls );
+}
+
+
 void DirTreeModel::readPkg( const PkgFilter & pkgFilter )
 {
     // logDebug() << "Reading " << pkgFilter << endl;
@@ -214,7 +413,6 @@ void DirTreeModel::readPkg( const PkgFilter & pkgFilter )
     if ( _tree->root() &&  _tree->root()->hasChildren() )
 	clear();
 
-    _updateTimer.start();
     _tree->readPkg( pkgFilter );
 }
 
@@ -258,9 +456,12 @@ FileInfo * DirTreeModel::findChild( DirInfo * parent, int childNo ) const
 {
     CHECK_PTR( parent );
 
+    // Only the rows fetched so far need to be sorted
+
     const FileInfoList & childrenList =
-	parent->sortedChildren( _sortCol, _sortOrder,
-				true );	    // includeAttic
+	parent->sortedChildren( sortColFor( parent ), sortOrderFor( parent ),
+				true,	    // includeAttic
+				qMax( childNo + 1, fetchedRows( parent ) ) );
 
     if ( childNo < 0 || childNo >= childrenList.size() )
     {
@@ -280,14 +481,32 @@ FileInfo * DirTreeModel::findChild( DirInfo * parent, int childNo ) const
 
 int DirTreeModel::rowNumber( FileInfo * child ) const
 {
-    if ( ! child->parent() )
+    DirInfo * parent = child->parent();
+
+    if ( ! parent )
 	return 0;
 
-    const FileInfoList & childrenList =
-	child->parent()->sortedChildren( _sortCol, _sortOrder,
-					 true ); // includeAttic
+    const FileInfoList * childrenList =
+	&parent->sortedChildren( sortColFor( parent ), sortOrderFor( parent ),
+				 true,	// includeAttic
+				 fetchedRows( parent ) );
+
+    // The row is cached in the child when the list is sorted, so this is
+    // normally O(1); the linear search is only a fallback.
+
+    int row = child->sortedRow();
+
+    if ( row < 0 )
+    {
+	// Not among the rows that are sorted so far: Sort all of them
+
+	childrenList = &parent->sortedChildren( sortColFor( parent ), sortOrderFor( parent ),
+						true ); // includeAttic
+	row = child->sortedRow();
+    }
 
-    int row = childrenList.indexOf( child );
+    if ( row < 0 || row >= childrenList->size() || childrenList->at( row ) != child )
+	row = childrenList->indexOf( child );
 
     if ( row < 0 )
     {
@@ -325,29 +544,214 @@ FileInfo * DirTreeModel::itemFromIndex( const QModelIndex & index )
 
 int DirTreeModel::rowCount( const QModelIndex & parentIndex ) const
 {
-    if ( ! _tree )
+    FileInfo * item = parentItem( parentIndex );
+
+    if ( ! item || ! item->isDirInfo() )
 	return 0;
 
-    int count = 0;
-    FileInfo * item = 0;
+    if ( item->toDirInfo()->isLocked() )
+    {
+	// logDebug() << item << " is locked - returning 0" << endl;
+	return 0;
+    }
 
-    if ( parentIndex.isValid() )
+    // The view wants to know about the children of this directory, so it
+    // needs to be notified about any changes from now on. If it is still
+    // being read, read it before anything else.
+
+    if ( ! item->toDirInfo()->isExposed() && item->pendingReadJobs() > 0 )
+	_tree->prioritize( item->toDirInfo() );
+
+    item->toDirInfo()->setExposed();
+
+    // In an out-of-core tree, its files need to be in memory now.
+
+    item->toDirInfo()->pageInFiles();
+
+    return reportedChildrenCount( item );
+}
+
+
+bool DirTreeModel::hasChildren( const QModelIndex & parentIndex ) const
+{
+    // Unlike the default implementation, don't use rowCount(): The view
+    // asks this for every visible directory to decide if it gets an
+    // expander, and that should not mark it as exposed.
+
+    FileInfo * item = parentItem( parentIndex );
+
+    if ( ! item || ! item->isDirInfo() || item->toDirInfo()->isLocked() )
+	return false;
+
+    if ( item->toDirInfo()->isCachePlaceholder() )
+	return true;	// Read when it is expanded
+
+    if ( item->toDirInfo()->hasFoldedFiles() )
+	return true;	// Same for folded small files
+
+    if ( item->isPkgInfo() && item->toPkgInfo()->isFileListPending() )
+	return true;	// Same for a package file list
+
+    return reportedChildrenCount( item ) > 0;
+}
+
+
+bool DirTreeModel::canFetchMore( const QModelIndex & parentIndex ) const
+{
+    // An invalid index is the root: In the packages view, it might have
+    // more children than fit into one chunk.
+
+    FileInfo * item = parentItem( parentIndex );
+
+    if ( ! item || ! item->isDirInfo() )
+	return false;
+
+    if ( item->isPkgInfo() && item->toPkgInfo()->isFileListPending() )
+	return true;
+
+    if ( item->toDirInfo()->isCachePlaceholder() ||
+	 item->toDirInfo()->hasFoldedFiles()	)
     {
-	item = static_cast<FileInfo *>( parentIndex.internalPointer() );
-	CHECK_MAGIC( item );
+	return true;
     }
-    else
-	item = _tree->root();
 
-    if ( ! item->isDirInfo() )
-	return 0;
+    return ! item->toDirInfo()->isLocked() &&
+	availableChildrenCount( item ) > fetchedRows( item );
+}
 
-    if ( item->toDirInfo()->isLocked() )
+
+void DirTreeModel::fetchMore( const QModelIndex & parentIndex )
+{
+    if ( ! canFetchMore( parentIndex ) )
+	return;
+
+    FileInfo * item = parentItem( parentIndex );
+
+    if ( item->isPkgInfo() && item->toPkgInfo()->isFileListPending() )
     {
-	// logDebug() << item << " is locked - returning 0" << endl;
-	return 0;
+	if ( ! _tree->readPkgFileList( item->toPkgInfo() ) )
+	    item->toPkgInfo()->setFileListPending( false );
+
+	return;
     }
 
+    if ( item->toDirInfo()->isCachePlaceholder() )
+    {
+	if ( ! _tree->readCachePlaceholder( item->toDirInfo() ) )
+	{
+	    // Don't try again and again
+
+	    item->toDirInfo()->setCachePlaceholder( false );
+	}
+
+	return;
+    }
+
+    if ( item->toDirInfo()->hasFoldedFiles() )
+    {
+	// Read the directory again with all its files. If it is busy right
+	// now, the view will ask again later.
+
+	_tree->unfoldFiles( item->toDirInfo() );
+
+	return;
+    }
+
+    // Report the next chunk of children. The view asks for the new count
+    // only after endInsertRows().
+
+    int fetched	   = reportedChildrenCount( item );
+    int newFetched = qMin( fetched + FETCH_CHUNK_SIZE, availableChildrenCount( item ) );
+
+    // logDebug() << "Fetching rows " << fetched << ".." << newFetched - 1 << " of " << item << endl;
+
+    beginInsertRows( parentIndex, fetched, newFetched - 1 );
+    _fetchedRows[ item ] = newFetched;
+    endInsertRows();
+}
+
+
+void DirTreeModel::fetchItem( FileInfo * item )
+{
+    if ( ! item || ! item->checkMagicNumber() )
+	return;
+
+    // From the top down: The view has to know the parent before its rows
+
+    QList<FileInfo *> items;
+
+    for ( FileInfo * ancestor = item; ancestor->parent(); ancestor = ancestor->parent() )
+	items.prepend( ancestor );
+
+    foreach ( FileInfo * ancestor, items )
+	fetchRow( ancestor, true );
+}
+
+
+void DirTreeModel::fetchRow( FileInfo * item, bool notify )
+{
+    DirInfo * parent = item->parent();
+
+    if ( ! parent )
+	return;
+
+    int fetched	  = fetchedRows( parent );
+    int available = availableChildrenCount( parent );
+
+    if ( available <= fetched )	// All of them are reported already
+	return;
+
+    int row = rowNumber( item );
+
+    if ( row < fetched )
+	return;
+
+    int newFetched = qMin( available, ( row / FETCH_CHUNK_SIZE + 1 ) * FETCH_CHUNK_SIZE );
+
+    if ( notify && ! parent->isLocked() )
+    {
+	beginInsertRows( modelIndex( parent ), fetched, newFetched - 1 );
+	_fetchedRows[ parent ] = newFetched;
+	endInsertRows();
+    }
+    else
+    {
+	_fetchedRows[ parent ] = newFetched;
+    }
+}
+
+
+int DirTreeModel::fetchedRows( FileInfo * dir ) const
+{
+    return _fetchedRows.value( dir, FETCH_CHUNK_SIZE );
+}
+
+
+FileInfo * DirTreeModel::parentItem( const QModelIndex & parentIndex ) const
+{
+    if ( ! _tree )
+	return 0;
+
+    if ( ! parentIndex.isValid() )
+	return _tree->root();
+
+    FileInfo * item = static_cast<FileInfo *>( parentIndex.internalPointer() );
+    CHECK_MAGIC( item );
+
+    return item;
+}
+
+
+int DirTreeModel::reportedChildrenCount( FileInfo * item ) const
+{
+    return qMin( availableChildrenCount( item ), fetchedRows( item ) );
+}
+
+
+int DirTreeModel::availableChildrenCount( FileInfo * item ) const
+{
+    int count = 0;
+
     switch ( item->readState() )
     {
 	case DirQueued:
@@ -422,7 +826,7 @@ QVariant DirTreeModel::data( const QModelIndex & index, int role ) const
     {
 	case Qt::DisplayRole: // Text
 	    {
-		QVariant result = columnText( item, col );
+		QVariant result = cachedColumnText( item, col );
 
 		if ( item && item->isDirInfo() )
 		{
@@ -447,6 +851,9 @@ QVariant DirTreeModel::data( const QModelIndex & index, int role ) const
 			return _subtreeReadErrColor;
 		}
 
+		if ( _tree->cacheVerifier()->mismatch( item ) != CacheMatch )
+		    return _cacheMismatchColor;
+
 		return QVariant();
 	    }
 
@@ -496,6 +903,7 @@ QVariant DirTreeModel::headerData( int		   section,
 		case GroupCol:		  return tr( "Group"		  );
 		case PermissionsCol:	  return tr( "Permissions"	  );
 		case OctalPermissionsCol: return tr( "Perm."	    );
+		case SizeDeltaCol:	  return tr( "Size Change"	  );
 		default:		  return QVariant();
 	    }
 
@@ -511,7 +919,8 @@ QVariant DirTreeModel::headerData( int		   section,
 		case LatestMTimeCol:
 		case OldestFileMTimeCol:
 		case PermissionsCol:
-		case OctalPermissionsCol: return Qt::AlignHCenter;
+		case OctalPermissionsCol:
+		case SizeDeltaCol:	  return Qt::AlignHCenter;
 		default:		  return Qt::AlignLeft;
 	    }
 
@@ -613,9 +1022,23 @@ void DirTreeModel::sort( int column, Qt::SortOrder order )
     // logDebug() << "Before layoutAboutToBeChanged()" << endl;
     // dumpPersistentIndexList();
 
+    DataColumn sortCol = DataColumns::fromViewCol( column );
+
+    // Sort all directories that the view will ask for right away in one
+    // batch in parallel, before the layout change: Those with persistent
+    // indexes, i.e. the expanded ones, the current one and the selected
+    // ones, and their parents.
+
+    presortChildren( sortCol, order );
+
     emit layoutAboutToBeChanged();
 
-    _sortCol   = DataColumns::fromViewCol( column );
+    // This sorts all shown directories again anyway
+
+    _shownSort.clear();
+    _resortTimer.stop();
+
+    _sortCol   = sortCol;
     _sortOrder = order;
 
     updatePersistentIndexes();
@@ -626,27 +1049,191 @@ void DirTreeModel::sort( int column, Qt::SortOrder order )
 }
 
 
+void DirTreeModel::presortChildren( DataColumn sortCol, Qt::SortOrder order )
+{
+    QList<DirInfo *> dirs = shownDirs();
+
+    if ( ! dirs.isEmpty() )
+	DirInfo::presortChildren( dirs, sortCol, order );
+}
+
+
+QList<DirInfo *> DirTreeModel::shownDirs() const
+{
+    QList<DirInfo *> dirs;
+
+    if ( ! _tree || ! _tree->root() )
+	return dirs;
+
+    QSet<DirInfo *> seen;
+
+    dirs << _tree->root();
+    seen << _tree->root();
+
+    foreach ( const QModelIndex & index, persistentIndexList() )
+    {
+	if ( ! index.isValid() || index.column() != 0 )
+	    continue;
+
+	FileInfo * item = static_cast<FileInfo *>( index.internalPointer() );
+
+	if ( ! item || ! item->checkMagicNumber() )
+	    continue;
+
+	DirInfo * dir = item->isDirInfo() ? item->toDirInfo() : item->parent();
+
+	while ( dir && ! seen.contains( dir ) )
+	{
+	    seen << dir;
+	    dirs << dir;
+	    dir = dir->parent();
+	}
+    }
+
+    return dirs;
+}
+
+
+void DirTreeModel::setSortColIncrementally( DataColumn col )
+{
+    if ( col == _sortCol )
+	return;
+
+    // Keep the sort order the view knows for all directories it might show
+    // right now. Those that are still waiting from a previous switch keep
+    // the one they have.
+
+    foreach ( DirInfo * dir, shownDirs() )
+    {
+	if ( ! _shownSort.contains( dir ) )
+	    _shownSort.insert( dir, qMakePair( _sortCol, _sortOrder ) );
+    }
+
+    _sortCol = col;
+
+    if ( ! _shownSort.isEmpty() )
+	_resortTimer.start();
+}
+
+
+DataColumn DirTreeModel::sortColFor( DirInfo * dir ) const
+{
+    if ( _shownSort.isEmpty() )
+	return _sortCol;
+
+    QHash<DirInfo *, QPair<DataColumn, Qt::SortOrder> >::const_iterator it = _shownSort.find( dir );
+
+    return it == _shownSort.end() ? _sortCol : it.value().first;
+}
+
+
+Qt::SortOrder DirTreeModel::sortOrderFor( DirInfo * dir ) const
+{
+    if ( _shownSort.isEmpty() )
+	return _sortOrder;
+
+    QHash<DirInfo *, QPair<DataColumn, Qt::SortOrder> >::const_iterator it = _shownSort.find( dir );
+
+    return it == _shownSort.end() ? _sortOrder : it.value().second;
+}
+
+
+void DirTreeModel::resortShownDirs()
+{
+    if ( _shownSort.isEmpty() )
+    {
+	_resortTimer.stop();
+	return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Take directories until there are enough children to sort
+
+    QList<DirInfo *> batch;
+    int items = 0;
+
+    for ( QHash<DirInfo *, QPair<DataColumn, Qt::SortOrder> >::const_iterator it = _shownSort.constBegin();
+	  it != _shownSort.constEnd() && ( batch.isEmpty() || items < RESORT_BATCH_ITEMS );
+	  ++it )
+    {
+	batch << it.key();
+	items += it.key()->directChildrenCount();
+    }
+
+    // The indexes of the directories in their old sort order: Their parents
+    // might be in this batch, too.
+
+    QList<QPersistentModelIndex> parents;
+
+    foreach ( DirInfo * dir, batch )
+	parents << QPersistentModelIndex( modelIndex( dir, 0 ) );
+
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 0, 0 ))
+    emit layoutAboutToBeChanged( parents, QAbstractItemModel::VerticalSortHint );
+#else
+    emit layoutAboutToBeChanged();
+#endif
+
+    foreach ( DirInfo * dir, batch )
+	_shownSort.remove( dir );
+
+    DirInfo::presortChildren( batch, _sortCol, _sortOrder );
+    updatePersistentIndexes( batch.toSet() );
+
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 0, 0 ))
+    emit layoutChanged( parents, QAbstractItemModel::VerticalSortHint );
+#else
+    emit layoutChanged();
+#endif
+
+    if ( _shownSort.isEmpty() )
+	_resortTimer.stop();
+
+    ScanStats::instance()->addModelUpdate( timer.nsecsElapsed() );
+}
+
+
 //---------------------------------------------------------------------------
 
 
 void DirTreeModel::busyDisplay()
 {
-    emit layoutAboutToBeChanged();
+    // logDebug() << "Sorting by " << NameCol << " during reading" << endl;
+    clearRowTextCache();
+    setSortColIncrementally( NameCol );
+}
 
-    _sortCol = NameCol;
-    // logDebug() << "Sorting by " << _sortCol << " during reading" << endl;
 
+void DirTreeModel::idleDisplay()
+{
+    // logDebug() << "Sorting by " << PercentNumCol << " after reading is finished" << endl;
+    clearRowTextCache();
+    setSortColIncrementally( PercentNumCol );
+}
+
+
+void DirTreeModel::cacheVerified()
+{
+    // Only the colors changed; just make the views redraw everything
+
+    emit layoutAboutToBeChanged();
     updatePersistentIndexes();
     emit layoutChanged();
 }
 
 
-void DirTreeModel::idleDisplay()
+void DirTreeModel::treeDiffChanged()
 {
     emit layoutAboutToBeChanged();
 
-    _sortCol = PercentNumCol;
-    // logDebug() << "Sorting by " << _sortCol << " after reading is finished" << endl;
+    clearRowTextCache();
+    _shownSort.clear();
+    _resortTimer.stop();
+
+    if ( _tree->root() )
+	_tree->root()->dropSortCache( true ); // recursive
 
     updatePersistentIndexes();
     emit layoutChanged();
@@ -694,13 +1281,14 @@ QVariant DirTreeModel::columnText( FileInfo * item, int col ) const
     {
 	case NameCol:		  return item->name();
 	case PercentBarCol:	  return item->isExcluded() ? tr( "[Excluded]" ) : QVariant();
-	case PercentNumCol:	  return item == _tree->firstToplevel() ? QVariant() : formatPercent( item->subtreeAllocatedPercent() );
+	case PercentNumCol:	  return item == _tree->visibleRoot() ? QVariant() : formatPercent( item->subtreeAllocatedPercent() );
 	case SizeCol:		  return sizeColText( item );
 	case LatestMTimeCol:	  return QString( "  " ) + formatTime( item->latestMtime() );
 	case UserCol:		  return limitedInfo ? QVariant() : item->userName();
 	case GroupCol:		  return limitedInfo ? QVariant() : item->groupName();
 	case PermissionsCol:	  return limitedInfo ? QVariant() : item->symbolicPermissions();
 	case OctalPermissionsCol: return limitedInfo ? QVariant() : item->octalPermissions();
+	case SizeDeltaCol:	  return sizeDeltaText( item );
     }
 
     if ( item->isDirInfo() )
@@ -739,6 +1327,39 @@ QVariant DirTreeModel::columnText( FileInfo * item, int col ) const
 }
 
 
+QVariant DirTreeModel::cachedColumnText( FileInfo * item, int col ) const
+{
+    if ( _tree->isBusy() || col < 0 || col >= DataColumnEnd )
+	return columnText( item, col );
+
+    CachedRowText * row = _rowTextCache.object( item );
+
+    if ( ! row )
+    {
+	row = new CachedRowText();
+	CHECK_NEW( row );
+	row->text.resize( DataColumnEnd );
+	_rowTextCache.insert( item, row );
+    }
+
+    const quint32 bit = 1U << col;
+
+    if ( ! ( row->valid & bit ) )
+    {
+	row->text[ col ] = columnText( item, col );
+	row->valid |= bit;
+    }
+
+    return row->text.at( col );
+}
+
+
+void DirTreeModel::clearRowTextCache()
+{
+    _rowTextCache.clear();
+}
+
+
 QVariant DirTreeModel::columnAlignment( FileInfo * item, int col ) const
 {
     Q_UNUSED( item );
@@ -753,6 +1374,7 @@ QVariant DirTreeModel::columnAlignment( FileInfo * item, int col ) const
 	case TotalFilesCol:
 	case TotalSubDirsCol:
 	case OctalPermissionsCol:
+	case SizeDeltaCol:
 	    alignment |= Qt::AlignRight;
 	    break;
 
@@ -785,9 +1407,12 @@ QVariant DirTreeModel::columnFont( FileInfo * item, int col ) const
 
 QVariant DirTreeModel::dominantItemColumnFont( FileInfo * item, int col ) const
 {
-    Q_UNUSED( item );
+    // The sort order of the rows that the view shows right now
+
+    DataColumn	  sortCol   = sortColFor  ( item->parent() );
+    Qt::SortOrder sortOrder = sortOrderFor( item->parent() );
 
-    switch ( _sortCol )
+    switch ( sortCol )
     {
 	// Only if sorting by size or percent
 	case PercentBarCol:
@@ -799,7 +1424,7 @@ QVariant DirTreeModel::dominantItemColumnFont( FileInfo * item, int col ) const
 	    return QVariant();
     }
 
-    if ( _sortOrder != Qt::DescendingOrder )
+    if ( sortOrder != Qt::DescendingOrder )
 	return QVariant();
 
     switch ( col )
@@ -829,7 +1454,7 @@ QVariant DirTreeModel::columnRawData( FileInfo * item, int col ) const
 	case PercentBarCol:
 	    {
 		if ( ( item->parent() && item->parent()->isBusy() ) ||
-		     item == _tree->firstToplevel() ||
+		     item == _tree->visibleRoot() ||
 		     item->isAttic() )
 		{
 		    return -1.0;
@@ -850,6 +1475,7 @@ QVariant DirTreeModel::columnRawData( FileInfo * item, int col ) const
 	case GroupCol:		  return item->gid();
 	case PermissionsCol:	  return item->mode();
 	case OctalPermissionsCol: return item->mode();
+	case SizeDeltaCol:	  return _treeDiff->sizeDelta( item );
 	default:		  return QVariant();
     }
 }
@@ -983,7 +1609,30 @@ QVariant DirTreeModel::sizeColText( FileInfo * item ) const
     QString leftMargin( 2, ' ' );
 
     if ( item->isDirInfo() )
+    {
+	// A mount point that is not read yet: Show the estimate until the
+	// real sum catches up with it.
+
+	FileSize estimate = item->toDirInfo()->sizeEstimate();
+
+	if ( estimate > item->totalAllocatedSize() )
+	    return leftMargin + "~" + formatSize( estimate );
+
+	// Extrapolated from a sampling scan: Add the 95% confidence interval
+
+	FileSize sampleError = item->toDirInfo()->sampleError();
+
+	if ( sampleError >= 0 && item->totalSize() > 0 )
+	{
+	    double percent = 100.0 * sampleError / item->totalSize();
+
+	    return leftMargin + "~" + formatSize( item->totalAllocatedSize() )
+		+ " " + QChar( 0x00B1 ) // plus-minus sign
+		+ QString( "%1%" ).arg( percent, 0, 'f', percent < 10.0 ? 1 : 0 );
+	}
+
 	return leftMargin + item->sizePrefix() + formatSize( item->totalAllocatedSize() );
+    }
 
     QString text = sizeText( item );
 
@@ -997,6 +1646,31 @@ QVariant DirTreeModel::sizeColText( FileInfo * item ) const
 }
 
 
+QVariant DirTreeModel::sizeDeltaText( FileInfo * item ) const
+{
+    if ( ! _treeDiff->isActive() )
+	return QVariant();
+
+    const TreeDiffItem * diff = _treeDiff->diff( item );
+
+    if ( ! diff )
+	return QVariant();
+
+    if ( diff->isNew )
+	return tr( "new" );
+
+    QString leftMargin( 2, ' ' );
+
+    if ( diff->sizeDelta > 0 )
+	return leftMargin + "+" + formatSize( diff->sizeDelta );
+
+    if ( diff->sizeDelta < 0 )
+	return leftMargin + "-" + formatSize( -diff->sizeDelta );
+
+    return leftMargin + QChar( 0x00B1 ) + "0"; // Files added and removed
+}
+
+
 QVariant DirTreeModel::columnIcon( FileInfo * item, int col ) const
 {
     if ( col != NameCol )
@@ -1053,6 +1727,14 @@ void DirTreeModel::readJobFinished( DirInfo * dir )
     // logDebug() << dir << endl;
     delayedUpdate( dir );
 
+    if ( ! dir || ! viewKnows( dir ) )
+    {
+	// Nothing to do: The view will ask for the children of this dir
+	// when it needs them.
+
+	return;
+    }
+
     if ( anyAncestorBusy( dir ) )
     {
 	if  ( dir && ! dir->isMountPoint() )
@@ -1065,6 +1747,12 @@ void DirTreeModel::readJobFinished( DirInfo * dir )
 }
 
 
+void DirTreeModel::childrenAdded( DirInfo * dir )
+{
+    delayedUpdate( dir );
+}
+
+
 bool DirTreeModel::anyAncestorBusy( FileInfo * item ) const
 {
     while ( item )
@@ -1092,14 +1780,19 @@ void DirTreeModel::newChildrenNotify( DirInfo * dir )
 	return;
     }
 
-    if ( ! dir->isTouched() && dir != _tree->root() && dir != _tree->firstToplevel() )
+    if ( ! viewKnows( dir ) )
     {
-	// logDebug() << "Remaining silent about untouched dir " << dir << endl;
+	// logDebug() << "Remaining silent about invisible dir " << dir << endl;
 	return;
     }
 
+    // The view might ask for any of the rows reported here, so any files
+    // in the spill store of an out-of-core tree are needed in memory.
+
+    dir->pageInFiles();
+
     QModelIndex index = modelIndex( dir );
-    int count = directChildrenCount( dir );
+    int count = qMin( directChildrenCount( dir ), fetchedRows( dir ) );
     // Debug::dumpDirectChildren( dir );
 
     if ( count > 0 )
@@ -1114,7 +1807,12 @@ void DirTreeModel::newChildrenNotify( DirInfo * dir )
 
     // If any readJobFinished signals were ignored because a parent was not
     // finished yet, now is the time to notify the view about those children,
-    // too.
+    // too. But if the view never asked for the children of this dir, it
+    // cannot know any of them; it will get everything when it asks.
+
+    if ( ! dir->isExposed() && dir != _tree->root() )
+	return;
+
     FileInfoIterator it( dir );
 
     while ( *it )
@@ -1130,15 +1828,47 @@ void DirTreeModel::newChildrenNotify( DirInfo * dir )
 }
 
 
+bool DirTreeModel::viewKnows( DirInfo * dir ) const
+{
+    if ( dir == _tree->root() || dir == _tree->firstToplevel() )
+	return true;
+
+    if ( ! dir->isTouched() )
+	return false;
+
+    DirInfo * parent = dir->parent();
+
+    return ! parent || parent == _tree->root() || parent->isExposed();
+}
+
+
+void DirTreeModel::collapsedNotify( const QModelIndex & index )
+{
+    FileInfo * item = itemFromIndex( index );
+
+    if ( item && item->isDirInfo() )
+	item->toDirInfo()->clearExposed( true ); // recursive
+}
+
+
 void DirTreeModel::delayedUpdate( DirInfo * dir )
 {
-    while ( dir && dir != _tree->root() )
-    {
-	if ( dir->isTouched() )
-	    _pendingUpdates.insert( dir );
+    // Keep all ancestors of a pending directory pending, too, even those
+    // the view doesn't know (sendPendingUpdates() skips them): Then only
+    // that part of a subtree needs to be searched in dropPendingUpdates(),
+    // and this can stop at the first directory that is already pending.
+
+    while ( dir && dir != _tree->root() && ! viewKnows( dir ) )
+	dir = dir->parent();
 
+    while ( dir && dir != _tree->root() && ! _pendingUpdates.contains( dir ) )
+    {
+	_pendingUpdates.insert( dir );
 	dir = dir->parent();
     }
+
+    if ( ! _pendingUpdates.isEmpty() )
+	_updateTimer->delayedRequest();
 }
 
 
@@ -1146,49 +1876,164 @@ void DirTreeModel::sendPendingUpdates()
 {
     // logDebug() << "Sending " << _pendingUpdates.size() << " updates" << endl;
 
+    QElapsedTimer timer;
+    timer.start();
+
+    // Coalesce the updates for siblings: The view only needs to know the
+    // range of rows from the first to the last changed child of each
+    // parent.
+
+    QHash<FileInfo *, FileInfo *> first;	// parent -> child with lowest row
+    QHash<FileInfo *, FileInfo *> last;	// parent -> child with highest row
+
     foreach ( DirInfo * dir, _pendingUpdates )
     {
-	dataChangedNotify( dir );
+	// Only if the view ever requested data about this dir and it did
+	// not collapse its parent since then
+
+	if ( ! dir || dir == _tree->root() || ! viewKnows( dir ) )
+	    continue;
+
+	// If the view is still interested in this dir, it will fetch data, and
+	// then the dir will be touched again. For all we know now, this dir
+	// might easily be out of scope for the view, so let's not bother the
+	// view again about this dir until it's clear that the view still wants
+	// updates about it.
+
+	dir->clearTouched();
+
+	FileInfo * parent = dir->parent();
+	FileInfo * lowest = first.value( parent, 0 );
+
+	if ( ! lowest )
+	{
+	    first.insert( parent, dir );
+	    last.insert ( parent, dir );
+	    continue;
+	}
+
+	int row = rowNumber( dir );
+
+	if ( row < rowNumber( lowest ) )
+	    first.insert( parent, dir );
+	else if ( row > rowNumber( last.value( parent ) ) )
+	    last.insert( parent, dir );
     }
 
     _pendingUpdates.clear();
+
+    for ( QHash<FileInfo *, FileInfo *>::const_iterator it = first.constBegin();
+	  it != first.constEnd();
+	  ++it )
+    {
+	dataChangedNotify( it.value(), last.value( it.key() ) );
+    }
+
+    if ( _tree->isBusy() )
+	ScanStats::instance()->addModelUpdate( timer.nsecsElapsed() );
 }
 
 
-void DirTreeModel::dataChangedNotify( DirInfo * dir )
+void DirTreeModel::dropPendingUpdates( FileInfo * subtree,
+				       bool	  includeSubtree )
 {
-    if ( ! dir || dir == _tree->root() )
+    // With nothing pending in 'subtree' itself, nothing below it is
+    // pending either (see delayedUpdate()): Just one lookup for most
+    // deleted items.
+
+    if ( ! subtree || ! subtree->isDirInfo() ||
+	 ! _pendingUpdates.contains( subtree->toDirInfo() ) )
+    {
 	return;
+    }
+
+    // Descend only into the directories that are pending
+
+    QList<DirInfo *> dirs;
+    dirs << subtree->toDirInfo();
 
-    if ( dir->isTouched() ) // only if the view ever requested data about this dir
+    while ( ! dirs.isEmpty() )
     {
-	QModelIndex topLeft	= modelIndex( dir, 0 );
-	QModelIndex bottomRight = createIndex( topLeft.row(), DataColumns::instance()->colCount() - 1, dir );
+	DirInfo * dir = dirs.takeLast();
 
-#if (QT_VERSION < QT_VERSION_CHECK( 5, 1, 0))
-	emit dataChanged( topLeft, bottomRight );
-#else
-	QVector<int> roles;
-	roles << Qt::DisplayRole;
+	for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+	{
+	    if ( child->isDirInfo() && _pendingUpdates.remove( child->toDirInfo() ) )
+		dirs << child->toDirInfo();
+	}
 
-	emit dataChanged( topLeft, bottomRight, roles );
-#endif
-	// logDebug() << "Data changed for " << dir << endl;
+	if ( dir->dotEntry() && _pendingUpdates.remove( dir->dotEntry() ) )
+	    dirs << dir->dotEntry();
 
-	// If the view is still interested in this dir, it will fetch data, and
-	// then the dir will be touched again. For all we know now, this dir
-	// might easily be out of scope for the view, so let's not bother the
-	// view again about this dir until it's clear that the view still wants
-	// updates about it.
+	if ( dir->attic() && _pendingUpdates.remove( dir->attic() ) )
+	    dirs << dir->attic();
+    }
 
-	dir->clearTouched();
+    if ( includeSubtree )
+	_pendingUpdates.remove( subtree->toDirInfo() );
+}
+
+
+void DirTreeModel::dropShownSort( FileInfo * subtree,
+				  bool	     includeSubtree )
+{
+    QMutableHashIterator<DirInfo *, QPair<DataColumn, Qt::SortOrder> > it( _shownSort );
+
+    while ( it.hasNext() )
+    {
+	DirInfo * dir = it.next().key();
+
+	if ( dir->isInSubtree( subtree ) &&
+	     ( includeSubtree || dir != subtree ) )
+	{
+	    it.remove();
+	}
+    }
+}
+
+
+void DirTreeModel::dropFetchedRows( FileInfo * subtree,
+				    bool       includeSubtree )
+{
+    QMutableHashIterator<FileInfo *, int> it( _fetchedRows );
+
+    while ( it.hasNext() )
+    {
+	FileInfo * dir = it.next().key();
+
+	if ( dir->isInSubtree( subtree ) &&
+	     ( includeSubtree || dir != subtree ) )
+	{
+	    it.remove();
+	}
     }
 }
 
 
+void DirTreeModel::dataChangedNotify( FileInfo * first, FileInfo * last )
+{
+    QModelIndex topLeft	    = modelIndex( first, 0 );
+    QModelIndex bottomRight = modelIndex( last, DataColumns::instance()->colCount() - 1 );
+
+    if ( ! topLeft.isValid() || ! bottomRight.isValid() )
+	return;
+
+    clearRowTextCache();
+
+#if (QT_VERSION < QT_VERSION_CHECK( 5, 1, 0))
+    emit dataChanged( topLeft, bottomRight );
+#else
+    QVector<int> roles;
+    roles << Qt::DisplayRole;
+
+    emit dataChanged( topLeft, bottomRight, roles );
+#endif
+    // logDebug() << "Data changed for " << first << " .. " << last << endl;
+}
+
+
 void DirTreeModel::readingFinished()
 {
-    _updateTimer.stop();
     idleDisplay();
     sendPendingUpdates();
 
@@ -1218,7 +2063,7 @@ void DirTreeModel::dumpPersistentIndexList() const
 }
 
 
-void DirTreeModel::updatePersistentIndexes()
+void DirTreeModel::updatePersistentIndexes( const QSet<DirInfo *> & parents )
 {
     QModelIndexList persistentList = persistentIndexList();
 
@@ -1229,6 +2074,22 @@ void DirTreeModel::updatePersistentIndexes()
 	if ( oldIndex.isValid() )
 	{
 	    FileInfo * item = static_cast<FileInfo *>( oldIndex.internalPointer() );
+
+	    if ( ! parents.isEmpty() &&
+		 ( ! item || ! item->checkMagicNumber() || ! parents.contains( item->parent() ) ) )
+	    {
+		continue;
+	    }
+
+	    // After sorting again, the item might be beyond the rows fetched
+	    // so far. The layout change tells the view about the new rows.
+
+	    if ( item && item->checkMagicNumber() )
+	    {
+		for ( FileInfo * ancestor = item; ancestor; ancestor = ancestor->parent() )
+		    fetchRow( ancestor, false );
+	    }
+
 	    QModelIndex newIndex = modelIndex( item, oldIndex.column() );
 #if 0
 	    logDebug() << "Updating #" << i
@@ -1284,16 +2145,34 @@ void DirTreeModel::deletingChild( FileInfo * child )
     {
 	QModelIndex parentIndex = modelIndex( child->parent(), 0 );
 	int row = rowNumber( child );
-	logDebug() << "beginRemoveRows for " << child << " row " << row << endl;
-	beginRemoveRows( parentIndex, row, row );
+	int fetched = fetchedRows( child->parent() );
+
+	// The view does not know the rows that were not fetched yet
+
+	if ( row < fetched )
+	{
+	    logDebug() << "beginRemoveRows for " << child << " row " << row << endl;
+	    beginRemoveRows( parentIndex, row, row );
+
+	    // If there are more children than were fetched, the next one
+	    // would move up into the fetched rows without the view knowing.
+
+	    if ( directChildrenCount( child->parent() ) > fetched )
+		_fetchedRows[ child->parent() ] = fetched - 1;
+	}
     }
 
     invalidatePersistent( child, true );
+    dropPendingUpdates( child, true );
+    dropFetchedRows( child, true );
+    dropShownSort( child, true );
+    clearRowTextCache();	// The totals and percentages of all ancestors change
 }
 
 
 void DirTreeModel::childDeleted()
 {
+    clearRowTextCache();
     endRemoveRows();
 }
 
@@ -1305,7 +2184,7 @@ void DirTreeModel::clearingSubtree( DirInfo * subtree )
     if ( subtree == _tree->root() || subtree->isTouched() )
     {
 	QModelIndex subtreeIndex = modelIndex( subtree, 0 );
-	int count = directChildrenCount( subtree );
+	int count = qMin( directChildrenCount( subtree ), fetchedRows( subtree ) );
 
 	if ( count > 0 )
 	{
@@ -1314,7 +2193,14 @@ void DirTreeModel::clearingSubtree( DirInfo * subtree )
 	}
     }
 
-    invalidatePersistent( subtree, false );
+    if ( ! _clearingSubtrees )	// Otherwise already done in clearingSubtrees()
+    {
+	invalidatePersistent( subtree, false );
+	dropPendingUpdates( subtree, false );
+	dropFetchedRows( subtree, false );
+	dropShownSort( subtree, false );
+	clearRowTextCache();
+    }
 }
 
 
@@ -1322,10 +2208,38 @@ void DirTreeModel::subtreeCleared( DirInfo * subtree )
 {
     Q_UNUSED( subtree );
 
+    if ( ! _clearingSubtrees )
+	clearRowTextCache();
+
     endRemoveRows();
 }
 
 
+void DirTreeModel::clearingSubtrees( const FileInfoSet & subtrees )
+{
+    logDebug() << "Clearing " << subtrees.size() << " subtrees" << endl;
+
+    invalidatePersistent( subtrees );
+
+    foreach ( FileInfo * subtree, subtrees )
+    {
+	dropPendingUpdates( subtree, false );
+	dropFetchedRows( subtree, false );
+	dropShownSort( subtree, false );
+    }
+
+    clearRowTextCache();
+    _clearingSubtrees = true;
+}
+
+
+void DirTreeModel::subtreesCleared()
+{
+    _clearingSubtrees = false;
+    clearRowTextCache();
+}
+
+
 void DirTreeModel::invalidatePersistent( FileInfo * subtree,
 					 bool	    includeParent )
 {
@@ -1350,6 +2264,29 @@ void DirTreeModel::invalidatePersistent( FileInfo * subtree,
 }
 
 
+void DirTreeModel::invalidatePersistent( const FileInfoSet & subtrees )
+{
+    foreach ( const QModelIndex & index, persistentIndexList() )
+    {
+	FileInfo * item = static_cast<FileInfo *>( index.internalPointer() );
+	CHECK_PTR( item );
+
+	bool invalid = ! item->checkMagicNumber();
+
+	if ( ! invalid )
+	{
+	    // Only what is below one of the subtrees goes away
+
+	    for ( FileInfo * parent = item->parent(); parent && ! invalid; parent = parent->parent() )
+		invalid = subtrees.contains( parent );
+	}
+
+	if ( invalid )
+	    changePersistentIndex( index, QModelIndex() );
+    }
+}
+
+
 QVariant DirTreeModel::formatPercent( float percent ) const
 {
     QString text = ::formatPercent( percent );
@@ -1361,6 +2298,37 @@ QVariant DirTreeModel::formatPercent( float percent ) const
 }
 
 
+void DirTreeModel::dirRefreshing( DirInfo * dir )
+{
+    // Make sure the current item and the selected items are not among the
+    // items that will be deleted when 'dir' is read again.
+
+    if ( ! _selectionModel )
+	return;
+
+    FileInfoSet items = _selectionModel->selectedItems();
+
+    if ( _selectionModel->currentItem() )
+	items << _selectionModel->currentItem();
+
+    foreach ( FileInfo * item, items )
+    {
+	if ( item != dir && item->isInSubtree( dir ) && ! survivesRefresh( item, dir ) )
+	{
+	    _selectionModel->setCurrentItem( dir, true );
+	    return;
+	}
+    }
+}
+
+
+void DirTreeModel::treeRefreshing( DirInfo * toplevel )
+{
+    if ( _selectionModel )
+	_selectionModel->setCurrentItem( toplevel, true );
+}
+
+
 void DirTreeModel::refreshSelected()
 {
     CHECK_PTR( _selectionModel );
@@ -15,11 +15,16 @@
 #include <QFont>
 #include <QIcon>
 #include <QSet>
-#include <QTimer>
+#include <QHash>
+#include <QCache>
+#include <QVector>
 #include <QTextStream>
+#include <QTimer>
+#include <QPair>
 
 #include "DataColumns.h"
 #include "FileInfo.h"
+#include "FileInfoSet.h"
 #include "PkgFilter.h"
 #include "FormatUtil.h"
 
@@ -28,7 +33,10 @@ namespace QDirStat
 {
     class DirTree;
     class DirInfo;
+    class DirWatcher;
     class SelectionModel;
+    class AdaptiveTimer;
+    class TreeDiff;
 
     enum CustomRoles
     {
@@ -36,6 +44,20 @@ namespace QDirStat
     };
 
 
+    /**
+     * The formatted texts of the columns of one row of a DirTreeModel that
+     * were already requested by a view. Bit n of 'valid' is set if the text
+     * for column n is in 'text'.
+     **/
+    struct CachedRowText
+    {
+	CachedRowText(): valid( 0 ) {}
+
+	quint32		  valid;
+	QVector<QVariant> text;
+    };
+
+
     class DirTreeModel: public QAbstractItemModel
     {
 	Q_OBJECT
@@ -66,6 +88,11 @@ namespace QDirStat
 	 **/
 	DirTree *tree()	{ return _tree; }
 
+	/**
+	 * Return the watcher for live updates of the tree.
+	 **/
+	DirWatcher * dirWatcher() const { return _dirWatcher; }
+
 	/**
 	 * Set the column order and what columns to display.
 	 *
@@ -155,6 +182,12 @@ namespace QDirStat
 	 **/
 	void setBoldItemFont( const QFont & font ) { _boldItemFont = font; }
 
+	/**
+	 * Return the differences of the tree against a baseline for the
+	 * SizeDeltaCol and for coloring the treemap.
+	 **/
+	TreeDiff * treeDiff() const { return _treeDiff; }
+
         /**
          * Return the icon indicate an item's type (file, directory etc.)
          * or a null icon if the type cannot be determined.
@@ -168,6 +201,11 @@ namespace QDirStat
 	 **/
 	void openUrl( const QString & url );
 
+	/**
+	 * Open several directory URLs together, each as a toplevel item.
+	 **/
+	void openUrls( const QStringList & urls );
+
 	/**
 	 * Open a pkg URL: Read installed packages that match the specified
 	 * PkgFilter and their file lists from the system's package manager(s).
@@ -235,6 +273,13 @@ namespace QDirStat
 	 **/
 	bool slowUpdate() const { return _slowUpdate; }
 
+	/**
+	 * Report that a view spent 'nanosec' repainting. While reading,
+	 * this is part of the cost of the display updates: If the updates
+	 * take more than the CPU budget, they are sent less often.
+	 **/
+	void addUpdateCost( qint64 nanosec );
+
 
     public:
 
@@ -266,9 +311,21 @@ namespace QDirStat
 
 	/**
 	 * Return a model index for 'item' and 'column'.
+	 *
+	 * Notice that only the rows of a huge directory that were fetched so
+	 * far are known to the view; call fetchItem() first for an item that
+	 * might not be among them.
 	 **/
 	QModelIndex modelIndex( FileInfo * item, int column = 0 ) const;
 
+	/**
+	 * Make sure the rows of 'item' and of all its ancestors are fetched,
+	 * i.e. reported to the view, e.g. before selecting it. This only
+	 * makes a difference for huge directories whose rows are fetched in
+	 * chunks (see fetchMore()).
+	 **/
+	void fetchItem( FileInfo * item );
+
 	/**
 	 * Return the current sort column.
 	 **/
@@ -289,6 +346,29 @@ namespace QDirStat
 	 **/
 	virtual int rowCount   ( const QModelIndex & parent ) const Q_DECL_OVERRIDE;
 
+	/**
+	 * Return 'true' if 'parent' has any rows. Unlike rowCount(), this
+	 * does not mark 'parent' as exposed to the view.
+	 **/
+	virtual bool hasChildren( const QModelIndex & parent = QModelIndex() ) const Q_DECL_OVERRIDE;
+
+	/**
+	 * Return 'true' if 'parent' is a cache placeholder whose contents
+	 * can still be read from its cache file, or if it has more children
+	 * than were reported to the view so far.
+	 **/
+	virtual bool canFetchMore( const QModelIndex & parent ) const Q_DECL_OVERRIDE;
+
+	/**
+	 * Start reading the contents of cache placeholder 'parent', or report
+	 * the next chunk of its children to the view.
+	 *
+	 * The children of a huge directory are reported in chunks: Only the
+	 * first chunk when the view asks for its rows, the next one when the
+	 * user scrolls to the end of them. Only those rows need to be sorted.
+	 **/
+	virtual void fetchMore( const QModelIndex & parent ) Q_DECL_OVERRIDE;
+
 	/**
 	 * Return the number of columns for 'parent'.
 	 **/
@@ -364,22 +444,50 @@ namespace QDirStat
 
 	/**
 	 * Fix up sort order while reading: Sort by read jobs if the sort
-	 * column is the PercentBarCol.
+	 * column is the PercentBarCol. The directories that are shown keep
+	 * their old sort order until resortShownDirs() gets to them.
 	 **/
 	void busyDisplay();
 
 	/**
 	 * Fix up sort order after reading is finished: No longer Sort by read
-	 * jobs if the sort column is the PercentBarCol.
+	 * jobs if the sort column is the PercentBarCol. As with busyDisplay(),
+	 * the shown directories are sorted again in small batches.
 	 **/
 	void idleDisplay();
 
+	/**
+	 * Sort the next batch of the directories in _shownSort by the current
+	 * sort column and order and tell the views about the new layout of
+	 * just those directories. Called from _resortTimer when the event
+	 * loop is idle until all of them are done.
+	 **/
+	void resortShownDirs();
+
+	/**
+	 * Show the new differences against the baseline.
+	 **/
+	void treeDiffChanged();
+
+	/**
+	 * Show the items that don't match the disk after checking the tree
+	 * against it.
+	 **/
+	void cacheVerified();
+
 	/**
 	 * Process notification that the read job for 'dir' is finished.
 	 * Other read jobs might still be pending.
 	 **/
 	void readJobFinished( DirInfo *dir );
 
+	/**
+	 * Process notification that a batch of children was added to 'dir':
+	 * Schedule an update of the summary fields of 'dir' and its
+	 * ancestors with the next update timer tick.
+	 **/
+	void childrenAdded( DirInfo * dir );
+
 	/**
 	 * Process notification that reading the dir tree is completely
 	 * finished.
@@ -390,17 +498,53 @@ namespace QDirStat
 	 * Delayed update of the data fields in the view for 'dir':
 	 * Store 'dir' and all its ancestors in _pendingUpdates.
 	 *
-	 * The updates will be sent several times per second to the views with
-	 * 'sendPendingUpdates()'.
+	 * The updates will be sent to the views with 'sendPendingUpdates()'
+	 * by the update timer: Several times per second, but less often if
+	 * the views need too much time to repaint.
 	 **/
 	void delayedUpdate( DirInfo * dir );
 
 	/**
-	 * Send all pending updates to the connected views.
+	 * Remove all pending updates for items in 'subtree' because that
+	 * subtree is about to be deleted. If 'includeSubtree' is 'false',
+	 * the 'subtree' item itself is left alone.
+	 **/
+	void dropPendingUpdates( FileInfo * subtree, bool includeSubtree );
+
+	/**
+	 * Forget how many rows were fetched for the directories in 'subtree'
+	 * because that subtree is about to be deleted. If 'includeSubtree' is
+	 * 'false', the 'subtree' item itself is left alone.
+	 **/
+	void dropFetchedRows( FileInfo * subtree, bool includeSubtree );
+
+	/**
+	 * Send all pending updates to the connected views: One dataChanged()
+	 * signal for each parent with changed children.
 	 * This is triggered by the update timer.
 	 **/
 	void sendPendingUpdates();
 
+	/**
+	 * Notification that a view collapsed the item at 'index': The view
+	 * no longer needs any notifications about its subtree until it asks
+	 * for its children again.
+	 **/
+	void collapsedNotify( const QModelIndex & index );
+
+	/**
+	 * Notification from the DirWatcher that 'dir' is about to be read
+	 * again: Make sure the current item and the selected items are not
+	 * among the items that will be deleted.
+	 **/
+	void dirRefreshing( DirInfo * dir );
+
+	/**
+	 * Notification from the DirWatcher that everything below 'toplevel'
+	 * is about to be read again: Select 'toplevel'.
+	 **/
+	void treeRefreshing( DirInfo * toplevel );
+
 	/**
 	 * Notification that a subtree is about to be deleted.
 	 **/
@@ -421,6 +565,16 @@ namespace QDirStat
 	 **/
 	void subtreeCleared( DirInfo * subtree );
 
+	/**
+	 * Notification that a number of subtrees are about to be cleared.
+	 **/
+	void clearingSubtrees( const FileInfoSet & subtrees );
+
+	/**
+	 * Notification that clearing those subtrees is done.
+	 **/
+	void subtreesCleared();
+
 	/**
 	 * Invalidate all persistent indexes in 'subtree'. 'includeParent'
 	 * indicates if 'subtree' itself will become invalid.
@@ -428,12 +582,57 @@ namespace QDirStat
 	void invalidatePersistent( FileInfo * subtree,
 				   bool	      includeParent );
 
+	/**
+	 * Invalidate all persistent indexes below any of 'subtrees', but not
+	 * those of the subtrees themselves. This is one pass over all
+	 * persistent indexes instead of one for each subtree.
+	 **/
+	void invalidatePersistent( const FileInfoSet & subtrees );
+
     protected:
 	/**
 	 * Create a new tree (and delete the old one if there is one)
 	 **/
 	void createTree();
 
+	/**
+	 * Compute the sort orders by 'sortCol' and 'sortOrder' of all
+	 * directories that have persistent indexes (typically because they
+	 * are expanded in a view) and their parents in one parallel batch
+	 * (see DirInfo::presortChildren()).
+	 **/
+	void presortChildren( DataColumn sortCol, Qt::SortOrder order );
+
+	/**
+	 * Return the directories that a view might currently show: The root,
+	 * those that have persistent indexes (the expanded, current and
+	 * selected ones) and all their ancestors.
+	 **/
+	QList<DirInfo *> shownDirs() const;
+
+	/**
+	 * Switch the sort column to 'col' without a layout change of the
+	 * whole model: The shown directories keep the sort column and order
+	 * they have now (see _shownSort), and resortShownDirs() sorts them
+	 * again in small batches when the event loop is idle. All other
+	 * directories use the new sort column right away.
+	 **/
+	void setSortColIncrementally( DataColumn col );
+
+	/**
+	 * Return the sort column and order to use for the children of 'dir':
+	 * The current ones unless 'dir' is still shown in an older sort order.
+	 **/
+	DataColumn    sortColFor  ( DirInfo * dir ) const;
+	Qt::SortOrder sortOrderFor( DirInfo * dir ) const;
+
+	/**
+	 * Forget the older sort orders of the directories in 'subtree'
+	 * because that subtree is about to be deleted. If 'includeSubtree' is
+	 * 'false', the 'subtree' item itself is left alone.
+	 **/
+	void dropShownSort( FileInfo * subtree, bool includeSubtree );
+
 	/**
 	 * Load all required icons.
 	 **/
@@ -447,14 +646,30 @@ namespace QDirStat
 	void newChildrenNotify( DirInfo * dir );
 
 	/**
-	 * Notify the view about changed data of 'dir'.
+	 * Return 'true' if a view might currently display the row for 'dir':
+	 * The view requested data for it, and its parent is exposed, i.e. the
+	 * view asked for its children and did not collapse it since then.
+	 * The view does not need any notifications about other directories.
+	 **/
+	bool viewKnows( DirInfo * dir ) const;
+
+	/**
+	 * Notify the view about changed data in the rows from 'first' to
+	 * 'last' of the same parent.
+	 **/
+	void dataChangedNotify( FileInfo * first, FileInfo * last );
+
+	/**
+	 * Set up the delay stages of the update timer.
 	 **/
-	void dataChangedNotify( DirInfo * dir );
+	void initUpdateTimer();
 
 	/**
 	 * Update the persistent indexes with current row after sorting etc.
+	 * If 'parents' is not empty, only those of the children of those
+	 * directories.
 	 **/
-	void updatePersistentIndexes();
+	void updatePersistentIndexes( const QSet<DirInfo *> & parents = QSet<DirInfo *>() );
 
 	/**
 	 * Return 'true' if 'item' or any ancestor (parent or parent's parent
@@ -480,6 +695,52 @@ namespace QDirStat
 	 **/
 	QVariant columnRawData	       ( FileInfo * item, int col ) const;
 
+	/**
+	 * Return the text for 'item' in column 'col' like columnText(), but
+	 * from the row text cache if possible. Nothing is cached while the
+	 * tree is being read: Then the texts change all the time anyway.
+	 **/
+	QVariant cachedColumnText( FileInfo * item, int col ) const;
+
+	/**
+	 * Drop all cached row texts. Call this whenever the data of any
+	 * item might have changed.
+	 **/
+	void clearRowTextCache();
+
+	/**
+	 * Return the item for 'parentIndex' or the tree's root if it is
+	 * invalid.
+	 **/
+	FileInfo * parentItem( const QModelIndex & parentIndex ) const;
+
+	/**
+	 * Return the number of children of 'item' to report to the view:
+	 * None while 'item' is still being read, and no more than were
+	 * fetched so far.
+	 **/
+	int reportedChildrenCount( FileInfo * item ) const;
+
+	/**
+	 * Return the number of children of 'item' that could be reported to
+	 * the view if they were all fetched: None while 'item' is still
+	 * being read.
+	 **/
+	int availableChildrenCount( FileInfo * item ) const;
+
+	/**
+	 * Return the number of rows of 'dir' fetched so far. This might be
+	 * more than the number of its children.
+	 **/
+	int fetchedRows( FileInfo * dir ) const;
+
+	/**
+	 * Make sure the row of 'item' in its parent is fetched. If 'notify'
+	 * is 'true', the view is notified about the new rows; otherwise the
+	 * caller has to take care of that, e.g. with a layout change.
+	 **/
+	void fetchRow( FileInfo * item, bool notify );
+
 	/**
 	 * Return the number of direct children (plus the attic if there is
 	 * one) of a subtree.
@@ -491,6 +752,11 @@ namespace QDirStat
 	 **/
 	QVariant sizeColText( FileInfo * item ) const;
 
+	/**
+	 * Return the text for the size change of 'item' against the baseline.
+	 **/
+	QVariant sizeDeltaText( FileInfo * item ) const;
+
 	/**
 	 * Format a percentage value as string if it is non-negative.
 	 * Return QVariant() if it is negative.
@@ -521,23 +787,33 @@ namespace QDirStat
 	//
 
 	DirTree *	 _tree;
+	DirWatcher *	 _dirWatcher;
+	TreeDiff *	 _treeDiff;
 	SelectionModel * _selectionModel;
 	QString		 _treeIconDir;
 	int		 _readJobsCol;
 	QSet<DirInfo *>	 _pendingUpdates;
-	QTimer		 _updateTimer;
+	QHash<FileInfo *, int> _fetchedRows;	// Only beyond the first chunk
+	AdaptiveTimer *	 _updateTimer;
 	int		 _updateTimerMillisec;
 	int		 _slowUpdateMillisec;
+	int		 _updateCpuBudget;
 	bool		 _slowUpdate;
 	DataColumn	 _sortCol;
 	Qt::SortOrder	 _sortOrder;
+	QHash<DirInfo *, QPair<DataColumn, Qt::SortOrder> > _shownSort; // Not sorted again yet
+	QTimer		 _resortTimer;
 	bool		 _removingRows;
+	bool		 _clearingSubtrees;
 	bool		 _useBoldForDominantItems;
 
+	mutable QCache<const FileInfo *, CachedRowText> _rowTextCache;
+
 	// Colors and fonts
 
 	QColor _dirReadErrColor;
 	QColor _subtreeReadErrColor;
+	QColor _cacheMismatchColor;
 
 	QFont  _boldItemFont;
 
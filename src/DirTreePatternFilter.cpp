@@ -17,6 +17,19 @@
 using namespace QDirStat;
 
 
+/**
+ * Return 'true' if 'pattern' contains any character with a special meaning
+ * in a wildcard pattern.
+ **/
+static bool hasWildcards( const QString & pattern )
+{
+    return pattern.contains( '*'  ) ||
+	pattern.contains( '?'  ) ||
+	pattern.contains( '['  ) ||
+	pattern.contains( '\\' );
+}
+
+
 DirTreeFilter * DirTreePatternFilter::create( const QString & pattern )
 {
     if ( pattern.isEmpty() )
@@ -24,12 +37,12 @@ DirTreeFilter * DirTreePatternFilter::create( const QString & pattern )
 
     DirTreeFilter * filter = 0;
 
-    if ( pattern.startsWith( "*." ) )
+    if ( pattern.startsWith( "*" ) )
     {
 	QString suffix = pattern;
 	suffix.remove( 0, 1 ); // Remove the leading "*"
 
-	if ( QRegExp( "^\\.[a-zA-Z0-9]+" ).exactMatch( suffix ) )
+	if ( ! suffix.isEmpty() && ! suffix.contains( '/' ) && ! hasWildcards( suffix ) )
 	    filter = new DirTreeSuffixFilter( suffix );
     }
 
@@ -42,9 +55,32 @@ DirTreeFilter * DirTreePatternFilter::create( const QString & pattern )
 
 
 DirTreePatternFilter::DirTreePatternFilter( const QString & pattern ):
-    _pattern( pattern )
+    _pattern( pattern ),
+    _matchMode( MatchRegExp )
 {
-    QString pat = _pattern.contains( "/" ) ?
+    bool    fullPath = _pattern.contains( "/" );
+    QString head     = _pattern.left( _pattern.size() - 1 );
+
+    if ( ! hasWildcards( _pattern ) )
+    {
+	_matchMode = fullPath ? MatchPath : MatchName;
+	_text	   = _pattern;
+    }
+    else if ( _pattern.endsWith( '*' ) && ! hasWildcards( head ) )
+    {
+	// A pattern "foo*" without a slash is matched as "*/foo*"
+
+	_matchMode = fullPath ? MatchPathPrefix : MatchPathContains;
+	_text	   = fullPath ? head : QString( "/" ) + head;
+    }
+
+    if ( _matchMode != MatchRegExp )
+    {
+	logDebug() << "Creating pattern filter without regexp for " << _pattern << endl;
+	return;
+    }
+
+    QString pat = fullPath ?
 	_pattern :
 	QString( "*/" ) + _pattern;
 
@@ -61,7 +97,30 @@ DirTreePatternFilter::~DirTreePatternFilter()
 
 bool DirTreePatternFilter::ignore( const QString & path ) const
 {
-    bool match = _regExp.exactMatch( path );
+    bool match = false;
+
+    switch ( _matchMode )
+    {
+	case MatchName:
+	    match = ignoreName( path.mid( path.lastIndexOf( '/' ) + 1 ) );
+	    break;
+
+	case MatchPath:
+	    match = path == _text;
+	    break;
+
+	case MatchPathPrefix:
+	    match = path.startsWith( _text );
+	    break;
+
+	case MatchPathContains:
+	    match = path.contains( _text );
+	    break;
+
+	case MatchRegExp:
+	    match = _regExp.exactMatch( path );
+	    break;
+    }
 
 #if VERBOSE_MATCH
     if ( match )
@@ -74,6 +133,12 @@ bool DirTreePatternFilter::ignore( const QString & path ) const
 }
 
 
+bool DirTreePatternFilter::ignoreName( const QString & name ) const
+{
+    return _matchMode == MatchName && name == _text;
+}
+
+
 
 
 
@@ -19,7 +19,8 @@ namespace QDirStat
 {
     /**
      * Dir tree filter that checks a wildcard match against a path.
-     * This uses QRegExp in wildcard mode.
+     * This uses QRegExp in wildcard mode, but simple patterns are checked
+     * with plain string comparisons instead.
      **/
     class DirTreePatternFilter: public DirTreeFilter
     {
@@ -55,6 +56,23 @@ namespace QDirStat
 	 **/
 	virtual bool ignore( const QString & path ) const Q_DECL_OVERRIDE;
 
+	/**
+	 * Return 'true' if this filter only checks the filename, i.e. if the
+	 * pattern is a plain filename without any wildcards.
+	 *
+	 * Reimplemented from DirTreeFilter.
+	 **/
+	virtual bool checksNameOnly() const Q_DECL_OVERRIDE
+	    { return _matchMode == MatchName; }
+
+	/**
+	 * Return 'true' if the filesystem object with 'name' should be
+	 * ignored, 'false' if not.
+	 *
+	 * Reimplemented from DirTreeFilter.
+	 **/
+	virtual bool ignoreName( const QString & name ) const Q_DECL_OVERRIDE;
+
 	/**
 	 * Return the pattern.
 	 **/
@@ -63,8 +81,24 @@ namespace QDirStat
 
     protected:
 
-	QString _pattern;
-        QRegExp _regExp;
+	/**
+	 * How the pattern is matched: The wildcard "*" also matches "/",
+	 * so a pattern "foo*" without a slash would match any path that
+	 * contains "/foo".
+	 **/
+	enum MatchMode
+	{
+	    MatchName,		// Filename == _text
+	    MatchPath,		// Path	    == _text
+	    MatchPathPrefix,	// Path starts with _text
+	    MatchPathContains,	// Path contains _text
+	    MatchRegExp		// Anything else
+	};
+
+	QString	  _pattern;
+	QString	  _text;
+        QRegExp	  _regExp;
+	MatchMode _matchMode;
 
     };	// class DirTreePatternFilter
 
@@ -81,7 +115,8 @@ namespace QDirStat
     public:
 
 	/**
-	 * Constructor. 'suffix' should start with a dot (".").
+	 * Constructor. 'suffix' usually starts with a dot ("."); it may not
+	 * contain a slash ("/").
 	 **/
 	DirTreeSuffixFilter( const QString & suffix );
 
@@ -98,6 +133,23 @@ namespace QDirStat
 	 **/
 	virtual bool ignore( const QString & path ) const Q_DECL_OVERRIDE;
 
+	/**
+	 * Return 'true' since the suffix of a path is the suffix of the
+	 * filename.
+	 *
+	 * Reimplemented from DirTreeFilter.
+	 **/
+	virtual bool checksNameOnly() const Q_DECL_OVERRIDE { return true; }
+
+	/**
+	 * Return 'true' if the filesystem object with 'name' should be
+	 * ignored, 'false' if not.
+	 *
+	 * Reimplemented from DirTreeFilter.
+	 **/
+	virtual bool ignoreName( const QString & name ) const Q_DECL_OVERRIDE
+	    { return ignore( name ); }
+
 	/**
 	 * Return the suffix.
 	 **/
@@ -8,7 +8,7 @@
 
 
 #include "DirTreePkgFilter.h"
-#include "PkgManager.h"
+#include "PkgQuery.h"
 #include "PkgFileListCache.h"
 #include "Exception.h"
 #include "Logger.h"
@@ -17,12 +17,12 @@
 using namespace QDirStat;
 
 
-DirTreePkgFilter::DirTreePkgFilter( PkgManager * pkgManager )
+DirTreePkgFilter::DirTreePkgFilter():
+    _fileListCache( 0 ),
+    _lastDirNode( 0 )
 {
-    CHECK_PTR( pkgManager );
-
-    logInfo() << "Creating file list cache for " << pkgManager->name() << endl;
-    _fileListCache = pkgManager->createFileListCache( PkgFileListCache::LookupGlobal );
+    logInfo() << "Creating file list cache for all package managers" << endl;
+    _fileListCache = PkgQuery::fileListCache( PkgFileListCache::LookupGlobal );
     logInfo() << "Done." << endl;
 }
 
@@ -34,9 +34,39 @@ DirTreePkgFilter::~DirTreePkgFilter()
 
 
 bool DirTreePkgFilter::ignore( const QString & path ) const
+{
+    int pos = path.lastIndexOf( '/' );
+
+    if ( pos < 0 )
+	return false;
+
+    return ignoreEntry( pos > 0 ? path.left( pos ) : QString( "/" ),
+			path.mid( pos + 1 ) );
+}
+
+
+bool DirTreePkgFilter::ignoreEntry( const QString & dirPath,
+				    const QString & name ) const
 {
     if ( ! _fileListCache )
 	return false;
 
-    return _fileListCache->containsFile( path );
+    if ( dirPath != _lastDirPath || _lastDirPath.isNull() )
+    {
+	_lastDirPath = dirPath;
+	_lastDirNode = _fileListCache->findNode( dirPath );
+    }
+
+    if ( ! _lastDirNode ) // No package has anything in this directory
+	return false;
+
+    const PkgFileTrieNode * node = _lastDirNode->child( name );
+
+    return node && node->isPkgFile;
+}
+
+
+qint64 DirTreePkgFilter::memoryUsage() const
+{
+    return _fileListCache ? _fileListCache->memoryUsage() : 0;
 }
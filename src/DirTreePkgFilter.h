@@ -15,21 +15,22 @@
 
 namespace QDirStat
 {
-    class PkgManager;
     class PkgFileListCache;
+    struct PkgFileTrieNode;
 
     /**
      * Concrete DirTreeFilter class to ignore files that belong to any
-     * installed package during directory reading.
+     * installed package of any package manager during directory reading.
      **/
     class DirTreePkgFilter: public DirTreeFilter
     {
     public:
 
 	/**
-	 * Constructor.
+	 * Constructor. This creates one file list cache for the files of all
+	 * package managers.
 	 **/
-	DirTreePkgFilter( PkgManager * pkgManager );
+	DirTreePkgFilter();
 
 	/**
 	 * Destructor.
@@ -44,10 +45,33 @@ namespace QDirStat
 	 **/
 	virtual bool ignore( const QString & path ) const Q_DECL_OVERRIDE;
 
+	/**
+	 * Return 'true' if 'name' in directory 'dirPath' should be ignored,
+	 * 'false' if not. This looks up 'dirPath' in the file list cache
+	 * only when it is different from the last call, so for all other
+	 * entries of the same directory this is just one short hash lookup.
+	 *
+	 * Reimplemented from DirTreeFilter.
+	 **/
+	virtual bool ignoreEntry( const QString & dirPath,
+				  const QString & name ) const Q_DECL_OVERRIDE;
+
+	/**
+	 * Return the memory of the file list cache.
+	 *
+	 * Reimplemented from DirTreeFilter.
+	 **/
+	virtual qint64 memoryUsage() const Q_DECL_OVERRIDE;
+
 
     protected:
 
-	PkgFileListCache * _fileListCache;
+	PkgFileListCache *		_fileListCache;
+
+	// Cache for the last directory that was looked up
+
+	mutable QString			_lastDirPath;
+	mutable const PkgFileTrieNode * _lastDirNode;
 
     };	// class DirTreeFilter
 
@@ -9,6 +9,7 @@
 
 #include <QMenu>
 #include <QKeyEvent>
+#include <QElapsedTimer>
 
 #include "DirTreeView.h"
 #include "DirTreeModel.h"
@@ -19,6 +20,7 @@
 #include "SizeColDelegate.h"
 #include "HeaderTweaker.h"
 #include "DirTree.h"
+#include "DirInfo.h"
 #include "FormatUtil.h"
 #include "Exception.h"
 #include "Logger.h"
@@ -50,6 +52,9 @@ DirTreeView::DirTreeView( QWidget * parent ):
 
     connect( this , SIGNAL( customContextMenuRequested( const QPoint & ) ),
 	     this,  SLOT  ( contextMenu		      ( const QPoint & ) ) );
+
+    connect( this , SIGNAL( collapsed	     ( const QModelIndex & ) ),
+	     this,  SLOT  ( collapsedNotify ( const QModelIndex & ) ) );
 }
 
 
@@ -68,6 +73,15 @@ void DirTreeView::currentChanged( const QModelIndex & current,
 }
 
 
+void DirTreeView::collapsedNotify( const QModelIndex & index )
+{
+    DirTreeModel * dirTreeModel = qobject_cast<DirTreeModel *>( model() );
+
+    if ( dirTreeModel )
+	dirTreeModel->collapsedNotify( index );
+}
+
+
 void DirTreeView::contextMenu( const QPoint & pos )
 {
     QModelIndex index = indexAt( pos );
@@ -204,6 +218,7 @@ QModelIndexList DirTreeView::expandedIndexes() const
 void DirTreeView::closeAllExcept( const QModelIndex & branch )
 {
     QModelIndexList branchesToClose = expandedIndexes();
+    QModelIndexList branchesToKeep;
 
     // Remove all ancestors of 'branch' from branchesToClose
 
@@ -212,22 +227,110 @@ void DirTreeView::closeAllExcept( const QModelIndex & branch )
     while ( index.isValid() )
     {
 	// logDebug() << "Not closing " << index << endl;
-	branchesToClose.removeAll( index );
+
+	if ( branchesToClose.removeAll( index ) > 0 )
+	    branchesToKeep.prepend( index );
+
 	index = index.parent();
     }
 
-    // Close all items in branchesToClose
-
-    foreach ( index, branchesToClose )
+    if ( ! branchesToClose.isEmpty() )
     {
-	// logDebug() << "Closing " << index << endl;
-	collapse( index );
+	// Collapsing the branches one by one makes the view update its
+	// internal list of visible items for each one; collapsing
+	// everything and expanding the few ancestors of 'branch' again
+	// (top-down) is just one rebuild.
+
+	setUpdatesEnabled( false );
+	collapseAll();
+
+	foreach ( index, branchesToKeep )
+	    expand( index );
+
+	setUpdatesEnabled( true );
+
+	// collapseAll() does not emit collapsed() for each branch, so the
+	// model needs to be told explicitly.
+
+	foreach ( index, branchesToClose )
+	    collapsedNotify( index );
     }
 
     scrollTo( currentIndex(), QAbstractItemView::PositionAtCenter );
 }
 
 
+void DirTreeView::expandToLevel( int level )
+{
+    if ( level < 1 )
+    {
+	QModelIndexList branchesToClose = expandedIndexes();
+	collapseAll();
+
+	foreach ( const QModelIndex & index, branchesToClose )
+	    collapsedNotify( index );
+
+	return;
+    }
+
+    DirTreeModel * dirTreeModel = dynamic_cast<DirTreeModel *>( model() );
+
+    if ( ! dirTreeModel )
+    {
+	logError() << "Wrong model type" << endl;
+	return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Collect all directories whose children will become visible: The
+    // root and everything down to 'level' - 1 levels below the toplevel.
+
+    DirInfo * root = dirTreeModel->tree() ? dirTreeModel->tree()->root() : 0;
+
+    if ( root )
+    {
+	QList<DirInfo *> dirs;
+	QList<DirInfo *> levelDirs;
+
+	dirs << root;
+	levelDirs << root;
+
+	for ( int depth = 0; depth < level && ! levelDirs.isEmpty(); ++depth )
+	{
+	    QList<DirInfo *> nextDirs;
+
+	    foreach ( DirInfo * parent, levelDirs )
+	    {
+		for ( FileInfo * child = parent->firstChild(); child; child = child->next() )
+		{
+		    if ( child->isDirInfo() )
+			nextDirs << child->toDirInfo();
+		}
+
+		if ( parent->dotEntry() )
+		    nextDirs << parent->dotEntry();
+
+		if ( parent->attic() )
+		    nextDirs << parent->attic();
+	    }
+
+	    dirs << nextDirs;
+	    levelDirs = nextDirs;
+	}
+
+	DirInfo::presortChildren( dirs, dirTreeModel->sortColumn(), dirTreeModel->sortOrder() );
+    }
+
+    setUpdatesEnabled( false );
+    expandToDepth( level - 1 );
+    setUpdatesEnabled( true );
+
+    logDebug() << "Expanded to level " << level << " in " << timer.elapsed() << " millisec" << endl;
+}
+
+
 void DirTreeView::setExpanded( FileInfo * item, bool expanded )
 {
     DirTreeModel * dirTreeModel = dynamic_cast<DirTreeModel *>( model() );
@@ -238,6 +341,7 @@ void DirTreeView::setExpanded( FileInfo * item, bool expanded )
         return;
     }
 
+    dirTreeModel->fetchItem( item );
     QModelIndex index = dirTreeModel->modelIndex( item );
 
     if ( index.isValid() )
@@ -296,3 +400,17 @@ void DirTreeView::keyPressEvent( QKeyEvent * event )
         }
     }
 }
+
+
+void DirTreeView::paintEvent( QPaintEvent * event )
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QTreeView::paintEvent( event );
+
+    DirTreeModel * dirTreeModel = qobject_cast<DirTreeModel *>( model() );
+
+    if ( dirTreeModel )
+	dirTreeModel->addUpdateCost( timer.nsecsElapsed() );
+}
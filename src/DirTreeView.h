@@ -89,11 +89,26 @@ namespace QDirStat
          **/
         void setExpanded( FileInfo * item, bool expanded = true );
 
+	/**
+	 * Expand the tree to 'level' levels below the toplevel; 0 collapses
+	 * everything.
+	 *
+	 * Unlike expandToDepth(), this first sorts the children of all
+	 * directories that will become visible in parallel (see
+	 * DirInfo::presortChildren()) and then expands them in one batch
+	 * with screen updates disabled.
+	 **/
+	void expandToLevel( int level );
+
 
     public slots:
 
 	/**
 	 * Close (collapse) all branches except the one that 'branch' is in.
+	 *
+	 * This collapses the complete tree in one operation and then
+	 * expands the ancestors of 'branch' again, which is much faster than
+	 * collapsing many branches one by one.
 	 **/
 	void closeAllExcept( const QModelIndex & branch );
 
@@ -105,6 +120,11 @@ namespace QDirStat
 	 **/
 	void contextMenu( const QPoint & pos );
 
+	/**
+	 * Tell the model that the item at 'index' was collapsed.
+	 **/
+	void collapsedNotify( const QModelIndex & index );
+
 
     protected:
 
@@ -148,6 +168,16 @@ namespace QDirStat
          **/
         virtual void mousePressEvent( QMouseEvent * event ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Paint event handler.
+	 *
+	 * This reports the time needed for painting to the DirTreeModel so it
+	 * can send fewer updates while reading if repainting is expensive.
+	 *
+	 * Reimplemented from QTreeView.
+	 **/
+	virtual void paintEvent( QPaintEvent * event ) Q_DECL_OVERRIDE;
+
 
 	// Data members
 
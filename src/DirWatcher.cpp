@@ -0,0 +1,408 @@
+/*
+ *   File name: DirWatcher.cpp
+ *   Summary:	Live updates of the directory tree with inotify
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <errno.h>
+#include <string.h>	// strerror()
+#include <unistd.h>	// read(), close()
+
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#  include <sys/inotify.h>
+#endif
+
+#include "DirWatcher.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Time to collect events before reading anything again
+
+#define DIR_WATCHER_DELAY_MILLISEC	1500
+
+#ifdef Q_OS_LINUX
+#  define DIR_WATCHER_MASK	( IN_CREATE	 | IN_DELETE	 | \
+				  IN_MOVED_FROM	 | IN_MOVED_TO	 | \
+				  IN_MODIFY	 | IN_CLOSE_WRITE | \
+				  IN_ATTRIB	 | IN_MOVE_SELF	 | \
+				  IN_ONLYDIR	 | IN_DONT_FOLLOW | \
+				  IN_EXCL_UNLINK )
+#endif
+
+using namespace QDirStat;
+
+
+DirWatcher::DirWatcher( DirTree * tree, QObject * parent ):
+    QObject( parent ),
+    _tree( tree ),
+    _fd( -1 ),
+    _notifier( 0 ),
+    _enabled( false ),
+    _overflow( false ),
+    _warnedAboutLimit( false )
+{
+    _timer.setSingleShot( true );
+    _timer.setInterval( DIR_WATCHER_DELAY_MILLISEC );
+
+    connect( &_timer, SIGNAL( timeout()	       ),
+	     this,    SLOT  ( processChanges() ) );
+
+    connect( _tree,   SIGNAL( finished()       ),
+	     this,    SLOT  ( addWatches()     ) );
+
+    connect( _tree,   SIGNAL( clearing()       ),
+	     this,    SLOT  ( removeAllWatches() ) );
+}
+
+
+DirWatcher::~DirWatcher()
+{
+    close();
+}
+
+
+bool DirWatcher::isAvailable()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void DirWatcher::setEnabled( bool enabled )
+{
+    if ( enabled == _enabled )
+	return;
+
+    if ( enabled )
+    {
+	if ( ! open() )
+	    return;
+
+	_enabled = true;
+	logInfo() << "Watching for changes" << endl;
+
+	if ( ! _tree->isBusy() )
+	    addWatches();
+    }
+    else
+    {
+	_enabled = false;
+	_timer.stop();
+	_changedDirs.clear();
+	close();
+    }
+}
+
+
+bool DirWatcher::open()
+{
+#ifdef Q_OS_LINUX
+    if ( _fd >= 0 )
+	return true;
+
+    _fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+    if ( _fd < 0 )
+    {
+	logError() << "inotify_init1() failed: " << strerror( errno ) << endl;
+	return false;
+    }
+
+    _notifier = new QSocketNotifier( _fd, QSocketNotifier::Read, this );
+    CHECK_NEW( _notifier );
+
+    connect( _notifier, SIGNAL( activated ( int ) ),
+	     this,	SLOT  ( readEvents()	 ) );
+
+    return true;
+#else
+    logWarning() << "Watching for changes is not supported on this platform" << endl;
+    return false;
+#endif
+}
+
+
+void DirWatcher::close()
+{
+    if ( _notifier )
+    {
+	delete _notifier;
+	_notifier = 0;
+    }
+
+    if ( _fd >= 0 )
+    {
+	::close( _fd );	 // This removes all watches
+	_fd = -1;
+    }
+
+    _wdToUrl.clear();
+    _urlToWd.clear();
+}
+
+
+void DirWatcher::removeAllWatches()
+{
+    if ( ! _enabled )
+	return;
+
+    // Closing and opening the inotify fd again is a lot cheaper than
+    // removing thousands of watches one by one.
+
+    close();
+    _changedDirs.clear();
+    _overflow = false;
+
+    if ( ! open() )
+	_enabled = false;
+}
+
+
+void DirWatcher::addWatches()
+{
+    if ( ! _enabled )
+	return;
+
+    // There may be several toplevel items (see DirTree::startReading())
+
+    for ( FileInfo * toplevel = _tree->root() ? _tree->root()->firstChild() : 0;
+	  toplevel;
+	  toplevel = toplevel->next() )
+    {
+	if ( toplevel->isDirInfo() && ! toplevel->isPkgInfo() )
+	    addWatches( toplevel->toDirInfo() );
+    }
+
+    logDebug() << "Watching " << watchCount() << " directories" << endl;
+
+    // Changes that could not be processed while the tree was busy
+
+    if ( ( _overflow || ! _changedDirs.isEmpty() ) && ! _timer.isActive() )
+	_timer.start();
+}
+
+
+void DirWatcher::addWatches( DirInfo * dir )
+{
+#ifdef Q_OS_LINUX
+    if ( dir->isPseudoDir() )
+	return;
+
+    if ( dir->readState() != DirFinished &&
+	 dir->readState() != DirCached )
+    {
+	// Excluded, not read (mount points), or read error
+	return;
+    }
+
+    QString url = dir->url();
+
+    if ( ! _urlToWd.contains( url ) )
+    {
+	int wd = inotify_add_watch( _fd, url.toUtf8(), DIR_WATCHER_MASK );
+
+	if ( wd < 0 )
+	{
+	    if ( errno == ENOSPC )
+	    {
+		if ( ! _warnedAboutLimit )
+		{
+		    logWarning() << "inotify watch limit reached after "
+				 << watchCount() << " directories; "
+				 << "see /proc/sys/fs/inotify/max_user_watches"
+				 << endl;
+		    _warnedAboutLimit = true;
+		}
+	    }
+
+	    // Don't watch this one, but try the subdirectories anyway:
+	    // Maybe only this one is not accessible.
+	}
+	else
+	{
+	    _wdToUrl.insert( wd, url );
+	    _urlToWd.insert( url, wd );
+	}
+    }
+
+    FileInfo * child = dir->firstChild();
+
+    while ( child )
+    {
+	if ( child->isDirInfo() )
+	    addWatches( child->toDirInfo() );
+
+	child = child->next();
+    }
+#else
+    Q_UNUSED( dir );
+#endif
+}
+
+
+void DirWatcher::forgetWatch( int wd )
+{
+    QString url = _wdToUrl.take( wd );
+
+    if ( ! url.isEmpty() && _urlToWd.value( url, -1 ) == wd )
+	_urlToWd.remove( url );
+}
+
+
+void DirWatcher::readEvents()
+{
+#ifdef Q_OS_LINUX
+    char buf[ 64 * 1024 ] __attribute__(( aligned( __alignof__( struct inotify_event ) ) ));
+
+    while ( true )
+    {
+	ssize_t len = read( _fd, buf, sizeof( buf ) );
+
+	if ( len <= 0 )		// EAGAIN: Nothing more to read
+	    break;
+
+	const char * ptr = buf;
+
+	while ( ptr < buf + len )
+	{
+	    const struct inotify_event * event = (const struct inotify_event *) ptr;
+	    ptr += sizeof( struct inotify_event ) + event->len;
+
+	    if ( event->mask & IN_Q_OVERFLOW )
+	    {
+		_overflow = true;
+		continue;
+	    }
+
+	    QString url = _wdToUrl.value( event->wd );
+
+	    if ( url.isEmpty() )
+		continue;
+
+	    if ( event->mask & IN_IGNORED )
+	    {
+		// The directory is gone; its parent gets an IN_DELETE
+		// or IN_MOVED_FROM event for it.
+
+		forgetWatch( event->wd );
+	    }
+	    else if ( event->mask & IN_MOVE_SELF )
+	    {
+		// The watch would still work, but with the wrong URL. Remove
+		// it; when the parent is read again, the directory gets a new
+		// one with the new URL.
+
+		inotify_rm_watch( _fd, event->wd );
+		forgetWatch( event->wd );
+	    }
+	    else if ( ! ( event->mask & IN_DELETE_SELF ) )
+	    {
+		_changedDirs.insert( url );
+	    }
+	}
+    }
+
+    if ( ( _overflow || ! _changedDirs.isEmpty() ) && ! _timer.isActive() )
+    {
+	// Not restarting the timer when it is already running: Otherwise a
+	// file that is written all the time would prevent any update.
+
+	_timer.start();
+    }
+#endif
+}
+
+
+void DirWatcher::processChanges()
+{
+    if ( ! _enabled )
+	return;
+
+    if ( _tree->isBusy() )
+    {
+	// Wait for the tree to finish (see addWatches())
+	return;
+    }
+
+    QList<DirInfo *> toplevels;
+
+    for ( FileInfo * toplevel = _tree->root() ? _tree->root()->firstChild() : 0;
+	  toplevel;
+	  toplevel = toplevel->next() )
+    {
+	if ( toplevel->isDirInfo() && ! toplevel->isPkgInfo() )
+	    toplevels << toplevel->toDirInfo();
+    }
+
+    if ( toplevels.isEmpty() )
+    {
+	_changedDirs.clear();
+	_overflow = false;
+	return;
+    }
+
+    if ( _overflow )
+    {
+	// Events were lost, so we have no idea what changed.
+
+	logWarning() << "inotify event queue overflow - refreshing everything" << endl;
+	_changedDirs.clear();
+	_overflow = false;
+
+	foreach ( DirInfo * toplevel, toplevels )
+	{
+	    emit refreshingAll( toplevel );
+	    emit refreshing( toplevel );
+	}
+
+	_tree->smartRefresh();	// All toplevel items
+	return;
+    }
+
+    QSet<DirInfo *> changedDirs;
+
+    foreach ( const QString & url, _changedDirs )
+    {
+	FileInfo * item = _tree->locate( url );
+
+	if ( item && item->isDirInfo() )
+	    changedDirs.insert( item->toDirInfo() );
+    }
+
+    _changedDirs.clear();
+    QList<DirInfo *> refreshList;
+
+    foreach ( DirInfo * dir, changedDirs )
+    {
+	// Read parents before their subdirectories: A subdirectory that is
+	// busy when its parent is read again would be read from scratch.
+
+	bool parentChanged = false;
+
+	for ( DirInfo * parent = dir->parent(); parent && ! parentChanged; parent = parent->parent() )
+	    parentChanged = changedDirs.contains( parent );
+
+	if ( parentChanged )
+	    _changedDirs.insert( dir->url() );	// Next time
+	else
+	    refreshList << dir;
+    }
+
+    foreach ( DirInfo * dir, refreshList )
+    {
+	emit refreshing( dir );
+	_tree->refreshDir( dir );
+    }
+}
+
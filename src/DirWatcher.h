@@ -0,0 +1,170 @@
+/*
+ *   File name: DirWatcher.h
+ *   Summary:	Live updates of the directory tree with inotify
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DirWatcher_h
+#define DirWatcher_h
+
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+
+class QSocketNotifier;
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+
+
+    /**
+     * Watcher for changes in the filesystem below the directories of a
+     * DirTree: When anything is created, deleted, renamed or modified in a
+     * directory that was read, only that one directory is read again (see
+     * DirTree::refreshDir()), so the tree and all its views keep up with
+     * what happens on disk without a complete rescan.
+     *
+     * This uses one inotify watch for each directory in the tree. Events
+     * are collected for a short while before anything is read again, so a
+     * flood of events (e.g. a running compiler) does not cause a flood of
+     * read jobs.
+     *
+     * This is only available on Linux.
+     *
+     * This does not know about any model or view; they can keep their
+     * state (e.g. the selection) valid when they get the refreshing()
+     * signals.
+     **/
+    class DirWatcher: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This watches 'tree'.
+	 **/
+	DirWatcher( DirTree * tree, QObject * parent = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~DirWatcher();
+
+	/**
+	 * Return 'true' if watching for changes is supported on this
+	 * platform.
+	 **/
+	static bool isAvailable();
+
+	/**
+	 * Return 'true' if watching is enabled.
+	 **/
+	bool enabled() const { return _enabled; }
+
+	/**
+	 * Enable or disable watching. When enabled, all directories that
+	 * are completely read are watched from now on.
+	 **/
+	void setEnabled( bool enabled );
+
+	/**
+	 * Return the number of watched directories.
+	 **/
+	int watchCount() const { return _wdToUrl.size(); }
+
+
+    signals:
+
+	/**
+	 * Emitted just before 'dir' is read again because something changed
+	 * in it. Only its direct children are read again; subdirectories
+	 * that are completely read are kept.
+	 **/
+	void refreshing( DirInfo * dir );
+
+	/**
+	 * Emitted just before the complete tree below 'toplevel' is read
+	 * again because events were lost. This is followed by refreshing()
+	 * for 'toplevel'.
+	 **/
+	void refreshingAll( DirInfo * toplevel );
+
+
+    protected slots:
+
+	/**
+	 * Add watches for all directories in the tree that are not watched
+	 * yet. This is called when the tree is finished reading.
+	 **/
+	void addWatches();
+
+	/**
+	 * Remove all watches. This is called when the tree is cleared.
+	 **/
+	void removeAllWatches();
+
+	/**
+	 * Read all pending inotify events.
+	 **/
+	void readEvents();
+
+	/**
+	 * Read the directories again that changed.
+	 **/
+	void processChanges();
+
+
+    protected:
+
+	/**
+	 * Open the inotify file descriptor. Return 'true' if OK.
+	 **/
+	bool open();
+
+	/**
+	 * Close the inotify file descriptor. This removes all watches.
+	 **/
+	void close();
+
+	/**
+	 * Add watches for 'dir' and all directories below it that are not
+	 * watched yet.
+	 **/
+	void addWatches( DirInfo * dir );
+
+	/**
+	 * Forget watch descriptor 'wd'.
+	 **/
+	void forgetWatch( int wd );
+
+
+	// Data members
+
+	DirTree *		_tree;
+	int			_fd;
+	QSocketNotifier *	_notifier;
+	QHash<int, QString>	_wdToUrl;
+	QHash<QString, int>	_urlToWd;
+	QSet<QString>		_changedDirs;
+	QTimer			_timer;
+	bool			_enabled;
+	bool			_overflow;
+	bool			_warnedAboutLimit;
+
+    };	// class DirWatcher
+
+}	// namespace QDirStat
+
+
+#endif // ifndef DirWatcher_h
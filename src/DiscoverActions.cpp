@@ -7,11 +7,17 @@
  */
 
 
+#include <QInputDialog>
+#include <QMessageBox>
+
 #include "DiscoverActions.h"
 #include "TreeWalker.h"
 #include "LocateFilesWindow.h"
 #include "FileSearchFilter.h"
+#include "TreeQuery.h"
 #include "DirInfo.h"
+#include "DirTree.h"
+#include "CacheVerifier.h"
 #include "BusyPopup.h"
 #include "QDirStatApp.h"
 #include "Logger.h"
@@ -67,6 +73,15 @@ void DiscoverActions::discoverHardLinkedFiles()
 }
 
 
+void DiscoverActions::discoverDuplicateFiles()
+{
+    BusyPopup msg( tr( "Checking for duplicate files..." ), app()->findMainWindow() );
+    discoverFiles( new QDirStat::DuplicateFilesTreeWalker(),
+                   tr( "Duplicate Files in %1" ) );
+    _locateFilesWindow->sortByColumn( LocateListSizeCol, Qt::DescendingOrder );
+}
+
+
 void DiscoverActions::discoverBrokenSymLinks()
 {
     BusyPopup msg( tr( "Checking symlinks..." ), app()->findMainWindow() );
@@ -84,6 +99,82 @@ void DiscoverActions::discoverSparseFiles()
 }
 
 
+void DiscoverActions::discoverCacheMismatches()
+{
+    FileInfo * sel = app()->selectedDirInfoOrRoot();
+
+    if ( ! sel || ! sel->tree() )
+        return;
+
+    CacheVerifier * verifier = sel->tree()->cacheVerifier();
+    _verifyPath = sel->url();
+
+    connect( verifier, SIGNAL( finished()            ),
+             this,     SLOT  ( showCacheMismatches() ),
+             Qt::UniqueConnection );
+
+    verifier->start( sel );
+}
+
+
+void DiscoverActions::showCacheMismatches()
+{
+    CacheVerifier * verifier = app()->dirTree()->cacheVerifier();
+
+    if ( _verifyPath.isEmpty() )    // Not started from here
+        return;
+
+    if ( ! verifier->hasMismatches() )
+    {
+        QMessageBox::information( app()->findMainWindow(), tr( "Verify Cache" ),
+                                  tr( "All %1 checked items in %2 match the disk." )
+                                  .arg( verifier->checkedCount() ).arg( _verifyPath ) );
+    }
+    else
+    {
+        discoverFiles( new QDirStat::CacheMismatchTreeWalker(),
+                       tr( "Cache Mismatches in %1" ),
+                       _verifyPath );
+        _locateFilesWindow->sortByColumn( LocateListPathCol, Qt::AscendingOrder );
+    }
+
+    _verifyPath.clear();
+}
+
+
+void DiscoverActions::discoverQuery()
+{
+    QWidget * parent = app()->findMainWindow();
+    TreeQuery query;
+    bool ok = false;
+
+    do
+    {
+        _lastQuery = QInputDialog::getText( parent,
+                                            tr( "Query" ),
+                                            tr( "Find files with e.g.\n"
+                                                "size > 1G and mtime < 2022 and owner = root and category = Compressed" ),
+                                            QLineEdit::Normal,
+                                            _lastQuery,
+                                            &ok );
+        if ( ! ok )
+            return;
+
+        if ( ! query.parse( _lastQuery ) )
+        {
+            QMessageBox::warning( parent, tr( "Error" ),
+                                  tr( "Invalid query: %1" ).arg( query.errorString() ) );
+        }
+    }
+    while ( query.isEmpty() );
+
+    QString headingText = tr( "Query Results for \"%1\" in %2" ).arg( _lastQuery ).arg( "%1" );
+
+    discoverFiles( new QDirStat::QueryTreeWalker( query ), headingText );
+    _locateFilesWindow->sortByColumn( LocateListSizeCol, Qt::DescendingOrder );
+}
+
+
 void DiscoverActions::discoverFilesFromYear( const QString & path, short year )
 {
     QString headingText = tr( "Files from %1 in %2" ).arg( year ).arg( "%1");
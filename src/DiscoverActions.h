@@ -58,9 +58,21 @@ namespace QDirStat
         void discoverNewestFiles();
         void discoverOldestFiles();
         void discoverHardLinkedFiles();
+        void discoverDuplicateFiles();
         void discoverBrokenSymLinks();
         void discoverSparseFiles();
 
+        /**
+         * Check the selected subtree against the disk in the background
+         * and show the items that don't match when that is done.
+         **/
+        void discoverCacheMismatches();
+
+        /**
+         * Ask the user for a TreeQuery and show the items that match it.
+         **/
+        void discoverQuery();
+
 
         //
         // Actions that are meant to be connected to the FileAgeWindow's
@@ -77,6 +89,14 @@ namespace QDirStat
 
         void findFiles( const FileSearchFilter & filter );
 
+    protected slots:
+
+        /**
+         * Show the items that don't match the disk after
+         * discoverCacheMismatches().
+         **/
+        void showCacheMismatches();
+
     public:
 
         /**
@@ -102,6 +122,8 @@ namespace QDirStat
     protected:
 
         QPointer<LocateFilesWindow> _locateFilesWindow;
+        QString                     _lastQuery;
+        QString                     _verifyPath;
 
     };  // class DiscoverActions
 
@@ -0,0 +1,182 @@
+/*
+ *   File name: DiscoverCache.cpp
+ *   Summary:	Cache for the results of the "discover" actions
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "DiscoverCache.h"
+#include "DuplicateFinder.h"
+#include "StatsEngine.h"
+#include "QDirStatApp.h"
+#include "DirTree.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Result key for the duplicate files; the top files use the sort key and
+// the sort order (see topFilesKey()).
+#define DUPLICATES_KEY	-1
+
+
+using namespace QDirStat;
+
+
+QPointer<DiscoverCache> DiscoverCache::_instance = 0;
+
+
+DiscoverCache * DiscoverCache::instance()
+{
+    if ( ! _instance )
+    {
+	_instance = new DiscoverCache( app()->dirTree() );
+	CHECK_NEW( _instance );
+    }
+
+    return _instance;
+}
+
+
+DiscoverCache::DiscoverCache( DirTree * tree ):
+    QObject( tree ),
+    _tree( tree ),
+    _topFilesCount( 0 )
+{
+    CHECK_PTR( tree );
+
+    connect( tree, SIGNAL( startingReading() ),
+	     this, SLOT	 ( invalidate()	     ) );
+
+    connect( tree, SIGNAL( finished()	),
+	     this, SLOT	 ( invalidate() ) );
+
+    connect( tree, SIGNAL( aborted()	),
+	     this, SLOT	 ( invalidate() ) );
+
+    connect( tree, SIGNAL( clearing()	),
+	     this, SLOT	 ( invalidate() ) );
+
+    connect( tree, SIGNAL( clearingSubtree( DirInfo * ) ),
+	     this, SLOT	 ( invalidate()		       ) );
+
+    connect( tree, SIGNAL( deletingChild( FileInfo * ) ),
+	     this, SLOT	 ( invalidate()		      ) );
+
+    connect( tree, SIGNAL( childDeleted() ),
+	     this, SLOT	 ( invalidate()	  ) );
+
+    connect( tree, SIGNAL( childrenAdded( DirInfo * ) ),
+	     this, SLOT	 ( invalidate()		     ) );
+
+    connect( tree, SIGNAL( filesPagedIn( DirInfo * ) ),
+	     this, SLOT	 ( invalidate()		    ) );
+}
+
+
+void DiscoverCache::invalidate()
+{
+    _results.clear();
+}
+
+
+bool DiscoverCache::canCache()
+{
+    return ! _tree->isBusy();
+}
+
+
+DiscoverCache::ResultKey DiscoverCache::topFilesKey( const FileInfo *	       subtree,
+						     TopFilesCollector::SortKey sortKey,
+						     Qt::SortOrder	       order )
+{
+    return ResultKey( subtree, 2 * (int) sortKey + ( order == Qt::DescendingOrder ? 1 : 0 ) );
+}
+
+
+FileInfoList DiscoverCache::topFiles( FileInfo *		 subtree,
+				      TopFilesCollector::SortKey sortKey,
+				      Qt::SortOrder		 order,
+				      int			 maxCount )
+{
+    if ( ! subtree )
+	return FileInfoList();
+
+    if ( maxCount != _topFilesCount )
+    {
+	// All cached top files are for a different number of files
+
+	invalidate();
+	_topFilesCount = maxCount;
+    }
+
+    ResultKey key = topFilesKey( subtree, sortKey, order );
+
+    if ( _results.contains( key ) )
+	return _results.value( key );
+
+    bool collectedTogether = sortKey == TopFilesCollector::ByMTime ||
+	( sortKey == TopFilesCollector::BySize && order == Qt::DescendingOrder );
+
+    if ( collectedTogether && canCache() )
+    {
+	collectTopFiles( subtree, maxCount );
+
+	return _results.value( key );
+    }
+
+    TopFilesCollector topFiles( maxCount, sortKey, order );
+
+    StatsEngine engine;
+    engine.addCollector( &topFiles );
+    engine.collect( subtree );
+
+    FileInfoList result = topFiles.results();
+
+    if ( canCache() )
+	_results.insert( key, result );
+
+    return result;
+}
+
+
+void DiscoverCache::collectTopFiles( FileInfo * subtree, int maxCount )
+{
+    // One traversal for all the top files of the "discover" menu
+
+    TopFilesCollector largest( maxCount, TopFilesCollector::BySize,  Qt::DescendingOrder );
+    TopFilesCollector newest ( maxCount, TopFilesCollector::ByMTime, Qt::DescendingOrder );
+    TopFilesCollector oldest ( maxCount, TopFilesCollector::ByMTime, Qt::AscendingOrder	 );
+
+    StatsEngine engine;
+    engine.addCollector( &largest );
+    engine.addCollector( &newest  );
+    engine.addCollector( &oldest  );
+    engine.collect( subtree );
+
+    _results.insert( topFilesKey( subtree, TopFilesCollector::BySize,  Qt::DescendingOrder ), largest.results() );
+    _results.insert( topFilesKey( subtree, TopFilesCollector::ByMTime, Qt::DescendingOrder ), newest.results()  );
+    _results.insert( topFilesKey( subtree, TopFilesCollector::ByMTime, Qt::AscendingOrder  ), oldest.results()  );
+}
+
+
+FileInfoList DiscoverCache::duplicateFiles( FileInfo * subtree )
+{
+    if ( ! subtree )
+	return FileInfoList();
+
+    ResultKey key( subtree, DUPLICATES_KEY );
+
+    if ( _results.contains( key ) )
+	return _results.value( key );
+
+    DuplicateFinder finder;
+    finder.find( subtree );
+
+    FileInfoList result = finder.files();
+
+    if ( canCache() )
+	_results.insert( key, result );
+
+    return result;
+}
@@ -0,0 +1,124 @@
+/*
+ *   File name: DiscoverCache.h
+ *   Summary:	Cache for the results of the "discover" actions
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DiscoverCache_h
+#define DiscoverCache_h
+
+
+#include <QObject>
+#include <QPointer>
+#include <QHash>
+#include <QPair>
+
+#include "FileInfo.h"
+#include "TopFilesCollector.h"
+
+
+namespace QDirStat
+{
+    class DirTree;
+
+
+    /**
+     * Cache for the expensive part of the "discover" actions: The top files
+     * by size or modification time and the duplicate files of a subtree.
+     *
+     * The largest, newest and oldest files are all found in one single
+     * traversal of the subtree, so after one of them, switching to any of
+     * the others for the same subtree does not need to traverse the tree
+     * again.
+     *
+     * All results are discarded as soon as the tree changes. Nothing is
+     * cached while the tree is being read.
+     *
+     * This is a singleton class. Use instance() to get the instance. It is
+     * deleted together with the DirTree of the application.
+     **/
+    class DiscoverCache: public QObject
+    {
+	Q_OBJECT
+
+    protected:
+
+	/**
+	 * Constructor. This is a singleton class; use instance() instead.
+	 **/
+	DiscoverCache( DirTree * tree );
+
+    public:
+
+	/**
+	 * Get the singleton for this class. The first call to this will create
+	 * it.
+	 **/
+	static DiscoverCache * instance();
+
+	/**
+	 * Return the top 'maxCount' files in 'subtree' by 'sortKey' in
+	 * 'order' (see TopFilesCollector), the best one first.
+	 **/
+	FileInfoList topFiles( FileInfo *		  subtree,
+			       TopFilesCollector::SortKey sortKey,
+			       Qt::SortOrder		  order,
+			       int			  maxCount );
+
+	/**
+	 * Return the files with identical contents in 'subtree' (see
+	 * DuplicateFinder).
+	 **/
+	FileInfoList duplicateFiles( FileInfo * subtree );
+
+
+    public slots:
+
+	/**
+	 * Discard all results.
+	 **/
+	void invalidate();
+
+
+    protected:
+
+	typedef QPair<const FileInfo *, int> ResultKey;
+
+	/**
+	 * Return the key for the top files of 'subtree' by 'sortKey' in
+	 * 'order'.
+	 **/
+	static ResultKey topFilesKey( const FileInfo *		  subtree,
+				      TopFilesCollector::SortKey sortKey,
+				      Qt::SortOrder		  order );
+
+	/**
+	 * Find the largest, the newest and the oldest files of 'subtree'
+	 * together in one traversal and add them to the cache.
+	 **/
+	void collectTopFiles( FileInfo * subtree, int maxCount );
+
+	/**
+	 * Return 'true' if results can be cached right now.
+	 **/
+	bool canCache();
+
+
+	//
+	// Data members
+	//
+
+	static QPointer<DiscoverCache>	_instance;
+	DirTree *			_tree;
+	QHash<ResultKey, FileInfoList>	_results;
+	int				_topFilesCount;
+
+    };	// class DiscoverCache
+
+}	// namespace QDirStat
+
+
+#endif // ifndef DiscoverCache_h
@@ -26,10 +26,10 @@ DotEntry::DotEntry( DirTree * tree,
 
     if ( parent )
     {
-	_device = parent->device();
+	setDevice( parent->device() );
 	_mode	= parent->mode();
-	_uid	= parent->uid();
-	_gid	= parent->gid();
+	setUid( parent->uid() );
+	setGid( parent->gid() );
     }
 }
 
@@ -56,6 +56,7 @@ void DotEntry::insertChild( FileInfo * newChild )
     newChild->setNext( _firstChild );
     _firstChild = newChild;
     newChild->setParent( this );	// make sure the parent pointer is correct
+    addToChildIndex( newChild );
 
     childAdded( newChild );		// update summaries
 }
@@ -7,6 +7,10 @@
  */
 
 
+#include <QFile>
+#include <QDir>
+#include <QElapsedTimer>
+
 #include "DpkgPkgManager.h"
 #include "PkgFileListCache.h"
 #include "Logger.h"
@@ -16,12 +20,20 @@
 #define LOG_OUTPUT	false
 #include "SysUtil.h"
 
+#define DPKG_STATUS_FILE	"/var/lib/dpkg/status"
+#define DPKG_INFO_DIR		"/var/lib/dpkg/info"
+
+// Max. number of paths for one "dpkg -S" call
+
+#define DPKG_OWNING_PKG_BATCH	64
+
 
 using namespace QDirStat;
 
 using SysUtil::runCommand;
 using SysUtil::tryRunCommand;
 using SysUtil::haveCommand;
+using SysUtil::mappedContents;
 
 
 bool DpkgPkgManager::isPrimaryPkgManager()
@@ -36,15 +48,33 @@ bool DpkgPkgManager::isAvailable()
 }
 
 
-QString DpkgPkgManager::owningPkg( const QString & path )
+void DpkgPkgManager::owningPkgCommand( const QStringList & paths,
+					QString		  & command_ret,
+					QStringList	  & args_ret )
 {
-    int exitCode = -1;
-    QString output = runCommand( "/usr/bin/dpkg", QStringList() << "-S" << path, &exitCode );
+    command_ret = "/usr/bin/dpkg";
+    args_ret	= QStringList() << "-S" << paths.mid( 0, maxOwningPkgBatch() );
+}
+
+
+int DpkgPkgManager::maxOwningPkgBatch() const
+{
+    return DPKG_OWNING_PKG_BATCH;
+}
+
+
+void DpkgPkgManager::parseOwningPkgOutput( const QStringList	      & paths,
+					   const QString	      & output,
+					   int				exitCode,
+					   QMap<QString, QString>     & pkgs_ret )
+{
+    // If any of the paths is not owned by any package, the exit code is 1,
+    // and there is an error message for it ("dpkg-query: no path found
+    // matching pattern /foo/bar"), but the others are still listed.
 
-    if ( exitCode != 0 || output.contains( "no path found matching pattern" ) )
-	return "";
+    Q_UNUSED( exitCode );
 
-    // Normal output: One line
+    // Normal output: One line for each path
     // dpkg -S /usr/bin/gdb  -->
     //
     // gdb: /usr/bin/gdb
@@ -70,34 +100,40 @@ QString DpkgPkgManager::owningPkg( const QString & path )
     // I.e there is no hint WTF this file belongs to. Great job, guys.
     // We are NOT going to reimplement that brain-dead diversion stuff here.
 
-    QStringList lines;
-
     foreach ( const QString & line, output.trimmed().split( "\n" ) )
     {
-	if ( ! line.startsWith( "diversion by" ) && ! line.isEmpty() )
-	    lines << line;
-    }
+	if ( line.startsWith( "diversion by" ) || line.isEmpty() )
+	    continue;
 
-    QString pkg;
+	int pos = line.indexOf( ": " );
 
-    if ( ! lines.isEmpty() )
-	pkg = lines.last().split( ": " ).first();
+	if ( pos < 0 )
+	    continue;
+
+	QString path = line.mid( pos + 2 );
 
-    return pkg;
+	if ( paths.contains( path ) )
+	    pkgs_ret.insert( path, line.left( pos ) );
+    }
 }
 
 
 PkgInfoList DpkgPkgManager::installedPkg()
 {
+    PkgInfoList pkgList;
+
+    if ( readStatusFile( pkgList ) )
+	return pkgList;
+
+    logWarning() << "Can't read " << DPKG_STATUS_FILE << "; using dpkg-query" << endl;
+
     int exitCode = -1;
     QString output = runCommand( "/usr/bin/dpkg-query",
 				 QStringList()
 				 << "--show"
-				 << "--showformat=${Package} | ${Version} | ${Architecture} | ${Status}\n",
+				 << "--showformat=${Package} | ${Version} | ${Architecture} | ${Status} | ${Installed-Size}\n",
 				 &exitCode );
 
-    PkgInfoList pkgList;
-
     if ( exitCode == 0 )
 	pkgList = parsePkgList( output );
 
@@ -115,7 +151,7 @@ PkgInfoList DpkgPkgManager::parsePkgList( const QString & output )
 	{
 	    QStringList fields = line.split( " | ", QString::KeepEmptyParts );
 
-	    if ( fields.size() != 4 )
+	    if ( fields.size() != 5 )
 		logError() << "Invalid dpkg-query output: \"" << line << "\n" << endl;
 	    else
 	    {
@@ -123,6 +159,7 @@ PkgInfoList DpkgPkgManager::parsePkgList( const QString & output )
 		QString version = fields.takeFirst();
 		QString arch	= fields.takeFirst();
 		QString status	= fields.takeFirst();
+		QString size	= fields.takeFirst();
 
 		if ( status == "install ok installed" ||
                      status == "hold ok installed"       )
@@ -130,6 +167,8 @@ PkgInfoList DpkgPkgManager::parsePkgList( const QString & output )
 		    PkgInfo * pkg = new PkgInfo( name, version, arch, this );
 		    CHECK_NEW( pkg );
 
+		    setInstalledSize( pkg, size.toLatin1() );
+
 		    pkgList << pkg;
 		}
 		else
@@ -144,6 +183,188 @@ PkgInfoList DpkgPkgManager::parsePkgList( const QString & output )
 }
 
 
+bool DpkgPkgManager::readStatusFile( PkgInfoList & pkgList )
+{
+    QFile file( DPKG_STATUS_FILE );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return false;
+
+    QByteArray contents = mappedContents( file );
+
+    // The status file consists of one paragraph for each package with
+    // "Field: value" lines, separated by empty lines. Continuation lines
+    // start with whitespace; they belong to fields that are not used here.
+    //
+    //	   Package: zip
+    //	   Status: install ok installed
+    //	   Priority: optional
+    //	   Architecture: amd64
+    //	   Installed-Size: 638
+    //	   Version: 3.0-12build2
+    //	   Description: Archiver for .zip files
+    //	    This is InfoZIP's zip program.
+
+    QByteArray name;
+    QByteArray version;
+    QByteArray arch;
+    QByteArray status;
+    QByteArray size;
+    int pos = 0;
+
+    while ( pos <= contents.size() )
+    {
+	int end = contents.indexOf( '\n', pos );
+
+	if ( end < 0 )
+	    end = contents.size();
+
+	const char * line = contents.constData() + pos;
+	int	     len  = end - pos;
+
+	if ( len == 0 )		// End of paragraph
+	{
+	    if ( ! name.isEmpty() &&
+		 ( status == "install ok installed" || status == "hold ok installed" ) )
+	    {
+		PkgInfo * pkg = new PkgInfo( QString::fromUtf8( name ),
+					     QString::fromUtf8( version ),
+					     QString::fromUtf8( arch ),
+					     this );
+		CHECK_NEW( pkg );
+
+		setInstalledSize( pkg, size );
+		pkgList << pkg;
+	    }
+
+	    name.clear();
+	    version.clear();
+	    arch.clear();
+	    status.clear();
+	    size.clear();
+	}
+	else if ( *line != ' ' && *line != '\t' )
+	{
+	    QByteArray field = QByteArray::fromRawData( line, len );
+	    int colon = field.indexOf( ':' );
+
+	    if ( colon > 0 )
+	    {
+		QByteArray key   = field.left( colon );
+		QByteArray value = field.mid( colon + 1 ).trimmed();
+
+		if	( key == "Package"	  ) name    = value;
+		else if ( key == "Version"	  ) version = value;
+		else if ( key == "Architecture"   ) arch    = value;
+		else if ( key == "Status"	  ) status  = value;
+		else if ( key == "Installed-Size" ) size    = value;
+	    }
+	}
+
+	pos = end + 1;
+    }
+
+    logDebug() << "Read " << pkgList.size() << " installed packages from "
+	       << DPKG_STATUS_FILE << endl;
+
+    return true;
+}
+
+
+void DpkgPkgManager::setInstalledSize( PkgInfo * pkg, const QByteArray & kiB )
+{
+    bool ok = false;
+    FileSize size = kiB.toLongLong( &ok );
+
+    if ( ok )
+	pkg->setInstalledSize( size * 1024 );
+}
+
+
+QStringList DpkgPkgManager::fileList( PkgInfo * pkg )
+{
+    QString fileName = listFileName( pkg );
+
+    if ( ! fileName.isEmpty() )
+    {
+	bool ok = false;
+	QStringList fileList = readListFile( fileName, &ok );
+
+	if ( ok )
+	    return fileList;
+    }
+
+    return PkgManager::fileList( pkg );
+}
+
+
+QString DpkgPkgManager::listFileName( PkgInfo * pkg )
+{
+    CHECK_PTR( pkg );
+
+    // Packages that can be installed for several architectures at the same
+    // time ("Multi-Arch: same") have the architecture in the file name,
+    // all others don't.
+
+    QString fileName = QString( DPKG_INFO_DIR "/%1.list" ).arg( queryName( pkg ) );
+
+    if ( QFile::exists( fileName ) )
+	return fileName;
+
+    fileName = QString( DPKG_INFO_DIR "/%1.list" ).arg( pkg->baseName() );
+
+    if ( QFile::exists( fileName ) )
+	return fileName;
+
+    return QString();
+}
+
+
+QStringList DpkgPkgManager::readListFile( const QString & fileName, bool * ok )
+{
+    QStringList fileList;
+    QFile file( fileName );
+
+    if ( ok )
+	*ok = false;
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return fileList;
+
+    QByteArray contents = mappedContents( file );
+    int pos = 0;
+
+    while ( pos < contents.size() )
+    {
+	int end = contents.indexOf( '\n', pos );
+
+	if ( end < 0 )
+	    end = contents.size();
+
+	int len = end - pos;
+
+	// Like in the output of "dpkg-query --listfiles", there is a "/."
+	// entry for the root directory in each list
+
+	if ( len > 0 && ! ( len == 2 && contents.at( pos ) == '/' && contents.at( pos + 1 ) == '.' ) )
+	    fileList << QString::fromUtf8( contents.constData() + pos, len );
+
+	pos = end + 1;
+    }
+
+    if ( ok )
+	*ok = true;
+
+    return fileList;
+}
+
+
+QStringList DpkgPkgManager::databasePaths() const
+{
+    return QStringList() << DPKG_STATUS_FILE << DPKG_INFO_DIR;
+}
+
+
 QString DpkgPkgManager::fileListCommand( PkgInfo * pkg )
 {
     return QString( "/usr/bin/dpkg-query --listfiles %1" ).arg( queryName( pkg ) );
@@ -187,6 +408,47 @@ QString DpkgPkgManager::queryName( PkgInfo * pkg )
 
 
 PkgFileListCache * DpkgPkgManager::createFileListCache( PkgFileListCache::LookupType lookupType )
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // The .list files are named after the package, for "Multi-Arch: same"
+    // packages with the architecture: "zip.list", "zlib1g:amd64.list".
+    // Those are just the same package names that "dpkg -S" would report.
+
+    QDir infoDir( DPKG_INFO_DIR );
+    QStringList entries = infoDir.entryList( QStringList() << "*.list", QDir::Files );
+
+    if ( entries.isEmpty() )
+    {
+	logWarning() << "No package file lists in " << DPKG_INFO_DIR << "; using dpkg -S" << endl;
+
+	return createFileListCacheFromCommand( lookupType );
+    }
+
+    QStringList pkgNames;
+    QStringList fileNames;
+
+    foreach ( const QString & entry, entries )
+    {
+	pkgNames  << entry.left( entry.size() - 5 );	// Without ".list"
+	fileNames << infoDir.filePath( entry );
+    }
+
+    PkgFileListCache * cache = new PkgFileListCache( this, lookupType );
+    CHECK_NEW( cache );
+
+    int fileCount = cache->addFileLists( pkgNames, fileNames, readListFile );
+
+    logDebug() << "Read " << fileCount << " files of " << pkgNames.size()
+	       << " packages from " << DPKG_INFO_DIR
+	       << " in " << timer.elapsed() << " millisec" << endl;
+
+    return cache;
+}
+
+
+PkgFileListCache * DpkgPkgManager::createFileListCacheFromCommand( PkgFileListCache::LookupType lookupType )
 {
     int exitCode = -1;
     QString output = runCommand( "/usr/bin/dpkg", QStringList() << "-S" << "*", &exitCode );
@@ -53,16 +53,35 @@ namespace QDirStat
 	virtual bool isAvailable() Q_DECL_OVERRIDE;
 
 	/**
-	 * Return the owning package of a file or directory with full path
-	 * 'path' or an empty string if it is not owned by any package.
+	 * Return the command and its arguments for finding the owning
+	 * packages of 'paths': dpkg can do that for many paths at once.
 	 *
 	 * Implemented from PkgManager.
 	 *
-	 * This basically executes this command:
+	 * This is basically this command:
 	 *
-	 *   /usr/bin/dpkg -S ${path}
+	 *   /usr/bin/dpkg -S ${paths}
 	 **/
-	virtual QString owningPkg( const QString & path ) Q_DECL_OVERRIDE;
+	virtual void owningPkgCommand( const QStringList & paths,
+				       QString		 & command_ret,
+				       QStringList	 & args_ret ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Parse the output of the owningPkgCommand() for 'paths'.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual void parseOwningPkgOutput( const QStringList	      & paths,
+					   const QString	      & output,
+					   int				exitCode,
+					   QMap<QString, QString>     & pkgs_ret ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return the maximum number of paths for one owningPkgCommand().
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual int maxOwningPkgBatch() const Q_DECL_OVERRIDE;
 
 
 	//-----------------------------------------------------------------
@@ -87,6 +106,25 @@ namespace QDirStat
 	 **/
 	virtual PkgInfoList installedPkg() Q_DECL_OVERRIDE;
 
+	/**
+	 * Return 'true' since installedPkg() sets the installed size from the
+	 * Installed-Size field (in KiB).
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsInstalledSize() Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Return the list of files and directories owned by a package.
+	 *
+	 * This reads the package's .list file in /var/lib/dpkg/info directly
+	 * and only falls back to "dpkg-query --listfiles" if there is none.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QStringList fileList( PkgInfo * pkg ) Q_DECL_OVERRIDE;
+
 	/**
 	 * Return 'true' if this package manager supports getting the file list
 	 * for a package.
@@ -111,6 +149,14 @@ namespace QDirStat
 	 **/
 	virtual QStringList parseFileList( const QString & output ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Return 'true' since fileList() reads the dpkg database directly.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsNativeFileList() Q_DECL_OVERRIDE
+	    { return true; }
+
 	/**
 	 * Return 'true' if this package manager supports building a file list
 	 * cache for getting all file lists for all packages.
@@ -131,6 +177,9 @@ namespace QDirStat
 	 * Ownership of the cache is transferred to the caller; make sure to
 	 * delete it when you are done with it.
 	 *
+	 * This reads all .list files in /var/lib/dpkg/info in parallel and
+	 * only falls back to "dpkg -S '*'" if that directory is missing.
+	 *
 	 * Reimplemented from PkgManager.
 	 **/
 	virtual PkgFileListCache * createFileListCache( PkgFileListCache::LookupType lookupType = PkgFileListCache::LookupByPkg ) Q_DECL_OVERRIDE;
@@ -145,6 +194,22 @@ namespace QDirStat
 	 **/
 	virtual QString queryName( PkgInfo * pkg ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Read the files and directories of one package from its .list
+	 * file 'fileName' in the dpkg database. Set 'ok' to 'false' if that
+	 * file could not be read.
+	 *
+	 * This is thread-safe, so it can be used from worker threads.
+	 **/
+	static QStringList readListFile( const QString & fileName, bool * ok = 0 );
+
+	/**
+	 * Return the dpkg status file and the directory with the file lists.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QStringList databasePaths() const Q_DECL_OVERRIDE;
+
 
     protected:
 
@@ -153,6 +218,30 @@ namespace QDirStat
 	 **/
 	PkgInfoList parsePkgList( const QString & output );
 
+	/**
+	 * Read the list of installed packages directly from the dpkg status
+	 * file. Return 'false' if that file could not be read.
+	 **/
+	bool readStatusFile( PkgInfoList & pkgList );
+
+	/**
+	 * Set the installed size of 'pkg' from an Installed-Size field 'kiB'
+	 * if it is valid.
+	 **/
+	void setInstalledSize( PkgInfo * pkg, const QByteArray & kiB );
+
+	/**
+	 * Return the full path of the .list file in the dpkg database for
+	 * 'pkg' or an empty string if there is none.
+	 **/
+	QString listFileName( PkgInfo * pkg );
+
+	/**
+	 * Create a file list cache from the output of "dpkg -S '*'". This is
+	 * the fallback if the dpkg database can't be read directly.
+	 **/
+	PkgFileListCache * createFileListCacheFromCommand( PkgFileListCache::LookupType lookupType );
+
     };	// class DpkgPkgManager
 
 }	// namespace QDirStat
@@ -0,0 +1,426 @@
+/*
+ *   File name: DuplicateFinder.cpp
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <fcntl.h>	// open(), posix_fadvise()
+#include <unistd.h>	// pread(), close()
+#include <errno.h>
+#include <algorithm>	// std::sort()
+
+#include <QHash>
+#include <QSet>
+#include <QPair>
+#include <QAtomicInt>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+
+#include "DuplicateFinder.h"
+#include "FileInfoIterator.h"
+#include "HardLinkIndex.h"
+#include "DirTree.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Files smaller than this are disregarded. Empty files are all identical,
+// but deleting them does not save any disk space.
+
+#define DUPLICATES_MIN_SIZE		1
+
+// Number of bytes at the start and at the end of a file for the partial
+// hash.
+
+#define DUPLICATES_PARTIAL_SIZE		4096
+
+// Buffer size for reading the complete contents of a file.
+
+#define DUPLICATES_BUFFER_SIZE		( 256 * 1024 )
+
+// Maximum number of threads for hashing. More threads than this mostly
+// make the disks seek more.
+
+#define DUPLICATES_MAX_THREADS		4
+
+// Interval for processing events while waiting for the worker threads.
+
+#define DUPLICATES_PROCESS_EVENTS_MILLISEC	100
+
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Task for hashing files in a worker thread. Each task takes the next
+     * candidate that is not yet taken by any other task until all are done,
+     * so large and small files are distributed evenly among the threads.
+     **/
+    class DuplicateHashTask: public QRunnable
+    {
+    public:
+
+	DuplicateHashTask( DuplicateFinder::Candidate * candidates,
+			   int				count,
+			   bool				fullContents,
+			   QAtomicInt &			next ):
+	    _candidates( candidates ),
+	    _count( count ),
+	    _fullContents( fullContents ),
+	    _next( next )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    while ( true )
+	    {
+		int index = _next.fetchAndAddOrdered( 1 );
+
+		if ( index >= _count )
+		    return;
+
+		DuplicateFinder::Candidate & candidate = _candidates[ index ];
+		candidate.hash = DuplicateFinder::hashFile( candidate.path,
+							    candidate.size,
+							    _fullContents );
+	    }
+	}
+
+    protected:
+
+	DuplicateFinder::Candidate * _candidates;
+	int			     _count;
+	bool			     _fullContents;
+	QAtomicInt &		     _next;
+    };
+
+
+    /**
+     * Read 'size' bytes from 'fd' starting at 'offset' and add them to
+     * 'hash'. Return 'true' if all of them could be read.
+     **/
+    static bool hashRange( int			 fd,
+			   FileSize		 offset,
+			   FileSize		 size,
+			   QByteArray &		 buffer,
+			   QCryptographicHash &	 hash )
+    {
+	while ( size > 0 )
+	{
+	    ssize_t len = pread( fd, buffer.data(), qMin( size, (FileSize) buffer.size() ), offset );
+
+	    if ( len < 0 && errno == EINTR )
+		continue;
+
+	    if ( len <= 0 )	// Error or the file became shorter
+		return false;
+
+	    hash.addData( buffer.constData(), len );
+	    offset += len;
+	    size   -= len;
+	}
+
+	return true;
+    }
+
+
+    static FileSize wastedSize( const FileInfoList & group )
+    {
+	return group.isEmpty() ? 0 : ( group.size() - 1 ) * group.first()->rawByteSize();
+    }
+
+
+    static bool moreWasted( const FileInfoList & a, const FileInfoList & b )
+    {
+	return wastedSize( a ) > wastedSize( b );
+    }
+
+
+    static bool lessPath( const DuplicateFinder::Candidate & a,
+			  const DuplicateFinder::Candidate & b )
+    {
+	return a.path < b.path;
+    }
+
+}	// namespace QDirStat
+
+
+
+DuplicateFinder::DuplicateFinder():
+    _wastedSize( 0 )
+{
+    // NOP
+}
+
+
+DuplicateFinder::~DuplicateFinder()
+{
+    // NOP
+}
+
+
+void DuplicateFinder::clear()
+{
+    _groups.clear();
+    _wastedSize = 0;
+}
+
+
+FileInfoList DuplicateFinder::files() const
+{
+    FileInfoList result;
+
+    foreach ( const FileInfoList & group, _groups )
+	result << group;
+
+    return result;
+}
+
+
+FileSize DuplicateFinder::partialHashCoversAll()
+{
+    return 2 * DUPLICATES_PARTIAL_SIZE;
+}
+
+
+void DuplicateFinder::find( FileInfo * subtree )
+{
+    clear();
+
+    if ( ! subtree )
+	return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Stage 1: Group by size
+
+    FileInfoList files;
+    collectFiles( subtree, files );
+
+    QHash<FileSize, FileInfoList> bySize;
+
+    foreach ( FileInfo * file, files )
+	bySize[ file->rawByteSize() ] << file;
+
+    CandidateList candidates;
+
+    foreach ( const FileInfoList & sameSize, bySize )
+    {
+	if ( sameSize.size() < 2 )
+	    continue;
+
+	foreach ( FileInfo * file, sameSize )
+	{
+	    Candidate candidate;
+	    candidate.file = file;
+	    candidate.path = file->path();
+	    candidate.size = file->rawByteSize();
+	    candidates << candidate;
+	}
+    }
+
+    logInfo() << files.size() << " files, " << candidates.size()
+	      << " with the same size as another one" << endl;
+
+    // Stage 2: Hash the start and the end of the files
+
+    hashCandidates( candidates, false );
+    QList<CandidateList> groups = groupByHash( candidates );
+
+    // Stage 3: Hash the complete contents of the remaining files unless the
+    // partial hash already covered all of it
+
+    candidates.clear();
+    QList<CandidateList> finalGroups;
+
+    foreach ( const CandidateList & group, groups )
+    {
+	if ( group.first().size <= partialHashCoversAll() )
+	    finalGroups << group;
+	else
+	    candidates << group;
+    }
+
+    logInfo() << candidates.size() << " files with the same partial hash" << endl;
+
+    hashCandidates( candidates, true );
+    finalGroups << groupByHash( candidates );
+
+    foreach ( CandidateList group, finalGroups )
+    {
+	std::sort( group.begin(), group.end(), lessPath );
+	FileInfoList fileGroup;
+
+	foreach ( const Candidate & candidate, group )
+	    fileGroup << candidate.file;
+
+	_groups << fileGroup;
+	_wastedSize += QDirStat::wastedSize( fileGroup );
+    }
+
+    std::sort( _groups.begin(), _groups.end(), moreWasted );
+
+    logInfo() << _groups.size() << " groups of duplicate files wasting "
+	      << formatSize( _wastedSize ) << " in "
+	      << timer.elapsed() << " millisec" << endl;
+}
+
+
+void DuplicateFinder::collectFiles( FileInfo * dir, FileInfoList & files )
+{
+    QSet<FileInfo *> otherLinks;
+    FileInfoList dirs;
+    dirs << dir;
+
+    while ( ! dirs.isEmpty() )
+    {
+	FileInfoIterator it( dirs.takeLast() );
+
+	while ( *it )
+	{
+	    FileInfo * item = *it;
+
+	    if ( item->hasChildren() )
+		dirs << item;
+
+	    if ( item->isFile() && item->rawByteSize() >= DUPLICATES_MIN_SIZE )
+	    {
+		// Hard links to the same inode have the same contents, of
+		// course, but they don't take any additional disk space.
+
+		if ( item->links() < 2 || ! item->tree() )
+		    files << item;
+		else if ( ! otherLinks.contains( item ) )
+		{
+		    files << item;
+
+		    foreach ( FileInfo * link, item->tree()->hardLinks()->links( item ) )
+			otherLinks.insert( link );
+		}
+	    }
+
+	    ++it;
+	}
+    }
+}
+
+
+void DuplicateFinder::hashCandidates( CandidateList & candidates, bool fullContents )
+{
+    if ( candidates.isEmpty() )
+	return;
+
+    Candidate * data = candidates.data(); // Detach now, not in the threads
+    QAtomicInt next( 0 );
+    QList<DuplicateHashTask *> tasks;
+
+    const int threads = qMin( QThread::idealThreadCount(), DUPLICATES_MAX_THREADS );
+
+    for ( int i = 0; i < threads && i < candidates.size(); ++i )
+    {
+	DuplicateHashTask * task = new DuplicateHashTask( data, candidates.size(), fullContents, next );
+	CHECK_NEW( task );
+	task->setAutoDelete( false );
+	tasks << task;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount( tasks.size() );
+
+    foreach ( DuplicateHashTask * task, tasks )
+	pool.start( task );
+
+    // Keep the GUI responsive while waiting, but only if that cannot change
+    // the tree: Not while it is being read. User input is not processed at
+    // all, just like in BusyPopup.
+
+    DirTree * tree = candidates.first().file->tree();
+    bool processEvents = ! tree || ! tree->isBusy();
+
+    while ( ! pool.waitForDone( processEvents ? DUPLICATES_PROCESS_EVENTS_MILLISEC : -1 ) )
+    {
+	QEventLoop eventLoop;
+	eventLoop.processEvents( QEventLoop::ExcludeUserInputEvents,
+				 DUPLICATES_PROCESS_EVENTS_MILLISEC / 2 );
+    }
+
+    qDeleteAll( tasks );
+}
+
+
+QList<DuplicateFinder::CandidateList>
+DuplicateFinder::groupByHash( const CandidateList & candidates )
+{
+    QHash<QPair<FileSize, QByteArray>, CandidateList> byHash;
+
+    foreach ( const Candidate & candidate, candidates )
+    {
+	if ( ! candidate.hash.isEmpty() )	// File could be read?
+	    byHash[ qMakePair( candidate.size, candidate.hash ) ] << candidate;
+    }
+
+    QList<CandidateList> groups;
+
+    foreach ( const CandidateList & group, byHash )
+    {
+	if ( group.size() > 1 )
+	    groups << group;
+    }
+
+    return groups;
+}
+
+
+QByteArray DuplicateFinder::hashFile( const QString & path,
+				      FileSize	      size,
+				      bool	      fullContents )
+{
+    int fd = ::open( path.toUtf8(), O_RDONLY | O_CLOEXEC );
+
+    if ( fd < 0 )
+	return QByteArray();
+
+    QCryptographicHash hash( QCryptographicHash::Md5 );
+    bool ok = true;
+
+    if ( fullContents )
+    {
+	// Tell the kernel to read ahead aggressively, and not to keep the
+	// contents in the page cache afterwards: That would only push out
+	// more useful data.
+
+	posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+	QByteArray buffer( DUPLICATES_BUFFER_SIZE, 0 );
+	ok = hashRange( fd, 0, size, buffer, hash );
+
+	posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+    }
+    else
+    {
+	QByteArray buffer( DUPLICATES_PARTIAL_SIZE, 0 );
+	FileSize headSize = qMin( size, (FileSize) DUPLICATES_PARTIAL_SIZE );
+	ok = hashRange( fd, 0, headSize, buffer, hash );
+
+	if ( ok && size > headSize )
+	{
+	    FileSize tailStart = qMax( headSize, size - DUPLICATES_PARTIAL_SIZE );
+	    ok = hashRange( fd, tailStart, size - tailStart, buffer, hash );
+	}
+    }
+
+    ::close( fd );
+
+    return ok ? hash.result() : QByteArray();
+}
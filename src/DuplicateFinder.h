@@ -0,0 +1,146 @@
+/*
+ *   File name: DuplicateFinder.h
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DuplicateFinder_h
+#define DuplicateFinder_h
+
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Class to find files with identical contents in a subtree.
+     *
+     * This works in stages, each of which only looks at the files that are
+     * still candidates after the previous one:
+     *
+     *	 - Group all regular files by size. Only one of several hard links
+     *	   to the same inode is used.
+     *
+     *	 - Hash the first and the last few kB of files of the same size in
+     *	   parallel.
+     *
+     *	 - Hash the complete contents of files of the same size with the
+     *	   same partial hash in parallel.
+     *
+     * Files that cannot be read are silently disregarded.
+     **/
+    class DuplicateFinder
+    {
+    public:
+
+	/**
+	 * One file to check in the hashing stages. All information the worker
+	 * threads need is copied here in the GUI thread, so they don't need to
+	 * access the FileInfo.
+	 **/
+	struct Candidate
+	{
+	    FileInfo *	file;
+	    QString	path;
+	    FileSize	size;
+	    QByteArray	hash;
+	};
+
+	typedef QVector<Candidate> CandidateList;
+
+	/**
+	 * Constructor.
+	 **/
+	DuplicateFinder();
+
+	/**
+	 * Destructor.
+	 **/
+	~DuplicateFinder();
+
+	/**
+	 * Find the duplicate files in 'subtree'. This blocks until all
+	 * hashing is done.
+	 **/
+	void find( FileInfo * subtree );
+
+	/**
+	 * Clear the results.
+	 **/
+	void clear();
+
+	/**
+	 * Return the groups of files with identical contents, the ones that
+	 * waste the most disk space first.
+	 **/
+	const QList<FileInfoList> & groups() const { return _groups; }
+
+	/**
+	 * Return all files of all groups.
+	 **/
+	FileInfoList files() const;
+
+	/**
+	 * Return the disk space that could be saved by keeping only one file
+	 * of each group.
+	 **/
+	FileSize wastedSize() const { return _wastedSize; }
+
+	/**
+	 * Calculate the hash of the file at 'path' with 'size' bytes: Of the
+	 * first and the last few kB only or, with 'fullContents', of all of
+	 * it. Return an empty byte array if the file could not be read
+	 * completely. This is called in the worker threads.
+	 **/
+	static QByteArray hashFile( const QString & path,
+				    FileSize	    size,
+				    bool	    fullContents );
+
+	/**
+	 * Return the size up to which the partial hash covers the complete
+	 * file.
+	 **/
+	static FileSize partialHashCoversAll();
+
+
+    protected:
+
+	/**
+	 * Add all regular files in 'dir' recursively to 'files'.
+	 **/
+	void collectFiles( FileInfo * dir, FileInfoList & files );
+
+	/**
+	 * Calculate the hash of all 'candidates' in parallel.
+	 **/
+	void hashCandidates( CandidateList & candidates, bool fullContents );
+
+	/**
+	 * Group 'candidates' by size and hash and return the groups with
+	 * more than one file.
+	 **/
+	static QList<CandidateList> groupByHash( const CandidateList & candidates );
+
+
+	//
+	// Data members
+	//
+
+	QList<FileInfoList>	_groups;
+	FileSize		_wastedSize;
+
+    };	// class DuplicateFinder
+
+}	// namespace QDirStat
+
+
+#endif // ifndef DuplicateFinder_h
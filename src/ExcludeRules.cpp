@@ -7,6 +7,9 @@
  */
 
 
+#include <QHash>
+#include <QMap>
+
 #include "ExcludeRules.h"
 #include "DirInfo.h"
 #include "DotEntry.h"
@@ -22,6 +25,214 @@
 using namespace QDirStat;
 
 
+namespace QDirStat
+{
+    /**
+     * Hash tables for the exclude rules with a plain text, "*suffix" or
+     * "prefix*" pattern that all either use the full path or the file name
+     * and that are all either case sensitive or not. The values are the
+     * indices of the rules in the rule list.
+     **/
+    struct ExcludeRulesTable
+    {
+	/**
+	 * Return 'true' if there are no rules in this table.
+	 **/
+	bool isEmpty() const
+	    { return texts.isEmpty() && suffixes.isEmpty() && prefixes.isEmpty(); }
+
+	/**
+	 * Return the lowest index of all rules in this table that match
+	 * 'text' or -1 if none matches.
+	 **/
+	int match( const QString & text ) const;
+
+	QHash<QString, int>		texts;
+	QMap<int, QHash<QString, int> > suffixes;	// By length
+	QMap<int, QHash<QString, int> > prefixes;	// By length
+    };
+
+
+    /**
+     * Index of the rules of an ExcludeRules object.
+     **/
+    struct ExcludeRulesIndex
+    {
+	ExcludeRulesTable tables[ 2 ][ 2 ];	// [ useFullPath ][ caseInsensitive ]
+	QList<int>	  regexpRules;		// Indices, ascending
+	int		  changeCount;
+    };
+
+
+    /**
+     * Kinds of patterns that can be looked up in an ExcludeRulesTable.
+     **/
+    enum ExcludePatternKind
+    {
+	RegExpPattern,	// Anything that needs the regexp
+	TextPattern,	// Plain text, matches only exactly that text
+	SuffixPattern,	// "*suffix"
+	PrefixPattern	// "prefix*"
+    };
+
+
+    /**
+     * Return the smaller one of two rule indices that are either valid or -1.
+     **/
+    static int firstIndex( int a, int b )
+    {
+	if ( a < 0 )
+	    return b;
+
+	if ( b < 0 )
+	    return a;
+
+	return qMin( a, b );
+    }
+
+
+    /**
+     * Return 'true' if 'str' contains any of the characters in 'chars'.
+     **/
+    static bool containsAny( const QString & str, const char * chars )
+    {
+	for ( const char * ch = chars; *ch; ++ch )
+	{
+	    if ( str.contains( QLatin1Char( *ch ) ) )
+		return true;
+	}
+
+	return false;
+    }
+
+
+    /**
+     * Convert a part of a regular expression that should be plain text to
+     * that text: Resolve escaped special characters like "\." and return
+     * 'false' if there is anything else with a special meaning.
+     **/
+    static bool regExpToText( const QString & regExp, QString & text )
+    {
+	text.clear();
+
+	for ( int i = 0; i < regExp.size(); ++i )
+	{
+	    QChar ch = regExp.at( i );
+
+	    if ( ch == '\\' )
+	    {
+		if ( ++i >= regExp.size() || regExp.at( i ).isLetterOrNumber() )
+		    return false;	// Dangling backslash or "\d" etc.
+
+		text += regExp.at( i );
+	    }
+	    else if ( QString( "^$.|?*+()[]{}" ).contains( ch ) )
+	    {
+		return false;
+	    }
+	    else
+	    {
+		text += ch;
+	    }
+	}
+
+	return true;
+    }
+
+
+    /**
+     * Find out what kind of pattern 'regexp' has and return the text,
+     * suffix or prefix of that pattern in 'text'.
+     **/
+    static ExcludePatternKind patternKind( const QRegExp & regexp, QString & text )
+    {
+	const QString & pattern = regexp.pattern();
+
+	switch ( regexp.patternSyntax() )
+	{
+	    case QRegExp::FixedString:
+		text = pattern;
+		return TextPattern;
+
+	    case QRegExp::Wildcard:
+	    case QRegExp::WildcardUnix:
+		{
+		    const char * specials = "*?[\\";
+
+		    if ( ! containsAny( pattern, specials ) )
+		    {
+			text = pattern;
+			return TextPattern;
+		    }
+
+		    if ( pattern.startsWith( '*' ) && ! containsAny( pattern.mid( 1 ), specials ) )
+		    {
+			text = pattern.mid( 1 );
+			return SuffixPattern;
+		    }
+
+		    if ( pattern.endsWith( '*' ) && ! containsAny( pattern.left( pattern.size() - 1 ), specials ) )
+		    {
+			text = pattern.left( pattern.size() - 1 );
+			return PrefixPattern;
+		    }
+		}
+		break;
+
+	    case QRegExp::RegExp:
+	    case QRegExp::RegExp2:
+
+		if ( regExpToText( pattern, text ) )
+		    return TextPattern;
+
+		if ( pattern.startsWith( ".*" ) && regExpToText( pattern.mid( 2 ), text ) )
+		    return SuffixPattern;
+
+		// In "foo\.*", ".*" is not a wildcard, but cutting it off leaves
+		// a dangling backslash that regExpToText() does not accept.
+
+		if ( pattern.endsWith( ".*" ) && regExpToText( pattern.left( pattern.size() - 2 ), text ) )
+		    return PrefixPattern;
+
+		break;
+
+	    default:
+		break;
+	}
+
+	return RegExpPattern;
+    }
+
+}	// namespace QDirStat
+
+
+int ExcludeRulesTable::match( const QString & text ) const
+{
+    int result = texts.value( text, -1 );
+
+    for ( QMap<int, QHash<QString, int> >::const_iterator it = suffixes.constBegin();
+	  it != suffixes.constEnd() && it.key() <= text.size();
+	  ++it )
+    {
+	result = firstIndex( result, it.value().value( text.right( it.key() ), -1 ) );
+    }
+
+    for ( QMap<int, QHash<QString, int> >::const_iterator it = prefixes.constBegin();
+	  it != prefixes.constEnd() && it.key() <= text.size();
+	  ++it )
+    {
+	result = firstIndex( result, it.value().value( text.left( it.key() ), -1 ) );
+    }
+
+    return result;
+}
+
+
+
+
+int ExcludeRule::_changeCount = 0;
+
+
 ExcludeRule::ExcludeRule( const QRegExp & regexp,
                           bool            useFullPath,
                           bool            checkAnyFileChild ):
@@ -103,6 +314,7 @@ ExcludeRules::ExcludeRules():
 {
     _lastMatchingRule  = 0;
     _defaultRulesAdded = false;
+    _index	       = 0;
 }
 
 
@@ -112,6 +324,7 @@ ExcludeRules::ExcludeRules( const QStringList & paths ):
 {
     _lastMatchingRule  = 0;
     _defaultRulesAdded = false;
+    _index	       = 0;
 
     foreach ( const QString & path, paths )
     {
@@ -151,6 +364,7 @@ void ExcludeRules::clear()
     qDeleteAll( _rules );
     _rules.clear();
     _lastMatchingRule = 0;
+    dropIndex();
 }
 
 
@@ -158,6 +372,7 @@ void ExcludeRules::add( ExcludeRule * rule )
 {
     CHECK_PTR( rule );
     _rules << rule;
+    dropIndex();
 }
 
 
@@ -186,6 +401,7 @@ void ExcludeRules::remove( ExcludeRule * rule )
 
     _rules.removeAll( rule );
     delete rule;
+    dropIndex();
 }
 
 
@@ -195,18 +411,17 @@ bool ExcludeRules::match( const QString & fullPath, const QString & fileName )
     if ( fullPath.isEmpty() || fileName.isEmpty() )
 	return false;
 
-    foreach ( ExcludeRule * rule, _rules )
+    ExcludeRule * rule = findMatchingRule( fullPath, fileName );
+
+    if ( rule )
     {
-	if ( rule->match( fullPath, fileName ) )
-	{
-	    _lastMatchingRule = rule;
+	_lastMatchingRule = rule;
 #if VERBOSE_EXCLUDE_MATCHES
 
-	    logDebug() << fullPath << " matches " << rule << endl;
+	logDebug() << fullPath << " matches " << rule << endl;
 
 #endif
-	    return true;
-	}
+	return true;
     }
 
     return false;
@@ -237,43 +452,156 @@ bool ExcludeRules::matchDirectChildren( DirInfo * dir )
 }
 
 
+QList<QRegExp> ExcludeRules::fileChildRegexps() const
+{
+    QList<QRegExp> result;
+
+    foreach ( ExcludeRule * rule, _rules )
+    {
+	if ( rule->checkAnyFileChild() && ! rule->regexp().pattern().isEmpty() )
+	    result << rule->regexp();
+    }
+
+    return result;
+}
+
+
 const ExcludeRule * ExcludeRules::matchingRule( const QString & fullPath,
 						const QString & fileName )
 {
     if ( fullPath.isEmpty() || fileName.isEmpty() )
 	return 0;
 
-    foreach ( ExcludeRule * rule, _rules )
+    return findMatchingRule( fullPath, fileName );
+}
+
+
+ExcludeRule * ExcludeRules::findMatchingRule( const QString & fullPath,
+					      const QString & fileName )
+{
+    // The rules might have been changed in place by the config page
+
+    if ( ! _index || _index->changeCount != ExcludeRule::changeCount() )
+	buildIndex();
+
+    int result = -1;
+
+    for ( int useFullPath = 0; useFullPath < 2; ++useFullPath )
+    {
+	for ( int caseInsensitive = 0; caseInsensitive < 2; ++caseInsensitive )
+	{
+	    const ExcludeRulesTable & table = _index->tables[ useFullPath ][ caseInsensitive ];
+
+	    if ( table.isEmpty() )
+		continue;
+
+	    const QString & text = useFullPath ? fullPath : fileName;
+	    result = firstIndex( result, table.match( caseInsensitive ? text.toLower() : text ) );
+	}
+    }
+
+    // Only rules before the first match so far can change the result
+
+    foreach ( int index, _index->regexpRules )
     {
-	if ( rule->match( fullPath, fileName ) )
-	    return rule;
+	if ( result >= 0 && index > result )
+	    break;
+
+	if ( _rules.at( index )->match( fullPath, fileName ) )
+	{
+	    result = index;
+	    break;
+	}
     }
 
-    return 0;
+    return result >= 0 ? _rules.at( result ) : 0;
+}
+
+
+void ExcludeRules::buildIndex()
+{
+    dropIndex();
+
+    _index = new ExcludeRulesIndex;
+    CHECK_NEW( _index );
+
+    _index->changeCount = ExcludeRule::changeCount();
+
+    for ( int i = 0; i < _rules.size(); ++i )
+    {
+	ExcludeRule * rule = _rules.at( i );
+
+	// Those are only used by matchDirectChildren()
+
+	if ( rule->checkAnyFileChild() || rule->regexp().pattern().isEmpty() )
+	    continue;
+
+	QString text;
+	ExcludePatternKind kind = patternKind( rule->regexp(), text );
+
+	if ( kind == RegExpPattern )
+	{
+	    _index->regexpRules << i;
+	    continue;
+	}
+
+	bool caseInsensitive = rule->regexp().caseSensitivity() == Qt::CaseInsensitive;
+
+	if ( caseInsensitive )
+	    text = text.toLower();
+
+	ExcludeRulesTable & table = _index->tables[ rule->useFullPath() ][ caseInsensitive ];
+	QHash<QString, int> & hash =
+	    kind == SuffixPattern ? table.suffixes[ text.size() ] :
+	    kind == PrefixPattern ? table.prefixes[ text.size() ] :
+	    table.texts;
+
+	if ( ! hash.contains( text ) )	// Keep the first rule
+	    hash.insert( text, i );
+    }
+
+#if 0
+    logDebug() << _rules.size() << " exclude rules, "
+	       << _index->regexpRules.size() << " with a regexp" << endl;
+#endif
+}
+
+
+void ExcludeRules::dropIndex()
+{
+    if ( _index )
+    {
+	delete _index;
+	_index = 0;
+    }
 }
 
 
 void ExcludeRules::moveUp( ExcludeRule * rule )
 {
     _listMover.moveUp( rule );
+    dropIndex();
 }
 
 
 void ExcludeRules::moveDown( ExcludeRule * rule )
 {
     _listMover.moveDown( rule );
+    dropIndex();
 }
 
 
 void ExcludeRules::moveToTop( ExcludeRule * rule )
 {
     _listMover.moveToTop( rule );
+    dropIndex();
 }
 
 
 void ExcludeRules::moveToBottom( ExcludeRule * rule )
 {
     _listMover.moveToBottom( rule );
+    dropIndex();
 }
 
 
@@ -22,6 +22,7 @@
 namespace QDirStat
 {
     class DirInfo;
+    struct ExcludeRulesIndex;
 
     /**
      * One single exclude rule to check text (file names) against.
@@ -92,7 +93,8 @@ namespace QDirStat
 	/**
 	 * Change this rule's regular expression.
 	 **/
-	void setRegexp( const QRegExp & regexp ) { _regexp = regexp; }
+	void setRegexp( const QRegExp & regexp )
+	    { _regexp = regexp; ++_changeCount; }
 
 	/**
 	 * Return 'true' if this exclude rule uses the full path to match
@@ -103,7 +105,8 @@ namespace QDirStat
 	/**
 	 * Set the 'full path' flag.
 	 **/
-	void setUseFullPath( bool useFullPath ) { _useFullPath = useFullPath; }
+	void setUseFullPath( bool useFullPath )
+	    { _useFullPath = useFullPath; ++_changeCount; }
 
         /**
          * Return 'true' if this exclude rule should be used to check against
@@ -115,13 +118,23 @@ namespace QDirStat
         /**
          * Set the 'check any file child' flag.
          **/
-        void setCheckAnyFileChild( bool check ) { _checkAnyFileChild = check; }
+        void setCheckAnyFileChild( bool check )
+            { _checkAnyFileChild = check; ++_changeCount; }
+
+        /**
+         * Return a number that changes whenever any exclude rule is changed,
+         * so an ExcludeRules object can recognize that it needs to update
+         * its index of the rules.
+         **/
+        static int changeCount() { return _changeCount; }
 
     private:
 
 	QRegExp _regexp;
 	bool	_useFullPath;
         bool    _checkAnyFileChild;
+
+        static int _changeCount;
     };
 
 
@@ -217,6 +230,14 @@ namespace QDirStat
          **/
         bool matchDirectChildren( DirInfo * dir );
 
+        /**
+         * Return copies of the regular expressions of all rules that have
+         * the 'checkAnyFileChild' flag set, e.g. to check them in another
+         * thread (see DirScanner::scanDir()). This is empty if there are no
+         * such rules.
+         **/
+        QList<QRegExp> fileChildRegexps() const;
+
 	/**
 	 * Find the exclude rule that matches 'text'.
 	 * Return 0 if there is no match.
@@ -293,12 +314,35 @@ namespace QDirStat
          **/
         void addDefaultRules();
 
+        /**
+         * Return the first rule in the list that matches 'fullPath' or
+         * 'fileName' or 0 if there is none.
+         *
+         * Rules with a plain text, "*suffix" or "prefix*" pattern are looked
+         * up in hash tables, so only the remaining rules are checked one by
+         * one with their regexp, and only those before any rule that
+         * matched in a hash table.
+         **/
+        ExcludeRule * findMatchingRule( const QString & fullPath,
+                                        const QString & fileName );
+
+        /**
+         * Build the index of the rules for findMatchingRule().
+         **/
+        void buildIndex();
+
+        /**
+         * Drop the index of the rules. It is built again when needed.
+         **/
+        void dropIndex();
+
     private:
 
 	ExcludeRuleList		 _rules;
 	ListMover<ExcludeRule *> _listMover;
 	ExcludeRule *		 _lastMatchingRule;
         bool                     _defaultRulesAdded;
+        ExcludeRulesIndex *      _index;
     };
 
 
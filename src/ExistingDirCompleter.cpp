@@ -7,9 +7,11 @@
  */
 
 
-#include <QFileSystemModel>
+#include <QWidget>
 
 #include "ExistingDirCompleter.h"
+#include "DirLookup.h"
+#include "AdaptiveTimer.h"
 #include "Logger.h"
 #include "Exception.h"
 
@@ -18,16 +20,27 @@ using namespace QDirStat;
 
 
 ExistingDirCompleter::ExistingDirCompleter( QObject * parent ):
-    QCompleter( parent )
+    QCompleter( parent ),
+    _lookupTimer( new AdaptiveTimer( this ) ),
+    _model( new QStringListModel( this ) )
 {
-    QFileSystemModel * model = new QFileSystemModel( this );
-    CHECK_NEW( model );
+    CHECK_NEW( _lookupTimer );
+    CHECK_NEW( _model );
 
-    model->setRootPath( "/" );
-    model->setFilter( QDir::Dirs );
-    model->setReadOnly( true );
+    _lookupTimer->addDelayStage(   0 );
+    _lookupTimer->addDelayStage( 200 ); // millisec
+    _lookupTimer->addDelayStage( 500 ); // millisec
 
-    setModel( model );
+    _lookupTimer->addCoolDownPeriod(  500 ); // millisec
+    _lookupTimer->addCoolDownPeriod( 1500 ); // millisec
+
+    connect( _lookupTimer, SIGNAL( deliverRequest( QVariant ) ),
+             this,         SLOT  ( lookup        ( QVariant ) ) );
+
+    connect( DirLookup::instance(), SIGNAL( subDirsFound( QString, QStringList ) ),
+             this,                  SLOT  ( subDirsFound( QString, QStringList ) ) );
+
+    setModel( _model );
 }
 
 
@@ -36,3 +49,66 @@ ExistingDirCompleter::~ExistingDirCompleter()
     // NOP
 }
 
+
+QStringList ExistingDirCompleter::splitPath( const QString & path ) const
+{
+    // The directory that is being typed is everything up to the last slash:
+    // "/usr/li" -> "/usr"
+
+    int slash = path.lastIndexOf( '/' );
+    QString dir = slash < 0 ? QString() : DirLookup::normalized( path.left( slash + 1 ) );
+
+    if ( dir != _dir )
+    {
+        // Don't change the model while the completer is using it; do that
+        // when back in the event loop.
+
+        _dir = dir;
+        _lookupTimer->delayedRequest( dir );
+    }
+
+    // The model contains complete paths, so match against the complete path
+
+    return QStringList() << path;
+}
+
+
+void ExistingDirCompleter::lookup( const QVariant & dir )
+{
+    if ( dir.toString() != _dir || _dir == _modelDir )
+        return;
+
+    QStringList subDirs;
+
+    if ( _dir.isEmpty() || DirLookup::instance()->knownSubDirs( _dir, subDirs ) )
+        showSubDirs( _dir, subDirs );
+    else
+        DirLookup::instance()->requestSubDirs( _dir );
+}
+
+
+void ExistingDirCompleter::subDirsFound( const QString & dir, const QStringList & subDirs )
+{
+    if ( dir != _dir || dir == _modelDir )
+        return;
+
+    showSubDirs( dir, subDirs );
+}
+
+
+void ExistingDirCompleter::showSubDirs( const QString & dir, const QStringList & subDirs )
+{
+    QString prefix = dir.endsWith( '/' ) ? dir : dir + '/';
+    QStringList paths;
+
+    foreach ( const QString & subDir, subDirs )
+        paths << prefix + subDir;
+
+    _model->setStringList( paths );
+    _modelDir = dir;
+
+    // Show the completions that are now there if the user is still typing
+
+    if ( widget() && widget()->hasFocus() && ! paths.isEmpty() )
+        complete();
+}
@@ -12,14 +12,24 @@
 
 
 #include <QCompleter>
+#include <QVariant>
+#include <QStringListModel>
 
 
 namespace QDirStat
 {
+    class AdaptiveTimer;
+
+
     /**
      * Completer class for QCombobox and related to complete names of existing
      * directories.
      *
+     * This never blocks on I/O: The subdirectories of the directory that is
+     * being typed are taken from the in-memory DirTree or from a recent
+     * lookup if possible, otherwise they are listed in the background (see
+     * DirLookup), and the completions are shown when they are there.
+     *
      * See ShowUnpkgFilesDialog for a usage example.
      **/
     class ExistingDirCompleter: public QCompleter
@@ -38,6 +48,42 @@ namespace QDirStat
          **/
         virtual ~ExistingDirCompleter();
 
+        /**
+         * Split 'path' for matching against the model. Reimplemented from
+         * QCompleter: This is called for each new completion prefix, so
+         * this also makes sure the model has the subdirectories of the
+         * directory that 'path' is in.
+         **/
+        virtual QStringList splitPath( const QString & path ) const Q_DECL_OVERRIDE;
+
+
+    protected slots:
+
+        /**
+         * Start listing directory 'dir' (a QString) in the background.
+         **/
+        void lookup( const QVariant & dir );
+
+        /**
+         * Notification that the subdirectories of 'dir' are listed.
+         **/
+        void subDirsFound( const QString & dir, const QStringList & subDirs );
+
+
+    protected:
+
+        /**
+         * Fill the model with the subdirectories of 'dir' and show the
+         * completions.
+         **/
+        void showSubDirs( const QString & dir, const QStringList & subDirs );
+
+
+        AdaptiveTimer *         _lookupTimer;
+        QStringListModel *      _model;
+        mutable QString         _dir;           // Dir that is wanted in the model
+        QString                 _modelDir;      // Dir that is in the model
+
     };  // class ExistingDirCompleter
 
 }       // namespace QDirStat
@@ -7,9 +7,9 @@
  */
 
 
-#include <QDir>
-
 #include "ExistingDirValidator.h"
+#include "DirLookup.h"
+#include "AdaptiveTimer.h"
 #include "Logger.h"
 #include "Exception.h"
 
@@ -18,8 +18,23 @@ using namespace QDirStat;
 
 
 ExistingDirValidator::ExistingDirValidator( QObject * parent ):
-    QValidator( parent )
+    QValidator( parent ),
+    _lookupTimer( new AdaptiveTimer( this ) )
 {
+    CHECK_NEW( _lookupTimer );
+
+    _lookupTimer->addDelayStage(   0 );
+    _lookupTimer->addDelayStage( 200 ); // millisec
+    _lookupTimer->addDelayStage( 500 ); // millisec
+
+    _lookupTimer->addCoolDownPeriod(  500 ); // millisec
+    _lookupTimer->addCoolDownPeriod( 1500 ); // millisec
+
+    connect( _lookupTimer, SIGNAL( deliverRequest( QVariant ) ),
+	     this,	   SLOT	 ( lookup	 ( QVariant ) ) );
+
+    connect( DirLookup::instance(), SIGNAL( isDirFound( QString, bool ) ),
+	     this,		    SLOT  ( isDirFound( QString, bool ) ) );
 }
 
 
@@ -34,7 +49,16 @@ ExistingDirValidator::validate( QString & input, int & pos) const
 {
     Q_UNUSED( pos );
 
-    bool ok = ! input.isEmpty() && QDir( input ).exists();
+    bool ok = false;
+    _input = DirLookup::normalized( input );
+
+    if ( ! _input.isEmpty() && ! DirLookup::instance()->knownIsDir( _input, ok ) )
+    {
+	// Don't wait for the filesystem: It might be a dead network mount
+
+	ok = false;
+	_lookupTimer->delayedRequest( _input );
+    }
 
     // This is a complex way to do
     //    emit isOk( ok );
@@ -50,3 +74,20 @@ ExistingDirValidator::validate( QString & input, int & pos) const
 
     return ok ? QValidator::Acceptable : QValidator::Intermediate;
 }
+
+
+void ExistingDirValidator::lookup( const QVariant & path )
+{
+    if ( path.toString() == _input )
+	DirLookup::instance()->requestIsDir( _input );
+}
+
+
+void ExistingDirValidator::isDirFound( const QString & path, bool isDir )
+{
+    if ( path != _input )
+	return;
+
+    emit isOk( isDir );
+    emit changed();	// Let the widget validate its input again
+}
@@ -11,14 +11,23 @@
 
 
 #include <QValidator>
+#include <QVariant>
 
 
 namespace QDirStat
 {
+    class AdaptiveTimer;
+
+
     /**
      * Validator class for QCombobox and related to validate names of existing
      * directories.
      *
+     * This never blocks on I/O: Paths that are not known from the in-memory
+     * DirTree or from a recent lookup are checked in the background (see
+     * DirLookup), and the result is signalled later with isOk(). Until then,
+     * the input is only Intermediate.
+     *
      * See ShowUnpkgFilesDialog for a usage example.
      **/
     class ExistingDirValidator: public QValidator
@@ -47,6 +56,25 @@ namespace QDirStat
 
 	void isOk( bool ok );
 
+
+    protected slots:
+
+	/**
+	 * Start the background check of 'path' (a QString).
+	 **/
+	void lookup( const QVariant & path );
+
+	/**
+	 * Notification that the background check of 'path' is done.
+	 **/
+	void isDirFound( const QString & path, bool isDir );
+
+
+    protected:
+
+	AdaptiveTimer * _lookupTimer;
+	mutable QString _input;		// Normalized
+
     };	// class ExistingDirValidator
 
 }	// namespace QDirStat
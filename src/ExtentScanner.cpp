@@ -0,0 +1,451 @@
+/*
+ *   File name: ExtentScanner.cpp
+ *   Summary:	Exclusive and shared disk usage of files from their extents
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <fcntl.h>	// open()
+#include <string.h>	// memset()
+#include <unistd.h>	// lseek(), close()
+#include <sys/ioctl.h>
+
+#ifdef __linux__
+#  include <linux/fs.h>		// FS_IOC_FIEMAP
+#  include <linux/fiemap.h>
+#  define HAVE_FIEMAP	1
+#else
+#  define HAVE_FIEMAP	0
+#endif
+
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+#include "ExtentScanner.h"
+#include "FileInfo.h"
+#include "FileInfoIterator.h"
+#include "DirTree.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Files smaller than this are not probed by default. Small files are the
+// vast majority, but they hardly matter for the disk usage.
+
+#define DEFAULT_EXTENT_MIN_FILE_SIZE	(1024*1024)
+
+// Number of files each worker probes in one go
+
+#define EXTENT_BATCH_SIZE		64
+
+// Number of extents to fetch with each FIEMAP call
+
+#define FIEMAP_EXTENT_COUNT		256
+
+#define VERBOSE_EXTENT_SCANNER		0
+
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Worker for probing a batch of files in a thread of the pool.
+     **/
+    class ExtentWorker: public QRunnable
+    {
+    public:
+
+	ExtentWorker( ExtentScanner *	    scanner,
+		      int		    generation,
+		      const ExtentJobList & jobs ):
+	    _scanner( scanner ),
+	    _generation( generation ),
+	    _jobs( jobs )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    for ( int i=0; i < _jobs.size(); ++i )
+	    {
+		ExtentJob & job = _jobs[i];
+		job.ok = ExtentScanner::probe( job.path, job.usage );
+	    }
+
+	    // The scanner waits for all workers in its destructor, so it
+	    // is still there.
+
+	    _scanner->workerDone( _generation, _jobs );
+	}
+
+    protected:
+
+	ExtentScanner * _scanner;
+	int		_generation;
+	ExtentJobList	_jobs;
+    };
+}
+
+
+#if HAVE_FIEMAP
+
+/**
+ * Sum up the extents of the open file 'fd' in 'usage_ret'. Return 'false'
+ * if the filesystem does not support FIEMAP.
+ **/
+static bool fiemapUsage( int fd, ExtentUsage & usage_ret )
+{
+    QByteArray buffer( sizeof( struct fiemap ) +
+		       FIEMAP_EXTENT_COUNT * sizeof( struct fiemap_extent ), 0 );
+    struct fiemap * map = (struct fiemap *) buffer.data();
+    __u64 start = 0;
+
+    while ( true )
+    {
+	memset( map, 0, buffer.size() );
+	map->fm_start	     = start;
+	map->fm_length	     = FIEMAP_MAX_OFFSET - start;
+	map->fm_extent_count = FIEMAP_EXTENT_COUNT;
+
+	if ( ioctl( fd, FS_IOC_FIEMAP, map ) < 0 )
+	    return false;
+
+	if ( map->fm_mapped_extents == 0 )
+	    return true;
+
+	for ( __u32 i=0; i < map->fm_mapped_extents; ++i )
+	{
+	    const struct fiemap_extent & extent = map->fm_extents[i];
+
+	    // Inline data is stored in the metadata, not in a block of its own
+
+	    if ( ! ( extent.fe_flags & FIEMAP_EXTENT_DATA_INLINE ) )
+	    {
+		if ( extent.fe_flags & FIEMAP_EXTENT_SHARED )
+		    usage_ret.shared	+= extent.fe_length;
+		else
+		    usage_ret.exclusive += extent.fe_length;
+	    }
+
+	    if ( extent.fe_flags & FIEMAP_EXTENT_LAST )
+		return true;
+
+	    start = extent.fe_logical + extent.fe_length;
+	}
+    }
+}
+
+#endif	// HAVE_FIEMAP
+
+
+/**
+ * Sum up the data regions of the open file 'fd' between the holes in
+ * 'usage_ret'. Return 'false' if that is not supported.
+ **/
+static bool seekHoleUsage( int fd, ExtentUsage & usage_ret )
+{
+#if defined( SEEK_DATA ) && defined( SEEK_HOLE )
+    off_t end = lseek( fd, 0, SEEK_END );
+
+    if ( end < 0 )
+	return false;
+
+    off_t pos = 0;
+
+    while ( pos < end )
+    {
+	off_t data = lseek( fd, pos, SEEK_DATA );
+
+	if ( data < 0 )		// ENXIO: Only a hole up to the end
+	    break;
+
+	off_t hole = lseek( fd, data, SEEK_HOLE );
+
+	if ( hole < 0 )
+	    return false;
+
+	usage_ret.exclusive += hole - data;
+	pos = hole;
+    }
+
+    return true;
+#else
+    Q_UNUSED( fd );
+    Q_UNUSED( usage_ret );
+
+    return false;
+#endif
+}
+
+
+ExtentScanner::ExtentScanner( DirTree * tree ):
+    QObject(),
+    _tree( tree ),
+    _enabled( false ),
+    _minFileSize( DEFAULT_EXTENT_MIN_FILE_SIZE ),
+    _generation( 0 ),
+    _pendingCount( 0 ),
+    _lastSubtree( 0 ),
+    _lastSubtreeValid( false ),
+    _collectScheduled( false )
+{
+    // This is mostly waiting for the disk; don't compete with the GUI thread
+    _threadPool.setMaxThreadCount( qMax( 1, QThread::idealThreadCount() - 1 ) );
+}
+
+
+ExtentScanner::~ExtentScanner()
+{
+    cancel();
+    _threadPool.waitForDone();
+}
+
+
+void ExtentScanner::start( FileInfo * subtree )
+{
+    cancel();
+
+    if ( ! subtree )
+	return;
+
+    ExtentJobList jobs;
+    collectJobs( subtree, jobs );
+
+    logInfo() << "Probing the extents of " << jobs.size() << " files of at least "
+	      << formatSize( _minFileSize ) << " in " << subtree << endl;
+
+    for ( int start = 0; start < jobs.size(); start += EXTENT_BATCH_SIZE )
+    {
+	ExtentWorker * worker = new ExtentWorker( this, _generation,
+						  jobs.mid( start, EXTENT_BATCH_SIZE ) );
+	CHECK_NEW( worker );
+
+	_threadPool.start( worker );	// takes over ownership
+    }
+
+    _pendingCount = jobs.size();
+
+    if ( _pendingCount == 0 )
+	emit finished();
+}
+
+
+void ExtentScanner::cancel()
+{
+    // Workers that did not start yet are simply dropped; the results of
+    // those that are running will be ignored because of the new generation.
+
+    _threadPool.clear();
+
+    QMutexLocker locker( &_mutex );
+    _results.clear();
+    ++_generation;
+    _pendingCount = 0;
+    _removed.clear();
+}
+
+
+void ExtentScanner::clear()
+{
+    cancel();
+    _usage.clear();
+    _lastSubtreeValid = false;
+}
+
+
+void ExtentScanner::remove( FileInfo * file )
+{
+    if ( _pendingCount > 0 )
+    {
+	// A worker might still be probing it; drop that result when it comes
+
+	_removed.insert( file );
+    }
+
+    if ( ! _usage.isEmpty() && _usage.remove( file ) > 0 )
+	_lastSubtreeValid = false;
+}
+
+
+bool ExtentScanner::usage( FileInfo * file, ExtentUsage & usage_ret ) const
+{
+    QHash<FileInfo *, ExtentUsage>::const_iterator it = _usage.constFind( file );
+
+    if ( it == _usage.constEnd() )
+	return false;
+
+    usage_ret = it.value();
+
+    return true;
+}
+
+
+ExtentUsage ExtentScanner::subtreeUsage( FileInfo * subtree )
+{
+    if ( _lastSubtreeValid && subtree == _lastSubtree )
+	return _lastSubtreeUsage;
+
+    ExtentUsage sum;
+
+    for ( QHash<FileInfo *, ExtentUsage>::const_iterator it = _usage.constBegin();
+	  it != _usage.constEnd();
+	  ++it )
+    {
+	FileInfo * file = it.key();
+
+	if ( subtree && ! file->isInSubtree( subtree ) )
+	    continue;
+
+	ExtentUsage usage = it.value();
+
+	// Distribute hard links just like FileInfo::allocatedSize()
+
+	if ( file->links() > 1 && ! FileInfo::ignoreHardLinks() )
+	{
+	    usage.exclusive /= file->links();
+	    usage.shared    /= file->links();
+	}
+
+	sum.exclusive += usage.exclusive;
+	sum.shared    += usage.shared;
+    }
+
+    _lastSubtree      = subtree;
+    _lastSubtreeUsage = sum;
+    _lastSubtreeValid = true;
+
+    return sum;
+}
+
+
+void ExtentScanner::collectJobs( FileInfo * dir, ExtentJobList & jobs )
+{
+    FileInfoList dirs;
+    dirs << dir;
+
+    while ( ! dirs.isEmpty() )
+    {
+	FileInfoIterator it( dirs.takeLast() );
+
+	while ( *it )
+	{
+	    FileInfo * item = *it;
+
+	    if ( item->hasChildren() )
+		dirs << item;
+
+	    if ( item->isFile() && item->isLocalFile() &&
+		 item->rawByteSize() >= _minFileSize )
+	    {
+		ExtentJob job;
+		job.file = item;
+		job.path = item->url();
+		job.ok	 = false;
+
+		jobs << job;
+	    }
+
+	    ++it;
+	}
+    }
+}
+
+
+bool ExtentScanner::probe( const QString & path, ExtentUsage & usage_ret )
+{
+    usage_ret = ExtentUsage();
+
+    int fd = open( path.toUtf8().constData(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC | O_NONBLOCK );
+
+    if ( fd < 0 )
+	return false;
+
+    bool ok = false;
+
+#if HAVE_FIEMAP
+    ok = fiemapUsage( fd, usage_ret );
+#endif
+
+    if ( ! ok )
+    {
+	usage_ret = ExtentUsage();
+	ok = seekHoleUsage( fd, usage_ret );
+    }
+
+    close( fd );
+
+    return ok;
+}
+
+
+void ExtentScanner::workerDone( int generation, const ExtentJobList & jobs )
+{
+    QMutexLocker locker( &_mutex );
+
+    _results << ExtentResultPair( generation, jobs );
+
+    if ( ! _collectScheduled )
+    {
+	_collectScheduled = true;
+	QMetaObject::invokeMethod( this, "collectResults", Qt::QueuedConnection );
+    }
+}
+
+
+void ExtentScanner::collectResults()
+{
+    QList<ExtentResultPair> results;
+
+    {
+	QMutexLocker locker( &_mutex );
+	results = _results;
+	_results.clear();
+	_collectScheduled = false;
+    }
+
+    if ( results.isEmpty() )	// Cancelled in the meantime
+	return;
+
+    int failed = 0;
+
+    foreach ( const ExtentResultPair & result, results )
+    {
+	if ( result.first != _generation )	// Files might be long gone
+	    continue;
+
+	foreach ( const ExtentJob & job, result.second )
+	{
+	    if ( _removed.contains( job.file ) )
+		continue;
+
+	    if ( job.ok )
+		_usage.insert( job.file, job.usage );
+	    else
+		++failed;
+	}
+
+	_pendingCount -= result.second.size();
+    }
+
+    _lastSubtreeValid = false;
+
+#if VERBOSE_EXTENT_SCANNER
+    if ( failed > 0 )
+	logDebug() << failed << " files could not be probed" << endl;
+#else
+    Q_UNUSED( failed );
+#endif
+
+    if ( _pendingCount <= 0 )
+    {
+	_pendingCount = 0;
+	_removed.clear();
+	logInfo() << "Extents of " << _usage.size() << " files probed" << endl;
+	emit finished();
+    }
+}
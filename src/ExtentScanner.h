@@ -0,0 +1,230 @@
+/*
+ *   File name: ExtentScanner.h
+ *   Summary:	Exclusive and shared disk usage of files from their extents
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ExtentScanner_h
+#define ExtentScanner_h
+
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+#include "FileSize.h"
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class FileInfo;
+
+
+    /**
+     * Disk usage of one file according to its extents.
+     **/
+    struct ExtentUsage
+    {
+	ExtentUsage(): exclusive( 0 ), shared( 0 ) {}
+
+	FileSize exclusive;	// bytes in extents that only this file uses
+	FileSize shared;	// bytes in extents shared with other files (reflinks, snapshots)
+
+	FileSize total() const { return exclusive + shared; }
+    };
+
+
+    /**
+     * One file to probe in the worker threads. The path is copied in the
+     * GUI thread, so the workers don't need to access the FileInfo.
+     **/
+    struct ExtentJob
+    {
+	FileInfo *  file;
+	QString	    path;
+	ExtentUsage usage;
+	bool	    ok;
+    };
+
+    typedef QVector<ExtentJob> ExtentJobList;
+    typedef QPair<int, ExtentJobList> ExtentResultPair;	// generation, jobs
+
+
+    /**
+     * Extent-aware disk usage for the larger files of a DirTree.
+     *
+     * st_blocks (and thus FileInfo::allocatedSize()) counts every block a
+     * file refers to, so on filesystems with reflinks or snapshots (Btrfs,
+     * XFS) extents that are shared between several files are counted once
+     * for each of them. This asks the filesystem for the extents of each file
+     * (the FIEMAP ioctl) and sums up the bytes that are shared with other
+     * files separately from those that belong to this file alone. If a
+     * filesystem does not support FIEMAP, the data regions are located with
+     * SEEK_DATA / SEEK_HOLE instead; they are all counted as exclusive.
+     *
+     * This is optional and off by default. If it is enabled, the owning
+     * DirTree starts it when reading is finished. To keep the cost bounded,
+     * only regular local files of at least minFileSize() bytes are probed;
+     * this is done in batches in a thread pool of its own while the GUI
+     * keeps going. finished() is emitted when all results are there.
+     **/
+    class ExtentScanner: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	ExtentScanner( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~ExtentScanner();
+
+	/**
+	 * Return 'true' if the extents are probed after each scan.
+	 **/
+	bool enabled() const { return _enabled; }
+
+	/**
+	 * Enable or disable probing the extents after each scan.
+	 **/
+	void setEnabled( bool enabled ) { _enabled = enabled; }
+
+	/**
+	 * Return the size from which on files are probed.
+	 **/
+	FileSize minFileSize() const { return _minFileSize; }
+
+	/**
+	 * Set the size from which on files are probed.
+	 **/
+	void setMinFileSize( FileSize size ) { _minFileSize = size; }
+
+	/**
+	 * Probe the files in 'subtree' in the background. Any previous run is
+	 * cancelled.
+	 **/
+	void start( FileInfo * subtree );
+
+	/**
+	 * Cancel probing. The results that are already there are kept.
+	 **/
+	void cancel();
+
+	/**
+	 * Remove all results and cancel probing.
+	 **/
+	void clear();
+
+	/**
+	 * Remove the result for 'file' if there is one. This is called when
+	 * the file is destroyed.
+	 **/
+	void remove( FileInfo * file );
+
+	/**
+	 * Return 'true' if there are no results.
+	 **/
+	bool isEmpty() const { return _usage.isEmpty(); }
+
+	/**
+	 * Return 'true' if files are still being probed.
+	 **/
+	bool isBusy() const { return _pendingCount > 0; }
+
+	/**
+	 * Return the extent usage of 'file' in 'usage_ret'. Return 'false' if
+	 * there is none because it was not probed.
+	 **/
+	bool usage( FileInfo * file, ExtentUsage & usage_ret ) const;
+
+	/**
+	 * Return the sum of the extent usage of all probed files in 'subtree'.
+	 * Files that were not probed are not included.
+	 **/
+	ExtentUsage subtreeUsage( FileInfo * subtree );
+
+	/**
+	 * Return the extent usage of the file at 'path' in 'usage_ret'.
+	 * Return 'false' if the extents could not be determined.
+	 *
+	 * This is called in the worker threads.
+	 **/
+	static bool probe( const QString & path, ExtentUsage & usage_ret );
+
+
+    signals:
+
+	/**
+	 * Emitted when probing is finished (but not when it is cancelled).
+	 **/
+	void finished();
+
+
+    protected slots:
+
+	/**
+	 * Take over the results of the workers. This is called in the GUI
+	 * thread.
+	 **/
+	void collectResults();
+
+
+    protected:
+
+	/**
+	 * Add the files to probe in 'dir' recursively to 'jobs'.
+	 **/
+	void collectJobs( FileInfo * dir, ExtentJobList & jobs );
+
+	/**
+	 * Notification from a worker thread that it is done with 'jobs'.
+	 **/
+	void workerDone( int generation, const ExtentJobList & jobs );
+
+	friend class ExtentWorker;
+
+
+	//
+	// Data members
+	//
+
+	DirTree *			_tree;
+	bool				_enabled;
+	FileSize			_minFileSize;
+	QThreadPool			_threadPool;
+	int				_generation;
+	int				_pendingCount;
+	QHash<FileInfo *, ExtentUsage>	_usage;
+	QSet<FileInfo *>		_removed;	// while workers are busy
+
+	// Cache for subtreeUsage()
+	FileInfo *			_lastSubtree;
+	ExtentUsage			_lastSubtreeUsage;
+	bool				_lastSubtreeValid;
+
+	// Shared with the worker threads; protected by _mutex
+	QMutex				_mutex;
+	QList<ExtentResultPair>		_results;
+	bool				_collectScheduled;
+
+    };	// class ExtentScanner
+
+}	// namespace QDirStat
+
+
+#endif // ifndef ExtentScanner_h
@@ -10,9 +10,10 @@
 #include <QDate>
 
 #include "FileAgeStats.h"
-#include "FileInfoIterator.h"
+#include "TreeColumns.h"
 #include "Logger.h"
 #include "Exception.h"
+#include "Trace.h"
 
 using namespace QDirStat;
 
@@ -64,51 +65,104 @@ void FileAgeStats::clearMonthStats( short year )
 
 void FileAgeStats::collect( FileInfo * subtree )
 {
+    TRACE_SPAN( "FileAgeStats::collect" );
+
     clear();
-    collectRecursive( subtree );
-    calcPercentages();
-    collectYears();
+
+    StatsEngine engine;
+    engine.addCollector( this );
+    engine.collect( subtree );
 }
 
 
-void FileAgeStats::collectRecursive( FileInfo * dir )
+void FileAgeStats::startCollecting( FileInfo * subtree )
 {
-    if ( ! dir )
-	return;
+    Q_UNUSED( subtree );
 
-    FileInfoIterator it( dir );
+    clear();
+}
 
-    while ( *it )
+
+void FileAgeStats::collectItem( FileInfo * item )
+{
+    if ( ! item->isFile() )
+        return;
+
+    addFile( item->mtimeYear(), item->mtimeMonth(), item->size() );
+}
+
+
+void FileAgeStats::collectColumns( const TreeColumns & columns, int first, int end )
+{
+    const quint8   * flags  = columns.flags().constData();
+    const short    * years  = columns.mtimeYears().constData();
+    const qint8    * months = columns.mtimeMonths().constData();
+    const FileSize * sizes  = columns.sizes().constData();
+
+    for ( int i = first; i < end; ++i )
     {
-	FileInfo * item = *it;
+        if ( flags[ i ] & TreeColumns::ItemIsFile )
+            addFile( years[ i ], months[ i ], sizes[ i ] );
+    }
+}
 
-        if ( item && item->isFile() )
-        {
-            short year  = item->mtimeYear();
-            short month = item->mtimeMonth();
 
-            YearStats &yearStats = _yearStats[ year ];
+void FileAgeStats::addFile( short year, short month, FileSize size )
+{
+    YearStats &yearStats = _yearStats[ year ];
 
-            yearStats.year = year;
-            yearStats.filesCount++;
-            yearStats.size += item->size();
+    yearStats.year = year;
+    yearStats.filesCount++;
+    yearStats.size += size;
 
-            YearStats * monthStats = this->monthStats( year, month );
+    YearStats * monthStats = this->monthStats( year, month );
+
+    if ( monthStats )
+    {
+        monthStats->filesCount++;
+        monthStats->size += size;
+    }
+}
 
-            if ( monthStats )
-            {
-                monthStats->filesCount++;
-                monthStats->size += item->size();
-            }
-        }
 
-	if ( item->hasChildren() )
-	{
-	    collectRecursive( item );
-	}
+StatsCollector * FileAgeStats::createPartial() const
+{
+    FileAgeStats * partial = new FileAgeStats();
+    CHECK_NEW( partial );
+
+    return partial;
+}
+
+
+void FileAgeStats::merge( StatsCollector * partial )
+{
+    FileAgeStats * stats = static_cast<FileAgeStats *>( partial );
+
+    foreach ( const YearStats & partialStats, stats->_yearStats )
+    {
+        YearStats & yearStats = _yearStats[ partialStats.year ];
 
-        ++it;
+        yearStats.year        = partialStats.year;
+        yearStats.filesCount += partialStats.filesCount;
+        yearStats.size       += partialStats.size;
     }
+
+    for ( int i = 0; i < 12; i++ )
+    {
+        _thisYearMonthStats[ i ].filesCount += stats->_thisYearMonthStats[ i ].filesCount;
+        _thisYearMonthStats[ i ].size       += stats->_thisYearMonthStats[ i ].size;
+        _lastYearMonthStats[ i ].filesCount += stats->_lastYearMonthStats[ i ].filesCount;
+        _lastYearMonthStats[ i ].size       += stats->_lastYearMonthStats[ i ].size;
+    }
+}
+
+
+void FileAgeStats::finishCollecting( FileInfo * subtree )
+{
+    Q_UNUSED( subtree );
+
+    calcPercentages();
+    collectYears();
 }
 
 
@@ -14,6 +14,7 @@
 #include <QList>
 
 #include "FileInfo.h"
+#include "StatsEngine.h"
 
 
 namespace QDirStat
@@ -32,7 +33,7 @@ namespace QDirStat
 
 	short		year;           // 1970-2037 (time_t range)
         short           month;          // 1-12 or 0 for the  complete year
-	int		filesCount;
+	FileCount	filesCount;
 	float		filesPercent;	// 0.0 .. 100.0
 	FileSize	size;
 	float		sizePercent;	// 0.0 .. 100.0
@@ -52,8 +53,11 @@ namespace QDirStat
     /**
      * Class for calculating and storing file age statistics, i.e. statistics
      * about the years of the last modification times of files in a subtree.
+     *
+     * This is also a StatsCollector, so it can be collected by a StatsEngine
+     * together with other statistics in one traversal of the tree.
      **/
-    class FileAgeStats
+    class FileAgeStats: public StatsCollector
     {
     public:
 
@@ -122,19 +126,32 @@ namespace QDirStat
          **/
         static short lastYear();
 
+        //
+        // Reimplemented from StatsCollector
+        //
+
+        virtual void startCollecting( FileInfo * subtree ) Q_DECL_OVERRIDE;
+        virtual void collectItem( FileInfo * item ) Q_DECL_OVERRIDE;
+        virtual bool canCollectColumns() const Q_DECL_OVERRIDE { return true; }
+        virtual void collectColumns( const TreeColumns & columns, int first, int end ) Q_DECL_OVERRIDE;
+        virtual StatsCollector * createPartial() const Q_DECL_OVERRIDE;
+        virtual void merge( StatsCollector * partial ) Q_DECL_OVERRIDE;
+        virtual void finishCollecting( FileInfo * subtree ) Q_DECL_OVERRIDE;
+        virtual QString cacheKey() const Q_DECL_OVERRIDE { return "FileAgeStats"; }
+
 
     protected:
 
         /**
-         * Clear all month stats for this or the last year.
+         * Add a file with modification time 'year' and 'month' and size
+         * 'size'.
          **/
-        void clearMonthStats( short year );
+        void addFile( short year, short month, FileSize size );
 
         /**
-         * Recurse through all file elements in the subtree and calculate the
-         * data for that subtree.
+         * Clear all month stats for this or the last year.
          **/
-    	void collectRecursive( FileInfo * subtree );
+        void clearMonthStats( short year );
 
         /**
          * Sum up the totals over all years and calculate the percentages for
@@ -164,7 +181,7 @@ namespace QDirStat
         YearStats       _thisYearMonthStats[ 12 ];
         YearStats       _lastYearMonthStats[ 12 ];
 
-        int             _totalFilesCount;
+        FileCount       _totalFilesCount;
         FileSize        _totalFilesSize;
 
         static short    _thisYear;
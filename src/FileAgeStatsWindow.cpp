@@ -8,6 +8,7 @@
 
 
 #include "FileAgeStatsWindow.h"
+#include "SharedStats.h"
 #include "DirTree.h"
 #include "Settings.h"
 #include "SettingsHelpers.h"
@@ -27,7 +28,7 @@ using namespace QDirStat;
 FileAgeStatsWindow::FileAgeStatsWindow( QWidget * parent ):
     QDialog( parent ),
     _ui( new Ui::FileAgeStatsWindow ),
-    _stats( new FileAgeStats( 0 ) ),
+    _stats( 0 ),
     _filesPercentBarDelegate( 0 ),
     _sizePercentBarDelegate( 0 ),
     _startGapsWithCurrentYear( true )
@@ -35,11 +36,13 @@ FileAgeStatsWindow::FileAgeStatsWindow( QWidget * parent ):
     // logDebug() << "init" << endl;
 
     CHECK_NEW( _ui );
-    CHECK_NEW( _stats );
 
     _ui->setupUi( this );
     initWidgets();
     readSettings();
+
+    connect( SharedStats::instance(), SIGNAL( finished()	),
+	     this,		      SLOT  ( statsFinished() ) );
 }
 
 
@@ -47,20 +50,19 @@ FileAgeStatsWindow::~FileAgeStatsWindow()
 {
     writeSettings();
 
-    delete _stats;
     delete _ui;
 }
 
 
 void FileAgeStatsWindow::clear()
 {
-    _stats->clear();
     _ui->treeWidget->clear();
 }
 
 
 void FileAgeStatsWindow::refresh()
 {
+    SharedStats::instance()->invalidate();
     populate( _subtree() );
 }
 
@@ -154,10 +156,25 @@ void FileAgeStatsWindow::populate( FileInfo * newSubtree )
     _ui->heading->setText( tr( "File Age Statistics for %1" )
                            .arg( _subtree.url() ) );
 
+    // The list is filled in statsFinished()
+    SharedStats::instance()->start( _subtree() );
+}
+
+
+void FileAgeStatsWindow::statsFinished()
+{
+    SharedStats * sharedStats = SharedStats::instance();
+
+    // Another window might have requested another subtree
+    if ( ! _subtree() || sharedStats->subtree() != _subtree() )
+        return;
+
+    clear();
+
     // For better Performance: Disable sorting while inserting many items
     _ui->treeWidget->setSortingEnabled( false );
 
-    _stats->collect( _subtree() );
+    _stats = sharedStats->fileAgeStats();
     populateListWidget();
 
     _ui->treeWidget->setSortingEnabled( true );
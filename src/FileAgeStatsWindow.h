@@ -124,6 +124,11 @@ namespace QDirStat
          **/
         void enableActions();
 
+        /**
+         * Fill the list when the statistics for the subtree are there.
+         **/
+        void statsFinished();
+
 
     protected:
 
@@ -164,7 +169,7 @@ namespace QDirStat
 	//
 
 	Ui::FileAgeStatsWindow * _ui;
-	FileAgeStats *		 _stats;
+	FileAgeStats *		 _stats;	// Owned by SharedStats
         PercentBarDelegate *     _filesPercentBarDelegate;
         PercentBarDelegate *     _sizePercentBarDelegate;
 	Subtree			 _subtree;
@@ -12,7 +12,9 @@
 #include "FileDetailsView.h"
 #include "AdaptiveTimer.h"
 #include "DirInfo.h"
+#include "DirTree.h"
 #include "DirTreeModel.h"
+#include "ExtentScanner.h"
 #include "FileInfoSet.h"
 #include "MimeCategorizer.h"
 #include "PkgQuery.h"
@@ -25,6 +27,10 @@
 
 #define ALLOCATED_FAT_PERCENT	33
 #define MAX_SYMLINK_TARGET_LEN	25
+#define MAX_PKG_PREFETCH	50
+
+// Selection changes to process at once for the selection summary
+#define SELECTION_SUMMARY_CHUNK_SIZE	10000
 
 using namespace QDirStat;
 
@@ -33,7 +39,8 @@ FileDetailsView::FileDetailsView( QWidget * parent ):
     QStackedWidget( parent ),
     _ui( new Ui::FileDetailsView ),
     _pkgUpdateTimer( new AdaptiveTimer( this ) ),
-    _labelLimit( 40 )
+    _labelLimit( 40 ),
+    _showSummaryWhenDone( false )
 {
     CHECK_NEW( _ui );
     CHECK_NEW( _pkgUpdateTimer );
@@ -57,6 +64,12 @@ FileDetailsView::FileDetailsView( QWidget * parent ):
 
     connect( _pkgUpdateTimer, SIGNAL( deliverRequest( QVariant ) ),
 	     this,	      SLOT  ( updatePkgInfo ( QVariant ) ) );
+
+    _selectionTimer.setSingleShot( true );
+    _selectionTimer.setInterval( 0 );
+
+    connect( &_selectionTimer, SIGNAL( timeout()		 ),
+	     this,	       SLOT  ( processPendingSelection() ) );
 }
 
 
@@ -90,15 +103,16 @@ void FileDetailsView::setCurrentPage( QWidget *page )
 
 void FileDetailsView::showDetails( const FileInfoSet & selectedItems )
 {
-    FileInfoSet sel = selectedItems.normalized();
+    // Not normalizing the selection here: The selection summary takes care
+    // of items in selected subtrees incrementally.
 
-    if ( sel.isEmpty() )
+    if ( selectedItems.isEmpty() )
     {
 	clear();
     }
-    else if ( sel.size() == 1 )
+    else if ( selectedItems.size() == 1 )
     {
-	FileInfo * item = sel.first();
+	FileInfo * item = selectedItems.first();
 
 	if ( item->isDirInfo() )
 	    showDetails( item->toDirInfo() );
@@ -107,7 +121,7 @@ void FileDetailsView::showDetails( const FileInfoSet & selectedItems )
     }
     else
     {
-	showSelectionSummary( sel );
+	showSelectionSummary( selectedItems );
     }
 }
 
@@ -207,6 +221,7 @@ void FileDetailsView::showFileInfo( FileInfo * file )
 
     setFileSizeLabel( _ui->fileSizeLabel, file );
     setFileAllocatedLabel( _ui->fileAllocatedLabel, file );
+    addSharedExtents( _ui->fileAllocatedLabel, file );
 
     _ui->fileUserCaption->setEnabled( file->hasUid() );
     _ui->fileGroupCaption->setEnabled( file->hasGid() );
@@ -275,6 +290,37 @@ void FileDetailsView::setFileAllocatedLabel( FileSizeLabel * label,
 }
 
 
+void FileDetailsView::addSharedExtents( FileSizeLabel * label,
+					FileInfo *	item )
+{
+    CHECK_PTR( item );
+
+    if ( ! item->tree() || item->tree()->extents()->isEmpty() )
+	return;
+
+    ExtentScanner * extents = item->tree()->extents();
+    ExtentUsage	    usage;
+
+    if ( item->isDirInfo() )
+	usage = extents->subtreeUsage( item );
+    else if ( ! extents->usage( item, usage ) )
+	return;
+
+    if ( usage.shared > 0 )
+    {
+	label->setText( tr( "%1 (%2 shared)" )
+			.arg( label->text() )
+			.arg( formatSize( usage.shared ) ),
+			label->value(),
+			label->prefix() );
+
+	label->setContextText( tr( "%1 exclusive, %2 shared with other files" )
+			       .arg( formatByteSize( usage.exclusive ) )
+			       .arg( formatByteSize( usage.shared ) ) );
+    }
+}
+
+
 void FileDetailsView::showFilePkgInfo( FileInfo * file )
 {
     CHECK_PTR( file );
@@ -288,11 +334,23 @@ void FileDetailsView::showFilePkgInfo( FileInfo * file )
 
         if ( isSystemFile )
         {
-            QString delayHint = QString( _pkgUpdateTimer->delayStage(), '.' );
-            _ui->filePackageLabel->setText( delayHint );
-
-            _ui->filePackageCaption->setEnabled( true );
-            _pkgUpdateTimer->delayedRequest( file->url() );
+	    QString pkg;
+	    _pkgQueryPath = file->url();
+
+	    if ( PkgQuery::cachedOwningPkg( _pkgQueryPath, pkg ) )
+	    {
+		// No need to wait for anything
+
+		owningPkgFound( _pkgQueryPath, pkg );
+	    }
+	    else
+	    {
+		QString delayHint = QString( _pkgUpdateTimer->delayStage(), '.' );
+		_ui->filePackageLabel->setText( delayHint );
+
+		_ui->filePackageCaption->setEnabled( true );
+		_pkgUpdateTimer->delayedRequest( pkgQueryPaths( file ) );
+	    }
         }
     }
     else // No supported package manager found
@@ -302,17 +360,59 @@ void FileDetailsView::showFilePkgInfo( FileInfo * file )
 }
 
 
-void FileDetailsView::updatePkgInfo( const QVariant & pathVariant )
+void FileDetailsView::updatePkgInfo( const QVariant & pathsVariant )
 {
-    QString path = pathVariant.toString();
+    QStringList paths = pathsVariant.toStringList();
+
+    if ( paths.isEmpty() )
+	return;
+
+    QString path = paths.takeFirst();
     // logDebug() << "Updating pkg info for " << path << endl;
 
-    QString pkg = PkgQuery::owningPkg( path );
+    // The package manager might take a while; don't wait for it, but show
+    // the result when it is there (unless the user moved on in the meantime).
+
+    PkgQuery * pkgQuery = PkgQuery::instance();
+
+    connect( pkgQuery, SIGNAL( owningPkgFound( QString, QString ) ),
+	     this,     SLOT  ( owningPkgFound( QString, QString ) ),
+	     Qt::UniqueConnection );
+
+    pkgQuery->requestOwningPkg( path, paths );
+}
+
+
+void FileDetailsView::owningPkgFound( const QString & path, const QString & pkg )
+{
+    if ( path != _pkgQueryPath )
+	return;
+
     _ui->filePackageLabel->setText( pkg );
     _ui->filePackageCaption->setEnabled( ! pkg.isEmpty() );
 }
 
 
+QStringList FileDetailsView::pkgQueryPaths( FileInfo * file )
+{
+    QStringList paths;
+    paths << file->url();
+
+    if ( ! file->parent() )
+	return paths;
+
+    for ( FileInfo * sibling = file->parent()->firstChild();
+	  sibling && paths.size() <= MAX_PKG_PREFETCH;
+	  sibling = sibling->next() )
+    {
+	if ( sibling != file && ! sibling->isPseudoDir() )
+	    paths << sibling->url();
+    }
+
+    return paths;
+}
+
+
 void FileDetailsView::setSystemFileWarningVisibility( bool visible )
 {
     _ui->fileSystemFileWarning->setVisible( visible );
@@ -379,14 +479,24 @@ void FileDetailsView::showSubtreeInfo( DirInfo * dir )
 	    break;
     }
 
+    FileSize estimate = dir->sizeEstimate();
+
+    if ( ! msg.isEmpty() && estimate >= 0 )
+	msg = tr( "~%1 (estimated)" ).arg( formatSize( estimate ) ) + "  " + msg;
+
     if ( msg.isEmpty() )
     {
 	// No special msg -> show summary fields
 
-	QString prefix = dir->sizePrefix();
+	QString  prefix	     = dir->sizePrefix();
+	FileSize sampleError = dir->sampleError();
+
+	if ( sampleError >= 0 )	// Extrapolated from a sampling scan?
+	    prefix = "~";
 
 	setLabel( _ui->dirTotalSizeLabel,   dir->totalSize(),	       prefix );
 	setLabel( _ui->dirAllocatedLabel,   dir->totalAllocatedSize(), prefix );
+	addSharedExtents( _ui->dirAllocatedLabel, dir );
 	setLabel( _ui->dirItemCountLabel,   dir->totalItems(),	       prefix );
 	setLabel( _ui->dirFileCountLabel,   dir->totalFiles(),	       prefix );
 	setLabel( _ui->dirSubDirCountLabel, dir->totalSubDirs(),       prefix );
@@ -394,6 +504,15 @@ void FileDetailsView::showSubtreeInfo( DirInfo * dir )
 
 	suppressIfSameContent( _ui->dirTotalSizeLabel, _ui->dirAllocatedLabel, _ui->dirAllocatedCaption );
 	_ui->dirAllocatedLabel->setBold( dir->totalUsedPercent() < ALLOCATED_FAT_PERCENT );
+
+	if ( sampleError >= 0 )
+	{
+	    _ui->dirTotalSizeLabel->setText( tr( "~%1 %2 %3" )
+					     .arg( formatSize( dir->totalSize() ) )
+					     .arg( QChar( 0x00B1 ) ) // plus-minus sign
+					     .arg( formatSize( sampleError ) ),
+					     dir->totalSize(), prefix );
+	}
     }
     else  // Special msg -> show it and clear all summary fields
     {
@@ -593,24 +712,98 @@ void FileDetailsView::showSelectionSummary( const FileInfoSet & selectedItems )
 {
     // logDebug() << "Showing selection summary" << endl;
 
-    setCurrentPage( _ui->selectionSummaryPage );
-    FileInfoSet sel = selectedItems.normalized();
+    if ( _pendingSelection.isEmpty() &&
+	 _selectionSummary.selectedItems().size() != selectedItems.size() )
+    {
+	// Not in sync with the deltas: Start over with the complete set
+
+	logDebug() << "Rebuilding the summary of " << selectedItems.size() << " items" << endl;
+	_selectionSummary.clear();
+
+	foreach ( FileInfo * item, selectedItems )
+	    _pendingSelection << qMakePair( item, true );
+    }
+
+    _showSummaryWhenDone = true;
+    processPendingSelection();
+}
+
+
+void FileDetailsView::updateSelectionDelta( const FileInfoSet & added,
+					    const FileInfoSet & removed )
+{
+    foreach ( FileInfo * item, removed )
+	_pendingSelection << qMakePair( item, false );
+
+    foreach ( FileInfo * item, added )
+	_pendingSelection << qMakePair( item, true );
+
+    if ( _pendingSelection.size() <= SELECTION_SUMMARY_CHUNK_SIZE )
+	applyPendingSelection( SELECTION_SUMMARY_CHUNK_SIZE );
+    else if ( ! _selectionTimer.isActive() )
+	_selectionTimer.start();
+}
+
+
+void FileDetailsView::processPendingSelection()
+{
+    bool done = applyPendingSelection( SELECTION_SUMMARY_CHUNK_SIZE );
+
+    if ( ! done )
+	_selectionTimer.start();
+
+    if ( _showSummaryWhenDone )
+    {
+	if ( done )
+	    _showSummaryWhenDone = false;
+
+	showSelectionSummary();
+    }
+}
+
+
+bool FileDetailsView::applyPendingSelection( int maxCount )
+{
+    int count = 0;
+
+    while ( ! _pendingSelection.isEmpty() && count++ < maxCount )
+    {
+	QPair<FileInfo *, bool> change = _pendingSelection.takeFirst();
+
+	if ( change.second )
+	    _selectionSummary.add( change.first );
+	else
+	    _selectionSummary.remove( change.first );
+    }
 
-    int fileCount	 = 0;
-    int dirCount	 = 0;
-    int subtreeFileCount = 0;
+    return _pendingSelection.isEmpty();
+}
+
+
+void FileDetailsView::showSelectionSummary()
+{
+    const SelectionSummary & sum = _selectionSummary;
 
-    foreach ( FileInfo * item, sel )
+    if ( _pendingSelection.isEmpty() && sum.itemCount() == 1 )
     {
+	// Only one item left after removing those in selected subtrees
+
+	FileInfo * item = *sum.countedItems().begin();
+
 	if ( item->isDirInfo() )
-	{
-	    ++dirCount;
-	    subtreeFileCount += item->totalFiles();
-	}
+	    showDetails( item->toDirInfo() );
 	else
-	    ++fileCount;
+	    showDetails( item );
+
+	return;
     }
 
+    setCurrentPage( _ui->selectionSummaryPage );
+
+    int	      fileCount	       = sum.fileCount();
+    int	      dirCount	       = sum.dirCount();
+    FileCount subtreeFileCount = sum.subtreeFileCount();
+
     _ui->selFileCountCaption->setEnabled( fileCount > 0 );
     _ui->selFileCountLabel->setEnabled( fileCount > 0 );
 
@@ -620,19 +813,23 @@ void FileDetailsView::showSelectionSummary( const FileInfoSet & selectedItems )
     _ui->selSubtreeFileCountCaption->setEnabled( subtreeFileCount > 0 );
     _ui->selSubtreeFileCountLabel->setEnabled( subtreeFileCount > 0 );
 
-    setLabel( _ui->selItemCount,	     sel.count()	      );
-    setLabel( _ui->selTotalSizeLabel,	     sel.totalSize()	      );
-    setLabel( _ui->selAllocatedLabel,	     sel.totalAllocatedSize() );
-    setLabel( _ui->selFileCountLabel,	     fileCount		      );
-    setLabel( _ui->selDirCountLabel,	     dirCount		      );
-    setLabel( _ui->selSubtreeFileCountLabel, subtreeFileCount	      );
+    // While the summary is still incomplete, mark the numbers as such
+
+    QString prefix = _pendingSelection.isEmpty() ? "" : ">= ";
+
+    setLabel( _ui->selItemCount,	     sum.itemCount(),	  prefix );
+    setLabel( _ui->selTotalSizeLabel,	     sum.totalSize(),	  prefix );
+    setLabel( _ui->selAllocatedLabel,	     sum.allocatedSize(), prefix );
+    setLabel( _ui->selFileCountLabel,	     fileCount,		  prefix );
+    setLabel( _ui->selDirCountLabel,	     dirCount,		  prefix );
+    setLabel( _ui->selSubtreeFileCountLabel, subtreeFileCount,	  prefix );
 
     suppressIfSameContent( _ui->selTotalSizeLabel, _ui->selAllocatedLabel, _ui->selAllocatedCaption );
 }
 
 
 void FileDetailsView::setLabel( QLabel *	label,
-				int		number,
+				FileCount	number,
 				const QString & prefix )
 {
     CHECK_PTR( label );
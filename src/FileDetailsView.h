@@ -10,7 +10,12 @@
 #define FileDetailsView_h
 
 #include <QStackedWidget>
+#include <QList>
+#include <QPair>
+#include <QTimer>
+
 #include "FileInfoSet.h"
+#include "SelectionSummary.h"
 #include "ui_file-details-view.h"
 
 
@@ -99,6 +104,15 @@ namespace QDirStat
 	 **/
 	void showSelectionSummary( const FileInfoSet & selectedItems );
 
+	/**
+	 * Update the selection summary with the items that were added to and
+	 * removed from the selection (see SelectionModel::selectionDelta()).
+	 * Large changes are processed in chunks from a timer, so the GUI
+	 * remains responsive.
+	 **/
+	void updateSelectionDelta( const FileInfoSet & added,
+				   const FileInfoSet & removed );
+
 	/**
 	 * Show the packages summary (pkg:/).
 	 **/
@@ -123,9 +137,22 @@ namespace QDirStat
     protected slots:
 
 	/**
-	 * Update package information via the AdaptiveTimer.
+	 * Update package information via the AdaptiveTimer. 'paths' is a
+	 * list of the path of the current file followed by the paths of its
+	 * siblings.
+	 **/
+	void updatePkgInfo( const QVariant & paths );
+
+	/**
+	 * Notification that the owning package of 'path' is known.
+	 **/
+	void owningPkgFound( const QString & path, const QString & pkg );
+
+	/**
+	 * Process the next chunk of pending selection changes and show the
+	 * selection summary when they are all done.
 	 **/
-	void updatePkgInfo( const QVariant & path );
+	void processPendingSelection();
 
 
     protected:
@@ -135,10 +162,22 @@ namespace QDirStat
 	 **/
 	QString parentPath( FileInfo * fileInfo );
 
+	/**
+	 * Apply up to 'maxCount' pending selection changes to the selection
+	 * summary. Return 'true' if there are none left.
+	 **/
+	bool applyPendingSelection( int maxCount );
+
+	/**
+	 * Show the selection summary from _selectionSummary as far as it is
+	 * done.
+	 **/
+	void showSelectionSummary();
+
 	/**
 	 * Set a label with a number and an optional prefix.
 	 **/
-	void setLabel( QLabel * label, int number, const QString & prefix = "" );
+	void setLabel( QLabel * label, FileCount number, const QString & prefix = "" );
 
 	/**
 	 * Set a file size label with a file size and an optional prefix.
@@ -186,6 +225,14 @@ namespace QDirStat
 	void setFileAllocatedLabel( FileSizeLabel * label,
 				    FileInfo *	    file );
 
+	/**
+	 * Add how much of the allocated size in 'label' is shared with other
+	 * files if the extents of 'item' (a file or a subtree) were probed
+	 * and anything is shared. See ExtentScanner.
+	 **/
+	void addSharedExtents( FileSizeLabel * label,
+			       FileInfo *      item );
+
 	/**
 	 * Set the text color for a label.
 	 **/
@@ -199,6 +246,13 @@ namespace QDirStat
 	void setSystemFileWarningVisibility( bool visible );
 	void setFilePkgBlockVisibility( bool visible );
 
+	/**
+	 * Return the path of 'file' followed by the paths of its siblings for
+	 * looking up the owning package: The user might click on one of them
+	 * next.
+	 **/
+	QStringList pkgQueryPaths( FileInfo * file );
+
 	void showSubtreeInfo( DirInfo * dir );
 	void showDirNodeInfo( DirInfo * dir );
 	void setDirBlockVisibility( bool visible );
@@ -211,6 +265,12 @@ namespace QDirStat
 	int		      _labelLimit;
 	QColor		      _dirReadErrColor;
 	QColor		      _normalTextColor;
+	QString		      _pkgQueryPath;
+
+	SelectionSummary		_selectionSummary;
+	QList<QPair<FileInfo *, bool> > _pendingSelection; // item, added?
+	QTimer				_selectionTimer;
+	bool				_showSummaryWhenDone;
 
     };	// class FileDetailsView
 }	// namespace QDirStat
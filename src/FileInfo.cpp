@@ -9,16 +9,20 @@
 
 #include <pwd.h>	// getpwuid()
 #include <grp.h>	// getgrgid()
-#include <time.h>       // gmtime()
+#include <time.h>       // gmtime_r()
 
 #include <QDateTime>
+#include <QVarLengthArray>
 
 #include "FileInfo.h"
 #include "DirInfo.h"
 #include "DotEntry.h"
 #include "Attic.h"
 #include "DirTree.h"
+#include "ExtentScanner.h"
+#include "CacheVerifier.h"
 #include "PkgInfo.h"
+#include "NodeArena.h"
 #include "FormatUtil.h"
 #include "SysUtil.h"
 #include "Logger.h"
@@ -32,10 +36,18 @@
 
 #define FRAGMENT_SIZE	2048
 
+// Tree depth up to which url() and path() don't need any memory allocation
+// for collecting the ancestors
+
+#define PATH_STACK_DEPTH	64
+
 using namespace QDirStat;
 
 
-bool FileInfo::_ignoreHardLinks = false;
+bool	FileInfo::_ignoreHardLinks = false;
+IdTable FileInfo::_devices( "device" );
+IdTable FileInfo::_uids	  ( "UID"    );
+IdTable FileInfo::_gids	  ( "GID"    );
 
 
 FileInfo::FileInfo( DirTree    * tree,
@@ -54,18 +66,19 @@ FileInfo::FileInfo( DirTree    * tree,
     _isIgnored	   = false;
     _hasUidGidPerm = false;
     _name	   = name ? name : "";
-    _device	   = 0;
     _mode	   = 0;
     _links	   = 0;
-    _uid	   = 0;
-    _gid	   = 0;
+    setDevice( 0 );
+    setUid( 0 );
+    setGid( 0 );
     _size	   = 0;
     _blocks	   = 0;
     _mtime	   = 0;
-    _mtimeYear     = -1;
-    _mtimeMonth    = -1;
+    _mimeCategoryIdx   = 0;
+    _mimeCategoryEpoch = 0;
     _allocatedSize = 0;
     _magic	   = FileInfoMagic;
+    _sortedRow	   = -1;
 }
 
 
@@ -89,15 +102,16 @@ FileInfo::FileInfo( const QString & filenameWithoutPath,
     _hasUidGidPerm = true;
     _name	   = filenameWithoutPath;
 
-    _device	   = statInfo->st_dev;
     _mode	   = statInfo->st_mode;
-    _links	   = statInfo->st_nlink;
-    _uid	   = statInfo->st_uid;
-    _gid	   = statInfo->st_gid;
+    setDevice( statInfo->st_dev   );
+    setLinks ( statInfo->st_nlink );
+    setUid   ( statInfo->st_uid   );
+    setGid   ( statInfo->st_gid   );
     _mtime	   = statInfo->st_mtime;
-    _mtimeYear     = -1;
-    _mtimeMonth    = -1;
+    _mimeCategoryIdx   = 0;
+    _mimeCategoryEpoch = 0;
     _magic	   = FileInfoMagic;
+    _sortedRow	   = -1;
     _allocatedSize = 0;
 
     if ( isSpecial() )
@@ -150,6 +164,9 @@ FileInfo::FileInfo( const QString & filenameWithoutPath,
 	    logDebug() << _links << " hard links: " << this << endl;
 	}
 #endif
+
+	if ( isFile() && _links > 1 && _tree )
+	    _tree->hardLinks()->add( statInfo->st_dev, statInfo->st_ino, this );
     }
 }
 
@@ -179,17 +196,18 @@ FileInfo::FileInfo( DirTree *	    tree,
     _isLocalFile   = true;
     _isIgnored	   = false;
     _hasUidGidPerm = withUidGidPerm;
-    _device	   = 0;
     _mode	   = mode;
     _size	   = size;
     _mtime	   = mtime;
-    _mtimeYear     = -1;
-    _mtimeMonth    = -1;
+    _mimeCategoryIdx   = 0;
+    _mimeCategoryEpoch = 0;
     _allocatedSize = 0;
-    _links	   = links;
-    _uid	   = uid;
-    _gid	   = gid;
     _magic	   = FileInfoMagic;
+    _sortedRow	   = -1;
+    setDevice( 0 );
+    setLinks ( links );
+    setUid   ( uid );
+    setGid   ( gid );
 
     if ( blocks < 0 )
     {
@@ -218,6 +236,9 @@ FileInfo::FileInfo( DirTree *	    tree,
         _allocatedSize  = blocks * STD_BLOCK_SIZE;
     }
 
+    if ( isFile() && _links > 1 && _tree )
+	_tree->hardLinks()->add( this );	// No inode number in cache files
+
     // logDebug() << "Created FileInfo " << this << endl;
 }
 
@@ -226,6 +247,17 @@ FileInfo::~FileInfo()
 {
     _magic = 0;
 
+    // isFile() is not virtual, so it is safe to use here.
+
+    if ( isFile() && _links > 1 && _tree && ! _tree->beingDestroyed() && ! _tree->reapingNodes() )
+	_tree->hardLinks()->remove( this );
+
+    if ( isFile() && _tree && ! _tree->beingDestroyed() && ! _tree->reapingNodes() )
+	_tree->extents()->remove( this );
+
+    if ( _tree && ! _tree->beingDestroyed() && ! _tree->reapingNodes() )
+	_tree->cacheVerifier()->remove( this );
+
     /**
      * The destructor should also take care about unlinking this object from
      * its parent's children list, but regrettably that just doesn't work: At
@@ -239,6 +271,18 @@ FileInfo::~FileInfo()
 }
 
 
+void * FileInfo::operator new( size_t size )
+{
+    return NodeArena::instance()->allocate( size );
+}
+
+
+void FileInfo::operator delete( void * ptr, size_t size )
+{
+    NodeArena::instance()->deallocate( ptr, size );
+}
+
+
 bool FileInfo::checkMagicNumber() const
 {
     return _magic == FileInfoMagic;
@@ -282,20 +326,20 @@ int FileInfo::usedPercent() const
 
 QString FileInfo::url() const
 {
-    if ( _parent )
-    {
-	QString parentUrl = _parent->url();
+    if ( ! _parent )
+	return name();
 
-	if ( isPseudoDir() ) // don't append "/." for dot entries and attics
-	    return parentUrl;
+    QString result;
+    StringPathSink sink( result );
+    writeUrlOrPath( sink, true );
 
-	if ( ! parentUrl.endsWith( "/" ) && ! _name.startsWith( "/" ) )
-	    parentUrl += "/";
+    return result;
+}
 
-	return parentUrl + _name;
-    }
-    else
-	return _name;
+
+void FileInfo::writeUrl( PathSink & sink ) const
+{
+    writeUrlOrPath( sink, true );
 }
 
 
@@ -304,20 +348,123 @@ QString FileInfo::path() const
     if ( isPkgInfo() )
 	return "";
 
-    if ( _parent )
+    if ( ! _parent )
+	return name();
+
+    QString result;
+    StringPathSink sink( result );
+    writeUrlOrPath( sink, false );
+
+    return result;
+}
+
+
+QByteArray FileInfo::rawPath() const
+{
+    QVarLengthArray<const FileInfo *, PATH_STACK_DEPTH> items;
+    const FileInfo * top = this;
+    int len = 0;
+
+    while ( top->_parent && ! top->isPkgInfo() )
+    {
+	items.append( top );
+	len += top->_name.byteLength() + 1;
+	top = top->_parent;
+    }
+
+    QByteArray result;
+
+    if ( ! top->isPkgInfo() )
+	result = top->rawName();
+    else if ( top != this )
+	result = "/";
+
+    result.reserve( result.size() + len );
+
+    for ( int i = items.size() - 1; i >= 0; --i )
     {
-	QString parentPath = _parent->isPkgInfo() ? "/" : _parent->path();
+	const CompactName & name = items[ i ]->_name;
+
+	if ( items[ i ]->isPseudoDir() )
+	    continue;
+
+	if ( ! result.endsWith( '/' ) && name.bytes()[0] != '/' )
+	    result += '/';
+
+	result.append( name.bytes(), name.byteLength() );
+    }
+
+    return result;
+}
+
+
+void FileInfo::writePath( PathSink & sink ) const
+{
+    writeUrlOrPath( sink, false );
+}
+
 
-	if ( isPseudoDir() )
-	    return parentPath;
+void FileInfo::writeUrlOrPath( PathSink & sink, bool withPkgUrl ) const
+{
+    // Collect the ancestors up to the toplevel item or the package this
+    // belongs to; this is where the path begins.
 
-	if ( ! parentPath.endsWith( "/" ) && ! _name.startsWith( "/" ) )
-	    parentPath += "/";
+    QVarLengthArray<const FileInfo *, PATH_STACK_DEPTH> items;
+    const FileInfo * top = this;
 
-	return parentPath + _name;
+    while ( top->_parent && ! top->isPkgInfo() )
+    {
+	items.append( top );
+	top = top->_parent;
+    }
+
+    static const QString slash( "/" );
+    QString prefix;
+
+    if ( top->isPkgInfo() )
+    {
+	if ( withPkgUrl )
+	    prefix = top->url();
+	else if ( top != this )
+	    prefix = slash;
     }
     else
-	return _name;
+	prefix = top->name();
+
+    // Convert each name only once
+
+    QVarLengthArray<QString, PATH_STACK_DEPTH> names( items.size() );
+    int len = prefix.size();
+
+    for ( int i=0; i < items.size(); ++i )
+    {
+	names[ i ] = items[ i ]->name();
+	len += names[ i ].size() + 1;
+    }
+
+    sink.reserve( len );
+    sink.append( prefix );
+
+    // Append the names from the top down with exactly one "/" between
+    // them; dot entries and attics don't add anything.
+
+    bool endsWithSlash = prefix.endsWith( '/' );
+
+    for ( int i = items.size() - 1; i >= 0; --i )
+    {
+	const FileInfo * item = items[ i ];
+
+	if ( item->isPseudoDir() )
+	    continue;
+
+	const QString & name = names[ i ];
+
+	if ( ! endsWithSlash && ! name.startsWith( '/' ) )
+	    sink.append( slash );
+
+	sink.append( name );
+	endsWithSlash = name.isEmpty() || name.endsWith( '/' );
+    }
 }
 
 
@@ -372,6 +519,31 @@ bool FileInfo::hasChildren() const
 
 bool FileInfo::isInSubtree( const FileInfo *subtree ) const
 {
+    if ( this == subtree )
+	return true;
+
+    if ( ! subtree || ! subtree->isDirInfo() )
+	return false;
+
+    // A subtree that was already taken out of the tree keeps its old
+    // numbers, so check that it still has a parent.
+
+    if ( _tree && subtree->tree() == _tree &&
+	 ( subtree->parent() || subtree == _tree->root() ) &&
+	 _tree->updateSubtreeNumbers() )
+    {
+	// Only directories are numbered; a file is where its parent is.
+
+	const DirInfo * dir = isDirInfo() ? static_cast<const DirInfo *>( this ) : _parent;
+	const DirInfo * top = static_cast<const DirInfo *>( subtree );
+
+	return dir &&
+	    dir->subtreeFirst() >= top->subtreeFirst() &&
+	    dir->subtreeFirst() <= top->subtreeLast();
+    }
+
+    // No numbers while the tree is busy: Walk up the parents
+
     const FileInfo * ancestor = this;
 
     while ( ancestor )
@@ -391,97 +563,59 @@ FileInfo * FileInfo::locate( QString url, bool findPseudoDirs )
     if ( ! _tree )
 	return 0;
 
-    FileInfo * result = 0;
-
-    if ( ! url.startsWith( _name ) && this != _tree->root() )
-	return 0;
-    else					// URL starts with this node's name
+    if ( this == _tree->root() )
     {
-	if ( this != _tree->root() )		// The root item is invisible
-	{
-	    url.remove( 0, _name.length() );	// Remove leading name of this node
-
-	    if ( url.length() == 0 )		// Nothing left?
-		return this;			// Hey! That's us!
+	// The root item is invisible; its children have their complete path
+	// as their name, so let them check the URL.
 
-	    if ( url.startsWith( "/" ) )	// If the next thing is a path delimiter,
-		url.remove( 0, 1 );		// remove that leading delimiter.
-	    else				// No path delimiter at the beginning
-	    {
-		if ( _name.right(1) != "/" &&	// and this is not the root directory
-		     ! isDotEntry() )		// or a dot entry:
-		{
-		    return 0;			// This can't be any of our children.
-		}
-	    }
-	}
-
-
-	// Search all children
-
-	FileInfo * child = firstChild();
-
-	while ( child )
+	for ( FileInfo * child = firstChild(); child; child = child->next() )
 	{
 	    FileInfo * foundChild = child->locate( url, findPseudoDirs );
 
 	    if ( foundChild )
 		return foundChild;
-	    else
-		child = child->next();
 	}
 
+	return attic() ? attic()->locate( url, findPseudoDirs ) : 0;
+    }
 
-	// Special case: One of the pseudo directories is requested.
-
-	if ( findPseudoDirs )
-	{
-	    if ( dotEntry() && url == dotEntryName() )
-		return dotEntry();
+    QString name = this->name();
 
-	    if ( attic() && url == atticName() )
-		return attic();
+    if ( ! url.startsWith( name ) )
+	return 0;
 
-	    if ( url == dotEntryName() + "/" + atticName() &&
-		 dotEntry() && dotEntry()->attic() )
-	    {
-		return dotEntry()->attic();
-	    }
-	}
+    int pos = name.length();			// Skip the leading name of this node
 
-	// Search the dot entry if there is one - but only if there is no more
-	// path delimiter left in the URL. The dot entry contains files only,
-	// and their names may not contain the path delimiter, nor can they
-	// have children. This check is not strictly necessary, but it may
-	// speed up things a bit if we don't search the non-directory children
-	// if the rest of the URL consists of several pathname components.
+    if ( pos == url.length() )			// Nothing left?
+	return this;				// Hey! That's us!
 
-	if ( dotEntry() &&
-	     ! url.contains( "/" ) )	   // No (more) "/" in this URL
-	{
-            // logDebug() << "Searching DotEntry for " << url << " in " << this << endl;
+    if ( url.at( pos ) == '/' )			// If the next thing is a path delimiter,
+	++pos;					// skip that leading delimiter.
+    else if ( ! name.endsWith( '/' ) &&		// No path delimiter, and this is not
+	      ! isDotEntry() )			// the root directory or a dot entry:
+    {
+	return 0;				// This can't be any of our children.
+    }
 
-            child = dotEntry()->firstChild();
+    // Resolve the rest of the URL one path component after the other: Each
+    // one is a direct child of the previous one, so there is no need to
+    // search any complete subtree.
 
-            while ( child )
-            {
-                if ( child->name() == url )
-                {
-                    // logDebug() << "Found " << url << " in " << dotEntry() << endl;
-                    return child;
-                }
+    QStringList components = url.mid( pos ).split( "/", QString::SkipEmptyParts );
+    FileInfo *	item	   = this;
 
-                child = child->next();
-            }
+    foreach ( const QString & component, components )
+    {
+	if ( ! item->isDirInfo() )
+	    return 0;
 
-            // logDebug() << "Cannot find " << url << " in DotEntry" << endl;
-	}
+	item = item->toDirInfo()->locateChild( component, findPseudoDirs );
 
-	if ( ! result && attic() )
-	    result = attic()->locate( url, findPseudoDirs );
+	if ( ! item )
+	    return 0;
     }
 
-    return result;
+    return item;
 }
 
 
@@ -607,7 +741,7 @@ QString FileInfo::octalPermissions() const
 
 QString FileInfo::baseName() const
 {
-    return QDirStat::baseName( _name );
+    return QDirStat::baseName( name() );
 }
 
 
@@ -709,35 +843,46 @@ QString FileInfo::symLinkTarget()
 }
 
 
-short FileInfo::mtimeYear()
+short FileInfo::mtimeYear() const
 {
-    if ( _mtimeYear == -1 )
-        processMtime();
+    if ( isPseudoDir() || isPkgInfo() )
+        return -1;
+
+    short year;
+    short month;
+    civilDate( _mtime, year, month );
 
-    return _mtimeYear;
+    return year;
 }
 
 
-short FileInfo::mtimeMonth()
+short FileInfo::mtimeMonth() const
 {
-    if ( _mtimeMonth == -1 )
-        processMtime();
+    if ( isPseudoDir() || isPkgInfo() )
+        return -1;
+
+    short year;
+    short month;
+    civilDate( _mtime, year, month );
 
-    return _mtimeMonth;
+    return month;
 }
 
 
-void  FileInfo::processMtime()
+void FileInfo::civilDates( const time_t * times,
+			   int		  count,
+			   short *	  years_ret,
+			   qint8 *	  months_ret )
 {
-    if ( isPseudoDir() || isPkgInfo() )
-        return;
-
-    // Using gmtime() which is standard C/C++
-    // unlike gmtime_r() which is not
-    struct tm * mtime_tm = gmtime( &_mtime );
+    for ( int i = 0; i < count; ++i )
+    {
+	short year;
+	short month;
+	civilDate( times[ i ], year, month );
 
-    _mtimeYear  = mtime_tm->tm_year + 1900;
-    _mtimeMonth = mtime_tm->tm_mon  + 1;
+	years_ret [ i ] = year;
+	months_ret[ i ] = (qint8) month;
+    }
 }
 
 
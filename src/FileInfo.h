@@ -18,6 +18,8 @@
 #include <QList>
 
 #include "FileSize.h"
+#include "CompactName.h"
+#include "IdTable.h"
 #include "Logger.h"
 
 // The size of a standard disk block.
@@ -41,6 +43,52 @@ namespace QDirStat
     class DirTree;
 
 
+    /**
+     * Receiver for a path that is written piece by piece by
+     * FileInfo::writeUrl() or FileInfo::writePath().
+     **/
+    class PathSink
+    {
+    public:
+
+	virtual ~PathSink() {}
+
+	/**
+	 * Called once before any append() with the total length of the
+	 * path, so the receiver can make room for it.
+	 **/
+	virtual void reserve( int len ) { Q_UNUSED( len ); }
+
+	/**
+	 * Append the next piece of the path.
+	 **/
+	virtual void append( const QString & piece ) = 0;
+    };
+
+
+    /**
+     * PathSink that appends to a string. Reusing the same string for many
+     * paths (after truncating it to 0) avoids any memory allocation once
+     * it is large enough.
+     **/
+    class StringPathSink: public PathSink
+    {
+    public:
+
+	StringPathSink( QString & str ): _str( str ) {}
+
+	virtual void reserve( int len ) Q_DECL_OVERRIDE
+	    { _str.reserve( _str.size() + len ); }
+
+	virtual void append( const QString & piece ) Q_DECL_OVERRIDE
+	    { _str += piece; }
+
+    protected:
+
+	QString & _str;
+    };
+
+
     /**
      * Status of a directory read job.
      **/
@@ -124,6 +172,21 @@ namespace QDirStat
 	 **/
 	virtual ~FileInfo();
 
+	/**
+	 * Class-specific allocation: All tree nodes (FileInfo and all derived
+	 * classes) are allocated from the NodeArena rather than from the
+	 * general heap.
+	 **/
+	static void * operator new( size_t size );
+
+	/**
+	 * Class-specific deallocation; see operator new().
+	 *
+	 * Since the destructor is virtual, 'size' is always the size of the
+	 * most derived class.
+	 **/
+	static void operator delete( void * ptr, size_t size );
+
 	/**
 	 * Check with the magic number if this object is valid.
 	 * Return 'true' if it is valid, 'false' if invalid.
@@ -149,7 +212,25 @@ namespace QDirStat
 	 * requested for "/usr/share/man". Notice, however, that the entry for
 	 * "/usr/share/man/man1" will only return "man1" in this example.
 	 **/
-	QString name() const { return _name; }
+	QString name() const { return _name.toString(); }
+
+	/**
+	 * Returns the name exactly as it is in the filesystem. This is the
+	 * same as name() in UTF-8 unless the name is not valid UTF-8.
+	 **/
+	QByteArray rawName() const { return _name.toBytes(); }
+
+	/**
+	 * Returns the name as it is stored, e.g. for the memory statistics.
+	 **/
+	const CompactName & compactName() const { return _name; }
+
+	/**
+	 * Set the name from its bytes in the filesystem. This is only needed
+	 * for names that are not valid UTF-8; see CompactName.
+	 **/
+	void setRawName( const char * bytes, int len )
+	    { _name = CompactName::fromBytes( bytes, len ); }
 
 	/**
 	 * Returns the base name of this object, i.e. the last path component,
@@ -160,11 +241,17 @@ namespace QDirStat
 	/**
 	 * Returns the full URL of this object with full path.
 	 *
-	 * This is a (somewhat) expensive operation since it will recurse up
-	 * to the top of the tree.
+	 * This walks up to the top of the tree, but the URL is built in one
+	 * string of the right size without any intermediate strings.
 	 **/
 	virtual QString url() const;
 
+	/**
+	 * Write the full URL of this object (see url()) piece by piece to
+	 * 'sink' without building a string for it.
+	 **/
+	void writeUrl( PathSink & sink ) const;
+
 	/**
 	 * Returns the full path of this object. Unlike url(), this never has a
 	 * protocol prefix or a part that identifies the package this belongs
@@ -174,11 +261,25 @@ namespace QDirStat
 	 * url()  might return	"Pkg:/chromium-browser/usr/lib/chromium/foo.z"
 	 * path() returns just	"/usr/lib/chromium/foo.z"
 	 *
-	 * Like url(), this is somewhat expensive since it recurses up the
-	 * tree, but it stops when a PkgInfo node is found there.
+	 * Like url(), this walks up the tree, but it stops when a PkgInfo
+	 * node is found there.
 	 **/
 	virtual QString path() const;
 
+	/**
+	 * Write the full path of this object (see path()) piece by piece to
+	 * 'sink' without building a string for it.
+	 **/
+	void writePath( PathSink & sink ) const;
+
+	/**
+	 * Returns the full path of this object in the local filesystem
+	 * (see path()) with the exact bytes of all names. Unlike path()
+	 * converted to UTF-8, this also works for system calls if any of the
+	 * names is not valid UTF-8.
+	 **/
+	QByteArray rawPath() const;
+
 	/**
 	 * Very much like FileInfo::url(), but with "/<Files>" appended if this
 	 * is a dot entry. Useful for debugging.
@@ -194,7 +295,7 @@ namespace QDirStat
 	 * Returns the major and minor device numbers of the device this file
 	 * resides on or 0 if this is a remote file.
 	 **/
-	dev_t device() const { return _device; }
+	dev_t device() const { return (dev_t) _devices.value( _deviceIdx ); }
 
 	/**
 	 * The file permissions and object type as returned by lstat().
@@ -211,13 +312,28 @@ namespace QDirStat
 	 **/
 	nlink_t links() const { return _links;	}
 
+	/**
+	 * Return the row of this item in the sorted children list of its
+	 * parent (DirInfo::sortedChildren()) or -1 if it was never sorted.
+	 *
+	 * This is only valid as long as that list is; it is not updated when
+	 * the list is dropped.
+	 **/
+	int sortedRow() const { return _sortedRow; }
+
+	/**
+	 * Set the row of this item in the sorted children list of its
+	 * parent. This is only meant for DirInfo::sortedChildren().
+	 **/
+	void setSortedRow( int row ) { _sortedRow = row; }
+
 	/**
 	 * User ID of the owner.
 	 *
 	 * Notice that this might be undefined if this tree branch was read
 	 * from a cache file. Check that with hasUid().
 	 **/
-	uid_t uid() const { return _uid; }
+	uid_t uid() const { return (uid_t) _uids.value( _uidIdx ); }
 
 	/**
 	 * Return the user name of the owner.
@@ -241,7 +357,7 @@ namespace QDirStat
 	 * Notice that this might be undefined if this tree branch was read
 	 * from a cache file. Check that with hasGid().
 	 **/
-	gid_t gid() const { return _gid; }
+	gid_t gid() const { return (gid_t) _gids.value( _gidIdx ); }
 
 	/**
 	 * Return the group name of the owner.
@@ -337,23 +453,48 @@ namespace QDirStat
 	 **/
 	time_t mtime() const { return _mtime; }
 
+	/**
+	 * Set the modification time. This is only needed when an existing
+	 * item is updated in place (see SmartRefreshJob).
+	 **/
+	void setMtime( time_t mtime ) { _mtime = mtime; }
+
         /**
-         * The year of the modification time of the file (1970-2037).
+         * The year of the modification time of the file (in UTC) or -1 for
+         * pseudo directories and packages.
          *
-         * The first call to this will calculate the value from _mtime and
-         * cache it (and the corresponding month); that's why this is not a
-         * const method.
+         * This is calculated from _mtime with a few integer operations
+         * each time (see civilDate()), so it is safe to call from several
+         * threads at once.
          **/
-        short mtimeYear();
+        short mtimeYear() const;
 
         /**
-         * The month of the modification time of the file (1-12).
-         *
-         * The first call to this will calculate the value from _mtime and
-         * cache it (and the corresponding year); that's why this is not a
-         * const method.
+         * The month of the modification time of the file (1-12, in UTC)
+         * or -1 for pseudo directories and packages.
          **/
-        short mtimeMonth();
+        short mtimeMonth() const;
+
+	/**
+	 * Calculate the year and the month (1-12) in UTC of 'time' and
+	 * return them in 'year_ret' and 'month_ret'.
+	 *
+	 * This uses only integer arithmetic (the "civil from days"
+	 * algorithm by Howard Hinnant) rather than gmtime_r(): No libc call,
+	 * no locking, no time zone, no branches that depend on the data.
+	 **/
+	static inline void civilDate( time_t time, short & year_ret, short & month_ret );
+
+	/**
+	 * Calculate the years and months in UTC of the 'count' times in
+	 * 'times' and store them in 'years_ret' and 'months_ret'. The loop
+	 * has no calls and no data-dependent branches, so the compiler can
+	 * vectorize it.
+	 **/
+	static void civilDates( const time_t * times,
+				int	       count,
+				short *	       years_ret,
+				qint8 *	       months_ret );
 
 	/**
 	 * Returns the total size in bytes of this subtree.
@@ -378,35 +519,35 @@ namespace QDirStat
 	 * item.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalItems() { return 0; }
+	virtual FileCount totalItems() { return 0; }
 
 	/**
 	 * Returns the total number of subdirectories in this subtree,
 	 * excluding this item. Dot entries and "." or ".." are not counted.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalSubDirs() { return 0; }
+	virtual FileCount totalSubDirs() { return 0; }
 
 	/**
 	 * Returns the total number of plain file children in this subtree,
 	 * excluding this item.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalFiles() { return 0; }
+	virtual FileCount totalFiles() { return 0; }
 
 	/**
 	 * Returns the total number of non-directory items in this subtree,
 	 * excluding this item.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalNonDirItems() { return 0; }
+	virtual FileCount totalNonDirItems() { return 0; }
 
 	/**
 	 * Returns the total number of ignored (non-directory!) items in this
 	 * subtree, excluding this item.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalIgnoredItems() { return 0; }
+	virtual FileCount totalIgnoredItems() { return 0; }
 
 	/**
 	 * Returns the total number of not ignored (non-directory!) items in
@@ -414,7 +555,7 @@ namespace QDirStat
 	 *
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalUnignoredItems() { return 0; }
+	virtual FileCount totalUnignoredItems() { return 0; }
 
 	/**
 	 * Returns the total number of direct children of this item.
@@ -432,7 +573,7 @@ namespace QDirStat
 	 *
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int errSubDirCount() { return 0; }
+	virtual FileCount errSubDirCount() { return 0; }
 
 	/**
 	 * Returns the latest modification time of this subtree.
@@ -598,6 +739,10 @@ namespace QDirStat
 	/**
 	 * Returns true if this entry is in subtree 'subtree', i.e. if this is
 	 * a child or grandchild etc. of 'subtree'.
+	 *
+	 * Unless the tree is busy, this compares the depth-first numbers of
+	 * the directories (see DirTree::updateSubtreeNumbers()) in constant
+	 * time instead of walking up the parents.
 	 **/
 	bool isInSubtree( const FileInfo *subtree ) const;
 
@@ -605,12 +750,10 @@ namespace QDirStat
 	 * Locate a child somewhere in this subtree whose URL (i.e. complete
 	 * path) matches the URL passed. Returns 0 if there is no such child.
 	 *
-	 * Notice: This is a very expensive operation since the entire subtree
-	 * is searched recursively.
+	 * The URL is resolved one path component after the other, so this
+	 * only looks at one item per level (see DirInfo::locateChild()).
 	 *
-	 * Derived classes might or might not wish to overwrite this method;
-	 * it's only advisable to do so if a derived class comes up with a
-	 * different method than brute-force searching all children.
+	 * Derived classes might or might not wish to overwrite this method.
 	 *
 	 * 'findPseudoDirs' specifies if locating pseudo directories like "dot
 	 * entries" (".../<Files>") or "attics" (".../<Ignored>") is desired.
@@ -941,44 +1084,91 @@ namespace QDirStat
 	static bool ignoreHardLinks() { return _ignoreHardLinks; }
 
 
+	/**
+	 * Return the MIME category index that MimeCategorizer cached in this
+	 * item and the epoch of the categorizer's configuration it belongs
+	 * to. An epoch of 0 means nothing is cached.
+	 **/
+	quint8 mimeCategoryIdx()   const { return _mimeCategoryIdx;   }
+	quint8 mimeCategoryEpoch() const { return _mimeCategoryEpoch; }
+
+	/**
+	 * Cache the MIME category index for epoch 'epoch'. This is only
+	 * meant to be used by MimeCategorizer.
+	 **/
+	void setMimeCategoryIdx( quint8 epoch, quint8 idx )
+	    { _mimeCategoryEpoch = epoch; _mimeCategoryIdx = idx; }
+
+
     protected:
 
-        /**
-         * Calculate values that are dependent on _mtime, yet quite expensive
-         * to calculate, and cache them: _mtimeYear, _mtimeMonth
-         **/
-        void processMtime();
+	/**
+	 * Write the URL (if 'withPkgUrl' is true) or the path of this object
+	 * to 'sink'. This is the common part of writeUrl() and writePath().
+	 **/
+	void writeUrlOrPath( PathSink & sink, bool withPkgUrl ) const;
+
+
+	/**
+	 * Set the device. This stores just the index into the device table.
+	 **/
+	void setDevice( dev_t device ) { _deviceIdx = _devices.index( device ); }
+
+	/**
+	 * Set the user ID. This stores just the index into the UID table.
+	 **/
+	void setUid( uid_t uid ) { _uidIdx = _uids.index( uid ); }
+
+	/**
+	 * Set the group ID. This stores just the index into the GID table.
+	 **/
+	void setGid( gid_t gid ) { _gidIdx = _gids.index( gid ); }
+
+	/**
+	 * Set the number of hard links.
+	 **/
+	void setLinks( nlink_t links )
+	    { _links = links > 0xFFFFFFFF ? 0xFFFFFFFF : (quint32) links; }
 
 
 	// Data members.
 	//
 	// Keep this short in order to use as little memory as possible -
 	// there will be a _lot_ of entries of this kind!
+	//
+	// The members are ordered by size to avoid any padding. The device,
+	// UID and GID are only stored as 16 bit indices into tables that are
+	// shared by all nodes: There are only very few different values of
+	// each in a typical tree.
 
-	short		_magic;			// magic number to detect if this object is valid
-	QString		_name;			// the file name (without path!)
-	bool		_isLocalFile   :1;	// flag: local or remote file?
-	bool		_isSparseFile  :1;	// (cache) flag: sparse file (file with "holes")?
-	bool		_isIgnored     :1;	// flag: ignored by rule?
-        bool            _hasUidGidPerm :1;      // flag: has UID / GID / permissions?
-	dev_t		_device;		// device this object resides on
-	mode_t		_mode;			// file permissions + object type
-	nlink_t		_links;			// number of links
-	uid_t		_uid;			// User ID of owner
-	gid_t		_gid;			// Group ID of owner
+	CompactName	_name;			// the file name (without path!)
+	DirInfo	 *	_parent;		// pointer to the parent entry
+	FileInfo *	_next;			// pointer to the next entry
+	DirTree	 *	_tree;			// pointer to the parent tree
 	FileSize	_size;			// size in bytes
 	FileSize	_blocks;		// 512 bytes blocks
 	FileSize	_allocatedSize;		// allocated size in bytes
 	time_t		_mtime;			// modification time
-        short           _mtimeYear;             // year  of the modification time or -1
-        short           _mtimeMonth;            // month of the modification time or -1
-
-	DirInfo	 *	_parent;		// pointer to the parent entry
-	FileInfo *	_next;			// pointer to the next entry
-	DirTree	 *	_tree;			// pointer to the parent tree
+	mode_t		_mode;			// file permissions + object type
+	quint32		_links;			// number of links
+	qint32		_sortedRow;		// (cache) row in the parent's sorted children
+	quint16		_deviceIdx;		// device this object resides on (index)
+	quint16		_uidIdx;		// User ID of owner (index)
+	quint16		_gidIdx;		// Group ID of owner (index)
+	short		_magic;			// magic number to detect if this object is valid
+	quint8		_mimeCategoryIdx;	// (cache) see MimeCategorizer::category()
+	quint8		_mimeCategoryEpoch;	// (cache) 0 if nothing cached
+	bool		_isLocalFile   :1;	// flag: local or remote file?
+	bool		_isSparseFile  :1;	// (cache) flag: sparse file (file with "holes")?
+	bool		_isIgnored     :1;	// flag: ignored by rule?
+	bool		_hasUidGidPerm :1;	// flag: has UID / GID / permissions?
 
 	static bool	_ignoreHardLinks;	// don't distribute size for multiple hard links
 
+	static IdTable	_devices;		// shared table of all devices
+	static IdTable	_uids;			// shared table of all user IDs
+	static IdTable	_gids;			// shared table of all group IDs
+
     };	// class FileInfo
 
 
@@ -986,6 +1176,29 @@ namespace QDirStat
     typedef QList<FileInfo *> FileInfoList;
 
 
+    inline void FileInfo::civilDate( time_t time, short & year_ret, short & month_ret )
+    {
+	// Days since 1970-01-01, rounded down also for times before that
+
+	qint64 secs = time;
+	qint64 days = ( secs - ( secs < 0 ) * 86399 ) / 86400;
+
+	// Shift the epoch to 0000-03-01 so the leap day is the last day of
+	// the year, then split into 400-year eras of 146097 days each.
+
+	days += 719468;
+	qint64	era = ( days - ( days < 0 ) * 146096 ) / 146097;
+	quint32 doe = (quint32) ( days - era * 146097 );		      // [0, 146096]
+	quint32 yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365; // [0, 399]
+	quint32 doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );	      // [0, 365]
+	quint32 mp  = ( 5 * doy + 2 ) / 153;				      // [0, 11], March = 0
+	quint32 month = mp + 3 - ( mp >= 10 ) * 12;			      // [1, 12]
+
+	year_ret  = (short) ( yoe + era * 400 + ( month <= 2 ) );
+	month_ret = (short) month;
+    }
+
+
 
     //----------------------------------------------------------------------
     //			       Static Functions
@@ -7,6 +7,9 @@
  */
 
 
+#include <QHash>
+#include <QVector>
+
 #include "FileInfoSet.h"
 #include "DirTree.h"
 #include "DirInfo.h"
@@ -33,10 +36,35 @@ bool FileInfoSet::containsAncestorOf( FileInfo * item ) const
 FileInfoSet FileInfoSet::normalized() const
 {
     FileInfoSet normalized;
+    normalized.reserve( size() );
+
+    // Remember for each ancestor that was visited if it or any of its own
+    // ancestors is in the set, so each of them is only checked once, no
+    // matter how many items of the set are below it. Without this, a large
+    // selection would walk up to the toplevel again and again for each
+    // item.
+
+    QHash<FileInfo *, bool> covered;
+    QVector<FileInfo *>	    visited;
 
     foreach ( FileInfo * item, *this )
     {
-	if ( ! containsAncestorOf( item ) )
+	FileInfo * ancestor = item ? item->parent() : 0;
+
+	while ( ancestor && ! contains( ancestor ) && ! covered.contains( ancestor ) )
+	{
+	    visited << ancestor;
+	    ancestor = ancestor->parent();
+	}
+
+	bool hasAncestor = ancestor && ( contains( ancestor ) || covered.value( ancestor ) );
+
+	foreach ( FileInfo * dir, visited )
+	    covered.insert( dir, hasAncestor );
+
+	visited.clear();
+
+	if ( ! hasAncestor )
 	    normalized << item;
 #if 0
 	else
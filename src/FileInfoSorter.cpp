@@ -7,8 +7,12 @@
  */
 
 
-#include <algorithm>    // std::swap()
+#include <algorithm>    // std::swap(), std::partial_sort()
 #include "FileInfoSorter.h"
+#include "DirInfo.h"
+#include "ParallelSort.h"
+#include "Exception.h"
+#include "TreeDiff.h"
 
 using namespace QDirStat;
 
@@ -65,6 +69,13 @@ bool FileInfoSorter::operator() ( FileInfo * a, FileInfo * b )
 	case GroupCol:		  return a->gid()	      < b->gid();
 	case PermissionsCol:	  return a->mode()	      < b->mode();
 	case OctalPermissionsCol: return a->mode()	      < b->mode();
+	case SizeDeltaCol:
+	    {
+		TreeDiff * diff = TreeDiff::activeDiff();
+
+		return diff && diff->sizeDelta( a ) < diff->sizeDelta( b );
+	    }
+
 	case ReadJobsCol:	  return a->pendingReadJobs() < b->pendingReadJobs();
 	case UndefinedCol:	  return false;
 	    // Intentionally omitting the 'default' branch
@@ -73,3 +84,335 @@ bool FileInfoSorter::operator() ( FileInfo * a, FileInfo * b )
 
     return false;
 }
+
+
+namespace QDirStat
+{
+    /**
+     * Sort key for NameCol: Ignored items last, then the dot entry, then
+     * by name.
+     **/
+    struct NameSortKey
+    {
+	QString name;
+	bool	isIgnored;
+	bool	isDotEntry;
+
+	bool operator<( const NameSortKey & other ) const
+	{
+	    if ( isIgnored != other.isIgnored ) return other.isIgnored;
+	    if ( isDotEntry	  ) return false;
+	    if ( other.isDotEntry ) return true;
+
+	    return name < other.name;
+	}
+    };
+
+
+    /**
+     * Sort key for SizeCol: The allocated size, then the size.
+     **/
+    struct SizeSortKey
+    {
+	FileSize allocatedSize;
+	FileSize size;
+
+	bool operator<( const SizeSortKey & other ) const
+	{
+	    if ( allocatedSize == other.allocatedSize )
+		return size < other.size;
+
+	    return allocatedSize < other.allocatedSize;
+	}
+    };
+
+
+    /**
+     * Sort key for OldestFileMTimeCol: 0 (no files at all) sorts last.
+     **/
+    struct OldestMtimeSortKey
+    {
+	time_t mtime;
+
+	bool operator<( const OldestMtimeSortKey & other ) const
+	{
+	    if ( mtime	     == 0 ) return false;
+	    if ( other.mtime == 0 ) return true;
+
+	    return mtime < other.mtime;
+	}
+    };
+
+
+    /**
+     * Functor to compare indices into an array of sort keys. The sort
+     * order is a template parameter, so there is no check for it in each
+     * comparison.
+     **/
+    template<typename Key, bool Descending>
+    class KeyRowSorter
+    {
+    public:
+	KeyRowSorter( const QVector<Key> & keys ):
+	    _keys( keys.constData() )
+	    {}
+
+	bool operator() ( quint32 a, quint32 b ) const
+	{
+	    return Descending ?
+		_keys[ b ] < _keys[ a ] :
+		_keys[ a ] < _keys[ b ];
+	}
+
+    private:
+	const Key * _keys;
+    };
+
+
+    /**
+     * Like KeyRowSorter, but equal keys are ordered by their name keys (if
+     * there are any) and then by their row. This is the order of two
+     * stable sorts, first by name, then by the keys, so it can be used with
+     * std::partial_sort() which is not stable.
+     **/
+    template<typename Key, bool Descending>
+    class KeyRowTieSorter
+    {
+    public:
+	KeyRowTieSorter( const QVector<Key> & keys, const NameSortKey * nameKeys ):
+	    _keys( keys.constData() ),
+	    _nameKeys( nameKeys )
+	    {}
+
+	bool operator() ( quint32 a, quint32 b ) const
+	{
+	    if ( Descending ? _keys[ b ] < _keys[ a ] : _keys[ a ] < _keys[ b ] ) return true;
+	    if ( Descending ? _keys[ a ] < _keys[ b ] : _keys[ b ] < _keys[ a ] ) return false;
+
+	    if ( _nameKeys )
+	    {
+		if ( _nameKeys[ a ] < _nameKeys[ b ] ) return true;
+		if ( _nameKeys[ b ] < _nameKeys[ a ] ) return false;
+	    }
+
+	    return a < b;
+	}
+
+    private:
+	const Key	  * _keys;
+	const NameSortKey * _nameKeys;
+    };
+
+}	// namespace QDirStat
+
+
+namespace QDirStat
+{
+    /**
+     * FileInfoSortKeys with one key of type 'Key' for each child.
+     **/
+    template<typename Key>
+    class FileInfoSortKeyList: public FileInfoSortKeys
+    {
+    public:
+
+	FileInfoSortKeyList( int size )
+	    { keys.reserve( size ); }
+
+	virtual void sortRows( Qt::SortOrder	  sortOrder,
+			       QVector<quint32> & rows ) const Q_DECL_OVERRIDE
+	{
+	    if ( sortOrder == Qt::DescendingOrder )
+		parallelStableSort( rows, KeyRowSorter<Key, true >( keys ) );
+	    else
+		parallelStableSort( rows, KeyRowSorter<Key, false>( keys ) );
+	}
+
+	virtual void partialSortRows( Qt::SortOrder	       sortOrder,
+				      const FileInfoSortKeys * nameKeys,
+				      QVector<quint32> &       rows,
+				      int		       first,
+				      int		       middle ) const Q_DECL_OVERRIDE
+	{
+	    // The name keys are always FileInfoSortKeyList<NameSortKey>, see
+	    // FileInfoSorter::sortKeys()
+
+	    const NameSortKey * names = nameKeys ?
+		static_cast<const FileInfoSortKeyList<NameSortKey> *>( nameKeys )->keys.constData() : 0;
+
+	    quint32 * begin = rows.data();
+
+	    if ( sortOrder == Qt::DescendingOrder )
+		std::partial_sort( begin + first, begin + middle, begin + rows.size(),
+				   KeyRowTieSorter<Key, true >( keys, names ) );
+	    else
+		std::partial_sort( begin + first, begin + middle, begin + rows.size(),
+				   KeyRowTieSorter<Key, false>( keys, names ) );
+	}
+
+	QVector<Key> keys;
+    };
+
+}	// namespace QDirStat
+
+
+/**
+ * Return the numeric keys that 'getKey' returns for each child.
+ **/
+static FileInfoSortKeys * numberKeys( const FileInfoList & children,
+				      qint64 (* getKey)( FileInfo * item ) )
+{
+    FileInfoSortKeyList<qint64> * sortKeys = new FileInfoSortKeyList<qint64>( children.size() );
+    CHECK_NEW( sortKeys );
+
+    foreach ( FileInfo * child, children )
+	sortKeys->keys << getKey( child );
+
+    return sortKeys;
+}
+
+
+static qint64 totalItemsKey	( FileInfo * item ) { return item->totalItems();      }
+static qint64 totalFilesKey	( FileInfo * item ) { return item->totalFiles();      }
+static qint64 totalSubDirsKey	( FileInfo * item ) { return item->totalSubDirs();    }
+static qint64 latestMtimeKey	( FileInfo * item ) { return item->latestMtime();     }
+static qint64 uidKey		( FileInfo * item ) { return item->uid();	      }
+static qint64 gidKey		( FileInfo * item ) { return item->gid();	      }
+static qint64 modeKey		( FileInfo * item ) { return item->mode();	      }
+static qint64 pendingReadJobsKey( FileInfo * item ) { return item->pendingReadJobs(); }
+
+
+static qint64 sizeDeltaKey( FileInfo * item )
+{
+    TreeDiff * diff = TreeDiff::activeDiff();
+
+    return diff ? diff->sizeDelta( item ) : 0;
+}
+
+
+void FileInfoSorter::sortRows( const FileInfoList & children,
+			       DataColumn	    sortCol,
+			       Qt::SortOrder	    sortOrder,
+			       QVector<quint32> &   rows )
+{
+    FileInfoSortKeys * keys = sortKeys( children, sortCol );
+
+    if ( keys )
+    {
+	keys->sortRows( sortOrder, rows );
+	delete keys;
+    }
+}
+
+
+void FileInfoSorter::partialSortRows( const FileInfoList & children,
+				      DataColumn	   sortCol,
+				      Qt::SortOrder	   sortOrder,
+				      QVector<quint32> &   rows,
+				      int		   first,
+				      int		   middle )
+{
+    if ( first >= middle )
+	return;
+
+    FileInfoSortKeys * keys = sortKeys( children, sortCol );
+
+    if ( keys )
+    {
+	FileInfoSortKeys * nameKeys = sortCol != NameCol ? sortKeys( children, NameCol ) : 0;
+
+	keys->partialSortRows( sortOrder, nameKeys, rows, first, middle );
+
+	delete nameKeys;
+	delete keys;
+    }
+}
+
+
+FileInfoSortKeys * FileInfoSorter::sortKeys( const FileInfoList & children,
+					     DataColumn		  sortCol )
+{
+    switch ( sortCol )
+    {
+	case NameCol:
+	    {
+		FileInfoSortKeyList<NameSortKey> * sortKeys =
+		    new FileInfoSortKeyList<NameSortKey>( children.size() );
+		CHECK_NEW( sortKeys );
+
+		foreach ( FileInfo * child, children )
+		{
+		    NameSortKey key;
+		    key.name	   = child->name();
+		    key.isIgnored  = child->isIgnored();
+		    key.isDotEntry = child->isDotEntry();
+		    sortKeys->keys << key;
+		}
+
+		return sortKeys;
+	    }
+
+	case PercentBarCol:
+	case PercentNumCol:
+	case SizeCol:
+	    {
+		FileInfoSortKeyList<SizeSortKey> * sortKeys =
+		    new FileInfoSortKeyList<SizeSortKey>( children.size() );
+		CHECK_NEW( sortKeys );
+
+		foreach ( FileInfo * child, children )
+		{
+		    SizeSortKey key;
+		    key.allocatedSize = child->totalAllocatedSize();
+		    key.size	      = child->totalSize();
+
+		    // A mount point or a package that is not read yet sorts
+		    // by its estimate, just like it is displayed
+
+		    if ( child->isDirInfo() )
+		    {
+			FileSize estimate = child->toDirInfo()->sizeEstimate();
+
+			if ( estimate > key.allocatedSize )
+			    key.allocatedSize = estimate;
+		    }
+
+		    sortKeys->keys << key;
+		}
+
+		return sortKeys;
+	    }
+
+	case OldestFileMTimeCol:
+	    {
+		FileInfoSortKeyList<OldestMtimeSortKey> * sortKeys =
+		    new FileInfoSortKeyList<OldestMtimeSortKey>( children.size() );
+		CHECK_NEW( sortKeys );
+
+		foreach ( FileInfo * child, children )
+		{
+		    OldestMtimeSortKey key;
+		    key.mtime = child->oldestFileMtime();
+		    sortKeys->keys << key;
+		}
+
+		return sortKeys;
+	    }
+
+	case TotalItemsCol:	  return numberKeys( children, totalItemsKey	  );
+	case TotalFilesCol:	  return numberKeys( children, totalFilesKey	  );
+	case TotalSubDirsCol:	  return numberKeys( children, totalSubDirsKey	  );
+	case LatestMTimeCol:	  return numberKeys( children, latestMtimeKey	  );
+	case UserCol:		  return numberKeys( children, uidKey		  );
+	case GroupCol:		  return numberKeys( children, gidKey		  );
+	case PermissionsCol:
+	case OctalPermissionsCol: return numberKeys( children, modeKey		  );
+	case SizeDeltaCol:	  return numberKeys( children, sizeDeltaKey	  );
+	case ReadJobsCol:	  return numberKeys( children, pendingReadJobsKey );
+	case UndefinedCol:	  return 0;
+	    // Intentionally omitting the 'default' branch
+	    // so the compiler can warn about unhandled enum values
+    }
+
+    return 0;
+}
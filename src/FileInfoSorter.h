@@ -10,6 +10,8 @@
 #define FileInfoSorter_h
 
 
+#include <QVector>
+
 #include "FileInfo.h"
 #include "DataColumns.h"
 
@@ -35,6 +37,42 @@ namespace QDirStat
      * For each element pair to compare, the FileInfoSorter's operator() will
      * be called with that pair as arguments.
      **/
+    /**
+     * The sort keys of a list of children for one sort column, fetched in
+     * advance (see FileInfoSorter::sortKeys()). Sorting by them does not
+     * touch any FileInfo, so it can be done in another thread.
+     **/
+    class FileInfoSortKeys
+    {
+    public:
+
+	virtual ~FileInfoSortKeys() {}
+
+	/**
+	 * Stable sort of 'rows', indices into the children, by these keys
+	 * in 'sortOrder'.
+	 **/
+	virtual void sortRows( Qt::SortOrder	  sortOrder,
+			       QVector<quint32> & rows ) const = 0;
+
+	/**
+	 * Sort the rows from 'first' on so that those up to 'middle' are in
+	 * their final order and the others in any order behind them. The
+	 * rows before 'first' have to be sorted already.
+	 *
+	 * Equal keys are ordered by 'nameKeys' (if not 0) and then by the
+	 * row, so this gives the same order as sortRows() by name followed
+	 * by sortRows() by these keys, only much faster if 'middle' is
+	 * small.
+	 **/
+	virtual void partialSortRows( Qt::SortOrder	       sortOrder,
+				      const FileInfoSortKeys * nameKeys,
+				      QVector<quint32> &       rows,
+				      int		       first,
+				      int		       middle ) const = 0;
+    };
+
+
     class FileInfoSorter
     {
     public:
@@ -53,6 +91,49 @@ namespace QDirStat
 	 **/
 	bool operator() ( FileInfo * a, FileInfo * b );
 
+	/**
+	 * Stable sort of 'rows', indices into 'children', by 'sortCol' in
+	 * 'sortOrder'; this gives the same order as sorting the children
+	 * with a FileInfoSorter.
+	 *
+	 * This is much faster for many children: It fetches the sort key of
+	 * each child only once (which might be a virtual call or even
+	 * trigger a recalc()) and then only compares those keys with a
+	 * comparison that is specialized for that kind of key at compile
+	 * time. So it is also safe to use with parallelStableSort().
+	 **/
+	static void sortRows( const FileInfoList & children,
+			      DataColumn	   sortCol,
+			      Qt::SortOrder	   sortOrder,
+			      QVector<quint32> &   rows );
+
+	/**
+	 * Sort 'rows' from 'first' on so that those up to 'middle' are in
+	 * the same order as with sortRows() by NameCol and then by 'sortCol'
+	 * and the others in any order behind them. The rows before 'first'
+	 * have to be sorted already.
+	 *
+	 * This is for showing the first rows of a huge directory without
+	 * sorting all of it.
+	 **/
+	static void partialSortRows( const FileInfoList & children,
+				     DataColumn		  sortCol,
+				     Qt::SortOrder	  sortOrder,
+				     QVector<quint32> &	  rows,
+				     int		  first,
+				     int		  middle );
+
+	/**
+	 * Fetch the sort keys of 'children' for 'sortCol', so 'rows' can be
+	 * sorted by them later with FileInfoSortKeys::sortRows() in any
+	 * thread. This has to be called in the thread that owns the tree
+	 * since fetching the keys might trigger a recalc().
+	 *
+	 * Return 0 for UndefinedCol. The caller takes over ownership.
+	 **/
+	static FileInfoSortKeys * sortKeys( const FileInfoList & children,
+					    DataColumn		 sortCol );
+
     private:
 	DataColumn    _sortCol;
 	Qt::SortOrder _sortOrder;
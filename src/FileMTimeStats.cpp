@@ -8,9 +8,10 @@
 
 
 #include "FileMTimeStats.h"
-#include "FileInfoIterator.h"
+#include "TreeColumns.h"
 #include "DirTree.h"
 #include "Exception.h"
+#include "Trace.h"
 
 #define VERBOSE_SORT_THRESHOLD  50000
 
@@ -21,39 +22,65 @@ FileMTimeStats::FileMTimeStats( FileInfo * subtree ):
     PercentileStats()
 {
     if ( subtree )
-    {
         collect( subtree );
-        sort();
-    }
 }
 
 
 void FileMTimeStats::collect( FileInfo * subtree )
 {
+    TRACE_SPAN( "FileMTimeStats::collect" );
+
     Q_CHECK_PTR( subtree );
 
-    if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
+    StatsEngine engine;
+    engine.addCollector( this );
+    engine.collect( subtree );
+}
+
+
+void FileMTimeStats::startCollecting( FileInfo * subtree )
+{
+    if ( _data.isEmpty() && ! _approximate )
+        _data.reserve( (int) qMin( subtree->totalFiles(), (FileCount) INT_MAX ) );
 
-    if ( subtree->isFile() )
-        _data << subtree->mtime();
+    dataChanged();
+}
+
+
+void FileMTimeStats::collectItem( FileInfo * item )
+{
+    // Disregard directories, symlinks, block devices and other special files
+
+    if ( item->isFile() )
+        addValue( item->mtime() );
+}
 
-    FileInfoIterator it( subtree );
 
-    while ( *it )
+void FileMTimeStats::collectColumns( const TreeColumns & columns, int first, int end )
+{
+    const quint8 * flags  = columns.flags().constData();
+    const time_t * mtimes = columns.mtimes().constData();
+
+    for ( int i = first; i < end; ++i )
     {
-	FileInfo * item = *it;
-
-	if ( item->hasChildren() )
-	{
-	    collect( item );
-	}
-	else if ( item->isFile() )
-	{
-            _data << item->mtime();
-	}
-	// Disregard symlinks, block devices and other special files
-
-	++it;
+	if ( flags[ i ] & TreeColumns::ItemIsFile )
+	    addValue( mtimes[ i ] );
     }
 }
+
+
+StatsCollector * FileMTimeStats::createPartial() const
+{
+    FileMTimeStats * partial = new FileMTimeStats();
+    CHECK_NEW( partial );
+
+    return partial;
+}
+
+
+void FileMTimeStats::merge( StatsCollector * partial )
+{
+    FileMTimeStats * stats = static_cast<FileMTimeStats *>( partial );
+
+    mergeValues( *stats );
+}
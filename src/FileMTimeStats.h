@@ -11,6 +11,7 @@
 #define FileMTimeStats_h
 
 #include "PercentileStats.h"
+#include "StatsEngine.h"
 #include "FileInfo.h"
 #include "HistogramView.h"
 
@@ -26,11 +27,13 @@ namespace QDirStat
      *
      * Notice that one data item (one qreal, i.e. one 64 bit double) is
      * stored for each file (or each matching file) in this object, so this is
-     * expensive in terms of memory usage. Also, since data usually need to be
-     * sorted for those calculations and sorting has at least logarithmic cost
-     * O( n * log(n) ), this also has heavy performance impact.
+     * expensive in terms of memory usage. See PercentileStats for what is
+     * sorted when.
+     *
+     * This is also a StatsCollector, so it can be collected by a StatsEngine
+     * together with other statistics in one traversal of the tree.
      **/
-    class FileMTimeStats: public PercentileStats
+    class FileMTimeStats: public PercentileStats, public StatsCollector
     {
     public:
 
@@ -46,6 +49,17 @@ namespace QDirStat
 	 * unsorted after this.
 	 **/
 	void collect( FileInfo * subtree );
+
+	//
+	// Reimplemented from StatsCollector
+	//
+
+	virtual void startCollecting( FileInfo * subtree ) Q_DECL_OVERRIDE;
+	virtual void collectItem( FileInfo * item ) Q_DECL_OVERRIDE;
+	virtual bool canCollectColumns() const Q_DECL_OVERRIDE { return true; }
+	virtual void collectColumns( const TreeColumns & columns, int first, int end ) Q_DECL_OVERRIDE;
+	virtual StatsCollector * createPartial() const Q_DECL_OVERRIDE;
+	virtual void merge( StatsCollector * partial ) Q_DECL_OVERRIDE;
     };
 
 }	// namespace QDirStat
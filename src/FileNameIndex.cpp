@@ -0,0 +1,209 @@
+/*
+ *   File name: FileNameIndex.cpp
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>	// std::lower_bound()
+
+#include <QElapsedTimer>
+
+#include "FileNameIndex.h"
+#include "FileInfoIterator.h"
+#include "SearchFilter.h"
+#include "ParallelSort.h"
+#include "QDirStatApp.h"
+#include "DirTree.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Sort order of the index: By name case insensitive, then case
+     * sensitive, so all items with the same name are next to each other.
+     **/
+    struct FileNameLess
+    {
+	bool operator()( FileInfo * a, FileInfo * b ) const
+	{
+	    const QString nameA = a->name();
+	    const QString nameB = b->name();
+
+	    int result = QString::compare( nameA, nameB, Qt::CaseInsensitive );
+
+	    return result != 0 ? result < 0 : nameA < nameB;
+	}
+    };
+
+
+    /**
+     * Comparison for binary searches in the index: Only case insensitive.
+     **/
+    struct FileNamePrefixLess
+    {
+	bool operator()( FileInfo * item, const QString & name ) const
+	{
+	    return QString::compare( item->name(), name, Qt::CaseInsensitive ) < 0;
+	}
+    };
+
+}	// namespace QDirStat
+
+
+
+QPointer<FileNameIndex> FileNameIndex::_instance = 0;
+
+
+FileNameIndex * FileNameIndex::instance()
+{
+    if ( ! _instance )
+    {
+	_instance = new FileNameIndex( app()->dirTree() );
+	CHECK_NEW( _instance );
+    }
+
+    return _instance;
+}
+
+
+FileNameIndex::FileNameIndex( DirTree * tree ):
+    QObject( tree ),
+    _tree( tree ),
+    _valid( false )
+{
+    CHECK_PTR( tree );
+
+    connect( tree, SIGNAL( startingReading() ),
+	     this, SLOT	 ( invalidate()	     ) );
+
+    connect( tree, SIGNAL( finished()	),
+	     this, SLOT	 ( invalidate() ) );
+
+    connect( tree, SIGNAL( aborted()	),
+	     this, SLOT	 ( invalidate() ) );
+
+    connect( tree, SIGNAL( clearing()	),
+	     this, SLOT	 ( invalidate() ) );
+
+    connect( tree, SIGNAL( clearingSubtree( DirInfo * ) ),
+	     this, SLOT	 ( invalidate()		       ) );
+
+    connect( tree, SIGNAL( deletingChild( FileInfo * ) ),
+	     this, SLOT	 ( invalidate()		      ) );
+
+    connect( tree, SIGNAL( childDeleted() ),
+	     this, SLOT	 ( invalidate()	  ) );
+
+    connect( tree, SIGNAL( filesPagedIn( DirInfo * ) ),
+	     this, SLOT	 ( invalidate()		    ) );
+}
+
+
+FileNameIndex::~FileNameIndex()
+{
+    // NOP
+}
+
+
+void FileNameIndex::invalidate()
+{
+    _items.clear();
+    _items.squeeze();
+    _valid = false;
+}
+
+
+void FileNameIndex::build()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    invalidate();
+    _items.reserve( (int) qMin( _tree->root()->totalItems(), (FileCount) INT_MAX ) );
+    addRecursive( _tree->root(), _items );
+
+    // The sums of all directories are up to date now, so the items can be
+    // sorted in several threads.
+
+    parallelStableSort( _items, FileNameLess() );
+    _valid = true;
+
+    logDebug() << "Indexed " << _items.size() << " items in "
+	       << timer.elapsed() << " millisec" << endl;
+}
+
+
+void FileNameIndex::addRecursive( FileInfo * dir, QVector<FileInfo *> & items )
+{
+    FileInfoIterator it( dir );
+
+    while ( *it )
+    {
+	items << *it;
+
+	if ( (*it)->hasChildren() )
+	    addRecursive( *it, items );
+
+	++it;
+    }
+}
+
+
+bool FileNameIndex::find( const SearchFilter & filter,
+			  FileInfo	     * subtree,
+			  FileInfoList	     & results )
+{
+    if ( ! subtree || _tree->isBusy() )
+	return false;
+
+    if ( ! _valid )
+	build();
+
+    // For a fixed start of the name or the exact name, only the items
+    // starting with the pattern (case insensitive) need to be checked.
+
+    QVector<FileInfo *>::const_iterator begin = _items.constBegin();
+    QVector<FileInfo *>::const_iterator end   = _items.constEnd();
+    bool prefixOnly = false;
+
+    if ( filter.filterMode() == SearchFilter::StartsWith ||
+	 filter.filterMode() == SearchFilter::ExactMatch   )
+    {
+	begin = std::lower_bound( begin, end, filter.pattern(), FileNamePrefixLess() );
+	prefixOnly = true;
+    }
+
+    // Match each name only once, and without converting it to a QString
+    // where possible
+
+    const CompactName * lastName = 0;
+    bool lastMatch = false;
+
+    for ( QVector<FileInfo *>::const_iterator it = begin; it != end; ++it )
+    {
+	FileInfo *	    item = *it;
+	const CompactName & name = item->compactName();
+
+	if ( ! lastName || name != *lastName )
+	{
+	    if ( prefixOnly && ! name.toString().startsWith( filter.pattern(), Qt::CaseInsensitive ) )
+		break;
+
+	    lastName  = &name;
+	    lastMatch = filter.matchesUtf8( name.bytes(), name.byteLength() );
+	}
+
+	if ( lastMatch && item->isInSubtree( subtree ) && item != subtree )
+	    results << item;
+    }
+
+    return true;
+}
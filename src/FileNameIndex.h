@@ -0,0 +1,122 @@
+/*
+ *   File name: FileNameIndex.h
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef FileNameIndex_h
+#define FileNameIndex_h
+
+
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class SearchFilter;
+
+
+    /**
+     * Index of all items in the DirTree of the application by name for
+     * finding files without matching the search pattern against each item
+     * of the tree again and again.
+     *
+     * The index is simply a vector of all items, sorted by name: Searching
+     * for a fixed start of a name or for an exact name only needs a binary
+     * search, and for any other search pattern, each name is only matched
+     * once no matter how many items have that name (think "Makefile" or
+     * "index.html").
+     *
+     * The index is built when it is first needed, and it is discarded as
+     * soon as the tree changes. It is never used while the tree is being
+     * read.
+     *
+     * This is a singleton class. Use instance() to get the instance. It is
+     * deleted together with the DirTree of the application.
+     **/
+    class FileNameIndex: public QObject
+    {
+	Q_OBJECT
+
+    protected:
+
+	/**
+	 * Constructor. This is a singleton class; use instance() instead.
+	 **/
+	FileNameIndex( DirTree * tree );
+
+    public:
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~FileNameIndex();
+
+	/**
+	 * Get the singleton for this class. The first call to this will create
+	 * it.
+	 **/
+	static FileNameIndex * instance();
+
+	/**
+	 * Find all items in 'subtree' (but not 'subtree' itself) whose name
+	 * matches 'filter' and add them to 'results'. This builds the index
+	 * first if necessary.
+	 *
+	 * This returns 'false' if the index cannot be used right now because
+	 * the tree is being read.
+	 **/
+	bool find( const SearchFilter & filter,
+		   FileInfo	      * subtree,
+		   FileInfoList	      & results );
+
+	/**
+	 * Return 'true' if the index is built.
+	 **/
+	bool isValid() const { return _valid; }
+
+    public slots:
+
+	/**
+	 * Discard the index, so the next search will build it again.
+	 **/
+	void invalidate();
+
+    protected:
+
+	/**
+	 * Build the index for the complete tree.
+	 **/
+	void build();
+
+	/**
+	 * Add all items below 'dir' to 'items', visiting them in the same way
+	 * as a TreeWalker.
+	 **/
+	static void addRecursive( FileInfo * dir, QVector<FileInfo *> & items );
+
+
+	//
+	// Data members
+	//
+
+	static QPointer<FileNameIndex>	_instance;
+
+	DirTree *			_tree;
+	QVector<FileInfo *>		_items;		// Sorted by name
+	bool				_valid;
+
+    };	// class FileNameIndex
+
+}	// namespace QDirStat
+
+
+#endif // ifndef FileNameIndex_h
@@ -32,5 +32,5 @@ FileSearchFilter::FileSearchFilter( DirInfo *       subtree,
     if ( _filterMode == Wildcard )
         _regexp.setPatternSyntax( QRegExp::Wildcard );
 
-    _regexp.setCaseSensitivity( Qt::CaseInsensitive );
+    setCaseSensitive( false );
 }
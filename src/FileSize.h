@@ -20,6 +20,9 @@
 namespace QDirStat
 {
     typedef long long FileSize;
+
+    // Numbers of items in a subtree: There might be more than 2^31
+    typedef long long FileCount;
 }
 
 
@@ -7,90 +7,147 @@
  */
 
 
+#include <algorithm>	// std::lower_bound(), std::upper_bound()
+
 #include "FileSizeStats.h"
-#include "FileInfoIterator.h"
+#include "TreeColumns.h"
 #include "FormatUtil.h"
 #include "Exception.h"
+#include "Trace.h"
 
 #define VERBOSE_SORT_THRESHOLD  50000
 
 using namespace QDirStat;
 
 
+namespace QDirStat
+{
+    /**
+     * Histogram bucket of a value from 'startVal' on with buckets of width
+     * 'bucketWidth'. Values above the last bucket go into the last one.
+     *
+     * This is monotonic in 'val', so it can be used as a comparison for a
+     * binary search in the sorted data.
+     **/
+    struct BucketIndex
+    {
+	BucketIndex( qreal startVal, qreal bucketWidth, int bucketCount ):
+	    _startVal( startVal ),
+	    _bucketWidth( bucketWidth ),
+	    _bucketCount( bucketCount )
+	    {}
+
+	int operator()( qreal val ) const
+	    { return qMin( ( val - _startVal ) / _bucketWidth, _bucketCount - 1.0 ); }
+
+	// For std::upper_bound(): Is 'val' in a bucket after 'index'?
+
+	bool operator()( int index, qreal val ) const
+	    { return index < (*this)( val ); }
+
+	qreal _startVal;
+	qreal _bucketWidth;
+	int   _bucketCount;
+    };
+
+}	// namespace QDirStat
+
+
 FileSizeStats::FileSizeStats( FileInfo * subtree ):
     PercentileStats()
 {
     if ( subtree )
-    {
         collect( subtree );
-        sort();
-    }
 }
 
 
 void FileSizeStats::collect( FileInfo * subtree )
 {
+    collect( subtree, "" );
+}
+
+
+void FileSizeStats::collect( FileInfo * subtree, const QString & suffix )
+{
+    TRACE_SPAN( "FileSizeStats::collect" );
+
     Q_CHECK_PTR( subtree );
 
-    if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
+    _suffix = suffix;
 
-    if ( subtree->isFile() )
-        _data << subtree->size();
+    StatsEngine engine;
+    engine.addCollector( this );
+    engine.collect( subtree );
+}
 
-    FileInfoIterator it( subtree );
 
-    while ( *it )
-    {
-	FileInfo * item = *it;
-
-	if ( item->hasChildren() )
-	{
-	    collect( item );
-	}
-	else if ( item->isFile() )
-	{
-            _data << item->size();
-	}
-	// Disregard symlinks, block devices and other special files
-
-	++it;
-    }
+void FileSizeStats::startCollecting( FileInfo * subtree )
+{
+    if ( _data.isEmpty() && ! _approximate )
+        _data.reserve( (int) qMin( subtree->totalFiles(), (FileCount) INT_MAX ) );
+
+    dataChanged();
 }
 
 
-void FileSizeStats::collect( FileInfo * subtree, const QString & suffix )
+void FileSizeStats::collectItem( FileInfo * item )
 {
-    Q_CHECK_PTR( subtree );
+    // Disregard directories, symlinks, block devices and other special files
+
+    if ( ! item->isFile() )
+        return;
+
+    if ( _suffix.isEmpty() || item->name().toLower().endsWith( _suffix ) )
+        addValue( item->size() );
+}
 
-    if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
 
-    if ( subtree->isFile() && subtree->name().toLower().endsWith( suffix ) )
-        _data << subtree->size();
+void FileSizeStats::collectColumns( const TreeColumns & columns, int first, int end )
+{
+    // Only without a suffix: The columns don't have the names
 
-    FileInfoIterator it( subtree );
+    const quint8   * flags = columns.flags().constData();
+    const FileSize * sizes = columns.sizes().constData();
 
-    while ( *it )
+    for ( int i = first; i < end; ++i )
     {
-	FileInfo * item = *it;
-
-	if ( item->hasChildren() )
-	{
-	    collect( item, suffix );
-	}
-	else if ( item->isFile() )
-	{
-            if ( item->name().toLower().endsWith( suffix ) )
-                _data << item->size();
-	}
-	// Disregard symlinks, block devices and other special files
-
-	++it;
+	if ( flags[ i ] & TreeColumns::ItemIsFile )
+	    addValue( sizes[ i ] );
     }
 }
 
 
+StatsCollector * FileSizeStats::createPartial() const
+{
+    FileSizeStats * partial = new FileSizeStats();
+    CHECK_NEW( partial );
+    partial->setSuffix( _suffix );
+    partial->setApproximate( _approximate );
+
+    return partial;
+}
+
+
+void FileSizeStats::merge( StatsCollector * partial )
+{
+    FileSizeStats * stats = static_cast<FileSizeStats *>( partial );
+
+    mergeValues( *stats );
+}
+
+
+QString FileSizeStats::cacheKey() const
+{
+    // Only a sketch is small enough to be cached for each large directory;
+    // exact data would be stored again on each level of the tree.
+
+    if ( ! _approximate )
+        return QString();
+
+    return "FileSizeStats:" + _suffix;
+}
+
+
 QRealList FileSizeStats::fillBuckets( int bucketCount,
                                       int startPercentile,
                                       int endPercentile )
@@ -110,13 +167,10 @@ QRealList FileSizeStats::fillBuckets( int bucketCount,
     for ( int i=0; i < bucketCount; ++i )
         buckets << 0.0;
 
-    if ( _data.isEmpty() )
+    if ( dataSize() == 0 )
         return buckets;
 
 
-    // The first call to percentile() or quantile() will cause the data to be
-    // sorted, so there is no need to sort them again here.
-
     qreal startVal = percentile( startPercentile );
     qreal endVal   = percentile( endPercentile );
     qreal bucketWidth = ( endVal - startVal ) / bucketCount;
@@ -130,22 +184,49 @@ QRealList FileSizeStats::fillBuckets( int bucketCount,
                << endl;
 #endif
 
-    for ( int i=0; i < _data.size(); ++i )
+    if ( _approximate )
     {
-        qreal val = _data.at( i );
+        // All values of one sketch bucket go into the histogram bucket of
+        // the value that represents them.
+
+        for ( int i=0; i < _sketch.bucketCount(); ++i )
+        {
+            qreal val = _sketch.bucketValue( i );
+
+            if ( val < startVal || _sketch.bucketItems( i ) == 0 )
+                continue;
+
+            if ( val > endVal )
+                break;
+
+            int index = qMin( ( val - startVal ) / bucketWidth, bucketCount - 1.0 );
+            buckets[ index ] += _sketch.bucketItems( i );
+        }
 
-        if ( val < startVal )
-            continue;
+        return buckets;
+    }
 
-        if ( val > endVal )
-            break;
+    // With sorted data, the values of each bucket are one contiguous range:
+    // Find the bucket boundaries with a binary search instead of looking at
+    // each value. This is fast enough to do it for each step while the user
+    // is dragging the start / end percentile sliders, so the data are sorted
+    // (only once) here even though the percentiles don't need that.
+
+    if ( ! _sorted )
+        sort();
 
-        // TO DO: Optimize this by taking into account that the data are sorted
-        // already. We don't really need that many divisions; just when leaving
-        // the current bucket would be sufficient.
+    BucketIndex bucketIndex( startVal, bucketWidth, bucketCount );
+
+    QRealList::const_iterator it  = std::lower_bound( _data.constBegin(), _data.constEnd(), startVal );
+    QRealList::const_iterator end = std::upper_bound( it, _data.constEnd(), endVal );
+
+    while ( it != end )
+    {
+        int index = bucketIndex( *it );
+        QRealList::const_iterator next = std::upper_bound( it, end, index, bucketIndex );
 
-        int index = qMin( ( val - startVal ) / bucketWidth, bucketCount - 1.0 );
-        ++buckets[ index ];
+        buckets[ index ] += next - it;
+        it = next;
     }
 
     return buckets;
@@ -11,6 +11,7 @@
 #define FileSizeStats_h
 
 #include "PercentileStats.h"
+#include "StatsEngine.h"
 #include "FileInfo.h"
 
 
@@ -24,11 +25,13 @@ namespace QDirStat
      *
      * Notice that one data item (one qreal, i.e. one 64 bit double) is
      * stored for each file (or each matching file) in this object, so this is
-     * expensive in terms of memory usage. Also, since data usually need to be
-     * sorted for those calculations and sorting has at least logarithmic cost
-     * O( n * log(n) ), this also has heavy performance impact.
+     * expensive in terms of memory usage. See PercentileStats for what is
+     * sorted when.
+     *
+     * This is also a StatsCollector, so it can be collected by a StatsEngine
+     * together with other statistics in one traversal of the tree.
      **/
-    class FileSizeStats: public PercentileStats
+    class FileSizeStats: public PercentileStats, public StatsCollector
     {
     public:
 
@@ -54,6 +57,29 @@ namespace QDirStat
 	 **/
 	void collect( FileInfo * subtree, const QString & suffix );
 
+	/**
+	 * Set the filename suffix for collecting with a StatsEngine: Only files
+	 * with that suffix are collected. An empty suffix means all files.
+	 **/
+	void setSuffix( const QString & suffix ) { _suffix = suffix; }
+
+	/**
+	 * Return the filename suffix for collecting with a StatsEngine.
+	 **/
+	const QString & suffix() const { return _suffix; }
+
+	//
+	// Reimplemented from StatsCollector
+	//
+
+	virtual void startCollecting( FileInfo * subtree ) Q_DECL_OVERRIDE;
+	virtual void collectItem( FileInfo * item ) Q_DECL_OVERRIDE;
+	virtual bool canCollectColumns() const Q_DECL_OVERRIDE { return _suffix.isEmpty(); }
+	virtual void collectColumns( const TreeColumns & columns, int first, int end ) Q_DECL_OVERRIDE;
+	virtual StatsCollector * createPartial() const Q_DECL_OVERRIDE;
+	virtual void merge( StatsCollector * partial ) Q_DECL_OVERRIDE;
+	virtual QString cacheKey() const Q_DECL_OVERRIDE;
+
         /**
          * Fill buckets for a histogram from 'startPercentile' to
          * 'endPercentile'.
@@ -61,6 +87,10 @@ namespace QDirStat
         QRealList fillBuckets( int bucketCount,
                                int startPercentile,
                                int endPercentile );
+
+    protected:
+
+	QString _suffix;
     };
 
 }	// namespace QDirStat
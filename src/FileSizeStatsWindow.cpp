@@ -13,10 +13,12 @@
 #include <QProcess>
 
 #include "FileSizeStatsWindow.h"
+#include "StatsEngine.h"
 #include "HistogramView.h"
 #include "BucketsTableModel.h"
 #include "DirTree.h"
 #include "MainWindow.h"
+#include "Settings.h"
 #include "SettingsHelpers.h"
 #include "HeaderTweaker.h"
 #include "QDirStatApp.h"
@@ -24,6 +26,9 @@
 #include "Logger.h"
 #include "Exception.h"
 
+// Above this number of files, use approximate statistics with bounded memory
+#define EXACT_STATS_MAX_FILES	1000000
+
 using namespace QDirStat;
 
 
@@ -35,7 +40,9 @@ FileSizeStatsWindow::FileSizeStatsWindow( QWidget * parent ):
     _ui( new Ui::FileSizeStatsWindow ),
     _subtree( 0 ),
     _suffix( "" ),
-    _stats( 0 )
+    _stats( 0 ),
+    _engine( 0 ),
+    _exactStatsMaxFiles( EXACT_STATS_MAX_FILES )
 {
     // logDebug() << "init" << endl;
 
@@ -44,9 +51,22 @@ FileSizeStatsWindow::FileSizeStatsWindow( QWidget * parent ):
     initWidgets();
     readWindowSettings( this, "FileSizeStatsWindow" );
 
+    Settings settings;
+    settings.beginGroup( "FileSizeStatsWindow" );
+    _exactStatsMaxFiles = settings.value( "ExactStatsMaxFiles", EXACT_STATS_MAX_FILES ).toInt();
+    settings.endGroup();
+
     _stats = new FileSizeStats();
     CHECK_NEW( _stats );
 
+    _engine = new StatsEngine( this );
+    CHECK_NEW( _engine );
+
+    _engine->addCollector( _stats );
+
+    connect( _engine, SIGNAL( finished()     ),
+	     this,    SLOT  ( calcFinished() ) );
+
     _bucketsTableModel = new BucketsTableModel( this, _ui->histogramView );
     CHECK_NEW( _bucketsTableModel );
 
@@ -66,6 +86,13 @@ FileSizeStatsWindow::~FileSizeStatsWindow()
 {
     // logDebug() << "destroying" << endl;
     writeWindowSettings( this, "FileSizeStatsWindow" );
+
+    Settings settings;
+    settings.beginGroup( "FileSizeStatsWindow" );
+    settings.setDefaultValue( "ExactStatsMaxFiles", _exactStatsMaxFiles );
+    settings.endGroup();
+
+    delete _engine;	// The threads might still be collecting into _stats
     delete _stats;
     delete _ui;
 }
@@ -85,6 +112,7 @@ FileSizeStatsWindow * FileSizeStatsWindow::sharedInstance()
 
 void FileSizeStatsWindow::clear()
 {
+    _engine->waitForDone();
     _stats->clear();
 }
 
@@ -121,14 +149,30 @@ void FileSizeStatsWindow::initWidgets()
 
 void FileSizeStatsWindow::calc()
 {
-    _stats->clear();
+    // For huge trees, keeping and sorting all file sizes would cost a lot of
+    // memory and time: Use a quantile sketch instead.
+
+    _engine->waitForDone();
+    _stats->setApproximate( _exactStatsMaxFiles > 0 &&
+			    _subtree->totalFiles() > _exactStatsMaxFiles );
+    _stats->setSuffix( _suffix );
+    _engine->start( _subtree );
+}
 
-    if ( _suffix.isEmpty() )
-	_stats->collect( _subtree );
-    else
-	_stats->collect( _subtree, _suffix );
+
+void FileSizeStatsWindow::calcFinished()
+{
+    // This might still be from a previous calc()
+    if ( _engine->isBusy() )
+	return;
 
     _stats->sort();
+
+    if ( _stats->isApproximate() )
+	_ui->heading->setText( _heading + " " + tr( "(approximated)" ) );
+
+    fillHistogram();
+    fillPercentileTable();
 }
 
 
@@ -163,19 +207,20 @@ void FileSizeStatsWindow::populate( FileInfo * subtree, const QString & suffix )
 	url = subtree->tree()->url();
 
     if ( _suffix.isEmpty() )
-	_ui->heading->setText( tr( "File Size Statistics for %1" ).arg( url ) );
+	_heading = tr( "File Size Statistics for %1" ).arg( url );
     else
-	_ui->heading->setText( tr( "File Size Statistics for %1 in %2" )
-			       .arg( suffix ).arg( url ) );
-    calc();
+	_heading = tr( "File Size Statistics for %1 in %2" ).arg( suffix ).arg( url );
 
-    fillHistogram();
-    fillPercentileTable();
+    _ui->heading->setText( _heading );
+    calc();
 }
 
 
 void FileSizeStatsWindow::fillPercentileTable()
 {
+    if ( _engine->isBusy() )	// The results are not there yet
+	return;
+
     int step = _ui->percentileFilterComboBox->currentIndex() == 0 ? 5 : 1;
     fillQuantileTable( _ui->percentileTable, 100, "P",
 		       _stats->percentileSums(),
@@ -442,6 +487,9 @@ void FileSizeStatsWindow::toggleOptions()
 
 void FileSizeStatsWindow::applyOptions()
 {
+    if ( _engine->isBusy() )
+	return;
+
     HistogramView * histogram = _ui->histogramView;
 
     int newStart = _ui->startPercentileSlider->value();
@@ -463,6 +511,9 @@ void FileSizeStatsWindow::applyOptions()
 
 void FileSizeStatsWindow::autoPercentiles()
 {
+    if ( _engine->isBusy() )
+	return;
+
     _ui->histogramView->autoStartEndPercentiles();
 
     updateOptions();
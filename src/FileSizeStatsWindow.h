@@ -24,6 +24,7 @@ namespace QDirStat
 {
     class DirTree;
     class FileSizeStats;
+    class StatsEngine;
     class BucketsTableModel;
 
 
@@ -129,6 +130,11 @@ namespace QDirStat
 	 **/
 	void showHelp();
 
+	/**
+	 * Fill the widgets when the statistics are there.
+	 **/
+	void calcFinished();
+
 
     protected:
 
@@ -138,7 +144,8 @@ namespace QDirStat
 	void clear();
 
 	/**
-	 * Calculate the statistics from the tree.
+	 * Start calculating the statistics from the tree in other threads.
+	 * calcFinished() is called when they are done.
 	 **/
 	void calc();
 
@@ -225,8 +232,11 @@ namespace QDirStat
 	Ui::FileSizeStatsWindow *   _ui;
 	FileInfo *		    _subtree;
 	QString			    _suffix;
+	QString			    _heading;	// without "(approximated)"
 	FileSizeStats *		    _stats;
+	StatsEngine *		    _engine;
 	BucketsTableModel *	    _bucketsTableModel;
+	int			    _exactStatsMaxFiles;
 
 	static QPointer<FileSizeStatsWindow> _sharedInstance;
     };
@@ -9,7 +9,6 @@
 
 #include "FileTypeStats.h"
 #include "DirTree.h"
-#include "FileInfoIterator.h"
 #include "MimeCategorizer.h"
 #include "FormatUtil.h"
 #include "Logger.h"
@@ -43,6 +42,14 @@ void FileTypeStats::clear()
     _suffixCount.clear();
     _categorySum.clear();
     _categoryCount.clear();
+    _categoryNonSuffixRuleSum.clear();
+    _categoryNonSuffixRuleCount.clear();
+    _suffixIdSum.clear();
+    _suffixIdCount.clear();
+    _otherSuffixIndex.clear();
+    _otherSuffixes.clear();
+    _otherSuffixSum.clear();
+    _otherSuffixCount.clear();
     _totalSize = 0LL;
 }
 
@@ -107,108 +114,202 @@ void FileTypeStats::calc( FileInfo * subtree )
 
     if ( subtree && subtree->checkMagicNumber() )
     {
-        collect( subtree );
-        _totalSize = subtree->totalSize();
-        removeCruft();
-        removeEmpty();
-        sanityCheck();
+        StatsEngine engine;
+        engine.addCollector( this );
+        engine.collect( subtree );
     }
 
     emit calcFinished();
 }
 
 
-void FileTypeStats::collect( FileInfo * dir )
+void FileTypeStats::startCollecting( FileInfo * subtree )
 {
-    if ( ! dir )
-	return;
+    Q_UNUSED( subtree );
 
-    FileInfoIterator it( dir );
+    clear();
+}
 
-    while ( *it )
-    {
-	FileInfo * item = *it;
 
-	if ( item->hasChildren() )
-	{
-	    collect( item );
-	}
-	else if ( item->isFile() )
-	{
-	    QString suffix;
-
-	    // First attempt: Try the MIME categorizer.
-	    //
-	    // If it knows the file's suffix, it can much easier find the
-	    // correct one in case there are multiple to choose from, for
-	    // example ".tar.bz2", not ".bz2" for a bzipped tarball. But on
-	    // Linux systems, having multiple dots in filenames is very common,
-	    // e.g. in .deb or .rpm packages, so the longest possible suffix is
-	    // not always the useful one (because it might contain version
-	    // numbers and all kinds of irrelevant information).
-	    //
-	    // The suffixes the MIME categorizer knows are carefully
-	    // hand-crafted, so if it knows anything about a suffix, it's the
-	    // best choice.
-
-	    MimeCategory * category = _mimeCategorizer->category( item->name(), &suffix );
-
-            if ( category )
-            {
-                addCategorySum( category, item );
-
-                if ( suffix.isEmpty() )
-                    addNonSuffixRuleSum( category, item );
-                else
-                    addSuffixSum( suffix, item );
-            }
-            else // ! category
+void FileTypeStats::collectItem( FileInfo * item )
+{
+    // The files of a directory read in directories-only mode are only in
+    // its file summary
+
+    if ( item->isDirInfo() && item->toDirInfo()->hasFileSummary() )
+	addFileSummary( item->toDirInfo()->fileSummary() );
+
+    // Disregard directories, symlinks, block devices and other special files
+
+    if ( ! item->isFile() )
+        return;
+
+    // First attempt: Try the MIME categorizer.
+    //
+    // If it knows the file's suffix, it can much easier find the
+    // correct one in case there are multiple to choose from, for
+    // example ".tar.bz2", not ".bz2" for a bzipped tarball. But on
+    // Linux systems, having multiple dots in filenames is very common,
+    // e.g. in .deb or .rpm packages, so the longest possible suffix is
+    // not always the useful one (because it might contain version
+    // numbers and all kinds of irrelevant information).
+    //
+    // The suffixes the MIME categorizer knows are carefully
+    // hand-crafted, so if it knows anything about a suffix, it's the
+    // best choice.
+    //
+    // This is called for every file, so it only adds to flat arrays; the
+    // suffix and category maps are only filled in foldSuffixSums().
+
+    int suffixId;
+    MimeCategory * category = _mimeCategorizer->category( item->name(), 0, &suffixId );
+
+    if ( category )
+    {
+        if ( suffixId < 0 )
+        {
+            addCategorySum( category, item );
+            addNonSuffixRuleSum( category, item );
+        }
+        else
+        {
+            if ( suffixId >= _suffixIdSum.size() )
             {
-                addCategorySum( _otherCategory, item );
-
-                if ( suffix.isEmpty() )
-                {
-                    if ( item->name().contains( '.' ) && ! item->name().startsWith( '.' ) )
-                    {
-                        // Fall back to the last (i.e. the shortest) suffix if the
-                        // MIME categorizer didn't know it: Use section -1 (the
-                        // last one, ignoring any trailing '.' separator).
-                        //
-                        // The downside is that this would not find a ".tar.bz",
-                        // but just the ".bz" for a compressed tarball. But it's
-                        // much better than getting a ".eab7d88df-git.deb" rather
-                        // than a ".deb".
-
-                        suffix = item->name().section( '.', -1 );
-                    }
-                }
-
-                suffix = suffix.toLower();
-
-                if ( suffix.isEmpty() )
-                    suffix = NO_SUFFIX;
-
-                addSuffixSum( suffix, item );
+                int size = qMax( suffixId + 1, _mimeCategorizer->suffixIdCount() );
+                _suffixIdSum.resize( size );
+                _suffixIdCount.resize( size );
             }
-            // Disregard symlinks, block devices and other special files
+
+            _suffixIdSum[ suffixId ] += item->size();
+            ++_suffixIdCount[ suffixId ];
+        }
+    }
+    else // ! category
+    {
+        QString suffix;
+
+        if ( item->name().contains( '.' ) && ! item->name().startsWith( '.' ) )
+        {
+            // Fall back to the last (i.e. the shortest) suffix if the
+            // MIME categorizer didn't know it: Use section -1 (the
+            // last one, ignoring any trailing '.' separator).
+            //
+            // The downside is that this would not find a ".tar.bz",
+            // but just the ".bz" for a compressed tarball. But it's
+            // much better than getting a ".eab7d88df-git.deb" rather
+            // than a ".deb".
+
+            suffix = item->name().section( '.', -1 ).toLower();
         }
 
-	++it;
+        if ( suffix.isEmpty() )
+            suffix = NO_SUFFIX;
+
+        int index = otherSuffixIndex( suffix );
+        _otherSuffixSum[ index ] += item->size();
+        ++_otherSuffixCount[ index ];
     }
 }
 
 
-void FileTypeStats::addCategorySum( MimeCategory * category, FileInfo * item )
+int FileTypeStats::otherSuffixIndex( const QString & suffix )
 {
-    _categorySum[ category ] += item->size();
-    ++_categoryCount[ category ];
+    QHash<QString, int>::const_iterator it = _otherSuffixIndex.constFind( suffix );
+
+    if ( it != _otherSuffixIndex.constEnd() )
+        return it.value();
+
+    int index = _otherSuffixes.size();
+    _otherSuffixIndex.insert( suffix, index );
+    _otherSuffixes    << suffix;
+    _otherSuffixSum   << 0LL;
+    _otherSuffixCount << 0;
+
+    return index;
+}
+
+
+StatsCollector * FileTypeStats::createPartial() const
+{
+    FileTypeStats * partial = new FileTypeStats();
+    CHECK_NEW( partial );
+
+    return partial;
+}
+
+
+void FileTypeStats::merge( StatsCollector * partial )
+{
+    FileTypeStats * stats = static_cast<FileTypeStats *>( partial );
+
+    if ( _suffixIdSum.size() < stats->_suffixIdSum.size() )
+    {
+        _suffixIdSum.resize  ( stats->_suffixIdSum.size() );
+        _suffixIdCount.resize( stats->_suffixIdSum.size() );
+    }
+
+    for ( int i=0; i < stats->_suffixIdSum.size(); ++i )
+    {
+        _suffixIdSum  [ i ] += stats->_suffixIdSum.at( i );
+        _suffixIdCount[ i ] += stats->_suffixIdCount.at( i );
+    }
+
+    for ( int i=0; i < stats->_otherSuffixes.size(); ++i )
+    {
+        int index = otherSuffixIndex( stats->_otherSuffixes.at( i ) );
+        _otherSuffixSum  [ index ] += stats->_otherSuffixSum.at( i );
+        _otherSuffixCount[ index ] += stats->_otherSuffixCount.at( i );
+    }
+
+    mergeCategoryMap( _categorySum,                stats->_categorySum,                stats );
+    mergeCategoryMap( _categoryCount,              stats->_categoryCount,              stats );
+    mergeCategoryMap( _categoryNonSuffixRuleSum,   stats->_categoryNonSuffixRuleSum,   stats );
+    mergeCategoryMap( _categoryNonSuffixRuleCount, stats->_categoryNonSuffixRuleCount, stats );
+}
+
+
+template<typename T>
+void FileTypeStats::mergeCategoryMap( QMap<MimeCategory *, T>       & sums,
+                                      const QMap<MimeCategory *, T> & partialSums,
+                                      const FileTypeStats           * partial ) const
+{
+    typename QMap<MimeCategory *, T>::const_iterator it = partialSums.constBegin();
+
+    while ( it != partialSums.constEnd() )
+    {
+        MimeCategory * category = it.key();
+
+        if ( category == partial->otherCategory() )
+            category = _otherCategory;
+
+        sums[ category ] += it.value();
+        ++it;
+    }
+}
+
+
+QString FileTypeStats::cacheKey() const
+{
+    // The results depend on the MIME categories
+
+    return QString( "FileTypeStats:%1" ).arg( _mimeCategorizer->generation() );
 }
 
 
-void FileTypeStats::addSuffixSum( const QString & suffix, FileInfo * item )
+void FileTypeStats::finishCollecting( FileInfo * subtree )
 {
-    _suffixSum[ suffix ] += item->size();
-    ++_suffixCount[ suffix ];
+    foldSuffixSums();
+    _totalSize = subtree->totalSize();
+    removeCruft();
+    removeEmpty();
+    sanityCheck();
+}
+
+
+void FileTypeStats::addCategorySum( MimeCategory * category, FileInfo * item )
+{
+    _categorySum[ category ] += item->size();
+    ++_categoryCount[ category ];
 }
 
 
@@ -219,6 +320,61 @@ void FileTypeStats::addNonSuffixRuleSum( MimeCategory * category, FileInfo * ite
 }
 
 
+void FileTypeStats::foldSuffixSums()
+{
+    // The suffix IDs are valid for the current generation of the MIME
+    // categorizer; results of another one are never merged (see cacheKey()).
+
+    int suffixIdCount = qMin( _suffixIdSum.size(), _mimeCategorizer->suffixIdCount() );
+
+    for ( int id=0; id < suffixIdCount; ++id )
+    {
+        if ( _suffixIdCount.at( id ) == 0 )
+            continue;
+
+        QString	       suffix	= _mimeCategorizer->suffix( id );
+        MimeCategory * category = _mimeCategorizer->suffixCategory( id );
+
+        _suffixSum    [ suffix	 ] += _suffixIdSum.at( id );
+        _suffixCount  [ suffix	 ] += _suffixIdCount.at( id );
+        _categorySum  [ category ] += _suffixIdSum.at( id );
+        _categoryCount[ category ] += _suffixIdCount.at( id );
+    }
+
+    for ( int i=0; i < _otherSuffixes.size(); ++i )
+    {
+        const QString & suffix = _otherSuffixes.at( i );
+
+        _suffixSum    [ suffix	       ] += _otherSuffixSum.at( i );
+        _suffixCount  [ suffix	       ] += _otherSuffixCount.at( i );
+        _categorySum  [ _otherCategory ] += _otherSuffixSum.at( i );
+        _categoryCount[ _otherCategory ] += _otherSuffixCount.at( i );
+    }
+
+    _suffixIdSum.clear();
+    _suffixIdCount.clear();
+    _otherSuffixIndex.clear();
+    _otherSuffixes.clear();
+    _otherSuffixSum.clear();
+    _otherSuffixCount.clear();
+}
+
+
+void FileTypeStats::addFileSummary( const DirFileSummary & summary )
+{
+    QHash<MimeCategory *, FileSize>::const_iterator it = summary.categorySum.constBegin();
+
+    while ( it != summary.categorySum.constEnd() )
+    {
+	MimeCategory * category = it.key() ? it.key() : _otherCategory;
+
+	_categorySum  [ category ] += it.value();
+	_categoryCount[ category ] += summary.categoryCount.value( it.key() );
+	++it;
+    }
+}
+
+
 void FileTypeStats::removeCruft()
 {
     // Make sure those two already exist to avoid confusing the iterator
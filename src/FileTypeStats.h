@@ -12,9 +12,12 @@
 
 #include <QObject>
 #include <QMap>
+#include <QHash>
+#include <QVector>
+#include <QStringList>
 
-#include "ui_file-type-stats-window.h"
 #include "DirInfo.h"
+#include "StatsEngine.h"
 
 // Using a suffix that can never occur: A slash is illegal in Linux/Unix
 // filenames.
@@ -41,8 +44,11 @@ namespace QDirStat
      * Class to calculate file type statistics for a subtree, such as how much
      * disk space is used for each kind of filename extension (*.jpg, *.mp4
      * etc.).
+     *
+     * This is also a StatsCollector, so it can be collected by a StatsEngine
+     * together with other statistics in one traversal of the tree.
      **/
-    class FileTypeStats: public QObject
+    class FileTypeStats: public QObject, public StatsCollector
     {
 	Q_OBJECT
 
@@ -152,15 +158,27 @@ namespace QDirStat
 	CategoryFileSizeMapIterator categorySumEnd() const
 	    { return _categorySum.constEnd(); }
 
+	//
+	// Reimplemented from StatsCollector
+	//
+
+	virtual void startCollecting( FileInfo * subtree ) Q_DECL_OVERRIDE;
+	virtual void collectItem( FileInfo * item ) Q_DECL_OVERRIDE;
+	virtual StatsCollector * createPartial() const Q_DECL_OVERRIDE;
+	virtual void merge( StatsCollector * partial ) Q_DECL_OVERRIDE;
+	virtual void finishCollecting( FileInfo * subtree ) Q_DECL_OVERRIDE;
+	virtual QString cacheKey() const Q_DECL_OVERRIDE;
+
     protected:
 
 	/**
-	 * Collect information from the associated widget tree:
-	 *
-	 * Recursively go through the tree and collect sizes for each file type
-	 * (filename extension).
+	 * Add the sums of all entries of 'partial' to 'sums', mapping the
+	 * "other" category of 'partial' to the one of this object.
 	 **/
-	void collect( FileInfo * dir );
+	template<typename T>
+	void mergeCategoryMap( QMap<MimeCategory *, T>	     & sums,
+			       const QMap<MimeCategory *, T> & partialSums,
+			       const FileTypeStats	     * partial ) const;
 
         //
         // Add the various sums
@@ -168,7 +186,25 @@ namespace QDirStat
 
         void addCategorySum     ( MimeCategory * category, FileInfo * item );
         void addNonSuffixRuleSum( MimeCategory * category, FileInfo * item );
-        void addSuffixSum       ( const QString & suffix,  FileInfo * item );
+
+	/**
+	 * Return the index of 'suffix' in the other suffixes, i.e. the ones
+	 * that the MIME categorizer does not know. Add it if it is not there
+	 * yet.
+	 **/
+	int otherSuffixIndex( const QString & suffix );
+
+	/**
+	 * Add the category totals of the files of a directory that was read
+	 * in directories-only mode. There are no suffix sums for them.
+	 **/
+	void addFileSummary( const DirFileSummary & summary );
+
+	/**
+	 * Add the sums that were collected by suffix ID and by index of
+	 * other suffixes to the suffix and category maps and clear them.
+	 **/
+	void foldSuffixSums();
 
 	/**
 	 * Remove useless content from the maps. On a Linux system, there tend
@@ -214,6 +250,17 @@ namespace QDirStat
 	CategoryFileSizeMap	_categoryNonSuffixRuleSum;
 	CategoryIntMap		_categoryNonSuffixRuleCount;
 
+	// While collecting: Sums of the suffix rules of the MIME categorizer
+	// by suffix ID and of the other suffixes by their index, so the maps
+	// above don't need to be searched for each file. See foldSuffixSums().
+
+	QVector<FileSize>	_suffixIdSum;
+	QVector<int>		_suffixIdCount;
+	QHash<QString, int>	_otherSuffixIndex;
+	QStringList		_otherSuffixes;
+	QVector<FileSize>	_otherSuffixSum;
+	QVector<int>		_otherSuffixCount;
+
         FileSize                _totalSize;
     };
 }
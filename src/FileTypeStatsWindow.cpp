@@ -13,6 +13,7 @@
 
 #include "FileTypeStatsWindow.h"
 #include "FileTypeStats.h"
+#include "SharedStats.h"
 #include "FileSizeStatsWindow.h"
 #include "LocateFileTypeWindow.h"
 #include "MimeCategory.h"
@@ -36,7 +37,8 @@ QPointer<FileTypeStatsWindow>  FileTypeStatsWindow::_sharedInstance       = 0;
 
 FileTypeStatsWindow::FileTypeStatsWindow( QWidget * parent ):
     QDialog( parent ),
-    _ui( new Ui::FileTypeStatsWindow )
+    _ui( new Ui::FileTypeStatsWindow ),
+    _stats( 0 )
 {
     // logDebug() << "init" << endl;
 
@@ -61,8 +63,8 @@ FileTypeStatsWindow::FileTypeStatsWindow( QWidget * parent ):
     connect( _ui->actionSizeStats, SIGNAL( triggered()	                 ),
 	     this,		   SLOT	 ( sizeStatsForCurrentFileType() ) );
 
-    _stats = new FileTypeStats( this );
-    CHECK_NEW( _stats );
+    connect( SharedStats::instance(), SIGNAL( finished()	),
+	     this,		      SLOT  ( statsFinished() ) );
 }
 
 
@@ -76,7 +78,6 @@ FileTypeStatsWindow::~FileTypeStatsWindow()
 
 void FileTypeStatsWindow::clear()
 {
-    _stats->clear();
     _ui->treeWidget->clear();
     enableActions(0);
 }
@@ -110,6 +111,7 @@ void FileTypeStatsWindow::initWidgets()
 
 void FileTypeStatsWindow::refresh()
 {
+    SharedStats::instance()->invalidate();
     populate( _subtree() );
 }
 
@@ -140,11 +142,26 @@ void FileTypeStatsWindow::populate( FileInfo * newSubtree )
 {
     clear();
     _subtree = newSubtree;
-    _stats->calc( newSubtree ? newSubtree : _subtree() );
 
     _ui->heading->setText( tr( "File Type Statistics for %1" )
                            .arg( _subtree.url() ) );
 
+    // The items are added in statsFinished()
+    SharedStats::instance()->start( _subtree() );
+}
+
+
+void FileTypeStatsWindow::statsFinished()
+{
+    SharedStats * sharedStats = SharedStats::instance();
+
+    // Another window might have requested another subtree
+    if ( ! _subtree() || sharedStats->subtree() != _subtree() )
+        return;
+
+    clear();
+    _stats = sharedStats->fileTypeStats();
+
     // Don't sort until all items are added
     _ui->treeWidget->setSortingEnabled( false );
 
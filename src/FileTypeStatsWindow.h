@@ -122,6 +122,11 @@ namespace QDirStat
 	 **/
 	void enableActions( QTreeWidgetItem * currentItem );
 
+	/**
+	 * Add the items when the statistics for the subtree are there.
+	 **/
+	void statsFinished();
+
 
     protected:
 
@@ -184,7 +189,7 @@ namespace QDirStat
 
 	Ui::FileTypeStatsWindow *   _ui;
         Subtree                     _subtree;
-	FileTypeStats *		    _stats;
+	FileTypeStats *		    _stats;	// Owned by SharedStats
 
 	static QPointer<LocateFileTypeWindow> _locateFileTypeWindow;
         static QPointer<FileTypeStatsWindow>  _sharedInstance;
@@ -0,0 +1,272 @@
+/*
+ *   File name: FlatpakPkgManager.cpp
+ *   Summary:	Flatpak package manager support for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include "FlatpakPkgManager.h"
+#include "PkgFileListCache.h"
+#include "Logger.h"
+#include "Exception.h"
+
+#define FLATPAK_SYSTEM_DIR	"/var/lib/flatpak"
+#define FLATPAK_USER_DIR	"/.local/share/flatpak"	// below $HOME
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * One deployed app or runtime.
+     **/
+    struct FlatpakDeployment
+    {
+	QString id;
+	QString arch;
+	QString branch;
+	QString dir;	// the active deployment, symlinks resolved
+    };
+
+
+    /**
+     * Return the Flatpak installation directories that exist.
+     **/
+    QStringList installations()
+    {
+	QStringList result;
+	QStringList candidates;
+
+	candidates << FLATPAK_SYSTEM_DIR
+		   << QDir::homePath() + FLATPAK_USER_DIR;
+
+	foreach ( const QString & dir, candidates )
+	{
+	    if ( QFileInfo( dir + "/app" ).isDir() || QFileInfo( dir + "/runtime" ).isDir() )
+		result << dir;
+	}
+
+	return result;
+    }
+
+
+    /**
+     * Return all deployed apps and runtimes of all installations. This
+     * does not create any PkgInfo, so it can be used in worker threads.
+     **/
+    QList<FlatpakDeployment> deployments()
+    {
+	QList<FlatpakDeployment> result;
+	QDir::Filters filters = QDir::Dirs | QDir::NoDotAndDotDot;
+
+	foreach ( const QString & installation, installations() )
+	{
+	    foreach ( const QString & kind, QStringList() << "app" << "runtime" )
+	    {
+		QDir kindDir( installation + "/" + kind );
+
+		foreach ( const QString & id, kindDir.entryList( filters ) )
+		{
+		    QDir idDir( kindDir.filePath( id ) );
+
+		    foreach ( const QString & arch, idDir.entryList( filters ) )
+		    {
+			QDir archDir( idDir.filePath( arch ) );
+
+			foreach ( const QString & branch, archDir.entryList( filters ) )
+			{
+			    // Only deployed refs have an "active" symlink
+
+			    FlatpakDeployment deployment;
+			    deployment.dir = QFileInfo( archDir.filePath( branch + "/active" ) ).canonicalFilePath();
+
+			    if ( deployment.dir.isEmpty() )
+				continue;
+
+			    deployment.id     = id;
+			    deployment.arch   = arch;
+			    deployment.branch = branch;
+			    result << deployment;
+			}
+		    }
+		}
+	    }
+	}
+
+	return result;
+    }
+}
+
+
+bool FlatpakPkgManager::isAvailable()
+{
+    return ! installations().isEmpty();
+}
+
+
+QString FlatpakPkgManager::owningPkg( const QString & path )
+{
+    foreach ( const QString & installation, installations() )
+    {
+	foreach ( const QString & kind, QStringList() << "/app/" << "/runtime/" )
+	{
+	    QString prefix = installation + kind;
+
+	    if ( path.startsWith( prefix ) )
+		return path.mid( prefix.size() ).section( '/', 0, 0 );
+	}
+    }
+
+    return QString();
+}
+
+
+void FlatpakPkgManager::owningPkgCommand( const QStringList & paths,
+					  QString	    & command_ret,
+					  QStringList	    & args_ret )
+{
+    Q_UNUSED( paths );
+
+    command_ret.clear();
+    args_ret.clear();
+}
+
+
+void FlatpakPkgManager::parseOwningPkgOutput( const QStringList	     & paths,
+					      const QString	     & output,
+					      int			exitCode,
+					      QMap<QString, QString> & pkgs_ret )
+{
+    Q_UNUSED( paths );
+    Q_UNUSED( output );
+    Q_UNUSED( exitCode );
+    Q_UNUSED( pkgs_ret );
+}
+
+
+PkgInfoList FlatpakPkgManager::installedPkg()
+{
+    PkgInfoList pkgList;
+
+    foreach ( const FlatpakDeployment & deployment, deployments() )
+    {
+	PkgInfo * pkg = new PkgInfo( deployment.id, deployment.branch, deployment.arch, this );
+	CHECK_NEW( pkg );
+
+	pkgList << pkg;
+    }
+
+    logDebug() << "Found " << pkgList.size() << " Flatpak apps and runtimes" << endl;
+
+    return pkgList;
+}
+
+
+QString FlatpakPkgManager::deployDir( PkgInfo * pkg ) const
+{
+    CHECK_PTR( pkg );
+
+    foreach ( const QString & installation, installations() )
+    {
+	foreach ( const QString & kind, QStringList() << "app" << "runtime" )
+	{
+	    QString active = QString( "%1/%2/%3/%4/%5/active" )
+		.arg( installation ).arg( kind )
+		.arg( pkg->baseName() ).arg( pkg->arch() ).arg( pkg->version() );
+
+	    QString dir = QFileInfo( active ).canonicalFilePath();
+
+	    if ( ! dir.isEmpty() )
+		return dir;
+	}
+    }
+
+    return QString();
+}
+
+
+QStringList FlatpakPkgManager::fileList( PkgInfo * pkg )
+{
+    QString dir = deployDir( pkg );
+
+    if ( dir.isEmpty() )
+	return QStringList();
+
+    return readDeployment( dir );
+}
+
+
+QStringList FlatpakPkgManager::readDeployment( const QString & deployDir, bool * ok )
+{
+    QStringList fileList;
+
+    if ( ok )
+	*ok = QFileInfo( deployDir ).isDir();
+
+    // Not following symlinks: They are part of the deployment themselves
+
+    QDirIterator it( deployDir,
+		     QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+		     QDirIterator::Subdirectories );
+
+    while ( it.hasNext() )
+	fileList << it.next();
+
+    return fileList;
+}
+
+
+PkgFileListCache * FlatpakPkgManager::createFileListCache( PkgFileListCache::LookupType lookupType )
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QStringList pkgNames;
+    QStringList deployDirs;
+
+    foreach ( const FlatpakDeployment & deployment, deployments() )
+    {
+	// Same as queryName()
+
+	pkgNames   << QString( "%1/%2/%3" ).arg( deployment.id ).arg( deployment.arch ).arg( deployment.branch );
+	deployDirs << deployment.dir;
+    }
+
+    PkgFileListCache * cache = new PkgFileListCache( this, lookupType );
+    CHECK_NEW( cache );
+
+    int fileCount = cache->addFileLists( pkgNames, deployDirs, readDeployment );
+
+    logDebug() << "Read " << fileCount << " files of " << pkgNames.size()
+	       << " Flatpak deployments in " << timer.elapsed() << " millisec" << endl;
+
+    return cache;
+}
+
+
+QString FlatpakPkgManager::queryName( PkgInfo * pkg )
+{
+    CHECK_PTR( pkg );
+
+    return QString( "%1/%2/%3" ).arg( pkg->baseName() ).arg( pkg->arch() ).arg( pkg->version() );
+}
+
+
+QStringList FlatpakPkgManager::databasePaths() const
+{
+    QStringList paths;
+
+    foreach ( const QString & installation, installations() )
+	paths << installation + "/.changed";
+
+    return paths;
+}
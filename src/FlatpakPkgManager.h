@@ -0,0 +1,207 @@
+/*
+ *   File name: FlatpakPkgManager.h
+ *   Summary:	Flatpak package manager support for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef FlatpakPkgManager_h
+#define FlatpakPkgManager_h
+
+#include <QString>
+#include <QStringList>
+
+#include "PkgManager.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Support for Flatpak applications and runtimes. This never starts the
+     * 'flatpak' command; it reads the deployments of the system-wide and the
+     * user's installation directly:
+     *
+     *	 /var/lib/flatpak/{app,runtime}/${id}/${arch}/${branch}/active
+     *	 ~/.local/share/flatpak/{app,runtime}/${id}/${arch}/${branch}/active
+     *
+     * Each deployed app or runtime is one package with its ID as the name
+     * and its branch as the version; its files are all the files of its
+     * active deployment.
+     *
+     * This is never a primary package manager; it is used in addition to
+     * the system's package manager.
+     **/
+    class FlatpakPkgManager: public PkgManager
+    {
+    public:
+
+	FlatpakPkgManager() {}
+	virtual ~FlatpakPkgManager() {}
+
+	/**
+	 * Return the name of this package manager.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual QString name() const { return "flatpak"; }
+
+	/**
+	 * Return 'false': Flatpak never manages the system itself.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual bool isPrimaryPkgManager() Q_DECL_OVERRIDE { return false; }
+
+	/**
+	 * Check if there is any Flatpak installation with deployed apps or
+	 * runtimes.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual bool isAvailable() Q_DECL_OVERRIDE;
+
+	/**
+	 * Return the owning package of 'path' if it is in a deployment.
+	 * This does not need any external command.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QString owningPkg( const QString & path ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return an empty command: The owning packages are found with
+	 * owningPkg() without any external command.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual void owningPkgCommand( const QStringList & paths,
+				       QString		 & command_ret,
+				       QStringList	 & args_ret ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Do nothing since there is no owningPkgCommand().
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual void parseOwningPkgOutput( const QStringList	      & paths,
+					   const QString	      & output,
+					   int				exitCode,
+					   QMap<QString, QString>     & pkgs_ret ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return the maximum number of paths for one owningPkgCommand():
+	 * Any number since they are all found in-process.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual int maxOwningPkgBatch() const Q_DECL_OVERRIDE { return 1000; }
+
+
+	//-----------------------------------------------------------------
+	//		       Optional Features
+	//-----------------------------------------------------------------
+
+	/**
+	 * Return 'true' if this package manager supports getting the list of
+	 * installed packages.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsGetInstalledPkg() Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Return the deployed apps and runtimes of all installations.
+	 *
+	 * Ownership of the list elements is transferred to the caller.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual PkgInfoList installedPkg() Q_DECL_OVERRIDE;
+
+	/**
+	 * Return 'true' if this package manager supports getting the file list
+	 * for a package.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsFileList() Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Return the files and directories of the active deployment of 'pkg'.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QStringList fileList( PkgInfo * pkg ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return 'true' since fileList() reads the deployment directly.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsNativeFileList() Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Return 'true' if this package manager supports building a file list
+	 * cache for getting all file lists for all packages.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsFileListCache() Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Create a file list cache with the specified lookup type for all
+	 * deployments. They are read in parallel.
+	 *
+	 * Ownership of the cache is transferred to the caller.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual PkgFileListCache * createFileListCache( PkgFileListCache::LookupType lookupType = PkgFileListCache::LookupByPkg ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return a name that is unique for 'pkg' even if the same app or
+	 * runtime is deployed for several branches or architectures:
+	 * ${id}/${arch}/${branch}.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QString queryName( PkgInfo * pkg ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return the ".changed" files of the installations that Flatpak
+	 * touches whenever anything is installed, updated or removed.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QStringList databasePaths() const Q_DECL_OVERRIDE;
+
+	/**
+	 * Read all files and directories below deployment directory
+	 * 'deployDir'. Set 'ok' to 'false' if that directory could not be
+	 * read.
+	 *
+	 * This is thread-safe, so it can be used from worker threads.
+	 **/
+	static QStringList readDeployment( const QString & deployDir, bool * ok = 0 );
+
+
+    protected:
+
+	/**
+	 * Return the active deployment directory of 'pkg' with all symlinks
+	 * resolved or an empty string if there is none.
+	 **/
+	QString deployDir( PkgInfo * pkg ) const;
+
+    }; // class FlatpakPkgManager
+
+} // namespace QDirStat
+
+
+#endif // FlatpakPkgManager_h
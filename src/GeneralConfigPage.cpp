@@ -75,6 +75,8 @@ void GeneralConfigPage::readSettings()
     settings.beginGroup( "DirectoryTree" );
 
     _ui->crossFilesystemsCheckBox->setChecked   ( settings.value( "CrossFilesystems"    , false ).toBool() );
+    _ui->smartRefreshCheckBox->setChecked       ( settings.value( "SmartRefresh"        , false ).toBool() );
+    _ui->watchForChangesCheckBox->setChecked    ( settings.value( "WatchForChanges"     , false ).toBool() );
     _ui->useBoldForDominantCheckBox->setChecked ( settings.value( "UseBoldForDominant"  , true  ).toBool() );
     _ui->treeUpdateIntervalSpinBox->setValue    ( settings.value( "UpdateTimerMillisec" ,   333 ).toInt()  );
     QString treeIconDir = settings.value( "TreeIconDir", ":/icons/tree-medium/" ).toString();
@@ -108,6 +110,8 @@ void GeneralConfigPage::writeSettings()
     settings.beginGroup( "DirectoryTree" );
 
     settings.setValue( "CrossFilesystems"    , _ui->crossFilesystemsCheckBox->isChecked()   );
+    settings.setValue( "SmartRefresh"        , _ui->smartRefreshCheckBox->isChecked()       );
+    settings.setValue( "WatchForChanges"     , _ui->watchForChangesCheckBox->isChecked()    );
     settings.setValue( "UseBoldForDominant"  , _ui->useBoldForDominantCheckBox->isChecked() );
     settings.setValue( "UpdateTimerMillisec" , _ui->treeUpdateIntervalSpinBox->value()      );
 
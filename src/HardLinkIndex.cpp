@@ -0,0 +1,129 @@
+/*
+ *   File name: HardLinkIndex.cpp
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "HardLinkIndex.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Device number for files without a known inode; the inode number is then
+// the address of the FileInfo, so each of them gets a key of its own.
+
+#define UNKNOWN_DEVICE	(~0ULL)
+
+using namespace QDirStat;
+
+
+HardLinkIndex::HardLinkIndex()
+{
+    // NOP
+}
+
+
+HardLinkIndex::~HardLinkIndex()
+{
+    // NOP
+}
+
+
+void HardLinkIndex::add( dev_t device, ino_t inode, FileInfo * file )
+{
+    CHECK_PTR( file );
+
+    InodeKey key( (quint64) device, (quint64) inode );
+
+    _inodes[ key ] << file;
+    _keys.insert( file, key );
+}
+
+
+void HardLinkIndex::add( FileInfo * file )
+{
+    CHECK_PTR( file );
+
+    InodeKey key( UNKNOWN_DEVICE, (quint64) (quintptr) file );
+
+    _inodes[ key ] << file;
+    _keys.insert( file, key );
+}
+
+
+void HardLinkIndex::remove( FileInfo * file )
+{
+    QHash<FileInfo *, InodeKey>::iterator it = _keys.find( file );
+
+    if ( it == _keys.end() )
+	return;
+
+    QHash<InodeKey, FileInfoList>::iterator inode = _inodes.find( it.value() );
+
+    if ( inode != _inodes.end() )
+    {
+	inode.value().removeOne( file );
+
+	if ( inode.value().isEmpty() )
+	    _inodes.erase( inode );
+    }
+
+    _keys.erase( it );
+}
+
+
+void HardLinkIndex::clear()
+{
+    _inodes.clear();
+    _keys.clear();
+}
+
+
+FileInfoList HardLinkIndex::links( FileInfo * file ) const
+{
+    QHash<FileInfo *, InodeKey>::const_iterator it = _keys.constFind( file );
+
+    if ( it == _keys.constEnd() )
+	return FileInfoList();
+
+    return _inodes.value( it.value() );
+}
+
+
+FileInfoList HardLinkIndex::files( FileInfo * subtree ) const
+{
+    FileInfoList result;
+
+    for ( QHash<FileInfo *, InodeKey>::const_iterator it = _keys.constBegin();
+	  it != _keys.constEnd();
+	  ++it )
+    {
+	if ( ! subtree || it.key()->isInSubtree( subtree ) )
+	    result << it.key();
+    }
+
+    return result;
+}
+
+
+FileSize HardLinkIndex::uniqueSize( FileInfo * subtree ) const
+{
+    FileSize size = 0;
+
+    foreach ( const FileInfoList & links, _inodes )
+    {
+	foreach ( FileInfo * file, links )
+	{
+	    if ( ! subtree || file->isInSubtree( subtree ) )
+	    {
+		size += file->rawByteSize();	// Only once for each inode
+		break;
+	    }
+	}
+    }
+
+    return size;
+}
@@ -0,0 +1,114 @@
+/*
+ *   File name: HardLinkIndex.h
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef HardLinkIndex_h
+#define HardLinkIndex_h
+
+
+#include <sys/types.h>
+
+#include <QHash>
+#include <QPair>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Index of all regular files with more than one hard link in a DirTree by
+     * device and inode number, so all links of the same file that are in the
+     * tree can be found at once, and the disk space that all of them really
+     * take can be calculated exactly.
+     *
+     * Only files with multiple hard links are indexed, which are normally
+     * only very few, so this hardly costs anything for the other files.
+     * FileInfo registers itself here when it is created from a stat() result
+     * and removes itself when it is destroyed. Files that were read from a
+     * cache file don't have an inode number, so each of them is indexed as
+     * an inode of its own.
+     **/
+    class HardLinkIndex
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	HardLinkIndex();
+
+	/**
+	 * Destructor.
+	 **/
+	~HardLinkIndex();
+
+	/**
+	 * Add 'file' with inode number 'inode' on 'device'.
+	 **/
+	void add( dev_t device, ino_t inode, FileInfo * file );
+
+	/**
+	 * Add 'file' without a known inode number, e.g. a file read from a
+	 * cache file. It is treated as if it were the only link of its inode
+	 * in the tree.
+	 **/
+	void add( FileInfo * file );
+
+	/**
+	 * Remove 'file' if it is in the index.
+	 **/
+	void remove( FileInfo * file );
+
+	/**
+	 * Remove all files.
+	 **/
+	void clear();
+
+	/**
+	 * Return all files in the tree that are hard links to the same inode
+	 * as 'file', including 'file' itself, or an empty list if 'file' is
+	 * not in the index.
+	 **/
+	FileInfoList links( FileInfo * file ) const;
+
+	/**
+	 * Return all indexed files that are in 'subtree'.
+	 **/
+	FileInfoList files( FileInfo * subtree ) const;
+
+	/**
+	 * Return the number of inodes with hard links in the tree.
+	 **/
+	int inodeCount() const { return _inodes.size(); }
+
+	/**
+	 * Return the number of files in the index.
+	 **/
+	int fileCount() const { return _keys.size(); }
+
+	/**
+	 * Return the sum of the sizes of all indexed files in 'subtree',
+	 * counting each inode only once.
+	 **/
+	FileSize uniqueSize( FileInfo * subtree ) const;
+
+
+    protected:
+
+	typedef QPair<quint64, quint64> InodeKey;	// device, inode
+
+	QHash<InodeKey, FileInfoList>	_inodes;
+	QHash<FileInfo *, InodeKey>	_keys;
+
+    };	// class HardLinkIndex
+
+}	// namespace QDirStat
+
+
+#endif // ifndef HardLinkIndex_h
@@ -0,0 +1,62 @@
+/*
+ *   File name: IdTable.cpp
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "IdTable.h"
+#include "Logger.h"
+
+// The largest possible number of entries with a 16 bit index
+
+#define ID_TABLE_MAX_SIZE	65536
+
+using namespace QDirStat;
+
+
+IdTable::IdTable( const char * name ):
+    _name( name ),
+    _lastValue( 0 ),
+    _lastIndex( 0 ),
+    _warnedFull( false )
+{
+    // NOP
+}
+
+
+quint16 IdTable::lookup( quint64 value )
+{
+    QHash<quint64, quint16>::const_iterator it = _indexes.constFind( value );
+    quint16 index = 0;
+
+    if ( it != _indexes.constEnd() )
+    {
+	index = it.value();
+    }
+    else if ( _values.size() < ID_TABLE_MAX_SIZE )
+    {
+	index = (quint16) _values.size();
+	_values.append( value );
+	_indexes.insert( value, index );
+    }
+    else
+    {
+	if ( ! _warnedFull )
+	{
+	    logWarning() << "Too many different " << _name << " values; "
+			 << "using " << _values.first() << " for " << value
+			 << " and all others" << endl;
+	    _warnedFull = true;
+	}
+
+	return 0;
+    }
+
+    _lastValue = value;
+    _lastIndex = index;
+
+    return index;
+}
@@ -0,0 +1,93 @@
+/*
+ *   File name: IdTable.h
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef IdTable_h
+#define IdTable_h
+
+
+#include <QVector>
+#include <QHash>
+
+
+namespace QDirStat
+{
+    /**
+     * Table of distinct values with a small index for each of them.
+     *
+     * This is used for FileInfo fields like the device, the user ID and the
+     * group ID: There are millions of FileInfo nodes in a typical tree, but
+     * only a handful of different devices and not many more different owners,
+     * so each node only stores a 16 bit index into a table like this instead
+     * of the full value.
+     *
+     * Values are never removed from the table, so an index remains valid for
+     * the lifetime of the program.
+     *
+     * This is not thread-safe; use it only from the GUI thread (which is
+     * where all tree nodes are created).
+     **/
+    class IdTable
+    {
+    public:
+
+	/**
+	 * Constructor. 'name' is only used for log messages.
+	 **/
+	IdTable( const char * name );
+
+	/**
+	 * Return the index for 'value'. If that value is not in the table
+	 * yet, it is added.
+	 *
+	 * If the table is full (which should never happen in real life), this
+	 * logs a warning and returns index 0, i.e. the first value that was
+	 * ever added.
+	 **/
+	quint16 index( quint64 value )
+	{
+	    // Fast path: Consecutive nodes very likely have the same value.
+
+	    if ( value == _lastValue && ! _values.isEmpty() )
+		return _lastIndex;
+
+	    return lookup( value );
+	}
+
+	/**
+	 * Return the value for 'index'.
+	 **/
+	quint64 value( quint16 index ) const
+	    { return index < _values.size() ? _values.at( index ) : 0; }
+
+	/**
+	 * Return the number of distinct values in this table.
+	 **/
+	int size() const { return _values.size(); }
+
+
+    protected:
+
+	/**
+	 * Look up 'value' in the hash and add it if it's not there yet.
+	 **/
+	quint16 lookup( quint64 value );
+
+
+	const char *		 _name;
+	QVector<quint64>	 _values;
+	QHash<quint64, quint16>	 _indexes;
+	quint64			 _lastValue;
+	quint16			 _lastIndex;
+	bool			 _warnedFull;
+
+    };	// class IdTable
+
+}	// namespace QDirStat
+
+#endif	// IdTable_h
@@ -0,0 +1,458 @@
+/*
+ *   File name: LatencyReplay.cpp
+ *   Summary:	Scripted replay of GUI actions to measure their latency
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <iostream>	// cout, cerr
+#include <algorithm>	// std::sort()
+
+#include <QApplication>
+#include <QTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QMetaObject>
+
+#include "LatencyReplay.h"
+#include "MainWindow.h"
+#include "QDirStatApp.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "FileInfoIterator.h"
+#include "FileInfoSet.h"
+#include "DirTreeView.h"
+#include "TreemapView.h"
+#include "SelectionModel.h"
+#include "DataColumns.h"
+#include "Logger.h"
+#include "Exception.h"
+#include "Version.h"
+
+
+// Time for the event loop between two samples, so timers and deferred
+// updates of one action don't end up in the next one
+
+#define REPLAY_PAUSE_MILLISEC	100
+
+#define DEFAULT_REPEAT		10
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * Return the largest file below 'dir', following the largest child
+     * on each level, or 0 if there is none.
+     **/
+    FileInfo * largestFile( FileInfo * dir )
+    {
+	FileInfo * item = dir;
+
+	while ( item && item->isDirInfo() )
+	{
+	    const FileInfoList & children =
+		item->toDirInfo()->sortedChildren( SizeCol, Qt::DescendingOrder );
+
+	    item = children.isEmpty() ? 0 : children.first();
+	}
+
+	return item;
+    }
+
+
+    /**
+     * Add up to 'count' items of the subtree of 'dir' to 'items'.
+     **/
+    void collectItems( FileInfo * dir, int count, FileInfoSet & items )
+    {
+	for ( FileInfoIterator it( dir ); *it && items.size() < count; ++it )
+	{
+	    items << *it;
+
+	    if ( (*it)->isDirInfo() )
+		collectItems( *it, count, items );
+	}
+    }
+
+
+    /**
+     * Return the percentile 'percent' of the sorted list 'sorted' in
+     * milliseconds (nearest rank).
+     **/
+    double percentile( const QList<qint64> & sorted, int percent )
+    {
+	if ( sorted.isEmpty() )
+	    return 0.0;
+
+	int index = qBound( 0, ( sorted.size() * percent + 99 ) / 100 - 1, sorted.size() - 1 );
+
+	return sorted.at( index ) / 1000000.0;
+    }
+}
+
+
+LatencyReplay::LatencyReplay( MainWindow * mainWin, QObject * parent ):
+    QObject( parent ),
+    _mainWin( mainWin ),
+    _current( 0 ),
+    _sample( 0 ),
+    _ok( true )
+{
+    _dirTreeView = mainWin->findChild<DirTreeView *>();
+    _treemapView = mainWin->findChild<TreemapView *>();
+}
+
+
+LatencyReplay::~LatencyReplay()
+{
+    // NOP
+}
+
+
+bool LatencyReplay::readScript( const QString & scriptFileName )
+{
+    QFile file( scriptFileName );
+
+    if ( ! file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+    {
+	logError() << "Can't open " << scriptFileName << endl;
+	return false;
+    }
+
+    QTextStream in( &file );
+    int repeat = DEFAULT_REPEAT;
+    int lineNo = 0;
+    bool ok    = true;
+
+    while ( ! in.atEnd() )
+    {
+	QString line = in.readLine();
+	++lineNo;
+
+	int comment = line.indexOf( '#' );
+
+	if ( comment >= 0 )
+	    line.truncate( comment );
+
+	QStringList action = line.split( ' ', QString::SkipEmptyParts );
+
+	if ( action.isEmpty() )
+	    continue;
+
+	if ( action.first() == "repeat" && action.size() == 2 )
+	{
+	    repeat = action.at( 1 ).toInt();
+
+	    if ( repeat > 0 )
+		continue;
+	}
+	else if ( isValid( action ) )
+	{
+	    _actions << action;
+	    _repeat  << repeat;
+
+	    continue;
+	}
+
+	logError() << scriptFileName << ":" << lineNo << ": Syntax error: " << line << endl;
+	std::cerr << qPrintable( scriptFileName ) << ":" << lineNo
+		  << ": Syntax error: " << qPrintable( line ) << std::endl;
+	ok = false;
+    }
+
+    return ok;
+}
+
+
+bool LatencyReplay::isValid( const QStringList & action ) const
+{
+    const QString & name = action.first();
+    bool hasNumber = false;
+
+    if ( action.size() == 2 )
+	action.at( 1 ).toInt( &hasNumber );
+
+    if ( name == "expand" || name == "select" )
+	return hasNumber;
+
+    if ( name == "sort" )
+    {
+	return ( action.size() == 2 || action.size() == 3 ) &&
+	    DataColumns::fromString( action.at( 1 ) ) != UndefinedCol &&
+	    ( action.size() == 2 || action.at( 2 ) == "asc" || action.at( 2 ) == "desc" );
+    }
+
+    if ( name == "stats" )
+    {
+	return action.size() == 2 &&
+	    ( action.at( 1 ) == "size" || action.at( 1 ) == "type" || action.at( 1 ) == "age" );
+    }
+
+    return action.size() == 1 &&
+	( name == "zoom-in"    || name == "zoom-out" ||
+	  name == "reset-zoom" || name == "clear-selection" );
+}
+
+
+void LatencyReplay::start( const QString & cacheFileName )
+{
+    _cacheFileName = cacheFileName;
+
+    if ( ! QFileInfo( cacheFileName ).isReadable() )
+    {
+	logError() << "Can't read " << cacheFileName << endl;
+	std::cerr << "Can't read " << qPrintable( cacheFileName ) << std::endl;
+	_ok = false;
+	finish();
+
+	return;
+    }
+
+    connect( app()->dirTree(), SIGNAL( finished()	   ),
+	     this,		SLOT  ( readingFinished() ) );
+
+    connect( app()->dirTree(), SIGNAL( aborted()	   ),
+	     this,		SLOT  ( readingAborted()  ) );
+
+    _mainWin->readCache( cacheFileName );
+}
+
+
+void LatencyReplay::readingFinished()
+{
+    disconnect( app()->dirTree(), 0, this, 0 );
+    logInfo() << "Replaying " << _actions.size() << " actions" << endl;
+
+    _current = 0;
+    _sample  = 0;
+    _nanosec.clear();
+    scheduleNext();
+}
+
+
+void LatencyReplay::readingAborted()
+{
+    disconnect( app()->dirTree(), 0, this, 0 );
+    logError() << "Reading " << _cacheFileName << " was aborted" << endl;
+    _ok = false;
+    finish();
+}
+
+
+void LatencyReplay::scheduleNext()
+{
+    QTimer::singleShot( REPLAY_PAUSE_MILLISEC, this, SLOT( nextSample() ) );
+}
+
+
+void LatencyReplay::nextSample()
+{
+    if ( _current >= _actions.size() )
+    {
+	finish();
+	return;
+    }
+
+    const QStringList & action = _actions.at( _current );
+
+    prepare( action );
+    qApp->processEvents();
+
+    _timer.start();
+
+    if ( ! perform( action ) )
+    {
+	logError() << "Can't replay " << action.join( " " ) << endl;
+	_ok = false;
+    }
+
+    // The action is done when everything it caused is processed and the
+    // window is painted again
+
+    qApp->processEvents();
+    _mainWin->repaint();
+    _nanosec << _timer.nsecsElapsed();
+
+    if ( ++_sample >= _repeat.at( _current ) )
+    {
+	writeResult();
+	++_current;
+	_sample = 0;
+    }
+
+    scheduleNext();
+}
+
+
+void LatencyReplay::prepare( const QStringList & action )
+{
+    const QString & name = action.first();
+    FileInfo * toplevel  = app()->dirTree()->firstToplevel();
+
+    if ( name == "expand" )
+    {
+	_dirTreeView->collapseAll();
+    }
+    else if ( name == "sort" )
+    {
+	// Sort by anything else first (the model ignores sorting by the
+	// current column and order) and drop the sort caches, so this
+	// really sorts again
+
+	DataColumn col = DataColumns::fromString( action.at( 1 ) );
+	DataColumn other = col == NameCol ? SizeCol : NameCol;
+	_dirTreeView->sortByColumn( DataColumns::toViewCol( other ), Qt::AscendingOrder );
+
+	if ( toplevel && toplevel->isDirInfo() )
+	    toplevel->toDirInfo()->dropSortCache( true ); // recursive
+    }
+    else if ( name == "zoom-in" || name == "zoom-out" )
+    {
+	if ( _treemapView && name == "zoom-in" && ! _treemapView->canZoomIn() )
+	    _treemapView->resetZoom();
+
+	app()->selectionModel()->setCurrentItem( largestFile( toplevel ),
+						 true ); // select
+
+	if ( _treemapView && name == "zoom-out" && ! _treemapView->canZoomOut() )
+	    _treemapView->zoomIn();
+    }
+    else if ( name == "select" )
+    {
+	app()->selectionModel()->clear();
+    }
+}
+
+
+bool LatencyReplay::perform( const QStringList & action )
+{
+    const QString & name = action.first();
+
+    if ( name == "expand" )
+    {
+	return QMetaObject::invokeMethod( _mainWin, "expandTreeToLevel",
+					  Q_ARG( int, action.at( 1 ).toInt() ) );
+    }
+
+    if ( name == "sort" )
+    {
+	DataColumn    col   = DataColumns::fromString( action.at( 1 ) );
+	Qt::SortOrder order = action.size() > 2 && action.at( 2 ) == "desc" ?
+	    Qt::DescendingOrder : Qt::AscendingOrder;
+
+	_dirTreeView->sortByColumn( DataColumns::toViewCol( col ), order );
+
+	return true;
+    }
+
+    if ( name == "stats" )
+    {
+	const char * slot =
+	    action.at( 1 ) == "size" ? "showFileSizeStats" :
+	    action.at( 1 ) == "type" ? "showFileTypeStats" : "showFileAgeStats";
+
+	return QMetaObject::invokeMethod( _mainWin, slot );
+    }
+
+    if ( name == "select" )
+    {
+	FileInfoSet items;
+	FileInfo * toplevel = app()->dirTree()->firstToplevel();
+
+	if ( toplevel )
+	{
+	    items << toplevel;
+	    collectItems( toplevel, action.at( 1 ).toInt(), items );
+	}
+
+	app()->selectionModel()->setSelectedItems( items );
+
+	return true;
+    }
+
+    if ( name == "clear-selection" )
+    {
+	app()->selectionModel()->clear();
+	return true;
+    }
+
+    if ( ! _treemapView )
+	return false;
+
+    if ( name == "zoom-in" )
+	_treemapView->zoomIn();
+    else if ( name == "zoom-out" )
+	_treemapView->zoomOut();
+    else if ( name == "reset-zoom" )
+	_treemapView->resetZoom();
+    else
+	return false;
+
+    return true;
+}
+
+
+void LatencyReplay::writeResult()
+{
+    QList<qint64> sorted = _nanosec;
+    std::sort( sorted.begin(), sorted.end() );
+
+    QJsonObject json;
+    QJsonArray	runs;
+
+    foreach ( qint64 nanosec, _nanosec )
+	runs.append( nanosec / 1000000.0 );
+
+    json[ "version"	   ] = QDIRSTAT_VERSION;
+    json[ "qt"		   ] = qVersion();
+    json[ "timestamp"	   ] = QDateTime::currentDateTime().toString( Qt::ISODate );
+    json[ "tree"	   ] = _cacheFileName;
+    json[ "benchmark"	   ] = _actions.at( _current ).join( " " );
+    json[ "items"	   ] = sorted.size();
+    json[ "minMillisec"	   ] = percentile( sorted, 0 );
+    json[ "medianMillisec" ] = percentile( sorted, 50 );
+    json[ "p90Millisec"	   ] = percentile( sorted, 90 );
+    json[ "p99Millisec"	   ] = percentile( sorted, 99 );
+    json[ "maxMillisec"	   ] = percentile( sorted, 100 );
+    json[ "runsMillisec"   ] = runs;
+
+    std::cout << QJsonDocument( json ).toJson( QJsonDocument::Compact ).constData() << std::endl;
+
+    logInfo() << _actions.at( _current ).join( " " )
+	      << ": median " << percentile( sorted, 50 ) << " ms"
+	      << ", p90 " << percentile( sorted, 90 ) << " ms" << endl;
+
+    _nanosec.clear();
+}
+
+
+void LatencyReplay::finish()
+{
+    QTimer::singleShot( 0, qApp, SLOT( quit() ) );
+}
+
+
+int LatencyReplay::run( MainWindow    * mainWin,
+			const QString & scriptFileName,
+			const QString & cacheFileName )
+{
+    LatencyReplay replay( mainWin );
+
+    if ( ! replay.readScript( scriptFileName ) )
+	return 1;
+
+    replay.start( cacheFileName );
+    qApp->exec();
+
+    return replay.ok() ? 0 : 1;
+}
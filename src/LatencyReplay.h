@@ -0,0 +1,179 @@
+/*
+ *   File name: LatencyReplay.h
+ *   Summary:	Scripted replay of GUI actions to measure their latency
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef LatencyReplay_h
+#define LatencyReplay_h
+
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QElapsedTimer>
+
+
+class MainWindow;
+
+
+namespace QDirStat
+{
+    class DirTreeView;
+    class TreemapView;
+
+
+    /**
+     * Replay of a script of GUI actions in the main window to measure how
+     * long the user has to wait for each of them: Expanding the tree,
+     * sorting by a column, zooming in the treemap, opening a statistics
+     * window, selecting many items.
+     *
+     * The script is a text file with one action per line; empty lines and
+     * comments starting with '#' are ignored:
+     *
+     *	   repeat 20		 # Measure each following action 20 times
+     *	   expand 3		 # Expand the tree to level 3
+     *	   sort SizeCol desc	 # Sort by a column (see DataColumns)
+     *	   zoom-in		 # Zoom the treemap in towards the largest file
+     *	   zoom-out
+     *	   reset-zoom
+     *	   stats type		 # Open the file type (size, age) statistics
+     *	   select 10000		 # Select the first 10000 items of the tree
+     *	   clear-selection
+     *
+     * Each measurement starts when the action is triggered and ends when
+     * the events it caused are processed and the main window is painted
+     * again. Treemap cushions that are still rendered in other threads
+     * after that are not included. Between the measurements, the event
+     * loop runs for a short while, so timers and deferred updates of the
+     * previous one don't end up in the next one.
+     *
+     * The result is one JSON object per action with the percentiles of its
+     * latency in milliseconds, in the same format as qdirstat-benchmark.
+     **/
+    class LatencyReplay: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This does not start anything yet.
+	 **/
+	LatencyReplay( MainWindow * mainWin, QObject * parent = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~LatencyReplay();
+
+	/**
+	 * Read the script 'scriptFileName'. Return 'false' if it can't be
+	 * read or if it has errors.
+	 **/
+	bool readScript( const QString & scriptFileName );
+
+	/**
+	 * Read 'cacheFileName' into the tree and replay the script when it
+	 * is finished. The application quits after the last action.
+	 **/
+	void start( const QString & cacheFileName );
+
+	/**
+	 * Return 'true' if every action in the script could be replayed.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Command line entry point for "qdirstat --replay": Replay
+	 * 'scriptFileName' on 'cacheFileName' in 'mainWin' and write the
+	 * results to stdout. This returns when the application should quit.
+	 *
+	 * Return the exit code for main().
+	 **/
+	static int run( MainWindow    * mainWin,
+			const QString & scriptFileName,
+			const QString & cacheFileName );
+
+
+    protected slots:
+
+	/**
+	 * Reading the cache file is finished: Start the first action.
+	 **/
+	void readingFinished();
+
+	/**
+	 * Reading the cache file was aborted.
+	 **/
+	void readingAborted();
+
+	/**
+	 * Measure the next sample of the current action or go on to the
+	 * next action.
+	 **/
+	void nextSample();
+
+
+    protected:
+
+	/**
+	 * Perform 'action' (a script line split into words) once. Return
+	 * 'false' if that is not possible.
+	 **/
+	bool perform( const QStringList & action );
+
+	/**
+	 * Prepare the next sample of 'action' without measuring it, e.g.
+	 * drop the sort caches so sorting really sorts again.
+	 **/
+	void prepare( const QStringList & action );
+
+	/**
+	 * Check 'action' for syntax errors. Return 'false' if it is not
+	 * valid.
+	 **/
+	bool isValid( const QStringList & action ) const;
+
+	/**
+	 * Write the results for the current action to stdout and clear them.
+	 **/
+	void writeResult();
+
+	/**
+	 * Schedule the next call to nextSample().
+	 **/
+	void scheduleNext();
+
+	/**
+	 * Finish the replay and quit the application.
+	 **/
+	void finish();
+
+
+	//
+	// Data members
+	//
+
+	MainWindow *		_mainWin;
+	DirTreeView *		_dirTreeView;
+	TreemapView *		_treemapView;
+	QList<QStringList>	_actions;
+	QList<int>		_repeat;	// for each action
+	int			_current;	// index in _actions
+	int			_sample;	// of the current action
+	QList<qint64>		_nanosec;	// of the current action
+	QElapsedTimer		_timer;
+	QString			_cacheFileName;
+	bool			_ok;
+    };
+
+}	// namespace QDirStat
+
+
+#endif	// LatencyReplay_h
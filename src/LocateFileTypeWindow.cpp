@@ -12,6 +12,7 @@
 #include "DirTree.h"
 #include "DotEntry.h"
 #include "SelectionModel.h"
+#include "SuffixIndex.h"
 #include "SettingsHelpers.h"
 #include "HeaderTweaker.h"
 #include "FormatUtil.h"
@@ -23,7 +24,8 @@ using namespace QDirStat;
 
 LocateFileTypeWindow::LocateFileTypeWindow( QWidget * parent ):
     QDialog( parent ),
-    _ui( new Ui::LocateFileTypeWindow )
+    _ui( new Ui::LocateFileTypeWindow ),
+    _suffixIndex( 0 )
 {
     // logDebug() << "init" << endl;
 
@@ -113,7 +115,7 @@ void LocateFileTypeWindow::populate( const QString & suffix, FileInfo * newSubtr
     // For better Performance: Disable sorting while inserting many items
     _ui->treeWidget->setSortingEnabled( false );
 
-    populateRecursive( newSubtree ? newSubtree : _subtree() );
+    populateFromIndex( newSubtree ? newSubtree : _subtree() );
 
     _ui->treeWidget->setSortingEnabled( true );
     _ui->treeWidget->sortByColumn( SSR_PathCol, Qt::AscendingOrder );
@@ -141,15 +143,29 @@ void LocateFileTypeWindow::populate( const QString & suffix, FileInfo * newSubtr
 }
 
 
-void LocateFileTypeWindow::populateRecursive( FileInfo * dir )
+void LocateFileTypeWindow::populateFromIndex( FileInfo * subtree )
 {
-    if ( ! dir )
+    if ( ! subtree || ! subtree->tree() )
 	return;
 
-    FileInfoSet matches = matchingFiles( dir );
+    // The index is kept as long as the tree does not change, so locating
+    // another suffix (e.g. from the file type stats window) does not need
+    // to traverse the tree again.
 
-    if ( ! matches.isEmpty() )
+    if ( ! _suffixIndex || _suffixIndex->tree() != subtree->tree() )
+    {
+	delete _suffixIndex;
+	_suffixIndex = new SuffixIndex( subtree->tree(), this );
+	CHECK_NEW( _suffixIndex );
+    }
+
+    foreach ( DirInfo * dir, _suffixIndex->dirs( _searchSuffix, subtree ) )
     {
+	FileInfoSet matches = matchingFiles( dir );
+
+	if ( matches.isEmpty() )
+	    continue;
+
 	// Create a search result for this path
 
 	FileSize totalSize = 0LL;
@@ -163,22 +179,6 @@ void LocateFileTypeWindow::populateRecursive( FileInfo * dir )
 
 	_ui->treeWidget->addTopLevelItem( searchResultItem );
     }
-
-
-    // Recurse through any subdirectories
-
-    FileInfo * child = dir->firstChild();
-
-    while ( child )
-    {
-	if ( child->isDirInfo() )
-	    populateRecursive( child );
-
-	child = child->next();
-    }
-
-    // Notice that unlike in FileTypeStats, there is no need to recurse through
-    // any dot entries: They are handled in matchingFiles() already.
 }
 
 
@@ -25,6 +25,7 @@ namespace QDirStat
     class FileTypeStats;
     class MimeCategory;
     class SelectionModel;
+    class SuffixIndex;
 
 
     /**
@@ -124,10 +125,13 @@ namespace QDirStat
 	void initWidgets();
 
 	/**
-	 * Recursively locate directories that contain files matching the
-	 * search suffix and create a search result item for each one.
+	 * Locate the directories in 'subtree' that contain files matching
+	 * the search suffix and create a search result item for each one.
+	 *
+	 * This uses a SuffixIndex, so only those directories are visited,
+	 * not the complete subtree.
 	 **/
-	void populateRecursive( FileInfo * dir );
+	void populateFromIndex( FileInfo * subtree );
 
 	/**
 	 * Return all direct file children matching the current search suffix.
@@ -142,6 +146,7 @@ namespace QDirStat
 	Ui::LocateFileTypeWindow * _ui;
         Subtree                    _subtree;
 	QString			   _searchSuffix;
+	SuffixIndex *		   _suffixIndex;
     };
 
 
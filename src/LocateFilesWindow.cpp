@@ -8,10 +8,12 @@
 
 
 #include <QMenu>
+#include <QElapsedTimer>
 
 #include "LocateFilesWindow.h"
 #include "QDirStatApp.h"        // SelectionModel, CleanupCollection
 #include "TreeWalker.h"
+#include "DiscoverCache.h"
 #include "FileInfoIterator.h"
 #include "SelectionModel.h"
 #include "ActionManager.h"
@@ -20,10 +22,14 @@
 #include "HeaderTweaker.h"
 #include "QDirStatApp.h"        // dirTreeModel()
 #include "DirTreeModel.h"       // itemTypeIcon()
+#include "DirTree.h"
 #include "FormatUtil.h"
 #include "Logger.h"
 #include "Exception.h"
 
+// Search the tree for this long before showing the results so far
+#define POPULATE_TIME_SLICE_MILLISEC	100
+
 using namespace QDirStat;
 
 
@@ -33,7 +39,8 @@ LocateFilesWindow::LocateFilesWindow( TreeWalker * treeWalker,
     _ui( new Ui::LocateFilesWindow ),
     _treeWalker( treeWalker ),
     _sortCol( LocateListPathCol ),
-    _sortOrder( Qt::AscendingOrder )
+    _sortOrder( Qt::AscendingOrder ),
+    _autoSelectedItem( 0 )
 {
     // logDebug() << "init" << endl;
 
@@ -46,6 +53,30 @@ LocateFilesWindow::LocateFilesWindow( TreeWalker * treeWalker,
     connect( _ui->refreshButton, SIGNAL( clicked() ),
 	     this,		 SLOT  ( refresh() ) );
 
+    connect( _ui->stopButton,	 SIGNAL( clicked() ),
+	     this,		 SLOT  ( stop()	   ) );
+
+    _populateTimer.setSingleShot( true );
+
+    connect( &_populateTimer,	 SIGNAL( timeout()	 ),
+	     this,		 SLOT  ( populateBatch() ) );
+
+    // The directories that are still to be searched must not go away
+
+    DirTree * tree = app()->dirTree();
+
+    connect( tree, SIGNAL( startingReading() ),
+	     this, SLOT	 ( stop()	     ) );
+
+    connect( tree, SIGNAL( clearing() ),
+	     this, SLOT	 ( stop()     ) );
+
+    connect( tree, SIGNAL( clearingSubtree( DirInfo * ) ),
+	     this, SLOT	 ( stop()		       ) );
+
+    connect( tree, SIGNAL( deletingChild( FileInfo * ) ),
+	     this, SLOT	 ( stop()		      ) );
+
     connect( _ui->treeWidget,	 SIGNAL( currentItemChanged( QTreeWidgetItem *,
 							     QTreeWidgetItem * ) ),
 	     this,		 SLOT  ( locateInMainWindow( QTreeWidgetItem * ) ) );
@@ -67,7 +98,9 @@ LocateFilesWindow::~LocateFilesWindow()
 
 void LocateFilesWindow::clear()
 {
+    stop();
     _ui->treeWidget->clear();
+    _autoSelectedItem = 0;
 }
 
 
@@ -75,6 +108,7 @@ void LocateFilesWindow::setTreeWalker( TreeWalker * newTreeWalker )
 {
     CHECK_PTR( newTreeWalker );
 
+    stop();
     delete _treeWalker;
     _treeWalker = newTreeWalker;
 }
@@ -82,6 +116,10 @@ void LocateFilesWindow::setTreeWalker( TreeWalker * newTreeWalker )
 
 void LocateFilesWindow::refresh()
 {
+    // The files on disk might have changed without the tree knowing it
+    // (e.g. the contents of duplicate files)
+    DiscoverCache::instance()->invalidate();
+
     populate( _subtree() );
     selectFirstItem();
 }
@@ -120,52 +158,131 @@ void LocateFilesWindow::populate( FileInfo * newSubtree )
     _subtree = newSubtree;
     _treeWalker->prepare( _subtree() );
 
+    FileInfo *	 subtree = newSubtree ? newSubtree : _subtree();
+    FileInfoList candidates;
+
+    if ( subtree && _treeWalker->findCandidates( subtree, candidates ) )
+    {
+	// For better Performance: Disable sorting while inserting many items
+	_ui->treeWidget->setSortingEnabled( false );
+
+	foreach ( FileInfo * item, candidates )
+	    addItem( item );
+
+	showResultsCount();
+
+	_ui->treeWidget->setSortingEnabled( true );
+	_ui->treeWidget->sortByColumn( _sortCol, _sortOrder );
+    }
+    else if ( subtree )
+    {
+	_pendingDirs << subtree;
+	_ui->stopButton->setEnabled( true );
+	populateBatch();
+    }
+    else
+    {
+	showResultsCount();
+    }
+}
+
+
+void LocateFilesWindow::populateBatch()
+{
+    QElapsedTimer timer;
+    timer.start();
+
     // For better Performance: Disable sorting while inserting many items
     _ui->treeWidget->setSortingEnabled( false );
 
-    populateRecursive( newSubtree ? newSubtree : _subtree() );
-    showResultsCount();
+    while ( ! _pendingDirs.isEmpty() &&
+	    ! _treeWalker->overflow() &&
+	    timer.elapsed() < POPULATE_TIME_SLICE_MILLISEC )
+    {
+	populateDir( _pendingDirs.takeLast() );
+    }
+
+    if ( _treeWalker->overflow() )	// No more results will be accepted
+	_pendingDirs.clear();
 
     _ui->treeWidget->setSortingEnabled( true );
     _ui->treeWidget->sortByColumn( _sortCol, _sortOrder );
+
+    if ( isPopulating() )
+    {
+	_populateTimer.start( 0 );
+    }
+    else
+    {
+	_ui->stopButton->setEnabled( false );
+
+	// Unless the user selected anything else meanwhile, select the item
+	// that is now the first one.
+
+	QTreeWidgetItem * current = _ui->treeWidget->currentItem();
+
+	if ( current && current == _autoSelectedItem )
+	    selectFirstItem();
+    }
+
+    showResultsCount();
 }
 
 
-void LocateFilesWindow::populateRecursive( FileInfo * dir )
+void LocateFilesWindow::stop()
 {
-    if ( ! dir )
+    if ( ! isPopulating() )
 	return;
 
+    logDebug() << "Stopped searching" << endl;
+
+    _populateTimer.stop();
+    _pendingDirs.clear();
+    _ui->stopButton->setEnabled( false );
+    showResultsCount();
+}
+
+
+void LocateFilesWindow::populateDir( FileInfo * dir )
+{
     FileInfoIterator it( dir );
 
     while ( *it )
     {
 	FileInfo * item = *it;
 
-        if ( _treeWalker->check( item ) )
-        {
-            LocateListItem * locateListItem = new LocateListItem( item );
-            CHECK_NEW( locateListItem );
-
-            _ui->treeWidget->addTopLevelItem( locateListItem );
-        }
+        addItem( item );
 
-	if ( item->hasChildren() )
-	{
-	    populateRecursive( item );
-	}
+	if ( item->hasChildren() && _treeWalker->checkSubtree( item ) )
+	    _pendingDirs << item;
 
         ++it;
     }
 }
 
 
+void LocateFilesWindow::addItem( FileInfo * item )
+{
+    if ( _treeWalker->check( item ) )
+    {
+        LocateListItem * locateListItem = new LocateListItem( item );
+        CHECK_NEW( locateListItem );
+
+        _ui->treeWidget->addTopLevelItem( locateListItem );
+    }
+}
+
+
 void LocateFilesWindow::showResultsCount()
 {
     QString text;
     int     count = _ui->treeWidget->topLevelItemCount();
 
-    if ( _treeWalker->overflow() )
+    if ( isPopulating() )
+    {
+        text = tr( "Searching... %1 Results" ).arg( count );
+    }
+    else if ( _treeWalker->overflow() )
     {
         text = tr( "Limited to %1 Results" ).arg( count );
     }
@@ -185,6 +302,8 @@ void LocateFilesWindow::selectFirstItem()
 
     if ( firstItem )
         _ui->treeWidget->setCurrentItem( firstItem );
+
+    _autoSelectedItem = firstItem;
 }
 
 
@@ -12,6 +12,7 @@
 
 #include <QDialog>
 #include <QTreeWidgetItem>
+#include <QTimer>
 
 #include "ui_locate-files-window.h"
 #include "FileInfo.h"
@@ -96,9 +97,19 @@ namespace QDirStat
 	 * This clears the old search results first, then searches the subtree
 	 * and populates the search result list with the items where
 	 * TreeWalker::check() returns 'true'.
+	 *
+	 * Large subtrees are searched in small time slices in the background,
+	 * so the first results are shown (and can be used) right away, and
+	 * the search can be stopped with stop().
 	 **/
 	void populate( FileInfo * subtree = 0 );
 
+	/**
+	 * Stop populating the window if that is still in progress. The
+	 * results found so far remain in the list.
+	 **/
+	void stop();
+
 	/**
 	 * Refresh (reload) all data.
 	 **/
@@ -127,6 +138,12 @@ namespace QDirStat
          **/
         void itemContextMenu( const QPoint & pos );
 
+	/**
+	 * Search the next directories of the subtree for one time slice and
+	 * add the results to the list.
+	 **/
+	void populateBatch();
+
 
     protected:
 
@@ -158,10 +175,22 @@ namespace QDirStat
         void addCleanupHotkeys();
 
 	/**
-	 * Recursively locate directories that contain files matching the
-	 * search suffix and create a search result item for each one.
+	 * Check the direct children of 'dir' with the TreeWalker, create a
+	 * search result item for each match and queue all children that have
+	 * children of their own for populateBatch().
 	 **/
-	void populateRecursive( FileInfo * dir );
+	void populateDir( FileInfo * dir );
+
+	/**
+	 * Return 'true' if populating the window is still in progress.
+	 **/
+	bool isPopulating() const { return ! _pendingDirs.isEmpty(); }
+
+        /**
+         * Create a search result item for 'item' if the TreeWalker accepts
+         * it.
+         **/
+        void addItem( FileInfo * item );
 
 
 	//
@@ -173,6 +202,9 @@ namespace QDirStat
         Subtree                 _subtree;
         int                     _sortCol;
         Qt::SortOrder           _sortOrder;
+        QList<FileInfo *>       _pendingDirs;
+        QTimer                  _populateTimer;
+        QTreeWidgetItem *       _autoSelectedItem;
     };
 
 
@@ -19,6 +19,9 @@
 #include <QSizeF>
 #include <QSize>
 #include <QStringList>
+#include <QThread>
+#include <QThreadStorage>
+#include <QIODevice>
 
 #include <stdio.h>	// stderr, fprintf()
 #include <stdlib.h>	// abort(), mkdtemp()
@@ -30,6 +33,10 @@
 
 #define VERBOSE_ROTATE 0
 
+// Interval for the writer thread to write the queued log lines to the file
+
+#define LOG_WRITE_INTERVAL_MILLISEC	50
+
 
 static LogSeverity toLogSeverity( QtMsgType msgType );
 
@@ -42,15 +49,188 @@ static void qt_logger( QtMsgType msgType,
 #endif
 
 
+/**
+ * One or more complete log lines in the queue of a Logger.
+ **/
+class LogQueueNode
+{
+public:
+
+    LogQueueNode( const QByteArray & text ):
+	text( text ),
+	next( 0 )
+	{}
+
+    QByteArray	   text;
+    LogQueueNode * next;
+};
+
+
+/**
+ * Thread that writes the queued log lines of a Logger to its log file.
+ **/
+class LogWriter: public QThread
+{
+public:
+
+    LogWriter( Logger * logger ):
+	QThread(),
+	_logger( logger )
+	{}
+
+    void stop() { _stopRequested.storeRelease( 1 ); }
+
+protected:
+
+    virtual void run() Q_DECL_OVERRIDE
+    {
+	while ( ! _stopRequested.loadAcquire() )
+	{
+	    _logger->flush();
+	    msleep( LOG_WRITE_INTERVAL_MILLISEC );
+	}
+    }
+
+    Logger *   _logger;
+    QAtomicInt _stopRequested;
+};
+
+
+/**
+ * Device for the log stream of one thread: It collects the text until there
+ * is a complete line (i.e. until 'endl' flushes the stream) and then puts it
+ * into the queue of the logger.
+ **/
+class LogLineDevice: public QIODevice
+{
+public:
+
+    LogLineDevice():
+	QIODevice(),
+	_logger( 0 )
+	{ open( QIODevice::WriteOnly ); }
+
+    void setLogger( Logger * logger ) { _logger = logger; }
+
+protected:
+
+    virtual qint64 readData( char * data, qint64 maxSize ) Q_DECL_OVERRIDE
+    {
+	Q_UNUSED( data );
+	Q_UNUSED( maxSize );
+
+	return -1;
+    }
+
+    virtual qint64 writeData( const char * data, qint64 size ) Q_DECL_OVERRIDE
+    {
+	_pending.append( data, size );
+	int end = _pending.lastIndexOf( '\n' );
+
+	if ( end >= 0 )
+	{
+	    if ( _logger )
+		_logger->enqueue( _pending.left( end + 1 ) );
+
+	    _pending.remove( 0, end + 1 );
+	}
+
+	return size;
+    }
+
+    Logger *   _logger;
+    QByteArray _pending;
+};
+
+
+/**
+ * Device that discards everything for the null stream that suppresses
+ * output below the log level.
+ **/
+class LogNullDevice: public QIODevice
+{
+public:
+
+    LogNullDevice():
+	QIODevice()
+	{ open( QIODevice::WriteOnly ); }
+
+protected:
+
+    virtual qint64 readData( char * data, qint64 maxSize ) Q_DECL_OVERRIDE
+    {
+	Q_UNUSED( data );
+	Q_UNUSED( maxSize );
+
+	return -1;
+    }
+
+    virtual qint64 writeData( const char * data, qint64 size ) Q_DECL_OVERRIDE
+    {
+	Q_UNUSED( data );
+
+	return size;
+    }
+};
+
+
+/**
+ * The log streams of one thread and the cached part of its time stamps.
+ **/
+class LogThreadData
+{
+public:
+
+    LogThreadData():
+	stream( &device ),
+	nullStream( &nullDevice ),
+	lastSecond( -1 )
+	{}
+
+    ~LogThreadData()
+    {
+	// The logger might be gone already when the thread ends; a partial
+	// line without 'endl' is simply dropped.
+
+	device.setLogger( 0 );
+    }
+
+    /**
+     * Return a time stamp like Logger::timeStamp(). Only the milliseconds
+     * are formatted for each line; the rest only once per second.
+     **/
+    QString timeStamp()
+    {
+	qint64 now    = QDateTime::currentMSecsSinceEpoch();
+	qint64 second = now / 1000;
+
+	if ( second != lastSecond )
+	{
+	    lastSecond	= second;
+	    secondStamp = QDateTime::fromMSecsSinceEpoch( now ).toString( "yyyy-MM-dd hh:mm:ss." );
+	}
+
+	return secondStamp + QString( "%1" ).arg( (int) ( now % 1000 ), 3, 10, QChar( '0' ) );
+    }
+
+    LogLineDevice device;	// Must be destroyed after the streams
+    LogNullDevice nullDevice;
+    QTextStream	  stream;
+    QTextStream	  nullStream;
+    qint64	  lastSecond;
+    QString	  secondStamp;
+};
+
+
+static QThreadStorage<LogThreadData *> logThreadData;
+
+
 Logger * Logger::_defaultLogger = 0;
 
 
-Logger::Logger( const QString &filename ):
-    _logStream( stderr, QIODevice::WriteOnly ),
-    _nullStream( stderr, QIODevice::WriteOnly )
+Logger::Logger( const QString &filename )
 {
     init();
-    createNullStream();
     openLogFile( filename );
 }
 
@@ -58,12 +238,9 @@ Logger::Logger( const QString &filename ):
 Logger::Logger( const QString & rawLogDir,
 		const QString & rawFilename,
 		bool		doRotate,
-		int		logRotateCount ):
-    _logStream( stderr, QIODevice::WriteOnly ),
-    _nullStream( stderr, QIODevice::WriteOnly )
+		int		logRotateCount )
 {
     init();
-    createNullStream();
 
     QString logDir   = expandVariables( rawLogDir   );
     QString filename = expandVariables( rawFilename );
@@ -80,9 +257,24 @@ Logger::Logger( const QString & rawLogDir,
 Logger::~Logger()
 {
     if ( _logFile.isOpen() )
+	log( __FILE__, __LINE__, __FUNCTION__, LogSeverityInfo ) << "-- Log End --\n" << endl;
+
+    _writer->stop();
+    _writer->wait();
+    delete _writer;
+
+    flush();
+    _logFile.close();
+
+    // Lines that other threads still log to this logger are dropped
+
+    LogQueueNode * node = _queue.fetchAndStoreAcquire( 0 );
+
+    while ( node )
     {
-	logInfo() << "-- Log End --\n" << endl;
-	_logFile.close();
+	LogQueueNode * next = node->next;
+	delete node;
+	node = next;
     }
 
     if ( this == _defaultLogger )
@@ -100,27 +292,89 @@ Logger::~Logger()
 void Logger::init()
 {
     _logLevel = LogSeverityVerbose;
-    _nullDevice.setFileName( "/dev/null" );
+
+    _writer = new LogWriter( this );
+    _writer->start();
 }
 
 
-void Logger::createNullStream()
+QTextStream & Logger::threadStream()
 {
-    // Open the null device to suppress output below the log level: This is
-    // necessary because each call to operator<<() for QTextStream returns the
-    // QTextStream, so we really need to return _nullStream (connected with
-    // /dev/null) to actually suppress anything; otherwise, it's just the
-    // logger time stamp etc. that gets suppressed, not the real logging
-    // output.
+    LogThreadData * data = logThreadData.localData();
 
-    if ( _nullDevice.open( QIODevice::WriteOnly | QIODevice::Text ) )
+    if ( ! data )
     {
-	_nullStream.setDevice( &_nullDevice );
+	data = new LogThreadData();
+	logThreadData.setLocalData( data );	// takes over ownership
     }
-    else
+
+    data->device.setLogger( this );
+
+    return data->stream;
+}
+
+
+void Logger::enqueue( const QByteArray & text )
+{
+    // Lock-free push to the front of the list; the writer thread takes the
+    // complete list at once and reverses it.
+
+    LogQueueNode * node = new LogQueueNode( text );
+    LogQueueNode * head;
+
+    do
     {
-	fprintf( stderr, "ERROR: Can't open /dev/null to suppress log output\n" );
+	head	   = _queue.loadAcquire();
+	node->next = head;
     }
+    while ( ! _queue.testAndSetRelease( head, node ) );
+}
+
+
+void Logger::flush()
+{
+    LogQueueNode * node = _queue.fetchAndStoreAcquire( 0 );
+
+    if ( ! node )
+	return;
+
+    // Restore the original order
+
+    LogQueueNode * lines = 0;
+
+    while ( node )
+    {
+	LogQueueNode * next = node->next;
+	node->next = lines;
+	lines	   = node;
+	node	   = next;
+    }
+
+    QMutexLocker locker( &_writeMutex );
+
+    while ( lines )
+    {
+	if ( _logFile.isOpen() )
+	    _logFile.write( lines->text );
+	else
+	    fwrite( lines->text.constData(), 1, lines->text.size(), stderr );
+
+	LogQueueNode * next = lines->next;
+	delete lines;
+	lines = next;
+    }
+
+    _logFile.flush();
+}
+
+
+void Logger::flush( Logger * logger )
+{
+    if ( ! logger )
+	logger = Logger::defaultLogger();
+
+    if ( logger )
+	logger->flush();
 }
 
 
@@ -128,18 +382,27 @@ void Logger::openLogFile( const QString & filename )
 {
     if ( ! _logFile.isOpen() || _logFile.fileName() != filename )
     {
-	_logFile.setFileName( filename );
+	bool ok;
+
+	{
+	    QMutexLocker locker( &_writeMutex );
 
-	if ( _logFile.open( QIODevice::WriteOnly |
-			    QIODevice::Text	 |
-			    QIODevice::Append	   ) )
+	    if ( _logFile.isOpen() )
+		_logFile.close();
+
+	    _logFile.setFileName( filename );
+	    ok = _logFile.open( QIODevice::WriteOnly |
+				QIODevice::Text	     |
+				QIODevice::Append      );
+	}
+
+	if ( ok )
 	{
 	    if ( ! _defaultLogger )
 		setDefaultLogger();
 
 	    fprintf( stderr, "Logging to %s\n", qPrintable( filename ) );
-	    _logStream.setDevice( &_logFile );
-	    _logStream << "\n\n";
+	    enqueue( "\n\n" );
 	    log( __FILE__, __LINE__, __FUNCTION__, LogSeverityInfo )
 		<< "-- Log Start --" << endl;
 	}
@@ -186,9 +449,13 @@ QTextStream & Logger::log( const QString &srcFile,
 			   LogSeverity	  severity )
 {
     if ( severity < _logLevel )
-	return _nullStream;
+    {
+	threadStream();		// Make sure there is LogThreadData
 
-    QString sev;
+	return logThreadData.localData()->nullStream;
+    }
+
+    const char * sev = "";
 
     switch ( severity )
     {
@@ -201,24 +468,26 @@ QTextStream & Logger::log( const QString &srcFile,
 	    // complain about unhandled enum values
     }
 
-    _logStream << Logger::timeStamp() << " "
-	       << "[" << (int) getpid() << "] "
-	       << sev << " ";
+    QTextStream & logStream = threadStream();
+
+    logStream << logThreadData.localData()->timeStamp() << " "
+	      << "[" << (int) getpid() << "] "
+	      << sev << " ";
 
     if ( ! srcFile.isEmpty() )
     {
-	_logStream << srcFile;
+	logStream << srcFile;
 
 	if ( srcLine > 0 )
-	    _logStream << ":" << srcLine;
+	    logStream << ":" << srcLine;
 
-	_logStream << " ";
+	logStream << " ";
 
 	if ( ! srcFunction.isEmpty() )
-	_logStream << srcFunction << "():  ";
+	logStream << srcFunction << "():  ";
     }
 
-    return _logStream;
+    return logStream;
 }
 
 
@@ -256,7 +525,7 @@ void Logger::setLogLevel( Logger *logger, LogSeverity newLevel )
 
 void Logger::newline()
 {
-    _logStream << endl;
+    threadStream() << endl;
 }
 
 
@@ -318,6 +587,7 @@ static void qt_logger( QtMsgType msgType, const char *msg)
     if ( msgType == QtFatalMsg )
     {
 	fprintf( stderr, "FATAL: %s\n", msg );
+	Logger::flush( 0 );
 	abort();
     }
 
@@ -325,6 +595,7 @@ static void qt_logger( QtMsgType msgType, const char *msg)
 	 QString( msg ).contains( "cannot connect to X server" ) )
     {
 	fprintf( stderr, "FATAL: %s\n", msg );
+	Logger::flush( 0 );
 	exit( 1 );
     }
 }
@@ -411,12 +682,14 @@ static void qt_logger( QtMsgType msgType,
             }
 
             logInfo() << "-- Exiting --\n" << endl;
+            Logger::flush( 0 );
 	    exit( 1 ); // Don't dump core, just exit
         }
 	else
         {
             fprintf( stderr, "FATAL: %s\n", qPrintable( msg ) );
             logInfo() << "-- Aborting with core dump --\n" << endl;
+            Logger::flush( 0 );
 	    abort(); // Exit with core dump (it might contain a useful backtrace)
         }
     }
@@ -654,5 +927,11 @@ QTextStream & operator<<( QTextStream & str, const QSize & size )
 
 QString formatErrno()
 {
-    return QString::fromUtf8( strerror( errno ) );
+    return formatErrno( errno );
+}
+
+
+QString formatErrno( int errorNumber )
+{
+    return QString::fromUtf8( strerror( errorNumber ) );
 }
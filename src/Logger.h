@@ -14,6 +14,8 @@
 #include <QStringList>
 #include <QFile>
 #include <QTextStream>
+#include <QAtomicPointer>
+#include <QMutex>
 
 
 // Intentionally not using LogDebug, LogMilestone etc. to avoid confusion
@@ -33,6 +35,28 @@ enum LogSeverity
 };
 
 
+// The lowest severity that is compiled in at all. Log statements below that
+// are removed by the compiler completely, including the evaluation of their
+// arguments. By default, release builds (QT_NO_DEBUG) only keep logInfo() and
+// above. To keep everything in a release build, use
+//
+//   qmake CONFIG+=debuglog
+
+#ifndef LOG_MIN_SEVERITY
+#  ifdef QT_NO_DEBUG
+#    define LOG_MIN_SEVERITY	LogSeverityInfo
+#  else
+#    define LOG_MIN_SEVERITY	LogSeverityVerbose
+#  endif
+#endif
+
+// The empty 'if' branch makes the stream expression that follows dead code
+// for a severity below LOG_MIN_SEVERITY. Since that 'if' already has its
+// 'else', this can safely be used in an 'if' without braces.
+
+#define LOG_IF_COMPILED_IN( SEVERITY )	if ( (SEVERITY) < LOG_MIN_SEVERITY ) {} else
+
+
 // Log macros for stream (QTextStream) output.
 //
 // Unlike qDebug() etc., they also record the location in the source code that
@@ -45,11 +69,16 @@ enum LogSeverity
 //
 //   logDebug() << "Result: " << result << endl;
 
-#define logVerbose()	Logger::log( 0, __FILE__, __LINE__, __FUNCTION__, LogSeverityVerbose   )
-#define logDebug()	Logger::log( 0, __FILE__, __LINE__, __FUNCTION__, LogSeverityDebug     )
-#define logInfo()	Logger::log( 0, __FILE__, __LINE__, __FUNCTION__, LogSeverityInfo      )
-#define logWarning()	Logger::log( 0, __FILE__, __LINE__, __FUNCTION__, LogSeverityWarning   )
-#define logError()	Logger::log( 0, __FILE__, __LINE__, __FUNCTION__, LogSeverityError     )
+#define logVerbose()	LOG_IF_COMPILED_IN( LogSeverityVerbose ) \
+			Logger::log( 0, __FILE__, __LINE__, __FUNCTION__, LogSeverityVerbose   )
+#define logDebug()	LOG_IF_COMPILED_IN( LogSeverityDebug ) \
+			Logger::log( 0, __FILE__, __LINE__, __FUNCTION__, LogSeverityDebug     )
+#define logInfo()	LOG_IF_COMPILED_IN( LogSeverityInfo ) \
+			Logger::log( 0, __FILE__, __LINE__, __FUNCTION__, LogSeverityInfo      )
+#define logWarning()	LOG_IF_COMPILED_IN( LogSeverityWarning ) \
+			Logger::log( 0, __FILE__, __LINE__, __FUNCTION__, LogSeverityWarning   )
+#define logError()	LOG_IF_COMPILED_IN( LogSeverityError ) \
+			Logger::log( 0, __FILE__, __LINE__, __FUNCTION__, LogSeverityError     )
 #define logNewline()	Logger::newline( 0 )
 
 
@@ -92,7 +121,16 @@ enum LogSeverity
  * QByteArray, int).
  *
  * This class also redirects Qt logging (qDebug() etc.) to the same log file.
+ *
+ * Logging is thread-safe: Each thread writes to a stream of its own. Each
+ * complete line is put into a lock-free queue, and a writer thread writes
+ * the queued lines to the log file, so logging never waits for the disk.
+ * Use flush() if the log file needs to be up to date right away, e.g. before
+ * the program exits abnormally.
  */
+class LogWriter;
+class LogQueueNode;
+
 class Logger
 {
 public:
@@ -154,6 +192,20 @@ public:
     void newline();
     static void newline( Logger * logger );
 
+    /**
+     * Write all complete log lines that are queued to the log file now.
+     *
+     * If 'logger' is 0, the default logger is used.
+     */
+    void flush();
+    static void flush( Logger * logger );
+
+    /**
+     * Put 'text' (one or more complete lines) into the queue for the log
+     * file. This can be called from any thread. Not for general use.
+     */
+    void enqueue( const QByteArray & text );
+
     /**
      * Return a timestamp string in the format used in the log file:
      * "yyyy-MM-dd hh:mm:ss.zzz"
@@ -189,11 +241,6 @@ public:
      */
     static Logger * defaultLogger() { return _defaultLogger; }
 
-    /**
-     * Return the QTextStream associated with this logger. Not for general use.
-     */
-    QTextStream & logStream() { return _logStream; }
-
     /**
      * Return the current log level, i.e. the severity that will actually be
      * logged. Any lower severity will be suppressed.
@@ -209,6 +256,9 @@ public:
      *
      * if ( logLevel() >= LogSeverityDebug )
      *	   logDebug() ...
+     *
+     * Log statements below LOG_MIN_SEVERITY are removed at compile time, so
+     * they don't cost anything at all.
      */
     LogSeverity logLevel() const { return _logLevel; }
 
@@ -254,10 +304,9 @@ protected:
     void init();
 
     /**
-     * Create the null log stream to suppress messages below the current log
-     * level.
+     * Return the log stream for the calling thread.
      **/
-    void createNullStream();
+    QTextStream & threadStream();
 
     /**
      * Actually open the log file.
@@ -294,12 +343,12 @@ protected:
 
 private:
 
-    static Logger * _defaultLogger;
-    QFile	    _logFile;
-    QTextStream	    _logStream;
-    QFile	    _nullDevice;
-    QTextStream	    _nullStream;
-    LogSeverity	    _logLevel;
+    static Logger *		  _defaultLogger;
+    QFile			  _logFile;	// Protected by _writeMutex
+    QMutex			  _writeMutex;
+    QAtomicPointer<LogQueueNode>  _queue;	// Most recent line first
+    LogWriter *			  _writer;
+    LogSeverity			  _logLevel;
 };
 
 
@@ -325,6 +374,11 @@ QTextStream & operator<<( QTextStream & str, const QSize   & size );
  **/
 QString formatErrno();
 
+/**
+ * Format error number 'errorNumber' (a saved errno) as a QString.
+ **/
+QString formatErrno( int errorNumber );
+
 #ifndef DONT_DEPRECATE_STRERROR
     // Use formatErrno() instead which deals with UTF-8 issues
     char * strerror(int) __attribute__ ((deprecated));
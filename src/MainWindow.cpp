@@ -16,6 +16,8 @@
 
 #include "MainWindow.h"
 #include "ActionManager.h"
+#include "BackgroundCacheWriter.h"
+#include "BinaryCache.h"
 #include "BookmarksManager.h"
 #include "BusyPopup.h"
 #include "CleanupCollection.h"
@@ -28,10 +30,12 @@
 #include "DirTreeModel.h"
 #include "Exception.h"
 #include "ExcludeRules.h"
+#include "ExtentScanner.h"
 #include "FileDetailsView.h"
 #include "FileSearchFilter.h"
 #include "FileSizeStatsWindow.h"
 #include "FileTypeStatsWindow.h"
+#include "OwnerStatsWindow.h"
 #include "FindFilesDialog.h"
 #include "Logger.h"
 #include "MimeCategorizer.h"
@@ -43,12 +47,18 @@
 #include "PkgQuery.h"
 #include "QDirStatApp.h"
 #include "Refresher.h"
+#include "ScanStats.h"
+#include "ScanStatsWindow.h"
+#include "MemoryStats.h"
+#include "MemoryStatsWindow.h"
 #include "SelectionModel.h"
 #include "Settings.h"
 #include "SettingsHelpers.h"
 #include "SignalBlocker.h"
 #include "SysUtil.h"
-#include "Trash.h"
+#include "TrashJob.h"
+#include "TreeDiff.h"
+#include "TreeExporter.h"
 #include "UnreadableDirsWindow.h"
 #include "Version.h"
 
@@ -64,10 +74,13 @@ MainWindow::MainWindow():
     QMainWindow(),
     _ui( new Ui::MainWindow ),
     _configDialog( 0 ),
+    _cacheWriter( 0 ),
     _enableDirPermissionsWarning( false ),
     _verboseSelection( false ),
     _urlInWindowTitle( false ),
     _useTreemapHover( false ),
+    _autoWriteCache( false ),
+    _pkgManagerSupportChecked( false ),
     _statusBarTimeout( 3000 ), // millisec
     _treeLevelMapper(0),
     _currentLayout( 0 )
@@ -95,6 +108,7 @@ MainWindow::MainWindow():
 
     _ui->treemapView->setDirTree( app()->dirTree() );
     _ui->treemapView->setSelectionModel( app()->selectionModel() );
+    _ui->treemapView->setTreeDiff( app()->dirTreeModel()->treeDiff() );
 
     _futureSelection.setTree( app()->dirTree() );
     _futureSelection.setUseParentFallback( true );
@@ -145,8 +159,6 @@ MainWindow::MainWindow():
     connectMenuActions();               // see MainWindowMenus.cpp
     changeLayout( _layoutName );        // see MainWindowLayout.cpp
 
-    checkPkgManagerSupport();
-
     if ( ! _ui->actionShowTreemap->isChecked() )
 	_ui->treemapView->disable();
 
@@ -173,12 +185,20 @@ MainWindow::~MainWindow()
     if ( _configDialog )
 	delete _configDialog;
 
+    if ( _cacheWriter )
+	delete _cacheWriter;	// This cancels writing
+
     delete _ui->dirTreeView;
     delete _ui;
     delete _historyButtons;
 
     qDeleteAll( _layouts );
 
+    // Deleting millions of tree items one by one would only delay the exit
+
+    if ( app()->dirTree() )
+	app()->dirTree()->prepareForExit();
+
     QDirStatApp::deleteInstance();
 
     // logDebug() << "Main window destroyed" << endl;
@@ -187,6 +207,11 @@ MainWindow::~MainWindow()
 
 void MainWindow::checkPkgManagerSupport()
 {
+    if ( _pkgManagerSupportChecked )
+	return;
+
+    _pkgManagerSupportChecked = true;
+
     if ( ! PkgQuery::haveGetInstalledPkgSupport() ||
 	 ! PkgQuery::haveFileListSupport()	    )
     {
@@ -224,6 +249,12 @@ void MainWindow::connectSignals()
     connect( app()->dirTree(),		 SIGNAL( aborted()	   ),
 	     this,			 SLOT  ( readingAborted()  ) );
 
+    connect( app()->dirTree()->extents(), SIGNAL( finished()		   ),
+	     this,			 SLOT  ( updateFileDetailsView() ) );
+
+    connect( app()->selectionModel(),	 SIGNAL( selectionDelta	      ( FileInfoSet, FileInfoSet ) ),
+	     _ui->fileDetailsView,	 SLOT  ( updateSelectionDelta( FileInfoSet, FileInfoSet ) ) );
+
     connect( app()->selectionModel(),	 SIGNAL( selectionChanged() ),
 	     this,			 SLOT  ( updateActions()    ) );
 
@@ -260,12 +291,18 @@ void MainWindow::connectSignals()
     connect( app()->cleanupCollection(), SIGNAL( cleanupFinished( int ) ),
 	     this,			 SLOT  ( cleanupFinished( int ) ) );
 
+    connect( app()->cleanupCollection(), SIGNAL( cleanupProgress( QString ) ),
+	     this,			 SLOT  ( showProgress   ( QString ) ) );
+
     connect( &_updateTimer,		 SIGNAL( timeout()	   ),
 	     this,			 SLOT  ( showElapsedTime() ) );
 
     connect( &_treeExpandTimer,		  SIGNAL( timeout() ),
 	     _ui->actionExpandTreeLevel1, SLOT  ( trigger()   ) );
 
+    connect( _ui->menuFile,		  SIGNAL( aboutToShow()		 ),
+	     this,			  SLOT	( checkPkgManagerSupport() ) );
+
     if ( _useTreemapHover )
     {
 	connect( _ui->treemapView,	  SIGNAL( hoverEnter ( FileInfo * ) ),
@@ -290,10 +327,16 @@ void MainWindow::updateActions()
     FileInfo * firstToplevel = app()->dirTree()->firstToplevel();
     bool pkgView	     = firstToplevel && firstToplevel->isPkgInfo();
 
-    _ui->actionStopReading->setEnabled( reading );
+    bool writingCache	     = _cacheWriter && _cacheWriter->isActive();
+    bool trashing	     = ! _trashJob.isNull();
+
+    _ui->actionStopReading->setEnabled( reading || writingCache || trashing );
     _ui->actionRefreshAll->setEnabled	( ! reading && firstToplevel );
     _ui->actionAskReadCache->setEnabled ( ! reading );
-    _ui->actionAskWriteCache->setEnabled( ! reading && ! pkgView && firstToplevel );
+    _ui->actionResumeReading->setEnabled( ! reading && DirTree::haveCheckpoint() );
+    _ui->actionAskWriteCache->setEnabled( ! reading && ! writingCache && ! pkgView && firstToplevel );
+    _ui->actionAskCompareCache->setEnabled( ! reading && ! pkgView && firstToplevel );
+    _ui->actionClearComparison->setEnabled( app()->dirTreeModel()->treeDiff()->isActive() );
 
     _ui->actionCopyPathToClipboard->setEnabled( currentItem );
     _ui->actionGoUp->setEnabled( currentItem && currentItem->treeLevel() > 1 );
@@ -307,7 +350,7 @@ void MainWindow::updateActions()
     bool pseudoDirSelected = selectedItems.containsPseudoDir();
     bool pkgSelected	   = selectedItems.containsPkg();
 
-    _ui->actionMoveToTrash->setEnabled( sel && ! pseudoDirSelected && ! pkgSelected && ! reading );
+    _ui->actionMoveToTrash->setEnabled( sel && ! pseudoDirSelected && ! pkgSelected && ! reading && ! trashing );
     _ui->actionRefreshSelected->setEnabled( selSize == 1 && ! sel->isExcluded() && ! sel->isMountPoint() && ! pkgView );
     _ui->actionContinueReadingAtMountPoint->setEnabled( oneDirSelected && sel->isMountPoint() );
     _ui->actionReadExcludedDirectory->setEnabled      ( oneDirSelected && sel->isExcluded()   );
@@ -318,6 +361,9 @@ void MainWindow::updateActions()
     _ui->actionFileSizeStats->setEnabled( ! reading && nothingOrOneDirInfo );
     _ui->actionFileTypeStats->setEnabled( ! reading && nothingOrOneDirInfo );
     _ui->actionFileAgeStats->setEnabled ( ! reading && nothingOrOneDirInfo );
+    _ui->actionOwnerStats->setEnabled   ( nothingOrOneDirInfo );	// Kept up to date while reading
+
+    _ui->actionDiscoverCacheMismatches->setEnabled( ! reading && ! pkgView && nothingOrOneDirInfo );
 
     bool showingTreemap = _ui->treemapView->isVisible();
 
@@ -341,6 +387,7 @@ void MainWindow::readSettings()
     _verboseSelection	  = settings.value( "VerboseSelection"	      , false ).toBool();
     _urlInWindowTitle	  = settings.value( "UrlInWindowTitle"	      , false ).toBool();
     _useTreemapHover	  = settings.value( "UseTreemapHover"	      , false ).toBool();
+    _autoWriteCache	  = settings.value( "AutoWriteCache"	      , false ).toBool();
     _layoutName		  = settings.value( "Layout"		      , "L2"  ).toString();
 
     settings.endGroup();
@@ -397,6 +444,7 @@ void MainWindow::writeSettings()
     settings.setDefaultValue( "StatusBarTimeoutMillisec", _statusBarTimeout );
     settings.setDefaultValue( "UrlInWindowTitle"	, _urlInWindowTitle );
     settings.setDefaultValue( "UseTreemapHover"		, _useTreemapHover );
+    settings.setDefaultValue( "AutoWriteCache"		, _autoWriteCache );
 
     settings.endGroup();
 
@@ -524,12 +572,17 @@ void MainWindow::readingFinished()
     QString elapsedTime = formatMillisec( _stopWatch.elapsed() );
     _ui->statusBar->showMessage( tr( "Finished. Elapsed time: %1").arg( elapsedTime ), LONG_MESSAGE );
     logInfo() << "Reading finished after " << elapsedTime << endl;
+    ScanStats::instance()->dumpToLog();
 
-    if ( app()->dirTree()->firstToplevel() &&
-	 app()->dirTree()->firstToplevel()->errSubDirCount() > 0 )
-    {
+    MemoryStats memoryStats;
+    memoryStats.collect( app()->dirTree(), _ui->treemapView );
+    memoryStats.dumpToLog();
+
+    if ( app()->dirTree()->readErrorCount() > 0 )
 	showDirPermissionsWarning();
-    }
+
+    if ( _autoWriteCache )
+	autoWriteCache();
 
     // Debug::dumpModelTree( app()->dirTreeModel(), QModelIndex(), "" );
 }
@@ -560,6 +613,31 @@ void MainWindow::openUrl( const QString & url )
 }
 
 
+void MainWindow::openDirs( const QStringList & origUrls )
+{
+    if ( origUrls.size() == 1 )
+    {
+	openUrl( origUrls.first() );
+	return;
+    }
+
+    QStringList urls;
+
+    foreach ( const QString & url, origUrls )
+	urls << handleSymLink( url );
+
+    _enableDirPermissionsWarning = true;
+    _historyButtons->clearHistory();
+    _futureSelection.clear();
+
+    app()->dirTreeModel()->openUrls( urls );
+    updateWindowTitle( urls.join( " " ) );
+
+    updateActions();
+    expandTreeToLevel( 1 );
+}
+
+
 void MainWindow::openDir( const QString & origUrl )
 {
     QString url = handleSymLink( origUrl );
@@ -673,6 +751,11 @@ void MainWindow::askOpenDir()
 
 void MainWindow::askOpenPkg()
 {
+    checkPkgManagerSupport();
+
+    if ( ! _ui->actionOpenPkg->isEnabled() )
+	return;
+
     bool canceled;
     PkgFilter pkgFilter = OpenPkgDialog::askPkgFilter( &canceled );
 
@@ -724,8 +807,15 @@ void MainWindow::refreshAll()
 	logDebug() << "Refreshing " << url << endl;
         _futureSelection.setUrl( url );
 
-	if ( PkgFilter::isPkgUrl( url ) )
+	DirTree *  tree	    = app()->dirTree();
+	FileInfo * toplevel = tree->firstToplevel();
+
+	if ( tree->visibleRoot() == tree->root() )	// Several toplevel items
+	    app()->dirTreeModel()->openUrls( tree->toplevelUrls() );
+	else if ( PkgFilter::isPkgUrl( url ) )
 	    app()->dirTreeModel()->readPkg( url );
+	else if ( tree->smartRefreshEnabled() && toplevel && toplevel->isDirInfo() )
+	    tree->smartRefresh();
 	else
 	    app()->dirTreeModel()->openUrl( url );
 
@@ -784,10 +874,25 @@ void MainWindow::applyFutureSelection()
 
 void MainWindow::stopReading()
 {
+    if ( _cacheWriter && _cacheWriter->isActive() )
+	_cacheWriter->cancel();
+
+    if ( _trashJob )
+	_trashJob->cancel();
+
     if ( app()->dirTree()->isBusy() )
     {
 	app()->dirTree()->abortReading();
-	_ui->statusBar->showMessage( tr( "Reading aborted." ), LONG_MESSAGE );
+
+	if ( app()->dirTree()->checkpointInterval() > 0 && DirTree::haveCheckpoint() )
+	{
+	    _ui->statusBar->showMessage( tr( "Reading aborted. Use \"Resume Interrupted Scan\" to continue." ),
+					 LONG_MESSAGE );
+	}
+	else
+	{
+	    _ui->statusBar->showMessage( tr( "Reading aborted." ), LONG_MESSAGE );
+	}
     }
 }
 
@@ -811,6 +916,22 @@ void MainWindow::readCache( const QString & cacheFileName )
 }
 
 
+void MainWindow::resumeReading()
+{
+    app()->dirTreeModel()->clear();
+    _historyButtons->clearHistory();
+
+    if ( ! app()->dirTree()->resumeReading() )
+    {
+	QMessageBox::warning( this,
+			      tr( "Error" ), // Title
+			      tr( "Can't read checkpoint file \"%1\"").arg( DirTree::checkpointFileName() ) );
+    }
+
+    updateActions();
+}
+
+
 void MainWindow::askReadCache()
 {
     QString fileName = QFileDialog::getOpenFileName( this, // parent
@@ -828,21 +949,193 @@ void MainWindow::askWriteCache()
     QString fileName = QFileDialog::getSaveFileName( this, // parent
 						     tr( "Enter name for QDirStat cache file"),
 						     DEFAULT_CACHE_NAME );
-    if ( ! fileName.isEmpty() )
+    if ( fileName.isEmpty() )
+	return;
+
+    if ( app()->dirTree()->hasFileSummaries() )
     {
-	bool ok = app()->dirTree()->writeCache( fileName );
+	QMessageBox::warning( this,
+			      tr( "Error" ), // Title
+			      tr( "This tree was read with directories only or with folded small files.\n"
+				  "Those files are only in the sums of their directories,\n"
+				  "so they can't be written to a cache file.\n\n"
+				  "Read the directory again without that to write a cache file." ) );
+	return;
+    }
 
-	if ( ok )
-	{
-	    showProgress( tr( "Directory tree written to file %1" ).arg( fileName ) );
-	}
-	else
-	{
-	    QMessageBox::warning( this,
-				   tr( "Error" ), // Title
-				   tr( "ERROR writing cache file \"%1\"").arg( fileName ) );
-	}
+    // The text format is written in the background; the binary format is
+    // fast enough to be written right away.
+
+    if ( ! fileName.endsWith( BINARY_CACHE_SUFFIX ) && writeCacheInBackground( fileName ) )
+	return;
+
+    bool ok = app()->dirTree()->writeCache( fileName );
+
+    if ( ok )
+    {
+	showProgress( tr( "Directory tree written to file %1" ).arg( fileName ) );
+    }
+    else
+    {
+	QMessageBox::warning( this,
+			      tr( "Error" ), // Title
+			      tr( "ERROR writing cache file \"%1\"").arg( fileName ) );
+    }
+}
+
+
+bool MainWindow::writeCacheInBackground( const QString & fileName )
+{
+    if ( ! _cacheWriter )
+    {
+	_cacheWriter = new QDirStat::BackgroundCacheWriter();
+	CHECK_NEW( _cacheWriter );
+
+	connect( _cacheWriter, SIGNAL( progress	         ( int ) ),
+		 this,	       SLOT  ( cacheWriteProgress( int ) ) );
+
+	connect( _cacheWriter, SIGNAL( finished	         ( bool ) ),
+		 this,	       SLOT  ( cacheWriteFinished( bool ) ) );
+    }
+
+    if ( ! _cacheWriter->start( app()->dirTree(), fileName ) )
+	return false;
+
+    showProgress( tr( "Writing cache file %1..." ).arg( fileName ) );
+    updateActions();
+
+    return true;
+}
+
+
+void MainWindow::autoWriteCache()
+{
+    // Later scans would read this cache file automatically, so it must
+    // have the real totals
+
+    if ( app()->dirTree()->hasPartialTotals() )
+	return;
+
+    FileInfo * toplevel = app()->dirTree()->firstToplevel();
+
+    if ( ! toplevel || ! toplevel->isDirInfo() || toplevel->isPkgInfo() ||
+	 ( _cacheWriter && _cacheWriter->isActive() ) )
+    {
+	return;
+    }
+
+    QString dir = toplevel->url();
+
+    if ( ! dir.startsWith( "/" ) || ! QFileInfo( dir ).isWritable() )
+	return;
+
+    writeCacheInBackground( ( dir == "/" ? dir : dir + "/" ) + DEFAULT_CACHE_NAME );
+}
+
+
+void MainWindow::cacheWriteProgress( int percent )
+{
+    if ( ! app()->dirTree()->isBusy() )
+	_ui->statusBar->showMessage( tr( "Writing cache file... %1%" ).arg( percent ) );
+}
+
+
+void MainWindow::cacheWriteFinished( bool ok )
+{
+    QString fileName = _cacheWriter->fileName();
+
+    if ( ok )
+    {
+	showProgress( tr( "Directory tree written to file %1" ).arg( fileName ) );
+    }
+    else if ( _cacheWriter->wasCanceled() )
+    {
+	showProgress( tr( "Writing cache file %1 canceled" ).arg( fileName ) );
+    }
+    else
+    {
+	QMessageBox::warning( this,
+			      tr( "Error" ), // Title
+			      tr( "ERROR writing cache file \"%1\"").arg( fileName ) );
+    }
+
+    updateActions();
+}
+
+
+void MainWindow::askExport()
+{
+    FileInfo * subtree = app()->selectedDirInfoOrRoot();
+
+    if ( ! subtree )
+	return;
+
+    QString fileName = QFileDialog::getSaveFileName( this, // parent
+						     tr( "Export to file" ),
+						     "qdirstat-export.csv",
+						     tr( "CSV (*.csv);;NDJSON (*.ndjson)" ) );
+    if ( fileName.isEmpty() )
+	return;
+
+    TreeExporter::Format format;
+
+    if ( ! TreeExporter::formatFromFileName( fileName, format ) )
+    {
+	format	  = TreeExporter::Csv;
+	fileName += ".csv";
+    }
+
+    BusyPopup msg( tr( "Exporting..." ), this );
+    TreeExporter exporter( format, DataColumns::instance()->columns() );
+
+    if ( exporter.write( subtree, fileName ) )
+    {
+	showProgress( tr( "Exported %1 to file %2" ).arg( subtree->url() ).arg( fileName ) );
+    }
+    else
+    {
+	QMessageBox::warning( this,
+			      tr( "Error" ), // Title
+			      tr( "ERROR exporting to file \"%1\": %2" )
+			      .arg( fileName ).arg( exporter.errorString() ) );
+    }
+}
+
+
+void MainWindow::askCompareCache()
+{
+    QString fileName = QFileDialog::getOpenFileName( this, // parent
+						     tr( "Select QDirStat cache file to compare with" ),
+						     DEFAULT_CACHE_NAME );
+    if ( fileName.isEmpty() )
+	return;
+
+    bool ok = false;
+
+    {
+	BusyPopup msg( tr( "Comparing with %1..." ).arg( fileName ), this );
+	ok = app()->dirTreeModel()->treeDiff()->compare( fileName );
+    }
+
+    if ( ok )
+    {
+	showProgress( tr( "Compared with %1" ).arg( fileName ) );
     }
+    else
+    {
+	QMessageBox::warning( this,
+			      tr( "Error" ), // Title
+			      tr( "ERROR comparing with cache file \"%1\"").arg( fileName ) );
+    }
+
+    updateActions();
+}
+
+
+void MainWindow::clearComparison()
+{
+    app()->dirTreeModel()->treeDiff()->clear();
+    updateActions();
 }
 
 
@@ -868,8 +1161,25 @@ void MainWindow::showProgress( const QString & text )
 
 void MainWindow::showElapsedTime()
 {
-    showProgress( tr( "Reading... %1" )
-		  .arg( formatMillisec( _stopWatch.elapsed(), false ) ) );
+    QString msg = tr( "Reading... %1" ).arg( formatMillisec( _stopWatch.elapsed(), false ) );
+
+    // Only when a complete filesystem is read: From its used inodes
+
+    ScanStats * scanStats = ScanStats::instance();
+    int percent = scanStats->percentDone();
+
+    if ( percent >= 0 )
+    {
+	qint64 remaining = scanStats->remainingMillisec();
+
+	if ( remaining >= 0 )
+	    msg += tr( "  (%1% done, about %2 left)" )
+		.arg( percent ).arg( formatMillisec( remaining, false ) );
+	else
+	    msg += tr( "  (%1% done)" ).arg( percent );
+    }
+
+    showProgress( msg );
 }
 
 
@@ -968,10 +1278,7 @@ void MainWindow::expandTreeToLevel( int level )
 {
     logDebug() << "Expanding tree to level " << level << endl;
 
-    if ( level < 1 )
-	_ui->dirTreeView->collapseAll();
-    else
-	_ui->dirTreeView->expandToDepth( level - 1 );
+    _ui->dirTreeView->expandToLevel( level );
 }
 
 
@@ -1134,19 +1441,40 @@ void MainWindow::moveToTrash()
 
     outputWindow->showAfterTimeout();
 
-    // Move all selected items to trash
+    // Move all selected items to trash in the background
+
+    QStringList paths;
 
     foreach ( FileInfo * item, selectedItems )
-    {
-	bool success = Trash::trash( item->path() );
+	paths << item->path();
 
-	if ( success )
-	    outputWindow->addStdout( tr( "Moved to trash: %1" ).arg( item->path() ) );
-	else
-	    outputWindow->addStderr( tr( "Move to trash failed for %1" ).arg( item->path() ) );
-    }
+    _trashJob = new QDirStat::TrashJob( paths, this );
+    CHECK_NEW( _trashJob );
+
+    _trashJob->setOutputWindow( outputWindow );
 
-    outputWindow->noMoreProcesses();
+    connect( _trashJob, SIGNAL( progress	    ( QString ) ),
+	     this,	SLOT  ( showProgress    ( QString ) ) );
+
+    connect( _trashJob, SIGNAL( finished	    ( int ) ),
+	     this,	SLOT  ( trashJobFinished( int ) ) );
+
+    _trashJob->start();
+    updateActions();
+}
+
+
+void MainWindow::trashJobFinished( int errorCount )
+{
+    showProgress( errorCount == 0 ?
+		  tr( "Moved to trash." ) :
+		  tr( "Moving to trash finished with %1 errors." ).arg( errorCount ) );
+
+    // The job deletes itself later; don't wait for that to enable the
+    // actions again.
+
+    _trashJob = 0;
+    updateActions();
 }
 
 
@@ -1170,6 +1498,11 @@ void MainWindow::openConfigDialog()
     CHECK_PTR( _configDialog );
     _configDialog->cleanupConfigPage()->setCleanupCollection( app()->cleanupCollection() );
 
+    // New category colors only need a reshade, not a new treemap layout
+
+    connect( _configDialog,	 SIGNAL( applyChanges()	 ),
+	     _ui->treemapView, SLOT  ( applySettings() ) );
+
     if ( ! _configDialog->isVisible() )
     {
 	_configDialog->setup();
@@ -1214,6 +1547,12 @@ void MainWindow::showFileAgeStats()
 }
 
 
+void MainWindow::showOwnerStats()
+{
+    OwnerStatsWindow::populateSharedInstance( app()->selectedDirInfoOrRoot() );
+}
+
+
 void MainWindow::showFilesystems()
 {
     if ( ! _filesystemsWindow )
@@ -1258,6 +1597,18 @@ void MainWindow::showUnreadableDirs()
 }
 
 
+void MainWindow::showScanStats()
+{
+    ScanStatsWindow::showSharedInstance();
+}
+
+
+void MainWindow::showMemoryStats()
+{
+    MemoryStatsWindow::showSharedInstance( _ui->treemapView );
+}
+
+
 void MainWindow::selectionChanged()
 {
     showSummary();
@@ -1275,6 +1626,11 @@ void MainWindow::currentItemChanged( FileInfo * newCurrent, FileInfo * oldCurren
 {
     showSummary();
 
+    // Read the current directory first if reading is still in progress
+
+    if ( newCurrent && newCurrent->isDirInfo() && newCurrent->pendingReadJobs() > 0 )
+	app()->dirTree()->prioritize( newCurrent->toDirInfo() );
+
     if ( ! oldCurrent )
 	updateFileDetailsView();
 
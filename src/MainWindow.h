@@ -36,10 +36,12 @@ class QMenu;
 
 namespace QDirStat
 {
+    class BackgroundCacheWriter;
     class ConfigDialog;
     class FileInfo;
     class DiscoverActions;
     class PkgManager;
+    class TrashJob;
     class UnpkgSettings;
 }
 
@@ -73,6 +75,12 @@ public slots:
      **/
     void openDir( const QString & url );
 
+    /**
+     * Open several directories together, each as a toplevel item, to
+     * compare them.
+     **/
+    void openDirs( const QStringList & urls );
+
     /**
      * Open a directory selection dialog and open the selected URL.
      **/
@@ -119,7 +127,8 @@ public slots:
     void refreshSelected();
 
     /**
-     * Stop reading if reading is in process.
+     * Stop reading if reading is in process, and stop writing a cache file
+     * in the background.
      **/
     void stopReading();
 
@@ -135,6 +144,11 @@ public slots:
      **/
     void readCache( const QString & cacheFileName );
 
+    /**
+     * Continue reading an interrupted scan from its checkpoint file.
+     **/
+    void resumeReading();
+
     /**
      * Open a file selection dialog to ask for a cache file, clear the
      * current tree and replace it with the content of the cache file.
@@ -147,6 +161,23 @@ public slots:
      **/
     void askWriteCache();
 
+    /**
+     * Open a file selection dialog and export the current subtree to the
+     * selected CSV or NDJSON file.
+     **/
+    void askExport();
+
+    /**
+     * Open a file selection dialog to ask for a cache file with an older
+     * scan and show the differences of the current tree against it.
+     **/
+    void askCompareCache();
+
+    /**
+     * Stop showing the differences against an older scan.
+     **/
+    void clearComparison();
+
     /**
      * Update the window title: Show "[root]" if running as root and add the
      * URL if that is configured.
@@ -194,6 +225,11 @@ public slots:
      **/
     void moveToTrash();
 
+    /**
+     * Notification that moving items to the trash is finished.
+     **/
+    void trashJobFinished( int errorCount );
+
     /**
      * Open the "Find Files" dialog and display the results.
      **/
@@ -275,6 +311,17 @@ protected slots:
      **/
     void updateActions();
 
+    /**
+     * Check for package manager support and enable or disable some of the
+     * related actions in the menus accordingly.
+     *
+     * This starts external commands for each supported package manager,
+     * so it is not done on startup, but only when the "File" menu is
+     * opened for the first time or one of those actions is used; any
+     * later call does nothing.
+     **/
+    void checkPkgManagerSupport();
+
     /**
      * Enable or disable the treemap view, depending on the value of
      * the corresponding action.
@@ -333,6 +380,12 @@ protected slots:
      **/
     void showFileAgeStats();
 
+    /**
+     * Show the disk usage by user and by group for the currently selected
+     * directory.
+     **/
+    void showOwnerStats();
+
     /**
      * Show detailed information about mounted filesystems in a separate window.
      **/
@@ -349,6 +402,17 @@ protected slots:
      **/
     void showElapsedTime();
 
+    /**
+     * Show the progress of writing a cache file in the background.
+     **/
+    void cacheWriteProgress( int percent );
+
+    /**
+     * Notification that writing a cache file in the background is
+     * finished.
+     **/
+    void cacheWriteFinished( bool ok );
+
     /**
      * Show a warning (as a panel message) about insufficient permissions when
      * reading directories.
@@ -361,6 +425,21 @@ protected slots:
      **/
     void showUnreadableDirs();
 
+    /**
+     * Show the scan statistics in a separate non-modal window.
+     *
+     * The hotkey for this is Ctrl-F7.
+     **/
+    void showScanStats();
+
+    /**
+     * Show the memory statistics of the tree, the treemap and the caches
+     * in a separate non-modal window.
+     *
+     * The hotkey for this is Ctrl-Shift-F7.
+     **/
+    void showMemoryStats();
+
     /**
      * Switch verbose logging for selection changes on or off.
      *
@@ -427,6 +506,18 @@ protected:
      **/
     void mapTreeExpandAction( QAction * action, int level );
 
+    /**
+     * Start writing the tree to cache file 'fileName' in the background.
+     * Return 'false' if that is not possible right now.
+     **/
+    bool writeCacheInBackground( const QString & fileName );
+
+    /**
+     * Write the tree to DEFAULT_CACHE_NAME in the toplevel directory if
+     * "AutoWriteCache" is set and the toplevel directory is writable.
+     **/
+    void autoWriteCache();
+
     /**
      * Initialize the layout actions.
      **/
@@ -457,12 +548,6 @@ protected:
      **/
     void writeLayoutSettings( TreeLayout * layout );
 
-    /**
-     * Check for package manager support and enable or disable some of the
-     * related actions in the menus accordingly.
-     **/
-    void checkPkgManagerSupport();
-
     /**
      * Apply the exclude rules from 'unpkgSettings' to the DirTree.
      **/
@@ -470,11 +555,11 @@ protected:
 
     /**
      * Apply the filters to the DirTree:
-     * - Ignore all files that belong to an installed package
+     * - Ignore all files that belong to an installed package of any
+     *   package manager
      * - Ignore all file patterns ("*.pyc" etc.) the user wishes to ignore
      **/
-    void setUnpkgFilters( const UnpkgSettings & unpkgSettings,
-                          PkgManager          * pkgManager );
+    void setUnpkgFilters( const UnpkgSettings & unpkgSettings );
 
     /**
      * Parse the starting directory in the 'unpkgSettings' and remove the
@@ -511,18 +596,22 @@ private:
 
     Ui::MainWindow		 * _ui;
     QDirStat::ConfigDialog	 * _configDialog;
+    QDirStat::BackgroundCacheWriter * _cacheWriter;
     QDirStat::HistoryButtons     * _historyButtons;
     QDirStat::DiscoverActions    * _discoverActions;
     QActionGroup		 * _layoutActionGroup;
     QPointer<FileAgeStatsWindow>   _fileAgeStatsWindow;
     QPointer<FilesystemsWindow>    _filesystemsWindow;
     QPointer<PanelMessage>	   _dirPermissionsWarning;
+    QPointer<QDirStat::TrashJob>   _trashJob;
     QString			   _dUrl;
     QElapsedTimer		   _stopWatch;
     bool			   _enableDirPermissionsWarning;
     bool			   _verboseSelection;
     bool			   _urlInWindowTitle;
     bool			   _useTreemapHover;
+    bool			   _autoWriteCache;
+    bool			   _pkgManagerSupportChecked;
     QString			   _layoutName;
     int				   _statusBarTimeout; // millisec
     QSignalMapper	       *   _treeLevelMapper;
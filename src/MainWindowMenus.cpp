@@ -57,7 +57,11 @@ void MainWindow::connectFileMenu()
     CONNECT_ACTION( _ui->actionContinueReadingAtMountPoint, this, refreshSelected()   );
     CONNECT_ACTION( _ui->actionStopReading,		    this, stopReading()	      );
     CONNECT_ACTION( _ui->actionAskWriteCache,		    this, askWriteCache()     );
+    CONNECT_ACTION( _ui->actionAskExport,		    this, askExport()	      );
     CONNECT_ACTION( _ui->actionAskReadCache,		    this, askReadCache()      );
+    CONNECT_ACTION( _ui->actionResumeReading,		    this, resumeReading()     );
+    CONNECT_ACTION( _ui->actionAskCompareCache,		    this, askCompareCache()   );
+    CONNECT_ACTION( _ui->actionClearComparison,		    this, clearComparison()   );
     CONNECT_ACTION( _ui->actionQuit,			    qApp, quit()	      );
 }
 
@@ -90,6 +94,7 @@ void MainWindow::connectViewMenu()
     _ui->actionFileTypeStats->setShortcutContext( Qt::ApplicationShortcut );
 
     CONNECT_ACTION( _ui->actionFileAgeStats,	   this, showFileAgeStats()  );
+    CONNECT_ACTION( _ui->actionOwnerStats,	   this, showOwnerStats()    );
     CONNECT_ACTION( _ui->actionShowFilesystems,	   this, showFilesystems()   );
 }
 
@@ -172,8 +177,11 @@ void MainWindow::connectDiscoverMenu()
     CONNECT_ACTION( _ui->actionDiscoverNewestFiles,     _discoverActions, discoverNewestFiles()     );
     CONNECT_ACTION( _ui->actionDiscoverOldestFiles,     _discoverActions, discoverOldestFiles()     );
     CONNECT_ACTION( _ui->actionDiscoverHardLinkedFiles, _discoverActions, discoverHardLinkedFiles() );
+    CONNECT_ACTION( _ui->actionDiscoverDuplicateFiles,  _discoverActions, discoverDuplicateFiles()  );
     CONNECT_ACTION( _ui->actionDiscoverBrokenSymLinks,  _discoverActions, discoverBrokenSymLinks()  );
     CONNECT_ACTION( _ui->actionDiscoverSparseFiles,     _discoverActions, discoverSparseFiles()     );
+    CONNECT_ACTION( _ui->actionDiscoverCacheMismatches, _discoverActions, discoverCacheMismatches() );
+    CONNECT_ACTION( _ui->actionDiscoverQuery,           _discoverActions, discoverQuery()           );
 }
 
 
@@ -224,11 +232,15 @@ void MainWindow::connectDebugActions()
 
     addAction( _ui->actionVerboseSelection );    // Shift-F7
     addAction( _ui->actionDumpSelection );       // F7
+    addAction( _ui->actionShowScanStats );       // Ctrl-F7
+    addAction( _ui->actionShowMemoryStats );     // Ctrl-Shift-F7
 
     connect( _ui->actionVerboseSelection, SIGNAL( toggled( bool )	   ),
 	     this,			  SLOT	( toggleVerboseSelection() ) );
 
     CONNECT_ACTION( _ui->actionDumpSelection, app()->selectionModel(), dumpSelectedItems() );
+    CONNECT_ACTION( _ui->actionShowScanStats, this, showScanStats() );
+    CONNECT_ACTION( _ui->actionShowMemoryStats, this, showMemoryStats() );
 
     connect( _ui->dirTreeView,		  SIGNAL( clicked    ( QModelIndex ) ),
 	     this,			  SLOT	( itemClicked( QModelIndex ) ) );
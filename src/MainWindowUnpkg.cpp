@@ -23,6 +23,11 @@ using namespace QDirStat;
 
 void MainWindow::askShowUnpkgFiles()
 {
+    checkPkgManagerSupport();
+
+    if ( ! _ui->actionShowUnpkgFiles->isEnabled() )
+	return;
+
     PkgManager * pkgManager = PkgQuery::primaryPkgManager();
 
     if ( ! pkgManager )
@@ -65,7 +70,7 @@ void MainWindow::showUnpkgFiles( const UnpkgSettings & unpkgSettings )
 
 
     setUnpkgExcludeRules( unpkgSettings );
-    setUnpkgFilters( unpkgSettings, pkgManager );
+    setUnpkgFilters( unpkgSettings );
 
     // Start reading the directory
 
@@ -97,12 +102,11 @@ void MainWindow::setUnpkgExcludeRules( const UnpkgSettings & unpkgSettings )
 }
 
 
-void MainWindow::setUnpkgFilters( const UnpkgSettings & unpkgSettings,
-                                  PkgManager          * pkgManager )
+void MainWindow::setUnpkgFilters( const UnpkgSettings & unpkgSettings )
 {
     // Filter for ignoring all files from all installed packages
 
-    DirTreeFilter * filter = new DirTreePkgFilter( pkgManager );
+    DirTreeFilter * filter = new DirTreePkgFilter();
     CHECK_NEW( filter );
 
     app()->dirTree()->clearFilters();
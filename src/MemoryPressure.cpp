@@ -0,0 +1,267 @@
+/*
+ *   File name: MemoryPressure.cpp
+ *   Summary:	Dropping caches when the system is short on memory
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <fcntl.h>	// open()
+#include <unistd.h>	// write(), close()
+#include <string.h>	// strlen()
+
+#include <QSocketNotifier>
+#include <QFile>
+#include <QStringList>
+
+#include "MemoryPressure.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#define PSI_MEMORY_FILE		   "/proc/pressure/memory"
+
+// PSI trigger: Notify if tasks were stalled waiting for memory for 150 ms
+// within a 2 second window. Unprivileged users can only use windows that
+// are a multiple of 2 seconds.
+
+#define PSI_TRIGGER		   "some 150000 2000000"
+
+// Without a trigger: Poll this often, and drop caches if the 10 second
+// average is above this percentage.
+
+#define POLL_INTERVAL_MILLISEC	   5000
+#define POLL_PSI_THRESHOLD_PERCENT 10.0
+
+// Don't drop caches more often than this; they need some time to show an
+// effect.
+
+#define MIN_EVICTION_INTERVAL_MILLISEC 10000
+
+// How much of each cache to drop
+
+#define EVICT_PERCENT		   50
+
+
+using namespace QDirStat;
+
+
+MemoryPressure * MemoryPressure::_instance = 0;
+
+
+MemoryPressure * MemoryPressure::instance()
+{
+    if ( ! _instance )
+    {
+	_instance = new MemoryPressure();
+	CHECK_NEW( _instance );
+    }
+
+    return _instance;
+}
+
+
+MemoryPressure::MemoryPressure():
+    QObject(),
+    _notifier( 0 ),
+    _psiFd( -1 ),
+    _lastCgroupEvents( -1 ),
+    _started( false )
+{
+    connect( &_pollTimer, SIGNAL( timeout()	 ),
+	     this,	  SLOT	( pollPressure() ) );
+}
+
+
+MemoryPressure::~MemoryPressure()
+{
+    delete _notifier;
+
+    if ( _psiFd >= 0 )
+	close( _psiFd );
+}
+
+
+void MemoryPressure::add( DiscardableCache * cache )
+{
+    CHECK_PTR( cache );
+
+    MemoryPressure * self = instance();
+
+    if ( ! self->_caches.contains( cache ) )
+	self->_caches << cache;
+
+    if ( ! self->_started )
+	self->start();
+}
+
+
+void MemoryPressure::remove( DiscardableCache * cache )
+{
+    if ( _instance )
+	_instance->_caches.removeAll( cache );
+}
+
+
+void MemoryPressure::start()
+{
+    _started = true;
+
+    if ( startPsiTrigger() )
+    {
+	logInfo() << "Watching the memory pressure with a PSI trigger" << endl;
+	return;
+    }
+
+    // Find the memory cgroup (v2) of this process: "0::/user.slice/..."
+
+    QFile cgroupFile( "/proc/self/cgroup" );
+
+    if ( cgroupFile.open( QIODevice::ReadOnly ) )
+    {
+	foreach ( const QString & line, QString::fromUtf8( cgroupFile.readAll() ).split( '\n' ) )
+	{
+	    if ( line.startsWith( "0::" ) )
+	    {
+		QString fileName = "/sys/fs/cgroup" + line.mid( 3 ) + "/memory.events";
+
+		if ( QFile::exists( fileName ) )
+		    _cgroupEventsFile = fileName;
+	    }
+	}
+    }
+
+    _lastCgroupEvents = cgroupEvents();
+
+    if ( psiAverage() >= 0.0 || _lastCgroupEvents >= 0 )
+    {
+	logInfo() << "Polling the memory pressure" << endl;
+	_pollTimer.start( POLL_INTERVAL_MILLISEC );
+    }
+    else
+    {
+	logInfo() << "No memory pressure information available" << endl;
+    }
+}
+
+
+bool MemoryPressure::startPsiTrigger()
+{
+    _psiFd = open( PSI_MEMORY_FILE, O_RDWR | O_NONBLOCK | O_CLOEXEC );
+
+    if ( _psiFd < 0 )
+	return false;
+
+    if ( write( _psiFd, PSI_TRIGGER, strlen( PSI_TRIGGER ) + 1 ) < 0 )
+    {
+	// No kernel support for triggers or no permission
+
+	close( _psiFd );
+	_psiFd = -1;
+
+	return false;
+    }
+
+    // The kernel signals the trigger with POLLPRI
+
+    _notifier = new QSocketNotifier( _psiFd, QSocketNotifier::Exception, this );
+    CHECK_NEW( _notifier );
+
+    connect( _notifier, SIGNAL( activated	( int ) ),
+	     this,	SLOT  ( pressureNotify()	) );
+
+    return true;
+}
+
+
+void MemoryPressure::pressureNotify()
+{
+    evictAll( EVICT_PERCENT );
+}
+
+
+void MemoryPressure::pollPressure()
+{
+    bool   pressure = false;
+    double average  = psiAverage();
+
+    if ( average > POLL_PSI_THRESHOLD_PERCENT )
+	pressure = true;
+
+    qint64 events = cgroupEvents();
+
+    if ( events > _lastCgroupEvents && _lastCgroupEvents >= 0 )
+	pressure = true;
+
+    _lastCgroupEvents = events;
+
+    if ( pressure )
+	evictAll( EVICT_PERCENT );
+}
+
+
+void MemoryPressure::evictAll( int percent )
+{
+    if ( _lastEviction.isValid() &&
+	 _lastEviction.elapsed() < MIN_EVICTION_INTERVAL_MILLISEC )
+    {
+	return;
+    }
+
+    _lastEviction.start();
+    logInfo() << "Memory pressure: Dropping " << percent << "% of "
+	      << _caches.size() << " caches" << endl;
+
+    foreach ( DiscardableCache * cache, _caches )
+	cache->evictCache( percent );
+}
+
+
+double MemoryPressure::psiAverage() const
+{
+    // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+
+    QFile file( PSI_MEMORY_FILE );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return -1.0;
+
+    foreach ( const QString & line, QString::fromUtf8( file.readAll() ).split( '\n' ) )
+    {
+	if ( line.startsWith( "some " ) )
+	{
+	    foreach ( const QString & field, line.split( ' ' ) )
+	    {
+		if ( field.startsWith( "avg10=" ) )
+		    return field.mid( 6 ).toDouble();
+	    }
+	}
+    }
+
+    return -1.0;
+}
+
+
+qint64 MemoryPressure::cgroupEvents() const
+{
+    if ( _cgroupEventsFile.isEmpty() )
+	return -1;
+
+    QFile file( _cgroupEventsFile );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return -1;
+
+    qint64 events = 0;
+
+    foreach ( const QString & line, QString::fromUtf8( file.readAll() ).split( '\n' ) )
+    {
+	QStringList fields = line.split( ' ' );
+
+	if ( fields.size() == 2 && ( fields[0] == "high" || fields[0] == "max" ) )
+	    events += fields[1].toLongLong();
+    }
+
+    return events;
+}
@@ -0,0 +1,153 @@
+/*
+ *   File name: MemoryPressure.h
+ *   Summary:	Dropping caches when the system is short on memory
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef MemoryPressure_h
+#define MemoryPressure_h
+
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+
+
+class QSocketNotifier;
+
+
+namespace QDirStat
+{
+    /**
+     * Interface for anything that keeps data only to be faster and that
+     * can give memory back when the system runs short of it. Register
+     * with MemoryPressure::add() and unregister with
+     * MemoryPressure::remove() before the object is destroyed.
+     **/
+    class DiscardableCache
+    {
+    public:
+
+	virtual ~DiscardableCache() {}
+
+	/**
+	 * Free memory: Drop the least recently used 'percent' percent of
+	 * the cache content, or everything that can be dropped for 100.
+	 **/
+	virtual void evictCache( int percent ) = 0;
+    };
+
+
+    /**
+     * Singleton that watches the memory pressure of the system and asks
+     * all registered caches to give memory back when it is high, so a
+     * session with a huge tree does not push the machine into swapping.
+     *
+     * This uses a PSI (pressure stall information) trigger on
+     * /proc/pressure/memory where available: The kernel notifies as soon
+     * as tasks were stalled waiting for memory for more than a certain
+     * time. Otherwise it polls the averages in that file and the "high"
+     * and "max" events of the memory cgroup (cgroup v2) of this process.
+     * If none of those exist, this does nothing.
+     *
+     * Watching starts with the first cache that is added. Everything here
+     * happens in the GUI thread.
+     **/
+    class MemoryPressure: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Return the singleton, creating it if needed.
+	 **/
+	static MemoryPressure * instance();
+
+	/**
+	 * Add a cache to be shrunk under memory pressure. Ownership is not
+	 * transferred.
+	 **/
+	static void add( DiscardableCache * cache );
+
+	/**
+	 * Remove a cache again.
+	 **/
+	static void remove( DiscardableCache * cache );
+
+	/**
+	 * Ask all caches to drop 'percent' percent of their content.
+	 **/
+	void evictAll( int percent );
+
+
+    protected slots:
+
+	/**
+	 * Notification from the PSI trigger that the memory pressure is
+	 * high.
+	 **/
+	void pressureNotify();
+
+	/**
+	 * Poll the memory pressure if there is no PSI trigger.
+	 **/
+	void pollPressure();
+
+
+    protected:
+
+	/**
+	 * Constructor. Use instance() instead.
+	 **/
+	MemoryPressure();
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~MemoryPressure();
+
+	/**
+	 * Start watching the memory pressure.
+	 **/
+	void start();
+
+	/**
+	 * Try to set up a PSI trigger. Return 'true' on success.
+	 **/
+	bool startPsiTrigger();
+
+	/**
+	 * Return the "some" 10 second average of the memory pressure in
+	 * percent or -1 if not available.
+	 **/
+	double psiAverage() const;
+
+	/**
+	 * Return the sum of the "high" and "max" events of the memory cgroup
+	 * of this process or -1 if not available.
+	 **/
+	qint64 cgroupEvents() const;
+
+
+	static MemoryPressure *	   _instance;
+
+	QList<DiscardableCache *>  _caches;
+	QSocketNotifier *	   _notifier;
+	int			   _psiFd;
+	QTimer			   _pollTimer;
+	QString			   _cgroupEventsFile;
+	qint64			   _lastCgroupEvents;
+	QElapsedTimer		   _lastEviction;
+	bool			   _started;
+
+    };	// class MemoryPressure
+
+}	// namespace QDirStat
+
+
+#endif // ifndef MemoryPressure_h
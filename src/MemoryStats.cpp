@@ -0,0 +1,264 @@
+/*
+ *   File name: MemoryStats.cpp
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+#include "MemoryStats.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "DotEntry.h"
+#include "Attic.h"
+#include "PkgInfo.h"
+#include "PkgQuery.h"
+#include "CompactName.h"
+#include "NodeArena.h"
+#include "TreemapView.h"
+#include "TreemapTile.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * Return the size of an object of 'size' bytes in the NodeArena.
+     **/
+    qint64 arenaSize( size_t size )
+    {
+	return ( size + NODE_ARENA_GRANULARITY - 1 ) / NODE_ARENA_GRANULARITY * NODE_ARENA_GRANULARITY;
+    }
+
+
+    /**
+     * Return the memory of the data of 'str' in bytes.
+     **/
+    qint64 stringBytes( const QString & str )
+    {
+	return str.isEmpty() ? 0 : ( str.capacity() + 1 ) * sizeof( QChar );
+    }
+
+
+    /**
+     * Return 'value' for a JSON document. JSON numbers are doubles anyway.
+     **/
+    QJsonValue jsonValue( qint64 value )
+    {
+	return QJsonValue( (double) value );
+    }
+}
+
+
+MemoryStats::MemoryStats():
+    _nameBytes( 0.0 ),
+    _sharedNames( 0 ),
+    _arenaNodes( 0 ),
+    _arenaChunks( 0 ),
+    _arenaBytes( 0 )
+{
+    // NOP
+}
+
+
+void MemoryStats::collect( DirTree * tree, TreemapView * treemapView )
+{
+    *this = MemoryStats();
+
+    if ( tree )
+    {
+	if ( tree->root() )
+	    addSubtree( tree->root() );
+
+	_filterCaches.bytes = tree->filterMemoryUsage();
+    }
+
+    _names.bytes = (qint64) _nameBytes;
+
+    if ( treemapView )
+    {
+	_tiles.count = treemapView->tileCount();
+	_tiles.bytes = _tiles.count * (qint64) sizeof( TreemapTile );
+
+	qint64 cacheBytes = 0;
+	_cushions.bytes	    = treemapView->cushionBytes( cacheBytes );
+	_cushionCache.bytes = cacheBytes;
+    }
+
+    qint64 ownerBytes = 0;
+    _ownerCache.count = PkgQuery::cacheStats( ownerBytes );
+    _ownerCache.bytes = ownerBytes;
+
+    _sharedNames = CompactName::sharedNameCount();
+
+    NodeArena * arena = NodeArena::instance();
+    _arenaNodes	 = arena->liveCount();
+    _arenaChunks = arena->chunkCount();
+    _arenaBytes	 = arena->bytesReserved();
+}
+
+
+void MemoryStats::addSubtree( FileInfo * item )
+{
+    if ( item->isPkgInfo() )
+    {
+	PkgInfo * pkg = item->toPkgInfo();
+	_pkgs.add( arenaSize( sizeof( PkgInfo ) ) +
+		   stringBytes( pkg->baseName() ) +
+		   stringBytes( pkg->version()	) +
+		   stringBytes( pkg->arch()	) );
+    }
+    else if ( item->isAttic() )
+	_attics.add( arenaSize( sizeof( Attic ) ) );
+    else if ( item->isDotEntry() )
+	_dotEntries.add( arenaSize( sizeof( DotEntry ) ) );
+    else if ( item->isDirInfo() )
+	_dirs.add( arenaSize( sizeof( DirInfo ) ) );
+    else
+	_files.add( arenaSize( sizeof( FileInfo ) ) );
+
+    const CompactName & name = item->compactName();
+
+    if ( ! name.isEmpty() )
+    {
+	++_names.count;
+	_nameBytes += name.memoryShare();
+    }
+
+    if ( ! item->isDirInfo() )
+	return;
+
+    DirInfo * dir	= item->toDirInfo();
+    qint64 sortBytes	= dir->sortCacheBytes();
+
+    if ( sortBytes > 0 )
+	_sortCaches.add( sortBytes );
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+	addSubtree( child );
+
+    if ( dir->dotEntry() )
+	addSubtree( dir->dotEntry() );
+
+    if ( dir->attic() )
+	addSubtree( dir->attic() );
+}
+
+
+qint64 MemoryStats::totalBytes() const
+{
+    // The cushion cache shares the pixmaps with the tiles as long as they
+    // exist, so only count the larger of both.
+
+    return _files.bytes + _dirs.bytes + _dotEntries.bytes + _attics.bytes + _pkgs.bytes
+	+ _names.bytes + _sortCaches.bytes
+	+ _tiles.bytes + qMax( _cushions.bytes, _cushionCache.bytes )
+	+ _filterCaches.bytes + _ownerCache.bytes;
+}
+
+
+qint64 MemoryStats::bytesPerItem() const
+{
+    qint64 items = _files.count + _dirs.count + _pkgs.count;
+
+    if ( items == 0 )
+	return 0;
+
+    qint64 bytes = _files.bytes + _dirs.bytes + _dotEntries.bytes + _attics.bytes + _pkgs.bytes
+	+ _names.bytes + _sortCaches.bytes;
+
+    return bytes / items;
+}
+
+
+QByteArray MemoryStats::toJson() const
+{
+    QJsonObject json;
+
+    json[ "files"	    ] = jsonCounter( _files	   );
+    json[ "dirs"	    ] = jsonCounter( _dirs	   );
+    json[ "dotEntries"	    ] = jsonCounter( _dotEntries   );
+    json[ "attics"	    ] = jsonCounter( _attics	   );
+    json[ "pkgs"	    ] = jsonCounter( _pkgs	   );
+    json[ "names"	    ] = jsonCounter( _names	   );
+    json[ "sortCaches"	    ] = jsonCounter( _sortCaches   );
+    json[ "tiles"	    ] = jsonCounter( _tiles	   );
+    json[ "cushionBytes"    ] = jsonValue( _cushions.bytes     );
+    json[ "cushionCacheBytes" ] = jsonValue( _cushionCache.bytes );
+    json[ "filterCacheBytes"  ] = jsonValue( _filterCaches.bytes );
+    json[ "ownerCache"	    ] = jsonCounter( _ownerCache   );
+    json[ "sharedNames"	    ] = _sharedNames;
+    json[ "arenaNodes"	    ] = jsonValue( _arenaNodes	   );
+    json[ "arenaChunks"	    ] = _arenaChunks;
+    json[ "arenaBytes"	    ] = jsonValue( _arenaBytes	   );
+    json[ "totalBytes"	    ] = jsonValue( totalBytes()	   );
+    json[ "bytesPerItem"    ] = jsonValue( bytesPerItem()  );
+
+    return QJsonDocument( json ).toJson( QJsonDocument::Compact );
+}
+
+
+QJsonObject MemoryStats::jsonCounter( const Counter & counter )
+{
+    QJsonObject json;
+
+    json[ "count" ] = jsonValue( counter.count );
+    json[ "bytes" ] = jsonValue( counter.bytes );
+
+    return json;
+}
+
+
+QString MemoryStats::textLine( const QString & label, const Counter & counter )
+{
+    return QString( "%1 %2  %3" )
+	.arg( label + ":", -20 )
+	.arg( counter.count, 10 )
+	.arg( formatSize( counter.bytes ), 10 );
+}
+
+
+QString MemoryStats::toText() const
+{
+    QStringList lines;
+
+    lines << textLine( "Files",		       _files	   )
+	  << textLine( "Directories",	       _dirs	   )
+	  << textLine( "Dot entries",	       _dotEntries )
+	  << textLine( "Attics",	       _attics	   )
+	  << textLine( "Packages",	       _pkgs	   )
+	  << textLine( "Names",		       _names	   )
+	  << textLine( "Sorted children",      _sortCaches )
+	  << ""
+	  << QString( "Shared names:        %1" ).arg( _sharedNames )
+	  << QString( "Node arena:          %1 nodes in %2 chunks (%3)" )
+	.arg( _arenaNodes ).arg( _arenaChunks ).arg( formatSize( _arenaBytes ) )
+	  << QString( "Per file or dir:     %1 bytes" ).arg( bytesPerItem() )
+	  << ""
+	  << textLine( "Treemap tiles",	       _tiles	   )
+	  << QString( "Tile cushions:       %1" ).arg( formatSize( _cushions.bytes	  ) )
+	  << QString( "Cushion cache:       %1" ).arg( formatSize( _cushionCache.bytes ) )
+	  << ""
+	  << QString( "Package filters:     %1" ).arg( formatSize( _filterCaches.bytes ) )
+	  << textLine( "Owning packages",      _ownerCache )
+	  << ""
+	  << QString( "Total:               %1" ).arg( formatSize( totalBytes() ) );
+
+    return lines.join( "\n" );
+}
+
+
+void MemoryStats::dumpToLog() const
+{
+    logInfo() << "Memory statistics: " << QString::fromUtf8( toJson() ) << endl;
+}
@@ -0,0 +1,151 @@
+/*
+ *   File name: MemoryStats.h
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef MemoryStats_h
+#define MemoryStats_h
+
+
+#include <QString>
+#include <QByteArray>
+
+
+class QJsonObject;
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class FileInfo;
+    class TreemapView;
+
+
+    /**
+     * Memory accounting for a DirTree and the caches around it: How many
+     * objects of each kind there are and how much memory they need. This
+     * is to find out how much memory a tree with a given number of items
+     * will need, and to compare the memory per item between versions.
+     *
+     * The tree nodes and their names are counted exactly the way the
+     * NodeArena allocates them; containers like the sorted children lists
+     * and the package caches are estimates.
+     *
+     * Unlike ScanStats, this is not updated while reading: collect()
+     * walks the complete tree each time. The statistics can be shown in
+     * the MemoryStatsWindow (Ctrl+Shift+F7), and they are dumped to the
+     * log as JSON when reading is finished.
+     **/
+    class MemoryStats
+    {
+    public:
+
+	/**
+	 * Constructor: Create empty statistics.
+	 **/
+	MemoryStats();
+
+	/**
+	 * Collect the statistics of 'tree' and, if it is non-null, of the
+	 * tiles of 'treemapView'. This replaces any previous content.
+	 **/
+	void collect( DirTree * tree, TreemapView * treemapView = 0 );
+
+	/**
+	 * Return the memory of everything that was counted in bytes, counting
+	 * cushions that are both in tiles and in the cushion cache only
+	 * once.
+	 **/
+	qint64 totalBytes() const;
+
+	/**
+	 * Return the memory of the tree nodes with their names and sort
+	 * caches per file or directory in bytes, i.e. without the pseudo
+	 * entries.
+	 **/
+	qint64 bytesPerItem() const;
+
+	/**
+	 * Return all statistics as a JSON document in one line.
+	 **/
+	QByteArray toJson() const;
+
+	/**
+	 * Return all statistics as human readable text with one item per
+	 * line.
+	 **/
+	QString toText() const;
+
+	/**
+	 * Write all statistics to the log as JSON.
+	 **/
+	void dumpToLog() const;
+
+
+    protected:
+
+	/**
+	 * Number of objects of one kind and their memory in bytes.
+	 **/
+	struct Counter
+	{
+	    Counter():
+		count( 0 ),
+		bytes( 0 )
+		{}
+
+	    void add( qint64 objBytes ) { ++count; bytes += objBytes; }
+
+	    qint64 count;
+	    qint64 bytes;
+	};
+
+	/**
+	 * Add 'item' and its complete subtree including dot entries and
+	 * attics.
+	 **/
+	void addSubtree( FileInfo * item );
+
+	/**
+	 * Return 'counter' as a JSON object.
+	 **/
+	static QJsonObject jsonCounter( const Counter & counter );
+
+	/**
+	 * Return one line of text for 'counter' with 'label'.
+	 **/
+	static QString textLine( const QString & label, const Counter & counter );
+
+
+	//
+	// Data members
+	//
+
+	Counter		_files;
+	Counter		_dirs;
+	Counter		_dotEntries;
+	Counter		_attics;
+	Counter		_pkgs;
+	Counter		_names;		// bytes: their share of the shared names
+	Counter		_sortCaches;	// sorted children lists and sort orders
+	Counter		_tiles;
+	Counter		_cushions;	// only bytes
+	Counter		_cushionCache;	// only bytes
+	Counter		_filterCaches;	// only bytes: package file lists
+	Counter		_ownerCache;	// owning packages
+	double		_nameBytes;	// not rounded for each name
+	int		_sharedNames;
+	long		_arenaNodes;
+	int		_arenaChunks;
+	qint64		_arenaBytes;
+
+    };	// class MemoryStats
+
+}	// namespace QDirStat
+
+
+#endif // ifndef MemoryStats_h
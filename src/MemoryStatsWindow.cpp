@@ -0,0 +1,115 @@
+/*
+ *   File name: MemoryStatsWindow.cpp
+ *   Summary:	QDirStat memory statistics window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QFontDatabase>
+
+#include "MemoryStatsWindow.h"
+#include "TreemapView.h"
+#include "DirTree.h"
+#include "QDirStatApp.h"
+#include "SettingsHelpers.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Walking a large tree takes a while, so not too often
+
+#define REFRESH_MILLISEC	3000
+
+using namespace QDirStat;
+
+
+QPointer<MemoryStatsWindow> MemoryStatsWindow::_sharedInstance = 0;
+
+
+MemoryStatsWindow::MemoryStatsWindow( QWidget * parent ):
+    QDialog( parent ),
+    _ui( new Ui::MemoryStatsWindow ),
+    _reading( false )
+{
+    CHECK_NEW( _ui );
+    _ui->setupUi( this );
+    _ui->statsText->setFont( QFontDatabase::systemFont( QFontDatabase::FixedFont ) );
+    readWindowSettings( this, "MemoryStatsWindow" );
+
+    connect( _ui->refreshButton, SIGNAL( clicked() ),
+	     this,		 SLOT  ( refresh() ) );
+
+    connect( _ui->dumpButton,	 SIGNAL( clicked()   ),
+	     this,		 SLOT  ( dumpToLog() ) );
+
+    connect( &_timer,		 SIGNAL( timeout() ),
+	     this,		 SLOT  ( refreshWhileReading() ) );
+
+    _timer.start( REFRESH_MILLISEC );
+}
+
+
+MemoryStatsWindow::~MemoryStatsWindow()
+{
+    writeWindowSettings( this, "MemoryStatsWindow" );
+    delete _ui;
+}
+
+
+MemoryStatsWindow * MemoryStatsWindow::sharedInstance()
+{
+    if ( ! _sharedInstance )
+    {
+	_sharedInstance = new MemoryStatsWindow( app()->findMainWindow() );
+	CHECK_NEW( _sharedInstance );
+    }
+
+    return _sharedInstance;
+}
+
+
+void MemoryStatsWindow::showSharedInstance( TreemapView * treemapView )
+{
+    sharedInstance()->setTreemapView( treemapView );
+    sharedInstance()->refresh();
+    sharedInstance()->show();
+    sharedInstance()->raise();
+}
+
+
+void MemoryStatsWindow::reject()
+{
+    deleteLater();
+}
+
+
+void MemoryStatsWindow::refresh()
+{
+    _stats.collect( app()->dirTree(), _treemapView );
+    QString text = _stats.toText();
+
+    // Don't reset the scroll position if nothing changed
+
+    if ( text != _ui->statsText->toPlainText() )
+	_ui->statsText->setPlainText( text );
+}
+
+
+void MemoryStatsWindow::refreshWhileReading()
+{
+    bool reading = app()->dirTree() && app()->dirTree()->isBusy();
+
+    // One more time when reading is finished
+
+    if ( reading || _reading )
+	refresh();
+
+    _reading = reading;
+}
+
+
+void MemoryStatsWindow::dumpToLog()
+{
+    _stats.dumpToLog();
+}
@@ -0,0 +1,123 @@
+/*
+ *   File name: MemoryStatsWindow.h
+ *   Summary:	QDirStat memory statistics window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef MemoryStatsWindow_h
+#define MemoryStatsWindow_h
+
+#include <QDialog>
+#include <QPointer>
+#include <QTimer>
+
+#include "ui_memory-stats-window.h"
+#include "MemoryStats.h"
+
+
+namespace QDirStat
+{
+    class TreemapView;
+
+
+    /**
+     * Modeless debug dialog to display the MemoryStats of the tree, the
+     * treemap and the package caches. Since that needs to walk the complete
+     * tree, it is only updated automatically while reading, and every few
+     * seconds at that; otherwise only with the "Refresh" button.
+     *
+     * This window is opened with the invisible Ctrl+Shift+F7 debug action.
+     **/
+    class MemoryStatsWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 **/
+	MemoryStatsWindow( QWidget * parent = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~MemoryStatsWindow();
+
+	/**
+	 * Static method for using one shared instance of this class. This
+	 * will create a new instance if there is none yet (or anymore).
+	 *
+	 * Do not hold on to this pointer; the instance destroys itself when
+	 * the user closes the window, and then the pointer becomes invalid.
+	 **/
+	static MemoryStatsWindow * sharedInstance();
+
+	/**
+	 * Convenience function for creating and showing the shared instance
+	 * with the tiles of 'treemapView'.
+	 **/
+	static void showSharedInstance( TreemapView * treemapView );
+
+	/**
+	 * Set the treemap view whose tiles to include.
+	 **/
+	void setTreemapView( TreemapView * treemapView )
+	    { _treemapView = treemapView; }
+
+
+    public slots:
+
+	/**
+	 * Collect and show the current statistics.
+	 **/
+	void refresh();
+
+	/**
+	 * Write the current statistics to the log as JSON.
+	 **/
+	void dumpToLog();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Close" or
+	 * WM_CLOSE button. This not only closes the dialog, it also deletes
+	 * it.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+
+    protected slots:
+
+	/**
+	 * Refresh if the tree is being read or if reading has just
+	 * finished.
+	 **/
+	void refreshWhileReading();
+
+
+    protected:
+
+	//
+	// Data members
+	//
+
+	Ui::MemoryStatsWindow * _ui;
+	QTimer			_timer;
+	QPointer<TreemapView>	_treemapView;
+	MemoryStats		_stats;
+	bool			_reading;
+
+	static QPointer<MemoryStatsWindow> _sharedInstance;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef MemoryStatsWindow_h
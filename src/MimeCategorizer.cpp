@@ -33,7 +33,11 @@ MimeCategorizer * MimeCategorizer::instance()
 
 MimeCategorizer::MimeCategorizer():
     QObject( 0 ),
-    _mapsDirty( true )
+    _mapsDirty( 1 ),
+    _generation( 0 ),
+    _cacheEpoch( 0 ),
+    _executableCategory( 0 ),
+    _symlinkCategory( 0 )
 {
     // logDebug() << "Creating MimeCategorizer" << endl;
     readSettings();
@@ -51,7 +55,10 @@ void MimeCategorizer::clear()
 {
     qDeleteAll( _categories );
     _categories.clear();
-    _mapsDirty = true;
+    _executableCategory = 0;
+    _symlinkCategory	= 0;
+    _mapsDirty.storeRelease( 1 );
+    ++_generation;
 }
 
 
@@ -68,15 +75,37 @@ MimeCategory * MimeCategorizer::category( FileInfo * item )
     CHECK_PTR  ( item );
     CHECK_MAGIC( item );
 
+    ensureMaps();
+
+    if ( item->mimeCategoryEpoch() == _cacheEpoch )
+    {
+	int idx = item->mimeCategoryIdx();
+
+	if ( idx <= _cacheCategories.size() )
+	    return idx > 0 ? _cacheCategories.at( idx - 1 ) : 0;
+    }
+
+    MimeCategory * matchedCategory = uncachedCategory( item );
+    int idx = matchedCategory ? _cacheIndex.value( matchedCategory, -1 ) : 0;
+
+    if ( idx >= 0 )
+	item->setMimeCategoryIdx( _cacheEpoch, idx );
+
+    return matchedCategory;
+}
+
+
+MimeCategory * MimeCategorizer::uncachedCategory( FileInfo * item )
+{
     if ( item->isSymLink() )
     {
-	return matchCategoryName( CATEGORY_SYMLINKS );
+	return _symlinkCategory;
     }
     else if ( item->isFile() )
     {
 	MimeCategory *matchedCategory = category( item->name() );
 	if ( ! matchedCategory && ( item->mode() & S_IXUSR  ) == S_IXUSR )
-	    return matchCategoryName( CATEGORY_EXECUTABLES );
+	    return _executableCategory;
 
 	return matchedCategory;
     }
@@ -87,54 +116,107 @@ MimeCategory * MimeCategorizer::category( FileInfo * item )
 }
 
 
+void MimeCategorizer::ensureMaps()
+{
+    // Build the suffix tries for fast lookup. This might be called from
+    // several threads at once by a StatsEngine: The acquire load makes sure
+    // that a thread that sees clean maps also sees everything buildMaps()
+    // wrote into them before its release store.
+
+    if ( _mapsDirty.loadAcquire() )
+    {
+	QMutexLocker locker( &_mutex );
+
+	if ( _mapsDirty.loadAcquire() )
+	    buildMaps();
+    }
+}
+
+
+int MimeCategorizer::suffixIdCount()
+{
+    ensureMaps();
+
+    return _suffixes.size();
+}
+
+
 MimeCategory * MimeCategorizer::category( const QString & filename,
-					  QString	* suffix_ret )
+					  QString	* suffix_ret,
+					  int		* suffixId_ret )
 {
     if ( suffix_ret )
 	*suffix_ret = "";
 
+    if ( suffixId_ret )
+	*suffixId_ret = -1;
+
     if ( filename.isEmpty() )
 	return 0;
 
-    // Build suffix maps for fast lookup
+    ensureMaps();
 
-    if ( _mapsDirty )
-	buildMaps();
+    // Check all suffixes of the filename at once, walking backwards from the
+    // last character: Each '.' (including a leading one) starts another
+    // suffix. As before, the longest matching suffix wins, e.g. "tar.bz2"
+    // over just "bz2", and for the same suffix, a case sensitive one wins.
 
     MimeCategory * category = 0;
-
-    // Find the filename suffix: Section #1
-    // (ignoring any leading '.' separator)
-    QString suffix = filename.section( '.', 1 );
-
-    while ( ! suffix.isEmpty() && ! category )
+    int matchPos	    = -1;
+    int suffixId	    = -1;
+    int sensitive	    = 0;	// Root nodes
+    int insensitive	    = 0;
+
+    for ( int i = filename.size() - 1;
+	  i >= 0 && ( sensitive >= 0 || insensitive >= 0 );
+	  --i )
     {
-        // logVerbose() << "Checking " << suffix << endl;
+	QChar ch = filename.at( i );
 
-	// Try case sensitive first
+	if ( ch == '.' )
+	{
+	    MimeCategory * found = 0;
+	    int foundId		 = -1;
 
-	category = _caseSensitiveSuffixMap.value( suffix, 0 );
+	    if ( sensitive >= 0 )
+	    {
+		found	= _caseSensitiveSuffixes.category( sensitive );
+		foundId = _caseSensitiveSuffixes.suffixId( sensitive );
+	    }
 
-	if ( ! category )
-	    category = _caseInsensitiveSuffixMap.value( suffix.toLower(), 0 );
+	    if ( ! found && insensitive >= 0 )
+	    {
+		found	= _caseInsensitiveSuffixes.category( insensitive );
+		foundId = _caseInsensitiveSuffixes.suffixId( insensitive );
+	    }
 
-	if ( category ) // success
-        {
-            if ( suffix_ret )
-                *suffix_ret = suffix;
-        }
-        else
-        {
-            // No match so far? Try the next suffix. Some files might have more
-            // than one, e.g., "tar.bz2" - if there is no match for "tar.bz2",
-            // there might be one for just "bz2".
+	    if ( found )
+	    {
+		category = found;
+		matchPos = i + 1;
+		suffixId = foundId;
+	    }
+	}
+
+	if ( sensitive >= 0 )
+	    sensitive = _caseSensitiveSuffixes.child( sensitive, ch );
 
-            suffix = suffix.section( '.', 1 );
-        }
+	if ( insensitive >= 0 )
+	    insensitive = _caseInsensitiveSuffixes.child( insensitive, ch.toLower() );
     }
 
-    if ( ! category ) // No match yet?
+    if ( category ) // success
+    {
+	if ( suffix_ret )
+	    *suffix_ret = filename.mid( matchPos );
+
+	if ( suffixId_ret )
+	    *suffixId_ret = suffixId;
+    }
+    else // No match yet?
+    {
 	category = matchPatterns( filename );
+    }
 
 #if 0
     if ( category )
@@ -147,6 +229,9 @@ MimeCategory * MimeCategorizer::category( const QString & filename,
 
 MimeCategory * MimeCategorizer::matchPatterns( const QString & filename ) const
 {
+    // QRegExp::exactMatch() stores the captured texts in the QRegExp
+    QMutexLocker locker( &_mutex );
+
     foreach ( MimeCategory * category, _categories )
     {
 	if ( category )
@@ -180,7 +265,8 @@ void MimeCategorizer::add( MimeCategory * category )
     CHECK_PTR( category );
 
     _categories << category;
-    _mapsDirty = true;
+    _mapsDirty.storeRelease( 1 );
+    ++_generation;
 }
 
 
@@ -189,45 +275,116 @@ void MimeCategorizer::remove( MimeCategory * category )
     CHECK_PTR( category );
 
     _categories.removeAll( category );
+
+    if ( category == _executableCategory )
+	_executableCategory = 0;
+
+    if ( category == _symlinkCategory )
+	_symlinkCategory = 0;
+
     delete category;
-    _mapsDirty = true;
+    _mapsDirty.storeRelease( 1 );
+    ++_generation;
 }
 
 
 void MimeCategorizer::buildMaps()
 {
-    _caseInsensitiveSuffixMap.clear();
-    _caseSensitiveSuffixMap.clear();
+    _caseInsensitiveSuffixes.clear();
+    _caseSensitiveSuffixes.clear();
+    _suffixes.clear();
+    _suffixCategories.clear();
+    _cacheCategories.clear();
+    _cacheIndex.clear();
+
+    // Invalidate all categories cached in FileInfo items; 0 is reserved
+    // for items that never had one.
+
+    if ( ++_cacheEpoch == 0 )
+	++_cacheEpoch;
 
     foreach ( MimeCategory * category, _categories )
     {
 	CHECK_PTR( category );
 
-	addSuffixes( _caseInsensitiveSuffixMap, category, category->caseInsensitiveSuffixList() );
-	addSuffixes( _caseSensitiveSuffixMap,	category, category->caseSensitiveSuffixList()	);
+	// Only as many categories as fit into the index are cached
+
+	if ( _cacheCategories.size() < 255 )
+	{
+	    _cacheCategories << category;
+	    _cacheIndex.insert( category, _cacheCategories.size() );
+	}
+
+	addSuffixes( _caseInsensitiveSuffixes, category, category->caseInsensitiveSuffixList() );
+	addSuffixes( _caseSensitiveSuffixes,   category, category->caseSensitiveSuffixList()   );
     }
 
-    _mapsDirty = false;
+    _mapsDirty.storeRelease( 0 );
 }
 
 
-void MimeCategorizer::addSuffixes( QMap<QString, MimeCategory *> & suffixMap,
-				   MimeCategory			 * category,
-				   const QStringList		 & suffixList  )
+void MimeCategorizer::addSuffixes( MimeSuffixTrie    & suffixTrie,
+				   MimeCategory	     * category,
+				   const QStringList & suffixList  )
 {
     foreach ( const QString & suffix, suffixList )
     {
-	if ( suffixMap.contains( suffix ) )
+	MimeCategory * duplicate = suffixTrie.add( suffix, category, _suffixes.size() );
+
+	if ( ! duplicate )
+	{
+	    _suffixes	      << suffix;
+	    _suffixCategories << category;
+	}
+	else
 	{
 	    logError() << "Duplicate suffix: " << suffix << " for "
-		       << suffixMap.value( suffix ) << " and " << category
+		       << duplicate << " and " << category
 		       << endl;
 	}
-	else
+    }
+}
+
+
+
+
+void MimeSuffixTrie::clear()
+{
+    _edges.clear();
+    _categories.clear();
+    _suffixIds.clear();
+    _categories << 0;	// The root node
+    _suffixIds	<< -1;
+}
+
+
+MimeCategory * MimeSuffixTrie::add( const QString & suffix, MimeCategory * category, int suffixId )
+{
+    int node = 0;
+
+    for ( int i = suffix.size() - 1; i >= 0; --i )
+    {
+	quint64 key  = edgeKey( node, suffix.at( i ) );
+	int	next = _edges.value( key, -1 );
+
+	if ( next < 0 )
 	{
-	    suffixMap[ suffix ] = category;
+	    next = _categories.size();
+	    _categories << 0;
+	    _suffixIds	<< -1;
+	    _edges.insert( key, next );
 	}
+
+	node = next;
     }
+
+    if ( _categories.at( node ) )
+	return _categories.at( node );
+
+    _categories[ node ] = category;
+    _suffixIds [ node ] = suffixId;
+
+    return 0;
 }
 
 
@@ -271,6 +428,12 @@ void MimeCategorizer::writeSettings()
     // logDebug() << endl;
     MimeCategorySettings settings;
 
+    // This is also called after categories were changed in place by the
+    // config page, so the suffix tries and the categories cached in the
+    // items need to be rebuilt.
+    ++_generation;
+    _mapsDirty.storeRelease( 1 );
+
     // Remove all leftover cleanup descriptions
     settings.removeGroups( settings.groupPrefix() );
 
@@ -10,7 +10,11 @@
 #define MimeCategorizer_h
 
 #include <QObject>
-#include <QMap>
+#include <QHash>
+#include <QVector>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QStringList>
 
 #include "MimeCategory.h"
 
@@ -22,6 +26,67 @@ namespace QDirStat
 {
     class FileInfo;
 
+
+    /**
+     * Trie of filename suffixes that is stored in reverse order, i.e. with
+     * the last character of each suffix at the root, so all suffixes of a
+     * filename can be looked up in one single pass from the end of the
+     * filename without creating any temporary strings.
+     *
+     * Nodes are identified by their index; the root node is 0.
+     **/
+    class MimeSuffixTrie
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	MimeSuffixTrie() { clear(); }
+
+	/**
+	 * Remove all suffixes.
+	 **/
+	void clear();
+
+	/**
+	 * Add 'suffix' with 'category' and ID 'suffixId'. If that suffix is
+	 * already there, this does nothing and returns the category it
+	 * already has. Otherwise, this returns 0.
+	 **/
+	MimeCategory * add( const QString & suffix, MimeCategory * category, int suffixId );
+
+	/**
+	 * Return the child of node 'node' for the previous character 'ch' of
+	 * a filename or -1 if there is none.
+	 **/
+	int child( int node, QChar ch ) const
+	    { return _edges.value( edgeKey( node, ch ), -1 ); }
+
+	/**
+	 * Return the category of the suffix that ends at node 'node' or 0 if
+	 * there is no suffix that ends there.
+	 **/
+	MimeCategory * category( int node ) const
+	    { return _categories.at( node ); }
+
+	/**
+	 * Return the ID of the suffix that ends at node 'node' or -1 if
+	 * there is no suffix that ends there.
+	 **/
+	int suffixId( int node ) const
+	    { return _suffixIds.at( node ); }
+
+    protected:
+
+	static quint64 edgeKey( int node, QChar ch )
+	    { return ( (quint64) node << 16 ) | ch.unicode(); }
+
+	QHash<quint64, int>	 _edges;
+	QVector<MimeCategory *> _categories;	// For each node
+	QVector<int>		 _suffixIds;	// For each node
+    };
+
     /**
      * Class to determine the MimeCategory of filenames.
      *
@@ -59,6 +124,13 @@ namespace QDirStat
 	 **/
 	static MimeCategorizer * instance();
 
+	/**
+	 * Return a number that changes whenever the categories change, so
+	 * any cached results of categorizing files can be recognized as
+	 * outdated.
+	 **/
+	int generation() const { return _generation; }
+
 	/**
 	 * Return the color for a FileInfo item or white if it doesn't fit
 	 * into any of the available categories.
@@ -68,6 +140,10 @@ namespace QDirStat
 	/**
 	 * Return the MimeCategory for a FileInfo item or 0 if it doesn't fit
 	 * into any of the available categories.
+	 *
+	 * The result is cached in the item as an index into the categories
+	 * until the categories change, so this is only expensive for the
+	 * first call for each item.
 	 **/
 	MimeCategory * category( FileInfo * item );
 
@@ -79,8 +155,32 @@ namespace QDirStat
 	 * category was found by a suffix rule. If the category was not found
 	 * or if a regexp (rather than a suffix rule) matched, this returns an
 	 * empty string.
+	 *
+	 * If 'suffixId_ret' is non-null, it returns the ID of the suffix rule
+	 * (see suffix()) or -1 if no suffix rule matched. This is cheaper than
+	 * 'suffix_ret' since no string is created.
+	 **/
+	MimeCategory * category( const QString & filename,
+				 QString       * suffix_ret   = 0,
+				 int	       * suffixId_ret = 0 );
+
+	/**
+	 * Return the number of suffix rules, i.e. the upper limit of the
+	 * suffix IDs. The IDs are only valid for one generation().
+	 **/
+	int suffixIdCount();
+
+	/**
+	 * Return the suffix of suffix rule 'suffixId' as it was configured
+	 * (case insensitive ones in lower case).
 	 **/
-	MimeCategory * category( const QString & filename, QString * suffix_ret = 0 );
+	QString suffix( int suffixId ) const { return _suffixes.at( suffixId ); }
+
+	/**
+	 * Return the category of suffix rule 'suffixId'.
+	 **/
+	MimeCategory * suffixCategory( int suffixId ) const
+	    { return _suffixCategories.at( suffixId ); }
 
 	/**
 	 * Add a MimeCategory.
@@ -129,14 +229,26 @@ namespace QDirStat
 	void buildMaps();
 
 	/**
-	 * Add all suffixes in 'suffixList' as key to 'suffixMap' with value
-	 * 'category'.
+	 * Build the internal maps if they are dirty. This is thread-safe.
+	 **/
+	void ensureMaps();
+
+	/**
+	 * Find the MimeCategory for a FileInfo item without using the cached
+	 * category in the item.
+	 **/
+	MimeCategory * uncachedCategory( FileInfo * item );
+
+	/**
+	 * Add all suffixes in 'suffixList' to 'suffixTrie' with 'category'
+	 * and assign them the next free suffix IDs.
 	 *
-	 * This provides a really fast map lookup for each suffix.
+	 * This provides a really fast lookup of all suffixes of a filename
+	 * at once.
 	 **/
-	void addSuffixes( QMap<QString, MimeCategory *> & suffixMap,
-			  MimeCategory			* category,
-			  const QStringList		& suffixList  );
+	void addSuffixes( MimeSuffixTrie    & suffixTrie,
+			  MimeCategory	    * category,
+			  const QStringList & suffixList  );
 
 	/**
 	 * Iterate over all categories to find categories by name.
@@ -166,11 +278,23 @@ namespace QDirStat
 
 	static MimeCategorizer *	_instance;
 
-	bool				_mapsDirty;
+	mutable QMutex			_mutex;
+	QAtomicInt			_mapsDirty;	// see ensureMaps()
+	int				_generation;
 	MimeCategoryList		_categories;
 
-	QMap<QString, MimeCategory *>	_caseInsensitiveSuffixMap;
-	QMap<QString, MimeCategory *>	_caseSensitiveSuffixMap;
+	MimeSuffixTrie			_caseInsensitiveSuffixes;
+	MimeSuffixTrie			_caseSensitiveSuffixes;
+	QStringList			_suffixes;		// By suffix ID
+	MimeCategoryList		_suffixCategories;	// By suffix ID
+
+	// For the categories cached in the FileInfo items: The epoch changes
+	// with each change of the categories; the index is 1-based, 0 is for
+	// items without a category.
+
+	quint8				_cacheEpoch;
+	MimeCategoryList		_cacheCategories;	// By index - 1
+	QHash<MimeCategory *, int>	_cacheIndex;
 
 	MimeCategory *_executableCategory;
 	MimeCategory *_symlinkCategory;
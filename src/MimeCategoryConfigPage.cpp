@@ -130,10 +130,10 @@ void MimeCategoryConfigPage::colorChanged( const QString & newColor )
 {
     QListWidgetItem * currentItem = listWidget()->currentItem();
 
-    // Always set the new colour, even if empty or invalid, for the mini-treemap to rebuild
+    // Always set the new colour, even if empty or invalid, for the mini-treemap to reshade
     QColor color( newColor );
     _ui->treemapView->setFixedColor( color );
-    _ui->treemapView->rebuildTreemap();
+    _ui->treemapView->reshade();
 
     if ( currentItem )
     {
@@ -160,7 +160,7 @@ void MimeCategoryConfigPage::pickColor()
 	    category->setColor( color );
 	    _ui->colorLineEdit->setText( color.name() );
 	    _ui->treemapView->setFixedColor( color );
-	    _ui->treemapView->rebuildTreemap();
+	    _ui->treemapView->reshade();
 	}
     }
 }
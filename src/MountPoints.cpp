@@ -7,21 +7,33 @@
  */
 
 
+#include <fcntl.h>	// open()
+#include <poll.h>	// poll()
+#include <unistd.h>	// read(), lseek(), close()
+#include <errno.h>
+#include <sys/statvfs.h>	// statvfs()
+
 #include <QFile>
 #include <QRegExp>
 #include <QFileInfo>
 
 #include "MountPoints.h"
+#include "DeviceTable.h"
 #include "SysUtil.h"
 #include "Logger.h"
 #include "Exception.h"
 
 #define LSBLK_TIMEOUT_SEC       10
 #define USE_PROC_MOUNTS         1
+#define MOUNT_INFO_FILE		"/proc/self/mountinfo"
+#define MOUNT_INFO_CHUNK_SIZE	( 64 * 1024 )
 
 using namespace QDirStat;
 
 
+static QString unescapeMountField( const QByteArray & field );
+
+
 MountPoint::MountPoint( const QString & device,
 			const QString & path,
 			const QString & filesystemType,
@@ -119,6 +131,95 @@ bool MountPoint::isSnapPackage() const
 }
 
 
+bool MountPoint::isOverlay() const
+{
+    return _filesystemType.toLower() == "overlay";
+}
+
+
+QStringList MountPoint::overlayLowerDirs() const
+{
+    QStringList dirs;
+
+    if ( ! isOverlay() )
+	return dirs;
+
+    foreach ( const QString & opt, _mountOptions )
+    {
+	if ( opt.startsWith( "lowerdir+=" ) )
+	{
+	    // Newer kernels: One layer per option, no escaping of colons
+
+	    QString dir = unescapeMountField( opt.mid( 10 ).toUtf8() );
+
+	    if ( ! dir.isEmpty() )
+		dirs << dir;
+	}
+	else if ( opt.startsWith( "lowerdir=" ) )
+	{
+	    // "lowerdir=/l/a:/l/b"; a colon in a path is escaped as "\:",
+	    // and "::" separates the data-only layers (which are layers, too)
+
+	    QString value = unescapeMountField( opt.mid( 9 ).toUtf8() );
+	    QString dir;
+
+	    for ( int i = 0; i < value.size(); ++i )
+	    {
+		if ( value.at( i ) == '\\' && i + 1 < value.size() )
+		{
+		    dir += value.at( ++i );
+		}
+		else if ( value.at( i ) == ':' )
+		{
+		    if ( ! dir.isEmpty() )
+			dirs << dir;
+
+		    dir.clear();
+		}
+		else
+		{
+		    dir += value.at( i );
+		}
+	    }
+
+	    if ( ! dir.isEmpty() )
+		dirs << dir;
+	}
+    }
+
+    return dirs;
+}
+
+
+QString MountPoint::overlayUpperDir() const
+{
+    if ( ! isOverlay() )
+	return QString();
+
+    foreach ( const QString & opt, _mountOptions )
+    {
+	if ( opt.startsWith( "upperdir=" ) )
+	    return unescapeMountField( opt.mid( 9 ).toUtf8() );
+    }
+
+    return QString();
+}
+
+
+QStringList MountPoint::overlayLayers() const
+{
+    QStringList layers;
+    QString upperDir = overlayUpperDir();
+
+    if ( ! upperDir.isEmpty() )
+	layers << upperDir;
+
+    layers << overlayLowerDirs();
+
+    return layers;
+}
+
+
 #if HAVE_Q_STORAGE_INFO
 
 QStorageInfo * MountPoint::storageInfo()
@@ -171,6 +272,15 @@ FileSize MountPoint::freeSizeForRoot()
     return storageInfo()->bytesFree();
 }
 
+
+void MountPoint::refreshSizeInfo()
+{
+    // Don't create a QStorageInfo if nobody asked for one yet
+
+    if ( _storageInfo )
+	_storageInfo->refresh();
+}
+
 #else  // ! HAVE_Q_STORAGE_INFO
 
 // Qt before 5.4 does not have QStorageInfo,
@@ -182,10 +292,24 @@ FileSize MountPoint::usedSize()		 { return -1; }
 FileSize MountPoint::reservedSize()	 { return -1; }
 FileSize MountPoint::freeSizeForUser()	 { return -1; }
 FileSize MountPoint::freeSizeForRoot()   { return -1; }
+void	 MountPoint::refreshSizeInfo()	 {}
 
 #endif // ! HAVE_Q_STORAGE_INFO
 
 
+FileCount MountPoint::usedInodes() const
+{
+    // QStorageInfo does not know about inodes
+
+    struct statvfs fs;
+
+    if ( statvfs( _path.toUtf8().constData(), &fs ) != 0 || fs.f_files == 0 )
+	return -1;
+
+    return (FileCount) ( fs.f_files - fs.f_ffree );
+}
+
+
 
 
 MountPoints * MountPoints::_instance = 0;
@@ -203,7 +327,8 @@ MountPoints * MountPoints::instance()
 }
 
 
-MountPoints::MountPoints()
+MountPoints::MountPoints():
+    _mountInfoFd( -1 )
 {
     init();
 }
@@ -212,6 +337,9 @@ MountPoints::MountPoints()
 MountPoints::~MountPoints()
 {
     init();
+
+    if ( _mountInfoFd >= 0 )
+	close( _mountInfoFd );
 }
 
 
@@ -219,8 +347,13 @@ void MountPoints::init()
 {
     qDeleteAll( _mountPointList );
     _mountPointList.clear();
-    _mountPointMap.clear();
+    qDeleteAll( _mountPointTrie.children );
+    _mountPointTrie.children.clear();
+    _mountPointTrie.mountPoint = 0;
+    _mountedDevices.clear();
+    _ntfsDevices.clear();
     _isPopulated     = false;
+    _checkedNtfsDevices = false;
     _checkedForBtrfs = false;
     _hasBtrfs	     = false;
     _hasNtfs         = false;
@@ -231,6 +364,8 @@ void MountPoints::clear()
 {
     if ( _instance )
 	_instance->init();
+
+    DeviceTable::clear();
 }
 
 
@@ -246,7 +381,7 @@ MountPoint * MountPoints::findByPath( const QString & path )
 {
     instance()->ensurePopulated();
 
-    return instance()->_mountPointMap.value( path, 0 );
+    return instance()->findInTrie( path, false );
 }
 
 
@@ -255,28 +390,51 @@ MountPoint * MountPoints::findNearestMountPoint( const QString & startPath )
     QFileInfo fileInfo( startPath );
     QString path = fileInfo.canonicalFilePath(); // absolute path without symlinks or ..
 
-    if ( path != startPath )
+    if ( path.isEmpty() )	// startPath does not exist
+	path = startPath;
+    else if ( path != startPath )
 	logDebug() << startPath << " canonicalized is " << path << endl;
 
-    MountPoint * mountPoint = findByPath( path );
+    instance()->ensurePopulated();
+    MountPoint * mountPoint = instance()->findInTrie( path, true );
+
+    // logDebug() << "Nearest mount point for " << startPath << " is " << mountPoint << endl;
+
+    return mountPoint;
+}
 
-    if ( ! mountPoint )
+
+MountPoint * MountPoints::findInTrie( const QString & path, bool nearest ) const
+{
+    if ( ! path.startsWith( '/' ) )
+	return 0;
+
+    const MountPointTrieNode * node = &_mountPointTrie;
+    MountPoint * nearestMountPoint  = node->mountPoint;
+    int start = 0;
+
+    while ( start < path.size() )
     {
-	QStringList pathComponents = startPath.split( "/", QString::SkipEmptyParts );
+	int end = path.indexOf( '/', start );
+
+	if ( end < 0 )
+	    end = path.size();
 
-	while ( ! mountPoint && ! pathComponents.isEmpty() )
+	if ( end > start )	// Skip empty path components
 	{
-	    // Try one level upwards
-	    pathComponents.removeLast();
-	    path = QString( "/" ) + pathComponents.join( "/" );
+	    node = node->children.value( path.mid( start, end - start ), 0 );
+
+	    if ( ! node )
+		return nearest ? nearestMountPoint : 0;
 
-	    mountPoint = instance()->_mountPointMap.value( path, 0 );
+	    if ( node->mountPoint )
+		nearestMountPoint = node->mountPoint;
 	}
-    }
 
-    // logDebug() << "Nearest mount point for " << startPath << " is " << mountPoint << endl;
+	start = end + 1;
+    }
 
-    return mountPoint;
+    return nearest ? nearestMountPoint : node->mountPoint;
 }
 
 
@@ -285,13 +443,7 @@ bool MountPoints::isDeviceMounted( const QString & device )
     // Do NOT call ensurePopulated() here: This would cause a recursion in the
     // populating process!
 
-    foreach ( MountPoint * mountPoint, instance()->_mountPointList )
-    {
-	if ( mountPoint->device() == device )
-	    return true;
-    }
-
-    return false;
+    return instance()->_mountedDevices.contains( device );
 }
 
 
@@ -324,10 +476,10 @@ void MountPoints::ensurePopulated()
 
 #if USE_PROC_MOUNTS
 
-    read( "/proc/mounts" ) || read( "/etc/mtab" );
+    readMountInfo() || read( "/proc/mounts" ) || read( "/etc/mtab" );
 
     if ( ! _isPopulated )
-	logError() << "Could not read either /proc/mounts or /etc/mtab" << endl;
+	logError() << "Could not read " << MOUNT_INFO_FILE << ", /proc/mounts or /etc/mtab" << endl;
 
 #endif
 
@@ -343,6 +495,225 @@ void MountPoints::ensurePopulated()
 }
 
 
+bool MountPoints::readMountInfo()
+{
+    if ( _mountInfoFd < 0 )
+    {
+	_mountInfoFd = open( MOUNT_INFO_FILE, O_RDONLY | O_CLOEXEC );
+
+	if ( _mountInfoFd < 0 )
+	{
+	    logWarning() << "Can't open " << MOUNT_INFO_FILE << ": " << formatErrno() << endl;
+	    return false;
+	}
+    }
+
+    // Read the complete file with the same file descriptor that is used
+    // for poll() in mountTableChanged(). Files in /proc don't have a size,
+    // so just read chunks until the end.
+
+    QByteArray content;
+    lseek( _mountInfoFd, 0, SEEK_SET );
+
+    while ( true )
+    {
+	int oldSize = content.size();
+	content.resize( oldSize + MOUNT_INFO_CHUNK_SIZE );
+	ssize_t len = ::read( _mountInfoFd, content.data() + oldSize, MOUNT_INFO_CHUNK_SIZE );
+
+	if ( len < 0 && errno == EINTR )
+	    len = 0;
+
+	if ( len <= 0 )
+	{
+	    content.resize( oldSize );
+
+	    if ( len < 0 )
+	    {
+		logWarning() << "Can't read " << MOUNT_INFO_FILE << ": " << formatErrno() << endl;
+		close( _mountInfoFd );
+		_mountInfoFd = -1;
+
+		return false;
+	    }
+
+	    break;
+	}
+
+	content.resize( oldSize + len );
+    }
+
+    logDebug() << "Reading " << MOUNT_INFO_FILE << endl;
+
+    int lineNo = 0;
+    int count  = 0;
+    int start  = 0;
+
+    while ( start < content.size() )
+    {
+	int end = content.indexOf( '\n', start );
+
+	if ( end < 0 )
+	    end = content.size();
+
+	++lineNo;
+	QByteArray line = content.mid( start, end - start );
+	start = end + 1;
+
+	if ( line.isEmpty() )
+	    continue;
+
+	if ( ! parseMountInfoLine( line ) )
+	{
+	    logError() << "Bad line " << MOUNT_INFO_FILE << ":" << lineNo << ": " << line << endl;
+	    continue;
+	}
+
+	if ( ! _mountPointList.last()->isDuplicate() )
+	    ++count;
+    }
+
+    if ( count < 1 )
+    {
+	logWarning() << "Not a single mount point in " << MOUNT_INFO_FILE << endl;
+	init();
+
+	return false;
+    }
+
+    // logDebug() << "Read " << _mountPointList.size() << " mount points from " << MOUNT_INFO_FILE << endl;
+    _isPopulated = true;
+
+    return true;
+}
+
+
+/**
+ * Return 'field' with the octal escapes of the kernel ("\040" for a blank,
+ * "\011" for a tab, "\012" for a newline, "\134" for a backslash) resolved.
+ **/
+static QString unescapeMountField( const QByteArray & field )
+{
+    if ( ! field.contains( '\\' ) )
+	return QString::fromUtf8( field );
+
+    QByteArray result;
+    result.reserve( field.size() );
+
+    for ( int i = 0; i < field.size(); ++i )
+    {
+	char c = field.at( i );
+
+	if ( c == '\\' && i + 3 < field.size() &&
+	     field.at( i+1 ) >= '0' && field.at( i+1 ) <= '7' &&
+	     field.at( i+2 ) >= '0' && field.at( i+2 ) <= '7' &&
+	     field.at( i+3 ) >= '0' && field.at( i+3 ) <= '7'	)
+	{
+	    c = (char) ( ( field.at( i+1 ) - '0' ) * 64 +
+			 ( field.at( i+2 ) - '0' ) * 8	+
+			 ( field.at( i+3 ) - '0' ) );
+	    i += 3;
+	}
+
+	result.append( c );
+    }
+
+    return QString::fromUtf8( result );
+}
+
+
+bool MountPoints::parseMountInfoLine( const QByteArray & line )
+{
+    // File format (/proc/self/mountinfo), see also proc(5):
+    //
+    //   36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+    //   (0)(1)(2)   (3)   (4)      (5)      (6)   (7) (8)   (9)          (10)
+    //
+    //   (0) mount ID      (1) parent ID	  (2) major:minor
+    //   (3) root	   (4) mount point	  (5) mount options
+    //   (6) zero or more optional fields, terminated by "-"
+    //   (8) filesystem type (9) mount source	  (10) superblock options
+    //
+    // Split without any regexp; this is called for each line, and there
+    // may be thousands of them on hosts with many containers.
+
+    QList<QByteArray> fields;
+    int start = 0;
+
+    while ( start < line.size() )
+    {
+	int end = line.indexOf( ' ', start );
+
+	if ( end < 0 )
+	    end = line.size();
+
+	if ( end > start )
+	    fields << line.mid( start, end - start );
+
+	start = end + 1;
+    }
+
+    int sep = fields.indexOf( "-", 6 );
+
+    if ( fields.size() < 6 || sep < 0 || sep + 2 >= fields.size() )
+	return false;
+
+    QString device = unescapeMountField( fields.at( sep + 2 ) );
+    QString path   = unescapeMountField( fields.at( 4 ) );
+    QString fsType = realFsType( device, QString::fromUtf8( fields.at( sep + 1 ) ) );
+
+    // Merge the superblock options into the mount options like
+    // /proc/mounts does: "rw,relatime" + "rw,errors=remount-ro"
+
+    QStringList mountOpts = QString::fromUtf8( fields.at( 5 ) ).split( ',' );
+
+    if ( sep + 3 < fields.size() )
+    {
+	foreach ( const QString & opt, QString::fromUtf8( fields.at( sep + 3 ) ).split( ',' ) )
+	{
+	    if ( opt != "rw" && opt != "ro" && ! mountOpts.contains( opt ) )
+		mountOpts << opt;
+	}
+    }
+
+    MountPoint * mountPoint = new MountPoint( device, path, fsType, mountOpts.join( "," ) );
+    CHECK_NEW( mountPoint );
+
+    postProcess( mountPoint );
+    add( mountPoint );
+
+    return true;
+}
+
+
+bool MountPoints::mountTableChanged()
+{
+    if ( _mountInfoFd < 0 )
+	return true; // Can't tell
+
+    // The kernel reports POLLPRI | POLLERR when the mount table changed
+    // since the last poll() on this file descriptor (or since it was
+    // opened). This does not read anything.
+
+    struct pollfd pollInfo;
+    pollInfo.fd	     = _mountInfoFd;
+    pollInfo.events  = POLLPRI;
+    pollInfo.revents = 0;
+
+    int result = poll( &pollInfo, 1, 0 );
+
+    if ( result < 0 )
+	return true;
+
+    bool changed = pollInfo.revents & ( POLLPRI | POLLERR );
+
+    if ( changed )
+	logInfo() << "Mount table changed" << endl;
+
+    return changed;
+}
+
+
 bool MountPoints::read( const QString & filename )
 {
     QFile file( filename );
@@ -353,7 +724,6 @@ bool MountPoints::read( const QString & filename )
 	return false;
     }
 
-    findNtfsDevices();
     logDebug() << "Reading " << filename << endl;
 
     QTextStream in( &file );
@@ -388,9 +758,7 @@ bool MountPoints::read( const QString & filename )
 	// ignoring fsck and dump order (0 0)
 
         path.replace( "\\040", " " );
-
-        if ( fsType == "fuseblk" && _ntfsDevices.contains( device ) )
-            fsType = "ntfs";
+        fsType = realFsType( device, fsType );
 
 	MountPoint * mountPoint = new MountPoint( device, path, fsType, mountOpts );
 	CHECK_NEW( mountPoint );
@@ -444,7 +812,43 @@ void MountPoints::add( MountPoint * mountPoint )
     CHECK_PTR( mountPoint );
 
     _mountPointList << mountPoint;
-    _mountPointMap[ mountPoint->path() ] = mountPoint;
+    _mountedDevices.insert( mountPoint->device() );
+
+    if ( mountPoint->isNtfs() )
+	_hasNtfs = true;
+
+    MountPointTrieNode * node = &_mountPointTrie;
+
+    foreach ( const QString & name, mountPoint->path().split( '/', QString::SkipEmptyParts ) )
+    {
+	MountPointTrieNode * child = node->children.value( name, 0 );
+
+	if ( ! child )
+	{
+	    child = new MountPointTrieNode();
+	    CHECK_NEW( child );
+	    node->children.insert( name, child );
+	}
+
+	node = child;
+    }
+
+    node->mountPoint = mountPoint; // The last one mounted here wins
+}
+
+
+QString MountPoints::realFsType( const QString & device, const QString & fsType )
+{
+    if ( fsType != "fuseblk" )
+	return fsType;
+
+    if ( ! _checkedNtfsDevices )
+    {
+	findNtfsDevices();
+	_checkedNtfsDevices = true;
+    }
+
+    return _ntfsDevices.contains( device ) ? QString( "ntfs" ) : fsType;
 }
 
 
@@ -452,8 +856,6 @@ void MountPoints::add( MountPoint * mountPoint )
 
 bool MountPoints::readStorageInfo()
 {
-    findNtfsDevices();
-
     foreach ( QStorageInfo mount, QStorageInfo::mountedVolumes() )
     {
         QString device( QString::fromUtf8( mount.device() ) );
@@ -463,8 +865,7 @@ bool MountPoints::readStorageInfo()
         if ( mount.isReadOnly() )
             mountOptions += "ro";
 
-        if ( fsType == "fuseblk" && _ntfsDevices.contains( device ) )
-            fsType = "ntfs";
+        fsType = realFsType( device, fsType );
 
         MountPoint * mountPoint = new MountPoint( device,
                                                   mount.rootPath(),
@@ -496,7 +897,7 @@ bool MountPoints::checkForBtrfs()
 {
     ensurePopulated();
 
-    foreach ( MountPoint * mountPoint, _mountPointMap )
+    foreach ( MountPoint * mountPoint, _mountPointList )
     {
 	if ( mountPoint && mountPoint->isBtrfs() )
 	    return true;
@@ -545,9 +946,9 @@ void MountPoints::findNtfsDevices()
         }
     }
 
-    _hasNtfs = ! _ntfsDevices.isEmpty();
-
-    if ( ! _hasNtfs )
+    if ( ! _ntfsDevices.isEmpty() )
+        _hasNtfs = true;
+    else
         logDebug() << "No NTFS devices found" << endl;
 }
 
@@ -590,8 +991,22 @@ void MountPoints::dump()
 
 void MountPoints::reload()
 {
-    instance()->clear();
-    instance()->ensurePopulated();
+    MountPoints * mountPoints = instance();
+
+    if ( mountPoints->_isPopulated && ! mountPoints->mountTableChanged() )
+    {
+	// Nothing was mounted or unmounted: Keep everything (and all
+	// MountPoint pointers), but the filesystems might have been filled
+	// or cleaned up.
+
+	foreach ( MountPoint * mountPoint, mountPoints->_mountPointList )
+	    mountPoint->refreshSizeInfo();
+
+	return;
+    }
+
+    mountPoints->clear();
+    mountPoints->ensurePopulated();
 }
 
 
@@ -13,7 +13,9 @@
 #include <QString>
 #include <QStringList>
 #include <QList>
-#include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QByteArray>
 #include <QTextStream>
 
 #if (QT_VERSION < QT_VERSION_CHECK( 5, 4, 0 ))
@@ -127,6 +129,32 @@ namespace QDirStat
          **/
         bool isSnapPackage() const;
 
+	/**
+	 * Return 'true' if this is an overlay filesystem, e.g. the merged view
+	 * of the image layers of a container.
+	 **/
+	bool isOverlay() const;
+
+	/**
+	 * Return the lower directories (the read-only layers) of an overlay
+	 * filesystem from its mount options, the topmost first, or an empty
+	 * list if this is not an overlay filesystem.
+	 **/
+	QStringList overlayLowerDirs() const;
+
+	/**
+	 * Return the upper directory (the writable layer) of an overlay
+	 * filesystem from its mount options or an empty string if there is
+	 * none.
+	 **/
+	QString overlayUpperDir() const;
+
+	/**
+	 * Return all layers of an overlay filesystem: The upper directory (if
+	 * there is one) and the lower directories.
+	 **/
+	QStringList overlayLayers() const;
+
 	/**
 	 * Set the 'duplicate' flag. This should only be set while /proc/mounts
 	 * or /etc/mtab is being read.
@@ -169,6 +197,20 @@ namespace QDirStat
 	 **/
 	FileSize freeSizeForRoot();
 
+	/**
+	 * Fetch the size information again the next time it is needed; the
+	 * filesystem might have been filled or cleaned up in the meantime.
+	 **/
+	void refreshSizeInfo();
+
+	/**
+	 * Number of used inodes of the filesystem of this mount point, i.e.
+	 * roughly the number of files and directories on it. This returns -1
+	 * if the filesystem does not have a fixed number of inodes (e.g.
+	 * Btrfs) or if it can't be queried.
+	 **/
+	FileCount usedInodes() const;
+
 
     protected:
 
@@ -191,6 +233,22 @@ namespace QDirStat
     }; // class MountPoint
 
 
+    /**
+     * One node of the path trie of all mount points: One path component.
+     * Finding the mount point for a path (or the nearest one above it)
+     * only needs one hash lookup for each path component, no matter how
+     * many mount points there are.
+     **/
+    struct MountPointTrieNode
+    {
+	MountPointTrieNode(): mountPoint( 0 ) {}
+	~MountPointTrieNode() { qDeleteAll( children ); }
+
+	QHash<QString, MountPointTrieNode *> children;
+	MountPoint *			     mountPoint; // mounted right here?
+    };
+
+
     /**
      * Singleton class to access the current mount points.
      **/
@@ -249,8 +307,8 @@ namespace QDirStat
 
 	/**
 	 * Ensure the mount points are populated with the content of
-	 * /proc/mounts, falling back to /etc/mtab if /proc/mounts cannot be
-	 * read.
+	 * /proc/self/mountinfo, falling back to /proc/mounts and /etc/mtab if
+	 * that cannot be read.
 	 **/
 	void ensurePopulated();
 
@@ -282,8 +340,11 @@ namespace QDirStat
 	static bool hasSizeInfo();
 
         /**
-         * Clear all information and reload it from disk.
-         * NOTICE: This invalidates ALL MountPoint pointers!
+         * Clear all information and reload it from disk if anything was
+         * mounted or unmounted since it was last read. Otherwise, only the
+         * size information is refreshed.
+         *
+         * NOTICE: This may invalidate ALL MountPoint pointers!
          **/
         static void reload();
 
@@ -306,6 +367,26 @@ namespace QDirStat
 	 **/
 	void init();
 
+	/**
+	 * Read /proc/self/mountinfo and populate the mount points with the
+	 * content. Return 'true' on success, 'false' on failure.
+	 *
+	 * The file stays open so mountTableChanged() can check for changes.
+	 **/
+	bool readMountInfo();
+
+	/**
+	 * Parse one line of /proc/self/mountinfo and add the mount point.
+	 * Return 'false' if the line could not be parsed.
+	 **/
+	bool parseMountInfoLine( const QByteArray & line );
+
+	/**
+	 * Return 'true' if anything was mounted or unmounted since
+	 * /proc/self/mountinfo was last read, or if that cannot be determined.
+	 **/
+	bool mountTableChanged();
+
 	/**
 	 * Read 'filename' (in /proc/mounts or /etc/mnt syntax) and populate
 	 * the mount points with the content. Return 'true' on success, 'false'
@@ -328,10 +409,24 @@ namespace QDirStat
         void postProcess( MountPoint * mountPoint );
 
         /**
-         * Add a mount point to the internal list and map.
+         * Add a mount point to the internal list and trie.
          **/
         void add( MountPoint * mountPoint );
 
+	/**
+	 * Return the mount point for 'path' from the trie. If 'nearest' is
+	 * 'true', return the nearest one upwards in the directory hierarchy
+	 * if there is none exactly at 'path'.
+	 **/
+	MountPoint * findInTrie( const QString & path, bool nearest ) const;
+
+	/**
+	 * Return the real filesystem type for 'fsType' on 'device': "ntfs"
+	 * for an NTFS that is mounted via FUSE ("fuseblk"). Only then
+	 * findNtfsDevices() is called.
+	 **/
+	QString realFsType( const QString & device, const QString & fsType );
+
 
 	/**
 	 * Check if any of the mount points has filesystem type "btrfs".
@@ -356,9 +451,12 @@ namespace QDirStat
 	static MountPoints * _instance;
 
 	QList<MountPoint *>	    _mountPointList;
-	QMap<QString, MountPoint *> _mountPointMap;
+	MountPointTrieNode	    _mountPointTrie;
+	QSet<QString>		    _mountedDevices;
         QStringList                 _ntfsDevices;
+	int			    _mountInfoFd;
 	bool			    _isPopulated;
+	bool			    _checkedNtfsDevices;
 	bool			    _checkedForBtrfs;
 	bool			    _hasBtrfs;
         bool                        _hasNtfs;
@@ -0,0 +1,165 @@
+/*
+ *   File name: MpscRing.h
+ *   Summary:	Lock-free multi-producer single-consumer ring buffer
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef MpscRing_h
+#define MpscRing_h
+
+
+#include <QAtomicInt>
+
+
+namespace QDirStat
+{
+    /**
+     * Bounded lock-free ring buffer for handing small records from any
+     * number of worker threads (producers) to one consumer thread
+     * (typically the GUI thread).
+     *
+     * Each slot has a sequence number that tells if it is free for the
+     * producer with a given position or if it contains a record for the
+     * consumer. A producer claims a position with one atomic compare and
+     * swap and publishes the record by advancing the slot's sequence
+     * number; there is no mutex and no heap allocation per record.
+     *
+     * T should be a small plain data type; it is copied into the slot.
+     *
+     * The buffer does not grow: push() returns 'false' if it is full. The
+     * caller needs a fallback for that case (which should be rare with a
+     * sensible capacity), e.g. a list that is protected by a mutex.
+     **/
+    template<typename T>
+    class MpscRing
+    {
+    public:
+
+	/**
+	 * Constructor. 'capacity' is rounded up to the next power of 2.
+	 **/
+	MpscRing( int capacity = 4096 ):
+	    _tail( 0 )
+	{
+	    int size = 2;
+
+	    while ( size < capacity )
+		size *= 2;
+
+	    _mask  = size - 1;
+	    _slots = new Slot[ size ];
+
+	    for ( int i = 0; i < size; ++i )
+		_slots[ i ].seq.storeRelease( i );
+
+	    _head.storeRelease( 0 );
+	}
+
+	/**
+	 * Destructor. Any records that are still in the buffer are
+	 * discarded; if they own anything, the consumer needs to pop() them
+	 * first.
+	 **/
+	~MpscRing() { delete[] _slots; }
+
+	/**
+	 * Add a record. Return 'false' if the buffer is full.
+	 *
+	 * This can be called from any thread.
+	 **/
+	bool push( const T & value )
+	{
+	    int pos = _head.loadAcquire();
+
+	    while ( true )
+	    {
+		Slot & slot = _slots[ pos & _mask ];
+		int diff = distance( slot.seq.loadAcquire(), pos );
+
+		if ( diff == 0 ) // Slot is free for this position
+		{
+		    if ( _head.testAndSetOrdered( pos, next( pos ) ) )
+		    {
+			slot.value = value;
+			slot.seq.storeRelease( next( pos ) ); // Publish it
+			return true;
+		    }
+
+		    // Another producer was faster; try the next position
+		}
+		else if ( diff < 0 ) // The consumer did not get to this slot yet
+		{
+		    return false;
+		}
+
+		pos = _head.loadAcquire();
+	    }
+	}
+
+	/**
+	 * Take the next record and store it in 'value'. Return 'false' if
+	 * there is none (or if the next one is not completely written yet;
+	 * it will be there with the next call).
+	 *
+	 * This may only be called from the consumer thread.
+	 **/
+	bool pop( T & value )
+	{
+	    Slot & slot = _slots[ _tail & _mask ];
+
+	    if ( distance( slot.seq.loadAcquire(), next( _tail ) ) != 0 )
+		return false;
+
+	    value = slot.value;
+	    slot.seq.storeRelease( (int) ( (unsigned) _tail + _mask + 1 ) ); // Free for the next round
+	    _tail = next( _tail );
+
+	    return true;
+	}
+
+	/**
+	 * Return the number of slots.
+	 **/
+	int capacity() const { return _mask + 1; }
+
+
+    protected:
+
+	struct Slot
+	{
+	    QAtomicInt seq;
+	    T	       value;
+	};
+
+	/**
+	 * Return the next position after 'pos'. Positions wrap around after
+	 * 2^32 records; all comparisons are done with distance().
+	 **/
+	static int next( int pos )
+	    { return (int) ( (unsigned) pos + 1 ); }
+
+	/**
+	 * Return the signed distance from 'b' to 'a' with wraparound.
+	 **/
+	static int distance( int a, int b )
+	    { return (int) ( (unsigned) a - (unsigned) b ); }
+
+	// Disable copying
+	MpscRing( const MpscRing & );
+	MpscRing & operator=( const MpscRing & );
+
+
+	Slot *	   _slots;
+	int	   _mask;
+	QAtomicInt _head;	// next position for a producer
+	int	   _tail;	// next position for the consumer; consumer only
+
+    };	// class MpscRing
+
+}	// namespace QDirStat
+
+
+#endif // ifndef MpscRing_h
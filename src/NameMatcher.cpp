@@ -0,0 +1,264 @@
+/*
+ *   File name: NameMatcher.cpp
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// memchr(), memcmp(), memcpy()
+
+#include "NameMatcher.h"
+
+
+#define NON_ASCII_BITS	Q_UINT64_C( 0x8080808080808080 )
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * Return ASCII character 'c' in lowercase.
+     **/
+    inline char foldCase( char c )
+    {
+	return ( c >= 'A' && c <= 'Z' ) ? c - 'A' + 'a' : c;
+    }
+
+
+    /**
+     * Return the next position of 'c' after 'pos' before 'end' or 0 if
+     * there is none.
+     **/
+    inline const char * nextPos( const char * pos, char c, const char * end )
+    {
+	return pos + 1 < end ? (const char *) memchr( pos + 1, c, end - pos - 1 ) : 0;
+    }
+}
+
+
+NameMatcher::NameMatcher():
+    _matchType( None ),
+    _caseSensitive( false ),
+    _anyChar( false )
+{
+    // NOP
+}
+
+
+void NameMatcher::compile( const QString & pattern,
+			   MatchType	   matchType,
+			   bool		   caseSensitive )
+{
+    _matchType	   = None;
+    _caseSensitive = caseSensitive;
+    _anyChar	   = false;
+    _parts.clear();
+
+    QByteArray utf8 = pattern.toUtf8();
+
+    if ( ! caseSensitive )
+    {
+	// Unicode case folding is more than ASCII case folding
+	// (e.g. the Kelvin sign folds to 'k'), so leave that to QString.
+
+	if ( ! isAscii( utf8.constData(), utf8.size() ) )
+	    return;
+
+	utf8 = utf8.toLower();
+    }
+
+    if ( matchType == Wildcard )
+    {
+	// Bracket expressions are left to QRegExp
+
+	if ( utf8.contains( '[' ) || utf8.contains( ']' ) || utf8.contains( '\\' ) )
+	    return;
+
+	_anyChar = utf8.contains( '?' );
+	_parts	 = utf8.split( '*' );
+    }
+
+    _pattern   = utf8;
+    _matchType = matchType;
+}
+
+
+NameMatcher::Result NameMatcher::match( const char * bytes, int len ) const
+{
+    if ( _matchType == None )
+	return Undecided;
+
+    // ASCII case folding only works for ASCII names, and '?' has to match
+    // exactly one byte.
+
+    if ( ( ! _caseSensitive || _anyChar ) && ! isAscii( bytes, len ) )
+	return Undecided;
+
+    bool match = false;
+
+    switch ( _matchType )
+    {
+	case Contains:
+	    match = find( bytes, len, 0, _pattern ) >= 0;
+	    break;
+
+	case StartsWith:
+	    match = len >= _pattern.size() && matchesAt( bytes, _pattern );
+	    break;
+
+	case ExactMatch:
+	    match = len == _pattern.size() && matchesAt( bytes, _pattern );
+	    break;
+
+	case Wildcard:
+	    match = matchWildcard( bytes, len );
+	    break;
+
+	case None:
+	    return Undecided;
+    }
+
+    return match ? Match : NoMatch;
+}
+
+
+bool NameMatcher::isAscii( const char * bytes, int len )
+{
+    int i = 0;
+
+    for ( ; i + 8 <= len; i += 8 )
+    {
+	quint64 word;
+	memcpy( &word, bytes + i, sizeof( word ) );
+
+	if ( word & NON_ASCII_BITS )
+	    return false;
+    }
+
+    for ( ; i < len; ++i )
+    {
+	if ( bytes[ i ] & 0x80 )
+	    return false;
+    }
+
+    return true;
+}
+
+
+bool NameMatcher::matchesAt( const char * bytes, const QByteArray & part ) const
+{
+    const char * pattern = part.constData();
+    int		 len	 = part.size();
+
+    if ( _caseSensitive && ! _anyChar )
+	return memcmp( bytes, pattern, len ) == 0;
+
+    for ( int i = 0; i < len; ++i )
+    {
+	if ( _anyChar && pattern[ i ] == '?' )
+	    continue;
+
+	char c = _caseSensitive ? bytes[ i ] : foldCase( bytes[ i ] );
+
+	if ( c != pattern[ i ] )
+	    return false;
+    }
+
+    return true;
+}
+
+
+int NameMatcher::find( const char * bytes, int len, int from, const QByteArray & part ) const
+{
+    if ( part.isEmpty() )
+	return from <= len ? from : -1;
+
+    if ( from + part.size() > len )
+	return -1;
+
+    // Candidates must start before 'end'
+
+    const char * end   = bytes + len - part.size() + 1;
+    char	 first = part.at( 0 );
+
+    if ( _anyChar && first == '?' )
+    {
+	for ( const char * pos = bytes + from; pos < end; ++pos )
+	{
+	    if ( matchesAt( pos, part ) )
+		return pos - bytes;
+	}
+
+	return -1;
+    }
+
+    // Case-insensitive: Look for the first byte in both cases and check
+    // the candidates in ascending order
+
+    char other = ( ! _caseSensitive && first >= 'a' && first <= 'z' ) ?
+	first - 'a' + 'A' : first;
+
+    const char * pos	  = (const char *) memchr( bytes + from, first, end - bytes - from );
+    const char * otherPos = other == first ?
+	0 : (const char *) memchr( bytes + from, other, end - bytes - from );
+
+    while ( pos || otherPos )
+    {
+	bool useOther = otherPos && ( ! pos || otherPos < pos );
+	const char * candidate = useOther ? otherPos : pos;
+
+	if ( matchesAt( candidate, part ) )
+	    return candidate - bytes;
+
+	if ( useOther )
+	    otherPos = nextPos( otherPos, other, end );
+	else
+	    pos = nextPos( pos, first, end );
+    }
+
+    return -1;
+}
+
+
+bool NameMatcher::matchWildcard( const char * bytes, int len ) const
+{
+    const QByteArray & firstPart = _parts.first();
+
+    if ( _parts.size() == 1 )	// No '*'
+	return len == firstPart.size() && matchesAt( bytes, firstPart );
+
+    // The first part has to be at the start and the last one at the end;
+    // the ones in between are found from left to right. The leftmost
+    // match of each one leaves the most room for the following ones.
+
+    const QByteArray & lastPart = _parts.last();
+
+    if ( len < firstPart.size() + lastPart.size() )
+	return false;
+
+    if ( ! matchesAt( bytes, firstPart ) ||
+	 ! matchesAt( bytes + len - lastPart.size(), lastPart ) )
+    {
+	return false;
+    }
+
+    int pos = firstPart.size();
+    int end = len - lastPart.size();
+
+    for ( int i = 1; i < _parts.size() - 1; ++i )
+    {
+	const QByteArray & part = _parts.at( i );
+	int found = find( bytes, end, pos, part );
+
+	if ( found < 0 )
+	    return false;
+
+	pos = found + part.size();
+    }
+
+    return true;
+}
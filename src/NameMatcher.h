@@ -0,0 +1,123 @@
+/*
+ *   File name: NameMatcher.h
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+#ifndef NameMatcher_h
+#define NameMatcher_h
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+
+namespace QDirStat
+{
+    /**
+     * Fast matching of a fixed string or a simple wildcard pattern against
+     * names in UTF-8 as they are stored in the tree (see CompactName),
+     * without converting each name to a QString first and without
+     * QRegExp.
+     *
+     * For a fixed string, memchr() (which uses SIMD instructions in any
+     * modern C library) finds the candidate positions for the first byte
+     * of the pattern, and only those are compared with the rest. A
+     * wildcard pattern with only '*' and '?' is split into the fixed parts
+     * between the '*' wildcards; they are searched one after the other
+     * from left to right. Anything else, e.g. bracket expressions, is left
+     * to QRegExp.
+     *
+     * Case-insensitive matching only folds ASCII letters; so it is only
+     * used for ASCII patterns and ASCII names. For anything else, and for
+     * '?' in names with multi-byte characters, match() returns Undecided,
+     * and the caller has to use the slow path with QString. The check for
+     * non-ASCII bytes handles 8 bytes at a time.
+     **/
+    class NameMatcher
+    {
+    public:
+
+	enum MatchType
+	{
+	    None,	// Not compiled or not supported: always Undecided
+	    Contains,
+	    StartsWith,
+	    ExactMatch,
+	    Wildcard	// Complete name with '*' and '?'
+	};
+
+	enum Result
+	{
+	    NoMatch,
+	    Match,
+	    Undecided
+	};
+
+	/**
+	 * Constructor: Create a matcher that does not match anything
+	 * itself, i.e. with type None.
+	 **/
+	NameMatcher();
+
+	/**
+	 * Set up the matcher for 'pattern' with 'matchType'. If that is not
+	 * supported, the type becomes None.
+	 **/
+	void compile( const QString & pattern,
+		      MatchType	      matchType,
+		      bool	      caseSensitive );
+
+	/**
+	 * Return the type this matcher was set up for; None if it is not
+	 * usable.
+	 **/
+	MatchType matchType() const { return _matchType; }
+
+	/**
+	 * Match the name with 'len' bytes 'bytes' in UTF-8 (not necessarily
+	 * 0-terminated).
+	 **/
+	Result match( const char * bytes, int len ) const;
+
+	/**
+	 * Return 'true' if the 'len' bytes 'bytes' are all ASCII.
+	 **/
+	static bool isAscii( const char * bytes, int len );
+
+
+    protected:
+
+	/**
+	 * Return 'true' if 'part' matches 'bytes' at the start.
+	 * 'bytes' must have at least the length of 'part'.
+	 **/
+	bool matchesAt( const char * bytes, const QByteArray & part ) const;
+
+	/**
+	 * Return the first position from 'from' on where 'part' matches
+	 * 'bytes' with length 'len', or -1 if there is none.
+	 **/
+	int find( const char * bytes, int len, int from, const QByteArray & part ) const;
+
+	/**
+	 * Match the wildcard pattern against the complete name.
+	 **/
+	bool matchWildcard( const char * bytes, int len ) const;
+
+
+	// Data members
+
+	MatchType		_matchType;
+	bool			_caseSensitive;
+	bool			_anyChar;	// '?' in the pattern
+	QByteArray		_pattern;	// lowercase if case-insensitive
+	QList<QByteArray>	_parts;		// Wildcard: between the '*'s
+
+    };	// class NameMatcher
+
+}	// namespace QDirStat
+
+#endif	// NameMatcher_h
@@ -0,0 +1,199 @@
+/*
+ *   File name: NodeArena.cpp
+ *   Summary:	Memory management for DirTree nodes
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stdlib.h>	// posix_memalign(), free()
+#include <string.h>	// memset()
+
+#include <new>		// std::bad_alloc
+
+#include "NodeArena.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+
+// Offset of the first slot in a chunk: The chunk header, rounded up to the
+// size class granularity so all slots are properly aligned.
+
+#define CHUNK_HEADER_SIZE	( ( ( sizeof( Chunk ) + NODE_ARENA_GRANULARITY - 1 ) \
+				    / NODE_ARENA_GRANULARITY ) * NODE_ARENA_GRANULARITY )
+
+using namespace QDirStat;
+
+
+NodeArena * NodeArena::instance()
+{
+    static NodeArena * arena = 0;
+
+    // Intentionally never deleted: Nodes might still be deleted very late
+    // during program shutdown, and there is no point in releasing the memory
+    // explicitly just before the process ends anyway.
+
+    if ( ! arena )
+	arena = new NodeArena();
+
+    return arena;
+}
+
+
+NodeArena::NodeArena():
+    _chunkCount( 0 ),
+    _liveCount( 0 )
+{
+    memset( _available, 0, sizeof( _available ) );
+}
+
+
+void * NodeArena::allocate( size_t size )
+{
+    if ( size > NODE_ARENA_MAX_SIZE )
+	return ::operator new( size );
+
+    int	    cls	  = sizeClass( size );
+    Chunk * chunk = _available[ cls ];
+
+    if ( ! chunk )
+	chunk = newChunk( cls );
+
+    void * ptr;
+
+    if ( chunk->freeList )
+    {
+	ptr = chunk->freeList;
+	chunk->freeList = *( (void **) ptr );
+    }
+    else
+    {
+	ptr = chunk->bump;
+	chunk->bump += chunk->slotSize;
+    }
+
+    chunk->live++;
+    _liveCount++;
+
+    if ( ! chunk->freeList && chunk->bump + chunk->slotSize > chunk->end )
+	unlinkAvailable( chunk ); // chunk is full
+
+    return ptr;
+}
+
+
+void NodeArena::deallocate( void * ptr, size_t size )
+{
+    if ( ! ptr )
+	return;
+
+    if ( size > NODE_ARENA_MAX_SIZE )
+    {
+	::operator delete( ptr );
+	return;
+    }
+
+    Chunk * chunk = chunkOf( ptr );
+
+    *( (void **) ptr ) = chunk->freeList;
+    chunk->freeList = ptr;
+    chunk->live--;
+    _liveCount--;
+
+    if ( chunk->live == 0 )
+    {
+	if ( chunk->available && ! chunk->prev && ! chunk->next )
+	{
+	    // This is the only chunk left for this size class. Keep it to
+	    // avoid getting a new one from the system right away and releasing
+	    // it again when single objects are created and deleted
+	    // repeatedly, but start over with a clean one.
+
+	    chunk->bump	    = ( (char *) chunk ) + CHUNK_HEADER_SIZE;
+	    chunk->freeList = 0;
+	}
+	else
+	{
+	    releaseChunk( chunk );
+	}
+    }
+    else if ( ! chunk->available )
+    {
+	linkAvailable( chunk );
+    }
+}
+
+
+NodeArena::Chunk * NodeArena::newChunk( int cls )
+{
+    void * mem = 0;
+
+    if ( posix_memalign( &mem, NODE_ARENA_CHUNK_SIZE, NODE_ARENA_CHUNK_SIZE ) != 0 || ! mem )
+	throw std::bad_alloc();
+
+    Chunk * chunk     = (Chunk *) mem;
+    chunk->prev	      = 0;
+    chunk->next	      = 0;
+    chunk->bump	      = ( (char *) mem ) + CHUNK_HEADER_SIZE;
+    chunk->end	      = ( (char *) mem ) + NODE_ARENA_CHUNK_SIZE;
+    chunk->freeList   = 0;
+    chunk->slotSize   = cls * NODE_ARENA_GRANULARITY;
+    chunk->sizeClass  = cls;
+    chunk->live	      = 0;
+    chunk->available  = false;
+
+    _chunkCount++;
+    linkAvailable( chunk );
+
+    return chunk;
+}
+
+
+void NodeArena::releaseChunk( Chunk * chunk )
+{
+    if ( chunk->available )
+	unlinkAvailable( chunk );
+
+    _chunkCount--;
+    free( chunk );
+}
+
+
+void NodeArena::linkAvailable( Chunk * chunk )
+{
+    Chunk * head = _available[ chunk->sizeClass ];
+
+    chunk->prev = 0;
+    chunk->next = head;
+
+    if ( head )
+	head->prev = chunk;
+
+    _available[ chunk->sizeClass ] = chunk;
+    chunk->available = true;
+}
+
+
+void NodeArena::unlinkAvailable( Chunk * chunk )
+{
+    if ( chunk->prev )
+	chunk->prev->next = chunk->next;
+    else
+	_available[ chunk->sizeClass ] = chunk->next;
+
+    if ( chunk->next )
+	chunk->next->prev = chunk->prev;
+
+    chunk->prev	     = 0;
+    chunk->next	     = 0;
+    chunk->available = false;
+}
+
+
+void NodeArena::logStats() const
+{
+    logDebug() << "Node arena: " << _liveCount << " nodes in "
+	       << _chunkCount << " chunks ("
+	       << formatSize( (FileSize) bytesReserved() ) << ")"
+	       << endl;
+}
@@ -0,0 +1,170 @@
+/*
+ *   File name: NodeArena.h
+ *   Summary:	Memory management for DirTree nodes
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef NodeArena_h
+#define NodeArena_h
+
+
+#include <stddef.h>	// size_t
+
+
+// Size of one chunk of memory to get from the system at once.
+// This needs to be a power of 2: Chunks are aligned to their size so the
+// chunk an object belongs to can be found with simple pointer arithmetic.
+
+#define NODE_ARENA_CHUNK_SIZE	( 256 * 1024 )
+
+// Granularity of the size classes
+
+#define NODE_ARENA_GRANULARITY	16
+
+// Objects larger than this are not handled by the arena, but with the normal
+// ::operator new() and ::operator delete()
+
+#define NODE_ARENA_MAX_SIZE	512
+
+
+namespace QDirStat
+{
+    /**
+     * Slab allocator for FileInfo, DirInfo and the other DirTree nodes.
+     *
+     * A DirTree easily has millions of nodes, and allocating each one of them
+     * separately from the general-purpose heap means a lot of overhead and a
+     * lot of fragmentation. Worse, deleting a large tree means millions of
+     * free() calls that have to do all their housekeeping for each one.
+     *
+     * This allocator gets large chunks from the system and hands out
+     * fixed-size slots from them with simple pointer bumping. Each chunk only
+     * contains objects of one size class. Freed slots go to a free list of
+     * their chunk, and when the last object in a chunk is freed, the whole
+     * chunk is returned to the system at once. So after DirTree::clear(),
+     * practically all memory is released, not kept in a fragmented heap.
+     *
+     * FileInfo hooks this in with its class-specific operator new() and
+     * operator delete(), so it is completely transparent for all code that
+     * creates or deletes tree nodes.
+     *
+     * This is not thread-safe; all tree nodes are created and deleted in the
+     * GUI thread.
+     **/
+    class NodeArena
+    {
+    public:
+
+	/**
+	 * Return the singleton for this class.
+	 **/
+	static NodeArena * instance();
+
+	/**
+	 * Allocate memory for an object of 'size' bytes.
+	 * This throws std::bad_alloc if there is not enough memory.
+	 **/
+	void * allocate( size_t size );
+
+	/**
+	 * Release the memory of an object of 'size' bytes that was allocated
+	 * with allocate().
+	 **/
+	void deallocate( void * ptr, size_t size );
+
+	/**
+	 * Return the number of chunks that are currently in use.
+	 **/
+	int chunkCount() const { return _chunkCount; }
+
+	/**
+	 * Return the number of objects that are currently allocated.
+	 **/
+	long liveCount() const { return _liveCount; }
+
+	/**
+	 * Return the total number of bytes currently held by the arena.
+	 **/
+	size_t bytesReserved() const
+	    { return (size_t) _chunkCount * NODE_ARENA_CHUNK_SIZE; }
+
+	/**
+	 * Write some statistics to the log.
+	 **/
+	void logStats() const;
+
+
+    protected:
+
+	/**
+	 * Header of a chunk. This is at the start of each chunk, the slots
+	 * follow directly after it.
+	 **/
+	struct Chunk
+	{
+	    Chunk * prev;	// previous chunk with free slots (same size class)
+	    Chunk * next;	// next chunk with free slots (same size class)
+	    char  * bump;	// next never used slot
+	    char  * end;	// end of this chunk
+	    void  * freeList;	// slots that were freed
+	    size_t  slotSize;
+	    int	    sizeClass;
+	    int	    live;	// number of allocated slots
+	    bool    available;	// in the list of chunks with free slots?
+	};
+
+	/**
+	 * Constructor. Use instance() instead.
+	 **/
+	NodeArena();
+
+	/**
+	 * Return the size class for 'size' bytes.
+	 **/
+	static int sizeClass( size_t size )
+	    { return ( size + NODE_ARENA_GRANULARITY - 1 ) / NODE_ARENA_GRANULARITY; }
+
+	/**
+	 * Return the chunk that 'ptr' was allocated from.
+	 **/
+	static Chunk * chunkOf( void * ptr )
+	    { return (Chunk *) ( (size_t) ptr & ~( (size_t) NODE_ARENA_CHUNK_SIZE - 1 ) ); }
+
+	/**
+	 * Get a new chunk from the system for 'sizeClass'.
+	 **/
+	Chunk * newChunk( int sizeClass );
+
+	/**
+	 * Return a chunk to the system.
+	 **/
+	void releaseChunk( Chunk * chunk );
+
+	/**
+	 * Add 'chunk' to the list of chunks with free slots.
+	 **/
+	void linkAvailable( Chunk * chunk );
+
+	/**
+	 * Remove 'chunk' from the list of chunks with free slots.
+	 **/
+	void unlinkAvailable( Chunk * chunk );
+
+
+	//
+	// Data members
+	//
+
+	Chunk * _available[ NODE_ARENA_MAX_SIZE / NODE_ARENA_GRANULARITY + 1 ];
+	int	_chunkCount;
+	long	_liveCount;
+
+    };	// class NodeArena
+
+}	// namespace QDirStat
+
+
+#endif // ifndef NodeArena_h
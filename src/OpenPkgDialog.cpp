@@ -10,6 +10,7 @@
 #include "Qt4Compat.h"
 
 #include "OpenPkgDialog.h"
+#include "PkgQuery.h"
 #include "Logger.h"
 #include "Exception.h"
 
@@ -19,7 +20,8 @@ using namespace QDirStat;
 
 OpenPkgDialog::OpenPkgDialog( QWidget * parent ):
     QDialog( parent ),
-    _ui( new Ui::OpenPkgDialog )
+    _ui( new Ui::OpenPkgDialog ),
+    _havePkgIndex( false )
 {
     // logDebug() << "init" << endl;
 
@@ -27,6 +29,15 @@ OpenPkgDialog::OpenPkgDialog( QWidget * parent ):
     _ui->setupUi( this );
     qEnableClearButton( _ui->pkgPatternField );
     _ui->pkgPatternField->setFocus();
+
+    connect( _ui->pkgPatternField,    SIGNAL( textChanged      ( QString ) ),
+	     this,		      SLOT  ( updateMatchCount()	   ) );
+
+    connect( _ui->filterModeComboBox, SIGNAL( currentIndexChanged( int ) ),
+	     this,		      SLOT  ( updateMatchCount()	   ) );
+
+    connect( _ui->allPkgRadioButton,  SIGNAL( toggled	       ( bool ) ),
+	     this,		      SLOT  ( updateMatchCount()	   ) );
 }
 
 
@@ -55,6 +66,24 @@ PkgFilter OpenPkgDialog::pkgFilter()
 }
 
 
+void OpenPkgDialog::updateMatchCount()
+{
+    if ( ! _havePkgIndex )
+    {
+	// Get the installed packages only once; after that, each keystroke
+	// only needs a lookup in the index.
+
+	PkgInfoList pkgList = PkgQuery::installedPkg();
+	_pkgIndex.build( pkgList );
+	qDeleteAll( pkgList );
+	_havePkgIndex = true;
+    }
+
+    int count = _pkgIndex.matchingPkgCount( pkgFilter() );
+    _ui->matchCountLabel->setText( tr( "%1 matching packages" ).arg( count ) );
+}
+
+
 PkgFilter OpenPkgDialog::askPkgFilter( bool    * canceled_ret,
                                        QWidget * parent )
 {
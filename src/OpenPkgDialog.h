@@ -14,6 +14,7 @@
 
 #include "ui_open-pkg-dialog.h"
 #include "PkgFilter.h"
+#include "PkgNameIndex.h"
 
 
 namespace QDirStat
@@ -54,9 +55,18 @@ namespace QDirStat
 	 **/
 	PkgFilter pkgFilter();
 
+    protected slots:
+
+	/**
+	 * Show how many installed packages match the current filter.
+	 **/
+	void updateMatchCount();
+
     protected:
 
 	Ui::OpenPkgDialog * _ui;
+	PkgNameIndex	    _pkgIndex;
+	bool		    _havePkgIndex;
 
     };	// class OpenPkgDialog
 
@@ -9,9 +9,11 @@
 
 #include <QApplication>
 #include <QCloseEvent>
+#include <QTextDocument>
 #include <QTimer>
 
 #include "OutputWindow.h"
+#include "ProcessStarter.h"
 #include "Settings.h"
 #include "SettingsHelpers.h"
 #include "Logger.h"
@@ -21,28 +23,57 @@ using QDirStat::readColorEntry;
 using QDirStat::writeColorEntry;
 using QDirStat::readFontEntry;
 using QDirStat::writeFontEntry;
+using QDirStat::ProcessStarter;
 
 
 #define CONNECT_ACTION(ACTION, RECEIVER, RCVR_SLOT) \
     connect( (ACTION), SIGNAL( triggered() ), (RECEIVER), SLOT( RCVR_SLOT ) )
 
+// Interval for adding the collected output to the output area
+#define OUTPUT_FLUSH_INTERVAL_MILLISEC	100
+
 
 OutputWindow::OutputWindow( QWidget * parent ):
     QDialog( parent ),
     _ui( new Ui::OutputWindow ),
+    _processStarter( 0 ),
+    _maxParallelProcesses( 0 ),
     _showOnStderr( true ),
     _noMoreProcesses( false ),
     _closed( false ),
     _killedAll( false ),
-    _errorCount( 0 )
+    _errorCount( 0 ),
+    _maxLines( 0 ),
+    _pendingLines( 0 ),
+    _droppedLines( 0 )
 {
     _ui->setupUi( this );
     logDebug() << "Creating" << endl;
     readSettings();
 
     _ui->terminal->clear();
+    _ui->terminal->setUndoRedoEnabled( false );
+
+    // The document drops its first blocks (lines) when there are more
+
+    _ui->terminal->document()->setMaximumBlockCount( _maxLines );
     setAutoClose( false );
 
+    _flushTimer.setSingleShot( true );
+    _flushTimer.setInterval( OUTPUT_FLUSH_INTERVAL_MILLISEC );
+
+    connect( &_flushTimer, SIGNAL( timeout()	 ),
+	     this,	   SLOT	 ( flushOutput() ) );
+
+    _processStarter = new ProcessStarter( this );
+    CHECK_NEW( _processStarter );
+    _processStarter->setMaxParallel( _maxParallelProcesses );
+
+    connect( _processStarter, SIGNAL( startingProcess( Process * ) ),
+	     this,	      SLOT  ( processStarting( Process * ) ) );
+
+    _processStarter->start();
+
     CONNECT_ACTION( _ui->actionZoomIn,	    this, zoomIn()    );
     CONNECT_ACTION( _ui->actionZoomOut,	    this, zoomOut()   );
     CONNECT_ACTION( _ui->actionResetZoom,   this, resetZoom() );
@@ -81,6 +112,8 @@ void OutputWindow::addProcess( Process * process )
                   << "no longer accepting new processes" << endl;
 	process->kill();
 	process->deleteLater();
+
+	return;
     }
 
     _processList << process;
@@ -98,8 +131,14 @@ void OutputWindow::addProcess( Process * process )
     connect( process, SIGNAL( finished	     ( int, QProcess::ExitStatus ) ),
 	     this,    SLOT  ( processFinished( int, QProcess::ExitStatus ) ) );
 
-    if ( ! hasActiveProcess() )
-	startNextProcess();
+    _processStarter->add( process );
+    updateActions();
+}
+
+
+void OutputWindow::setMaxParallel( int maxParallel )
+{
+    _processStarter->setMaxParallel( maxParallel );
 }
 
 
@@ -136,18 +175,88 @@ void OutputWindow::addText( const QString & rawText, const QColor & textColor )
     if ( ! text.endsWith( "\n" ) )
 	text += "\n";
 
-    _ui->terminal->moveCursor( QTextCursor::End );
-    QTextCursor cursor( _ui->terminal->textCursor() );
+    int lines = text.count( '\n' );
+
+    if ( ! _pendingOutput.isEmpty() && _pendingOutput.last().color == textColor )
+    {
+	// Merge with the previous chunk: The typical case is a lot of
+	// stdout output from one process
 
-    QTextCharFormat format;
-    format.setForeground( QBrush( textColor ) );
-    cursor.setCharFormat( format );
-    cursor.insertText( text );
+	_pendingOutput.last().text  += text;
+	_pendingOutput.last().lines += lines;
+    }
+    else
+    {
+	PendingOutput output;
+	output.text  = text;
+	output.color = textColor;
+	output.lines = lines;
+	_pendingOutput << output;
+    }
+
+    _pendingLines += lines;
+    trimPendingOutput();
+
+    if ( ! _flushTimer.isActive() )
+	_flushTimer.start();
+}
+
+
+void OutputWindow::trimPendingOutput()
+{
+    if ( _maxLines <= 0 )
+	return;
+
+    while ( _pendingOutput.size() > 1 &&
+	    _pendingLines - _pendingOutput.first().lines >= _maxLines )
+    {
+	_pendingLines -= _pendingOutput.first().lines;
+	_droppedLines += _pendingOutput.first().lines;
+	_pendingOutput.removeFirst();
+    }
+}
+
+
+void OutputWindow::flushOutput()
+{
+    if ( _pendingOutput.isEmpty() )
+	return;
+
+    QTextCursor cursor( _ui->terminal->document() );
+    cursor.movePosition( QTextCursor::End );
+    cursor.beginEditBlock();
+
+    if ( _droppedLines > 0 )
+    {
+	QTextCharFormat format;
+	format.setForeground( QBrush( _commandTextColor ) );
+	cursor.setCharFormat( format );
+	cursor.insertText( tr( "[%1 lines skipped]" ).arg( _droppedLines ) + "\n" );
+	_droppedLines = 0;
+    }
+
+    foreach ( const PendingOutput & output, _pendingOutput )
+    {
+	QTextCharFormat format;
+	format.setForeground( QBrush( output.color ) );
+	cursor.setCharFormat( format );
+	cursor.insertText( output.text );
+    }
+
+    cursor.endEditBlock();
+
+    _pendingOutput.clear();
+    _pendingLines = 0;
+
+    _ui->terminal->moveCursor( QTextCursor::End );
 }
 
 
 void OutputWindow::clearOutput()
 {
+    _pendingOutput.clear();
+    _pendingLines = 0;
+    _droppedLines = 0;
     _ui->terminal->clear();
 }
 
@@ -237,7 +346,7 @@ void OutputWindow::processFinished( int exitCode, QProcess::ExitStatus exitStatu
 	closeIfDone();
     }
 
-    startNextProcess(); // this also calls updateActions()
+    updateActions();
 }
 
 
@@ -292,7 +401,7 @@ void OutputWindow::processError( QProcess::ProcessError error )
 	process->deleteLater();
     }
 
-    startNextProcess(); // this also calls updateActions()
+    updateActions();
 
     if ( ! _showOnStderr && ! isVisible() )
 	closeIfDone();
@@ -370,6 +479,7 @@ void OutputWindow::resetZoom()
 void OutputWindow::killAll()
 {
     int killCount = 0;
+    _processStarter->clear();	// Don't start any more
 
     foreach ( Process * process, _processList )
     {
@@ -410,42 +520,18 @@ bool OutputWindow::hasActiveProcess() const
 }
 
 
-Process * OutputWindow::pickQueuedProcess()
+void OutputWindow::processStarting( Process * process )
 {
-    foreach ( Process * process, _processList )
-    {
-	if ( process->state() == QProcess::NotRunning )
-	    return process;
-    }
-
-    return 0;
-}
+    QString dir = process->workingDirectory();
 
-
-Process * OutputWindow::startNextProcess()
-{
-    Process * process = pickQueuedProcess();
-
-    if ( process )
+    if ( dir != _lastWorkingDir )
     {
-	QString dir = process->workingDirectory();
-
-	if ( dir != _lastWorkingDir )
-	{
-	    addCommandLine( "cd " + dir );
-	    _lastWorkingDir = dir;
-	}
-
-	addCommandLine( command( process ) );
-	logInfo() << "Starting: " << process << endl;
-
-	process->start();
-	qApp->processEvents(); // Keep GUI responsive
+	addCommandLine( "cd " + dir );
+	_lastWorkingDir = dir;
     }
 
-    updateActions();
-
-    return process;
+    addCommandLine( command( process ) );
+    logInfo() << "Starting: " << process << endl;
 }
 
 
@@ -524,6 +610,8 @@ void OutputWindow::readSettings()
     _stderrColor	 = readColorEntry( settings, "StdErrTextColor"	 , QColor( Qt::red    ) );
     _terminalDefaultFont = readFontEntry ( settings, "TerminalFont"	 , _ui->terminal->font() );
     _defaultShowTimeout	 = settings.value( "DefaultShowTimeoutMillisec", 500 ).toInt();
+    _maxParallelProcesses = settings.value( "MaxParallelProcesses"	 , 0   ).toInt();
+    _maxLines		 = settings.value( "MaxLines"			 , 20000 ).toInt();
 
     settings.endGroup();
 
@@ -544,6 +632,8 @@ void OutputWindow::writeSettings()
     writeColorEntry( settings, "StdErrTextColor"   , _stderrColor	  );
     writeFontEntry ( settings, "TerminalFont"	   , _terminalDefaultFont );
     settings.setValue( "DefaultShowTimeoutMillisec", _defaultShowTimeout  );
+    settings.setValue( "MaxParallelProcesses"	   , _maxParallelProcesses );
+    settings.setValue( "MaxLines"		   , _maxLines		  );
 
     settings.endGroup();
 
@@ -13,6 +13,7 @@
 #include <QList>
 #include <QTextStream>
 #include <QStringList>
+#include <QTimer>
 
 #include "ui_output-window.h"
 #include "Process.h"
@@ -20,6 +21,11 @@
 class QCloseEvent;
 using QDirStat::Process;
 
+namespace QDirStat
+{
+    class ProcessStarter;
+}
+
 
 /**
  * Terminal-like window to watch output of external processes started via
@@ -28,11 +34,21 @@ using QDirStat::Process;
  *
  * This class can watch more than one process: It can watch a sequence of
  * processes, such as QDirStat cleanup actions as they are invoked for each
- * selected item one after another, or even multiple processes running in
- * parallel (which may make the output a bit messy, of course).
+ * selected item, or even multiple processes running in parallel (which may
+ * make the output a bit messy, of course).
+ *
+ * The processes are started with a ProcessStarter: By default, as many run
+ * in parallel as the ProcessStarter finds useful for this machine. The
+ * "MaxParallelProcesses" setting of the "OutputWindow" group limits that;
+ * 1 runs them strictly one after another.
  *
  * If this dialog is created, but now shown, it will (by default) show itself
  * as soon as there is any output on stderr.
+ *
+ * The output is collected and added to the output area in batches from a
+ * timer, so a process with a lot of output does not block the GUI. Only
+ * the last lines are kept (the "MaxLines" setting, 0 for no limit); older
+ * ones are dropped, so the output area does not grow without bounds.
  **/
 class OutputWindow: public QDialog
 {
@@ -53,10 +69,17 @@ public:
     /**
      * Add a process to watch. Ownership of the process is transferred to this
      * object. If the process is not started yet, it will be started as soon as
-     * there is no other one running.
+     * the number of running processes permits it.
      **/
     void addProcess( Process * process );
 
+    /**
+     * Set the maximum number of processes to run in parallel for this
+     * window only, overriding the "MaxParallelProcesses" setting. This is
+     * not written to the settings. 0 means automatic.
+     **/
+    void setMaxParallel( int maxParallel );
+
     /**
      * Tell this dialog that no more processes will be added, so when the last
      * one is finished and the "auto close" checkbox is checked, it may close
@@ -270,6 +293,16 @@ protected slots:
      **/
     void timeoutShow();
 
+    /**
+     * The process starter is about to start 'process'.
+     **/
+    void processStarting( Process * process );
+
+    /**
+     * Add all pending output to the output area.
+     **/
+    void flushOutput();
+
 
 signals:
 
@@ -303,27 +336,21 @@ protected:
 
     /**
      * Add one or more lines of text in text color 'textColor' to the output
-     * area.
+     * area. This only queues the text for the next flushOutput().
      **/
     void addText( const QString & text, const QColor & textColor );
 
     /**
-     * Obtain the process to use from sender(). Return 0 if this is not a
-     * QProcess.
+     * Drop the oldest pending output that would be dropped from the output
+     * area right away anyway.
      **/
-    Process * senderProcess( const char * callingFunctionName ) const;
+    void trimPendingOutput();
 
     /**
-     * Pick the next inactive process that can be started. Return 0 if there is
-     * none.
-     **/
-    Process * pickQueuedProcess();
-
-    /**
-     * Try to start the next inactive process, if there is any. Return that
-     * process or 0 if there is none.
+     * Obtain the process to use from sender(). Return 0 if this is not a
+     * QProcess.
      **/
-    Process * startNextProcess();
+    Process * senderProcess( const char * callingFunctionName ) const;
 
     /**
      * Zoom the terminal font by the specified factor.
@@ -337,6 +364,8 @@ protected:
 
     Ui::OutputWindow  * _ui;
     QList<Process *>	_processList;
+    QDirStat::ProcessStarter * _processStarter;
+    int			_maxParallelProcesses;
     bool		_showOnStderr;
     bool		_noMoreProcesses;
     bool		_closed;
@@ -349,6 +378,22 @@ protected:
     QColor		_stderrColor;
     QFont		_terminalDefaultFont;
     int			_defaultShowTimeout;
+    int			_maxLines;
+
+    /**
+     * Output that is not in the output area yet.
+     **/
+    struct PendingOutput
+    {
+	QString text;
+	QColor	color;
+	int	lines;
+    };
+
+    QList<PendingOutput> _pendingOutput;
+    int			 _pendingLines;
+    int			 _droppedLines;
+    QTimer		 _flushTimer;
 
 };	// class OutputWindow
 
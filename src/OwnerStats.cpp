@@ -0,0 +1,316 @@
+/*
+ *   File name: OwnerStats.cpp
+ *   Summary:	Disk usage by user and group in a DirTree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>	// std::sort()
+
+#include "OwnerStats.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "DotEntry.h"
+#include "Attic.h"
+#include "SpillStore.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * Add 'items' with 'size' and 'allocatedSize' to user 'uid' and group
+     * 'gid' in all of 'tracked'.
+     **/
+    void addUsage( const QVector<OwnerTotals *> & tracked,
+		   uint		uid,
+		   uint		gid,
+		   FileCount	items,
+		   FileSize	size,
+		   FileSize	allocatedSize )
+    {
+	foreach ( OwnerTotals * totals, tracked )
+	{
+	    OwnerUsage & user = totals->users[ uid ];
+	    user.items	       += items;
+	    user.size	       += size;
+	    user.allocatedSize += allocatedSize;
+
+	    OwnerUsage & group = totals->groups[ gid ];
+	    group.items		+= items;
+	    group.size		+= size;
+	    group.allocatedSize += allocatedSize;
+	}
+    }
+
+
+    bool allocatedGreaterThan( const QPair<uint, OwnerUsage> & a,
+			       const QPair<uint, OwnerUsage> & b )
+    {
+	return a.second.allocatedSize > b.second.allocatedSize;
+    }
+}
+
+
+OwnerStats::OwnerStats( DirTree * tree ):
+    _tree( tree ),
+    _dirty( false ),
+    _lastParent( 0 )
+{
+    // NOP
+}
+
+
+OwnerStats::~OwnerStats()
+{
+    clearCounts();
+}
+
+
+void OwnerStats::add( FileInfo * item )
+{
+    if ( _dirty || ! item || item->isPseudoDir() || item == _tree->root() )
+	return;
+
+    if ( item->isDirInfo() )
+    {
+	// A new directory might be one of the first levels itself
+
+	addItem( item, trackedDirs( item->toDirInfo() ) );
+	return;
+    }
+
+    if ( item->parent() != _lastParent )
+    {
+	_lastParent  = item->parent();
+	_lastTracked = trackedDirs( item->parent() );
+    }
+
+    addItem( item, _lastTracked );
+}
+
+
+void OwnerStats::add( DirInfo * parent, const FileInfoList & newChildren )
+{
+    if ( _dirty || newChildren.isEmpty() )
+	return;
+
+    QVector<OwnerTotals *> tracked = trackedDirs( parent );
+
+    foreach ( FileInfo * child, newChildren )
+    {
+	if ( child->isDirInfo() )
+	    add( child );
+	else
+	    addItem( child, tracked );
+    }
+}
+
+
+QVector<OwnerTotals *> OwnerStats::trackedDirs( DirInfo * dir )
+{
+    QVector<OwnerTotals *> tracked;
+    tracked << &_totals;
+
+    // The real directories from 'dir' up to the toplevel
+
+    QVector<DirInfo *> ancestors;
+
+    for ( DirInfo * ancestor = dir; ancestor && ancestor != _tree->root(); ancestor = ancestor->parent() )
+    {
+	if ( ! ancestor->isPseudoDir() )
+	    ancestors << ancestor;
+    }
+
+    // The last one is the toplevel at depth 0
+
+    for ( int i = qMax( 0, ancestors.size() - 1 - OWNER_STATS_DEPTH ); i < ancestors.size(); ++i )
+    {
+	OwnerTotals *& totals = _dirs[ ancestors.at( i ) ];
+
+	if ( ! totals )
+	{
+	    totals = new OwnerTotals();
+	    CHECK_NEW( totals );
+	}
+
+	tracked << totals;
+    }
+
+    return tracked;
+}
+
+
+void OwnerStats::addItem( FileInfo * item, const QVector<OwnerTotals *> & tracked )
+{
+    addUsage( tracked,
+	      item->hasUid() ? (uint) item->uid() : OWNER_UNKNOWN,
+	      item->hasGid() ? (uint) item->gid() : OWNER_UNKNOWN,
+	      1,
+	      item->size(),
+	      item->allocatedSize() );
+}
+
+
+void OwnerStats::addSummary( DirInfo			* dir,
+			     const ChildrenSummary	& summary,
+			     const QVector<OwnerTotals *> & tracked )
+{
+    addUsage( tracked,
+	      dir->hasUid() ? (uint) dir->uid() : OWNER_UNKNOWN,
+	      dir->hasGid() ? (uint) dir->gid() : OWNER_UNKNOWN,
+	      summary.items,
+	      summary.size,
+	      summary.allocatedSize );
+}
+
+
+void OwnerStats::addSubtree( FileInfo *		    item,
+			     QVector<OwnerTotals *> tracked,
+			     bool		    trackLevels,
+			     int		    depth )
+{
+    if ( ! item->isDirInfo() )
+    {
+	addItem( item, tracked );
+	return;
+    }
+
+    DirInfo * dir = item->toDirInfo();
+
+    if ( ! dir->isPseudoDir() )
+    {
+	if ( trackLevels && depth <= OWNER_STATS_DEPTH )
+	{
+	    OwnerTotals * totals = new OwnerTotals();
+	    CHECK_NEW( totals );
+
+	    _dirs.insert( dir, totals );
+	    tracked << totals;
+	}
+
+	addItem( dir, tracked );
+
+	if ( dir->hasFileSummary() )
+	    addSummary( dir, dir->fileSummary().files, tracked );
+
+	++depth;
+    }
+
+    if ( dir->hasSpilledFiles() )
+    {
+	// The spilled files of a dot entry belong to its directory
+
+	DirInfo * owner = dir->isPseudoDir() && dir->parent() ? dir->parent() : dir;
+	addSummary( owner, _tree->spillStore()->summary( dir ), tracked );
+    }
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+	addSubtree( child, tracked, trackLevels, depth );
+
+    if ( dir->dotEntry() )
+	addSubtree( dir->dotEntry(), tracked, trackLevels, depth );
+
+    if ( dir->attic() )
+	addSubtree( dir->attic(), tracked, trackLevels, depth );
+}
+
+
+void OwnerStats::recount()
+{
+    clearCounts();
+    _dirty = false;
+
+    if ( ! _tree->root() )
+	return;
+
+    QVector<OwnerTotals *> tracked;
+    tracked << &_totals;
+
+    for ( FileInfo * toplevel = _tree->root()->firstChild(); toplevel; toplevel = toplevel->next() )
+	addSubtree( toplevel, tracked, true, 0 );
+
+    logDebug() << "Recounted " << _totals.users.size() << " users and "
+	       << _totals.groups.size() << " groups" << endl;
+}
+
+
+void OwnerStats::invalidate()
+{
+    _dirty	 = true;
+    _lastParent	 = 0;
+    _lastTracked.clear();
+}
+
+
+void OwnerStats::clear()
+{
+    clearCounts();
+    _dirty = false;
+}
+
+
+void OwnerStats::clearCounts()
+{
+    qDeleteAll( _dirs );
+    _dirs.clear();
+    _totals	 = OwnerTotals();
+    _lastParent	 = 0;
+    _lastTracked.clear();
+}
+
+
+const OwnerTotals & OwnerStats::totals()
+{
+    if ( _dirty )
+	recount();
+
+    return _totals;
+}
+
+
+OwnerTotals OwnerStats::totals( DirInfo * dir )
+{
+    if ( ! dir || dir == _tree->root() )
+	return totals();
+
+    if ( _dirty )
+	recount();
+
+    OwnerTotals * tracked = dir->isPseudoDir() ? 0 : _dirs.value( dir );
+
+    if ( tracked )
+	return *tracked;
+
+    // Deeper in the tree: Count its subtree now
+
+    OwnerTotals subtree;
+    QVector<OwnerTotals *> subtreeTotals;
+    subtreeTotals << &subtree;
+
+    addSubtree( dir, subtreeTotals, false, 0 );
+
+    return subtree;
+}
+
+
+QList<QPair<uint, OwnerUsage> > OwnerStats::top( const OwnerUsageMap & usage, int count )
+{
+    QList<QPair<uint, OwnerUsage> > owners;
+
+    for ( OwnerUsageMap::const_iterator it = usage.constBegin(); it != usage.constEnd(); ++it )
+	owners << qMakePair( it.key(), it.value() );
+
+    std::sort( owners.begin(), owners.end(), allocatedGreaterThan );
+
+    if ( count > 0 && owners.size() > count )
+	owners = owners.mid( 0, count );
+
+    return owners;
+}
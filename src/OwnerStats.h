@@ -0,0 +1,203 @@
+/*
+ *   File name: OwnerStats.h
+ *   Summary:	Disk usage by user and group in a DirTree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef OwnerStats_h
+#define OwnerStats_h
+
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QVector>
+
+#include "FileInfo.h"
+
+
+// Number of directory levels below the toplevel directory that have their
+// own totals by owner
+
+#define OWNER_STATS_DEPTH	2
+
+// Key for items without a known user or group, e.g. from a cache file
+// without them
+
+#define OWNER_UNKNOWN		( (uint) -1 )
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    struct ChildrenSummary;
+
+
+    /**
+     * Number of items of one user or group and their sizes.
+     **/
+    struct OwnerUsage
+    {
+	OwnerUsage(): items( 0 ), size( 0 ), allocatedSize( 0 ) {}
+
+	FileCount items;
+	FileSize  size;
+	FileSize  allocatedSize;
+    };
+
+    typedef QHash<uint, OwnerUsage> OwnerUsageMap;	// uid or gid -> usage
+
+
+    /**
+     * Usage by user ID and by group ID.
+     **/
+    struct OwnerTotals
+    {
+	OwnerUsageMap users;
+	OwnerUsageMap groups;
+    };
+
+
+    /**
+     * Disk usage by user and by group of a DirTree, for both the complete
+     * tree and each directory of the first OWNER_STATS_DEPTH levels below
+     * the toplevel. This answers "who filled up this filesystem?" without
+     * walking the tree.
+     *
+     * This is updated incrementally as items are added to the tree, no
+     * matter if they are read from disk, from a cache file or from a scan
+     * daemon: DirTree calls add() from its notifications about new
+     * children. Removing items is not tracked; when anything is deleted or
+     * read again, the statistics are only invalidated, and they are
+     * recounted from the tree when they are needed the next time.
+     *
+     * Each item counts with its own size; a directory is just another item
+     * here. Files that don't have a FileInfo (see DirFileSummary and
+     * SpillStore) count for the owner of their directory in a recount.
+     * Entries extrapolated from a sample don't count.
+     **/
+    class OwnerStats
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	OwnerStats( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	~OwnerStats();
+
+	/**
+	 * Add 'item' that was just added to the tree. It may also be a
+	 * temporary FileInfo for a file that is only added to the sums of
+	 * its parent.
+	 **/
+	void add( FileInfo * item );
+
+	/**
+	 * Add 'newChildren' that were just added to 'parent' in one batch.
+	 **/
+	void add( DirInfo * parent, const FileInfoList & newChildren );
+
+	/**
+	 * Notification that items were removed from the tree or will be
+	 * read again: Recount the statistics the next time they are needed.
+	 **/
+	void invalidate();
+
+	/**
+	 * Forget everything, e.g. because the tree is cleared.
+	 **/
+	void clear();
+
+	/**
+	 * Return 'true' if the statistics don't need to be recounted.
+	 **/
+	bool isValid() const { return ! _dirty; }
+
+	/**
+	 * Return the totals of the complete tree.
+	 **/
+	const OwnerTotals & totals();
+
+	/**
+	 * Return the totals of the subtree of 'dir'. This is instant for
+	 * the first levels of the tree; for deeper directories, this walks
+	 * the subtree.
+	 **/
+	OwnerTotals totals( DirInfo * dir );
+
+	/**
+	 * Return the 'count' owners with the largest allocated size in
+	 * 'usage', the largest first. 0 returns all of them.
+	 **/
+	static QList<QPair<uint, OwnerUsage> > top( const OwnerUsageMap & usage,
+						    int count = 0 );
+
+
+    protected:
+
+	/**
+	 * Return the totals of the directories of the first levels that
+	 * 'dir' is in, including 'dir' itself.
+	 **/
+	QVector<OwnerTotals *> trackedDirs( DirInfo * dir );
+
+	/**
+	 * Add 'item' to the tree's totals and to 'tracked'.
+	 **/
+	void addItem( FileInfo * item, const QVector<OwnerTotals *> & tracked );
+
+	/**
+	 * Add the entries of 'dir' in 'summary' that don't have a FileInfo
+	 * to the owner of 'dir' in 'tracked'.
+	 **/
+	void addSummary( DirInfo * dir, const ChildrenSummary & summary,
+			 const QVector<OwnerTotals *> & tracked );
+
+	/**
+	 * Add the items of the subtree of 'item' to 'tracked', creating the
+	 * totals of the first levels on the way if 'trackLevels' is 'true'.
+	 **/
+	void addSubtree( FileInfo * item, QVector<OwnerTotals *> tracked,
+			 bool trackLevels, int depth );
+
+	/**
+	 * Count everything again from the tree.
+	 **/
+	void recount();
+
+	/**
+	 * Delete all totals.
+	 **/
+	void clearCounts();
+
+
+	//
+	// Data members
+	//
+
+	DirTree *			  _tree;
+	OwnerTotals			  _totals;
+	QHash<const DirInfo *, OwnerTotals *> _dirs;
+	bool				  _dirty;
+
+	// The tracked directories of the last parent, since items are
+	// mostly added for the same parent one after the other
+
+	const DirInfo *			  _lastParent;
+	QVector<OwnerTotals *>		  _lastTracked;
+
+    };	// class OwnerStats
+
+}	// namespace QDirStat
+
+
+#endif // ifndef OwnerStats_h
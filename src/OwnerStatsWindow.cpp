@@ -0,0 +1,226 @@
+/*
+ *   File name: OwnerStatsWindow.cpp
+ *   Summary:	QDirStat "Owner Statistics" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <pwd.h>	// getpwuid()
+#include <grp.h>	// getgrgid()
+
+#include "OwnerStatsWindow.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "SettingsHelpers.h"
+#include "HeaderTweaker.h"
+#include "QDirStatApp.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+QPointer<OwnerStatsWindow> OwnerStatsWindow::_sharedInstance = 0;
+
+
+OwnerStatsWindow::OwnerStatsWindow( QWidget * parent ):
+    QDialog( parent ),
+    _ui( new Ui::OwnerStatsWindow )
+{
+    CHECK_NEW( _ui );
+    _ui->setupUi( this );
+    initWidgets();
+    readWindowSettings( this, "OwnerStatsWindow" );
+}
+
+
+OwnerStatsWindow::~OwnerStatsWindow()
+{
+    writeWindowSettings( this, "OwnerStatsWindow" );
+    delete _ui;
+}
+
+
+OwnerStatsWindow * OwnerStatsWindow::sharedInstance()
+{
+    if ( ! _sharedInstance )
+    {
+	_sharedInstance = new OwnerStatsWindow( app()->findMainWindow() );
+	CHECK_NEW( _sharedInstance );
+    }
+
+    return _sharedInstance;
+}
+
+
+void OwnerStatsWindow::populateSharedInstance( FileInfo * subtree )
+{
+    if ( ! subtree )
+	return;
+
+    sharedInstance()->populate( subtree );
+    sharedInstance()->show();
+    sharedInstance()->raise();
+}
+
+
+void OwnerStatsWindow::initWidgets()
+{
+    QFont font = _ui->heading->font();
+    font.setBold( true );
+    _ui->heading->setFont( font );
+
+    QStringList headers;
+
+    headers << tr( "Owner"     )
+	    << tr( "Items"     )
+	    << tr( "Size"      )
+	    << tr( "Allocated" )
+	    << tr( "%"	       );
+
+    _ui->treeWidget->setHeaderLabels( headers );
+    _ui->treeWidget->header()->setStretchLastSection( false );
+
+    QTreeWidgetItem * hItem = _ui->treeWidget->headerItem();
+
+    for ( int col = 0; col < headers.size(); ++col )
+	hItem->setTextAlignment( col, Qt::AlignHCenter );
+
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+
+    connect( _ui->refreshButton, SIGNAL( clicked() ),
+	     this,		 SLOT  ( refresh() ) );
+
+    connect( _ui->groupsButton,	 SIGNAL( toggled( bool ) ),
+	     this,		 SLOT  ( refresh()	 ) );
+}
+
+
+void OwnerStatsWindow::reject()
+{
+    deleteLater();
+}
+
+
+void OwnerStatsWindow::refresh()
+{
+    populate( _subtree() );
+}
+
+
+void OwnerStatsWindow::populate( FileInfo * newSubtree )
+{
+    _ui->treeWidget->clear();
+
+    if ( newSubtree )
+	_subtree = newSubtree;
+
+    FileInfo * subtree = _subtree();
+    DirTree  * tree    = subtree ? subtree->tree() : app()->dirTree();
+
+    if ( ! tree )
+	return;
+
+    OwnerTotals totals;
+
+    if ( subtree && subtree->isDirInfo() )
+	totals = tree->ownerStats()->totals( subtree->toDirInfo() );
+    else
+	totals = tree->ownerStats()->totals();
+
+    bool groups = _ui->groupsButton->isChecked();
+    const OwnerUsageMap & usage = groups ? totals.groups : totals.users;
+
+    _ui->heading->setText( ( groups ? tr( "Disk Usage by Group for %1" ) :
+			     tr( "Disk Usage by User for %1" ) ).arg( _subtree.url() ) );
+
+    FileSize totalAllocated = 0;
+
+    foreach ( const OwnerUsage & owner, usage )
+	totalAllocated += owner.allocatedSize;
+
+    // Don't sort until all items are added
+
+    _ui->treeWidget->setSortingEnabled( false );
+
+    for ( OwnerUsageMap::const_iterator it = usage.constBegin(); it != usage.constEnd(); ++it )
+    {
+	OwnerListItem * item = new OwnerListItem( ownerName( it.key() ), it.value(), totalAllocated );
+	CHECK_NEW( item );
+
+	_ui->treeWidget->addTopLevelItem( item );
+    }
+
+    _ui->treeWidget->setSortingEnabled( true );
+    _ui->treeWidget->sortByColumn( OwnerListAllocatedCol, Qt::DescendingOrder );
+}
+
+
+QString OwnerStatsWindow::ownerName( uint id ) const
+{
+    if ( id == OWNER_UNKNOWN )
+	return tr( "(unknown)" );
+
+    if ( _ui->groupsButton->isChecked() )
+    {
+	struct group * grp = getgrgid( (gid_t) id );
+
+	if ( grp )
+	    return grp->gr_name;
+    }
+    else
+    {
+	struct passwd * pw = getpwuid( (uid_t) id );
+
+	if ( pw )
+	    return pw->pw_name;
+    }
+
+    return QString::number( id );
+}
+
+
+
+
+OwnerListItem::OwnerListItem( const QString    & name,
+			      const OwnerUsage & usage,
+			      FileSize		 totalAllocated ):
+    QTreeWidgetItem( QTreeWidgetItem::UserType ),
+    _usage( usage )
+{
+    float percent = totalAllocated > 0 ?
+	100.0 * _usage.allocatedSize / totalAllocated : 0.0;
+
+    setText( OwnerListNameCol,	    name + " " );
+    setText( OwnerListItemsCol,	    QString::number( _usage.items ) + " " );
+    setText( OwnerListSizeCol,	    formatSize( _usage.size ) + " " );
+    setText( OwnerListAllocatedCol, formatSize( _usage.allocatedSize ) + " " );
+    setText( OwnerListPercentCol,   formatPercent( percent ) + " " );
+
+    for ( int col = OwnerListItemsCol; col < OwnerListColumnCount; ++col )
+	setTextAlignment( col, Qt::AlignRight );
+}
+
+
+bool OwnerListItem::operator<( const QTreeWidgetItem & rawOther ) const
+{
+    // Since this is a reference, the dynamic_cast will throw a std::bad_cast
+    // exception if it fails. Not catching this here since this is a genuine
+    // error which should not be silently ignored.
+    const OwnerListItem & other = dynamic_cast<const OwnerListItem &>( rawOther );
+
+    int col = treeWidget() ? treeWidget()->sortColumn() : OwnerListAllocatedCol;
+
+    switch ( col )
+    {
+	case OwnerListItemsCol:		return _usage.items < other.usage().items;
+	case OwnerListSizeCol:		return _usage.size  < other.usage().size;
+	case OwnerListAllocatedCol:
+	case OwnerListPercentCol:	return _usage.allocatedSize < other.usage().allocatedSize;
+	default:			return QTreeWidgetItem::operator<( rawOther );
+    }
+}
@@ -0,0 +1,162 @@
+/*
+ *   File name: OwnerStatsWindow.h
+ *   Summary:	QDirStat "Owner Statistics" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef OwnerStatsWindow_h
+#define OwnerStatsWindow_h
+
+#include <QDialog>
+#include <QPointer>
+#include <QTreeWidgetItem>
+
+#include "ui_owner-stats-window.h"
+#include "OwnerStats.h"
+#include "Subtree.h"
+
+
+namespace QDirStat
+{
+    class FileInfo;
+
+
+    /**
+     * Modeless dialog to display the disk usage by user or by group of a
+     * subtree, the largest first. The numbers come from the OwnerStats of
+     * the tree, so this is instant for the first levels of the tree even
+     * for huge trees.
+     **/
+    class OwnerStatsWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 **/
+	OwnerStatsWindow( QWidget * parent = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~OwnerStatsWindow();
+
+	/**
+	 * Static method for using one shared instance of this class. This
+	 * will create a new instance if there is none yet (or anymore).
+	 *
+	 * Do not hold on to this pointer; the instance destroys itself when
+	 * the user closes the window, and then the pointer becomes invalid.
+	 **/
+	static OwnerStatsWindow * sharedInstance();
+
+	/**
+	 * Convenience function for creating, populating and showing the
+	 * shared instance.
+	 **/
+	static void populateSharedInstance( FileInfo * subtree );
+
+
+    public slots:
+
+	/**
+	 * Populate the window with the owners of 'subtree'.
+	 **/
+	void populate( FileInfo * subtree );
+
+	/**
+	 * Populate the window again with the same subtree.
+	 **/
+	void refresh();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Close" or
+	 * WM_CLOSE button. This not only closes the dialog, it also deletes
+	 * it.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+
+    protected:
+
+	/**
+	 * One-time initialization of the widgets in this window.
+	 **/
+	void initWidgets();
+
+	/**
+	 * Return the user name of 'uid' or the group name of 'gid' if
+	 * showing groups.
+	 **/
+	QString ownerName( uint id ) const;
+
+
+	//
+	// Data members
+	//
+
+	Ui::OwnerStatsWindow * _ui;
+	Subtree		       _subtree;
+
+	static QPointer<OwnerStatsWindow> _sharedInstance;
+    };
+
+
+    enum OwnerListColumns
+    {
+	OwnerListNameCol,
+	OwnerListItemsCol,
+	OwnerListSizeCol,
+	OwnerListAllocatedCol,
+	OwnerListPercentCol,
+	OwnerListColumnCount
+    };
+
+
+    /**
+     * Item class for the owner list.
+     **/
+    class OwnerListItem: public QTreeWidgetItem
+    {
+    public:
+
+	/**
+	 * Constructor. 'totalAllocated' is the allocated size of all owners
+	 * together for the percentage.
+	 **/
+	OwnerListItem( const QString	& name,
+		       const OwnerUsage & usage,
+		       FileSize		  totalAllocated );
+
+	/**
+	 * Return the usage of this owner.
+	 **/
+	const OwnerUsage & usage() const { return _usage; }
+
+	/**
+	 * Less-than operator for sorting.
+	 *
+	 * Reimplemented from QTreeWidgetItem.
+	 **/
+	virtual bool operator<( const QTreeWidgetItem & other ) const Q_DECL_OVERRIDE;
+
+
+    protected:
+
+	OwnerUsage _usage;
+
+    };	// class OwnerListItem
+
+}	// namespace QDirStat
+
+
+#endif // ifndef OwnerStatsWindow_h
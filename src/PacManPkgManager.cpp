@@ -7,13 +7,22 @@
  */
 
 
+#include <QFile>
+#include <QDir>
+#include <QElapsedTimer>
+
 #include "PacManPkgManager.h"
+#include "PkgFileListCache.h"
 #include "Logger.h"
 #include "Exception.h"
 
+#define PACMAN_LOCAL_DB_DIR	"/var/lib/pacman/local"
+
 
 using namespace QDirStat;
 
+using SysUtil::mappedContents;
+
 
 bool PacManPkgManager::isPrimaryPkgManager()
 {
@@ -28,28 +37,34 @@ bool PacManPkgManager::isAvailable()
 }
 
 
-QString PacManPkgManager::owningPkg( const QString & path )
+void PacManPkgManager::owningPkgCommand( const QStringList & paths,
+					  QString	    & command_ret,
+					  QStringList	    & args_ret )
 {
-    int exitCode = -1;
-    QString output = runCommand( "/usr/bin/pacman",
-                                 QStringList() << "-Qo" << path,
-                                 &exitCode );
+    command_ret = "/usr/bin/pacman";
+    args_ret	= QStringList() << "-Qo" << paths.first();
+}
+
 
+void PacManPkgManager::parseOwningPkgOutput( const QStringList	        & paths,
+					     const QString	        & output,
+					     int			  exitCode,
+					     QMap<QString, QString>     & pkgs_ret )
+{
     if ( exitCode != 0 || output.contains( "No package owns" ) )
-	return "";
+	return;
 
     // Sample output:
     //
-    //   /usr/bin/pacman is owned by pacman 5.1.1-3
+    //	 /usr/bin/pacman is owned by pacman 5.1.1-3
     //
     // The path might contain blanks, so it might not be safe to just use
     // blank-separated section #4; let's remove the part before the package
     // name.
 
-    output.remove( QRegExp( "^.*is owned by " ) );
-    QString pkg = output.section( " ", 0, 0 );
-
-    return pkg;
+    QString pkg = output;
+    pkg.remove( QRegExp( "^.*is owned by " ) );
+    pkgs_ret.insert( paths.first(), pkg.section( " ", 0, 0 ) );
 }
 
 
@@ -110,3 +125,150 @@ QStringList PacManPkgManager::parseFileList( const QString & output )
     return output.split( "\n" );
 }
 
+
+QStringList PacManPkgManager::fileList( PkgInfo * pkg )
+{
+    CHECK_PTR( pkg );
+
+    // Each package has a directory ${name}-${version} in the local database
+    // where ${version} is "${pkgver}-${pkgrel}" as reported by "pacman -Qn".
+
+    QString fileName = QString( PACMAN_LOCAL_DB_DIR "/%1-%2/files" )
+        .arg( pkg->baseName() ).arg( pkg->version() );
+    bool ok = false;
+    QStringList fileList = readFilesFile( fileName, &ok );
+
+    if ( ok )
+        return fileList;
+
+    return PkgManager::fileList( pkg );
+}
+
+
+QStringList PacManPkgManager::readFilesFile( const QString & fileName, bool * ok )
+{
+    QStringList fileList;
+    QFile file( fileName );
+
+    if ( ok )
+        *ok = false;
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+        return fileList;
+
+    // Sample file:
+    //
+    //   %FILES%
+    //   usr/
+    //   usr/bin/
+    //   usr/bin/pacman
+    //
+    //   %BACKUP%
+    //   etc/pacman.conf	2bd2e5a7c7a9f3a0c3b6c9a3e1a9d3f1
+    //
+    // The paths are relative to the root directory; directories end with a
+    // slash, just like in the output of "pacman -Qlq".
+
+    QByteArray contents = mappedContents( file );
+    bool inFiles = false;
+    int	 pos	 = 0;
+
+    while ( pos < contents.size() )
+    {
+        int end = contents.indexOf( '\n', pos );
+
+        if ( end < 0 )
+            end = contents.size();
+
+        const char * line = contents.constData() + pos;
+        int	     len  = end - pos;
+
+        if ( len > 0 && line[0] == '%' )
+            inFiles = ( len == 7 && qstrncmp( line, "%FILES%", 7 ) == 0 );
+        else if ( inFiles && len > 0 )
+            fileList << "/" + QString::fromUtf8( line, len );
+
+        pos = end + 1;
+    }
+
+    if ( ok )
+        *ok = true;
+
+    return fileList;
+}
+
+
+QStringList PacManPkgManager::databasePaths() const
+{
+    return QStringList() << PACMAN_LOCAL_DB_DIR;
+}
+
+
+PkgFileListCache * PacManPkgManager::createFileListCache( PkgFileListCache::LookupType lookupType )
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QDir localDb( PACMAN_LOCAL_DB_DIR );
+    QStringList pkgDirs = localDb.entryList( QDir::Dirs | QDir::NoDotAndDotDot );
+
+    if ( pkgDirs.isEmpty() )
+    {
+        logWarning() << "No packages in " << PACMAN_LOCAL_DB_DIR << "; using pacman -Ql" << endl;
+
+        return createFileListCacheFromCommand( lookupType );
+    }
+
+    // The directories are named ${name}-${pkgver}-${pkgrel}. Neither
+    // ${pkgver} nor ${pkgrel} may contain a dash, but the name may.
+
+    QStringList pkgNames;
+    QStringList fileNames;
+
+    foreach ( const QString & pkgDir, pkgDirs )
+    {
+        pkgNames  << pkgDir.section( '-', 0, -3 );
+        fileNames << localDb.filePath( pkgDir + "/files" );
+    }
+
+    PkgFileListCache * cache = new PkgFileListCache( this, lookupType );
+    CHECK_NEW( cache );
+
+    int fileCount = cache->addFileLists( pkgNames, fileNames, readFilesFile );
+
+    logDebug() << "Read " << fileCount << " files of " << pkgNames.size()
+               << " packages from " << PACMAN_LOCAL_DB_DIR
+               << " in " << timer.elapsed() << " millisec" << endl;
+
+    return cache;
+}
+
+
+PkgFileListCache * PacManPkgManager::createFileListCacheFromCommand( PkgFileListCache::LookupType lookupType )
+{
+    int exitCode = -1;
+    QString output = runCommand( "/usr/bin/pacman",
+                                 QStringList() << "-Ql",
+                                 &exitCode );
+
+    if ( exitCode != 0 )
+        return 0;
+
+    PkgFileListCache * cache = new PkgFileListCache( this, lookupType );
+    CHECK_NEW( cache );
+
+    // Sample output:
+    //
+    //   pacman /usr/bin/pacman
+    //   pacman /usr/bin/pacman-conf
+
+    foreach ( const QString & line, output.split( "\n" ) )
+    {
+        int blank = line.indexOf( ' ' );
+
+        if ( blank > 0 )
+            cache->add( line.left( blank ), line.mid( blank + 1 ) );
+    }
+
+    return cache;
+}
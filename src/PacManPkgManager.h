@@ -50,16 +50,28 @@ namespace QDirStat
 	virtual bool isAvailable() Q_DECL_OVERRIDE;
 
 	/**
-	 * Return the owning package of a file or directory with full path
-	 * 'path' or an empty string if it is not owned by any package.
+	 * Return the command and its arguments for finding the owning
+	 * package of the first of 'paths'.
 	 *
 	 * Implemented from PkgManager.
 	 *
-	 * This basically executes this command:
+	 * This is basically this command:
 	 *
-	 *   /usr/bin/rpm -qf ${path}
+	 *   /usr/bin/pacman -Qo ${path}
 	 **/
-	virtual QString owningPkg( const QString & path ) Q_DECL_OVERRIDE;
+	virtual void owningPkgCommand( const QStringList & paths,
+				       QString		 & command_ret,
+				       QStringList	 & args_ret ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Parse the output of the owningPkgCommand() for 'paths'.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual void parseOwningPkgOutput( const QStringList	      & paths,
+					   const QString	      & output,
+					   int				exitCode,
+					   QMap<QString, QString>     & pkgs_ret ) Q_DECL_OVERRIDE;
 
 
         //-----------------------------------------------------------------
@@ -108,6 +120,62 @@ namespace QDirStat
          **/
         virtual QStringList parseFileList( const QString & output ) Q_DECL_OVERRIDE;
 
+        /**
+         * Return the list of files and directories owned by a package.
+         *
+         * This reads the package's "files" file in /var/lib/pacman/local
+         * directly and only falls back to "pacman -Qlq" if there is none.
+         *
+	 * Reimplemented from PkgManager.
+         **/
+        virtual QStringList fileList( PkgInfo * pkg ) Q_DECL_OVERRIDE;
+
+        /**
+         * Return 'true' since fileList() reads the pacman database directly.
+         *
+	 * Reimplemented from PkgManager.
+         **/
+        virtual bool supportsNativeFileList() Q_DECL_OVERRIDE
+            { return true; }
+
+        /**
+         * Return 'true' if this package manager supports building a file list
+         * cache for getting all file lists for all packages.
+         *
+	 * Reimplemented from PkgManager.
+         **/
+        virtual bool supportsFileListCache() Q_DECL_OVERRIDE
+            { return true; }
+
+        /**
+         * Create a file list cache with the specified lookup type for all
+         * installed packages.
+         *
+         * This reads all "files" files in /var/lib/pacman/local in parallel
+         * and only falls back to "pacman -Ql" if that directory is missing.
+         *
+         * Ownership of the cache is transferred to the caller.
+         *
+	 * Reimplemented from PkgManager.
+         **/
+        virtual PkgFileListCache * createFileListCache( PkgFileListCache::LookupType lookupType = PkgFileListCache::LookupByPkg ) Q_DECL_OVERRIDE;
+
+        /**
+         * Read the files and directories of one package from its "files"
+         * file 'fileName' in the pacman database. Set 'ok' to 'false' if that
+         * file could not be read.
+         *
+         * This is thread-safe, so it can be used from worker threads.
+         **/
+        static QStringList readFilesFile( const QString & fileName, bool * ok = 0 );
+
+        /**
+         * Return the directory of the local package database.
+         *
+	 * Reimplemented from PkgManager.
+         **/
+        virtual QStringList databasePaths() const Q_DECL_OVERRIDE;
+
 
     protected:
 
@@ -116,6 +184,12 @@ namespace QDirStat
          **/
         PkgInfoList parsePkgList( const QString & output );
 
+        /**
+         * Create a file list cache from the output of "pacman -Ql". This is
+         * the fallback if the pacman database can't be read directly.
+         **/
+        PkgFileListCache * createFileListCacheFromCommand( PkgFileListCache::LookupType lookupType );
+
     }; // class PacManPkgManager
 
 } // namespace QDirStat
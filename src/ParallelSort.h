@@ -0,0 +1,143 @@
+/*
+ *   File name: ParallelSort.h
+ *   Summary:	Parallel stable sorting for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ParallelSort_h
+#define ParallelSort_h
+
+
+#include <algorithm>	// std::stable_sort(), std::inplace_merge()
+
+#include <QVector>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
+
+// Below this size, sorting in one thread is faster than starting threads
+#define PARALLEL_SORT_MIN_SIZE		50000
+
+// Upper limit for the number of threads, no matter how many cores there are
+#define PARALLEL_SORT_MAX_THREADS	8
+
+
+namespace QDirStat
+{
+    /**
+     * Worker for parallelStableSort(): Stable sort of one chunk.
+     **/
+    template<typename T, typename Compare>
+    class ParallelSortChunk: public QRunnable
+    {
+    public:
+
+	ParallelSortChunk( T * begin, T * end, const Compare & compare ):
+	    _begin( begin ),
+	    _end( end ),
+	    _compare( compare )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	    { std::stable_sort( _begin, _end, _compare ); }
+
+    protected:
+
+	T *	_begin;
+	T *	_end;
+	Compare _compare;
+    };
+
+
+    /**
+     * Worker for parallelStableSort(): Merge two adjacent sorted chunks.
+     **/
+    template<typename T, typename Compare>
+    class ParallelSortMerge: public QRunnable
+    {
+    public:
+
+	ParallelSortMerge( T * begin, T * middle, T * end, const Compare & compare ):
+	    _begin( begin ),
+	    _middle( middle ),
+	    _end( end ),
+	    _compare( compare )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	    { std::inplace_merge( _begin, _middle, _end, _compare ); }
+
+    protected:
+
+	T *	_begin;
+	T *	_middle;
+	T *	_end;
+	Compare _compare;
+    };
+
+
+    /**
+     * Sort 'data' with 'compare' like std::stable_sort(), but split it up
+     * into one chunk for each CPU core, sort the chunks in parallel and then
+     * merge them, again in parallel as far as possible. Small vectors are
+     * simply sorted in the calling thread.
+     *
+     * Each thread gets its own copy of 'compare'. It is called from several
+     * threads at the same time, so it must not modify anything it compares;
+     * in particular, the sums of dirty directories need to be updated before
+     * sorting FileInfo pointers.
+     **/
+    template<typename T, typename Compare>
+    void parallelStableSort( QVector<T> & data, const Compare & compare )
+    {
+	const int size	  = data.size();
+	const int threads = qMin( QThread::idealThreadCount(), PARALLEL_SORT_MAX_THREADS );
+
+	if ( size < PARALLEL_SORT_MIN_SIZE || threads < 2 )
+	{
+	    std::stable_sort( data.begin(), data.end(), compare );
+	    return;
+	}
+
+	T * begin = data.data();	// Detach in this thread, not in the workers
+	QVector<int> bounds;
+
+	for ( int i = 0; i <= threads; ++i )
+	    bounds << (int) ( (qint64) size * i / threads );
+
+	QThreadPool pool;
+	pool.setMaxThreadCount( threads );
+
+	for ( int i = 0; i < threads; ++i )
+	    pool.start( new ParallelSortChunk<T, Compare>( begin + bounds[ i ],
+							   begin + bounds[ i+1 ],
+							   compare ) );
+	pool.waitForDone();
+
+	// Merge pairs of adjacent chunks until there is only one left;
+	// the merges of each round are independent of each other.
+
+	for ( int width = 1; width < threads; width *= 2 )
+	{
+	    for ( int i = 0; i + width < threads; i += 2 * width )
+	    {
+		int end = qMin( i + 2 * width, threads );
+
+		pool.start( new ParallelSortMerge<T, Compare>( begin + bounds[ i ],
+							       begin + bounds[ i + width ],
+							       begin + bounds[ end ],
+							       compare ) );
+	    }
+
+	    pool.waitForDone();
+	}
+    }
+
+}	// namespace QDirStat
+
+
+#endif // ifndef ParallelSort_h
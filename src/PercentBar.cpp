@@ -18,6 +18,13 @@
 
 #define MIN_PERCENT_BAR_HEIGHT  22
 
+// Size of the cache of rendered percent bars in kB
+
+#define PERCENT_BAR_CACHE_SIZE	( 4 * 1024 )
+
+#define PERCENT_BAR_PEN_WIDTH	2
+#define PERCENT_BAR_MARGIN	4
+
 using namespace QDirStat;
 
 
@@ -27,14 +34,17 @@ PercentBarDelegate::PercentBarDelegate( QTreeView * treeView,
     _treeView( treeView ),
     _percentBarCol( percentBarCol ),
     _invisibleLevels( 1 ),      // invisible root
-    _startColorIndex( 0 )
+    _startColorIndex( 0 ),
+    _pixmapCache( PERCENT_BAR_CACHE_SIZE )
 {
     readSettings();
+    MemoryPressure::add( this );
 }
 
 
 PercentBarDelegate::~PercentBarDelegate()
 {
+    MemoryPressure::remove( this );
     writeSettings();
 }
 
@@ -70,6 +80,10 @@ void PercentBarDelegate::readSettings()
     _sizeHintWidth = settings.value( "PercentBarColumnWidth", 180 ).toInt();
 
     settings.endGroup();
+
+    // The colors might have changed
+
+    _pixmapCache.clear();
 }
 
 
@@ -114,12 +128,11 @@ void PercentBarDelegate::paint( QPainter		   * painter,
 	    int indentPixel  = ( depth * _treeView->indentation() ) / 2;
 	    QColor fillColor = _fillColors.at( colorIndex % _fillColors.size() );
 
-	    paintPercentBar( percent,
-			     painter,
-			     indentPixel,
-			     option.rect,
-			     fillColor,
-			     _barBackground );
+	    paintCachedPercentBar( percent,
+				   painter,
+				   indentPixel,
+				   option.rect,
+				   fillColor );
 	}
 	else // percent < 0.0 => tree is busy => use as read job column
 	{
@@ -129,6 +142,80 @@ void PercentBarDelegate::paint( QPainter		   * painter,
 }
 
 
+void PercentBarDelegate::paintCachedPercentBar( float	  percent,
+						QPainter *	  painter,
+						int		  indentPixel,
+						const QRect  &	  cellRect,
+						const QColor &	  fillColor ) const
+{
+    if ( cellRect.isEmpty() )
+	return;
+
+    qreal pixelRatio = 1.0;
+
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 6, 0 ))
+    if ( painter->device() )
+	pixelRatio = painter->device()->devicePixelRatioF();
+#endif
+
+    PercentBarCacheKey key;
+
+    key.width	      = cellRect.width();
+    key.height	      = cellRect.height();
+    key.indentPixel   = indentPixel;
+    key.fillWidth     = percentBarFillWidth( percent, indentPixel, cellRect );
+    key.pixelRatio    = qRound( pixelRatio * 100 );
+    key.fillColor     = fillColor.rgb();
+    key.barBackground = _barBackground.rgb();
+    key.background    = painter->background().color().rgb();
+
+    QPixmap * pixmap = _pixmapCache.object( key );
+
+    if ( ! pixmap )
+    {
+	pixmap = new QPixmap( qRound( cellRect.width()	* pixelRatio ),
+			      qRound( cellRect.height() * pixelRatio ) );
+	CHECK_NEW( pixmap );
+
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 6, 0 ))
+	pixmap->setDevicePixelRatio( pixelRatio );
+#endif
+	pixmap->fill( painter->background().color() );
+
+	{
+	    QPainter pixmapPainter( pixmap );
+	    pixmapPainter.setBackground( painter->background() );
+	    pixmapPainter.setPen( painter->pen() );
+
+	    paintPercentBar( percent,
+			     &pixmapPainter,
+			     indentPixel,
+			     QRect( QPoint( 0, 0 ), cellRect.size() ),
+			     fillColor,
+			     _barBackground );
+	}
+
+	int cost = qMax( 1, pixmap->width() * pixmap->height() * 4 / 1024 ); // kB
+	_pixmapCache.insert( key, pixmap, cost );
+    }
+
+    painter->drawPixmap( cellRect.topLeft(), *pixmap );
+}
+
+
+void PercentBarDelegate::evictCache( int percent )
+{
+    // Lowering the limit makes QCache drop the least recently used
+    // pixmaps; then restore the configured budget.
+
+    int maxCost = _pixmapCache.maxCost();
+    int keep	= _pixmapCache.totalCost() * ( 100 - qBound( 0, percent, 100 ) ) / 100;
+
+    _pixmapCache.setMaxCost( keep );
+    _pixmapCache.setMaxCost( maxCost );
+}
+
+
 QVariant PercentBarDelegate::percentData( const QModelIndex & index ) const
 {
     QVariant result;
@@ -192,8 +279,47 @@ QSize PercentBarDelegate::sizeHint( const QStyleOptionViewItem & option,
 
 
 
+bool PercentBarCacheKey::operator==( const PercentBarCacheKey & other ) const
+{
+    return width	 == other.width		&&
+	height		 == other.height	&&
+	indentPixel	 == other.indentPixel	&&
+	fillWidth	 == other.fillWidth	&&
+	pixelRatio	 == other.pixelRatio	&&
+	fillColor	 == other.fillColor	&&
+	barBackground	 == other.barBackground &&
+	background	 == other.background;
+}
+
+
+uint QDirStat::qHash( const PercentBarCacheKey & key )
+{
+    // The colors are the same for all bars on the same tree level
+
+    uint hash = key.width;
+
+    hash = hash * 31 + key.height;
+    hash = hash * 31 + key.indentPixel;
+    hash = hash * 31 + key.fillWidth;
+    hash = hash * 31 + key.fillColor;
+
+    return hash;
+}
+
+
+
 namespace QDirStat
 {
+    int percentBarFillWidth( float	   percent,
+			     int	   indentPixel,
+			     const QRect & cellRect )
+    {
+	int w = cellRect.width() - 2 * PERCENT_BAR_MARGIN - indentPixel;
+
+	return (int) ( ( w - 2 * PERCENT_BAR_PEN_WIDTH ) * percent / 100.0 );
+    }
+
+
     void paintPercentBar( float		 percent,
 			  QPainter *	 painter,
 			  int		 indentPixel,
@@ -201,9 +327,9 @@ namespace QDirStat
 			  const QColor & fillColor,
 			  const QColor & barBackground )
     {
-	int penWidth = 2;
-	int extraMargin = 4;
-	int itemMargin = 4;
+	int penWidth = PERCENT_BAR_PEN_WIDTH;
+	int extraMargin = PERCENT_BAR_MARGIN;
+	int itemMargin = PERCENT_BAR_MARGIN;
 	int x = cellRect.x() + itemMargin;
 	int y = cellRect.y() + extraMargin;
 	int w = cellRect.width() - 2 * itemMargin;
@@ -220,7 +346,7 @@ namespace QDirStat
 	    pen.setWidth( 0 );
 	    painter->setPen( pen );
 	    painter->setBrush( Qt::NoBrush );
-	    fillWidth = (int) ( ( w - 2 * penWidth ) * percent / 100.0);
+	    fillWidth = percentBarFillWidth( percent, indentPixel, cellRect );
 
 
 	    // Fill bar background.
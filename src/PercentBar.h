@@ -12,9 +12,12 @@
 #include <QStyledItemDelegate>
 #include <QColor>
 #include <QList>
+#include <QCache>
+#include <QPixmap>
 
 #include "DirTreeView.h"
 #include "DirTreeModel.h"       // RawDataRole
+#include "MemoryPressure.h"
 
 
 typedef QList<QColor> ColorList;
@@ -23,6 +26,29 @@ class QTreeView;
 
 namespace QDirStat
 {
+    /**
+     * Key for the cache of rendered percent bars: Everything that makes a
+     * difference in the pixels of a bar. Instead of the percentage, this
+     * uses the width of the filled part, so all percentages that look the
+     * same share one cache entry.
+     **/
+    struct PercentBarCacheKey
+    {
+	int	width;
+	int	height;
+	int	indentPixel;
+	int	fillWidth;
+	int	pixelRatio;	// devicePixelRatio * 100
+	QRgb	fillColor;
+	QRgb	barBackground;
+	QRgb	background;
+
+	bool operator==( const PercentBarCacheKey & other ) const;
+    };
+
+    uint qHash( const PercentBarCacheKey & key );
+
+
     /**
      * Item delegate class to paint the percent bar in the PercentBarCol.
      *
@@ -55,13 +81,17 @@ namespace QDirStat
      * For indented tree levels, the percent bar is indented as well, and a
      * different color is used for each indentation level.
      *
+     * The rendered bars are cached as pixmaps, so repainting the view
+     * (which happens several times per second while reading a directory
+     * tree) mostly only copies pixmaps.
+     *
      *
      * Notice that for QDirStat's DirTreeView and its DirTreeModel, there is a
      * special class DirTreePercentBarDelegate that is derived from this, but
      * reimplements the percentData() method to use the custom RawDataRole to
      * get the numeric value from the model.
      **/
-    class PercentBarDelegate: public QStyledItemDelegate
+    class PercentBarDelegate: public QStyledItemDelegate, public DiscardableCache
     {
 	Q_OBJECT
 
@@ -118,6 +148,14 @@ namespace QDirStat
          **/
         int startColorIndex() const { return _startColorIndex; }
 
+	/**
+	 * Drop the least recently used 'percent' percent of the cached
+	 * percent bars.
+	 *
+	 * Implemented from DiscardableCache.
+	 **/
+	virtual void evictCache( int percent ) Q_DECL_OVERRIDE;
+
 
     public slots:
 
@@ -155,6 +193,16 @@ namespace QDirStat
          **/
         virtual QVariant percentData( const QModelIndex & index ) const;
 
+	/**
+	 * Paint a percent bar like paintPercentBar(), but use a cached
+	 * pixmap of it if there is one.
+	 **/
+	void paintCachedPercentBar( float	   percent,
+				    QPainter *	   painter,
+				    int		   indentPixel,
+				    const QRect  & cellRect,
+				    const QColor & fillColor ) const;
+
 
 	//
 	// Data Members
@@ -168,6 +216,8 @@ namespace QDirStat
 	QColor	    _barBackground;
 	int	    _sizeHintWidth;
 
+	mutable QCache<PercentBarCacheKey, QPixmap> _pixmapCache;
+
     }; // class PercentBarDelegate
 
 
@@ -226,6 +276,14 @@ namespace QDirStat
 			  const QColor & fillColor,
 			  const QColor & barBackground	 );
 
+    /**
+     * Return the width of the filled part of a percent bar that
+     * paintPercentBar() would paint.
+     **/
+    int percentBarFillWidth( float	  percent,
+			     int	  indentPixel,
+			     const QRect & cellRect );
+
     /**
      * Return a color that contrasts with 'contrastColor'.
      **/
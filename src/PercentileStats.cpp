@@ -8,18 +8,225 @@
 
 
 #include <math.h>	// ceil()
-#include <algorithm>    // std::sort()
+#include <string.h>	// memcpy()
+#include <algorithm>    // std::sort(), std::nth_element()
+
+#include <QVector>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
 
 #include "PercentileStats.h"
+#include "ParallelSort.h"	// PARALLEL_SORT_MIN_SIZE, PARALLEL_SORT_MAX_THREADS
 #include "Exception.h"
 
 #define VERBOSE_SORT_THRESHOLD	50000
 
+// Number of bits per radix sort pass
+#define RADIX_BITS		8
+#define RADIX_BUCKETS		( 1 << RADIX_BITS )
+
+// Highest bit of the radix sort keys
+#define SIGN_BIT		( Q_UINT64_C( 1 ) << 63 )
+
 using namespace QDirStat;
 
 
+namespace QDirStat
+{
+    /**
+     * Worker for one pass of parallelRadixSort() over one chunk of the
+     * keys: Count the keys for each digit or move them to their place in
+     * 'dest'.
+     **/
+    class RadixSortJob: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor. In the counting pass, 'counts' gets the number of
+	 * keys for each digit. In the scattering pass, 'counts' has to
+	 * contain the position in 'dest' for the first key of this chunk
+	 * with each digit.
+	 **/
+	RadixSortJob( const quint64 * src,
+		      quint64 *	      dest,
+		      int	      begin,
+		      int	      end,
+		      int	      shift,
+		      int *	      counts,
+		      bool	      scatter ):
+	    _src( src ),
+	    _dest( dest ),
+	    _begin( begin ),
+	    _end( end ),
+	    _shift( shift ),
+	    _counts( counts ),
+	    _scatter( scatter )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    if ( _scatter )
+	    {
+		for ( int i = _begin; i < _end; ++i )
+		    _dest[ _counts[ digit( _src[i] ) ]++ ] = _src[i];
+	    }
+	    else
+	    {
+		for ( int i = _begin; i < _end; ++i )
+		    ++_counts[ digit( _src[i] ) ];
+	    }
+	}
+
+    protected:
+
+	int digit( quint64 key ) const
+	    { return (int) ( key >> _shift ) & ( RADIX_BUCKETS - 1 ); }
+
+	const quint64 * _src;
+	quint64 *	_dest;
+	int		_begin;
+	int		_end;
+	int		_shift;
+	int *		_counts;
+	bool		_scatter;
+    };
+
+}	// namespace QDirStat
+
+
+/**
+ * Return a key for 'value' that sorts as an unsigned integer like 'value'
+ * as a qreal: Flip all bits of negative numbers, only the sign bit of
+ * positive numbers.
+ **/
+static quint64 radixSortKey( qreal value )
+{
+    quint64 bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+
+    return ( bits & SIGN_BIT ) ? ~bits : bits | SIGN_BIT;
+}
+
+
+/**
+ * Return the qreal for a key from radixSortKey().
+ **/
+static qreal radixSortValue( quint64 key )
+{
+    quint64 bits = ( key & SIGN_BIT ) ? key & ~SIGN_BIT : ~key;
+    qreal   value;
+    memcpy( &value, &bits, sizeof( value ) );
+
+    return value;
+}
+
+
+/**
+ * Sort 'keys' with a least significant digit radix sort. Each pass counts
+ * the digits in one chunk of the keys for each thread, then each thread
+ * moves the keys of its chunk to their place. Passes for digits that are
+ * the same for all keys (like the high bits of file sizes) are skipped.
+ **/
+static void parallelRadixSort( QVector<quint64> & keys )
+{
+    const int size    = keys.size();
+    const int threads = qBound( 1, QThread::idealThreadCount(), PARALLEL_SORT_MAX_THREADS );
+
+    QVector<quint64> buffer( size );
+    QVector<int>     counts( threads * RADIX_BUCKETS );
+    QVector<int>     bounds;
+
+    for ( int i = 0; i <= threads; ++i )
+	bounds << (int) ( (qint64) size * i / threads );
+
+    quint64 * src  = keys.data();
+    quint64 * dest = buffer.data();
+
+    QThreadPool pool;
+    pool.setMaxThreadCount( threads );
+
+    for ( int shift = 0; shift < 64; shift += RADIX_BITS )
+    {
+	counts.fill( 0 );
+
+	for ( int t = 0; t < threads; ++t )
+	    pool.start( new RadixSortJob( src, dest, bounds[ t ], bounds[ t+1 ], shift,
+					  counts.data() + t * RADIX_BUCKETS, false ) );
+	pool.waitForDone();
+
+	// Turn the counts into the start positions for each chunk and digit:
+	// All keys with a lower digit first, then the ones of the chunks
+	// before with the same digit.
+
+	int  pos     = 0;
+	bool skipped = false;
+
+	for ( int digit = 0; digit < RADIX_BUCKETS; ++digit )
+	{
+	    int total = 0;
+
+	    for ( int t = 0; t < threads; ++t )
+	    {
+		int & count = counts[ t * RADIX_BUCKETS + digit ];
+		int   start = pos;
+
+		pos   += count;
+		total += count;
+		count  = start;
+	    }
+
+	    if ( total == size )
+		skipped = true;
+	}
+
+	if ( skipped )	// All keys have the same digit: Nothing to do
+	    continue;
+
+	for ( int t = 0; t < threads; ++t )
+	    pool.start( new RadixSortJob( src, dest, bounds[ t ], bounds[ t+1 ], shift,
+					  counts.data() + t * RADIX_BUCKETS, true ) );
+	pool.waitForDone();
+
+	qSwap( src, dest );
+    }
+
+    if ( src != keys.data() )
+	keys.swap( buffer );
+}
+
+
+/**
+ * Multi-quantile selection: Move the items at the (sorted, unique) ranks
+ * 'ranks' of the items 'begin' .. 'end' (with rank 'offset' for 'begin') to
+ * their sorted position, with all items between two of those ranks in
+ * between them.
+ **/
+static void selectRanks( QRealList::iterator begin,
+			 QRealList::iterator end,
+			 int		     offset,
+			 const int *	     ranks,
+			 int		     rankCount )
+{
+    if ( rankCount == 0 || end - begin < 2 )
+	return;
+
+    int middle = rankCount / 2;
+    QRealList::iterator pos = begin + ( ranks[ middle ] - offset );
+
+    std::nth_element( begin, pos, end );
+
+    selectRanks( begin, pos, offset, ranks, middle );
+    selectRanks( pos + 1, end, ranks[ middle ] + 1,
+		 ranks + middle + 1, rankCount - middle - 1 );
+}
+
+
 PercentileStats::PercentileStats():
-    _sorted( false )
+    _sorted( false ),
+    _selected( false ),
+    _approximate( false )
 {
 
 }
@@ -37,29 +244,152 @@ void PercentileStats::clear()
     // list to _data.
 
     _data = QRealList();
+    _sketch.clear();
+    dataChanged();
+}
+
+
+void PercentileStats::setApproximate( bool approximate )
+{
+    clear();
+    _approximate = approximate;
+}
+
+
+void PercentileStats::mergeValues( const PercentileStats & other )
+{
+    if ( other._approximate != _approximate )
+	THROW( Exception( "Cannot merge exact and approximate statistics" ) );
+
+    if ( _approximate )
+	_sketch.merge( other._sketch );
+    else
+	_data += other._data;
+
+    dataChanged();
 }
 
 
 void PercentileStats::sort()
 {
+    if ( _approximate )	// The sketch is always sorted
+    {
+	_sorted = true;
+	return;
+    }
+
     if ( _data.size() > VERBOSE_SORT_THRESHOLD )
 	logDebug() << "Sorting " << _data.size() << " elements" << endl;
 
-    std::sort( _data.begin(), _data.end() );
-    _sorted = true;
+    if ( _data.size() < PARALLEL_SORT_MIN_SIZE )
+    {
+	std::sort( _data.begin(), _data.end() );
+    }
+    else
+    {
+	QVector<quint64> keys( _data.size() );
+
+	for ( int i=0; i < _data.size(); ++i )
+	    keys[i] = radixSortKey( _data.at(i) );
+
+	parallelRadixSort( keys );
+
+	for ( int i=0; i < _data.size(); ++i )
+	    _data[i] = radixSortValue( keys.at(i) );
+    }
+
+    _sorted   = true;
+    _selected = true;
 
     if ( _data.size() > VERBOSE_SORT_THRESHOLD )
 	logDebug() << "Sorting done." << endl;
 }
 
 
+void PercentileStats::selectPercentiles()
+{
+    if ( _approximate || _sorted || _selected )
+	return;
+
+    const int size = _data.size();
+
+    if ( size < 2 )
+    {
+	_selected = true;
+	return;
+    }
+
+    // The ranks that quantile() uses for all percentiles; this includes
+    // the median, the minimum and the maximum
+
+    QVector<int> ranks;
+    ranks.reserve( 4 * 101 );
+
+    for ( int i=0; i <= 100; ++i )
+    {
+	int pos = (int) ( ( (qint64) size * i ) / 100 );
+	ranks << pos - 1 << pos;
+    }
+
+    ranks << size - 1;
+
+    // The first and the last rank of each percentile for percentileSums()
+
+    qreal percentileSize = size / 100.0;
+    int	  lastPercentile = 1;
+
+    for ( int i=1; i < size; ++i )
+    {
+	int percentile = qMax( 1, (int) ceil( i / percentileSize ) );
+
+	if ( percentile != lastPercentile )
+	{
+	    ranks << i - 1 << i;
+	    lastPercentile = percentile;
+	}
+    }
+
+    std::sort( ranks.begin(), ranks.end() );
+    ranks.erase( std::unique( ranks.begin(), ranks.end() ), ranks.end() );
+
+    while ( ! ranks.isEmpty() && ranks.first() < 0 )
+	ranks.removeFirst();
+
+    while ( ! ranks.isEmpty() && ranks.last() >= size )
+	ranks.removeLast();
+
+    if ( size > VERBOSE_SORT_THRESHOLD )
+	logDebug() << "Selecting " << ranks.size() << " ranks of " << size << " elements" << endl;
+
+    selectRanks( _data.begin(), _data.end(), 0, ranks.constData(), ranks.size() );
+    _selected = true;
+}
+
+
+qreal PercentileStats::valueAtRank( int rank )
+{
+    if ( _approximate )
+	return _sketch.valueAtRank( rank );
+
+    if ( rank < 0 || rank >= _data.size() )
+	return 0.0;
+
+    if ( ! _sorted )
+	sort();
+
+    return _data.at( rank );
+}
+
+
 qreal PercentileStats::median()
 {
+    if ( _approximate )
+	return _sketch.valueAtRank( _sketch.count() / 2 );
+
     if ( _data.isEmpty() )
 	return 0;
 
-    if ( ! _sorted )
-	sort();
+    selectPercentiles();
 
     int centerPos = _data.size() / 2;
 
@@ -88,6 +418,9 @@ qreal PercentileStats::median()
 
 qreal PercentileStats::average()
 {
+    if ( _approximate )
+	return _sketch.isEmpty() ? 0.0 : _sketch.sum() / _sketch.count();
+
     if ( _data.isEmpty() )
 	return 0.0;
 
@@ -103,11 +436,13 @@ qreal PercentileStats::average()
 
 qreal PercentileStats::min()
 {
+    if ( _approximate )
+	return _sketch.min();
+
     if ( _data.isEmpty() )
 	return 0.0;
 
-    if ( ! _sorted )
-	sort();
+    selectPercentiles();
 
     return _data.first();
 }
@@ -115,11 +450,13 @@ qreal PercentileStats::min()
 
 qreal PercentileStats::max()
 {
+    if ( _approximate )
+	return _sketch.max();
+
     if ( _data.isEmpty() )
 	return 0.0;
 
-    if ( ! _sorted )
-	sort();
+    selectPercentiles();
 
     return _data.last();
 }
@@ -127,7 +464,7 @@ qreal PercentileStats::max()
 
 qreal PercentileStats::quantile( int order, int number )
 {
-    if ( _data.isEmpty() )
+    if ( dataSize() == 0 )
 	return 0.0;
 
     if ( number > order )
@@ -143,7 +480,14 @@ qreal PercentileStats::quantile( int order, int number )
 	THROW( Exception( msg ) );
     }
 
-    if ( ! _sorted )
+    if ( _approximate )
+	return _sketch.valueAtRank( ( _sketch.count() * number ) / order );
+
+    // The selection only has the ranks of the percentiles
+
+    if ( 100 % order == 0 )
+	selectPercentiles();
+    else if ( ! _sorted )
 	sort();
 
     if ( number == 0 )
@@ -152,7 +496,7 @@ qreal PercentileStats::quantile( int order, int number )
     if ( number == order )
 	return _data.last();
 
-    int pos = ( _data.size() * number ) / order;
+    int pos = (int) ( ( (qint64) _data.size() * number ) / order );
 
     // Same as in median(): The integer division already cut off any non-zero
     // decimal place, so don't subtract 1 to compensate for starting _data with
@@ -160,7 +504,7 @@ qreal PercentileStats::quantile( int order, int number )
 
     qreal result = _data.at( pos );
 
-    if ( ( _data.size() * number ) % order == 0 )
+    if ( ( (qint64) _data.size() * number ) % order == 0 )
     {
 	// Same as in median: We hit between two elements, so use the average
 	// between them.
@@ -193,16 +537,24 @@ PercentileSums PercentileStats::percentileSums()
     for ( int i=0; i <= 100; ++i )
 	sums._individual << 0.0;
 
-    if ( ! _sorted )
-	sort();
+    if ( _approximate )
+    {
+	approximatePercentileSums( sums );
+    }
+    else
+    {
+	// Only the ranks matter here, not the order within one percentile
 
-    qreal percentileSize = _data.size() / 100.0;
+	selectPercentiles();
 
-    for ( int i=0; i < _data.size(); ++i )
-    {
-	int percentile = qMax( 1, (int) ceil( i / percentileSize ) );
+	qreal percentileSize = _data.size() / 100.0;
 
-	sums._individual[ percentile ] += _data.at(i);
+	for ( int i=0; i < _data.size(); ++i )
+	{
+	    int percentile = qMax( 1, (int) ceil( i / percentileSize ) );
+
+	    sums._individual[ percentile ] += _data.at(i);
+	}
     }
 
     qreal runningTotal = 0;
@@ -223,3 +575,45 @@ PercentileSums PercentileStats::percentileSums()
 
     return sums;
 }
+
+
+void PercentileStats::approximatePercentileSums( PercentileSums & sums ) const
+{
+    // Same as for the exact data: Item no. 'rank' in sorted order belongs to
+    // percentile ceil( rank / percentileSize ). All items of one sketch
+    // bucket count with the average of that bucket; if a bucket spans
+    // several percentiles, it is split up between them.
+
+    qreal  percentileSize = _sketch.count() / 100.0;
+    qint64 rank		  = 0;
+
+    if ( percentileSize <= 0.0 )
+	return;
+
+    for ( int bucket = 0; bucket < _sketch.bucketCount(); ++bucket )
+    {
+	qint64 items = _sketch.bucketItems( bucket );
+
+	if ( items == 0 )
+	    continue;
+
+	qreal average = _sketch.bucketSum( bucket ) / items;
+
+	while ( items > 0 )
+	{
+	    int percentile = qBound( 1, (int) ceil( rank / percentileSize ), 100 );
+
+	    // All ranks up to percentile * percentileSize belong to this percentile
+
+	    qint64 last	 = (qint64) floor( percentile * percentileSize );
+	    qint64 count = qBound( (qint64) 1, last - rank + 1, items );
+
+	    if ( percentile == 100 )
+		count = items;
+
+	    sums._individual[ percentile ] += count * average;
+	    rank  += count;
+	    items -= count;
+	}
+    }
+}
@@ -12,6 +12,8 @@
 
 #include <QList>
 
+#include "QuantileSketch.h"
+
 
 typedef QList<qreal> QRealList;
 
@@ -28,9 +30,23 @@ namespace QDirStat
      *
      * Notice that one data item (one qreal, i.e. one 64 bit double) is
      * stored for each file (or each matching file) in this object, so this is
-     * expensive in terms of memory usage. Also, since data usually need to be
-     * sorted for those calculations and sorting has at least logarithmic cost
-     * O( n * log(n) ), this also has heavy performance impact.
+     * expensive in terms of memory usage.
+     *
+     * The percentiles, the median, the minimum, the maximum and the
+     * percentile sums do not need completely sorted data: It is enough to
+     * move the items at the ranks of the percentile boundaries to their
+     * sorted position, with everything between two of them in between (a
+     * multi-quantile selection), which is O(n) instead of O(n * log(n)).
+     * Only functions that really need sorted data (like
+     * FileSizeStats::fillBuckets()) sort them; large data are sorted with a
+     * parallel radix sort.
+     *
+     * For huge numbers of data items, there is an approximate mode that only
+     * keeps a QuantileSketch with bounded memory and does not need any
+     * sorting. All results are then within the relative accuracy of the
+     * sketch, except the exact count, sum, minimum and maximum. The data()
+     * list is empty in that mode. This only makes sense for values like file
+     * sizes where a relative error is acceptable, not for points in time.
      **/
     class PercentileStats
     {
@@ -52,28 +68,56 @@ namespace QDirStat
 
 	/**
 	 * Sort the collected data in ascending order.
-	 * This is necessary after all collect() calls.
 	 *
 	 * The functions accessing results like min(), max(), median(),
-	 * quantile(), percentile() etc. all implicitly sort the data if they
-	 * are not sorted yet.
+	 * quantile(), percentile() etc. all implicitly sort or select the
+	 * data as needed, so this is only needed before using data()
+	 * directly.
 	 **/
 	void sort();
 
+	/**
+	 * Return 'true' if the data are sorted.
+	 **/
+	bool isSorted() const { return _sorted; }
+
 	/**
 	 * Return the size of the collected data, i.e. the number of data
 	 * points.
 	 **/
-	int dataSize() const { return _data.size(); }
+	int dataSize() const
+	    { return _approximate ? (int) _sketch.count() : _data.size(); }
+
+	/**
+	 * Switch between exact and approximate mode. This clears all data.
+	 **/
+	void setApproximate( bool approximate );
 
 	/**
-	 * Return a reference to the collected data.
+	 * Return 'true' if this is in approximate mode.
+	 **/
+	bool isApproximate() const { return _approximate; }
+
+	/**
+	 * Return the sketch that holds the data in approximate mode.
+	 **/
+	const QuantileSketch & sketch() const { return _sketch; }
+
+	/**
+	 * Return a reference to the collected data. This is empty in
+	 * approximate mode. The data are only in sorted order after sort().
 	 **/
 	QRealList & data() { return _data; }
 
 
-	// All calculation functions below will sort the internal data first if
-	// they are not sorted yet. This is why they are not const.
+	// All calculation functions below will sort or select the internal
+	// data first if that is not done yet. This is why they are not const.
+
+	/**
+	 * Return the value with rank 'rank' (0 .. dataSize()-1) in sorted
+	 * order. This sorts the data if they are not sorted yet.
+	 **/
+	qreal valueAtRank( int rank );
 
 	/**
 	 * Calculate the median.
@@ -132,8 +176,49 @@ namespace QDirStat
 
     protected:
 
-	QRealList _data;
-	bool	  _sorted;
+	/**
+	 * Add one data item, depending on the mode to the data list or to the
+	 * sketch.
+	 **/
+	void addValue( qreal value )
+	{
+	    if ( _approximate )
+		_sketch.add( value );
+	    else
+		_data << value;
+	}
+
+	/**
+	 * Add all data items of 'other' which needs to be in the same mode.
+	 **/
+	void mergeValues( const PercentileStats & other );
+
+	/**
+	 * Calculate the percentile sums in approximate mode.
+	 **/
+	void approximatePercentileSums( PercentileSums & sums ) const;
+
+	/**
+	 * Move the items at all ranks that the percentiles, the median, the
+	 * minimum, the maximum and the percentile sums use to their sorted
+	 * position, with all items between two of those ranks in between
+	 * them. This does nothing if the data are already sorted or
+	 * selected.
+	 **/
+	void selectPercentiles();
+
+	/**
+	 * Mark the data as neither sorted nor selected. Call this when the
+	 * data are changed.
+	 **/
+	void dataChanged() { _sorted = false; _selected = false; }
+
+
+	QRealList	_data;
+	bool		_sorted;
+	bool		_selected;	// see selectPercentiles()
+	bool		_approximate;
+	QuantileSketch	_sketch;
     };
 
     /**
@@ -173,7 +258,7 @@ namespace QDirStat
 	QRealList _individual;
 	QRealList _cumulative;
 
-	friend PercentileSums PercentileStats::percentileSums();
+	friend class PercentileStats;
     };
 
 }	// namespace QDirStat
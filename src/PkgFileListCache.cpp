@@ -6,14 +6,139 @@
  *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
  */
 
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QVector>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+
 #include "PkgFileListCache.h"
 #include "Exception.h"
 #include "Logger.h"
 
+#define PKG_FILE_LIST_MAX_THREADS	4
+
+#define PKG_CACHE_MAGIC			0x51445046	// "QDPF"
+#define PKG_CACHE_VERSION		1
+
+// Rough overhead of one QHash or QMap node and of the data of one QString
+// for memoryUsage()
+#define CONTAINER_NODE_OVERHEAD		16
+#define STRING_DATA_OVERHEAD		24
+
 
 using namespace QDirStat;
 
 
+namespace QDirStat
+{
+    /**
+     * Task for reading file lists in a worker thread. Each task takes the
+     * next file that is not yet taken by any other task until all are done.
+     **/
+    class PkgFileListReadTask: public QRunnable
+    {
+    public:
+
+	PkgFileListReadTask( const QStringList & fileNames,
+			     QStringList       * results,
+			     PkgFileListReader	 reader,
+			     QAtomicInt	       & next ):
+	    _fileNames( fileNames ),
+	    _results( results ),
+	    _reader( reader ),
+	    _next( next )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    while ( true )
+	    {
+		int index = _next.fetchAndAddOrdered( 1 );
+
+		if ( index >= _fileNames.size() )
+		    return;
+
+		_results[ index ] = _reader( _fileNames.at( index ), 0 );
+	    }
+	}
+
+    protected:
+
+	const QStringList & _fileNames;
+	QStringList	  * _results;
+	PkgFileListReader   _reader;
+	QAtomicInt	  & _next;
+    };
+
+}	// namespace QDirStat
+
+
+namespace
+{
+    /**
+     * Move all children of trie node 'source' to 'target' and merge them
+     * with any children of the same name that 'target' already has.
+     **/
+    void mergeTrieNode( PkgFileTrieNode * target, PkgFileTrieNode * source )
+    {
+	target->isPkgFile = target->isPkgFile || source->isPkgFile;
+
+	QHash<QString, PkgFileTrieNode *>::const_iterator it = source->children.constBegin();
+
+	for ( ; it != source->children.constEnd(); ++it )
+	{
+	    PkgFileTrieNode * targetChild = target->children.value( it.key(), 0 );
+
+	    if ( targetChild )
+	    {
+		mergeTrieNode( targetChild, it.value() );
+		delete it.value();	// Its children are moved or deleted
+	    }
+	    else
+	    {
+		target->children.insert( it.key(), it.value() );
+	    }
+	}
+
+	source->children.clear();
+    }
+
+
+    /**
+     * Return an estimate of the memory of the string data of 'str'.
+     **/
+    qint64 stringBytes( const QString & str )
+    {
+	return STRING_DATA_OVERHEAD + ( str.capacity() + 1 ) * sizeof( QChar );
+    }
+
+
+    /**
+     * Return an estimate of the memory of trie node 'node' and all its
+     * descendants.
+     **/
+    qint64 trieNodeBytes( const PkgFileTrieNode * node )
+    {
+	qint64 bytes = sizeof( PkgFileTrieNode );
+
+	QHash<QString, PkgFileTrieNode *>::const_iterator it = node->children.constBegin();
+
+	for ( ; it != node->children.constEnd(); ++it )
+	{
+	    bytes += CONTAINER_NODE_OVERHEAD + sizeof( QString ) + sizeof( PkgFileTrieNode * );
+	    bytes += stringBytes( it.key() );
+	    bytes += trieNodeBytes( it.value() );
+	}
+
+	return bytes;
+    }
+}
+
+
 #define CHECK_LOOKUP_TYPE(wanted)					  \
 do {									  \
     if ( ( _lookupType & (wanted) ) != (wanted) )			 \
@@ -61,7 +186,33 @@ bool PkgFileListCache::containsFile( const QString & fileName ) const
 {
     CHECK_LOOKUP_TYPE( LookupGlobal );
 
-    return _fileNames.contains( fileName );
+    const PkgFileTrieNode * node = findNode( fileName );
+
+    return node && node->isPkgFile;
+}
+
+
+const PkgFileTrieNode * PkgFileListCache::findNode( const QString & path ) const
+{
+    CHECK_LOOKUP_TYPE( LookupGlobal );
+
+    const PkgFileTrieNode * node = &_fileTrie;
+    int start = 0;
+
+    while ( node && start < path.size() )
+    {
+	int end = path.indexOf( '/', start );
+
+	if ( end < 0 )
+	    end = path.size();
+
+	if ( end > start )	// Skip empty path components
+	    node = node->child( path.mid( start, end - start ) );
+
+	start = end + 1;
+    }
+
+    return node;
 }
 
 
@@ -76,7 +227,8 @@ void PkgFileListCache::remove( const QString & pkgName )
 void PkgFileListCache::clear()
 {
     _pkgFileNames.clear();
-    _fileNames.clear();
+    qDeleteAll( _fileTrie.children );
+    _fileTrie.children.clear();
 }
 
 
@@ -87,5 +239,221 @@ void PkgFileListCache::add( const QString & pkgName,
 	_pkgFileNames.insert( pkgName, fileName );
 
     if ( _lookupType & LookupGlobal )
-	_fileNames.insert( fileName );
+    {
+	PkgFileTrieNode * node = &_fileTrie;
+
+	foreach ( const QString & name, fileName.split( '/', QString::SkipEmptyParts ) )
+	{
+	    PkgFileTrieNode * child = node->children.value( name, 0 );
+
+	    if ( ! child )
+	    {
+		child = new PkgFileTrieNode();
+		CHECK_NEW( child );
+		node->children.insert( name, child );
+	    }
+
+	    node = child;
+	}
+
+	node->isPkgFile = true;
+    }
+}
+
+
+int PkgFileListCache::addFileLists( const QStringList & pkgNames,
+				    const QStringList & fileNames,
+				    PkgFileListReader	reader )
+{
+    if ( fileNames.isEmpty() )
+	return 0;
+
+    QVector<QStringList> results( fileNames.size() );
+    QStringList * data = results.data();	// Detach now, not in the threads
+    QAtomicInt next( 0 );
+    QList<PkgFileListReadTask *> tasks;
+
+    const int threads = qMin( QThread::idealThreadCount(), PKG_FILE_LIST_MAX_THREADS );
+
+    for ( int i = 0; i < threads && i < fileNames.size(); ++i )
+    {
+	PkgFileListReadTask * task = new PkgFileListReadTask( fileNames, data, reader, next );
+	CHECK_NEW( task );
+	task->setAutoDelete( false );
+	tasks << task;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount( tasks.size() );
+
+    foreach ( PkgFileListReadTask * task, tasks )
+	pool.start( task );
+
+    pool.waitForDone();
+    qDeleteAll( tasks );
+
+    int fileCount = 0;
+
+    for ( int i = 0; i < results.size() && i < pkgNames.size(); ++i )
+    {
+	foreach ( const QString & path, results.at( i ) )
+	    add( pkgNames.at( i ), path );
+
+	fileCount += results.at( i ).size();
+    }
+
+    return fileCount;
+}
+
+
+void PkgFileListCache::merge( PkgFileListCache * other )
+{
+    CHECK_PTR( other );
+
+    if ( other == this )
+	return;
+
+    if ( other->_pkgManager != _pkgManager )
+	_pkgManager = 0;
+
+    _lookupType = (LookupType) ( _lookupType & other->_lookupType );
+
+    if ( _lookupType & LookupByPkg )
+	_pkgFileNames.unite( other->_pkgFileNames );
+    else
+	_pkgFileNames.clear();
+
+    if ( _lookupType & LookupGlobal )
+	mergeTrieNode( &_fileTrie, &other->_fileTrie );
+    else
+    {
+	qDeleteAll( _fileTrie.children );
+	_fileTrie.children.clear();
+    }
+
+    other->clear();
+}
+
+
+qint64 PkgFileListCache::memoryUsage() const
+{
+    qint64 bytes = sizeof( PkgFileListCache );
+
+    // The file root node is part of this object
+
+    bytes += trieNodeBytes( &_fileTrie ) - sizeof( PkgFileTrieNode );
+
+    QMultiMap<QString, QString>::const_iterator it = _pkgFileNames.constBegin();
+
+    for ( ; it != _pkgFileNames.constEnd(); ++it )
+    {
+	bytes += CONTAINER_NODE_OVERHEAD + 2 * sizeof( QString );
+	bytes += stringBytes( it.key() ) + stringBytes( it.value() );
+    }
+
+    return bytes;
+}
+
+
+bool PkgFileListCache::save( const QString & fileName, const QString & dbStamp ) const
+{
+    CHECK_LOOKUP_TYPE( LookupByPkg );
+
+    QSaveFile file( fileName );
+
+    if ( ! file.open( QIODevice::WriteOnly ) )
+    {
+	logWarning() << "Can't write " << fileName << ": " << file.errorString() << endl;
+	return false;
+    }
+
+    QDataStream stream( &file );
+    stream.setVersion( QDataStream::Qt_5_0 );
+
+    QStringList pkgNames = _pkgFileNames.uniqueKeys();	// sorted
+
+    stream << (quint32) PKG_CACHE_MAGIC
+	   << (quint32) PKG_CACHE_VERSION
+	   << dbStamp
+	   << (quint32) pkgNames.size();
+
+    foreach ( const QString & pkgName, pkgNames )
+    {
+	QStringList fileList( _pkgFileNames.values( pkgName ) );
+	fileList.sort();
+
+	stream << pkgName << fileList;
+    }
+
+    if ( stream.status() != QDataStream::Ok || ! file.commit() )
+    {
+	logWarning() << "Error writing " << fileName << endl;
+	return false;
+    }
+
+    logDebug() << "Wrote " << pkgNames.size() << " packages to " << fileName << endl;
+
+    return true;
+}
+
+
+PkgFileListCache * PkgFileListCache::load( const QString & fileName,
+					   const QString & dbStamp,
+					   PkgManager	 * pkgManager,
+					   LookupType	   lookupType )
+{
+    QFile file( fileName );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return 0;
+
+    QDataStream stream( &file );
+    stream.setVersion( QDataStream::Qt_5_0 );
+
+    quint32 magic	= 0;
+    quint32 version	= 0;
+    quint32 pkgCount	= 0;
+    QString fileDbStamp;
+
+    stream >> magic >> version >> fileDbStamp >> pkgCount;
+
+    if ( stream.status() != QDataStream::Ok ||
+	 magic	 != PKG_CACHE_MAGIC	      ||
+	 version != PKG_CACHE_VERSION )
+    {
+	logWarning() << "Ignoring invalid package file list cache " << fileName << endl;
+	return 0;
+    }
+
+    if ( fileDbStamp != dbStamp )
+    {
+	logInfo() << "Package database changed; not using " << fileName << endl;
+	return 0;
+    }
+
+    PkgFileListCache * cache = new PkgFileListCache( pkgManager, lookupType );
+    CHECK_NEW( cache );
+
+    for ( quint32 i = 0; i < pkgCount && stream.status() == QDataStream::Ok; ++i )
+    {
+	QString	    pkgName;
+	QStringList fileList;
+
+	stream >> pkgName >> fileList;
+
+	foreach ( const QString & path, fileList )
+	    cache->add( pkgName, path );
+    }
+
+    if ( stream.status() != QDataStream::Ok )
+    {
+	logWarning() << "Error reading " << fileName << endl;
+	delete cache;
+
+	return 0;
+    }
+
+    logInfo() << "Read " << pkgCount << " packages from " << fileName << endl;
+
+    return cache;
 }
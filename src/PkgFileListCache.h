@@ -10,8 +10,9 @@
 #define PkgFileListCache_h
 
 #include <QString>
+#include <QStringList>
 #include <QMultiMap>
-#include <QSet>
+#include <QHash>
 
 
 namespace QDirStat
@@ -20,6 +21,35 @@ namespace QDirStat
 
     class PkgManager;
 
+    /**
+     * Function to read the file list of one package from a file in the
+     * package manager's database. It sets 'ok' to 'false' if that file could
+     * not be read. It has to be thread-safe.
+     **/
+    typedef QStringList (* PkgFileListReader)( const QString & fileName, bool * ok );
+
+
+    /**
+     * One node of the path trie of all files in a PkgFileListCache: One
+     * path component, i.e. a directory or a file. Each name is stored only
+     * once for each directory, no matter how many packages have files
+     * there, and a lookup only hashes the short path components.
+     **/
+    struct PkgFileTrieNode
+    {
+	PkgFileTrieNode(): isPkgFile( false ) {}
+	~PkgFileTrieNode() { qDeleteAll( children ); }
+
+	/**
+	 * Return the child node with 'name' or 0 if there is none.
+	 **/
+	const PkgFileTrieNode * child( const QString & name ) const
+	    { return children.value( name, 0 ); }
+
+	QHash<QString, PkgFileTrieNode *> children;
+	bool				  isPkgFile; // in any file list?
+    };
+
 
     /**
      * Cache class for a package file lists.
@@ -39,7 +69,7 @@ namespace QDirStat
 	enum LookupType
 	{
 	    LookupByPkg	  = 1,		// Will use only containsPkg()
-	    LookupGlobal  = 2,		// Will use only containsFile()
+	    LookupGlobal  = 2,		// Will use only containsFile() / findNode()
 	    LookupAll	  = 0xFFFF	// Will use all
 	};
 
@@ -72,11 +102,19 @@ namespace QDirStat
 	 **/
 	bool containsFile( const QString & fileName ) const;
 
+	/**
+	 * Return the trie node for 'path' or 0 if no package has anything
+	 * in or below 'path'. This is useful to look up many files in the
+	 * same directory: Find the directory once and then check each file
+	 * with PkgFileTrieNode::child().
+	 **/
+	const PkgFileTrieNode * findNode( const QString & path ) const;
+
 	/**
 	 * Return 'true' if the cache is empty, 'false' if not.
 	 **/
 	bool isEmpty() const
-	    { return _pkgFileNames.isEmpty() && _fileNames.isEmpty(); }
+	    { return _pkgFileNames.isEmpty() && _fileTrie.children.isEmpty(); }
 
 	/**
 	 * Remove the entries for a package from the cache.
@@ -94,7 +132,60 @@ namespace QDirStat
 	void add( const QString & pkgName, const QString & fileName );
 
 	/**
-	 * Return the package manager parent of this cache.
+	 * Read the file lists of many packages with 'reader' in parallel and
+	 * add them. 'fileNames' are the files in the package manager's
+	 * database with the file list of the package with the same index in
+	 * 'pkgNames'. Return the total number of files added.
+	 *
+	 * This is much faster than one external command for each package,
+	 * and most of the time for reading the files goes into opening them,
+	 * so this uses several threads.
+	 **/
+	int addFileLists( const QStringList & pkgNames,
+			  const QStringList & fileNames,
+			  PkgFileListReader   reader );
+
+	/**
+	 * Move all entries of 'other' to this cache; 'other' is empty
+	 * afterwards. The trie nodes are moved, not copied.
+	 *
+	 * If 'other' belongs to a different package manager, this cache no
+	 * longer belongs to any single one: pkgManager() then returns 0. It
+	 * can then only be set up for the lookup types of both caches.
+	 **/
+	void merge( PkgFileListCache * other );
+
+	/**
+	 * Return an estimate of the memory this cache needs in bytes.
+	 **/
+	qint64 memoryUsage() const;
+
+	/**
+	 * Write this cache to file 'fileName' with the package database stamp
+	 * 'dbStamp' (see PkgManager::databaseStamp()). This requires a cache
+	 * that was created with LookupByPkg. Return 'true' on success.
+	 *
+	 * The file contains each package name once, followed by its sorted
+	 * file list, so it can be read back for any lookup type.
+	 **/
+	bool save( const QString & fileName, const QString & dbStamp ) const;
+
+	/**
+	 * Read a cache for 'pkgManager' with lookup type 'lookupType' from
+	 * file 'fileName' that was written with save(). Return 0 if there is
+	 * no such file, if it can't be read, or if it was written for another
+	 * package database stamp than 'dbStamp', i.e. if it is outdated.
+	 *
+	 * Ownership of the cache is transferred to the caller.
+	 **/
+	static PkgFileListCache * load( const QString & fileName,
+					const QString & dbStamp,
+					PkgManager    * pkgManager,
+					LookupType	lookupType );
+
+	/**
+	 * Return the package manager parent of this cache or 0 if it
+	 * contains the file lists of several package managers (see merge()).
 	 **/
 	PkgManager * pkgManager() const { return _pkgManager; }
 
@@ -109,7 +200,7 @@ namespace QDirStat
 	PkgManager *		    _pkgManager;
 	LookupType		    _lookupType;
 	QMultiMap<QString, QString> _pkgFileNames;
-	QSet<QString>		    _fileNames;
+	PkgFileTrieNode		    _fileTrie;
     };
 }	// namespace QDirStat
 
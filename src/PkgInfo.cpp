@@ -31,8 +31,10 @@ PkgInfo::PkgInfo( const QString & name,
     _version( version ),
     _arch( arch ),
     _pkgManager( pkgManager ),
+    _installedSize( -1 ),
     _multiVersion( false ),
-    _multiArch( false )
+    _multiArch( false ),
+    _fileListPending( false )
 {
     // logDebug() << "Creating " << this << endl;
 }
@@ -53,8 +55,10 @@ PkgInfo::PkgInfo( DirTree *       tree,
              0 ),   // mtime
     _baseName( name ),
     _pkgManager( pkgManager ),
+    _installedSize( -1 ),
     _multiVersion( false ),
-    _multiArch( false )
+    _multiArch( false ),
+    _fileListPending( false )
 {
     // logDebug() << "Creating " << this << endl;
 }
@@ -68,7 +72,7 @@ PkgInfo::~PkgInfo()
 
 QString PkgInfo::url() const
 {
-    QString name = _name;
+    QString name = this->name();
 
     if ( isPkgUrl( name ) )
         name = "";
@@ -105,7 +109,7 @@ FileInfo * PkgInfo::locate( const QString & path )
 
         QString pkgName = components.takeFirst();
 
-        if ( pkgName != _name )
+        if ( pkgName != name() )
         {
             logError() << "Path " << path << " does not belong to " << this << endl;
             return 0;
@@ -133,33 +137,21 @@ FileInfo * PkgInfo::locate( DirInfo *           subtree,
     if ( ! subtree || pathComponents.isEmpty() )
         return 0;
 
-    QStringList components = pathComponents;
-    QString     wanted     = components.takeFirst();
+    // Resolve one path component after the other; each one is a direct
+    // child of the previous one.
 
-    FileInfoIterator it( subtree );
+    FileInfo * item = subtree;
 
-    while ( *it )
+    foreach ( const QString & component, pathComponents )
     {
-        // logDebug() << "Checking " << (*it)->name() << " in " << subtree << " for " << wanted << endl;
+        if ( ! item->isDirInfo() )
+            return 0;
 
-        if ( (*it)->name() == wanted )
-        {
-            if ( components.isEmpty() )
-            {
-                // logDebug() << "  Found " << *it << endl;
-                return *it;
-            }
-            else
-            {
-                if ( ! (*it)->isDirInfo() )
-                    return 0;
-                else
-                    return locate( (*it)->toDirInfo(), components );
-            }
-        }
+        item = item->toDirInfo()->locateChild( component );
 
-        ++it;
+        if ( ! item )
+            return 0;
     }
 
-    return 0;
+    return item;
 }
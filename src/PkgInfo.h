@@ -105,6 +105,32 @@ namespace QDirStat
          **/
         void setMultiVersion( bool val ) { _multiVersion = val; }
 
+        /**
+         * Return the installed size of this package according to the
+         * package manager's database or -1 if it is unknown. This is only
+         * known before the file list is read if the package manager
+         * supports it (see PkgManager::supportsInstalledSize()).
+         **/
+        FileSize installedSize() const { return _installedSize; }
+
+        /**
+         * Set the installed size of this package.
+         **/
+        void setInstalledSize( FileSize size ) { _installedSize = size; }
+
+        /**
+         * Return 'true' if the file list of this package is not read yet
+         * because it is only read when a view needs it. See
+         * DirTree::readPkgFileList().
+         **/
+        bool isFileListPending() const { return _fileListPending; }
+
+        /**
+         * Set or clear the file list pending flag.
+         **/
+        void setFileListPending( bool pending = true )
+            { _fileListPending = pending; }
+
         /**
          * Returns true if this is a PkgInfo object.
          *
@@ -159,9 +185,11 @@ namespace QDirStat
         QString      _version;
         QString      _arch;
         PkgManager * _pkgManager;
+        FileSize     _installedSize;
 
-        bool         _multiVersion :1;
-        bool         _multiArch    :1;
+        bool         _multiVersion    :1;
+        bool         _multiArch       :1;
+        bool         _fileListPending :1;
 
     };  // class PkgInfo
 
@@ -7,7 +7,13 @@
  */
 
 
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QStandardPaths>
+
 #include "PkgManager.h"
+#include "Settings.h"
 #include "Logger.h"
 #include "Exception.h"
 
@@ -27,6 +33,25 @@ PkgManager::~PkgManager()
 }
 
 
+QString PkgManager::owningPkg( const QString & path )
+{
+    QStringList paths;
+    paths << path;
+
+    QString	command;
+    QStringList args;
+    owningPkgCommand( paths, command, args );
+
+    int exitCode = -1;
+    QString output = SysUtil::runCommand( command, args, &exitCode );
+
+    QMap<QString, QString> pkgs;
+    parseOwningPkgOutput( paths, output, exitCode, pkgs );
+
+    return pkgs.value( path );
+}
+
+
 QStringList PkgManager::fileList( PkgInfo * pkg )
 {
     QStringList fileList;
@@ -46,3 +71,70 @@ QStringList PkgManager::fileList( PkgInfo * pkg )
     return fileList;
 }
 
+
+QString PkgManager::databaseStamp() const
+{
+    QStringList stamps;
+
+    foreach ( const QString & path, databasePaths() )
+    {
+	QFileInfo info( path );
+
+	if ( info.exists() )
+	{
+	    stamps << QString( "%1 %2 %3" )
+		.arg( path )
+		.arg( info.lastModified().toMSecsSinceEpoch() )
+		.arg( info.size() );
+	}
+    }
+
+    return stamps.join( "\n" );
+}
+
+
+QString PkgManager::fileListCacheName() const
+{
+    QString cacheDir = QStandardPaths::writableLocation( QStandardPaths::GenericCacheLocation );
+
+    return QString( "%1/qdirstat/pkg-files-%2.cache" ).arg( cacheDir ).arg( name() );
+}
+
+
+PkgFileListCache * PkgManager::fileListCache( PkgFileListCache::LookupType lookupType )
+{
+    QString dbStamp = databaseStamp();
+
+    if ( dbStamp.isEmpty() )	// Can't tell if the package database changed
+	return createFileListCache( lookupType );
+
+    QString cacheName = fileListCacheName();
+    PkgFileListCache * cache = PkgFileListCache::load( cacheName, dbStamp, this, lookupType );
+
+    if ( cache )
+	return cache;
+
+    // Writing the cache file requires the files of each package
+
+    PkgFileListCache::LookupType createType = (PkgFileListCache::LookupType)
+	( lookupType | PkgFileListCache::LookupByPkg );
+
+    cache = createFileListCache( createType );
+
+    if ( cache && ! cache->isEmpty() )
+    {
+	QString cacheDir = QFileInfo( cacheName ).path();
+	QDir().mkpath( cacheDir );
+
+	if ( cache->save( cacheName, dbStamp ) && SysUtil::runningWithSudo() )
+	{
+	    // Don't leave a cache file in the user's home directory that is
+	    // owned by root
+
+	    Settings::fixFileOwner( cacheDir );
+	    Settings::fixFileOwner( cacheName );
+	}
+    }
+
+    return cache;
+}
@@ -11,6 +11,7 @@
 #define PkgManager_h
 
 #include <QString>
+#include <QMap>
 
 #include "PkgInfo.h"
 #include "PkgFileListCache.h"
@@ -97,9 +98,43 @@ namespace QDirStat
 	 * Return the owning package of a file or directory with full path
 	 * 'path' or an empty string if it is not owned by any package.
 	 *
+	 * This default implementation runs the owningPkgCommand() for 'path'
+	 * and waits for it to finish.
+	 **/
+	virtual QString owningPkg( const QString & path );
+
+	/**
+	 * Return the command in 'command_ret' and its arguments in 'args_ret'
+	 * for finding the owning packages of 'paths'. Only the first
+	 * maxOwningPkgBatch() paths are used.
+	 *
+	 * This is used for queries that don't wait for the command to finish
+	 * (see PkgQuery::requestOwningPkg()).
+	 *
 	 * Derived classes are required to implement this.
 	 **/
-	virtual QString owningPkg( const QString & path ) = 0;
+	virtual void owningPkgCommand( const QStringList & paths,
+				       QString		 & command_ret,
+				       QStringList	 & args_ret ) = 0;
+
+	/**
+	 * Parse the output of the owningPkgCommand() for 'paths' with exit
+	 * code 'exitCode' and add the owning package of each path that is
+	 * owned by a package to 'pkgs_ret'.
+	 *
+	 * Derived classes are required to implement this.
+	 **/
+	virtual void parseOwningPkgOutput( const QStringList	      & paths,
+					   const QString	      & output,
+					   int				exitCode,
+					   QMap<QString, QString>     & pkgs_ret ) = 0;
+
+	/**
+	 * Return the maximum number of paths for one owningPkgCommand().
+	 *
+	 * This default implementation returns 1.
+	 **/
+	virtual int maxOwningPkgBatch() const { return 1; }
 
 
 	//-----------------------------------------------------------------
@@ -124,6 +159,14 @@ namespace QDirStat
 	 **/
 	virtual PkgInfoList installedPkg() { return PkgInfoList(); }
 
+	/**
+	 * Return 'true' if installedPkg() also sets the installed size of
+	 * each package from the package database (see
+	 * PkgInfo::installedSize()), so the sizes are known before any file
+	 * list is read.
+	 **/
+	virtual bool supportsInstalledSize() { return false; }
+
 	/**
 	 * Return the list of files and directories owned by a package.
 	 **/
@@ -157,6 +200,14 @@ namespace QDirStat
 	virtual QStringList parseFileList( const QString & output )
 	    { Q_UNUSED( output); return QStringList(); }
 
+	/**
+	 * Return 'true' if this package manager reads the file list for a
+	 * package directly from its database in fileList() instead of
+	 * starting an external command. Then there is no point in starting a
+	 * background process for each package.
+	 **/
+	virtual bool supportsNativeFileList() { return false; }
+
 	/**
 	 * Return 'true' if this package manager supports building a file list
 	 * cache for getting all file lists for all packages.
@@ -183,6 +234,44 @@ namespace QDirStat
 	virtual QString queryName( PkgInfo * pkg )
 	    { return pkg->name(); }
 
+	/**
+	 * Return the files and directories of the package database whose
+	 * modification times change whenever a package is installed, updated
+	 * or removed. This is used for invalidating the persistent file list
+	 * cache.
+	 *
+	 * This default implementation returns nothing, i.e. the file list
+	 * cache is never stored on disk.
+	 **/
+	virtual QStringList databasePaths() const { return QStringList(); }
+
+	//-----------------------------------------------------------------
+	//		       Convenience Functions
+	//-----------------------------------------------------------------
+
+	/**
+	 * Return a string that identifies the current state of the package
+	 * database: The modification times and sizes of databasePaths(), or
+	 * an empty string if there are none.
+	 **/
+	QString databaseStamp() const;
+
+	/**
+	 * Return a file list cache with the specified lookup type for all
+	 * installed packages: Read it from the persistent cache file if that
+	 * is still up to date, otherwise create it with createFileListCache()
+	 * and write the cache file for the next time.
+	 *
+	 * Ownership of the cache is transferred to the caller.
+	 **/
+	PkgFileListCache * fileListCache( PkgFileListCache::LookupType lookupType = PkgFileListCache::LookupByPkg );
+
+	/**
+	 * Return the name of the persistent file list cache file for this
+	 * package manager.
+	 **/
+	QString fileListCacheName() const;
+
     }; // class PkgManager
 
 } // namespace QDirStat
@@ -0,0 +1,231 @@
+/*
+ *   File name: PkgNameIndex.cpp
+ *   Summary:	Package manager Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>	// std::sort(), std::lower_bound()
+
+#include <QRegExp>
+#include <QSet>
+
+#include "PkgNameIndex.h"
+#include "SearchFilter.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#define TRIGRAM_LEN	3
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * Sort names case-insensitively, and names that differ only in case
+     * in a defined order.
+     **/
+    bool lessCaseInsensitive( const QString & a, const QString & b )
+    {
+	int result = QString::compare( a, b, Qt::CaseInsensitive );
+
+	return result == 0 ? a < b : result < 0;
+    }
+
+
+    /**
+     * Return the elements that are in both ascending lists 'a' and 'b'.
+     **/
+    QVector<int> intersect( const QVector<int> & a, const QVector<int> & b )
+    {
+	QVector<int> result;
+	int i = 0;
+	int j = 0;
+
+	while ( i < a.size() && j < b.size() )
+	{
+	    if ( a.at( i ) < b.at( j ) )
+		++i;
+	    else if ( b.at( j ) < a.at( i ) )
+		++j;
+	    else
+	    {
+		result << a.at( i );
+		++i;
+		++j;
+	    }
+	}
+
+	return result;
+    }
+}
+
+
+void PkgNameIndex::build( const PkgInfoList & pkgList )
+{
+    _names.clear();
+    _lowerNames.clear();
+    _pkgIndexes.clear();
+    _trigrams.clear();
+
+    QHash<QString, QVector<int> > groups;
+
+    for ( int i = 0; i < pkgList.size(); ++i )
+	groups[ pkgList.at( i )->baseName() ] << i;
+
+    _names = groups.keys();
+    std::sort( _names.begin(), _names.end(), lessCaseInsensitive );
+    _pkgIndexes.reserve( _names.size() );
+
+    for ( int nameIndex = 0; nameIndex < _names.size(); ++nameIndex )
+    {
+	QString lowerName = _names.at( nameIndex ).toLower();
+
+	_lowerNames << lowerName;
+	_pkgIndexes << groups.value( _names.at( nameIndex ) );
+
+	QSet<QString> nameTrigrams;
+
+	for ( int pos = 0; pos + TRIGRAM_LEN <= lowerName.size(); ++pos )
+	    nameTrigrams.insert( lowerName.mid( pos, TRIGRAM_LEN ) );
+
+	// The name indexes are ascending, so each list stays sorted
+
+	foreach ( const QString & trigram, nameTrigrams )
+	    _trigrams[ trigram ] << nameIndex;
+    }
+
+    logDebug() << "Indexed " << _names.size() << " package names with "
+	       << _trigrams.size() << " trigrams" << endl;
+}
+
+
+QList<int> PkgNameIndex::matchingNames( const SearchFilter & filter ) const
+{
+    if ( filter.filterMode() == SearchFilter::SelectAll )
+	return allNames();
+
+    QList<int> result;
+
+    foreach ( int nameIndex, candidates( filter ) )
+    {
+	if ( filter.matches( _names.at( nameIndex ) ) )
+	    result << nameIndex;
+    }
+
+    return result;
+}
+
+
+int PkgNameIndex::matchingPkgCount( const SearchFilter & filter ) const
+{
+    int count = 0;
+
+    foreach ( int nameIndex, matchingNames( filter ) )
+	count += _pkgIndexes.at( nameIndex ).size();
+
+    return count;
+}
+
+
+QList<int> PkgNameIndex::candidates( const SearchFilter & filter ) const
+{
+    QString pattern = filter.pattern().toLower();
+    bool found	    = false;
+    QList<int> result;
+
+    switch ( filter.filterMode() )
+    {
+	case SearchFilter::StartsWith:
+	case SearchFilter::ExactMatch:
+	    return prefixRange( pattern );
+
+	case SearchFilter::Contains:
+	    result = trigramCandidates( QStringList() << pattern, found );
+	    break;
+
+	case SearchFilter::Wildcard:
+	    {
+		// The fixed parts between the wildcards; a bracket
+		// expression is just another wildcard here.
+
+		pattern.replace( QRegExp( "\\[[^\\]]*\\]" ), "*" );
+		QStringList fragments = pattern.split( QRegExp( "[*?]" ) );
+
+		// The pattern has to match the complete name, so a fixed
+		// part at the start is a prefix.
+
+		if ( ! fragments.first().isEmpty() )
+		    return prefixRange( fragments.first() );
+
+		result = trigramCandidates( fragments, found );
+	    }
+	    break;
+
+	case SearchFilter::RegExp:
+	case SearchFilter::SelectAll:
+	case SearchFilter::Auto:
+	    break;
+    }
+
+    return found ? result : allNames();
+}
+
+
+QList<int> PkgNameIndex::prefixRange( const QString & prefix ) const
+{
+    QList<int> result;
+    QStringList::const_iterator it = std::lower_bound( _lowerNames.constBegin(),
+							_lowerNames.constEnd(),
+							prefix );
+
+    for ( int nameIndex = it - _lowerNames.constBegin();
+	  nameIndex < _lowerNames.size() && _lowerNames.at( nameIndex ).startsWith( prefix );
+	  ++nameIndex )
+    {
+	result << nameIndex;
+    }
+
+    return result;
+}
+
+
+QList<int> PkgNameIndex::trigramCandidates( const QStringList & fragments,
+					    bool	      & found_ret ) const
+{
+    QVector<int> result;
+    found_ret = false;
+
+    foreach ( const QString & fragment, fragments )
+    {
+	for ( int pos = 0; pos + TRIGRAM_LEN <= fragment.size(); ++pos )
+	{
+	    QVector<int> names = _trigrams.value( fragment.mid( pos, TRIGRAM_LEN ) );
+
+	    result    = found_ret ? intersect( result, names ) : names;
+	    found_ret = true;
+
+	    if ( result.isEmpty() )
+		return QList<int>();
+	}
+    }
+
+    return result.toList();
+}
+
+
+QList<int> PkgNameIndex::allNames() const
+{
+    QList<int> result;
+    result.reserve( _names.size() );
+
+    for ( int nameIndex = 0; nameIndex < _names.size(); ++nameIndex )
+	result << nameIndex;
+
+    return result;
+}
@@ -0,0 +1,130 @@
+/*
+ *   File name: PkgNameIndex.h
+ *   Summary:	Package manager Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+#ifndef PkgNameIndex_h
+#define PkgNameIndex_h
+
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <QVector>
+
+#include "PkgInfo.h"
+
+
+namespace QDirStat
+{
+    class SearchFilter;
+
+
+    /**
+     * Index of the base names of a list of packages for matching them
+     * against a package filter without testing every single name.
+     *
+     * The distinct base names are sorted case-insensitively, so "starts
+     * with" and "exact match" patterns are a binary search. For each
+     * trigram (three consecutive characters) there is a list of the names
+     * that contain it, so a "contains" or wildcard pattern only needs to
+     * look at the names that have all the trigrams of its fixed parts.
+     * Regular expressions still test all names.
+     *
+     * Each name knows the packages that have it as their base name, i.e.
+     * the same package installed in multiple versions or for multiple
+     * architectures, so they don't need to be grouped again.
+     **/
+    class PkgNameIndex
+    {
+    public:
+
+	/**
+	 * Constructor: Create an empty index.
+	 **/
+	PkgNameIndex() {}
+
+	/**
+	 * Constructor: Create an index of the base names of 'pkgList'.
+	 **/
+	PkgNameIndex( const PkgInfoList & pkgList ) { build( pkgList ); }
+
+	/**
+	 * Index the base names of 'pkgList', replacing any previous content.
+	 * The index does not keep any pointers to the packages, only their
+	 * positions in 'pkgList'.
+	 **/
+	void build( const PkgInfoList & pkgList );
+
+	/**
+	 * Return the number of distinct base names.
+	 **/
+	int nameCount() const { return _names.size(); }
+
+	/**
+	 * Return base name no. 'nameIndex'.
+	 **/
+	const QString & name( int nameIndex ) const { return _names.at( nameIndex ); }
+
+	/**
+	 * Return the positions in the indexed package list of the packages
+	 * with base name no. 'nameIndex'.
+	 **/
+	const QVector<int> & pkgIndexes( int nameIndex ) const
+	    { return _pkgIndexes.at( nameIndex ); }
+
+	/**
+	 * Return the indexes of the base names that match 'filter' in
+	 * ascending order.
+	 **/
+	QList<int> matchingNames( const SearchFilter & filter ) const;
+
+	/**
+	 * Return the number of packages whose base name matches 'filter'.
+	 **/
+	int matchingPkgCount( const SearchFilter & filter ) const;
+
+
+    protected:
+
+	/**
+	 * Return the indexes of the names that might match 'filter' without
+	 * checking them, in ascending order.
+	 **/
+	QList<int> candidates( const SearchFilter & filter ) const;
+
+	/**
+	 * Return the indexes of the names that start with 'prefix' (which
+	 * has to be lowercase).
+	 **/
+	QList<int> prefixRange( const QString & prefix ) const;
+
+	/**
+	 * Return the indexes of the names that contain all the trigrams of
+	 * the fixed strings 'fragments' (which have to be lowercase).
+	 * 'found_ret' is set to 'false' if none of them is long enough to
+	 * have any trigram.
+	 **/
+	QList<int> trigramCandidates( const QStringList & fragments,
+				      bool	        & found_ret ) const;
+
+	/**
+	 * Return all name indexes.
+	 **/
+	QList<int> allNames() const;
+
+
+	// Data members
+
+	QStringList			_names;		// sorted case-insensitively
+	QStringList			_lowerNames;
+	QVector<QVector<int> >		_pkgIndexes;
+	QHash<QString, QVector<int> >	_trigrams;	// ascending name indexes
+
+    };	// class PkgNameIndex
+
+}	// namespace QDirStat
+
+#endif	// PkgNameIndex_h
@@ -7,11 +7,19 @@
  */
 
 
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
+
 #include "PkgQuery.h"
 #include "PkgManager.h"
+#include "PkgFileListCache.h"
+#include "AsyncCommand.h"
 #include "DpkgPkgManager.h"
 #include "RpmPkgManager.h"
 #include "PacManPkgManager.h"
+#include "FlatpakPkgManager.h"
+#include "SnapPkgManager.h"
 #include "Logger.h"
 #include "Exception.h"
 
@@ -33,6 +41,36 @@ using SysUtil::tryRunCommand;
 using SysUtil::haveCommand;
 
 
+namespace QDirStat
+{
+    /**
+     * Task for creating the file list cache of one package manager in a
+     * worker thread.
+     **/
+    class FileListCacheTask: public QRunnable
+    {
+    public:
+
+	FileListCacheTask( PkgManager			* pkgManager,
+			   PkgFileListCache::LookupType	  lookupType,
+			   PkgFileListCache	       ** result ):
+	    _pkgManager( pkgManager ),
+	    _lookupType( lookupType ),
+	    _result( result )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	    { *_result = _pkgManager->fileListCache( _lookupType ); }
+
+    protected:
+
+	PkgManager *		     _pkgManager;
+	PkgFileListCache::LookupType _lookupType;
+	PkgFileListCache **	     _result;
+    };
+}
+
+
 PkgQuery * PkgQuery::_instance = 0;
 
 
@@ -48,19 +86,36 @@ PkgQuery * PkgQuery::instance()
 }
 
 
-PkgQuery::PkgQuery()
+PkgQuery::PkgQuery():
+    QObject(),
+    _command( 0 ),
+    _queryPkgManager( 0 )
 {
     _cache.setMaxCost( CACHE_SIZE );
     checkPkgManagers();
+    MemoryPressure::add( this );
 }
 
 
 PkgQuery::~PkgQuery()
 {
+    MemoryPressure::remove( this );
     qDeleteAll( _pkgManagers );
 }
 
 
+void PkgQuery::evictCache( int percent )
+{
+    // QCache drops the least recently used entries when the limit is
+    // lowered; then it may grow again.
+
+    int keep = _cache.totalCost() * ( 100 - qBound( 0, percent, 100 ) ) / 100;
+
+    _cache.setMaxCost( keep );
+    _cache.setMaxCost( CACHE_SIZE );
+}
+
+
 void PkgQuery::checkPkgManagers()
 {
     logInfo() << "Checking available supported package managers..." << endl;
@@ -68,6 +123,8 @@ void PkgQuery::checkPkgManagers()
     checkPkgManager( new DpkgPkgManager()   );
     checkPkgManager( new RpmPkgManager()    );
     checkPkgManager( new PacManPkgManager() );
+    checkPkgManager( new FlatpakPkgManager() );
+    checkPkgManager( new SnapPkgManager()   );
 
     _pkgManagers += _secondaryPkgManagers;
     _secondaryPkgManagers.clear();
@@ -126,6 +183,192 @@ QString PkgQuery::owningPkg( const QString & path )
 }
 
 
+bool PkgQuery::cachedOwningPkg( const QString & path, QString & pkg_ret )
+{
+    QString * pkg = instance()->_cache.object( path );
+
+    if ( ! pkg )
+	return false;
+
+    pkg_ret = *pkg;
+
+    return true;
+}
+
+
+int PkgQuery::cacheStats( qint64 & bytes_ret )
+{
+    bytes_ret = 0;
+
+    if ( ! _instance )
+	return 0;
+
+    // Only the paths: Looking at the package names would count as using
+    // them and change the order in which they are dropped.
+
+    foreach ( const QString & path, _instance->_cache.keys() )
+	bytes_ret += 2 * sizeof( QString ) + ( path.size() + 1 ) * sizeof( QChar );
+
+    return _instance->_cache.size();
+}
+
+
+void PkgQuery::requestOwningPkg( const QString	   & path,
+				 const QStringList & prefetchPaths )
+{
+    QString * pkg = _cache.object( path );
+
+    if ( pkg )
+    {
+	emit owningPkgFound( path, *pkg );
+	return;
+    }
+
+    QStringList paths;
+    paths << path;
+
+    foreach ( const QString & prefetchPath, prefetchPaths )
+    {
+	if ( ! _cache.contains( prefetchPath ) && ! paths.contains( prefetchPath ) )
+	    paths << prefetchPath;
+    }
+
+    _waitingPaths = paths;
+
+    if ( ! _command )
+	startQuery();
+    else if ( ! _batchPaths.contains( path ) )
+	_command->cancel();	// Nobody is interested in that anymore
+
+}
+
+
+void PkgQuery::startQuery()
+{
+    if ( _command )
+	return;
+
+    if ( ! _waitingPaths.isEmpty() )
+    {
+	// A newer request: Drop what is left of the current one; the user
+	// is not interested in that anymore.
+
+	_queryPaths	 = _waitingPaths;
+	_notFoundPaths.clear();
+	_queryPkgManager = 0;
+	_waitingPaths.clear();
+    }
+
+    if ( _queryPaths.isEmpty() )
+    {
+	// This package manager is done; try the next one with the paths
+	// that it did not find.
+
+	_queryPaths = _notFoundPaths;
+	_notFoundPaths.clear();
+	++_queryPkgManager;
+    }
+
+    if ( _queryPaths.isEmpty() )
+	return;
+
+    if ( _queryPkgManager >= _pkgManagers.size() )
+    {
+	// Nobody owns these
+
+	foreach ( const QString & path, _queryPaths )
+	    foundOwningPkg( path, "" );
+
+	_queryPaths.clear();
+	return;
+    }
+
+    PkgManager * pkgManager = _pkgManagers.at( _queryPkgManager );
+    _batchPaths = _queryPaths.mid( 0, pkgManager->maxOwningPkgBatch() );
+    _queryPaths = _queryPaths.mid( _batchPaths.size() );
+
+    QString	command;
+    QStringList args;
+    pkgManager->owningPkgCommand( _batchPaths, command, args );
+
+    if ( command.isEmpty() )
+    {
+	// This package manager finds the owning packages without any
+	// external command
+
+	foreach ( const QString & path, _batchPaths )
+	{
+	    QString pkg = pkgManager->owningPkg( path );
+
+	    if ( pkg.isEmpty() )
+		_notFoundPaths << path;
+	    else
+		foundOwningPkg( path, pkg );
+	}
+
+	_batchPaths.clear();
+	startQuery();
+
+	return;
+    }
+
+    _command = new AsyncCommand( command, args, this );
+    CHECK_NEW( _command );
+
+    connect( _command, SIGNAL( finished	    ( AsyncCommand * ) ),
+	     this,     SLOT  ( queryFinished( AsyncCommand * ) ) );
+
+    _command->start();
+}
+
+
+void PkgQuery::queryFinished( AsyncCommand * command )
+{
+    if ( command != _command )
+	return;
+
+    bool cancelled = _command->cancelled();
+    QMap<QString, QString> pkgs;
+
+    if ( _command->ok() )
+    {
+	PkgManager * pkgManager = _pkgManagers.at( _queryPkgManager );
+	pkgManager->parseOwningPkgOutput( _batchPaths, _command->output(), _command->exitCode(), pkgs );
+    }
+
+    _command->deleteLater();
+    _command = 0;
+
+    if ( ! cancelled )	// Otherwise a newer request takes over in startQuery()
+    {
+	foreach ( const QString & path, _batchPaths )
+	{
+	    if ( pkgs.contains( path ) )
+		foundOwningPkg( path, pkgs.value( path ) );
+	    else
+		_notFoundPaths << path;
+	}
+    }
+
+    _batchPaths.clear();
+    startQuery();
+}
+
+
+void PkgQuery::foundOwningPkg( const QString & path, const QString & pkg )
+{
+#if VERBOSE_PKG_QUERY
+    if ( pkg.isEmpty() )
+	logDebug() << "No package owns " << path << endl;
+    else
+	logDebug() << "Package " << pkg << " owns " << path << endl;
+#endif
+
+    _cache.insert( path, new QString( pkg ), CACHE_COST );
+    emit owningPkgFound( path, pkg );
+}
+
+
 PkgInfoList PkgQuery::installedPkg()
 {
     return instance()->getInstalledPkg();
@@ -199,6 +442,9 @@ PkgInfoList PkgQuery::getInstalledPkg()
 
 QStringList PkgQuery::getFileList( PkgInfo * pkg )
 {
+    if ( pkg && pkg->pkgManager() )
+	return pkg->pkgManager()->fileList( pkg );
+
     foreach ( PkgManager * pkgManager, _pkgManagers )
     {
         QStringList fileList = pkgManager->fileList( pkg );
@@ -245,3 +491,70 @@ bool PkgQuery::checkFileListSupport()
 
     return false;
 }
+
+
+bool PkgQuery::haveFileListCacheSupport()
+{
+    foreach ( PkgManager * pkgManager, instance()->_pkgManagers )
+    {
+        if ( pkgManager->supportsFileListCache() )
+            return true;
+    }
+
+    return false;
+}
+
+
+PkgFileListCache * PkgQuery::fileListCache( PkgFileListCache::LookupType lookupType )
+{
+    QList<PkgManager *> pkgManagers;
+
+    foreach ( PkgManager * pkgManager, instance()->_pkgManagers )
+    {
+	if ( pkgManager->supportsFileListCache() )
+	    pkgManagers << pkgManager;
+    }
+
+    if ( pkgManagers.isEmpty() )
+	return 0;
+
+    // Each package manager reads its own database, so they don't have to
+    // wait for each other.
+
+    QVector<PkgFileListCache *> caches( pkgManagers.size(), 0 );
+    PkgFileListCache ** results = caches.data();	// Detach now, not in the threads
+
+    QThreadPool pool;
+    pool.setMaxThreadCount( pkgManagers.size() );
+
+    for ( int i = 0; i < pkgManagers.size(); ++i )
+    {
+	FileListCacheTask * task = new FileListCacheTask( pkgManagers.at( i ), lookupType, &results[ i ] );
+	CHECK_NEW( task );
+
+	pool.start( task ); // The thread pool takes over ownership
+    }
+
+    pool.waitForDone();
+
+    PkgFileListCache * merged = 0;
+
+    for ( int i = 0; i < caches.size(); ++i )
+    {
+	if ( ! caches.at( i ) )
+	{
+	    logWarning() << "No file list cache from " << pkgManagers.at( i )->name() << endl;
+	}
+	else if ( ! merged )
+	{
+	    merged = caches.at( i );
+	}
+	else
+	{
+	    merged->merge( caches.at( i ) );
+	    delete caches.at( i );
+	}
+    }
+
+    return merged;
+}
@@ -10,22 +10,29 @@
 #ifndef PkgQuery_h
 #define PkgQuery_h
 
+#include <QObject>
 #include <QString>
+#include <QStringList>
 #include <QCache>
 
 #include "PkgInfo.h"
+#include "PkgFileListCache.h"
+#include "MemoryPressure.h"
 
 
 namespace QDirStat
 {
     class PkgManager;
+    class AsyncCommand;
 
 
     /**
      * Singleton class for simple queries to the system's package manager.
      **/
-    class PkgQuery
+    class PkgQuery: public QObject, public DiscardableCache
     {
+	Q_OBJECT
+
     public:
 
 	/**
@@ -34,6 +41,35 @@ namespace QDirStat
 	 **/
 	static QString owningPkg( const QString & path );
 
+	/**
+	 * Return 'true' if the owning package of 'path' is known without
+	 * asking the package manager, i.e. if it is in the cache, and return
+	 * it (or an empty string if no package owns it) in 'pkg_ret'.
+	 **/
+	static bool cachedOwningPkg( const QString & path, QString & pkg_ret );
+
+	/**
+	 * Return the number of cached owning packages and an estimate of
+	 * their memory in bytes in 'bytes_ret'. This does not create the
+	 * instance if there is none yet.
+	 **/
+	static int cacheStats( qint64 & bytes_ret );
+
+	/**
+	 * Find the owning package of 'path' without waiting for the package
+	 * manager. owningPkgFound() is emitted when it is known; if it is in
+	 * the cache, that happens right away.
+	 *
+	 * The owning packages of 'prefetchPaths' (e.g. the siblings of
+	 * 'path') are found in the same package manager call if it can do
+	 * that, and they are added to the cache for the next request.
+	 *
+	 * While the package manager is busy, only the latest request is kept
+	 * waiting; older ones are dropped.
+	 **/
+	void requestOwningPkg( const QString	 & path,
+			       const QStringList & prefetchPaths = QStringList() );
+
 	/**
 	 * Return the singleton instance of this class.
 	 **/
@@ -74,6 +110,21 @@ namespace QDirStat
          **/
         static QStringList fileList( PkgInfo * pkg );
 
+        /**
+         * Return 'true' if any of the package managers can create a file
+         * list cache.
+         **/
+        static bool haveFileListCacheSupport();
+
+	/**
+	 * Create the file list caches of all package managers that support
+	 * that, each in its own thread, and merge them into one. Return 0 if
+	 * there is none.
+	 *
+	 * Ownership of the cache is transferred to the caller.
+	 **/
+	static PkgFileListCache * fileListCache( PkgFileListCache::LookupType lookupType );
+
 	/**
 	 * Return the owning package of a file or directory with full path
 	 * 'path' or an empty string if it is not owned by any package.
@@ -88,7 +139,9 @@ namespace QDirStat
         PkgInfoList getInstalledPkg();
 
         /**
-         * Return the list of files and directories owned by a package.
+         * Return the list of files and directories owned by a package from
+         * its own package manager or, if it has none, from the first one
+         * that knows it.
          **/
         QStringList getFileList( PkgInfo * pkg );
 
@@ -104,9 +157,46 @@ namespace QDirStat
          **/
         bool checkFileListSupport();
 
+	/**
+	 * Drop 'percent' percent of the cached owning packages, the least
+	 * recently used ones first. Implemented from DiscardableCache.
+	 **/
+	virtual void evictCache( int percent ) Q_DECL_OVERRIDE;
+
+
+    signals:
+
+	/**
+	 * Emitted when the owning package of a path from requestOwningPkg()
+	 * is known. 'pkg' is empty if no package owns it.
+	 **/
+	void owningPkgFound( const QString & path, const QString & pkg );
+
+
+    protected slots:
+
+	/**
+	 * Notification that the package manager command of the current query
+	 * is finished.
+	 **/
+	void queryFinished( AsyncCommand * command );
+
 
     protected:
 
+	/**
+	 * Start the package manager command for the next paths of the
+	 * current query or for the waiting request if there is nothing more
+	 * to do for the current one.
+	 **/
+	void startQuery();
+
+	/**
+	 * Store the owning package of 'path' in the cache and tell the
+	 * receivers of owningPkgFound().
+	 **/
+	void foundOwningPkg( const QString & path, const QString & pkg );
+
 	/**
 	 * Constructor. For internal use only; use the static methods instead.
 	 **/
@@ -137,6 +227,15 @@ namespace QDirStat
 	QList <PkgManager *>	 _secondaryPkgManagers;
 	QCache<QString, QString> _cache;
 
+	// Queries that don't wait for the package manager
+
+	AsyncCommand *		 _command;
+	QStringList		 _queryPaths;	// Paths for the current package manager
+	QStringList		 _batchPaths;	// Paths of the running command
+	QStringList		 _notFoundPaths; // Paths for the next package manager
+	int			 _queryPkgManager;
+	QStringList		 _waitingPaths;	// Paths of the latest request
+
     }; // class PkgQuery
 
 } // namespace QDirStat
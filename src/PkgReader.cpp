@@ -7,16 +7,28 @@
  */
 
 
+#include <algorithm>	// std::sort()
+
 #include "PkgReader.h"
+#include "PkgNameIndex.h"
 #include "PkgQuery.h"
 #include "PkgManager.h"
 #include "PkgFileListCache.h"
 #include "DirTree.h"
+#include "DirScanner.h"
 #include "ProcessStarter.h"
 #include "Settings.h"
 #include "Logger.h"
 #include "Exception.h"
 
+// Number of cache misses in one directory after which all its entries are
+// read at once: Many packages share directories like /usr/bin or
+// /usr/share/doc, but reading a large directory like /etc completely just
+// for one file of one package does not pay off.
+
+#define PREFETCH_MIN_MISSES	2
+
+
 using namespace QDirStat;
 
 bool PkgReader::_verboseMissingPkgFiles = false;
@@ -24,8 +36,9 @@ bool PkgReader::_verboseMissingPkgFiles = false;
 
 PkgReader::PkgReader( DirTree * tree ):
     _tree( tree ),
-    _maxParallelProcesses( 6 ),
-    _minCachePkgListSize( 200 )
+    _maxParallelProcesses( 0 ),
+    _minCachePkgListSize( 200 ),
+    _lazyFileLists( false )
 {
     // logInfo() << endl;
     readSettings();
@@ -54,69 +67,89 @@ void PkgReader::read( const PkgFilter & filter )
 	return;
     }
 
-    handleMultiPkg();
     addPkgToTree();
 
     PkgManager * pkgManager = PkgQuery::primaryPkgManager();
 
-    if ( pkgManager && pkgManager->supportsFileListCache() &&
-	 _pkgList.size() >= _minCachePkgListSize )
+    if ( _lazyFileLists && pkgManager && pkgManager->supportsInstalledSize() )
+    {
+	createLazyPkgItems();
+    }
+    else if ( PkgQuery::haveFileListCacheSupport() &&
+	      _pkgList.size() >= _minCachePkgListSize )
     {
 	createCachePkgReadJobs();
     }
     else
     {
-	createAsyncPkgReadJobs();
+	createPkgReadJobs( _pkgList );
     }
 
     // Ownership of the PkgInfo * items in _pkgList was transferred to the
     // tree, so intentionally NOT calling qDeleteItems( _pkgList ) !
 
     _pkgList.clear();
-    _multiPkg.clear();
 }
 
 
-void PkgReader::filterPkgList( const PkgFilter & filter )
+void PkgReader::readFileList( PkgInfo * pkg )
 {
-    if ( filter.filterMode() == PkgFilter::SelectAll )
+    CHECK_PTR( pkg );
+
+    if ( ! pkg->isFileListPending() )
 	return;
 
-    PkgInfoList matches;
+    logDebug() << "Reading the file list of " << pkg << endl;
 
-    foreach ( PkgInfo * pkg, _pkgList )
-    {
-	if ( filter.matches( pkg->baseName() ) )
-	{
-	    // logDebug() << "Selecting pkg " << pkg << endl;
-	    matches << pkg;
-	}
-    }
+    pkg->setFileListPending( false );
+    pkg->setReadState( DirQueued );
 
-    _pkgList = matches;
+    // Building a file list cache for all packages does not pay off for a
+    // single one.
+
+    createPkgReadJobs( PkgInfoList() << pkg );
 }
 
 
-void PkgReader::handleMultiPkg()
+void PkgReader::filterPkgList( const PkgFilter & filter )
 {
-    _multiPkg.clear();
+    PkgNameIndex index( _pkgList );
+    QList<int>	 pkgIndexes;
 
-    foreach ( PkgInfo * pkg, _pkgList )
+    foreach ( int nameIndex, index.matchingNames( filter ) )
     {
-	_multiPkg.insert( pkg->baseName(), pkg );
-    }
+	const QVector<int> & namePkgIndexes = index.pkgIndexes( nameIndex );
 
-    foreach ( const QString & pkgName, _multiPkg.uniqueKeys() )
-    {
-	createDisplayName( pkgName );
+	if ( namePkgIndexes.size() > 1 )
+	{
+	    PkgInfoList sameName;
+
+	    foreach ( int pkgIndex, namePkgIndexes )
+		sameName << _pkgList.at( pkgIndex );
+
+	    createDisplayName( index.name( nameIndex ), sameName );
+	}
+
+	foreach ( int pkgIndex, namePkgIndexes )
+	    pkgIndexes << pkgIndex;
     }
+
+    // Keep the order of the package manager
+
+    std::sort( pkgIndexes.begin(), pkgIndexes.end() );
+
+    PkgInfoList matches;
+
+    foreach ( int pkgIndex, pkgIndexes )
+	matches << _pkgList.at( pkgIndex );
+
+    _pkgList = matches;
 }
 
 
-void PkgReader::createDisplayName( const QString & pkgName )
+void PkgReader::createDisplayName( const QString     & pkgName,
+				   const PkgInfoList & pkgList )
 {
-    PkgInfoList pkgList = _multiPkg.values( pkgName );
-
     if ( pkgList.size() < 2 )
 	return;
 
@@ -184,31 +217,85 @@ void PkgReader::addPkgToTree()
 }
 
 
+void PkgReader::createLazyPkgItems()
+{
+    foreach ( PkgInfo * pkg, _pkgList )
+    {
+	pkg->setFileListPending();
+	pkg->setReadState( DirOnRequestOnly );
+
+	// Shown until the file list is read
+
+	if ( pkg->installedSize() >= 0 )
+	    pkg->setSizeEstimate( pkg->installedSize() );
+    }
+
+    logInfo() << "Deferring the file lists of " << _pkgList.size() << " packages" << endl;
+
+    _tree->sendFinished();
+}
+
+
 void PkgReader::createCachePkgReadJobs()
 {
-    PkgManager * pkgManager = PkgQuery::primaryPkgManager();
-    CHECK_PTR( pkgManager );
+    // The file list caches of all package managers are created in parallel
+    // and merged into one.
 
-    QSharedPointer<PkgFileListCache> fileListCache( pkgManager->createFileListCache() );
+    QSharedPointer<PkgFileListCache> fileListCache( PkgQuery::fileListCache( PkgFileListCache::LookupByPkg ) );
     // The shared pointer will take care of deleting the cache when the last
     // job that uses it is destroyed.
 
     if ( ! fileListCache )
     {
 	logError() << "Creating the file list cache failed" << endl;
+	createPkgReadJobs( _pkgList );
 	return;
     }
 
+    PkgInfoList uncachedPkgList;
+
     foreach ( PkgInfo * pkg, _pkgList )
     {
-	CachePkgReadJob * job = new CachePkgReadJob( _tree, pkg, fileListCache );
-	CHECK_NEW( job );
-	_tree->addJob( job );
+	if ( pkg->pkgManager() && pkg->pkgManager()->supportsFileListCache() )
+	{
+	    CachePkgReadJob * job = new CachePkgReadJob( _tree, pkg, fileListCache );
+	    CHECK_NEW( job );
+	    _tree->addJob( job );
+	}
+	else
+	{
+	    uncachedPkgList << pkg;
+	}
     }
+
+    createPkgReadJobs( uncachedPkgList );
 }
 
 
-void PkgReader::createAsyncPkgReadJobs()
+void PkgReader::createPkgReadJobs( const PkgInfoList & pkgList )
+{
+    PkgInfoList asyncPkgList;
+
+    foreach ( PkgInfo * pkg, pkgList )
+    {
+	if ( pkg->pkgManager() && pkg->pkgManager()->supportsNativeFileList() )
+	{
+	    PkgReadJob * job = new PkgReadJob( _tree, pkg );
+	    CHECK_NEW( job );
+	    _tree->addJob( job );
+	}
+	else
+	{
+	    asyncPkgList << pkg;
+	}
+    }
+
+    if ( ! asyncPkgList.isEmpty() )
+	createAsyncPkgReadJobs( asyncPkgList );
+}
+
+
+void PkgReader::createAsyncPkgReadJobs( const PkgInfoList & pkgList )
 {
     logDebug() << endl;
 
@@ -217,7 +304,7 @@ void PkgReader::createAsyncPkgReadJobs()
     processStarter->setAutoDelete( true );
     processStarter->setMaxParallel( _maxParallelProcesses );
 
-    foreach ( PkgInfo * pkg, _pkgList )
+    foreach ( PkgInfo * pkg, pkgList )
     {
 	Process * process = createReadFileListProcess( pkg );
 
@@ -270,9 +357,10 @@ void PkgReader::readSettings()
     Settings settings;
     settings.beginGroup( "Pkg" );
 
-    _maxParallelProcesses   = settings.value( "MaxParallelProcesses"  ,  6    ).toInt();
+    _maxParallelProcesses   = settings.value( "MaxParallelProcesses"  ,  0    ).toInt();
     _minCachePkgListSize    = settings.value( "MinCachePkgListSize"   , 200   ).toInt();
     _verboseMissingPkgFiles = settings.value( "VerboseMissingPkgFiles", false ).toBool();
+    _lazyFileLists	    = settings.value( "LazyFileLists"	      , false ).toBool();
 
     settings.endGroup();
 }
@@ -286,6 +374,7 @@ void PkgReader::writeSettings()
     settings.setValue( "MaxParallelProcesses"  , _maxParallelProcesses   );
     settings.setValue( "MinCachePkgListSize"   , _minCachePkgListSize    );
     settings.setValue( "VerboseMissingPkgFiles", _verboseMissingPkgFiles );
+    settings.setValue( "LazyFileLists"	       , _lazyFileLists		 );
 
     settings.endGroup();
 }
@@ -295,10 +384,13 @@ void PkgReader::writeSettings()
 
 
 
-QMap<QString, struct stat> PkgReadJob::_statCache;
-int PkgReadJob::_activeJobs = 0;
-int PkgReadJob::_cacheHits  = 0;
-int PkgReadJob::_lstatCalls = 0;
+PkgStatCacheDir * PkgReadJob::_statCache = 0;
+int PkgReadJob::_activeJobs	   = 0;
+int PkgReadJob::_statRequests	   = 0;
+int PkgReadJob::_cacheHits	   = 0;
+int PkgReadJob::_lstatCalls	   = 0;
+int PkgReadJob::_dirReads	   = 0;
+int PkgReadJob::_prefetchedEntries = 0;
 
 
 PkgReadJob::PkgReadJob( DirTree * tree,
@@ -323,10 +415,15 @@ PkgReadJob::~PkgReadJob()
 
 void PkgReadJob::clearStatCache()
 {
-    _statCache.clear();
-    _activeJobs = 0;
-    _cacheHits  = 0;
-    _lstatCalls = 0;
+    delete _statCache;
+    _statCache = 0;
+
+    _activeJobs	       = 0;
+    _statRequests      = 0;
+    _cacheHits	       = 0;
+    _lstatCalls	       = 0;
+    _dirReads	       = 0;
+    _prefetchedEntries = 0;
 }
 
 
@@ -334,10 +431,13 @@ void PkgReadJob::reportCacheStats()
 {
     float hitPercent = 0.0;
 
-    if ( _lstatCalls > 0 )
-        hitPercent = ( 100.0 * _cacheHits ) /_lstatCalls;
+    if ( _statRequests > 0 )
+        hitPercent = ( 100.0 * _cacheHits ) / _statRequests;
 
+    logDebug() << _statRequests << " stat requests" << endl;
     logDebug() << _lstatCalls << " lstat() calls" << endl;
+    logDebug() << _dirReads << " directories read with "
+               << _prefetchedEntries << " entries" << endl;
     logDebug() << _cacheHits << " stat cache hits ("
                << qRound( hitPercent ) << "%)" << endl;
 }
@@ -350,6 +450,8 @@ void PkgReadJob::startReading()
     CHECK_PTR( _pkg );
 
     _pkg->setReadState( DirReading );
+    _cursorPath.clear();
+    _cursorDirs.clear();
 
     foreach ( const QString & path, fileList() )
     {
@@ -378,16 +480,32 @@ void PkgReadJob::addFile( const QString & fileListPath )
 
     // logDebug() << "Adding " << fileListPath << " to " << _pkg << endl;
 
-    QStringList remaining = fileListPath.split( "/", QString::SkipEmptyParts );
-    QStringList currentPath;
-    DirInfo *	parent = _pkg;
+    QStringList components = fileListPath.split( "/", QString::SkipEmptyParts );
+
+    if ( components.isEmpty() )
+	return;
+
+    // Start from the deepest directory that this path has in common with
+    // the previous one
+
+    int depth	 = 0;
+    int maxDepth = qMin( _cursorPath.size(), components.size() - 1 );
+
+    while ( depth < maxDepth && _cursorPath.at( depth ) == components.at( depth ) )
+	++depth;
+
+    _cursorPath.erase( _cursorPath.begin() + depth, _cursorPath.end() );
+    _cursorDirs.erase( _cursorDirs.begin() + depth, _cursorDirs.end() );
 
-    while ( ! remaining.isEmpty() )
+    QStringList currentPath = components.mid( 0, depth );
+    DirInfo *	parent	    = depth > 0 ? _cursorDirs.last() : _pkg;
+
+    while ( depth < components.size() )
     {
-	QString currentName = remaining.takeFirst();
+	const QString & currentName = components.at( depth++ );
 	currentPath << currentName;
 
-	FileInfo * newParent = _pkg->locate( parent, QStringList() << currentName );
+	FileInfo * newParent = parent->locateChild( currentName );
 
 	if ( ! newParent )
 	{
@@ -413,7 +531,7 @@ void PkgReadJob::addFile( const QString & fileListPath )
 	    // logDebug() << "Created " << newParent << endl;
 	}
 
-	if ( ! remaining.isEmpty() )
+	if ( depth < components.size() )
 	{
 	    parent = newParent->toDirInfo();
 
@@ -422,6 +540,9 @@ void PkgReadJob::addFile( const QString & fileListPath )
 		logWarning() << newParent << " should be a directory, but is not" << endl;
 		return;
 	    }
+
+	    _cursorPath << currentName;
+	    _cursorDirs << parent;
 	}
     }
 }
@@ -450,12 +571,7 @@ FileInfo * PkgReadJob::createItem( const QStringList & pathComponents,
 				   DirTree	     * tree,
 				   DirInfo	     * parent )
 {
-    struct stat * statInfo;
-    QString path = QString( "/" ) + pathComponents.join( "/" );
-
-    // logDebug() << "path: \"" << path << "\"" << endl;
-
-    statInfo = this->lstat( path );
+    struct stat * statInfo = this->lstat( pathComponents );
 
     if ( ! statInfo ) // lstat() failed
 	return 0;
@@ -485,28 +601,48 @@ FileInfo * PkgReadJob::createItem( const QStringList & pathComponents,
 }
 
 
-struct stat * PkgReadJob::lstat( const QString & path )
+struct stat * PkgReadJob::lstat( const QStringList & pathComponents )
 {
     static struct stat statInfo;
 
-    if ( _statCache.contains( path ) )
+    ++_statRequests;
+
+    PkgStatCacheDir * dir  = statCacheDir( pathComponents );
+    const QString   & name = pathComponents.last();
+
+    QHash<QString, struct stat>::const_iterator it = dir->entries.constFind( name );
+
+    if ( it == dir->entries.constEnd() && ! dir->prefetched &&
+         ++dir->misses >= PREFETCH_MIN_MISSES )
+    {
+        QString dirPath = QString( "/" ) + pathComponents.mid( 0, pathComponents.size() - 1 ).join( "/" );
+
+        if ( prefetch( dir, dirPath ) )
+            it = dir->entries.constFind( name );
+    }
+
+    if ( it != dir->entries.constEnd() )
     {
         ++_cacheHits;
-        // logDebug() << "stat cache hit for " << path << endl;
-        statInfo = _statCache.value( path );
+        // logDebug() << "stat cache hit for " << name << endl;
+        statInfo = it.value();
+    }
+    else if ( dir->prefetched )
+    {
+        return 0;	// Not in that directory
     }
     else
     {
+        QString path = QString( "/" ) + pathComponents.join( "/" );
         int result = ::lstat( path.toUtf8(), &statInfo );
         ++_lstatCalls;
 
         if ( result != 0 )
             return 0;	// lstat() failed
 
-        _statCache.insert( path, statInfo );
+        dir->entries.insert( name, statInfo );
     }
 
-
     if ( S_ISDIR( statInfo.st_mode ) )	// directory?
     {
 	// Zero the directory's own size fields to prevent them from
@@ -524,6 +660,60 @@ struct stat * PkgReadJob::lstat( const QString & path )
 }
 
 
+PkgStatCacheDir * PkgReadJob::statCacheDir( const QStringList & pathComponents )
+{
+    if ( ! _statCache )
+    {
+        _statCache = new PkgStatCacheDir();
+        CHECK_NEW( _statCache );
+    }
+
+    PkgStatCacheDir * dir = _statCache;
+
+    for ( int i = 0; i < pathComponents.size() - 1; ++i )
+    {
+        PkgStatCacheDir * subDir = dir->subDirs.value( pathComponents.at( i ) );
+
+        if ( ! subDir )
+        {
+            subDir = new PkgStatCacheDir();
+            CHECK_NEW( subDir );
+            dir->subDirs.insert( pathComponents.at( i ), subDir );
+        }
+
+        dir = subDir;
+    }
+
+    return dir;
+}
+
+
+bool PkgReadJob::prefetch( PkgStatCacheDir * dir, const QString & dirPath )
+{
+    DirScanResult scanResult;
+    DirScanner::scanDir( dirPath.toUtf8(), scanResult );
+
+    if ( scanResult.status != DirScanResult::ScanOk )
+        return false;
+
+    ++_dirReads;
+    dir->prefetched = true;
+    dir->entries.reserve( scanResult.entries.size() );
+
+    foreach ( const DirScanEntry & entry, scanResult.entries )
+    {
+        if ( entry.statErrno == 0 )	// fstatat() OK?
+        {
+            QString name = QString::fromUtf8( scanResult.name( entry ), entry.nameLength );
+            dir->entries.insert( name, entry.statInfo );
+            ++_prefetchedEntries;
+        }
+    }
+
+    return true;
+}
+
+
 
 
 
@@ -604,8 +794,12 @@ CachePkgReadJob::CachePkgReadJob( DirTree * tree,
 
 QStringList CachePkgReadJob::fileList()
 {
+    // A cache without a package manager has the merged file lists of all
+    // of them
+
     if ( _fileListCache &&
-	 _fileListCache->pkgManager() == _pkg->pkgManager() )
+	 ( ! _fileListCache->pkgManager() ||
+	   _fileListCache->pkgManager() == _pkg->pkgManager() ) )
     {
 	QString pkgName = _pkg->pkgManager()->queryName( _pkg );
         QStringList fileList;
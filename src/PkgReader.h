@@ -10,6 +10,7 @@
 #define PkgReader_h
 
 #include <QMap>
+#include <QHash>
 #include <QSharedPointer>
 
 #include "DirReadJob.h"
@@ -60,6 +61,12 @@ namespace QDirStat
 	 **/
 	void read( const PkgFilter & filter );
 
+	/**
+	 * Read the file list of package 'pkg' whose file list is still
+	 * pending (see PkgInfo::isFileListPending()) in a read job.
+	 **/
+	void readFileList( PkgInfo * pkg );
+
 	/**
 	 * Read parameters from the settings file.
 	 **/
@@ -83,24 +90,25 @@ namespace QDirStat
 
         /**
          * Filter the package list: Remove those package that don't match the
-         * filter.
+         * filter. Handle packages that are installed in multiple versions or
+         * for multiple architectures: Assign a different display name to
+         * each of them.
+         *
+         * Both use a PkgNameIndex of the package list, so only the
+         * candidates of the index are checked against the filter, and the
+         * packages are already grouped by their base name.
          **/
         void filterPkgList( const PkgFilter & filter );
 
 	/**
-	 * Handle packages that are installed in multiple versions or for
-	 * multiple architectures: Assign a different display name to each of
-	 * them.
-	 **/
-	void handleMultiPkg();
-
-	/**
-	 * Create a suitable display names for a package: Packages that are
-	 * only installed in one version or for one architecture will simply
-	 * keep their base name; others will have the version and/or the
-	 * architecture appended so the user can tell them apart.
+	 * Create a suitable display names for the packages 'pkgList' that
+	 * all have base name 'pkgName': Packages that are only installed in
+	 * one version or for one architecture will simply keep their base
+	 * name; others will have the version and/or the architecture appended
+	 * so the user can tell them apart.
 	 **/
-	void createDisplayName( const QString & pkgName );
+	void createDisplayName( const QString	  & pkgName,
+				const PkgInfoList & pkgList );
 
 	/**
 	 * Add the packages to the DirTree.
@@ -108,16 +116,36 @@ namespace QDirStat
 	void addPkgToTree();
 
         /**
-         * Create a read job for each package to read its file list from a file
-         * list cache and add it to the read job queue.
+         * Don't read any file lists now: Mark each package as having a
+         * pending file list and show its installed size from the package
+         * database until its file list is read when a view needs it (see
+         * DirTree::readPkgFileList()).
+         **/
+        void createLazyPkgItems();
+
+        /**
+         * Create a read job for each package to read its file list from the
+         * merged file list cache of all package managers and add it to the
+         * read job queue. Packages whose package manager has no file list
+         * cache get a job from createPkgReadJobs().
          **/
         void createCachePkgReadJobs();
 
         /**
-         * Create a read job for each package with a background process to read
-         * its file list and add it as a blocked job to the read job queue.
+         * Create a read job for each package of 'pkgList' that is suitable
+         * for its package manager: One that reads the file list directly
+         * from the package manager's database when the job is started if
+         * the package manager supports that, otherwise one from
+         * createAsyncPkgReadJobs().
          **/
-        void createAsyncPkgReadJobs();
+        void createPkgReadJobs( const PkgInfoList & pkgList );
+
+        /**
+         * Create a read job for each package of 'pkgList' with a background
+         * process to read its file list and add it as a blocked job to the
+         * read job queue.
+         **/
+        void createAsyncPkgReadJobs( const PkgInfoList & pkgList );
 
         /**
          * Create a process for reading the file list for 'pkg' with the
@@ -130,9 +158,9 @@ namespace QDirStat
 
 	DirTree *                       _tree;
 	PkgInfoList			_pkgList;
-	QMultiMap<QString, PkgInfo *>	_multiPkg;
         int                             _maxParallelProcesses;
         int                             _minCachePkgListSize;
+        bool                            _lazyFileLists;
         static bool                     _verboseMissingPkgFiles;
 
     };	// class PkgReader
@@ -140,6 +168,29 @@ namespace QDirStat
 
 
 
+    /**
+     * One directory in the stat cache of the PkgReadJobs: The lstat()
+     * results of its entries and the subdirectories that were visited so
+     * far, each keyed by its name. The cache is a tree of those, so a
+     * lookup only needs to hash the short path components, not the
+     * complete path.
+     *
+     * Once a directory is visited often enough, all its entries are read
+     * at once (see DirScanner::scanDir()); 'prefetched' is then set, and
+     * anything that is not in 'entries' does not exist at all.
+     **/
+    struct PkgStatCacheDir
+    {
+	PkgStatCacheDir(): misses( 0 ), prefetched( false ) {}
+	~PkgStatCacheDir() { qDeleteAll( subDirs ); }
+
+	QHash<QString, PkgStatCacheDir *> subDirs;
+	QHash<QString, struct stat>	  entries;
+	int				  misses;
+	bool				  prefetched;
+    };
+
+
     /**
      * Read job class for reading information about a package. This is the base
      * class with a simplistic approach that just starts the external command
@@ -198,6 +249,12 @@ namespace QDirStat
         /**
          * Add all files belonging to 'path' to this package.
          * Create all directories as needed.
+         *
+         * The file lists are sorted, so most paths are in the same
+         * directory as the previous one or only a little below or above
+         * it. This keeps the directories of the previous path (the
+         * cursor) and only descends from the part that both have in
+         * common.
          **/
         void addFile( const QString & path );
 
@@ -214,11 +271,25 @@ namespace QDirStat
                                DirInfo	         * parent );
 
         /**
-         * Do an lstat() syscall for 'path' or fetch the result from a cache.
-         * Return 0 if lstat() fails. Ownership of the returned value is not
-         * transferred to the caller, so don't delete it!
+         * Do an lstat() syscall for the path specified in 'pathComponents'
+         * or fetch the result from a cache that is shared between all
+         * PkgReadJobs. Return 0 if lstat() fails. Ownership of the returned
+         * value is not transferred to the caller, so don't delete it!
          **/
-        struct stat * lstat( const QString & path );
+        struct stat * lstat( const QStringList & pathComponents );
+
+        /**
+         * Return the stat cache directory for the parent directory of
+         * 'pathComponents'. Create it and all directories above it if
+         * necessary.
+         **/
+        static PkgStatCacheDir * statCacheDir( const QStringList & pathComponents );
+
+        /**
+         * Read all entries of directory 'dirPath' into 'dir'.
+         * Return 'true' on success, 'false' on error.
+         **/
+        static bool prefetch( PkgStatCacheDir * dir, const QString & dirPath );
 
         /**
          * Recursively finalize all directories in the subtree.
@@ -238,12 +309,17 @@ namespace QDirStat
 
         // Data members
 
-	PkgInfo * _pkg;
-
-        static QMap<QString, struct stat> _statCache;
-        static int                        _activeJobs;
-        static int                        _cacheHits;
-        static int                        _lstatCalls;
+	PkgInfo *	   _pkg;
+        QStringList        _cursorPath;	// Directories of the last added path
+        QList<DirInfo *>   _cursorDirs;	// The DirInfo for each of them
+
+        static PkgStatCacheDir * _statCache;
+        static int               _activeJobs;
+        static int               _statRequests;
+        static int               _cacheHits;
+        static int               _lstatCalls;
+        static int               _dirReads;
+        static int               _prefetchedEntries;
 
     };	// class PkgReadJob
 
@@ -7,30 +7,83 @@
  */
 
 
+#include <QThread>
+
 #include "ProcessStarter.h"
 #include "Logger.h"
 #include "Exception.h"
 
 
+// Upper limit of parallel processes relative to the number of CPU cores if
+// no fixed limit is set: More than that will hardly ever help, not even
+// when the processes are mostly waiting for I/O.
+
+#define MAX_PARALLEL_PER_CPU		4
+
+// Minimum number of finished processes before adapting the number of
+// parallel processes again (but at least as many as are running in parallel)
+
+#define ADAPT_MIN_FINISHED		4
+
+// Throughput changes below this are considered noise
+
+#define ADAPT_TOLERANCE			0.05
+
+// Processes that take less time than this on average are dominated by the
+// process startup, i.e. they are CPU-bound.
+
+#define SHORT_PROCESS_MILLISEC		20
+
+
 using namespace QDirStat;
 
 
+/**
+ * Return the number of CPU cores.
+ **/
+static int cpuCount()
+{
+    return qMax( QThread::idealThreadCount(), 1 );
+}
+
+
 ProcessStarter::ProcessStarter( QObject * parent ):
     QObject( parent ),
-    _maxParallel( 8 ),
+    _maxParallel( 0 ),
+    _parallel( cpuCount() ),
+    _direction( 1 ),
     _autoDelete( false ),
-    _started( false )
+    _started( false ),
+    _windowStart( 0 ),
+    _windowLatency( 0 ),
+    _windowFinished( 0 ),
+    _lastThroughput( 0.0 )
+{
+    _timer.start();
+}
+
+
+void ProcessStarter::setMaxParallel( int newVal )
 {
+    _maxParallel = qMax( newVal, 0 );
+    _parallel    = qMin( cpuCount(), parallelLimit() );
+}
+
 
+int ProcessStarter::parallelLimit() const
+{
+    return _maxParallel > 0 ? _maxParallel : MAX_PARALLEL_PER_CPU * cpuCount();
 }
 
 
 void ProcessStarter::start()
 {
     logDebug() << "Starting. Processes in queue: " << _waiting.count() << endl;
-    logDebug() << "Maximum parallel processes: " << _maxParallel << endl;
+    logDebug() << "Parallel processes: " << _parallel
+               << " (max. " << parallelLimit() << ")" << endl;
 
-    _started = true;
+    _started     = true;
+    _windowStart = _timer.elapsed();
     startProcesses();
 }
 
@@ -42,14 +95,29 @@ void ProcessStarter::add( Process * process )
     connect( process, SIGNAL( finished	     ( int, QProcess::ExitStatus ) ),
 	     this,    SLOT  ( processFinished( int, QProcess::ExitStatus ) ) );
 
+    connect( process, SIGNAL( error	  ( QProcess::ProcessError ) ),
+	     this,    SLOT  ( processError( QProcess::ProcessError ) ) );
+
+    connect( process, SIGNAL( destroyed	      ( QObject * ) ),
+	     this,    SLOT  ( processDestroyed( QObject * ) ) );
+
     if ( _started )
         startProcesses();
 }
 
 
+void ProcessStarter::clear()
+{
+    foreach ( Process * process, _waiting )
+        disconnect( process, 0, this, 0 );
+
+    _waiting.clear();
+}
+
+
 void ProcessStarter::startProcesses()
 {
-    while ( _running.size() < _maxParallel )
+    while ( _running.size() < _parallel )
     {
         if ( _waiting.isEmpty() )
             return;
@@ -58,8 +126,11 @@ void ProcessStarter::startProcesses()
 
         if ( process )
         {
-            process->start();
             _running.append( process );
+            _startTime.insert( process, _timer.elapsed() );
+
+            emit startingProcess( process );
+            process->start();
         }
     }
 }
@@ -79,9 +150,53 @@ void ProcessStarter::processFinished( int                  exitCode,
         return;
     }
 
+    done( process );
+}
+
+
+void ProcessStarter::processError( QProcess::ProcessError error )
+{
+    if ( error != QProcess::FailedToStart ) // A 'finished' signal will follow
+        return;
+
+    Process * process = qobject_cast<Process *>( sender() );
+
+    if ( process )
+        done( process );
+}
+
+
+void ProcessStarter::processDestroyed( QObject * obj )
+{
+    // The process is already half destroyed, so don't use it in any way
+    // other than comparing pointers.
+
+    for ( int i = _running.size() - 1; i >= 0; --i )
+    {
+        if ( (QObject *) _running.at( i ) == obj )
+            _running.removeAt( i );
+    }
+
+    for ( int i = _waiting.size() - 1; i >= 0; --i )
+    {
+        if ( (QObject *) _waiting.at( i ) == obj )
+            _waiting.removeAt( i );
+    }
+}
+
+
+void ProcessStarter::done( Process * process )
+{
+    if ( ! _running.contains( process ) )
+        return;
+
     _running.removeAll( process );
     _waiting.removeAll( process ); // It shouldn't be in _waiting; just making sure
 
+    _windowLatency += _timer.elapsed() - _startTime.take( process );
+    ++_windowFinished;
+    adapt();
+
     if ( _started )
     {
         if ( _waiting.isEmpty() )
@@ -97,3 +212,42 @@ void ProcessStarter::processFinished( int                  exitCode,
         }
     }
 }
+
+
+void ProcessStarter::adapt()
+{
+    if ( _windowFinished < qMax( _parallel, ADAPT_MIN_FINISHED ) )
+        return;
+
+    qint64 now        = _timer.elapsed();
+    qint64 millisec   = qMax( now - _windowStart, (qint64) 1 );
+    double throughput = ( 1000.0 * _windowFinished ) / millisec;
+    qint64 latency    = _windowLatency / _windowFinished;
+
+    // Turn around if that did not improve anything
+
+    if ( throughput <= _lastThroughput * ( 1.0 + ADAPT_TOLERANCE ) )
+        _direction = -_direction;
+
+    int limit = parallelLimit();
+
+    if ( latency < SHORT_PROCESS_MILLISEC )
+        limit = qMin( limit, cpuCount() );
+
+    int parallel = qBound( 1, _parallel + _direction, qMax( limit, 1 ) );
+
+    if ( parallel != _parallel )
+    {
+        logDebug() << qRound( throughput ) << " processes/sec, "
+                   << latency << " ms each: "
+                   << _parallel << " -> " << parallel
+                   << " parallel processes" << endl;
+
+        _parallel = parallel;
+    }
+
+    _lastThroughput = throughput;
+    _windowStart    = now;
+    _windowLatency  = 0;
+    _windowFinished = 0;
+}
@@ -12,6 +12,8 @@
 
 #include <QObject>
 #include <QList>
+#include <QHash>
+#include <QElapsedTimer>
 
 #include "Process.h"
 
@@ -23,6 +25,15 @@ namespace QDirStat
      * the number of processes running in parallel. Whenever a process
      * finishes, the next one from the list is started.
      *
+     * The number of processes running in parallel adapts itself to what
+     * works best on this machine: It starts with the number of CPU cores,
+     * and whenever a number of processes finished, it measures how many
+     * processes per second finished. If that got better than the last time,
+     * it continues in the same direction (one more or one less parallel
+     * process), otherwise it turns around. Very short processes are limited
+     * to the number of CPU cores since they are dominated by the process
+     * startup, so more of them would only compete for the CPU.
+     *
      * When all processes are started and the 'autoDelete' flag is set, this
      * class will delete itself.
      **/
@@ -53,14 +64,30 @@ namespace QDirStat
         void start();
 
         /**
-         * Return the maximum number of processes running in parallel.
+         * Remove all processes that are not started yet. They are not
+         * deleted, and they will never be started by this object.
+         **/
+        void clear();
+
+        /**
+         * Return the upper limit for the number of processes running in
+         * parallel. 0 means to choose that automatically from the number of
+         * CPU cores.
          **/
         int maxParallel() const { return _maxParallel; }
 
         /**
-         * Set the maximum number of processes running in parallel.
+         * Set the upper limit for the number of processes running in
+         * parallel. 0 (the default) means to choose that automatically from
+         * the number of CPU cores. 1 runs the processes one after another.
+         **/
+        void setMaxParallel( int newVal );
+
+        /**
+         * Return the current number of processes running in parallel as it
+         * was adapted so far.
          **/
-        void setMaxParallel( int newVal ) { _maxParallel = newVal; }
+        int parallel() const { return _parallel; }
 
         /**
          * Return 'true' if this object will automatically delete itself when
@@ -76,6 +103,14 @@ namespace QDirStat
         void setAutoDelete( bool newVal ) { _autoDelete = newVal; }
 
 
+    signals:
+
+        /**
+         * Emitted just before 'process' is started.
+         **/
+        void startingProcess( Process * process );
+
+
     protected slots:
 
         /**
@@ -84,20 +119,62 @@ namespace QDirStat
         void processFinished( int                  exitCode,
                               QProcess::ExitStatus exitStatus );
 
+        /**
+         * Notification that a process reported an error. If it could not
+         * even be started, this is handled like processFinished() since
+         * there will be no 'finished' signal.
+         **/
+        void processError( QProcess::ProcessError error );
+
+        /**
+         * Notification that a process object is destroyed.
+         **/
+        void processDestroyed( QObject * obj );
+
     protected:
 
         /**
-         * Start more processes until the limit (_maxParallel) is reached.
+         * Start more processes until the current limit (_parallel) is
+         * reached.
          **/
         void startProcesses();
 
+        /**
+         * Take 'process' off the list of running processes and start more
+         * if there are any left.
+         **/
+        void done( Process * process );
+
+        /**
+         * Adapt the current number of parallel processes to the throughput
+         * since the last time.
+         **/
+        void adapt();
+
+        /**
+         * Return the upper limit for _parallel.
+         **/
+        int parallelLimit() const;
+
+
         // Data members
 
-        int              _maxParallel;
-        bool             _autoDelete;
-        bool             _started;
-        QList<Process *> _running;
-        QList<Process *> _waiting;
+        int                       _maxParallel;
+        int                       _parallel;
+        int                       _direction;
+        bool                      _autoDelete;
+        bool                      _started;
+        QList<Process *>          _running;
+        QList<Process *>          _waiting;
+
+        // Statistics for adapting _parallel
+
+        QElapsedTimer             _timer;
+        QHash<Process *, qint64>  _startTime;
+        qint64                    _windowStart;
+        qint64                    _windowLatency;
+        int                       _windowFinished;
+        double                    _lastThroughput;
     };
 }
 
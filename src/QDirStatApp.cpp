@@ -131,7 +131,12 @@ FileInfo * QDirStatApp::selectedDirInfoOrRoot() const
 {
     FileInfo * sel = selectedDirInfo();
 
-    return sel ? sel : root();
+    if ( sel )
+	return sel;
+
+    // All toplevel items if several directories were opened together
+
+    return dirTree() ? dirTree()->visibleRoot() : 0;
 }
 
 
@@ -164,7 +164,7 @@ namespace QDirStat
         /**
          * Return the first selected (which may also be a PkgInfo, Attic or
          * DotEntry) from the SelectionModel or, if none is selected, the
-         * DirTree's root directory.
+         * DirTree's root directory (see DirTree::visibleRoot()).
          *
          * Notice that this might still return 0 if the tree is completely
          * empty.
@@ -0,0 +1,203 @@
+/*
+ *   File name: QuantileSketch.cpp
+ *   Summary:	Statistics classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <math.h>	// log(), pow(), ceil()
+
+#include "QuantileSketch.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+QuantileSketch::QuantileSketch( double relativeAccuracy )
+{
+    if ( relativeAccuracy <= 0.0 || relativeAccuracy >= 1.0 )
+    {
+	logError() << "Invalid relative accuracy " << relativeAccuracy << endl;
+	relativeAccuracy = 0.01;
+    }
+
+    _gamma    = ( 1.0 + relativeAccuracy ) / ( 1.0 - relativeAccuracy );
+    _logGamma = log( _gamma );
+
+    clear();
+}
+
+
+void QuantileSketch::clear()
+{
+    _offset    = 0;
+    _counts.clear();
+    _sums.clear();
+    _zeroCount = 0;
+    _zeroSum   = 0.0;
+    _count     = 0;
+    _sum       = 0.0;
+    _min       = 0.0;
+    _max       = 0.0;
+}
+
+
+int QuantileSketch::key( double value ) const
+{
+    // Bucket 'key' holds the values in ( gamma^(key-1), gamma^key ]
+
+    return (int) ceil( log( value ) / _logGamma );
+}
+
+
+void QuantileSketch::add( double value )
+{
+    if ( _count == 0 )
+    {
+	_min = value;
+	_max = value;
+    }
+    else
+    {
+	_min = qMin( _min, value );
+	_max = qMax( _max, value );
+    }
+
+    ++_count;
+    _sum += value;
+
+    if ( value <= 0.0 )
+    {
+	++_zeroCount;
+	_zeroSum += value;
+
+	return;
+    }
+
+    int k = key( value );
+
+    if ( _counts.isEmpty() )
+    {
+	_offset = k;
+    }
+    else if ( k < _offset )
+    {
+	// Grow the buckets at the front
+
+	int grow = _offset - k;
+	_counts.insert( 0, grow, 0 );
+	_sums.insert  ( 0, grow, 0.0 );
+	_offset = k;
+    }
+
+    int index = k - _offset;
+
+    if ( index >= _counts.size() )
+    {
+	_counts.resize( index + 1 );
+	_sums.resize  ( index + 1 );
+    }
+
+    ++_counts[ index ];
+    _sums[ index ] += value;
+}
+
+
+void QuantileSketch::merge( const QuantileSketch & other )
+{
+    if ( other._gamma != _gamma )
+	THROW( Exception( "Cannot merge quantile sketches with different accuracy" ) );
+
+    if ( other.isEmpty() )
+	return;
+
+    if ( isEmpty() )
+    {
+	*this = other;
+	return;
+    }
+
+    _min	= qMin( _min, other._min );
+    _max	= qMax( _max, other._max );
+    _count     += other._count;
+    _sum       += other._sum;
+    _zeroCount += other._zeroCount;
+    _zeroSum   += other._zeroSum;
+
+    if ( other._counts.isEmpty() )
+	return;
+
+    if ( _counts.isEmpty() )
+    {
+	_offset = other._offset;
+	_counts = other._counts;
+	_sums	= other._sums;
+
+	return;
+    }
+
+    if ( other._offset < _offset )
+    {
+	int grow = _offset - other._offset;
+	_counts.insert( 0, grow, 0 );
+	_sums.insert  ( 0, grow, 0.0 );
+	_offset = other._offset;
+    }
+
+    int start = other._offset - _offset;
+    int end   = start + other._counts.size();
+
+    if ( end > _counts.size() )
+    {
+	_counts.resize( end );
+	_sums.resize  ( end );
+    }
+
+    for ( int i = 0; i < other._counts.size(); ++i )
+    {
+	_counts[ start + i ] += other._counts.at( i );
+	_sums  [ start + i ] += other._sums.at( i );
+    }
+}
+
+
+double QuantileSketch::bucketValue( int index ) const
+{
+    if ( index == 0 )
+	return _zeroCount > 0 ? _zeroSum / _zeroCount : 0.0;
+
+    // The value with the same relative error to both bucket boundaries
+
+    double value = 2.0 * pow( _gamma, _offset + index - 1 ) / ( _gamma + 1.0 );
+
+    return qBound( _min, value, _max );
+}
+
+
+double QuantileSketch::valueAtRank( qint64 rank ) const
+{
+    if ( isEmpty() )
+	return 0.0;
+
+    if ( rank <= 0 )
+	return _min;
+
+    if ( rank >= _count - 1 )
+	return _max;
+
+    qint64 seen = 0;
+
+    for ( int i = 0; i < bucketCount(); ++i )
+    {
+	seen += bucketItems( i );
+
+	if ( seen > rank )
+	    return bucketValue( i );
+    }
+
+    return _max;
+}
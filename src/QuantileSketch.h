@@ -0,0 +1,140 @@
+/*
+ *   File name: QuantileSketch.h
+ *   Summary:	Statistics classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef QuantileSketch_h
+#define QuantileSketch_h
+
+
+#include <QVector>
+
+
+namespace QDirStat
+{
+    /**
+     * Approximate distribution of a large number of non-negative values with
+     * bounded memory for calculating quantiles (a "DDSketch").
+     *
+     * Each value is counted in a bucket with logarithmically growing
+     * boundaries, so any quantile returned by this is within the relative
+     * accuracy of the true value: With the default accuracy of 1%, a median
+     * of 2.00 MB could be reported as anything between 1.98 MB and 2.02 MB.
+     *
+     * The number of buckets only depends on the range of the values, not on
+     * their number: For file sizes from 1 byte to 8 EB, it is at most about
+     * 2200 buckets with 1% accuracy. Values of zero or less all go into one
+     * extra bucket.
+     *
+     * Sketches with the same accuracy can be merged, so parts of a tree can
+     * be collected separately.
+     **/
+    class QuantileSketch
+    {
+    public:
+
+	/**
+	 * Constructor. 'relativeAccuracy' is the maximum relative error of
+	 * the quantiles, e.g. 0.01 for 1%.
+	 **/
+	QuantileSketch( double relativeAccuracy = 0.01 );
+
+	/**
+	 * Clear all data.
+	 **/
+	void clear();
+
+	/**
+	 * Add one value.
+	 **/
+	void add( double value );
+
+	/**
+	 * Add all values of 'other'. Both sketches need to have the same
+	 * relative accuracy.
+	 **/
+	void merge( const QuantileSketch & other );
+
+	/**
+	 * Return the number of values.
+	 **/
+	qint64 count() const { return _count; }
+
+	/**
+	 * Return 'true' if there are no values.
+	 **/
+	bool isEmpty() const { return _count == 0; }
+
+	/**
+	 * Return the exact sum of all values.
+	 **/
+	double sum() const { return _sum; }
+
+	/**
+	 * Return the exact minimum and maximum values.
+	 **/
+	double min() const { return _min; }
+	double max() const { return _max; }
+
+	/**
+	 * Return the approximate value with rank 'rank' (0 .. count()-1) if
+	 * all values were sorted in ascending order.
+	 **/
+	double valueAtRank( qint64 rank ) const;
+
+	/**
+	 * Return the number of buckets including the one for values of zero
+	 * or less, which is always the first one. The buckets are sorted by
+	 * value in ascending order.
+	 **/
+	int bucketCount() const { return _counts.size() + 1; }
+
+	/**
+	 * Return the number of values in bucket no. 'index'.
+	 **/
+	qint64 bucketItems( int index ) const
+	    { return index == 0 ? _zeroCount : _counts.at( index - 1 ); }
+
+	/**
+	 * Return the exact sum of the values in bucket no. 'index'.
+	 **/
+	double bucketSum( int index ) const
+	    { return index == 0 ? _zeroSum : _sums.at( index - 1 ); }
+
+	/**
+	 * Return the value that represents all values of bucket no. 'index'.
+	 **/
+	double bucketValue( int index ) const;
+
+    protected:
+
+	/**
+	 * Return the bucket key for a value greater than zero.
+	 **/
+	int key( double value ) const;
+
+
+	// Data members
+
+	double		_gamma;
+	double		_logGamma;
+	int		_offset;	// Key of _counts[ 0 ]
+	QVector<qint64> _counts;
+	QVector<double> _sums;
+	qint64		_zeroCount;
+	double		_zeroSum;
+	qint64		_count;
+	double		_sum;
+	double		_min;
+	double		_max;
+
+    };	// class QuantileSketch
+
+}	// namespace QDirStat
+
+
+#endif // ifndef QuantileSketch_h
@@ -56,7 +56,11 @@ namespace QDirStat
     public slots:
 
 	/**
-	 * Refresh all subtrees in the internal FileInfoSet.
+	 * Refresh all subtrees in the internal FileInfoSet as one batch (see
+	 * DirTree::refresh( const FileInfoSet & )), so refreshing after a
+	 * cleanup of many items costs about the same as refreshing one
+	 * subtree.
+	 *
 	 * After this is done, this object will delete itself.
 	 **/
 	void refresh();
@@ -0,0 +1,1201 @@
+/*
+ *   File name: RemoteScan.cpp
+ *   Summary:	Scanning directories on another machine over SSH
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <errno.h>
+#include <poll.h>	// poll()
+#include <signal.h>	// signal(), SIGPIPE
+#include <string.h>	// memcmp(), memcpy(), memset()
+#include <unistd.h>	// read(), write()
+
+#include <iostream>	// cerr
+
+#include <QDir>
+#include <QFileInfo>
+
+#include "RemoteScan.h"
+#include "DirInfo.h"
+#include "DirScanner.h"
+#include "DirTree.h"
+#include "ExcludeRules.h"
+#include "MountPoints.h"
+#include "Process.h"
+#include "RemoteScanCoordinator.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// The agent on the remote machine
+
+#define REMOTE_AGENT_COMMAND	"qdirstat"
+
+// The agent sends its output when this much has accumulated or when the
+// oldest part of it is waiting for this long, whichever comes first.
+
+#define AGENT_BUFFER_SIZE	(64*1024)
+#define AGENT_FLUSH_MILLISEC	200
+
+// Like in FileInfo.cpp: Only files with less blocks than this below their
+// size are sparse files.
+
+#define FRAGMENT_SIZE		2048
+
+// Number of records to add to the tree in one time slice
+
+#define MAX_RECORDS_PER_SLICE	1000
+
+// An agent that had nothing to hand over is not asked again for this long
+
+#define DONATION_RETRY_MILLISEC	500
+
+// Longer names than this can only come from a corrupt stream
+
+#define MAX_NAME_LENGTH		(64*1024)
+
+
+using namespace QDirStat;
+using std::cerr;
+
+
+int RemoteScanAgent::run( const QString & rawDir, int fd )
+{
+    // Get EPIPE from write() rather than being killed if the other side is
+    // gone
+
+    signal( SIGPIPE, SIG_IGN );
+
+    QByteArray  dir = QDir::cleanPath( QFileInfo( rawDir ).absoluteFilePath() ).toUtf8();
+    struct stat statInfo;
+
+    if ( lstat( dir.constData(), &statInfo ) != 0 || ! S_ISDIR( statInfo.st_mode ) )
+    {
+	cerr << "qdirstat --agent: Not a directory: " << dir.constData() << std::endl;
+	return 1;
+    }
+
+    logInfo() << "Remote scan agent reading " << dir << endl;
+
+    RemoteScanAgent agent( fd );
+
+    agent.writeHeader();
+
+    // Depth first without recursion: A deep tree must not overflow the stack
+
+    QVector<OpenDir> openDirs;
+    agent.readDir( dir, dir, statInfo, openDirs );
+
+    while ( ! openDirs.isEmpty() && agent._ok )
+	agent.step( openDirs );
+
+    agent.flush();
+
+    if ( ! agent._ok )
+    {
+	logError() << "Remote scan agent: Write error: " << strerror( errno ) << endl;
+	return 1;
+    }
+
+    logInfo() << "Remote scan agent finished" << endl;
+
+    return 0;
+}
+
+
+int RemoteScanAgent::runServer( int inFd, int outFd )
+{
+    signal( SIGPIPE, SIG_IGN );
+
+    logInfo() << "Remote scan agent server started" << endl;
+
+    RemoteScanAgent agent( outFd );
+    agent._inFd = inFd;
+
+    agent.writeHeader();
+
+    QVector<OpenDir> openDirs;
+
+    while ( agent._ok )
+    {
+	if ( openDirs.isEmpty() )
+	{
+	    agent.readCommands( true, openDirs );	// wait for the next one
+
+	    if ( openDirs.isEmpty() )			// stdin closed
+		break;
+	}
+	else
+	{
+	    // Check for "donate" after each directory: The coordinator only
+	    // asks when another agent is idle.
+
+	    agent.readCommands( false, openDirs );
+	}
+
+	if ( ! openDirs.isEmpty() )
+	    agent.step( openDirs );
+    }
+
+    agent.flush();
+
+    if ( ! agent._ok )
+    {
+	logError() << "Remote scan agent: Write error: " << strerror( errno ) << endl;
+	return 1;
+    }
+
+    logInfo() << "Remote scan agent server finished" << endl;
+
+    return 0;
+}
+
+
+RemoteScanAgent::RemoteScanAgent( int fd ):
+    _fd( fd ),
+    _ok( true ),
+    _inFd( -1 ),
+    _inputClosed( false )
+{
+    _buffer.reserve( AGENT_BUFFER_SIZE + MAX_NAME_LENGTH );
+    _sinceFlush.start();
+}
+
+
+void RemoteScanAgent::readDir( const QByteArray  & path,
+			       const QByteArray	 & name,
+			       const struct stat & statInfo,
+			       QVector<OpenDir>	 & openDirs )
+{
+    DirScanResult scanResult;
+    DirScanner::scanDir( path, scanResult );
+
+    switch ( scanResult.status )
+    {
+	case DirScanResult::ScanPermissionDenied:
+	    writeRecord( statInfo, name, RemotePermissionDenied );
+	    return;
+
+	case DirScanResult::ScanOpenDirError:
+	    writeRecord( statInfo, name, RemoteReadError );
+	    return;
+
+	case DirScanResult::ScanOk:
+	    break;
+    }
+
+    writeRecord( statInfo, name );
+
+    OpenDir openDir;
+    openDir.path   = path;
+    openDir.device = statInfo.st_dev;
+
+    foreach ( const DirScanEntry & entry, scanResult.entries )
+    {
+	if ( entry.statErrno != 0 )	// fstatat() failed
+	    continue;
+
+	QByteArray entryName( scanResult.name( entry ), entry.nameLength );
+
+	if ( S_ISDIR( entry.statInfo.st_mode ) )
+	{
+	    SubDir subDir;
+	    subDir.name	    = entryName;
+	    subDir.statInfo = entry.statInfo;
+
+	    openDir.subDirs << subDir;
+	}
+	else
+	{
+	    writeRecord( entry.statInfo, entryName );
+	}
+    }
+
+    openDirs << openDir;
+}
+
+
+void RemoteScanAgent::step( QVector<OpenDir> & openDirs )
+{
+    OpenDir & openDir = openDirs.last();
+
+    if ( openDir.next < openDir.subDirs.size() )
+    {
+	// Copy this: readDir() might reallocate 'openDirs'
+
+	SubDir	   subDir = openDir.subDirs.at( openDir.next++ );
+	QByteArray path	  = subPath( openDir.path, subDir.name );
+	dev_t	   device = openDir.device;
+
+	// A different device number without a mount point is a Btrfs
+	// subvolume; that is read just like any other directory.
+
+	if ( subDir.statInfo.st_dev != device &&
+	     MountPoints::findByPath( QString::fromUtf8( path ) ) )
+	{
+	    writeRecord( subDir.statInfo, subDir.name, RemoteMountPoint );
+	}
+	else
+	{
+	    readDir( path, subDir.name, subDir.statInfo, openDirs );
+	}
+    }
+    else
+    {
+	writeEndRecord();
+	openDirs.pop_back();
+    }
+}
+
+
+void RemoteScanAgent::donate( QVector<OpenDir> & openDirs )
+{
+    int donated = 0;
+
+    // The topmost directories have the largest subtrees left, so handing
+    // over from there splits the remaining work best.
+
+    for ( int i=0; i < openDirs.size() && donated == 0; ++i )
+    {
+	OpenDir & openDir = openDirs[i];
+	int	  unread  = openDir.subDirs.size() - openDir.next;
+
+	// The next one of the innermost directory is read right away anyway
+
+	if ( unread < 1 || ( i == openDirs.size() - 1 && unread < 2 ) )
+	    continue;
+
+	int		keep = openDir.subDirs.size() - ( unread + 1 ) / 2;
+	QVector<SubDir> kept = openDir.subDirs.mid( 0, keep );
+
+	for ( int j = keep; j < openDir.subDirs.size(); ++j )
+	{
+	    const SubDir & subDir = openDir.subDirs.at( j );
+
+	    // Leave anything that might be a mount point to this agent
+
+	    if ( subDir.statInfo.st_dev != openDir.device )
+	    {
+		kept << subDir;
+	    }
+	    else
+	    {
+		writeRecord( subDir.statInfo, subPath( openDir.path, subDir.name ), RemoteDonated );
+		++donated;
+	    }
+	}
+
+	openDir.subDirs = kept;
+    }
+
+    writeEndRecord( RemoteDonationEnd );
+    flush();
+}
+
+
+void RemoteScanAgent::readCommands( bool wait, QVector<OpenDir> & openDirs )
+{
+    do
+    {
+	bool haveInput = wait;
+
+	if ( ! wait )
+	{
+	    struct pollfd pollFd;
+	    pollFd.fd	  = _inFd;
+	    pollFd.events  = POLLIN;
+	    pollFd.revents = 0;
+
+	    haveInput = poll( &pollFd, 1, 0 ) > 0;
+	}
+
+	if ( haveInput && ! _inputClosed )
+	{
+	    // Everything for the last command needs to be out before waiting
+	    // for the next one
+
+	    if ( wait )
+		flush();
+
+	    char    buf[ 4096 ];
+	    ssize_t len = ::read( _inFd, buf, sizeof( buf ) );
+
+	    if ( len > 0 )
+		_input.append( buf, len );
+	    else if ( len == 0 || errno != EINTR )
+		_inputClosed = true;
+	}
+
+	int pos;
+
+	while ( ( pos = _input.indexOf( '\n' ) ) >= 0 )
+	{
+	    QByteArray line = _input.left( pos );
+	    _input.remove( 0, pos + 1 );
+	    command( line, openDirs );
+	}
+    }
+    while ( wait && openDirs.isEmpty() && ! _inputClosed && _ok );
+}
+
+
+void RemoteScanAgent::command( const QByteArray & line, QVector<OpenDir> & openDirs )
+{
+    if ( line == "donate" )
+    {
+	donate( openDirs );
+    }
+    else if ( line.startsWith( "scan /" ) && openDirs.isEmpty() )
+    {
+	QByteArray  path = line.mid( 5 );
+	struct stat statInfo;
+
+	if ( lstat( path.constData(), &statInfo ) != 0 || ! S_ISDIR( statInfo.st_mode ) )
+	{
+	    // Answer anyway: The other side waits for this subtree
+
+	    memset( &statInfo, 0, sizeof( statInfo ) );
+	    statInfo.st_mode = S_IFDIR;
+	    writeRecord( statInfo, path, RemoteReadError );
+	}
+	else
+	{
+	    readDir( path, path, statInfo, openDirs );
+	}
+    }
+    else
+    {
+	logError() << "Remote scan agent: Bad command \"" << line << "\"" << endl;
+    }
+}
+
+
+QByteArray RemoteScanAgent::subPath( const QByteArray & dir, const QByteArray & name )
+{
+    QByteArray path = dir;
+
+    if ( ! path.endsWith( '/' ) )
+	path += '/';
+
+    return path + name;
+}
+
+
+void RemoteScanAgent::writeHeader()
+{
+    BinaryCacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, BINARY_CACHE_MAGIC, sizeof( header.magic ) );
+    header.version	 = BINARY_CACHE_VERSION;
+    header.byteOrderMark = BINARY_CACHE_BOM;
+    header.flags	 = BinaryCacheWithUidGidPerm | BinaryCacheStream;
+    header.recordSize	 = sizeof( BinaryCacheRecord );
+
+    write( &header, sizeof( header ) );
+}
+
+
+void RemoteScanAgent::writeRecord( const struct stat & statInfo,
+				   const QByteArray  & name,
+				   quint32	       flags )
+{
+    BinaryCacheRecord rec;
+    memset( &rec, 0, sizeof( rec ) );
+
+    // Just like in a cache file, blocks are only there for sparse files
+
+    bool sparse = S_ISREG( statInfo.st_mode ) &&
+	statInfo.st_blocks * STD_BLOCK_SIZE + FRAGMENT_SIZE < statInfo.st_size;
+
+    rec.size	   = statInfo.st_size;
+    rec.blocks	   = sparse ? statInfo.st_blocks : -1;
+    rec.mtime	   = statInfo.st_mtime;
+    rec.nameLength = name.size();
+    rec.mode	   = statInfo.st_mode;
+    rec.uid	   = statInfo.st_uid;
+    rec.gid	   = statInfo.st_gid;
+    rec.links	   = statInfo.st_nlink;
+    rec.reserved   = flags;
+
+    write( &rec, sizeof( rec ) );
+    write( name.constData(), name.size() );
+}
+
+
+void RemoteScanAgent::writeEndRecord( quint32 flags )
+{
+    BinaryCacheRecord rec;
+    memset( &rec, 0, sizeof( rec ) );
+    rec.reserved = flags;
+
+    write( &rec, sizeof( rec ) );
+}
+
+
+void RemoteScanAgent::write( const void * data, int size )
+{
+    _buffer.append( (const char *) data, size );
+
+    if ( _buffer.size() >= AGENT_BUFFER_SIZE ||
+	 _sinceFlush.elapsed() >= AGENT_FLUSH_MILLISEC )
+    {
+	flush();
+    }
+}
+
+
+void RemoteScanAgent::flush()
+{
+    const char * data = _buffer.constData();
+    int		 left = _buffer.size();
+
+    while ( left > 0 && _ok )
+    {
+	ssize_t written = ::write( _fd, data, left );
+
+	if ( written < 0 )
+	{
+	    if ( errno != EINTR )
+		_ok = false;
+	}
+	else
+	{
+	    data += written;
+	    left -= written;
+	}
+    }
+
+    _buffer.clear();
+    _sinceFlush.restart();
+}
+
+
+
+
+RemoteReadJob::RemoteReadJob( DirTree * tree, const QString & url ):
+    ObjDirReadJob( tree, 0 ),
+    _url( url ),
+    _process( 0 ),
+    _pos( 0 ),
+    _haveHeader( false ),
+    _withUidGidPerm( false ),
+    _waiting( false ),
+    _processDone( false ),
+    _complete( false ),
+    _ok( true ),
+    _toplevel( 0 ),
+    _coordinator( 0 ),
+    _unitDir( 0 ),
+    _inUnit( true ),
+    _unitRecords( 0 ),
+    _donating( false ),
+    _donated( 0 )
+{
+    RemoteHostList hosts;
+    parseUrl( url, hosts, _remoteDir );
+
+    if ( ! hosts.isEmpty() )
+	_host = hosts.first();
+}
+
+
+RemoteReadJob::RemoteReadJob( DirTree		    * tree,
+			      const QString	    & url,
+			      const RemoteHost	    & host,
+			      RemoteScanCoordinator * coordinator ):
+    ObjDirReadJob( tree, 0 ),
+    _url( url ),
+    _host( host ),
+    _process( 0 ),
+    _pos( 0 ),
+    _haveHeader( false ),
+    _withUidGidPerm( false ),
+    _waiting( false ),
+    _processDone( false ),
+    _complete( false ),
+    _ok( true ),
+    _toplevel( 0 ),
+    _coordinator( coordinator ),
+    _unitDir( 0 ),
+    _inUnit( false ),
+    _unitRecords( 0 ),
+    _donating( false ),
+    _donated( 0 )
+{
+    RemoteHostList hosts;
+    parseUrl( url, hosts, _remoteDir );
+}
+
+
+RemoteReadJob::~RemoteReadJob()
+{
+    if ( _process )
+    {
+	_process->disconnect( this );
+	_process->kill();
+	_process->waitForFinished( 1000 );
+	delete _process;
+    }
+
+    if ( _unitDir && ! _tree->beingDestroyed() )
+    {
+	// Reading was aborted while this agent was reading a subtree
+
+	_unitDir->readJobAborted( _unitDir );
+	_unitDir->readJobFinished( _unitDir );
+    }
+
+    if ( _coordinator )
+	_coordinator->jobDone( this );
+}
+
+
+bool RemoteReadJob::isRemoteUrl( const QString & url )
+{
+    RemoteHostList hosts;
+    QString	   path;
+
+    return parseUrl( url, hosts, path );
+}
+
+
+bool RemoteReadJob::parseUrl( const QString  & url,
+			      RemoteHostList & hosts_ret,
+			      QString	     & path_ret )
+{
+    // QUrl can't handle a list of hosts, so this is done here
+
+    hosts_ret.clear();
+    path_ret.clear();
+
+    QString prefix = REMOTE_URL_SCHEME "://";
+
+    if ( ! url.startsWith( prefix ) )
+	return false;
+
+    int pathStart = url.indexOf( '/', prefix.size() );
+
+    if ( pathStart < 0 )
+	return false;
+
+    QStringList authorities = url.mid( prefix.size(), pathStart - prefix.size() ).split( ',' );
+
+    foreach ( const QString & authority, authorities )
+    {
+	RemoteHost remoteHost;
+	int	   colon = authority.lastIndexOf( ':' );
+
+	remoteHost.host = colon < 0 ? authority : authority.left( colon );
+
+	if ( colon >= 0 )
+	{
+	    bool ok = false;
+	    remoteHost.port = authority.mid( colon + 1 ).toInt( &ok );
+
+	    if ( ! ok || remoteHost.port <= 0 )
+		return false;
+	}
+
+	if ( remoteHost.host.isEmpty() || remoteHost.host.endsWith( '@' ) )
+	    return false;
+
+	// ssh would take something like "-oProxyCommand=..." as an option
+
+	if ( remoteHost.host.startsWith( '-' ) ||
+	     remoteHost.host.mid( remoteHost.host.lastIndexOf( '@' ) + 1 ).startsWith( '-' ) )
+	{
+	    return false;
+	}
+
+	hosts_ret << remoteHost;
+    }
+
+    path_ret = QDir::cleanPath( url.mid( pathStart ) );
+
+    return true;
+}
+
+
+bool RemoteReadJob::startAgent()
+{
+    QStringList args;
+
+    // No terminal, and never ask for a password: There is nobody to answer
+
+    args << "-T" << "-o" << "BatchMode=yes";
+
+    if ( _host.port > 0 )
+	args << "-p" << QString::number( _host.port );
+
+    // No more options after this, whatever the host name looks like
+
+    args << "--" << _host.host;
+
+    if ( _coordinator )
+    {
+	args << REMOTE_AGENT_COMMAND " --agent-server";
+    }
+    else
+    {
+	// The remote shell gets the command as one string
+
+	QString dir = _remoteDir;
+	dir.replace( "'", "'\\''" );
+
+	args << QString( REMOTE_AGENT_COMMAND " --agent '" ) + dir + "'";
+    }
+
+    _process = new Process();
+    CHECK_NEW( _process );
+
+    _process->setProgram( "ssh" );
+    _process->setArguments( args );
+
+    connect( _process, SIGNAL( readyReadStandardOutput() ),
+	     this,     SLOT  ( readyRead()		 ) );
+
+    connect( _process, SIGNAL( finished	       ( int, QProcess::ExitStatus ) ),
+	     this,     SLOT  ( processFinished() ) );
+
+    connect( _process, SIGNAL( error	       ( QProcess::ProcessError ) ),
+	     this,     SLOT  ( processError( QProcess::ProcessError ) ) );
+
+    logInfo() << "Starting remote scan: ssh " << args.join( " " ) << endl;
+    _process->start();
+
+    // QProcess keeps this until the process is running
+
+    if ( ! _commands.isEmpty() )
+    {
+	_process->write( _commands );
+	_commands.clear();
+    }
+
+    return true;
+}
+
+
+void RemoteReadJob::scan( const QString & path, DirInfo * dir )
+{
+    _unitDir	 = dir;
+    _inUnit	 = true;
+    _unitRecords = 0;
+
+    sendCommand( "scan " + path.toUtf8() );
+}
+
+
+void RemoteReadJob::requestDonation()
+{
+    if ( _donating )
+	return;
+
+    _donating = true;
+    _donated  = 0;
+    sendCommand( "donate" );
+}
+
+
+bool RemoteReadJob::canDonate() const
+{
+    if ( ! _inUnit || _donating )
+	return false;
+
+    return ! _sinceNoDonation.isValid() ||
+	_sinceNoDonation.elapsed() >= DONATION_RETRY_MILLISEC;
+}
+
+
+void RemoteReadJob::sendCommand( const QByteArray & command )
+{
+    if ( _process )
+	_process->write( command + "\n" );
+    else
+	_commands += command + "\n";
+}
+
+
+void RemoteReadJob::quit()
+{
+    if ( _complete )
+	return;
+
+    _complete = true;
+
+    if ( _process )
+	_process->closeWriteChannel();	// The agent exits when stdin is closed
+
+    stopWaiting();
+}
+
+
+void RemoteReadJob::read()
+{
+    /*
+     * This will be called repeatedly from DirReadJobQueue::timeSlicedRead()
+     * until finished() is called.
+     */
+
+    if ( ! _process )
+    {
+	if ( ! startAgent() )
+	{
+	    finished();
+	    return;
+	}
+
+	waitForData();
+	return;
+    }
+
+    int	 count	  = 0;
+    bool needData = false;
+
+    while ( _ok && ! _complete && count < MAX_RECORDS_PER_SLICE )
+    {
+	if ( ! ( _haveHeader ? readRecord() : readHeader() ) )
+	{
+	    needData = true;
+	    break;
+	}
+
+	++count;
+    }
+
+    if ( _pos > 0 )	// Drop what is already in the tree
+    {
+	_buffer.remove( 0, _pos );
+	_pos = 0;
+    }
+
+    if ( _ok && ! _complete && needData )
+    {
+	if ( ! _processDone )
+	{
+	    waitForData();
+	    return;
+	}
+
+	error( "Connection closed before the scan was complete" );
+    }
+
+    if ( _complete )
+	logInfo() << "Remote scan of " << _url << " on " << _host.host << " finished" << endl;
+
+    if ( _complete || ! _ok )
+	finished();
+
+    // Don't add anything after finished() since this deletes this job!
+}
+
+
+bool RemoteReadJob::readHeader()
+{
+    if ( _buffer.size() - _pos < (int) sizeof( BinaryCacheHeader ) )
+	return false;
+
+    BinaryCacheHeader header;
+    memcpy( &header, _buffer.constData() + _pos, sizeof( header ) );
+
+    if ( memcmp( header.magic, BINARY_CACHE_MAGIC, sizeof( header.magic ) ) != 0 )
+    {
+	error( "No remote scan data (is " REMOTE_AGENT_COMMAND " installed there?)" );
+	return false;
+    }
+
+    if ( header.byteOrderMark != BINARY_CACHE_BOM )
+    {
+	error( "The remote machine has a different byte order" );
+	return false;
+    }
+
+    if ( header.version	   != BINARY_CACHE_VERSION	||
+	 header.recordSize != sizeof( BinaryCacheRecord ) ||
+	 ! ( header.flags & BinaryCacheStream ) )
+    {
+	error( QString( "Unsupported remote scan data version %1" ).arg( header.version ) );
+	return false;
+    }
+
+    _withUidGidPerm = header.flags & BinaryCacheWithUidGidPerm;
+    _haveHeader	    = true;
+    _pos	   += sizeof( header );
+
+    return true;
+}
+
+
+bool RemoteReadJob::readRecord()
+{
+    if ( _buffer.size() - _pos < (int) sizeof( BinaryCacheRecord ) )
+	return false;
+
+    BinaryCacheRecord rec;
+    memcpy( &rec, _buffer.constData() + _pos, sizeof( rec ) );
+
+    if ( rec.nameLength > MAX_NAME_LENGTH )
+    {
+	error( "Corrupt record" );
+	return true;
+    }
+
+    if ( _buffer.size() - _pos < (int) ( sizeof( rec ) + rec.nameLength ) )
+	return false;
+
+    QString name = QString::fromUtf8( _buffer.constData() + _pos + sizeof( rec ),
+				      rec.nameLength );
+    _pos += sizeof( rec ) + rec.nameLength;
+
+    if ( rec.nameLength == 0 )
+    {
+	if ( rec.reserved & RemoteDonationEnd )
+	{
+	    // The agent is done with handing over directories
+
+	    _donating = false;
+
+	    if ( _donated == 0 )
+		_sinceNoDonation.start();
+	    else
+		_sinceNoDonation.invalidate();
+
+	    if ( _coordinator )
+		_coordinator->donationFinished( this );
+
+	    return true;
+	}
+
+	if ( rec.mode != 0 || _dirStack.isEmpty() )
+	{
+	    error( "Corrupt record" );
+	    return true;
+	}
+
+	// The end record of the innermost directory
+
+	DirInfo * dir = _dirStack.last();
+	_dirStack.pop_back();
+
+	if ( dir )	// Not excluded
+	    finishReading( dir, DirFinished );
+
+	if ( _dirStack.isEmpty() )
+	    unitFinished();
+    }
+    else if ( rec.reserved & RemoteDonated )
+    {
+	addDonated( rec, name );
+    }
+    else
+    {
+	addItem( rec, name );
+    }
+
+    return true;
+}
+
+
+void RemoteReadJob::addItem( const BinaryCacheRecord & rec, const QString & name )
+{
+    bool      isDir    = S_ISDIR( rec.mode );
+    bool      notRead  = rec.reserved & ( RemoteReadError | RemotePermissionDenied | RemoteMountPoint );
+    DirInfo * parent   = 0;
+    QString   itemName = name;
+
+    ++_unitRecords;
+
+    if ( _dirStack.isEmpty() )	// The start of a subtree
+    {
+	if ( ! isDir )
+	{
+	    error( "Subtree does not start with a directory" );
+	    return;
+	}
+
+	if ( _unitDir )	// Handed over from another agent; it already exists
+	{
+	    if ( notRead )
+	    {
+		finishNotRead( _unitDir, rec );
+		unitFinished();
+	    }
+	    else
+	    {
+		_unitDir->setReadState( DirReading );
+		_dirStack.append( _unitDir );
+	    }
+
+	    return;
+	}
+
+	if ( _toplevel )
+	{
+	    error( "Unexpected toplevel directory" );
+	    return;
+	}
+
+	// The toplevel directory gets the complete URL as its name
+
+	parent	 = _tree->root();
+	itemName = _url;
+    }
+    else
+    {
+	parent = _dirStack.last();
+
+	if ( ! parent )	// In an excluded subtree
+	{
+	    if ( isDir && ! notRead )
+		_dirStack.append( 0 );	// for its end record
+
+	    return;
+	}
+    }
+
+    if ( isDir )
+    {
+	DirInfo * dir = new DirInfo( _tree, parent, itemName,
+				     rec.mode, rec.size,
+				     _withUidGidPerm, rec.uid, rec.gid,
+				     rec.mtime );
+	CHECK_NEW( dir );
+	dir->setReadState( DirReading );
+	parent->insertChild( dir );
+
+	if ( ! _toplevel )
+	    _toplevel = dir;
+
+	childAdded( dir );
+
+	if ( notRead )
+	{
+	    finishNotRead( dir, rec );
+
+	    if ( dir == _toplevel )
+		unitFinished();
+	}
+	else if ( dir != _toplevel &&
+		  ExcludeRules::instance()->match( remotePath( dir ), dir->name() ) )
+	{
+	    logDebug() << "Excluding " << dir << endl;
+	    dir->setExcluded();
+	    finishReading( dir, DirOnRequestOnly );
+
+	    // Skip the complete subtree
+
+	    _dirStack.append( 0 );
+	}
+	else
+	{
+	    _dirStack.append( dir );
+	}
+    }
+    else
+    {
+	FileInfo * item = new FileInfo( _tree, parent, itemName,
+					rec.mode, rec.size,
+					_withUidGidPerm, rec.uid, rec.gid,
+					rec.mtime,
+					rec.blocks, rec.links );
+	CHECK_NEW( item );
+	parent->insertChild( item );
+	childAdded( item );
+    }
+}
+
+
+void RemoteReadJob::addDonated( const BinaryCacheRecord & rec, const QString & path )
+{
+    ++_donated;
+
+    // The parent is one of the directories this agent is reading right now
+
+    QString parentPath = path.section( '/', 0, -2 );
+
+    if ( parentPath.isEmpty() )
+	parentPath = "/";
+
+    DirInfo * parent = 0;
+
+    for ( int i = _dirStack.size() - 1; i >= 0 && ! parent; --i )
+    {
+	DirInfo * dir = _dirStack.at( i );
+
+	if ( dir && remotePath( dir ) == parentPath )
+	    parent = dir;
+    }
+
+    if ( ! parent || ! _coordinator )	// In an excluded subtree
+	return;
+
+    DirInfo * dir = new DirInfo( _tree, parent, path.section( '/', -1 ),
+				 rec.mode, rec.size,
+				 _withUidGidPerm, rec.uid, rec.gid,
+				 rec.mtime );
+    CHECK_NEW( dir );
+    parent->insertChild( dir );
+    childAdded( dir );
+
+    if ( ExcludeRules::instance()->match( path, dir->name() ) )
+    {
+	logDebug() << "Excluding " << dir << endl;
+	dir->setExcluded();
+	finishReading( dir, DirOnRequestOnly );
+	return;
+    }
+
+    dir->setReadState( DirQueued );
+    dir->readJobAdded();	// until another agent has read it
+    _coordinator->addUnit( path, dir );
+}
+
+
+void RemoteReadJob::unitFinished()
+{
+    if ( _unitDir )
+    {
+	_unitDir->readJobFinished( _unitDir );
+	_unitDir = 0;
+    }
+
+    _inUnit = false;
+
+    if ( _coordinator )
+	_coordinator->unitFinished( this );	// might call scan() or quit()
+    else
+	_complete = true;
+}
+
+
+void RemoteReadJob::finishNotRead( DirInfo * dir, const BinaryCacheRecord & rec )
+{
+    if ( rec.reserved & RemoteMountPoint )
+    {
+	dir->setMountPoint();
+	finishReading( dir, DirOnRequestOnly );
+    }
+    else if ( rec.reserved & RemotePermissionDenied )
+    {
+	logWarning() << "No permission to read directory " << dir << endl;
+	finishReading( dir, DirPermissionDenied );
+    }
+    else
+    {
+	logWarning() << "Remote opendir(" << dir << ") failed" << endl;
+	finishReading( dir, DirError );
+    }
+}
+
+
+void RemoteReadJob::finishReading( DirInfo * dir, DirReadState readState )
+{
+    dir->setReadState( readState );
+    dir->finalizeLocal();
+    _tree->sendReadJobFinished( dir );
+}
+
+
+QString RemoteReadJob::remotePath( DirInfo * dir ) const
+{
+    // With several agents, another job might have created the toplevel
+
+    FileInfo * toplevel = _tree->firstToplevel();
+
+    if ( ! toplevel )
+	return _remoteDir;
+
+    return QDir::cleanPath( _remoteDir + "/" + dir->url().mid( toplevel->url().length() ) );
+}
+
+
+void RemoteReadJob::waitForData()
+{
+    if ( _waiting )
+	return;
+
+    // Don't keep the queue spinning while there is nothing to do
+
+    _waiting = true;
+    queue()->block( this );
+}
+
+
+void RemoteReadJob::stopWaiting()
+{
+    if ( ! _waiting )
+	return;
+
+    _waiting = false;
+    _tree->unblock( this );
+}
+
+
+void RemoteReadJob::readyRead()
+{
+    if ( ! _process )
+	return;
+
+    _buffer += _process->readAllStandardOutput();
+    stopWaiting();
+}
+
+
+void RemoteReadJob::processFinished()
+{
+    if ( ! _process )
+	return;
+
+    _buffer += _process->readAllStandardOutput();
+    _processDone = true;
+    stopWaiting();
+}
+
+
+void RemoteReadJob::processError( QProcess::ProcessError error )
+{
+    if ( ! _process || error != QProcess::FailedToStart )
+	return;
+
+    logError() << "Can't start ssh: " << _process->errorString() << endl;
+    _processDone = true;
+    stopWaiting();
+}
+
+
+void RemoteReadJob::error( const QString & msg )
+{
+    logError() << _url << ": " << msg << endl;
+
+    if ( _process )
+    {
+	QString sshError = QString::fromUtf8( _process->readAllStandardError() ).trimmed();
+
+	if ( ! sshError.isEmpty() )
+	    logError() << "ssh: " << sshError << endl;
+    }
+
+    _ok = false;
+
+    // The directories that are still open will never be complete
+
+    if ( _unitDir && _dirStack.isEmpty() )
+	finishReading( _unitDir, DirError );
+
+    while ( ! _dirStack.isEmpty() )
+    {
+	DirInfo * dir = _dirStack.last();
+	_dirStack.pop_back();
+
+	if ( dir )
+	    finishReading( dir, DirError );
+    }
+
+    if ( _unitDir )
+    {
+	_unitDir->readJobFinished( _unitDir );
+	_unitDir = 0;
+    }
+}
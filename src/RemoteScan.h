@@ -0,0 +1,461 @@
+/*
+ *   File name: RemoteScan.h
+ *   Summary:	Scanning directories on another machine over SSH
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef RemoteScan_h
+#define RemoteScan_h
+
+
+#include <sys/stat.h>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QProcess>
+#include <QString>
+#include <QVector>
+
+#include "DirReadJob.h"
+#include "BinaryCache.h"
+
+
+// URL scheme for directories on other machines:
+//
+//   ssh://[user@]host[:port][,[user@]host[:port]...]/path
+
+#define REMOTE_URL_SCHEME	"ssh"
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class Process;
+    class RemoteScanCoordinator;
+
+
+    /**
+     * Flags in the 'reserved' field of a streamed directory record.
+     **/
+    enum RemoteScanFlags
+    {
+	RemoteReadError	       = 0x01,	// the directory could not be read
+	RemotePermissionDenied = 0x02,	// no permission to read the directory
+	RemoteMountPoint       = 0x04,	// another filesystem; not read
+	RemoteDonated	       = 0x08,	// handed over to another agent; not read
+	RemoteDonationEnd      = 0x10	// end of the answer to "donate"
+    };
+
+
+    /**
+     * One machine to run an agent on.
+     **/
+    struct RemoteHost
+    {
+	RemoteHost(): port( 0 ) {}
+
+	QString host;	// [user@]host
+	int	port;	// 0 for the default
+    };
+
+    typedef QList<RemoteHost> RemoteHostList;
+
+
+    /**
+     * The scanning side of a remote scan: "qdirstat --agent <dir>" on the
+     * remote machine. This reads the directory tree with
+     * DirScanner::scanDir() (just like the local scanner threads) and writes
+     * it as a stream of binary cache records, so only those compact records
+     * cross the network, and all the system calls are done next to the
+     * disks.
+     *
+     * The stream is a BinaryCacheHeader with the BinaryCacheStream flag
+     * (and no record count or offsets) followed by the records, each one
+     * immediately followed by its name (UTF-8, no trailing 0):
+     *
+     *	 - A directory record, followed by the records of all its
+     *	   non-directory children, then its subdirectories (recursively in
+     *	   the same way), then an end record (all 0) for that directory.
+     *
+     *	 - The first directory record has the absolute path as its name, all
+     *	   others only the name without path.
+     *
+     *	 - Directories that could not be read and mount points have no
+     *	   children and no end record; see RemoteScanFlags.
+     *
+     * The stream is complete when the end record of the toplevel directory
+     * is there.
+     *
+     * With "qdirstat --agent-server", the agent reads commands from stdin
+     * and writes one stream for all of them to stdout:
+     *
+     *	 - "scan <path>": Read the subtree at 'path' as above, with 'path'
+     *	   as the name of its first record.
+     *
+     *	 - "donate": Hand over about half of the subdirectories that are not
+     *	   read yet from the topmost directory that has any, so another
+     *	   agent can read them: A RemoteDonated record with the absolute
+     *	   path as its name for each of them, then an end record with
+     *	   RemoteDonationEnd. This is checked for after each directory.
+     *
+     * The agent server exits when stdin is closed. This is what the
+     * RemoteScanCoordinator uses.
+     *
+     * This does not need (and must not create) a QApplication: The remote
+     * machine might not have any display.
+     **/
+    class RemoteScanAgent
+    {
+    public:
+
+	/**
+	 * Scan 'dir' and write the stream to file descriptor 'fd'.
+	 * Return the exit code for the program.
+	 **/
+	static int run( const QString & dir, int fd );
+
+	/**
+	 * Read commands from file descriptor 'inFd' and write the stream to
+	 * 'outFd' until 'inFd' is closed. Return the exit code for the
+	 * program.
+	 **/
+	static int runServer( int inFd, int outFd );
+
+    protected:
+
+	/**
+	 * Constructor.
+	 **/
+	RemoteScanAgent( int fd );
+
+	/**
+	 * A subdirectory that is not read yet.
+	 **/
+	struct SubDir
+	{
+	    QByteArray	name;
+	    struct stat statInfo;
+	};
+
+	/**
+	 * A directory whose subdirectories are being read.
+	 **/
+	struct OpenDir
+	{
+	    OpenDir(): device( 0 ), next( 0 ) {}
+
+	    QByteArray	    path;
+	    dev_t	    device;
+	    QVector<SubDir> subDirs;
+	    int		    next;	// index in subDirs
+	};
+
+	/**
+	 * Read directory 'path' and write its record with 'name' and the
+	 * records of its non-directory children. If that worked, the
+	 * directory is added to 'openDirs' so its subdirectories are read
+	 * next.
+	 **/
+	void readDir( const QByteArray  & path,
+		      const QByteArray  & name,
+		      const struct stat & statInfo,
+		      QVector<OpenDir>	& openDirs );
+
+	/**
+	 * Read the next subdirectory of the innermost directory in
+	 * 'openDirs' or write its end record if there are no more.
+	 **/
+	void step( QVector<OpenDir> & openDirs );
+
+	/**
+	 * Hand over some of the subdirectories in 'openDirs' that are not
+	 * read yet (see the class comment).
+	 **/
+	void donate( QVector<OpenDir> & openDirs );
+
+	/**
+	 * Read the commands that are there and execute them. With 'wait',
+	 * wait until there is a directory to read in 'openDirs' or until the
+	 * input is closed.
+	 **/
+	void readCommands( bool wait, QVector<OpenDir> & openDirs );
+
+	/**
+	 * Execute one command.
+	 **/
+	void command( const QByteArray & line, QVector<OpenDir> & openDirs );
+
+	/**
+	 * Return the path of 'name' in 'dir'.
+	 **/
+	static QByteArray subPath( const QByteArray & dir, const QByteArray & name );
+
+	/**
+	 * Append the stream header to the output.
+	 **/
+	void writeHeader();
+
+	/**
+	 * Append one record with 'name' to the output.
+	 **/
+	void writeRecord( const struct stat & statInfo,
+			  const QByteArray  & name,
+			  quint32	      flags = 0 );
+
+	/**
+	 * Append the end record of a directory to the output.
+	 **/
+	void writeEndRecord( quint32 flags = 0 );
+
+	/**
+	 * Append 'size' bytes from 'data' to the output and send it if
+	 * enough has accumulated or if it was waiting for too long.
+	 **/
+	void write( const void * data, int size );
+
+	/**
+	 * Send everything in the output buffer.
+	 **/
+	void flush();
+
+
+	int		_fd;
+	QByteArray	_buffer;
+	QElapsedTimer	_sinceFlush;
+	bool		_ok;
+
+	// Only for the agent server
+	int		_inFd;
+	QByteArray	_input;
+	bool		_inputClosed;
+
+    };	// class RemoteScanAgent
+
+
+
+    /**
+     * The reading side of a remote scan: A read job that starts the agent
+     * on the remote machine with SSH and adds the records to the tree as
+     * they arrive. The tree is live while it grows, just like with a local
+     * scan.
+     *
+     * The toplevel directory has the complete remote URL as its name, so
+     * none of the items can be confused with local files.
+     *
+     * The SSH connection must not need a password since there is no
+     * terminal to ask for one; use an SSH key or agent.
+     *
+     * With several hosts in the URL, there is one of these jobs for each
+     * host, and a RemoteScanCoordinator tells them what to read.
+     **/
+    class RemoteReadJob: public ObjDirReadJob
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor for reading 'url' (see isRemoteUrl()) into 'tree'.
+	 **/
+	RemoteReadJob( DirTree * tree, const QString & url );
+
+	/**
+	 * Constructor for one of the agents of 'coordinator' on 'host'.
+	 * This does nothing until the coordinator calls scan().
+	 **/
+	RemoteReadJob( DirTree		     * tree,
+		       const QString	     & url,
+		       const RemoteHost	     & host,
+		       RemoteScanCoordinator * coordinator );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~RemoteReadJob();
+
+	/**
+	 * Add the records that are there to the tree. This is called
+	 * repeatedly from the read queue until finished() is called. If it
+	 * has to wait for more data, the job is blocked in the queue in the
+	 * meantime.
+	 *
+	 * Inherited and reimplemented from DirReadJob.
+	 **/
+	virtual void read();
+
+	/**
+	 * Return 'true' if 'url' is a URL for a remote scan:
+	 *
+	 *   ssh://[user@]host[:port]/path
+	 **/
+	static bool isRemoteUrl( const QString & url );
+
+	/**
+	 * Split remote URL 'url' into its hosts and the path on them.
+	 * Return 'false' if this is no remote URL.
+	 **/
+	static bool parseUrl( const QString  & url,
+			      RemoteHostList & hosts_ret,
+			      QString	     & path_ret );
+
+	/**
+	 * Let the agent read the subtree at 'path' on the remote machine
+	 * into 'dir'. If 'dir' is 0, this is the toplevel directory.
+	 **/
+	void scan( const QString & path, DirInfo * dir );
+
+	/**
+	 * Ask the agent to hand over some of the directories it did not read
+	 * yet.
+	 **/
+	void requestDonation();
+
+	/**
+	 * Return 'true' if it makes sense to ask this agent to hand over
+	 * some directories: It is reading something, and it did not just
+	 * say it has nothing to hand over.
+	 **/
+	bool canDonate() const;
+
+	/**
+	 * Return the number of records of the subtree that is being read.
+	 **/
+	int unitRecords() const { return _unitRecords; }
+
+	/**
+	 * Stop the agent after everything is read.
+	 **/
+	void quit();
+
+	/**
+	 * Return the host of this agent.
+	 **/
+	const QString & host() const { return _host.host; }
+
+
+    protected slots:
+
+	/**
+	 * Take over the data from the agent that is waiting.
+	 **/
+	void readyRead();
+
+	/**
+	 * Notification that the SSH process is finished.
+	 **/
+	void processFinished();
+
+	/**
+	 * Notification that the SSH process could not be started.
+	 **/
+	void processError( QProcess::ProcessError error );
+
+
+    protected:
+
+	/**
+	 * Start the agent on the remote machine. Return 'false' if that
+	 * failed.
+	 **/
+	bool startAgent();
+
+	/**
+	 * Check the stream header. Return 'false' if it is not complete yet
+	 * or if it is bad; the latter sets an error.
+	 **/
+	bool readHeader();
+
+	/**
+	 * Add the next record to the tree. Return 'false' if it is not
+	 * complete yet.
+	 **/
+	bool readRecord();
+
+	/**
+	 * Create a tree item for 'rec' with 'name'.
+	 **/
+	void addItem( const BinaryCacheRecord & rec, const QString & name );
+
+	/**
+	 * Create the directory that another agent will read for a
+	 * RemoteDonated record with 'path' and hand it to the coordinator.
+	 **/
+	void addDonated( const BinaryCacheRecord & rec, const QString & path );
+
+	/**
+	 * Notification that the subtree that was being read is complete.
+	 **/
+	void unitFinished();
+
+	/**
+	 * Finish 'dir' for a record that says it was not read.
+	 **/
+	void finishNotRead( DirInfo * dir, const BinaryCacheRecord & rec );
+
+	/**
+	 * Set the read state of 'dir' and tell the views that it is done.
+	 **/
+	void finishReading( DirInfo * dir, DirReadState readState );
+
+	/**
+	 * Send 'command' to the agent.
+	 **/
+	void sendCommand( const QByteArray & command );
+
+	/**
+	 * Block in the read queue until more data arrive.
+	 **/
+	void waitForData();
+
+	/**
+	 * Continue in the read queue if waiting for data.
+	 **/
+	void stopWaiting();
+
+	/**
+	 * Log an error, mark the unfinished directories and stop reading.
+	 **/
+	void error( const QString & msg );
+
+	/**
+	 * Return the path on the remote machine of 'dir'.
+	 **/
+	QString remotePath( DirInfo * dir ) const;
+
+
+	QString		    _url;
+	QString		    _remoteDir;
+	RemoteHost	    _host;
+	Process *	    _process;
+	QByteArray	    _commands;	// until the process is started
+	QByteArray	    _buffer;
+	int		    _pos;	// in _buffer
+	bool		    _haveHeader;
+	bool		    _withUidGidPerm;
+	bool		    _waiting;
+	bool		    _processDone;
+	bool		    _complete;
+	bool		    _ok;
+	DirInfo *	    _toplevel;
+	QVector<DirInfo *>  _dirStack;	// 0 for excluded directories
+
+	// Only with a coordinator
+	RemoteScanCoordinator * _coordinator;
+	DirInfo *	    _unitDir;
+	bool		    _inUnit;
+	int		    _unitRecords;
+	bool		    _donating;
+	int		    _donated;
+	QElapsedTimer	    _sinceNoDonation;
+
+    };	// class RemoteReadJob
+
+}	// namespace QDirStat
+
+
+#endif // ifndef RemoteScan_h
@@ -0,0 +1,211 @@
+/*
+ *   File name: RemoteScanCoordinator.cpp
+ *   Summary:	Distributing a remote scan over several agents
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>	// std::sort()
+
+#include <QTimer>
+
+#include "RemoteScanCoordinator.h"
+#include "RemoteScan.h"
+#include "DirInfo.h"
+#include "DirTree.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Check again this often while agents are idle and none of the busy ones
+// had anything to hand over
+
+#define REBALANCE_RETRY_MILLISEC	500
+
+
+using namespace QDirStat;
+
+
+/**
+ * Sort functor for the busy jobs: Largest subtree first.
+ **/
+struct LargerUnitFirst
+{
+    bool operator() ( RemoteReadJob * a, RemoteReadJob * b ) const
+	{ return a->unitRecords() > b->unitRecords(); }
+};
+
+
+RemoteScanCoordinator::RemoteScanCoordinator( DirTree * tree, const QString & url ):
+    QObject(),
+    _tree( tree ),
+    _url( url ),
+    _retryScheduled( false ),
+    _quitting( false )
+{
+    // NOP
+}
+
+
+RemoteScanCoordinator::~RemoteScanCoordinator()
+{
+    // NOP
+}
+
+
+void RemoteScanCoordinator::start()
+{
+    RemoteHostList hosts;
+    QString	   remoteDir;
+
+    if ( ! RemoteReadJob::parseUrl( _url, hosts, remoteDir ) || hosts.isEmpty() )
+    {
+	logError() << "Bad remote URL " << _url << endl;
+	deleteLater();
+	return;
+    }
+
+    logInfo() << "Reading " << remoteDir << " with " << hosts.size() << " agents" << endl;
+
+    foreach ( const RemoteHost & host, hosts )
+    {
+	RemoteReadJob * job = new RemoteReadJob( _tree, _url, host, this );
+	CHECK_NEW( job );
+
+	if ( _jobs.isEmpty() )
+	    job->scan( remoteDir, 0 );	// The toplevel
+	else
+	    _idle.insert( job );
+
+	_jobs << job;
+    }
+
+    // The first agent is asked right away to hand over some of the
+    // toplevel subdirectories to the others.
+
+    requestDonations();
+
+    foreach ( RemoteReadJob * job, _jobs )
+	_tree->addJob( job );
+}
+
+
+void RemoteScanCoordinator::addUnit( const QString & path, DirInfo * dir )
+{
+    Unit unit;
+    unit.path = path;
+    unit.dir  = dir;
+
+    _units << unit;
+}
+
+
+void RemoteScanCoordinator::unitFinished( RemoteReadJob * job )
+{
+    _idle.insert( job );
+    rebalance();
+}
+
+
+void RemoteScanCoordinator::donationFinished( RemoteReadJob * job )
+{
+    Q_UNUSED( job );
+
+    rebalance();
+}
+
+
+void RemoteScanCoordinator::jobDone( RemoteReadJob * job )
+{
+    _jobs.removeAll( job );
+    _idle.remove( job );
+
+    if ( ! _jobs.isEmpty() )
+    {
+	// Another agent takes over if this one failed
+
+	if ( ! _quitting )
+	    rebalance();
+
+	return;
+    }
+
+    if ( ! _units.isEmpty() && ! _tree->beingDestroyed() )
+    {
+	logWarning() << _units.size() << " directories were not read" << endl;
+
+	foreach ( const Unit & unit, _units )
+	{
+	    unit.dir->readJobAborted( unit.dir );
+	    unit.dir->readJobFinished( unit.dir );
+	}
+    }
+
+    _units.clear();
+    deleteLater();
+}
+
+
+void RemoteScanCoordinator::rebalance()
+{
+    _retryScheduled = false;
+
+    if ( _quitting )
+	return;
+
+    while ( ! _units.isEmpty() && ! _idle.isEmpty() )
+    {
+	RemoteReadJob * job = *_idle.begin();
+	_idle.remove( job );
+
+	Unit unit = _units.takeFirst();
+	job->scan( unit.path, unit.dir );
+    }
+
+    if ( _idle.isEmpty() )
+	return;
+
+    if ( _idle.size() == _jobs.size() )	// All done
+    {
+	logInfo() << "All agents are done with " << _url << endl;
+	_quitting = true;
+
+	// quit() might lead to jobDone() for each of them
+
+	QList<RemoteReadJob *> jobs = _jobs;
+
+	foreach ( RemoteReadJob * job, jobs )
+	    job->quit();
+
+	return;
+    }
+
+    requestDonations();
+}
+
+
+void RemoteScanCoordinator::requestDonations()
+{
+    QList<RemoteReadJob *> busy;
+
+    foreach ( RemoteReadJob * job, _jobs )
+    {
+	if ( ! _idle.contains( job ) && job->canDonate() )
+	    busy << job;
+    }
+
+    std::sort( busy.begin(), busy.end(), LargerUnitFirst() );
+
+    for ( int i=0; i < busy.size() && i < _idle.size(); ++i )
+	busy.at( i )->requestDonation();
+
+    if ( busy.isEmpty() && ! _retryScheduled )
+    {
+	// Those that just had nothing to hand over might have more later
+
+	_retryScheduled = true;
+	QTimer::singleShot( REBALANCE_RETRY_MILLISEC, this, SLOT( rebalance() ) );
+    }
+}
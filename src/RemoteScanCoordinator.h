@@ -0,0 +1,132 @@
+/*
+ *   File name: RemoteScanCoordinator.h
+ *   Summary:	Distributing a remote scan over several agents
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef RemoteScanCoordinator_h
+#define RemoteScanCoordinator_h
+
+
+#include <QObject>
+#include <QList>
+#include <QSet>
+#include <QString>
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class RemoteReadJob;
+
+
+    /**
+     * Coordinator for reading one directory tree with remote scan agents on
+     * several machines at the same time, e.g. the client nodes of a
+     * clustered filesystem where one machine alone can't do the stat()
+     * calls fast enough. The URL lists all the hosts:
+     *
+     *	 ssh://node1,node2,user@node3:2222/path
+     *
+     * There is one RemoteReadJob with an agent server (see
+     * RemoteScanAgent) for each host; they all add to the same tree. The
+     * first one starts with the complete tree. Whenever an agent is idle
+     * and there is nothing left to hand out, the agents that are busy with
+     * the largest subtrees are asked to hand over about half of the
+     * subdirectories they did not read yet; those are then handed out to
+     * the idle agents one by one. So the work is distributed at the top
+     * level first, and it is split further wherever one subtree turns out
+     * to be much larger than the others.
+     *
+     * This deletes itself when all its jobs are gone.
+     **/
+    class RemoteScanCoordinator: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. 'url' needs to be a remote URL with any number of
+	 * hosts (see RemoteReadJob::isRemoteUrl()).
+	 **/
+	RemoteScanCoordinator( DirTree * tree, const QString & url );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~RemoteScanCoordinator();
+
+	/**
+	 * Create the jobs and add them to the tree. Don't access this object
+	 * anymore after this: It might already be gone.
+	 **/
+	void start();
+
+	/**
+	 * Add a directory that an agent handed over. 'path' is its path on
+	 * the remote machines.
+	 **/
+	void addUnit( const QString & path, DirInfo * dir );
+
+	/**
+	 * Notification that 'job' is done with its subtree.
+	 **/
+	void unitFinished( RemoteReadJob * job );
+
+	/**
+	 * Notification that 'job' is done with handing over directories.
+	 **/
+	void donationFinished( RemoteReadJob * job );
+
+	/**
+	 * Notification that 'job' is being deleted.
+	 **/
+	void jobDone( RemoteReadJob * job );
+
+
+    protected slots:
+
+	/**
+	 * Hand out the pending directories to the idle jobs and ask the busy
+	 * ones to hand over more if needed.
+	 **/
+	void rebalance();
+
+
+    protected:
+
+	/**
+	 * Ask busy jobs to hand over directories: As many as there are idle
+	 * ones, those with the largest subtrees first.
+	 **/
+	void requestDonations();
+
+	/**
+	 * A directory that is not read yet.
+	 **/
+	struct Unit
+	{
+	    QString   path;
+	    DirInfo * dir;
+	};
+
+
+	DirTree *		_tree;
+	QString			_url;
+	QList<RemoteReadJob *>	_jobs;
+	QSet<RemoteReadJob *>	_idle;
+	QList<Unit>		_units;
+	bool			_retryScheduled;
+	bool			_quitting;
+
+    };	// class RemoteScanCoordinator
+
+}	// namespace QDirStat
+
+
+#endif // ifndef RemoteScanCoordinator_h
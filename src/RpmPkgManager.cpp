@@ -12,11 +12,21 @@
 #include <QElapsedTimer>
 #include <QPointer>
 
+#ifdef HAVE_LIBRPM
+#  include <rpm/rpmlib.h>	// rpmReadConfigFiles()
+#  include <rpm/rpmts.h>
+#  include <rpm/rpmdb.h>
+#  include <rpm/rpmfi.h>
+#  include <rpm/header.h>
+#endif
+
 #include "RpmPkgManager.h"
 #include "PkgFileListCache.h"
 #include "Settings.h"
-#include "MessagePanel.h"
-#include "PanelMessage.h"
+#ifndef QDIRSTAT_HEADLESS
+#  include "MessagePanel.h"
+#  include "PanelMessage.h"
+#endif
 #include "Logger.h"
 #include "Exception.h"
 
@@ -62,19 +72,24 @@ bool RpmPkgManager::isAvailable()
 }
 
 
-QString RpmPkgManager::owningPkg( const QString & path )
+void RpmPkgManager::owningPkgCommand( const QStringList & paths,
+				       QString		 & command_ret,
+				       QStringList	 & args_ret )
 {
-    int exitCode = -1;
-    QString output = runCommand( _rpmCommand,
-				 QStringList() << "-qf" << "--queryformat" << "%{name}" << path,
-				 &exitCode );
+    command_ret = _rpmCommand;
+    args_ret	= QStringList() << "-qf" << "--queryformat" << "%{name}" << paths.first();
+}
 
-    if ( exitCode != 0 || output.contains( "not owned by any package" ) )
-	return "";
 
-    QString pkg = output;
+void RpmPkgManager::parseOwningPkgOutput( const QStringList	     & paths,
+					  const QString		     & output,
+					  int			       exitCode,
+					  QMap<QString, QString>     & pkgs_ret )
+{
+    if ( exitCode != 0 || output.contains( "not owned by any package" ) )
+	return;
 
-    return pkg;
+    pkgs_ret.insert( paths.first(), output );
 }
 
 
@@ -88,7 +103,7 @@ PkgInfoList RpmPkgManager::installedPkg()
 				 QStringList()
 				 << "-qa"
 				 << "--queryformat"
-				 << "%{name} | %{version}-%{release} | %{arch}\n",
+				 << "%{name} | %{version}-%{release} | %{arch} | %{size}\n",
 				 &exitCode,
 				 LONG_CMD_TIMEOUT_SEC );
 
@@ -114,13 +129,15 @@ PkgInfoList RpmPkgManager::parsePkgList( const QString & output )
 	{
 	    QStringList fields = line.split( " | ", QString::KeepEmptyParts );
 
-	    if ( fields.size() != 3 )
+	    if ( fields.size() != 4 )
 		logError() << "Invalid rpm -qa output: " << line << "\n" << endl;
 	    else
 	    {
 		QString name	= fields.takeFirst();
 		QString version = fields.takeFirst(); // includes release
 		QString arch	= fields.takeFirst();
+		bool	sizeOk	= false;
+		FileSize size	= fields.takeFirst().toLongLong( &sizeOk );
 
 		if ( arch == "(none)" )
 		    arch = "";
@@ -128,6 +145,9 @@ PkgInfoList RpmPkgManager::parsePkgList( const QString & output )
 		PkgInfo * pkg = new PkgInfo( name, version, arch, this );
 		CHECK_NEW( pkg );
 
+		if ( sizeOk )
+		    pkg->setInstalledSize( size );
+
 		pkgList << pkg;
 	    }
 	}
@@ -174,6 +194,11 @@ QString RpmPkgManager::queryName( PkgInfo * pkg )
 
 PkgFileListCache * RpmPkgManager::createFileListCache( PkgFileListCache::LookupType lookupType )
 {
+    PkgFileListCache * nativeCache = createNativeFileListCache( lookupType );
+
+    if ( nativeCache )
+	return nativeCache;
+
     int exitCode = -1;
     QString queryFormat = "[%{=NAME}-%{=VERSION}-%{=RELEASE}.%{=ARCH} | %{FILENAMES}\n]";
 
@@ -225,6 +250,225 @@ PkgFileListCache * RpmPkgManager::createFileListCache( PkgFileListCache::LookupT
 }
 
 
+QStringList RpmPkgManager::databasePaths() const
+{
+    QStringList paths;
+
+    // Berkeley DB (old), ndb (SUSE) and sqlite (Fedora) in the old and in
+    // the new location. Only those that exist are used.
+
+    foreach ( const QString & dir, QStringList() << "/var/lib/rpm" << "/usr/lib/sysimage/rpm" )
+    {
+	paths << dir + "/Packages"
+	      << dir + "/Packages.db"
+	      << dir + "/rpmdb.sqlite"
+	      << dir + "/rpmdb.sqlite-wal";
+    }
+
+    return paths;
+}
+
+
+QStringList RpmPkgManager::fileList( PkgInfo * pkg )
+{
+    bool ok = false;
+    QStringList fileList = nativeFileList( pkg, &ok );
+
+    if ( ok )
+	return fileList;
+
+    return PkgManager::fileList( pkg );
+}
+
+
+bool RpmPkgManager::supportsNativeFileList()
+{
+#ifdef HAVE_LIBRPM
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+#ifdef HAVE_LIBRPM
+
+/**
+ * Read the rpm configuration (macros like %_dbpath) once. Return 'true' on
+ * success.
+ **/
+static bool initLibRpm()
+{
+    static int result = -1;
+
+    if ( result < 0 )
+    {
+	result = rpmReadConfigFiles( 0, 0 ) == 0 ? 1 : 0;
+
+	if ( ! result )
+	    logWarning() << "Can't read the rpm configuration" << endl;
+    }
+
+    return result == 1;
+}
+
+
+/**
+ * Return the name of the package with header 'header' as used in the file
+ * list cache: ${name}-${version}-${release}.${arch}, just like
+ * RpmPkgManager::queryName(). Packages without an architecture like
+ * gpg-pubkey just don't have the ".${arch}" part.
+ **/
+static QString headerPkgName( Header header )
+{
+    QString name = QString( "%1-%2-%3" )
+	.arg( QString::fromUtf8( headerGetString( header, RPMTAG_NAME    ) ) )
+	.arg( QString::fromUtf8( headerGetString( header, RPMTAG_VERSION ) ) )
+	.arg( QString::fromUtf8( headerGetString( header, RPMTAG_RELEASE ) ) );
+
+    const char * arch = headerGetString( header, RPMTAG_ARCH );
+
+    if ( arch && *arch )
+	name += "." + QString::fromUtf8( arch );
+
+    return name;
+}
+
+
+/**
+ * Return the files and directories of the package with header 'header'.
+ **/
+static QStringList headerFileList( rpmts transactionSet, Header header )
+{
+    QStringList fileList;
+    rpmfi fileInfo = rpmfiNew( transactionSet, header, RPMTAG_BASENAMES, RPMFI_KEEPHEADER );
+
+    if ( fileInfo )
+    {
+	rpmfiInit( fileInfo, 0 );
+
+	while ( rpmfiNext( fileInfo ) >= 0 )
+	    fileList << QString::fromUtf8( rpmfiFN( fileInfo ) );
+
+	rpmfiFree( fileInfo );
+    }
+
+    return fileList;
+}
+
+#endif	// HAVE_LIBRPM
+
+
+QStringList RpmPkgManager::nativeFileList( PkgInfo * pkg, bool * ok )
+{
+    QStringList fileList;
+    *ok = false;
+
+#ifdef HAVE_LIBRPM
+
+    CHECK_PTR( pkg );
+
+    if ( ! initLibRpm() )
+	return fileList;
+
+    rpmts transactionSet = rpmtsCreate();
+    QByteArray name = pkg->baseName().toUtf8();
+    QString queryName = this->queryName( pkg );
+    rpmdbMatchIterator it = rpmtsInitIterator( transactionSet, RPMDBI_NAME,
+					       name.constData(), name.size() );
+
+    if ( it )
+    {
+	*ok = true;	// The database is readable
+	Header header;
+
+	// There might be several versions or architectures of this package
+
+	while ( ( header = rpmdbNextIterator( it ) ) != 0 )
+	{
+	    if ( headerPkgName( header ) == queryName )
+	    {
+		fileList = headerFileList( transactionSet, header );
+		break;
+	    }
+	}
+
+	rpmdbFreeIterator( it );
+    }
+
+    rpmtsFree( transactionSet );
+
+#else
+    Q_UNUSED( pkg );
+#endif
+
+    return fileList;
+}
+
+
+PkgFileListCache * RpmPkgManager::createNativeFileListCache( PkgFileListCache::LookupType lookupType )
+{
+#ifdef HAVE_LIBRPM
+
+    if ( ! initLibRpm() )
+	return 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    rpmts transactionSet = rpmtsCreate();
+    rpmdbMatchIterator it = rpmtsInitIterator( transactionSet, RPMDBI_PACKAGES, 0, 0 );
+
+    if ( ! it )
+    {
+	logWarning() << "Can't open the RPM database" << endl;
+	rpmtsFree( transactionSet );
+
+	return 0;
+    }
+
+    PkgFileListCache * cache = new PkgFileListCache( this, lookupType );
+    CHECK_NEW( cache );
+
+    // librpm serializes all access to the database, so there is nothing to
+    // gain from several threads here. Not starting rpm for each package is
+    // what makes the difference.
+
+    Header header;
+    int pkgCount  = 0;
+    int fileCount = 0;
+
+    while ( ( header = rpmdbNextIterator( it ) ) != 0 )
+    {
+	QString	    pkgName  = headerPkgName( header );
+	QStringList fileList = headerFileList( transactionSet, header );
+
+	foreach ( const QString & path, fileList )
+	    cache->add( pkgName, path );
+
+	++pkgCount;
+	fileCount += fileList.size();
+    }
+
+    rpmdbFreeIterator( it );
+    rpmtsFree( transactionSet );
+
+    logDebug() << "Read " << fileCount << " files of " << pkgCount
+	       << " packages from the RPM database in "
+	       << timer.elapsed() << " millisec" << endl;
+
+    return cache;
+
+#else
+
+    Q_UNUSED( lookupType );
+
+    return 0;
+
+#endif	// HAVE_LIBRPM
+}
+
+
 void RpmPkgManager::readSettings()
 {
     Settings settings;
@@ -250,6 +494,8 @@ void RpmPkgManager::rebuildRpmDbWarning()
 	logWarning()  << "rpm is very slow. Run	  sudo rpm --rebuilddb"	  << endl;
     }
 
+#ifndef QDIRSTAT_HEADLESS
+
     // Add a panel message so the user is sure to see this message.
     //
     // This is a bit out of place in this class, but a full-fledged user
@@ -273,5 +519,7 @@ void RpmPkgManager::rebuildRpmDbWarning()
 	MessagePanel::firstInstance()->add( panelMessage );
     }
 
+#endif	// QDIRSTAT_HEADLESS
+
     issuedWarning = true;
 }
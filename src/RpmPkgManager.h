@@ -57,16 +57,28 @@ namespace QDirStat
 	virtual bool isAvailable() Q_DECL_OVERRIDE;
 
 	/**
-	 * Return the owning package of a file or directory with full path
-	 * 'path' or an empty string if it is not owned by any package.
+	 * Return the command and its arguments for finding the owning
+	 * package of the first of 'paths'.
 	 *
 	 * Implemented from PkgManager.
 	 *
-	 * This basically executes this command:
+	 * This is basically this command:
 	 *
 	 *   /usr/bin/rpm -qf ${path}
 	 **/
-	virtual QString owningPkg( const QString & path ) Q_DECL_OVERRIDE;
+	virtual void owningPkgCommand( const QStringList & paths,
+				       QString		 & command_ret,
+				       QStringList	 & args_ret ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Parse the output of the owningPkgCommand() for 'paths'.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual void parseOwningPkgOutput( const QStringList	      & paths,
+					   const QString	      & output,
+					   int				exitCode,
+					   QMap<QString, QString>     & pkgs_ret ) Q_DECL_OVERRIDE;
 
 
 	//-----------------------------------------------------------------
@@ -91,6 +103,15 @@ namespace QDirStat
 	 **/
 	virtual PkgInfoList installedPkg() Q_DECL_OVERRIDE;
 
+	/**
+	 * Return 'true' since installedPkg() sets the installed size from the
+	 * SIZE tag (the sum of the file sizes).
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsInstalledSize() Q_DECL_OVERRIDE
+	    { return true; }
+
 	/**
 	 * Return 'true' if this package manager supports getting the file list
 	 * for a package.
@@ -115,6 +136,25 @@ namespace QDirStat
 	 **/
 	virtual QStringList parseFileList( const QString & output ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Return the list of files and directories owned by a package.
+	 *
+	 * If QDirStat was built with librpm, this reads the package header
+	 * directly from the RPM database; otherwise, or if that fails, it
+	 * uses "rpm -ql".
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QStringList fileList( PkgInfo * pkg ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return 'true' if fileList() reads the RPM database directly, i.e.
+	 * if QDirStat was built with librpm.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsNativeFileList() Q_DECL_OVERRIDE;
+
 	/**
 	 * Return 'true' if this package manager supports building a file list
 	 * cache for getting all file lists for all packages.
@@ -135,6 +175,10 @@ namespace QDirStat
 	 * Ownership of the cache is transferred to the caller; make sure to
 	 * delete it when you are done with it.
 	 *
+	 * If QDirStat was built with librpm, this reads all package headers
+	 * directly from the RPM database instead of parsing the output of
+	 * "rpm -qa".
+	 *
 	 * Reimplemented from PkgManager.
 	 **/
 	virtual PkgFileListCache * createFileListCache( PkgFileListCache::LookupType lookupType = PkgFileListCache::LookupByPkg ) Q_DECL_OVERRIDE;
@@ -149,6 +193,13 @@ namespace QDirStat
 	 **/
 	virtual QString queryName( PkgInfo * pkg ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Return the RPM database files for all known database backends.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QStringList databasePaths() const Q_DECL_OVERRIDE;
+
 
     protected:
 
@@ -168,6 +219,20 @@ namespace QDirStat
 	 **/
 	void rebuildRpmDbWarning();
 
+	/**
+	 * Read the file list of 'pkg' with librpm. Set 'ok' to 'false' if the
+	 * RPM database could not be opened or if QDirStat was built without
+	 * librpm.
+	 **/
+	QStringList nativeFileList( PkgInfo * pkg, bool * ok );
+
+	/**
+	 * Create a file list cache for all packages with librpm. Return 0 if
+	 * the RPM database could not be opened or if QDirStat was built
+	 * without librpm.
+	 **/
+	PkgFileListCache * createNativeFileListCache( PkgFileListCache::LookupType lookupType );
+
 
 	// Data members
 
@@ -0,0 +1,528 @@
+/*
+ *   File name: ScanDaemon.cpp
+ *   Summary:	Sharing one live directory tree with several sessions
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <errno.h>
+#include <sys/stat.h>	// mkdir(), lstat()
+#include <unistd.h>	// getuid()
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+#include "ScanDaemon.h"
+#include "BinaryCache.h"
+#include "DirInfo.h"
+#include "DirReadJob.h"
+#include "DirTree.h"
+#include "DirWatcher.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Directory for the sockets and files of all scan daemons of one user
+
+#define SCAN_DAEMON_DIR			"/tmp/qdirstat-daemon-$UID"
+
+// How long a client waits for the daemon to accept the connection. The
+// socket is local, so if it takes longer, something is wrong.
+
+#define DAEMON_CONNECT_TIMEOUT_MILLISEC	500
+
+// Number of snapshot and update files to keep for clients that did not
+// get around to reading them yet
+
+#define MAX_DAEMON_FILES		32
+
+
+using namespace QDirStat;
+
+
+/**
+ * Return 'true' if 'path' is somewhere below 'dir'.
+ **/
+static bool isBelow( const QString & path, const QString & dir )
+{
+    if ( dir == "/" )
+	return path != dir;
+
+    return path.startsWith( dir + "/" );
+}
+
+
+ScanDaemon::ScanDaemon( const QString & dir ):
+    QObject(),
+    _dir( QDir::cleanPath( QFileInfo( dir ).absoluteFilePath() ) ),
+    _tree( 0 ),
+    _watcher( 0 ),
+    _server( 0 ),
+    _fileCount( 0 ),
+    _initialReadDone( false )
+{
+    // NOP
+}
+
+
+ScanDaemon::~ScanDaemon()
+{
+    delete _watcher;
+    delete _tree;
+
+    if ( _server )
+    {
+	_server->close();	// This removes the socket
+	removeAllFiles();
+    }
+}
+
+
+int ScanDaemon::run( const QString & dir, int & argc, char ** argv )
+{
+    QCoreApplication app( argc, argv );
+    ScanDaemon daemon( dir );
+
+    if ( ! daemon.start() )
+	return 1;
+
+    return app.exec();
+}
+
+
+QString ScanDaemon::runtimeDir()
+{
+    QString dir = QString( SCAN_DAEMON_DIR ).replace( "$UID", QString::number( getuid() ) );
+    QByteArray path = dir.toUtf8();
+
+    if ( mkdir( path.constData(), 0700 ) < 0 && errno != EEXIST )
+    {
+	logError() << "Can't create " << dir << ": " << formatErrno() << endl;
+	return QString();
+    }
+
+    // Anybody who could write to that directory could pretend to be the
+    // daemon, and anybody who could read the files there could see the
+    // complete directory tree.
+
+    struct stat statInfo;
+
+    if ( lstat( path.constData(), &statInfo ) < 0 ||
+	 ! S_ISDIR( statInfo.st_mode )		 ||
+	 statInfo.st_uid != getuid()		 ||
+	 ( statInfo.st_mode & 077 ) != 0	   )
+    {
+	logError() << "Not using " << dir << ": Not a private directory" << endl;
+	return QString();
+    }
+
+    return dir;
+}
+
+
+QString ScanDaemon::socketName( const QString & dir )
+{
+    QString runtime = runtimeDir();
+
+    if ( runtime.isEmpty() )
+	return QString();
+
+    QByteArray hash = QCryptographicHash::hash( QDir::cleanPath( dir ).toUtf8(),
+						QCryptographicHash::Md5 ).toHex().left( 16 );
+
+    return runtime + "/" + QString::fromLatin1( hash ) + ".sock";
+}
+
+
+bool ScanDaemon::start()
+{
+    QString name = socketName( _dir );
+
+    if ( name.isEmpty() )
+	return false;
+
+    {
+	QLocalSocket probe;
+	probe.connectToServer( name );
+
+	if ( probe.waitForConnected( DAEMON_CONNECT_TIMEOUT_MILLISEC ) )
+	{
+	    logError() << "A scan daemon for " << _dir << " is already running" << endl;
+	    return false;
+	}
+    }
+
+    // Clean up after a daemon for the same directory that was killed
+
+    _prefix = name.left( name.length() - QString( ".sock" ).length() ) + "-";
+    QLocalServer::removeServer( name );
+    removeAllFiles();
+
+    _server = new QLocalServer( this );
+    CHECK_NEW( _server );
+
+    if ( ! _server->listen( name ) )
+    {
+	logError() << "Can't listen on " << name << ": " << _server->errorString() << endl;
+	delete _server;
+	_server = 0;
+
+	return false;
+    }
+
+    connect( _server, SIGNAL( newConnection() ),
+	     this,    SLOT  ( newConnection() ) );
+
+    _tree = new DirTree();
+    CHECK_NEW( _tree );
+    _tree->setUseScanDaemon( false );	// This is the daemon
+
+    _watcher = new DirWatcher( _tree );
+    CHECK_NEW( _watcher );
+
+    connect( _watcher, SIGNAL( refreshing   ( DirInfo * ) ),
+	     this,     SLOT  ( dirRefreshing( DirInfo * ) ) );
+
+    connect( _tree,    SIGNAL( finished()     ),
+	     this,     SLOT  ( treeFinished() ) );
+
+    if ( DirWatcher::isAvailable() )
+	_watcher->setEnabled( true );
+    else
+	logWarning() << "No live updates on this platform" << endl;
+
+    logInfo() << "Scan daemon for " << _dir << " listening on " << name << endl;
+    _tree->startReading( _dir );
+
+    return true;
+}
+
+
+void ScanDaemon::newConnection()
+{
+    while ( _server->hasPendingConnections() )
+    {
+	QLocalSocket * client = _server->nextPendingConnection();
+	CHECK_PTR( client );
+
+	connect( client, SIGNAL( disconnected()	      ),
+		 this,	 SLOT  ( clientDisconnected() ) );
+
+	_clients << client;
+	logInfo() << "New client; now " << _clients.size() << " clients" << endl;
+
+	// A client that connects while the tree is busy has to wait:
+	// Updates before the snapshot would make no sense.
+
+	if ( _initialReadDone && ! _tree->isBusy() )
+	    sendSnapshot( client );
+	else
+	    _waitingClients << client;
+    }
+}
+
+
+void ScanDaemon::clientDisconnected()
+{
+    QLocalSocket * client = qobject_cast<QLocalSocket *>( sender() );
+
+    if ( ! client )
+	return;
+
+    _clients.removeAll( client );
+    _waitingClients.removeAll( client );
+    client->deleteLater();
+
+    logInfo() << "Client gone; now " << _clients.size() << " clients" << endl;
+}
+
+
+void ScanDaemon::dirRefreshing( DirInfo * dir )
+{
+    _changedDirs.insert( dir->url() );
+    _snapshot.clear();
+}
+
+
+void ScanDaemon::treeFinished()
+{
+    if ( ! _initialReadDone )
+    {
+	_initialReadDone = true;
+	_changedDirs.clear();
+	logInfo() << "Initial read of " << _dir << " done" << endl;
+    }
+    else
+    {
+	sendUpdates();
+    }
+
+    foreach ( QLocalSocket * client, _waitingClients )
+	sendSnapshot( client );
+
+    _waitingClients.clear();
+    removeOldFiles();
+}
+
+
+void ScanDaemon::sendSnapshot( QLocalSocket * client )
+{
+    if ( _snapshot.isEmpty() )
+    {
+	QString fileName = newFileName( "snapshot" );
+	BinaryCacheWriter writer( fileName, _tree );
+
+	if ( ! writer.ok() )
+	{
+	    logError() << "Can't write snapshot " << fileName << endl;
+	    client->disconnectFromServer();
+	    return;
+	}
+
+	_snapshot = fileName;
+    }
+
+    client->write( "snapshot " + _snapshot.toUtf8() + "\n" );
+}
+
+
+void ScanDaemon::sendUpdates()
+{
+    QStringList paths;
+
+    foreach ( const QString & path, _changedDirs )
+    {
+	// Subdirectories are included in the update of their parent
+
+	bool parentChanged = false;
+
+	foreach ( const QString & dir, _changedDirs )
+	{
+	    if ( isBelow( path, dir ) )
+	    {
+		parentChanged = true;
+		break;
+	    }
+	}
+
+	if ( ! parentChanged )
+	    paths << path;
+    }
+
+    _changedDirs.clear();
+
+    foreach ( const QString & path, paths )
+    {
+	FileInfo * dir = _tree->locate( path );
+
+	if ( ! dir || ! dir->isDirInfo() )	// Gone; its parent is updated, too
+	    continue;
+
+	QString fileName = newFileName( "update" );
+	BinaryCacheWriter writer( fileName, _tree, dir );
+
+	if ( ! writer.ok() )
+	{
+	    logError() << "Can't write update " << fileName << endl;
+	    continue;
+	}
+
+	broadcast( "update " + path.toUtf8().toPercentEncoding() + " " + fileName.toUtf8() + "\n" );
+    }
+}
+
+
+void ScanDaemon::broadcast( const QByteArray & line )
+{
+    foreach ( QLocalSocket * client, _clients )
+    {
+	if ( ! _waitingClients.contains( client ) )
+	    client->write( line );
+    }
+}
+
+
+QString ScanDaemon::newFileName( const QString & kind )
+{
+    QString fileName = QString( "%1%2-%3%4" )
+	.arg( _prefix ).arg( kind ).arg( ++_fileCount ).arg( BINARY_CACHE_SUFFIX );
+    _files << fileName;
+
+    return fileName;
+}
+
+
+void ScanDaemon::removeOldFiles()
+{
+    while ( _files.size() > MAX_DAEMON_FILES )
+    {
+	QString fileName = _files.takeFirst();
+
+	if ( fileName == _snapshot )	// Still the current one
+	    _files << fileName;
+	else
+	    QFile::remove( fileName );
+    }
+}
+
+
+void ScanDaemon::removeAllFiles()
+{
+    QFileInfo prefix( _prefix );
+    QDir dir( prefix.path() );
+
+    foreach ( const QString & fileName, dir.entryList( QStringList() << prefix.fileName() + "*",
+							QDir::Files | QDir::System ) )
+    {
+	dir.remove( fileName );
+    }
+
+    _files.clear();
+    _snapshot.clear();
+}
+
+
+
+
+ScanDaemonClient::ScanDaemonClient( DirTree * tree ):
+    QObject(),
+    _tree( tree ),
+    _socket( 0 )
+{
+    connect( _tree, SIGNAL( finished()		  ),
+	     this,  SLOT  ( applyPendingUpdates() ) );
+}
+
+
+ScanDaemonClient::~ScanDaemonClient()
+{
+    close();
+}
+
+
+bool ScanDaemonClient::connectTo( const QString & dir )
+{
+    close();
+
+    QString name = ScanDaemon::socketName( dir );
+
+    if ( name.isEmpty() || ! QFile::exists( name ) )
+	return false;
+
+    _socket = new QLocalSocket( this );
+    CHECK_NEW( _socket );
+
+    _socket->connectToServer( name );
+
+    if ( ! _socket->waitForConnected( DAEMON_CONNECT_TIMEOUT_MILLISEC ) )
+    {
+	logWarning() << "Scan daemon for " << dir << " not responding" << endl;
+	delete _socket;
+	_socket = 0;
+
+	return false;
+    }
+
+    connect( _socket, SIGNAL( readyRead()    ),
+	     this,    SLOT  ( readMessages() ) );
+
+    connect( _socket, SIGNAL( disconnected() ),
+	     this,    SLOT  ( daemonGone()   ) );
+
+    _dir = dir;
+    logInfo() << "Getting " << dir << " from the scan daemon" << endl;
+
+    return true;
+}
+
+
+void ScanDaemonClient::close()
+{
+    if ( _socket )
+    {
+	_socket->disconnect( this );
+	_socket->abort();
+	_socket->deleteLater();
+	_socket = 0;
+    }
+
+    _pendingUpdates.clear();
+}
+
+
+void ScanDaemonClient::readMessages()
+{
+    while ( _socket && _socket->canReadLine() )
+    {
+	QByteArray line = _socket->readLine();
+	line.chop( 1 );	// newline
+
+	QList<QByteArray> fields = line.split( ' ' );
+
+	if ( fields.size() == 2 && fields[0] == "snapshot" )
+	{
+	    QString fileName = QString::fromUtf8( fields[1] );
+	    logInfo() << "Reading snapshot " << fileName << endl;
+
+	    CacheReadJob * job = new CacheReadJob( _tree, 0, fileName );
+	    CHECK_NEW( job );
+
+	    _tree->addJob( job );
+	}
+	else if ( fields.size() == 3 && fields[0] == "update" )
+	{
+	    QString path     = QString::fromUtf8( QByteArray::fromPercentEncoding( fields[1] ) );
+	    QString fileName = QString::fromUtf8( fields[2] );
+
+	    // One at a time: Each one is read by a job of its own
+
+	    _pendingUpdates << qMakePair( path, fileName );
+	    applyPendingUpdates();
+	}
+	else
+	{
+	    logError() << "Bad message from the scan daemon: \"" << line << "\"" << endl;
+	}
+    }
+}
+
+
+void ScanDaemonClient::daemonGone()
+{
+    logWarning() << "Scan daemon for " << _dir << " is gone; no more updates" << endl;
+    close();
+}
+
+
+void ScanDaemonClient::applyPendingUpdates()
+{
+    // Reading an update makes the tree busy until it is done; if it can't
+    // be read, continue with the next one right away.
+
+    while ( ! _tree->isBusy() && ! _pendingUpdates.isEmpty() )
+    {
+	QPair<QString, QString> update = _pendingUpdates.takeFirst();
+	applyUpdate( update.first, update.second );
+    }
+}
+
+
+void ScanDaemonClient::applyUpdate( const QString & path, const QString & fileName )
+{
+    FileInfo * oldDir = _tree->locate( path );
+
+    if ( oldDir )
+	_tree->deleteSubtree( oldDir );
+
+    // The reader finds the parent by the path of the first record
+
+    if ( ! _tree->readCache( fileName ) )
+	logError() << "Can't read update " << fileName << " for " << path << endl;
+}
@@ -0,0 +1,253 @@
+/*
+ *   File name: ScanDaemon.h
+ *   Summary:	Sharing one live directory tree with several sessions
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScanDaemon_h
+#define ScanDaemon_h
+
+
+#include <QObject>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+
+class QLocalServer;
+class QLocalSocket;
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class DirWatcher;
+
+
+    /**
+     * Scan daemon: "qdirstat --daemon <dir>" reads 'dir' once and keeps the
+     * tree up to date with a DirWatcher. Any number of QDirStat sessions
+     * that open the same directory get that tree from the daemon instead
+     * of reading it again (see ScanDaemonClient), so that is instant and
+     * does not cause any I/O on the filesystem.
+     *
+     * The daemon listens on a local socket in a directory that only the
+     * user can access (see runtimeDir()), so only sessions of the same user
+     * (typically root) can connect. It sends one line for each message:
+     *
+     *	 - "snapshot <file>": The complete tree is in binary cache file
+     *	   <file>. This is sent once to each new client, as soon as the
+     *	   initial read is done.
+     *
+     *	 - "update <path> <file>": The subtree at <path> (percent-encoded)
+     *	   changed; its new content is in binary cache file <file>.
+     *
+     * The clients read those files with the normal cache reader. The files
+     * are in the same directory as the socket; the newest ones are kept for
+     * a while so clients can still read them after newer ones are written.
+     *
+     * This does not need (and must not create) a QApplication: It might run
+     * without any display.
+     **/
+    class ScanDaemon: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor for a daemon for directory 'dir'.
+	 **/
+	ScanDaemon( const QString & dir );
+
+	/**
+	 * Destructor. This removes the socket and all files.
+	 **/
+	virtual ~ScanDaemon();
+
+	/**
+	 * Create the socket and start reading. Return 'false' if that failed,
+	 * e.g. if another daemon for the same directory is already running.
+	 **/
+	bool start();
+
+	/**
+	 * Run a daemon for 'dir' until it is killed. Return the exit code for
+	 * the program.
+	 **/
+	static int run( const QString & dir, int & argc, char ** argv );
+
+	/**
+	 * Return the directory for the socket and the files of all daemons
+	 * of the current user. This is created if needed. Return an empty
+	 * string if it does not exist and can't be created, or if anybody
+	 * else has access to it.
+	 **/
+	static QString runtimeDir();
+
+	/**
+	 * Return the name of the socket of the daemon for 'dir' or an empty
+	 * string if there is no usable runtime directory.
+	 **/
+	static QString socketName( const QString & dir );
+
+
+    protected slots:
+
+	/**
+	 * Accept new clients.
+	 **/
+	void newConnection();
+
+	/**
+	 * Forget clients that are gone.
+	 **/
+	void clientDisconnected();
+
+	/**
+	 * Notification that the watcher is about to read 'dir' again.
+	 **/
+	void dirRefreshing( DirInfo * dir );
+
+	/**
+	 * Notification that the tree is finished reading: Send the snapshot
+	 * after the initial read, the updates after that.
+	 **/
+	void treeFinished();
+
+
+    protected:
+
+	/**
+	 * Send the snapshot to 'client', writing a new one if needed.
+	 **/
+	void sendSnapshot( QLocalSocket * client );
+
+	/**
+	 * Write an update file for each changed directory and send it to all
+	 * clients.
+	 **/
+	void sendUpdates();
+
+	/**
+	 * Send 'line' to all clients.
+	 **/
+	void broadcast( const QByteArray & line );
+
+	/**
+	 * Return the name of a new file for the tree or a subtree.
+	 **/
+	QString newFileName( const QString & kind );
+
+	/**
+	 * Remove the oldest files that no client should still need.
+	 **/
+	void removeOldFiles();
+
+	/**
+	 * Remove all files of this daemon, also those of a previous daemon
+	 * for the same directory that was killed.
+	 **/
+	void removeAllFiles();
+
+
+	QString			_dir;
+	QString			_prefix;	// for all files of this daemon
+	DirTree *		_tree;
+	DirWatcher *		_watcher;
+	QLocalServer *		_server;
+	QList<QLocalSocket *>	_clients;
+	QList<QLocalSocket *>	_waitingClients;
+	QSet<QString>		_changedDirs;
+	QStringList		_files;		// oldest first
+	QString			_snapshot;
+	int			_fileCount;
+	bool			_initialReadDone;
+
+    };	// class ScanDaemon
+
+
+
+    /**
+     * The client side of the scan daemon: DirTree uses this to get its
+     * content from a daemon that is running for the directory that is
+     * opened, and to keep it up to date from the daemon's updates.
+     **/
+    class ScanDaemonClient: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	ScanDaemonClient( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~ScanDaemonClient();
+
+	/**
+	 * Connect to the daemon for 'dir'. Return 'false' if there is none.
+	 * If this succeeds, the tree is read from the daemon's snapshot as
+	 * soon as that is available.
+	 **/
+	bool connectTo( const QString & dir );
+
+	/**
+	 * Disconnect from the daemon. The tree stays as it is.
+	 **/
+	void close();
+
+	/**
+	 * Return 'true' if connected to a daemon.
+	 **/
+	bool isConnected() const { return _socket != 0; }
+
+
+    protected slots:
+
+	/**
+	 * Handle the messages from the daemon that are there.
+	 **/
+	void readMessages();
+
+	/**
+	 * Notification that the daemon is gone.
+	 **/
+	void daemonGone();
+
+	/**
+	 * Apply the updates that arrived while the tree was busy.
+	 **/
+	void applyPendingUpdates();
+
+
+    protected:
+
+	/**
+	 * Replace the subtree at 'path' with the content of cache file
+	 * 'file'.
+	 **/
+	void applyUpdate( const QString & path, const QString & file );
+
+
+	DirTree *			_tree;
+	QLocalSocket *			_socket;
+	QString				_dir;
+	QList<QPair<QString, QString> > _pendingUpdates;	// path, file
+
+    };	// class ScanDaemonClient
+
+}	// namespace QDirStat
+
+
+#endif // ifndef ScanDaemon_h
@@ -0,0 +1,308 @@
+/*
+ *   File name: ScanStats.cpp
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QStringList>
+
+#include "ScanStats.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Number of buckets of the stat latency histograms. Bucket 0 is for less
+// than 1 microsecond per entry, bucket i for 2^(i-1) .. 2^i microseconds,
+// the last one for everything above.
+
+#define LATENCY_BUCKETS		20
+
+#define NANOSEC_PER_MILLISEC	1000000LL
+
+// Don't estimate the remaining time before there is a reliable rate
+
+#define MIN_ENTRIES_FOR_ETA	1000
+#define MIN_MILLISEC_FOR_ETA	2000
+
+
+using namespace QDirStat;
+
+
+/**
+ * Return 'value' for a JSON document. JSON numbers are doubles anyway.
+ **/
+static QJsonValue jsonValue( qint64 value )
+{
+    return QJsonValue( (double) value );
+}
+
+
+ScanStats * ScanStats::instance()
+{
+    static ScanStats * stats = 0;
+
+    if ( ! stats )
+    {
+	stats = new ScanStats();
+	CHECK_NEW( stats );
+    }
+
+    return stats;
+}
+
+
+ScanStats::ScanStats():
+    _elapsedMillisec( 0 ),
+    _running( false )
+{
+    start();
+    _running = false;
+}
+
+
+void ScanStats::start()
+{
+    _devices.clear();
+    _dirs	     = 0;
+    _entries	     = 0;
+    _scanNanosec     = 0;
+    _treeNanosec     = 0;
+    _excludeChecks   = 0;
+    _excludeNanosec  = 0;
+    _modelNanosec    = 0;
+    _queueSamples    = 0;
+    _queueSum	     = 0;
+    _queueMax	     = 0;
+    _pendingScansMax = 0;
+    _expectedEntries = 0;
+
+    _elapsedMillisec = 0;
+    _running	     = true;
+    _timer.start();
+}
+
+
+void ScanStats::finish()
+{
+    if ( ! _running )
+	return;
+
+    _elapsedMillisec = _timer.elapsed();
+    _running	     = false;
+}
+
+
+qint64 ScanStats::elapsedMillisec() const
+{
+    return _running ? _timer.elapsed() : _elapsedMillisec;
+}
+
+
+qint64 ScanStats::entriesPerSec() const
+{
+    qint64 millisec = elapsedMillisec();
+
+    return millisec > 0 ? ( _entries * 1000 ) / millisec : 0;
+}
+
+
+int ScanStats::percentDone() const
+{
+    if ( ! _running || _expectedEntries <= 0 )
+	return -1;
+
+    return (int) qMin( ( _entries * 100 ) / _expectedEntries, 99LL );
+}
+
+
+qint64 ScanStats::remainingMillisec() const
+{
+    qint64 millisec = elapsedMillisec();
+
+    if ( percentDone() < 0 ||
+	 _entries  < MIN_ENTRIES_FOR_ETA ||
+	 millisec  < MIN_MILLISEC_FOR_ETA )
+    {
+	return -1;
+    }
+
+    // Beyond the estimate, nothing useful can be said any more
+
+    qint64 remaining = _expectedEntries - _entries;
+
+    if ( remaining <= 0 )
+	return -1;
+
+    return ( remaining * millisec ) / _entries;
+}
+
+
+void ScanStats::addScan( dev_t device, int entries, qint64 nanosec )
+{
+    DeviceStats & stats = _devices[ device ];
+
+    if ( stats.latency.isEmpty() )
+	stats.latency.fill( 0, LATENCY_BUCKETS );
+
+    stats.dirs++;
+    stats.entries += entries;
+    stats.nanosec += nanosec;
+    stats.latency[ latencyBucket( nanosec / qMax( entries, 1 ) ) ]++;
+
+    _scanNanosec += nanosec;
+}
+
+
+void ScanStats::addTreeBuilding( int entries, qint64 nanosec )
+{
+    _dirs++;
+    _entries	 += entries;
+    _treeNanosec += nanosec;
+}
+
+
+void ScanStats::sampleQueue( int queuedJobs, int pendingScans )
+{
+    _queueSamples++;
+    _queueSum	     += queuedJobs;
+    _queueMax	      = qMax( _queueMax, queuedJobs );
+    _pendingScansMax  = qMax( _pendingScansMax, pendingScans );
+}
+
+
+int ScanStats::latencyBucket( qint64 nanosec )
+{
+    qint64 microsec = nanosec / 1000;
+    int	   bucket   = 0;
+
+    while ( microsec > 0 && bucket < LATENCY_BUCKETS - 1 )
+    {
+	microsec >>= 1;
+	++bucket;
+    }
+
+    return bucket;
+}
+
+
+qint64 ScanStats::bucketLimit( int bucket )
+{
+    return bucket < LATENCY_BUCKETS - 1 ? 1LL << bucket : -1;
+}
+
+
+QByteArray ScanStats::toJson() const
+{
+    QJsonObject json;
+
+    json[ "elapsedMillisec"	 ] = jsonValue( elapsedMillisec() );
+    json[ "running"		 ] = _running;
+    json[ "dirs"		 ] = jsonValue( _dirs );
+    json[ "entries"		 ] = jsonValue( _entries );
+    json[ "entriesPerSec"	 ] = jsonValue( entriesPerSec() );
+    json[ "scanMillisec"	 ] = jsonValue( _scanNanosec    / NANOSEC_PER_MILLISEC );
+    json[ "treeMillisec"	 ] = jsonValue( _treeNanosec    / NANOSEC_PER_MILLISEC );
+    json[ "excludeChecks"	 ] = jsonValue( _excludeChecks );
+    json[ "excludeMillisec"	 ] = jsonValue( _excludeNanosec / NANOSEC_PER_MILLISEC );
+    json[ "modelMillisec"	 ] = jsonValue( _modelNanosec   / NANOSEC_PER_MILLISEC );
+    json[ "queueAvg"		 ] = jsonValue( _queueSamples > 0 ? _queueSum / _queueSamples : 0 );
+    json[ "queueMax"		 ] = jsonValue( _queueMax );
+    json[ "pendingScansMax"	 ] = jsonValue( _pendingScansMax );
+    json[ "expectedEntries"	 ] = jsonValue( _expectedEntries );
+
+    QJsonArray devices;
+
+    for ( QMap<dev_t, DeviceStats>::const_iterator it = _devices.constBegin();
+	  it != _devices.constEnd();
+	  ++it )
+    {
+	const DeviceStats & stats = it.value();
+	QJsonObject device;
+	QJsonArray  latency;
+
+	// Only up to the last bucket that is in use
+
+	int last = stats.latency.size() - 1;
+
+	while ( last >= 0 && stats.latency.at( last ) == 0 )
+	    --last;
+
+	for ( int i = 0; i <= last; ++i )
+	    latency.append( jsonValue( stats.latency.at( i ) ) );
+
+	device[ "device"	 ] = jsonValue( (qint64) it.key() );
+	device[ "dirs"		 ] = jsonValue( stats.dirs );
+	device[ "entries"	 ] = jsonValue( stats.entries );
+	device[ "scanMillisec"	 ] = jsonValue( stats.nanosec / NANOSEC_PER_MILLISEC );
+	device[ "latencyHistogram" ] = latency;
+
+	devices.append( device );
+    }
+
+    json[ "devices" ] = devices;
+
+    return QJsonDocument( json ).toJson( QJsonDocument::Compact );
+}
+
+
+QString ScanStats::toText() const
+{
+    QStringList lines;
+
+    lines << QString( "Elapsed:           %1 ms%2" ).arg( elapsedMillisec() )
+	.arg( _running ? " (reading)" : "" )
+	  << QString( "Directories:       %1" ).arg( _dirs )
+	  << QString( "Entries:           %1" ).arg( _entries )
+	  << QString( "Entries / sec:     %1" ).arg( entriesPerSec() )
+	  << QString( "Expected entries:  %1" )
+	.arg( _expectedEntries > 0 ? QString::number( _expectedEntries ) : QString( "unknown" ) )
+	  << QString( "Scanner time:      %1 ms" ).arg( _scanNanosec / NANOSEC_PER_MILLISEC )
+	  << QString( "Tree building:     %1 ms" ).arg( _treeNanosec / NANOSEC_PER_MILLISEC )
+	  << QString( "Exclude rules:     %1 ms for %2 checks" )
+	.arg( _excludeNanosec / NANOSEC_PER_MILLISEC ).arg( _excludeChecks )
+	  << QString( "Model and views:   %1 ms" ).arg( _modelNanosec / NANOSEC_PER_MILLISEC )
+	  << QString( "Queue depth:       %1 avg, %2 max" )
+	.arg( _queueSamples > 0 ? _queueSum / _queueSamples : 0 ).arg( _queueMax )
+	  << QString( "Pending scans:     %1 max" ).arg( _pendingScansMax );
+
+    for ( QMap<dev_t, DeviceStats>::const_iterator it = _devices.constBegin();
+	  it != _devices.constEnd();
+	  ++it )
+    {
+	const DeviceStats & stats = it.value();
+
+	lines << ""
+	      << QString( "Device %1: %2 directories, %3 entries, %4 ms" )
+	    .arg( (qint64) it.key() ).arg( stats.dirs ).arg( stats.entries )
+	    .arg( stats.nanosec / NANOSEC_PER_MILLISEC )
+	      << "  Stat latency per entry:";
+
+	for ( int i = 0; i < stats.latency.size(); ++i )
+	{
+	    if ( stats.latency.at( i ) == 0 )
+		continue;
+
+	    qint64  limit = bucketLimit( i );
+	    QString range = limit < 0 ?
+		QString( ">= %1 us" ).arg( 1LL << ( i - 1 ) ) :
+		QString( "<  %1 us" ).arg( limit );
+
+	    lines << QString( "    %1: %2 directories" )
+		.arg( range, -12 ).arg( stats.latency.at( i ) );
+	}
+    }
+
+    return lines.join( "\n" );
+}
+
+
+void ScanStats::dumpToLog() const
+{
+    logInfo() << "Scan statistics: " << QString::fromUtf8( toJson() ) << endl;
+}
@@ -0,0 +1,208 @@
+/*
+ *   File name: ScanStats.h
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScanStats_h
+#define ScanStats_h
+
+
+#include <sys/types.h>
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QMap>
+#include <QElapsedTimer>
+
+
+namespace QDirStat
+{
+    /**
+     * Counters to find out why reading a directory tree is slow: Whether the
+     * time goes into the system calls (i.e. the storage is slow) or into
+     * QDirStat's own overhead like building the tree, checking the exclude
+     * rules or updating the model and the views.
+     *
+     * All counters are updated in the GUI thread only; the time the scanner
+     * threads need for a directory is passed back with the DirScanResult.
+     *
+     * The counters are reset when reading starts. They can be shown in the
+     * ScanStatsWindow (Ctrl+F7), and they are dumped to the log as JSON
+     * when reading is finished.
+     **/
+    class ScanStats
+    {
+    public:
+
+	/**
+	 * Return the singleton for this class.
+	 **/
+	static ScanStats * instance();
+
+	/**
+	 * Reset all counters and start the clock. This is called when
+	 * reading starts.
+	 **/
+	void start();
+
+	/**
+	 * Stop the clock. This is called when reading is finished.
+	 **/
+	void finish();
+
+	/**
+	 * Return 'true' if reading is in progress.
+	 **/
+	bool isRunning() const { return _running; }
+
+	/**
+	 * Add the result of reading one directory with 'entries' entries on
+	 * 'device' that took 'nanosec' nanoseconds in the system calls.
+	 **/
+	void addScan( dev_t device, int entries, qint64 nanosec );
+
+	/**
+	 * Add the time for creating the tree nodes for 'entries' entries in
+	 * the GUI thread.
+	 **/
+	void addTreeBuilding( int entries, qint64 nanosec );
+
+	/**
+	 * Add the time for checking one entry against the exclude rules and
+	 * the filters.
+	 **/
+	void addExcludeCheck( qint64 nanosec )
+	    { ++_excludeChecks; _excludeNanosec += nanosec; }
+
+	/**
+	 * Add the time for updating the model and the views.
+	 **/
+	void addModelUpdate( qint64 nanosec ) { _modelNanosec += nanosec; }
+
+	/**
+	 * Record the current depth of the read job queue and the number of
+	 * directories waiting for or being read in scanner threads.
+	 **/
+	void sampleQueue( int queuedJobs, int pendingScans );
+
+	/**
+	 * Return the elapsed time since reading started in milliseconds.
+	 **/
+	qint64 elapsedMillisec() const;
+
+	/**
+	 * Return the number of entries read per second so far.
+	 **/
+	qint64 entriesPerSec() const;
+
+	/**
+	 * Set the number of entries that reading is expected to find, e.g.
+	 * from the used inodes of the filesystems, or 0 if that is unknown.
+	 * This has to be set after reading has started; start() resets it.
+	 **/
+	void setExpectedEntries( qint64 entries ) { _expectedEntries = entries; }
+
+	/**
+	 * Return the number of entries that reading is expected to find or 0
+	 * if that is unknown.
+	 **/
+	qint64 expectedEntries() const { return _expectedEntries; }
+
+	/**
+	 * Return how much of the expected entries were read so far in
+	 * percent, or -1 if that is unknown or if reading is not in
+	 * progress. Since the expected number is only an estimate, this never
+	 * returns more than 99.
+	 **/
+	int percentDone() const;
+
+	/**
+	 * Return the estimated time until reading is finished in
+	 * milliseconds at the rate so far, or -1 if that is unknown.
+	 **/
+	qint64 remainingMillisec() const;
+
+	/**
+	 * Return all counters as a JSON document in one line.
+	 **/
+	QByteArray toJson() const;
+
+	/**
+	 * Return all counters as human readable text with one item per line.
+	 **/
+	QString toText() const;
+
+	/**
+	 * Write all counters to the log as JSON.
+	 **/
+	void dumpToLog() const;
+
+
+    protected:
+
+	/**
+	 * Constructor. Use instance() instead.
+	 **/
+	ScanStats();
+
+	/**
+	 * Return the latency histogram bucket for 'nanosec' per entry.
+	 **/
+	static int latencyBucket( qint64 nanosec );
+
+	/**
+	 * Return the upper limit of latency histogram bucket 'bucket' in
+	 * microseconds or -1 for the last one.
+	 **/
+	static qint64 bucketLimit( int bucket );
+
+
+	struct DeviceStats
+	{
+	    DeviceStats():
+		dirs( 0 ),
+		entries( 0 ),
+		nanosec( 0 )
+		{}
+
+	    qint64	    dirs;
+	    qint64	    entries;
+	    qint64	    nanosec;
+	    QVector<qint64> latency;	// Histogram: Directories per bucket
+	};
+
+
+	//
+	// Data members
+	//
+
+	QElapsedTimer		    _timer;
+	qint64			    _elapsedMillisec;
+	bool			    _running;
+
+	QMap<dev_t, DeviceStats>    _devices;
+	qint64			    _dirs;
+	qint64			    _entries;
+	qint64			    _scanNanosec;
+	qint64			    _treeNanosec;
+	qint64			    _excludeChecks;
+	qint64			    _excludeNanosec;
+	qint64			    _modelNanosec;
+
+	qint64			    _queueSamples;
+	qint64			    _queueSum;
+	int			    _queueMax;
+	int			    _pendingScansMax;
+	qint64			    _expectedEntries;
+
+    };	// class ScanStats
+
+}	// namespace QDirStat
+
+
+#endif // ifndef ScanStats_h
@@ -0,0 +1,94 @@
+/*
+ *   File name: ScanStatsWindow.cpp
+ *   Summary:	QDirStat scan statistics window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QFontDatabase>
+
+#include "ScanStatsWindow.h"
+#include "ScanStats.h"
+#include "QDirStatApp.h"
+#include "SettingsHelpers.h"
+#include "Logger.h"
+#include "Exception.h"
+
+#define REFRESH_MILLISEC	1000
+
+using namespace QDirStat;
+
+
+QPointer<ScanStatsWindow> ScanStatsWindow::_sharedInstance = 0;
+
+
+ScanStatsWindow::ScanStatsWindow( QWidget * parent ):
+    QDialog( parent ),
+    _ui( new Ui::ScanStatsWindow )
+{
+    CHECK_NEW( _ui );
+    _ui->setupUi( this );
+    _ui->statsText->setFont( QFontDatabase::systemFont( QFontDatabase::FixedFont ) );
+    readWindowSettings( this, "ScanStatsWindow" );
+
+    connect( _ui->dumpButton, SIGNAL( clicked()   ),
+	     this,	      SLOT  ( dumpToLog() ) );
+
+    connect( &_timer,	      SIGNAL( timeout() ),
+	     this,	      SLOT  ( refresh() ) );
+
+    _timer.start( REFRESH_MILLISEC );
+    refresh();
+}
+
+
+ScanStatsWindow::~ScanStatsWindow()
+{
+    writeWindowSettings( this, "ScanStatsWindow" );
+    delete _ui;
+}
+
+
+ScanStatsWindow * ScanStatsWindow::sharedInstance()
+{
+    if ( ! _sharedInstance )
+    {
+	_sharedInstance = new ScanStatsWindow( app()->findMainWindow() );
+	CHECK_NEW( _sharedInstance );
+    }
+
+    return _sharedInstance;
+}
+
+
+void ScanStatsWindow::showSharedInstance()
+{
+    sharedInstance()->refresh();
+    sharedInstance()->show();
+    sharedInstance()->raise();
+}
+
+
+void ScanStatsWindow::reject()
+{
+    deleteLater();
+}
+
+
+void ScanStatsWindow::refresh()
+{
+    QString text = ScanStats::instance()->toText();
+
+    // Don't reset the scroll position if nothing changed
+
+    if ( text != _ui->statsText->toPlainText() )
+	_ui->statsText->setPlainText( text );
+}
+
+
+void ScanStatsWindow::dumpToLog()
+{
+    ScanStats::instance()->dumpToLog();
+}
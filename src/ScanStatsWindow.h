@@ -0,0 +1,98 @@
+/*
+ *   File name: ScanStatsWindow.h
+ *   Summary:	QDirStat scan statistics window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScanStatsWindow_h
+#define ScanStatsWindow_h
+
+#include <QDialog>
+#include <QPointer>
+#include <QTimer>
+
+#include "ui_scan-stats-window.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Modeless debug dialog to display the ScanStats counters. While
+     * reading, they are updated once a second.
+     *
+     * This window is opened with the invisible Ctrl+F7 debug action.
+     **/
+    class ScanStatsWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 **/
+	ScanStatsWindow( QWidget * parent = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~ScanStatsWindow();
+
+	/**
+	 * Static method for using one shared instance of this class. This
+	 * will create a new instance if there is none yet (or anymore).
+	 *
+	 * Do not hold on to this pointer; the instance destroys itself when
+	 * the user closes the window, and then the pointer becomes invalid.
+	 **/
+	static ScanStatsWindow * sharedInstance();
+
+	/**
+	 * Convenience function for creating and showing the shared instance.
+	 **/
+	static void showSharedInstance();
+
+
+    public slots:
+
+	/**
+	 * Show the current counters.
+	 **/
+	void refresh();
+
+	/**
+	 * Write the current counters to the log as JSON.
+	 **/
+	void dumpToLog();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Close" or
+	 * WM_CLOSE button. This not only closes the dialog, it also deletes
+	 * it.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+
+    protected:
+
+	//
+	// Data members
+	//
+
+	Ui::ScanStatsWindow * _ui;
+	QTimer		      _timer;
+
+	static QPointer<ScanStatsWindow> _sharedInstance;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef ScanStatsWindow_h
@@ -0,0 +1,300 @@
+/*
+ *   File name: ScanTuner.cpp
+ *   Summary:	Automatic tuning of the directory reading threads per device
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QUrl>
+
+#include "ScanTuner.h"
+#include "Settings.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// A measuring window needs both this much time and this many directories
+// to say anything about the rate
+
+#define TUNE_WINDOW_MILLISEC	1000
+#define TUNE_WINDOW_MIN_DIRS	100
+
+// Ignore windows where the thread pool was idle for more than this
+// fraction of the directories
+
+#define TUNE_MAX_IDLE_FRACTION	0.25
+
+// A rate that is not at least this much better than the best one so far is
+// no improvement; this keeps measuring noise from adding threads.
+
+#define TUNE_MIN_GAIN		0.10
+
+// Back off when the time for each entry goes up by this factor
+
+#define TUNE_MAX_LATENCY_RISE	2.0
+
+#define TUNE_MAX_THREADS	64
+
+// Try once more to add threads after this many measuring windows with the
+// same number; the load of the device might have changed.
+
+#define TUNE_REPROBE_WINDOWS	30
+
+#define SETTINGS_GROUP		"ScanThreadsPerDevice"
+
+
+using namespace QDirStat;
+
+
+bool ScanTuner::_enabled = true;
+
+
+ScanTuner::ScanTuner():
+    _settingsRead( false )
+{
+    // NOP
+}
+
+
+ScanTuner::~ScanTuner()
+{
+    writeSettings();
+}
+
+
+int ScanTuner::addDevice( dev_t device, const QString & deviceName, int defaultThreads )
+{
+    readSettings();
+
+    DeviceTuning tuning;
+    tuning.deviceName = deviceName;
+    tuning.threads    = qBound( 1, _remembered.value( deviceName, defaultThreads ), TUNE_MAX_THREADS );
+
+    if ( deviceName.isEmpty() )
+	tuning.threads = qBound( 1, defaultThreads, TUNE_MAX_THREADS );
+
+    tuning.bestThreads = tuning.threads;
+
+    _devices.insert( device, tuning );
+
+    return tuning.threads;
+}
+
+
+int ScanTuner::threads( dev_t device ) const
+{
+    QHash<dev_t, DeviceTuning>::const_iterator it = _devices.constFind( device );
+
+    return it == _devices.constEnd() ? 0 : it.value().threads;
+}
+
+
+int ScanTuner::addScan( dev_t device, int entries, qint64 nanosec, bool busy )
+{
+    QHash<dev_t, DeviceTuning>::iterator it = _devices.find( device );
+
+    if ( it == _devices.end() )
+	return 0;
+
+    DeviceTuning & tuning = it.value();
+
+    if ( ! tuning.timer.isValid() )
+	tuning.timer.start();
+
+    ++tuning.dirs;
+    tuning.entries += entries;
+    tuning.nanosec += nanosec;
+
+    if ( ! busy )
+	++tuning.idleDirs;
+
+    if ( tuning.dirs < TUNE_WINDOW_MIN_DIRS || tuning.timer.elapsed() < TUNE_WINDOW_MILLISEC )
+	return 0;
+
+    int newThreads = climb( tuning );
+    resetWindow( tuning );
+
+    return newThreads;
+}
+
+
+int ScanTuner::climb( DeviceTuning & tuning )
+{
+    if ( tuning.idleDirs > tuning.dirs * TUNE_MAX_IDLE_FRACTION || tuning.entries == 0 )
+    {
+	// Not enough work to keep all threads busy: The rate says nothing
+	// about the number of threads.
+
+	return 0;
+    }
+
+    int	   oldThreads = tuning.threads;
+    double rate	      = tuning.entries * 1000.0 / qMax( 1LL, (qint64) tuning.timer.elapsed() );
+    double latency    = (double) tuning.nanosec / tuning.entries;
+
+    if ( tuning.settledWindows > 0 )
+    {
+	if ( ++tuning.settledWindows < TUNE_REPROBE_WINDOWS )
+	    return 0;
+
+	// Start climbing again from here
+
+	tuning.settledWindows = 0;
+	tuning.reversed	      = false;
+	tuning.step	      = 1;
+	tuning.bestRate	      = 0.0;
+    }
+
+    bool improved = rate > tuning.bestRate * ( 1.0 + TUNE_MIN_GAIN );
+
+    if ( tuning.bestRate > 0.0 && tuning.lastLatency > 0.0 &&
+	 latency > tuning.lastLatency * TUNE_MAX_LATENCY_RISE &&
+	 rate < tuning.lastRate * ( 1.0 + TUNE_MIN_GAIN ) )
+    {
+	// The device is congested
+	improved = false;
+    }
+
+    tuning.lastRate    = rate;
+    tuning.lastLatency = latency;
+
+    if ( improved )
+    {
+	tuning.bestRate	   = rate;
+	tuning.bestThreads = tuning.threads;
+    }
+    else
+    {
+	if ( tuning.reversed )
+	{
+	    settle( tuning );
+
+	    return tuning.threads == oldThreads ? 0 : tuning.threads;
+	}
+
+	// Try the other direction from the best number so far
+
+	tuning.reversed = true;
+	tuning.step	= -tuning.step;
+	tuning.threads	= tuning.bestThreads;
+    }
+
+    // Big steps upwards to get to many threads quickly, small ones
+    // downwards
+
+    int threads = tuning.threads;
+
+    if ( tuning.step > 0 )
+	threads += qMax( 1, threads / 2 );
+    else
+	threads -= qMax( 1, threads / 4 );
+
+    threads = qBound( 1, threads, TUNE_MAX_THREADS );
+
+    if ( threads == tuning.threads )
+    {
+	// At the limit in this direction
+
+	if ( tuning.reversed )
+	{
+	    settle( tuning );
+	}
+	else
+	{
+	    tuning.reversed = true;
+	    tuning.step	    = -tuning.step;
+	}
+    }
+    else
+    {
+	logInfo() << "Trying " << threads << " threads for device " << tuning.deviceName
+		  << ": " << qRound( rate ) << " entries/sec with " << oldThreads << endl;
+
+	tuning.threads = threads;
+    }
+
+    return tuning.threads == oldThreads ? 0 : tuning.threads;
+}
+
+
+void ScanTuner::settle( DeviceTuning & tuning )
+{
+    tuning.threads	  = tuning.bestThreads;
+    tuning.settledWindows = 1;
+
+    logInfo() << "Using " << tuning.threads << " threads for device " << tuning.deviceName
+	      << ": " << qRound( tuning.bestRate ) << " entries/sec" << endl;
+
+    if ( ! tuning.deviceName.isEmpty() &&
+	 _remembered.value( tuning.deviceName ) != tuning.threads )
+    {
+	_remembered.insert( tuning.deviceName, tuning.threads );
+	_changed.insert( tuning.deviceName );
+    }
+}
+
+
+void ScanTuner::resetWindow( DeviceTuning & tuning )
+{
+    tuning.timer.invalidate();
+    tuning.dirs	    = 0;
+    tuning.idleDirs = 0;
+    tuning.entries  = 0;
+    tuning.nanosec  = 0;
+}
+
+
+void ScanTuner::clear()
+{
+    writeSettings();
+    _devices.clear();
+}
+
+
+void ScanTuner::readSettings()
+{
+    if ( _settingsRead )
+	return;
+
+    _settingsRead = true;
+
+    Settings settings;
+    settings.beginGroup( SETTINGS_GROUP );
+
+    foreach ( const QString & key, settings.childKeys() )
+    {
+	int threads = settings.value( key, 0 ).toInt();
+
+	if ( threads > 0 )
+	    _remembered.insert( QUrl::fromPercentEncoding( key.toLatin1() ), threads );
+    }
+
+    settings.endGroup();
+}
+
+
+void ScanTuner::writeSettings()
+{
+    if ( _changed.isEmpty() )
+	return;
+
+    Settings settings;
+    settings.beginGroup( SETTINGS_GROUP );
+
+    foreach ( const QString & deviceName, _changed )
+	settings.setValue( settingsKey( deviceName ), _remembered.value( deviceName ) );
+
+    settings.endGroup();
+    _changed.clear();
+}
+
+
+QString ScanTuner::settingsKey( const QString & deviceName )
+{
+    // Device names like "/dev/sda2" or "nas:/export" have slashes which
+    // QSettings would take as groups
+
+    return QString::fromLatin1( QUrl::toPercentEncoding( deviceName ) );
+}
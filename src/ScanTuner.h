@@ -0,0 +1,182 @@
+/*
+ *   File name: ScanTuner.h
+ *   Summary:	Automatic tuning of the directory reading threads per device
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScanTuner_h
+#define ScanTuner_h
+
+
+#include <sys/types.h>	// dev_t
+
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
+
+
+namespace QDirStat
+{
+    /**
+     * Hill climbing for the number of DirScanner worker threads of each
+     * device: A fast SSD reads fastest with many stat calls in flight, a
+     * rotational disk with one or two, and for a network filesystem it
+     * depends on the server. So this measures the entries per second that
+     * are read from each device for a while, and it keeps adding threads
+     * as long as that improves. When it gets worse, or when the time for
+     * each entry goes up a lot without the rate improving, it goes back to
+     * the best number so far and tries the other direction.
+     *
+     * Only busy time counts: As long as the thread pool of a device is not
+     * saturated, the rate depends on how fast the directories are queued,
+     * not on the number of threads.
+     *
+     * The best number for each device is remembered in the settings
+     * (group [ScanThreadsPerDevice]) by its device name, so the next scan
+     * of that device starts with it.
+     *
+     * This is used only in the GUI thread.
+     **/
+    class ScanTuner
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	ScanTuner();
+
+	/**
+	 * Destructor. This writes the remembered thread counts.
+	 **/
+	~ScanTuner();
+
+	/**
+	 * Enable or disable tuning. When disabled, the thread pools keep the
+	 * number of threads from the settings.
+	 **/
+	static void setEnabled( bool enabled ) { _enabled = enabled; }
+
+	/**
+	 * Return 'true' if tuning is enabled.
+	 **/
+	static bool isEnabled() { return _enabled; }
+
+	/**
+	 * Start tuning 'device' with the device name 'deviceName' (empty if
+	 * unknown) and return the number of threads to start with: The
+	 * remembered one or 'defaultThreads'.
+	 **/
+	int addDevice( dev_t device, const QString & deviceName, int defaultThreads );
+
+	/**
+	 * Return the current number of threads for 'device' or 0 if it is
+	 * not tuned.
+	 **/
+	int threads( dev_t device ) const;
+
+	/**
+	 * Notification that a directory with 'entries' entries on 'device'
+	 * was read in 'nanosec' nanoseconds. 'busy' is 'true' if the thread
+	 * pool of that device had enough work for all of its threads.
+	 *
+	 * Return the new number of threads for 'device' if it should change
+	 * or 0 if not.
+	 **/
+	int addScan( dev_t device, int entries, qint64 nanosec, bool busy );
+
+	/**
+	 * Forget all devices, but keep the remembered thread counts. This
+	 * writes the ones that changed to the settings.
+	 **/
+	void clear();
+
+	/**
+	 * Write the remembered thread counts that changed to the settings.
+	 **/
+	void writeSettings();
+
+
+    protected:
+
+	struct DeviceTuning
+	{
+	    DeviceTuning():
+		threads( 1 ),
+		step( 1 ),
+		bestThreads( 1 ),
+		bestRate( 0.0 ),
+		lastRate( 0.0 ),
+		lastLatency( 0.0 ),
+		reversed( false ),
+		settledWindows( 0 ),
+		dirs( 0 ),
+		idleDirs( 0 ),
+		entries( 0 ),
+		nanosec( 0 )
+		{}
+
+	    QString	  deviceName;
+	    int		  threads;
+	    int		  step;		// +1 or -1: the direction to try next
+	    int		  bestThreads;
+	    double	  bestRate;	// entries per second
+	    double	  lastRate;
+	    double	  lastLatency;	// nanosec per entry
+	    bool	  reversed;	// tried the other direction already
+	    int		  settledWindows; // 0 while climbing
+
+	    // The current measuring window
+
+	    QElapsedTimer timer;
+	    int		  dirs;
+	    int		  idleDirs;
+	    qint64	  entries;
+	    qint64	  nanosec;
+	};
+
+	/**
+	 * Evaluate the finished measuring window of 'tuning' and return the
+	 * new number of threads or 0 if it stays the same.
+	 **/
+	int climb( DeviceTuning & tuning );
+
+	/**
+	 * Stop climbing for 'tuning' and stay with the best number of
+	 * threads so far.
+	 **/
+	void settle( DeviceTuning & tuning );
+
+	/**
+	 * Start a new measuring window for 'tuning'.
+	 **/
+	static void resetWindow( DeviceTuning & tuning );
+
+	/**
+	 * Read the remembered thread counts from the settings.
+	 **/
+	void readSettings();
+
+	/**
+	 * Return the settings key for device name 'deviceName'.
+	 **/
+	static QString settingsKey( const QString & deviceName );
+
+
+	QHash<dev_t, DeviceTuning>  _devices;
+	QHash<QString, int>	    _remembered;	// device name -> threads
+	QSet<QString>		    _changed;
+	bool			    _settingsRead;
+
+	static bool		    _enabled;
+
+    };	// class ScanTuner
+
+}	// namespace QDirStat
+
+
+#endif // ifndef ScanTuner_h
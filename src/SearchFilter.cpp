@@ -28,7 +28,7 @@ SearchFilter::SearchFilter( const QString & pattern,
     if ( _filterMode == Wildcard )
         _regexp.setPatternSyntax( QRegExp::Wildcard );
 
-    _regexp.setCaseSensitivity( Qt::CaseInsensitive );
+    setCaseSensitive( false );
 }
 
 
@@ -87,7 +87,18 @@ bool SearchFilter::matches( const QString & str ) const
         case Contains:   return str.contains  ( _pattern, caseSensitivity );
         case StartsWith: return str.startsWith( _pattern, caseSensitivity );
         case ExactMatch: return QString::compare( str, _pattern, caseSensitivity ) == 0;
-        case Wildcard:   return _regexp.exactMatch( str );
+        case Wildcard:
+            if ( _matcher.matchType() == NameMatcher::Wildcard )
+            {
+                QByteArray utf8 = str.toUtf8();
+                NameMatcher::Result result = _matcher.match( utf8.constData(), utf8.size() );
+
+                if ( result != NameMatcher::Undecided )
+                    return result == NameMatcher::Match;
+            }
+
+            return _regexp.exactMatch( str );
+
         case RegExp:     return str.contains( _regexp );
         case SelectAll:  return true;
         case Auto:
@@ -100,10 +111,44 @@ bool SearchFilter::matches( const QString & str ) const
 }
 
 
+bool SearchFilter::matchesUtf8( const char * bytes, int len ) const
+{
+    switch ( _matcher.match( bytes, len ) )
+    {
+        case NameMatcher::Match:     return true;
+        case NameMatcher::NoMatch:   return false;
+        case NameMatcher::Undecided: break;
+    }
+
+    return matches( QString::fromUtf8( bytes, len ) );
+}
+
+
 void SearchFilter::setCaseSensitive( bool sensitive )
 {
     _regexp.setCaseSensitivity( sensitive ?
                                 Qt::CaseSensitive : Qt::CaseInsensitive );
+    compileMatcher();
+}
+
+
+void SearchFilter::compileMatcher()
+{
+    NameMatcher::MatchType matchType = NameMatcher::None;
+
+    switch ( _filterMode )
+    {
+        case Contains:   matchType = NameMatcher::Contains;   break;
+        case StartsWith: matchType = NameMatcher::StartsWith; break;
+        case ExactMatch: matchType = NameMatcher::ExactMatch; break;
+        case Wildcard:   matchType = NameMatcher::Wildcard;   break;
+        case RegExp:
+        case SelectAll:
+        case Auto:
+            break;
+    }
+
+    _matcher.compile( _pattern, matchType, isCaseSensitive() );
 }
 
 
@@ -13,6 +13,8 @@
 #include <QRegExp>
 #include <QTextStream>
 
+#include "NameMatcher.h"
+
 
 namespace QDirStat
 {
@@ -56,6 +58,17 @@ namespace QDirStat
          **/
         bool matches( const QString & str ) const;
 
+        /**
+         * Check if a name with 'len' bytes 'bytes' in UTF-8 matches this
+         * filter, e.g. the name of a tree node (see CompactName).
+         *
+         * For fixed strings and simple wildcards, this works directly on
+         * the bytes without converting the name to a QString (see
+         * NameMatcher), so use this rather than matches() for names that
+         * are UTF-8 anyway.
+         **/
+        bool matchesUtf8( const char * bytes, int len ) const;
+
         /**
          * Return the pattern.
          **/
@@ -97,6 +110,13 @@ namespace QDirStat
          **/
         void guessFilterMode();
 
+        /**
+         * Set up the fast matcher for the current pattern, filter mode and
+         * case sensitivity. setCaseSensitive() does this, so derived
+         * classes only need this if they change anything after that.
+         **/
+        void compileMatcher();
+
 
         // Data members
 
@@ -104,6 +124,7 @@ namespace QDirStat
         QRegExp         _regexp;
         FilterMode      _filterMode;
         FilterMode      _defaultFilterMode;
+        NameMatcher     _matcher;
 
     };  // class SearchFilter
 
@@ -63,26 +63,44 @@ FileInfoSet SelectionModel::selectedItems()
 {
     if ( _selectedItemsDirty )
     {
-	// Build set of selected items from the selected model indexes
+	// Build set of selected items from the selected row ranges
 
-	_selectedItems.clear();
+	_selectedItems	    = items( selection() );
+	_selectedItemsDirty = false;
+    }
+
+    return _selectedItems;
+}
+
+
+FileInfoSet SelectionModel::items( const QItemSelection & selection ) const
+{
+    FileInfoSet items;
+
+    foreach ( const QItemSelectionRange & range, selection )
+    {
+	// Whole rows are selected, so column 0 is enough
+
+	if ( ! range.isValid() || range.left() > 0 )
+	    continue;
+
+	items.reserve( items.size() + range.height() );
 
-	foreach ( const QModelIndex index, selectedIndexes() )
+	for ( int row = range.top(); row <= range.bottom(); ++row )
 	{
+	    QModelIndex index = _dirTreeModel->index( row, 0, range.parent() );
+
 	    if ( index.isValid() )
 	    {
 		FileInfo * item = static_cast<FileInfo *>( index.internalPointer() );
-		CHECK_MAGIC( item );
 
-		// logDebug() << "Adding " << item << " col " << index.column() << " to selected items" << endl;
-		_selectedItems << item;
+		// logDebug() << "Adding " << item << " to selected items" << endl;
+		items << item;
 	    }
 	}
-
-	_selectedItemsDirty = false;
     }
 
-    return _selectedItems;
+    return items;
 }
 
 
@@ -112,10 +130,21 @@ void SelectionModel::propagateCurrentChanged( const QModelIndex & newCurrentInde
 void SelectionModel::propagateSelectionChanged( const QItemSelection & selected,
 						const QItemSelection & deselected )
 {
-    Q_UNUSED( selected );
-    Q_UNUSED( deselected );
+    // Only convert the ranges that changed, not the complete selection
 
-    _selectedItemsDirty = true;
+    FileInfoSet added	= items( selected   );
+    FileInfoSet removed = items( deselected );
+
+    if ( ! _selectedItemsDirty )
+    {
+	_selectedItems.subtract( removed );
+	_selectedItems.unite( added );
+    }
+
+    // The delta first, so anything that keeps its own state from the
+    // deltas is up to date when selectionChanged() is handled
+
+    emit selectionDelta( added, removed );
     emit selectionChanged();
     emit selectionChanged( selectedItems() );
 }
@@ -132,6 +161,7 @@ void SelectionModel::extendSelection( FileInfo * item, bool clear )
 {
     if ( item )
     {
+	_dirTreeModel->fetchItem( item );
 	QModelIndex index = _dirTreeModel->modelIndex( item, 0 );
 
 	if ( index.isValid() )
@@ -162,6 +192,7 @@ void SelectionModel::setSelectedItems( const FileInfoSet & selectedItems )
 
     foreach ( FileInfo * item, selectedItems )
     {
+	_dirTreeModel->fetchItem( item );
 	QModelIndex index = _dirTreeModel->modelIndex( item, 0 );
 
 	if ( index.isValid() )
@@ -184,6 +215,7 @@ void SelectionModel::setCurrentItem( FileInfo * item, bool select )
 
     if ( item )
     {
+	_dirTreeModel->fetchItem( item );
 	QModelIndex index = _dirTreeModel->modelIndex( item, 0 );
 
 	if ( index.isValid() )
@@ -223,6 +255,7 @@ void SelectionModel::setCurrentItem( const QString & path )
 void SelectionModel::setCurrentBranch( FileInfo * item )
 {
     _currentBranch = item;
+    _dirTreeModel->fetchItem( item );
     QModelIndex index = _dirTreeModel->modelIndex( item, 0 );
 
     emit currentBranchChanged( item  );
@@ -308,6 +341,9 @@ SelectionModelProxy::SelectionModelProxy( SelectionModel * master, QObject * par
     connect( master, SIGNAL( selectionChanged( FileInfoSet ) ),
 	     this,   SIGNAL( selectionChanged( FileInfoSet ) ) );
 
+    connect( master, SIGNAL( selectionDelta( FileInfoSet, FileInfoSet ) ),
+	     this,   SIGNAL( selectionDelta( FileInfoSet, FileInfoSet ) ) );
+
     connect( master, SIGNAL( currentItemChanged( FileInfo *, FileInfo * ) ),
 	     this,   SIGNAL( currentItemChanged( FileInfo *, FileInfo * ) ) );
 }
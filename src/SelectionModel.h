@@ -30,6 +30,13 @@ namespace QDirStat
      * QItemSelectionModel base class is the master with its QModelIndex based
      * selection; this subclass fetches that QModelIndex selection and
      * translates each item into a FileInfo pointer on demand.
+     *
+     * The QItemSelection consists of row ranges in a parent, so the
+     * translation goes over those ranges row by row rather than over all
+     * selected indexes (one per column). The set of selected items is then
+     * kept up to date with the added and removed ranges of each change,
+     * which are also available as FileInfoSets with the
+     * selectionDelta() signal.
      **/
     class SelectionModel: public QItemSelectionModel
     {
@@ -176,6 +183,14 @@ namespace QDirStat
 	void selectionChanged();
 	void selectionChanged( const FileInfoSet & selectedItems );
 
+	/**
+	 * Emitted when the selection changes with only the items that were
+	 * added to and removed from the selection. For a large selection,
+	 * this is a lot cheaper to handle than the complete set.
+	 **/
+	void selectionDelta( const FileInfoSet & added,
+			     const FileInfoSet & removed );
+
 	/**
 	 * Emitted when the current branch changes. Tree views can use this to
 	 * close all other branches.
@@ -212,6 +227,12 @@ namespace QDirStat
 
     protected:
 
+	/**
+	 * Return the items of column 0 of the row ranges in 'selection'.
+	 **/
+	FileInfoSet items( const QItemSelection & selection ) const;
+
+
 	// Data members
 
 	DirTreeModel	* _dirTreeModel;
@@ -281,6 +302,7 @@ namespace QDirStat
 
 	void selectionChanged();
 	void selectionChanged( const FileInfoSet & selectedItems );
+	void selectionDelta( const FileInfoSet & added, const FileInfoSet & removed );
 	void currentItemChanged( FileInfo * newCurrent, FileInfo * oldCurrent );
 
     };	// class SelectionModelProxy
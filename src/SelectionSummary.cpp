@@ -0,0 +1,151 @@
+/*
+ *   File name: SelectionSummary.cpp
+ *   Summary:	Incrementally maintained summary of selected items
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "SelectionSummary.h"
+#include "FileInfo.h"
+#include "DirInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+SelectionSummary::SelectionSummary()
+{
+    clear();
+}
+
+
+void SelectionSummary::clear()
+{
+    _selected.clear();
+    _counted.clear();
+
+    _fileCount	      = 0;
+    _dirCount	      = 0;
+    _subtreeFileCount = 0;
+    _totalSize	      = 0;
+    _allocatedSize    = 0;
+}
+
+
+void SelectionSummary::add( FileInfo * item )
+{
+    if ( ! item || ! item->checkMagicNumber() || _selected.contains( item ) )
+	return;
+
+    _selected << item;
+
+    if ( hasSelectedAncestor( item ) )
+	return;		// Already included in that ancestor
+
+    if ( item->isDirInfo() && ! _counted.isEmpty() )
+    {
+	// Items in this new subtree are now included in this directory
+
+	foreach ( FileInfo * counted, _counted )
+	{
+	    if ( ! counted->checkMagicNumber() )
+		_counted.remove( counted );
+	    else if ( counted->isInSubtree( item ) )
+		uncount( counted );
+	}
+    }
+
+    count( item );
+}
+
+
+void SelectionSummary::remove( FileInfo * item )
+{
+    if ( ! _selected.remove( item ) )
+	return;
+
+    if ( ! _counted.contains( item ) )
+	return;
+
+    if ( ! item->checkMagicNumber() )	// Deleted meanwhile: Can't trust anything
+    {
+	FileInfoSet selected = _selected;
+	clear();
+
+	foreach ( FileInfo * sel, selected )
+	    add( sel );
+
+	return;
+    }
+
+    uncount( item );
+
+    if ( item->isDirInfo() )
+    {
+	// Selected items in this subtree are no longer included in it
+
+	foreach ( FileInfo * sel, _selected )
+	{
+	    if ( sel->checkMagicNumber() &&
+		 sel->isInSubtree( item ) &&
+		 ! hasSelectedAncestor( sel ) )
+	    {
+		count( sel );
+	    }
+	}
+    }
+}
+
+
+bool SelectionSummary::hasSelectedAncestor( FileInfo * item ) const
+{
+    for ( FileInfo * parent = item->parent(); parent; parent = parent->parent() )
+    {
+	if ( _selected.contains( parent ) )
+	    return true;
+    }
+
+    return false;
+}
+
+
+void SelectionSummary::count( FileInfo * item )
+{
+    _counted << item;
+
+    if ( item->isDirInfo() )
+    {
+	++_dirCount;
+	_subtreeFileCount += item->totalFiles();
+    }
+    else
+    {
+	++_fileCount;
+    }
+
+    _totalSize	   += item->totalSize();
+    _allocatedSize += item->totalAllocatedSize();
+}
+
+
+void SelectionSummary::uncount( FileInfo * item )
+{
+    _counted.remove( item );
+
+    if ( item->isDirInfo() )
+    {
+	--_dirCount;
+	_subtreeFileCount -= item->totalFiles();
+    }
+    else
+    {
+	--_fileCount;
+    }
+
+    _totalSize	   -= item->totalSize();
+    _allocatedSize -= item->totalAllocatedSize();
+}
@@ -0,0 +1,109 @@
+/*
+ *   File name: SelectionSummary.h
+ *   Summary:	Incrementally maintained summary of selected items
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef SelectionSummary_h
+#define SelectionSummary_h
+
+
+#include "FileInfoSet.h"
+#include "FileSize.h"
+
+
+namespace QDirStat
+{
+    class FileInfo;
+
+    /**
+     * Sums (item count, sizes, file and directory counts) of a set of
+     * selected items like FileInfoSet::normalized() would give them: Items
+     * that have a selected ancestor are not counted since they are already
+     * included in that ancestor.
+     *
+     * Items are added and removed one by one, so a selection change only
+     * costs as much as the items that were added or removed. Only adding
+     * or removing a directory requires a look at the other selected items
+     * to find those in its subtree.
+     **/
+    class SelectionSummary
+    {
+    public:
+
+	/**
+	 * Constructor for an empty summary.
+	 **/
+	SelectionSummary();
+
+	/**
+	 * Remove all items.
+	 **/
+	void clear();
+
+	/**
+	 * Add a newly selected item.
+	 **/
+	void add( FileInfo * item );
+
+	/**
+	 * Remove an item that is no longer selected.
+	 **/
+	void remove( FileInfo * item );
+
+	/**
+	 * Return all selected items, including those that are not counted.
+	 **/
+	const FileInfoSet & selectedItems() const { return _selected; }
+
+	/**
+	 * Return the counted items, i.e. the normalized selection.
+	 **/
+	const FileInfoSet & countedItems() const { return _counted; }
+
+	/**
+	 * Return the sums of the counted items.
+	 **/
+	int	  itemCount()	     const { return _counted.size();	 }
+	int	  fileCount()	     const { return _fileCount;		 }
+	int	  dirCount()	     const { return _dirCount;		 }
+	FileCount subtreeFileCount() const { return _subtreeFileCount;	 }
+	FileSize  totalSize()	     const { return _totalSize;		 }
+	FileSize  allocatedSize()    const { return _allocatedSize;	 }
+
+
+    protected:
+
+	/**
+	 * Return 'true' if any ancestor of 'item' is selected.
+	 **/
+	bool hasSelectedAncestor( FileInfo * item ) const;
+
+	/**
+	 * Add 'item' to the counted items and its values to the sums.
+	 **/
+	void count( FileInfo * item );
+
+	/**
+	 * Remove 'item' from the counted items and its values from the sums.
+	 **/
+	void uncount( FileInfo * item );
+
+
+	FileInfoSet _selected;
+	FileInfoSet _counted;
+	int	    _fileCount;
+	int	    _dirCount;
+	FileCount   _subtreeFileCount;
+	FileSize    _totalSize;
+	FileSize    _allocatedSize;
+
+    };	// class SelectionSummary
+
+}	// namespace QDirStat
+
+
+#endif // ifndef SelectionSummary_h
@@ -0,0 +1,95 @@
+/*
+ *   File name: SessionCache.cpp
+ *   Summary:	Automatic per-user cache of the trees of previous sessions
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>	// lstat(), chmod()
+#include <unistd.h>	// getuid()
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+
+#include "SessionCache.h"
+#include "BinaryCache.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+QString SessionCache::cacheDir()
+{
+    QString cacheDir = QStandardPaths::writableLocation( QStandardPaths::GenericCacheLocation );
+
+    return cacheDir + "/qdirstat/sessions";
+}
+
+
+QString SessionCache::fileName( const QString & dir, const QString & device )
+{
+    QString path = cacheDir();
+
+    if ( ! QFileInfo( path ).isDir() )
+    {
+	// The file names of the trees are nobody else's business
+
+	QDir().mkpath( path );
+	chmod( path.toUtf8(), 0700 );
+    }
+
+    QByteArray key  = device.toUtf8() + '\0' + QDir::cleanPath( dir ).toUtf8();
+    QByteArray hash = QCryptographicHash::hash( key, QCryptographicHash::Sha1 ).toHex().left( 24 );
+
+    return path + "/" + QString::fromLatin1( hash ) + BINARY_CACHE_SUFFIX;
+}
+
+
+QString SessionCache::find( const QString & dir, const QString & device )
+{
+    QString path = fileName( dir, device );
+
+    // Only trust files that nobody else could have written
+
+    struct stat statInfo;
+
+    if ( lstat( path.toUtf8(), &statInfo ) < 0 )
+	return QString();
+
+    if ( ! S_ISREG( statInfo.st_mode )	 ||
+	 statInfo.st_uid != getuid()	 ||
+	 ! BinaryCacheReader::isBinaryCache( path ) )
+    {
+	logWarning() << "Ignoring session cache " << path << endl;
+	return QString();
+    }
+
+    return path;
+}
+
+
+void SessionCache::prune( int maxFiles )
+{
+    QDir dir( cacheDir() );
+
+    if ( ! dir.exists() )
+	return;
+
+    QStringList nameFilters;
+    nameFilters << QString( "*" ) + BINARY_CACHE_SUFFIX;
+
+    QFileInfoList files = dir.entryInfoList( nameFilters, QDir::Files, QDir::Time ); // newest first
+
+    for ( int i = qMax( 0, maxFiles ); i < files.size(); ++i )
+    {
+	logInfo() << "Removing old session cache " << files.at( i ).filePath() << endl;
+	QFile::remove( files.at( i ).filePath() );
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ *   File name: SessionCache.h
+ *   Summary:	Automatic per-user cache of the trees of previous sessions
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef SessionCache_h
+#define SessionCache_h
+
+
+#include <QString>
+
+
+namespace QDirStat
+{
+    /**
+     * Binary cache files (see BinaryCache.h) of the directories that were
+     * read in previous sessions, so opening the same directory again shows
+     * its tree right away instead of reading it from scratch.
+     *
+     * The files are in the user's cache directory
+     * (~/.cache/qdirstat/sessions), one for each directory and device,
+     * so a different filesystem mounted at the same path does not get the
+     * tree of the old one. DirTree writes them in a background thread
+     * after reading is finished, and it checks a tree from there for
+     * changes with a SmartRefreshJob (see CacheReadJob::setRefreshAll()).
+     *
+     * Only the most recently written ones are kept.
+     **/
+    class SessionCache
+    {
+    public:
+
+	/**
+	 * Return the name of the session cache file for directory 'dir'
+	 * on device 'device'. This creates the directory for it if
+	 * necessary.
+	 **/
+	static QString fileName( const QString & dir, const QString & device );
+
+	/**
+	 * Return the name of an existing session cache file for directory
+	 * 'dir' on device 'device' or an empty string if there is none.
+	 **/
+	static QString find( const QString & dir, const QString & device );
+
+	/**
+	 * Remove the oldest session cache files so that at most 'maxFiles'
+	 * are left.
+	 **/
+	static void prune( int maxFiles );
+
+    protected:
+
+	/**
+	 * Return the directory for the session cache files.
+	 **/
+	static QString cacheDir();
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef SessionCache_h
@@ -83,6 +83,13 @@ void Settings::setDefaultValue( const QString & key, int newValue )
 }
 
 
+void Settings::setDefaultValue( const QString & key, double newValue )
+{
+    if ( ! contains( key ) )
+        setValue( key, newValue );
+}
+
+
 void Settings::setDefaultValue( const QString & key, const QString & newValue )
 {
     if ( ! contains( key ) )
@@ -75,6 +75,7 @@ namespace QDirStat
 	 **/
 	void setDefaultValue( const QString & key, bool		   newValue );
 	void setDefaultValue( const QString & key, int		   newValue );
+	void setDefaultValue( const QString & key, double	   newValue );
 	void setDefaultValue( const QString & key, const QString & newValue );
 
 	/**
@@ -104,15 +105,15 @@ namespace QDirStat
 	 **/
 	static void fixFileOwners();
 
-
-    protected:
-
 	/**
-	 * Change the owner of the config file to the user in the $SUDO_UID /
-	 * $SUDO_GID environment variables (if set).
+	 * Change the owner of a file in the user's home directory to the user
+	 * in the $SUDO_UID / $SUDO_GID environment variables (if set).
 	 **/
 	static void fixFileOwner( const QString & filename );
 
+
+    protected:
+
 	/**
 	 * Move all settings groups starting with 'groupPrefix' from settings
 	 * object 'from' to settings object 'to'.
@@ -10,7 +10,9 @@
 #include <QSettings>
 #include <QColor>
 #include <QRegExp>
-#include <QWidget>
+#ifndef QDIRSTAT_HEADLESS
+#  include <QWidget>
+#endif
 
 #include "SettingsHelpers.h"
 #include "Settings.h"
@@ -177,6 +179,8 @@ namespace QDirStat
     }
 
 
+#ifndef QDIRSTAT_HEADLESS
+
     void readWindowSettings( QWidget * widget, const QString & settingsGroup )
     {
         QDirStat::Settings settings;
@@ -204,5 +208,7 @@ namespace QDirStat
         settings.endGroup();
     }
 
+#endif	// QDIRSTAT_HEADLESS
+
 } // namespace QDirStat
 
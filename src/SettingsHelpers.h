@@ -88,6 +88,8 @@ namespace QDirStat
      **/
     QMap<int, QString> patternSyntaxMapping();
 
+#ifndef QDIRSTAT_HEADLESS
+
     /**
      * Read window settings (size and position) from the settings and apply
      * them.
@@ -101,6 +103,8 @@ namespace QDirStat
     void writeWindowSettings( QWidget *       widget,
                               const QString & settingsGroup );
 
+#endif	// QDIRSTAT_HEADLESS
+
 }	// namespace QDirStat
 
 #endif	// SettingsHelpers_h
@@ -0,0 +1,140 @@
+/*
+ *   File name: SharedStats.cpp
+ *   Summary:	Statistics classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "SharedStats.h"
+#include "StatsEngine.h"
+#include "FileTypeStats.h"
+#include "FileAgeStats.h"
+#include "QDirStatApp.h"
+#include "DirTree.h"
+#include "Logger.h"
+#include "Exception.h"
+#include "Trace.h"
+
+
+using namespace QDirStat;
+
+
+QPointer<SharedStats> SharedStats::_instance = 0;
+
+
+SharedStats * SharedStats::instance()
+{
+    if ( ! _instance )
+    {
+	_instance = new SharedStats( app()->dirTree() );
+	CHECK_NEW( _instance );
+    }
+
+    return _instance;
+}
+
+
+SharedStats::SharedStats( DirTree * tree ):
+    QObject( tree ),
+    _subtree( 0 ),
+    _collecting( 0 )
+{
+    CHECK_PTR( tree );
+
+    _fileTypeStats = new FileTypeStats( this );
+    CHECK_NEW( _fileTypeStats );
+
+    _fileAgeStats = new FileAgeStats();
+    CHECK_NEW( _fileAgeStats );
+
+    _engine = new StatsEngine( this );
+    CHECK_NEW( _engine );
+
+    _engine->addCollector( _fileTypeStats );
+    _engine->addCollector( _fileAgeStats  );
+
+    connect( _engine, SIGNAL( finished()	),
+	     this,    SLOT  ( collectFinished() ) );
+
+    connect( tree, SIGNAL( startingReading() ),
+	     this, SLOT	 ( invalidate()	     ) );
+
+    connect( tree, SIGNAL( finished()	),
+	     this, SLOT	 ( invalidate() ) );
+
+    connect( tree, SIGNAL( aborted()	),
+	     this, SLOT	 ( invalidate() ) );
+
+    connect( tree, SIGNAL( clearing()	),
+	     this, SLOT	 ( invalidate() ) );
+
+    connect( tree, SIGNAL( clearingSubtree( DirInfo * ) ),
+	     this, SLOT	 ( invalidate()		       ) );
+
+    connect( tree, SIGNAL( deletingChild( FileInfo * ) ),
+	     this, SLOT	 ( invalidate()		      ) );
+
+    connect( tree, SIGNAL( childDeleted() ),
+	     this, SLOT	 ( invalidate()	  ) );
+}
+
+
+SharedStats::~SharedStats()
+{
+    // The threads might still be collecting into the stats
+
+    delete _engine;
+    delete _fileAgeStats;
+}
+
+
+void SharedStats::invalidate()
+{
+    _subtree	= 0;
+    _collecting = 0;
+}
+
+
+void SharedStats::start( FileInfo * subtree )
+{
+    TRACE_SPAN( "SharedStats::start" );
+
+    if ( subtree && subtree == _subtree )
+    {
+	emit finished();
+	return;
+    }
+
+    // Don't clear the stats under the threads of a previous request
+
+    _engine->waitForDone();
+    _fileTypeStats->clear();
+    _fileAgeStats->clear();
+    _subtree = 0;
+
+    if ( ! subtree || ! subtree->checkMagicNumber() )
+    {
+	_collecting = 0;
+	emit finished();
+	return;
+    }
+
+    _collecting = subtree;
+    _engine->start( subtree );
+}
+
+
+void SharedStats::collectFinished()
+{
+    // This might be from a previous request or from one that was
+    // invalidated meanwhile; wait for the current one
+
+    if ( _engine->isBusy() || ! _collecting )
+	return;
+
+    _subtree	= _collecting;
+    _collecting = 0;
+    emit finished();
+}
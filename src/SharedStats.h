@@ -0,0 +1,130 @@
+/*
+ *   File name: SharedStats.h
+ *   Summary:	Statistics classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef SharedStats_h
+#define SharedStats_h
+
+
+#include <QObject>
+#include <QPointer>
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class FileInfo;
+    class FileTypeStats;
+    class FileAgeStats;
+    class StatsEngine;
+
+
+    /**
+     * File type and file age statistics for one subtree that are shared by
+     * all statistics windows: Whenever any of them is requested for a new
+     * subtree, all of them are collected in one single traversal of the tree
+     * with a StatsEngine, so opening the next statistics window for the same
+     * subtree is instant. This is done in other threads while the GUI keeps
+     * going; finished() is emitted when the results are there.
+     *
+     * The results are discarded as soon as the tree changes.
+     *
+     * This is a singleton class. Use instance() to get the instance. It is
+     * deleted together with the DirTree of the application.
+     **/
+    class SharedStats: public QObject
+    {
+	Q_OBJECT
+
+    protected:
+
+	/**
+	 * Constructor. This is a singleton class; use instance() instead.
+	 **/
+	SharedStats( DirTree * tree );
+
+    public:
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~SharedStats();
+
+	/**
+	 * Get the singleton for this class. The first call to this will create
+	 * it.
+	 **/
+	static SharedStats * instance();
+
+	/**
+	 * Start collecting all statistics for 'subtree' unless that was
+	 * already done. finished() is emitted when they are there; that
+	 * might also be right away.
+	 **/
+	void start( FileInfo * subtree );
+
+	/**
+	 * Return the subtree of the current statistics or 0 if there are
+	 * none (yet).
+	 **/
+	FileInfo * subtree() const { return _subtree; }
+
+	/**
+	 * Return the file type statistics for subtree(). Ownership stays
+	 * with this class.
+	 **/
+	FileTypeStats * fileTypeStats() const { return _fileTypeStats; }
+
+	/**
+	 * Return the file age statistics for subtree(). Ownership stays with
+	 * this class.
+	 **/
+	FileAgeStats * fileAgeStats() const { return _fileAgeStats; }
+
+    signals:
+
+	/**
+	 * Emitted when the statistics requested with start() are there.
+	 **/
+	void finished();
+
+    public slots:
+
+	/**
+	 * Discard the collected statistics, so the next request will collect
+	 * them again.
+	 **/
+	void invalidate();
+
+    protected slots:
+
+	/**
+	 * Notification that the engine is done.
+	 **/
+	void collectFinished();
+
+    protected:
+
+	//
+	// Data members
+	//
+
+	static QPointer<SharedStats>	_instance;
+
+	StatsEngine *			_engine;
+	FileTypeStats *			_fileTypeStats;
+	FileAgeStats *			_fileAgeStats;
+	FileInfo *			_subtree;
+	FileInfo *			_collecting;
+
+    };	// class SharedStats
+
+}	// namespace QDirStat
+
+
+#endif // ifndef SharedStats_h
@@ -0,0 +1,156 @@
+/*
+ *   File name: SharedTree.cpp
+ *   Summary:	Handing directory trees to other sessions in shared memory
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>	// O_CREAT etc.
+#include <stdio.h>	// rename()
+#include <sys/mman.h>	// shm_open(), shm_unlink()
+#include <sys/stat.h>	// lstat()
+#include <unistd.h>	// getuid(), getpid(), close()
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include "SharedTree.h"
+#include "BinaryCache.h"
+#include "DirTree.h"
+#include "FileInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Where POSIX shared memory segments are visible as files (Linux)
+
+#define SHARED_TREE_SHM_DIR	"/dev/shm"
+
+using namespace QDirStat;
+
+
+QString SharedTree::segmentName( const QString & dir )
+{
+    QByteArray hash = QCryptographicHash::hash( QDir::cleanPath( dir ).toUtf8(),
+						QCryptographicHash::Md5 ).toHex().left( 16 );
+
+    return QString( "/qdirstat-%1-%2" BINARY_CACHE_SUFFIX )
+	.arg( getuid() ).arg( QString::fromLatin1( hash ) );
+}
+
+
+QString SharedTree::segmentPath( const QString & name )
+{
+    if ( ! QFileInfo( SHARED_TREE_SHM_DIR ).isDir() )
+	return QString();
+
+    return SHARED_TREE_SHM_DIR + name;
+}
+
+
+bool SharedTree::publish( DirTree * tree )
+{
+    CHECK_PTR( tree );
+
+    FileInfo * toplevel = tree->firstToplevel();
+
+    if ( ! toplevel )
+	return false;
+
+    // Other sessions would take this for the complete tree
+
+    if ( tree->hasPartialTotals() || tree->hasFileSummaries() )
+    {
+	logInfo() << "Not publishing the partial tree of " << toplevel << endl;
+	return false;
+    }
+
+    QString dir	    = toplevel->url();
+    QString name    = segmentName( dir );
+    QString tmpName = name + QString( ".%1.new" ).arg( getpid() );
+    QString path    = segmentPath( name );
+    QString tmpPath = segmentPath( tmpName );
+
+    if ( path.isEmpty() )
+    {
+	logWarning() << "No shared memory segments in " << SHARED_TREE_SHM_DIR << endl;
+	return false;
+    }
+
+    // Create the segment with shm_open() so it only gets the user's
+    // permissions; the cache writer then fills it like any other file.
+
+    shm_unlink( tmpName.toUtf8() );
+    int fd = shm_open( tmpName.toUtf8(), O_CREAT | O_EXCL | O_RDWR, 0600 );
+
+    if ( fd < 0 )
+    {
+	logError() << "Can't create shared memory segment " << tmpName
+		   << ": " << formatErrno() << endl;
+	return false;
+    }
+
+    close( fd );
+
+    QElapsedTimer timer;
+    timer.start();
+
+    BinaryCacheWriter writer( tmpPath, tree );
+
+    // Replace any older segment in one go: Sessions that are reading
+    // that one keep their mapping of it.
+
+    if ( ! writer.ok() || rename( tmpPath.toUtf8(), path.toUtf8() ) != 0 )
+    {
+	logError() << "Can't publish " << dir << " in " << path << endl;
+	shm_unlink( tmpName.toUtf8() );
+
+	return false;
+    }
+
+    logInfo() << "Published " << dir << " in " << path
+	      << " in " << timer.elapsed() << " millisec" << endl;
+
+    return true;
+}
+
+
+void SharedTree::withdraw( const QString & dir )
+{
+    QString name = segmentName( dir );
+
+    if ( shm_unlink( name.toUtf8() ) == 0 )
+	logInfo() << "Withdrew shared tree " << name << endl;
+}
+
+
+QString SharedTree::find( const QString & dir )
+{
+    QString path = segmentPath( segmentName( dir ) );
+
+    if ( path.isEmpty() )
+	return QString();
+
+    // Only trust segments that nobody else could have written
+
+    struct stat statInfo;
+
+    if ( lstat( path.toUtf8(), &statInfo ) < 0 )
+	return QString();
+
+    if ( ! S_ISREG( statInfo.st_mode )	 ||
+	 statInfo.st_uid != getuid()	 ||
+	 ( statInfo.st_mode & 077 ) != 0 ||
+	 ! BinaryCacheReader::isBinaryCache( path ) )
+    {
+	logWarning() << "Ignoring shared tree " << path << endl;
+	return QString();
+    }
+
+    return path;
+}
@@ -0,0 +1,82 @@
+/*
+ *   File name: SharedTree.h
+ *   Summary:	Handing directory trees to other sessions in shared memory
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef SharedTree_h
+#define SharedTree_h
+
+
+#include <QString>
+
+
+namespace QDirStat
+{
+    class DirTree;
+
+
+    /**
+     * Publishing a directory tree in a POSIX shared memory segment, so
+     * another QDirStat session of the same user that opens the same
+     * directory can take the tree from there instead of reading the
+     * directory again.
+     *
+     * The segment has the binary cache format (see BinaryCache.h): Fixed
+     * width records in preorder and a string table. The other session maps
+     * it read-only and reads the records directly from that mapping like
+     * from any binary cache file, so nothing is copied and nothing is
+     * parsed; it only needs to create its own tree items from them.
+     *
+     * The segment is only accessible for the user, and it is removed when
+     * the publishing tree is cleared or destroyed. Sessions that still
+     * have it mapped can keep using it until they are done.
+     **/
+    class SharedTree
+    {
+    public:
+
+	/**
+	 * Publish the tree of 'tree' for its directory. An older segment
+	 * for the same directory is replaced; sessions that are reading
+	 * the old one are not disturbed.
+	 *
+	 * Return 'true' if success, 'false' if not.
+	 **/
+	static bool publish( DirTree * tree );
+
+	/**
+	 * Remove the segment for directory 'dir'.
+	 **/
+	static void withdraw( const QString & dir );
+
+	/**
+	 * Return the file name of a published segment for directory 'dir'
+	 * that can be read with the cache reader, or an empty string if
+	 * there is none.
+	 **/
+	static QString find( const QString & dir );
+
+	/**
+	 * Return the name of the shared memory segment for directory 'dir'
+	 * (as for shm_open()).
+	 **/
+	static QString segmentName( const QString & dir );
+
+    protected:
+
+	/**
+	 * Return the file name for shared memory segment 'name' or an empty
+	 * string if shared memory segments are not visible as files on this
+	 * system.
+	 **/
+	static QString segmentPath( const QString & name );
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef SharedTree_h
@@ -25,6 +25,10 @@
 #define MARGIN_TOP      2
 #define MARGIN_BOTTOM   2
 
+// Max. number of entries in the text cache before it is cleared
+
+#define MAX_TEXT_CACHE_SIZE	2000
+
 using namespace QDirStat;
 
 
@@ -65,9 +69,9 @@ void SizeColDelegate::paint( QPainter		        * painter,
                 // logDebug() << "Small file " << item << endl;
 
                 QString text = _model->data( index, Qt::DisplayRole ).toString();
-                QStringList fields = text.split( " (" );  //  "137 B (4k)"
+                const SizeColText & parts = sizeColText( text, option.font );
 
-                if ( fields.size() == 2 )
+                if ( ! parts.sizeText.isEmpty() )
                 {
                     QRect rect           = option.rect;
                     const QPalette & pal = option.palette;
@@ -84,20 +88,15 @@ void SizeColDelegate::paint( QPainter		        * painter,
                         painter->fillRect( rect, pal.highlight() );
                     }
 
-                    QString sizeText  = fields.takeFirst();             // "137 B"
-                    QString allocText = " (" + fields.takeFirst();      // " (4k)"
-
                     // Draw the size ("137 B").
                     //
                     // Since we align right, we need to move the rectangle to the left
                     // to reserve some space for the allocated size.
 
-                    QFontMetrics fontMetrics( option.font );
-                    int allocWidth = fontMetrics.width( allocText );
-                    rect.setWidth( rect.width() - allocWidth );
+                    rect.setWidth( rect.width() - parts.allocWidth );
 
                     painter->setPen( textColor );
-                    painter->drawText( rect, alignment, sizeText );
+                    painter->drawText( rect, alignment, parts.sizeText );
 
 
                     // Draw the allocated size (" (4k)").
@@ -110,7 +109,7 @@ void SizeColDelegate::paint( QPainter		        * painter,
                     rect.setWidth( rect.width() );
 
                     painter->setPen( allocColor );
-                    painter->drawText( rect, alignment, allocText );
+                    painter->drawText( rect, alignment, parts.allocText );
 
                     return;
                 }
@@ -141,7 +140,7 @@ QSize SizeColDelegate::sizeHint( const QStyleOptionViewItem & option,
             {
                 QString text = _model->data( index, Qt::DisplayRole ).toString();
                 QFontMetrics fontMetrics( option.font );
-                int width  = fontMetrics.width( text );
+                int width  = sizeColText( text, option.font ).width;
                 int height = fontMetrics.height();
                 QSize size( width  + MARGIN_RIGHT + MARGIN_LEFT,
                             height + MARGIN_TOP   + MARGIN_BOTTOM );
@@ -165,6 +164,38 @@ QSize SizeColDelegate::sizeHint( const QStyleOptionViewItem & option,
 }
 
 
+const SizeColText & SizeColDelegate::sizeColText( const QString & text,
+						   const QFont   & font ) const
+{
+    if ( font != _textCacheFont || _textCache.size() >= MAX_TEXT_CACHE_SIZE )
+    {
+	_textCache.clear();
+	_textCacheFont = font;
+    }
+
+    QHash<QString, SizeColText>::iterator it = _textCache.find( text );
+
+    if ( it == _textCache.end() )
+    {
+	SizeColText parts;
+	QFontMetrics fontMetrics( font );
+	QStringList fields = text.split( " (" );  //  "137 B (4k)"
+
+	if ( fields.size() == 2 )
+	{
+	    parts.sizeText   = fields.takeFirst();		// "137 B"
+	    parts.allocText  = " (" + fields.takeFirst();	// " (4k)"
+	    parts.allocWidth = fontMetrics.width( parts.allocText );
+	}
+
+	parts.width = fontMetrics.width( text );
+	it = _textCache.insert( text, parts );
+    }
+
+    return it.value();
+}
+
+
 void SizeColDelegate::ensureModel( const QModelIndex & index ) const
 {
     if ( ! _model )
@@ -11,6 +11,10 @@
 
 
 #include <QStyledItemDelegate>
+#include <QHash>
+#include <QString>
+#include <QFont>
+
 class QTreeView;
 
 
@@ -18,6 +22,21 @@ namespace QDirStat
 {
     class DirTreeModel;
 
+
+    /**
+     * The parts of a size text like "137 B (4k)" and their widths, as
+     * they are needed for painting.
+     **/
+    struct SizeColText
+    {
+	SizeColText(): allocWidth( 0 ), width( 0 ) {}
+
+	QString sizeText;	// "137 B"
+	QString allocText;	// " (4k)"
+	int	allocWidth;	// Width of allocText in pixels
+	int	width;		// Width of the complete text in pixels
+    };
+
     /**
      * Item delegate for the size column in the DirTreeView.
      *
@@ -61,6 +80,18 @@ namespace QDirStat
          **/
         void ensureModel( const QModelIndex & index ) const;
 
+	/**
+	 * Return the parts of the size text 'text' with font 'font' from
+	 * the text cache. If 'text' does not consist of a size and an
+	 * allocated size, sizeText in the result is empty.
+	 *
+	 * Small files only have a limited number of different sizes, so
+	 * this is much cheaper than splitting the text and measuring it
+	 * again for each repaint.
+	 **/
+	const SizeColText & sizeColText( const QString & text,
+					 const QFont   & font ) const;
+
 
         //
         // Data members
@@ -70,6 +101,9 @@ namespace QDirStat
         mutable DirTreeModel *  _model;
         bool                    _usingDarkTheme;
 
+	mutable QHash<QString, SizeColText> _textCache;
+	mutable QFont			    _textCacheFont;
+
     };  // class SizeColDelegate
 
 }       // namespace QDirStat
@@ -0,0 +1,150 @@
+/*
+ *   File name: SnapPkgManager.cpp
+ *   Summary:	Snap package manager support for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QDir>
+#include <QFileInfo>
+
+#include "SnapPkgManager.h"
+#include "PkgFileListCache.h"
+#include "Logger.h"
+#include "Exception.h"
+
+#define SNAPD_SNAPS_DIR		"/var/lib/snapd/snaps"
+#define SNAP_MOUNT_DIR		"/snap/"
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * Return the .snap files of all installed snap revisions, i.e. all
+     * files "${name}_${revision}.snap" in the snaps directory. Partial
+     * downloads are in a subdirectory, so they are not included.
+     **/
+    QFileInfoList snapFiles()
+    {
+	QDir snapsDir( SNAPD_SNAPS_DIR );
+
+	return snapsDir.entryInfoList( QStringList() << "*_*.snap", QDir::Files );
+    }
+}
+
+
+bool SnapPkgManager::isAvailable()
+{
+    return QFileInfo( SNAPD_SNAPS_DIR ).isDir();
+}
+
+
+QString SnapPkgManager::owningPkg( const QString & path )
+{
+    if ( path.startsWith( SNAP_MOUNT_DIR ) )
+    {
+	// /snap/${name}/${revision}/...; /snap/bin only has symlinks to
+	// /usr/bin/snap.
+
+	QString name = path.section( '/', 2, 2 );
+
+	return name == "bin" ? QString() : name;
+    }
+
+    QFileInfo fileInfo( path );
+
+    if ( fileInfo.path() == SNAPD_SNAPS_DIR && fileInfo.suffix() == "snap" )
+	return fileInfo.completeBaseName().section( '_', 0, -2 );
+
+    return QString();
+}
+
+
+void SnapPkgManager::owningPkgCommand( const QStringList & paths,
+				       QString		 & command_ret,
+				       QStringList	 & args_ret )
+{
+    Q_UNUSED( paths );
+
+    command_ret.clear();
+    args_ret.clear();
+}
+
+
+void SnapPkgManager::parseOwningPkgOutput( const QStringList	   & paths,
+					   const QString	   & output,
+					   int			     exitCode,
+					   QMap<QString, QString> & pkgs_ret )
+{
+    Q_UNUSED( paths );
+    Q_UNUSED( output );
+    Q_UNUSED( exitCode );
+    Q_UNUSED( pkgs_ret );
+}
+
+
+PkgInfoList SnapPkgManager::installedPkg()
+{
+    PkgInfoList pkgList;
+
+    foreach ( const QFileInfo & snapFile, snapFiles() )
+    {
+	// Snap names may not contain an underscore, but be safe
+
+	QString queryName = snapFile.completeBaseName();
+	QString name	  = queryName.section( '_', 0, -2 );
+	QString revision  = queryName.section( '_', -1 );
+
+	PkgInfo * pkg = new PkgInfo( name, revision, "", this );
+	CHECK_NEW( pkg );
+
+	pkg->setInstalledSize( snapFile.size() );
+	pkgList << pkg;
+    }
+
+    logDebug() << "Found " << pkgList.size() << " snap revisions" << endl;
+
+    return pkgList;
+}
+
+
+QStringList SnapPkgManager::fileList( PkgInfo * pkg )
+{
+    QString snapFile = QString( SNAPD_SNAPS_DIR "/%1.snap" ).arg( queryName( pkg ) );
+
+    if ( ! QFileInfo( snapFile ).isFile() )
+	return QStringList();
+
+    return QStringList() << snapFile;
+}
+
+
+PkgFileListCache * SnapPkgManager::createFileListCache( PkgFileListCache::LookupType lookupType )
+{
+    PkgFileListCache * cache = new PkgFileListCache( this, lookupType );
+    CHECK_NEW( cache );
+
+    foreach ( const QFileInfo & snapFile, snapFiles() )
+	cache->add( snapFile.completeBaseName(), snapFile.absoluteFilePath() );
+
+    return cache;
+}
+
+
+QString SnapPkgManager::queryName( PkgInfo * pkg )
+{
+    CHECK_PTR( pkg );
+
+    return pkg->baseName() + "_" + pkg->version();
+}
+
+
+QStringList SnapPkgManager::databasePaths() const
+{
+    return QStringList() << SNAPD_SNAPS_DIR;
+}
@@ -0,0 +1,194 @@
+/*
+ *   File name: SnapPkgManager.h
+ *   Summary:	Snap package manager support for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef SnapPkgManager_h
+#define SnapPkgManager_h
+
+#include <QString>
+#include <QStringList>
+
+#include "PkgManager.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Support for snaps. This never starts the 'snap' command; it reads the
+     * snap files that snapd keeps for each installed revision directly:
+     *
+     *	 /var/lib/snapd/snaps/${name}_${revision}.snap
+     *
+     * Each of them is one package with its revision as the version. Its only
+     * file is the .snap file itself: That is where all the disk space goes;
+     * its content is mounted read-only below /snap/${name}/${revision}.
+     *
+     * This is never a primary package manager; it is used in addition to
+     * the system's package manager.
+     **/
+    class SnapPkgManager: public PkgManager
+    {
+    public:
+
+	SnapPkgManager() {}
+	virtual ~SnapPkgManager() {}
+
+	/**
+	 * Return the name of this package manager.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual QString name() const { return "snap"; }
+
+	/**
+	 * Return 'false': snapd never manages the system itself.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual bool isPrimaryPkgManager() Q_DECL_OVERRIDE { return false; }
+
+	/**
+	 * Check if there is a snapd snaps directory.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual bool isAvailable() Q_DECL_OVERRIDE;
+
+	/**
+	 * Return the owning package of 'path' if it is a .snap file or below
+	 * the mount point of a snap. This does not need any external command.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QString owningPkg( const QString & path ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return an empty command: The owning packages are found with
+	 * owningPkg() without any external command.
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual void owningPkgCommand( const QStringList & paths,
+				       QString		 & command_ret,
+				       QStringList	 & args_ret ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Do nothing since there is no owningPkgCommand().
+	 *
+	 * Implemented from PkgManager.
+	 **/
+	virtual void parseOwningPkgOutput( const QStringList	      & paths,
+					   const QString	      & output,
+					   int				exitCode,
+					   QMap<QString, QString>     & pkgs_ret ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return the maximum number of paths for one owningPkgCommand():
+	 * Any number since they are all found in-process.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual int maxOwningPkgBatch() const Q_DECL_OVERRIDE { return 1000; }
+
+
+	//-----------------------------------------------------------------
+	//		       Optional Features
+	//-----------------------------------------------------------------
+
+	/**
+	 * Return 'true' if this package manager supports getting the list of
+	 * installed packages.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsGetInstalledPkg() Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Return the installed revisions of all snaps.
+	 *
+	 * Ownership of the list elements is transferred to the caller.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual PkgInfoList installedPkg() Q_DECL_OVERRIDE;
+
+	/**
+	 * Return 'true': The installed size is the size of the .snap file.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsInstalledSize() Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Return 'true' if this package manager supports getting the file list
+	 * for a package.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsFileList() Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Return the .snap file of 'pkg'.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QStringList fileList( PkgInfo * pkg ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return 'true' since fileList() does not need any external command.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsNativeFileList() Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Return 'true' if this package manager supports building a file list
+	 * cache for getting all file lists for all packages.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual bool supportsFileListCache() Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Create a file list cache with the specified lookup type for all
+	 * installed snaps.
+	 *
+	 * Ownership of the cache is transferred to the caller.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual PkgFileListCache * createFileListCache( PkgFileListCache::LookupType lookupType = PkgFileListCache::LookupByPkg ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return a name that is unique for 'pkg' even if several revisions
+	 * of the same snap are installed: ${name}_${revision}, just like the
+	 * name of its .snap file.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QString queryName( PkgInfo * pkg ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Return the snaps directory: snapd adds or removes a file there
+	 * whenever a snap is installed, refreshed or removed.
+	 *
+	 * Reimplemented from PkgManager.
+	 **/
+	virtual QStringList databasePaths() const Q_DECL_OVERRIDE;
+
+    }; // class SnapPkgManager
+
+} // namespace QDirStat
+
+
+#endif // SnapPkgManager_h
@@ -0,0 +1,193 @@
+/*
+ *   File name: SpillStore.cpp
+ *   Summary:	On-disk store for file nodes of out-of-core trees
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QDir>
+
+#include "SpillStore.h"
+#include "DirTree.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+SpillStore::SpillStore( DirTree * tree ):
+    _tree( tree ),
+    _file( QDir::tempPath() + "/qdirstat-spill-XXXXXX" ),
+    _size( 0 ),
+    _data( 0 ),
+    _mappedSize( 0 )
+{
+    CHECK_PTR( _tree );
+}
+
+
+SpillStore::~SpillStore()
+{
+    unmap();
+}
+
+
+bool SpillStore::open()
+{
+    if ( _file.isOpen() )
+	return true;
+
+    if ( ! _file.open() )
+    {
+	logError() << "Can't open temporary file: " << _file.errorString() << endl;
+	return false;
+    }
+
+    logInfo() << "Spilling files to " << _file.fileName() << endl;
+
+    return true;
+}
+
+
+bool SpillStore::store( const DirInfo * dir, const FileInfoList & files )
+{
+    if ( files.isEmpty() || ! open() )
+	return false;
+
+    Block block;
+    block.offset = _size;
+    block.count	 = files.size();
+
+    QByteArray names;
+    QByteArray records( files.size() * sizeof( BinaryCacheRecord ), 0 );
+    BinaryCacheRecord * rec = (BinaryCacheRecord *) records.data();
+
+    foreach ( FileInfo * file, files )
+    {
+	QByteArray name = file->name().toUtf8();
+
+	rec->size	= file->rawByteSize();
+	rec->blocks	= file->isSparseFile() ? file->blocks() : -1;
+	rec->mtime	= file->mtime();
+	rec->nameOffset = names.size();	// relative to the names of this block
+	rec->nameLength = name.size();
+	rec->mode	= file->mode();
+	rec->uid	= file->uid();
+	rec->gid	= file->gid();
+	rec->links	= file->links();
+
+	names += name;
+	block.summary.add( file );
+	++rec;
+    }
+
+    _file.seek( _size );
+
+    if ( _file.write( records ) != records.size() ||
+	 _file.write( names   ) != names.size()	   )
+    {
+	logError() << "Can't write to " << _file.fileName() << ": "
+		   << _file.errorString() << endl;
+
+	_file.resize( _size );
+	return false;
+    }
+
+    _size += records.size() + names.size();
+    _blocks.insert( dir, block );
+
+    return true;
+}
+
+
+bool SpillStore::load( DirInfo * dir, FileInfoList & files_ret )
+{
+    Block block = _blocks.value( dir );
+
+    if ( block.count == 0 )
+	return false;
+
+    qint64 namesOffset = block.offset + block.count * sizeof( BinaryCacheRecord );
+
+    if ( ! mapUpTo( _size ) )
+	return false;
+
+    const BinaryCacheRecord * rec   = (const BinaryCacheRecord *) ( _data + block.offset );
+    const char *	      names = (const char *) _data + namesOffset;
+
+    for ( int i=0; i < block.count; ++i, ++rec )
+    {
+	if ( namesOffset + (qint64) ( rec->nameOffset + rec->nameLength ) > _size )
+	{
+	    logError() << "Corrupt spill store block for " << dir << endl;
+	    return false;
+	}
+
+	QString name = QString::fromUtf8( names + rec->nameOffset, rec->nameLength );
+
+	FileInfo * file = new FileInfo( _tree, dir, name,
+					rec->mode, rec->size,
+					true, rec->uid, rec->gid,
+					rec->mtime,
+					rec->blocks, rec->links );
+	CHECK_NEW( file );
+	files_ret << file;
+    }
+
+    return true;
+}
+
+
+bool SpillStore::mapUpTo( qint64 end )
+{
+    if ( end <= _mappedSize )
+	return true;
+
+    unmap();
+
+    // Written data may still be in the file's buffer. A file can't be
+    // mapped beyond its end, so map everything that is written so far.
+
+    _file.flush();
+
+    qint64 mapSize = _size;
+    _data = mapSize > 0 ? _file.map( 0, mapSize ) : 0;
+
+    if ( ! _data )
+    {
+	logError() << "Can't map " << _file.fileName() << ": " << _file.errorString() << endl;
+	return false;
+    }
+
+    _mappedSize = mapSize;
+
+    return true;
+}
+
+
+void SpillStore::unmap()
+{
+    if ( _data )
+	_file.unmap( _data );
+
+    _data	= 0;
+    _mappedSize = 0;
+}
+
+
+void SpillStore::clear()
+{
+    if ( _size > 0 )
+	logInfo() << "Clearing " << formatSize( _size ) << " of spilled files" << endl;
+
+    unmap();
+    _blocks.clear();
+    _size = 0;
+
+    if ( _file.isOpen() )
+	_file.resize( 0 );
+}
@@ -0,0 +1,153 @@
+/*
+ *   File name: SpillStore.h
+ *   Summary:	On-disk store for file nodes of out-of-core trees
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef SpillStore_h
+#define SpillStore_h
+
+
+#include <QTemporaryFile>
+#include <QHash>
+
+#include "BinaryCache.h"
+#include "DirInfo.h"
+
+
+namespace QDirStat
+{
+    class DirTree;
+
+
+    /**
+     * Store for the non-directory children of directories in an out-of-core
+     * tree (see DirTree::outOfCore()): Instead of keeping a FileInfo for
+     * every file in memory, the files of a directory are written to this
+     * store when reading that directory is finished, and only the
+     * directory's sums stay in memory. When a view needs the files again
+     * (when the directory is expanded in the tree view or when the treemap
+     * is zoomed into it), they are paged in, i.e. new FileInfo objects are
+     * created from the store.
+     *
+     * The files are stored in a temporary file with the fixed-width records
+     * of the binary cache format (see BinaryCacheRecord): The records of
+     * each directory are written in one block, directly followed by their
+     * names. The temporary file is mapped into memory for paging in, so the
+     * operating system takes care of caching it.
+     *
+     * The store only grows; the space of paged-in or deleted files is only
+     * reclaimed when the store is cleared.
+     **/
+    class SpillStore
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	SpillStore( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	~SpillStore();
+
+	/**
+	 * Write 'files' (non-directory children of 'dir') to the store. The
+	 * FileInfo objects are not touched; the caller is responsible for
+	 * unlinking and deleting them.
+	 *
+	 * Returns 'false' upon error; nothing is stored for 'dir' then.
+	 **/
+	bool store( const DirInfo * dir, const FileInfoList & files );
+
+	/**
+	 * Return 'true' if there are files of 'dir' in the store.
+	 **/
+	bool contains( const DirInfo * dir ) const
+	    { return _blocks.contains( dir ); }
+
+	/**
+	 * Return the sums of the files of 'dir' in the store.
+	 **/
+	ChildrenSummary summary( const DirInfo * dir ) const
+	    { return _blocks.value( dir ).summary; }
+
+	/**
+	 * Create new FileInfo objects with parent 'dir' for the files of
+	 * 'dir' in the store and append them to 'files_ret'. They are not
+	 * inserted into 'dir's children list.
+	 *
+	 * Returns 'false' upon error.
+	 **/
+	bool load( DirInfo * dir, FileInfoList & files_ret );
+
+	/**
+	 * Forget the files of 'dir'.
+	 **/
+	void remove( const DirInfo * dir ) { _blocks.remove( dir ); }
+
+	/**
+	 * Forget all files and truncate the temporary file.
+	 **/
+	void clear();
+
+	/**
+	 * Return the number of bytes written to the store.
+	 **/
+	qint64 size() const { return _size; }
+
+
+    protected:
+
+	/**
+	 * The files of one directory.
+	 **/
+	struct Block
+	{
+	    Block(): offset( 0 ), count( 0 ) {}
+
+	    qint64	    offset;	// file offset of the first record
+	    int		    count;	// number of records
+	    ChildrenSummary summary;
+	};
+
+	/**
+	 * Open the temporary file if it is not open yet.
+	 * Returns 'false' upon error.
+	 **/
+	bool open();
+
+	/**
+	 * Make sure the temporary file is mapped into memory at least up to
+	 * 'end'. Returns 'false' upon error.
+	 **/
+	bool mapUpTo( qint64 end );
+
+	/**
+	 * Unmap the temporary file.
+	 **/
+	void unmap();
+
+
+	//
+	// Data members
+	//
+
+	DirTree *		       _tree;
+	QTemporaryFile		       _file;
+	qint64			       _size;
+	uchar *			       _data;
+	qint64			       _mappedSize;
+	QHash<const DirInfo *, Block>  _blocks;
+
+    };	// class SpillStore
+
+}	// namespace QDirStat
+
+
+#endif // ifndef SpillStore_h
@@ -0,0 +1,370 @@
+/*
+ *   File name: StatRing.cpp
+ *   Summary:	Asynchronous stat calls with Linux io_uring
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <errno.h>
+#include <string.h>	// memset()
+#include <fcntl.h>	// AT_ constants
+#include <unistd.h>	// syscall(), close()
+
+#include <QThreadStorage>
+
+#ifdef __linux__
+#  include <sys/mman.h>		// mmap()
+#  include <sys/syscall.h>	// __NR_io_uring_setup
+#  include <sys/sysmacros.h>	// makedev()
+#endif
+
+#include "StatRing.h"
+#include "DirScanner.h"
+
+
+#if defined( __linux__ ) && defined( __NR_io_uring_setup ) && defined( STATX_BASIC_STATS )
+#  include <linux/io_uring.h>
+#  define HAVE_IO_URING		1
+#else
+#  define HAVE_IO_URING		0
+#endif
+
+
+using namespace QDirStat;
+
+
+// Set to 'false' if io_uring or IORING_OP_STATX turn out not to work (old
+// kernel, disabled by the admin, seccomp filter in a container). Like in
+// DirScanner.cpp, this is not protected by a mutex; it only ever changes
+// from 'true' to 'false'.
+
+static volatile bool haveStatRing = true;
+
+#if HAVE_IO_URING
+
+// Rounded up to 8 bytes for the alignment in the buffer
+#define STATX_BUF_SIZE	( ( sizeof( struct statx ) + 7 ) & ~7 )
+
+#define loadAcquire( ptr )		__atomic_load_n( ( ptr ), __ATOMIC_ACQUIRE )
+#define storeRelease( ptr, val )	__atomic_store_n( ( ptr ), ( val ), __ATOMIC_RELEASE )
+
+#endif
+
+
+StatRing::StatRing():
+    _fd( -1 ),
+    _sqRing( 0 ),
+    _sqRingSize( 0 ),
+    _cqRing( 0 ),
+    _cqRingSize( 0 ),
+    _sqes( 0 ),
+    _sqesSize( 0 ),
+    _sqHead( 0 ),
+    _sqTail( 0 ),
+    _sqMask( 0 ),
+    _sqArray( 0 ),
+    _cqHead( 0 ),
+    _cqTail( 0 ),
+    _cqMask( 0 ),
+    _cqes( 0 ),
+    _depth( 0 )
+{
+#if HAVE_IO_URING
+    struct io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+
+    _fd = syscall( __NR_io_uring_setup, STAT_RING_DEPTH, &params );
+
+    if ( _fd < 0 )
+	return;
+
+    if ( ! mapRings( &params ) )
+    {
+	close();
+	return;
+    }
+
+    _depth = params.sq_entries;
+
+    _statxBufs.resize( _depth * STATX_BUF_SIZE / sizeof( quint64 ) );
+    _freeSlots.reserve( _depth );
+
+    for ( int i = _depth - 1; i >= 0; --i )
+	_freeSlots.append( i );
+#endif
+}
+
+
+StatRing::~StatRing()
+{
+    close();
+}
+
+
+StatRing * StatRing::forThisThread()
+{
+    static QThreadStorage<StatRing *> rings;
+
+    if ( ! haveStatRing )
+	return 0;
+
+    if ( ! rings.hasLocalData() )
+    {
+	StatRing * ring = new StatRing();
+
+	if ( ! ring->ok() )
+	{
+	    haveStatRing = false;
+	    delete ring;
+	    ring = 0;
+	}
+
+	rings.setLocalData( ring );
+    }
+
+    return rings.localData();
+}
+
+
+bool StatRing::mapRings( void * paramsPtr )
+{
+#if HAVE_IO_URING
+    struct io_uring_params * params = (struct io_uring_params *) paramsPtr;
+
+    _sqRingSize = params->sq_off.array + params->sq_entries * sizeof( unsigned );
+    _cqRingSize = params->cq_off.cqes  + params->cq_entries * sizeof( struct io_uring_cqe );
+
+    if ( params->features & IORING_FEAT_SINGLE_MMAP )
+    {
+	_sqRingSize = qMax( _sqRingSize, _cqRingSize );
+	_cqRingSize = 0;
+    }
+
+    _sqRing = mmap( 0, _sqRingSize, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING );
+
+    if ( _sqRing == MAP_FAILED )
+    {
+	_sqRing = 0;
+	return false;
+    }
+
+    if ( _cqRingSize > 0 )
+    {
+	_cqRing = mmap( 0, _cqRingSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING );
+
+	if ( _cqRing == MAP_FAILED )
+	{
+	    _cqRing = 0;
+	    return false;
+	}
+    }
+
+    _sqesSize = params->sq_entries * sizeof( struct io_uring_sqe );
+    _sqes = mmap( 0, _sqesSize, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES );
+
+    if ( _sqes == MAP_FAILED )
+    {
+	_sqes = 0;
+	return false;
+    }
+
+    char * sq = (char *) _sqRing;
+    char * cq = _cqRing ? (char *) _cqRing : sq;
+
+    _sqHead  = (unsigned *) ( sq + params->sq_off.head	       );
+    _sqTail  = (unsigned *) ( sq + params->sq_off.tail	       );
+    _sqMask  = (unsigned *) ( sq + params->sq_off.ring_mask    );
+    _sqArray = (unsigned *) ( sq + params->sq_off.array	       );
+    _cqHead  = (unsigned *) ( cq + params->cq_off.head	       );
+    _cqTail  = (unsigned *) ( cq + params->cq_off.tail	       );
+    _cqMask  = (unsigned *) ( cq + params->cq_off.ring_mask    );
+    _cqes    = (void *)	    ( cq + params->cq_off.cqes	       );
+
+    return true;
+#else
+    Q_UNUSED( paramsPtr );
+    return false;
+#endif
+}
+
+
+void StatRing::close()
+{
+#if HAVE_IO_URING
+    if ( _sqes )
+	munmap( _sqes, _sqesSize );
+
+    if ( _cqRing )
+	munmap( _cqRing, _cqRingSize );
+
+    if ( _sqRing )
+	munmap( _sqRing, _sqRingSize );
+#endif
+
+    _sqes   = 0;
+    _cqRing = 0;
+    _sqRing = 0;
+
+    if ( _fd >= 0 )
+    {
+	::close( _fd );
+	_fd = -1;
+    }
+}
+
+
+unsigned StatRing::statxMask()
+{
+#if defined( __linux__ ) && defined( STATX_BASIC_STATS )
+    // Only what FileInfo really uses; in particular no atime, ctime and
+    // btime. The i-number is needed for the hard link index.
+
+    return STATX_TYPE | STATX_MODE   | STATX_NLINK | STATX_UID | STATX_GID |
+	   STATX_SIZE | STATX_BLOCKS | STATX_MTIME | STATX_INO;
+#else
+    return 0;
+#endif
+}
+
+
+void StatRing::toStat( const void * statxBuf, struct stat * statInfo )
+{
+    memset( statInfo, 0, sizeof( struct stat ) );
+
+#if defined( __linux__ ) && defined( STATX_BASIC_STATS )
+    const struct statx * stx = (const struct statx *) statxBuf;
+
+    statInfo->st_mode	= stx->stx_mode;
+    statInfo->st_dev	= makedev( stx->stx_dev_major, stx->stx_dev_minor );
+    statInfo->st_ino	= stx->stx_ino;
+    statInfo->st_nlink	= stx->stx_nlink;
+    statInfo->st_uid	= stx->stx_uid;
+    statInfo->st_gid	= stx->stx_gid;
+    statInfo->st_size	= stx->stx_size;
+    statInfo->st_blocks = stx->stx_blocks;
+    statInfo->st_mtime	= stx->stx_mtime.tv_sec;
+#else
+    Q_UNUSED( statxBuf );
+#endif
+}
+
+
+bool StatRing::statEntries( int dirFd, DirScanResult & result )
+{
+#if HAVE_IO_URING
+    if ( ! ok() )
+	return false;
+
+    int flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+
+    struct io_uring_sqe * sqes = (struct io_uring_sqe *) _sqes;
+    struct io_uring_cqe * cqes = (struct io_uring_cqe *) _cqes;
+    char * statxBufs = (char *) _statxBufs.data();
+
+    const int count = result.entries.size();
+    DirScanEntry * entries = result.entries.data();
+    int  next	  = 0;
+    int  inFlight = 0;
+    bool failed	  = false;
+
+    while ( next < count || inFlight > 0 )
+    {
+	// Fill the submission queue
+
+	unsigned tail = *_sqTail;
+
+	while ( ! failed && next < count && ! _freeSlots.isEmpty() )
+	{
+	    int slot = _freeSlots.last();
+	    _freeSlots.removeLast();
+
+	    unsigned index = tail & *_sqMask;
+	    struct io_uring_sqe * sqe = &sqes[ index ];
+	    memset( sqe, 0, sizeof( *sqe ) );
+
+	    sqe->opcode	     = IORING_OP_STATX;
+	    sqe->fd	     = dirFd;
+	    sqe->addr	     = (quint64) result.name( entries[ next ] );
+	    sqe->len	     = statxMask();
+	    sqe->off	     = (quint64) ( statxBufs + slot * STATX_BUF_SIZE );
+	    sqe->statx_flags = flags;
+	    sqe->user_data   = ( (quint64) slot << 32 ) | (quint32) next;
+
+	    _sqArray[ index ] = index;
+	    ++tail;
+	    ++next;
+	    ++inFlight;
+	}
+
+	storeRelease( _sqTail, tail );
+
+	// Also those that the kernel did not take the last time
+
+	unsigned toSubmit = tail - loadAcquire( _sqHead );
+
+	int ret = syscall( __NR_io_uring_enter, _fd, toSubmit, 1,
+			   IORING_ENTER_GETEVENTS, 0, 0 );
+
+	if ( ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY )
+	{
+	    // Requests that are already in flight might still complete
+	    // into the statx buffers, so this ring can't be used any more.
+
+	    haveStatRing = false;
+	    close();
+	    return false;
+	}
+
+	// Collect the results
+
+	unsigned head = *_cqHead;
+
+	while ( head != loadAcquire( _cqTail ) )
+	{
+	    const struct io_uring_cqe * cqe = &cqes[ head & *_cqMask ];
+
+	    int slot  = cqe->user_data >> 32;
+	    int entry = cqe->user_data & 0xFFFFFFFF;
+
+	    if ( cqe->res == 0 )
+	    {
+		toStat( statxBufs + slot * STATX_BUF_SIZE, &entries[ entry ].statInfo );
+		entries[ entry ].statErrno = 0;
+	    }
+	    else if ( cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP )
+	    {
+		// IORING_OP_STATX is not supported by this kernel
+
+		failed = true;
+	    }
+	    else
+	    {
+		entries[ entry ].statErrno = -cqe->res;
+	    }
+
+	    _freeSlots.append( slot );
+	    --inFlight;
+	    ++head;
+	}
+
+	storeRelease( _cqHead, head );
+
+	if ( failed && inFlight == 0 )
+	{
+	    haveStatRing = false;
+	    return false;
+	}
+    }
+
+    return true;
+#else
+    Q_UNUSED( dirFd );
+    Q_UNUSED( result );
+    return false;
+#endif
+}
@@ -0,0 +1,136 @@
+/*
+ *   File name: StatRing.h
+ *   Summary:	Asynchronous stat calls with Linux io_uring
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef StatRing_h
+#define StatRing_h
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <QVector>
+
+
+// Maximum number of stat requests in flight at the same time
+
+#define STAT_RING_DEPTH		256
+
+
+namespace QDirStat
+{
+    struct DirScanResult;
+
+
+    /**
+     * An io_uring instance for stat calls: Instead of doing one statx() at
+     * a time and waiting for each one to complete, this submits up to
+     * STAT_RING_DEPTH IORING_OP_STATX requests at once and collects their
+     * results as they come in. On high-latency storage (network
+     * filesystems, in particular) this keeps the device (or the server)
+     * busy rather than waiting for one request after the other.
+     *
+     * This talks to the kernel directly with the io_uring_setup() and
+     * io_uring_enter() system calls; liburing is not needed.
+     *
+     * An io_uring instance must not be shared between threads; use
+     * forThisThread() to get one for the current thread.
+     *
+     * This is only available on Linux 5.6 and later. If it is not
+     * available, ok() returns 'false', and the caller should do the stat
+     * calls the conventional way.
+     **/
+    class StatRing
+    {
+    public:
+
+	/**
+	 * Constructor: Set up the io_uring.
+	 **/
+	StatRing();
+
+	/**
+	 * Destructor.
+	 **/
+	~StatRing();
+
+	/**
+	 * Return the StatRing for the current thread. It is created when
+	 * this is called for the first time in a thread, and it is
+	 * destroyed when the thread exits.
+	 *
+	 * This returns 0 if io_uring is not available.
+	 **/
+	static StatRing * forThisThread();
+
+	/**
+	 * Return 'true' if the io_uring was set up successfully.
+	 **/
+	bool ok() const { return _fd >= 0; }
+
+	/**
+	 * Get the information for all entries in 'result' from directory
+	 * 'dirFd' like fstatat() without following symlinks and store it in
+	 * the entries' statInfo / statErrno fields.
+	 *
+	 * Return 'false' if the io_uring failed; in that case, the caller
+	 * should do the stat calls for all entries the conventional way.
+	 **/
+	bool statEntries( int dirFd, DirScanResult & result );
+
+	/**
+	 * Copy the fields that QDirStat uses from a statx struct to a
+	 * stat struct.
+	 **/
+	static void toStat( const void * statxBuf, struct stat * statInfo );
+
+	/**
+	 * The statx() mask for the fields that QDirStat uses.
+	 **/
+	static unsigned statxMask();
+
+    protected:
+
+	/**
+	 * Map the ring buffers. Return 'true' if OK.
+	 **/
+	bool mapRings( void * params );
+
+	/**
+	 * Unmap the ring buffers and close the io_uring fd.
+	 **/
+	void close();
+
+
+	int		_fd;
+	void *		_sqRing;
+	size_t		_sqRingSize;
+	void *		_cqRing;
+	size_t		_cqRingSize;
+	void *		_sqes;
+	size_t		_sqesSize;
+
+	unsigned *	_sqHead;
+	unsigned *	_sqTail;
+	unsigned *	_sqMask;
+	unsigned *	_sqArray;
+	unsigned *	_cqHead;
+	unsigned *	_cqTail;
+	unsigned *	_cqMask;
+	void *		_cqes;
+	unsigned	_depth;
+
+	QVector<quint64> _statxBufs;	// one struct statx for each slot
+	QVector<int>	 _freeSlots;
+
+    };	// class StatRing
+
+}	// namespace QDirStat
+
+
+#endif // ifndef StatRing_h
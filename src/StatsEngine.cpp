@@ -0,0 +1,639 @@
+/*
+ *   File name: StatsEngine.cpp
+ *   Summary:	Statistics classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>	// std::sort()
+
+#include <QThread>
+#include <QRunnable>
+
+#include "StatsEngine.h"
+#include "FileInfo.h"
+#include "DirTree.h"
+#include "FileInfoIterator.h"
+#include "DirInfo.h"
+#include "TreeColumns.h"
+#include "Logger.h"
+#include "Exception.h"
+#include "Trace.h"
+
+// Below this number of items, collecting in one thread is faster than
+// starting threads
+#define STATS_PARALLEL_MIN_ITEMS	10000
+
+// Upper limit for the number of threads, no matter how many cores there are
+#define STATS_MAX_THREADS		8
+
+// Split the tree into up to this many parts per thread: The threads take
+// the next part when they are done with one, so they all finish at about the
+// same time even if the parts are very different in size
+#define STATS_PARTS_PER_THREAD		8
+
+// Cache the statistics of directories with at least this many items
+#define STATS_CACHE_MIN_ITEMS		10000
+
+#define VERBOSE_STATS_ENGINE		0
+
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Abstract base class for the workers of a StatsEngine: Collect with
+     * partial collectors, then tell the engine.
+     **/
+    class StatsTask: public QRunnable
+    {
+    public:
+
+	StatsTask( StatsEngine * engine, const StatsCollectorList & partials ):
+	    _engine( engine ),
+	    _partials( partials )
+	    {
+		setAutoDelete( false );
+	    }
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    collect();
+
+	    // The engine waits for all tasks before it goes away, so it is
+	    // still there.
+
+	    _engine->taskDone();
+	}
+
+	virtual void collect() = 0;
+
+	const StatsCollectorList & partials() const { return _partials; }
+
+    protected:
+
+	StatsEngine *	   _engine;
+	StatsCollectorList _partials;
+    };
+
+
+    /**
+     * Worker for StatsEngine: Collect subtrees from a list that is shared with
+     * the other workers with partial collectors. Each worker takes the next
+     * subtree that no other worker has taken yet until there are no more.
+     **/
+    class StatsEngineTask: public StatsTask
+    {
+    public:
+
+	StatsEngineTask( StatsEngine *		  engine,
+			 const StatsCollectorList & partials,
+			 const QList<FileInfo *>  & subtrees,
+			 const QStringList	  & cacheKeys,
+			 QAtomicInt		  & nextSubtree ):
+	    StatsTask( engine, partials ),
+	    _subtrees( subtrees ),
+	    _cacheKeys( cacheKeys ),
+	    _nextSubtree( nextSubtree )
+	    {}
+
+	virtual void collect() Q_DECL_OVERRIDE
+	{
+	    while ( true )
+	    {
+		int index = _nextSubtree.fetchAndAddOrdered( 1 );
+
+		if ( index >= _subtrees.size() )
+		    return;
+
+		StatsEngine::collectSubtree( _subtrees.at( index ), _partials, _cacheKeys );
+	    }
+	}
+
+    protected:
+
+	const QList<FileInfo *> & _subtrees;
+	QStringList		   _cacheKeys;
+	QAtomicInt &		   _nextSubtree;
+    };
+
+
+    /**
+     * Worker for StatsEngine::collectColumns(): Collect one range of the
+     * columns of a subtree with partial collectors.
+     **/
+    class StatsColumnsTask: public StatsTask
+    {
+    public:
+
+	StatsColumnsTask( StatsEngine *		   engine,
+			  const StatsCollectorList & partials,
+			  const TreeColumnsPtr	   & columns,
+			  int			     first,
+			  int			     end ):
+	    StatsTask( engine, partials ),
+	    _columns( columns ),
+	    _first( first ),
+	    _end( end )
+	    {}
+
+	virtual void collect() Q_DECL_OVERRIDE
+	{
+	    foreach ( StatsCollector * partial, _partials )
+		partial->collectColumns( *_columns, _first, _end );
+	}
+
+    protected:
+
+	TreeColumnsPtr _columns;
+	int	       _first;
+	int	       _end;
+    };
+
+
+    static bool moreItems( FileInfo * a, FileInfo * b )
+    {
+	return a->totalItems() > b->totalItems();
+    }
+
+}	// namespace QDirStat
+
+
+
+bool StatsEngine::_useColumns = false;
+
+
+StatsEngine::StatsEngine( QObject * parent ):
+    QObject( parent ),
+    _busy( false ),
+    _async( false ),
+    _tree( 0 ),
+    _subtree( 0 ),
+    _nextSubtree( 0 ),
+    _runningTasks( 0 )
+{
+    // NOP
+}
+
+
+StatsEngine::~StatsEngine()
+{
+    _async = false;	// Nobody to tell anymore
+    waitForDone();
+}
+
+
+void StatsEngine::addCollector( StatsCollector * collector )
+{
+    CHECK_PTR( collector );
+
+    _collectors << collector;
+}
+
+
+void StatsEngine::collect( FileInfo * subtree )
+{
+    TRACE_SPAN( "StatsEngine::collect" );
+
+    waitForDone();	// A previous start()
+    _async = false;
+
+    if ( begin( subtree ) )
+	finish();
+}
+
+
+void StatsEngine::start( FileInfo * subtree )
+{
+    TRACE_SPAN( "StatsEngine::start" );
+
+    waitForDone();
+
+    DirTree * tree = subtree && subtree->checkMagicNumber() ? subtree->tree() : 0;
+
+    if ( tree && tree->isBusy() )
+    {
+	// The read jobs change the tree all the time; they can't wait for
+	// the threads.
+
+	collect( subtree );
+	emit finished();
+	return;
+    }
+
+    _async = true;
+
+    if ( ! begin( subtree ) )
+	emit finished();
+}
+
+
+void StatsEngine::waitForDone()
+{
+    if ( ! _busy )
+	return;
+
+    finish();
+
+    if ( _async )
+	QMetaObject::invokeMethod( this, "finished", Qt::QueuedConnection );
+}
+
+
+void StatsEngine::taskDone()
+{
+    if ( ! _runningTasks.deref() )
+	QMetaObject::invokeMethod( this, "tasksDone", Qt::QueuedConnection );
+}
+
+
+void StatsEngine::tasksDone()
+{
+    // waitForDone() might have been faster, and a new run might be busy
+    // by now
+
+    if ( ! _busy || ! _async || _runningTasks.loadAcquire() > 0 )
+	return;
+
+    finish();
+    emit finished();
+}
+
+
+bool StatsEngine::begin( FileInfo * subtree )
+{
+    if ( ! subtree || ! subtree->checkMagicNumber() )
+	return false;
+
+    // Update the sums of all dirty directories now: Reading them in the
+    // worker threads would write them.
+
+    FileCount totalItems = subtree->totalItems();
+
+    foreach ( StatsCollector * collector, _collectors )
+	collector->startCollecting( subtree );
+
+    _subtree = subtree;
+
+    if ( canCollectColumns( subtree ) )
+    {
+	if ( collectColumns( subtree->toDirInfo() ) )
+	    return true;
+
+	finish();
+	return false;
+    }
+
+    collectItem( subtree, _collectors );
+
+    // If all collectors can be cached, collect the subtree into a new set of
+    // partial collectors that is then cached in the subtree directory.
+
+    QStringList	       cacheKeys = this->cacheKeys();
+    StatsCollectorList targets	 = _collectors;
+    StatsCollectorList aggregates;
+
+    if ( isCacheable( subtree, cacheKeys ) )
+    {
+	aggregates = subtree->toDirInfo()->cachedStats( cacheKeys );
+
+	if ( ! aggregates.isEmpty() )
+	{
+	    merge( aggregates );
+	    totalItems = 0;	// Nothing left to collect
+	}
+	else
+	{
+	    targets	  = createPartials();
+	    _cacheTargets = targets;
+	    _cacheKeys	  = cacheKeys;
+	}
+    }
+
+    const int threads = qMin( QThread::idealThreadCount(), STATS_MAX_THREADS );
+
+    if ( totalItems == 0 )
+    {
+	// NOP
+    }
+    else if ( totalItems < STATS_PARALLEL_MIN_ITEMS || threads < 2 )
+    {
+	collectRecursive( subtree, targets, cacheKeys );
+    }
+    else
+    {
+	// Split up the tree at directory boundaries: Collect the items at the
+	// top in this thread and replace the largest subtree by its children
+	// until there are enough parts of a reasonable size.
+
+	QList<FileInfo *> subtrees;
+	subtrees << subtree;
+
+	const FileCount maxItems = totalItems / ( threads * STATS_PARTS_PER_THREAD );
+
+	while ( ! subtrees.isEmpty() )
+	{
+	    std::sort( subtrees.begin(), subtrees.end(), moreItems );
+	    FileInfo * largest = subtrees.first();
+
+	    if ( largest != subtree &&
+		 ( largest->totalItems() <= maxItems ||
+		   subtrees.size() >= threads * STATS_PARTS_PER_THREAD ) )
+	    {
+		break;
+	    }
+
+	    subtrees.removeFirst();
+
+	    FileInfoIterator it( largest );
+
+	    while ( *it )
+	    {
+		collectItem( *it, targets );
+
+		if ( (*it)->hasChildren() )
+		    subtrees << *it;
+
+		++it;
+	    }
+	}
+
+	if ( collectParallel( subtrees, threads, targets, cacheKeys ) )
+	    return true;
+    }
+
+    finish();
+    return false;
+}
+
+
+void StatsEngine::finish()
+{
+    _threadPool.waitForDone();
+
+    foreach ( StatsTask * task, _tasks )
+    {
+	merge( _mergeTargets, task->partials() );
+	qDeleteAll( task->partials() );
+    }
+
+    qDeleteAll( _tasks );
+    _tasks.clear();
+    _mergeTargets.clear();
+    _subtrees.clear();
+
+    // The new results for the subtree directory are cached there
+
+    if ( ! _cacheTargets.isEmpty() )
+    {
+	_subtree->toDirInfo()->setCachedStats( _cacheKeys, _cacheTargets );
+	merge( _cacheTargets );
+	_cacheTargets.clear();
+    }
+
+    _cacheKeys.clear();
+
+    foreach ( StatsCollector * collector, _collectors )
+	collector->finishCollecting( _subtree );
+
+    if ( _tree )
+	_tree->removeStatsEngine( this );
+
+    _tree    = 0;
+    _subtree = 0;
+    _busy    = false;
+}
+
+
+void StatsEngine::startTasks( const QList<StatsTask *>  & tasks,
+			      const StatsCollectorList & targets )
+{
+    _tasks	  = tasks;
+    _mergeTargets = targets;
+    _busy	  = true;
+    _runningTasks.storeRelease( tasks.size() );
+
+    // Anything that changes the tree waits for the tasks first
+
+    _tree = _subtree->tree();
+
+    if ( _tree )
+	_tree->addStatsEngine( this );
+
+    _threadPool.setMaxThreadCount( tasks.size() );
+
+    foreach ( StatsTask * task, tasks )
+	_threadPool.start( task );
+}
+
+
+bool StatsEngine::canCollectColumns( FileInfo * subtree ) const
+{
+    if ( ! _useColumns || _collectors.isEmpty() ||
+	 ! subtree->isDirInfo() || subtree->isPseudoDir() )
+    {
+	return false;
+    }
+
+    foreach ( StatsCollector * collector, _collectors )
+    {
+	if ( ! collector->canCollectColumns() )
+	    return false;
+    }
+
+    return true;
+}
+
+
+bool StatsEngine::collectColumns( DirInfo * dir )
+{
+    TreeColumnsPtr columns = TreeColumns::take( dir );
+    int first;
+    int end;
+
+    if ( ! columns->range( dir, first, end ) )
+	return false;
+
+    const int threads = qMin( QThread::idealThreadCount(), STATS_MAX_THREADS );
+
+    if ( end - first < STATS_PARALLEL_MIN_ITEMS || threads < 2 )
+    {
+	foreach ( StatsCollector * collector, _collectors )
+	    collector->collectColumns( *columns, first, end );
+
+	return false;
+    }
+
+    // The items of a range are all equally expensive, so one part of the
+    // same size for each thread is just right.
+
+    QList<StatsTask *> tasks;
+    int partSize = ( end - first + threads - 1 ) / threads;
+
+    for ( int start = first; start < end; start += partSize )
+    {
+	StatsColumnsTask * task = new StatsColumnsTask( this,
+							createPartials(),
+							columns,
+							start,
+							qMin( start + partSize, end ) );
+	CHECK_NEW( task );
+	tasks << task;
+    }
+
+    startTasks( tasks, _collectors );
+
+    return true;
+}
+
+
+QStringList StatsEngine::cacheKeys() const
+{
+    QStringList keys;
+
+    foreach ( StatsCollector * collector, _collectors )
+    {
+	QString key = collector->cacheKey();
+
+	if ( key.isEmpty() )
+	    return QStringList();
+
+	keys << key;
+    }
+
+    return keys;
+}
+
+
+bool StatsEngine::isCacheable( FileInfo * dir, const QStringList & cacheKeys )
+{
+    return ! cacheKeys.isEmpty() &&
+	dir->isDirInfo() &&
+	dir->totalItems() >= STATS_CACHE_MIN_ITEMS;
+}
+
+
+StatsCollectorList StatsEngine::createPartials() const
+{
+    return createPartials( _collectors );
+}
+
+
+StatsCollectorList StatsEngine::createPartials( const StatsCollectorList & collectors )
+{
+    StatsCollectorList partials;
+
+    foreach ( StatsCollector * collector, collectors )
+    {
+	StatsCollector * partial = collector->createPartial();
+	CHECK_PTR( partial );
+	partials << partial;
+    }
+
+    return partials;
+}
+
+
+void StatsEngine::merge( const StatsCollectorList & partials )
+{
+    merge( _collectors, partials );
+}
+
+
+void StatsEngine::merge( const StatsCollectorList & collectors,
+			 const StatsCollectorList & partials )
+{
+    for ( int i = 0; i < collectors.size(); ++i )
+	collectors[ i ]->merge( partials[ i ] );
+}
+
+
+bool StatsEngine::collectParallel( const QList<FileInfo *>  & subtrees,
+				   int			      threads,
+				   const StatsCollectorList & targets,
+				   const QStringList	    & cacheKeys )
+{
+    if ( subtrees.isEmpty() )
+	return false;
+
+    // The subtrees are sorted by size, largest first, so the small ones at
+    // the end fill the gaps.
+
+    _subtrees = subtrees;
+    _nextSubtree.storeRelease( 0 );
+    QList<StatsTask *> tasks;
+
+    for ( int i = 0; i < threads && i < subtrees.size(); ++i )
+    {
+	StatsEngineTask * task = new StatsEngineTask( this,
+						      createPartials( targets ),
+						      _subtrees,
+						      cacheKeys,
+						      _nextSubtree );
+	CHECK_NEW( task );
+	tasks << task;
+    }
+
+#if VERBOSE_STATS_ENGINE
+    logDebug() << "Collecting " << subtrees.size() << " subtrees in "
+	       << tasks.size() << " threads" << endl;
+#endif
+
+    startTasks( tasks, targets );
+
+    return true;
+}
+
+
+void StatsEngine::collectRecursive( FileInfo		     * dir,
+				    const StatsCollectorList & collectors,
+				    const QStringList	     & cacheKeys )
+{
+    FileInfoIterator it( dir );
+
+    while ( *it )
+    {
+	FileInfo * item = *it;
+	collectItem( item, collectors );
+
+	if ( item->hasChildren() )
+	    collectSubtree( item, collectors, cacheKeys );
+
+	++it;
+    }
+}
+
+
+void StatsEngine::collectSubtree( FileInfo		   * dir,
+				  const StatsCollectorList & collectors,
+				  const QStringList	   & cacheKeys )
+{
+    if ( ! isCacheable( dir, cacheKeys ) )
+    {
+	collectRecursive( dir, collectors, cacheKeys );
+	return;
+    }
+
+    StatsCollectorList aggregates = dir->toDirInfo()->cachedStats( cacheKeys );
+
+    if ( aggregates.isEmpty() )
+    {
+	aggregates = createPartials( collectors );
+	collectRecursive( dir, aggregates, cacheKeys );
+	dir->toDirInfo()->setCachedStats( cacheKeys, aggregates );
+    }
+
+    merge( collectors, aggregates );
+}
+
+
+void StatsEngine::collectItem( FileInfo		      * item,
+			       const StatsCollectorList & collectors )
+{
+    foreach ( StatsCollector * collector, collectors )
+	collector->collectItem( item );
+}
@@ -0,0 +1,372 @@
+/*
+ *   File name: StatsEngine.h
+ *   Summary:	Statistics classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef StatsEngine_h
+#define StatsEngine_h
+
+
+#include <QObject>
+#include <QList>
+#include <QStringList>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+
+namespace QDirStat
+{
+    class FileInfo;
+    class DirInfo;
+    class DirTree;
+    class StatsCollector;
+    class StatsTask;
+    class TreeColumns;
+
+    typedef QList<StatsCollector *> StatsCollectorList;
+
+
+    /**
+     * Abstract base class for statistics that are collected from the items
+     * of a subtree: A StatsEngine walks the tree and calls collectItem()
+     * for each item, so any number of collectors can share one traversal.
+     *
+     * For collecting in parallel, the engine creates partial collectors
+     * with createPartial() for parts of the tree, lets them collect in
+     * other threads and finally merges their results into the original
+     * collector with merge(). collectItem() of a partial collector must not
+     * change anything but that collector itself.
+     **/
+    class StatsCollector
+    {
+    public:
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~StatsCollector() {}
+
+	/**
+	 * Prepare collecting data from 'subtree', e.g. clear the previous
+	 * data. This is called before any other method, always in the GUI
+	 * thread.
+	 **/
+	virtual void startCollecting( FileInfo * subtree ) { Q_UNUSED( subtree ); }
+
+	/**
+	 * Collect data from 'item'. This is called for every item in the
+	 * subtree, including the subtree itself, the dot entries and all
+	 * directories. Derived classes are required to implement this.
+	 **/
+	virtual void collectItem( FileInfo * item ) = 0;
+
+	/**
+	 * Return 'true' if this collector can collect its data from a
+	 * column-wise copy of the tree (see TreeColumns) with
+	 * collectColumns().
+	 **/
+	virtual bool canCollectColumns() const { return false; }
+
+	/**
+	 * Collect data from the items 'first' .. 'end' - 1 of 'columns'.
+	 * If all collectors of an engine can do this, the engine calls this
+	 * instead of collectItem(). Like collectItem(), this might be called
+	 * in another thread for a partial collector.
+	 **/
+	virtual void collectColumns( const TreeColumns & columns, int first, int end )
+	    { Q_UNUSED( columns ); Q_UNUSED( first ); Q_UNUSED( end ); }
+
+	/**
+	 * Create a new, empty collector with the same parameters as this one
+	 * for collecting part of the subtree in another thread or for caching
+	 * the results for a directory. The caller takes over ownership. This
+	 * might be called in any thread.
+	 **/
+	virtual StatsCollector * createPartial() const = 0;
+
+	/**
+	 * Add the data of 'partial' to this collector. 'partial' is always
+	 * one that was created with createPartial() of this collector.
+	 **/
+	virtual void merge( StatsCollector * partial ) = 0;
+
+	/**
+	 * Finish collecting data from 'subtree', e.g. calculate percentages
+	 * or sort the data. This is called after all other methods, always
+	 * in the GUI thread.
+	 **/
+	virtual void finishCollecting( FileInfo * subtree ) { Q_UNUSED( subtree ); }
+
+	/**
+	 * Return a key that identifies the parameters of this collector if
+	 * its results for large directories may be cached in the directories,
+	 * or an empty string if not. Results are only cached if all
+	 * collectors of an engine can be cached.
+	 *
+	 * Caching only makes sense if the results for a directory are small:
+	 * It costs memory for each level of the tree.
+	 **/
+	virtual QString cacheKey() const { return QString(); }
+
+    };	// class StatsCollector
+
+
+    /**
+     * Engine to collect any number of statistics from a subtree in one
+     * single traversal of the tree.
+     *
+     * Large trees are split up at directory boundaries into many more parts
+     * than there are threads. Each thread has its own set of partial
+     * collectors and takes the next part that is not taken yet whenever it
+     * is done with one, so no thread is idle while others still have a lot
+     * of work. The partial results are merged afterwards. Small trees are
+     * simply collected in the calling thread.
+     *
+     * collect() blocks until the threads are done. start() returns right
+     * away and emits finished() when the results are there, so the GUI
+     * keeps going meanwhile. The engine is registered with the DirTree
+     * while it is busy: Anything that changes the tree waits for it first
+     * (see DirTree::finishStats()), so the items are not pulled out from
+     * under the threads.
+     *
+     * Optionally (see setUseColumns()), if all collectors can do that,
+     * they collect from a column-wise copy of the tree (see TreeColumns)
+     * instead: That is a linear scan over a few arrays, and the range of
+     * the subtree is simply split up into one part for each thread. The
+     * copy is kept until the subtree changes.
+     *
+     * If all collectors provide a cache key, the results for each large
+     * directory are cached in that directory as a set of partial collectors
+     * until anything in that subtree changes. Those directories are then
+     * not traversed again, so collecting the same or another subtree again
+     * only costs a traversal down to the largest directories.
+     *
+     * Usage:
+     *
+     *	   FileTypeStats typeStats;
+     *	   FileAgeStats	 ageStats;
+     *
+     *	   StatsEngine engine;
+     *	   engine.addCollector( &typeStats );
+     *	   engine.addCollector( &ageStats  );
+     *	   engine.collect( subtree );
+     **/
+    class StatsEngine: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	StatsEngine( QObject * parent = 0 );
+
+	/**
+	 * Destructor. This waits for the threads if they are still busy.
+	 **/
+	virtual ~StatsEngine();
+
+	/**
+	 * Add a collector. This does not transfer ownership.
+	 **/
+	void addCollector( StatsCollector * collector );
+
+	/**
+	 * Return the collectors.
+	 **/
+	const StatsCollectorList & collectors() const { return _collectors; }
+
+	/**
+	 * Remove all collectors. Don't do this while the engine is busy.
+	 **/
+	void clear() { _collectors.clear(); }
+
+	/**
+	 * Enable or disable collecting from a column-wise copy of the tree
+	 * if all collectors can do that. This is global for all engines.
+	 **/
+	static void setUseColumns( bool useColumns ) { _useColumns = useColumns; }
+
+	/**
+	 * Return 'true' if collecting from a column-wise copy of the tree is
+	 * enabled.
+	 **/
+	static bool useColumns() { return _useColumns; }
+
+	/**
+	 * Collect the data for all collectors from 'subtree'. This returns
+	 * when everything is collected.
+	 **/
+	void collect( FileInfo * subtree );
+
+	/**
+	 * Start collecting the data for all collectors from 'subtree' in
+	 * other threads and return right away. finished() is emitted when
+	 * everything is collected. Don't touch the collectors until then.
+	 *
+	 * While the tree is still being read, it changes all the time, so
+	 * this collects everything right away like collect().
+	 **/
+	void start( FileInfo * subtree );
+
+	/**
+	 * Return 'true' if the threads are still collecting.
+	 **/
+	bool isBusy() const { return _busy; }
+
+	/**
+	 * Wait until the threads are done and finish collecting. finished()
+	 * is still emitted (queued) for a run that was started with start().
+	 * This does nothing if the engine is not busy.
+	 **/
+	void waitForDone();
+
+	/**
+	 * Recursively collect the data for 'collectors' from all items in
+	 * the subtree of 'dir', but not from 'dir' itself. If 'cacheKeys' is
+	 * not empty, use and create cached results for large directories.
+	 **/
+	static void collectRecursive( FileInfo		       * dir,
+				      const StatsCollectorList & collectors,
+				      const QStringList	       & cacheKeys = QStringList() );
+
+	/**
+	 * Like collectRecursive(), but use or create cached results for
+	 * 'dir' itself if it is large enough and 'cacheKeys' is not empty.
+	 **/
+	static void collectSubtree( FileInfo		     * dir,
+				    const StatsCollectorList & collectors,
+				    const QStringList	     & cacheKeys );
+
+    signals:
+
+	/**
+	 * Emitted when everything is collected after start().
+	 **/
+	void finished();
+
+    protected slots:
+
+	/**
+	 * Notification that the last task is done. This is called in the
+	 * GUI thread.
+	 **/
+	void tasksDone();
+
+    protected:
+
+	/**
+	 * Prepare collecting from 'subtree' and start the threads. Return
+	 * 'true' if they are busy now and finish() needs to be called when
+	 * they are done. Otherwise everything is already collected.
+	 **/
+	bool begin( FileInfo * subtree );
+
+	/**
+	 * Wait for the threads, merge their results and finish collecting.
+	 **/
+	void finish();
+
+	/**
+	 * Notification from a task in a worker thread that it is done.
+	 **/
+	void taskDone();
+
+	friend class StatsTask;
+
+	/**
+	 * Start 'tasks' in the thread pool. Their partial results are merged
+	 * into 'targets' when they are done.
+	 **/
+	void startTasks( const QList<StatsTask *>  & tasks,
+			 const StatsCollectorList & targets );
+
+	/**
+	 * Return 'true' if all collectors can collect from the columns of
+	 * 'subtree'.
+	 **/
+	bool canCollectColumns( FileInfo * subtree ) const;
+
+	/**
+	 * Collect the data for all collectors from the columns of 'dir',
+	 * using several threads for large subtrees. Return 'true' if the
+	 * threads are busy.
+	 **/
+	bool collectColumns( DirInfo * dir );
+
+	/**
+	 * Call collectItem() for 'item' for all 'collectors'.
+	 **/
+	static void collectItem( FileInfo		  * item,
+				 const StatsCollectorList & collectors );
+
+	/**
+	 * Start collecting 'subtrees' in several threads with partial
+	 * collectors. Their results are merged into 'targets' when they are
+	 * done. 'subtrees' should be sorted by size, largest first. Return
+	 * 'true' if the threads are busy.
+	 **/
+	bool collectParallel( const QList<FileInfo *>  & subtrees,
+			      int			 threads,
+			      const StatsCollectorList & targets,
+			      const QStringList	       & cacheKeys );
+
+	/**
+	 * Return the cache keys of all collectors or an empty list if any of
+	 * them cannot be cached.
+	 **/
+	QStringList cacheKeys() const;
+
+	/**
+	 * Return 'true' if results for 'dir' should be cached.
+	 **/
+	static bool isCacheable( FileInfo * dir, const QStringList & cacheKeys );
+
+	/**
+	 * Create a list of partial collectors for the collectors of this
+	 * engine or for 'collectors'.
+	 **/
+	StatsCollectorList createPartials() const;
+	static StatsCollectorList createPartials( const StatsCollectorList & collectors );
+
+	/**
+	 * Merge 'partials' into the collectors of this engine or into
+	 * 'collectors' with the same index.
+	 **/
+	void merge( const StatsCollectorList & partials );
+	static void merge( const StatsCollectorList & collectors,
+			   const StatsCollectorList & partials );
+
+
+	// Data members
+
+	StatsCollectorList _collectors;
+	QThreadPool	   _threadPool;
+	bool		   _busy;
+	bool		   _async;
+	DirTree *	   _tree;	// The engine is registered there while busy
+	FileInfo *	   _subtree;
+
+	// State of the current run for finish()
+
+	QList<StatsTask *> _tasks;
+	StatsCollectorList _mergeTargets;	// for the partials of the tasks
+	StatsCollectorList _cacheTargets;	// to cache in _subtree
+	QStringList	   _cacheKeys;
+	QList<FileInfo *>  _subtrees;		// shared with the tasks
+	QAtomicInt	   _nextSubtree;	// shared with the tasks
+	QAtomicInt	   _runningTasks;
+
+	static bool	   _useColumns;
+
+    };	// class StatsEngine
+
+}	// namespace QDirStat
+
+
+#endif // ifndef StatsEngine_h
@@ -0,0 +1,150 @@
+/*
+ *   File name: SuffixIndex.cpp
+ *   Summary:	Index of the directories that contain files with a suffix
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QElapsedTimer>
+
+#include "SuffixIndex.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "FileInfoSet.h"
+#include "Trace.h"
+#include "Logger.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+SuffixIndex::SuffixIndex( DirTree * tree, QObject * parent ):
+    QObject( parent ),
+    _tree( tree ),
+    _valid( false )
+{
+    CHECK_PTR( _tree );
+
+    // Any change of the tree makes the index invalid; it is simply dropped
+    // and rebuilt on the next query.
+
+    connect( _tree, SIGNAL( clearing()				),
+	     this,  SLOT  ( invalidate()			) );
+
+    connect( _tree, SIGNAL( deletingChild	( FileInfo * )	),
+	     this,  SLOT  ( invalidate()			) );
+
+    connect( _tree, SIGNAL( clearingSubtree	( DirInfo * )	),
+	     this,  SLOT  ( invalidate()			) );
+
+    connect( _tree, SIGNAL( clearingSubtrees	( FileInfoSet ) ),
+	     this,  SLOT  ( invalidate()			) );
+
+    connect( _tree, SIGNAL( childDeleted()			),
+	     this,  SLOT  ( invalidate()			) );
+
+    connect( _tree, SIGNAL( childrenAdded	( DirInfo * )	),
+	     this,  SLOT  ( invalidate()			) );
+
+    connect( _tree, SIGNAL( filesPagedIn	( DirInfo * )	),
+	     this,  SLOT  ( invalidate()			) );
+
+    connect( _tree, SIGNAL( startingReading()			),
+	     this,  SLOT  ( invalidate()			) );
+
+    connect( _tree, SIGNAL( finished()				),
+	     this,  SLOT  ( invalidate()			) );
+
+    connect( _tree, SIGNAL( aborted()				),
+	     this,  SLOT  ( invalidate()			) );
+}
+
+
+void SuffixIndex::invalidate()
+{
+    if ( _valid )
+    {
+	_dirs.clear();
+	_valid = false;
+    }
+}
+
+
+QVector<DirInfo *> SuffixIndex::dirs( const QString & suffix,
+				      const FileInfo * subtree )
+{
+    ensureValid();
+
+    QVector<DirInfo *> allDirs = _dirs.value( suffix.toLower() );
+
+    if ( ! subtree || subtree == _tree->root() )
+	return allDirs;
+
+    QVector<DirInfo *> result;
+
+    foreach ( DirInfo * dir, allDirs )
+    {
+	if ( dir->isInSubtree( subtree ) )
+	    result << dir;
+    }
+
+    return result;
+}
+
+
+void SuffixIndex::ensureValid()
+{
+    if ( _valid )
+	return;
+
+    TRACE_SPAN( "SuffixIndex::build" );
+
+    QElapsedTimer timer;
+    timer.start();
+
+    addRecursive( _tree->root() );
+    _valid = true;
+
+    logDebug() << "Indexed " << _dirs.size() << " suffixes in "
+	       << timer.elapsed() << " millisec" << endl;
+}
+
+
+void SuffixIndex::addRecursive( DirInfo * dir )
+{
+    if ( ! dir )
+	return;
+
+    // The files are in the dot entry if there is one
+
+    DirInfo * fileParent = dir->dotEntry() ? dir->dotEntry() : dir;
+
+    for ( FileInfo * child = fileParent->firstChild(); child; child = child->next() )
+    {
+	if ( ! child->isFile() )
+	    continue;
+
+	QString name = child->name().toLower();
+	int	pos  = name.indexOf( '.' );
+
+	while ( pos >= 0 )
+	{
+	    QVector<DirInfo *> & dirs = _dirs[ name.mid( pos ) ];
+
+	    // Each directory only once for each suffix
+
+	    if ( dirs.isEmpty() || dirs.last() != dir )
+		dirs << dir;
+
+	    pos = name.indexOf( '.', pos + 1 );
+	}
+    }
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() )
+	    addRecursive( child->toDirInfo() );
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ *   File name: SuffixIndex.h
+ *   Summary:	Index of the directories that contain files with a suffix
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef SuffixIndex_h
+#define SuffixIndex_h
+
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QString>
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class FileInfo;
+
+
+    /**
+     * Inverted index from file name suffixes to the directories that
+     * directly contain files with that suffix (in the directory itself or
+     * in its dot entry).
+     *
+     * The index is built with one traversal of the tree when it is first
+     * needed. After that, locating the directories with a suffix in any
+     * subtree only visits those directories, not the complete subtree. It
+     * is dropped whenever the tree changes and rebuilt on the next query.
+     *
+     * The suffixes are case insensitive, and each file is indexed with all
+     * its suffixes: "foo.tar.gz" is found for ".gz" as well as for
+     * ".tar.gz".
+     **/
+    class SuffixIndex: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	SuffixIndex( DirTree * tree, QObject * parent = 0 );
+
+	/**
+	 * Return the tree of this index.
+	 **/
+	DirTree * tree() const { return _tree; }
+
+	/**
+	 * Return the directories in 'subtree' (0 for the complete tree)
+	 * that directly contain files ending with 'suffix' (with a leading
+	 * '.'). The directories are in no particular order.
+	 **/
+	QVector<DirInfo *> dirs( const QString & suffix,
+				 const FileInfo * subtree = 0 );
+
+	/**
+	 * Return 'true' if the index is built.
+	 **/
+	bool isValid() const { return _valid; }
+
+
+    public slots:
+
+	/**
+	 * Drop the index. It is rebuilt on the next query.
+	 **/
+	void invalidate();
+
+
+    protected:
+
+	/**
+	 * Build the index if it is not valid.
+	 **/
+	void ensureValid();
+
+	/**
+	 * Add 'dir' and all its subdirectories to the index.
+	 **/
+	void addRecursive( DirInfo * dir );
+
+
+	DirTree *			      _tree;
+	QHash<QString, QVector<DirInfo *> > _dirs;
+	bool				      _valid;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef SuffixIndex_h
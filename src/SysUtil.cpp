@@ -15,6 +15,14 @@
 #include <sys/stat.h>   // lstat()
 #include <sys/types.h>
 
+#ifdef __linux__
+#  include <sys/sysmacros.h>	// major(), minor()
+#  include <sys/syscall.h>	// SYS_ioprio_set
+#endif
+
+#include <QFile>
+#include <QStringList>
+
 #include "SysUtil.h"
 #include "Process.h"
 #include "DirSaver.h"
@@ -274,3 +282,65 @@ QByteArray SysUtil::readLink( const QByteArray & path )
 
     return targetBuf;
 }
+
+
+bool SysUtil::setIdleIoPriority( bool idle )
+{
+#if defined( __linux__ ) && defined( SYS_ioprio_set )
+    // There is no glibc wrapper for ioprio_set(), and the constants are
+    // only in the kernel headers (linux/ioprio.h).
+
+    const int ioprioWhoProcess = 1;	// IOPRIO_WHO_PROCESS
+    const int ioprioClassIdle  = 3;	// IOPRIO_CLASS_IDLE
+    const int ioprioClassShift = 13;	// IOPRIO_CLASS_SHIFT
+
+    int ioprio = idle ? ( ioprioClassIdle << ioprioClassShift ) : 0; // 0: default
+
+    // For IOPRIO_WHO_PROCESS, 0 is the calling thread
+
+    return syscall( SYS_ioprio_set, ioprioWhoProcess, 0, ioprio ) == 0;
+#else
+    Q_UNUSED( idle );
+
+    return false;
+#endif
+}
+
+
+bool SysUtil::isRotational( dev_t device )
+{
+#ifdef __linux__
+    QString devDir = QString( "/sys/dev/block/%1:%2" )
+	.arg( major( device ) ).arg( minor( device ) );
+
+    // For a partition, the queue information is in the parent device
+
+    QStringList candidates;
+    candidates << devDir + "/queue/rotational"
+	       << devDir + "/../queue/rotational";
+
+    foreach ( const QString & fileName, candidates )
+    {
+	QFile file( fileName );
+
+	if ( file.open( QIODevice::ReadOnly ) )
+	    return file.readAll().trimmed() == "1";
+    }
+#else
+    Q_UNUSED( device );
+#endif
+
+    return false;
+}
+
+
+QByteArray SysUtil::mappedContents( QFile & file )
+{
+    qint64  size = file.size();
+    uchar * data = size > 0 ? file.map( 0, size ) : 0;
+
+    if ( data )
+	return QByteArray::fromRawData( (const char *) data, size );
+
+    return file.readAll();	// Empty or not mappable, e.g. in /proc
+}
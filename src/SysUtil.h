@@ -15,6 +15,8 @@
 #include <QString>
 #include <QRegExp>
 
+class QFile;
+
 
 // Override these before #include
 
@@ -177,6 +179,31 @@ namespace QDirStat
          **/
         QByteArray readLink( const QByteArray & path );
 
+        /**
+         * Return 'true' if 'device' is a rotational disk, i.e. a classic
+         * hard disk where seeking is expensive. This uses the information
+         * from /sys/dev/block, so it only works for block devices on Linux;
+         * for anything else (network filesystems, Btrfs subvolumes with
+         * anonymous device numbers) this returns 'false'.
+         **/
+        bool isRotational( dev_t device );
+
+        /**
+         * Set the I/O priority of the calling thread to the "idle" class if
+         * 'idle' is 'true', i.e. it only gets disk time when no other
+         * process needs it; otherwise back to the default. This only works
+         * on Linux with an I/O scheduler that supports priorities; return
+         * 'false' if it didn't work.
+         **/
+        bool setIdleIoPriority( bool idle );
+
+        /**
+         * Return the contents of 'file' which has to be open for reading.
+         * Nonempty files are mapped into memory, so the contents are only
+         * valid as long as 'file' is open; copy them if necessary.
+         **/
+        QByteArray mappedContents( QFile & file );
+
     }	// namespace SysUtil
 }	// namespace QDirStat
 
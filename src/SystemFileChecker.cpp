@@ -9,8 +9,11 @@
 
 #include <sys/types.h>          // uid_t
 
+#include <QHash>
+
 #include "SystemFileChecker.h"
 #include "DirInfo.h"
+#include "Exception.h"
 
 
 #define MIN_NON_SYSTEM_UID      500
@@ -18,6 +21,124 @@
 using namespace QDirStat;
 
 
+namespace QDirStat
+{
+    /**
+     * Node of the trie of the known system paths: One node for each path
+     * component.
+     **/
+    struct SystemPathNode
+    {
+        SystemPathNode( SystemFileChecker::PathClass pathClass ):
+            pathClass( pathClass )
+            {}
+
+        SystemFileChecker::PathClass     pathClass;
+        QHash<QString, SystemPathNode *> children;
+    };
+}
+
+
+/**
+ * Add directory 'prefix' with class 'pathClass' to the trie below 'root'.
+ * Missing intermediate nodes get the class of their parent.
+ **/
+static void addPrefix( SystemPathNode               * root,
+                       const QString                & prefix,
+                       SystemFileChecker::PathClass   pathClass )
+{
+    SystemPathNode * node = root;
+
+    foreach ( const QString & name, prefix.split( '/', QString::SkipEmptyParts ) )
+    {
+        SystemPathNode * child = node->children.value( name, 0 );
+
+        if ( ! child )
+        {
+            child = new SystemPathNode( node->pathClass );
+            CHECK_NEW( child );
+            node->children.insert( name, child );
+        }
+
+        node = child;
+    }
+
+    node->pathClass = pathClass;
+}
+
+
+/**
+ * Return the trie of the known system paths. It is created with the first
+ * call and never deleted.
+ **/
+static const SystemPathNode * systemPathTrie()
+{
+    static SystemPathNode * root = 0;
+
+    if ( ! root )
+    {
+        root = new SystemPathNode( SystemFileChecker::OrdinaryPath );
+        CHECK_NEW( root );
+
+        const char * systemPaths[] =
+            {
+                "/boot/", "/bin/", "/dev/", "/etc/", "/lib/", "/lib32/", "/lib64/",
+                "/opt/", "/proc/", "/sbin/", "/sys/", "/usr/", 0
+            };
+
+        for ( int i = 0; systemPaths[ i ]; ++i )
+            addPrefix( root, systemPaths[ i ], SystemFileChecker::SystemPath );
+
+        addPrefix( root, "/usr/local/", SystemFileChecker::OrdinaryPath );
+
+        addPrefix( root, "/run/", SystemFileChecker::MightBeSystemPath );
+        addPrefix( root, "/srv/", SystemFileChecker::MightBeSystemPath );
+        addPrefix( root, "/var/", SystemFileChecker::MightBeSystemPath );
+
+        /**
+         * Intentionally NOT considered true system paths:
+         *
+         *   /cdrom
+         *   /home
+         *   /lost+found
+         *   /media
+         *   /mnt
+         *   /root
+         *   /run
+         *   /srv
+         *   /tmp
+         *   /var
+         *
+         * Some of those might be debatable: While it is true that no mere user
+         * should mess with anything outside his home directory, some might work on
+         * web projects below /srv, some might write or use software that does
+         * things below /run, some might be in the process of cleaning up a mess
+         * left behind by fsck below /lost+found, some may wish to clean up
+         * accumulated logs and spool files and whatnot below /var.
+         *
+         * Of course many users might legitimately use classic removable media
+         * mount points like /cdrom, /media, /mnt, and all users are free to use
+         * /tmp and /var/tmp.
+         *
+         * A few of them are only "might be" system paths, though, in
+         * particular for files owned by system users; and so is anything
+         * in a lost+found directory, on any filesystem.
+         **/
+    }
+
+    return root;
+}
+
+
+/**
+ * Return 'true' if 'name' is the name of a lost+found directory.
+ **/
+static inline bool isLostAndFound( const QString & name )
+{
+    return name == QLatin1String( "lost+found" );
+}
+
+
 bool SystemFileChecker::isSystemFile( FileInfo * file )
 {
     if ( ! file )
@@ -26,16 +147,31 @@ bool SystemFileChecker::isSystemFile( FileInfo * file )
     if ( file->isPseudoDir() && file->parent() )
         file = file->parent();
 
-    QString path = file->url();
+    // The known system paths are all directories, so a file is what its
+    // directory is.
+
+    DirInfo * dir = file->isDirInfo() ? file->toDirInfo() : file->parent();
+    PathClass pathClass;
+
+    if ( dir )
+    {
+        pathClass = dirPathClass( dir );
+    }
+    else
+    {
+        QString path = file->url();
+
+        if ( file->isDir() )
+            path += "/";
 
-    if ( file->isDir() )
-        path += "/";
+        pathClass = SystemFileChecker::pathClass( path );
+    }
 
-    if ( isSystemPath( path ) )
+    if ( pathClass == SystemPath )
         return true;
 
     if ( file->hasUid() && isSystemUid( file->uid() ) &&
-         mightBeSystemPath( path ) )
+         pathClass == MightBeSystemPath )
         return true;
 
     return false;
@@ -50,68 +186,110 @@ bool SystemFileChecker::isSystemUid( uid_t uid )
 
 bool SystemFileChecker::isSystemPath( const QString & path )
 {
-    if ( path.startsWith( "/boot/"  ) ||
-         path.startsWith( "/bin/"   ) ||
-         path.startsWith( "/dev/"   ) ||
-         path.startsWith( "/etc/"   ) ||
-         path.startsWith( "/lib/"   ) ||
-         path.startsWith( "/lib32/" ) ||
-         path.startsWith( "/lib64/" ) ||
-         path.startsWith( "/opt/"   ) ||
-         path.startsWith( "/proc/"  ) ||
-         path.startsWith( "/sbin/"  ) ||
-         path.startsWith( "/sys/"   )   )
-    {
-        return true;
-    }
+    return pathClass( path ) == SystemPath;
+}
+
+
+bool SystemFileChecker::mightBeSystemPath( const QString & path )
+{
+    return pathClass( path ) != OrdinaryPath;
+}
+
 
-    if ( path.startsWith( "/usr/" ) &&
-         ! path.startsWith( "/usr/local/" ) )
+SystemFileChecker::PathClass
+SystemFileChecker::pathClass( const QString & path, bool * final_ret )
+{
+    const SystemPathNode * node = path.startsWith( '/' ) ? systemPathTrie() : 0;
+    PathClass result  = OrdinaryPath;
+    bool lostAndFound = false;
+    int  start        = 0;
+
+    while ( true )
     {
-        return true;
+        // Only complete directory components count, i.e. with a slash
+        // after them
+
+        int end = path.indexOf( '/', start );
+
+        if ( end < 0 )
+            break;
+
+        if ( end > start )
+        {
+            QString name = path.mid( start, end - start );
+
+            if ( node )
+            {
+                node = node->children.value( name, 0 );
+
+                if ( node )
+                    result = node->pathClass;
+            }
+
+            if ( isLostAndFound( name ) )
+                lostAndFound = true;
+        }
+
+        start = end + 1;
     }
 
-    /**
-     * Intentionally NOT considered true system paths:
-     *
-     *   /cdrom
-     *   /home
-     *   /lost+found
-     *   /media
-     *   /mnt
-     *   /root
-     *   /run
-     *   /srv
-     *   /tmp
-     *   /var
-     *
-     * Some of those might be debatable: While it is true that no mere user
-     * should mess with anything outside his home directory, some might work on
-     * web projects below /srv, some might write or use software that does
-     * things below /run, some might be in the process of cleaning up a mess
-     * left behind by fsck below /lost+found, some may wish to clean up
-     * accumulated logs and spool files and whatnot below /var.
-     *
-     * Of course many users might legitimately use classic removable media
-     * mount points like /cdrom, /media, /mnt, and all users are free to use
-     * /tmp and /var/tmp.
-     **/
+    if ( lostAndFound && result == OrdinaryPath )
+        result = MightBeSystemPath;
 
-    return false;
+    if ( final_ret )
+        *final_ret = ! node || node->children.isEmpty();
+
+    return result;
 }
 
 
-bool SystemFileChecker::mightBeSystemPath( const QString & path )
+SystemFileChecker::PathClass SystemFileChecker::dirPathClass( DirInfo * dir )
 {
-    if ( path.contains  ( "/lost+found/" ) ||   // Also on other mounted filesystems!
-         path.startsWith( "/run/"        ) ||
-         path.startsWith( "/srv/"        ) ||
-         path.startsWith( "/var/"        )   )
+    CHECK_PTR( dir );
+
+    while ( dir->isPseudoDir() && dir->parent() )
+        dir = dir->parent();
+
+    PathClass result = (PathClass) dir->systemPathClass();
+
+    if ( result != UnknownPath )
+        return result;
+
+    // The invisible root of the tree has no meaningful path
+
+    DirInfo * parent = dir->parent();
+    bool      final  = false;
+
+    while ( parent && parent->isPseudoDir() )
+        parent = parent->parent();
+
+    if ( parent && ! parent->parent() )
+        parent = 0;
+
+    if ( parent )
+        dirPathClass( parent );
+
+    if ( parent && parent->systemPathClass() != UnknownPath )
     {
-        return true;
+        // Everything below the parent is the same, so only the name
+        // of this directory matters.
+
+        result = (PathClass) parent->systemPathClass();
+
+        if ( result == OrdinaryPath && isLostAndFound( dir->name() ) )
+            result = MightBeSystemPath;
+
+        final = true;
     }
     else
     {
-        return false;
+        result = pathClass( dir->url() + "/", &final );
     }
+
+    // Only cache a class that all subdirectories can simply take over
+
+    if ( final )
+        dir->setSystemPathClass( result );
+
+    return result;
 }
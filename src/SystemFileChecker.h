@@ -18,6 +18,7 @@
 namespace QDirStat
 {
     class FileInfo;
+    class DirInfo;
 
     /**
      * Check functions to find out if a file is a system file.
@@ -28,8 +29,25 @@ namespace QDirStat
     class SystemFileChecker
     {
     public:
+
+        /**
+         * What a path is known as. 0 is reserved for "not known yet" in
+         * the cache of each DirInfo.
+         **/
+        enum PathClass
+        {
+            UnknownPath = 0,
+            OrdinaryPath,
+            MightBeSystemPath,
+            SystemPath
+        };
+
         /**
          * Return 'true' if a file is clearly a system file.
+         *
+         * This does not build the path of the file: The class of the path
+         * of each directory is cached in the directory, and subdirectories
+         * and files simply take it over from there (see dirPathClass()).
          **/
         static bool isSystemFile( FileInfo * file );
 
@@ -51,6 +69,25 @@ namespace QDirStat
          **/
         static bool mightBeSystemPath( const QString & path );
 
+        /**
+         * Return the class of 'path'. Directories need a trailing slash.
+         *
+         * If 'final_ret' is not 0, return in it whether all paths below
+         * 'path' have the same class (unless there is a "lost+found"
+         * directory somewhere below).
+         **/
+        static PathClass pathClass( const QString & path, bool * final_ret = 0 );
+
+        /**
+         * Return the class of the path of directory 'dir' (or of its
+         * parent if it is a pseudo directory) and cache it in 'dir'.
+         *
+         * If the class of the parent directory is final, this is only
+         * a check of the name of 'dir'; otherwise the path is built and
+         * checked with pathClass().
+         **/
+        static PathClass dirPathClass( DirInfo * dir );
+
     }; // class SystemFileChecker
 }
 
@@ -0,0 +1,130 @@
+/*
+ *   File name: TopFilesCollector.cpp
+ *   Summary:	Statistics classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>	// std::push_heap(), std::pop_heap(), std::sort()
+
+#include "TopFilesCollector.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+TopFilesCollector::TopFilesCollector( int	    maxCount,
+				      SortKey	    sortKey,
+				      Qt::SortOrder order ):
+    _maxCount( maxCount ),
+    _sortKey( sortKey ),
+    _order( order )
+{
+    if ( _maxCount < 1 )
+	_maxCount = 1;
+}
+
+
+TopFilesCollector::~TopFilesCollector()
+{
+    // NOP
+}
+
+
+void TopFilesCollector::clear()
+{
+    _heap.clear();
+}
+
+
+void TopFilesCollector::startCollecting( FileInfo * subtree )
+{
+    Q_UNUSED( subtree );
+
+    clear();
+    _heap.reserve( _maxCount );
+}
+
+
+qint64 TopFilesCollector::value( FileInfo * item ) const
+{
+    qint64 result = 0;
+
+    switch ( _sortKey )
+    {
+	case BySize:	      result = item->size();	      break;
+	case ByAllocatedSize: result = item->allocatedSize(); break;
+	case ByMTime:	      result = item->mtime();	      break;
+    }
+
+    return _order == Qt::AscendingOrder ? -result : result;
+}
+
+
+void TopFilesCollector::collectItem( FileInfo * item )
+{
+    // Disregard directories, symlinks, block devices and other special files
+
+    if ( ! item->isFile() )
+	return;
+
+    Entry entry;
+    entry.value = value( item );
+    entry.item	= item;
+
+    add( entry );
+}
+
+
+void TopFilesCollector::add( const Entry & entry )
+{
+    if ( _heap.size() < _maxCount )
+    {
+	_heap << entry;
+	std::push_heap( _heap.begin(), _heap.end(), betterThan );
+    }
+    else if ( betterThan( entry, _heap.first() ) )
+    {
+	// Replace the worst one on top of the heap
+
+	std::pop_heap( _heap.begin(), _heap.end(), betterThan );
+	_heap.last() = entry;
+	std::push_heap( _heap.begin(), _heap.end(), betterThan );
+    }
+}
+
+
+StatsCollector * TopFilesCollector::createPartial() const
+{
+    TopFilesCollector * partial = new TopFilesCollector( _maxCount, _sortKey, _order );
+    CHECK_NEW( partial );
+
+    return partial;
+}
+
+
+void TopFilesCollector::merge( StatsCollector * partial )
+{
+    TopFilesCollector * other = static_cast<TopFilesCollector *>( partial );
+
+    foreach ( const Entry & entry, other->_heap )
+	add( entry );
+}
+
+
+FileInfoList TopFilesCollector::results() const
+{
+    QVector<Entry> sorted = _heap;
+    std::sort( sorted.begin(), sorted.end(), betterThan );
+
+    FileInfoList results;
+
+    foreach ( const Entry & entry, sorted )
+	results << entry.item;
+
+    return results;
+}
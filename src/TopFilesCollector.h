@@ -0,0 +1,140 @@
+/*
+ *   File name: TopFilesCollector.h
+ *   Summary:	Statistics classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TopFilesCollector_h
+#define TopFilesCollector_h
+
+
+#include <QVector>
+
+#include "StatsEngine.h"
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    /**
+     * StatsCollector to find the top n files of a subtree by size, allocated
+     * size or modification time, e.g. the 200 largest or the 200 oldest
+     * files.
+     *
+     * This keeps only the best n files found so far in a heap with the
+     * worst one of them on top, so it needs one single traversal of the
+     * tree and memory only for n files no matter how large the tree is.
+     * Partial collectors of a StatsEngine simply find their own top n
+     * files that are then merged.
+     *
+     * Only regular files are considered.
+     **/
+    class TopFilesCollector: public StatsCollector
+    {
+    public:
+
+	enum SortKey
+	{
+	    BySize,
+	    ByAllocatedSize,
+	    ByMTime
+	};
+
+	/**
+	 * Constructor: Find the top 'maxCount' files by 'sortKey', the ones
+	 * with the greatest values for Qt::DescendingOrder (largest or
+	 * newest files), the ones with the smallest values for
+	 * Qt::AscendingOrder (smallest or oldest files).
+	 **/
+	TopFilesCollector( int		 maxCount,
+			   SortKey	 sortKey,
+			   Qt::SortOrder order = Qt::DescendingOrder );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~TopFilesCollector();
+
+	/**
+	 * Clear all data.
+	 **/
+	void clear();
+
+	/**
+	 * Return the top files, the best one first.
+	 **/
+	FileInfoList results() const;
+
+	/**
+	 * Return the number of files found, at most maxCount().
+	 **/
+	int size() const { return _heap.size(); }
+
+	/**
+	 * Return the maximum number of files to find.
+	 **/
+	int maxCount() const { return _maxCount; }
+
+
+	//
+	// Implemented from StatsCollector
+	//
+
+	virtual void startCollecting( FileInfo * subtree ) Q_DECL_OVERRIDE;
+
+	virtual void collectItem( FileInfo * item ) Q_DECL_OVERRIDE;
+
+	virtual StatsCollector * createPartial() const Q_DECL_OVERRIDE;
+
+	virtual void merge( StatsCollector * partial ) Q_DECL_OVERRIDE;
+
+
+    protected:
+
+	/**
+	 * One file in the heap with the value it is sorted by. For
+	 * Qt::AscendingOrder, the value is negated, so greater is always
+	 * better.
+	 **/
+	struct Entry
+	{
+	    qint64     value;
+	    FileInfo * item;
+	};
+
+	/**
+	 * Heap order: The worst entry is on top of the heap.
+	 **/
+	static bool betterThan( const Entry & a, const Entry & b )
+	    { return a.value > b.value; }
+
+	/**
+	 * Return the value of 'item' to sort by.
+	 **/
+	qint64 value( FileInfo * item ) const;
+
+	/**
+	 * Add 'entry' if it is better than the worst one so far or if there
+	 * are not yet maxCount() entries.
+	 **/
+	void add( const Entry & entry );
+
+
+	//
+	// Data members
+	//
+
+	int		_maxCount;
+	SortKey		_sortKey;
+	Qt::SortOrder	_order;
+	QVector<Entry>	_heap;
+
+    };	// class TopFilesCollector
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TopFilesCollector_h
@@ -0,0 +1,173 @@
+/*
+ *   File name: Trace.cpp
+ *   Summary:	Trace spans for performance investigations
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stdio.h>		// fprintf()
+#include <time.h>		// clock_gettime()
+#include <unistd.h>		// getpid()
+
+#if defined( __linux__ )
+#  include <sys/syscall.h>	// SYS_gettid
+#endif
+
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+
+#include "Trace.h"
+
+// Max. number of spans to keep; the rest is dropped
+
+#define MAX_TRACE_SPANS		( 1024 * 1024 )
+
+using namespace QDirStat;
+
+
+namespace
+{
+    struct TraceEvent
+    {
+	const char * name;
+	qint64	     start;
+	qint64	     duration;
+	qint64	     threadId;
+    };
+
+
+    /**
+     * The collected spans. This writes them to the trace file when it is
+     * destroyed, i.e. when the program exits.
+     **/
+    class TraceLog
+    {
+    public:
+
+	TraceLog(): dropped( 0 ), written( false ) {}
+	~TraceLog() { write(); }
+
+	void write();
+
+	QMutex		    mutex;
+	QVector<TraceEvent> events;
+	qint64		    dropped;
+	bool		    written;
+    };
+
+
+    TraceLog & traceLog()
+    {
+	static TraceLog log;
+
+	return log;
+    }
+
+
+    qint64 currentThreadId()
+    {
+#if defined( __linux__ ) && defined( SYS_gettid )
+	return (qint64) syscall( SYS_gettid );
+#else
+	return (qint64) (quintptr) QThread::currentThreadId();
+#endif
+    }
+}
+
+
+bool Tracer::_enabled = ! qgetenv( TRACE_ENV_VAR ).isEmpty();
+
+
+qint64 Tracer::now()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (qint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+void Tracer::addSpan( const char * name, qint64 start )
+{
+    TraceEvent event;
+
+    event.name	   = name;
+    event.start	   = start;
+    event.duration = now() - start;
+    event.threadId = currentThreadId();
+
+    TraceLog & log = traceLog();
+    QMutexLocker locker( &log.mutex );
+
+    if ( log.events.size() < MAX_TRACE_SPANS )
+	log.events.append( event );
+    else
+	++log.dropped;
+}
+
+
+void Tracer::write()
+{
+    if ( _enabled )
+	traceLog().write();
+}
+
+
+void TraceLog::write()
+{
+    QMutexLocker locker( &mutex );
+
+    if ( written || ! Tracer::isEnabled() )
+	return;
+
+    written = true;
+
+    // This might be called when the program exits, possibly after the
+    // logger is gone, so errors only go to stderr.
+
+    QString fileName = QString::fromLocal8Bit( qgetenv( TRACE_ENV_VAR ) );
+    QFile file( fileName );
+
+    if ( ! file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+	fprintf( stderr, "Can't write trace file %s\n", qPrintable( fileName ) );
+	return;
+    }
+
+    QByteArray pid  = QByteArray::number( (qint64) getpid() );
+    QByteArray data = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    for ( int i=0; i < events.size(); ++i )
+    {
+	const TraceEvent & event = events.at( i );
+
+	data += "{\"name\":\"";
+	data += event.name;
+	data += "\",\"ph\":\"X\",\"ts\":" + QByteArray::number( event.start )
+	    + ",\"dur\":" + QByteArray::number( event.duration )
+	    + ",\"pid\":" + pid
+	    + ",\"tid\":" + QByteArray::number( event.threadId )
+	    + ( i < events.size() - 1 ? "},\n" : "}\n" );
+
+	if ( data.size() > 64 * 1024 )
+	{
+	    file.write( data );
+	    data.clear();
+	}
+    }
+
+    data += "]}\n";
+    file.write( data );
+    file.close();
+
+    fprintf( stderr, "Wrote %d trace spans to %s\n", events.size(), qPrintable( fileName ) );
+
+    if ( dropped > 0 )
+	fprintf( stderr, "Dropped %lld trace spans\n", (long long) dropped );
+
+    events.clear();
+}
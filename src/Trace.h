@@ -0,0 +1,114 @@
+/*
+ *   File name: Trace.h
+ *   Summary:	Trace spans for performance investigations
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef Trace_h
+#define Trace_h
+
+
+#include <QtGlobal>
+
+
+// Name of the environment variable with the trace file name
+
+#define TRACE_ENV_VAR	"QDIRSTAT_TRACE"
+
+
+/**
+ * Trace the time from here to the end of the current scope as a span with
+ * name 'NAME' (a string literal). Usage:
+ *
+ *     void DirInfo::recalc()
+ *     {
+ *	   TRACE_SPAN( "DirInfo::recalc" );
+ *	   ...
+ *     }
+ **/
+#define TRACE_SPAN( NAME )	QDirStat::TraceSpan traceSpan_( NAME )
+
+
+namespace QDirStat
+{
+    /**
+     * Collector for trace spans.
+     *
+     * Tracing is enabled by setting the environment variable QDIRSTAT_TRACE
+     * to the name of a file:
+     *
+     *	   QDIRSTAT_TRACE=/tmp/qdirstat-trace.json qdirstat /work
+     *
+     * When the program exits, the spans are written to that file in the
+     * Chrome trace event format (JSON); open it with chrome://tracing or
+     * https://ui.perfetto.dev. The thread IDs are those of the kernel, so
+     * they can be matched with 'perf' recordings.
+     *
+     * Without that environment variable, a span costs only one check of a
+     * static flag.
+     **/
+    class Tracer
+    {
+    public:
+
+	/**
+	 * Return 'true' if tracing is enabled.
+	 **/
+	static bool isEnabled() { return _enabled; }
+
+	/**
+	 * Return the current time in microseconds of the monotonic clock.
+	 **/
+	static qint64 now();
+
+	/**
+	 * Add a span with name 'name' that started at 'start' (from now())
+	 * and ended now. 'name' has to remain valid until the program
+	 * exits; use string literals. This can be called from any thread.
+	 **/
+	static void addSpan( const char * name, qint64 start );
+
+	/**
+	 * Write all spans to the trace file. This is done automatically
+	 * when the program exits; the file is only written once.
+	 **/
+	static void write();
+
+    private:
+
+	static bool _enabled;
+    };
+
+
+    /**
+     * A span that starts in the constructor and ends in the destructor.
+     * Use the TRACE_SPAN() macro.
+     **/
+    class TraceSpan
+    {
+    public:
+
+	TraceSpan( const char * name ):
+	    _name( name ),
+	    _start( Tracer::isEnabled() ? Tracer::now() : -1 )
+	    {}
+
+	~TraceSpan()
+	    {
+		if ( _start >= 0 )
+		    Tracer::addSpan( _name, _start );
+	    }
+
+    private:
+
+	const char * _name;
+	qint64	     _start;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef Trace_h
@@ -8,12 +8,23 @@
 
 
 #include <sys/stat.h>   // struct stat
+#include <sys/ioctl.h>  // ioctl()
 #include <unistd.h>     // getuid()
 #include <errno.h>      // ENOENT
+#include <fcntl.h>      // open(), O_EXCL
+#include <dirent.h>     // opendir(), readdir()
+#include <string.h>     // strcmp()
+#include <stdio.h>      // rename()
+
+#ifdef __linux__
+#  include <linux/fs.h>         // FICLONE
+#  include <sys/syscall.h>      // SYS_copy_file_range
+#endif
 
 #include <QDir>
 #include <QDateTime>
 #include <QFile>
+#include <QHash>
 #include <QTextStream>
 
 #include "Trash.h"
@@ -21,6 +32,26 @@
 #include "Exception.h"
 
 
+// Use copy_file_range() for copying to a trash dir on another device where
+// available: The kernel copies the data without passing it through user
+// space, and some filesystems can even do it on the server side.
+
+#if defined( __linux__ ) && defined( SYS_copy_file_range )
+#  define USE_COPY_FILE_RANGE	1
+#else
+#  define USE_COPY_FILE_RANGE	0
+#endif
+
+// Maximum number of bytes for one copy_file_range() call: Small enough to
+// check for cancellation now and then.
+
+#define TRASH_COPY_CHUNK_SIZE	( 64 * 1024 * 1024 )
+
+// Buffer size for copying with read() and write()
+
+#define TRASH_COPY_BUFFER_SIZE	( 1024 * 1024 )
+
+
 Trash * Trash::_instance = 0;
 
 
@@ -176,28 +207,156 @@ TrashDir * Trash::trashDir( const QString & path )
 
 bool Trash::trash( const QString & path )
 {
-    try
+    return trash( QStringList() << path ) == 1;
+}
+
+
+int Trash::trash( const QStringList & paths, QStringList * failedPaths )
+{
+    QList<TrashBatch> trashBatches = batches( paths, failedPaths );
+
+    // One deletion date for the whole batch
+
+    QString deletionDate = QDateTime::currentDateTime().toString( Qt::ISODate );
+    int	    successCount = 0;
+
+    foreach ( const TrashBatch & batch, trashBatches )
+    {
+	QStringList movedPaths;
+	successCount += trash( batch, deletionDate, &movedPaths );
+
+	if ( failedPaths && movedPaths.size() < batch.paths.size() )
+	{
+	    QSet<QString> moved = movedPaths.toSet();
+
+	    foreach ( const QString & path, batch.paths )
+	    {
+		if ( ! moved.contains( path ) )
+		    *failedPaths << path;
+	    }
+	}
+    }
+
+    return successCount;
+}
+
+
+QList<TrashBatch> Trash::batches( const QStringList & paths, QStringList * failedPaths )
+{
+    // Group the paths by trash dir so each trash dir is listed only once
+
+    QList<TrashBatch> result;
+    QHash<TrashDir *, int> batchIndex;
+
+    foreach ( const QString & path, paths )
     {
 	TrashDir * trashDir = instance()->trashDir( path );
 
 	if ( ! trashDir )
-	    return false;
+	{
+	    logError() << "Move to trash failed for " << path << endl;
+
+	    if ( failedPaths )
+		*failedPaths << path;
+
+	    continue;
+	}
+
+	if ( ! batchIndex.contains( trashDir ) )
+	{
+	    TrashBatch batch;
+	    batch.trashDir = trashDir;
+
+	    batchIndex.insert( trashDir, result.size() );
+	    result << batch;
+	}
 
-	QString targetName = trashDir->uniqueName( path );
-	trashDir->createTrashInfo( path, targetName );
-	trashDir->move( path, targetName );
+	result[ batchIndex.value( trashDir ) ].paths << path;
     }
-    catch ( const FileException & ex )
+
+    return result;
+}
+
+
+int Trash::trash( const TrashBatch & batch,
+		  const QString	   & deletionDate,
+		  QStringList	   * movedPaths,
+		  TrashProgress	   * progress )
+{
+    TrashDir *	  trashDir  = batch.trashDir;
+    QSet<QString> usedNames = trashDir->usedNames();
+    QStringList	  infoPaths;
+    QStringList	  targetNames;
+    int		  successCount = 0;
+
+    // Write all .trashinfo files first: The trash spec requires them to
+    // exist before the items are moved to Trash/files.
+
+    foreach ( const QString & path, batch.paths )
     {
-	CAUGHT( ex );
-	logError() << "Move to trash failed for " << path << endl;
+	try
+	{
+	    QString targetName;
 
-	return false;
+	    do
+	    {
+		// If another process took that name in the meantime,
+		// just try the next one.
+
+		targetName = trashDir->uniqueName( path, usedNames );
+	    }
+	    while ( ! trashDir->createTrashInfo( path, targetName, deletionDate ) );
+
+	    infoPaths	<< path;
+	    targetNames << targetName;
+	}
+	catch ( const FileException & ex )
+	{
+	    CAUGHT( ex );
+	    logError() << "Move to trash failed for " << path << endl;
+
+	    if ( progress )
+		progress->failed.ref();
+	}
     }
 
-    logInfo() << "Successfully moved to trash: " << path << endl;
+    for ( int i = 0; i < infoPaths.size(); ++i )
+    {
+	const QString & path	  = infoPaths.at( i );
+	QString		infoName = trashDir->infoPath() + "/" + targetNames.at( i ) + ".trashinfo";
 
-    return true;
+	if ( progress && progress->canceled.loadAcquire() )
+	{
+	    // Not moved: Its .trashinfo file must go, too
+
+	    QFile::remove( infoName );
+	    continue;
+	}
+
+	try
+	{
+	    trashDir->move( path, targetNames.at( i ), progress );
+	    successCount++;
+	    logInfo() << "Successfully moved to trash: " << path << endl;
+
+	    if ( movedPaths )
+		*movedPaths << path;
+
+	    if ( progress )
+		progress->moved.ref();
+	}
+	catch ( const FileException & ex )
+	{
+	    CAUGHT( ex );
+	    logError() << "Move to trash failed for " << path << endl;
+	    QFile::remove( infoName );
+
+	    if ( progress && ! progress->canceled.loadAcquire() )
+		progress->failed.ref();
+	}
+    }
+
+    return successCount;
 }
 
 
@@ -233,9 +392,16 @@ TrashDir::TrashDir( const QString & path, dev_t device ):
 
 
 QString TrashDir::uniqueName( const QString & path )
+{
+    QSet<QString> names = usedNames();
+
+    return uniqueName( path, names );
+}
+
+
+QString TrashDir::uniqueName( const QString & path, QSet<QString> & usedNames )
 {
     QFileInfo file( path );
-    QDir filesDir( filesPath() );
 
     QString baseName  = file.baseName();
     QString extension = file.completeSuffix();
@@ -245,7 +411,7 @@ QString TrashDir::uniqueName( const QString & path )
     if ( ! extension.isEmpty() )
 	name += "." + extension;
 
-    while ( filesDir.exists( name ) )
+    while ( usedNames.contains( name ) )
     {
 	name = QString( "%1_%2" ).arg( baseName ).arg( ++count );
 
@@ -253,15 +419,30 @@ QString TrashDir::uniqueName( const QString & path )
 	    name += "." + extension;
     }
 
-    // We don't care if a .trashinfo file with that name already exists in the
-    // Trash/info directory: Without a corresponding file or directory in the
-    // Trash/files directory, that .trashinfo file is worthless anyway and can
-    // safely be overwritten.
+    usedNames.insert( name );
 
     return name;
 }
 
 
+QSet<QString> TrashDir::usedNames() const
+{
+    QSet<QString> names;
+    QDir::Filters filters = QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot;
+
+    foreach ( const QString & name, QDir( filesPath() ).entryList( filters ) )
+	names.insert( name );
+
+    foreach ( const QString & name, QDir( infoPath() ).entryList( filters ) )
+    {
+	if ( name.endsWith( ".trashinfo" ) )
+	    names.insert( name.left( name.size() - 10 ) );
+    }
+
+    return names;
+}
+
+
 bool TrashDir::ensureDirExists( const QString & path,
 				mode_t		mode,
 				bool		doThrow )
@@ -285,29 +466,374 @@ bool TrashDir::ensureDirExists( const QString & path,
 }
 
 
-void TrashDir::createTrashInfo( const QString & path,
-				const QString & targetName )
+bool TrashDir::createTrashInfo( const QString & path,
+				const QString & targetName,
+				const QString & deletionDate )
 {
-    QFile trashInfo( infoPath() + "/" + targetName + ".trashinfo" );
+    QString infoName = infoPath() + "/" + targetName + ".trashinfo";
+
+    // O_EXCL to never overwrite the .trashinfo file of another item that a
+    // different process might just have moved to the trash
+
+    int fd = open( infoName.toUtf8(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600 );
+
+    if ( fd < 0 && errno == EEXIST )
+	return false;
+
+    QFile trashInfo;
+
+    if ( fd < 0 || ! trashInfo.open( fd, QIODevice::WriteOnly | QIODevice::Text, QFile::AutoCloseHandle ) )
+    {
+	if ( fd >= 0 )
+	    close( fd );
 
-    if ( ! trashInfo.open( QIODevice::WriteOnly | QIODevice::Text ) )
-	THROW( FileException( trashInfo.fileName(), "Can't open " + trashInfo.fileName() ) );
+	THROW( FileException( infoName, "Can't open " + infoName ) );
+    }
 
     QTextStream str( &trashInfo );
     str << "[Trash Info]" << endl;
     str << "Path=" << path << endl;
-    str << "DeletionDate=" << QDateTime::currentDateTime().toString( Qt::ISODate ) << endl;
+    str << "DeletionDate="
+	<< ( deletionDate.isEmpty() ? QDateTime::currentDateTime().toString( Qt::ISODate ) : deletionDate )
+	<< endl;
+
+    return true;
 }
 
 
 void TrashDir::move( const QString & path,
-		     const QString & targetName )
+		     const QString & targetName,
+		     TrashProgress * progress )
+{
+    QString	targetPath = filesPath() + "/" + targetName;
+    QByteArray	src	   = path.toUtf8();
+    QByteArray	dest	   = targetPath.toUtf8();
+
+    if ( ::rename( src, dest ) == 0 )
+	return;
+
+    if ( errno != EXDEV )
+    {
+	THROW( FileException( path, "Could not move " + path + " to " + targetPath
+			      + ": " + formatErrno() ) );
+    }
+
+    // The trash dir is on another device (e.g. the home trash dir as the
+    // fallback for a filesystem without a trash dir of its own): Copy
+    // everything, then remove the original.
+
+    struct stat statInfo;
+
+    if ( lstat( dest, &statInfo ) == 0 )
+	THROW( FileException( path, targetPath + " already exists" ) );
+
+    if ( lstat( src, &statInfo ) != 0 )
+	THROW( FileException( path, "Can't stat " + path + ": " + formatErrno() ) );
+
+    // Never cross into filesystems that are mounted below 'path'
+    dev_t srcDevice = statInfo.st_dev;
+
+    logInfo() << "Copying " << path << " to " << targetPath << endl;
+    QString error;
+
+    if ( ! copyTree( src, dest, srcDevice, progress, error ) )
+    {
+	if ( lstat( dest, &statInfo ) == 0 )
+	    removeTree( dest, statInfo.st_dev );
+	THROW( FileException( path, "Could not copy " + path + " to " + targetPath
+			      + ": " + error ) );
+    }
+
+    // Now the copy in the trash is the one that counts; if anything of the
+    // original is left, that is not a reason to remove it from the trash
+    // again.
+
+    if ( ! removeTree( src, srcDevice ) )
+	logWarning() << "Could not completely remove " << path << " after copying it to the trash" << endl;
+}
+
+
+bool TrashDir::copyTree( const QByteArray & src,
+			 const QByteArray & dest,
+			 dev_t		    device,
+			 TrashProgress	  * progress,
+			 QString	  & error_ret )
+{
+    if ( progress && progress->canceled.loadAcquire() )
+    {
+	error_ret = "Canceled";
+	return false;
+    }
+
+    struct stat statInfo;
+
+    if ( lstat( src, &statInfo ) != 0 )
+    {
+	error_ret = QString( "lstat() failed for %1: %2" ).arg( QString::fromUtf8( src ) ).arg( formatErrno() );
+	return false;
+    }
+
+    if ( statInfo.st_dev != device )
+    {
+	// Rather not trash anything than copy and then remove a complete
+	// mounted filesystem
+
+	error_ret = QString( "%1 is a mount point" ).arg( QString::fromUtf8( src ) );
+	return false;
+    }
+
+    mode_t mode = statInfo.st_mode;
+    bool   ok	= true;
+
+    if ( S_ISDIR( mode ) )
+    {
+	// Writable for now so the contents can be copied
+
+	if ( mkdir( dest, 0700 ) != 0 )
+	{
+	    error_ret = QString( "mkdir() failed for %1: %2" ).arg( QString::fromUtf8( dest ) ).arg( formatErrno() );
+	    return false;
+	}
+
+	DIR * dir = opendir( src );
+
+	if ( ! dir )
+	{
+	    error_ret = QString( "opendir() failed for %1: %2" ).arg( QString::fromUtf8( src ) ).arg( formatErrno() );
+	    return false;
+	}
+
+	struct dirent * entry;
+
+	while ( ok && ( entry = readdir( dir ) ) )
+	{
+	    if ( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
+		continue;
+
+	    ok = copyTree( src + "/" + entry->d_name, dest + "/" + entry->d_name, device, progress, error_ret );
+	}
+
+	closedir( dir );
+
+	if ( ok && chmod( dest, mode & 07777 ) != 0 )
+	{
+	    error_ret = QString( "chmod() failed for %1: %2" ).arg( QString::fromUtf8( dest ) ).arg( formatErrno() );
+	    ok = false;
+	}
+    }
+    else if ( S_ISLNK( mode ) )
+    {
+	QByteArray target( statInfo.st_size + 1, '\0' );
+	ssize_t len = readlink( src, target.data(), target.size() );
+
+	if ( len < 0 || symlink( target.left( len ), dest ) != 0 )
+	{
+	    error_ret = QString( "Copying symlink %1 failed: %2" ).arg( QString::fromUtf8( src ) ).arg( formatErrno() );
+	    return false;
+	}
+    }
+    else if ( S_ISREG( mode ) )
+    {
+	ok = copyFile( src, dest, mode & 07777, progress, error_ret );
+    }
+    else // FIFO, socket, device
+    {
+	if ( mknod( dest, mode, statInfo.st_rdev ) != 0 )
+	{
+	    error_ret = QString( "mknod() failed for %1: %2" ).arg( QString::fromUtf8( dest ) ).arg( formatErrno() );
+	    return false;
+	}
+    }
+
+    if ( ok )
+    {
+	struct timespec times[ 2 ];
+	times[ 0 ] = statInfo.st_atim;
+	times[ 1 ] = statInfo.st_mtim;
+
+	// Not worth failing for
+
+	utimensat( AT_FDCWD, dest, times, AT_SYMLINK_NOFOLLOW );
+    }
+
+    return ok;
+}
+
+
+bool TrashDir::copyFile( const QByteArray & src,
+			 const QByteArray & dest,
+			 mode_t		    mode,
+			 TrashProgress	  * progress,
+			 QString	  & error_ret )
+{
+    int in = open( src, O_RDONLY | O_CLOEXEC );
+
+    if ( in < 0 )
+    {
+	error_ret = QString( "Can't open %1: %2" ).arg( QString::fromUtf8( src ) ).arg( formatErrno() );
+	return false;
+    }
+
+    int out = open( dest, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600 );
+
+    if ( out < 0 )
+    {
+	error_ret = QString( "Can't create %1: %2" ).arg( QString::fromUtf8( dest ) ).arg( formatErrno() );
+	close( in );
+
+	return false;
+    }
+
+    bool done = false;
+    bool ok   = true;
+
+#ifdef FICLONE
+
+    // Different mounts of the same filesystem (bind mounts, Btrfs
+    // subvolumes) can share the data blocks
+
+    done = ioctl( out, FICLONE, in ) == 0;
+
+#endif
+
+#if USE_COPY_FILE_RANGE
+
+    // Let the kernel copy the data without copying it to user space and
+    // back; this may fail for some filesystems, then fall back to read()
+    // and write().
+
+    bool copied = false;
+
+    while ( ! done && ok )
+    {
+	if ( progress && progress->canceled.loadAcquire() )
+	{
+	    error_ret = "Canceled";
+	    ok = false;
+	    break;
+	}
+
+	long len = syscall( SYS_copy_file_range, in, (void *) 0, out, (void *) 0,
+			    (size_t) TRASH_COPY_CHUNK_SIZE, 0u );
+
+	if ( len > 0 )
+	    copied = true;
+	else if ( len == 0 )
+	    done = true;
+	else if ( ! copied && ( errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+				errno == EOPNOTSUPP ) )
+	    break;	// Use read() and write() below
+	else
+	{
+	    error_ret = QString( "Copying %1 failed: %2" ).arg( QString::fromUtf8( src ) ).arg( formatErrno() );
+	    ok = false;
+	}
+    }
+
+#endif
+
+    if ( ! done && ok )
+    {
+	QByteArray buffer( TRASH_COPY_BUFFER_SIZE, '\0' );
+
+	while ( ok )
+	{
+	    if ( progress && progress->canceled.loadAcquire() )
+	    {
+		error_ret = "Canceled";
+		ok = false;
+		break;
+	    }
+
+	    ssize_t len = read( in, buffer.data(), buffer.size() );
+
+	    if ( len == 0 )
+		break;
+
+	    const char * ptr = buffer.constData();
+
+	    while ( len > 0 )
+	    {
+		ssize_t written = write( out, ptr, len );
+
+		if ( written < 0 && errno == EINTR )
+		    continue;
+
+		if ( written <= 0 )
+		{
+		    len = -1;
+		    break;
+		}
+
+		ptr += written;
+		len -= written;
+	    }
+
+	    if ( len < 0 && errno != EINTR )
+	    {
+		error_ret = QString( "Copying %1 failed: %2" ).arg( QString::fromUtf8( src ) ).arg( formatErrno() );
+		ok = false;
+	    }
+	}
+    }
+
+    if ( ok && fchmod( out, mode ) != 0 )
+    {
+	error_ret = QString( "fchmod() failed for %1: %2" ).arg( QString::fromUtf8( dest ) ).arg( formatErrno() );
+	ok = false;
+    }
+
+    if ( close( out ) != 0 && ok )
+    {
+	error_ret = QString( "Writing %1 failed: %2" ).arg( QString::fromUtf8( dest ) ).arg( formatErrno() );
+	ok = false;
+    }
+
+    close( in );
+
+    if ( ok && progress )
+	progress->copiedFiles.ref();
+
+    return ok;
+}
+
+
+bool TrashDir::removeTree( const QByteArray & path, dev_t device )
 {
-    QFile file( path );
-    QString targetPath = filesPath() + "/" + targetName;
+    struct stat statInfo;
+
+    if ( lstat( path, &statInfo ) != 0 )
+	return errno == ENOENT;
+
+    if ( statInfo.st_dev != device )	// Leave mounted filesystems alone
+	return false;
+
+    if ( ! S_ISDIR( statInfo.st_mode ) )
+	return unlink( path ) == 0;
+
+    // Read the complete directory first; removing entries while reading it
+    // may or may not make readdir() skip some.
+
+    QList<QByteArray> names;
+    DIR * dir = opendir( path );
+
+    if ( dir )
+    {
+	struct dirent * entry;
+
+	while ( ( entry = readdir( dir ) ) )
+	{
+	    if ( strcmp( entry->d_name, "." ) != 0 && strcmp( entry->d_name, ".." ) != 0 )
+		names << QByteArray( entry->d_name );
+	}
+
+	closedir( dir );
+    }
+
+    bool ok = true;
 
-    bool success = file.rename( targetPath );
+    foreach ( const QByteArray & name, names )
+	ok = removeTree( path + "/" + name, device ) && ok;
 
-    if ( ! success )
-	THROW( FileException( path, "Could not move " + path + " to " + targetPath ) );
+    return rmdir( path ) == 0 && ok;
 }
@@ -13,12 +13,39 @@
 #include <sys/types.h>  // dev_t
 
 #include <QObject>
+#include <QAtomicInt>
+#include <QList>
 #include <QMap>
+#include <QSet>
+#include <QStringList>
 
 class TrashDir;
 typedef QMap<dev_t, TrashDir *> TrashDirMap;
 
 
+/**
+ * The paths that go to one trash directory.
+ **/
+struct TrashBatch
+{
+    TrashDir *	trashDir;
+    QStringList paths;
+};
+
+
+/**
+ * Progress of moving items to the trash. This is shared between the threads
+ * that move the items and the thread that reports the progress.
+ **/
+struct TrashProgress
+{
+    QAtomicInt moved;		// items that are in the trash now
+    QAtomicInt failed;		// items that could not be moved
+    QAtomicInt copiedFiles;	// files copied to a trash dir on another device
+    QAtomicInt canceled;	// set to stop as soon as possible
+};
+
+
 /**
  * This class implements the XDG Trash specification:
  *
@@ -43,6 +70,47 @@ public:
      **/
     static bool trash( const QString & path );
 
+    /**
+     * Throw many files or directories into the trash at once. This
+     * resolves the trash directory only once for each device, lists its
+     * contents only once to find unique names, and writes all .trashinfo
+     * files before moving the items there.
+     *
+     * Return the number of items that were moved successfully. If
+     * 'failedPaths' is non-null, the paths that could not be moved to the
+     * trash are added there.
+     **/
+    static int trash( const QStringList & paths, QStringList * failedPaths = 0 );
+
+    /**
+     * Group 'paths' by the trash directory where they have to go. This
+     * creates the trash directories if necessary, so it should be called
+     * in the GUI thread.
+     *
+     * If 'failedPaths' is non-null, the paths for which there is no trash
+     * directory are added there.
+     **/
+    static QList<TrashBatch> batches( const QStringList & paths,
+				      QStringList	* failedPaths = 0 );
+
+    /**
+     * Throw the items of 'batch' into its trash directory with
+     * 'deletionDate'. Return the number of items that were moved
+     * successfully. Those paths are added to 'movedPaths' if it is
+     * non-null.
+     *
+     * If 'progress' is non-null, it is updated for each item, and moving
+     * stops as soon as possible when it is canceled; the items that are not
+     * moved yet stay where they are.
+     *
+     * This only uses 'batch.trashDir', so batches with different trash
+     * directories can be moved in different threads at the same time.
+     **/
+    static int trash( const TrashBatch & batch,
+		      const QString    & deletionDate,
+		      QStringList      * movedPaths = 0,
+		      TrashProgress    * progress   = 0 );
+
     /**
      * Restore a file or directory from the trash to its original location.
      * Return 'true' on success, 'false' on error.
@@ -160,27 +228,51 @@ public:
 
     /**
      * Create a name that is unique within this trash directory.
-     * If no file or directory with 'name' exists yet in Trash/files or
+     * If a file or directory with 'name' already exists in Trash/files or
      * Trash/info, append a number.
      **/
     QString uniqueName( const QString & name );
 
+    /**
+     * Create a name that is unique within this trash directory. 'usedNames'
+     * are the names that are already taken (see usedNames()); the new name
+     * is added to them.
+     **/
+    QString uniqueName( const QString & name, QSet<QString> & usedNames );
+
+    /**
+     * Return the names that are already in use in this trash dir: The
+     * contents of Trash/files and the .trashinfo files in Trash/info
+     * without their extension.
+     **/
+    QSet<QString> usedNames() const;
+
     /**
      * Create a .trashinfo file for a file or directory 'path' that will be
-     * named 'targetName' (the unique name) in the trash dir.
+     * named 'targetName' (the unique name) in the trash dir. If
+     * 'deletionDate' is empty, the current time is used.
      *
-     * This might throw a FileException.
+     * Return 'false' if a .trashinfo file with that name already exists.
+     * This might throw a FileException for any other error.
      **/
-    void createTrashInfo( const QString & path, const QString & targetName );
+    bool createTrashInfo( const QString & path,
+			  const QString & targetName,
+			  const QString & deletionDate = QString() );
 
     /**
      * Move a file or directory 'path' to to targetName in the trash dir's
-     * /files subdirectory. If both are on different devices, copy the file and
-     * then delete the original.
+     * /files subdirectory. If both are on different devices, copy the file or
+     * the complete directory tree (see copyTree()) and then delete the
+     * original.
+     *
+     * If 'progress' is non-null, the copied files are counted there, and
+     * copying stops if it is canceled.
      *
      * This might throw a FileException.
      **/
-    void move( const QString & path, const QString & targetName );
+    void move( const QString & path,
+	       const QString & targetName,
+	       TrashProgress * progress = 0 );
 
 
 protected:
@@ -195,6 +287,39 @@ protected:
 				 mode_t		 mode,
 				 bool		 doThrow = false );
 
+    /**
+     * Copy file, symlink or directory tree 'src' to 'dest' which must not
+     * exist yet, keeping the permissions and the modification times. Files
+     * are cloned (reflink) if the filesystem can do that, otherwise copied
+     * with copy_file_range() in the kernel where available. Anything that
+     * is not on 'device', i.e. a mount point below 'src', is an error.
+     *
+     * Return 'true' if success, 'false' if error; then 'error_ret'
+     * describes the error.
+     **/
+    static bool copyTree( const QByteArray & src,
+			  const QByteArray & dest,
+			  dev_t		     device,
+			  TrashProgress	   * progress,
+			  QString	   & error_ret );
+
+    /**
+     * Copy the contents of file 'src' to new file 'dest' with 'mode'.
+     * Return 'true' if success, 'false' if error.
+     **/
+    static bool copyFile( const QByteArray & src,
+			  const QByteArray & dest,
+			  mode_t	     mode,
+			  TrashProgress	   * progress,
+			  QString	   & error_ret );
+
+    /**
+     * Remove file, symlink or directory tree 'path'. Anything that is not
+     * on 'device' is left alone. Return 'true' if everything could be
+     * removed.
+     **/
+    static bool removeTree( const QByteArray & path, dev_t device );
+
     //
     // Data members
     //
@@ -0,0 +1,197 @@
+/*
+ *   File name: TrashJob.cpp
+ *   Summary:	Moving items to the trash in worker threads
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QDateTime>
+#include <QRunnable>
+#include <QSet>
+#include <QThread>
+
+#include "TrashJob.h"
+#include "OutputWindow.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Maximum number of worker threads. There is one batch for each trash
+// directory, i.e. for each filesystem; usually there are only very few.
+
+#define TRASH_JOB_MAX_THREADS	4
+
+// Interval for reporting the progress of the worker threads.
+
+#define TRASH_JOB_POLL_MILLISEC 200
+
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Task for moving one batch to the trash in a worker thread.
+     **/
+    class TrashTask: public QRunnable
+    {
+    public:
+
+	TrashTask( TrashJob * job, int batchIndex ):
+	    _job( job ),
+	    _batchIndex( batchIndex )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	    { _job->trashBatch( _batchIndex ); }
+
+    protected:
+
+	TrashJob * _job;
+	int	   _batchIndex;
+    };
+}
+
+
+TrashJob::TrashJob( const QStringList & paths, QObject * parent ):
+    QObject( parent ),
+    _paths( paths ),
+    _finishedBatches( 0 ),
+    _lastReported( -1 )
+{
+    // Finding and creating the trash directories uses the Trash singleton,
+    // so this is done here in the GUI thread.
+
+    _batches = Trash::batches( paths, &_failedPaths );
+    _movedPaths.resize( _batches.size() );
+    _deletionDate = QDateTime::currentDateTime().toString( Qt::ISODate );
+
+    _progress.failed.storeRelease( _failedPaths.size() );
+
+    _threadPool.setMaxThreadCount( qBound( 1, _batches.size(), TRASH_JOB_MAX_THREADS ) );
+
+    connect( &_timer, SIGNAL( timeout() ),
+	     this,    SLOT  ( poll()	) );
+
+    logInfo() << "Moving " << total() << " items to "
+	      << _batches.size() << " trash dirs" << endl;
+}
+
+
+TrashJob::~TrashJob()
+{
+    _threadPool.waitForDone();
+}
+
+
+void TrashJob::start()
+{
+    if ( _outputWindow )
+    {
+	_outputWindow->addCommandLine( tr( "Moving %1 items to the trash" ).arg( total() ) );
+
+	foreach ( const QString & path, _failedPaths )
+	    _outputWindow->addStderr( tr( "No trash directory for %1" ).arg( path ) );
+    }
+
+    for ( int i = 0; i < _batches.size(); ++i )
+    {
+	TrashTask * task = new TrashTask( this, i );
+	CHECK_NEW( task );
+
+	_threadPool.start( task ); // The thread pool takes over ownership
+    }
+
+    _timer.start( TRASH_JOB_POLL_MILLISEC );
+    poll();
+}
+
+
+void TrashJob::cancel()
+{
+    logInfo() << "Canceling moving items to the trash" << endl;
+    _progress.canceled.storeRelease( 1 );
+}
+
+
+void TrashJob::trashBatch( int index )
+{
+    // Each task writes only its own list of moved paths; poll() reads them
+    // only after all tasks are finished.
+
+    Trash::trash( _batches.at( index ), _deletionDate, &_movedPaths[ index ], &_progress );
+    _finishedBatches.ref();
+}
+
+
+void TrashJob::poll()
+{
+    int moved  = _progress.moved.loadAcquire();
+    int copied = _progress.copiedFiles.loadAcquire();
+    int done   = moved + _progress.failed.loadAcquire() + copied;
+
+    if ( done != _lastReported )
+    {
+	_lastReported = done;
+	QString text = tr( "Moved %1 of %2 items to the trash" ).arg( moved ).arg( total() );
+
+	if ( copied > 0 )
+	    text += tr( " (%1 files copied to another filesystem)" ).arg( copied );
+
+	emit progress( text );
+    }
+
+    if ( _finishedBatches.loadAcquire() < _batches.size() )
+	return;
+
+    _timer.stop();
+    reportResults();
+
+    int errorCount = total() - moved;
+
+    if ( _outputWindow )
+	_outputWindow->noMoreProcesses();
+
+    emit finished( errorCount );
+    deleteLater();
+}
+
+
+void TrashJob::reportResults()
+{
+    QSet<QString> movedPaths;
+
+    foreach ( const QStringList & batchPaths, _movedPaths )
+	movedPaths.unite( batchPaths.toSet() );
+
+    int moved  = movedPaths.size();
+    int failed = 0;
+
+    foreach ( const QString & path, _paths )
+    {
+	if ( movedPaths.contains( path ) )
+	{
+	    if ( _outputWindow )
+		_outputWindow->addStdout( tr( "Moved to trash: %1" ).arg( path ) );
+	}
+	else if ( ! _failedPaths.contains( path ) ) // already reported
+	{
+	    ++failed;
+
+	    if ( _outputWindow )
+	    {
+		if ( wasCanceled() )
+		    _outputWindow->addStdout( tr( "Not moved to trash (canceled): %1" ).arg( path ) );
+		else
+		    _outputWindow->addStderr( tr( "Move to trash failed for %1" ).arg( path ) );
+	    }
+	}
+    }
+
+    logInfo() << "Moved " << moved << " of " << total() << " items to the trash, "
+	      << failed + _failedPaths.size() << " not moved"
+	      << ( wasCanceled() ? " (canceled)" : "" ) << endl;
+}
@@ -0,0 +1,152 @@
+/*
+ *   File name: TrashJob.h
+ *   Summary:	Moving items to the trash in worker threads
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TrashJob_h
+#define TrashJob_h
+
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QStringList>
+#include <QAtomicInt>
+#include <QThreadPool>
+#include <QPointer>
+#include <QTimer>
+
+#include "Trash.h"
+
+
+class OutputWindow;
+
+
+namespace QDirStat
+{
+    /**
+     * Class to move files and directories to the trash in worker threads,
+     * so the GUI remains responsive even if the trash directory is on
+     * another device and everything has to be copied there.
+     *
+     * The items are grouped by the trash directory where they go (see
+     * Trash::batches()), and each group is moved in a worker thread of its
+     * own, so the trash directories on different filesystems are filled in
+     * parallel.
+     *
+     * The progress is reported with the progress() signal, the results go to
+     * the output window. It can be canceled at any time; items that are not
+     * completely moved to the trash yet stay where they are.
+     *
+     * Like Deleter, an instance of this class deletes itself when it is done.
+     **/
+    class TrashJob: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This finds the trash directories for all of 'paths'.
+	 **/
+	TrashJob( const QStringList & paths, QObject * parent = 0 );
+
+	/**
+	 * Destructor. This waits for all worker threads.
+	 **/
+	virtual ~TrashJob();
+
+	/**
+	 * Set an output window to report the results to. When all is done,
+	 * this calls OutputWindow::noMoreProcesses() so it emits
+	 * lastProcessFinished() just like for a cleanup with external
+	 * processes.
+	 **/
+	void setOutputWindow( OutputWindow * outputWindow )
+	    { _outputWindow = outputWindow; }
+
+	/**
+	 * Start moving the items to the trash in the worker threads.
+	 **/
+	void start();
+
+	/**
+	 * Stop as soon as possible. The item that is currently being copied
+	 * to another device and all items that are not moved yet stay where
+	 * they are.
+	 **/
+	void cancel();
+
+	/**
+	 * Return 'true' if cancel() was called.
+	 **/
+	bool wasCanceled() const { return _progress.canceled.loadAcquire() != 0; }
+
+	/**
+	 * Return the total number of items to move to the trash.
+	 **/
+	int total() const { return _paths.size(); }
+
+	/**
+	 * Move batch no. 'index' to the trash. This is called in a worker
+	 * thread.
+	 **/
+	void trashBatch( int index );
+
+
+    signals:
+
+	/**
+	 * Emitted periodically while moving the items to the trash.
+	 **/
+	void progress( const QString & text );
+
+	/**
+	 * Emitted when everything is done.
+	 **/
+	void finished( int errorCount );
+
+
+    protected slots:
+
+	/**
+	 * Report the progress and check for the end of the work in the GUI
+	 * thread.
+	 **/
+	void poll();
+
+
+    protected:
+
+	/**
+	 * Report the results to the output window.
+	 **/
+	void reportResults();
+
+
+	//
+	// Data members
+	//
+
+	QStringList		_paths;
+	QStringList		_failedPaths;	// no trash dir for them
+	QList<TrashBatch>	_batches;
+	QVector<QStringList>	_movedPaths;	// one for each batch
+	QString			_deletionDate;
+	QThreadPool		_threadPool;
+	QTimer			_timer;
+	QPointer<OutputWindow>	_outputWindow;
+	TrashProgress		_progress;
+	QAtomicInt		_finishedBatches;
+	int			_lastReported;
+
+    };	// class TrashJob
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TrashJob_h
@@ -0,0 +1,193 @@
+/*
+ *   File name: TreeColumns.cpp
+ *   Summary:	Column-wise copy of a directory tree for fast linear scans
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "TreeColumns.h"
+#include "DirInfo.h"
+#include "DirTree.h"
+#include "DotEntry.h"
+#include "MimeCategorizer.h"
+#include "SpillStore.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+TreeColumns::TreeColumns()
+{
+    _categories << 0;	// Id 0: No category
+}
+
+
+TreeColumnsPtr TreeColumns::take( DirInfo * dir )
+{
+    CHECK_PTR( dir );
+
+    // If nothing changed in the subtree of an ancestor, nothing changed
+    // here either, so its columns are just as good.
+
+    for ( DirInfo * ancestor = dir; ancestor; ancestor = ancestor->parent() )
+    {
+	TreeColumnsPtr cached = ancestor->cachedColumns();
+
+	if ( cached && cached->_dirIndex.contains( dir ) )
+	    return cached;
+    }
+
+    TreeColumns * columns = new TreeColumns();
+    CHECK_NEW( columns );
+
+    int reserve = (int) qMin( dir->totalItems() + 1, (FileCount) INT_MAX );
+
+    columns->_sizes.reserve	    ( reserve );
+    columns->_allocatedSizes.reserve( reserve );
+    columns->_mtimes.reserve	    ( reserve );
+    columns->_uids.reserve	    ( reserve );
+    columns->_categoryIds.reserve   ( reserve );
+    columns->_flags.reserve	    ( reserve );
+    columns->_parents.reserve	    ( reserve );
+    columns->_subtreeEnds.reserve   ( reserve );
+    columns->_items.reserve	    ( reserve );
+
+    columns->addSubtree( dir, -1 );
+    columns->_categoryIdx.clear();
+
+    // The years and months in one go from the times: No calls per item,
+    // so this can be vectorized.
+
+    int count = columns->_mtimes.size();
+    columns->_mtimeYears.resize ( count );
+    columns->_mtimeMonths.resize( count );
+
+    FileInfo::civilDates( columns->_mtimes.constData(),
+			  count,
+			  columns->_mtimeYears.data(),
+			  columns->_mtimeMonths.data() );
+
+    TreeColumnsPtr result( columns );
+
+    // A directory that is still being read changes all the time, so there
+    // is no point in keeping its columns.
+
+    if ( ! dir->isBusy() )
+	dir->setCachedColumns( result );
+
+    return result;
+}
+
+
+bool TreeColumns::range( const FileInfo * dir, int & first_ret, int & end_ret ) const
+{
+    QHash<const FileInfo *, int>::const_iterator it = _dirIndex.find( dir );
+
+    if ( it == _dirIndex.end() )
+	return false;
+
+    first_ret = it.value();
+    end_ret   = _subtreeEnds.at( first_ret );
+
+    return true;
+}
+
+
+void TreeColumns::addSubtree( DirInfo * dir, int parent )
+{
+    int index = addItem( dir, parent );
+    _dirIndex.insert( dir, index );
+
+    addFiles( dir, index );
+
+    if ( dir->dotEntry() )
+	addFiles( dir->dotEntry(), index );
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() && ! child->isPseudoDir() )
+	    addSubtree( child->toDirInfo(), index );
+    }
+
+    _subtreeEnds[ index ] = _sizes.size();
+}
+
+
+void TreeColumns::addFiles( DirInfo * dir, int parent )
+{
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( ! child->isDirInfo() )
+	    addItem( child, parent );
+    }
+
+    if ( dir->hasSpilledFiles() )
+    {
+	// Files of an out-of-core tree: Use temporary objects from the spill
+	// store without paging them in
+
+	FileInfoList spilled;
+	dir->tree()->spillStore()->load( dir, spilled );
+
+	foreach ( FileInfo * file, spilled )
+	{
+	    int index = addItem( file, parent );
+	    _items[ index ] = 0;	// Gone in a moment
+	}
+
+	qDeleteAll( spilled );
+    }
+}
+
+
+int TreeColumns::addItem( FileInfo * item, int parent )
+{
+    quint8 flags = 0;
+
+    if ( item->isFile() )
+	flags |= ItemIsFile;
+
+    if ( item->isDirInfo() )
+	flags |= ItemIsDir;
+
+    if ( item->isSymLink() )
+	flags |= ItemIsSymLink;
+
+    quint16 categoryId = 0;
+
+    if ( item->isFile() )
+    {
+	MimeCategory * category = MimeCategorizer::instance()->category( item );
+
+	if ( category )
+	{
+	    QHash<MimeCategory *, quint16>::const_iterator it = _categoryIdx.find( category );
+
+	    if ( it != _categoryIdx.end() )
+		categoryId = it.value();
+	    else
+	    {
+		categoryId = _categories.size();
+		_categories << category;
+		_categoryIdx.insert( category, categoryId );
+	    }
+	}
+    }
+
+    int index = _sizes.size();
+
+    _sizes	    << item->size();
+    _allocatedSizes << item->allocatedSize();
+    _mtimes	    << item->mtime();
+    _uids	    << (uint) item->uid();
+    _categoryIds    << categoryId;
+    _flags	    << flags;
+    _parents	    << parent;
+    _subtreeEnds    << index + 1;
+    _items	    << item;
+
+    return index;
+}
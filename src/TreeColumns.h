@@ -0,0 +1,205 @@
+/*
+ *   File name: TreeColumns.h
+ *   Summary:	Column-wise copy of a directory tree for fast linear scans
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreeColumns_h
+#define TreeColumns_h
+
+
+#include <time.h>	// time_t
+
+#include <QSharedPointer>
+#include <QVector>
+#include <QHash>
+
+#include "FileSize.h"
+
+
+namespace QDirStat
+{
+    class FileInfo;
+    class DirInfo;
+    class MimeCategory;
+    class TreeColumns;
+
+    /**
+     * Reference to a column-wise copy of a subtree. This can be copied and
+     * released in any thread; the copy is deleted when the last reference
+     * is gone.
+     **/
+    typedef QSharedPointer<const TreeColumns> TreeColumnsPtr;
+
+
+    /**
+     * Column-wise ("structure of arrays") copy of the fields of all items
+     * of a subtree that statistics need: One array for each field, each
+     * with one entry for each item.
+     *
+     * The items are in depth-first order: Each directory is followed by
+     * its files, then by the subtrees of its subdirectories, so each
+     * subtree is one contiguous range of indices (see range()). Statistics
+     * over a subtree then are a linear scan over a few arrays instead of
+     * following pointers and calling virtual methods for objects all over
+     * the heap, which is much friendlier to the CPU cache and easy to split
+     * up for several threads.
+     *
+     * Just like TreeSnapshotDir, this is immutable, so it can be used in
+     * other threads without any locking. It is kept in the directory until
+     * anything changes in its subtree (see DirInfo::dropStatsCache()), so
+     * taking it again is free as long as the tree does not change.
+     *
+     * The pseudo directories are resolved: The files of the dot entry are
+     * files of their directory. Ignored items in the attic are not
+     * included.
+     **/
+    class TreeColumns
+    {
+    public:
+
+	/**
+	 * Flags for each item
+	 **/
+	enum ItemFlags
+	{
+	    ItemIsFile	  = 0x01,	// regular file
+	    ItemIsDir	  = 0x02,
+	    ItemIsSymLink = 0x04
+	};
+
+	/**
+	 * Return the columns of the subtree of 'dir'. This reuses the
+	 * columns of 'dir' or those of an ancestor if nothing changed since
+	 * they were taken. This can only be called in the GUI thread.
+	 **/
+	static TreeColumnsPtr take( DirInfo * dir );
+
+	/**
+	 * Return the number of items.
+	 **/
+	int count() const { return _sizes.size(); }
+
+	/**
+	 * Return the range of indices of the subtree of 'dir' (including
+	 * 'dir' itself) in 'first_ret' and 'end_ret' (one after the last
+	 * one). Return 'false' if 'dir' is not in these columns.
+	 **/
+	bool range( const FileInfo * dir, int & first_ret, int & end_ret ) const;
+
+	//
+	// The columns. Each one has count() entries.
+	//
+
+	/**
+	 * The sizes (FileInfo::size(), i.e. divided by the hard links).
+	 **/
+	const QVector<FileSize> & sizes() const { return _sizes; }
+
+	/**
+	 * The allocated sizes (FileInfo::allocatedSize()).
+	 **/
+	const QVector<FileSize> & allocatedSizes() const { return _allocatedSizes; }
+
+	/**
+	 * The modification times.
+	 **/
+	const QVector<time_t> & mtimes() const { return _mtimes; }
+
+	/**
+	 * The years and months (1-12) of the modification times in UTC,
+	 * calculated in bulk from mtimes() (see FileInfo::civilDates()).
+	 **/
+	const QVector<short> &	mtimeYears()  const { return _mtimeYears;  }
+	const QVector<qint8> &	mtimeMonths() const { return _mtimeMonths; }
+
+	/**
+	 * The user IDs.
+	 **/
+	const QVector<uint> & uids() const { return _uids; }
+
+	/**
+	 * The MIME categories of the files as indices into categories();
+	 * 0 for directories and files without a category.
+	 **/
+	const QVector<quint16> & categoryIds() const { return _categoryIds; }
+
+	/**
+	 * The ItemFlags.
+	 **/
+	const QVector<quint8> & flags() const { return _flags; }
+
+	/**
+	 * The index of the directory each item belongs to; -1 for the
+	 * toplevel directory.
+	 **/
+	const QVector<int> & parents() const { return _parents; }
+
+	/**
+	 * For directories, the index after the last item of their subtree;
+	 * for all other items, their own index + 1.
+	 **/
+	const QVector<int> & subtreeEnds() const { return _subtreeEnds; }
+
+	/**
+	 * The items themselves, to find the results in the tree again. Only
+	 * use them in the GUI thread, and only if the tree did not change.
+	 * 0 for files that are paged out to the spill store.
+	 **/
+	const QVector<const FileInfo *> & items() const { return _items; }
+
+	/**
+	 * The MIME categories by their index in categoryIds(). Index 0 is a
+	 * null pointer.
+	 **/
+	const QVector<MimeCategory *> & categories() const { return _categories; }
+
+
+    protected:
+
+	/**
+	 * Constructor. Use take() instead.
+	 **/
+	TreeColumns();
+
+	/**
+	 * Append the subtree of 'dir' in depth-first order.
+	 **/
+	void addSubtree( DirInfo * dir, int parent );
+
+	/**
+	 * Append the files of 'dir' (a directory or a dot entry) including
+	 * those that are paged out to the spill store.
+	 **/
+	void addFiles( DirInfo * dir, int parent );
+
+	/**
+	 * Append one item and return its index.
+	 **/
+	int addItem( FileInfo * item, int parent );
+
+
+	QVector<FileSize>	   _sizes;
+	QVector<FileSize>	   _allocatedSizes;
+	QVector<time_t>		   _mtimes;
+	QVector<short>		   _mtimeYears;
+	QVector<qint8>		   _mtimeMonths;
+	QVector<uint>		   _uids;
+	QVector<quint16>	   _categoryIds;
+	QVector<quint8>		   _flags;
+	QVector<int>		   _parents;
+	QVector<int>		   _subtreeEnds;
+	QVector<const FileInfo *>  _items;
+	QVector<MimeCategory *>	   _categories;
+	QHash<MimeCategory *, quint16> _categoryIdx;	// only while taking
+	QHash<const FileInfo *, int>   _dirIndex;
+
+    };	// class TreeColumns
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreeColumns_h
@@ -0,0 +1,473 @@
+/*
+ *   File name: TreeDiff.cpp
+ *   Summary:	Differences between a directory tree and an older scan
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>
+
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QPair>
+
+#include "TreeDiff.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "DirTreeCache.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Interval for processing events while waiting for the worker threads.
+
+#define TREE_DIFF_PROCESS_EVENTS_MILLISEC	100
+
+
+using namespace QDirStat;
+
+
+TreeDiff * TreeDiff::_activeDiff = 0;
+
+
+namespace QDirStat
+{
+    /**
+     * Task for comparing directories in a worker thread.
+     **/
+    class TreeDiffTask: public QRunnable
+    {
+    public:
+
+	TreeDiffTask( TreeDiff * diff ):
+	    _diff( diff )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	    { _diff->work( _result ); }
+
+	TreeDiff::WorkerResult & result() { return _result; }
+
+    protected:
+
+	TreeDiff *		_diff;
+	TreeDiff::WorkerResult	_result;
+    };
+
+
+    /**
+     * Compare function for sorting children by name.
+     **/
+    static bool nameLessThan( FileInfo * a, FileInfo * b )
+    {
+	return a->name() < b->name();
+    }
+}
+
+
+TreeDiff::TreeDiff( DirTree * tree, QObject * parent ):
+    QObject( parent ),
+    _tree( tree ),
+    _active( false ),
+    _busyWorkers( 0 )
+{
+    CHECK_PTR( _tree );
+
+    connect( _tree, SIGNAL( clearing()		 ),
+	     this,  SLOT  ( clear()		 ) );
+
+    connect( _tree, SIGNAL( startingReading()	 ),
+	     this,  SLOT  ( clear()		 ) );
+
+    connect( _tree, SIGNAL( clearingSubtree( DirInfo * ) ),
+	     this,  SLOT  ( clear()		 ) );
+
+    connect( _tree, SIGNAL( deletingChild  ( FileInfo * ) ),
+	     this,  SLOT  ( deletingChild  ( FileInfo * ) ) );
+}
+
+
+TreeDiff::~TreeDiff()
+{
+    if ( _activeDiff == this )
+	_activeDiff = 0;
+}
+
+
+void TreeDiff::clear()
+{
+    if ( ! _active )
+	return;
+
+    _map.clear();
+    _active = false;
+
+    if ( _activeDiff == this )
+	_activeDiff = 0;
+
+    emit changed();
+}
+
+
+const TreeDiffItem * TreeDiff::diff( const FileInfo * item ) const
+{
+    if ( ! _active )
+	return 0;
+
+    TreeDiffMap::const_iterator it = _map.find( item );
+
+    return it == _map.end() ? 0 : &it.value();
+}
+
+
+FileSize TreeDiff::sizeDelta( const FileInfo * item ) const
+{
+    const TreeDiffItem * itemDiff = diff( item );
+
+    return itemDiff ? itemDiff->sizeDelta : 0;
+}
+
+
+bool TreeDiff::compare( const QString & cacheFileName )
+{
+    clear();
+
+    FileInfo * currentTop = _tree->firstToplevel();
+
+    if ( ! currentTop || ! currentTop->isDirInfo() || _tree->isBusy() )
+	return false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Read the baseline into a tree of its own
+
+    DirTree * baseline = new DirTree();
+    CHECK_NEW( baseline );
+
+    {
+	CacheReader reader( cacheFileName, baseline );
+
+	if ( reader.ok() )
+	    reader.read();
+
+	if ( ! reader.ok() )
+	{
+	    logError() << "Can't read baseline " << cacheFileName << endl;
+	    delete baseline;
+	    return false;
+	}
+    }
+
+    logInfo() << "Read baseline " << cacheFileName << " in "
+	      << timer.restart() / 1000.0 << " sec" << endl;
+
+    // Find the same directory in both trees: One of them may be a subtree
+    // of the other
+
+    FileInfo * baselineTop = baseline->firstToplevel();
+
+    if ( baselineTop && baselineTop->url() != currentTop->url() )
+    {
+	FileInfo * item = baseline->locate( currentTop->url() );
+
+	if ( item )
+	    baselineTop = item;
+	else
+	    currentTop = _tree->locate( baselineTop->url() );
+    }
+
+    if ( ! baselineTop || ! baselineTop->isDirInfo() ||
+	 ! currentTop	|| ! currentTop->isDirInfo() )
+    {
+	logError() << "No common directory in " << cacheFileName << endl;
+	delete baseline;
+	return false;
+    }
+
+    // The sums are calculated on demand; make sure the worker threads
+    // don't do that at the same time.
+
+    currentTop->totalSize();
+    baselineTop->totalSize();
+
+    DirPair top;
+    top.current	 = currentTop->toDirInfo();
+    top.baseline = baselineTop->toDirInfo();
+
+    _queue.clear();
+    _queue << top;
+    _busyWorkers = 0;
+
+    QList<TreeDiffTask *> tasks;
+
+    for ( int i=0; i < QThread::idealThreadCount(); ++i )
+    {
+	TreeDiffTask * task = new TreeDiffTask( this );
+	CHECK_NEW( task );
+	task->setAutoDelete( false );
+	tasks << task;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount( tasks.size() );
+
+    foreach ( TreeDiffTask * task, tasks )
+	pool.start( task );
+
+    // Keep the GUI responsive while waiting; user input is not processed,
+    // so the tree cannot change.
+
+    while ( ! pool.waitForDone( TREE_DIFF_PROCESS_EVENTS_MILLISEC ) )
+    {
+	QEventLoop eventLoop;
+	eventLoop.processEvents( QEventLoop::ExcludeUserInputEvents,
+				 TREE_DIFF_PROCESS_EVENTS_MILLISEC / 2 );
+    }
+
+    QVector<FileInfo *> countDirs;
+
+    foreach ( TreeDiffTask * task, tasks )
+    {
+	_map.unite( task->result().map );
+	countDirs += task->result().countDirs;
+    }
+
+    qDeleteAll( tasks );
+    delete baseline;
+
+    propagateCounts( countDirs, currentTop );
+
+    logInfo() << "Compared with " << cacheFileName << " in "
+	      << timer.elapsed() / 1000.0 << " sec: "
+	      << _map.size() << " changed items" << endl;
+
+    _baselineFileName = cacheFileName;
+    _active	      = true;
+    _activeDiff	      = this;
+
+    emit changed();
+
+    return true;
+}
+
+
+void TreeDiff::work( WorkerResult & result )
+{
+    // This is called in the worker threads!
+
+    QVector<DirPair> subDirs;
+
+    while ( true )
+    {
+	DirPair pair;
+
+	{
+	    QMutexLocker locker( &_queueMutex );
+
+	    while ( _queue.isEmpty() && _busyWorkers > 0 )
+		_queueChanged.wait( &_queueMutex );
+
+	    if ( _queue.isEmpty() )	// And nobody can add any more
+	    {
+		_queueChanged.wakeAll();
+		return;
+	    }
+
+	    pair = _queue.takeLast();
+	    ++_busyWorkers;
+	}
+
+	compareDir( pair, result, subDirs );
+
+	QMutexLocker locker( &_queueMutex );
+	_queue += subDirs;
+	--_busyWorkers;
+	_queueChanged.wakeAll();
+	subDirs.clear();
+    }
+}
+
+
+void TreeDiff::compareDir( const DirPair    & pair,
+			   WorkerResult	    & result,
+			   QVector<DirPair> & subDirs )
+{
+    QVector<FileInfo *> current;
+    QVector<FileInfo *> baseline;
+
+    sortedChildren( pair.current,  current  );
+    sortedChildren( pair.baseline, baseline );
+
+    TreeDiffItem dirDiff;	// Only this level; see propagateCounts()
+    TreeDiffItem filesDiff;	// For the dot entry
+    dirDiff.sizeDelta = pair.current->totalSize() - pair.baseline->totalSize();
+
+    int i = 0;
+    int j = 0;
+
+    while ( i < current.size() || j < baseline.size() )
+    {
+	FileInfo * cur	= i < current.size()  ? current.at( i )	 : 0;
+	FileInfo * base = j < baseline.size() ? baseline.at( j ) : 0;
+
+	int cmp = ! cur ? 1 : ! base ? -1 : cur->name().compare( base->name() );
+
+	if ( cmp == 0 && cur->isDirInfo() != base->isDirInfo() )
+	{
+	    // Same name, but a file became a directory or vice versa:
+	    // Handle this as one item added and one removed
+
+	    cmp = -1;
+	}
+
+	if ( cmp < 0 )		// Only in the current tree: Added
+	{
+	    markNew( cur, result.map );
+
+	    if ( cur->isDirInfo() )
+		dirDiff.addedFiles += cur->totalFiles();
+	    else
+	    {
+		dirDiff.addedFiles++;
+		filesDiff.addedFiles++;
+		filesDiff.sizeDelta += cur->totalSize();
+	    }
+
+	    ++i;
+	}
+	else if ( cmp > 0 )	// Only in the baseline: Removed
+	{
+	    if ( base->isDirInfo() )
+		dirDiff.removedFiles += base->totalFiles();
+	    else
+	    {
+		dirDiff.removedFiles++;
+		filesDiff.removedFiles++;
+		filesDiff.sizeDelta -= base->totalSize();
+	    }
+
+	    ++j;
+	}
+	else			// In both
+	{
+	    if ( cur->isDirInfo() )
+	    {
+		DirPair subDir;
+		subDir.current	= cur->toDirInfo();
+		subDir.baseline = base->toDirInfo();
+		subDirs << subDir;
+	    }
+	    else if ( cur->totalSize() != base->totalSize() )
+	    {
+		TreeDiffItem fileDiff;
+		fileDiff.sizeDelta = cur->totalSize() - base->totalSize();
+		result.map.insert( cur, fileDiff );
+		filesDiff.sizeDelta += fileDiff.sizeDelta;
+	    }
+
+	    ++i;
+	    ++j;
+	}
+    }
+
+    if ( pair.current->dotEntry() &&
+	 ( filesDiff.sizeDelta != 0 || filesDiff.addedFiles || filesDiff.removedFiles ) )
+    {
+	result.map.insert( pair.current->dotEntry(), filesDiff );
+    }
+
+    if ( dirDiff.addedFiles || dirDiff.removedFiles )
+	result.countDirs << pair.current;
+
+    if ( dirDiff.sizeDelta != 0 || dirDiff.addedFiles || dirDiff.removedFiles )
+	result.map.insert( pair.current, dirDiff );
+}
+
+
+void TreeDiff::markNew( FileInfo * item, TreeDiffMap & map )
+{
+    TreeDiffItem itemDiff;
+    itemDiff.sizeDelta	= item->totalSize();
+    itemDiff.addedFiles = item->isDirInfo() ? item->totalFiles() : 1;
+    itemDiff.isNew	= true;
+    map.insert( item, itemDiff );
+
+    if ( item->dotEntry() )
+	markNew( item->dotEntry(), map );
+
+    for ( FileInfo * child = item->firstChild(); child; child = child->next() )
+	markNew( child, map );
+}
+
+
+void TreeDiff::sortedChildren( DirInfo * dir, QVector<FileInfo *> & children )
+{
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( ! child->isDotEntry() )
+	    children << child;
+    }
+
+    if ( dir->dotEntry() )
+    {
+	for ( FileInfo * child = dir->dotEntry()->firstChild(); child; child = child->next() )
+	    children << child;
+    }
+
+    std::sort( children.begin(), children.end(), nameLessThan );
+}
+
+
+void TreeDiff::propagateCounts( const QVector<FileInfo *> & countDirs, FileInfo * top )
+{
+    // Take the counts of this level only first, before any of them are
+    // changed.
+
+    QVector<QPair<FileCount, FileCount> > counts;
+    counts.reserve( countDirs.size() );
+
+    foreach ( FileInfo * dir, countDirs )
+    {
+	const TreeDiffItem & dirDiff = _map[ dir ];
+	counts << qMakePair( dirDiff.addedFiles, dirDiff.removedFiles );
+    }
+
+    for ( int i=0; i < countDirs.size(); ++i )
+    {
+	FileInfo * dir = countDirs.at( i );
+
+	while ( dir != top && dir->parent() )
+	{
+	    dir = dir->parent();
+
+	    TreeDiffItem & dirDiff = _map[ dir ];
+	    dirDiff.addedFiles	 += counts.at( i ).first;
+	    dirDiff.removedFiles += counts.at( i ).second;
+	}
+    }
+}
+
+
+void TreeDiff::deletingChild( FileInfo * child )
+{
+    if ( _active )
+	removeSubtree( child );
+}
+
+
+void TreeDiff::removeSubtree( FileInfo * item )
+{
+    _map.remove( item );
+
+    if ( item->dotEntry() )
+	removeSubtree( item->dotEntry() );
+
+    for ( FileInfo * child = item->firstChild(); child; child = child->next() )
+	removeSubtree( child );
+}
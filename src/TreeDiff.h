@@ -0,0 +1,230 @@
+/*
+ *   File name: TreeDiff.h
+ *   Summary:	Differences between a directory tree and an older scan
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreeDiff_h
+#define TreeDiff_h
+
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "FileSize.h"
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class FileInfo;
+
+
+    /**
+     * Differences of one item of the current tree against the baseline.
+     **/
+    struct TreeDiffItem
+    {
+	TreeDiffItem():
+	    sizeDelta( 0 ),
+	    addedFiles( 0 ),
+	    removedFiles( 0 ),
+	    isNew( false )
+	    {}
+
+	FileSize  sizeDelta;	// Change of the total size
+	FileCount addedFiles;	// Files added in this subtree
+	FileCount removedFiles;	// Files removed from this subtree
+	bool	  isNew;	// Not in the baseline at all
+    };
+
+
+    typedef QHash<const FileInfo *, TreeDiffItem> TreeDiffMap;
+
+
+    /**
+     * Structural diff between a directory tree and a baseline, i.e. an
+     * older scan of the same directory from a cache file: What grew, what
+     * shrank, what was added or removed.
+     *
+     * The baseline is read into a second DirTree, and both trees are
+     * walked together: The children of each pair of matching directories
+     * are sorted by name and merged like two sorted lists. Each directory
+     * pair is one unit of work for a number of worker threads, so the walk
+     * is parallel and linear in the number of items (except for sorting
+     * each directory's children). The baseline tree is deleted afterwards;
+     * only the differences are kept.
+     *
+     * Items of the current tree that did not change are not stored at all.
+     **/
+    class TreeDiff: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor for differences of 'tree'.
+	 **/
+	TreeDiff( DirTree * tree, QObject * parent = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~TreeDiff();
+
+	/**
+	 * Read cache file 'cacheFileName' as the baseline and compare the
+	 * tree against it. Return 'false' upon error.
+	 **/
+	bool compare( const QString & cacheFileName );
+
+	/**
+	 * Return 'true' if there is a result of compare().
+	 **/
+	bool isActive() const { return _active; }
+
+	/**
+	 * Return the baseline cache file name of the last compare().
+	 **/
+	const QString & baselineFileName() const { return _baselineFileName; }
+
+	/**
+	 * Return the differences of 'item' or 0 if it did not change.
+	 **/
+	const TreeDiffItem * diff( const FileInfo * item ) const;
+
+	/**
+	 * Return the change of the total size of 'item' against the
+	 * baseline.
+	 **/
+	FileSize sizeDelta( const FileInfo * item ) const;
+
+	/**
+	 * Return the TreeDiff that is currently active (that has a result)
+	 * or 0 if there is none. This is used for sorting by the size delta
+	 * column.
+	 **/
+	static TreeDiff * activeDiff() { return _activeDiff; }
+
+
+    public slots:
+
+	/**
+	 * Forget all differences.
+	 **/
+	void clear();
+
+
+    signals:
+
+	/**
+	 * Emitted when the differences changed: After compare() or clear().
+	 **/
+	void changed();
+
+
+    protected slots:
+
+	/**
+	 * Forget the differences of an item that is about to be deleted and
+	 * its subtree.
+	 **/
+	void deletingChild( FileInfo * child );
+
+
+    protected:
+
+	/**
+	 * A pair of matching directories in the current tree and in the
+	 * baseline.
+	 **/
+	struct DirPair
+	{
+	    DirInfo * current;
+	    DirInfo * baseline;
+	};
+
+	/**
+	 * Results of one worker thread.
+	 **/
+	struct WorkerResult
+	{
+	    TreeDiffMap		map;
+	    QVector<FileInfo *> countDirs;	// Dirs with added / removed files
+	};
+
+	/**
+	 * Take directory pairs from the work queue and compare them until
+	 * the queue is empty and no other worker can add any more.
+	 *
+	 * This is called in the worker threads.
+	 **/
+	void work( WorkerResult & result );
+
+	/**
+	 * Compare the direct children of 'pair' and store the differences in
+	 * 'result'. Add the matching subdirectories to 'subDirs'.
+	 *
+	 * This is called in the worker threads.
+	 **/
+	void compareDir( const DirPair	   & pair,
+			 WorkerResult	   & result,
+			 QVector<DirPair>  & subDirs );
+
+	/**
+	 * Mark 'item' and all its descendants as new.
+	 **/
+	static void markNew( FileInfo * item, TreeDiffMap & map );
+
+	/**
+	 * Collect the children of 'dir' including those of its dot entry
+	 * (but not the dot entry itself) sorted by name.
+	 **/
+	static void sortedChildren( DirInfo * dir, QVector<FileInfo *> & children );
+
+	/**
+	 * Add the added / removed file counts of the directories in
+	 * 'countDirs' to all their ancestors up to 'top'.
+	 **/
+	void propagateCounts( const QVector<FileInfo *> & countDirs, FileInfo * top );
+
+	/**
+	 * Remove 'item' and its descendants from the differences.
+	 **/
+	void removeSubtree( FileInfo * item );
+
+
+	friend class TreeDiffTask;
+
+
+	//
+	// Data members
+	//
+
+	DirTree *	 _tree;
+	TreeDiffMap	 _map;
+	QString		 _baselineFileName;
+	bool		 _active;
+
+	// Work queue of the worker threads
+
+	QMutex		 _queueMutex;
+	QWaitCondition	 _queueChanged;
+	QVector<DirPair> _queue;
+	int		 _busyWorkers;
+
+	static TreeDiff * _activeDiff;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreeDiff_h
@@ -0,0 +1,658 @@
+/*
+ *   File name: TreeExporter.cpp
+ *   Summary:	Export of a directory tree to CSV or NDJSON
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <pwd.h>	// getpwuid()
+#include <grp.h>	// getgrgid()
+#include <stdio.h>	// stdout
+#include <sys/stat.h>	// ALLPERMS
+#include <iostream>	// cerr
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+
+#include "TreeExporter.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "DotEntry.h"
+#include "SpillStore.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Number of rows that are encoded in one piece
+#define EXPORT_BATCH_SIZE		8192
+
+// Number of batches per thread that may be waiting to be encoded or written
+#define EXPORT_BATCHES_PER_THREAD	2
+
+// Upper limit for the number of threads, no matter how many cores there are
+#define EXPORT_MAX_THREADS		8
+
+
+using std::cerr;
+using namespace QDirStat;
+
+
+/**
+ * Append 'value' as a CSV field: In quotes if needed, with quotes doubled.
+ **/
+static void appendCsv( QByteArray & out, const QByteArray & value )
+{
+    bool needsQuotes = false;
+
+    for ( int i = 0; i < value.size() && ! needsQuotes; ++i )
+    {
+	char ch = value.at( i );
+	needsQuotes = ch == ',' || ch == '"' || ch == '\n' || ch == '\r';
+    }
+
+    if ( ! needsQuotes )
+    {
+	out += value;
+	return;
+    }
+
+    out += '"';
+
+    for ( int i = 0; i < value.size(); ++i )
+    {
+	char ch = value.at( i );
+
+	if ( ch == '"' )
+	    out += '"';
+
+	out += ch;
+    }
+
+    out += '"';
+}
+
+
+/**
+ * Append 'value' as a JSON string.
+ **/
+static void appendJson( QByteArray & out, const QByteArray & value )
+{
+    out += '"';
+
+    for ( int i = 0; i < value.size(); ++i )
+    {
+	unsigned char ch = value.at( i );
+
+	switch ( ch )
+	{
+	    case '"':  out += "\\\""; break;
+	    case '\\': out += "\\\\"; break;
+	    case '\n': out += "\\n";  break;
+	    case '\r': out += "\\r";  break;
+	    case '\t': out += "\\t";  break;
+
+	    default:
+		if ( ch < 0x20 )
+		{
+		    char buf[ 8 ];
+		    snprintf( buf, sizeof( buf ), "\\u%04x", ch );
+		    out += buf;
+		}
+		else
+		{
+		    out += ch;
+		}
+		break;
+	}
+    }
+
+    out += '"';
+}
+
+
+namespace QDirStat
+{
+    /**
+     * Worker for the TreeExporter: Encode one batch of rows.
+     **/
+    class ExportEncodeTask: public QRunnable
+    {
+    public:
+
+	ExportEncodeTask( const QVector<ExportRow> & rows,
+			  TreeExporter::Format	     format,
+			  const DataColumnList	   & columns ):
+	    _rows( rows ),
+	    _format( format ),
+	    _columns( columns )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    foreach ( const ExportRow & row, _rows )
+		encode( row );
+
+	    _rows.clear();
+	    _done.release();
+	}
+
+	/**
+	 * Wait until run() is finished and return the result.
+	 **/
+	const QByteArray & result()
+	{
+	    _done.acquire();
+	    _done.release();	// For any further calls
+
+	    return _result;
+	}
+
+	/**
+	 * Return 'true' if run() is finished.
+	 **/
+	bool isDone() const { return _done.available() > 0; }
+
+    protected:
+
+	/**
+	 * Append one row to the result.
+	 **/
+	void encode( const ExportRow & row );
+
+
+	QVector<ExportRow>   _rows;
+	TreeExporter::Format _format;
+	DataColumnList	     _columns;
+	QByteArray	     _result;
+	QSemaphore	     _done;
+    };
+
+}	// namespace QDirStat
+
+
+void ExportEncodeTask::encode( const ExportRow & row )
+{
+    bool json = _format == TreeExporter::NdJson;
+
+    if ( json )
+	_result += '{';
+
+    for ( int i = 0; i < _columns.size(); ++i )
+    {
+	DataColumn col = _columns.at( i );
+	QByteArray value;
+	bool	   isString = false;
+
+	switch ( col )
+	{
+	    case NameCol:	     value = row.path;				 isString = true; break;
+	    case SizeCol:	     value = QByteArray::number( row.size );			  break;
+	    case TotalItemsCol:	     value = QByteArray::number( row.totalItems );		  break;
+	    case TotalFilesCol:	     value = QByteArray::number( row.totalFiles );		  break;
+	    case TotalSubDirsCol:    value = QByteArray::number( row.totalSubDirs );		  break;
+	    case LatestMTimeCol:     value = QByteArray::number( (qint64) row.latestMtime );	  break;
+	    case OldestFileMTimeCol: value = QByteArray::number( (qint64) row.oldestFileMtime ); break;
+	    case UserCol:	     value = row.user;				 isString = true; break;
+	    case GroupCol:	     value = row.group;				 isString = true; break;
+
+	    case PermissionsCol:
+		if ( row.hasPermissions )
+		    value = symbolicMode( row.mode, true ).toLatin1();
+		isString = true;
+		break;
+
+	    case OctalPermissionsCol:
+		if ( row.hasPermissions )
+		    value = formatOctal( ALLPERMS & row.mode ).toLatin1();
+		isString = true;
+		break;
+
+	    default:
+		break;
+	}
+
+	if ( json )
+	{
+	    if ( i > 0 )
+		_result += ',';
+
+	    appendJson( _result, TreeExporter::columnName( col ).toLatin1() );
+	    _result += ':';
+
+	    if ( isString )
+		appendJson( _result, value );
+	    else
+		_result += value;
+	}
+	else
+	{
+	    if ( i > 0 )
+		_result += ',';
+
+	    appendCsv( _result, value );
+	}
+    }
+
+    _result += json ? "}\n" : "\n";
+}
+
+
+
+
+TreeExporter::TreeExporter( Format format, const DataColumnList & columns ):
+    _format( format ),
+    _maxDepth( -1 ),
+    _dirsOnly( false ),
+    _ok( true ),
+    _file( 0 )
+{
+    _columns << NameCol;	// Always the path first
+
+    foreach ( DataColumn col, columns )
+    {
+	if ( col != NameCol && ! columnName( col ).isEmpty() && ! _columns.contains( col ) )
+	    _columns << col;
+    }
+
+    _pool.setMaxThreadCount( qBound( 1, QThread::idealThreadCount(), EXPORT_MAX_THREADS ) );
+}
+
+
+TreeExporter::~TreeExporter()
+{
+    _pool.waitForDone();
+    qDeleteAll( _tasks );
+    delete _file;
+}
+
+
+QString TreeExporter::columnName( DataColumn col )
+{
+    switch ( col )
+    {
+	case NameCol:		  return "path";
+	case SizeCol:		  return "size";
+	case TotalItemsCol:	  return "items";
+	case TotalFilesCol:	  return "files";
+	case TotalSubDirsCol:	  return "subdirs";
+	case LatestMTimeCol:	  return "mtime";
+	case OldestFileMTimeCol:  return "oldest_file_mtime";
+	case UserCol:		  return "user";
+	case GroupCol:		  return "group";
+	case PermissionsCol:	  return "permissions";
+	case OctalPermissionsCol: return "octal_permissions";
+	default:		  return QString();
+    }
+}
+
+
+bool TreeExporter::formatFromFileName( const QString & fileName, Format & format_ret )
+{
+    QString suffix = QFileInfo( fileName ).suffix().toLower();
+
+    if ( suffix == "csv" )
+    {
+	format_ret = Csv;
+	return true;
+    }
+
+    if ( suffix == "ndjson" || suffix == "jsonl" || suffix == "json" )
+    {
+	format_ret = NdJson;
+	return true;
+    }
+
+    return false;
+}
+
+
+bool TreeExporter::write( FileInfo * subtree, const QString & fileName )
+{
+    CHECK_PTR( subtree );
+
+    _ok = true;
+    _errorString.clear();
+
+    _file = new QFile( fileName == "-" ? QString() : fileName );
+    CHECK_NEW( _file );
+
+    bool opened = fileName == "-" ?
+	_file->open( stdout, QIODevice::WriteOnly ) :
+	_file->open( QIODevice::WriteOnly | QIODevice::Truncate );
+
+    if ( ! opened )
+    {
+	_errorString = _file->errorString();
+	logError() << "Can't open " << fileName << ": " << _errorString << endl;
+	delete _file;
+	_file = 0;
+
+	return false;
+    }
+
+    logInfo() << "Exporting " << subtree << " to " << fileName << endl;
+
+    if ( _format == Csv )
+	writeData( csvHeader() );
+
+    QByteArray path = subtree->url().toUtf8();
+
+    if ( subtree->isDirInfo() && ! subtree->isPseudoDir() )
+	addSubtree( subtree->toDirInfo(), path, 0 );
+    else if ( subtree->isPseudoDir() )
+	addFiles( subtree->toDirInfo(), subtree->parent()->url().toUtf8() );
+    else
+	addRow( subtree, path );
+
+    flushBatch();
+    writeDone( true );
+
+    _file->close();
+    delete _file;
+    _file = 0;
+
+    if ( _ok )
+	logInfo() << "Export to " << fileName << " done" << endl;
+
+    return _ok;
+}
+
+
+void TreeExporter::addSubtree( DirInfo * dir, const QByteArray & path, int depth )
+{
+    addRow( dir, path );
+
+    bool belowLimit = _maxDepth < 0 || depth < _maxDepth;
+
+    if ( ! belowLimit || ! _ok )
+	return;
+
+    if ( ! _dirsOnly )
+    {
+	addFiles( dir, path );
+
+	if ( dir->dotEntry() )
+	    addFiles( dir->dotEntry(), path );
+    }
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() && ! child->isPseudoDir() )
+	    addSubtree( child->toDirInfo(), path + '/' + child->name().toUtf8(), depth + 1 );
+    }
+}
+
+
+void TreeExporter::addFiles( DirInfo * dir, const QByteArray & dirPath )
+{
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( ! child->isDirInfo() )
+	    addRow( child, dirPath + '/' + child->name().toUtf8() );
+    }
+
+    if ( dir->hasSpilledFiles() )
+    {
+	// Files of an out-of-core tree: Use temporary objects from the spill
+	// store without paging them in
+
+	FileInfoList spilled;
+	dir->tree()->spillStore()->load( dir, spilled );
+
+	foreach ( FileInfo * file, spilled )
+	    addRow( file, dirPath + '/' + file->name().toUtf8() );
+
+	qDeleteAll( spilled );
+    }
+}
+
+
+void TreeExporter::addRow( FileInfo * item, const QByteArray & path )
+{
+    ExportRow row;
+
+    row.path		= path;
+    row.size		= item->isDirInfo() ? item->totalSize() : item->size();
+    row.totalItems	= item->totalItems();
+    row.totalFiles	= item->totalFiles();
+    row.totalSubDirs	= item->totalSubDirs();
+    row.latestMtime	= item->latestMtime();
+    row.oldestFileMtime = item->oldestFileMtime();
+    row.user		= item->hasUid() ? userName ( item->uid(), _userNames  ) : QByteArray();
+    row.group		= item->hasGid() ? groupName( item->gid(), _groupNames ) : QByteArray();
+    row.mode		= item->mode();
+    row.hasPermissions	= item->hasPermissions();
+
+    _batch << row;
+
+    if ( _batch.size() >= EXPORT_BATCH_SIZE )
+	flushBatch();
+}
+
+
+void TreeExporter::flushBatch()
+{
+    if ( _batch.isEmpty() )
+	return;
+
+    ExportEncodeTask * task = new ExportEncodeTask( _batch, _format, _columns );
+    CHECK_NEW( task );
+    task->setAutoDelete( false );
+
+    _tasks << task;
+    _pool.start( task );
+    _batch.clear();
+    _batch.reserve( EXPORT_BATCH_SIZE );
+
+    writeDone( false );
+}
+
+
+void TreeExporter::writeDone( bool all )
+{
+    // Write the batches in their original order: Only the first one in the
+    // list can be written. If there are too many in the pipeline, wait for
+    // it so the rows don't pile up in memory.
+
+    int maxTasks = _pool.maxThreadCount() * EXPORT_BATCHES_PER_THREAD;
+
+    while ( ! _tasks.isEmpty() &&
+	    ( all || _tasks.size() > maxTasks || _tasks.first()->isDone() ) )
+    {
+	ExportEncodeTask * task = _tasks.takeFirst();
+	writeData( task->result() );
+	delete task;
+    }
+}
+
+
+void TreeExporter::writeData( const QByteArray & data )
+{
+    if ( ! _ok || ! _file )
+	return;
+
+    if ( _file->write( data ) != data.size() )
+    {
+	_ok = false;
+	_errorString = _file->errorString();
+	logError() << "Write error: " << _errorString << endl;
+    }
+}
+
+
+QByteArray TreeExporter::csvHeader() const
+{
+    QStringList names;
+
+    foreach ( DataColumn col, _columns )
+	names << columnName( col );
+
+    return names.join( "," ).toLatin1() + "\n";
+}
+
+
+QByteArray TreeExporter::userName( uint id, QHash<uint, QByteArray> & names )
+{
+    QHash<uint, QByteArray>::const_iterator it = names.find( id );
+
+    if ( it != names.end() )
+	return it.value();
+
+    struct passwd * pw = getpwuid( id );
+    QByteArray name = pw ? QByteArray( pw->pw_name ) : QByteArray::number( id );
+    names.insert( id, name );
+
+    return name;
+}
+
+
+QByteArray TreeExporter::groupName( uint id, QHash<uint, QByteArray> & names )
+{
+    QHash<uint, QByteArray>::const_iterator it = names.find( id );
+
+    if ( it != names.end() )
+	return it.value();
+
+    struct group * grp = getgrgid( id );
+    QByteArray name = grp ? QByteArray( grp->gr_name ) : QByteArray::number( id );
+    names.insert( id, name );
+
+    return name;
+}
+
+
+int TreeExporter::run( int & argc, char ** argv )
+{
+    QCoreApplication app( argc, argv );
+    QStringList args = QCoreApplication::arguments();
+    args.removeFirst();		// Program name
+    args.removeFirst();		// --export
+
+    QString	   fileName;
+    QString	   source;
+    QString	   subtreePath;
+    DataColumnList columns;
+    int		   maxDepth = -1;
+    bool	   dirsOnly = false;
+    bool	   ok	    = ! args.isEmpty();
+
+    if ( ok )
+	fileName = args.takeFirst();
+
+    while ( ok && ! args.isEmpty() )
+    {
+	QString arg = args.takeFirst();
+
+	if ( arg == "--columns" && ! args.isEmpty() )
+	{
+	    foreach ( const QString & name, args.takeFirst().split( ',' ) )
+	    {
+		DataColumn col = UndefinedCol;
+
+		for ( int i = DataColumnBegin; i < DataColumnEnd; ++i )
+		{
+		    if ( columnName( static_cast<DataColumn>( i ) ) == name.trimmed() )
+			col = static_cast<DataColumn>( i );
+		}
+
+		if ( col == UndefinedCol )
+		{
+		    cerr << "qdirstat --export: Unknown column " << qPrintable( name ) << std::endl;
+		    ok = false;
+		}
+
+		columns << col;
+	    }
+	}
+	else if ( arg == "--depth" && ! args.isEmpty() )
+	{
+	    maxDepth = args.takeFirst().toInt( &ok );
+	}
+	else if ( arg == "--dirs-only" )
+	{
+	    dirsOnly = true;
+	}
+	else if ( arg == "--subtree" && ! args.isEmpty() )
+	{
+	    subtreePath = args.takeFirst();
+	}
+	else if ( ! arg.startsWith( "--" ) && source.isEmpty() )
+	{
+	    source = arg;
+	}
+	else
+	{
+	    ok = false;
+	}
+    }
+
+    Format format = Csv;
+
+    if ( ok && fileName != "-" && ! formatFromFileName( fileName, format ) )
+    {
+	cerr << "qdirstat --export: Use .csv or .ndjson for " << qPrintable( fileName ) << std::endl;
+	return 1;
+    }
+
+    if ( ! ok || source.isEmpty() )
+    {
+	cerr << "Usage: qdirstat --export <file> [--columns <col>,...] [--depth <n>]"
+	     << " [--dirs-only] [--subtree <dir>] <directory or cache file>" << std::endl;
+	return 1;
+    }
+
+    if ( columns.isEmpty() )
+	columns = DataColumns::instance()->defaultColumns();
+
+    DirTree tree;
+    QEventLoop eventLoop;
+
+    QObject::connect( &tree,	  SIGNAL( finished() ),
+		      &eventLoop, SLOT	( quit()     ) );
+
+    if ( QFileInfo( source ).isFile() )
+    {
+	// Only load what is exported from the cache file
+
+	if ( ! tree.readCache( source, subtreePath ) )
+	{
+	    cerr << "qdirstat --export: Can't read cache file " << qPrintable( source ) << std::endl;
+	    return 1;
+	}
+    }
+    else
+    {
+	tree.startReading( source );
+    }
+
+    if ( tree.isBusy() )
+	eventLoop.exec();
+
+    FileInfo * subtree = subtreePath.isEmpty() ?
+	tree.firstToplevel() : tree.locate( subtreePath );
+
+    if ( ! subtree )
+    {
+	cerr << "qdirstat --export: Nothing read from " << qPrintable( source ) << std::endl;
+	return 1;
+    }
+
+    TreeExporter exporter( format, columns );
+    exporter.setMaxDepth( maxDepth );
+    exporter.setDirsOnly( dirsOnly );
+
+    if ( ! exporter.write( subtree, fileName ) )
+    {
+	cerr << "qdirstat --export: " << qPrintable( exporter.errorString() ) << std::endl;
+	return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ *   File name: TreeExporter.h
+ *   Summary:	Export of a directory tree to CSV or NDJSON
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreeExporter_h
+#define TreeExporter_h
+
+
+#include <sys/types.h>	// mode_t
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+#include "DataColumns.h"
+#include "FileSize.h"
+
+
+class QFile;
+
+
+namespace QDirStat
+{
+    class FileInfo;
+    class DirInfo;
+    class ExportEncodeTask;
+
+
+    /**
+     * The fields of one item that are exported, copied in the GUI thread so
+     * they can be encoded in other threads.
+     **/
+    struct ExportRow
+    {
+	QByteArray path;
+	FileSize   size;	// totalSize() for directories
+	FileCount  totalItems;
+	FileCount  totalFiles;
+	FileCount  totalSubDirs;
+	time_t	   latestMtime;
+	time_t	   oldestFileMtime;
+	QByteArray user;
+	QByteArray group;
+	mode_t	   mode;
+	bool	   hasPermissions;
+    };
+
+
+    /**
+     * Streaming export of a subtree to CSV or NDJSON (one JSON object per
+     * line) for other tools, e.g. capacity dashboards.
+     *
+     * Each item is one row with the path and the selected DataColumns; the
+     * percentage columns and those that only make sense in the GUI are
+     * left out. Times are in seconds since the epoch. The pseudo
+     * directories are resolved (the files of the dot entry are files of
+     * their directory); ignored items in the attic are not exported.
+     *
+     * The tree can only be used in the GUI thread, so that walks the tree
+     * and copies the fields of a batch of items to ExportRows; the batches
+     * are then encoded in a thread pool and written to the file in their
+     * original order while the next batches are collected.
+     **/
+    class TreeExporter
+    {
+    public:
+
+	enum Format
+	{
+	    Csv,
+	    NdJson
+	};
+
+	/**
+	 * Constructor. 'columns' are the DataColumns to export; the path is
+	 * always the first one.
+	 **/
+	TreeExporter( Format format, const DataColumnList & columns );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~TreeExporter();
+
+	/**
+	 * Only export items up to 'depth' levels below the start directory.
+	 * -1 (the default) means no limit.
+	 **/
+	void setMaxDepth( int depth ) { _maxDepth = depth; }
+
+	/**
+	 * Only export directories, no files.
+	 **/
+	void setDirsOnly( bool dirsOnly ) { _dirsOnly = dirsOnly; }
+
+	/**
+	 * Export the subtree of 'subtree' to 'fileName' ("-" for stdout).
+	 * Return 'true' if success, 'false' if not; see errorString().
+	 **/
+	bool write( FileInfo * subtree, const QString & fileName );
+
+	/**
+	 * Return the error of the last write().
+	 **/
+	const QString & errorString() const { return _errorString; }
+
+	/**
+	 * Return the format for the suffix of 'fileName' in 'format_ret':
+	 * .csv or .ndjson / .jsonl / .json. Return 'false' if that suffix is
+	 * unknown.
+	 **/
+	static bool formatFromFileName( const QString & fileName, Format & format_ret );
+
+	/**
+	 * Return the name of 'col' in the export or an empty string if that
+	 * column can't be exported.
+	 **/
+	static QString columnName( DataColumn col );
+
+	/**
+	 * Run an export from the command line:
+	 *
+	 *   qdirstat --export <file> [--columns <col>,...] [--depth <n>]
+	 *	      [--dirs-only] [--subtree <dir>] <directory or cache file>
+	 *
+	 * With --subtree, only that directory is exported, and only that part
+	 * of a cache file is read.
+	 *
+	 * Return the exit code for the program.
+	 **/
+	static int run( int & argc, char ** argv );
+
+
+    protected:
+
+	/**
+	 * Add the subtree of 'dir' at 'depth' with path 'path'.
+	 **/
+	void addSubtree( DirInfo * dir, const QByteArray & path, int depth );
+
+	/**
+	 * Add the files of 'dir' (a directory or a dot entry) in directory
+	 * 'dirPath', including those in the spill store.
+	 **/
+	void addFiles( DirInfo * dir, const QByteArray & dirPath );
+
+	/**
+	 * Add one item.
+	 **/
+	void addRow( FileInfo * item, const QByteArray & path );
+
+	/**
+	 * Start encoding the current batch.
+	 **/
+	void flushBatch();
+
+	/**
+	 * Write the encoded batches that are done. If 'all' is 'true', wait
+	 * for all of them; otherwise only until there are few enough batches
+	 * in the pipeline.
+	 **/
+	void writeDone( bool all );
+
+	/**
+	 * Write 'data' to the file and remember any error.
+	 **/
+	void writeData( const QByteArray & data );
+
+	/**
+	 * Return the CSV header line.
+	 **/
+	QByteArray csvHeader() const;
+
+	/**
+	 * Return the name of the user or group with ID 'id' from the cache
+	 * 'names'.
+	 **/
+	static QByteArray userName ( uint id, QHash<uint, QByteArray> & names );
+	static QByteArray groupName( uint id, QHash<uint, QByteArray> & names );
+
+
+	Format				_format;
+	DataColumnList			_columns;
+	int				_maxDepth;
+	bool				_dirsOnly;
+	bool				_ok;
+	QString				_errorString;
+	QFile *				_file;
+	QVector<ExportRow>		_batch;
+	QList<ExportEncodeTask *>	_tasks;		// in file order
+	QThreadPool			_pool;
+	QHash<uint, QByteArray>		_userNames;
+	QHash<uint, QByteArray>		_groupNames;
+
+    };	// class TreeExporter
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreeExporter_h
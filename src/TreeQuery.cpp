@@ -0,0 +1,575 @@
+/*
+ *   File name: TreeQuery.cpp
+ *   Summary:	Predicate queries over the scanned tree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <pwd.h>	// getpwnam()
+
+#include <QObject>
+#include <QDate>
+#include <QDateTime>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QRegExp>
+
+#include "TreeQuery.h"
+#include "TreeColumns.h"
+#include "DirInfo.h"
+#include "MimeCategorizer.h"
+#include "MimeCategory.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Below this number of items, one thread is faster than starting threads
+#define QUERY_PARALLEL_MIN_ITEMS	50000
+
+// Upper limit for the number of threads, no matter how many cores there are
+#define QUERY_MAX_THREADS		8
+
+
+using namespace QDirStat;
+
+
+namespace QDirStat
+{
+    /**
+     * Worker for TreeQuery::find(): Find the matches in one range of the
+     * columns.
+     **/
+    class TreeQueryTask: public QRunnable
+    {
+    public:
+
+	TreeQueryTask( const TreeColumns		 & columns,
+		       const QVector<TreeQueryClause> & clauses,
+		       int				   first,
+		       int				   end ):
+	    _columns( columns ),
+	    _clauses( clauses ),
+	    _first( first ),
+	    _end( end )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    TreeQuery::find( _columns, _clauses, _first, _end, _matches );
+	}
+
+	const QVector<int> & matches() const { return _matches; }
+
+    protected:
+
+	const TreeColumns &		 _columns;
+	const QVector<TreeQueryClause> & _clauses;
+	int				 _first;
+	int				 _end;
+	QVector<int>			 _matches;
+    };
+
+
+    /**
+     * Return the time_t of 'date' at 00:00 UTC: FileInfo::mtimeYear() and
+     * FileInfo::mtimeMonth() use UTC, too.
+     **/
+    static qint64 startOfDay( const QDate & date )
+    {
+	return QDateTime( date, QTime( 0, 0 ), Qt::UTC ).toTime_t();
+    }
+
+}	// namespace QDirStat
+
+
+
+TreeQuery::TreeQuery()
+{
+    // NOP
+}
+
+
+bool TreeQuery::parse( const QString & text )
+{
+    _text = text;
+    _errorString.clear();
+    _clauses.clear();
+
+    QStringList tokens = tokenize( text );
+    int pos = 0;
+
+    if ( tokens.isEmpty() )
+    {
+	_errorString = QObject::tr( "Empty query" );
+	return false;
+    }
+
+    while ( pos < tokens.size() )
+    {
+	if ( ! parseClause( tokens, pos ) )
+	{
+	    _clauses.clear();
+	    return false;
+	}
+
+	if ( pos < tokens.size() )
+	{
+	    QString word = tokens.at( pos++ );
+
+	    if ( word.toLower() != "and" && word != "&&" )
+	    {
+		_errorString = QObject::tr( "Expected \"and\" instead of \"%1\"" ).arg( word );
+		_clauses.clear();
+		return false;
+	    }
+
+	    if ( pos >= tokens.size() )
+	    {
+		_errorString = QObject::tr( "Missing condition after \"%1\"" ).arg( word );
+		_clauses.clear();
+		return false;
+	    }
+	}
+    }
+
+    bool hasType = false;
+
+    foreach ( const TreeQueryClause & clause, _clauses )
+    {
+	if ( clause.field == TreeQueryClause::Type )
+	    hasType = true;
+    }
+
+    if ( ! hasType )	// Only regular files by default
+    {
+	TreeQueryClause clause;
+	clause.field = TreeQueryClause::Type;
+	clause.op    = TreeQueryClause::Equal;
+	clause.flag  = TreeColumns::ItemIsFile;
+	clause.lo    = 1;
+	clause.hi    = 2;
+
+	_clauses << clause;
+    }
+
+    return true;
+}
+
+
+bool TreeQuery::parseClause( const QStringList & tokens, int & pos )
+{
+    if ( pos + 3 > tokens.size() )
+    {
+	_errorString = QObject::tr( "Incomplete condition: \"%1\"" )
+	    .arg( tokens.mid( pos ).join( " " ) );
+	return false;
+    }
+
+    QString fieldName = tokens.at( pos++ ).toLower();
+    QString opName    = tokens.at( pos++ );
+    QString value     = tokens.at( pos++ );
+
+    TreeQueryClause clause;
+
+    if	    ( fieldName == "size"	)  clause.field = TreeQueryClause::Size;
+    else if ( fieldName == "allocated" ) clause.field = TreeQueryClause::Allocated;
+    else if ( fieldName == "mtime"	)  clause.field = TreeQueryClause::MTime;
+    else if ( fieldName == "owner" ||
+	      fieldName == "user"	)  clause.field = TreeQueryClause::Owner;
+    else if ( fieldName == "category" ) clause.field = TreeQueryClause::Category;
+    else if ( fieldName == "type"	)  clause.field = TreeQueryClause::Type;
+    else
+    {
+	_errorString = QObject::tr( "Unknown field \"%1\"" ).arg( fieldName );
+	return false;
+    }
+
+    if	    ( opName == "="  || opName == "==" ) clause.op = TreeQueryClause::Equal;
+    else if ( opName == "!="			 ) clause.op = TreeQueryClause::NotEqual;
+    else if ( opName == "<"			 ) clause.op = TreeQueryClause::Less;
+    else if ( opName == "<="			 ) clause.op = TreeQueryClause::LessEqual;
+    else if ( opName == ">"			 ) clause.op = TreeQueryClause::Greater;
+    else if ( opName == ">="			 ) clause.op = TreeQueryClause::GreaterEqual;
+    else
+    {
+	_errorString = QObject::tr( "Unknown operator \"%1\"" ).arg( opName );
+	return false;
+    }
+
+    bool ordered = clause.field == TreeQueryClause::Size  ||
+	clause.field == TreeQueryClause::Allocated ||
+	clause.field == TreeQueryClause::MTime;
+
+    if ( ! ordered &&
+	 clause.op != TreeQueryClause::Equal &&
+	 clause.op != TreeQueryClause::NotEqual )
+    {
+	_errorString = QObject::tr( "Only = and != are possible for \"%1\"" ).arg( fieldName );
+	return false;
+    }
+
+    bool ok = true;
+
+    switch ( clause.field )
+    {
+	case TreeQueryClause::Size:
+	case TreeQueryClause::Allocated:
+	    ok = parseSize( value, clause.lo );
+	    clause.hi = clause.lo + 1;
+	    break;
+
+	case TreeQueryClause::MTime:
+	    ok = parseDate( value, clause.lo, clause.hi );
+	    break;
+
+	case TreeQueryClause::Owner:
+	    {
+		uint uid = value.toUInt( &ok );
+
+		if ( ! ok )
+		{
+		    struct passwd * pw = getpwnam( value.toUtf8().constData() );
+		    ok = pw != 0;
+
+		    if ( ok )
+			uid = pw->pw_uid;
+		}
+
+		clause.lo = uid;
+		clause.hi = clause.lo + 1;
+	    }
+	    break;
+
+	case TreeQueryClause::Category:
+	    ok = false;
+	    clause.lo = 0;	// See matches() and compile()
+	    clause.hi = 1;
+
+	    foreach ( MimeCategory * category, MimeCategorizer::instance()->categories() )
+	    {
+		if ( category->name().compare( value, Qt::CaseInsensitive ) == 0 )
+		{
+		    clause.category = category;
+		    ok = true;
+		    break;
+		}
+	    }
+	    break;
+
+	case TreeQueryClause::Type:
+	    {
+		QString type = value.toLower();
+
+		if	( type == "file"    ) clause.flag = TreeColumns::ItemIsFile;
+		else if ( type == "dir"	    ) clause.flag = TreeColumns::ItemIsDir;
+		else if ( type == "symlink" ) clause.flag = TreeColumns::ItemIsSymLink;
+		else ok = false;
+
+		clause.lo = 1;
+		clause.hi = 2;
+	    }
+	    break;
+    }
+
+    if ( ! ok )
+    {
+	_errorString = QObject::tr( "Invalid value for \"%1\": \"%2\"" ).arg( fieldName ).arg( value );
+	return false;
+    }
+
+    _clauses << clause;
+
+    return true;
+}
+
+
+QStringList TreeQuery::tokenize( const QString & text )
+{
+    QStringList tokens;
+    int pos = 0;
+
+    while ( pos < text.size() )
+    {
+	QChar ch = text.at( pos );
+
+	if ( ch.isSpace() )
+	{
+	    ++pos;
+	}
+	else if ( ch == '"' || ch == '\'' )
+	{
+	    int end = text.indexOf( ch, pos + 1 );
+
+	    if ( end < 0 )
+		end = text.size();
+
+	    tokens << text.mid( pos + 1, end - pos - 1 );
+	    pos = end + 1;
+	}
+	else if ( QString( "=!<>" ).contains( ch ) )
+	{
+	    int len = ( pos + 1 < text.size() && text.at( pos + 1 ) == '=' ) ? 2 : 1;
+	    tokens << text.mid( pos, len );
+	    pos += len;
+	}
+	else
+	{
+	    int start = pos;
+
+	    while ( pos < text.size() &&
+		    ! text.at( pos ).isSpace() &&
+		    ! QString( "=!<>\"'" ).contains( text.at( pos ) ) )
+	    {
+		++pos;
+	    }
+
+	    tokens << text.mid( start, pos - start );
+	}
+    }
+
+    return tokens;
+}
+
+
+bool TreeQuery::parseSize( const QString & text, qint64 & size_ret )
+{
+    QRegExp regexp( "([0-9]+(\\.[0-9]*)?)\\s*([KMGTP]?)(i?B)?", Qt::CaseInsensitive );
+
+    if ( ! regexp.exactMatch( text.trimmed() ) )
+	return false;
+
+    double size = regexp.cap( 1 ).toDouble();
+    QString unit = regexp.cap( 3 ).toUpper();
+
+    int exponent = QString( "KMGTP" ).indexOf( unit ) + 1; // 0 for no unit
+
+    if ( unit.isEmpty() )
+	exponent = 0;
+
+    for ( int i = 0; i < exponent; ++i )
+	size *= 1024.0;
+
+    size_ret = (qint64) size;
+
+    return true;
+}
+
+
+bool TreeQuery::parseDate( const QString & text,
+			   qint64	 & start_ret,
+			   qint64	 & end_ret )
+{
+    QStringList fields = text.split( '-' );
+
+    if ( fields.size() > 3 )
+	return false;
+
+    int  values[ 3 ] = { 0, 1, 1 };
+    bool ok = true;
+
+    for ( int i = 0; i < fields.size() && ok; ++i )
+	values[ i ] = fields.at( i ).toInt( &ok );
+
+    QDate start( values[ 0 ], values[ 1 ], values[ 2 ] );
+
+    if ( ! ok || ! start.isValid() )
+	return false;
+
+    QDate end;
+
+    switch ( fields.size() )
+    {
+	case 1:	 end = start.addYears( 1 );  break;
+	case 2:	 end = start.addMonths( 1 ); break;
+	default: end = start.addDays( 1 );   break;
+    }
+
+    start_ret = startOfDay( start );
+    end_ret   = startOfDay( end );
+
+    return true;
+}
+
+
+bool TreeQuery::matches( FileInfo * item ) const
+{
+    if ( ! item || _clauses.isEmpty() || item->isPseudoDir() )
+	return false;
+
+    foreach ( const TreeQueryClause & clause, _clauses )
+    {
+	qint64 value = 0;
+
+	switch ( clause.field )
+	{
+	    case TreeQueryClause::Size:	     value = item->size();	    break;
+	    case TreeQueryClause::Allocated: value = item->allocatedSize(); break;
+	    case TreeQueryClause::MTime:     value = item->mtime();	    break;
+	    case TreeQueryClause::Owner:     value = item->uid();	    break;
+
+	    case TreeQueryClause::Category:
+		value = item->isFile() &&
+		    MimeCategorizer::instance()->category( item ) == clause.category ? clause.lo : clause.hi;
+		break;
+
+	    case TreeQueryClause::Type:
+		switch ( clause.flag )
+		{
+		    case TreeColumns::ItemIsFile:    value = item->isFile()    ? 1 : 0; break;
+		    case TreeColumns::ItemIsDir:     value = item->isDirInfo() ? 1 : 0; break;
+		    case TreeColumns::ItemIsSymLink: value = item->isSymLink() ? 1 : 0; break;
+		}
+		break;
+	}
+
+	if ( ! clause.matches( value ) )
+	    return false;
+    }
+
+    return true;
+}
+
+
+QVector<TreeQueryClause> TreeQuery::compile( const TreeColumns & columns ) const
+{
+    QVector<TreeQueryClause> clauses = _clauses;
+
+    for ( int i = 0; i < clauses.size(); ++i )
+    {
+	TreeQueryClause & clause = clauses[ i ];
+
+	if ( clause.field == TreeQueryClause::Category )
+	{
+	    // An empty range if there is no file of that category at all
+
+	    clause.lo = columns.categories().indexOf( clause.category );
+	    clause.hi = clause.lo < 0 ? clause.lo : clause.lo + 1;
+	}
+    }
+
+    return clauses;
+}
+
+
+void TreeQuery::find( const TreeColumns		    & columns,
+		      const QVector<TreeQueryClause> & clauses,
+		      int				first,
+		      int				end,
+		      QVector<int>		    & matches_ret )
+{
+    const FileSize * sizes	    = columns.sizes().constData();
+    const FileSize * allocatedSizes = columns.allocatedSizes().constData();
+    const time_t   * mtimes	    = columns.mtimes().constData();
+    const uint	   * uids	    = columns.uids().constData();
+    const quint16  * categoryIds    = columns.categoryIds().constData();
+    const quint8   * flags	    = columns.flags().constData();
+    const TreeQueryClause * clauseData = clauses.constData();
+    const int clauseCount = clauses.size();
+
+    // One single pass for all clauses: Each item is only loaded once, and
+    // the first clause that does not match ends the checks for that item.
+
+    for ( int i = first; i < end; ++i )
+    {
+	bool match = true;
+
+	for ( int c = 0; c < clauseCount && match; ++c )
+	{
+	    const TreeQueryClause & clause = clauseData[ c ];
+	    qint64 value = 0;
+
+	    switch ( clause.field )
+	    {
+		case TreeQueryClause::Size:	 value = sizes[ i ];		       break;
+		case TreeQueryClause::Allocated: value = allocatedSizes[ i ];	       break;
+		case TreeQueryClause::MTime:	 value = mtimes[ i ];		       break;
+		case TreeQueryClause::Owner:	 value = uids[ i ];		       break;
+		case TreeQueryClause::Category:	 value = categoryIds[ i ];	       break;
+		case TreeQueryClause::Type:	 value = flags[ i ] & clause.flag ? 1 : 0; break;
+	    }
+
+	    match = clause.matches( value );
+	}
+
+	if ( match )
+	    matches_ret << i;
+    }
+}
+
+
+FileInfoList TreeQuery::find( DirInfo * dir, int maxResults ) const
+{
+    FileInfoList results;
+
+    if ( ! dir || _clauses.isEmpty() )
+	return results;
+
+    TreeColumnsPtr columns = TreeColumns::take( dir );
+    QVector<TreeQueryClause> clauses = compile( *columns );
+    int first;
+    int end;
+
+    if ( ! columns->range( dir, first, end ) )
+	return results;
+
+    const int threads = qMin( QThread::idealThreadCount(), QUERY_MAX_THREADS );
+    QVector<int> matches;
+
+    if ( end - first < QUERY_PARALLEL_MIN_ITEMS || threads < 2 )
+    {
+	find( *columns, clauses, first, end, matches );
+    }
+    else
+    {
+	QList<TreeQueryTask *> tasks;
+	int partSize = ( end - first + threads - 1 ) / threads;
+
+	for ( int start = first; start < end; start += partSize )
+	{
+	    TreeQueryTask * task = new TreeQueryTask( *columns, clauses,
+						      start, qMin( start + partSize, end ) );
+	    CHECK_NEW( task );
+	    task->setAutoDelete( false );
+	    tasks << task;
+	}
+
+	QThreadPool pool;
+	pool.setMaxThreadCount( tasks.size() );
+
+	foreach ( TreeQueryTask * task, tasks )
+	    pool.start( task );
+
+	pool.waitForDone();
+
+	// Keep the tree order of the matches
+
+	foreach ( TreeQueryTask * task, tasks )
+	    matches += task->matches();
+
+	qDeleteAll( tasks );
+    }
+
+    logDebug() << matches.size() << " matches for \"" << _text << "\" in "
+	       << end - first << " items" << endl;
+
+    const QVector<const FileInfo *> & items = columns->items();
+
+    foreach ( int index, matches )
+    {
+	if ( results.size() >= maxResults )
+	    break;
+
+	// Nothing in the subtree changed since the columns were taken (or they
+	// would have been dropped), so the items are all still there. 0 for
+	// items in the spill store.
+
+	FileInfo * item = const_cast<FileInfo *>( items.at( index ) );
+
+	if ( item )
+	    results << item;
+    }
+
+    return results;
+}
@@ -0,0 +1,222 @@
+/*
+ *   File name: TreeQuery.h
+ *   Summary:	Predicate queries over the scanned tree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreeQuery_h
+#define TreeQuery_h
+
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    class DirInfo;
+    class MimeCategory;
+    class TreeColumns;
+
+
+    /**
+     * One predicate of a TreeQuery: 'field' 'op' value.
+     *
+     * Each value is a half-open range [lo, hi): A size or a user ID is a
+     * range of one, a year in a modification time is a whole year. The
+     * operators then compare with the start or the end of that range, so
+     * "mtime < 2022" means before 2022 and "mtime > 2022" means after 2022.
+     **/
+    struct TreeQueryClause
+    {
+	enum Field
+	{
+	    Size,
+	    Allocated,
+	    MTime,
+	    Owner,
+	    Category,
+	    Type
+	};
+
+	enum Op
+	{
+	    Equal,
+	    NotEqual,
+	    Less,
+	    LessEqual,
+	    Greater,
+	    GreaterEqual
+	};
+
+	TreeQueryClause():
+	    field( Size ),
+	    op( Equal ),
+	    lo( 0 ),
+	    hi( 0 ),
+	    category( 0 ),
+	    flag( 0 )
+	    {}
+
+	/**
+	 * Return 'true' if 'value' satisfies this clause.
+	 **/
+	bool matches( qint64 value ) const
+	{
+	    switch ( op )
+	    {
+		case Equal:	   return value >= lo && value < hi;
+		case NotEqual:	   return value <  lo || value >= hi;
+		case Less:	   return value <  lo;
+		case LessEqual:	   return value <  hi;
+		case Greater:	   return value >= hi;
+		case GreaterEqual: return value >= lo;
+	    }
+
+	    return false;
+	}
+
+	Field		field;
+	Op		op;
+	qint64		lo;
+	qint64		hi;
+	MimeCategory *	category;	// only for Category
+	int		flag;		// only for Type: TreeColumns::ItemFlags
+    };
+
+
+    /**
+     * Query over the items of a tree with a list of predicates that all
+     * have to match, e.g.
+     *
+     *	   size > 1G and mtime < 2022 and owner = build and category = "Compressed"
+     *
+     * Fields:
+     *
+     *	 - size, allocated: A number with an optional unit (K, M, G, T, P;
+     *	   all base 1024; "KiB", "MB" etc. are also accepted).
+     *
+     *	 - mtime: A year, year-month or year-month-day (UTC, just like the
+     *	   file age statistics).
+     *
+     *	 - owner: A user name or a numeric user ID.
+     *
+     *	 - category: The name of a MIME category (case insensitive).
+     *
+     *	 - type: "file", "dir" or "symlink".
+     *
+     * Operators: = (or ==), !=, <, <=, >, >=. "owner", "category" and
+     * "type" only support = and !=. Values with blanks can be quoted.
+     *
+     * Unless there is a "type" clause, only regular files are found.
+     *
+     * The query is compiled once into a flat list of clauses. find() then
+     * evaluates all clauses in one single pass over the columns of the
+     * subtree (see TreeColumns) in several threads, without touching the
+     * FileInfo objects at all.
+     **/
+    class TreeQuery
+    {
+    public:
+
+	/**
+	 * Constructor for an empty query that matches nothing.
+	 **/
+	TreeQuery();
+
+	/**
+	 * Parse 'text'. Return 'false' if there is a syntax error; see
+	 * errorString() for what is wrong.
+	 **/
+	bool parse( const QString & text );
+
+	/**
+	 * Return the text of the query.
+	 **/
+	const QString & text() const { return _text; }
+
+	/**
+	 * Return a message about what was wrong in the last parse().
+	 **/
+	const QString & errorString() const { return _errorString; }
+
+	/**
+	 * Return 'true' if there is no valid query.
+	 **/
+	bool isEmpty() const { return _clauses.isEmpty(); }
+
+	/**
+	 * Return 'true' if 'item' matches this query.
+	 **/
+	bool matches( FileInfo * item ) const;
+
+	/**
+	 * Find the items in the subtree of 'dir' that match this query, at
+	 * most 'maxResults' of them. This can only be called in the GUI
+	 * thread. Items that are paged out to the spill store are not
+	 * returned.
+	 **/
+	FileInfoList find( DirInfo * dir, int maxResults ) const;
+
+	/**
+	 * Find the indices of the items from 'first' to 'end' (excluding
+	 * 'end') in 'columns' that match this query with the clauses
+	 * compiled for those columns by compile(). This can be used in any
+	 * thread.
+	 **/
+	static void find( const TreeColumns		   & columns,
+			  const QVector<TreeQueryClause> & clauses,
+			  int				     first,
+			  int				     end,
+			  QVector<int>			   & matches_ret );
+
+	/**
+	 * Return the clauses for 'columns': Categories are resolved to the
+	 * category IDs of those columns.
+	 **/
+	QVector<TreeQueryClause> compile( const TreeColumns & columns ) const;
+
+
+    protected:
+
+	/**
+	 * Parse one clause from 'tokens' starting at 'pos'. Return 'false'
+	 * and set _errorString if that is not possible.
+	 **/
+	bool parseClause( const QStringList & tokens, int & pos );
+
+	/**
+	 * Split 'text' into tokens: words, quoted strings and operators.
+	 **/
+	static QStringList tokenize( const QString & text );
+
+	/**
+	 * Parse a size with an optional unit into 'size_ret'.
+	 **/
+	static bool parseSize( const QString & text, qint64 & size_ret );
+
+	/**
+	 * Parse a date (year, year-month or year-month-day) into the range
+	 * from 'start_ret' to 'end_ret'.
+	 **/
+	static bool parseDate( const QString & text,
+			       qint64	     & start_ret,
+			       qint64	     & end_ret );
+
+
+	QString			 _text;
+	QString			 _errorString;
+	QVector<TreeQueryClause> _clauses;
+
+    };	// class TreeQuery
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreeQuery_h
@@ -0,0 +1,141 @@
+/*
+ *   File name: TreeSnapshot.cpp
+ *   Summary:	Immutable snapshots of a directory tree for other threads
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "TreeSnapshot.h"
+#include "DirInfo.h"
+#include "DirTree.h"
+#include "DotEntry.h"
+#include "SpillStore.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+TreeSnapshotDir::TreeSnapshotDir():
+    _totalSize( 0 ),
+    _totalAllocatedSize( 0 ),
+    _totalBlocks( 0 ),
+    _totalItems( 0 ),
+    _totalSubDirs( 0 ),
+    _totalFiles( 0 ),
+    _latestMtime( 0 ),
+    _readState( DirQueued ),
+    _isMountPoint( false ),
+    _isExcluded( false ),
+    _isComplete( false )
+{
+    // NOP
+}
+
+
+TreeSnapshotDirPtr TreeSnapshotDir::take( DirInfo * dir )
+{
+    CHECK_PTR( dir );
+
+    TreeSnapshotDirPtr cached = dir->cachedSnapshot();
+
+    if ( cached )	// Nothing changed in this subtree since the last one
+	return cached;
+
+    TreeSnapshotDir * snapshot = new TreeSnapshotDir();
+    CHECK_NEW( snapshot );
+
+    copyItem( dir, snapshot->_self );
+    snapshot->_totalSize	  = dir->totalSize();
+    snapshot->_totalAllocatedSize = dir->totalAllocatedSize();
+    snapshot->_totalBlocks	  = dir->totalBlocks();
+    snapshot->_totalItems	  = dir->totalItems();
+    snapshot->_totalSubDirs	  = dir->totalSubDirs();
+    snapshot->_totalFiles	  = dir->totalFiles();
+    snapshot->_latestMtime	  = dir->latestMtime();
+    snapshot->_readState	  = dir->readState();
+    snapshot->_isMountPoint	  = dir->isMountPoint();
+    snapshot->_isExcluded	  = dir->isExcluded();
+    snapshot->_isComplete	  = ! dir->isBusy();
+
+    snapshot->addFiles( dir );
+
+    if ( dir->dotEntry() )
+	snapshot->addFiles( dir->dotEntry() );
+
+    FileInfo * child = dir->firstChild();
+
+    while ( child )
+    {
+	if ( child->isDirInfo() && ! child->isPseudoDir() )
+	    snapshot->_subDirs << take( child->toDirInfo() );
+
+	child = child->next();
+    }
+
+    TreeSnapshotDirPtr result( snapshot );
+
+    // A directory that is still being read changes all the time, so there
+    // is no point in keeping its snapshot.
+
+    if ( snapshot->_isComplete )
+	dir->setCachedSnapshot( result );
+
+    return result;
+}
+
+
+void TreeSnapshotDir::addFiles( DirInfo * dir )
+{
+    FileInfo * child = dir->firstChild();
+
+    while ( child )
+    {
+	if ( ! child->isDirInfo() )
+	{
+	    SnapshotItem item;
+	    copyItem( child, item );
+	    _files << item;
+	}
+
+	child = child->next();
+    }
+
+    if ( dir->hasSpilledFiles() )
+    {
+	// Files of an out-of-core tree: Use temporary objects from the spill
+	// store without paging them in
+
+	FileInfoList spilled;
+	dir->tree()->spillStore()->load( dir, spilled );
+
+	foreach ( FileInfo * file, spilled )
+	{
+	    SnapshotItem item;
+	    copyItem( file, item );
+	    item.item = 0;	// Gone in a moment
+	    _files << item;
+	}
+
+	qDeleteAll( spilled );
+    }
+}
+
+
+void TreeSnapshotDir::copyItem( FileInfo * item, SnapshotItem & snapshot_ret )
+{
+    snapshot_ret.name	       = item->name();
+    snapshot_ret.size	       = item->size();
+    snapshot_ret.rawSize       = item->rawByteSize();
+    snapshot_ret.allocatedSize = item->allocatedSize();
+    snapshot_ret.blocks	       = item->blocks();
+    snapshot_ret.mtime	       = item->mtime();
+    snapshot_ret.mode	       = item->mode();
+    snapshot_ret.uid	       = item->uid();
+    snapshot_ret.gid	       = item->gid();
+    snapshot_ret.links	       = item->links();
+    snapshot_ret.isSparse      = item->isSparseFile();
+    snapshot_ret.item	       = item;
+}
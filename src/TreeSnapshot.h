@@ -0,0 +1,204 @@
+/*
+ *   File name: TreeSnapshot.h
+ *   Summary:	Immutable snapshots of a directory tree for other threads
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreeSnapshot_h
+#define TreeSnapshot_h
+
+
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include "FileInfo.h"
+#include "FileSize.h"
+
+
+namespace QDirStat
+{
+    class DirInfo;
+    class TreeSnapshotDir;
+
+    /**
+     * Reference to a snapshot of a directory. This can be copied and
+     * released in any thread; the snapshot is deleted when the last
+     * reference is gone.
+     **/
+    typedef QSharedPointer<const TreeSnapshotDir> TreeSnapshotDirPtr;
+
+
+    /**
+     * A copy of the fields of one FileInfo in a snapshot.
+     **/
+    struct SnapshotItem
+    {
+	SnapshotItem():
+	    size( 0 ),
+	    rawSize( 0 ),
+	    allocatedSize( 0 ),
+	    blocks( 0 ),
+	    mtime( 0 ),
+	    mode( 0 ),
+	    uid( 0 ),
+	    gid( 0 ),
+	    links( 0 ),
+	    isSparse( false ),
+	    item( 0 )
+	    {}
+
+	QString		 name;
+	FileSize	 size;		// size(), i.e. divided by the hard links
+	FileSize	 rawSize;	// rawByteSize()
+	FileSize	 allocatedSize; // allocatedSize()
+	FileSize	 blocks;
+	time_t		 mtime;
+	mode_t		 mode;
+	uid_t		 uid;
+	gid_t		 gid;
+	nlink_t		 links;
+	bool		 isSparse;
+
+	// Only to find the item in the tree again in the GUI thread: It
+	// might be deleted any time. 0 for files that are paged out to the
+	// spill store.
+	const FileInfo * item;
+    };
+
+
+    /**
+     * Immutable snapshot of the subtree of a directory. Statistics, the
+     * treemap layout or cache writers can use this in other threads while
+     * the tree itself keeps changing in the GUI thread: Nothing in a
+     * snapshot ever changes, so there is no locking at all, and the tree
+     * never has to wait for the readers.
+     *
+     * Snapshots share the subtrees that did not change: Each directory
+     * keeps its last snapshot until anything is added or removed anywhere
+     * below it (just like the cached statistics, see
+     * DirInfo::dropStatsCache()). So taking another snapshot of a tree
+     * that is still being read only copies the directories that are busy
+     * or that changed, and the complete subtrees are reused from the
+     * previous snapshot. Directories that are still being read are never
+     * kept.
+     *
+     * The pseudo directories are resolved: The files of the dot entry are
+     * files of their directory. Ignored items in the attic are not
+     * included.
+     *
+     * Usage:
+     *
+     *	   // In the GUI thread:
+     *	   TreeSnapshotDirPtr snapshot = TreeSnapshotDir::take( dir );
+     *
+     *	   // Hand 'snapshot' over to any thread and use it there.
+     **/
+    class TreeSnapshotDir
+    {
+    public:
+
+	/**
+	 * Return a snapshot of the subtree of 'dir'. This can only be called
+	 * in the GUI thread (or whatever thread owns the tree).
+	 **/
+	static TreeSnapshotDirPtr take( DirInfo * dir );
+
+	/**
+	 * Return the fields of the directory itself.
+	 **/
+	const SnapshotItem & self() const { return _self; }
+
+	/**
+	 * Return the name of the directory.
+	 **/
+	const QString & name() const { return _self.name; }
+
+	/**
+	 * Return the direct children that are not directories.
+	 **/
+	const QVector<SnapshotItem> & files() const { return _files; }
+
+	/**
+	 * Return the snapshots of the subdirectories.
+	 **/
+	const QVector<TreeSnapshotDirPtr> & subDirs() const { return _subDirs; }
+
+	/**
+	 * Return the summary fields of the subtree as they were when the
+	 * snapshot was taken. See the same methods in DirInfo.
+	 **/
+	FileSize totalSize()	      const { return _totalSize; }
+	FileSize totalAllocatedSize() const { return _totalAllocatedSize; }
+	FileSize totalBlocks()	      const { return _totalBlocks; }
+	FileCount totalItems()	      const { return _totalItems; }
+	FileCount totalSubDirs()      const { return _totalSubDirs; }
+	FileCount totalFiles()	      const { return _totalFiles; }
+	time_t	 latestMtime()	      const { return _latestMtime; }
+
+	/**
+	 * Return the read state of the directory.
+	 **/
+	DirReadState readState() const { return _readState; }
+
+	/**
+	 * Return 'true' if the directory is a mount point.
+	 **/
+	bool isMountPoint() const { return _isMountPoint; }
+
+	/**
+	 * Return 'true' if the directory is excluded.
+	 **/
+	bool isExcluded() const { return _isExcluded; }
+
+	/**
+	 * Return 'true' if nothing was being read anywhere in this subtree
+	 * when the snapshot was taken.
+	 **/
+	bool isComplete() const { return _isComplete; }
+
+
+    protected:
+
+	/**
+	 * Constructor. Use take() instead.
+	 **/
+	TreeSnapshotDir();
+
+	/**
+	 * Copy the fields of 'item' to 'snapshot_ret'.
+	 **/
+	static void copyItem( FileInfo * item, SnapshotItem & snapshot_ret );
+
+	/**
+	 * Append the non-directory children of 'dir' (a directory or its dot
+	 * entry) to the files of this snapshot, including those that are
+	 * paged out to the spill store.
+	 **/
+	void addFiles( DirInfo * dir );
+
+
+	SnapshotItem			_self;
+	QVector<SnapshotItem>		_files;
+	QVector<TreeSnapshotDirPtr>	_subDirs;
+	FileSize			_totalSize;
+	FileSize			_totalAllocatedSize;
+	FileSize			_totalBlocks;
+	FileCount			_totalItems;
+	FileCount			_totalSubDirs;
+	FileCount			_totalFiles;
+	time_t				_latestMtime;
+	DirReadState			_readState;
+	bool				_isMountPoint;
+	bool				_isExcluded;
+	bool				_isComplete;
+
+    };	// class TreeSnapshotDir
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreeSnapshot_h
@@ -7,15 +7,23 @@
  */
 
 
+#include <QDateTime>
+
 #include "TreeWalker.h"
 #include "FileSizeStats.h"
 #include "FileMTimeStats.h"
+#include "FileNameIndex.h"
+#include "HardLinkIndex.h"
+#include "CacheVerifier.h"
+#include "DiscoverCache.h"
+#include "DirTree.h"
 #include "SysUtil.h"
 #include "Logger.h"
 #include "Exception.h"
 
 #define MAX_RESULTS              200
 #define MAX_FIND_FILES_RESULTS  1000
+#define MAX_QUERY_RESULTS      10000
 
 
 using namespace QDirStat;
@@ -41,7 +49,7 @@ qreal TreeWalker::upperPercentileThreshold( PercentileStats & stats )
     {
         logDebug() << "Threshold: " << MAX_RESULTS << " items" << endl;
         int index = stats.dataSize() - MAX_RESULTS;
-        threshold = stats.data().at( index );
+        threshold = stats.valueAtRank( index );
     }
 
     return threshold;
@@ -68,7 +76,7 @@ qreal TreeWalker::lowerPercentileThreshold( PercentileStats & stats )
     {
         logDebug() << "Threshold: " << MAX_RESULTS << " items" << endl;
         int index = MAX_RESULTS;
-        threshold = stats.data().at( index );
+        threshold = stats.valueAtRank( index );
     }
 
     return threshold;
@@ -77,27 +85,99 @@ qreal TreeWalker::lowerPercentileThreshold( PercentileStats & stats )
 
 
 
-void LargestFilesTreeWalker::prepare( FileInfo * subtree )
+bool TreeWalker::mayHaveMtime( FileInfo * dir, time_t startTime, time_t endTime )
+{
+    // The latest mtime also includes directories, so it is only an upper
+    // limit for the files, but that is good enough for skipping subtrees.
+
+    if ( dir->latestMtime() < startTime )
+        return false;
+
+    time_t oldest = dir->oldestFileMtime();
+
+    // 0 means no files at all, but only if there is no file with mtime 0
+
+    if ( oldest >= endTime || ( oldest == 0 && dir->totalFiles() == 0 ) )
+        return false;
+
+    return true;
+}
+
+
+/**
+ * Return the time_t of 'date' at 00:00 UTC: FileInfo::mtimeYear() and
+ * FileInfo::mtimeMonth() use UTC, too.
+ **/
+static time_t startOfDay( const QDate & date )
+{
+    return QDateTime( date, QTime( 0, 0 ), Qt::UTC ).toTime_t();
+}
+
+
+FilesFromYearTreeWalker::FilesFromYearTreeWalker( short year ):
+    TreeWalker(),
+    _year( year )
+{
+    QDate start( year, 1, 1 );
+
+    _startTime = startOfDay( start );
+    _endTime   = startOfDay( start.addYears( 1 ) );
+}
+
+
+FilesFromMonthTreeWalker::FilesFromMonthTreeWalker( short year, short month ):
+    TreeWalker(),
+    _year( year ),
+    _month( month )
+{
+    QDate start( year, month, 1 );
+
+    _startTime = startOfDay( start );
+    _endTime   = startOfDay( start.addMonths( 1 ) );
+}
+
+
+void TopFilesTreeWalker::prepare( FileInfo * subtree )
 {
     TreeWalker::prepare( subtree );
-    FileSizeStats stats( subtree );
-    _threshold = (FileSize) upperPercentileThreshold( stats );
+    _topFiles.clear();
+
+    _topFiles = DiscoverCache::instance()->topFiles( subtree, _sortKey, _order, MAX_RESULTS );
+}
+
+
+bool TopFilesTreeWalker::findCandidates( FileInfo     * subtree,
+                                         FileInfoList & candidates )
+{
+    Q_UNUSED( subtree );
+
+    // Those were found for the same subtree in prepare() just before
+
+    candidates = _topFiles;
+    _topFiles.clear();
+
+    return true;
+}
+
+
+void LargestFilesTreeWalker::prepare( FileInfo * subtree )
+{
+    TopFilesTreeWalker::prepare( subtree );
+    _threshold = _topFiles.isEmpty() ? 0 : _topFiles.last()->size();
 }
 
 
 void NewFilesTreeWalker::prepare( FileInfo * subtree )
 {
-    TreeWalker::prepare( subtree );
-    FileMTimeStats stats( subtree );
-    _threshold = (time_t) upperPercentileThreshold( stats );
+    TopFilesTreeWalker::prepare( subtree );
+    _threshold = _topFiles.isEmpty() ? 0 : _topFiles.last()->mtime();
 }
 
 
 void OldFilesTreeWalker::prepare( FileInfo * subtree )
 {
-    TreeWalker::prepare( subtree );
-    FileMTimeStats stats( subtree );
-    _threshold = (time_t) lowerPercentileThreshold( stats );
+    TopFilesTreeWalker::prepare( subtree );
+    _threshold = _topFiles.isEmpty() ? 0 : _topFiles.last()->mtime();
 }
 
 
@@ -109,6 +189,25 @@ bool BrokenSymLinksTreeWalker::check( FileInfo * item )
 }
 
 
+bool CacheMismatchTreeWalker::check( FileInfo * item )
+{
+    return item && item->tree() &&
+        item->tree()->cacheVerifier()->mismatch( item ) != CacheMatch;
+}
+
+
+bool CacheMismatchTreeWalker::findCandidates( FileInfo     * subtree,
+                                              FileInfoList & candidates )
+{
+    if ( ! subtree || ! subtree->tree() )
+        return false;
+
+    candidates = subtree->tree()->cacheVerifier()->mismatches( subtree );
+
+    return true;
+}
+
+
 
 
 void FindFilesTreeWalker::prepare( FileInfo * subtree )
@@ -137,11 +236,98 @@ bool FindFilesTreeWalker::check( FileInfo * item )
          ( _filter.findSymLinks() && item->isSymLink() ) ||
          ( _filter.findPkg()      && item->isPkgInfo() )   )
     {
-        match = _filter.matches( item->name() );
+        const CompactName & name = item->compactName();
+        match = _filter.matchesUtf8( name.bytes(), name.byteLength() );
+    }
+
+    if ( match )
+        ++_count;
+
+    return match;
+}
+
+
+bool FindFilesTreeWalker::findCandidates( FileInfo     * subtree,
+                                          FileInfoList & candidates )
+{
+    return FileNameIndex::instance()->find( _filter, subtree, candidates );
+}
+
+
+void QueryTreeWalker::prepare( FileInfo * subtree )
+{
+    TreeWalker::prepare( subtree );
+    _count = 0;
+}
+
+
+bool QueryTreeWalker::check( FileInfo * item )
+{
+    if ( _count >= MAX_QUERY_RESULTS )
+    {
+        _overflow = true;
+
+        return false;
     }
 
+    bool match = _query.matches( item );
+
     if ( match )
         ++_count;
 
     return match;
 }
+
+
+bool QueryTreeWalker::findCandidates( FileInfo     * subtree,
+                                      FileInfoList & candidates )
+{
+    // Pseudo directories are not in the columns: Walk the tree for them
+
+    if ( ! subtree || ! subtree->isDirInfo() || subtree->isPseudoDir() )
+        return false;
+
+    candidates = _query.find( subtree->toDirInfo(), MAX_QUERY_RESULTS + 1 );
+
+    if ( candidates.size() > MAX_QUERY_RESULTS )
+    {
+        candidates.removeLast();
+        _overflow = true;
+    }
+
+    return true;
+}
+
+
+bool HardLinkedFilesTreeWalker::findCandidates( FileInfo     * subtree,
+                                                FileInfoList & candidates )
+{
+    if ( ! subtree || ! subtree->tree() )
+        return false;
+
+    candidates = subtree->tree()->hardLinks()->files( subtree );
+
+    return true;
+}
+
+
+void DuplicateFilesTreeWalker::prepare( FileInfo * subtree )
+{
+    TreeWalker::prepare( subtree );
+
+    _duplicates = DiscoverCache::instance()->duplicateFiles( subtree );
+}
+
+
+bool DuplicateFilesTreeWalker::findCandidates( FileInfo     * subtree,
+                                               FileInfoList & candidates )
+{
+    Q_UNUSED( subtree );
+
+    // Those were found for the same subtree in prepare() just before
+
+    candidates = _duplicates;
+    _duplicates.clear();
+
+    return true;
+}
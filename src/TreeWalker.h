@@ -12,6 +12,8 @@
 
 #include "FileInfo.h"
 #include "FileSearchFilter.h"
+#include "TopFilesCollector.h"
+#include "TreeQuery.h"
 
 
 namespace QDirStat
@@ -30,6 +32,7 @@ namespace QDirStat
      *   - newest files
      *   - oldest files
      *   - files with multiple hard links
+     *   - duplicate files
      *   - broken symlinks
      *   - sparse files
      **/
@@ -64,6 +67,28 @@ namespace QDirStat
          **/
         virtual bool check( FileInfo * item ) = 0;
 
+        /**
+         * Find the items in 'subtree' that might fit into the category
+         * without traversing the tree, e.g. by using an index, and add them
+         * to 'candidates'. Only those are then checked with check().
+         *
+         * Return 'true' if that was possible, 'false' if the complete tree
+         * needs to be traversed. This default implementation returns
+         * 'false'.
+         **/
+        virtual bool findCandidates( FileInfo     * subtree,
+                                     FileInfoList & candidates )
+            { Q_UNUSED( subtree ); Q_UNUSED( candidates ); return false; }
+
+        /**
+         * Return 'false' if nothing in the subtree of 'dir' can fit into the
+         * category, so that subtree does not need to be traversed. This is
+         * only a quick check based on what the directory already knows
+         * about its subtree. This default implementation returns 'true'.
+         **/
+        virtual bool checkSubtree( FileInfo * dir )
+            { Q_UNUSED( dir ); return true; }
+
         /**
          * Flag: Results overflow while walking the tree?
          *
@@ -87,6 +112,14 @@ namespace QDirStat
          **/
         qreal lowerPercentileThreshold( PercentileStats & stats );
 
+        /**
+         * Return 'true' if the subtree of 'dir' may contain files with a
+         * modification time from 'startTime' to 'endTime' (excluding
+         * 'endTime'), based on the oldest and latest modification time in
+         * that subtree.
+         **/
+        static bool mayHaveMtime( FileInfo * dir, time_t startTime, time_t endTime );
+
 
         //
         // Data members
@@ -97,13 +130,53 @@ namespace QDirStat
     };  // class TreeWalker
 
 
+    /**
+     * Abstract base class for TreeWalkers to find the top n files by size or
+     * modification time: prepare() gets them from the DiscoverCache, which
+     * finds them with TopFilesCollectors in one single traversal of the tree
+     * for all those walkers, and only those are checked.
+     **/
+    class TopFilesTreeWalker: public TreeWalker
+    {
+    public:
+
+        TopFilesTreeWalker( TopFilesCollector::SortKey sortKey,
+                            Qt::SortOrder              order ):
+            TreeWalker(),
+            _sortKey( sortKey ),
+            _order( order )
+            {}
+
+        /**
+         * Find the top files.
+         **/
+        virtual void prepare( FileInfo * subtree );
+
+        /**
+         * Return the top files that were found in prepare().
+         **/
+        virtual bool findCandidates( FileInfo     * subtree,
+                                     FileInfoList & candidates );
+
+    protected:
+
+        TopFilesCollector::SortKey _sortKey;
+        Qt::SortOrder              _order;
+        FileInfoList               _topFiles;   // The best one first
+    };
+
+
     /**
      * TreeWalker to find the largest files.
      **/
-    class LargestFilesTreeWalker: public TreeWalker
+    class LargestFilesTreeWalker: public TopFilesTreeWalker
     {
     public:
 
+        LargestFilesTreeWalker():
+            TopFilesTreeWalker( TopFilesCollector::BySize, Qt::DescendingOrder )
+            {}
+
         /**
          * Find the threshold for what is considered a "large file".
          **/
@@ -121,10 +194,14 @@ namespace QDirStat
     /**
      * TreeWalker to find new files.
      **/
-    class NewFilesTreeWalker: public TreeWalker
+    class NewFilesTreeWalker: public TopFilesTreeWalker
     {
     public:
 
+        NewFilesTreeWalker():
+            TopFilesTreeWalker( TopFilesCollector::ByMTime, Qt::DescendingOrder )
+            {}
+
         /**
          * Find the threshold for what is considered a "new file".
          **/
@@ -142,10 +219,14 @@ namespace QDirStat
     /**
      * TreeWalker to find old files.
      **/
-    class OldFilesTreeWalker: public TreeWalker
+    class OldFilesTreeWalker: public TopFilesTreeWalker
     {
     public:
 
+        OldFilesTreeWalker():
+            TopFilesTreeWalker( TopFilesCollector::ByMTime, Qt::AscendingOrder )
+            {}
+
         /**
          * Find the threshold for what is considered an "old file".
          **/
@@ -169,6 +250,42 @@ namespace QDirStat
 
         virtual bool check( FileInfo * item )
             { return item && item->isFile() && item->links() > 1; }
+
+        /**
+         * Take the candidates from the hard link index of the tree instead
+         * of traversing the whole subtree.
+         **/
+        virtual bool findCandidates( FileInfo     * subtree,
+                                     FileInfoList & candidates );
+    };
+
+
+    /**
+     * TreeWalker to find files with identical contents: prepare() gets
+     * them from the DiscoverCache, which finds them with a DuplicateFinder,
+     * and only those are checked.
+     **/
+    class DuplicateFilesTreeWalker: public TreeWalker
+    {
+    public:
+
+        /**
+         * Find the duplicate files.
+         **/
+        virtual void prepare( FileInfo * subtree );
+
+        virtual bool check( FileInfo * item )
+            { return item && item->isFile(); }
+
+        /**
+         * Return the duplicate files that were found in prepare().
+         **/
+        virtual bool findCandidates( FileInfo     * subtree,
+                                     FileInfoList & candidates );
+
+    protected:
+
+        FileInfoList _duplicates;
     };
 
 
@@ -195,6 +312,25 @@ namespace QDirStat
     };
 
 
+    /**
+     * TreeWalker to find the items that don't match the disk after
+     * checking the tree against it with its CacheVerifier.
+     **/
+    class CacheMismatchTreeWalker: public TreeWalker
+    {
+    public:
+
+        virtual bool check( FileInfo * item );
+
+        /**
+         * Take the candidates from the results of the CacheVerifier of the
+         * tree instead of traversing the whole subtree.
+         **/
+        virtual bool findCandidates( FileInfo     * subtree,
+                                     FileInfoList & candidates );
+    };
+
+
     /**
      * TreeWalker to find files with the specified modification year.
      **/
@@ -202,17 +338,19 @@ namespace QDirStat
     {
     public:
 
-        FilesFromYearTreeWalker( short year ):
-            TreeWalker(),
-            _year( year )
-            {}
+        FilesFromYearTreeWalker( short year );
 
         virtual bool check( FileInfo * item )
             { return item && item->isFile() && item->mtimeYear() == _year; }
 
+        virtual bool checkSubtree( FileInfo * dir )
+            { return mayHaveMtime( dir, _startTime, _endTime ); }
+
     protected:
 
-        short _year;
+        short  _year;
+        time_t _startTime;
+        time_t _endTime;
     };
 
 
@@ -223,11 +361,7 @@ namespace QDirStat
     {
     public:
 
-        FilesFromMonthTreeWalker( short year, short month ):
-            TreeWalker(),
-            _year( year ),
-            _month( month )
-            {}
+        FilesFromMonthTreeWalker( short year, short month );
 
         virtual bool check( FileInfo * item )
             {
@@ -236,10 +370,15 @@ namespace QDirStat
                     && item->mtimeMonth() == _month;
             }
 
+        virtual bool checkSubtree( FileInfo * dir )
+            { return mayHaveMtime( dir, _startTime, _endTime ); }
+
     protected:
 
-        short _year;
-        short _month;
+        short  _year;
+        short  _month;
+        time_t _startTime;
+        time_t _endTime;
     };
 
 
@@ -259,12 +398,47 @@ namespace QDirStat
 
         virtual bool check( FileInfo * item );
 
+        /**
+         * Find the items with a matching name with the FileNameIndex.
+         **/
+        virtual bool findCandidates( FileInfo     * subtree,
+                                     FileInfoList & candidates );
+
     protected:
 
         FileSearchFilter _filter;
         int              _count;
     };
 
+
+    /**
+     * TreeWalker to find the items that match a TreeQuery.
+     **/
+    class QueryTreeWalker: public TreeWalker
+    {
+    public:
+        QueryTreeWalker( const TreeQuery & query ):
+            TreeWalker(),
+            _query( query ),
+            _count( 0 )
+            {}
+
+        virtual void prepare( FileInfo * subtree );
+
+        virtual bool check( FileInfo * item );
+
+        /**
+         * Find the matching items in the columns of the subtree.
+         **/
+        virtual bool findCandidates( FileInfo     * subtree,
+                                     FileInfoList & candidates );
+
+    protected:
+
+        TreeQuery _query;
+        int       _count;
+    };
+
 }       // namespace QDirStat
 
 #endif  // TreeWalker_h
@@ -0,0 +1,719 @@
+/*
+ *   File name: TreemapExporter.cpp
+ *   Summary:	Export of a treemap to a PNG or SVG file
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// memset()
+#include <iostream>	// cerr
+
+#include <zlib.h>
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThread>
+
+#include "TreemapExporter.h"
+#include "TreemapLayout.h"
+#include "TreemapView.h"	// DefaultMinTileSize, DefaultAmbientLight
+#include "DirTree.h"
+#include "FileInfo.h"
+#include "MimeCategorizer.h"
+#include "Settings.h"
+#include "SettingsHelpers.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Number of rows that one thread renders in one go
+
+#define EXPORT_STRIP_HEIGHT	128
+
+#define EXPORT_MAX_THREADS	8
+
+// Size of the compressed data in one IDAT chunk of a PNG file
+
+#define PNG_CHUNK_SIZE		( 256 * 1024 )
+
+// Write the SVG file in pieces of this size
+
+#define SVG_WRITE_SIZE		( 64 * 1024 )
+
+#define DEFAULT_EXPORT_SIZE	4096
+
+using std::cerr;
+using namespace QDirStat;
+
+
+/**
+ * Append 'value' in network byte order (big endian) as PNG requires it.
+ **/
+static void appendUInt32( QByteArray & out, quint32 value )
+{
+    out += (char) ( ( value >> 24 ) & 0xff );
+    out += (char) ( ( value >> 16 ) & 0xff );
+    out += (char) ( ( value >>	8 ) & 0xff );
+    out += (char) (   value	    & 0xff );
+}
+
+
+/**
+ * Return a PNG chunk of type 'type' with 'size' bytes of 'data'.
+ **/
+static QByteArray pngChunk( const char * type, const char * data, int size )
+{
+    QByteArray chunk;
+    chunk.reserve( size + 12 );
+
+    appendUInt32( chunk, size );
+    chunk.append( type, 4 );
+    chunk.append( data, size );
+
+    // The CRC is over the type and the data, not the length
+
+    uLong crc = crc32( 0L, Z_NULL, 0 );
+    crc = crc32( crc, (const Bytef *) chunk.constData() + 4, 4 + size );
+    appendUInt32( chunk, crc );
+
+    return chunk;
+}
+
+
+/**
+ * Fill 'pixels' of 'image' with 'color'. Anything outside the image is
+ * clipped.
+ **/
+static void fillPixels( QImage & image, const QRect & rect, QRgb color )
+{
+    QRect pixels = rect & image.rect();
+
+    for ( int y = pixels.top(); y <= pixels.bottom(); ++y )
+    {
+	QRgb * line = (QRgb *) image.scanLine( y );
+
+	for ( int x = pixels.left(); x <= pixels.right(); ++x )
+	    line[ x ] = color;
+    }
+}
+
+
+namespace QDirStat
+{
+    /**
+     * Thread pool job that renders one strip of a treemap export.
+     **/
+    class TreemapStripJob: public QRunnable
+    {
+    public:
+
+	TreemapStripJob( const TreemapExporter * exporter,
+			 const TreemapLayout   & layout,
+			 QImage		       * strip,
+			 int			 top ):
+	    QRunnable(),
+	    _exporter( exporter ),
+	    _layout( layout ),
+	    _strip( strip ),
+	    _top( top )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	    { _exporter->renderStrip( _layout, *_strip, _top ); }
+
+    protected:
+
+	const TreemapExporter * _exporter;
+	const TreemapLayout   & _layout;
+	QImage		      * _strip;
+	int			_top;
+    };
+
+
+    /**
+     * Encoder for a PNG file that gets the image row by row and returns
+     * the bytes for the file as soon as there are enough of them.
+     *
+     * The rows are stored with the "Sub" filter: Each byte is stored as the
+     * difference to the same color channel of the pixel to its left. That
+     * makes the smooth cushions compress a lot better.
+     **/
+    class PngStreamEncoder
+    {
+    public:
+
+	PngStreamEncoder( int width, int height ):
+	    _width( width ),
+	    _height( height ),
+	    _row( 1 + 3 * width, 0 ),
+	    _out( PNG_CHUNK_SIZE, 0 ),
+	    _outUsed( 0 )
+	    {
+		memset( &_zStream, 0, sizeof( _zStream ) );
+		deflateInit( &_zStream, Z_DEFAULT_COMPRESSION );
+	    }
+
+	~PngStreamEncoder()
+	    { deflateEnd( &_zStream ); }
+
+	/**
+	 * Return the signature and the header of the file.
+	 **/
+	QByteArray start();
+
+	/**
+	 * Add one row of pixels and return what is ready for the file.
+	 **/
+	QByteArray addRow( const QRgb * pixels );
+
+	/**
+	 * Return the rest of the file.
+	 **/
+	QByteArray finish();
+
+    protected:
+
+	/**
+	 * Compress 'size' bytes of 'data' and return the IDAT chunks that
+	 * are complete.
+	 **/
+	QByteArray compress( const char * data, int size, int flush );
+
+	int		_width;
+	int		_height;
+	z_stream	_zStream;
+	QByteArray	_row;
+	QByteArray	_out;
+	int		_outUsed;
+    };
+}
+
+
+QByteArray PngStreamEncoder::start()
+{
+    QByteArray header;
+    appendUInt32( header, _width  );
+    appendUInt32( header, _height );
+    header += (char) 8;		// Bit depth
+    header += (char) 2;		// Color type: RGB
+    header += (char) 0;		// Compression method: deflate
+    header += (char) 0;		// Filter method: adaptive
+    header += (char) 0;		// No interlace
+
+    QByteArray data( "\x89PNG\r\n\x1a\n", 8 );
+    data += pngChunk( "IHDR", header.constData(), header.size() );
+
+    return data;
+}
+
+
+QByteArray PngStreamEncoder::addRow( const QRgb * pixels )
+{
+    char * row = _row.data();
+    int	   red	 = 0;
+    int	   green = 0;
+    int	   blue	 = 0;
+
+    *row++ = 1;		// Filter type: Sub
+
+    for ( int x = 0; x < _width; ++x )
+    {
+	QRgb pixel = pixels[ x ];
+
+	*row++ = (char) ( qRed	 ( pixel ) - red   );
+	*row++ = (char) ( qGreen ( pixel ) - green );
+	*row++ = (char) ( qBlue	 ( pixel ) - blue  );
+
+	red   = qRed  ( pixel );
+	green = qGreen( pixel );
+	blue  = qBlue ( pixel );
+    }
+
+    return compress( _row.constData(), _row.size(), Z_NO_FLUSH );
+}
+
+
+QByteArray PngStreamEncoder::finish()
+{
+    QByteArray data = compress( 0, 0, Z_FINISH );
+    data += pngChunk( "IEND", 0, 0 );
+
+    return data;
+}
+
+
+QByteArray PngStreamEncoder::compress( const char * data, int size, int flush )
+{
+    QByteArray chunks;
+
+    _zStream.next_in  = (Bytef *) data;
+    _zStream.avail_in = size;
+
+    forever
+    {
+	_zStream.next_out  = (Bytef *) _out.data() + _outUsed;
+	_zStream.avail_out = _out.size() - _outUsed;
+
+	int result = deflate( &_zStream, flush );
+	_outUsed = _out.size() - _zStream.avail_out;
+
+	if ( _outUsed == _out.size() )
+	{
+	    chunks += pngChunk( "IDAT", _out.constData(), _outUsed );
+	    _outUsed = 0;
+	}
+
+	if ( flush == Z_FINISH ? result == Z_STREAM_END || result == Z_STREAM_ERROR :
+				 _zStream.avail_in == 0 && _zStream.avail_out > 0 )
+	{
+	    break;
+	}
+    }
+
+    if ( flush == Z_FINISH && _outUsed > 0 )
+    {
+	chunks += pngChunk( "IDAT", _out.constData(), _outUsed );
+	_outUsed = 0;
+    }
+
+    return chunks;
+}
+
+
+
+
+TreemapExporter::TreemapExporter():
+    _format( Png ),
+    _size( DEFAULT_EXPORT_SIZE, DEFAULT_EXPORT_SIZE ),
+    _ok( false ),
+    _file( 0 )
+{
+    _pool.setMaxThreadCount( qBound( 1, QThread::idealThreadCount(), EXPORT_MAX_THREADS ) );
+    readSettings();
+}
+
+
+TreemapExporter::~TreemapExporter()
+{
+    _pool.waitForDone();
+    delete _file;
+}
+
+
+void TreemapExporter::readSettings()
+{
+    // The same settings as the treemap view
+
+    Settings settings;
+    settings.beginGroup( "Treemaps" );
+
+    int ambientLight	= settings.value( "AmbientLight"  , DefaultAmbientLight ).toInt();
+    _squarify		= settings.value( "Squarify"	  , true  ).toBool();
+    _cushionShading	= settings.value( "CushionShading", true  ).toBool();
+    _minTileSize	= settings.value( "MinTileSize"	  , DefaultMinTileSize ).toInt();
+    _outlineColor	= readColorEntry( settings, "OutlineColor", Qt::black		      );
+    _dirFillColor	= readColorEntry( settings, "DirFillColor", QColor( 0x10, 0x7d, 0xb4 ) );
+
+    settings.endGroup();
+
+    // Same as TreemapView::cushionLight() with the light source from the
+    // paper about cushion treemaps
+
+    _light.ambient	   = (double) ambientLight / 255;
+    _light.lightX	   = ( 1 - _light.ambient ) * -0.09759;
+    _light.lightY	   = ( 1 - _light.ambient ) * -0.19518;
+    _light.lightZ	   = ( 1 - _light.ambient ) *  0.9759;
+    _light.enforceContrast = false;
+
+    _background = QColor( Qt::white ).rgb();
+}
+
+
+bool TreemapExporter::formatFromFileName( const QString & fileName, Format & format_ret )
+{
+    QString suffix = QFileInfo( fileName ).suffix().toLower();
+
+    if ( suffix == "png" )
+	format_ret = Png;
+    else if ( suffix == "svg" )
+	format_ret = Svg;
+    else
+	return false;
+
+    return true;
+}
+
+
+bool TreemapExporter::write( FileInfo * subtree, const QString & fileName )
+{
+    CHECK_PTR( subtree );
+
+    _ok = true;
+    _errorString.clear();
+
+    if ( ! formatFromFileName( fileName, _format ) )
+    {
+	_errorString = QString( "Unknown format for %1; use .png or .svg" ).arg( fileName );
+	return false;
+    }
+
+    if ( _size.width() < 1 || _size.height() < 1 )
+    {
+	_errorString = QString( "Invalid size %1x%2" ).arg( _size.width() ).arg( _size.height() );
+	return false;
+    }
+
+    _file = new QFile( fileName );
+    CHECK_NEW( _file );
+
+    if ( ! _file->open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+	_errorString = _file->errorString();
+	logError() << "Can't open " << fileName << ": " << _errorString << endl;
+	delete _file;
+	_file = 0;
+
+	return false;
+    }
+
+    logInfo() << "Exporting the treemap of " << subtree << " to " << fileName
+	      << " with " << _size.width() << "x" << _size.height() << " pixels" << endl;
+
+    // The subtree sums are calculated lazily; make sure they are all up to
+    // date before the layout threads get to see the tree.
+
+    subtree->totalAllocatedSize();
+
+    TreemapLayout layout( _squarify, _minTileSize );
+    layout.setParallel( true );
+    layout.layout( subtree, QRectF( 0.0, 0.0, _size.width(), _size.height() ) );
+
+    collectTileColors( layout );
+
+    if ( _format == Png )
+	writePng( layout );
+    else
+	writeSvg( layout );
+
+    _tileColors.clear();
+    _cushionTiles.clear();
+
+    _file->close();
+
+    if ( _ok && _file->error() != QFile::NoError )
+    {
+	_ok = false;
+	_errorString = _file->errorString();
+    }
+
+    delete _file;
+    _file = 0;
+
+    if ( _ok )
+	logInfo() << "Exported " << layout.size() << " tiles to " << fileName << endl;
+    else
+	QFile::remove( fileName );
+
+    return _ok;
+}
+
+
+void TreemapExporter::collectTileColors( const TreemapLayout & layout )
+{
+    const TreemapLayoutTileList & tiles = layout.tiles();
+    MimeCategorizer * categorizer = MimeCategorizer::instance();
+
+    _tileColors.resize( tiles.size() );
+    _cushionTiles.resize( tiles.size() );
+
+    for ( int i = 0; i < tiles.size(); ++i )
+    {
+	FileInfo * orig = tiles.at( i ).orig;
+	bool isDir = orig->isDir() || orig->isDotEntry() || orig->isPkgInfo();
+
+	_tileColors  [ i ] = isDir ? _dirFillColor.rgb() : categorizer->color( orig ).rgb();
+	_cushionTiles[ i ] = _cushionShading && ! isDir;
+    }
+}
+
+
+void TreemapExporter::writePng( const TreemapLayout & layout )
+{
+    const int width	 = _size.width();
+    const int height	 = _size.height();
+    const int batchSize	 = _pool.maxThreadCount();
+    const int stripCount = ( height + EXPORT_STRIP_HEIGHT - 1 ) / EXPORT_STRIP_HEIGHT;
+
+    PngStreamEncoder encoder( width, height );
+    writeData( encoder.start() );
+
+    // Two sets of strips: The threads render the next batch into one of
+    // them while the other one is compressed and written.
+
+    QVector<QImage> strips( 2 * batchSize );
+
+    for ( int i = 0; i < strips.size(); ++i )
+	strips[ i ] = QImage( width, EXPORT_STRIP_HEIGHT, QImage::Format_RGB32 );
+
+    for ( int batchStart = 0; batchStart < stripCount + batchSize && _ok; batchStart += batchSize )
+    {
+	_pool.waitForDone();	// The previous batch
+
+	// Start rendering the next batch
+
+	int set = ( batchStart / batchSize ) % 2;
+
+	for ( int i = 0; i < batchSize && batchStart + i < stripCount; ++i )
+	{
+	    int top = ( batchStart + i ) * EXPORT_STRIP_HEIGHT;
+	    _pool.start( new TreemapStripJob( this, layout, &strips[ set * batchSize + i ], top ) );
+	}
+
+	// Write the previous batch
+
+	if ( batchStart == 0 )
+	    continue;
+
+	int prevStart = batchStart - batchSize;
+	int prevSet   = 1 - set;
+
+	for ( int i = 0; i < batchSize && prevStart + i < stripCount && _ok; ++i )
+	{
+	    const QImage & strip = strips.at( prevSet * batchSize + i );
+	    int top  = ( prevStart + i ) * EXPORT_STRIP_HEIGHT;
+	    int rows = qMin( EXPORT_STRIP_HEIGHT, height - top );
+
+	    for ( int y = 0; y < rows; ++y )
+		writeData( encoder.addRow( (const QRgb *) strip.constScanLine( y ) ) );
+	}
+    }
+
+    _pool.waitForDone();
+
+    if ( _ok )
+	writeData( encoder.finish() );
+}
+
+
+void TreemapExporter::renderStrip( const TreemapLayout & layout,
+				   QImage	       & strip,
+				   int			 top ) const
+{
+    strip.fill( _background );
+
+    const QRectF stripRect( 0.0, top, strip.width(), strip.height() );
+    const QPointF origin( 0.0, top );
+    const TreemapLayoutTileList & tiles = layout.tiles();
+
+    int i = 0;
+
+    while ( i < tiles.size() )
+    {
+	const TreemapLayoutTile & tile = tiles.at( i );
+
+	if ( tile.rect.width() < 1.0 || tile.rect.height() < 1.0 || ! tile.rect.intersects( stripRect ) )
+	{
+	    i = tile.end;	// Nothing of this subtree is in this strip
+	    continue;
+	}
+
+	if ( _cushionTiles.at( i ) )
+	{
+	    CushionRenderer::renderCushion( strip, tile.rect, tile.surface,
+					    QColor( _tileColors.at( i ) ), _light, origin );
+	}
+	else
+	{
+	    QRect pixels( (int) tile.rect.x(),	   (int) tile.rect.y() - top,
+			  (int) tile.rect.width(), (int) tile.rect.height() );
+
+	    fillPixels( strip, pixels, _tileColors.at( i ) );
+
+	    if ( ! _cushionShading )
+	    {
+		// The outline at the top and at the left; the neighbours
+		// provide the other ones.
+
+		QRgb outline = _outlineColor.rgb();
+		fillPixels( strip, QRect( pixels.left(), pixels.top(), pixels.width(), 1 ), outline );
+		fillPixels( strip, QRect( pixels.left(), pixels.top(), 1, pixels.height() ), outline );
+	    }
+	}
+
+	++i;
+    }
+}
+
+
+void TreemapExporter::writeSvg( const TreemapLayout & layout )
+{
+    QByteArray out;
+
+    out += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    out += QString( "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+		    "width=\"%1\" height=\"%2\" viewBox=\"0 0 %1 %2\">\n" )
+	.arg( _size.width() ).arg( _size.height() ).toUtf8();
+
+    if ( _cushionShading )
+	out += "<g>\n";
+    else
+	out += "<g stroke=\"" + _outlineColor.name().toUtf8() + "\" stroke-width=\"0.5\">\n";
+
+    const TreemapLayoutTileList & tiles = layout.tiles();
+    int i = 0;
+
+    while ( i < tiles.size() && _ok )
+    {
+	const TreemapLayoutTile & tile = tiles.at( i );
+
+	if ( tile.rect.width() < 1.0 || tile.rect.height() < 1.0 )
+	{
+	    i = tile.end;	// The subtree is even smaller
+	    continue;
+	}
+
+	out += QString( "<rect x=\"%1\" y=\"%2\" width=\"%3\" height=\"%4\" fill=\"%5\"/>\n" )
+	    .arg( tile.rect.x(),      0, 'f', 1 )
+	    .arg( tile.rect.y(),      0, 'f', 1 )
+	    .arg( tile.rect.width(),  0, 'f', 1 )
+	    .arg( tile.rect.height(), 0, 'f', 1 )
+	    .arg( QColor( _tileColors.at( i ) ).name() ).toUtf8();
+
+	if ( out.size() >= SVG_WRITE_SIZE )
+	{
+	    writeData( out );
+	    out.clear();
+	}
+
+	++i;
+    }
+
+    out += "</g>\n</svg>\n";
+    writeData( out );
+}
+
+
+void TreemapExporter::writeData( const QByteArray & data )
+{
+    if ( ! _ok || data.isEmpty() )
+	return;
+
+    if ( _file->write( data ) != data.size() )
+    {
+	_ok = false;
+	_errorString = _file->errorString();
+	logError() << "Writing the treemap failed: " << _errorString << endl;
+    }
+}
+
+
+int TreemapExporter::run( int & argc, char ** argv )
+{
+    QCoreApplication app( argc, argv );
+    QStringList args = QCoreApplication::arguments();
+    args.removeFirst();		// Program name
+    args.removeFirst();		// --export-treemap
+
+    QString fileName;
+    QString source;
+    QString subtreePath;
+    QSize   size( DEFAULT_EXPORT_SIZE, DEFAULT_EXPORT_SIZE );
+    bool    ok = ! args.isEmpty();
+
+    if ( ok )
+	fileName = args.takeFirst();
+
+    while ( ok && ! args.isEmpty() )
+    {
+	QString arg = args.takeFirst();
+
+	if ( arg == "--size" && ! args.isEmpty() )
+	{
+	    QStringList dimensions = args.takeFirst().split( 'x' );
+	    bool widthOk  = false;
+	    bool heightOk = false;
+
+	    if ( dimensions.size() == 2 )
+	    {
+		size = QSize( dimensions.at( 0 ).toInt( &widthOk  ),
+			      dimensions.at( 1 ).toInt( &heightOk ) );
+	    }
+
+	    ok = widthOk && heightOk && size.width() > 0 && size.height() > 0;
+	}
+	else if ( arg == "--subtree" && ! args.isEmpty() )
+	{
+	    subtreePath = args.takeFirst();
+	}
+	else if ( ! arg.startsWith( "--" ) && source.isEmpty() )
+	{
+	    source = arg;
+	}
+	else
+	{
+	    ok = false;
+	}
+    }
+
+    Format format = Png;
+
+    if ( ok && ! formatFromFileName( fileName, format ) )
+    {
+	cerr << "qdirstat --export-treemap: Use .png or .svg for " << qPrintable( fileName ) << std::endl;
+	return 1;
+    }
+
+    if ( ! ok || source.isEmpty() )
+    {
+	cerr << "Usage: qdirstat --export-treemap <file.png|file.svg> [--size <w>x<h>]"
+	     << " [--subtree <dir>] <directory or cache file>" << std::endl;
+	return 1;
+    }
+
+    DirTree tree;
+    QEventLoop eventLoop;
+
+    QObject::connect( &tree,	  SIGNAL( finished() ),
+		      &eventLoop, SLOT	( quit()     ) );
+
+    if ( QFileInfo( source ).isFile() )
+    {
+	if ( ! tree.readCache( source, subtreePath ) )
+	{
+	    cerr << "qdirstat --export-treemap: Can't read cache file " << qPrintable( source ) << std::endl;
+	    return 1;
+	}
+    }
+    else
+    {
+	tree.startReading( source );
+    }
+
+    if ( tree.isBusy() )
+	eventLoop.exec();
+
+    FileInfo * subtree = subtreePath.isEmpty() ?
+	tree.firstToplevel() : tree.locate( subtreePath );
+
+    if ( ! subtree )
+    {
+	cerr << "qdirstat --export-treemap: Nothing read from " << qPrintable( source ) << std::endl;
+	return 1;
+    }
+
+    TreemapExporter exporter;
+    exporter.setSize( size );
+
+    if ( ! exporter.write( subtree, fileName ) )
+    {
+	cerr << "qdirstat --export-treemap: " << qPrintable( exporter.errorString() ) << std::endl;
+	return 1;
+    }
+
+    return 0;
+}
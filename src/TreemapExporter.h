@@ -0,0 +1,166 @@
+/*
+ *   File name: TreemapExporter.h
+ *   Summary:	Export of a treemap to a PNG or SVG file
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreemapExporter_h
+#define TreemapExporter_h
+
+
+#include <QByteArray>
+#include <QColor>
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+#include "CushionRenderer.h"	// CushionLight
+
+
+class QFile;
+
+
+namespace QDirStat
+{
+    class FileInfo;
+    class TreemapLayout;
+    class TreemapStripJob;
+
+
+    /**
+     * Export of the treemap of a subtree to a PNG or SVG file of any size,
+     * e.g. 16384 x 16384 pixels for printed capacity reports, without any
+     * treemap view.
+     *
+     * A PNG file is rendered in strips of rows that are shaded in a thread
+     * pool and compressed and written one after the other while the next
+     * ones are shaded, so the memory for the image is bounded by a few
+     * strips, no matter how large it is. An SVG file has one rectangle for
+     * each tile with its plain color; there are no cushions.
+     *
+     * The treemap settings (colors, light, squarified or not, minimum tile
+     * size) are the same as for the treemap view.
+     **/
+    class TreemapExporter
+    {
+    public:
+
+	enum Format
+	{
+	    Png,
+	    Svg
+	};
+
+	/**
+	 * Constructor.
+	 **/
+	TreemapExporter();
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~TreemapExporter();
+
+	/**
+	 * Set the size of the treemap in pixels.
+	 **/
+	void setSize( const QSize & size ) { _size = size; }
+
+	/**
+	 * Return the size of the treemap in pixels.
+	 **/
+	const QSize & size() const { return _size; }
+
+	/**
+	 * Export the treemap of 'subtree' to 'fileName' in the format for
+	 * its suffix. Return 'true' if success, 'false' if not; see
+	 * errorString().
+	 **/
+	bool write( FileInfo * subtree, const QString & fileName );
+
+	/**
+	 * Return the error of the last write().
+	 **/
+	const QString & errorString() const { return _errorString; }
+
+	/**
+	 * Return the format for the suffix of 'fileName' in 'format_ret':
+	 * .png or .svg. Return 'false' if that suffix is unknown.
+	 **/
+	static bool formatFromFileName( const QString & fileName, Format & format_ret );
+
+	/**
+	 * Run an export from the command line:
+	 *
+	 *   qdirstat --export-treemap <file.png|file.svg> [--size <w>x<h>]
+	 *	      [--subtree <dir>] <directory or cache file>
+	 *
+	 * Return the exit code for the program.
+	 **/
+	static int run( int & argc, char ** argv );
+
+
+    protected:
+
+	friend class TreemapStripJob;
+
+	/**
+	 * Read the treemap settings of the treemap view.
+	 **/
+	void readSettings();
+
+	/**
+	 * Copy the color of each tile of 'layout' to _tileColors: The tree
+	 * may only be used in this thread.
+	 **/
+	void collectTileColors( const TreemapLayout & layout );
+
+	/**
+	 * Write 'layout' as a PNG image to _file.
+	 **/
+	void writePng( const TreemapLayout & layout );
+
+	/**
+	 * Write 'layout' as an SVG image to _file.
+	 **/
+	void writeSvg( const TreemapLayout & layout );
+
+	/**
+	 * Render the rows of 'layout' that start at 'top' into 'strip'.
+	 * This is called in the worker threads; it only uses 'layout' and
+	 * _tileColors.
+	 **/
+	void renderStrip( const TreemapLayout & layout, QImage & strip, int top ) const;
+
+	/**
+	 * Write 'data' to the file and remember any error.
+	 **/
+	void writeData( const QByteArray & data );
+
+
+	Format			_format;
+	QSize			_size;
+	bool			_squarify;
+	int			_minTileSize;
+	bool			_cushionShading;
+	CushionLight		_light;
+	QColor			_outlineColor;
+	QColor			_dirFillColor;
+	QRgb			_background;
+	QVector<QRgb>		_tileColors;
+	QVector<bool>		_cushionTiles;
+	bool			_ok;
+	QString			_errorString;
+	QFile *			_file;
+	QThreadPool		_pool;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreemapExporter_h
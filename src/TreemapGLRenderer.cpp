@@ -0,0 +1,287 @@
+/*
+ *   File name: TreemapGLRenderer.cpp
+ *   Summary:	Treemap cushion shading with OpenGL for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "TreemapGLRenderer.h"
+
+#if HAVE_TREEMAP_GL
+
+#include <stddef.h>	// offsetof()
+
+#include <QPainter>
+#include <QPaintEngine>
+#include <QOpenGLWidget>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QMatrix4x4>
+
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+// Attribute locations
+
+#define ATTR_CORNER	0
+#define ATTR_RECT	1
+#define ATTR_SURFACE	2
+#define ATTR_COLOR	3
+
+
+// The same calculation as CushionRenderer::shadeCushion(), only per
+// fragment: The surface normal at the pixel center is
+//
+//     nx = 2 * xx2 * x + xx1
+//     ny = 2 * yy2 * y + yy1
+//
+// with the interpolated scene position (x, y), and that is lit by the
+// ambient light and the directed light source.
+
+static const char * vertexShaderBody =
+    "in vec2 corner;\n"
+    "in vec4 rect;\n"
+    "in vec4 surface;\n"
+    "in vec3 color;\n"
+    "uniform mat4 matrix;\n"
+    "out vec2 scenePos;\n"
+    "out vec4 cushionSurface;\n"
+    "out vec3 cushionColor;\n"
+    "void main()\n"
+    "{\n"
+    "    scenePos       = rect.xy + corner * rect.zw;\n"
+    "    cushionSurface = surface;\n"
+    "    cushionColor   = color;\n"
+    "    gl_Position    = matrix * vec4( scenePos, 0.0, 1.0 );\n"
+    "}\n";
+
+static const char * fragmentShaderBody =
+    "in vec2 scenePos;\n"
+    "in vec4 cushionSurface;\n"
+    "in vec3 cushionColor;\n"
+    "uniform vec4 light; // ambient, lightX, lightY, lightZ\n"
+    "out vec4 fragColor;\n"
+    "void main()\n"
+    "{\n"
+    "    float nx   = 2.0 * cushionSurface.x * scenePos.x + cushionSurface.y;\n"
+    "    float ny   = 2.0 * cushionSurface.z * scenePos.y + cushionSurface.w;\n"
+    "    float cosa = ( light.w - ny * light.z - nx * light.y ) / sqrt( nx * nx + ny * ny + 1.0 );\n"
+    "    float intensity = max( cosa, 0.0 ) + light.x;\n"
+    "    fragColor = vec4( min( cushionColor * intensity, vec3( 1.0 ) ), 1.0 );\n"
+    "}\n";
+
+
+TreemapGLRenderer::TreemapGLRenderer( QOpenGLWidget * widget ):
+    _widget( widget ),
+    _cornerBuffer( QOpenGLBuffer::VertexBuffer ),
+    _cushionBuffer( QOpenGLBuffer::VertexBuffer ),
+    _initialized( false ),
+    _failed( false ),
+    _uploadPending( false )
+{
+    CHECK_PTR( widget );
+}
+
+
+TreemapGLRenderer::~TreemapGLRenderer()
+{
+    if ( _initialized )
+    {
+	// The OpenGL resources belong to the widget's context
+
+	_widget->makeCurrent();
+
+	_vao.destroy();
+	_cushionBuffer.destroy();
+	_cornerBuffer.destroy();
+	_program.removeAllShaders();
+
+	_widget->doneCurrent();
+    }
+}
+
+
+bool TreemapGLRenderer::isOpenGL( QPainter * painter )
+{
+    QPaintEngine * engine = painter->paintEngine();
+
+    return engine && engine->type() == QPaintEngine::OpenGL2;
+}
+
+
+void TreemapGLRenderer::setCushions( const QVector<TreemapGLCushion> & cushions )
+{
+    _cushions	   = cushions;
+    _uploadPending = true;
+}
+
+
+bool TreemapGLRenderer::init()
+{
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+
+    if ( ! context )
+	return false;
+
+    // Instanced drawing and the 'in' / 'out' shader syntax need OpenGL 3.3
+    // or OpenGL ES 3.0
+
+    const QSurfaceFormat format = context->format();
+    const QPair<int, int> version = format.version();
+    QByteArray header;
+
+    if ( context->isOpenGLES() )
+    {
+	if ( version < qMakePair( 3, 0 ) )
+	{
+	    logWarning() << "Need OpenGL ES 3.0 for the treemap; have "
+			 << version.first << "." << version.second << endl;
+	    return false;
+	}
+
+	header = "#version 300 es\nprecision highp float;\n";
+    }
+    else
+    {
+	if ( version < qMakePair( 3, 3 ) )
+	{
+	    logWarning() << "Need OpenGL 3.3 for the treemap; have "
+			 << version.first << "." << version.second << endl;
+	    return false;
+	}
+
+	header = "#version 330 core\n";
+    }
+
+    if ( ! _program.addShaderFromSourceCode( QOpenGLShader::Vertex,   header + vertexShaderBody	 ) ||
+	 ! _program.addShaderFromSourceCode( QOpenGLShader::Fragment, header + fragmentShaderBody ) )
+    {
+	logError() << "Compiling the treemap shaders failed: " << _program.log() << endl;
+	return false;
+    }
+
+    _program.bindAttributeLocation( "corner",  ATTR_CORNER  );
+    _program.bindAttributeLocation( "rect",    ATTR_RECT    );
+    _program.bindAttributeLocation( "surface", ATTR_SURFACE );
+    _program.bindAttributeLocation( "color",   ATTR_COLOR   );
+
+    if ( ! _program.link() )
+    {
+	logError() << "Linking the treemap shaders failed: " << _program.log() << endl;
+	return false;
+    }
+
+    if ( ! _vao.create() )
+	return false;
+
+    QOpenGLVertexArrayObject::Binder vaoBinder( &_vao );
+    QOpenGLExtraFunctions * gl = context->extraFunctions();
+
+
+    // The corners of one tile as a triangle strip: the same for all tiles
+
+    static const float corners[] = { 0.0f, 0.0f,   1.0f, 0.0f,   0.0f, 1.0f,   1.0f, 1.0f };
+
+    _cornerBuffer.create();
+    _cornerBuffer.bind();
+    _cornerBuffer.allocate( corners, sizeof( corners ) );
+
+    gl->glEnableVertexAttribArray( ATTR_CORNER );
+    gl->glVertexAttribPointer( ATTR_CORNER, 2, GL_FLOAT, GL_FALSE, 0, 0 );
+    _cornerBuffer.release();
+
+
+    // Everything else once for each tile
+
+    _cushionBuffer.create();
+    _cushionBuffer.setUsagePattern( QOpenGLBuffer::StaticDraw );
+    _cushionBuffer.bind();
+
+    const GLsizei stride = sizeof( TreemapGLCushion );
+
+    gl->glEnableVertexAttribArray( ATTR_RECT    );
+    gl->glEnableVertexAttribArray( ATTR_SURFACE );
+    gl->glEnableVertexAttribArray( ATTR_COLOR   );
+
+    gl->glVertexAttribPointer( ATTR_RECT,    4, GL_FLOAT, GL_FALSE, stride,
+			       (const void *) offsetof( TreemapGLCushion, rect    ) );
+    gl->glVertexAttribPointer( ATTR_SURFACE, 4, GL_FLOAT, GL_FALSE, stride,
+			       (const void *) offsetof( TreemapGLCushion, surface ) );
+    gl->glVertexAttribPointer( ATTR_COLOR,   3, GL_FLOAT, GL_FALSE, stride,
+			       (const void *) offsetof( TreemapGLCushion, color   ) );
+
+    gl->glVertexAttribDivisor( ATTR_RECT,    1 );
+    gl->glVertexAttribDivisor( ATTR_SURFACE, 1 );
+    gl->glVertexAttribDivisor( ATTR_COLOR,   1 );
+
+    _cushionBuffer.release();
+
+    return true;
+}
+
+
+bool TreemapGLRenderer::draw( QPainter * painter, const CushionLight & light )
+{
+    if ( _failed )
+	return false;
+
+    painter->beginNativePainting();
+
+    if ( ! _initialized )
+    {
+	_initialized = true;	// even if it fails: clean up what was created
+
+	if ( ! init() )
+	{
+	    _failed = true;
+	    painter->endNativePainting();
+
+	    return false;
+	}
+    }
+
+    QOpenGLExtraFunctions * gl = QOpenGLContext::currentContext()->extraFunctions();
+    QOpenGLVertexArrayObject::Binder vaoBinder( &_vao );
+
+    if ( _uploadPending )
+    {
+	_cushionBuffer.bind();
+	_cushionBuffer.allocate( _cushions.constData(), _cushions.size() * sizeof( TreemapGLCushion ) );
+	_cushionBuffer.release();
+	_uploadPending = false;
+    }
+
+    // From scene coordinates to normalized device coordinates: The same
+    // transformation that the painter uses, then from device pixels to
+    // -1.0 .. 1.0 (with the y axis upwards).
+
+    const QPaintDevice * device = painter->device();
+    QMatrix4x4 matrix;
+    matrix.ortho( 0, device->width(), device->height(), 0, -1, 1 );
+    matrix *= QMatrix4x4( painter->combinedTransform() );
+
+    _program.bind();
+    _program.setUniformValue( "matrix", matrix );
+    _program.setUniformValue( "light",
+			      (float) light.ambient,
+			      (float) light.lightX,
+			      (float) light.lightY,
+			      (float) light.lightZ );
+
+    gl->glDisable( GL_BLEND );
+    gl->glDisable( GL_DEPTH_TEST );
+    gl->glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, _cushions.size() );
+
+    _program.release();
+    painter->endNativePainting();
+
+    return true;
+}
+
+#endif // HAVE_TREEMAP_GL
@@ -0,0 +1,131 @@
+/*
+ *   File name: TreemapGLRenderer.h
+ *   Summary:	Treemap cushion shading with OpenGL for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreemapGLRenderer_h
+#define TreemapGLRenderer_h
+
+
+#include <QtGlobal>
+
+// Instanced drawing needs QOpenGLExtraFunctions
+
+#if QT_VERSION >= QT_VERSION_CHECK( 5, 6, 0 )
+#  define HAVE_TREEMAP_GL	1
+#else
+#  define HAVE_TREEMAP_GL	0
+#endif
+
+
+#if HAVE_TREEMAP_GL
+
+#include <QVector>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+
+#include "TreemapLayout.h"
+#include "CushionRenderer.h"	// CushionLight
+
+
+class QPainter;
+class QOpenGLWidget;
+
+
+namespace QDirStat
+{
+    /**
+     * The per-tile data that is uploaded to the GPU for each cushion.
+     **/
+    struct TreemapGLCushion
+    {
+	float rect[4];		// x, y, width, height
+	float surface[4];	// xx2, xx1, yy2, yy1
+	float color[3];		// red, green, blue: 0.0 .. 1.0
+    };
+
+
+    /**
+     * Shade the cushions of a treemap on the GPU.
+     *
+     * The cushion of a tile is a function of its rectangle and the four
+     * coefficients of its cushion surface, so the fragment shader can
+     * calculate it for each pixel from nothing but that and the light
+     * source. All cushions are uploaded once as instance data and drawn
+     * with one single instanced draw call, so they can be redrawn at any
+     * time at next to no cost.
+     *
+     * This needs an OpenGL 3.3 or OpenGL ES 3.0 context, i.e. a treemap view
+     * with a QOpenGLWidget viewport. All methods must be called with that
+     * context current, i.e. from a paint() method between
+     * QPainter::beginNativePainting() and QPainter::endNativePainting().
+     **/
+    class TreemapGLRenderer
+    {
+    public:
+
+	/**
+	 * Constructor. 'widget' is the OpenGL viewport that this renders in.
+	 **/
+	TreemapGLRenderer( QOpenGLWidget * widget );
+
+	/**
+	 * Destructor. This makes the widget's context current to release
+	 * the OpenGL resources.
+	 **/
+	virtual ~TreemapGLRenderer();
+
+	/**
+	 * Set the cushions to draw. They are uploaded to the GPU with the
+	 * next draw().
+	 **/
+	void setCushions( const QVector<TreemapGLCushion> & cushions );
+
+	/**
+	 * Draw all cushions with 'light' to 'painter' (which must be
+	 * painting on the OpenGL widget of this renderer).
+	 *
+	 * Return 'false' if the cushions can't be drawn because the OpenGL
+	 * context does not support what is needed; the caller should then
+	 * render them with the CPU.
+	 **/
+	bool draw( QPainter * painter, const CushionLight & light );
+
+	/**
+	 * Return 'true' if 'painter' is painting with OpenGL, i.e. on the
+	 * viewport of a treemap view that uses OpenGL.
+	 **/
+	static bool isOpenGL( QPainter * painter );
+
+
+    protected:
+
+	/**
+	 * Create the shader program and the buffers. Return 'true' on
+	 * success.
+	 **/
+	bool init();
+
+
+	QOpenGLWidget *			_widget;
+	QOpenGLShaderProgram		_program;
+	QOpenGLBuffer			_cornerBuffer;
+	QOpenGLBuffer			_cushionBuffer;
+	QOpenGLVertexArrayObject	_vao;
+	QVector<TreemapGLCushion>	_cushions;
+	bool				_initialized;
+	bool				_failed;
+	bool				_uploadPending;
+
+    };	// class TreemapGLRenderer
+
+}	// namespace QDirStat
+
+#endif // HAVE_TREEMAP_GL
+
+#endif // ifndef TreemapGLRenderer_h
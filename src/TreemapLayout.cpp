@@ -0,0 +1,565 @@
+/*
+ *   File name: TreemapLayout.cpp
+ *   Summary:	Treemap layout for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <math.h>    // round(), ceil()
+
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
+#include "TreemapLayout.h"
+#include "FileInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Subtrees with at least this many items are laid out by another thread in
+// the parallel layout mode; smaller ones are not worth the overhead.
+#define PARALLEL_LAYOUT_MIN_ITEMS	20000
+
+
+namespace QDirStat
+{
+    /**
+     * Thread pool job for one deferred subtree of a parallel layout.
+     **/
+    class TreemapLayoutJob: public QRunnable
+    {
+    public:
+
+	TreemapLayoutJob( TreemapLayout	       * layout,
+			  FileInfo	       * root,
+			  const QRectF	       & rect,
+			  const CushionSurface & surface,
+			  Orientation		 orientation ):
+	    _layout( layout ),
+	    _root( root ),
+	    _rect( rect ),
+	    _surface( surface ),
+	    _orientation( orientation )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	    { _layout->addTile( _root, _rect, _surface, -1, _orientation ); }
+
+    protected:
+
+	TreemapLayout * _layout;
+	FileInfo *	_root;
+	QRectF		_rect;
+	CushionSurface	_surface;
+	Orientation	_orientation;
+    };
+}
+
+
+using namespace QDirStat;
+
+
+TreemapLayout::TreemapLayout( bool squarify, int minTileSize ):
+    _squarify( squarify ),
+    _minTileSize( minTileSize ),
+    _generation( 0 ),
+    _expectedGeneration( 0 ),
+    _maxDepth( 0 ),
+    _depth( 0 ),
+    _truncated( false ),
+    _parallel( false ),
+    _threadPool( 0 )
+{
+    // NOP
+}
+
+
+void TreemapLayout::clear()
+{
+    _tiles.clear();
+    _index.clear();
+}
+
+
+void TreemapLayout::setCancelCheck( const QAtomicInt * generation, int expected )
+{
+    _generation		= generation;
+    _expectedGeneration = expected;
+}
+
+
+void TreemapLayout::layout( FileInfo * root, const QRectF & rect )
+{
+    layout( root, rect, CushionSurface() );
+}
+
+
+void TreemapLayout::layout( FileInfo		 * root,
+			    const QRectF	 & rect,
+			    const CushionSurface & surface )
+{
+    clear();
+    _rect      = rect;
+    _depth     = 0;
+    _truncated = false;
+
+    if ( ! root )
+	return;
+
+    if ( _parallel && root->totalItems() >= PARALLEL_LAYOUT_MIN_ITEMS )
+    {
+	// Large subtrees go to the thread pool, and they hand on large
+	// subtrees of their own in the same way, so the threads keep
+	// taking the next subtree until all are done.
+
+	QThreadPool threadPool;
+	threadPool.setMaxThreadCount( qMax( 1, QThread::idealThreadCount() ) );
+	_threadPool = &threadPool;
+
+	addTile( root, rect, surface, -1, TreemapAuto );
+
+	threadPool.waitForDone();
+	_threadPool = 0;
+
+	mergeDeferred();
+    }
+    else
+    {
+	addTile( root, rect, surface, -1, TreemapAuto );
+    }
+}
+
+
+int TreemapLayout::addTile( FileInfo		 * orig,
+			    const QRectF	 & rect,
+			    const CushionSurface & surface,
+			    int			   parent,
+			    Orientation		   orientation )
+{
+    TreemapLayoutTile tile;
+    tile.orig	 = orig;
+    tile.rect	 = rect;
+    tile.surface = surface;
+    tile.parent	 = parent;
+    tile.end	 = -1;
+
+    // Don't keep any references to tiles across this: Adding more tiles
+    // might reallocate the list.
+
+    _tiles.append( tile );
+    int index = _tiles.size() - 1;
+
+    if ( _maxDepth > 0 && _depth >= _maxDepth )
+    {
+	if ( orig->hasChildren() )
+	    _truncated = true;
+    }
+    else if ( shouldDefer( index ) )
+    {
+	defer( index, orientation );
+    }
+    else if ( ! isCanceled() )
+    {
+	++_depth;
+	createChildren( index, orientation );
+	--_depth;
+    }
+
+    _tiles[ index ].end = _tiles.size();
+
+    return index;
+}
+
+
+bool TreemapLayout::shouldDefer( int index ) const
+{
+    // Never the root of a layout: That is what another thread lays out
+
+    if ( ! _threadPool || _tiles[ index ].parent < 0 )
+	return false;
+
+    FileInfo * orig = _tiles[ index ].orig;
+
+    return orig->isDirInfo() && orig->totalItems() >= PARALLEL_LAYOUT_MIN_ITEMS;
+}
+
+
+void TreemapLayout::defer( int index, Orientation orientation )
+{
+    const TreemapLayoutTile & tile = _tiles[ index ];
+
+    TreemapLayout * subLayout = new TreemapLayout( _squarify, _minTileSize );
+    CHECK_NEW( subLayout );
+
+    subLayout->_rect		   = tile.rect;
+    subLayout->_generation	   = _generation;
+    subLayout->_expectedGeneration = _expectedGeneration;
+    subLayout->_maxDepth	   = _maxDepth;
+    subLayout->_depth		   = _depth;
+    subLayout->_threadPool	   = _threadPool;
+
+    TreemapLayoutDeferred deferred;
+    deferred.index  = index;
+    deferred.layout = subLayout;
+    _deferred << deferred;
+
+    // The surface is the one before the caller adds the ridge of this tile,
+    // just like for the children in createChildren().
+
+    _threadPool->start( new TreemapLayoutJob( subLayout, tile.orig, tile.rect,
+					      tile.surface, orientation ) );
+}
+
+
+void TreemapLayout::mergeDeferred()
+{
+    if ( _deferred.isEmpty() )
+	return;
+
+    // The deferred subtrees might have deferred subtrees of their own
+
+    int count = _tiles.size();
+
+    for ( int i = 0; i < _deferred.size(); ++i )
+    {
+	_deferred[ i ].layout->mergeDeferred();
+	count += _deferred[ i ].layout->size() - 1;
+    }
+
+    // Insert the tiles of each deferred subtree after its root tile; that
+    // one stays as it is here because the caller of addTile() changed its
+    // surface. The deferred tiles are in the order of their indexes.
+
+    TreemapLayoutTileList tiles;
+    tiles.reserve( count );
+
+    QVector<int> newIndex( _tiles.size() );
+    int next = 0;
+
+    for ( int i = 0; i < _tiles.size(); ++i )
+    {
+	int base    = tiles.size();
+	newIndex[i] = base;
+
+	TreemapLayoutTile tile = _tiles[i];
+
+	if ( tile.parent >= 0 )		// The parent is always before the tile
+	    tile.parent = newIndex[ tile.parent ];
+
+	tiles << tile;
+
+	if ( next < _deferred.size() && _deferred[ next ].index == i )
+	{
+	    TreemapLayout * subLayout = _deferred[ next ].layout;
+	    const TreemapLayoutTileList & subTiles = subLayout->_tiles;
+
+	    for ( int j = 1; j < subTiles.size(); ++j )
+	    {
+		TreemapLayoutTile subTile = subTiles[j];
+		subTile.parent += base;
+		subTile.end    += base;
+		tiles << subTile;
+	    }
+
+	    if ( subLayout->_truncated )
+		_truncated = true;
+
+	    delete subLayout;
+	    ++next;
+	}
+    }
+
+    for ( int i = 0; i < _tiles.size(); ++i )
+    {
+	int end = _tiles[i].end;
+	tiles[ newIndex[i] ].end = end < _tiles.size() ? newIndex[ end ] : tiles.size();
+    }
+
+    _tiles = tiles;
+    _deferred.clear();
+    _index.clear();
+}
+
+
+void TreemapLayout::createChildren( int index, Orientation orientation )
+{
+    if ( _tiles[ index ].orig->totalAllocatedSize() == 0 )	// Prevent division by zero
+	return;
+
+    if ( _squarify )
+	createSquarifiedChildren( index );
+    else
+	createChildrenSimple( index, orientation );
+}
+
+
+void TreemapLayout::createChildrenSimple( int index, Orientation orientation )
+{
+    FileInfo *	 orig = _tiles[ index ].orig;
+    const QRectF rect = _tiles[ index ].rect;
+
+    Orientation dir	 = orientation;
+    Orientation childDir = orientation;
+
+    if ( dir == TreemapAuto )
+	dir = rect.width() > rect.height() ? TreemapHorizontal : TreemapVertical;
+
+    if ( orientation == TreemapHorizontal )  childDir = TreemapVertical;
+    if ( orientation == TreemapVertical	  )  childDir = TreemapHorizontal;
+
+    int offset	 = 0;
+    int size	 = dir == TreemapHorizontal ? rect.width() : rect.height();
+    double scale = (double) size / (double) orig->totalAllocatedSize();
+
+    _tiles[ index ].surface.addRidge( childDir, rect );
+    FileSize minSize = (FileSize) ( _minTileSize / scale );
+    FileInfoSortedBySizeIterator it( orig, minSize );
+
+    while ( *it )
+    {
+	int childSize = (int) ( scale * (*it)->totalAllocatedSize() );
+
+	if ( childSize >= _minTileSize )
+	{
+	    QRectF childRect;
+
+	    if ( dir == TreemapHorizontal )
+		childRect = QRectF( rect.x() + offset, rect.y(), childSize, rect.height() );
+	    else
+		childRect = QRectF( rect.x(), rect.y() + offset, rect.width(), childSize );
+
+	    int child = addTile( *it, childRect, _tiles[ index ].surface, index, childDir );
+	    _tiles[ child ].surface.addRidge( dir, childRect );
+
+	    offset += childSize;
+	}
+
+	++it;
+    }
+}
+
+
+void TreemapLayout::createSquarifiedChildren( int index )
+{
+    FileInfo *	 orig = _tiles[ index ].orig;
+    const QRectF rect = _tiles[ index ].rect;
+
+    if ( orig->totalAllocatedSize() == 0 )
+    {
+	logError()  << "Zero totalAllocatedSize()" << endl;
+	return;
+    }
+
+    double scale	= rect.width() * (double) rect.height() / orig->totalAllocatedSize();
+    FileSize minSize	= (FileSize) ( _minTileSize / scale );
+
+    FileInfoSortedBySizeIterator it( orig, minSize );
+    QRectF childrenRect = rect;
+
+    FileSize remainingTotal = 0;
+
+    for ( FileInfoSortedBySizeIterator item = it; *item; ++item )
+	remainingTotal += (*item)->totalAllocatedSize();
+
+    if ( minSize > 0 )
+	remainingTotal = orig->totalAllocatedSize();
+
+    while ( *it )
+    {
+	FileInfoList row = squarify( childrenRect, remainingTotal, it );
+	childrenRect = layoutRow( index, childrenRect, remainingTotal, row );
+
+	foreach ( FileInfo * item, row )
+	    remainingTotal -= item->totalAllocatedSize();
+    }
+}
+
+
+FileInfoList TreemapLayout::squarify( const QRectF		    & rect,
+				      FileSize			      remainingTotal,
+				      FileInfoSortedBySizeIterator  & it )
+{
+    FileInfoList row;
+    const double rectLength = qMin( rect.width(), rect.height() );
+    const double rectHeight = qMax( rect.width(), rect.height() );
+
+    if ( rectLength == 0 || rectHeight == 0 )	// Sanity check
+    {
+	if ( *it )	// Prevent endless loop in case of error:
+	    ++it;	// Advance iterator.
+
+	return row;
+    }
+
+    double bestAspectRatio = 0;
+    double sum		   = 0;
+
+    FileSize firstScale = (*it)->totalAllocatedSize() * rectLength;
+
+    while ( *it )
+    {
+	const FileSize size = (*it)->totalAllocatedSize();
+	sum += size;
+
+	if ( size != 0 && sum != 0 )
+	{
+	    const double height      = rectHeight * sum / remainingTotal;
+	    const double firstWidth  = firstScale / sum;
+	    const double lastWidth   = rectLength * size / sum;
+	    const double aspectRatio = qMin( height / firstWidth, lastWidth / height );
+
+	    if ( aspectRatio < bestAspectRatio )
+		break;
+
+	    bestAspectRatio = aspectRatio;
+	}
+
+	row.append( *it );
+	++it;
+    }
+
+    return row;
+}
+
+
+QRectF TreemapLayout::layoutRow( int		index,
+				 const QRectF & rect,
+				 FileSize	remainingTotal,
+				 FileInfoList & row )
+{
+    if ( row.isEmpty() )
+	return rect;
+
+    // Determine the direction in which to subdivide.
+    // We always use the longer side of the rectangle.
+    Orientation dir = rect.width() < rect.height() ? TreemapHorizontal : TreemapVertical;
+
+    // This row's primary length is the shorter one.
+    int primary = qMin( rect.width(), rect.height() );
+
+    // This row's secondary length is determined by the area (the number of
+    // pixels) to be allocated for all of the row's items.
+
+    FileSize sum = 0;
+
+    foreach ( FileInfo * item, row )
+	sum += item->totalAllocatedSize();
+
+    if ( sum == 0 )	// Prevent division by zero.
+	return rect;
+
+    int secondary = (int) ( sum * qMax(rect.width(), rect.height()) / remainingTotal + 0.5 );
+
+    if ( secondary < _minTileSize )	// We don't want tiles that small.
+	return rect;
+
+
+    // Set up a cushion surface for this layout row:
+    // Add another ridge perpendicular to the row's direction
+    // that optically groups this row's tiles together.
+
+    CushionSurface rowCushionSurface = _tiles[ index ].surface;
+
+    if ( dir == TreemapHorizontal )
+    {
+	QRectF rowRect = QRectF(rect.x(), rect.y(), primary, secondary);
+	rowCushionSurface.addRidge( TreemapVertical, rowRect );
+    }
+    else
+    {
+	QRectF rowRect = QRectF(rect.x(), rect.y(), secondary, primary);
+	rowCushionSurface.addRidge( TreemapHorizontal, rowRect );
+    }
+
+    double offset = 0;
+    double remaining = primary;
+    FileInfoList::const_iterator it  = row.constBegin();
+    FileInfoList::const_iterator end = row.constEnd();
+
+    while ( it != end )
+    {
+	double childSize =  (*it)->totalAllocatedSize() / (double) sum * primary;
+
+	if ( childSize > remaining )	// Prevent overflow because of accumulated rounding errors
+	    childSize = remaining;
+
+	remaining -= childSize;
+
+	if ( childSize >= _minTileSize )
+	{
+	    QRectF childRect;
+
+	    if ( dir == TreemapHorizontal )
+		childRect = QRectF( rect.x() + round( offset ), rect.y(), ceil( childSize ), secondary );
+	    else
+		childRect = QRectF( rect.x(), rect.y() + round( offset ), secondary, ceil( childSize ) );
+
+	    int child = addTile( *it, childRect, rowCushionSurface, index );
+	    _tiles[ child ].surface.addRidge( dir, childRect );
+
+	    offset += childSize;
+	}
+
+	++it;
+    }
+
+
+    // Subtract the layouted area from the rectangle.
+
+    QRectF newRect;
+
+    if ( dir == TreemapHorizontal )
+	newRect = QRectF( rect.x(), rect.y() + secondary, rect.width(), rect.height() - secondary );
+    else
+	newRect = QRectF( rect.x() + secondary, rect.y(), rect.width() - secondary, rect.height() );
+
+    return newRect;
+}
+
+
+int TreemapLayout::tileAt( const QPointF & pos ) const
+{
+    if ( _tiles.isEmpty() || ! _tiles.first().rect.contains( pos ) )
+	return -1;
+
+    int index = 0;
+
+    while ( true )
+    {
+	// Check the direct children and skip their subtrees. If children
+	// overlap because of rounding, the last one wins: It is the one on
+	// top.
+
+	int found = -1;
+
+	for ( int child = index + 1; child < _tiles[ index ].end; child = _tiles[ child ].end )
+	{
+	    if ( _tiles[ child ].rect.contains( pos ) )
+		found = child;
+	}
+
+	if ( found < 0 )
+	    return index;
+
+	index = found;
+    }
+}
+
+
+int TreemapLayout::indexOf( const FileInfo * item ) const
+{
+    if ( ! item )
+	return -1;
+
+    if ( _index.isEmpty() )
+    {
+	_index.reserve( _tiles.size() );
+
+	for ( int i = 0; i < _tiles.size(); ++i )
+	    _index.insert( _tiles[ i ].orig, i );
+    }
+
+    return _index.value( item, -1 );
+}
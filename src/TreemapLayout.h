@@ -0,0 +1,323 @@
+/*
+ *   File name: TreemapLayout.h
+ *   Summary:	Treemap layout for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreemapLayout_h
+#define TreemapLayout_h
+
+
+#include <QRectF>
+#include <QPointF>
+#include <QVector>
+#include <QHash>
+#include <QAtomicInt>
+
+class QThreadPool;
+
+#include "CushionSurface.h"
+#include "FileInfoIterator.h"
+
+
+namespace QDirStat
+{
+    class FileInfo;
+
+    /**
+     * The geometry of one treemap tile.
+     *
+     * The tiles of a treemap are stored in a flat list in preorder: Each
+     * tile is followed by all the tiles of its subtree. The subtree of the
+     * tile at index i ranges from i+1 to 'end' (exclusive), so it is easy to
+     * skip a subtree or to iterate over the direct children of a tile.
+     **/
+    struct TreemapLayoutTile
+    {
+	FileInfo *	orig;
+	QRectF		rect;
+	CushionSurface	surface;
+	int		parent;		// Index of the parent tile; -1 for the root
+	int		end;		// Index after the last tile of the subtree
+    };
+
+    typedef QVector<TreemapLayoutTile> TreemapLayoutTileList;
+
+    class TreemapLayout;
+
+
+    /**
+     * A subtree of a parallel layout that is laid out separately by
+     * another thread: 'layout' has the tiles of the subtree of the tile
+     * with index 'index'.
+     **/
+    struct TreemapLayoutDeferred
+    {
+	int		index;
+	TreemapLayout * layout;
+    };
+
+
+    /**
+     * Treemap layout: Calculate the position, size and cushion surface of
+     * all treemap tiles without creating any of them.
+     *
+     * This uses nothing but the FileInfo tree and the parameters passed to
+     * the constructor.
+     **/
+    class TreemapLayout
+    {
+    public:
+
+	/**
+	 * Constructor. 'squarify' selects the "squarified treemaps"
+	 * algorithm rather than the simple one; tiles smaller than
+	 * 'minTileSize' pixels are left out.
+	 **/
+	TreemapLayout( bool squarify = true, int minTileSize = 3 );
+
+	/**
+	 * Calculate the layout for the subtree of 'root' in 'rect'. This
+	 * replaces any previous layout.
+	 **/
+	void layout( FileInfo * root, const QRectF & rect );
+
+	/**
+	 * Calculate the layout for the subtree of 'root' in 'rect' like
+	 * above, but start with cushion surface 'surface' for the root. This
+	 * is for laying out part of an existing treemap again.
+	 **/
+	void layout( FileInfo		   * root,
+		     const QRectF	   & rect,
+		     const CushionSurface & surface );
+
+	/**
+	 * Clear the layout.
+	 **/
+	void clear();
+
+	/**
+	 * Stop the layout as soon as 'generation' no longer has the value
+	 * 'expected'. This is for a layout in a worker thread that may
+	 * become obsolete while it is still running: The GUI thread simply
+	 * changes 'generation'. A canceled layout is incomplete and should
+	 * be discarded.
+	 **/
+	void setCancelCheck( const QAtomicInt * generation, int expected );
+
+	/**
+	 * Return 'true' if this layout was canceled.
+	 **/
+	bool isCanceled() const
+	    { return _generation && *_generation != _expectedGeneration; }
+
+	/**
+	 * Limit the layout to 'maxDepth' levels below the root; deeper tiles
+	 * are simply left out. 0 means no limit (the default).
+	 *
+	 * This is for a quick preview of a treemap that takes much longer
+	 * to lay out completely.
+	 **/
+	void setMaxDepth( int maxDepth ) { _maxDepth = maxDepth; }
+
+	/**
+	 * Enable or disable the parallel layout mode: Subtrees with many
+	 * items are laid out in parallel in a thread pool, and their tiles
+	 * are merged into this layout when they are all done. The result is
+	 * exactly the same as without this mode.
+	 *
+	 * The same conditions as for a layout in a worker thread apply: The
+	 * tree must not change, and its sums must be up to date.
+	 **/
+	void setParallel( bool parallel ) { _parallel = parallel; }
+
+	/**
+	 * Return 'true' if the last layout() left out any tiles because of
+	 * the maximum depth.
+	 **/
+	bool isTruncated() const { return _truncated; }
+
+	/**
+	 * Return 'true' if this layout uses the "squarified treemaps"
+	 * algorithm.
+	 **/
+	bool squarified() const { return _squarify; }
+
+	/**
+	 * Return the minimum tile size of this layout.
+	 **/
+	int minTileSize() const { return _minTileSize; }
+
+	/**
+	 * Return the rectangle of the complete layout.
+	 **/
+	const QRectF & rect() const { return _rect; }
+
+	/**
+	 * Return all tiles in preorder. The first one is the root.
+	 **/
+	const TreemapLayoutTileList & tiles() const { return _tiles; }
+
+	/**
+	 * Return the tile with index 'index'.
+	 **/
+	const TreemapLayoutTile & tile( int index ) const { return _tiles.at( index ); }
+
+	/**
+	 * Return the number of tiles.
+	 **/
+	int size() const { return _tiles.size(); }
+
+	/**
+	 * Return 'true' if there are no tiles.
+	 **/
+	bool isEmpty() const { return _tiles.isEmpty(); }
+
+	/**
+	 * Return the root of the layout or 0 if it is empty.
+	 **/
+	FileInfo * root() const { return _tiles.isEmpty() ? 0 : _tiles.first().orig; }
+
+	/**
+	 * Return 'true' if the tile with index 'index' has no child tiles.
+	 **/
+	bool isLeaf( int index ) const { return _tiles.at( index ).end == index + 1; }
+
+	/**
+	 * Return the index of the innermost tile at 'pos' or -1 if there is
+	 * none.
+	 *
+	 * This descends from the root tile to the child that contains 'pos',
+	 * skipping the subtrees of all other children, so it only looks at a
+	 * tiny part of the tiles.
+	 **/
+	int tileAt( const QPointF & pos ) const;
+
+	/**
+	 * Return the index of the tile for 'item' or -1 if there is none.
+	 **/
+	int indexOf( const FileInfo * item ) const;
+
+
+    protected:
+
+	friend class TreemapLayoutJob;
+
+	/**
+	 * Add a tile for 'orig' with 'rect' and 'surface' below the tile
+	 * with index 'parent' and create its children. Return the index of
+	 * the new tile.
+	 **/
+	int addTile( FileInfo		  * orig,
+		     const QRectF	  & rect,
+		     const CushionSurface & surface,
+		     int		    parent,
+		     Orientation	    orientation = TreemapAuto );
+
+	/**
+	 * Create the children of the tile with index 'index'.
+	 **/
+	void createChildren( int index, Orientation orientation );
+
+	/**
+	 * Return 'true' if the subtree of the tile with index 'index' should
+	 * be laid out by another thread in the parallel layout mode.
+	 **/
+	bool shouldDefer( int index ) const;
+
+	/**
+	 * Start laying out the subtree of the tile with index 'index' in
+	 * the thread pool.
+	 **/
+	void defer( int index, Orientation orientation );
+
+	/**
+	 * Merge the tiles of all deferred subtrees into this layout. This
+	 * has to wait until all of them are done.
+	 **/
+	void mergeDeferred();
+
+	/**
+	 * Create children using the simple treemap algorithm:
+	 * Alternate between horizontal and vertical subdivision in each
+	 * level. Each child will get the entire height or width, respectively,
+	 * of the specified rectangle. This algorithm is very fast, but often
+	 * results in very thin, elongated tiles.
+	 **/
+	void createChildrenSimple( int index, Orientation orientation );
+
+	/**
+	 * Create children using the "squarified treemaps" algorithm as
+	 * described by Mark Bruls, Kees Huizing, and Jarke J. van Wijk of the
+	 * TU Eindhoven, NL.
+	 *
+	 * This algorithm is not quite so simple and involves more expensive
+	 * operations, e.g., sorting the children of each node by size first,
+	 * try some variations of the layout and maybe backtrack to the
+	 * previous attempt. But it results in tiles that are much more
+	 * square-like, i.e. have more reasonable width-to-height ratios. It is
+	 * very much less likely to get thin, elongated tiles that are hard to
+	 * point at and even harder to compare visually against each other.
+	 *
+	 * This implementation includes some improvements to that basic
+	 * algorithm. For example, children below a certain size are
+	 * disregarded completely since they will not get an adequate visual
+	 * representation anyway (it would be way too small). They are
+	 * summarized in some kind of 'misc stuff' area in the parent treemap
+	 * tile - in fact, part of the parent directory's tile can be "seen
+	 * through".
+	 *
+	 * In short, a lot of small children that don't have any useful effect
+	 * for the user in finding wasted disk space are omitted from handling
+	 * and, most important, don't need to be sorted by size (which has a
+	 * cost of O(n*ln(n)) in the best case, so reducing n helps a lot).
+	 **/
+	void createSquarifiedChildren( int index );
+
+	/**
+	 * Squarify as many children as possible: Try to squeeze members
+	 * referred to by 'it' into 'rect' until the aspect ratio doesn't get
+	 * better any more. Returns a list of children that should be laid out
+	 * in 'rect'. Moves 'it' until there is no more improvement or 'it'
+	 * runs out of items.
+	 **/
+	FileInfoList squarify( const QRectF		     & rect,
+			       FileSize			       remainingTotal,
+			       FileInfoSortedBySizeIterator  & it );
+
+	/**
+	 * Lay out all members of 'row' within 'rect' as children of the tile
+	 * with index 'index' along the longer side of 'rect'. Returns the
+	 * new rectangle with the laid out area subtracted.
+	 **/
+	QRectF layoutRow( int		 index,
+			  const QRectF & rect,
+			  FileSize	 remainingTotal,
+			  FileInfoList & row );
+
+
+	// Data members
+
+	bool				   _squarify;
+	int				   _minTileSize;
+	QRectF				   _rect;
+	const QAtomicInt *		   _generation;
+	int				   _expectedGeneration;
+	int				   _maxDepth;
+	int				   _depth;
+	bool				   _truncated;
+	bool				   _parallel;
+	QThreadPool *			   _threadPool;	// only during layout()
+	QVector<TreemapLayoutDeferred>	   _deferred;
+	TreemapLayoutTileList		   _tiles;
+	mutable QHash<const FileInfo *, int> _index;	// built on demand
+
+    };	// class TreemapLayout
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreemapLayout_h
@@ -0,0 +1,191 @@
+/*
+ *   File name: TreemapLayoutCache.cpp
+ *   Summary:	Cache of recent treemap layouts for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "TreemapLayoutCache.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#define VERBOSE_LAYOUT_CACHE	0
+
+// Default memory budget for the layout cache in kilobytes; the treemap
+// view might change this
+
+#define DEFAULT_LAYOUT_CACHE_SIZE	( 32 * 1024 )
+
+
+using namespace QDirStat;
+
+
+bool TreemapLayoutCacheKey::operator==( const TreemapLayoutCacheKey & other ) const
+{
+    return root	       == other.root	 &&
+	size	       == other.size	 &&
+	squarify       == other.squarify &&
+	minTileSize    == other.minTileSize;
+}
+
+
+uint QDirStat::qHash( const TreemapLayoutCacheKey & key )
+{
+    uint hash = ::qHash( key.root );
+
+    hash = hash * 31 + key.size.width();
+    hash = hash * 31 + key.size.height();
+    hash = hash * 31 + key.minTileSize * 2 + ( key.squarify ? 1 : 0 );
+
+    return hash;
+}
+
+
+TreemapLayoutCache::TreemapLayoutCache( QObject * parent ):
+    QObject( parent ),
+    _tree( 0 ),
+    _cache( DEFAULT_LAYOUT_CACHE_SIZE )
+{
+    MemoryPressure::add( this );
+}
+
+
+TreemapLayoutCache::~TreemapLayoutCache()
+{
+    MemoryPressure::remove( this );
+}
+
+
+void TreemapLayoutCache::setDirTree( DirTree * tree )
+{
+    clear();
+
+    if ( _tree )
+	disconnect( _tree, 0, this, 0 );
+
+    _tree = tree;
+
+    if ( ! _tree )
+	return;
+
+    // Only signals that are sent anyway: Connecting to childAdded() would
+    // make the tree send it for every single item while reading. Nothing
+    // is cached while reading, and starting to read drops everything.
+
+    connect( _tree, SIGNAL( startingReading() ),
+	     this,  SLOT  ( clear()	     ) );
+
+    connect( _tree, SIGNAL( clearing() ),
+	     this,  SLOT  ( clear()    ) );
+
+    connect( _tree, SIGNAL( deletingChild( FileInfo * ) ),
+	     this,  SLOT  ( invalidate   ( FileInfo * ) ) );
+
+    connect( _tree, SIGNAL( clearingSubtree( DirInfo * ) ),
+	     this,  SLOT  ( invalidateDir  ( DirInfo * ) ) );
+
+    connect( _tree, SIGNAL( childrenAdded( DirInfo * ) ),
+	     this,  SLOT  ( invalidateDir( DirInfo * ) ) );
+
+    connect( _tree, SIGNAL( readJobFinished( DirInfo * ) ),
+	     this,  SLOT  ( invalidateDir  ( DirInfo * ) ) );
+
+    connect( _tree, SIGNAL( filesPagedIn ( DirInfo * ) ),
+	     this,  SLOT  ( invalidateDir( DirInfo * ) ) );
+}
+
+
+bool TreemapLayoutCache::find( FileInfo	     * root,
+			       const QRectF  & rect,
+			       bool	       squarify,
+			       int	       minTileSize,
+			       TreemapLayout & layout_ret )
+{
+    TreemapLayout * layout = _cache.object( TreemapLayoutCacheKey( root, rect.size(),
+								   squarify, minTileSize ) );
+
+    // The key rounds the size, so check the exact rectangle
+
+    if ( ! layout || layout->rect() != rect )
+	return false;
+
+#if VERBOSE_LAYOUT_CACHE
+    logDebug() << "Using cached layout for " << root << endl;
+#endif
+
+    layout_ret = *layout;
+
+    return true;
+}
+
+
+void TreemapLayoutCache::insert( const TreemapLayout & layout )
+{
+    if ( _cache.maxCost() <= 0 || layout.isEmpty() || layout.isTruncated() )
+	return;
+
+    TreemapLayoutCacheKey key( layout.root(), layout.rect().size(),
+			       layout.squarified(), layout.minTileSize() );
+
+    if ( _cache.contains( key ) )
+	return;
+
+    TreemapLayout * copy = new TreemapLayout( layout );
+    CHECK_NEW( copy );
+
+    // The layout might come from a worker thread that is long gone
+    copy->setCancelCheck( 0, 0 );
+
+    // The cost is the size in kilobytes
+    int cost = qMax( 1, (int) ( (qint64) layout.size() * sizeof( TreemapLayoutTile ) / 1024 ) );
+
+    _cache.insert( key, copy, cost );
+}
+
+
+void TreemapLayoutCache::clear()
+{
+    _cache.clear();
+}
+
+
+void TreemapLayoutCache::invalidate( FileInfo * item )
+{
+    if ( ! item || _cache.isEmpty() )
+	return;
+
+    foreach ( const TreemapLayoutCacheKey & key, _cache.keys() )
+    {
+	if ( item->isInSubtree( key.root ) || key.root->isInSubtree( item ) )
+	{
+#if VERBOSE_LAYOUT_CACHE
+	    logDebug() << "Dropping cached layout for " << key.root << endl;
+#endif
+	    _cache.remove( key );
+	}
+    }
+}
+
+
+void TreemapLayoutCache::invalidateDir( DirInfo * dir )
+{
+    invalidate( dir );
+}
+
+
+void TreemapLayoutCache::evictCache( int percent )
+{
+    // Lowering the limit makes QCache drop the least recently used
+    // layouts; then restore the configured budget.
+
+    int maxCost = _cache.maxCost();
+    int keep	= _cache.totalCost() * ( 100 - qBound( 0, percent, 100 ) ) / 100;
+
+    _cache.setMaxCost( keep );
+    _cache.setMaxCost( maxCost );
+}
@@ -0,0 +1,157 @@
+/*
+ *   File name: TreemapLayoutCache.h
+ *   Summary:	Cache of recent treemap layouts for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreemapLayoutCache_h
+#define TreemapLayoutCache_h
+
+
+#include <QObject>
+#include <QCache>
+#include <QSize>
+#include <QSizeF>
+#include <QRectF>
+
+#include "TreemapLayout.h"
+#include "MemoryPressure.h"
+
+
+namespace QDirStat
+{
+    class FileInfo;
+    class DirInfo;
+    class DirTree;
+
+
+    /**
+     * Cache key for a treemap layout: Everything a layout depends on
+     * apart from the tree itself.
+     **/
+    struct TreemapLayoutCacheKey
+    {
+	FileInfo *	root;
+	QSize		size;
+	bool		squarify;
+	int		minTileSize;
+
+	TreemapLayoutCacheKey( FileInfo *     root,
+			       const QSizeF & size,
+			       bool	      squarify,
+			       int	      minTileSize ):
+	    root( root ),
+	    size( size.toSize() ),
+	    squarify( squarify ),
+	    minTileSize( minTileSize )
+	    {}
+
+	bool operator==( const TreemapLayoutCacheKey & other ) const;
+    };
+
+    uint qHash( const TreemapLayoutCacheKey & key );
+
+
+    /**
+     * Cache of the layouts of the treemaps that were shown recently, so
+     * zooming back out or going back and forth in the history of
+     * directories shows the treemap without laying it out again.
+     *
+     * A layout refers to all items in the subtree of its root, so it is
+     * only valid as long as nothing in that subtree changes. This watches
+     * the tree for that: Any change of an item drops the layouts of its
+     * ancestors (whose sizes changed with it) and of everything in its
+     * subtree (which may be deleted). Reading the tree drops everything.
+     **/
+    class TreemapLayoutCache: public QObject, public DiscardableCache
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	TreemapLayoutCache( QObject * parent = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~TreemapLayoutCache();
+
+	/**
+	 * Watch 'tree' for changes. This clears the cache.
+	 **/
+	void setDirTree( DirTree * tree );
+
+	/**
+	 * Find the layout for 'root' in 'rect' with 'squarify' and
+	 * 'minTileSize' and copy it to 'layout_ret'. Return 'false' if there
+	 * is none.
+	 **/
+	bool find( FileInfo	  * root,
+		   const QRectF	  & rect,
+		   bool		    squarify,
+		   int		    minTileSize,
+		   TreemapLayout  & layout_ret );
+
+	/**
+	 * Add a complete layout to the cache. Truncated layouts (e.g. a
+	 * preview) are ignored.
+	 **/
+	void insert( const TreemapLayout & layout );
+
+	/**
+	 * Set the memory budget for the cached layouts in kilobytes. 0
+	 * disables the cache.
+	 **/
+	void setCacheSize( int kiloBytes ) { _cache.setMaxCost( kiloBytes ); }
+
+	/**
+	 * Return the memory of the cached layouts in kilobytes.
+	 **/
+	int cacheUsed() const { return _cache.totalCost(); }
+
+	/**
+	 * Drop 'percent' percent of the cached layouts, the least recently
+	 * used ones first. Implemented from DiscardableCache.
+	 **/
+	virtual void evictCache( int percent ) Q_DECL_OVERRIDE;
+
+
+    public slots:
+
+	/**
+	 * Drop all cached layouts.
+	 **/
+	void clear();
+
+	/**
+	 * Drop all layouts that contain 'item' or anything in its subtree:
+	 * Those with a root that is 'item', one of its ancestors or in the
+	 * subtree of 'item'.
+	 **/
+	void invalidate( FileInfo * item );
+
+	/**
+	 * Same as above for the DirTree signals with a DirInfo.
+	 **/
+	void invalidateDir( DirInfo * dir );
+
+
+    protected:
+
+	// Data members
+
+	DirTree *					 _tree;
+	QCache<TreemapLayoutCacheKey, TreemapLayout> _cache;
+
+    };	// class TreemapLayoutCache
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreemapLayoutCache_h
@@ -0,0 +1,162 @@
+/*
+ *   File name: TreemapLayouter.cpp
+ *   Summary:	Treemap layout in a worker thread for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QMetaObject>
+#include <QElapsedTimer>
+
+#include "TreemapLayouter.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#define VERBOSE_LAYOUTER	0
+
+
+namespace QDirStat
+{
+    /**
+     * One layout for the thread pool.
+     **/
+    class TreemapLayoutWorker: public QRunnable
+    {
+    public:
+
+	TreemapLayoutWorker( TreemapLayouter * layouter,
+			     int	       generation,
+			     FileInfo	     * root,
+			     const QRectF    & rect,
+			     bool	       squarify,
+			     int	       minTileSize ):
+	    _layouter( layouter ),
+	    _generation( generation ),
+	    _root( root ),
+	    _rect( rect ),
+	    _layout( squarify, minTileSize )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+#if VERBOSE_LAYOUTER
+	    QElapsedTimer stopwatch;
+	    stopwatch.start();
+#endif
+	    _layout.setCancelCheck( &_layouter->_generation, _generation );
+	    _layout.setParallel( true );
+
+	    if ( _layout.isCanceled() ) // Obsolete before it even started
+		return;
+
+	    _layout.layout( _root, _rect );
+
+#if VERBOSE_LAYOUTER
+	    logDebug() << _layout.size() << " tiles"
+		       << ( _layout.isCanceled() ? " (canceled)" : "" )
+		       << " after " << formatMillisec( stopwatch.elapsed() ) << endl;
+#endif
+
+	    if ( ! _layout.isCanceled() )
+		_layouter->workerDone( _generation, _layout );
+	}
+
+    protected:
+
+	TreemapLayouter * _layouter;
+	int		  _generation;
+	FileInfo *	  _root;
+	QRectF		  _rect;
+	TreemapLayout	  _layout;
+    };
+}
+
+
+using namespace QDirStat;
+
+
+TreemapLayouter::TreemapLayouter( QObject * parent ):
+    QObject( parent ),
+    _generation( 0 ),
+    _busy( false ),
+    _resultGeneration( -1 )
+{
+    // One layout at a time; an obsolete one stops right away anyway
+    _threadPool.setMaxThreadCount( 1 );
+}
+
+
+TreemapLayouter::~TreemapLayouter()
+{
+    cancel();
+}
+
+
+void TreemapLayouter::start( FileInfo	  * root,
+			     const QRectF & rect,
+			     bool	    squarify,
+			     int	    minTileSize )
+{
+    // A layout that is still running stops when it notices the new
+    // generation; one that did not even start yet is simply dropped.
+
+    int generation = _generation.fetchAndAddOrdered( 1 ) + 1;
+    _threadPool.clear();
+
+    TreemapLayoutWorker * worker =
+	new TreemapLayoutWorker( this, generation, root, rect, squarify, minTileSize );
+    CHECK_NEW( worker );
+
+    _threadPool.start( worker );	// takes over ownership
+    _busy = true;
+}
+
+
+void TreemapLayouter::cancel()
+{
+    _generation.fetchAndAddOrdered( 1 );
+    _threadPool.clear();
+    _threadPool.waitForDone();
+
+    QMutexLocker locker( &_mutex );
+    _result.clear();
+    _resultGeneration = -1;
+    _busy = false;
+}
+
+
+void TreemapLayouter::workerDone( int generation, const TreemapLayout & layout )
+{
+    QMutexLocker locker( &_mutex );
+
+    _result	      = layout;
+    _resultGeneration = generation;
+
+    QMetaObject::invokeMethod( this, "collectResult", Qt::QueuedConnection );
+}
+
+
+void TreemapLayouter::collectResult()
+{
+    TreemapLayout layout;
+
+    {
+	QMutexLocker locker( &_mutex );
+
+	if ( _resultGeneration != _generation )	// Canceled or superseded
+	    return;
+
+	layout = _result;
+	_result.clear();
+	_resultGeneration = -1;
+    }
+
+    _busy = false;
+    emit finished( layout );
+}
@@ -0,0 +1,122 @@
+/*
+ *   File name: TreemapLayouter.h
+ *   Summary:	Treemap layout in a worker thread for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreemapLayouter_h
+#define TreemapLayouter_h
+
+
+#include <QObject>
+#include <QRectF>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QThreadPool>
+
+#include "TreemapLayout.h"
+
+
+namespace QDirStat
+{
+    class FileInfo;
+    class TreemapLayoutWorker;
+
+    /**
+     * Calculate a TreemapLayout in a worker thread so the GUI remains
+     * responsive even for huge trees.
+     *
+     * There is at most one layout that is still of interest: Starting a
+     * new one makes any previous one obsolete. An obsolete layout stops
+     * as soon as possible, and its result is discarded.
+     *
+     * The worker thread only reads the FileInfo tree. The caller has to
+     * make sure that the tree does not change while a layout is running
+     * (call cancel() before that) and that the sizes of the tree are up to
+     * date before starting (they are calculated lazily, and that would be
+     * a write access).
+     **/
+    class TreemapLayouter: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	TreemapLayouter( QObject * parent = 0 );
+
+	/**
+	 * Destructor. This waits for the worker thread to finish.
+	 **/
+	virtual ~TreemapLayouter();
+
+	/**
+	 * Start calculating the layout for the subtree of 'root' in 'rect'.
+	 * This cancels any previous layout, but it does not wait for it.
+	 * finished() is emitted when the layout is complete.
+	 **/
+	void start( FileInfo	 * root,
+		    const QRectF & rect,
+		    bool	   squarify,
+		    int		   minTileSize );
+
+	/**
+	 * Cancel the current layout, if there is any, and wait until the
+	 * worker thread no longer accesses the tree.
+	 **/
+	void cancel();
+
+	/**
+	 * Return 'true' if a layout is being calculated.
+	 **/
+	bool isBusy() const { return _busy; }
+
+
+    signals:
+
+	/**
+	 * Emitted in the GUI thread when a layout is complete.
+	 **/
+	void finished( const TreemapLayout & layout );
+
+
+    protected slots:
+
+	/**
+	 * Take the result from the worker thread and emit finished().
+	 **/
+	void collectResult();
+
+
+    protected:
+
+	friend class TreemapLayoutWorker;
+
+	/**
+	 * Notification from the worker thread that it is done with
+	 * 'layout'. This is called in the context of that worker thread.
+	 **/
+	void workerDone( int generation, const TreemapLayout & layout );
+
+
+	QThreadPool	_threadPool;
+	QAtomicInt	_generation;
+	bool		_busy;
+
+	// Shared with the worker thread; protected by _mutex
+
+	QMutex		_mutex;
+	TreemapLayout	_result;
+	int		_resultGeneration;
+
+    };	// class TreemapLayouter
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreemapLayouter_h
@@ -0,0 +1,584 @@
+/*
+ *   File name: TreemapRaster.cpp
+ *   Summary:	Treemap rendering for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QImage>
+#include <QPainter>
+#include <QGraphicsScene>
+#include <QGraphicsSceneMouseEvent>
+#include <QElapsedTimer>
+
+#include "TreemapRaster.h"
+#include "TreemapView.h"
+#include "CushionRenderer.h"
+#include "FileInfo.h"
+#include "FormatUtil.h"
+#include "Exception.h"
+#include "Logger.h"
+
+#if HAVE_TREEMAP_GL
+#  include <QOpenGLWidget>
+#endif
+
+
+#define VERBOSE_RASTER	0
+
+
+using namespace QDirStat;
+
+
+TreemapRaster::TreemapRaster( TreemapView	  * parentView,
+			      const TreemapLayout & layout ):
+    QGraphicsItem(),
+    _parentView( parentView ),
+    _layout( layout ),
+    _rect( layout.rect() ),
+    _glCushions( parentView->openGLRendering() && parentView->doCushionShading() ),
+#if HAVE_TREEMAP_GL
+    _glRenderer( 0 ),
+#endif
+    _currentItem( 0 ),
+    _highlightedItem( 0 ),
+    _hoverItem( 0 ),
+    _currentItemRect( 0 ),
+    _sceneMask( 0 )
+{
+#if VERBOSE_RASTER
+    QElapsedTimer stopwatch;
+    stopwatch.start();
+#endif
+
+    rasterize();
+
+#if VERBOSE_RASTER
+    logDebug() << _layout.size() << " tiles rendered after "
+	       << formatMillisec( stopwatch.elapsed() ) << endl;
+#endif
+
+    setZValue( TileLayer );
+    setAcceptHoverEvents( true );
+    _parentView->scene()->addItem( this );
+}
+
+
+TreemapRaster::~TreemapRaster()
+{
+    // DO NOT try to delete any of the highlight rectangles or the scene
+    // mask: They are owned by the QGraphicsScene, just like for a
+    // TreemapTile.
+
+#if HAVE_TREEMAP_GL
+    if ( _glRenderer )
+	delete _glRenderer;
+#endif
+}
+
+
+void TreemapRaster::rasterize()
+{
+    QImage image( (int) _rect.width(), (int) _rect.height(), QImage::Format_RGB32 );
+    image.fill( _parentView->palette().color( QPalette::Base ).rgb() );
+
+    const TreemapLayoutTileList & tiles = _layout.tiles();
+    const bool cushions = _parentView->doCushionShading();
+
+    // Tiles without a cushion first: Each of them is followed by its
+    // subtree, so the children end up on top of their parents.
+
+    QPainter painter( &image );
+
+    if ( cushions )
+	painter.setPen( Qt::NoPen );
+    else
+	painter.setPen( QPen( _parentView->outlineColor(), 1 ) );
+
+    for ( int i = 0; i < tiles.size(); ++i )
+    {
+	const TreemapLayoutTile & tile = tiles.at( i );
+	FileInfo * orig = tile.orig;
+
+	if ( tile.rect.width() < 1.0 || tile.rect.height() < 1.0 )
+	    continue;
+
+	if ( cushions )
+	{
+	    // Same as QGraphicsRectItem::paint() with the brush from
+	    // TreemapTile::init()
+
+	    if ( orig->isDir() || orig->isDotEntry() || orig->isPkgInfo() )
+	    {
+		painter.setBrush( _parentView->dirBrush( orig, tile.rect ) );
+		painter.drawRect( tile.rect );
+	    }
+	}
+	else	// No cushion shading, use plain tiles
+	{
+	    if ( orig->isDir() || orig->isDotEntry() )
+	    {
+		if ( _parentView->useDirGradient() )
+		    painter.setBrush( _parentView->dirBrush( orig, tile.rect ) );
+		else
+		    painter.setBrush( _parentView->dirFillColor() );
+	    }
+	    else
+	    {
+		painter.setBrush( _parentView->tileColor( orig ) );
+	    }
+
+	    painter.drawRect( tile.rect );
+	}
+    }
+
+    painter.end();
+
+
+    // Now the cushions
+
+    if ( cushions )
+    {
+	const CushionLight light = _parentView->cushionLight();
+
+	for ( int i = 0; i < tiles.size(); ++i )
+	{
+	    const TreemapLayoutTile & tile = tiles.at( i );
+	    FileInfo * orig = tile.orig;
+
+	    if ( orig->isDir() || orig->isDotEntry() || orig->isPkgInfo() )
+		continue;
+
+	    const QColor color = _parentView->tileColor( orig );
+
+#if HAVE_TREEMAP_GL
+	    if ( _glCushions )
+	    {
+		// Only collect them for the GPU; EnforceContrast is ignored there
+
+		TreemapGLCushion cushion;
+		cushion.rect[0]	   = tile.rect.x();
+		cushion.rect[1]	   = tile.rect.y();
+		cushion.rect[2]	   = tile.rect.width();
+		cushion.rect[3]	   = tile.rect.height();
+		cushion.surface[0] = tile.surface.xx2();
+		cushion.surface[1] = tile.surface.xx1();
+		cushion.surface[2] = tile.surface.yy2();
+		cushion.surface[3] = tile.surface.yy1();
+		cushion.color[0]   = color.redF();
+		cushion.color[1]   = color.greenF();
+		cushion.color[2]   = color.blueF();
+
+		_glCushionData << cushion;
+		continue;
+	    }
+#endif
+	    CushionRenderer::renderCushion( image, tile.rect, tile.surface, color, light );
+	}
+
+	if ( _parentView->forceCushionGrid() && ! _glCushions )
+	{
+	    painter.begin( &image );
+	    drawCushionGrid( &painter );
+	    painter.end();
+	}
+    }
+
+    _pixmap = QPixmap::fromImage( image );
+}
+
+
+void TreemapRaster::drawCushionGrid( QPainter * painter )
+{
+    // Draw a clearly visible boundary
+
+    const TreemapLayoutTileList & tiles = _layout.tiles();
+    painter->setPen( QPen( _parentView->cushionGridColor(), 1 ) );
+
+    for ( int i = 0; i < tiles.size(); ++i )
+    {
+	const TreemapLayoutTile & tile = tiles.at( i );
+	FileInfo * orig = tile.orig;
+
+	if ( orig->isDir() || orig->isDotEntry() || orig->isPkgInfo() )
+	    continue;
+
+	if ( tile.rect.x() > 0 )
+	    painter->drawLine( tile.rect.topLeft(), tile.rect.bottomLeft() );
+
+	if ( tile.rect.y() > 0 )
+	    painter->drawLine( tile.rect.topLeft(), tile.rect.topRight() );
+    }
+}
+
+
+bool TreemapRaster::drawGLCushions( QPainter * painter, QWidget * widget )
+{
+#if HAVE_TREEMAP_GL
+    if ( ! _glRenderer )
+    {
+	QOpenGLWidget * glWidget = qobject_cast<QOpenGLWidget *>( widget );
+
+	if ( ! glWidget || ! TreemapGLRenderer::isOpenGL( painter ) )
+	    return false;
+
+	_glRenderer = new TreemapGLRenderer( glWidget );
+	CHECK_NEW( _glRenderer );
+
+	_glRenderer->setCushions( _glCushionData );
+	_glCushionData.clear();
+    }
+
+    if ( ! _glRenderer->draw( painter, _parentView->cushionLight() ) )
+	return false;
+
+    if ( _parentView->forceCushionGrid() )
+	drawCushionGrid( painter );
+
+    return true;
+#else
+    Q_UNUSED( painter );
+    Q_UNUSED( widget );
+
+    return false;
+#endif
+}
+
+
+void TreemapRaster::paint( QPainter			  * painter,
+			   const QStyleOptionGraphicsItem * option,
+			   QWidget			  * widget )
+{
+    Q_UNUSED( option );
+
+    painter->drawPixmap( _rect.topLeft(), _pixmap );
+
+    if ( _glCushions && ! drawGLCushions( painter, widget ) )
+    {
+	// No OpenGL after all: Render the cushions with the CPU
+
+	logInfo() << "Falling back to rendering the treemap cushions in the CPU" << endl;
+
+	_glCushions = false;
+	rasterize();
+	painter->drawPixmap( _rect.topLeft(), _pixmap );
+    }
+}
+
+
+FileInfo * TreemapRaster::itemAt( const QPointF & pos ) const
+{
+    int index = _layout.tileAt( pos );
+
+    return index >= 0 ? _layout.tile( index ).orig : 0;
+}
+
+
+void TreemapRaster::setCurrentItem( FileInfo * item )
+{
+    FileInfo * oldCurrent = _currentItem;
+    int index = _layout.indexOf( item );
+    _currentItem = index >= 0 ? item : 0;
+
+    if ( _currentItem )
+    {
+	int highlightedParent = _parentHighlightList.isEmpty() ? -1 :
+	    _layout.tile( _layout.indexOf( _highlightedItem ) ).parent;
+
+	if ( highlightedParent != _layout.tile( index ).parent )
+	    clearParentsHighlight();
+
+	if ( ! _currentItemRect )
+	{
+	    _currentItemRect = new HighlightRect( scene(), _parentView->currentItemColor() );
+	    CHECK_NEW( _currentItemRect );
+	}
+    }
+
+    if ( _currentItemRect )
+    {
+	if ( ! _currentItem || index == 0 )	// Don't highlight the root tile
+	{
+	    _currentItemRect->hide();
+	}
+	else
+	{
+	    _currentItemRect->highlightRect( _layout.tile( index ).rect );
+	    _currentItemRect->setPenStyle( _selectedItems.contains( _currentItem ) ?
+					   Qt::SolidLine : Qt::DotLine );
+	}
+    }
+
+    if ( oldCurrent != _currentItem )
+	_parentView->sendCurrentItem( _currentItem );
+}
+
+
+void TreemapRaster::setSelectedItems( const FileInfoSet & items )
+{
+    _selectedItems = items;
+    updateSelectionHighlight();
+}
+
+
+void TreemapRaster::reshade()
+{
+    // The layout with the cushion surfaces is still valid; only the
+    // colors and the light changed.
+
+#if HAVE_TREEMAP_GL
+    _glCushionData.clear();
+#endif
+
+    rasterize();
+
+#if HAVE_TREEMAP_GL
+    if ( _glRenderer )
+    {
+	_glRenderer->setCushions( _glCushionData );
+	_glCushionData.clear();
+    }
+#endif
+
+    update();
+}
+
+
+void TreemapRaster::updateSelectionHighlight()
+{
+    qDeleteAll( _selectionRects );
+    _selectionRects.clear();
+
+    foreach ( FileInfo * item, _selectedItems )
+    {
+	int index = _layout.indexOf( item );
+
+	if ( index <= 0 )	// Not in this treemap or the root
+	    continue;
+
+	QRectF rect = _layout.tile( index ).rect;
+	int lineWidth = 2;
+
+	if ( _layout.isLeaf( index ) )
+	{
+	    // Like TreemapTile::paintSelectionRect()
+
+	    rect.setSize( rect.size() - QSizeF( 1.0, 1.0 ) );
+	    lineWidth = 1;
+	}
+
+	HighlightRect * highlight = new HighlightRect( scene(), rect,
+						       _parentView->selectedItemsColor(),
+						       lineWidth );
+	CHECK_NEW( highlight );
+	_selectionRects << highlight;
+    }
+}
+
+
+void TreemapRaster::toggleParentsHighlight( FileInfo * item )
+{
+    if ( item && item == _highlightedItem )
+	clearParentsHighlight();
+    else
+	highlightParents( _layout.indexOf( item ) );
+}
+
+
+void TreemapRaster::highlightParents( int index )
+{
+    clearParentsHighlight();
+
+    if ( index < 0 )
+	return;
+
+    _highlightedItem = _layout.tile( index ).orig;
+
+    int parent	  = _layout.tile( index ).parent;
+    int topParent = -1;
+    int lineWidth = 2;  // For the first (the direct) parent
+
+    while ( parent > 0 )	// Not for the root
+    {
+	const TreemapLayoutTile & tile = _layout.tile( parent );
+
+	HighlightRect * highlight = new HighlightRect( scene(), tile.rect, Qt::white, lineWidth );
+	CHECK_NEW( highlight );
+	_parentHighlightList << highlight;
+	highlight->setToolTip( tile.orig->debugUrl() );
+
+	topParent = parent;
+	parent	  = tile.parent;
+	lineWidth = 1;	// For all higher-level parents
+    }
+
+    if ( topParent > 0 )
+    {
+	_sceneMask = new SceneMask( scene(), _layout.tile( topParent ).rect, 0.6 );
+	CHECK_NEW( _sceneMask );
+    }
+}
+
+
+void TreemapRaster::clearParentsHighlight()
+{
+    qDeleteAll( _parentHighlightList );
+    _parentHighlightList.clear();
+    _highlightedItem = 0;
+
+    if ( _sceneMask )
+    {
+	delete _sceneMask;
+	_sceneMask = 0;
+    }
+}
+
+
+bool TreemapRaster::acceptsHover( FileInfo * item )
+{
+    return ( item->isDir() && item->totalSubDirs() == 0 ) || item->isDotEntry();
+}
+
+
+void TreemapRaster::mousePressEvent( QGraphicsSceneMouseEvent * event )
+{
+    FileInfo * item = itemAt( event->pos() );
+
+    if ( ! item )
+    {
+	QGraphicsItem::mousePressEvent( event );
+	return;
+    }
+
+    switch ( event->button() )
+    {
+	case Qt::LeftButton:
+	case Qt::MidButton:
+
+	    // Handle item selection (with or without Ctrl) like
+	    // QGraphicsScene does for selectable items.
+
+	    if ( event->modifiers() & Qt::ControlModifier )
+	    {
+		if ( _selectedItems.contains( item ) )
+		    _selectedItems.remove( item );
+		else
+		    _selectedItems.insert( item );
+	    }
+	    else
+	    {
+		_selectedItems.clear();
+		_selectedItems.insert( item );
+	    }
+
+	    updateSelectionHighlight();
+	    setCurrentItem( item );
+
+	    if ( event->button() == Qt::MidButton )
+		toggleParentsHighlight( item );
+	    break;
+
+	case Qt::RightButton:
+	    setCurrentItem( item );
+	    break;
+
+	default:
+	    QGraphicsItem::mousePressEvent( event );
+	    return;
+    }
+
+    event->accept();
+}
+
+
+void TreemapRaster::mouseReleaseEvent( QGraphicsSceneMouseEvent * event )
+{
+    QGraphicsItem::mouseReleaseEvent( event );
+    _parentView->sendSelection();
+}
+
+
+void TreemapRaster::mouseDoubleClickEvent( QGraphicsSceneMouseEvent * event )
+{
+    // Careful: Zooming deletes this item.
+
+    switch ( event->button() )
+    {
+	case Qt::LeftButton:
+	    logDebug() << "Zooming treemap in" << endl;
+	    _parentView->zoomIn();
+	    break;
+
+	case Qt::MidButton:
+	    logDebug() << "Zooming treemap out" << endl;
+	    _parentView->zoomOut();
+	    break;
+
+	default:
+	    break;
+    }
+}
+
+
+void TreemapRaster::wheelEvent( QGraphicsSceneWheelEvent * event )
+{
+    if ( event->delta() > 0 )
+    {
+	if ( ! _currentItem )  // can only zoom in with a current item
+	    setCurrentItem( itemAt( event->pos() ) );
+
+	_parentView->zoomIn();
+    }
+    else if ( event->delta() < 0 )
+    {
+	_parentView->zoomOut();
+    }
+}
+
+
+void TreemapRaster::contextMenuEvent( QGraphicsSceneContextMenuEvent * event )
+{
+    FileInfo * item = itemAt( event->pos() );
+
+    if ( item )
+	_parentView->openContextMenu( item, event->screenPos() );
+}
+
+
+void TreemapRaster::hoverMoveEvent( QGraphicsSceneHoverEvent * event )
+{
+    // Report the same tiles as TreemapTile: The innermost one that accepts
+    // hover events.
+
+    int index = _layout.tileAt( event->pos() );
+
+    while ( index >= 0 && ! acceptsHover( _layout.tile( index ).orig ) )
+	index = _layout.tile( index ).parent;
+
+    FileInfo * item = index >= 0 ? _layout.tile( index ).orig : 0;
+
+    if ( item != _hoverItem )
+    {
+	if ( _hoverItem )
+	    _parentView->sendHoverLeave( _hoverItem );
+
+	_hoverItem = item;
+
+	if ( _hoverItem )
+	    _parentView->sendHoverEnter( _hoverItem );
+    }
+}
+
+
+void TreemapRaster::hoverLeaveEvent( QGraphicsSceneHoverEvent * event )
+{
+    Q_UNUSED( event );
+
+    if ( _hoverItem )
+    {
+	_parentView->sendHoverLeave( _hoverItem );
+	_hoverItem = 0;
+    }
+}
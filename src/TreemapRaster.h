@@ -0,0 +1,222 @@
+/*
+ *   File name: TreemapRaster.h
+ *   Summary:	Treemap rendering for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreemapRaster_h
+#define TreemapRaster_h
+
+
+#include <QGraphicsItem>
+#include <QPixmap>
+#include <QList>
+#include <QVector>
+
+#include "TreemapLayout.h"
+#include "FileInfoSet.h"
+#include "TreemapGLRenderer.h"
+
+
+class QGraphicsSceneMouseEvent;
+class QGraphicsSceneHoverEvent;
+class QGraphicsSceneWheelEvent;
+class QGraphicsSceneContextMenuEvent;
+
+
+namespace QDirStat
+{
+    class TreemapView;
+    class HighlightRect;
+    class SceneMask;
+
+
+    /**
+     * A complete treemap in one single QGraphicsItem: This is the
+     * alternative to one TreemapTile for each file and directory for very
+     * large trees.
+     *
+     * The tiles are only kept in a TreemapLayout, and all of them are
+     * rendered into one image when this item is created; mouse clicks are
+     * mapped to the tiles with TreemapLayout::tileAt(). Only the current
+     * item, the selected items and the parents highlight are separate
+     * graphics items on top of this.
+     *
+     * This is a lot cheaper than one graphics item for each tile when there
+     * are hundreds of thousands of tiles: QGraphicsScene does not need to
+     * index that many items, and there is no per-tile overhead when
+     * painting.
+     *
+     * If the treemap view uses OpenGL, the cushions are not part of the
+     * image; they are shaded on the GPU by a TreemapGLRenderer each time
+     * this item is painted.
+     **/
+    class TreemapRaster: public QGraphicsItem
+    {
+    public:
+
+	/**
+	 * Constructor: Render the treemap with 'layout' and add it to the
+	 * scene of 'parentView'.
+	 **/
+	TreemapRaster( TreemapView	   * parentView,
+		       const TreemapLayout & layout );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~TreemapRaster();
+
+	/**
+	 * Return the root of this treemap.
+	 **/
+	FileInfo * root() const { return _layout.root(); }
+
+	/**
+	 * Return the layout of this treemap.
+	 **/
+	const TreemapLayout & layout() const { return _layout; }
+
+	/**
+	 * Return the innermost item at scene position 'pos' or 0 if there is
+	 * none.
+	 **/
+	FileInfo * itemAt( const QPointF & pos ) const;
+
+	/**
+	 * Return the current item or 0 if there is none.
+	 **/
+	FileInfo * currentItem() const { return _currentItem; }
+
+	/**
+	 * Make 'item' the current item and highlight it. If it does not have
+	 * a tile in this treemap, there will be no current item.
+	 *
+	 * If the current item changes, this is sent to the selection model
+	 * via the parent view.
+	 **/
+	void setCurrentItem( FileInfo * item );
+
+	/**
+	 * Return the selected items.
+	 **/
+	const FileInfoSet & selectedItems() const { return _selectedItems; }
+
+	/**
+	 * Set the selected items and highlight those that have a tile. This
+	 * does not send anything to the selection model.
+	 **/
+	void setSelectedItems( const FileInfoSet & items );
+
+	/**
+	 * Render the tiles again with the same layout, e.g. after the colors
+	 * or the light changed.
+	 **/
+	void reshade();
+
+	/**
+	 * Highlight the parents of 'item' if it is not currently highlighted
+	 * or clear the highlight if it is.
+	 **/
+	void toggleParentsHighlight( FileInfo * item );
+
+	/**
+	 * Clear the parents highlight.
+	 **/
+	void clearParentsHighlight();
+
+	/**
+	 * Return the bounding rectangle: The complete treemap.
+	 *
+	 * Reimplemented from QGraphicsItem.
+	 **/
+	virtual QRectF boundingRect() const Q_DECL_OVERRIDE { return _rect; }
+
+	/**
+	 * Paint the rendered treemap.
+	 *
+	 * Reimplemented from QGraphicsItem.
+	 **/
+	virtual void paint( QPainter			   * painter,
+			    const QStyleOptionGraphicsItem * option,
+			    QWidget			   * widget = 0 ) Q_DECL_OVERRIDE;
+
+    protected:
+
+	/**
+	 * Render all tiles into one image.
+	 **/
+	void rasterize();
+
+	/**
+	 * Draw the cushion grid lines for all leaf tiles.
+	 **/
+	void drawCushionGrid( QPainter * painter );
+
+	/**
+	 * Draw the cushions on the GPU. Return 'false' if that is not
+	 * possible.
+	 **/
+	bool drawGLCushions( QPainter * painter, QWidget * widget );
+
+	/**
+	 * Update the highlight rectangles for the selected items.
+	 **/
+	void updateSelectionHighlight();
+
+	/**
+	 * Highlight the parents of the tile with index 'index'.
+	 **/
+	void highlightParents( int index );
+
+	/**
+	 * Return 'true' if the tile for 'item' should report hovering, just
+	 * like a TreemapTile does.
+	 **/
+	static bool acceptsHover( FileInfo * item );
+
+	//
+	// Event handlers; all reimplemented from QGraphicsItem.
+	//
+
+	virtual void mousePressEvent( QGraphicsSceneMouseEvent * event ) Q_DECL_OVERRIDE;
+	virtual void mouseReleaseEvent( QGraphicsSceneMouseEvent * event ) Q_DECL_OVERRIDE;
+	virtual void mouseDoubleClickEvent( QGraphicsSceneMouseEvent * event ) Q_DECL_OVERRIDE;
+	virtual void wheelEvent( QGraphicsSceneWheelEvent * event ) Q_DECL_OVERRIDE;
+	virtual void contextMenuEvent( QGraphicsSceneContextMenuEvent * event ) Q_DECL_OVERRIDE;
+	virtual void hoverMoveEvent( QGraphicsSceneHoverEvent * event ) Q_DECL_OVERRIDE;
+	virtual void hoverLeaveEvent( QGraphicsSceneHoverEvent * event ) Q_DECL_OVERRIDE;
+
+
+	// Data members
+
+	TreemapView *		_parentView;
+	TreemapLayout		_layout;
+	QRectF			_rect;
+	QPixmap			_pixmap;
+	bool			_glCushions;
+#if HAVE_TREEMAP_GL
+	TreemapGLRenderer *	_glRenderer;
+	QVector<TreemapGLCushion> _glCushionData;
+#endif
+	FileInfo *		_currentItem;
+	FileInfoSet		_selectedItems;
+	FileInfo *		_highlightedItem;
+	FileInfo *		_hoverItem;
+
+	// Owned by the scene, just like all other graphics items
+
+	HighlightRect *		_currentItemRect;
+	QList<HighlightRect *>	_selectionRects;
+	QList<HighlightRect *>	_parentHighlightList;
+	SceneMask *		_sceneMask;
+
+    };	// class TreemapRaster
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreemapRaster_h
@@ -14,7 +14,8 @@
 #include <QGraphicsRectItem>
 #include <QRectF>
 
-#include "FileInfoIterator.h"
+#include "FileInfo.h"
+#include "CushionSurface.h"
 
 
 class QGraphicsSceneMouseEvent;
@@ -26,105 +27,7 @@ namespace QDirStat
     class FileInfo;
     class TreemapView;
     class HighlightRect;
-
-    enum Orientation
-    {
-	TreemapHorizontal,
-	TreemapVertical,
-	TreemapAuto
-    };
-
-
-    /**
-     * Helper class for cushioned treemaps: This class holds the polynome
-     * parameters for the cushion surface. The height of each point of such a
-     * surface is defined as:
-     *
-     *	   z(x, y) = a*x^2 + b*y^2 + c*x + d*y
-     * or
-     *	   z(x, y) = xx2*x^2 + yy2*y^2 + xx1*x + yy1*y
-     *
-     * to better keep track of which coefficient belongs where.
-     **/
-    class CushionSurface
-    {
-    public:
-	/**
-	 * Constructor. All polynome coefficients are set to 0.
-	 **/
-	CushionSurface();
-
-	/**
-	 * Adds a ridge in dimension 'dim' within rectangle 'rect' to this
-	 * surface.
-	 *
-	 * See the paper about "cushion treemaps" by Jarke J. van Wiik and Huub
-	 * van de Wetering from the TU Eindhoven, NL for more details.
-	 *
-	 * If you don't want to get all that involved: The coefficients are
-	 * changed in some way.
-	 **/
-	void addRidge( Orientation dim, const QRectF & rect );
-
-	/**
-	 * Returns the polynomal coefficient of the second order for the X
-	 * direction.
-	 **/
-	double xx2() const { return _xx2; }
-
-	/**
-	 * Returns the polynomal coefficient of the first order for the X
-	 * direction.
-	 **/
-	double xx1() const { return _xx1; }
-
-	/**
-	 * Returns the polynomal coefficient of the second order for the Y
-	 * direction.
-	 **/
-	double yy2() const { return _yy2; }
-
-	/**
-	 * Returns the polynomal coefficient of the first order for the Y
-	 * direction.
-	 **/
-	double yy1() const { return _yy1; }
-
-        /**
-         * Return the number of ridge pairs (square and linear) on this level.
-         **/
-        int ridgeCount() const { return _ridgeCount; }
-
-        /**
-         * Return a multiplication factor for both square and linear ridges,
-         * depending on the ridge count.
-         **/
-        double ridgeCoefficient() const;
-
-
-    protected:
-
-	/**
-	 * Calculate a new square polynomal coefficient for adding a ridge of
-	 * specified height between x1 and x2.
-	 **/
-	double squareRidge( double squareCoefficient, int x1, int x2 ) const;
-
-	/**
-	 * Calculate a new linear polynomal coefficient for adding a ridge of
-	 * specified height between x1 and x2.
-	 **/
-	double linearRidge( double linearCoefficient, int x1, int x2 ) const;
-
-
-	// Data members
-
-	double _xx2, _xx1;
-	double _yy2, _yy1;
-        int    _ridgeCount;
-
-    }; // class CushionSurface
-
+    struct TreemapLayoutTile;
 
 
     /**
@@ -140,32 +43,14 @@ namespace QDirStat
     public:
 
 	/**
-	 * Constructor: Create a treemap tile from 'fileinfo' that fits into a
-	 * rectangle 'rect' inside 'parent'.
-	 *
-	 * 'orientation' is the direction for further subdivision. 'Auto'
-	 * selects the wider direction inside 'rect'.
+	 * Constructor: Create a treemap tile for 'layoutTile' inside
+	 * 'parentTile'. This does not create any children; the TreemapView
+	 * creates one tile for each tile of a TreemapLayout.
 	 **/
-	TreemapTile( TreemapView  * parentView,
-		     TreemapTile  * parentTile,
-		     FileInfo	  * orig,
-		     const QRectF & rect,
-		     Orientation    orientation = TreemapAuto );
-
-    protected:
+	TreemapTile( TreemapView	     * parentView,
+		     TreemapTile	     * parentTile,
+		     const TreemapLayoutTile & layoutTile );
 
-	/**
-	 * Alternate constructor: Like the above, but explicitly specify a
-	 * cushion surface rather than using the parent's.
-	 **/
-	TreemapTile( TreemapView	  * parentView,
-		     TreemapTile	  * parentTile,
-		     FileInfo		  * orig,
-		     const QRectF	  & rect,
-		     const CushionSurface & cushionSurface,
-		     Orientation	    orientation = TreemapAuto );
-
-    public:
 	/**
 	 * Destructor.
 	 **/
@@ -192,73 +77,47 @@ namespace QDirStat
 	 **/
 	CushionSurface & cushionSurface() { return _cushionSurface; }
 
-
-    protected:
+	/**
+	 * Set the rendered cushion for this tile. This is used when the
+	 * cushion was rendered in the background by the CushionRenderer.
+	 **/
+	void setCushion( const QPixmap & cushion )
+	    { _cushion = cushion; _cushionPending = false; }
 
 	/**
-	 * Create children (sub-tiles) of this tile.
+	 * Return the rendered cushion of this tile or a null pixmap if it
+	 * has none.
 	 **/
-	void createChildren( const QRectF & rect,
-			     Orientation    orientation );
+	const QPixmap & cushion() const { return _cushion; }
 
 	/**
-	 * Create children (sub-tiles) using the simple treemap algorithm:
-	 * Alternate between horizontal and vertical subdivision in each
-	 * level. Each child will get the entire height or width, respectively,
-	 * of the specified rectangle. This algorithm is very fast, but often
-	 * results in very thin, elongated tiles.
+	 * Mark this tile's cushion as being rendered in the background:
+	 * Until it is set with setCushion(), this tile paints only a
+	 * placeholder.
 	 **/
-	void createChildrenSimple( const QRectF & rect,
-				   Orientation	  orientation );
+	void setCushionPending() { _cushionPending = true; }
 
 	/**
-	 * Create children using the "squarified treemaps" algorithm as
-	 * described by Mark Bruls, Kees Huizing, and Jarke J. van Wijk of the
-	 * TU Eindhoven, NL.
-	 *
-	 * This algorithm is not quite so simple and involves more expensive
-	 * operations, e.g., sorting the children of each node by size first,
-	 * try some variations of the layout and maybe backtrack to the
-	 * previous attempt. But it results in tiles that are much more
-	 * square-like, i.e. have more reasonable width-to-height ratios. It is
-	 * very much less likely to get thin, elongated tiles that are hard to
-	 * point at and even harder to compare visually against each other.
-	 *
-	 * This implementation includes some improvements to that basic
-	 * algorithm. For example, children below a certain size are
-	 * disregarded completely since they will not get an adequate visual
-	 * representation anyway (it would be way too small). They are
-	 * summarized in some kind of 'misc stuff' area in the parent treemap
-	 * tile - in fact, part of the parent directory's tile can be "seen
-	 * through".
-	 *
-	 * In short, a lot of small children that don't have any useful effect
-	 * for the user in finding wasted disk space are omitted from handling
-	 * and, most important, don't need to be sorted by size (which has a
-	 * cost of O(n*ln(n)) in the best case, so reducing n helps a lot).
+	 * Return 'true' if this is a leaf tile that needs a cushion, i.e.
+	 * one that is not a directory, a dot entry or a package.
 	 **/
-	void createSquarifiedChildren( const QRectF & rect );
+	bool needsCushion() const;
 
 	/**
-	 * Squarify as many children as possible: Try to squeeze members
-	 * referred to by 'it' into 'rect' until the aspect ratio doesn't get
-	 * better any more. Returns a list of children that should be laid out
-	 * in 'rect'. Moves 'it' until there is no more improvement or 'it'
-	 * runs out of items.
-	 *
-	 * 'scale' is the scaling factor between file sizes and pixels.
+	 * Return 'true' if this tile's cushion is still being rendered in the
+	 * background.
 	 **/
-	FileInfoList squarify( const QRectF & rect,
-			       FileSize       remainingTotal,
-			       FileInfoSortedBySizeIterator & it   );
+	bool cushionPending() const { return _cushionPending; }
 
 	/**
-	 * Lay out all members of 'row' within 'rect' along its longer side.
-	 * Returns the new rectangle with the layouted area subtracted.
+	 * Delete the highlighter of this tile if it has one. This is needed
+	 * before deleting a tile on its own rather than together with the
+	 * complete scene: The highlighter is owned by the scene.
 	 **/
-	QRectF layoutRow( const QRectF	& rect,
-			  FileSize	  remainingTotal,
-			  FileInfoList	& row );
+	void deleteHighlighter();
+
+
+    protected:
 
 	/**
 	 * Paint this tile.
@@ -338,22 +197,11 @@ namespace QDirStat
 	/**
 	 * Render a cushion as described in "cushioned treemaps" by Jarke
 	 * J. van Wijk and Huub van de Wetering	 of the TU Eindhoven, NL.
+	 *
+	 * See also CushionRenderer::renderCushion().
 	 **/
 	QPixmap renderCushion();
 
-	/**
-	 * Check if the contrast of the specified image is sufficient to
-	 * visually distinguish an outline at the right and bottom borders
-	 * and add a grey line there, if necessary.
-	 **/
-	void enforceContrast( QImage & image );
-
-	/**
-	 * Returns a color that gives a reasonable contrast to 'col': Lighter
-	 * if 'col' is dark, darker if 'col' is light.
-	 **/
-	QRgb contrastingColor( QRgb col );
-
     private:
 
 	/**
@@ -371,6 +219,7 @@ namespace QDirStat
 	FileInfo *	_orig;
 	CushionSurface	_cushionSurface;
 	QPixmap		_cushion;
+	bool		_cushionPending;
 	HighlightRect * _highlighter;
 
     }; // class TreemapTile
@@ -7,36 +7,58 @@
  */
 
 
+#include <math.h>	// sqrt(), ceil()
+
 #include <QElapsedTimer>
 #include <QResizeEvent>
 #include <QRegExp>
 #include <QTimer>
+#include <QMenu>
+#include <QLinearGradient>
+#include <QGraphicsPixmapItem>
+#include <QPainter>
 
 #include "TreemapView.h"
+#include "TreeDiff.h"
 #include "DirTree.h"
 #include "DirInfo.h"
+#include "DotEntry.h"
 #include "FormatUtil.h"
 #include "SelectionModel.h"
 #include "Settings.h"
 #include "SettingsHelpers.h"
 #include "SignalBlocker.h"
 #include "TreemapTile.h"
+#include "TreemapLayout.h"
+#include "TreemapLayouter.h"
+#include "TreemapLayoutCache.h"
+#include "TreemapRaster.h"
+#include "TreemapGLRenderer.h"
+#include "CushionRenderer.h"
 #include "DelayedRebuilder.h"
+#include "ActionManager.h"
+#include "CleanupCollection.h"
 #include "Exception.h"
 #include "Logger.h"
+#include "Trace.h"
+
+#if HAVE_TREEMAP_GL
+#  include <QOpenGLWidget>
+#  include <QSurfaceFormat>
+#endif
 
 #define REBUILD_STOPWATCH       0
 #define UpdateMinSize	        20
 
-using namespace QDirStat;
-
+// Rebuilds with fewer tiles say little about the cost of a tile
+#define MIN_TILES_FOR_TILE_COST	1000
 
-// Treemap layers (Z values)
+// Part of the view's pixels in each direction for the low-resolution preview
+// while resizing, and how often that preview is updated
+#define LOW_RES_PREVIEW_SCALE		0.25
+#define LOW_RES_PREVIEW_INTERVAL	50	// millisec
 
-const double TileLayer           = 0.0;
-const double SceneMaskLayer      = 1e5;
-const double TileHighlightLayer  = 1e6;
-const double SceneHighlightLayer = 1e10;
+using namespace QDirStat;
 
 
 TreemapView::TreemapView( QWidget * parent ):
@@ -46,14 +68,22 @@ TreemapView::TreemapView( QWidget * parent ):
     _selectionModelProxy(0),
     _cleanupCollection(0),
     _rebuilder(0),
+    _cushionRenderer(0),
+    _layouter(0),
+    _layoutCache(0),
+    _layoutRoot(0),
     _rootTile(0),
+    _raster(0),
     _currentItem(0),
     _currentItemRect(0),
     _sceneMask(0),
     _newRoot(0),
     _highlightedTile(0),
     _useFixedColor(false),
-    _useDirGradient(true)
+    _useDirGradient(true),
+    _tileCost(0.0),
+    _lowResPreview(0),
+    _treeDiff(0)
 {
     // logDebug() << endl;
 
@@ -66,6 +96,29 @@ TreemapView::TreemapView( QWidget * parent ):
     _lightY = -0.19518;
     _lightZ = 0.9759;
 
+#if HAVE_TREEMAP_GL
+    if ( _openGLRendering )
+    {
+	// Instanced drawing in TreemapGLRenderer needs OpenGL 3.3; QPainter
+	// also works with a core profile.
+
+	QSurfaceFormat format;
+	format.setVersion( 3, 3 );
+	format.setProfile( QSurfaceFormat::CoreProfile );
+
+	QOpenGLWidget * glViewport = new QOpenGLWidget();
+	CHECK_NEW( glViewport );
+
+	glViewport->setFormat( format );
+	setViewport( glViewport );	// takes over ownership
+
+	// Partial updates are expensive with OpenGL
+	setViewportUpdateMode( QGraphicsView::FullViewportUpdate );
+    }
+#else
+    _openGLRendering = false;
+#endif
+
     setHorizontalScrollBarPolicy( Qt::ScrollBarAlwaysOff );
     setVerticalScrollBarPolicy	( Qt::ScrollBarAlwaysOff );
 
@@ -74,6 +127,26 @@ TreemapView::TreemapView( QWidget * parent ):
 
     connect( _rebuilder, SIGNAL( rebuild() ),
 	     this,	 SLOT  ( rebuildTreemapDelayed() ) );
+
+    _cushionRenderer = new CushionRenderer( this );
+    CHECK_NEW( _cushionRenderer );
+    _cushionRenderer->setCacheSize( _cushionCacheSize * 1024 );
+
+    _layouter = new TreemapLayouter( this );
+    CHECK_NEW( _layouter );
+
+    connect( _layouter, SIGNAL( finished  ( TreemapLayout ) ),
+	     this,	SLOT  ( showLayout( TreemapLayout ) ) );
+
+    _layoutCache = new TreemapLayoutCache( this );
+    CHECK_NEW( _layoutCache );
+    _layoutCache->setCacheSize( _layoutCacheSize * 1024 );
+
+    _lowResPreviewTimer.setSingleShot( true );
+    _lowResPreviewTimer.setInterval( LOW_RES_PREVIEW_INTERVAL );
+
+    connect( &_lowResPreviewTimer, SIGNAL( timeout()	       ),
+	     this,		   SLOT	 ( showLowResPreview() ) );
 }
 
 
@@ -83,19 +156,38 @@ TreemapView::~TreemapView()
     // There is no settings dialog for this class because the settings are all
     // pretty obscure - strictly for experts.
     writeSettings();
+
+    // The layout worker thread might still access the tree
+    _layouter->cancel();
+
+    // Wait for the cushion rendering threads before the tiles are deleted
+    delete _cushionRenderer;
 }
 
 
 void TreemapView::clear()
 {
+    // A pending layout would replace the cleared treemap later
+    cancelLayout();
+
+    // The pending results refer to the tiles that are about to be deleted
+    _cushionRenderer->cancelAll();
+
+    // A preview that comes in late would cover the new treemap
+    _lowResPreviewTimer.stop();
+
     if ( scene() )
 	qDeleteAll( scene()->items() );
 
     _currentItem     = 0;
     _currentItemRect = 0;
     _rootTile	     = 0;
+    _tiles.clear();
+    _dirtyTiles.clear();
+    _raster	     = 0;
     _newRoot         = 0;
     _sceneMask       = 0;
+    _lowResPreview   = 0;
     _parentHighlightList.clear();
 }
 
@@ -104,19 +196,20 @@ void TreemapView::setDirTree( DirTree * newTree )
 {
     // logDebug() << endl;
     _tree = newTree;
+    _layoutCache->setDirTree( _tree );
 
     if ( ! _tree )
 	return;
 
-    if ( _tree->firstToplevel() )
+    if ( _tree->visibleRoot() )
     {
-	if ( ! _rootTile )
+	if ( ! treemapRoot() )
 	{
 	    // The treemap might already be created indirectly by
 	    // rebuildTreemap() called from resizeEvent() triggered by resize()
 	    // above. If this is so, don't do it again.
 
-	    rebuildTreemap( _tree->firstToplevel() );
+	    rebuildTreemap( _tree->visibleRoot() );
 	}
     }
 
@@ -129,6 +222,23 @@ void TreemapView::setDirTree( DirTree * newTree )
     connect( _tree, SIGNAL( clearing() ),
 	     this,  SLOT  ( clear()    ) );
 
+    // The cached cushions would still be valid, but there is little point
+    // in keeping them for a completely different tree
+
+    connect( _tree,		SIGNAL( clearing()   ),
+	     _cushionRenderer,	SLOT  ( clearCache() ) );
+
+    // The background layout must not see the tree changing
+
+    connect( _tree, SIGNAL( clearingSubtree	 ( DirInfo * ) ),
+	     this,  SLOT  ( clearingSubtreeNotify( DirInfo * ) ) );
+
+    connect( _tree, SIGNAL( startingReading() ),
+	     this,  SLOT  ( cancelLayout   () ) );
+
+    connect( _tree, SIGNAL( pagingInFiles	( DirInfo * ) ),
+	     this,  SLOT  ( pagingInFilesNotify( DirInfo * ) ) );
+
     connect( _tree, SIGNAL( finished()	     ),
 	     this,  SLOT  ( rebuildTreemap() ) );
 }
@@ -161,8 +271,8 @@ void TreemapView::setSelectionModel( SelectionModel * selectionModel )
     connect( _selectionModelProxy, SIGNAL( currentItemChanged( FileInfo *, FileInfo * ) ),
 	     this,		   SLOT	 ( updateCurrentItem ( FileInfo *		 ) ) );
 
-    connect( _selectionModelProxy, SIGNAL( selectionChanged( FileInfoSet ) ),
-	     this,		   SLOT	 ( updateSelection ( FileInfoSet ) ) );
+    connect( _selectionModelProxy, SIGNAL( selectionDelta	     ( FileInfoSet, FileInfoSet ) ),
+	     this,		   SLOT	 ( updateSelectionDelta( FileInfoSet, FileInfoSet ) ) );
 }
 
 
@@ -173,11 +283,23 @@ void TreemapView::readSettings()
 
     _ambientLight	= settings.value( "AmbientLight"     , DefaultAmbientLight ).toInt();
     _squarify		= settings.value( "Squarify"	     , true  ).toBool();
+    _flatRendering	= settings.value( "FlatRendering"    , false ).toBool();
+    _openGLRendering	= settings.value( "OpenGLRendering"  , false ).toBool();
+    _backgroundLayout	= settings.value( "BackgroundLayout" , true  ).toBool();
+    _progressiveDepth	= settings.value( "ProgressiveDepth" , 0     ).toInt();
+    _resizePreview	= settings.value( "ResizePreview"    , true  ).toBool();
+    _cushionCacheSize	= settings.value( "CushionCacheSize" , 64    ).toInt();
+    _layoutCacheSize	= settings.value( "LayoutCacheSize"  , 32    ).toInt();
     _doCushionShading	= settings.value( "CushionShading"   , true  ).toBool();
     _enforceContrast	= settings.value( "EnforceContrast"  , false ).toBool();
+    _hiDpiCushionMinSize = settings.value( "HiDpiCushionMinSize", DefaultHiDpiCushionMinSize ).toInt();
     _forceCushionGrid	= settings.value( "ForceCushionGrid" , false ).toBool();
     _useDirGradient	= settings.value( "UseDirGradient"   , true  ).toBool();
     _minTileSize	= settings.value( "MinTileSize"	     , DefaultMinTileSize ).toInt();
+    _rebuildTimeBudget	= settings.value( "RebuildTimeBudget", DefaultRebuildTimeBudget ).toInt();
+
+    _adaptiveMinTileSize = _minTileSize;
+    _currentMinTileSize	 = _minTileSize;
 
     _currentItemColor	= readColorEntry( settings, "CurrentItemColor"	, Qt::red		     );
     _selectedItemsColor = readColorEntry( settings, "SelectedItemsColor", Qt::yellow		     );
@@ -187,6 +309,10 @@ void TreemapView::readSettings()
     _dirFillColor	= readColorEntry( settings, "DirFillColor"	, QColor( 0x10, 0x7d, 0xb4 ) );
     _dirGradientStart	= readColorEntry( settings, "DirGradientStart"	, QColor( 0x60, 0x60, 0x70 ) );
     _dirGradientEnd	= readColorEntry( settings, "DirGradientEnd"	, QColor( 0x70, 0x70, 0x80 ) );
+    _grownColor		= readColorEntry( settings, "GrownColor"	, QColor( 0xe0, 0x30, 0x20 ) );
+    _shrunkColor	= readColorEntry( settings, "ShrunkColor"	, QColor( 0x30, 0xb0, 0x40 ) );
+    _unchangedColor	= readColorEntry( settings, "UnchangedColor"	, QColor( 0xa0, 0xa0, 0xa0 ) );
+    _newColor		= readColorEntry( settings, "NewColor"		, QColor( 0xff, 0x80, 0x00 ) );
 
     settings.endGroup();
 }
@@ -201,11 +327,20 @@ void TreemapView::writeSettings()
 
     settings.setValue( "AmbientLight"	   , _ambientLight	 );
     settings.setValue( "Squarify"	   , _squarify		 );
+    settings.setValue( "FlatRendering"	   , _flatRendering	 );
+    settings.setValue( "OpenGLRendering"   , _openGLRendering	 );
+    settings.setValue( "BackgroundLayout"  , _backgroundLayout	 );
+    settings.setValue( "ProgressiveDepth"  , _progressiveDepth	 );
+    settings.setValue( "ResizePreview"	   , _resizePreview	 );
+    settings.setValue( "CushionCacheSize"  , _cushionCacheSize	 );
+    settings.setValue( "LayoutCacheSize"   , _layoutCacheSize	 );
     settings.setValue( "CushionShading"	   , _doCushionShading	 );
     settings.setValue( "EnforceContrast"   , _enforceContrast	 );
+    settings.setValue( "HiDpiCushionMinSize", _hiDpiCushionMinSize );
     settings.setValue( "ForceCushionGrid"  , _forceCushionGrid	 );
     settings.setValue( "UseDirGradient"	   , _useDirGradient	 );
     settings.setValue( "MinTileSize"	   , _minTileSize	 );
+    settings.setValue( "RebuildTimeBudget" , _rebuildTimeBudget  );
 
     writeColorEntry( settings, "CurrentItemColor"  , _currentItemColor	 );
     writeColorEntry( settings, "SelectedItemsColor", _selectedItemsColor );
@@ -215,6 +350,10 @@ void TreemapView::writeSettings()
     writeColorEntry( settings, "DirFillColor"	   , _dirFillColor	 );
     writeColorEntry( settings, "DirGradientStart"  , _dirGradientStart	 );
     writeColorEntry( settings, "DirGradientEnd"	   , _dirGradientEnd	 );
+    writeColorEntry( settings, "GrownColor"	   , _grownColor	 );
+    writeColorEntry( settings, "ShrunkColor"	   , _shrunkColor	 );
+    writeColorEntry( settings, "UnchangedColor"	   , _unchangedColor	 );
+    writeColorEntry( settings, "NewColor"	   , _newColor		 );
 
     settings.endGroup();
 }
@@ -222,25 +361,10 @@ void TreemapView::writeSettings()
 
 void TreemapView::zoomIn()
 {
-    if ( ! canZoomIn() )
-	return;
-
-    TreemapTile * newRootTile = _currentItem;
+    FileInfo * newRoot = zoomInRoot();
 
-    while ( newRootTile &&
-	    newRootTile->parentTile() != _rootTile &&
-	    newRootTile->parentTile() ) // This should never happen, but who knows?
-    {
-	newRootTile = newRootTile->parentTile();
-    }
-
-    if ( newRootTile )
-    {
-	FileInfo * newRoot = newRootTile->orig();
-
-	if ( newRoot->isDirInfo() )
-	    rebuildTreemap( newRoot );
-    }
+    if ( newRoot )
+	rebuildTreemap( newRoot );
 }
 
 
@@ -249,9 +373,9 @@ void TreemapView::zoomOut()
     if ( ! canZoomOut() )
 	return;
 
-    FileInfo * newRoot = _rootTile->orig();
+    FileInfo * newRoot = treemapRoot();
 
-    if ( newRoot->parent() && newRoot->parent() != _tree->root() )
+    if ( newRoot->parent() && newRoot != _tree->visibleRoot() )
 	newRoot = newRoot->parent();
 
     rebuildTreemap( newRoot );
@@ -260,50 +384,93 @@ void TreemapView::zoomOut()
 
 void TreemapView::resetZoom()
 {
-    if ( _tree && _tree->firstToplevel() )
-	rebuildTreemap( _tree->firstToplevel() );
+    if ( _tree && _tree->visibleRoot() )
+	rebuildTreemap( _tree->visibleRoot() );
 }
 
 
-bool TreemapView::canZoomIn() const
+FileInfo * TreemapView::zoomInRoot() const
 {
-    if ( ! _currentItem || ! _rootTile )
-	return false;
+    FileInfo * newRoot = 0;
 
-    if ( _currentItem == _rootTile )
-	return false;
+    if ( _raster )
+    {
+	// Same as below, only with the parents from the layout
 
-    TreemapTile * newRootTile = _currentItem;
+	const TreemapLayout & layout = _raster->layout();
+	int index = layout.indexOf( _raster->currentItem() );
 
-    while ( newRootTile->parentTile() != _rootTile &&
-	    newRootTile->parentTile() ) // This should never happen, but who knows?
-    {
-	newRootTile = newRootTile->parentTile();
-    }
+	if ( index <= 0 )	// No current item or the root
+	    return 0;
 
-    if ( newRootTile )
+	while ( layout.tile( index ).parent > 0 )
+	    index = layout.tile( index ).parent;
+
+	newRoot = layout.tile( index ).orig;
+    }
+    else
     {
-	FileInfo * newRoot = newRootTile->orig();
+	if ( ! _currentItem || ! _rootTile )
+	    return 0;
+
+	if ( _currentItem == _rootTile )
+	    return 0;
 
-	if ( newRoot->isDirInfo() )
-	    return true;
+	TreemapTile * newRootTile = _currentItem;
+
+	while ( newRootTile->parentTile() != _rootTile &&
+		newRootTile->parentTile() ) // This should never happen, but who knows?
+	{
+	    newRootTile = newRootTile->parentTile();
+	}
+
+	newRoot = newRootTile->orig();
     }
 
-    return false;
+    return newRoot->isDirInfo() ? newRoot : 0;
+}
+
+
+bool TreemapView::canZoomIn() const
+{
+    return zoomInRoot() != 0;
 }
 
 
 bool TreemapView::canZoomOut() const
 {
-    if ( ! _rootTile || ! _tree->firstToplevel() )
+    if ( ! treemapRoot() || ! _tree->visibleRoot() )
 	return false;
 
-    return _rootTile->orig() != _tree->firstToplevel();
+    return treemapRoot() != _tree->visibleRoot();
+}
+
+
+FileInfo * TreemapView::treemapRoot() const
+{
+    if ( _layouter->isBusy() )
+	return _layoutRoot;
+
+    if ( _raster )
+	return _raster->root();
+
+    return _rootTile ? _rootTile->orig() : 0;
 }
 
 
 void TreemapView::rebuildTreemap()
 {
+    if ( ! _dirtyTiles.isEmpty() )
+    {
+	// Only some parts of the tree changed, and the tiles for them are
+	// already gone: Just fill those holes.
+
+	if ( ! _tree->isBusy() )  // Otherwise wait until reading is finished
+	    updateDirtyTiles();
+
+	return;
+    }
+
     FileInfo * root = 0;
 
     if ( ! _savedRootUrl.isEmpty() )
@@ -314,166 +481,867 @@ void TreemapView::rebuildTreemap()
     }
 
     if ( ! root )
-	root = _rootTile ? _rootTile->orig() : _tree->firstToplevel();
+	root = treemapRoot() ? treemapRoot() : _tree->visibleRoot();
 
     rebuildTreemap( root, sceneRect().size() );
     _savedRootUrl = "";
 }
 
 
-void TreemapView::rebuildTreemap( FileInfo *	 newRoot,
-				  const QSizeF & newSz )
+void TreemapView::rebuildTreemap( FileInfo *	 newRoot,
+				  const QSizeF & newSz )
+{
+    TRACE_SPAN( "TreemapView::rebuildTreemap" );
+
+    // logDebug() << endl;
+
+    QSizeF newSize = newSz;
+
+    if ( newSz.isEmpty() )
+	newSize = visibleSize();
+
+    QRectF rect = QRectF( 0.0, 0.0, (double) newSize.width(), (double) newSize.height() );
+
+    if ( ! newRoot || newSize.width() < UpdateMinSize || newSize.height() < UpdateMinSize )
+    {
+	// The treemap contents is displayed only if larger than a certain
+	// minimum visible size. This is an easy way for the user to avoid
+	// time-consuming delays when deleting a lot of files: Simply make the
+	// treemap (sub-) window very small.
+
+	// logDebug() << "Too small - suppressing treemap contents" << endl;
+
+	resetScene( rect );
+	emit treemapChanged();
+
+	return;
+    }
+
+    if ( newRoot->isDirInfo() )
+    {
+	// In an out-of-core tree, zooming into a directory brings its files
+	// back into memory.
+
+	newRoot->toDirInfo()->pageInFiles();
+
+	if ( newRoot->dotEntry() )
+	    newRoot->dotEntry()->pageInFiles();
+
+	if ( _tree && newRoot->pendingReadJobs() > 0 )
+	    _tree->prioritize( newRoot->toDirInfo() );
+    }
+
+    _currentMinTileSize = layoutMinTileSize( newRoot );
+
+    if ( _tree && ! _tree->isBusy() )
+    {
+	// Zooming back out or going back in the history shows a treemap
+	// that was laid out only moments ago
+
+	TreemapLayout cached;
+
+	if ( _layoutCache->find( newRoot, rect, _squarify, _currentMinTileSize, cached ) )
+	{
+	    cancelLayout();
+	    _rebuildStopwatch.invalidate();	// Says nothing about the cost
+	    showLayout( cached );
+
+	    return;
+	}
+    }
+
+    _rebuildStopwatch.start();
+
+    if ( _backgroundLayout && _tree && ! _tree->isBusy() )
+    {
+	// Keep the old treemap until the new layout is ready; this also
+	// cancels any layout that is still running for an older size or
+	// root.
+	//
+	// The subtree sums are calculated lazily, and that changes the
+	// tree, so make sure they are all up to date before the worker
+	// thread gets to see the tree.
+
+	newRoot->totalAllocatedSize();
+
+	if ( _progressiveDepth > 0 )
+	{
+	    // Show only the top levels right away; this takes about the same
+	    // time no matter how large the tree is. The complete layout
+	    // replaces it when it is ready.
+
+	    TreemapLayout preview( _squarify, _currentMinTileSize );
+	    preview.setMaxDepth( _progressiveDepth );
+	    preview.layout( newRoot, rect );
+	    showLayout( preview );
+
+	    if ( ! preview.isTruncated() )	// Nothing left to refine
+		return;
+	}
+
+	_layoutRoot = newRoot;
+	_layouter->start( newRoot, rect, _squarify, _currentMinTileSize );
+
+	return;	// showLayout() will follow
+    }
+
+#if REBUILD_STOPWATCH
+    QElapsedTimer stopwatch;
+    stopwatch.start();
+#endif
+
+    TreemapLayout layout( _squarify, _currentMinTileSize );
+    layout.layout( newRoot, rect );
+    showLayout( layout );
+
+#if REBUILD_STOPWATCH
+    logDebug() << "Treemap finished after "
+	       << formatMillisec( stopwatch.elapsed() )
+	       << endl;
+#endif
+}
+
+
+void TreemapView::showLayout( const TreemapLayout & layout )
+{
+    if ( _tree && ! _tree->isBusy() )
+	_layoutCache->insert( layout );	// ignores previews
+
+    resetScene( layout.rect() );
+
+    if ( ! layout.isEmpty() )
+    {
+	if ( _flatRendering )
+	{
+	    _raster = new TreemapRaster( this, layout );
+	    CHECK_NEW( _raster );
+	}
+	else
+	{
+	    QList<TreemapTile *> tiles = createTiles( layout );
+	    _rootTile = tiles.first();
+
+	    if ( _doCushionShading )
+		startCushionRendering( tiles );
+	}
+    }
+
+    // Synchronize selection with other views
+
+    if ( _selectionModel )
+    {
+	updateSelection( _selectionModel->selectedItems() );
+	updateCurrentItem( _selectionModel->currentItem() );
+    }
+
+    // A preview is not what the budget is about
+
+    if ( _rebuildStopwatch.isValid() && ! layout.isTruncated() )
+    {
+	adaptMinTileSize( layout.size(), _rebuildStopwatch.elapsed() );
+	_rebuildStopwatch.invalidate();
+    }
+
+    emit treemapChanged();
+}
+
+
+int TreemapView::layoutMinTileSize( FileInfo * root )
+{
+    if ( _rebuildTimeBudget <= 0 || _tileCost <= 0.0 )
+	return _adaptiveMinTileSize;
+
+    // Small trees get all the detail
+
+    if ( root && root->totalItems() * _tileCost <= _rebuildTimeBudget )
+	return _minTileSize;
+
+    return _adaptiveMinTileSize;
+}
+
+
+void TreemapView::adaptMinTileSize( int tileCount, qint64 elapsedMillisec )
+{
+    if ( _rebuildTimeBudget <= 0 || tileCount < MIN_TILES_FOR_TILE_COST )
+	return;
+
+    // Smooth the cost a little: It varies with the shape of the tree and
+    // with whatever else the machine is doing.
+
+    qreal cost = elapsedMillisec / (qreal) tileCount;
+    _tileCost  = _tileCost > 0.0 ? ( _tileCost + cost ) / 2.0 : cost;
+
+    if ( _currentMinTileSize != _adaptiveMinTileSize )
+	return;		// A small tree that got all the detail
+
+    qreal factor = sqrt( tileCount * _tileCost / _rebuildTimeBudget );
+
+    // Leave some room to avoid going back and forth all the time
+
+    if ( factor <= 1.2 && factor >= 0.6 )
+	return;
+
+    int newSize = qBound( _minTileSize,
+			  (int) ceil( _adaptiveMinTileSize * factor ),
+			  qMax( _minTileSize, MaxAdaptiveMinTileSize ) );
+
+    if ( newSize != _adaptiveMinTileSize )
+    {
+	logInfo() << tileCount << " tiles in " << elapsedMillisec << " millisec: "
+		  << "Min tile size now " << newSize << " instead of " << _adaptiveMinTileSize
+		  << endl;
+
+	_adaptiveMinTileSize = newSize;
+    }
+}
+
+
+void TreemapView::cancelLayout()
+{
+    _layouter->cancel();
+}
+
+
+void TreemapView::resetScene( const QRectF & rect )
+{
+    // Delete all old stuff.
+    clear();
+
+    if ( ! scene() )
+    {
+	QGraphicsScene * scene = new QGraphicsScene( this );
+	CHECK_NEW( scene);
+	setScene( scene );
+    }
+
+    scene()->setSceneRect( rect );
+
+    // Undo stretching the old treemap while resizing
+    resetTransform();
+}
+
+
+QList<TreemapTile *> TreemapView::createTiles( const TreemapLayout & layout,
+					       TreemapTile	   * rootTile )
+{
+    // The layout is in preorder, so each parent tile is created before its
+    // children.
+
+    const TreemapLayoutTileList & layoutTiles = layout.tiles();
+    QVector<TreemapTile *> tiles( layoutTiles.size() );
+    QList<TreemapTile *>   newTiles;
+
+    for ( int i = 0; i < layoutTiles.size(); ++i )
+    {
+	const TreemapLayoutTile & layoutTile = layoutTiles.at( i );
+
+	if ( i == 0 && rootTile )
+	{
+	    tiles[ i ] = rootTile;
+	    continue;
+	}
+
+	TreemapTile * parent = layoutTile.parent >= 0 ? tiles.at( layoutTile.parent ) : 0;
+
+	tiles[ i ] = new TreemapTile( this, parent, layoutTile );
+	CHECK_NEW( tiles[ i ] );
+
+	_tiles.insert( layoutTile.orig, tiles[ i ] );
+	newTiles << tiles[ i ];
+    }
+
+    return newTiles;
+}
+
+
+void TreemapView::startCushionRendering( const QList<TreemapTile *> & tiles,
+					 bool				placeholders )
+{
+    // This can only be done when the tree of tiles is complete: The ridges
+    // are added to a tile's cushion surface after it is created.
+
+    CushionJobList jobs;
+
+    foreach ( TreemapTile * tile, tiles )
+    {
+	if ( ! tile->needsCushion() )
+	    continue;
+
+	QRectF rect = tile->rect();
+
+	if ( rect.width() < 1.0 || rect.height() < 1.0 )
+	    continue;
+
+	CushionJob job;
+	job.tile    = tile;
+	job.rect    = rect;
+	job.surface = tile->cushionSurface();
+	job.color   = tileColor( tile->orig() );
+	job.scale   = cushionScale( rect );
+	jobs << job;
+
+	if ( placeholders )
+	    tile->setCushionPending();
+    }
+
+    _cushionRenderer->render( jobs, cushionLight() );
+}
+
+
+void TreemapView::reshade()
+{
+    if ( _raster )
+    {
+	_raster->reshade();
+	return;
+    }
+
+    if ( ! _rootTile )
+	return;
+
+    // Results of an older rendering would come with the old colors
+
+    _cushionRenderer->cancelAll();
+    QList<TreemapTile *> cushionTiles;
+
+    foreach ( TreemapTile * tile, _tiles )
+    {
+	if ( tile->needsCushion() )
+	    cushionTiles << tile;
+	else
+	    tile->setBrush( dirBrush( tile->orig(), tile->rect() ) );
+    }
+
+    if ( _doCushionShading )
+	startCushionRendering( cushionTiles, false ); // keep the old cushions
+
+    scene()->update();
+}
+
+
+void TreemapView::applySettings()
+{
+    bool squarify	     = _squarify;
+    bool flatRendering	     = _flatRendering;
+    bool openGLRendering     = _openGLRendering;
+    bool doCushionShading    = _doCushionShading;
+    int	 minTileSize	     = _minTileSize;
+    int	 adaptiveMinTileSize = _adaptiveMinTileSize;
+    int	 currentMinTileSize  = _currentMinTileSize;
+
+    readSettings();
+    _cushionRenderer->setCacheSize( _cushionCacheSize * 1024 );
+    _layoutCache->setCacheSize( _layoutCacheSize * 1024 );
+
+    if ( _minTileSize == minTileSize )
+    {
+	// Keep what was learnt about the time it takes to build the treemap
+
+	_adaptiveMinTileSize = adaptiveMinTileSize;
+	_currentMinTileSize  = currentMinTileSize;
+    }
+
+    if ( _squarify	   != squarify	       ||
+	 _flatRendering	   != flatRendering    ||
+	 _openGLRendering  != openGLRendering  ||
+	 _doCushionShading != doCushionShading ||
+	 _minTileSize	   != minTileSize )
+    {
+	if ( _tree && _tree->visibleRoot() && ! _tree->isBusy() )
+	    rebuildTreemap();
+    }
+    else
+    {
+	reshade();
+    }
+}
+
+
+CushionLight TreemapView::cushionLight() const
+{
+    // 'ambient' is the ambient light, the rest is the directed light source
+
+    CushionLight light;
+
+    light.ambient	  = (double) _ambientLight / 255;
+    light.lightX	  = ( 1 - light.ambient ) * _lightX;
+    light.lightY	  = ( 1 - light.ambient ) * _lightY;
+    light.lightZ	  = ( 1 - light.ambient ) * _lightZ;
+    light.enforceContrast = _enforceContrast;
+
+    return light;
+}
+
+
+qreal TreemapView::cushionScale( const QRectF & rect ) const
+{
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 6, 0 ))
+    qreal ratio = devicePixelRatioF();
+#else
+    qreal ratio = 1.0;
+#endif
+
+    if ( ratio <= 1.0 || _hiDpiCushionMinSize < 0 )
+	return 1.0;
+
+    if ( rect.width() < _hiDpiCushionMinSize || rect.height() < _hiDpiCushionMinSize )
+	return 1.0;
+
+    return ratio;
+}
+
+
+void TreemapView::scheduleRebuildTreemap( FileInfo * newRoot )
+{
+    _newRoot = newRoot;
+    _rebuilder->scheduleRebuild();
+}
+
+
+void TreemapView::rebuildTreemapDelayed()
+{
+    if ( ! _newRoot )
+        _newRoot = _tree->visibleRoot();
+
+    if ( _newRoot )
+        rebuildTreemap( _newRoot );
+}
+
+
+void TreemapView::deleteNotify( FileInfo * child )
+{
+    if ( canUpdateIncrementally( child ) )
+    {
+	// Only throw out the tiles of 'child'; the childDeleted() signal
+	// that the tree emits after deleting is done will trigger laying out
+	// the parent's contents again.
+
+	invalidateTiles( child, false );
+	return;
+    }
+
+    if ( treemapRoot() )
+    {
+	if ( treemapRoot() != _tree->visibleRoot() )
+	{
+	    // If the user zoomed the treemap in, save the root's URL so the
+	    // current state can be restored upon the next rebuildTreemap()
+	    // call (which is triggered by the childDeleted() signal that the
+	    // tree emits after deleting is done).
+	    //
+	    // Intentionally using debugUrl() here rather than just url() so
+	    // the correct zoom can be restored even when a dot entry is the
+	    // current treemap root.
+
+	    _savedRootUrl = treemapRoot()->debugUrl();
+	}
+	else
+	{
+	    // A shortcut for the most common case: No zoom. Simply use the
+	    // tree's root for the next treemap rebuild.
+
+	    _savedRootUrl = "";
+	}
+    }
+    else
+    {
+	// Intentionally leaving _savedRootUrl alone: Otherwise multiple
+	// deleteNotify() calls might cause a previously saved _savedRootUrl to
+	// be unnecessarily deleted, thus the treemap couldn't be restored as
+	// it was.
+    }
+
+    clear();
+}
+
+
+void TreemapView::clearingSubtreeNotify( DirInfo * subtree )
+{
+    if ( canUpdateIncrementally( subtree ) )
+    {
+	// Keep the tile of 'subtree', but not those of its children. The
+	// finished() signal after reading it again will trigger laying out
+	// its contents again.
+
+	invalidateTiles( subtree, true );
+    }
+    else
+    {
+	// The background layout must not see the tree changing
+
+	cancelLayout();
+    }
+}
+
+
+void TreemapView::pagingInFilesNotify( DirInfo * dir )
+{
+    Q_UNUSED( dir );
+
+    if ( _layouter->isBusy() )
+    {
+	// The background layout must not see the children changing; lay out
+	// everything again with the new children.
+
+	FileInfo * root = treemapRoot();
+	cancelLayout();
+	scheduleRebuildTreemap( root );
+    }
+}
+
+
+bool TreemapView::canUpdateIncrementally( FileInfo * item ) const
+{
+    // Not with flat rendering (there are no tiles) or while a new layout
+    // will replace the current one anyway.
+
+    if ( ! _rootTile || _layouter->isBusy() )
+	return false;
+
+    // If the treemap root itself is affected, there is nothing left to
+    // keep.
+
+    return ! _rootTile->orig()->isInSubtree( item );
+}
+
+
+void TreemapView::invalidateTiles( FileInfo * item, bool childrenOnly )
+{
+    // Dirty tiles in the part of the tree that goes away are gone, too
+
+    foreach ( FileInfo * dirty, _dirtyTiles )
+    {
+	if ( dirty->isInSubtree( item ) && ! ( childrenOnly && dirty == item ) )
+	    _dirtyTiles.remove( dirty );
+    }
+
+    // The nearest tile that remains is the one that needs a new layout
+    // of its contents. If there is none, this is outside of the treemap,
+    // so nothing changes at all.
+
+    FileInfo * dirty = childrenOnly ? item : item->parent();
+
+    while ( dirty && ! _tiles.contains( dirty ) )
+	dirty = dirty->parent();
+
+    if ( dirty )
+	_dirtyTiles.insert( dirty );
+
+    // Tiles only have child tiles if they have a tile themselves
+
+    TreemapTile * tile = _tiles.value( item );
+
+    if ( tile )
+	deleteTiles( tile, childrenOnly );
+}
+
+
+void TreemapView::deleteTiles( TreemapTile * tile, bool childrenOnly )
+{
+    QList<TreemapTile *> doomed;
+    QList<TreemapTile *> todo;
+    todo << tile;
+
+    while ( ! todo.isEmpty() )
+    {
+	TreemapTile * current = todo.takeFirst();
+
+	if ( current != tile || ! childrenOnly )
+	    doomed << current;
+
+	foreach ( QGraphicsItem * child, current->childItems() )
+	{
+	    TreemapTile * childTile = dynamic_cast<TreemapTile *>( child );
+
+	    if ( childTile )
+		todo << childTile;
+	}
+    }
+
+    if ( doomed.isEmpty() )
+	return;
+
+    // Forget everything that refers to those tiles
+
+    clearParentsHighlight();
+    bool cushionsPending = false;
+
+    foreach ( TreemapTile * doomedTile, doomed )
+    {
+	_tiles.remove( doomedTile->orig() );
+	doomedTile->deleteHighlighter();
+
+	if ( doomedTile->cushionPending() )
+	    cushionsPending = true;
+
+	if ( doomedTile == _currentItem )
+	{
+	    _currentItem = 0;
+
+	    if ( _currentItemRect )
+		_currentItemRect->hide();
+	}
+    }
+
+    // Deleting a tile also deletes its children.
+
+    if ( childrenOnly )
+    {
+	foreach ( QGraphicsItem * child, tile->childItems() )
+	{
+	    if ( dynamic_cast<TreemapTile *>( child ) )
+		delete child;
+	}
+    }
+    else
+    {
+	delete tile;
+    }
+
+    if ( cushionsPending )
+    {
+	// The cushion renderer can't forget single tiles, so start over
+	// with those of the remaining tiles that don't have a cushion yet.
+
+	_cushionRenderer->cancelAll();
+
+	QList<TreemapTile *> pending;
+
+	foreach ( TreemapTile * remaining, _tiles )
+	{
+	    if ( remaining->cushionPending() )
+		pending << remaining;
+	}
+
+	startCushionRendering( pending );
+    }
+}
+
+
+void TreemapView::updateDirtyTiles()
+{
+    QList<TreemapTile *> dirtyTiles;
+
+    foreach ( FileInfo * dirty, _dirtyTiles )
+    {
+	// Skip dirty tiles inside other dirty tiles: They will be laid out
+	// again anyway.
+
+	bool nested = false;
+
+	foreach ( FileInfo * other, _dirtyTiles )
+	{
+	    if ( other != dirty && dirty->isInSubtree( other ) )
+	    {
+		nested = true;
+		break;
+	    }
+	}
+
+	TreemapTile * tile = _tiles.value( dirty );
+
+	if ( tile && ! nested )
+	    dirtyTiles << tile;
+    }
+
+    _dirtyTiles.clear();
+    QList<TreemapTile *> newTiles;
+
+    foreach ( TreemapTile * tile, dirtyTiles )
+    {
+	// logDebug() << "Updating treemap tiles of " << tile->orig() << endl;
+
+	deleteTiles( tile, true );	// What is left of them
+
+	TreemapLayout layout( _squarify, _currentMinTileSize );
+	layout.layout( tile->orig(), tile->rect(), tile->cushionSurface() );
+	newTiles << createTiles( layout, tile );
+    }
+
+    if ( _doCushionShading )
+	startCushionRendering( newTiles );
+
+    // Synchronize selection with other views
+
+    if ( _selectionModel )
+    {
+	updateSelection( _selectionModel->selectedItems() );
+	updateCurrentItem( _selectionModel->currentItem() );
+    }
+
+    emit treemapChanged();
+}
+
+
+void TreemapView::resizeEvent( QResizeEvent * event )
+{
+    // logDebug() << endl;
+    QGraphicsView::resizeEvent( event );
+
+    if ( ! _tree )
+	return;
+
+    bool tooSmall = event->size().width()  < UpdateMinSize ||
+		    event->size().height() < UpdateMinSize;
+
+    if ( tooSmall && treemapRoot() )
+    {
+	// logDebug() << "Suppressing treemap contents" << endl;
+	scheduleRebuildTreemap( treemapRoot() );
+    }
+    else if ( ! tooSmall && ! treemapRoot() )
+    {
+	if ( _tree && _tree->visibleRoot() )
+	{
+	    // logDebug() << "Redisplaying suppressed treemap contents" << endl;
+	    scheduleRebuildTreemap( _tree->visibleRoot() );
+	}
+    }
+    else if ( treemapRoot() )
+    {
+	// logDebug() << "Auto-resizing treemap" << endl;
+
+	if ( _resizePreview )
+	    showResizePreview( event->size() );
+
+	scheduleRebuildTreemap( treemapRoot() );
+    }
+}
+
+
+void TreemapView::showResizePreview( const QSize & newSize )
 {
-    // logDebug() << endl;
+    QRectF rect = sceneRect();
 
-    QSizeF newSize = newSz;
-
-    if ( newSz.isEmpty() )
-	newSize = visibleSize();
+    if ( ! scene() || rect.width() < 1.0 || rect.height() < 1.0 )
+	return;
 
-    // Delete all old stuff.
-    clear();
+    // Stretching what is already there costs nothing, so the treemap
+    // follows the new size right away.
 
-    if ( ! scene() )
-    {
-	QGraphicsScene * scene = new QGraphicsScene( this );
-	CHECK_NEW( scene);
-	setScene( scene );
-    }
+    setTransform( QTransform::fromScale( newSize.width()  / rect.width(),
+					 newSize.height() / rect.height() ) );
 
-    QRectF rect = QRectF( 0.0, 0.0, (double) newSize.width(), (double) newSize.height() );
-    scene()->setSceneRect( rect );
+    // Don't restart the timer: The low-resolution preview should also be
+    // updated while the size keeps changing, not only when it pauses.
 
-    if ( newSize.width() >= UpdateMinSize && newSize.height() >= UpdateMinSize )
-    {
-	// The treemap contents is displayed if larger than a certain minimum
-	// visible size. This is an easy way for the user to avoid
-	// time-consuming delays when deleting a lot of files: Simply make the
-	// treemap (sub-) window very small.
+    if ( ! _lowResPreviewTimer.isActive() )
+	_lowResPreviewTimer.start();
+}
 
-	// Fill the new scene
 
-	if ( newRoot )
-	{
-#if REBUILD_STOPWATCH
-            QElapsedTimer stopwatch;
-	    stopwatch.start();
-#endif
+void TreemapView::showLowResPreview()
+{
+    FileInfo * root = treemapRoot();
+    QRectF     rect = sceneRect();
 
-	    _rootTile = new TreemapTile( this,		// parentView
-					 0,		// parentTile
-					 newRoot,	// orig
-					 rect,
-					 TreemapAuto );
+    if ( ! root || ! scene() || rect.width() < 1.0 || rect.height() < 1.0 )
+	return;
 
-#if REBUILD_STOPWATCH
-            logDebug() << "Treemap finished after "
-                       << formatMillisec( stopwatch.elapsed() )
-                       << endl;
-#endif
-	}
+    TRACE_SPAN( "TreemapView::showLowResPreview" );
 
+    QImage image = renderLowResPreview( root, visibleSize() );
 
-	// Synchronize selection with other views
+    if ( image.isNull() )
+	return;
 
-	if ( _selectionModel )
-	{
-	    updateSelection( _selectionModel->selectedItems() );
-	    updateCurrentItem( _selectionModel->currentItem() );
-	}
-    }
-    else
+    if ( ! _lowResPreview )
     {
-	// logDebug() << "Too small - suppressing treemap contents" << endl;
+	_lowResPreview = new QGraphicsPixmapItem();
+	CHECK_NEW( _lowResPreview );
+
+	_lowResPreview->setZValue( ResizePreviewLayer );
+	_lowResPreview->setAcceptedMouseButtons( Qt::NoButton );
+	_lowResPreview->setTransformationMode( Qt::SmoothTransformation );
+	scene()->addItem( _lowResPreview );
     }
 
-    emit treemapChanged();
+    // The scene still has the old size; the view's transform stretches it
+    // to the new one.
+
+    _lowResPreview->setPixmap( QPixmap::fromImage( image ) );
+    _lowResPreview->setTransform( QTransform::fromScale( rect.width()  / image.width(),
+							 rect.height() / image.height() ) );
 }
 
 
-void TreemapView::scheduleRebuildTreemap( FileInfo * newRoot )
+QImage TreemapView::renderLowResPreview( FileInfo * root, const QSizeF & size )
 {
-    _newRoot = newRoot;
-    _rebuilder->scheduleRebuild();
-}
+    QRectF rect( 0.0, 0.0,
+		 ceil( size.width()  * LOW_RES_PREVIEW_SCALE ),
+		 ceil( size.height() * LOW_RES_PREVIEW_SCALE ) );
 
+    if ( rect.width() < 1.0 || rect.height() < 1.0 )
+	return QImage();
 
-void TreemapView::rebuildTreemapDelayed()
-{
-    if ( ! _newRoot )
-        _newRoot = _tree->firstToplevel();
+    // Same min tile size in the low-resolution pixels: That makes the tiles
+    // coarser and a lot fewer.
 
-    if ( _newRoot )
-        rebuildTreemap( _newRoot );
-}
+    TreemapLayout layout( _squarify, _currentMinTileSize );
+    layout.layout( root, rect );
 
+    QImage image( (int) rect.width(), (int) rect.height(), QImage::Format_RGB32 );
+    image.fill( palette().color( QPalette::Base ).rgb() );
 
-void TreemapView::deleteNotify( FileInfo * )
-{
-    if ( _rootTile )
+    const TreemapLayoutTileList & tiles = layout.tiles();
+
+    // Like TreemapRaster::rasterize(), but without the cushion grid and
+    // the outlines: They would only be blurred when stretched.
+
+    QPainter painter( &image );
+    painter.setPen( Qt::NoPen );
+
+    for ( int i = 0; i < tiles.size(); ++i )
     {
-	if ( _rootTile->orig() != _tree->firstToplevel() )
+	const TreemapLayoutTile & tile = tiles.at( i );
+	FileInfo * orig = tile.orig;
+
+	if ( tile.rect.width() < 1.0 || tile.rect.height() < 1.0 )
+	    continue;
+
+	if ( orig->isDir() || orig->isDotEntry() || orig->isPkgInfo() )
 	{
-	    // If the user zoomed the treemap in, save the root's URL so the
-	    // current state can be restored upon the next rebuildTreemap()
-	    // call (which is triggered by the childDeleted() signal that the
-	    // tree emits after deleting is done).
-	    //
-	    // Intentionally using debugUrl() here rather than just url() so
-	    // the correct zoom can be restored even when a dot entry is the
-	    // current treemap root.
+	    if ( _doCushionShading || _useDirGradient )
+		painter.setBrush( dirBrush( orig, tile.rect ) );
+	    else
+		painter.setBrush( _dirFillColor );
 
-	    _savedRootUrl = _rootTile->orig()->debugUrl();
+	    painter.drawRect( tile.rect );
 	}
-	else
+	else if ( ! _doCushionShading )
 	{
-	    // A shortcut for the most common case: No zoom. Simply use the
-	    // tree's root for the next treemap rebuild.
-
-	    _savedRootUrl = "";
+	    painter.setBrush( tileColor( orig ) );
+	    painter.drawRect( tile.rect );
 	}
     }
-    else
-    {
-	// Intentionally leaving _savedRootUrl alone: Otherwise multiple
-	// deleteNotify() calls might cause a previously saved _savedRootUrl to
-	// be unnecessarily deleted, thus the treemap couldn't be restored as
-	// it was.
-    }
 
-    clear();
-}
+    painter.end();
 
+    if ( _doCushionShading )
+    {
+	// Enforcing the contrast is per tile, and with tiles this small it
+	// would mostly add noise.
 
-void TreemapView::resizeEvent( QResizeEvent * event )
-{
-    // logDebug() << endl;
-    QGraphicsView::resizeEvent( event );
+	CushionLight light = cushionLight();
+	light.enforceContrast = false;
 
-    if ( ! _tree )
-	return;
+	for ( int i = 0; i < tiles.size(); ++i )
+	{
+	    const TreemapLayoutTile & tile = tiles.at( i );
+	    FileInfo * orig = tile.orig;
 
-    bool tooSmall = event->size().width()  < UpdateMinSize ||
-		    event->size().height() < UpdateMinSize;
+	    if ( orig->isDir() || orig->isDotEntry() || orig->isPkgInfo() )
+		continue;
 
-    if ( tooSmall && _rootTile )
-    {
-	// logDebug() << "Suppressing treemap contents" << endl;
-	scheduleRebuildTreemap( _rootTile->orig() );
-    }
-    else if ( ! tooSmall && ! _rootTile )
-    {
-	if ( _tree && _tree->firstToplevel() )
-	{
-	    // logDebug() << "Redisplaying suppressed treemap contents" << endl;
-	    scheduleRebuildTreemap( _tree->firstToplevel() );
+	    if ( tile.rect.width() < 1.0 || tile.rect.height() < 1.0 )
+		continue;
+
+	    CushionRenderer::renderCushion( image, tile.rect, tile.surface,
+					    tileColor( orig ), light );
 	}
     }
-    else if ( _rootTile )
-    {
-	// logDebug() << "Auto-resizing treemap" << endl;
-	scheduleRebuildTreemap( _rootTile->orig() );
-    }
+
+    return image;
 }
 
 
@@ -500,7 +1368,7 @@ void TreemapView::enable()
 	if ( parentWidget )
 	    resize( parentWidget->height(), width() );
 
-	scheduleRebuildTreemap( _tree->firstToplevel() );
+	scheduleRebuildTreemap( _tree->visibleRoot() );
     }
 }
 
@@ -529,13 +1397,20 @@ void TreemapView::setCurrentItem( TreemapTile * tile )
 	    _currentItemRect->highlight( _currentItem );
     }
 
-    if ( oldCurrent != _currentItem && _selectionModelProxy )
-    {
-	// logDebug() << "Sending currentItemChanged " << _currentItem << endl;
+    if ( oldCurrent != _currentItem )
+	sendCurrentItem( _currentItem ? _currentItem->orig() : 0 );
+}
 
-	SignalBlocker sigBlocker( _selectionModelProxy ); // Prevent signal ping-pong
-	emit currentItemChanged( _currentItem ? _currentItem->orig() : 0 );
-    }
+
+void TreemapView::sendCurrentItem( FileInfo * node )
+{
+    if ( ! _selectionModelProxy )
+	return;
+
+    // logDebug() << "Sending currentItemChanged " << node << endl;
+
+    SignalBlocker sigBlocker( _selectionModelProxy ); // Prevent signal ping-pong
+    emit currentItemChanged( node );
 }
 
 
@@ -543,28 +1418,31 @@ void TreemapView::setCurrentItem( FileInfo * node )
 {
     // logDebug() << node << endl;
 
-    if ( node && _rootTile )
+    if ( node && treemapRoot() )
     {
-	FileInfo * treemapRoot = _rootTile->orig();
+	FileInfo * newRoot = treemapRoot();
 
 	// Check if the new current item is inside the current treemap
 	// (it might be zoomed).
 
-	while ( ! node->isInSubtree( treemapRoot ) &&
-		treemapRoot->parent() &&
-		treemapRoot->parent() != _tree->root() )
+	while ( ! node->isInSubtree( newRoot ) &&
+		newRoot->parent() &&
+		newRoot != _tree->visibleRoot() )
 	{
-	    treemapRoot = treemapRoot->parent(); // try one level higher
+	    newRoot = newRoot->parent(); // try one level higher
 	}
 
-	if ( treemapRoot != _rootTile->orig() )	  // need to zoom out?
+	if ( newRoot != treemapRoot() )	  // need to zoom out?
 	{
-	    logDebug() << "Zooming out to " << treemapRoot << " to make current item visible" << endl;
-	    rebuildTreemap( treemapRoot );
+	    logDebug() << "Zooming out to " << newRoot << " to make current item visible" << endl;
+	    rebuildTreemap( newRoot );
 	}
     }
 
-    setCurrentItem( findTile( node ) );
+    if ( _raster )
+	_raster->setCurrentItem( node );
+    else
+	setCurrentItem( findTile( node ) );
 }
 
 
@@ -575,13 +1453,70 @@ void TreemapView::updateSelection( const FileInfoSet & newSelection )
 
     // logDebug() << newSelection.size() << " items selected" << endl;
     SignalBlocker sigBlocker( this );
-    scene()->clearSelection();
+
+    if ( _raster )
+    {
+	_raster->setSelectedItems( newSelection );
+	updateCurrentItem( _raster->currentItem() );
+	return;
+    }
+
+    // Only touch the tiles whose selection state changes: Each one has to
+    // be repainted. The tiles are found with the _tiles hash, so this does
+    // not depend on the number of tiles in the scene.
+
+    foreach ( QGraphicsItem * item, scene()->selectedItems() )
+    {
+	TreemapTile * tile = dynamic_cast<TreemapTile *>( item );
+
+	if ( ! tile || ! newSelection.contains( tile->orig() ) )
+	    item->setSelected( false );
+    }
 
     foreach ( const FileInfo * item, newSelection )
     {
 	// logDebug() << "	 Selected: " << item << endl;
 	TreemapTile * tile = findTile( item );
 
+	if ( tile && ! tile->isSelected() )
+	    tile->setSelected( true );
+    }
+
+    updateCurrentItem( _currentItem ? _currentItem->orig() : 0 );
+}
+
+
+void TreemapView::updateSelectionDelta( const FileInfoSet & added,
+					const FileInfoSet & removed )
+{
+    if ( ! scene() )
+	return;
+
+    if ( _raster || ! _selectionModel )
+    {
+	// The raster treemap needs the complete set; the SelectionModel
+	// keeps it up to date incrementally anyway.
+
+	if ( _selectionModel )
+	    updateSelection( _selectionModel->selectedItems() );
+
+	return;
+    }
+
+    SignalBlocker sigBlocker( this );
+
+    foreach ( FileInfo * item, removed )
+    {
+	TreemapTile * tile = findTile( item );
+
+	if ( tile && ! added.contains( item ) )
+	    tile->setSelected( false );
+    }
+
+    foreach ( FileInfo * item, added )
+    {
+	TreemapTile * tile = findTile( item );
+
 	if ( tile )
 	    tile->setSelected( true );
     }
@@ -596,6 +1531,25 @@ void TreemapView::sendSelection()
 	return;
 
     SignalBlocker sigBlocker( _selectionModelProxy );
+
+    if ( _raster )
+    {
+	FileInfo *	    current	  = _raster->currentItem();
+	const FileInfoSet & selectedItems = _raster->selectedItems();
+
+	if ( current && selectedItems.size() == 1 && selectedItems.contains( current ) )
+	{
+	    _selectionModel->setCurrentItem( current, true ); // select
+	}
+	else
+	{
+	    _selectionModel->setSelectedItems( selectedItems );
+	    _selectionModel->setCurrentItem( current );
+	}
+
+	return;
+    }
+
     QList<QGraphicsItem *> selectedTiles = scene()->selectedItems();
 
     if ( selectedTiles.size() == 1 && selectedTiles.first() == _currentItem )
@@ -637,18 +1591,25 @@ void TreemapView::updateCurrentItem( FileInfo * currentItem )
 
 TreemapTile * TreemapView::findTile( const FileInfo * fileInfo )
 {
-    if ( ! fileInfo || ! scene() )
-	return 0;
+    return _tiles.value( fileInfo, 0 );
+}
+
+
+qint64 TreemapView::cushionBytes( qint64 & cacheBytes_ret ) const
+{
+    qint64 bytes = 0;
 
-    foreach ( QGraphicsItem *graphicsItem, scene()->items() )
+    foreach ( const TreemapTile * tile, _tiles )
     {
-	TreemapTile * tile = dynamic_cast<TreemapTile *>(graphicsItem);
+	const QPixmap & cushion = tile->cushion();
 
-	if ( tile && tile->orig() == fileInfo )
-	    return tile;
+	if ( ! cushion.isNull() )
+	    bytes += (qint64) cushion.width() * cushion.height() * cushion.depth() / 8;
     }
 
-    return 0;
+    cacheBytes_ret = _cushionRenderer ? _cushionRenderer->cacheUsed() * 1024LL : 0;
+
+    return bytes;
 }
 
 
@@ -661,6 +1622,63 @@ QSize TreemapView::visibleSize()
 }
 
 
+void TreemapView::setTreeDiff( TreeDiff * treeDiff )
+{
+    if ( _treeDiff )
+	disconnect( _treeDiff, 0, this, 0 );
+
+    _treeDiff = treeDiff;
+
+    if ( _treeDiff )
+    {
+	connect( _treeDiff, SIGNAL( changed()	      ),
+		 this,	    SLOT  ( treeDiffChanged() ) );
+    }
+}
+
+
+void TreemapView::treeDiffChanged()
+{
+    // Only the colors change
+
+    if ( _tree && _tree->visibleRoot() && ! _tree->isBusy() )
+	reshade();
+}
+
+
+QColor TreemapView::tileColor( FileInfo * file ) const
+{
+    if ( _useFixedColor )
+	return _fixedColor;
+
+    if ( ! _treeDiff || ! _treeDiff->isActive() )
+	return MimeCategorizer::instance()->color( file );
+
+    // Color by growth: The more an item grew (or shrank) in relation to its
+    // size, the more intense the color.
+
+    const TreeDiffItem * diff = _treeDiff->diff( file );
+
+    if ( diff && diff->isNew )
+	return _newColor;
+
+    if ( ! diff || diff->sizeDelta == 0 )
+	return _unchangedColor;
+
+    FileSize size    = file->totalSize();
+    FileSize oldSize = size - diff->sizeDelta;
+    FileSize maxSize = qMax( size, oldSize );
+    double   ratio   = maxSize > 0 ? qAbs( diff->sizeDelta ) / (double) maxSize : 1.0;
+    ratio = qBound( 0.2, ratio, 1.0 ); // Keep small changes visible
+
+    const QColor & color = diff->sizeDelta > 0 ? _grownColor : _shrunkColor;
+
+    return QColor( _unchangedColor.red()   + ( color.red()   - _unchangedColor.red()   ) * ratio,
+		   _unchangedColor.green() + ( color.green() - _unchangedColor.green() ) * ratio,
+		   _unchangedColor.blue()  + ( color.blue()  - _unchangedColor.blue()  ) * ratio );
+}
+
+
 void TreemapView::setFixedColor( const QColor & color )
 {
     _fixedColor	   = color;
@@ -744,6 +1762,82 @@ TreemapTile * TreemapView::highlightedParent() const
 }
 
 
+QBrush TreemapView::dirBrush( FileInfo * dir, const QRectF & rect ) const
+{
+    if ( ( dir->isDir() || dir->isDotEntry() ) && _useDirGradient )
+    {
+	if ( qMax( rect.width(), rect.height() ) < _currentMinTileSize )
+	    return QBrush( Qt::NoBrush );
+
+	QLinearGradient gradient( rect.topLeft(), rect.bottomRight() );
+	gradient.setColorAt( 0.0, _dirGradientStart );
+	gradient.setColorAt( 1.0, _dirGradientEnd   );
+
+	return QBrush( gradient );
+    }
+
+    return QBrush( QColor( 0x60, 0x60, 0x60 ) );
+}
+
+
+void TreemapView::openContextMenu( FileInfo * item, const QPoint & screenPos )
+{
+    if ( ! selectionModel() )
+	return;
+
+    FileInfoSet selectedItems = selectionModel()->selectedItems();
+
+    if ( ! selectedItems.contains( item ) )
+    {
+	logDebug() << "Abandoning old selection" << endl;
+	selectionModel()->setCurrentItem( item, true );
+	selectedItems = selectionModel()->selectedItems();
+    }
+
+    if ( selectionModel()->verbose() )
+	selectionModel()->dumpSelectedItems();
+
+    logDebug() << "Context menu for " << item << endl;
+
+    QMenu menu;
+    QStringList actions;
+
+    // The first action should not be a destructive one like "move to trash":
+    // It's just too easy to select and execute the first action accidentially,
+    // especially on a laptop touchpad.
+
+    actions << "actionGoUp"
+            << "actionGoToToplevel"
+            << "---"
+            << "actionMoveToTrash"
+        ;
+
+    // Intentionally adding unconditionally, even if disabled
+    ActionManager::instance()->addActions( &menu, actions );
+
+
+
+    // User-defined cleanups
+
+    if ( cleanupCollection() )
+	cleanupCollection()->addEnabledToMenu( &menu );
+
+    // Less commonly used menu options
+    actions.clear();
+    actions << "---"
+	    << "actionTreemapZoomIn"
+	    << "actionTreemapZoomOut"
+	    << "actionResetTreemapZoom"
+        ;
+
+    ActionManager::instance()->addEnabledActions( &menu, actions );
+
+    menu.exec( screenPos );
+}
+
+
+
+
 void TreemapView::sendHoverEnter( FileInfo * node )
 {
     emit hoverEnter( node );
@@ -762,7 +1856,8 @@ void TreemapView::sendHoverLeave( FileInfo * node )
 
 HighlightRect::HighlightRect( QGraphicsScene * scene, const QColor & color, int lineWidth ):
     QGraphicsRectItem(),
-    _tile(0)
+    _tile(0),
+    _outlineShape( false )
 {
     QPen pen( color, lineWidth );
     pen.setStyle( Qt::DotLine );
@@ -776,7 +1871,8 @@ HighlightRect::HighlightRect( QGraphicsScene * scene, const QColor & color, int
 
 HighlightRect::HighlightRect( TreemapTile * tile, const QColor & color, int lineWidth ):
     QGraphicsRectItem(),
-    _tile( tile )
+    _tile( tile ),
+    _outlineShape( true )
 {
     CHECK_PTR( tile );
 
@@ -787,9 +1883,26 @@ HighlightRect::HighlightRect( TreemapTile * tile, const QColor & color, int line
 }
 
 
+HighlightRect::HighlightRect( QGraphicsScene * scene,
+			      const QRectF   & rect,
+			      const QColor   & color,
+			      int	       lineWidth ):
+    QGraphicsRectItem(),
+    _tile(0),
+    _outlineShape( true )
+{
+    CHECK_PTR( scene );
+
+    setPen( QPen( color, lineWidth ) );
+    setZValue( TileHighlightLayer );
+    scene->addItem( this );
+    highlightRect( rect );
+}
+
+
 QPainterPath HighlightRect::shape() const
 {
-    if ( ! _tile )
+    if ( ! _outlineShape )
         return QGraphicsRectItem::shape();
 
     // Return just the outline as the shape so any tooltip is only displayed on
@@ -802,10 +1915,12 @@ QPainterPath HighlightRect::shape() const
 
     const int thickness = 10;
 
+    const QRectF outline = _tile ? _tile->rect() : rect();
+
     QPainterPath path;
-    path.addRect( _tile->rect() );
-    path.addRect( _tile->rect().adjusted( thickness,   thickness,
-                                          -thickness, -thickness ) );
+    path.addRect( outline );
+    path.addRect( outline.adjusted( thickness,   thickness,
+                                    -thickness, -thickness ) );
     return path;
 }
 
@@ -814,12 +1929,7 @@ void HighlightRect::highlight( TreemapTile * tile )
 {
     if ( tile )
     {
-	QRectF tileRect = tile->rect();
-	tileRect.moveTo( mapFromScene( tile->mapToScene( tileRect.topLeft() ) ) );
-	setRect( tileRect );
-
-	if ( ! isVisible() )
-	    show();
+	highlightRect( tile->mapRectToScene( tile->rect() ) );
     }
     else
     {
@@ -829,6 +1939,15 @@ void HighlightRect::highlight( TreemapTile * tile )
 }
 
 
+void HighlightRect::highlightRect( const QRectF & sceneRect )
+{
+    setRect( mapRectFromScene( sceneRect ) );
+
+    if ( ! isVisible() )
+	show();
+}
+
+
 void HighlightRect::setPenStyle( Qt::PenStyle style )
 {
     QPen highlightPen = pen();
@@ -863,20 +1982,39 @@ SceneMask::SceneMask( TreemapTile * tile, float opacity ):
     // logDebug() << "Adding scene mask for " << tile->orig() << endl;
     CHECK_PTR( tile );
 
+    init( tile->scene(), tile->rect(), opacity, SceneMaskLayer + tile->zValue() );
+}
+
+
+SceneMask::SceneMask( QGraphicsScene * scene, const QRectF & rect, float opacity ):
+    QGraphicsPathItem(),
+    _tile(0)
+{
+    CHECK_PTR( scene );
+
+    init( scene, rect, opacity, SceneMaskLayer + 1.0 );
+}
+
+
+void SceneMask::init( QGraphicsScene * scene,
+		      const QRectF   & rect,
+		      float	       opacity,
+		      double	       z )
+{
     QPainterPath path;
-    path.addRect( tile->scene()->sceneRect() );
+    path.addRect( scene->sceneRect() );
 
     // Since the default OddEvenFillRule leaves overlapping areas unfilled,
-    // adding the tile's rect that is inside the scene rect leaves the tile
-    // "cut out", i.e. unobscured.
+    // adding the rect that is inside the scene rect leaves it "cut out",
+    // i.e. unobscured.
 
-    path.addRect( tile->rect() );
+    path.addRect( rect );
     setPath( path );
 
     const int grey = 0x30;
     QColor color( grey, grey, grey, opacity * 255 );
     setBrush( color );
 
-    setZValue( SceneMaskLayer + tile->zValue() );
-    tile->scene()->addItem( this );
+    setZValue( z );
+    scene->addItem( this );
 }
@@ -15,9 +15,13 @@
 #include <QGraphicsRectItem>
 #include <QGraphicsPathItem>
 #include <QList>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QTimer>
 
 #include "MimeCategorizer.h"
 #include "FileInfo.h"
+#include "FileInfoSet.h"
 
 
 #define MinAmbientLight		   0
@@ -29,22 +33,47 @@
 
 #define DefaultMinTileSize	   3
 
+// Default target time for laying out and showing a treemap; 0 disables the
+// adaptive minimum tile size
+#define DefaultRebuildTimeBudget   1000	// millisec
+#define MaxAdaptiveMinTileSize	   32
+
+// Default minimum width and height of a tile for cushions with the full
+// device pixel ratio on HiDPI screens
+#define DefaultHiDpiCushionMinSize 32
+
+// Treemap layers (Z values)
+
+#define TileLayer		   0.0
+#define SceneMaskLayer		   1e5
+#define TileHighlightLayer	   1e6
+#define SceneHighlightLayer	   1e10
+#define ResizePreviewLayer	   1e11
+
 
 class QMouseEvent;
 class QSettings;
+class QGraphicsPixmapItem;
 
 
 namespace QDirStat
 {
     class TreemapTile;
+    class TreemapRaster;
+    class TreemapLayout;
+    class TreemapLayouter;
+    class TreemapLayoutCache;
     class HighlightRect;
     class SceneMask;
     class DirTree;
     class SelectionModel;
+    class TreeDiff;
     class SelectionModelProxy;
     class CleanupCollection;
     class FileInfoSet;
     class DelayedRebuilder;
+    class CushionRenderer;
+    struct CushionLight;
 
     typedef QList<HighlightRect *> HighlightRectList;
 
@@ -92,6 +121,21 @@ namespace QDirStat
 	 **/
 	TreemapTile * rootTile() const { return _rootTile; }
 
+	/**
+	 * Returns the FileInfo of the treemap root or 0 if there is none.
+	 * Unlike rootTile(), this also works with flat rendering.
+	 *
+	 * While a new layout is calculated in the background, this is
+	 * already the root of that new layout.
+	 **/
+	FileInfo * treemapRoot() const;
+
+	/**
+	 * Returns the item that renders the complete treemap with flat
+	 * rendering or 0 if there is none.
+	 **/
+	TreemapRaster * raster() const { return _raster; }
+
         /**
          * Returns the currently highlighted treemap tile (that was highlighted
          * with a middle click) or 0 if there is none.
@@ -129,18 +173,22 @@ namespace QDirStat
 	/**
 	 * Search the treemap for a tile that corresponds to the specified
 	 * FileInfo node. Returns 0 if there is none.
-	 *
-	 * Notice: This is an expensive operation since all treemap tiles need
-	 * to be searched.
 	 **/
 	TreemapTile * findTile( const FileInfo * node );
 
+	/**
+	 * Set the differences against a baseline. While they are active, the
+	 * tiles are colored by growth instead of by MIME category.
+	 **/
+	void setTreeDiff( TreeDiff * treeDiff );
+
 	/**
 	 * Returns a suitable color for 'file' based on a set of internal rules
-	 * (according to filename extension, MIME type or permissions).
+	 * (according to filename extension, MIME type or permissions) or
+	 * according to its growth if there are differences against a
+	 * baseline.
 	 **/
-	QColor tileColor( FileInfo * file ) const
-		{ return _useFixedColor ? _fixedColor : MimeCategorizer::instance()->color( file ); }
+	QColor tileColor( FileInfo * file ) const;
 
 	/**
 	 * Use a fixed color for all tiles. To undo this, set an invalid QColor
@@ -163,6 +211,13 @@ namespace QDirStat
 	 **/
 	void updateSelection( const FileInfoSet & newSelection );
 
+	/**
+	 * Update the selection with only the items that have been added to
+	 * or removed from the selection in another view.
+	 **/
+	void updateSelectionDelta( const FileInfoSet & added,
+				   const FileInfoSet & removed );
+
 	/**
 	 * Update the current item that has been changed in another view.
 	 **/
@@ -208,6 +263,23 @@ namespace QDirStat
 	 **/
 	void rebuildTreemap();
 
+	/**
+	 * Render the colors and the cushion shading of the current treemap
+	 * again, e.g. after the light or the colors changed: The tile
+	 * geometry and the cushion surfaces stay as they are, so this does
+	 * not need a new layout. The cushions are rendered in the background
+	 * threads of the CushionRenderer; the old ones stay visible until
+	 * the new ones are ready.
+	 **/
+	void reshade();
+
+	/**
+	 * Read the settings again and apply them: Rebuild the treemap if
+	 * anything changed that affects the layout or the kind of rendering,
+	 * otherwise only reshade() it.
+	 **/
+	void applySettings();
+
 	/**
 	 * Clear the treemap contents.
 	 **/
@@ -230,11 +302,34 @@ namespace QDirStat
 	 **/
 	void deleteNotify( FileInfo * node );
 
+	/**
+	 * Notification that the children of 'subtree' are about to be
+	 * cleared, e.g. for a refresh.
+	 **/
+	void clearingSubtreeNotify( DirInfo * subtree );
+
+	/**
+	 * Notification that the files of 'dir' are about to be paged in,
+	 * i.e. its children change.
+	 **/
+	void pagingInFilesNotify( DirInfo * dir );
+
 	/**
 	 * Sync the selected items and the current item to the selection model.
 	 **/
 	void sendSelection();
 
+	/**
+	 * Send a currentItemChanged() signal for 'node' to the selection
+	 * model.
+	 **/
+	void sendCurrentItem( FileInfo * node );
+
+	/**
+	 * Open the context menu for 'item' at 'screenPos'.
+	 **/
+	void openContextMenu( FileInfo * item, const QPoint & screenPos );
+
         /**
          * Send a hoverEnter() signal for 'node'.
          **/
@@ -355,6 +450,39 @@ namespace QDirStat
 	 **/
 	bool squarify() const { return _squarify; }
 
+	/**
+	 * Returns 'true' if the complete treemap is rendered into one single
+	 * graphics item (TreemapRaster) rather than one TreemapTile for each
+	 * item. This is a lot cheaper for very large trees.
+	 **/
+	bool flatRendering() const { return _flatRendering; }
+
+	/**
+	 * Returns 'true' if this view uses an OpenGL viewport. With flat
+	 * rendering, the cushions are then shaded on the GPU.
+	 **/
+	bool openGLRendering() const { return _openGLRendering; }
+
+	/**
+	 * Returns 'true' if the treemap layout is calculated in a worker
+	 * thread while the old treemap remains visible.
+	 **/
+	bool backgroundLayout() const { return _backgroundLayout; }
+
+	/**
+	 * Returns the number of levels of a quick preview layout that is
+	 * displayed right away while the complete layout is calculated in
+	 * the background, or 0 if there is no preview.
+	 **/
+	int progressiveDepth() const { return _progressiveDepth; }
+
+	/**
+	 * Returns 'true' if the treemap is stretched right away and then
+	 * replaced by a quick low-resolution version while the view is being
+	 * resized, before the full-quality rebuild when resizing settles.
+	 **/
+	bool resizePreview() const { return _resizePreview; }
+
 	/**
 	 * Returns 'true' if cushion shading is to be used, 'false' if not.
 	 **/
@@ -381,8 +509,12 @@ namespace QDirStat
 	/**
 	 * Returns the minimum tile size in pixels. No treemap tiles less than
 	 * this in width or height are desired.
+	 *
+	 * This is the minimum tile size that is currently used; it may be
+	 * more than the configured one to stay within the rebuild time
+	 * budget (see adaptMinTileSize()).
 	 **/
-	int minTileSize() const { return _minTileSize; }
+	int minTileSize() const { return _currentMinTileSize; }
 
 	/**
 	 * Returns the cushion grid color.
@@ -394,6 +526,11 @@ namespace QDirStat
 	 **/
 	const QColor & selectedItemsColor() const { return _selectedItemsColor; }
 
+	/**
+	 * Returns the color for the current item highlight rectangle.
+	 **/
+	const QColor & currentItemColor() const { return _currentItemColor; }
+
 	/**
 	 * Returns the outline color to use if cushion shading is not used.
 	 **/
@@ -423,6 +560,12 @@ namespace QDirStat
          **/
         const QColor & dirGradientEnd() const { return _dirGradientEnd; }
 
+	/**
+	 * Returns the brush for the tile of directory 'dir' (or any other
+	 * tile that does not get a cushion) with 'rect'.
+	 **/
+	QBrush dirBrush( FileInfo * dir, const QRectF & rect ) const;
+
 
 	/**
 	 * Returns the intensity of ambient light for cushion shading
@@ -449,6 +592,44 @@ namespace QDirStat
 	 **/
 	double lightZ() const { return _lightZ; }
 
+	/**
+	 * Returns the light source parameters for rendering cushions.
+	 **/
+	CushionLight cushionLight() const;
+
+	/**
+	 * Returns the minimum width and height of a tile in logical pixels
+	 * for rendering its cushion with the full device pixel ratio; 0 for
+	 * all tiles, -1 for none.
+	 **/
+	int hiDpiCushionMinSize() const { return _hiDpiCushionMinSize; }
+
+	/**
+	 * Returns the number of image pixels for each logical pixel in each
+	 * direction for the cushion of a tile with 'rect': The device pixel
+	 * ratio for tiles of at least hiDpiCushionMinSize(), 1.0 for smaller
+	 * ones.
+	 *
+	 * That keeps large cushions crisp on HiDPI screens without paying
+	 * for four times as many pixels for all the small ones: Those are
+	 * stretched when painted, and since a cushion is a smooth function,
+	 * that is hardly visible at their size.
+	 **/
+	qreal cushionScale( const QRectF & rect ) const;
+
+	/**
+	 * Return the number of treemap tiles.
+	 **/
+	int tileCount() const { return _tiles.size(); }
+
+	/**
+	 * Return the memory of the rendered cushions of all tiles in bytes
+	 * and the memory of the cushion cache in 'cacheBytes_ret'. Tiles and
+	 * the cache share the same cushions, so both may contain the same
+	 * pixmaps.
+	 **/
+	qint64 cushionBytes( qint64 & cacheBytes_ret ) const;
+
 
     signals:
 
@@ -494,6 +675,31 @@ namespace QDirStat
 	 **/
 	void rebuildTreemapDelayed();
 
+	/**
+	 * Recolor the tiles after the differences against the baseline
+	 * changed.
+	 **/
+	void treeDiffChanged();
+
+	/**
+	 * Replace the treemap contents with new tiles for 'layout'.
+	 **/
+	void showLayout( const TreemapLayout & layout );
+
+	/**
+	 * Cancel any layout that is being calculated in the background.
+	 * This waits for the worker thread, so afterwards it is safe to
+	 * change the tree.
+	 **/
+	void cancelLayout();
+
+	/**
+	 * Show a low-resolution version of the treemap for the current view
+	 * size on top of the stretched old one while the view is being
+	 * resized.
+	 **/
+	void showLowResPreview();
+
     protected:
 
 	/**
@@ -505,6 +711,92 @@ namespace QDirStat
 	 **/
 	virtual void resizeEvent( QResizeEvent * event ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Start rendering the cushions of all leaf tiles in the background.
+	 * With 'placeholders', the tiles show a plain placeholder until
+	 * their new cushion is ready, otherwise they keep the old one.
+	 **/
+	void startCushionRendering( const QList<TreemapTile *> & tiles,
+				    bool			 placeholders = true );
+
+	/**
+	 * Clear the treemap contents and set up the scene for 'rect'.
+	 **/
+	void resetScene( const QRectF & rect );
+
+	/**
+	 * Return the minimum tile size for laying out the subtree of 'root':
+	 * The configured one if each item of that subtree can get a tile
+	 * within the rebuild time budget, otherwise the adaptive one.
+	 **/
+	int layoutMinTileSize( FileInfo * root );
+
+	/**
+	 * Adapt the minimum tile size for the next rebuilds to the rebuild
+	 * time budget after a rebuild that created 'tileCount' tiles in
+	 * 'elapsedMillisec'. The number of tiles is roughly proportional to
+	 * 1 / minTileSize^2, so this scales the minimum tile size with the
+	 * square root of how far that rebuild was off the budget.
+	 **/
+	void adaptMinTileSize( int tileCount, qint64 elapsedMillisec );
+
+	/**
+	 * Stretch the current treemap to 'newSize' right away and schedule
+	 * a low-resolution preview for that size.
+	 **/
+	void showResizePreview( const QSize & newSize );
+
+	/**
+	 * Render the treemap of 'root' for 'size' into an image with only a
+	 * fraction of the pixels: Coarse tiles, cushions without contrast
+	 * enforcement and no grid.
+	 **/
+	QImage renderLowResPreview( FileInfo * root, const QSizeF & size );
+
+	/**
+	 * Create one TreemapTile for each tile of 'layout' and return them in
+	 * preorder, i.e. the root tile first.
+	 *
+	 * If 'rootTile' is specified, this existing tile is used for the root
+	 * of the layout, and only its new children are created and returned.
+	 **/
+	QList<TreemapTile *> createTiles( const TreemapLayout & layout,
+					  TreemapTile	      * rootTile = 0 );
+
+	/**
+	 * Return 'true' if the tiles for 'item' can be updated incrementally
+	 * rather than rebuilding the complete treemap.
+	 **/
+	bool canUpdateIncrementally( FileInfo * item ) const;
+
+	/**
+	 * Delete the tiles of 'item' (or just those of its children if
+	 * 'childrenOnly' is 'true') because that part of the tree is about
+	 * to go away, and remember the nearest tile that remains as dirty.
+	 **/
+	void invalidateTiles( FileInfo * item, bool childrenOnly );
+
+	/**
+	 * Delete 'tile' with all its children or just its children if
+	 * 'childrenOnly' is 'true'. This also deletes everything that
+	 * refers to those tiles: highlighters, the current item, pending
+	 * cushions.
+	 **/
+	void deleteTiles( TreemapTile * tile, bool childrenOnly );
+
+	/**
+	 * Lay out the contents of all dirty tiles again within their
+	 * current rectangles. The rest of the treemap remains untouched.
+	 **/
+	void updateDirtyTiles();
+
+	/**
+	 * Return the directory to zoom in to from the current item or 0 if
+	 * zooming in is not possible: The child of the treemap root that
+	 * contains the current item.
+	 **/
+	FileInfo * zoomInRoot() const;
+
 
 	// Data members
 
@@ -513,7 +805,14 @@ namespace QDirStat
 	SelectionModelProxy * _selectionModelProxy;
 	CleanupCollection   * _cleanupCollection;
         DelayedRebuilder    * _rebuilder;
+	CushionRenderer	    * _cushionRenderer;
+	TreemapLayouter	    * _layouter;
+	TreemapLayoutCache  * _layoutCache;
+	FileInfo	    * _layoutRoot;
 	TreemapTile	    * _rootTile;
+	QHash<const FileInfo *, TreemapTile *> _tiles;
+	FileInfoSet	      _dirtyTiles;
+	TreemapRaster	    * _raster;
 	TreemapTile	    * _currentItem;
 	HighlightRect	    * _currentItemRect;
         SceneMask           * _sceneMask;
@@ -523,11 +822,26 @@ namespace QDirStat
 	QString		      _savedRootUrl;
 
 	bool   _squarify;
+	bool   _flatRendering;
+	bool   _openGLRendering;
+	bool   _backgroundLayout;
+	int    _progressiveDepth;
+	bool   _resizePreview;
+	int    _cushionCacheSize;	// MB
+	int    _layoutCacheSize;	// MB
 	bool   _doCushionShading;
 	bool   _forceCushionGrid;
 	bool   _enforceContrast;
+	int    _hiDpiCushionMinSize;
 	bool   _useFixedColor;
 	int    _minTileSize;
+	int    _rebuildTimeBudget;	// millisec; 0 for a fixed min tile size
+	int    _adaptiveMinTileSize;
+	int    _currentMinTileSize;	// the one of the current layout
+	qreal  _tileCost;		// millisec per tile; 0 if unknown
+	QElapsedTimer _rebuildStopwatch;
+	QTimer _lowResPreviewTimer;
+	QGraphicsPixmapItem * _lowResPreview;
         bool   _useDirGradient;
 
 	QColor _currentItemColor;
@@ -539,6 +853,12 @@ namespace QDirStat
         QColor _dirGradientStart;
         QColor _dirGradientEnd;
 	QColor _fixedColor;
+	QColor _grownColor;
+	QColor _shrunkColor;
+	QColor _unchangedColor;
+	QColor _newColor;
+
+	TreeDiff * _treeDiff;
 
 	int    _ambientLight;
 
@@ -580,6 +900,15 @@ namespace QDirStat
 	 **/
 	HighlightRect( TreemapTile * tile, const QColor & color, int lineWidth = 2 );
 
+	/**
+	 * Create a highlight rectangle for 'rect' and highlight it right
+	 * away. This is used when there are no tiles (flat rendering).
+	 **/
+	HighlightRect( QGraphicsScene * scene,
+		       const QRectF   & rect,
+		       const QColor   & color,
+		       int		lineWidth = 2 );
+
 	/**
 	 * Highlight the specified treemap tile: Resize this selection
 	 * rectangle to match this tile and move it to this tile's
@@ -588,6 +917,12 @@ namespace QDirStat
 	 **/
 	virtual void highlight( TreemapTile * tile );
 
+	/**
+	 * Highlight 'rect' (in scene coordinates) and show this selection
+	 * rectangle if it is currently invisible.
+	 **/
+	void highlightRect( const QRectF & rect );
+
 	/**
 	 * Set the pen style. Recommended: Qt::SolidLine or Qt::DotLine.
 	 **/
@@ -615,6 +950,7 @@ namespace QDirStat
     protected:
 
         TreemapTile * _tile;
+	bool	      _outlineShape;
 
     }; // class TreemapSelectionRect
 
@@ -668,6 +1004,12 @@ namespace QDirStat
          **/
         SceneMask( TreemapTile * tile, float opacity );
 
+        /**
+         * Constructor: Create a mask like above that leaves 'rect'
+         * uncovered. This is used when there are no tiles (flat rendering).
+         **/
+        SceneMask( QGraphicsScene * scene, const QRectF & rect, float opacity );
+
         /**
          * Return the tile that this masks.
          **/
@@ -675,6 +1017,11 @@ namespace QDirStat
 
     protected:
 
+        /**
+         * Initialization common to all constructors.
+         **/
+        void init( QGraphicsScene * scene, const QRectF & rect, float opacity, double z );
+
         TreemapTile * _tile;
     };
 
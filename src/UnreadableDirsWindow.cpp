@@ -10,7 +10,7 @@
 #include "UnreadableDirsWindow.h"
 #include "QDirStatApp.h"        // SelectionModel
 #include "DirTree.h"
-#include "Attic.h"
+#include "DirInfo.h"
 #include "SelectionModel.h"
 #include "SettingsHelpers.h"
 #include "HeaderTweaker.h"
@@ -77,7 +77,8 @@ void UnreadableDirsWindow::initWidgets()
 		 << tr( "User"	      )
 		 << tr( "Group"	      )
 		 << tr( "Permissions" )
-		 << tr( "Perm."	      );
+		 << tr( "Perm."	      )
+		 << tr( "Error"	      );
 
     _ui->treeWidget->setColumnCount( headerLabels.size() );
     _ui->treeWidget->setHeaderLabels( headerLabels );
@@ -117,9 +118,25 @@ void UnreadableDirsWindow::populate( FileInfo * newSubtree )
     clear();
     _subtree = newSubtree;
 
-    logDebug() << "Locating all unreadable dirs below " << _subtree.url() << endl;
+    DirTree * tree = newSubtree ? newSubtree->tree() : _subtree.tree();
+
+    if ( tree )
+    {
+	foreach ( DirInfo * dir, tree->readErrorDirs( _subtree() ) )
+	{
+	    UnreadableDirListItem * searchResultItem =
+		new UnreadableDirListItem( dir->url(),
+					   dir->userName(),
+					   dir->groupName(),
+					   dir->symbolicPermissions(),
+					   dir->octalPermissions(),
+					   errorText( dir ) );
+	    CHECK_NEW( searchResultItem );
+
+	    _ui->treeWidget->addTopLevelItem( searchResultItem );
+	}
+    }
 
-    populateRecursive( newSubtree ? newSubtree : _subtree() );
     _ui->treeWidget->sortByColumn( 0, Qt::AscendingOrder );
 
     int count = _ui->treeWidget->topLevelItemCount();
@@ -148,44 +165,17 @@ void UnreadableDirsWindow::populate( FileInfo * newSubtree )
 }
 
 
-void UnreadableDirsWindow::populateRecursive( FileInfo * subtree )
+QString UnreadableDirsWindow::errorText( DirInfo * dir )
 {
-    if ( ! subtree || ! subtree->isDirInfo() )
-	return;
-
-    DirInfo * dir = subtree->toDirInfo();
-
-    if ( dir->readError() )
-    {
-	UnreadableDirListItem * searchResultItem =
-	    new UnreadableDirListItem( dir->url(),
-				       dir->userName(),
-				       dir->groupName(),
-				       dir->symbolicPermissions(),
-				       dir->octalPermissions() );
-	CHECK_NEW( searchResultItem );
-
-	_ui->treeWidget->addTopLevelItem( searchResultItem );
-    }
-
-
-    // Recurse through any subdirectories
-
-    FileInfo * child = dir->firstChild();
+    int errorNumber = dir->tree() ? dir->tree()->readErrorNumber( dir ) : 0;
 
-    while ( child )
-    {
-	if ( child->isDir() )
-	    populateRecursive( child );
-
-	child = child->next();
-    }
+    if ( errorNumber != 0 )
+	return formatErrno( errorNumber );
 
-    if ( dir->attic() )
-        populateRecursive( dir->attic() );
+    if ( dir->readState() == DirPermissionDenied )
+	return tr( "Permission denied" );
 
-    // No need to recurse through dot entries; they can't have any read error
-    // or any subdirectory children which might have a read error.
+    return tr( "Read error" );
 }
 
 
@@ -216,7 +206,8 @@ UnreadableDirListItem::UnreadableDirListItem( const QString & path,
 					      const QString & userName,
 					      const QString & groupName,
 					      const QString & symbolicPermissions,
-					      const QString & octalPermissions	) :
+					      const QString & octalPermissions,
+					      const QString & error		) :
     QTreeWidgetItem( QTreeWidgetItem::UserType ),
     _path( path )
 {
@@ -231,6 +222,7 @@ UnreadableDirListItem::UnreadableDirListItem( const QString & path,
     setText( ++col, groupName		);  setTextAlignment( col, Qt::AlignLeft    );
     setText( ++col, symbolicPermissions );  setTextAlignment( col, Qt::AlignHCenter );
     setText( ++col, octalPermissions	);  setTextAlignment( col, Qt::AlignRight   );
+    setText( ++col, error		);  setTextAlignment( col, Qt::AlignLeft    );
 }
 
 
@@ -38,6 +38,7 @@ namespace QDirStat
      *	 - group name
      *	 - permissions in octal ("0750")
      *	 - symbolic permissions "drwxrw----"
+     *	 - the error (the errno message if it is known)
      *
      * Upon click, the directory is located in the main window, i.e.  in the
      * main window's tree view all parent directories are opened, the directory
@@ -107,9 +108,10 @@ namespace QDirStat
 	/**
 	 * Populate the window: Locate unreadable directories in 'subtree'.
 	 *
-	 * This clears the old search results first, then searches the subtree
-	 * and populates the search result list with the directories could not
-	 * be read.
+	 * This clears the old search results first, then populates the
+	 * search result list with the directories in the subtree that could
+	 * not be read. This uses the unreadable directories that the DirTree
+	 * collects while reading, so it does not need to traverse the tree.
 	 **/
 	void populate( FileInfo * newSubtree );
 
@@ -145,10 +147,10 @@ namespace QDirStat
 	void initWidgets();
 
 	/**
-	 * Recursively find unreadable directories in a subtree and add an
-	 * entry to the tree widget for each one.
+	 * Return the text for the error column for unreadable directory
+	 * 'dir'.
 	 **/
-	void populateRecursive( FileInfo * subtree );
+	static QString errorText( DirInfo * dir );
 
 
 	//
@@ -192,7 +194,8 @@ namespace QDirStat
 			       const QString & userName,
 			       const QString & groupName,
 			       const QString & symbolicPermissions,
-			       const QString & octalPermissions	 );
+			       const QString & octalPermissions,
+			       const QString & error		 );
 
 	/**
 	 * Return the path of this directory.
@@ -13,7 +13,12 @@
 #include "QDirStatApp.h"
 #include "MainWindow.h"
 #include "DirTreeModel.h"
+#include "LatencyReplay.h"
+#include "RemoteScan.h"
+#include "ScanDaemon.h"
 #include "Settings.h"
+#include "TreeExporter.h"
+#include "TreemapExporter.h"
 #include "Logger.h"
 #include "Exception.h"
 #include "Version.h"
@@ -29,11 +34,21 @@ void usage( const QStringList & argList )
     cerr << "\n"
 	 << "Usage: \n"
 	 << "\n"
-	 << "  " << progName << " [--slow-update|-s] [<directory-name>]\n"
+	 << "  " << progName << " [--slow-update|-s] [<directory-name>...]\n"
 	 << "  " << progName << " pkg:/pkgpattern\n"
 	 << "  " << progName << " unpkg:/dir\n"
 	 << "  " << progName << " --dont-ask|-d\n"
 	 << "  " << progName << " --cache|-c <cache-file-name>\n"
+	 << "  " << progName << " ssh://[user@]host[:port][,[user@]host[:port]...]/dir\n"
+	 << "  " << progName << " --agent <directory-name>\n"
+	 << "  " << progName << " --agent-server\n"
+	 << "  " << progName << " --daemon <directory-name>\n"
+	 << "  " << progName << " --export <file.csv|file.ndjson> [--columns <col>,...]\n"
+	 << "       [--depth <n>] [--dirs-only] [--subtree <directory-name>]\n"
+	 << "       <directory-name|cache-file-name>\n"
+	 << "  " << progName << " --export-treemap <file.png|file.svg> [--size <w>x<h>]\n"
+	 << "       [--subtree <directory-name>] <directory-name|cache-file-name>\n"
+	 << "  " << progName << " --replay <script-file> <cache-file-name>\n"
 	 << "  " << progName << " --help|-h\n"
 	 << "\n"
 	 << "\n"
@@ -45,6 +60,28 @@ void usage( const QStringList & argList )
          << "- Exact match: \"pkg:/=mypkg\"\n"
          << "- All packages: \"pkg:/\"\n"
 	 << "\n"
+	 << "ssh:// reads a directory on another machine over SSH; that machine\n"
+	 << "needs qdirstat, too. It runs there with --agent which writes the\n"
+	 << "directory tree to stdout without any GUI.\n"
+	 << "With several hosts, the directories are distributed among them;\n"
+	 << "they run with --agent-server which reads commands from stdin.\n"
+	 << "\n"
+	 << "--daemon reads a directory once and keeps it up to date without any\n"
+	 << "GUI. Opening the same directory later takes the tree from there.\n"
+	 << "\n"
+	 << "--export reads a directory or a cache file without any GUI and writes\n"
+	 << "one line for each item to a CSV or NDJSON file (\"-\" for stdout).\n"
+	 << "Columns: path, size, items, files, subdirs, mtime, oldest_file_mtime,\n"
+	 << "user, group, permissions, octal_permissions.\n"
+	 << "\n"
+	 << "--export-treemap reads a directory or a cache file without any GUI\n"
+	 << "and writes its treemap to a PNG or SVG file of any size (default\n"
+	 << "4096x4096) with the treemap settings of the GUI.\n"
+	 << "\n"
+	 << "--replay reads a cache file, replays the GUI actions in a script\n"
+	 << "(expand, sort, zoom-in, zoom-out, stats, select, ...), and writes how\n"
+	 << "long each of them took to stdout as JSON. Then it quits.\n"
+	 << "\n"
          << "See also   man qdirstat"
 	 << "\n"
 	 << std::endl;
@@ -98,27 +135,53 @@ int main( int argc, char *argv[] )
     Logger logger( "/tmp/qdirstat-$USER", "qdirstat.log" );
     logVersion();
 
+    // The remote scan agent runs without any GUI: There might not even be
+    // a display on that machine.
+
+    if ( argc == 3 && QString( argv[1] ) == "--agent" )
+	return QDirStat::RemoteScanAgent::run( QString::fromLocal8Bit( argv[2] ), 1 );
+
+    if ( argc == 2 && QString( argv[1] ) == "--agent-server" )
+	return QDirStat::RemoteScanAgent::runServer( 0, 1 );
+
     // Set org/app name for QSettings
     QCoreApplication::setOrganizationName( "QDirStat" );
     QCoreApplication::setApplicationName ( "QDirStat" );
 
+    // The scan daemon runs without any GUI, too, but it uses the settings
+    // (e.g. the exclude rules).
+
+    if ( argc == 3 && QString( argv[1] ) == "--daemon" )
+	return QDirStat::ScanDaemon::run( QString::fromLocal8Bit( argv[2] ), argc, argv );
+
+    if ( argc >= 3 && QString( argv[1] ) == "--export" )
+	return QDirStat::TreeExporter::run( argc, argv );
+
+    if ( argc >= 3 && QString( argv[1] ) == "--export-treemap" )
+	return QDirStat::TreemapExporter::run( argc, argv );
+
     QApplication qtApp( argc, argv);
     QStringList argList = QCoreApplication::arguments();
     argList.removeFirst(); // Remove program name
 
     MainWindow * mainWin = new MainWindow();
     CHECK_PTR( mainWin );
-    mainWin->show();
 
     bool dont_ask = commandLineSwitch( "--dont-ask", "-d", argList );
 
     if ( commandLineSwitch( "--slow-update", "-s", argList ) )
         QDirStat::app()->dirTreeModel()->setSlowUpdate();
 
+    // Start reading before showing the main window: The scanner threads can
+    // already work while the window is shown and painted for the first time.
+
+    bool askOpenDir = false;
+    QString replayScript;
+    QString replayCache;
+
     if ( argList.isEmpty() )
     {
-        if ( ! dont_ask )
-            mainWin->askOpenDir();
+        askOpenDir = ! dont_ask;
     }
     else
     {
@@ -135,18 +198,45 @@ int main( int argc, char *argv[] )
 	    else
 		usage( argList );
 	}
+	else if ( arg == "--replay" )
+	{
+	    if ( argList.size() == 3 )
+	    {
+		replayScript = argList.at(1);
+		replayCache  = argList.at(2);
+	    }
+	    else
+		usage( argList );
+	}
 	else if ( arg == "--help" || arg == "-h" )
 	    usage( argList );
-	else if ( arg.startsWith( "-" ) || argList.size() > 1 )
+	else if ( arg.startsWith( "-" ) )
 	    usage( argList );
+	else if ( argList.size() > 1 )
+	{
+	    // Several directories to compare them
+	    mainWin->openDirs( argList );
+	}
 	else if ( ! arg.isEmpty() )
 	{
             mainWin->openUrl( arg );
 	}
     }
 
+    mainWin->show();
+
+    if ( askOpenDir )
+        mainWin->askOpenDir();
+
+    int exitCode = fatal ? 1 : 0;
+
     if ( ! fatal )
-	qtApp.exec();
+    {
+	if ( ! replayScript.isEmpty() )
+	    exitCode = QDirStat::LatencyReplay::run( mainWin, replayScript, replayCache );
+	else
+	    qtApp.exec();
+    }
 
     delete mainWin;
 
@@ -156,5 +246,5 @@ int main( int argc, char *argv[] )
     // our config files if possible.
     QDirStat::Settings::fixFileOwners();
 
-    return fatal ? 1 : 0;
+    return exitCode;
 }
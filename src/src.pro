@@ -11,13 +11,31 @@
 
 TEMPLATE	 = app
 
-QT		+= widgets
+QT		+= widgets network
 # Commented out to get -O2 optimization by default (issue #160)
 # CONFIG	+= debug
 DEPENDPATH	+= .
 MOC_DIR		 = .moc
 OBJECTS_DIR	 = .obj
-LIBS		+= -lz
+LIBS		+= -lz -lrt
+
+# Optional: Read the RPM database directly with librpm instead of starting
+# "rpm -ql" for each package. Enable with
+#
+#     qmake CONFIG+=librpm
+
+CONFIG(librpm) {
+    CONFIG	+= link_pkgconfig
+    PKGCONFIG	+= rpm
+    DEFINES	+= HAVE_LIBRPM
+}
+
+# Optional: Keep logDebug() and logVerbose() in a release build. By default,
+# they are only compiled in with CONFIG+=debug. Enable with
+#
+#     qmake CONFIG+=debuglog
+
+CONFIG(debuglog): DEFINES += LOG_MIN_SEVERITY=LogSeverityVerbose
 
 major_is_less_5 = $$find(QT_MAJOR_VERSION, [234])
 !isEmpty(major_is_less_5):DEFINES += 'Q_DECL_OVERRIDE=""'
@@ -51,20 +69,36 @@ SOURCES	  = main.cpp			\
             QDirStatApp.cpp             \
 	    ActionManager.cpp		\
 	    AdaptiveTimer.cpp		\
+	    AsyncCommand.cpp		\
             Attic.cpp			\
+	    BackgroundCacheWriter.cpp	\
+	    BinaryCache.cpp		\
+	    BlockGzip.cpp		\
             BookmarksManager.cpp        \
 	    BreadcrumbNavigator.cpp	\
 	    BucketsTableModel.cpp	\
 	    BusyPopup.cpp		\
+	    CacheDelta.cpp		\
+	    CacheIndex.cpp		\
+	    CacheParser.cpp		\
+	    CacheSummary.cpp		\
+	    CacheVerifier.cpp		\
 	    Cleanup.cpp			\
 	    CleanupCollection.cpp	\
 	    CleanupConfigPage.cpp	\
+	    CompactName.cpp		\
 	    ConfigDialog.cpp		\
+	    CushionRenderer.cpp	\
+	    CushionSurface.cpp		\
 	    DataColumns.cpp		\
 	    DebugHelpers.cpp		\
 	    DelayedRebuilder.cpp	\
+	    Deleter.cpp			\
+	    DeviceTable.cpp		\
 	    DirInfo.cpp			\
+	    DirLookup.cpp		\
 	    DirReadJob.cpp		\
+	    DirScanner.cpp		\
 	    DirSaver.cpp		\
 	    DirTree.cpp			\
 	    DirTreeCache.cpp		\
@@ -72,14 +106,18 @@ SOURCES	  = main.cpp			\
 	    DirTreePatternFilter.cpp	\
 	    DirTreePkgFilter.cpp	\
 	    DirTreeView.cpp		\
+	    DirWatcher.cpp		\
 	    DiscoverActions.cpp		\
+	    DiscoverCache.cpp		\
 	    DotEntry.cpp		\
 	    DpkgPkgManager.cpp		\
+	    DuplicateFinder.cpp		\
 	    Exception.cpp		\
 	    ExcludeRules.cpp		\
 	    ExcludeRulesConfigPage.cpp	\
 	    ExistingDirCompleter.cpp	\
             ExistingDirValidator.cpp	\
+	    ExtentScanner.cpp		\
 	    FileAgeStats.cpp		\
 	    FileAgeStatsWindow.cpp	\
 	    FileDetailsView.cpp		\
@@ -88,6 +126,7 @@ SOURCES	  = main.cpp			\
 	    FileInfoSet.cpp		\
 	    FileInfoSorter.cpp		\
             FileMTimeStats.cpp		\
+	    FileNameIndex.cpp		\
             FileSearchFilter.cpp        \
 	    FileSizeLabel.cpp		\
 	    FileSizeStats.cpp		\
@@ -96,8 +135,10 @@ SOURCES	  = main.cpp			\
 	    FileTypeStats.cpp		\
 	    FileTypeStatsWindow.cpp	\
             FindFilesDialog.cpp         \
+	    FlatpakPkgManager.cpp	\
 	    FormatUtil.cpp		\
 	    GeneralConfigPage.cpp	\
+	    HardLinkIndex.cpp		\
 	    HeaderTweaker.cpp		\
 	    HistogramDraw.cpp		\
 	    HistogramItems.cpp		\
@@ -105,6 +146,8 @@ SOURCES	  = main.cpp			\
 	    HistogramView.cpp		\
 	    History.cpp			\
 	    HistoryButtons.cpp		\
+	    IdTable.cpp			\
+	    LatencyReplay.cpp		\
 	    ListEditor.cpp		\
 	    LocateFileTypeWindow.cpp	\
 	    LocateFilesWindow.cpp	\
@@ -114,14 +157,21 @@ SOURCES	  = main.cpp			\
 	    MainWindowLayout.cpp	\
 	    MainWindowMenus.cpp		\
 	    MainWindowUnpkg.cpp		\
+	    MemoryPressure.cpp		\
+	    MemoryStats.cpp		\
+	    MemoryStatsWindow.cpp	\
 	    MessagePanel.cpp		\
 	    MimeCategorizer.cpp		\
 	    MimeCategory.cpp		\
 	    MimeCategoryConfigPage.cpp	\
 	    MountPoints.cpp		\
+	    NameMatcher.cpp		\
+	    NodeArena.cpp		\
 	    OpenDirDialog.cpp		\
 	    OpenPkgDialog.cpp		\
 	    OutputWindow.cpp		\
+	    OwnerStats.cpp		\
+	    OwnerStatsWindow.cpp	\
 	    PacManPkgManager.cpp	\
 	    PanelMessage.cpp		\
 	    PathSelector.cpp		\
@@ -131,25 +181,56 @@ SOURCES	  = main.cpp			\
 	    PkgFilter.cpp		\
 	    PkgInfo.cpp			\
 	    PkgManager.cpp		\
+	    PkgNameIndex.cpp		\
 	    PkgQuery.cpp		\
 	    PkgReader.cpp		\
 	    PopupLabel.cpp		\
 	    Process.cpp			\
 	    ProcessStarter.cpp		\
+	    QuantileSketch.cpp		\
 	    Refresher.cpp		\
+	    RemoteScan.cpp		\
+	    RemoteScanCoordinator.cpp	\
 	    RpmPkgManager.cpp		\
+	    ScanDaemon.cpp		\
+	    ScanStats.cpp		\
+	    ScanStatsWindow.cpp		\
+	    ScanTuner.cpp		\
 	    SearchFilter.cpp		\
 	    SelectionModel.cpp		\
+	    SelectionSummary.cpp	\
+	    SessionCache.cpp		\
 	    Settings.cpp		\
 	    SettingsHelpers.cpp		\
+	    SharedStats.cpp		\
+	    SharedTree.cpp		\
 	    ShowUnpkgFilesDialog.cpp	\
 	    SizeColDelegate.cpp		\
+	    SnapPkgManager.cpp		\
+	    SpillStore.cpp		\
+	    StatRing.cpp		\
+	    StatsEngine.cpp		\
 	    StdCleanup.cpp		\
 	    Subtree.cpp			\
+	    SuffixIndex.cpp		\
 	    SysUtil.cpp			\
 	    SystemFileChecker.cpp	\
+	    TopFilesCollector.cpp	\
+	    Trace.cpp			\
 	    Trash.cpp			\
+	    TrashJob.cpp		\
+	    TreeColumns.cpp		\
+	    TreeDiff.cpp		\
+	    TreeExporter.cpp	\
+	    TreeQuery.cpp		\
+	    TreeSnapshot.cpp		\
 	    TreeWalker.cpp		\
+	    TreemapExporter.cpp	\
+	    TreemapGLRenderer.cpp	\
+	    TreemapLayout.cpp		\
+	    TreemapLayoutCache.cpp	\
+	    TreemapLayouter.cpp		\
+	    TreemapRaster.cpp		\
 	    TreemapTile.cpp		\
 	    TreemapView.cpp		\
 	    UnpkgSettings.cpp		\
@@ -160,21 +241,37 @@ HEADERS	  =				\
             QDirStatApp.h		\
 	    ActionManager.h		\
 	    AdaptiveTimer.h		\
+	    AsyncCommand.h		\
 	    Attic.h			\
+	    BackgroundCacheWriter.h	\
+	    BinaryCache.h		\
+	    BlockGzip.h		\
             BookmarksManager.h          \
             BreadcrumbNavigator.h	\
             BrokenLibc.h                \
 	    BucketsTableModel.h		\
 	    BusyPopup.h			\
+	    CacheDelta.h		\
+	    CacheIndex.h		\
+	    CacheParser.h		\
+	    CacheSummary.h		\
+	    CacheVerifier.h		\
 	    Cleanup.h			\
 	    CleanupCollection.h		\
 	    CleanupConfigPage.h		\
+	    CompactName.h		\
 	    ConfigDialog.h		\
+	    CushionRenderer.h		\
+	    CushionSurface.h		\
 	    DataColumns.h		\
 	    DebugHelpers.h		\
 	    DelayedRebuilder.h		\
+	    Deleter.h			\
+	    DeviceTable.h		\
 	    DirInfo.h			\
+	    DirLookup.h			\
 	    DirReadJob.h		\
+	    DirScanner.h		\
 	    DirSaver.h			\
 	    DirTree.h			\
 	    DirTreeCache.h		\
@@ -183,46 +280,64 @@ HEADERS	  =				\
 	    DirTreePatternFilter.h	\
 	    DirTreePkgFilter.h		\
 	    DirTreeView.h		\
+	    DirWatcher.h		\
 	    DiscoverActions.h		\
+	    DiscoverCache.h		\
 	    DotEntry.h			\
 	    DpkgPkgManager.h		\
+	    DuplicateFinder.h		\
 	    Exception.h			\
 	    ExcludeRules.h		\
 	    ExcludeRulesConfigPage.h	\
 	    ExistingDirCompleter.h	\
 	    ExistingDirValidator.h	\
+	    ExtentScanner.h		\
 	    FileDetailsView.h		\
 	    FileInfo.h			\
 	    FileInfoIterator.h		\
 	    FileInfoSet.h		\
 	    FileInfoSorter.h		\
 	    FileMTimeStats.h		\
+	    FileNameIndex.h		\
             FileSearchFilter.h          \
 	    FileSizeLabel.h		\
 	    FileSizeStats.h		\
 	    FileSizeStatsWindow.h	\
 	    FileSystemsWindow.h		\
 	    FileTypeStats.h		\
+	    FlatpakPkgManager.h		\
 	    GeneralConfigPage.h		\
+	    HardLinkIndex.h		\
 	    HeaderTweaker.h		\
 	    HistogramItems.h		\
 	    HistogramView.h		\
+	    IdTable.h			\
+	    LatencyReplay.h		\
 	    ListEditor.h		\
 	    ListMover.h			\
 	    LocateFileTypeWindow.h	\
 	    LocateFilesWindow.h		\
 	    Logger.h			\
 	    MainWindow.h		\
+	    MemoryPressure.h		\
+	    MemoryStats.h		\
+	    MemoryStatsWindow.h		\
 	    MessagePanel.h		\
 	    MimeCategorizer.h		\
 	    MimeCategory.h		\
 	    MimeCategoryConfigPage.h	\
 	    MountPoints.h		\
+	    MpscRing.h		\
+	    NameMatcher.h		\
+	    NodeArena.h			\
 	    OpenDirDialog.h		\
 	    OpenPkgDialog.h		\
 	    OutputWindow.h		\
+	    OwnerStats.h		\
+	    OwnerStatsWindow.h		\
 	    PacManPkgManager.h		\
 	    PanelMessage.h		\
+	    ParallelSort.h		\
 	    PathSelector.h		\
 	    PercentBar.h		\
 	    PercentileStats.h		\
@@ -230,26 +345,57 @@ HEADERS	  =				\
 	    PkgFilter.h			\
 	    PkgInfo.h			\
 	    PkgManager.h		\
+	    PkgNameIndex.h		\
 	    PkgQuery.h			\
 	    PkgReader.h			\
 	    PopupLabel.h		\
 	    Process.h			\
 	    ProcessStarter.h		\
 	    Qt4Compat.h			\
+	    QuantileSketch.h		\
 	    Refresher.h			\
+	    RemoteScan.h		\
+	    RemoteScanCoordinator.h	\
 	    RpmPkgManager.h		\
+	    ScanDaemon.h		\
+	    ScanStats.h			\
+	    ScanStatsWindow.h		\
+	    ScanTuner.h			\
 	    SearchFilter.h              \
 	    SelectionModel.h		\
+	    SelectionSummary.h		\
+	    SessionCache.h		\
 	    Settings.h			\
 	    SettingsHelpers.h		\
+	    SharedStats.h		\
+	    SharedTree.h		\
 	    ShowUnpkgFilesDialog.h	\
 	    SignalBlocker.h		\
 	    SizeColDelegate.h		\
+	    SnapPkgManager.h		\
+	    SpillStore.h		\
+	    StatRing.h		\
+	    StatsEngine.h		\
 	    StdCleanup.h		\
 	    Subtree.h			\
+	    SuffixIndex.h		\
 	    SysUtil.h			\
 	    SystemFileChecker.h		\
+	    TopFilesCollector.h		\
+	    Trace.h			\
 	    Trash.h			\
+	    TrashJob.h			\
+	    TreeColumns.h		\
+	    TreeDiff.h		\
+	    TreeExporter.h		\
+	    TreeQuery.h		\
+	    TreeSnapshot.h		\
+	    TreemapExporter.h		\
+	    TreemapGLRenderer.h		\
+	    TreemapLayout.h		\
+	    TreemapLayoutCache.h	\
+	    TreemapLayouter.h		\
+	    TreemapRaster.h		\
 	    TreemapTile.h		\
 	    UnpkgSettings.cpp		\
 	    UnreadableDirsWindow.h	\
@@ -280,12 +426,15 @@ FORMS	  = main-window.ui		   \
 	    general-config-page.ui	   \
 	    locate-file-type-window.ui	   \
 	    locate-files-window.ui	   \
+	    memory-stats-window.ui	   \
 	    message-panel.ui		   \
 	    mime-category-config-page.ui   \
 	    open-dir-dialog.ui		   \
 	    open-pkg-dialog.ui		   \
 	    output-window.ui		   \
+	    owner-stats-window.ui	   \
 	    panel-message.ui		   \
+	    scan-stats-window.ui	   \
 	    show-unpkg-files-dialog.ui	   \
 	    unreadable-dirs-window.ui
 